@@ -0,0 +1,235 @@
+# Generate C++ layouts of the shaders' push constants and uniform blocks from their reflection
+# data, run as a script by `AddShaders`:
+#
+#     cmake -DREFLECTION_FILES=<a.json|b.json|...> -DOUTPUT=<header> -P ShaderLayouts.cmake
+#
+# Every block becomes a struct in `vk_shader_layouts::<module>`, where `<module>` is the shader's
+# file name with dots turned into underscores, with glm members at the offsets the shader reads
+# them from and explicit padding between them, so uploading one is a `memcpy`. Every member's
+# offset and the size are `static_assert`ed. Members glm has no type for with the right stride,
+# like buffer references or arrays of arrays, become opaque bytes or `uint64_t` addresses.
+#
+# `VK_SHADER_LAYOUT_CHECK(module, block, type)` checks that a hand written `type` has every
+# member of the block, at the same offset, so a shader change that moves one fails the build.
+
+# For `string(JSON)`.
+cmake_minimum_required(VERSION 3.19)
+
+# The C++ type of a GLSL base type, and its size, or an empty type when glm has none.
+function(ShaderLayoutBaseType GLSL_TYPE MATRIX_STRIDE OUT_TYPE OUT_SIZE)
+    set(TYPE "")
+    set(SIZE 0)
+    if(GLSL_TYPE MATCHES "^(float|int|uint|bool)$")
+        set(SIZE 4)
+        if(GLSL_TYPE STREQUAL "float")
+            set(TYPE "float")
+        elseif(GLSL_TYPE STREQUAL "int")
+            set(TYPE "int32_t")
+        else()
+            set(TYPE "uint32_t")
+        endif()
+    elseif(GLSL_TYPE MATCHES "^(u|i)?vec([234])$")
+        set(TYPE "glm::${GLSL_TYPE}")
+        math(EXPR SIZE "4 * ${CMAKE_MATCH_2}")
+    elseif(GLSL_TYPE MATCHES "^mat([234])$")
+        set(COLUMNS ${CMAKE_MATCH_1})
+        math(EXPR PACKED_STRIDE "4 * ${COLUMNS}")
+        if(MATRIX_STRIDE EQUAL 16 AND NOT COLUMNS EQUAL 4)
+            # std140 pads every column to a vec4, which glm's matrices do not.
+            set(TYPE "std::array<glm::vec4, ${COLUMNS}>")
+            math(EXPR SIZE "16 * ${COLUMNS}")
+        elseif(MATRIX_STRIDE EQUAL 0 OR MATRIX_STRIDE EQUAL PACKED_STRIDE)
+            set(TYPE "glm::${GLSL_TYPE}")
+            math(EXPR SIZE "4 * ${COLUMNS} * ${COLUMNS}")
+        endif()
+    elseif(GLSL_TYPE MATCHES "^(uint64_t|int64_t|double)$")
+        set(TYPE "${GLSL_TYPE}")
+        set(SIZE 8)
+    endif()
+
+    set(${OUT_TYPE} "${TYPE}" PARENT_SCOPE)
+    set(${OUT_SIZE} ${SIZE} PARENT_SCOPE)
+endfunction()
+
+# Appends the struct for the reflected type `TYPE_ID` of `JSON` to `OUT_CODE`, nested structs
+# first, and sets `OUT_SIZE` to its size and `OUT_NAME` to its name.
+function(ShaderLayoutStruct JSON TYPE_ID INDENT OUT_CODE OUT_NAME OUT_SIZE OUT_CHECKS)
+    string(JSON STRUCT_NAME GET "${JSON}" types ${TYPE_ID} name)
+    string(JSON MEMBER_COUNT LENGTH "${JSON}" types ${TYPE_ID} members)
+    set(NESTED "")
+    set(MEMBERS "")
+    set(ASSERTS "")
+    set(CHECKS "")
+    set(CURSOR 0)
+    set(PADDING_INDEX 0)
+    math(EXPR LAST "${MEMBER_COUNT} - 1")
+    foreach(I RANGE ${LAST})
+        string(JSON MEMBER GET "${JSON}" types ${TYPE_ID} members ${I})
+        string(JSON MEMBER_NAME GET "${MEMBER}" name)
+        string(JSON MEMBER_TYPE GET "${MEMBER}" type)
+        string(JSON OFFSET GET "${MEMBER}" offset)
+        string(JSON MATRIX_STRIDE ERROR_VARIABLE NO_MATRIX_STRIDE GET "${MEMBER}" matrix_stride)
+        if(NO_MATRIX_STRIDE)
+            set(MATRIX_STRIDE 0)
+        endif()
+        string(JSON ARRAY_STRIDE ERROR_VARIABLE NO_ARRAY_STRIDE GET "${MEMBER}" array_stride)
+        string(JSON ARRAY_RANK ERROR_VARIABLE NO_ARRAY LENGTH "${MEMBER}" array)
+        if(NO_ARRAY)
+            set(ARRAY_RANK 0)
+        endif()
+        string(JSON POINTER ERROR_VARIABLE NO_POINTER GET "${MEMBER}" physical_pointer)
+        if(NO_POINTER)
+            set(POINTER OFF)
+        endif()
+
+        # The size up to the next member, for the members the type of which is opaque.
+        if(I LESS LAST)
+            math(EXPR NEXT_INDEX "${I} + 1")
+            string(JSON NEXT_OFFSET GET "${JSON}" types ${TYPE_ID} members ${NEXT_INDEX} offset)
+            math(EXPR GAP "${NEXT_OFFSET} - ${OFFSET}")
+        else()
+            set(GAP 0)
+        endif()
+
+        set(ELEMENT_TYPE "")
+        set(ELEMENT_SIZE 0)
+        if(MEMBER_TYPE MATCHES "^_")
+            string(JSON TYPE_POINTER ERROR_VARIABLE NO_TYPE_POINTER GET "${JSON}" types ${MEMBER_TYPE} physical_pointer)
+            if(POINTER OR (NOT NO_TYPE_POINTER AND TYPE_POINTER))
+                set(ELEMENT_TYPE "uint64_t")
+                set(ELEMENT_SIZE 8)
+            else()
+                # A struct used twice in a module is only defined the first time.
+                get_property(EMITTED GLOBAL PROPERTY SHADER_LAYOUT_EMITTED)
+                ShaderLayoutStruct("${JSON}" ${MEMBER_TYPE} "${INDENT}" NESTED_CODE ELEMENT_TYPE ELEMENT_SIZE NESTED_CHECKS)
+                if(NOT MEMBER_TYPE IN_LIST EMITTED)
+                    string(APPEND NESTED "${NESTED_CODE}\n")
+                    set_property(GLOBAL APPEND PROPERTY SHADER_LAYOUT_EMITTED ${MEMBER_TYPE})
+                endif()
+            endif()
+        else()
+            ShaderLayoutBaseType(${MEMBER_TYPE} ${MATRIX_STRIDE} ELEMENT_TYPE ELEMENT_SIZE)
+        endif()
+
+        set(CPP_TYPE "${ELEMENT_TYPE}")
+        set(SIZE ${ELEMENT_SIZE})
+        if(ARRAY_RANK EQUAL 1 AND NOT ELEMENT_TYPE STREQUAL "")
+            string(JSON LENGTH GET "${MEMBER}" array 0)
+            if(NO_ARRAY_STRIDE)
+                set(ARRAY_STRIDE ${ELEMENT_SIZE})
+            endif()
+            if(LENGTH EQUAL 0)
+                # A runtime array, which only a buffer's last member can be.
+                set(CPP_TYPE "")
+            elseif(ARRAY_STRIDE EQUAL ELEMENT_SIZE)
+                set(CPP_TYPE "std::array<${ELEMENT_TYPE}, ${LENGTH}>")
+            else()
+                set(CPP_TYPE "std::array<Strided<${ELEMENT_TYPE}, ${ARRAY_STRIDE}>, ${LENGTH}>")
+            endif()
+            math(EXPR SIZE "${ARRAY_STRIDE} * ${LENGTH}")
+        elseif(ARRAY_RANK GREATER 1)
+            set(CPP_TYPE "")
+        endif()
+
+        if(CPP_TYPE STREQUAL "")
+            if(GAP EQUAL 0)
+                message(WARNING "ShaderLayouts: skipping `${STRUCT_NAME}`, its last member `${MEMBER_NAME}` has no fixed size")
+                set(${OUT_CODE} "" PARENT_SCOPE)
+                set(${OUT_NAME} "" PARENT_SCOPE)
+                set(${OUT_SIZE} 0 PARENT_SCOPE)
+                set(${OUT_CHECKS} "" PARENT_SCOPE)
+                return()
+            endif()
+            set(CPP_TYPE "std::array<std::byte, ${GAP}>")
+            set(SIZE ${GAP})
+        endif()
+
+        if(OFFSET GREATER CURSOR)
+            math(EXPR PADDING "${OFFSET} - ${CURSOR}")
+            string(APPEND MEMBERS "${INDENT}    std::array<std::byte, ${PADDING}> padding${PADDING_INDEX};\n")
+            math(EXPR PADDING_INDEX "${PADDING_INDEX} + 1")
+        endif()
+        string(APPEND MEMBERS "${INDENT}    ${CPP_TYPE} ${MEMBER_NAME};\n")
+        string(APPEND ASSERTS "${INDENT}static_assert(offsetof(${STRUCT_NAME}, ${MEMBER_NAME}) == ${OFFSET}, \"${STRUCT_NAME}::${MEMBER_NAME} must be at offset ${OFFSET}\");\n")
+        string(APPEND CHECKS "${MEMBER_NAME}=${OFFSET};")
+        math(EXPR CURSOR "${OFFSET} + ${SIZE}")
+    endforeach()
+
+    string(APPEND ASSERTS "${INDENT}static_assert(sizeof(${STRUCT_NAME}) == ${CURSOR}, \"${STRUCT_NAME} must be ${CURSOR} bytes\");\n")
+    set(${OUT_CODE} "${NESTED}${INDENT}struct ${STRUCT_NAME} {\n${MEMBERS}${INDENT}};\n\n${ASSERTS}" PARENT_SCOPE)
+    set(${OUT_NAME} "${STRUCT_NAME}" PARENT_SCOPE)
+    set(${OUT_SIZE} ${CURSOR} PARENT_SCOPE)
+    set(${OUT_CHECKS} "${CHECKS}" PARENT_SCOPE)
+endfunction()
+
+if(NOT DEFINED REFLECTION_FILES OR NOT DEFINED OUTPUT)
+    message(FATAL_ERROR "ShaderLayouts.cmake needs REFLECTION_FILES and OUTPUT")
+endif()
+
+string(REPLACE "|" ";" REFLECTION_FILES "${REFLECTION_FILES}")
+set(NAMESPACES "")
+set(CHECK_MACROS "")
+foreach(REFLECTION_FILE IN LISTS REFLECTION_FILES)
+    get_filename_component(SHADER_NAME "${REFLECTION_FILE}" NAME_WLE)
+    string(REPLACE "." "_" MODULE "${SHADER_NAME}")
+    file(READ "${REFLECTION_FILE}" JSON)
+    set_property(GLOBAL PROPERTY SHADER_LAYOUT_EMITTED "")
+
+    set(BLOCKS "")
+    foreach(KIND IN ITEMS push_constants ubos)
+        string(JSON BLOCK_COUNT ERROR_VARIABLE NO_BLOCKS LENGTH "${JSON}" ${KIND})
+        if(NO_BLOCKS OR BLOCK_COUNT EQUAL 0)
+            continue()
+        endif()
+
+        math(EXPR LAST_BLOCK "${BLOCK_COUNT} - 1")
+        foreach(B RANGE ${LAST_BLOCK})
+            string(JSON TYPE_ID GET "${JSON}" ${KIND} ${B} type)
+            ShaderLayoutStruct("${JSON}" ${TYPE_ID} "        " CODE STRUCT_NAME STRUCT_SIZE CHECKS)
+            if(CODE STREQUAL "")
+                continue()
+            endif()
+
+            if(NOT BLOCKS STREQUAL "")
+                string(APPEND BLOCKS "\n")
+            endif()
+            string(APPEND BLOCKS "${CODE}")
+            set(MACRO "#define VK_SHADER_LAYOUT_CHECK_${MODULE}_${STRUCT_NAME}(type)")
+            foreach(CHECK IN LISTS CHECKS)
+                if(CHECK MATCHES "^(.+)=(.+)$")
+                    string(APPEND MACRO " \\\n    static_assert(offsetof(type, ${CMAKE_MATCH_1}) == ${CMAKE_MATCH_2}, \"${STRUCT_NAME}::${CMAKE_MATCH_1} of ${SHADER_NAME} is at offset ${CMAKE_MATCH_2}\");")
+                endif()
+            endforeach()
+            string(APPEND CHECK_MACROS "${MACRO}\n\n")
+        endforeach()
+    endforeach()
+
+    if(NOT BLOCKS STREQUAL "")
+        string(APPEND NAMESPACES "\n    namespace ${MODULE} {\n${BLOCKS}    }\n")
+    endif()
+endforeach()
+
+set(HEADER "// Generated by cmake/ShaderLayouts.cmake from the shaders' reflection data, do not edit.
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#define VK_SHADER_LAYOUT_CHECK(module, block, type) VK_SHADER_LAYOUT_CHECK_##module##_##block(type)
+
+
+namespace vk_shader_layouts {
+    // An array element padded to the array's stride, like a float in a std140 array.
+    template <typename T, size_t STRIDE>
+    struct Strided {
+        T value;
+        std::array<std::byte, STRIDE - sizeof(T)> padding;
+    };
+${NAMESPACES}}
+
+${CHECK_MACROS}")
+
+file(WRITE "${OUTPUT}" "${HEADER}")
@@ -0,0 +1,67 @@
+# Compile GLSL shaders to SPIR-V at build time.
+#
+# Every source `<name>.<stage>` turns into `<name>.<stage>.spv` in `OUTPUT_DIRECTORY`, optimized
+# for performance, with include dependencies tracked through a depfile `<name>.<stage>.spv.d`
+# next to it, which the demo also reads to reload shaders when an include changes. When `spirv-cross` is
+# available, reflection data for each module is written next to it as `<name>.<stage>.json`,
+# and, given a `LAYOUT_HEADER`, the C++ layouts of every module's push constants and uniform
+# blocks are generated from it into that header by `ShaderLayouts.cmake`, in which case
+# `SHADER_LAYOUTS_FOUND` is set.
+set(SHADER_LAYOUTS_SCRIPT "${CMAKE_CURRENT_LIST_DIR}/ShaderLayouts.cmake")
+
+function(AddShaders TARGET)
+    cmake_parse_arguments(PARSE_ARGV 1 SHADERS "" "OUTPUT_DIRECTORY;LAYOUT_HEADER" "SOURCES")
+
+    if(NOT Vulkan_GLSLC_EXECUTABLE)
+        message(FATAL_ERROR "glslc is required to compile shaders, install the Vulkan SDK")
+    endif()
+
+    find_program(SPIRV_CROSS_EXECUTABLE spirv-cross HINTS "$ENV{VULKAN_SDK}/bin")
+
+    set(SHADER_OUTPUTS)
+    set(REFLECTION_OUTPUTS)
+    foreach(SHADER_SOURCE IN LISTS SHADERS_SOURCES)
+        get_filename_component(SHADER_NAME "${SHADER_SOURCE}" NAME)
+        set(SHADER_INPUT "${CMAKE_CURRENT_SOURCE_DIR}/${SHADER_SOURCE}")
+        set(SHADER_OUTPUT "${SHADERS_OUTPUT_DIRECTORY}/${SHADER_NAME}.spv")
+        set(SHADER_DEPFILE "${SHADER_OUTPUT}.d")
+
+        set(REFLECT_COMMAND)
+        set(REFLECT_OUTPUT)
+        if(SPIRV_CROSS_EXECUTABLE)
+            set(REFLECT_OUTPUT "${SHADERS_OUTPUT_DIRECTORY}/${SHADER_NAME}.json")
+            set(REFLECT_COMMAND COMMAND "${SPIRV_CROSS_EXECUTABLE}" "${SHADER_OUTPUT}" --reflect --output "${REFLECT_OUTPUT}")
+        endif()
+
+        add_custom_command(
+            OUTPUT "${SHADER_OUTPUT}" ${REFLECT_OUTPUT}
+            COMMAND ${CMAKE_COMMAND} -E make_directory "${SHADERS_OUTPUT_DIRECTORY}"
+            COMMAND "${Vulkan_GLSLC_EXECUTABLE}" --target-env=vulkan1.3 -O -MD -MF "${SHADER_DEPFILE}" -o "${SHADER_OUTPUT}" "${SHADER_INPUT}"
+            ${REFLECT_COMMAND}
+            DEPENDS "${SHADER_INPUT}"
+            DEPFILE "${SHADER_DEPFILE}"
+            COMMENT "Compiling shader ${SHADER_SOURCE}"
+            VERBATIM
+        )
+
+        list(APPEND SHADER_OUTPUTS "${SHADER_OUTPUT}" ${REFLECT_OUTPUT})
+        list(APPEND REFLECTION_OUTPUTS ${REFLECT_OUTPUT})
+    endforeach()
+
+    set(SHADER_LAYOUTS_FOUND OFF PARENT_SCOPE)
+    if(SHADERS_LAYOUT_HEADER AND REFLECTION_OUTPUTS)
+        # The list goes through the command line with `|` for `;`, which it would split on.
+        string(REPLACE ";" "|" REFLECTION_ARGUMENT "${REFLECTION_OUTPUTS}")
+        add_custom_command(
+            OUTPUT "${SHADERS_LAYOUT_HEADER}"
+            COMMAND "${CMAKE_COMMAND}" "-DREFLECTION_FILES=${REFLECTION_ARGUMENT}" "-DOUTPUT=${SHADERS_LAYOUT_HEADER}" -P "${SHADER_LAYOUTS_SCRIPT}"
+            DEPENDS ${REFLECTION_OUTPUTS} "${SHADER_LAYOUTS_SCRIPT}"
+            COMMENT "Generating shader layouts"
+            VERBATIM
+        )
+        list(APPEND SHADER_OUTPUTS "${SHADERS_LAYOUT_HEADER}")
+        set(SHADER_LAYOUTS_FOUND ON PARENT_SCOPE)
+    endif()
+
+    add_custom_target(${TARGET} ALL DEPENDS ${SHADER_OUTPUTS})
+endfunction()
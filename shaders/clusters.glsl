@@ -0,0 +1,51 @@
+// The clustered lights: the scene's point lights, and the grid of view space clusters they
+// are binned into, for shaders that include `scene.glsl` first. Matches `vk_lights`.
+
+// The clusters tile the render area in x and y, and slice the view depth exponentially, so
+// that near and far clusters are about as deep as they are wide.
+const uint CLUSTER_GRID_X = 16u;
+const uint CLUSTER_GRID_Y = 9u;
+const uint CLUSTER_GRID_Z = 24u;
+const uint CLUSTER_COUNT = CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z;
+// More lights than this reaching a cluster are left out of it.
+const uint MAX_LIGHTS_PER_CLUSTER = 128u;
+
+// Matches `vk_lights::Light`.
+struct Light {
+    // The world space position, and the radius the light falls off to nothing at.
+    vec4 positionRadius;
+    vec4 color;
+};
+
+layout(std430, set = 0, binding = 6) readonly buffer Lights {
+    Light lights[];
+};
+
+// Every cluster's light count, then every cluster's list of up to `MAX_LIGHTS_PER_CLUSTER`
+// light indices.
+#ifdef CLUSTERS_WRITER
+layout(std430, set = 0, binding = 7) writeonly buffer Clusters {
+#else
+layout(std430, set = 0, binding = 7) readonly buffer Clusters {
+#endif
+    uint clusterLightCounts[CLUSTER_COUNT];
+    uint clusterLightIndices[];
+};
+
+uint clusterIndex(uvec3 cluster) {
+    return (cluster.z * CLUSTER_GRID_Y + cluster.y) * CLUSTER_GRID_X + cluster.x;
+}
+
+// The view depth slice `slice` starts at, the inverse of the slicing in `fragmentCluster`.
+float clusterSliceDepth(uint slice) {
+    return exp((float(slice) - scene.clusters.w) / scene.clusters.z);
+}
+
+// The cluster of a fragment at `viewDepth` in front of the camera.
+uvec3 fragmentCluster(vec2 fragCoord, float viewDepth) {
+    const vec2 tile = fragCoord * scene.clusters.xy;
+    const float slice = log(max(viewDepth, 1e-4)) * scene.clusters.z + scene.clusters.w;
+    const ivec3 cluster = ivec3(ivec2(tile), int(slice));
+
+    return uvec3(clamp(cluster, ivec3(0), ivec3(CLUSTER_GRID_X, CLUSTER_GRID_Y, CLUSTER_GRID_Z) - 1));
+}
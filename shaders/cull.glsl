@@ -0,0 +1,157 @@
+// The body of `cull.comp` and `cull_subgroup.comp`, which defines `SUBGROUP_COMPACTION`.
+
+// Sized per device by `vk_compute::ComputeTuning::linear`.
+layout(local_size_x_id = 0) in;
+
+struct DrawCommand {
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint firstInstance;
+};
+
+// A sequence of device generated commands, see `GENERATED_COMMANDS`: the pipeline of the
+// scene's execution set to bind, the instance to push as a constant, and the draw.
+struct GeneratedDraw {
+    uint pipelineIndex;
+    uint instanceIndex;
+    DrawCommand draw;
+};
+
+#include "scene.glsl"
+
+layout(std430, set = 0, binding = 2) writeonly buffer DrawCommands {
+    DrawCommand drawCommands[];
+};
+
+layout(std430, set = 0, binding = 2) writeonly buffer GeneratedDraws {
+    GeneratedDraw generatedDraws[];
+};
+
+layout(std430, set = 0, binding = 3) buffer DrawCount {
+    uint drawCount;
+    uint taskGroupCount[3];
+};
+
+layout(std430, set = 0, binding = 5) writeonly buffer VisibleInstances {
+    uint visibleInstances[];
+};
+
+// Whether each instance was visible at the end of the last frame, for the two phases of
+// culling around a depth pre-pass.
+layout(std430, set = 0, binding = 8) buffer Visibility {
+    uint visibility[];
+};
+
+#include "occlusion.glsl"
+
+// The path the renderer takes, so that the other one folds away.
+layout(constant_id = 1) const bool MESH_SHADING = false;
+
+// `local_size_x` in `scene.task`.
+layout(constant_id = 2) const uint MESHLET_TASKS_PER_WORKGROUP = 32u;
+
+// Matches `vk_gpu_driven::CullPhase`. A single phase culls against the pyramid the previous
+// frame left behind. With a depth pre-pass, the early phase keeps what was visible last frame
+// for the pre-pass to draw, without testing it for occlusion, and the late phase culls every
+// instance against the pyramid built from the pre-pass and records which are visible.
+const uint CULL_PHASE_SINGLE = 0u;
+const uint CULL_PHASE_EARLY = 1u;
+const uint CULL_PHASE_LATE = 2u;
+layout(constant_id = 3) const uint CULL_PHASE = CULL_PHASE_SINGLE;
+
+// With device generated commands, the draws become sequences that also pick their pipeline and
+// push their instance to the vertex shader, so one execution draws instances of any pipeline
+// in the execution set. The scene has the one pipeline, at index 0, which every instance picks.
+layout(constant_id = 4) const bool GENERATED_COMMANDS = false;
+const uint SCENE_PIPELINE_INDEX = 0u;
+
+// The task workgroups covering every meshlet of the first `listedCount` listed instances, as
+// every task invocation culls one meshlet of one listed instance.
+uint taskGroupsFor(uint listedCount) {
+    return (listedCount * scene.mesh.w + MESHLET_TASKS_PER_WORKGROUP - 1u) / MESHLET_TASKS_PER_WORKGROUP;
+}
+
+// The coarsest level of detail whose error, scaled with the instance, stays within its pixels
+// at the view depth of the nearest point of the instance's bounding sphere.
+uint meshLod(vec3 center, float radius, float scale) {
+    const float depth = -(scene.view * vec4(center, 1.0)).z - radius;
+    for (uint lod = uint(scene.lodSelection.y) - 1u; lod > 0u; lod--) {
+        if (uintBitsToFloat(scene.lods[lod].z) * scale * scene.lodSelection.x <= depth) {
+            return lod;
+        }
+    }
+
+    return 0u;
+}
+
+void main() {
+    const uint index = gl_GlobalInvocationID.x;
+    if (index == 0u) {
+        taskGroupCount[1] = 1u;
+        taskGroupCount[2] = 1u;
+    }
+
+    if (index >= scene.cull.x) {
+        return;
+    }
+
+    const Instance instance = instances[index];
+    const vec3 center = instancePosition(instance);
+    const float radius = MESH_RADIUS * instanceScale(instance);
+    const bool inFrustum = !isOutsideFrustum(center, radius);
+    const bool visible = CULL_PHASE == CULL_PHASE_EARLY
+        ? inFrustum && visibility[index] != 0u
+        : inFrustum && !isOccluded(center, radius);
+    if (CULL_PHASE == CULL_PHASE_LATE) {
+        visibility[index] = visible ? 1u : 0u;
+    }
+
+#ifdef SUBGROUP_COMPACTION
+    // The survivors of a subgroup take consecutive slots, at their prefix count in a ballot,
+    // with one atomic between them.
+    const uvec4 survivors = subgroupBallot(visible);
+    const uint survivorCount = subgroupBallotBitCount(survivors);
+    if (survivorCount == 0u) {
+        return;
+    }
+
+    uint firstIndex = 0u;
+    if (subgroupElect()) {
+        firstIndex = atomicAdd(drawCount, survivorCount);
+        if (MESH_SHADING) {
+            atomicMax(taskGroupCount[0], taskGroupsFor(firstIndex + survivorCount));
+        }
+    }
+
+    // Broadcast before the culled invocations leave, as the elected one may be among them.
+    firstIndex = subgroupBroadcastFirst(firstIndex);
+    if (!visible) {
+        return;
+    }
+
+    const uint drawIndex = firstIndex + subgroupBallotExclusiveBitCount(survivors);
+#else
+    if (!visible) {
+        return;
+    }
+
+    const uint drawIndex = atomicAdd(drawCount, 1u);
+    if (MESH_SHADING) {
+        atomicMax(taskGroupCount[0], taskGroupsFor(drawIndex + 1u));
+    }
+#endif
+
+    if (!MESH_SHADING) {
+        const uvec4 lod = scene.lods[meshLod(center, radius, instanceScale(instance))];
+        if (GENERATED_COMMANDS) {
+            generatedDraws[drawIndex] = GeneratedDraw(SCENE_PIPELINE_INDEX, index, DrawCommand(lod.x, 1u, lod.y, int(scene.mesh.z), 0u));
+        } else {
+            drawCommands[drawIndex] = DrawCommand(lod.x, 1u, lod.y, int(scene.mesh.z), index);
+        }
+        return;
+    }
+
+    visibleInstances[drawIndex] = index;
+}
@@ -0,0 +1,262 @@
+// The body of `downsample.comp` and `downsample_subgroup.comp`, which defines `SUBGROUP_QUADS`.
+//
+// Builds every level of a single channel image in one dispatch. Each workgroup reduces a tile
+// of `TILE_SIZE` texels a side of level 0, read from the source, down to a single texel of
+// level 6, all in registers and shared memory. The last workgroup to finish, found with an
+// atomic counter in the scratch buffer, reduces those texels through the remaining levels the
+// same way. Level 0 covers the source at any ratio, and every level after it halves the one
+// before it, so level 0 has to be a power of two a side.
+
+// 256 invocations, each of which starts from a 4x4 block of texels.
+layout(local_size_x = 256) in;
+
+// Matches `vk_downsample::Reduction`.
+const uint REDUCTION_MAX = 0u;
+const uint REDUCTION_AVERAGE = 1u;
+const uint REDUCTION_MIN = 2u;
+
+layout(constant_id = 0) const uint REDUCTION = REDUCTION_MAX;
+
+// Matches `vk_downsample::MAX_LEVELS` and `vk_downsample::TILE_SIZE`.
+const uint MAX_LEVELS = 13u;
+const uint TILE_SIZE = 64u;
+
+// The levels a tile is reduced through below the level it starts from.
+const uint TILE_LEVELS = 6u;
+
+layout(set = 0, binding = 0) uniform sampler2D source;
+layout(set = 0, binding = 1, r32f) writeonly uniform image2D levels[MAX_LEVELS];
+
+// Matches `vk_downsample::Scratch`: how many workgroups have finished, reset by the last, and
+// each workgroup's texel of level 6.
+layout(std430, set = 0, binding = 2) coherent buffer Scratch {
+    uint finishedWorkgroups;
+    uint padding[3];
+    float tileTexels[];
+} scratch;
+
+layout(push_constant) uniform PushConstants {
+    uvec2 sourceSize;
+    uvec2 levelSize;
+    uint levelCount;
+} pushConstants;
+
+shared float values[256];
+shared bool lastWorkgroup;
+
+float reduce4(float a, float b, float c, float d) {
+    if (REDUCTION == REDUCTION_MAX) {
+        return max(max(a, b), max(c, d));
+    } else if (REDUCTION == REDUCTION_MIN) {
+        return min(min(a, b), min(c, d));
+    }
+
+    return 0.25 * (a + b + c + d);
+}
+
+uvec2 levelSize(uint level) {
+    return max(pushConstants.levelSize >> level, uvec2(1u));
+}
+
+// Which children of a texel of the level above `level` there are. Every level halves the one
+// before it, so a texel only ever lacks its second child along a side of a single texel, where
+// the first one stands in for it.
+uvec2 childStep(uint level) {
+    return min(levelSize(level) - 1u, uvec2(1u));
+}
+
+// The position of invocation `index` in a 16x16 square, in Morton order, so that every four
+// invocations in a row cover a 2x2 block, every sixteen a 4x4 block, and so on.
+uvec2 mortonPosition(uint index) {
+    return uvec2(
+        (index & 1u) | ((index >> 1u) & 2u) | ((index >> 2u) & 4u) | ((index >> 3u) & 8u),
+        ((index >> 1u) & 1u) | ((index >> 2u) & 2u) | ((index >> 3u) & 4u) | ((index >> 4u) & 8u)
+    );
+}
+
+// Storage images may only be indexed with constants without
+// `shaderStorageImageArrayDynamicIndexing`.
+void storeLevel(uint level, uvec2 texel, float value) {
+    if (level >= pushConstants.levelCount || any(greaterThanEqual(texel, levelSize(level)))) {
+        return;
+    }
+
+    const ivec2 coordinates = ivec2(texel);
+    const vec4 data = vec4(value);
+    switch (level) {
+        case 0u: imageStore(levels[0], coordinates, data); break;
+        case 1u: imageStore(levels[1], coordinates, data); break;
+        case 2u: imageStore(levels[2], coordinates, data); break;
+        case 3u: imageStore(levels[3], coordinates, data); break;
+        case 4u: imageStore(levels[4], coordinates, data); break;
+        case 5u: imageStore(levels[5], coordinates, data); break;
+        case 6u: imageStore(levels[6], coordinates, data); break;
+        case 7u: imageStore(levels[7], coordinates, data); break;
+        case 8u: imageStore(levels[8], coordinates, data); break;
+        case 9u: imageStore(levels[9], coordinates, data); break;
+        case 10u: imageStore(levels[10], coordinates, data); break;
+        case 11u: imageStore(levels[11], coordinates, data); break;
+        case 12u: imageStore(levels[12], coordinates, data); break;
+    }
+}
+
+// A texel of level 0, reduced from the texels of the source it covers, a footprint of up to
+// three texels a side when the source is not twice its size.
+float loadSource(uvec2 texel) {
+    const vec2 scale = vec2(pushConstants.sourceSize) / vec2(pushConstants.levelSize);
+    const uvec2 begin = uvec2(vec2(texel) * scale);
+    const uvec2 end = max(min(uvec2(ceil(vec2(texel + 1u) * scale)), pushConstants.sourceSize), begin + 1u);
+
+    // Negative infinity for the maximum, and positive for the minimum.
+    float value = REDUCTION == REDUCTION_MAX ? uintBitsToFloat(0xff800000u) : (REDUCTION == REDUCTION_MIN ? uintBitsToFloat(0x7f800000u) : 0.0);
+    for (uint y = begin.y; y < end.y; y++) {
+        for (uint x = begin.x; x < end.x; x++) {
+            const float texelValue = texelFetch(source, ivec2(min(uvec2(x, y), pushConstants.sourceSize - 1u)), 0).x;
+            if (REDUCTION == REDUCTION_MAX) {
+                value = max(value, texelValue);
+            } else if (REDUCTION == REDUCTION_MIN) {
+                value = min(value, texelValue);
+            } else {
+                value += texelValue;
+            }
+        }
+    }
+
+    if (REDUCTION == REDUCTION_AVERAGE) {
+        value /= float((end.x - begin.x) * (end.y - begin.y));
+    }
+
+    return value;
+}
+
+// A texel of `base`, clamped to the level: level 0 from the source, level 6 from what the
+// workgroups left in the scratch buffer.
+float loadBase(uint base, uvec2 texel) {
+    const uvec2 clamped = min(texel, levelSize(base) - 1u);
+    if (base == 0u) {
+        return loadSource(clamped);
+    }
+
+    return scratch.tileTexels[clamped.y * levelSize(base).x + clamped.x];
+}
+
+// Reduces the texels of the group of `4 * stride` invocations starting at `first`, each of
+// which left its texel in `values` at its index, along `step`.
+float reduceShared(uint first, uint stride, uvec2 step) {
+    return reduce4(
+        values[first],
+        values[first + stride * step.x],
+        values[first + 2u * stride * step.y],
+        values[first + stride * (step.x + 2u * step.y)]
+    );
+}
+
+// Reduces the tile at `tile` of level `base` through the `TILE_LEVELS` levels below it,
+// storing each, and `base` as well when it is level 0, and returns the tile's texel of the
+// last. `index` is the invocation's place in Morton order.
+float downsampleTile(uint base, uvec2 tile, uint index) {
+    const uvec2 position = mortonPosition(index);
+
+    // A 4x4 block of `base`, and the 2x2 block of the level below it.
+    float block[4][4];
+    const uvec2 blockOrigin = tile * TILE_SIZE + position * 4u;
+    for (uint y = 0u; y < 4u; y++) {
+        for (uint x = 0u; x < 4u; x++) {
+            block[y][x] = loadBase(base, blockOrigin + uvec2(x, y));
+            if (base == 0u) {
+                storeLevel(0u, blockOrigin + uvec2(x, y), block[y][x]);
+            }
+        }
+    }
+
+    float quad[2][2];
+    const uvec2 firstStep = childStep(base);
+    for (uint y = 0u; y < 2u; y++) {
+        for (uint x = 0u; x < 2u; x++) {
+            const uint left = 2u * x;
+            const uint top = 2u * y;
+            quad[y][x] = reduce4(
+                block[top][left],
+                block[top][left + firstStep.x],
+                block[top + firstStep.y][left],
+                block[top + firstStep.y][left + firstStep.x]
+            );
+            storeLevel(base + 1u, tile * (TILE_SIZE / 2u) + position * 2u + uvec2(x, y), quad[y][x]);
+        }
+    }
+
+    const uvec2 secondStep = childStep(base + 1u);
+    const float texel = reduce4(quad[0][0], quad[0][secondStep.x], quad[secondStep.y][0], quad[secondStep.y][secondStep.x]);
+    storeLevel(base + 2u, tile * (TILE_SIZE / 4u) + position, texel);
+
+    // Every four invocations hold a 2x2 block of the third level, which reduces to a texel of
+    // the fourth, within a quad of the subgroup or through shared memory.
+    const uvec2 thirdStep = childStep(base + 2u);
+#ifdef SUBGROUP_QUADS
+    const float right = subgroupQuadSwapHorizontal(texel);
+    const float below = subgroupQuadSwapVertical(texel);
+    const float diagonal = subgroupQuadSwapDiagonal(texel);
+    if (index % 4u == 0u) {
+        const float stepRight = thirdStep.x != 0u ? right : texel;
+        const float stepBelow = thirdStep.y != 0u ? below : texel;
+        const float stepDiagonal = thirdStep.x != 0u && thirdStep.y != 0u ? diagonal : (thirdStep.x != 0u ? right : stepBelow);
+        values[index] = reduce4(texel, stepRight, stepBelow, stepDiagonal);
+        storeLevel(base + 3u, tile * (TILE_SIZE / 8u) + mortonPosition(index >> 2u), values[index]);
+    }
+#else
+    values[index] = texel;
+    barrier();
+    if (index % 4u == 0u) {
+        values[index] = reduceShared(index, 1u, thirdStep);
+        storeLevel(base + 3u, tile * (TILE_SIZE / 8u) + mortonPosition(index >> 2u), values[index]);
+    }
+#endif
+    barrier();
+
+    // The rest go through shared memory, each level on a quarter of the invocations before.
+    for (uint level = 4u; level <= TILE_LEVELS; level++) {
+        const uint stride = 1u << (2u * (level - 3u));
+        if (index % (4u * stride) == 0u) {
+            values[index] = reduceShared(index, stride, childStep(base + level - 1u));
+            storeLevel(base + level, tile * (TILE_SIZE >> level) + mortonPosition(index >> (2u * (level - 2u))), values[index]);
+        }
+        barrier();
+    }
+
+    return values[0];
+}
+
+void main() {
+#ifdef SUBGROUP_QUADS
+    // Pipelines of the subgroup variant run in full subgroups, whose quads are then 2x2 blocks.
+    const uint index = gl_SubgroupID * gl_SubgroupSize + gl_SubgroupInvocationID;
+#else
+    const uint index = gl_LocalInvocationIndex;
+#endif
+
+    const uvec2 tile = gl_WorkGroupID.xy;
+    const float tileTexel = downsampleTile(0u, tile, index);
+    if (pushConstants.levelCount <= TILE_LEVELS + 1u) {
+        return;
+    }
+
+    // The tile's texel is published before the workgroup counts itself finished, so the last
+    // one sees every other tile's.
+    if (index == 0u) {
+        scratch.tileTexels[tile.y * levelSize(TILE_LEVELS).x + tile.x] = tileTexel;
+        memoryBarrierBuffer();
+        const uint workgroupCount = gl_NumWorkGroups.x * gl_NumWorkGroups.y;
+        lastWorkgroup = atomicAdd(scratch.finishedWorkgroups, 1u) == workgroupCount - 1u;
+    }
+    barrier();
+    if (!lastWorkgroup) {
+        return;
+    }
+
+    // Level 6 is at most `TILE_SIZE` texels a side, a single tile.
+    if (index == 0u) {
+        scratch.finishedWorkgroups = 0u;
+    }
+    memoryBarrierBuffer();
+    downsampleTile(TILE_LEVELS, uvec2(0u), index);
+}
@@ -0,0 +1,60 @@
+// Occlusion culling against the depth pyramid, which the previous frame left behind or, with a
+// depth pre-pass, the pre-pass built, for shaders that include `scene.glsl` first.
+layout(set = 0, binding = 4) uniform sampler2D depthPyramid;
+
+// The uv bounds of a sphere entirely in front of the near plane, in a view space looking down
+// positive z, after "2D Polyhedral Bounds of a Clipped, Perspective-Projected 3D Sphere" by
+// Mara and McGuire.
+bool projectSphere(vec3 center, float radius, float znear, float P00, float P11, out vec4 aabb) {
+    if (center.z < radius + znear) {
+        return false;
+    }
+
+    const vec2 cx = -center.xz;
+    const vec2 vx = vec2(sqrt(dot(cx, cx) - radius * radius), radius);
+    const vec2 minX = mat2(vx.x, vx.y, -vx.y, vx.x) * cx;
+    const vec2 maxX = mat2(vx.x, -vx.y, vx.y, vx.x) * cx;
+
+    const vec2 cy = -center.yz;
+    const vec2 vy = vec2(sqrt(dot(cy, cy) - radius * radius), radius);
+    const vec2 minY = mat2(vy.x, vy.y, -vy.y, vy.x) * cy;
+    const vec2 maxY = mat2(vy.x, -vy.y, vy.y, vy.x) * cy;
+
+    aabb = vec4(minX.x / minX.y * P00, minY.x / minY.y * P11, maxX.x / maxX.y * P00, maxY.x / maxY.y * P11);
+    // Clip space points up, uv space down.
+    aabb = aabb.xwzy * vec4(0.5, -0.5, 0.5, -0.5) + vec4(0.5);
+
+    return true;
+}
+
+// Whether the sphere lies behind everything the pyramid holds over its bounds. The level
+// is picked so the bounds span at most two texels a side, and the four texels they touch are
+// compared with the sphere's nearest point. Depth is reversed, so the farthest is the smallest
+// and the near plane is at depth 1. Spheres crossing the near plane are never culled.
+bool isOccluded(vec3 center, float radius) {
+    if (scene.cull.y == 0) {
+        return false;
+    }
+
+    const vec3 viewCenter = (scene.view * vec4(center, 1.0)).xyz * vec3(1.0, 1.0, -1.0);
+    const float znear = scene.projection.w;
+    vec4 aabb;
+    if (!projectSphere(viewCenter, radius, znear, scene.projection.x, abs(scene.projection.y), aabb)) {
+        return false;
+    }
+
+    const vec2 size = (aabb.zw - aabb.xy) * vec2(scene.cull.zw);
+    const int level = min(int(ceil(log2(max(max(size.x, size.y), 1.0)))), textureQueryLevels(depthPyramid) - 1);
+    const ivec2 levelSize = textureSize(depthPyramid, level);
+    const ivec2 low = clamp(ivec2(aabb.xy * vec2(levelSize)), ivec2(0), levelSize - 1);
+    const ivec2 high = clamp(ivec2(aabb.zw * vec2(levelSize)), ivec2(0), levelSize - 1);
+    const float depth = min(
+        min(texelFetch(depthPyramid, low, level).x, texelFetch(depthPyramid, ivec2(high.x, low.y), level).x),
+        min(texelFetch(depthPyramid, ivec2(low.x, high.y), level).x, texelFetch(depthPyramid, high, level).x)
+    );
+
+    const float nearestDistance = viewCenter.z - radius;
+    const float sphereDepth = scene.projection.w / nearestDistance - scene.projection.z;
+
+    return sphereDepth < depth;
+}
@@ -0,0 +1,37 @@
+#version 450
+
+// Blends the overlay's glyphs and solid quads over the frame. The glyphs are printable ASCII
+// from the space to the underscore, with each row of three columns in three bits, the top row
+// in the lowest, and the left column in the lowest bit of its row.
+
+layout(location = 0) in vec2 inCell;
+layout(location = 1) flat in uint inGlyph;
+layout(location = 2) in vec4 inColor;
+
+layout(location = 0) out vec4 outColor;
+
+// Matches `vk_overlay::GLYPH_COUNT`, `vk_overlay::SOLID` and `vk_overlay::GLYPH_BITMAPS`.
+const uint GLYPH_COUNT = 64;
+const uint SOLID = 0xffffffffu;
+
+const uint GLYPHS[GLYPH_COUNT] = uint[](
+    0x0000u, 0x2092u, 0x002du, 0x5f7du, 0x3c9eu, 0x42a1u, 0x6aaau, 0x0012u,
+    0x4494u, 0x1491u, 0x0aa8u, 0x05d0u, 0x1400u, 0x01c0u, 0x2000u, 0x12a4u,
+    0x7b6fu, 0x749au, 0x73e7u, 0x79a7u, 0x49edu, 0x79cfu, 0x7bcfu, 0x2527u,
+    0x7befu, 0x79efu, 0x0410u, 0x1410u, 0x4454u, 0x0e38u, 0x1511u, 0x20a7u,
+    0x636fu, 0x5beau, 0x3aebu, 0x624eu, 0x3b6bu, 0x72cfu, 0x12cfu, 0x6b4eu,
+    0x5bedu, 0x7497u, 0x2b24u, 0x5aedu, 0x7249u, 0x5bfdu, 0x5b6bu, 0x2b6au,
+    0x12ebu, 0x676au, 0x5aebu, 0x388eu, 0x2497u, 0x7b6du, 0x2b6du, 0x5fedu,
+    0x5aadu, 0x24adu, 0x72a7u, 0x324bu, 0x4889u, 0x6926u, 0x002au, 0x7000u
+);
+
+void main() {
+    if (inGlyph != SOLID) {
+        const uvec2 cell = uvec2(min(inCell, vec2(2.0, 4.0)));
+        if (inGlyph >= GLYPH_COUNT || (GLYPHS[inGlyph] & (1u << (cell.y * 3u + cell.x))) == 0u) {
+            discard;
+        }
+    }
+
+    outColor = inColor;
+}
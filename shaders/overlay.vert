@@ -0,0 +1,40 @@
+#version 450
+
+// Expands each quad of the overlay, an instance each, into two triangles in pixel space, with
+// the glyph's cell coordinates across it.
+
+layout(push_constant) uniform PushConstants {
+    // The size of the target in pixels.
+    vec2 extent;
+} pushConstants;
+
+// The quad's top left corner and size in pixels, its glyph and its color.
+layout(location = 0) in vec4 inRect;
+layout(location = 1) in uint inGlyph;
+layout(location = 2) in vec4 inColor;
+
+layout(location = 0) out vec2 outCell;
+layout(location = 1) flat out uint outGlyph;
+layout(location = 2) out vec4 outColor;
+
+const vec2 CORNERS[6] = vec2[](
+    vec2(0.0, 0.0),
+    vec2(1.0, 0.0),
+    vec2(1.0, 1.0),
+    vec2(0.0, 0.0),
+    vec2(1.0, 1.0),
+    vec2(0.0, 1.0)
+);
+
+// Every glyph is three columns wide and five rows tall.
+const vec2 GLYPH_SIZE = vec2(3.0, 5.0);
+
+void main() {
+    const vec2 corner = CORNERS[gl_VertexIndex];
+    const vec2 position = inRect.xy + corner * inRect.zw;
+
+    gl_Position = vec4(position / pushConstants.extent * 2.0 - 1.0, 0.0, 1.0);
+    outCell = corner * GLYPH_SIZE;
+    outGlyph = inGlyph;
+    outColor = inColor;
+}
@@ -0,0 +1,13 @@
+#version 450
+
+// A soft round spot, added onto whatever is behind it, so particles need no sorting.
+
+layout(location = 0) in vec2 inCorner;
+layout(location = 1) in vec4 inColor;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    const float falloff = max(1.0 - dot(inCorner, inCorner), 0.0);
+    outColor = vec4(inColor.rgb * (inColor.a * falloff * falloff), 0.0);
+}
@@ -0,0 +1,39 @@
+#version 450
+#extension GL_EXT_buffer_reference : require
+
+// Expands each live particle, an instance each, into a quad facing the camera, which cools and
+// fades over the particle's life.
+
+#include "particles.glsl"
+
+layout(push_constant) uniform PushConstants {
+    mat4 viewProjection;
+    // The camera's right and up in world space, with the quads' half size in `w`.
+    vec4 cameraRight;
+    vec4 cameraUp;
+    Particles particles;
+} pushConstants;
+
+layout(location = 0) out vec2 outCorner;
+layout(location = 1) out vec4 outColor;
+
+const vec2 CORNERS[6] = vec2[](
+    vec2(-1.0, -1.0),
+    vec2(1.0, -1.0),
+    vec2(1.0, 1.0),
+    vec2(-1.0, -1.0),
+    vec2(1.0, 1.0),
+    vec2(-1.0, 1.0)
+);
+
+void main() {
+    const Particle particle = pushConstants.particles.particles[gl_InstanceIndex];
+    const vec2 corner = CORNERS[gl_VertexIndex];
+    const vec3 offset = pushConstants.cameraRight.xyz * corner.x + pushConstants.cameraUp.xyz * corner.y;
+    const vec3 position = particle.positionAge.xyz + offset * pushConstants.cameraRight.w;
+    const float life = clamp(particle.positionAge.w / particle.velocityLifetime.w, 0.0, 1.0);
+
+    gl_Position = pushConstants.viewProjection * vec4(position, 1.0);
+    outCorner = corner;
+    outColor = vec4(mix(vec3(1.0, 0.8, 0.35), vec3(0.8, 0.2, 0.05), life), 1.0 - life);
+}
@@ -0,0 +1,27 @@
+// The particles of `vk_particles::ParticleSystem`, for shaders that enable
+// `GL_EXT_buffer_reference`.
+
+// Matches `vk_particles::Particle`. Positions and velocities are in world space, ages and
+// lifetimes in seconds.
+struct Particle {
+    vec4 positionAge;
+    vec4 velocityLifetime;
+};
+
+layout(std430, buffer_reference, buffer_reference_align = 16) buffer Particles {
+    Particle particles[];
+};
+
+// Matches `vk_particles::ParticleState`, the draw of the live particles, an instance each, and
+// how many of them the last compaction kept.
+layout(std430, buffer_reference, buffer_reference_align = 4) buffer ParticleState {
+    uint vertexCount;
+    uint instanceCount;
+    uint firstVertex;
+    uint firstInstance;
+    uint survivorCount;
+};
+
+layout(std430, buffer_reference, buffer_reference_align = 4) buffer ParticleFlags {
+    uint flags[];
+};
@@ -0,0 +1,12 @@
+#version 450
+
+// Post processes the scene into a swapchain image bound as a color attachment, for swapchains
+// that cannot be storage images, see `post.glsl`.
+
+#include "post.glsl"
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    outColor = postProcess(uvec2(gl_FragCoord.xy));
+}
@@ -0,0 +1,90 @@
+// The body of `post.comp` and `post.frag`: everything between the scene's HDR color and the
+// swapchain in one read and one write per pixel. Exposure and the vignette scale the scene's
+// color, the filmic curve maps it into the display's range, the grading LUT takes the curve's
+// sRGB encoded result to the graded one, and dithering spreads the quantization of the output
+// format into noise instead of bands.
+
+layout(set = 0, binding = 0) uniform sampler2D source;
+
+// Matches `vk_post::LUT_SIZE`. Texels of the grading LUT packed as RGBA8, red fastest, then
+// green, then blue.
+const uint LUT_SIZE = 16u;
+
+layout(std430, set = 0, binding = 1) readonly buffer GradingLut {
+    uint texels[];
+} gradingLut;
+
+// Matches `vk_post::PushConstants`.
+layout(push_constant) uniform PushConstants {
+    // The part of the source the output covers, as a fraction of the source's size.
+    vec2 sourceScale;
+    uvec2 outputSize;
+    float exposure;
+    float vignette;
+    // One step of the output format, in encoded values.
+    float ditherAmplitude;
+    // Whether the output is written sRGB encoded, or linear for the format to encode.
+    uint encodeSrgb;
+    uint frame;
+} pushConstants;
+
+vec3 linearToSrgb(vec3 linear) {
+    const vec3 low = linear * 12.92;
+    const vec3 high = 1.055 * pow(linear, vec3(1.0 / 2.4)) - 0.055;
+
+    return mix(high, low, lessThanEqual(linear, vec3(0.0031308)));
+}
+
+vec3 srgbToLinear(vec3 encoded) {
+    const vec3 low = encoded / 12.92;
+    const vec3 high = pow((encoded + 0.055) / 1.055, vec3(2.4));
+
+    return mix(high, low, lessThanEqual(encoded, vec3(0.04045)));
+}
+
+// Narkowicz's fit of the ACES filmic curve.
+vec3 tonemap(vec3 color) {
+    return clamp((color * (2.51 * color + 0.03)) / (color * (2.43 * color + 0.59) + 0.14), 0.0, 1.0);
+}
+
+vec3 lutTexel(uvec3 texel) {
+    return unpackUnorm4x8(gradingLut.texels[(texel.z * LUT_SIZE + texel.y) * LUT_SIZE + texel.x]).rgb;
+}
+
+// The LUT filtered trilinearly at an encoded color.
+vec3 grade(vec3 encoded) {
+    const vec3 position = clamp(encoded, 0.0, 1.0) * float(LUT_SIZE - 1u);
+    const uvec3 low = uvec3(position);
+    const uvec3 high = min(low + 1u, uvec3(LUT_SIZE - 1u));
+    const vec3 weight = position - vec3(low);
+
+    const vec3 bottomFront = mix(lutTexel(low), lutTexel(uvec3(high.x, low.y, low.z)), weight.x);
+    const vec3 topFront = mix(lutTexel(uvec3(low.x, high.y, low.z)), lutTexel(uvec3(high.x, high.y, low.z)), weight.x);
+    const vec3 bottomBack = mix(lutTexel(uvec3(low.x, low.y, high.z)), lutTexel(uvec3(high.x, low.y, high.z)), weight.x);
+    const vec3 topBack = mix(lutTexel(uvec3(low.x, high.y, high.z)), lutTexel(high), weight.x);
+
+    return mix(mix(bottomFront, topFront, weight.y), mix(bottomBack, topBack, weight.y), weight.z);
+}
+
+// Jimenez's interleaved gradient noise, moved every frame, so the dither never settles into a
+// visible pattern.
+float ditherNoise(uvec2 pixel) {
+    const vec2 position = vec2(pixel) + 5.588238 * float(pushConstants.frame & 63u);
+
+    return fract(52.9829189 * fract(dot(position, vec2(0.06711056, 0.00583715))));
+}
+
+// The output color of `pixel`, ready to be written.
+vec4 postProcess(uvec2 pixel) {
+    const vec2 uv = (vec2(pixel) + 0.5) / vec2(pushConstants.outputSize);
+    vec3 color = textureLod(source, uv * pushConstants.sourceScale, 0.0).rgb;
+
+    const vec2 centered = 2.0 * uv - 1.0;
+    color *= pushConstants.exposure * max(1.0 - pushConstants.vignette * dot(centered, centered), 0.0);
+
+    vec3 encoded = grade(linearToSrgb(tonemap(color)));
+    encoded += (ditherNoise(pixel) - 0.5) * pushConstants.ditherAmplitude;
+    encoded = clamp(encoded, 0.0, 1.0);
+
+    return vec4(pushConstants.encodeSrgb != 0u ? encoded : srgbToLinear(encoded), 1.0);
+}
@@ -0,0 +1,62 @@
+// Shared by the kernels of `vk_gpu_primitives::GpuPrimitives`, which enable
+// `GL_EXT_buffer_reference`, `GL_KHR_shader_subgroup_arithmetic` and
+// `GL_KHR_shader_subgroup_ballot`. Buffers are reached through device addresses in push
+// constants, so no kernel needs a descriptor. Workgroups run in full subgroups, which makes
+// `laneIndex` a permutation of the workgroup's invocations in the order subgroup scans go in.
+
+// Sized per device by `vk_compute::ComputeTuning::linear`.
+layout(local_size_x_id = 0) in;
+
+// Matches `vk_gpu_primitives::ITEMS_PER_INVOCATION`.
+layout(constant_id = 1) const uint ITEMS_PER_INVOCATION = 8u;
+
+// A workgroup covers a block of this many elements.
+const uint BLOCK_SIZE = gl_WorkGroupSize.x * ITEMS_PER_INVOCATION;
+
+// Matches `vk_gpu_primitives::RADIX_BITS`.
+const uint RADIX_BITS = 8u;
+const uint RADIX = 1u << RADIX_BITS;
+
+layout(std430, buffer_reference, buffer_reference_align = 4) buffer Words {
+    uint data[];
+};
+
+uint laneIndex() {
+    return gl_SubgroupID * gl_SubgroupSize + gl_SubgroupInvocationID;
+}
+
+shared uint subgroupSums[gl_WorkGroupSize.x];
+shared uint workgroupSum;
+
+// The exclusive prefix sum of `value` over the workgroup in `laneIndex` order, with the sum
+// over the whole workgroup in `total`. Every invocation of the workgroup has to call it.
+uint workgroupExclusiveAdd(uint value, out uint total) {
+    const uint inclusive = subgroupInclusiveAdd(value);
+    if (gl_SubgroupInvocationID == gl_SubgroupSize - 1u) {
+        subgroupSums[gl_SubgroupID] = inclusive;
+    }
+    barrier();
+
+    // A workgroup only spans a few subgroups.
+    if (gl_LocalInvocationIndex == 0u) {
+        uint sum = 0u;
+        for (uint i = 0u; i < gl_NumSubgroups; i++) {
+            const uint subgroupSum = subgroupSums[i];
+            subgroupSums[i] = sum;
+            sum += subgroupSum;
+        }
+        workgroupSum = sum;
+    }
+    barrier();
+
+    total = workgroupSum;
+    const uint prefix = subgroupSums[gl_SubgroupID] + inclusive - value;
+    barrier();
+
+    return prefix;
+}
+
+// The radix digit of the key at `index` the sort is on, `shift` bits into the key.
+uint radixDigit(Words keys, uint keyWords, uint index, uint shift) {
+    return (keys.data[index * keyWords + shift / 32u] >> (shift % 32u)) & (RADIX - 1u);
+}
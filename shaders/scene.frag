@@ -0,0 +1,5 @@
+#version 450
+
+// The scene's fragment shader with shadow maps only, see `scene_shading.glsl`.
+
+#include "scene_shading.glsl"
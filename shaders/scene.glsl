@@ -0,0 +1,123 @@
+// Declarations the scene's shaders share. Matches `SceneUniforms` in `vk_gpu_driven.h`.
+
+// Matches `vk_transforms::WorldMatrix`: the rows of an affine transform, which scales
+// uniformly.
+struct Instance {
+    vec4 rows[3];
+};
+
+// Matches `vk_shadows::CASCADE_COUNT`.
+const uint SHADOW_CASCADE_COUNT = 4u;
+
+// Matches `vk_gpu_driven::LOD_COUNT`, the last level being the impostor.
+const uint MESH_LOD_COUNT = 4u;
+
+layout(set = 0, binding = 0) uniform SceneUniforms {
+    mat4 view;
+    mat4 viewProjection;
+    vec4 frustumPlanes[6];
+    // P00, P11, P22 and P32 of the projection.
+    vec4 projection;
+    // The instances uploaded so far, whether the depth pyramid holds a previous frame, and the
+    // size of its first level.
+    uvec4 cull;
+    // The index count, first index and vertex offset of the mesh every instance draws, and its
+    // meshlet count on the mesh shading path, which is zero on the vertex path.
+    uvec4 mesh;
+    // The box the mesh's positions are quantized relative to, in xyz.
+    vec4 meshBoundsMin;
+    vec4 meshBoundsExtent;
+    // The clusters per pixel in x and y, and the scale and bias that map the log of the view
+    // depth to a cluster slice, see `clusters.glsl`.
+    vec4 clusters;
+    // The number of lights in `clusters.glsl`'s light buffer, none until it is uploaded.
+    uvec4 lights;
+    // The light's view projection of every shadow cascade, the view depth each covers up to,
+    // and half the side of the square each covers. The virtual shadow map only uses the first,
+    // see `virtual_shadows.glsl`.
+    mat4 shadowMatrices[SHADOW_CASCADE_COUNT];
+    vec4 shadowSplits;
+    vec4 shadowRadii;
+    // Towards the directional light in xyz, and how it casts shadows in w: not at all at 0,
+    // through the cascades at 1, through the virtual shadow map at 2, and through the near
+    // cascades and ray queries past them at 3.
+    vec4 directionalLight;
+    // The texels of the virtual shadow map's finest level a pixel covers per unit of view
+    // depth, in x.
+    vec4 virtualShadows;
+    // The index count and first index of every level of detail of the mesh, and the bits of
+    // its error in z, see `vk_gpu_driven::MeshLod`.
+    uvec4 lods[MESH_LOD_COUNT];
+    // The view depth per unit of error at which a level's error covers the pixels it may, in
+    // x, and the levels to pick from in y, one where every instance draws the first.
+    vec4 lodSelection;
+} scene;
+
+#ifdef SCENE_ADDRESSES
+#include "scene_addresses.glsl"
+#else
+layout(std430, set = 0, binding = 1) readonly buffer Instances {
+    Instance instances[];
+};
+#endif
+
+// Matches `vk_vertex_format::quantizePosition`.
+vec3 decodePosition(vec3 quantized) {
+    return scene.meshBoundsMin.xyz + quantized * scene.meshBoundsExtent.xyz;
+}
+
+// Matches `vk_vertex_format::encodeOctahedral`.
+vec3 decodeOctahedral(vec2 encoded) {
+    vec3 direction = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    const float fold = max(-direction.z, 0.0);
+    direction.x += direction.x >= 0.0 ? -fold : fold;
+    direction.y += direction.y >= 0.0 ? -fold : fold;
+
+    return normalize(direction);
+}
+
+vec3 transformPoint(Instance instance, vec3 point) {
+    const vec4 p = vec4(point, 1.0);
+
+    return vec3(dot(instance.rows[0], p), dot(instance.rows[1], p), dot(instance.rows[2], p));
+}
+
+vec3 transformDirection(Instance instance, vec3 direction) {
+    const vec4 d = vec4(direction, 0.0);
+
+    return vec3(dot(instance.rows[0], d), dot(instance.rows[1], d), dot(instance.rows[2], d));
+}
+
+vec3 instancePosition(Instance instance) {
+    return vec3(instance.rows[0].w, instance.rows[1].w, instance.rows[2].w);
+}
+
+float instanceScale(Instance instance) {
+    return length(vec3(instance.rows[0].x, instance.rows[1].x, instance.rows[2].x));
+}
+
+// The bounding sphere of the unit cube every instance scales.
+const float MESH_RADIUS = 0.8660254;
+
+// Half the side of the impostor's square, matches `vk_gpu_driven::IMPOSTOR_HALF_EXTENT`.
+const float MESH_IMPOSTOR_HALF_EXTENT = 0.61237244;
+
+// A stable color per instance, from a PCG hash of its index.
+vec3 instanceColor(uint index) {
+    uint hash = index * 747796405u + 2891336453u;
+    hash = ((hash >> ((hash >> 28u) + 4u)) ^ hash) * 277803737u;
+    hash = (hash >> 22u) ^ hash;
+
+    return vec3(uvec3(hash, hash >> 8u, hash >> 16u) & 255u) / 255.0 * 0.7 + 0.3;
+}
+
+// Whether a sphere lies entirely outside one of the frustum's planes.
+bool isOutsideFrustum(vec3 center, float radius) {
+    for (int i = 0; i < 6; i++) {
+        if (dot(scene.frustumPlanes[i], vec4(center, 1.0)) < -radius) {
+            return true;
+        }
+    }
+
+    return false;
+}
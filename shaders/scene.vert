@@ -0,0 +1,50 @@
+#version 450
+
+// Transforms the unit cube by the world matrix of the instance the indirect draw picked through its first instance,
+// or pushed as a constant with device generated commands, or turns its impostor to face the camera.
+
+#include "scene.glsl"
+
+// Quantized, see `vk_gpu_driven::Vertex`.
+layout(location = 0) in vec4 inPosition;
+layout(location = 1) in vec2 inNormal;
+
+layout(location = 0) out vec3 outNormal;
+layout(location = 1) out vec3 outColor;
+layout(location = 2) out vec3 outWorldPosition;
+
+// Matches `GENERATED_COMMANDS` in `cull.glsl`.
+layout(constant_id = 0) const bool GENERATED_COMMANDS = false;
+
+layout(push_constant) uniform DrawConstants {
+    uint instanceIndex;
+} draw;
+
+// The depth pre-pass draws with this shader as well, and the main pass keeps its fragments
+// where they match the depth the pre-pass left.
+invariant gl_Position;
+
+void main() {
+    const uint instanceIndex = GENERATED_COMMANDS ? draw.instanceIndex : uint(gl_InstanceIndex);
+    const Instance instance = instances[instanceIndex];
+    vec3 worldPosition = transformPoint(instance, decodePosition(inPosition.xyz));
+    vec3 normal = transformDirection(instance, decodeOctahedral(inNormal));
+
+    // The impostor's vertices, whose w is one, span a square in the camera's right and up
+    // around the instance, moved towards the camera to about where the cube's front is, and
+    // face the camera.
+    if (inPosition.w > 0.5) {
+        const vec3 center = instancePosition(instance);
+        const vec3 eye = -(transpose(mat3(scene.view)) * scene.view[3].xyz);
+        const vec3 right = vec3(scene.view[0].x, scene.view[1].x, scene.view[2].x);
+        const vec3 up = vec3(scene.view[0].y, scene.view[1].y, scene.view[2].y);
+        const vec2 corner = 2.0 * decodePosition(inPosition.xyz).xy;
+        normal = normalize(eye - center);
+        worldPosition = center + (right * corner.x + up * corner.y + normal) * (MESH_IMPOSTOR_HALF_EXTENT * instanceScale(instance));
+    }
+
+    gl_Position = scene.viewProjection * vec4(worldPosition, 1.0);
+    outWorldPosition = worldPosition;
+    outNormal = normal;
+    outColor = instanceColor(instanceIndex);
+}
@@ -0,0 +1,50 @@
+// The buffers the task and mesh shaders reach through the addresses in
+// `vk_gpu_driven::SceneAddresses`, for shaders that enable `GL_EXT_buffer_reference`, define
+// `SCENE_ADDRESSES` and include `scene.glsl` first.
+
+// Matches `vk_meshlets::Meshlet`.
+struct Meshlet {
+    vec3 center;
+    float radius;
+    vec3 coneApex;
+    float coneCutoff;
+    vec3 coneAxis;
+    uint vertexOffset;
+    uint triangleOffset;
+    uint vertexCount;
+    uint triangleCount;
+    uint padding;
+};
+
+// Matches `vk_gpu_driven::Vertex`: four 16 bit unsigned fractions of the position, and two
+// 16 bit signed fractions of the octahedral normal.
+struct Vertex {
+    uint position[2];
+    uint normal;
+};
+
+layout(std430, buffer_reference, buffer_reference_align = 16) readonly buffer InstanceBuffer {
+    Instance data[];
+};
+
+layout(std430, buffer_reference, buffer_reference_align = 16) readonly buffer MeshletBuffer {
+    Meshlet data[];
+};
+
+layout(std430, buffer_reference, buffer_reference_align = 4) readonly buffer IndexBuffer {
+    uint data[];
+};
+
+layout(std430, buffer_reference, buffer_reference_align = 4) readonly buffer VertexBuffer {
+    Vertex data[];
+};
+
+// Matches `vk_gpu_driven::SceneAddresses`. The meshlet triangles are three 8 bit local vertex
+// indices each.
+layout(push_constant) uniform SceneAddresses {
+    InstanceBuffer instances;
+    MeshletBuffer meshlets;
+    IndexBuffer meshletVertices;
+    IndexBuffer meshletTriangles;
+    VertexBuffer vertices;
+} addresses;
@@ -0,0 +1,8 @@
+#version 460
+#extension GL_EXT_ray_query : require
+
+// The scene's fragment shader tracing shadow rays past the near cascades, for devices with
+// ray queries, see `scene_shading.glsl`.
+
+#define RAY_QUERY_SHADOWS
+#include "scene_shading.glsl"
@@ -0,0 +1,182 @@
+// The scene's fragment shader, which `scene.frag` and `scene_ray_query.frag` include. Lights
+// the scene with one directional light, shadowed through the cascades of the shadow map,
+// through the virtual shadow map, or with rays traced past the near cascades when
+// `RAY_QUERY_SHADOWS` is defined, and with the point lights of the fragment's cluster, which
+// `light_cull.comp` listed, so the cost of a fragment follows the lights around it rather than
+// all there are.
+
+#include "scene.glsl"
+#include "clusters.glsl"
+#include "virtual_shadows.glsl"
+
+layout(location = 0) in vec3 inNormal;
+layout(location = 1) in vec3 inColor;
+layout(location = 2) in vec3 inWorldPosition;
+
+layout(location = 0) out vec4 outColor;
+
+// A layer per cascade, see `vk_shadows::ShadowCascades`, or the single layer of the virtual
+// shadow map's atlas.
+layout(set = 0, binding = 9) uniform sampler2DArrayShadow shadowMap;
+
+// An entry per page of the virtual shadow map: its page of the atlas plus one, or zero while
+// it is not resident.
+layout(std430, set = 0, binding = 10) readonly buffer PageTable {
+    uint pageTable[];
+};
+
+#ifdef RAY_QUERY_SHADOWS
+// The top level acceleration structure of every instance, see
+// `vk_ray_query::SceneAccelerationStructure`.
+layout(set = 0, binding = 11) uniform accelerationStructureEXT topLevel;
+
+// Matches `vk_shadows::FIRST_CACHED_CASCADE`, the cascades still rendered with rays traced.
+const uint RASTERIZED_CASCADE_COUNT = 2u;
+// How far a ray starts off the surface along its normal, in world units, so that it does not
+// hit the cube it leaves.
+const float RAY_NORMAL_OFFSET = 0.01;
+// Past the far plane of any view, see `vk_gpu_driven::IndirectRenderer::sceneUniforms`.
+const float RAY_MAX_DISTANCE = 1.0e5;
+#endif
+
+const float AMBIENT = 0.15;
+// How far a position is pushed out along its normal before it is looked up, in texels of its
+// cascade or level, so that a surface does not shadow itself where the map's texels are
+// coarser than its fragments.
+const float NORMAL_OFFSET_TEXELS = 1.5;
+
+// The share of the directional light that reaches a fragment, filtered over the 3x3 texels
+// around it in the first cascade that covers its view depth. Past the last cascade, and
+// outside the cascades of a view they were not fitted to, nothing is shadowed.
+float cascadeShadow(vec3 worldPosition, vec3 normal, float viewDepth) {
+    uint cascade = 0u;
+    while (cascade < SHADOW_CASCADE_COUNT && viewDepth > scene.shadowSplits[cascade]) {
+        cascade++;
+    }
+    if (cascade == SHADOW_CASCADE_COUNT) {
+        return 1.0;
+    }
+
+    const float texel = 1.0 / float(textureSize(shadowMap, 0).x);
+    const vec3 offsetPosition = worldPosition + normal * (NORMAL_OFFSET_TEXELS * 2.0 * scene.shadowRadii[cascade] * texel);
+    const vec4 position = scene.shadowMatrices[cascade] * vec4(offsetPosition, 1.0);
+    const vec2 uv = position.xy * 0.5 + 0.5;
+    if (any(lessThan(uv, vec2(0.0))) || any(greaterThan(uv, vec2(1.0)))) {
+        return 1.0;
+    }
+
+    float lit = 0.0;
+    for (int y = -1; y <= 1; y++) {
+        for (int x = -1; x <= 1; x++) {
+            lit += texture(shadowMap, vec4(uv + vec2(x, y) * texel, float(cascade), position.z));
+        }
+    }
+
+    return lit / 9.0;
+}
+
+// The same, from the page of the virtual shadow map at the level the fragment's footprint
+// calls for, or the first coarser one resident, filtered over the 3x3 texels around it
+// without leaving the page's tile of the atlas. Nothing is shadowed where no level is
+// resident yet.
+float virtualShadow(vec3 worldPosition, vec3 normal, float viewDepth) {
+    const uint firstLevel = virtualShadowLevel(viewDepth);
+    const vec3 offsetPosition = worldPosition + normal * (NORMAL_OFFSET_TEXELS * virtualShadowTexelSize(firstLevel));
+    const vec4 position = scene.shadowMatrices[0] * vec4(offsetPosition, 1.0);
+    const vec2 uv = position.xy * 0.5 + 0.5;
+    if (any(lessThan(uv, vec2(0.0))) || any(greaterThanEqual(uv, vec2(1.0)))) {
+        return 1.0;
+    }
+
+    const vec2 atlasTexel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    const float pageSize = float(VIRTUAL_SHADOW_PAGE_SIZE);
+    for (uint level = firstLevel; level < VIRTUAL_SHADOW_LEVEL_COUNT; level++) {
+        const uint pages = virtualShadowPagesPerSide(level);
+        const vec2 pagePosition = uv * float(pages);
+        const uvec2 page = min(uvec2(pagePosition), uvec2(pages - 1u));
+        const uint entry = pageTable[virtualShadowPageIndex(level, page)];
+        if (entry == 0u) {
+            continue;
+        }
+
+        const uint physicalPage = entry - 1u;
+        const vec2 tile = vec2(physicalPage % VIRTUAL_SHADOW_ATLAS_PAGES_PER_SIDE, physicalPage / VIRTUAL_SHADOW_ATLAS_PAGES_PER_SIDE) * pageSize;
+        const vec2 texel = clamp((pagePosition - vec2(page)) * pageSize, vec2(1.5), vec2(pageSize - 1.5));
+        float lit = 0.0;
+        for (int y = -1; y <= 1; y++) {
+            for (int x = -1; x <= 1; x++) {
+                lit += texture(shadowMap, vec4((tile + texel + vec2(x, y)) * atlasTexel, 0.0, position.z));
+            }
+        }
+
+        return lit / 9.0;
+    }
+
+    return 1.0;
+}
+
+#ifdef RAY_QUERY_SHADOWS
+// Whether anything lies between the fragment and the directional light, with the near
+// cascades' filtered lookups kept where their texels are finer than the fragments. Any hit
+// ends the query, and every instance is opaque, so the hardware never calls back to the
+// shader for a candidate.
+float rayQueryShadow(vec3 worldPosition, vec3 normal, float viewDepth) {
+    if (viewDepth <= scene.shadowSplits[RASTERIZED_CASCADE_COUNT - 1u]) {
+        return cascadeShadow(worldPosition, normal, viewDepth);
+    }
+
+    rayQueryEXT query;
+    rayQueryInitializeEXT(
+        query,
+        topLevel,
+        gl_RayFlagsTerminateOnFirstHitEXT | gl_RayFlagsOpaqueEXT | gl_RayFlagsSkipClosestHitShaderEXT,
+        0xFFu,
+        worldPosition + normal * RAY_NORMAL_OFFSET,
+        0.0,
+        scene.directionalLight.xyz,
+        RAY_MAX_DISTANCE
+    );
+    while (rayQueryProceedEXT(query)) {
+    }
+
+    return rayQueryGetIntersectionTypeEXT(query, true) == gl_RayQueryCommittedIntersectionNoneEXT ? 1.0 : 0.0;
+}
+#endif
+
+float directionalShadow(vec3 worldPosition, vec3 normal, float viewDepth) {
+    if (scene.directionalLight.w == 0.0) {
+        return 1.0;
+    } else if (scene.directionalLight.w == 2.0) {
+        return virtualShadow(worldPosition, normal, viewDepth);
+    }
+#ifdef RAY_QUERY_SHADOWS
+    if (scene.directionalLight.w == 3.0) {
+        return rayQueryShadow(worldPosition, normal, viewDepth);
+    }
+#endif
+
+    return cascadeShadow(worldPosition, normal, viewDepth);
+}
+
+void main() {
+    const vec3 normal = normalize(inNormal);
+    const float viewDepth = -(scene.view * vec4(inWorldPosition, 1.0)).z;
+    const float diffuse = max(dot(normal, scene.directionalLight.xyz), 0.0);
+    const float shadow = diffuse > 0.0 ? directionalShadow(inWorldPosition, normal, viewDepth) : 1.0;
+    vec3 color = inColor * (AMBIENT + (1.0 - AMBIENT) * diffuse * shadow);
+
+    if (scene.lights.x > 0u) {
+        const uint cluster = clusterIndex(fragmentCluster(gl_FragCoord.xy, viewDepth));
+        const uint count = clusterLightCounts[cluster];
+        for (uint i = 0u; i < count; i++) {
+            const Light light = lights[clusterLightIndices[cluster * MAX_LIGHTS_PER_CLUSTER + i]];
+            const vec3 toLight = light.positionRadius.xyz - inWorldPosition;
+            const float distance = length(toLight);
+            const float falloff = clamp(1.0 - distance / light.positionRadius.w, 0.0, 1.0);
+            const float lambert = max(dot(normal, toLight / max(distance, 1e-4)), 0.0);
+            color += inColor * light.color.rgb * (falloff * falloff * lambert);
+        }
+    }
+
+    outColor = vec4(color, 1.0);
+}
@@ -0,0 +1,31 @@
+#version 450
+
+// Transforms the unit cube by the world matrix of every instance into a cascade of the shadow
+// map, or a page of the virtual shadow map, whose projection the push constants carry.
+// Instances whose bounds miss the viewport are moved outside the clip volume instead, so they
+// cost their vertices and are never rasterized.
+
+#include "scene.glsl"
+
+// Quantized, see `vk_gpu_driven::Vertex`.
+layout(location = 0) in vec4 inPosition;
+
+// Matches `vk_gpu_driven::ShadowConstants`.
+layout(push_constant) uniform ShadowConstants {
+    mat4 viewProjection;
+} shadow;
+
+void main() {
+    const Instance instance = instances[gl_InstanceIndex];
+    const vec4 center = shadow.viewProjection * vec4(instancePosition(instance), 1.0);
+    // The projection is orthographic and square, so a world unit spans the length of its first
+    // row in clip space, in x and y alike.
+    const float clipScale = length(vec3(shadow.viewProjection[0][0], shadow.viewProjection[1][0], shadow.viewProjection[2][0]));
+    const float radius = MESH_RADIUS * instanceScale(instance) * clipScale;
+    if (any(greaterThan(abs(center.xy), vec2(1.0 + radius)))) {
+        gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+        return;
+    }
+
+    gl_Position = shadow.viewProjection * vec4(transformPoint(instance, decodePosition(inPosition.xyz)), 1.0);
+}
@@ -0,0 +1,28 @@
+#version 450
+
+// Blends a batch of sprites over the target, each its color times its texture, or just its
+// color for `SOLID` batches. The texture of a `DISTANCE_FIELD` batch only gives the sprites'
+// coverage, from its distance to the edge in screen pixels, so the edge stays sharp at any size.
+
+#include "sprite.glsl"
+
+layout(location = 0) in vec2 inUv;
+layout(location = 1) in vec4 inColor;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    vec4 color = inColor;
+    if (pushConstants.texture != SOLID) {
+        const vec4 texel = texture(sampler2D(images[textureSlot()], samplers[pushConstants.sampler]), inUv);
+        if ((pushConstants.texture & DISTANCE_FIELD) != 0u) {
+            // Half a pixel either side of the edge, however the field is scaled.
+            const float width = max(0.5 * fwidth(texel.r), 1.0e-4);
+            color.a *= smoothstep(0.5 - width, 0.5 + width, texel.r);
+        } else {
+            color *= texel;
+        }
+    }
+
+    outColor = color;
+}
@@ -0,0 +1,27 @@
+// Shared by `sprite.vert` and `sprite.frag`: the bindless descriptor heap, and the push
+// constants that pick a batch's texture out of it.
+
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Bindings 0 and 2 of `vk_descriptors::BindlessDescriptorHeap`.
+layout(set = 0, binding = 0) uniform texture2D images[];
+layout(set = 0, binding = 2) uniform sampler samplers[];
+
+// Matches `vk_sprites::SpriteBatcher::PushConstants`.
+layout(push_constant) uniform PushConstants {
+    // The size of the target in pixels.
+    vec2 extent;
+    // The batch's texture and sampler slots in the heap, or `SOLID` for untextured sprites.
+    // Texture slots may have `DISTANCE_FIELD` set.
+    uint texture;
+    uint sampler;
+} pushConstants;
+
+// Matches `vk_sprites::SOLID` and `vk_sprites::DISTANCE_FIELD`.
+const uint SOLID = 0xffffffffu;
+const uint DISTANCE_FIELD = 0x80000000u;
+
+// The batch's texture without its flags.
+uint textureSlot() {
+    return pushConstants.texture & ~DISTANCE_FIELD;
+}
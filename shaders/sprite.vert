@@ -0,0 +1,52 @@
+#version 450
+
+// Expands each sprite, an instance each, into two triangles in pixel space, with its texture
+// coordinates across it. A sprite is its corners in pixels and then in texels, each as
+// `x0, y0, x1, y1`, in eight 12 bit fields from the lowest bit of the first word up, and its
+// color in the last word, see `vk_sprites::Sprite`.
+
+#include "sprite.glsl"
+
+layout(location = 0) in uvec4 inSprite;
+
+layout(location = 0) out vec2 outUv;
+layout(location = 1) out vec4 outColor;
+
+const uint COORDINATE_BITS = 12u;
+const uint COORDINATE_MASK = (1u << COORDINATE_BITS) - 1u;
+
+const vec2 CORNERS[6] = vec2[](
+    vec2(0.0, 0.0),
+    vec2(1.0, 0.0),
+    vec2(1.0, 1.0),
+    vec2(0.0, 0.0),
+    vec2(1.0, 1.0),
+    vec2(0.0, 1.0)
+);
+
+// Field `index` of the sprite, which may start in one word and end in the next.
+uint field(uint index) {
+    const uint offset = index * COORDINATE_BITS;
+    const uint word = offset / 32u;
+    const uint shift = offset % 32u;
+    uint value = inSprite[word] >> shift;
+    if (shift + COORDINATE_BITS > 32u) {
+        value |= inSprite[word + 1u] << (32u - shift);
+    }
+
+    return value & COORDINATE_MASK;
+}
+
+void main() {
+    const vec2 corner = CORNERS[gl_VertexIndex];
+    const vec2 position = mix(vec2(field(0u), field(1u)), vec2(field(2u), field(3u)), corner);
+    const vec2 texel = mix(vec2(field(4u), field(5u)), vec2(field(6u), field(7u)), corner);
+
+    gl_Position = vec4(position / pushConstants.extent * 2.0 - 1.0, 0.0, 1.0);
+    outUv = vec2(0.0);
+    if (pushConstants.texture != SOLID) {
+        const vec2 textureExtent = vec2(textureSize(sampler2D(images[textureSlot()], samplers[pushConstants.sampler]), 0));
+        outUv = texel / textureExtent;
+    }
+    outColor = unpackUnorm4x8(inSprite.w);
+}
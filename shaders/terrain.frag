@@ -0,0 +1,18 @@
+#version 450
+
+// Grass on the flats and rock on the slopes, lit by the scene's directional light.
+
+layout(location = 0) in vec3 inNormal;
+layout(location = 1) in float inLight;
+
+layout(location = 0) out vec4 outColor;
+
+// Matches `AMBIENT` in `scene.frag`.
+const float AMBIENT = 0.15;
+
+void main() {
+    const vec3 normal = normalize(inNormal);
+    const vec3 albedo = mix(vec3(0.35, 0.3, 0.25), vec3(0.25, 0.4, 0.15), smoothstep(0.75, 0.9, normal.y));
+
+    outColor = vec4(albedo * (AMBIENT + (1.0 - AMBIENT) * inLight), 1.0);
+}
@@ -0,0 +1,41 @@
+// Shared by `terrain.vert` and `terrain_streamed.frag`: the clipmap levels, and the push
+// constants of a terrain draw.
+
+#extension GL_EXT_buffer_reference : require
+
+#include "texture_streaming.glsl"
+
+// Match `vk_terrain::GRID_SIZE`, `vk_terrain::RING_SIZE` and `vk_terrain::MAX_LEVELS`.
+const int GRID_SIZE = 127;
+const int RING_SIZE = 128;
+const uint MAX_LEVELS = 12u;
+
+// Matches `vk_terrain::ALBEDO_REPEAT`: the finest level's samples the albedo texture spans
+// before it repeats.
+const float ALBEDO_REPEAT = 64.0;
+
+// Matches `vk_terrain::ClipmapLevel`.
+struct TerrainLevel {
+    ivec2 origin;
+    float spacing;
+    float padding;
+};
+
+layout(std430, buffer_reference, buffer_reference_align = 16) readonly buffer Terrain {
+    TerrainLevel levels[MAX_LEVELS];
+    float heights[];
+};
+
+// Matches `vk_terrain::DrawPushConstants`. The rest is only set for terrain with a streamed
+// albedo, whose texture and sampler are slots of the bindless descriptor heap.
+layout(push_constant) uniform PushConstants {
+    mat4 viewProjection;
+    vec3 lightDirection;
+    uint frame;
+    Terrain terrain;
+    StreamingResidency residency;
+    StreamingFeedback feedback;
+    StreamedTexture albedo;
+    uint albedoImage;
+    uint albedoSampler;
+} pushConstants;
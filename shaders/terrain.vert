@@ -0,0 +1,51 @@
+#version 450
+
+// Places a vertex of one clipmap level's grid, the draw's instance, on the level's heights,
+// which are read out of the level's toroidally addressed ring. Where the level meets the
+// coarser one around it, its odd vertices are lowered onto the coarser level's edges, so the
+// levels meet without cracks. The albedo coordinate repeats every `ALBEDO_REPEAT` samples
+// of the finest level.
+
+#include "terrain.glsl"
+
+layout(location = 0) out vec3 outNormal;
+layout(location = 1) out float outLight;
+layout(location = 2) out vec2 outAlbedoCoordinate;
+
+float sampleHeight(uint level, ivec2 sampleCoordinate) {
+    const ivec2 wrapped = sampleCoordinate & ivec2(RING_SIZE - 1);
+
+    return pushConstants.terrain.heights[level * uint(RING_SIZE * RING_SIZE) + uint(wrapped.y * RING_SIZE + wrapped.x)];
+}
+
+void main() {
+    const uint level = uint(gl_InstanceIndex);
+    const TerrainLevel clipmap = pushConstants.terrain.levels[level];
+    const ivec2 local = ivec2(gl_VertexIndex % GRID_SIZE, gl_VertexIndex / GRID_SIZE);
+    const ivec2 sampleCoordinate = clipmap.origin + local;
+
+    // The corner is on even samples, so the parity of a vertex is the same in the level and
+    // in the world.
+    float height = sampleHeight(level, sampleCoordinate);
+    const bool edgeRow = local.y == 0 || local.y == GRID_SIZE - 1;
+    const bool edgeColumn = local.x == 0 || local.x == GRID_SIZE - 1;
+    if (edgeRow && (local.x & 1) == 1) {
+        height = 0.5 * (sampleHeight(level, sampleCoordinate - ivec2(1, 0)) + sampleHeight(level, sampleCoordinate + ivec2(1, 0)));
+    } else if (edgeColumn && (local.y & 1) == 1) {
+        height = 0.5 * (sampleHeight(level, sampleCoordinate - ivec2(0, 1)) + sampleHeight(level, sampleCoordinate + ivec2(0, 1)));
+    }
+
+    // Central differences, one sided at the level's edges.
+    const ivec2 low = max(local - 1, ivec2(0));
+    const ivec2 high = min(local + 1, ivec2(GRID_SIZE - 1));
+    const float slopeX = (sampleHeight(level, clipmap.origin + ivec2(high.x, local.y)) - sampleHeight(level, clipmap.origin + ivec2(low.x, local.y))) / (float(high.x - low.x) * clipmap.spacing);
+    const float slopeZ = (sampleHeight(level, clipmap.origin + ivec2(local.x, high.y)) - sampleHeight(level, clipmap.origin + ivec2(local.x, low.y))) / (float(high.y - low.y) * clipmap.spacing);
+    const vec3 normal = normalize(vec3(-slopeX, 1.0, -slopeZ));
+
+    // Matches the world positions `vk_terrain::HeightTiles` samples at.
+    const vec2 position = vec2(sampleCoordinate) * clipmap.spacing;
+    gl_Position = pushConstants.viewProjection * vec4(position.x, height, position.y, 1.0);
+    outNormal = normal;
+    outLight = max(dot(normal, pushConstants.lightDirection), 0.0);
+    outAlbedoCoordinate = vec2(sampleCoordinate) * (clipmap.spacing / pushConstants.terrain.levels[0].spacing) / ALBEDO_REPEAT;
+}
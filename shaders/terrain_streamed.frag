@@ -0,0 +1,38 @@
+#version 450
+
+// `terrain.frag` with the albedo sampled from a texture streamed by
+// `vk_streaming::TextureStreamer`, and the procedural one where its tiles are not in yet.
+
+#extension GL_EXT_nonuniform_qualifier : require
+
+#include "terrain.glsl"
+
+// Bindings 0 and 2 of `vk_descriptors::BindlessDescriptorHeap`.
+layout(set = 0, binding = 0) uniform texture2D images[];
+layout(set = 0, binding = 2) uniform sampler samplers[];
+
+layout(location = 0) in vec3 inNormal;
+layout(location = 1) in float inLight;
+layout(location = 2) in vec2 inAlbedoCoordinate;
+
+layout(location = 0) out vec4 outColor;
+
+// Matches `AMBIENT` in `scene.frag`.
+const float AMBIENT = 0.15;
+
+void main() {
+    const vec3 normal = normalize(inNormal);
+    const vec3 procedural = mix(vec3(0.35, 0.3, 0.25), vec3(0.25, 0.4, 0.15), smoothstep(0.75, 0.9, normal.y));
+    const vec3 albedo = sampleStreamed(
+        images[pushConstants.albedoImage],
+        samplers[pushConstants.albedoSampler],
+        pushConstants.albedo,
+        pushConstants.residency,
+        pushConstants.feedback,
+        inAlbedoCoordinate,
+        pushConstants.frame,
+        vec4(procedural, 1.0)
+    ).rgb;
+
+    outColor = vec4(albedo * (AMBIENT + (1.0 - AMBIENT) * inLight), 1.0);
+}
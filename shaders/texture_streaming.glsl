@@ -0,0 +1,55 @@
+// Sampling of textures streamed by `vk_streaming::TextureStreamer`, whose feedback and
+// residency buffers are reached through their addresses. Needs `GL_EXT_buffer_reference`.
+
+// Matches `vk_streaming::ShaderTextureInfo`.
+struct StreamedTexture {
+    uint firstRegion;
+    uint regionsX;
+    uint regionsY;
+    uint tailLevel;
+};
+
+// Matches `vk_streaming::NO_MIP`.
+const uint NO_MIP = 0xffffffffu;
+
+// The finest mip resident over each region, written by the CPU for the frame.
+layout(std430, buffer_reference, buffer_reference_align = 4) readonly buffer StreamingResidency {
+    uint residency[];
+};
+
+// The finest mip sampled over each region this frame, reset to `NO_MIP` every frame.
+layout(std430, buffer_reference, buffer_reference_align = 4) buffer StreamingFeedback {
+    uint feedback[];
+};
+
+// Samples the texture no finer than what is resident over `uv`, and asks for the mip that
+// would have been sampled. A few pixels of each 8x8 block write feedback, a different one
+// every frame, which keeps atomics off the hot path and still covers every visible region
+// within a few frames. Returns `fallback` until the texture's mip tail is resident.
+vec4 sampleStreamed(
+    texture2D image,
+    sampler imageSampler,
+    StreamedTexture info,
+    StreamingResidency residency,
+    StreamingFeedback feedback,
+    vec2 uv,
+    uint frame,
+    vec4 fallback
+) {
+    const vec2 wrapped = fract(uv);
+    const uvec2 region = min(uvec2(wrapped * vec2(info.regionsX, info.regionsY)), uvec2(info.regionsX, info.regionsY) - 1u);
+    const uint regionIndex = info.firstRegion + region.y * info.regionsX + region.x;
+    const float lod = textureQueryLod(sampler2D(image, imageSampler), uv).y;
+
+    const uvec2 pixel = uvec2(gl_FragCoord.xy) & 7u;
+    if (((pixel.y * 8u + pixel.x) ^ (frame * 13u)) % 64u < 2u) {
+        atomicMin(feedback.feedback[regionIndex], min(uint(max(lod, 0.0)), info.tailLevel));
+    }
+
+    const uint resident = residency.residency[regionIndex];
+    if (resident == NO_MIP) {
+        return fallback;
+    }
+
+    return textureLod(sampler2D(image, imageSampler), uv, max(lod, float(resident)));
+}
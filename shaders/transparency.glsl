@@ -0,0 +1,34 @@
+// The panes and per pixel fragment lists of `vk_transparency::TransparencyRenderer`, for
+// shaders that enable `GL_EXT_buffer_reference`.
+
+// Matches `vk_transparency::Pane`: a quad around `center`, spanning `axisU` and `axisV` from it
+// each way, of a color with its opacity in `w`.
+struct Pane {
+    vec4 center;
+    vec4 axisU;
+    vec4 axisV;
+    vec4 color;
+};
+
+layout(std430, buffer_reference, buffer_reference_align = 16) readonly buffer Panes {
+    Pane panes[];
+};
+
+// Matches `vk_transparency::FragmentList`: how many nodes are taken, then the nodes, each a
+// fragment's color packed to 8 bits a channel, its depth, and the node drawn before it at its
+// pixel.
+layout(std430, buffer_reference, buffer_reference_align = 16) buffer FragmentList {
+    uint count;
+    uint padding[3];
+    uvec4 nodes[];
+};
+
+// Ends a pixel's list.
+const uint END_OF_LIST = 0xffffffffu;
+
+layout(push_constant) uniform PushConstants {
+    mat4 viewProjection;
+    Panes panes;
+    FragmentList list;
+    uint capacity;
+} pushConstants;
@@ -0,0 +1,26 @@
+#version 450
+#extension GL_EXT_buffer_reference : require
+
+// Expands each pane, an instance each, into its quad.
+
+#include "transparency.glsl"
+
+layout(location = 0) out vec4 outColor;
+
+const vec2 CORNERS[6] = vec2[](
+    vec2(-1.0, -1.0),
+    vec2(1.0, -1.0),
+    vec2(1.0, 1.0),
+    vec2(-1.0, -1.0),
+    vec2(1.0, 1.0),
+    vec2(-1.0, 1.0)
+);
+
+void main() {
+    const Pane pane = pushConstants.panes.panes[gl_InstanceIndex];
+    const vec2 corner = CORNERS[gl_VertexIndex];
+    const vec3 position = pane.center.xyz + pane.axisU.xyz * corner.x + pane.axisV.xyz * corner.y;
+
+    gl_Position = pushConstants.viewProjection * vec4(position, 1.0);
+    outColor = pane.color;
+}
@@ -0,0 +1,27 @@
+#version 450
+
+// Blends the weighted average of a pixel's transparent fragments over the opaque scene, by
+// how much of the scene they hide.
+
+layout(set = 0, binding = 0) uniform sampler2D accumulation;
+layout(set = 0, binding = 1) uniform sampler2D revealage;
+
+layout(location = 0) in vec2 inUV;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    const ivec2 pixel = ivec2(gl_FragCoord.xy);
+    const float revealed = texelFetch(revealage, pixel, 0).r;
+    if (revealed >= 1.0) {
+        discard;
+    }
+
+    vec4 sum = texelFetch(accumulation, pixel, 0);
+    // Half floats overflow under enough bright, near fragments.
+    if (any(isinf(sum.rgb))) {
+        sum.rgb = vec3(sum.a);
+    }
+
+    outColor = vec4(sum.rgb / max(sum.a, 1e-5), 1.0 - revealed);
+}
@@ -0,0 +1,24 @@
+#version 450
+#extension GL_EXT_buffer_reference : require
+
+// Appends a transparent fragment to its pixel's list: a node is taken from the shared pool and
+// swapped in as the pixel's head. Fragments behind the scene are rejected before the shader
+// runs, and once the pool is used up, the frame's remaining fragments are dropped.
+
+#include "transparency.glsl"
+
+layout(early_fragment_tests) in;
+
+layout(set = 0, binding = 0, r32ui) uniform coherent uimage2D heads;
+
+layout(location = 0) in vec4 inColor;
+
+void main() {
+    const uint node = atomicAdd(pushConstants.list.count, 1u);
+    if (node >= pushConstants.capacity) {
+        return;
+    }
+
+    const uint next = imageAtomicExchange(heads, ivec2(gl_FragCoord.xy), node);
+    pushConstants.list.nodes[node] = uvec4(packUnorm4x8(inColor), floatBitsToUint(gl_FragCoord.z), next, 0u);
+}
@@ -0,0 +1,54 @@
+#version 450
+#extension GL_EXT_buffer_reference : require
+
+// Sorts a pixel's list of transparent fragments by depth, keeping the nearest
+// `MAX_SORTED_FRAGMENTS`, and blends them front to back over the opaque scene, premultiplied.
+
+#include "transparency.glsl"
+
+// Matches `vk_transparency::MAX_SORTED_FRAGMENTS`.
+const uint MAX_SORTED_FRAGMENTS = 16u;
+
+layout(set = 0, binding = 0, r32ui) uniform readonly uimage2D heads;
+
+layout(location = 0) in vec2 inUV;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    uint node = imageLoad(heads, ivec2(gl_FragCoord.xy)).r;
+    if (node == END_OF_LIST) {
+        discard;
+    }
+
+    // Insertion sorted, nearest first, which is the greatest depth with reversed depth. A
+    // fragment behind a full list is left out.
+    uvec2 fragments[MAX_SORTED_FRAGMENTS];
+    uint count = 0u;
+    while (node != END_OF_LIST && node < pushConstants.capacity) {
+        const uvec4 entry = pushConstants.list.nodes[node];
+        node = entry.z;
+        const float depth = uintBitsToFloat(entry.y);
+        if (count == MAX_SORTED_FRAGMENTS && depth <= uintBitsToFloat(fragments[count - 1u].y)) {
+            continue;
+        }
+
+        uint i = min(count, MAX_SORTED_FRAGMENTS - 1u);
+        while (i > 0u && uintBitsToFloat(fragments[i - 1u].y) < depth) {
+            fragments[i] = fragments[i - 1u];
+            i--;
+        }
+        fragments[i] = entry.xy;
+        count = min(count + 1u, MAX_SORTED_FRAGMENTS);
+    }
+
+    vec3 color = vec3(0.0);
+    float transmittance = 1.0;
+    for (uint i = 0u; i < count; i++) {
+        const vec4 fragment = unpackUnorm4x8(fragments[i].x);
+        color += transmittance * fragment.a * fragment.rgb;
+        transmittance *= 1.0 - fragment.a;
+    }
+
+    outColor = vec4(color, 1.0 - transmittance);
+}
@@ -0,0 +1,21 @@
+#version 450
+
+// Adds a transparent fragment into the accumulation target, its premultiplied color and
+// opacity weighted by how near it is, and multiplies its transparency into the revealage
+// target, so the result does not depend on the order fragments arrive in. The weight is the
+// depth based one of McGuire and Bavoil's weighted blended order independent transparency.
+
+layout(location = 0) in vec4 inColor;
+
+layout(location = 0) out vec4 outAccumulation;
+layout(location = 1) out float outRevealage;
+
+void main() {
+    const float alpha = inColor.a;
+    // Depth is reversed, 1 at the near plane.
+    const float nearness = gl_FragCoord.z;
+    const float weight = clamp(alpha * 3000.0 * nearness * nearness * nearness, 0.01, 3000.0);
+
+    outAccumulation = vec4(inColor.rgb * alpha, alpha) * weight;
+    outRevealage = alpha;
+}
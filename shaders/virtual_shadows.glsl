@@ -0,0 +1,34 @@
+// The pages of the virtual shadow map, for shaders that include `scene.glsl` first. Matches
+// `vk_virtual_shadows`, whose map the scene's uniforms carry when `directionalLight.w` is 2:
+// its projection in `shadowMatrices[0]`, the scene radius it covers in `shadowRadii.x`, and
+// the texels of its finest level a pixel covers per unit of view depth in `virtualShadows.x`.
+
+const uint VIRTUAL_SHADOW_PAGE_SIZE = 128u;
+const uint VIRTUAL_SHADOW_PAGES_PER_SIDE = 128u;
+const uint VIRTUAL_SHADOW_LEVEL_COUNT = 4u;
+const uint VIRTUAL_SHADOW_ATLAS_PAGES_PER_SIDE = 32u;
+
+// The level whose texels are about the size of a pixel at `viewDepth`, the finest one for
+// anything closer.
+uint virtualShadowLevel(float viewDepth) {
+    const float texels = max(viewDepth * scene.virtualShadows.x, 1.0);
+
+    return min(uint(floor(log2(texels))), VIRTUAL_SHADOW_LEVEL_COUNT - 1u);
+}
+
+uint virtualShadowPagesPerSide(uint level) {
+    return VIRTUAL_SHADOW_PAGES_PER_SIDE >> level;
+}
+
+// Every level has a quarter of the pages of the one before it, so the levels before `level`
+// take up (4^8 - 4^(8 - level)) / 3 entries of the page table.
+uint virtualShadowPageIndex(uint level, uvec2 page) {
+    const uint offset = (65536u - (65536u >> (2u * level))) / 3u;
+
+    return offset + page.y * virtualShadowPagesPerSide(level) + page.x;
+}
+
+// The side of a texel of `level`, in world units.
+float virtualShadowTexelSize(uint level) {
+    return 2.0 * scene.shadowRadii.x * float(1u << level) / float(VIRTUAL_SHADOW_PAGES_PER_SIDE * VIRTUAL_SHADOW_PAGE_SIZE);
+}
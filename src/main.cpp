@@ -1,4 +1,4 @@
-#include <vulkan/vulkan.h>
+#include "vk_dispatch.h"
 
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
@@ -8,697 +8,9594 @@
 #include <cstdlib>
 #include <vector>
 #include <optional>
-#include <set>
 #include <cstdint>
 #include <limits>
 #include <algorithm>
+#include <numeric>
+#include <iterator>
+#include <array>
+#include <string>
+#include <cstring>
+#include <tuple>
+#include <atomic>
+#include <compare>
+#include <cctype>
+#include <thread>
+#include <filesystem>
+#include <chrono>
+#include <bit>
+#include <exception>
+#include <random>
+#include <sstream>
+#include <future>
+#include <memory>
+#include <memory_resource>
+#include <fstream>
+#include <span>
+#include <cstdio>
+#include <string_view>
 
 #include <fmt/core.h>
 #include <fmt/ostream.h>
 
+#include "vk_profiling.h"
+#include "vk_tracing.h"
+#include "vk_debug.h"
+#include "vk_log.h"
+#include "vk_extensions.h"
+#include "vk_memory.h"
+#include "vk_upload.h"
+#include "vk_readback.h"
+#include "vk_frame_dump.h"
+#include "vk_recording.h"
+#include "vk_jobs.h"
+#include "vk_topology.h"
+#include "vk_pipeline_cache.h"
+#include "vk_pipelines.h"
+#include "vk_shaders.h"
+#include "vk_descriptors.h"
+#include "vk_features.h"
+#include "vk_present.h"
+#include "vk_host_memory.h"
+#include "vk_handles.h"
+#include "vk_validation.h"
+#include "vk_platform.h"
+#include "vk_power.h"
+#include "vk_surface.h"
+#include "vk_display.h"
+#include "vk_fullscreen.h"
+#include "vk_compute.h"
+#include "vk_compute_present.h"
+#include "vk_device_group.h"
+#include "vk_input.h"
+#include "vk_frame_budget.h"
+#include "vk_frame_limiter.h"
+#include "vk_resolution.h"
+#include "vk_upscaling.h"
+#include "vk_render_graph.h"
+#include "vk_gpu_driven.h"
+#include "vk_shadows.h"
+#include "vk_virtual_shadows.h"
+#include "vk_gpu_primitives.h"
+#include "vk_decompression.h"
+#include "vk_particles.h"
+#include "vk_ray_query.h"
+#include "vk_bvh.h"
+#include "vk_math.h"
+#include "vk_ecs.h"
+#include "vk_frame_packets.h"
+#include "vk_simulation.h"
+#include "vk_shading_rate.h"
+#include "vk_async_io.h"
+#include "vk_coroutines.h"
+#include "vk_assets.h"
+#include "vk_textures.h"
+#include "vk_thermal.h"
+#include "vk_capture.h"
+#include "vk_barriers.h"
+#include "vk_breadcrumbs.h"
+#include "vk_result.h"
+#include "vk_config.h"
+#include "vk_overlay.h"
+#include "vk_metrics.h"
+#include "vk_service.h"
+#include "vk_frame_export.h"
+#include "vk_video_encode.h"
+#include "vk_submit.h"
+#include "vk_create_info.h"
+#include "vk_streaming.h"
+#include "vk_terrain.h"
+#include "vk_transparency.h"
+#include "vk_post.h"
+#include "vk_sprites.h"
+#include "vk_text.h"
+#include "vk_resources.h"
+#include "vk_image_views.h"
+#include "vk_allocation_tracking.h"
 
+// Counts every heap allocation of the program, for the allocation report and the frame loop's
+// allocation check. The array and `nothrow` forms call these.
+#if HELLO_WINDOW_ALLOCATION_TRACKING
+void* operator new(size_t size) {
+    return vk_allocation_tracking::allocate(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    return vk_allocation_tracking::allocateAligned(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* memory) noexcept {
+    vk_allocation_tracking::deallocate(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    vk_allocation_tracking::deallocate(memory);
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept {
+    vk_allocation_tracking::deallocateAligned(memory);
+}
+
+void operator delete(void* memory, size_t, std::align_val_t) noexcept {
+    vk_allocation_tracking::deallocateAligned(memory);
+}
+#endif
+
+
+// The size of each window, and of the offscreen images when rendering headless, unless
+// `HELLO_WINDOW_WINDOW_SIZE` says otherwise.
 const uint32_t WIDTH = 800;
 const uint32_t HEIGHT = 600;
+const uint32_t MAX_WINDOW_DIMENSION = 16384;
+
+constexpr const char* VK_LAYER_KHRONOS_validation = vk_validation::KHRONOS_VALIDATION_LAYER;
+
+constexpr auto VALIDATION_LAYERS = std::array<const char*, 1> {
+    VK_LAYER_KHRONOS_validation
+};
+
+constexpr auto DEVICE_EXTENSIONS = std::array<const char*, 1> {
+    VK_KHR_SWAPCHAIN_EXTENSION_NAME
+};
+
+constexpr auto SORTED_VALIDATION_LAYERS = vk_extensions::sortedNames(VALIDATION_LAYERS);
+constexpr auto SORTED_DEVICE_EXTENSIONS = vk_extensions::sortedNames(DEVICE_EXTENSIONS);
+
+// Debug builds validate by default, release builds only when asked to with
+// `HELLO_WINDOW_VALIDATION`.
+#ifdef NDEBUG
+const auto DEFAULT_VALIDATION_POLICY = vk_validation::ValidationPolicy::Off;
+#else
+const auto DEFAULT_VALIDATION_POLICY = vk_validation::ValidationPolicy::Full;
+#endif
+
+// Frames the CPU records ahead of the GPU, unless `HELLO_WINDOW_FRAMES_IN_FLIGHT` says
+// otherwise. Every frame in flight adds a frame of latency, and its own command buffers,
+// upload region and timestamp queries.
+const uint32_t DEFAULT_FRAMES_IN_FLIGHT = 2;
+const uint32_t MAX_FRAMES_IN_FLIGHT = 4;
+
+// Threads recording commands for a frame, including the main thread.
+const uint32_t DEFAULT_RECORDING_THREAD_COUNT = 4;
+const uint32_t MAX_RECORDING_THREAD_COUNT = 64;
+
+// The most workers `HELLO_WINDOW_JOB_THREADS` can start.
+const uint32_t MAX_JOB_THREAD_COUNT = 256;
+
+// Size of the upload region of each frame in flight, in MiB.
+const uint32_t DEFAULT_FRAME_UPLOAD_ARENA_MIB = 4;
+
+// Size of the staging ring asset uploads go through on the transfer queue, in MiB.
+const uint32_t DEFAULT_STAGING_BUFFER_MIB = 32;
+
+// Size of the host cached ring screenshots and other readbacks are copied into, in MiB. It
+// holds a few frames of a 4K window.
+const uint32_t DEFAULT_READBACK_BUFFER_MIB = 96;
+
+// Device memory the tiles of streamed textures may take, in MiB.
+const uint32_t DEFAULT_TEXTURE_STREAMING_BUDGET_MIB = 256;
+
+// The largest budget the settings above take, in MiB.
+const uint32_t MAX_BUFFER_MIB = 4096;
+
+// The most swapchain images `HELLO_WINDOW_SWAPCHAIN_IMAGES` can ask for, before the surface's
+// own limits.
+const uint32_t MAX_SWAPCHAIN_IMAGE_COUNT = 16;
+
+// The bitrate headless frames are encoded at, unless `HELLO_WINDOW_VIDEO_BITRATE_KBPS` says
+// otherwise, in kbit/s, and the frame rate the stream is timed at, since headless frames are
+// rendered as fast as the device goes.
+const uint32_t DEFAULT_VIDEO_BITRATE_KBPS = 8000;
+const uint32_t MAX_VIDEO_BITRATE_KBPS = 1'000'000;
+const uint32_t VIDEO_FRAME_RATE = 60;
+
+// Frame dumps take one frame in `HELLO_WINDOW_FRAME_DUMP_INTERVAL`, every frame by default,
+// and drop frames while this many are still being read back or written.
+const uint32_t DEFAULT_FRAME_DUMP_INTERVAL = 1;
+const uint32_t MAX_FRAME_DUMP_INTERVAL = 100'000;
+const uint32_t FRAME_DUMP_QUEUE_DEPTH = 8;
+
+// How long an acquire waits for a swapchain image, unless `HELLO_WINDOW_ACQUIRE_TIMEOUT_MS`
+// says otherwise, before the window sits the frame out, and how long each wait in between
+// queued jobs lasts while it does.
+const uint32_t DEFAULT_ACQUIRE_TIMEOUT_MS = 100;
+const uint32_t MAX_ACQUIRE_TIMEOUT_MS = 10'000;
+constexpr auto ACQUIRE_POLL_INTERVAL = std::chrono::microseconds { 500 };
+
+// How long the idle render mode parks the main thread in `glfwWaitEventsTimeout` before
+// it wakes up on its own, in seconds.
+const double IDLE_WAIT_TIMEOUT = 0.5;
+
+// How often the frame time percentiles are written to stdout when
+// `HELLO_WINDOW_FRAME_TELEMETRY` is set to `json`.
+constexpr auto FRAME_TELEMETRY_EXPORT_INTERVAL = std::chrono::seconds { 5 };
+
+// Frames rendered before a benchmark starts measuring, to leave out pipeline compiles and
+// the swapchain settling in.
+constexpr uint64_t BENCH_WARMUP_FRAMES = 120;
+
+// The most windows `HELLO_WINDOW_WINDOW_COUNT` can open. Every window adds a swapchain to
+// each frame's submission and present.
+constexpr uint32_t MAX_WINDOW_COUNT = 8;
+// Counted over the displays of every GPU.
+constexpr uint32_t MAX_DISPLAY_INDEX = 63;
+constexpr uint32_t MAX_MONITOR_INDEX = 15;
+
+// Input events the main thread can queue up for the renderer between two frames. Events past
+// that are dropped.
+constexpr size_t INPUT_QUEUE_CAPACITY = 1024;
+
+// The smallest render scale `HELLO_WINDOW_RENDER_SCALE` accepts. Past that the upscaled
+// frame is mostly blur.
+constexpr double MIN_RENDER_SCALE = 0.25;
+
+// The most instances `HELLO_WINDOW_INSTANCE_COUNT` can place. Each window's draw buffer holds
+// a draw for every one of them.
+constexpr uint32_t MAX_INSTANCE_COUNT = 4'000'000;
+
+// The most lights `HELLO_WINDOW_LIGHT_COUNT` can scatter through the scene. Each one is
+// tested against every cluster of every window each frame.
+constexpr uint32_t MAX_LIGHT_COUNT = 65'536;
+
+// The most particles `HELLO_WINDOW_PARTICLE_COUNT` can fit, 256 MiB of them in each of their
+// two buffers.
+constexpr uint32_t MAX_PARTICLE_COUNT = 8'000'000;
+
+// The most launches of each condition `HELLO_WINDOW_STARTUP_BENCH` can ask for.
+constexpr uint32_t MAX_STARTUP_BENCH_RUNS = 1000;
+
+// The driver shader caches the cold launches of the startup benchmark turn off, Mesa's and
+// NVIDIA's, by the environment variables the drivers read.
+constexpr std::array<std::pair<const char*, const char*>, 2> COLD_START_DRIVER_ENVIRONMENT = { {
+    { "MESA_SHADER_CACHE_DISABLE", "true" },
+    { "__GL_SHADER_DISK_CACHE", "0" },
+} };
+
+// The most widgets `HELLO_WINDOW_WIDGETS` can draw, four sprites and a label of up to twelve
+// glyphs each.
+constexpr uint32_t MAX_WIDGET_COUNT = vk_sprites::MAX_SPRITES / 16;
+
+// The panes of glass `HELLO_WINDOW_TRANSPARENCY` scatters through the scene.
+constexpr uint32_t TRANSPARENT_PANE_COUNT = 512;
+
+// The most samples `HELLO_WINDOW_MSAA` can ask for, the largest sample count Vulkan has.
+constexpr uint32_t MAX_MSAA_SAMPLES = 64;
+
+// How far the plus and minus keys move the frame limit, in frames per second.
+constexpr double FRAME_LIMIT_STEP = 10.0;
+
+// How far the bracket keys move the render scale while the overlay is shown.
+constexpr double RENDER_SCALE_STEP = 0.125;
+
+// The frame limit and render scale the power policy holds frames to while it saves power,
+// unless they were set lower.
+constexpr double POWER_SAVING_FRAME_LIMIT = 30.0;
+constexpr double POWER_SAVING_RENDER_SCALE = 0.75;
+
+// The frames the overlay's frame time graph shows, and the frame time at its top.
+constexpr size_t OVERLAY_GRAPH_FRAMES = 120;
+constexpr double OVERLAY_GRAPH_MILLISECONDS = 1000.0 / 30.0;
+constexpr float OVERLAY_GRAPH_HEIGHT = 48.0f;
+
+const char* RENDER_MODE_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_RENDER_MODE";
+const char* PRESENT_MODE_POLICY_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_PRESENT_MODE";
+const char* DEVICE_OVERRIDE_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_DEVICE";
+const char* STARTUP_REPORT_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_STARTUP_REPORT";
+const char* STARTUP_BENCH_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_STARTUP_BENCH";
+const char* STARTUP_BENCH_OUTPUT_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_STARTUP_BENCH_OUTPUT";
+const char* EXIT_AFTER_STARTUP_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_EXIT_AFTER_STARTUP";
+const char* VALIDATION_LOG_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_VALIDATION_LOG";
+const char* PIPELINE_CACHE_DIRECTORY_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_PIPELINE_CACHE_DIR";
+const char* FRAME_TELEMETRY_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_FRAME_TELEMETRY";
+const char* PIPELINE_STATISTICS_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_PIPELINE_STATISTICS";
+const char* PERFORMANCE_COUNTERS_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_PERFORMANCE_COUNTERS";
+const char* CRASH_DIAGNOSTICS_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_CRASH_DIAGNOSTICS";
+const char* LOG_FORMAT_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_LOG_FORMAT";
+// Where the driver's own crash dump goes when the device is lost, if it has one.
+const char* DEVICE_FAULT_DUMP_FILE_NAME = "device_fault_vendor.bin";
+const char* HEADLESS_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_HEADLESS";
+const char* BENCH_FRAMES_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_BENCH_FRAMES";
+const char* BENCH_SECONDS_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_BENCH_SECONDS";
+const char* BENCH_OUTPUT_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_BENCH_OUTPUT";
+const char* BENCH_SWEEP_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_BENCH_SWEEP";
+const char* INIT_BENCH_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_INIT_BENCH_ITERATIONS";
+const char* CAPTURE_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_CAPTURE";
+const char* REPLAY_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_REPLAY";
+const char* HOST_ALLOCATOR_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_HOST_ALLOCATOR";
+const char* ALLOCATION_CHECK_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_ALLOCATION_CHECK";
+const char* VALIDATION_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_VALIDATION";
+const char* DEBUG_LABELS_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_DEBUG_LABELS";
+const char* LIST_EXTENSIONS_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_LIST_EXTENSIONS";
+const char* SURFACE_FORMAT_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_SURFACE_FORMAT";
+const char* PRESENT_PATH_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_PRESENT_PATH";
+const char* SWAPCHAIN_SHARING_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_SWAPCHAIN_SHARING";
+const char* PRESENT_QUEUE_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_PRESENT_QUEUE";
+const char* WINDOW_COUNT_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_WINDOW_COUNT";
+const char* WINDOW_COMPOSITE_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_WINDOW_COMPOSITE";
+const char* DEVICE_GROUP_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_DEVICE_GROUP";
+const char* RENDER_THREAD_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_RENDER_THREAD";
+const char* LOW_LATENCY_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_LOW_LATENCY";
+const char* FRAME_LIMIT_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_FRAME_LIMIT";
+const char* POWER_POLICY_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_POWER_POLICY";
+const char* TIER_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_TIER";
+const char* THERMAL_GOVERNOR_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_THERMAL_GOVERNOR";
+const char* RENDER_SCALE_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_RENDER_SCALE";
+const char* GPU_BUDGET_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_GPU_BUDGET_MS";
+const char* CPU_BUDGET_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_CPU_BUDGET_MS";
+const char* UPSCALER_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_UPSCALER";
+const char* ASYNC_COMPUTE_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_ASYNC_COMPUTE";
+const char* COMMAND_CACHE_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_COMMAND_CACHE";
+const char* INSTANCE_COUNT_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_INSTANCE_COUNT";
+const char* LIGHT_COUNT_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_LIGHT_COUNT";
+const char* PARTICLE_COUNT_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_PARTICLE_COUNT";
+const char* MESH_SHADING_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_MESH_SHADING";
+const char* GENERATED_COMMANDS_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_GENERATED_COMMANDS";
+const char* DESCRIPTOR_BUFFER_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_DESCRIPTOR_BUFFER";
+const char* SHADER_OBJECTS_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_SHADER_OBJECTS";
+const char* DEPTH_PREPASS_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_DEPTH_PREPASS";
+const char* SHADOWS_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_SHADOWS";
+const char* LOD_ERROR_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_LOD_ERROR";
+const char* TICK_RATE_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_TICK_RATE";
+const char* ANIMATION_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_ANIMATION";
+const char* TERRAIN_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_TERRAIN";
+const char* TRANSPARENCY_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_TRANSPARENCY";
+const char* POST_PROCESS_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_POST_PROCESS";
+const char* WIDGETS_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_WIDGETS";
+const char* MSAA_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_MSAA";
+const char* SHADING_RATE_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_SHADING_RATE";
+const char* ASSET_PACK_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_ASSET_PACK";
+const char* UPLOAD_STRATEGY_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_UPLOAD_STRATEGY";
+const char* FRAMES_IN_FLIGHT_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_FRAMES_IN_FLIGHT";
+const char* SWAPCHAIN_IMAGES_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_SWAPCHAIN_IMAGES";
+const char* RECORDING_THREADS_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_RECORDING_THREADS";
+const char* JOB_THREADS_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_JOB_THREADS";
+const char* THREAD_PLACEMENT_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_THREAD_PLACEMENT";
+const char* FRAME_UPLOAD_ARENA_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_FRAME_UPLOAD_ARENA_MB";
+const char* STAGING_BUFFER_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_STAGING_BUFFER_MB";
+const char* HOST_IMAGE_COPY_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_HOST_IMAGE_COPY";
+const char* READBACK_BUFFER_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_READBACK_BUFFER_MB";
+const char* TEXTURE_STREAMING_BUDGET_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_TEXTURE_STREAMING_BUDGET_MB";
+const char* WINDOW_SIZE_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_WINDOW_SIZE";
+const char* DISPLAY_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_DISPLAY";
+const char* FULLSCREEN_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_FULLSCREEN";
+const char* OVERLAY_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_OVERLAY";
+const char* METRICS_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_METRICS";
+const char* SERVICE_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_SERVICE";
+const char* FRAME_EXPORT_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_FRAME_EXPORT";
+const char* VIDEO_ENCODE_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_VIDEO_ENCODE";
+const char* VIDEO_BITRATE_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_VIDEO_BITRATE_KBPS";
+const char* FRAME_DUMP_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_FRAME_DUMP";
+const char* FRAME_DUMP_INTERVAL_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_FRAME_DUMP_INTERVAL";
+const char* ACQUIRE_TIMEOUT_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_ACQUIRE_TIMEOUT_MS";
+
+// Set by the build. Without it, shaders are looked up next to the working directory and never
+// recompiled at runtime.
+#ifndef HELLO_WINDOW_SHADER_SOURCE_DIR
+#define HELLO_WINDOW_SHADER_SOURCE_DIR "shaders"
+#endif
+
+#ifndef HELLO_WINDOW_SHADER_BINARY_DIR
+#define HELLO_WINDOW_SHADER_BINARY_DIR "bin/shaders"
+#endif
+
+#ifndef HELLO_WINDOW_GLSLC
+#define HELLO_WINDOW_GLSLC ""
+#endif
+
+// Set by the build with the `HELLO_WINDOW_LEAK_CHECK` option, which keeps the full teardown at
+// exit, so that every object the demo created is seen destroyed.
+#ifndef HELLO_WINDOW_LEAK_CHECK
+#define HELLO_WINDOW_LEAK_CHECK 0
+#endif
+
+
+enum class RenderMode {
+    Continuous,
+    OnDemand,
+};
+
+static RenderMode renderModeFromEnvironment() {
+    const char* value = vk_config::get(RENDER_MODE_ENVIRONMENT_VARIABLE);
+    if (value == nullptr) {
+        return RenderMode::Continuous;
+    }
+
+    const auto mode = std::string { value };
+    if (mode == "continuous") {
+        return RenderMode::Continuous;
+    } else if (mode == "on-demand" || mode == "idle") {
+        return RenderMode::OnDemand;
+    }
+
+    VK_LOG_WARNING("Unknown render mode `{}` in {}, falling back to continuous", mode, RENDER_MODE_ENVIRONMENT_VARIABLE);
+
+    return RenderMode::Continuous;
+}
+
+// How frames get into the swapchain images.
+//
+// * `Raster` clears and draws them as color attachments of a render pass.
+// * `Compute` writes them from a compute shader as storage images, for post processing only
+//   pipelines that would otherwise spend a fullscreen raster pass or a copy on it. It needs
+//   the surface to allow storage usage, and falls back to `Raster` where it does not.
+enum class PresentPath {
+    Raster,
+    Compute,
+};
+
+static PresentPath presentPathFromEnvironment() {
+    const char* value = vk_config::get(PRESENT_PATH_ENVIRONMENT_VARIABLE);
+    if (value == nullptr) {
+        return PresentPath::Raster;
+    }
+
+    const auto path = std::string { value };
+    if (path == "raster") {
+        return PresentPath::Raster;
+    } else if (path == "compute") {
+        return PresentPath::Compute;
+    }
+
+    VK_LOG_WARNING("Unknown present path `{}` in {}, falling back to raster", path, PRESENT_PATH_ENVIRONMENT_VARIABLE);
+
+    return PresentPath::Raster;
+}
+
+// How swapchain images are shared when the graphics and present queue families differ.
+//
+// * `Concurrent` lets both families use the images without any ownership transfer, which
+//   some hardware pays for by disabling framebuffer compression.
+// * `Exclusive` keeps the images owned by one family at a time, and releases each frame's image
+//   from the graphics family to the present family, which acquires it in a small submission of
+//   its own before presenting.
+enum class SwapChainSharing {
+    Concurrent,
+    Exclusive,
+};
+
+static SwapChainSharing swapChainSharingFromEnvironment() {
+    const char* value = vk_config::get(SWAPCHAIN_SHARING_ENVIRONMENT_VARIABLE);
+    if (value == nullptr) {
+        return SwapChainSharing::Concurrent;
+    }
+
+    const auto sharing = std::string { value };
+    if (sharing == "concurrent") {
+        return SwapChainSharing::Concurrent;
+    } else if (sharing == "exclusive") {
+        return SwapChainSharing::Exclusive;
+    }
+
+    VK_LOG_WARNING("Unknown swapchain sharing `{}` in {}, falling back to concurrent", sharing, SWAPCHAIN_SHARING_ENVIRONMENT_VARIABLE);
+
+    return SwapChainSharing::Concurrent;
+}
+
+// Unset, frames are presented from the family they are rendered on whenever it can present.
+static bool presentOnComputeFromEnvironment() {
+    const char* value = vk_config::get(PRESENT_QUEUE_ENVIRONMENT_VARIABLE);
+
+    return value != nullptr && std::string { value } == "compute";
+}
+
+// What the present mode and swapchain image count are optimized for.
+//
+// * `Latency` favors the shortest input-to-photon time, and accepts tearing to get it.
+// * `Throughput` renders as many frames as the GPU can produce, without tearing where the
+//   surface has a mailbox mode, and tearing where it only has an immediate one.
+// * `Power` never renders faster than the display refreshes.
+enum class PresentModePolicy {
+    Latency,
+    Throughput,
+    Power,
+};
+
+static constexpr PresentModePolicy DEFAULT_PRESENT_MODE_POLICY = vk_platform::CurrentPlatform::PREFER_FIFO_BY_DEFAULT
+    ? PresentModePolicy::Power
+    : PresentModePolicy::Throughput;
+
+static const char* presentModePolicyToString(PresentModePolicy policy) {
+    switch (policy) {
+        case PresentModePolicy::Latency: return "latency";
+        case PresentModePolicy::Throughput: return "throughput";
+        case PresentModePolicy::Power: return "power";
+    }
+
+    return "unknown";
+}
+
+static PresentModePolicy presentModePolicyFromEnvironment() {
+    const char* value = vk_config::get(PRESENT_MODE_POLICY_ENVIRONMENT_VARIABLE);
+    if (value == nullptr) {
+        return DEFAULT_PRESENT_MODE_POLICY;
+    }
+
+    const auto policy = std::string { value };
+    if (policy == "latency") {
+        return PresentModePolicy::Latency;
+    } else if (policy == "throughput") {
+        return PresentModePolicy::Throughput;
+    } else if (policy == "power") {
+        return PresentModePolicy::Power;
+    }
+
+    VK_LOG_WARNING("Unknown present mode policy `{}` in {}, falling back to the default", policy, PRESENT_MODE_POLICY_ENVIRONMENT_VARIABLE);
+
+    return DEFAULT_PRESENT_MODE_POLICY;
+}
+
+// When the demo trades frame rate and resolution for battery life.
+//
+// * `Off` never does.
+// * `Auto` does while the machine runs on battery or in a low power mode.
+// * `Always` does from the first frame on, to see what it costs on a plugged in machine.
+enum class PowerPolicy {
+    Off,
+    Auto,
+    Always,
+};
+
+static const char* powerPolicyToString(PowerPolicy policy) {
+    switch (policy) {
+        case PowerPolicy::Off: return "off";
+        case PowerPolicy::Auto: return "auto";
+        case PowerPolicy::Always: return "always";
+    }
+
+    return "unknown";
+}
+
+static PowerPolicy powerPolicyFromEnvironment() {
+    const char* value = vk_config::get(POWER_POLICY_ENVIRONMENT_VARIABLE);
+    if (value == nullptr) {
+        return PowerPolicy::Auto;
+    }
+
+    const auto policy = std::string { value };
+    if (policy == "off") {
+        return PowerPolicy::Off;
+    } else if (policy == "auto") {
+        return PowerPolicy::Auto;
+    } else if (policy == "always") {
+        return PowerPolicy::Always;
+    }
+
+    VK_LOG_WARNING("Unknown power policy `{}` in {}, falling back to auto", policy, POWER_POLICY_ENVIRONMENT_VARIABLE);
+
+    return PowerPolicy::Auto;
+}
+
+// The highest capability tier the renderer may pick, which tries the paths of lower tiers
+// on a device that has more.
+static vk_features::Tier maxTierFromEnvironment() {
+    const char* value = vk_config::get(TIER_ENVIRONMENT_VARIABLE);
+    if (value == nullptr) {
+        return vk_features::Tier::HighEnd;
+    }
+
+    const auto tier = std::string { value };
+    for (const auto candidate : vk_features::TIERS) {
+        if (tier == vk_features::tierToString(candidate)) {
+            return candidate;
+        }
+    }
+
+    VK_LOG_WARNING("Unknown capability tier `{}` in {}, falling back to high-end", tier, TIER_ENVIRONMENT_VARIABLE);
+
+    return vk_features::Tier::HighEnd;
+}
+
+// The settings the power policy overrides while it saves power.
+struct RenderSettings {
+    PresentModePolicy presentModePolicy;
+    // Nothing while the frame limit follows the first window's monitor.
+    std::optional<double> frameLimit;
+    double renderScale;
+    RenderMode renderMode;
+};
+
+static vk_profiling::ReportFormat startupReportFormatFromEnvironment() {
+    const char* value = vk_config::get(STARTUP_REPORT_ENVIRONMENT_VARIABLE);
+    if (value != nullptr && std::string { value } == "json") {
+        return vk_profiling::ReportFormat::Json;
+    }
+
+    return vk_profiling::ReportFormat::Table;
+}
+
+static std::filesystem::path startupBenchOutputFromEnvironment() {
+    const char* value = vk_config::get(STARTUP_BENCH_OUTPUT_ENVIRONMENT_VARIABLE);
+    if (value != nullptr && value[0] != '\0') {
+        return std::filesystem::path { value };
+    }
+
+    return std::filesystem::path { "startup_bench.json" };
+}
+
+static bool exitAfterStartupFromEnvironment() {
+    const char* value = vk_config::get(EXIT_AFTER_STARTUP_ENVIRONMENT_VARIABLE);
+
+    return value != nullptr && std::string { value } == "on";
+}
+
+static bool renderThreadFromEnvironment() {
+    const char* value = vk_config::get(RENDER_THREAD_ENVIRONMENT_VARIABLE);
+
+    return value != nullptr && std::string { value } == "on";
+}
+
+static bool windowCompositeFromEnvironment() {
+    const char* value = vk_config::get(WINDOW_COMPOSITE_ENVIRONMENT_VARIABLE);
+
+    return value != nullptr && std::string { value } == "on";
+}
+
+static bool overlayFromEnvironment() {
+    const char* value = vk_config::get(OVERLAY_ENVIRONMENT_VARIABLE);
+
+    return value != nullptr && std::string { value } == "on";
+}
+
+// `<address>:<port>`, or only the port for every interface. Nothing, the default, serves no
+// metrics.
+static std::optional<vk_socket::Endpoint> metricsEndpointFromEnvironment() {
+    const char* value = vk_config::get(METRICS_ENVIRONMENT_VARIABLE);
+    if (value == nullptr || value[0] == '\0') {
+        return std::nullopt;
+    }
+
+    const auto endpoint = vk_socket::parseEndpoint(value, vk_metrics::DEFAULT_ADDRESS);
+    if (!endpoint.has_value()) {
+        VK_LOG_WARNING("Invalid metrics endpoint `{}` in {}, expected a port or <address>:<port>, serving no metrics", value, METRICS_ENVIRONMENT_VARIABLE);
+    }
+
+    return endpoint;
+}
+
+// `<address>:<port>`, or only the port for the loopback interface. Nothing, the default, runs
+// the demo once instead of as a service.
+static std::optional<vk_socket::Endpoint> serviceEndpointFromEnvironment() {
+    const char* value = vk_config::get(SERVICE_ENVIRONMENT_VARIABLE);
+    if (value == nullptr || value[0] == '\0') {
+        return std::nullopt;
+    }
+
+    const auto endpoint = vk_socket::parseEndpoint(value, vk_service::DEFAULT_ADDRESS);
+    if (!endpoint.has_value()) {
+        VK_LOG_WARNING("Invalid service endpoint `{}` in {}, expected a port or <address>:<port>, running once", value, SERVICE_ENVIRONMENT_VARIABLE);
+    }
+
+    return endpoint;
+}
+
+// The local socket headless frames are shared with other processes at, or nothing.
+static std::optional<std::filesystem::path> frameExportPathFromEnvironment() {
+    const char* value = vk_config::get(FRAME_EXPORT_ENVIRONMENT_VARIABLE);
+    if (value == nullptr || value[0] == '\0') {
+        return std::nullopt;
+    }
+
+    return std::filesystem::path { value };
+}
+
+// The H.264 file headless frames are encoded to, or nothing.
+static std::optional<std::filesystem::path> videoEncodePathFromEnvironment() {
+    const char* value = vk_config::get(VIDEO_ENCODE_ENVIRONMENT_VARIABLE);
+    if (value == nullptr || value[0] == '\0') {
+        return std::nullopt;
+    }
+
+    return std::filesystem::path { value };
+}
+
+static bool lowLatencyFromEnvironment() {
+    const char* value = vk_config::get(LOW_LATENCY_ENVIRONMENT_VARIABLE);
+
+    return value != nullptr && std::string { value } == "on";
+}
+
+// A frame rate of zero leaves the frame rate unlimited, and nothing, when the variable is
+// unset, caps it at the refresh rate of the monitor the first window is on.
+static std::optional<double> frameLimitFromEnvironment() {
+    const char* value = vk_config::get(FRAME_LIMIT_ENVIRONMENT_VARIABLE);
+    if (value == nullptr || value[0] == '\0') {
+        return std::nullopt;
+    }
+
+    try {
+        const auto frameLimit = std::stod(std::string { value });
+        if (frameLimit >= 0.0) {
+            return frameLimit;
+        }
+    } catch (const std::exception&) {
+    }
+
+    VK_LOG_WARNING("Invalid frame limit `{}` in {}, expected frames per second, leaving the frame rate unlimited", value, FRAME_LIMIT_ENVIRONMENT_VARIABLE);
+
+    return 0.0;
+}
+
+static double renderScaleFromEnvironment() {
+    const char* value = vk_config::get(RENDER_SCALE_ENVIRONMENT_VARIABLE);
+    if (value == nullptr || value[0] == '\0') {
+        return 1.0;
+    }
+
+    try {
+        const auto renderScale = std::stod(std::string { value });
+        if (renderScale >= MIN_RENDER_SCALE && renderScale <= 1.0) {
+            return renderScale;
+        }
+    } catch (const std::exception&) {
+    }
+
+    VK_LOG_WARNING("Invalid render scale `{}` in {}, expected {} to 1, rendering at full resolution", value, RENDER_SCALE_ENVIRONMENT_VARIABLE, MIN_RENDER_SCALE);
+
+    return 1.0;
+}
+
+// The GPU frame time dynamic resolution holds, when it is asked for.
+static std::optional<double> gpuBudgetFromEnvironment() {
+    const char* value = vk_config::get(GPU_BUDGET_ENVIRONMENT_VARIABLE);
+    if (value == nullptr || value[0] == '\0') {
+        return std::nullopt;
+    }
+
+    try {
+        const auto budget = std::stod(std::string { value });
+        if (budget > 0.0) {
+            return budget;
+        }
+    } catch (const std::exception&) {
+    }
+
+    VK_LOG_WARNING("Invalid GPU budget `{}` in {}, expected milliseconds, leaving the resolution fixed", value, GPU_BUDGET_ENVIRONMENT_VARIABLE);
+
+    return std::nullopt;
+}
+
+// Unset, every subsystem gets the default budget, and zero leaves them all unlimited.
+static double cpuBudgetFromEnvironment() {
+    const char* value = vk_config::get(CPU_BUDGET_ENVIRONMENT_VARIABLE);
+    if (value == nullptr || value[0] == '\0') {
+        return vk_frame_budget::FrameBudget::DEFAULT_BUDGET_MILLISECONDS;
+    }
+
+    try {
+        const auto budget = std::stod(std::string { value });
+        if (budget >= 0.0) {
+            return budget;
+        }
+    } catch (const std::exception&) {
+    }
+
+    VK_LOG_WARNING(
+        "Invalid CPU budget `{}` in {}, expected milliseconds, using {} ms",
+        value,
+        CPU_BUDGET_ENVIRONMENT_VARIABLE,
+        vk_frame_budget::FrameBudget::DEFAULT_BUDGET_MILLISECONDS
+    );
+
+    return vk_frame_budget::FrameBudget::DEFAULT_BUDGET_MILLISECONDS;
+}
+
+// Unset, scaled frames are blitted to the swapchain image with a linear filter.
+static vk_upscaling::Upscaler upscalerFromEnvironment() {
+    const char* value = vk_config::get(UPSCALER_ENVIRONMENT_VARIABLE);
+    if (value == nullptr || value[0] == '\0') {
+        return vk_upscaling::Upscaler::Linear;
+    }
+
+    const auto upscaler = std::string { value };
+    if (upscaler == "linear") {
+        return vk_upscaling::Upscaler::Linear;
+    } else if (upscaler == "temporal") {
+        return vk_upscaling::Upscaler::Temporal;
+    }
+
+    VK_LOG_WARNING("Unknown upscaler `{}` in {}, expected linear or temporal, upscaling linearly", upscaler, UPSCALER_ENVIRONMENT_VARIABLE);
+
+    return vk_upscaling::Upscaler::Linear;
+}
+
+// Validating already names objects and labels command buffers, so this only matters to
+// release builds.
+static bool debugLabelsFromEnvironment() {
+    const char* value = vk_config::get(DEBUG_LABELS_ENVIRONMENT_VARIABLE);
+
+    return value != nullptr && std::string { value } == "on";
+}
+
+// Async compute is on wherever the device has a dedicated compute family, unless turned off.
+static bool asyncComputeFromEnvironment() {
+    const char* value = vk_config::get(ASYNC_COMPUTE_ENVIRONMENT_VARIABLE);
+
+    return value == nullptr || std::string { value } != "off";
+}
+
+static bool commandCacheFromEnvironment() {
+    const char* value = vk_config::get(COMMAND_CACHE_ENVIRONMENT_VARIABLE);
+
+    return value == nullptr || std::string { value } != "off";
+}
+
+static bool meshShadingFromEnvironment() {
+    const char* value = vk_config::get(MESH_SHADING_ENVIRONMENT_VARIABLE);
+
+    return value == nullptr || std::string { value } != "off";
+}
+
+static bool generatedCommandsFromEnvironment() {
+    const char* value = vk_config::get(GENERATED_COMMANDS_ENVIRONMENT_VARIABLE);
+
+    return value == nullptr || std::string { value } != "off";
+}
+
+static bool descriptorBufferFromEnvironment() {
+    const char* value = vk_config::get(DESCRIPTOR_BUFFER_ENVIRONMENT_VARIABLE);
+
+    return value == nullptr || std::string { value } != "off";
+}
+
+static bool shaderObjectsFromEnvironment() {
+    const char* value = vk_config::get(SHADER_OBJECTS_ENVIRONMENT_VARIABLE);
+
+    return value != nullptr && std::string { value } == "on";
+}
+
+static bool depthPrepassFromEnvironment() {
+    const char* value = vk_config::get(DEPTH_PREPASS_ENVIRONMENT_VARIABLE);
+
+    return value != nullptr && std::string { value } == "on";
+}
+
+static bool animationFromEnvironment() {
+    const char* value = vk_config::get(ANIMATION_ENVIRONMENT_VARIABLE);
+
+    return value != nullptr && std::string { value } == "on";
+}
+
+static bool terrainFromEnvironment() {
+    const char* value = vk_config::get(TERRAIN_ENVIRONMENT_VARIABLE);
+
+    return value != nullptr && std::string { value } == "on";
+}
+
+static bool postProcessFromEnvironment() {
+    const char* value = vk_config::get(POST_PROCESS_ENVIRONMENT_VARIABLE);
+
+    return value != nullptr && std::string { value } == "on";
+}
+
+// Unset, nothing in the scene is transparent.
+static std::optional<vk_transparency::Mode> transparencyFromEnvironment() {
+    const char* value = vk_config::get(TRANSPARENCY_ENVIRONMENT_VARIABLE);
+    if (value == nullptr || value[0] == '\0') {
+        return std::nullopt;
+    }
+
+    const auto mode = std::string { value };
+    if (mode == "off") {
+        return std::nullopt;
+    } else if (mode == "on" || mode == "weighted") {
+        return vk_transparency::Mode::WeightedBlended;
+    } else if (mode == "linked") {
+        return vk_transparency::Mode::LinkedList;
+    }
+
+    VK_LOG_WARNING("Unknown transparency `{}` in {}, expected off, weighted or linked, drawing nothing transparent", mode, TRANSPARENCY_ENVIRONMENT_VARIABLE);
+
+    return std::nullopt;
+}
+
+// Unset, the directional light casts its shadows through the near cascades and ray queries past
+// them, on devices that trace rays, and through cascades elsewhere.
+static vk_gpu_driven::ShadowMode shadowsFromEnvironment() {
+    const char* value = vk_config::get(SHADOWS_ENVIRONMENT_VARIABLE);
+    if (value == nullptr || value[0] == '\0') {
+        return vk_gpu_driven::ShadowMode::RayQuery;
+    }
+
+    const auto mode = std::string { value };
+    if (mode == "off") {
+        return vk_gpu_driven::ShadowMode::Off;
+    } else if (mode == "on" || mode == "cascades") {
+        return vk_gpu_driven::ShadowMode::Cascades;
+    } else if (mode == "virtual") {
+        return vk_gpu_driven::ShadowMode::Virtual;
+    } else if (mode == "ray_query") {
+        return vk_gpu_driven::ShadowMode::RayQuery;
+    }
+
+    VK_LOG_WARNING("Unknown shadows `{}` in {}, expected off, cascades, virtual or ray_query, using cascades", mode, SHADOWS_ENVIRONMENT_VARIABLE);
+
+    return vk_gpu_driven::ShadowMode::Cascades;
+}
+
+// The pixels of error a level of detail may show, where zero draws every instance in full.
+static float lodErrorFromEnvironment() {
+    const char* value = vk_config::get(LOD_ERROR_ENVIRONMENT_VARIABLE);
+    if (value == nullptr || value[0] == '\0') {
+        return vk_gpu_driven::DEFAULT_LOD_ERROR_PIXELS;
+    }
+
+    try {
+        const auto pixels = std::stod(std::string { value });
+        if (pixels >= 0.0) {
+            return static_cast<float>(pixels);
+        }
+    } catch (const std::exception&) {
+    }
+
+    VK_LOG_WARNING("Invalid level of detail error `{}` in {}, expected pixels, allowing {}", value, LOD_ERROR_ENVIRONMENT_VARIABLE, vk_gpu_driven::DEFAULT_LOD_ERROR_PIXELS);
+
+    return vk_gpu_driven::DEFAULT_LOD_ERROR_PIXELS;
+}
+
+static double tickRateFromEnvironment() {
+    const char* value = vk_config::get(TICK_RATE_ENVIRONMENT_VARIABLE);
+    if (value == nullptr || value[0] == '\0') {
+        return vk_simulation::DEFAULT_TICK_RATE;
+    }
+
+    try {
+        const auto tickRate = std::stod(std::string { value });
+        if (tickRate > 0.0) {
+            return tickRate;
+        }
+    } catch (const std::exception&) {
+    }
+
+    VK_LOG_WARNING("Invalid tick rate `{}` in {}, expected ticks per second, simulating {}", value, TICK_RATE_ENVIRONMENT_VARIABLE, vk_simulation::DEFAULT_TICK_RATE);
+
+    return vk_simulation::DEFAULT_TICK_RATE;
+}
+
+// One sample, the default, leaves the scene without multisampling.
+static uint32_t msaaSamplesFromEnvironment() {
+    const char* value = vk_config::get(MSAA_ENVIRONMENT_VARIABLE);
+    if (value == nullptr || value[0] == '\0') {
+        return 1;
+    }
+
+    try {
+        const auto samples = std::stoul(std::string { value });
+        if (samples >= 1 && samples <= MAX_MSAA_SAMPLES && std::has_single_bit(samples)) {
+            return static_cast<uint32_t>(samples);
+        }
+    } catch (const std::exception&) {
+    }
+
+    VK_LOG_WARNING("Invalid sample count `{}` in {}, expected a power of two from 1 to {}, not multisampling", value, MSAA_ENVIRONMENT_VARIABLE, MAX_MSAA_SAMPLES);
+
+    return 1;
+}
+
+// The most samples up to `limit` that both the color and the depth attachments of a
+// framebuffer support. Every device supports one and four.
+static VkSampleCountFlagBits maxSampleCount(const VkPhysicalDeviceLimits& limits, uint32_t limit) {
+    const auto supported = limits.framebufferColorSampleCounts & limits.framebufferDepthSampleCounts;
+    for (auto samples = std::bit_floor(limit); samples > 1; samples /= 2) {
+        if ((supported & samples) != 0) {
+            return static_cast<VkSampleCountFlagBits>(samples);
+        }
+    }
+
+    return VK_SAMPLE_COUNT_1_BIT;
+}
+
+// Unset, the scene is shaded at full rate.
+static vk_shading_rate::Mode shadingRateFromEnvironment() {
+    const char* value = vk_config::get(SHADING_RATE_ENVIRONMENT_VARIABLE);
+    if (value == nullptr || value[0] == '\0') {
+        return vk_shading_rate::Mode::Off;
+    }
+
+    const auto mode = std::string { value };
+    if (mode == "off") {
+        return vk_shading_rate::Mode::Off;
+    } else if (mode == "coarse") {
+        return vk_shading_rate::Mode::Coarse;
+    } else if (mode == "foveated") {
+        return vk_shading_rate::Mode::Foveated;
+    }
+
+    VK_LOG_WARNING("Unknown shading rate `{}` in {}, expected off, coarse or foveated, shading at full rate", mode, SHADING_RATE_ENVIRONMENT_VARIABLE);
+
+    return vk_shading_rate::Mode::Off;
+}
+
+static std::optional<std::filesystem::path> assetPackPathFromEnvironment() {
+    const char* value = vk_config::get(ASSET_PACK_ENVIRONMENT_VARIABLE);
+    if (value == nullptr || value[0] == '\0') {
+        return std::nullopt;
+    }
+
+    return std::filesystem::path { value };
+}
+
+// Unset, the strategy follows from whether the device has a resizable BAR.
+static std::optional<vk_memory::UploadStrategy> uploadStrategyFromEnvironment() {
+    const char* value = vk_config::get(UPLOAD_STRATEGY_ENVIRONMENT_VARIABLE);
+    if (value == nullptr || value[0] == '\0') {
+        return std::nullopt;
+    }
+
+    const auto strategy = std::string { value };
+    if (strategy == "direct") {
+        return vk_memory::UploadStrategy::Direct;
+    } else if (strategy == "staged") {
+        return vk_memory::UploadStrategy::Staged;
+    }
+
+    VK_LOG_WARNING("Unknown upload strategy `{}` in {}, expected direct or staged, picking one for the device", strategy, UPLOAD_STRATEGY_ENVIRONMENT_VARIABLE);
+
+    return std::nullopt;
+}
+
+static bool thermalGovernorFromEnvironment() {
+    const char* value = vk_config::get(THERMAL_GOVERNOR_ENVIRONMENT_VARIABLE);
+
+    return value == nullptr || std::string { value } != "off";
+}
+
+static bool hostImageCopyFromEnvironment() {
+    const char* value = vk_config::get(HOST_IMAGE_COPY_ENVIRONMENT_VARIABLE);
+
+    return value == nullptr || std::string { value } != "off";
+}
+
+// No instances, the default, leaves the GPU driven scene out.
+static uint32_t instanceCountFromEnvironment() {
+    const char* value = vk_config::get(INSTANCE_COUNT_ENVIRONMENT_VARIABLE);
+    if (value == nullptr || value[0] == '\0') {
+        return 0;
+    }
+
+    try {
+        const auto instanceCount = std::stoul(std::string { value });
+        if (instanceCount <= MAX_INSTANCE_COUNT) {
+            return static_cast<uint32_t>(instanceCount);
+        }
+    } catch (const std::exception&) {
+    }
+
+    VK_LOG_WARNING("Invalid instance count `{}` in {}, expected 0 to {}, drawing no scene", value, INSTANCE_COUNT_ENVIRONMENT_VARIABLE, MAX_INSTANCE_COUNT);
+
+    return 0;
+}
+
+// No lights, the default, lights the scene with its directional light only.
+static uint32_t lightCountFromEnvironment() {
+    const char* value = vk_config::get(LIGHT_COUNT_ENVIRONMENT_VARIABLE);
+    if (value == nullptr || value[0] == '\0') {
+        return 0;
+    }
+
+    try {
+        const auto lightCount = std::stoul(std::string { value });
+        if (lightCount <= MAX_LIGHT_COUNT) {
+            return static_cast<uint32_t>(lightCount);
+        }
+    } catch (const std::exception&) {
+    }
+
+    VK_LOG_WARNING("Invalid light count `{}` in {}, expected 0 to {}, adding no lights", value, LIGHT_COUNT_ENVIRONMENT_VARIABLE, MAX_LIGHT_COUNT);
+
+    return 0;
+}
+
+// No particles, the default, leaves the particle system out.
+static uint32_t particleCountFromEnvironment() {
+    const char* value = vk_config::get(PARTICLE_COUNT_ENVIRONMENT_VARIABLE);
+    if (value == nullptr || value[0] == '\0') {
+        return 0;
+    }
+
+    try {
+        const auto particleCount = std::stoul(std::string { value });
+        if (particleCount <= MAX_PARTICLE_COUNT) {
+            return static_cast<uint32_t>(particleCount);
+        }
+    } catch (const std::exception&) {
+    }
+
+    VK_LOG_WARNING("Invalid particle count `{}` in {}, expected 0 to {}, drawing no particles", value, PARTICLE_COUNT_ENVIRONMENT_VARIABLE, MAX_PARTICLE_COUNT);
+
+    return 0;
+}
+
+static uint32_t widgetCountFromEnvironment() {
+    const char* value = vk_config::get(WIDGETS_ENVIRONMENT_VARIABLE);
+    if (value == nullptr || value[0] == '\0') {
+        return 0;
+    }
+
+    try {
+        const auto widgetCount = std::stoul(std::string { value });
+        if (widgetCount <= MAX_WIDGET_COUNT) {
+            return static_cast<uint32_t>(widgetCount);
+        }
+    } catch (const std::exception&) {
+    }
+
+    VK_LOG_WARNING("Invalid widget count `{}` in {}, expected 0 to {}, drawing no widgets", value, WIDGETS_ENVIRONMENT_VARIABLE, MAX_WIDGET_COUNT);
+
+    return 0;
+}
+
+static bool frameTelemetryFromEnvironment() {
+    const char* value = vk_config::get(FRAME_TELEMETRY_ENVIRONMENT_VARIABLE);
+
+    return value != nullptr && std::string { value } == "json";
+}
+
+static vk_log::Format logFormatFromEnvironment() {
+    const char* value = vk_config::get(LOG_FORMAT_ENVIRONMENT_VARIABLE);
+
+    return value != nullptr && std::string { value } == "json" ? vk_log::Format::Json : vk_log::Format::Text;
+}
+
+static bool pipelineStatisticsFromEnvironment() {
+    const char* value = vk_config::get(PIPELINE_STATISTICS_ENVIRONMENT_VARIABLE);
+
+    return value != nullptr && std::string { value } == "on";
+}
+
+// Comma separated parts of the names of the hardware counters to read, or `list` to print
+// every counter of the device. Nothing leaves the counters off.
+static std::vector<std::string> performanceCountersFromEnvironment() {
+    const char* value = vk_config::get(PERFORMANCE_COUNTERS_ENVIRONMENT_VARIABLE);
+    if (value == nullptr) {
+        return {};
+    }
+
+    auto patterns = std::vector<std::string> {};
+    auto stream = std::istringstream { value };
+    auto pattern = std::string {};
+    while (std::getline(stream, pattern, ',')) {
+        if (!pattern.empty()) {
+            patterns.push_back(pattern);
+        }
+    }
+
+    return patterns;
+}
+
+static bool crashDiagnosticsFromEnvironment() {
+    const char* value = vk_config::get(CRASH_DIAGNOSTICS_ENVIRONMENT_VARIABLE);
+
+    return value != nullptr && std::string { value } == "on";
+}
+
+// The number of frames to render without a window, or nothing to open a window as usual.
+static std::optional<uint64_t> headlessFrameCountFromEnvironment() {
+    const char* value = vk_config::get(HEADLESS_ENVIRONMENT_VARIABLE);
+    if (value == nullptr || value[0] == '\0') {
+        return std::nullopt;
+    }
+
+    try {
+        const auto frameCount = std::stoull(std::string { value });
+        if (frameCount > 0) {
+            return frameCount;
+        }
+    } catch (const std::exception&) {
+    }
+
+    VK_LOG_WARNING("Invalid frame count `{}` in {}, opening a window", value, HEADLESS_ENVIRONMENT_VARIABLE);
+
+    return std::nullopt;
+}
+
+// A benchmark run renders for a fixed number of frames or seconds with vsync off, then writes
+// its frame time statistics to `output`.
+struct BenchmarkSettings {
+    std::optional<uint64_t> frameCount;
+    std::optional<double> seconds;
+    std::filesystem::path output;
+};
+
+static std::optional<BenchmarkSettings> benchmarkSettingsFromEnvironment() {
+    auto settings = BenchmarkSettings { .output = "bench.json" };
+    try {
+        const char* frames = vk_config::get(BENCH_FRAMES_ENVIRONMENT_VARIABLE);
+        if (frames != nullptr && frames[0] != '\0') {
+            settings.frameCount = std::stoull(std::string { frames });
+        }
+
+        const char* seconds = vk_config::get(BENCH_SECONDS_ENVIRONMENT_VARIABLE);
+        if (seconds != nullptr && seconds[0] != '\0') {
+            settings.seconds = std::stod(std::string { seconds });
+        }
+    } catch (const std::exception&) {
+        VK_LOG_WARNING("Invalid benchmark length in {} or {}, not benchmarking", BENCH_FRAMES_ENVIRONMENT_VARIABLE, BENCH_SECONDS_ENVIRONMENT_VARIABLE);
+
+        return std::nullopt;
+    }
+
+    if (!settings.frameCount.has_value() && !settings.seconds.has_value()) {
+        return std::nullopt;
+    }
+
+    const char* output = vk_config::get(BENCH_OUTPUT_ENVIRONMENT_VARIABLE);
+    if (output != nullptr && output[0] != '\0') {
+        settings.output = output;
+    }
+
+    return settings;
+}
+
+// One axis of a benchmark sweep: a setting, named as on the command line, and the values the
+// app is rerun with, one benchmark run each.
+struct BenchmarkSweepAxis {
+    std::string setting;
+    std::vector<std::string> values;
+};
+
+// Axes separated by `;`, like `instance-count=1000,10000,100000;job-threads=1,2,4,8`, each
+// swept on its own with the other settings as they are, so every axis gives one scaling
+// curve. No axes, the default, benchmarks once.
+static std::vector<BenchmarkSweepAxis> benchmarkSweepFromEnvironment() {
+    const char* value = vk_config::get(BENCH_SWEEP_ENVIRONMENT_VARIABLE);
+    if (value == nullptr || value[0] == '\0') {
+        return {};
+    }
+
+    auto axes = std::vector<BenchmarkSweepAxis> {};
+    auto text = std::string_view { value };
+    while (!text.empty()) {
+        const auto end = std::min(text.find(';'), text.size());
+        const auto axis = vk_config::trim(text.substr(0, end));
+        text.remove_prefix(std::min(end + 1, text.size()));
+        if (axis.empty()) {
+            continue;
+        }
+
+        const auto separator = axis.find('=');
+        if (separator == std::string_view::npos || separator == 0 || separator + 1 == axis.size()) {
+            VK_LOG_WARNING("Invalid sweep `{}` in {}, expected `setting=value,value,...`, not sweeping", axis, BENCH_SWEEP_ENVIRONMENT_VARIABLE);
+
+            return {};
+        }
+
+        auto sweep = BenchmarkSweepAxis { .setting = std::string { vk_config::trim(axis.substr(0, separator)) } };
+        auto values = axis.substr(separator + 1);
+        while (!values.empty()) {
+            const auto comma = std::min(values.find(','), values.size());
+            if (const auto point = vk_config::trim(values.substr(0, comma)); !point.empty()) {
+                sweep.values.emplace_back(point);
+            }
+
+            values.remove_prefix(std::min(comma + 1, values.size()));
+        }
+
+        axes.push_back(std::move(sweep));
+    }
+
+    return axes;
+}
+
+// The file to write a capture of every frame to, or nothing to not capture.
+static std::optional<std::filesystem::path> capturePathFromEnvironment() {
+    const char* value = vk_config::get(CAPTURE_ENVIRONMENT_VARIABLE);
+    if (value == nullptr || value[0] == '\0') {
+        return std::nullopt;
+    }
+
+    return std::filesystem::path { value };
+}
+
+// A capture to replay headless in place of `HELLO_WINDOW_HEADLESS`, or nothing.
+static std::optional<std::filesystem::path> replayPathFromEnvironment() {
+    const char* value = vk_config::get(REPLAY_ENVIRONMENT_VARIABLE);
+    if (value == nullptr || value[0] == '\0') {
+        return std::nullopt;
+    }
+
+    return std::filesystem::path { value };
+}
+
+static uint32_t initBenchmarkIterationsFromEnvironment() {
+    const char* value = vk_config::get(INIT_BENCH_ENVIRONMENT_VARIABLE);
+    if (value == nullptr || value[0] == '\0') {
+        return 0;
+    }
+
+    try {
+        return static_cast<uint32_t>(std::stoul(std::string { value }));
+    } catch (const std::exception&) {
+        VK_LOG_WARNING("Invalid iteration count `{}` in {}, skipping the init benchmarks", value, INIT_BENCH_ENVIRONMENT_VARIABLE);
+
+        return 0;
+    }
+}
+
+static uint32_t windowCountFromEnvironment() {
+    const char* value = vk_config::get(WINDOW_COUNT_ENVIRONMENT_VARIABLE);
+    if (value == nullptr || value[0] == '\0') {
+        return 1;
+    }
+
+    try {
+        const auto windowCount = std::stoul(std::string { value });
+        if (windowCount > 0 && windowCount <= MAX_WINDOW_COUNT) {
+            return static_cast<uint32_t>(windowCount);
+        }
+    } catch (const std::exception&) {
+    }
+
+    VK_LOG_WARNING("Invalid window count `{}` in {}, expected 1 to {}, opening one window", value, WINDOW_COUNT_ENVIRONMENT_VARIABLE, MAX_WINDOW_COUNT);
+
+    return 1;
+}
+
+// A count of `min` to `max`, or nothing when `variable` is unset or out of range, which leaves
+// the choice to the caller.
+static std::optional<uint32_t> countFromEnvironment(const char* variable, const char* name, uint32_t min, uint32_t max) {
+    const char* value = vk_config::get(variable);
+    if (value == nullptr || value[0] == '\0') {
+        return std::nullopt;
+    }
+
+    try {
+        const auto count = std::stoul(std::string { value });
+        if (count >= min && count <= max) {
+            return static_cast<uint32_t>(count);
+        }
+    } catch (const std::exception&) {
+    }
+
+    VK_LOG_WARNING("Invalid {} `{}` in {}, expected {} to {}, falling back to the default", name, value, variable, min, max);
+
+    return std::nullopt;
+}
+
+static uint32_t framesInFlightFromEnvironment() {
+    return countFromEnvironment(FRAMES_IN_FLIGHT_ENVIRONMENT_VARIABLE, "frame count", 1, MAX_FRAMES_IN_FLIGHT).value_or(DEFAULT_FRAMES_IN_FLIGHT);
+}
+
+// Nothing, the default, sizes the swapchain by the queue depth.
+static std::optional<uint32_t> swapchainImageCountFromEnvironment() {
+    return countFromEnvironment(SWAPCHAIN_IMAGES_ENVIRONMENT_VARIABLE, "image count", 1, MAX_SWAPCHAIN_IMAGE_COUNT);
+}
+
+static uint32_t recordingThreadCountFromEnvironment() {
+    return countFromEnvironment(RECORDING_THREADS_ENVIRONMENT_VARIABLE, "thread count", 1, MAX_RECORDING_THREAD_COUNT).value_or(DEFAULT_RECORDING_THREAD_COUNT);
+}
+
+// Nothing, the default, starts a worker for every core but the main thread's.
+static std::optional<uint32_t> jobThreadCountFromEnvironment() {
+    return countFromEnvironment(JOB_THREADS_ENVIRONMENT_VARIABLE, "thread count", 1, MAX_JOB_THREAD_COUNT);
+}
+
+// Launches of each condition, or none, the default, to start the app itself.
+static uint32_t startupBenchRunsFromEnvironment() {
+    return countFromEnvironment(STARTUP_BENCH_ENVIRONMENT_VARIABLE, "run count", 0, MAX_STARTUP_BENCH_RUNS).value_or(0);
+}
+
+static bool threadPlacementFromEnvironment() {
+    const char* value = vk_config::get(THREAD_PLACEMENT_ENVIRONMENT_VARIABLE);
+
+    return value == nullptr || std::string { value } != "off";
+}
+
+// In bit/s.
+static uint32_t videoBitrateFromEnvironment() {
+    const auto kilobits = countFromEnvironment(VIDEO_BITRATE_ENVIRONMENT_VARIABLE, "bitrate", 1, MAX_VIDEO_BITRATE_KBPS).value_or(DEFAULT_VIDEO_BITRATE_KBPS);
+
+    return kilobits * 1000;
+}
+
+// The directory frames are dumped to, with one in how many frames, or nothing.
+static std::optional<vk_frame_dump::FrameDumpSettings> frameDumpFromEnvironment() {
+    const char* value = vk_config::get(FRAME_DUMP_ENVIRONMENT_VARIABLE);
+    if (value == nullptr || value[0] == '\0') {
+        return std::nullopt;
+    }
+
+    return vk_frame_dump::FrameDumpSettings {
+        .directory = std::filesystem::path { value },
+        .interval = countFromEnvironment(FRAME_DUMP_INTERVAL_ENVIRONMENT_VARIABLE, "frame interval", 1, MAX_FRAME_DUMP_INTERVAL).value_or(DEFAULT_FRAME_DUMP_INTERVAL),
+        .queueDepth = FRAME_DUMP_QUEUE_DEPTH,
+    };
+}
+
+static std::chrono::milliseconds acquireTimeoutFromEnvironment() {
+    const auto milliseconds = countFromEnvironment(ACQUIRE_TIMEOUT_ENVIRONMENT_VARIABLE, "timeout", 1, MAX_ACQUIRE_TIMEOUT_MS).value_or(DEFAULT_ACQUIRE_TIMEOUT_MS);
+
+    return std::chrono::milliseconds { milliseconds };
+}
+
+// The display to present to directly, or nothing, the default, which opens windows.
+static std::optional<uint32_t> displayIndexFromEnvironment() {
+    return countFromEnvironment(DISPLAY_ENVIRONMENT_VARIABLE, "display index", 0, MAX_DISPLAY_INDEX);
+}
+
+// The monitor the first window goes fullscreen on, or nothing, the default, for a window.
+static std::optional<uint32_t> fullscreenMonitorFromEnvironment() {
+    return countFromEnvironment(FULLSCREEN_ENVIRONMENT_VARIABLE, "monitor index", 0, MAX_MONITOR_INDEX);
+}
+
+// A buffer size given in MiB, in bytes.
+static VkDeviceSize bufferSizeFromEnvironment(const char* variable, uint32_t defaultMebibytes) {
+    const auto mebibytes = countFromEnvironment(variable, "buffer size", 1, MAX_BUFFER_MIB).value_or(defaultMebibytes);
+
+    return VkDeviceSize { mebibytes } * 1024 * 1024;
+}
+
+// `<width>x<height>`, like `1920x1080`.
+static VkExtent2D windowSizeFromEnvironment() {
+    const char* value = vk_config::get(WINDOW_SIZE_ENVIRONMENT_VARIABLE);
+    if (value == nullptr || value[0] == '\0') {
+        return VkExtent2D { WIDTH, HEIGHT };
+    }
+
+    const auto size = std::string_view { value };
+    const auto separator = size.find('x');
+    if (separator != std::string_view::npos) {
+        try {
+            const auto width = std::stoul(std::string { size.substr(0, separator) });
+            const auto height = std::stoul(std::string { size.substr(separator + 1) });
+            if (width > 0 && height > 0 && width <= MAX_WINDOW_DIMENSION && height <= MAX_WINDOW_DIMENSION) {
+                return VkExtent2D { static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
+            }
+        } catch (const std::exception&) {
+        }
+    }
+
+    VK_LOG_WARNING("Invalid window size `{}` in {}, expected <width>x<height> of up to {}, falling back to {}x{}", value, WINDOW_SIZE_ENVIRONMENT_VARIABLE, MAX_WINDOW_DIMENSION, WIDTH, HEIGHT);
+
+    return VkExtent2D { WIDTH, HEIGHT };
+}
+
+static vk_device_group::DeviceGroupMode deviceGroupModeFromEnvironment() {
+    const char* value = vk_config::get(DEVICE_GROUP_ENVIRONMENT_VARIABLE);
+    if (value == nullptr) {
+        return vk_device_group::DeviceGroupMode::Off;
+    }
+
+    const auto mode = vk_device_group::deviceGroupModeFromString(value);
+    if (!mode.has_value()) {
+        VK_LOG_WARNING("Unknown device group mode `{}` in {}, falling back to off", value, DEVICE_GROUP_ENVIRONMENT_VARIABLE);
+
+        return vk_device_group::DeviceGroupMode::Off;
+    }
+
+    return mode.value();
+}
+
+static std::filesystem::path pipelineCacheDirectoryFromEnvironment() {
+    const char* value = vk_config::get(PIPELINE_CACHE_DIRECTORY_ENVIRONMENT_VARIABLE);
+    if (value != nullptr && value[0] != '\0') {
+        return std::filesystem::path { value };
+    }
+
+    return std::filesystem::current_path();
+}
+
+static vk_validation::ValidationPolicy validationPolicyFromEnvironment() {
+    const char* value = vk_config::get(VALIDATION_ENVIRONMENT_VARIABLE);
+    if (value == nullptr) {
+        return DEFAULT_VALIDATION_POLICY;
+    }
+
+    const auto policy = vk_validation::validationPolicyFromString(value);
+    if (!policy.has_value()) {
+        VK_LOG_WARNING(
+            "Unknown validation policy `{}` in {}, falling back to {}",
+            value,
+            VALIDATION_ENVIRONMENT_VARIABLE,
+            vk_validation::validationPolicyToString(DEFAULT_VALIDATION_POLICY)
+        );
+
+        return DEFAULT_VALIDATION_POLICY;
+    }
+
+    return policy.value();
+}
+
+static vk_surface::SurfaceFormatPolicy surfaceFormatPolicyFromEnvironment() {
+    const char* value = vk_config::get(SURFACE_FORMAT_ENVIRONMENT_VARIABLE);
+    if (value == nullptr) {
+        return vk_surface::SurfaceFormatPolicy::Sdr;
+    }
+
+    const auto policy = vk_surface::surfaceFormatPolicyFromString(value);
+    if (!policy.has_value()) {
+        VK_LOG_WARNING("Unknown surface format policy `{}` in {}, falling back to sdr", value, SURFACE_FORMAT_ENVIRONMENT_VARIABLE);
+
+        return vk_surface::SurfaceFormatPolicy::Sdr;
+    }
+
+    return policy.value();
+}
+
+static vk_host_memory::HostAllocatorMode hostAllocatorModeFromEnvironment() {
+    const char* value = vk_config::get(HOST_ALLOCATOR_ENVIRONMENT_VARIABLE);
+    if (value == nullptr) {
+        return vk_host_memory::HostAllocatorMode::Driver;
+    }
+
+    const auto mode = std::string { value };
+    if (mode == "driver") {
+        return vk_host_memory::HostAllocatorMode::Driver;
+    } else if (mode == "tracking") {
+        return vk_host_memory::HostAllocatorMode::Tracking;
+    } else if (mode == "arena") {
+        return vk_host_memory::HostAllocatorMode::Arena;
+    }
+
+    VK_LOG_WARNING("Unknown host allocator `{}` in {}, falling back to the driver's", mode, HOST_ALLOCATOR_ENVIRONMENT_VARIABLE);
+
+    return vk_host_memory::HostAllocatorMode::Driver;
+}
+
+static vk_allocation_tracking::AllocationCheck allocationCheckFromEnvironment() {
+    const char* value = vk_config::get(ALLOCATION_CHECK_ENVIRONMENT_VARIABLE);
+    if (value == nullptr) {
+        return vk_allocation_tracking::AllocationCheck::Off;
+    }
+
+    const auto check = std::string { value };
+    if (!HELLO_WINDOW_ALLOCATION_TRACKING) {
+        VK_LOG_WARNING("{} needs a build with HELLO_WINDOW_ALLOCATION_TRACKING, ignoring it", ALLOCATION_CHECK_ENVIRONMENT_VARIABLE);
+
+        return vk_allocation_tracking::AllocationCheck::Off;
+    } else if (check == "off") {
+        return vk_allocation_tracking::AllocationCheck::Off;
+    } else if (check == "report") {
+        return vk_allocation_tracking::AllocationCheck::Report;
+    } else if (check == "assert") {
+        return vk_allocation_tracking::AllocationCheck::Assert;
+    }
+
+    VK_LOG_WARNING("Unknown allocation check `{}` in {}, falling back to off", check, ALLOCATION_CHECK_ENVIRONMENT_VARIABLE);
+
+    return vk_allocation_tracking::AllocationCheck::Off;
+}
+
+static const char* presentModeToString(VkPresentModeKHR presentMode) {
+    switch (presentMode) {
+        case VK_PRESENT_MODE_IMMEDIATE_KHR: return "IMMEDIATE";
+        case VK_PRESENT_MODE_MAILBOX_KHR: return "MAILBOX";
+        case VK_PRESENT_MODE_FIFO_KHR: return "FIFO";
+        case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "FIFO_RELAXED";
+        default: return "UNKNOWN";
+    }
+}
+
+// The compute and transfer families are only set when the device has a family dedicated to
+// that kind of work, i.e. a compute family without graphics, or a transfer family without
+// graphics or compute. Work submitted to those runs asynchronously next to graphics work.
+struct QueueFamilyIndices {
+    std::optional<uint32_t> graphicsFamily;
+    std::optional<uint32_t> presentFamily;
+    std::optional<uint32_t> computeFamily;
+    std::optional<uint32_t> transferFamily;
+    // Only looked for when headless frames are encoded.
+    std::optional<uint32_t> videoEncodeFamily;
+
+    // Rendering headless needs no present queue.
+    bool isComplete(bool presentRequired) const {
+        return graphicsFamily.has_value() && (presentFamily.has_value() || !presentRequired);
+    }
+};
+
+// Everything the renderer needs to know about a physical device, queried from the driver
+// once during device selection. Enumerating a device is a driver round-trip per call, which
+// dominates startup time on remote and virtualized GPUs, so every later stage reads from here.
+// Surface capabilities are not cached, since the current extent changes with the window.
+struct PhysicalDeviceInfo {
+    VkPhysicalDevice physicalDevice;
+    VkPhysicalDeviceProperties properties;
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vk_features::FeatureChain features;
+    std::array<uint8_t, VK_UUID_SIZE> uuid;
+    std::vector<VkQueueFamilyProperties> queueFamilies;
+    std::vector<VkExtensionProperties> extensions;
+    // The codecs each queue family encodes, only queried when headless frames are encoded.
+    std::vector<VkVideoCodecOperationFlagsKHR> videoEncodeCodecs;
+    std::vector<VkSurfaceFormatKHR> surfaceFormats;
+    std::vector<VkPresentModeKHR> presentModes;
+    QueueFamilyIndices queueFamilyIndices;
+};
+
+// Physical devices are ranked by comparing these fields in order: the device type first, so
+// a discrete GPU always wins over an integrated one, then the size of the largest device local
+// heap, then the number of dedicated compute and transfer queue families, then the number of
+// optional features the renderer can make use of.
+struct PhysicalDeviceScore {
+    uint32_t deviceTypeRank;
+    VkDeviceSize deviceLocalHeapSize;
+    uint32_t queueCapabilities;
+    uint32_t supportedFeatures;
+
+    auto operator<=>(const PhysicalDeviceScore& other) const = default;
+};
+
+struct SwapImageCountSelection {
+    uint32_t imageCount;
+    std::string reason;
+};
+
+struct SwapChainSupportDetails {
+    VkSurfaceCapabilitiesKHR capabilities;
+    std::vector<VkSurfaceFormatKHR> formats;
+    std::vector<VkPresentModeKHR> presentModes;
+};
+
+// The command buffer the GPU benchmarks record into, from a transient pool of its own that
+// is reset after every submission.
+struct BenchmarkCommands {
+    vk_handles::CommandPool commandPool;
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+};
+
+// A buffer a GPU benchmark reads or writes, with memory of its own.
+struct BenchmarkBuffer {
+    vk_memory::ScopedAllocation memory;
+    vk_handles::Buffer buffer;
+    VkDeviceAddress address = 0;
+};
+
+// The present queue's half of an exclusive ownership transfer: one prerecorded command buffer
+// per swapchain image acquiring it from the graphics family, and the semaphore the present
+// waits on once it has.
+struct PresentOwnershipTransfer {
+    vk_handles::CommandPool commandPool;
+    std::vector<VkCommandBuffer> acquireCommandBuffers;
+    std::vector<vk_handles::Semaphore> acquiredSemaphores;
+};
+
+// The objects belonging to a swapchain that was replaced during recreation. They stay alive
+// until every frame submitted before the swapchain was retired has finished on the GPU.
+// Members are destroyed in reverse order, so the views and semaphores go before the swapchain.
+struct RetiredSwapChain {
+    vk_handles::SwapChain swapChain;
+    std::vector<vk_handles::Image> splitImages;
+    std::vector<vk_handles::ImageView> imageViews;
+    std::vector<vk_handles::Semaphore> renderFinishedSemaphores;
+    std::vector<vk_handles::Fence> presentFences;
+    vk_compute_present::PresentTargets presentTargets;
+    PresentOwnershipTransfer ownershipTransfer;
+};
+
+// Everything one window presents with: its surface and swapchain, the views and per image
+// objects of the swapchain, and the acquire semaphore of each frame slot. All windows share the
+// instance, the device and each frame's submission and present. Rendering headless uses a
+// single presenter without a window or swapchain, whose images are the offscreen images.
+struct WindowPresenter {
+    // Position in the app's presenters. The first window picks the device and is the one
+    // paced to the display.
+    uint32_t index = 0;
+    GLFWwindow* window = nullptr;
+    // Set for a fullscreen window, which asks for exclusive fullscreen where the driver offers it.
+    GLFWmonitor* monitor = nullptr;
+    vk_fullscreen::Exclusivity exclusivity = vk_fullscreen::Exclusivity::Unavailable;
+    vk_handles::Surface surface;
+    // The support on `surfaceMonitor` the swapchain is made with, out of `surfaceSupport`,
+    // which the first window seeds from the physical device cache. `monitorGeneration` is the
+    // `vk_fullscreen::monitorGeneration` it was cached under.
+    std::vector<VkSurfaceFormatKHR> surfaceFormats;
+    std::vector<VkPresentModeKHR> presentModes;
+    vk_surface::SurfaceSupportCache surfaceSupport;
+    GLFWmonitor* surfaceMonitor = nullptr;
+    uint32_t monitorGeneration = 0;
+    // Raised when the swapchain went out of date without a resize to explain it, when the
+    // support on the current monitor may have changed under the cached one.
+    bool surfaceSupportOutdated = false;
+
+    vk_handles::SwapChain swapChain;
+    // In split frame mode, `images` are the split images aliasing the swapchain's, and each
+    // device renders the strip of `deviceRenderAreas` at its own index.
+    std::vector<VkImage> images;
+    std::vector<vk_handles::Image> splitImages;
+    std::vector<VkRect2D> deviceRenderAreas;
+    VkFormat imageFormat = VK_FORMAT_UNDEFINED;
+    VkColorSpaceKHR colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+    VkExtent2D extent {};
+    VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+    VkImageUsageFlags imageUsage = 0;
+    // Owned by the app's image view cache, and released from it with the images.
+    std::vector<VkImageView> imageViews;
+    // Whether the current swapchain was created for the compute present path.
+    bool computePresent = false;
+    // Whether the current swapchain was created for rendering at the render scale, into a
+    // transient image of the frame's render graph that is blitted up into the swapchain image.
+    bool scaledRendering = false;
+    // Whether the scene renders into an HDR image the post processing pass then writes into
+    // the swapchain image, as a storage image with `postStorage` and a color attachment
+    // otherwise.
+    bool postProcessed = false;
+    bool postStorage = false;
+    // Whether the current swapchain can take the shared scene of window compositing, blitted
+    // into it, which takes neither of the paths above.
+    bool compositable = false;
+    vk_compute_present::PresentTargets presentTargets;
+    // Whether the current swapchain is exclusive to one family at a time while the graphics
+    // and present families differ, so every frame transfers its image.
+    bool ownershipTransfer = false;
+    PresentOwnershipTransfer presentOwnershipTransfer;
+
+    std::vector<vk_handles::Semaphore> imageAvailableSemaphores;
+    std::vector<vk_handles::Semaphore> renderFinishedSemaphores;
+    // With `VK_EXT_swapchain_maintenance1`, a fence per swapchain image signaled once the
+    // presentation engine is done with the image's last present, and the present modes the
+    // swapchain was created to switch between without being recreated.
+    std::vector<vk_handles::Fence> presentFences;
+    std::vector<VkPresentModeKHR> switchablePresentModes;
+
+    // The framebuffer size the renderer last took from the main thread, which it sizes the
+    // swapchain to. GLFW only reports sizes on the main thread.
+    VkExtent2D framebufferExtent {};
+    // Some platforms keep the framebuffer size of an iconified window, so it is tracked too.
+    bool iconified = false;
+    bool framebufferResized = false;
+    bool swapChainOutdated = false;
+};
+
+// A screenshot copied into the readback ring, which is written out once its frame is done.
+struct Screenshot {
+    std::filesystem::path path;
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkExtent2D extent {};
+    std::future<std::vector<std::byte>> texels;
+};
+
+// A window taking part in the current frame, and the swapchain image it acquired.
+struct PresentingWindow {
+    uint32_t presenterIndex;
+    uint32_t imageIndex;
+};
+
+// The first window's scene, rendered once into an offscreen image of the frame's render graph
+// for every window of the frame to blit from.
+struct SharedScene {
+    vk_render_graph::ResourceId image;
+    VkExtent2D extent;
+};
+
+class App {
+    public:
+        explicit App() = default;
+
+        ~App() {
+            this->cleanup();
+        }
+
+        // Failures the driver reports come back with their `VkResult`, and the rest, like a
+        // missing GPU or a bad configuration, are thrown.
+        vk_result::Status run() {
+            vk_log::logger().setFormat(logFormatFromEnvironment());
+            if (m_initBenchmarkIterations > 0) {
+                vk_dispatch::enableHooks();
+            }
+            m_startupProfiler.measure("loadVulkanLoader", []() { vk_dispatch::loadLoader(); });
+            m_hostAllocator.init(hostAllocatorModeFromEnvironment());
+            m_allocationCheck.init(allocationCheckFromEnvironment());
+            m_startupProfiler.measure("startJobSystem", [this]() { this->startJobSystem(); });
+            this->loadReplay();
+            this->startService();
+            this->startBenchmark();
+            this->configureDisplay();
+            VK_RESULT_TRY(this->initInstanceAndWindow());
+            VK_RESULT_TRY(this->initVulkan());
+            this->startCapture();
+            this->benchmarkInitHelpers();
+            if (!m_exitAfterStartup) {
+                VK_RESULT_TRY(this->mainLoop());
+            }
+            m_captureWriter.close();
+            this->writeBenchmarkResults();
+            // Every setting that changes anything has been read by now.
+            vk_config::config().reportUnused();
+            // The reports write to stdout directly, after whatever the run logged.
+            vk_log::flush();
+            this->reportStartupTimes();
+            m_gpuProfiler.report(std::cout);
+            m_clockCalibration.report(std::cout);
+            m_submitBatcher.report(std::cout);
+            m_sceneCommandCache.report(std::cout);
+            m_pipelineStatistics.report(std::cout);
+            m_performanceCounters.report(std::cout);
+            if (this->usesAsyncCompute()) {
+                m_asyncComputeProfiler.report(std::cout);
+            }
+            m_presentLatencyMonitor.report(std::cout);
+            m_hostAllocator.report(std::cout);
+            m_allocationCheck.report(std::cout);
+            if (const auto droppedLogMessages = vk_log::logger().droppedCount(); droppedLogMessages > 0) {
+                fmt::println(std::cout, "Log messages dropped: {}", droppedLogMessages);
+            }
+
+            return vk_result::Status {};
+        }
+
+        // Print the startup stage timings, as a table or as JSON depending on
+        // `HELLO_WINDOW_STARTUP_REPORT`.
+        void reportStartupTimes() const {
+            m_startupProfiler.report(std::cout, m_startupReportFormat);
+        }
+
+        bool isHeadless() const {
+            return m_headlessFrameCount.has_value();
+        }
+
+        // Whether the frames go to GLFW windows, rather than to no surface at all or straight
+        // to a display.
+        bool usesWindowSystem() const {
+            return !this->isHeadless() && !m_displayIndex.has_value();
+        }
+
+        // Presenting straight to a display skips the compositor, and its frame of latency, for
+        // kiosks that run nothing else. There is no window system to take input or events from,
+        // so it renders a single fullscreen view continuously, on the main thread.
+        void configureDisplay() {
+            if (!m_displayIndex.has_value()) {
+                return;
+            } else if (this->isHeadless()) {
+                VK_LOG_WARNING("Ignoring {}, headless rendering presents nothing", DISPLAY_ENVIRONMENT_VARIABLE);
+                m_displayIndex.reset();
+                return;
+            }
+
+            if (m_windowCount > 1) {
+                VK_LOG_WARNING("Ignoring {}, a display shows a single view", WINDOW_COUNT_ENVIRONMENT_VARIABLE);
+                m_windowCount = 1;
+            }
+            m_renderMode = RenderMode::Continuous;
+            m_renderThreadEnabled = false;
+        }
+
+        // Benchmarks render back to back with the latency policy, which never picks `FIFO`
+        // unless it is all the driver has, so vsync does not cap the frame rate.
+        void startBenchmark() {
+            if (!m_benchmarkSettings.has_value()) {
+                return;
+            }
+
+            const auto& settings = m_benchmarkSettings.value();
+            auto duration = std::optional<std::chrono::duration<double>> {};
+            if (settings.seconds.has_value()) {
+                duration = std::chrono::duration<double> { settings.seconds.value() };
+            }
+
+            m_renderMode = RenderMode::Continuous;
+            m_presentModePolicy = PresentModePolicy::Latency;
+            m_benchmark.start(settings.frameCount, duration, BENCH_WARMUP_FRAMES);
+        }
+
+        // A replay renders the capture's frames headless, with the scene the capture was taken
+        // with, so that one capture measures the same work on every build. Only one window
+        // renders headless, so frames of several windows replay the first window that took part.
+        void loadReplay() {
+            const auto path = replayPathFromEnvironment();
+            if (!path.has_value()) {
+                return;
+            }
+
+            m_replay = vk_capture::readCapture(path.value());
+            if (m_replay->frames.empty()) {
+                throw std::runtime_error("failed to replay capture, it has no frames!");
+            }
+
+            const auto& header = m_replay->header;
+            m_instanceCount = header.instanceCount;
+            m_lightCount = header.lightCount;
+            m_particleCount = header.particleCount;
+            m_headlessFrameCount = m_replay->frames.size();
+            VK_LOG_INFO("Replaying {} frames of {} windows from {}", m_replay->frames.size(), header.windowCount, path->string());
+        }
+
+        // A service renders headless, into offscreen images, and only the frames it is asked
+        // for. It listens before the instance is created, so a port already taken fails the
+        // start before it costs anything, and clients that connect early wait for startup.
+        void startService() {
+            if (!m_serviceEndpoint.has_value()) {
+                return;
+            } else if (m_replay.has_value()) {
+                VK_LOG_WARNING("Ignoring {}, a replay renders its capture once", SERVICE_ENVIRONMENT_VARIABLE);
+                m_serviceEndpoint.reset();
+                return;
+            }
+
+            m_headlessFrameCount = 0;
+            m_renderService.start(m_serviceEndpoint.value());
+        }
+
+        void startCapture() {
+            const auto path = capturePathFromEnvironment();
+            if (!path.has_value()) {
+                return;
+            }
+
+            m_captureWriter.open(path.value(), m_instanceCount, m_lightCount, m_particleCount, static_cast<uint32_t>(m_presenters.size()));
+            m_frameCapturedWindows.reserve(m_presenters.size());
+            VK_LOG_INFO("Capturing frames to {}", path->string());
+        }
+
+        // Records the windows taking part in the frame about to be recorded, under the frame
+        // number the camera follows.
+        void captureFrame() {
+            m_frameCapturedWindows.clear();
+            for (const auto [presenterIndex, imageIndex] : m_presentingWindows) {
+                const auto& presenter = m_presenters[presenterIndex];
+                m_frameCapturedWindows.push_back(vk_capture::CapturedWindow {
+                    .windowIndex = presenter.index,
+                    .width = presenter.extent.width,
+                    .height = presenter.extent.height,
+                });
+            }
+
+            m_captureWriter.writeFrame(m_frameCount, m_frameCapturedWindows);
+        }
+
+        // Frames are replayed in the order they were captured, one per frame, so the camera is
+        // where it was as long as the two stay in step.
+        void replayFrame() {
+            const auto& frame = m_replay->frames[m_frameCount];
+            if (frame.frameNumber != m_frameCount) {
+                throw std::runtime_error("failed to replay capture, frames are out of order!");
+            }
+
+            const auto& window = frame.windows.front();
+            m_presenters.front().extent = VkExtent2D { window.width, window.height };
+        }
+
+        // Time the helpers on the startup path in isolation, each
+        // `HELLO_WINDOW_INIT_BENCH_ITERATIONS` times, once the app is fully initialized, along
+        // with their heap allocations and driver calls. They are cheap on their own, but a
+        // regression in any of them adds to every cold start. The helpers run against a mock
+        // driver first, whose numbers only move with the helpers' own code, and then against
+        // the real one, like the kernels and GPU work after them. The hooks only apply to this
+        // thread, so the job system and the services keep calling the real driver meanwhile.
+        void benchmarkInitHelpers() {
+            const auto iterations = m_initBenchmarkIterations;
+            if (iterations == 0) {
+                return;
+            }
+
+            auto benchmark = vk_profiling::MicroBenchmark {};
+            {
+                const auto mockHooks = vk_dispatch::DispatchHooks { vk_dispatch::HookMode::Mock };
+                benchmark.setDriver("mock");
+                this->benchmarkStartupHelpers(benchmark, iterations, vk_dispatch::HookMode::Mock);
+            }
+
+            const auto countingHooks = vk_dispatch::DispatchHooks { vk_dispatch::HookMode::Count };
+            benchmark.setDriver("real");
+            this->benchmarkStartupHelpers(benchmark, iterations, vk_dispatch::HookMode::Count);
+            this->benchmarkCpuCulling(benchmark, iterations);
+            this->benchmarkMathKernels(benchmark, iterations);
+            this->benchmarkSceneChunkExtraction(benchmark, iterations);
+            this->benchmarkSceneBvh(benchmark, iterations);
+            this->benchmarkFrameUploads(benchmark, iterations);
+            this->benchmarkPerDrawDescriptors(benchmark, iterations);
+            this->benchmarkGpuPrimitives(benchmark, iterations);
+            this->benchmarkGpuDecompression(benchmark, iterations);
+            this->benchmarkAssetPackReads(benchmark, iterations);
+            this->benchmarkSceneShaderCompiles(benchmark, iterations);
+
+            benchmark.report(std::cout, startupReportFormatFromEnvironment());
+        }
+
+        // The camera the CPU kernel benchmarks look through, at the edge of their field of
+        // random positions between -100 and 100.
+        static glm::mat4 benchmarkViewProjection() {
+            const auto view = glm::lookAtRH(glm::vec3 { 0.0f, 0.0f, -100.0f }, glm::vec3 { 0.0f }, glm::vec3 { 0.0f, 1.0f, 0.0f });
+
+            return glm::perspectiveRH_ZO(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 400.0f) * view;
+        }
+
+        // The CPU culling fallback of the GPU driven scene, at the scene size it has to keep up
+        // with every frame, seen from the edge of the field.
+        void benchmarkCpuCulling(vk_profiling::MicroBenchmark& benchmark, uint32_t iterations) {
+            constexpr uint32_t CULL_BENCHMARK_BOXES = 100'000;
+
+            auto bounds = vk_cpu_culling::BoundsStore {};
+            bounds.resize(CULL_BENCHMARK_BOXES);
+            auto random = std::mt19937 { 1 };
+            auto position = std::uniform_real_distribution<float> { -100.0f, 100.0f };
+            for (uint32_t i = 0; i < CULL_BENCHMARK_BOXES; i++) {
+                const auto matrix = vk_transforms::WorldMatrix {
+                    .rows = {
+                        glm::vec4 { 1.0f, 0.0f, 0.0f, position(random) },
+                        glm::vec4 { 0.0f, 1.0f, 0.0f, position(random) },
+                        glm::vec4 { 0.0f, 0.0f, 1.0f, position(random) },
+                    },
+                };
+                bounds.set(i, matrix, 0.5f);
+            }
+
+            const auto planes = vk_cpu_culling::extractFrustumPlanes(benchmarkViewProjection());
+            auto culler = vk_cpu_culling::FrustumCuller {};
+            benchmark.run("cpuFrustumCulling", iterations, [this, &culler, &bounds, &planes]() {
+                culler.cull(m_jobSystem, bounds, CULL_BENCHMARK_BOXES, planes);
+            });
+        }
+
+        // The batch math kernels against the scalar loops they replace: a million points
+        // through the view projection, like the clip space positions of picking, and the box
+        // of a mesh under a million instance matrices, like a scene tree build.
+        void benchmarkMathKernels(vk_profiling::MicroBenchmark& benchmark, uint32_t iterations) {
+            constexpr uint32_t MATH_BENCHMARK_COUNT = 1'000'000;
+
+            auto random = std::mt19937 { 1 };
+            auto position = std::uniform_real_distribution<float> { -100.0f, 100.0f };
+            auto points = std::vector<glm::vec3>(MATH_BENCHMARK_COUNT);
+            auto instanceMatrices = std::vector<vk_transforms::WorldMatrix>(MATH_BENCHMARK_COUNT);
+            for (uint32_t i = 0; i < MATH_BENCHMARK_COUNT; i++) {
+                points[i] = glm::vec3 { position(random), position(random), position(random) };
+                instanceMatrices[i] = vk_transforms::WorldMatrix {
+                    .rows = {
+                        glm::vec4 { 1.0f, 0.0f, 0.0f, points[i].x },
+                        glm::vec4 { 0.0f, 1.0f, 0.0f, points[i].y },
+                        glm::vec4 { 0.0f, 0.0f, 1.0f, points[i].z },
+                    },
+                };
+            }
+
+            const auto viewProjection = benchmarkViewProjection();
+            auto clipPositions = std::vector<glm::vec4>(MATH_BENCHMARK_COUNT);
+            benchmark.run("transformPointsScalar", iterations, [&points, &clipPositions, &viewProjection]() {
+                for (size_t i = 0; i < points.size(); i++) {
+                    clipPositions[i] = viewProjection * glm::vec4 { points[i], 1.0f };
+                }
+            });
+            benchmark.run("transformPoints", iterations, [&points, &clipPositions, &viewProjection]() {
+                vk_math::transformPoints(viewProjection, points, clipPositions.data());
+            });
+
+            const auto unitBox = vk_math::Aabb { .min = glm::vec3 { -0.5f }, .max = glm::vec3 { 0.5f } };
+            auto instanceBoxes = std::vector<vk_math::Aabb>(MATH_BENCHMARK_COUNT);
+            benchmark.run("transformBoxesScalar", iterations, [&instanceMatrices, &instanceBoxes, &unitBox]() {
+                for (size_t i = 0; i < instanceMatrices.size(); i++) {
+                    instanceBoxes[i] = vk_math::transformBox(instanceMatrices[i], unitBox);
+                }
+            });
+            benchmark.run("transformBoxInstances", iterations, [&instanceMatrices, &instanceBoxes, &unitBox]() {
+                vk_math::transformBoxInstances(instanceMatrices, unitBox, instanceBoxes.data());
+            });
+        }
+
+        // Extracting world matrices from the chunks of a million entity scene, a job per chunk,
+        // which is what the renderer does for every instance it uploads.
+        void benchmarkSceneChunkExtraction(vk_profiling::MicroBenchmark& benchmark, uint32_t iterations) {
+            constexpr uint32_t EXTRACT_BENCHMARK_ENTITIES = 1'000'000;
+
+            auto random = std::mt19937 { 1 };
+            auto position = std::uniform_real_distribution<float> { -100.0f, 100.0f };
+            auto scene = vk_ecs::World {};
+            for (uint32_t i = 0; i < EXTRACT_BENCHMARK_ENTITIES; i++) {
+                scene.create(
+                    vk_transforms::LocalTransform { .position = glm::vec3 { position(random), position(random), position(random) } },
+                    vk_gpu_driven::SceneInstance { .index = i }
+                );
+            }
+
+            auto worldMatrices = std::vector<vk_transforms::WorldMatrix>(EXTRACT_BENCHMARK_ENTITIES);
+            benchmark.run("sceneChunkExtraction", iterations, [this, &scene, &worldMatrices]() {
+                scene.forEachChunk<vk_transforms::LocalTransform, vk_gpu_driven::SceneInstance>(m_jobSystem, [&worldMatrices](const vk_ecs::ChunkView& chunk) {
+                    const auto first = chunk.components<const vk_gpu_driven::SceneInstance>().front().index;
+                    vk_transforms::composeWorldMatrices(chunk.components<const vk_transforms::LocalTransform>(), worldMatrices.data() + first);
+                });
+            });
+        }
+
+        // Linking the scene's pipeline against creating its stages as shader objects, both
+        // without any cache, whichever the frames use. Only the first window's format is used.
+        void benchmarkSceneShaderCompiles(vk_profiling::MicroBenchmark& benchmark, uint32_t iterations) {
+            if (!m_indirectRenderer.isInitialized()) {
+                return;
+            }
+
+            const auto& presenter = m_presenters.front();
+            benchmark.run("scenePipelineCompile", iterations, [this, &presenter]() {
+                m_indirectRenderer.compileDrawPipeline(this->sceneColorFormat(presenter));
+            });
+            if (vk_features::has(m_deviceFeatures, vk_features::Feature::ShaderObject)) {
+                benchmark.run("sceneShaderObjectCompile", iterations, [this]() { m_indirectRenderer.compileSceneShaders(); });
+            }
+        }
+
+        // The helpers `benchmarkInitHelpers` names, each returning what it computed for the
+        // benchmark to sink.
+        void benchmarkStartupHelpers(vk_profiling::MicroBenchmark& benchmark, uint32_t iterations, vk_dispatch::HookMode driver) {
+            const auto& deviceInfo = m_physicalDeviceInfo;
+            benchmark.run("getRequiredExtensions", iterations, [this]() {
+                const auto scope = vk_host_memory::ArenaScope { m_frameArena };
+                vk_profiling::doNotOptimize(this->getRequiredExtensions());
+            });
+            benchmark.run("checkValidationLayerSupport", iterations, [this]() { return this->checkValidationLayerSupport(); });
+            benchmark.run("checkDeviceExtensionSupport", iterations, [this, &deviceInfo]() {
+                return this->checkDeviceExtensionSupport(deviceInfo.extensions);
+            });
+            benchmark.run("findQueueFamilies", iterations, [this, &deviceInfo]() {
+                return this->findQueueFamilies(deviceInfo.physicalDevice, deviceInfo.queueFamilies, deviceInfo.videoEncodeCodecs);
+            });
+
+            // Only the first window is measured, the others run the same code.
+            auto& presenter = m_presenters.front();
+            if (!this->isHeadless()) {
+                benchmark.run("querySwapChainSupport", iterations, [this, &presenter]() { return this->querySwapChainSupport(presenter); });
+                benchmark.run("selectSwapSurfaceFormat", iterations, [this, &deviceInfo]() {
+                    return this->selectSwapSurfaceFormat(deviceInfo.surfaceFormats);
+                });
+            }
+
+            // The views of the images in use are cached, so this measures the lookups a
+            // recreation keeping its images does instead of the views' creation. A miss keeps
+            // what it creates, which the mock would leave null, so it only runs for real.
+            if (driver == vk_dispatch::HookMode::Count) {
+                benchmark.run("createImageViews", iterations, [this, &presenter]() { this->createImageViews(presenter).orThrow(); });
+            }
+        }
+
+        // CPU picking at the scale it has to stay interactive at: a million cubes of the scene's
+        // mesh, hundreds of millions of triangles, built, refitted after a tenth of them moved,
+        // and picked from the edge of the field. Needs the scene for its mesh.
+        void benchmarkSceneBvh(vk_profiling::MicroBenchmark& benchmark, uint32_t iterations) {
+            constexpr uint32_t BVH_BENCHMARK_INSTANCES = 1'000'000;
+            constexpr uint32_t BVH_BENCHMARK_PICKS = 1024;
+            if (!m_indirectRenderer.isInitialized()) {
+                return;
+            }
+
+            auto random = std::mt19937 { 1 };
+            auto position = std::uniform_real_distribution<float> { -100.0f, 100.0f };
+            auto matrices = std::vector<vk_transforms::WorldMatrix>(BVH_BENCHMARK_INSTANCES);
+            for (auto& matrix : matrices) {
+                matrix = vk_transforms::WorldMatrix {
+                    .rows = {
+                        glm::vec4 { 1.0f, 0.0f, 0.0f, position(random) },
+                        glm::vec4 { 0.0f, 1.0f, 0.0f, position(random) },
+                        glm::vec4 { 0.0f, 0.0f, 1.0f, position(random) },
+                    },
+                };
+            }
+
+            // The instance tree alone, which is what a build redoes.
+            auto meshBox = vk_bvh::Aabb {};
+            for (const auto& meshPosition : m_indirectRenderer.meshPositions()) {
+                meshBox.grow(meshPosition);
+            }
+            auto boxes = std::vector<vk_bvh::Aabb> {};
+            for (const auto& matrix : matrices) {
+                boxes.push_back(vk_bvh::transformBox(matrix, meshBox));
+            }
+            auto instanceTree = vk_bvh::Bvh4 {};
+            benchmark.run("sceneBvhBuild", iterations, [this, &instanceTree, &boxes]() {
+                instanceTree.build(m_jobSystem, boxes);
+            });
+
+            auto bvh = vk_bvh::SceneBvh {};
+            bvh.init(m_jobSystem, m_indirectRenderer.meshPositions(), m_indirectRenderer.meshIndices());
+            bvh.setInstances(0, matrices);
+            bvh.update();
+
+            const auto moved = std::span { matrices }.first(BVH_BENCHMARK_INSTANCES / 10);
+            benchmark.run("sceneBvhRefit", iterations, [&bvh, moved]() {
+                bvh.setInstances(0, moved);
+                bvh.update();
+            });
+
+            auto rays = std::vector<vk_bvh::Ray> {};
+            auto target = std::uniform_real_distribution<float> { -50.0f, 50.0f };
+            for (uint32_t i = 0; i < BVH_BENCHMARK_PICKS; i++) {
+                const auto origin = glm::vec3 { 0.0f, 0.0f, -150.0f };
+                rays.push_back(vk_bvh::Ray {
+                    .origin = origin,
+                    .direction = glm::vec3 { target(random), target(random), 0.0f } - origin,
+                    .maxDistance = 2.0f,
+                });
+            }
+            benchmark.run("sceneBvhPicks", iterations, [&bvh, &rays]() {
+                for (const auto& ray : rays) {
+                    vk_profiling::doNotOptimize(bvh.pick(ray));
+                }
+            });
+        }
+
+        BenchmarkCommands createBenchmarkCommands() {
+            const auto poolInfo = VkCommandPoolCreateInfo {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+                .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+                .queueFamilyIndex = m_queueFamilyIndices.graphicsFamily.value(),
+            };
+
+            auto commandPool = VkCommandPool {};
+            const auto poolResult = vkCreateCommandPool(m_device, &poolInfo, m_hostAllocator.callbacks(), &commandPool);
+            if (poolResult != VK_SUCCESS) {
+                throw std::runtime_error("failed to create benchmark command pool!");
+            }
+
+            auto commands = BenchmarkCommands {
+                .commandPool = vk_handles::CommandPool { m_device, commandPool, m_hostAllocator.callbacks() },
+            };
+            const auto allocateInfo = VkCommandBufferAllocateInfo {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                .commandPool = commandPool,
+                .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                .commandBufferCount = 1,
+            };
+
+            const auto allocateResult = vkAllocateCommandBuffers(m_device, &allocateInfo, &commands.commandBuffer);
+            if (allocateResult != VK_SUCCESS) {
+                throw std::runtime_error("failed to allocate benchmark command buffer!");
+            }
+
+            return commands;
+        }
+
+        // A buffer with its own memory, and its device address when `usage` asks for one.
+        BenchmarkBuffer createBenchmarkBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags requiredFlags) {
+            const auto bufferInfo = VkBufferCreateInfo {
+                .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                .size = size,
+                .usage = usage,
+                .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            };
+
+            auto buffer = VkBuffer {};
+            const auto result = vkCreateBuffer(m_device, &bufferInfo, m_hostAllocator.callbacks(), &buffer);
+            if (result != VK_SUCCESS) {
+                throw std::runtime_error("failed to create benchmark buffer!");
+            }
+
+            auto benchmarkBuffer = BenchmarkBuffer();
+            benchmarkBuffer.buffer = vk_handles::Buffer { m_device, buffer, m_hostAllocator.callbacks() };
+            benchmarkBuffer.memory = vk_memory::ScopedAllocation {
+                m_memoryAllocator,
+                m_memoryAllocator.allocateForBuffer(buffer, vk_memory::AllocationCreateInfo { .requiredFlags = requiredFlags }),
+            };
+            if ((usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) != 0) {
+                benchmarkBuffer.address = vk_memory::bufferDeviceAddress(m_device, buffer);
+            }
+
+            return benchmarkBuffer;
+        }
+
+        // Records a benchmark's commands with `record`, submits them to the graphics queue and
+        // waits for the device, then resets the pool for the next call.
+        void submitAndWait(const BenchmarkCommands& commands, const auto& record) {
+            const auto commandBuffer = commands.commandBuffer;
+            const auto beginInfo = VkCommandBufferBeginInfo {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+            };
+            vkBeginCommandBuffer(commandBuffer, &beginInfo);
+            record(commandBuffer);
+            vkEndCommandBuffer(commandBuffer);
+
+            const auto submitInfo = VkSubmitInfo {
+                .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+                .commandBufferCount = 1,
+                .pCommandBuffers = &commandBuffer,
+            };
+            const auto result = vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
+            if (result != VK_SUCCESS) {
+                throw std::runtime_error("failed to submit benchmark commands!");
+            }
+
+            vkDeviceWaitIdle(m_device);
+            vkResetCommandPool(m_device, commands.commandPool.get(), 0);
+        }
+
+        // A pass's worth of per draw bindings recorded into a command buffer, written into sets
+        // from frame descriptor pools and, where the device has `VK_KHR_push_descriptor`,
+        // pushed. The command buffer is submitted and waited for, a round trip that is the same
+        // for both, so that work a driver defers to the submission is counted too.
+        void benchmarkPerDrawDescriptors(vk_profiling::MicroBenchmark& benchmark, uint32_t iterations) {
+            constexpr uint32_t DESCRIPTOR_BENCHMARK_DRAWS = 1024;
+            constexpr VkDeviceSize DESCRIPTOR_BENCHMARK_RANGE = 256;
+
+            const auto commands = this->createBenchmarkCommands();
+
+            const auto binding = VkDescriptorSetLayoutBinding {
+                .binding = 0,
+                .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                .descriptorCount = 1,
+                .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            };
+            const auto ratios = std::array {
+                vk_descriptors::PoolSizeRatio { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.0f },
+            };
+            auto frameDescriptors = vk_descriptors::FrameDescriptorAllocator {};
+            frameDescriptors.init(m_device, 1, ratios, DESCRIPTOR_BENCHMARK_DRAWS, m_hostAllocator.callbacks());
+
+            for (const auto pushDescriptors : { false, true }) {
+                if (pushDescriptors && !vk_features::has(m_deviceFeatures, vk_features::Feature::PushDescriptor)) {
+                    continue;
+                }
+
+                auto descriptors = vk_descriptors::PerDrawDescriptors {};
+                descriptors.init(m_device, m_descriptorLayoutCache, frameDescriptors, std::span { &binding, 1 }, pushDescriptors);
+
+                const auto setLayout = descriptors.setLayout();
+                const auto pipelineLayoutInfo = VkPipelineLayoutCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+                    .setLayoutCount = 1,
+                    .pSetLayouts = &setLayout,
+                };
+
+                auto pipelineLayout = VkPipelineLayout {};
+                const auto layoutResult = vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, m_hostAllocator.callbacks(), &pipelineLayout);
+                if (layoutResult != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create descriptor benchmark pipeline layout!");
+                }
+
+                const auto name = pushDescriptors ? "perDrawPushDescriptors" : "perDrawDescriptorSets";
+                benchmark.run(name, iterations, [this, &descriptors, &frameDescriptors, &commands, pipelineLayout]() {
+                    frameDescriptors.beginFrame(0);
+                    this->submitAndWait(commands, [&](VkCommandBuffer commandBuffer) {
+                        for (uint32_t draw = 0; draw < DESCRIPTOR_BENCHMARK_DRAWS; draw++) {
+                            const auto bufferInfo = VkDescriptorBufferInfo {
+                                .buffer = m_frameUploadArena.buffer(),
+                                .offset = 0,
+                                .range = DESCRIPTOR_BENCHMARK_RANGE,
+                            };
+                            auto write = VkWriteDescriptorSet {
+                                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                                .dstBinding = 0,
+                                .descriptorCount = 1,
+                                .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                                .pBufferInfo = &bufferInfo,
+                            };
+                            descriptors.bind(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, std::span { &write, 1 });
+                        }
+                    });
+                });
+
+                vkDestroyPipelineLayout(m_device, pipelineLayout, m_hostAllocator.callbacks());
+            }
+
+            frameDescriptors.destroy();
+        }
+
+        // A frame's worth of uniforms written and made visible to the GPU, both straight into
+        // device local memory and through a staging copy, whichever the frames use. Each call
+        // waits for the copy, so the staged numbers include the round trip.
+        void benchmarkFrameUploads(vk_profiling::MicroBenchmark& benchmark, uint32_t iterations) {
+            constexpr VkDeviceSize UPLOAD_BENCHMARK_BYTES = 256 * 1024;
+
+            const auto commands = this->createBenchmarkCommands();
+
+            const auto source = std::vector<std::byte>(UPLOAD_BENCHMARK_BYTES, std::byte { 0x5a });
+            const auto& limits = m_physicalDeviceInfo.properties.limits;
+            for (const auto strategy : { vk_memory::UploadStrategy::Direct, vk_memory::UploadStrategy::Staged }) {
+                auto arena = vk_memory::FrameUploadArena {};
+                arena.init(m_device, m_memoryAllocator, UPLOAD_BENCHMARK_BYTES, 1, limits.minUniformBufferOffsetAlignment, strategy);
+
+                const auto name = strategy == vk_memory::UploadStrategy::Direct ? "frameUploadDirect" : "frameUploadStaged";
+                benchmark.run(name, iterations, [this, &arena, &source, &commands]() {
+                    arena.beginFrame(0);
+                    const auto allocation = arena.allocate(source.size());
+                    std::memcpy(allocation->mappedData, source.data(), source.size());
+
+                    this->submitAndWait(commands, [&arena](VkCommandBuffer commandBuffer) { arena.recordCopies(commandBuffer); });
+                });
+
+                arena.destroy(m_memoryAllocator);
+            }
+        }
+
+        // The GPU primitives over a million random elements, each call waiting for the GPU.
+        // Sorts start by copying their keys back from a pristine buffer, so that every one of
+        // them sorts the same shuffled keys, and the copy is in their numbers. The outputs of
+        // the last call of each are read back and checked against the standard algorithms.
+        void benchmarkGpuPrimitives(vk_profiling::MicroBenchmark& benchmark, uint32_t iterations) {
+            constexpr uint32_t PRIMITIVES_BENCHMARK_COUNT = 1 << 20;
+
+            if (!vk_gpu_primitives::supports(m_computeTuning, vk_features::has(m_deviceFeatures, vk_features::Feature::BufferDeviceAddress))) {
+                return;
+            }
+
+            auto primitives = vk_gpu_primitives::GpuPrimitives {};
+            primitives.init(
+                m_device,
+                m_memoryAllocator,
+                m_shaderLibrary,
+                m_pipelineRegistry,
+                m_computeTuning,
+                m_hostAllocator.callbacks(),
+                PRIMITIVES_BENCHMARK_COUNT
+            );
+
+            const auto createBuffer = [this](uint32_t words, VkMemoryPropertyFlags requiredFlags) {
+                constexpr auto usage = VkBufferUsageFlags {
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                        | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT
+                        | VK_BUFFER_USAGE_TRANSFER_SRC_BIT
+                        | VK_BUFFER_USAGE_TRANSFER_DST_BIT
+                };
+
+                return this->createBenchmarkBuffer(VkDeviceSize { words } * sizeof(uint32_t), usage, requiredFlags);
+            };
+
+            // The shuffled keys and flags are written once through a host visible mapping.
+            constexpr auto hostVisible = VkMemoryPropertyFlags { VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT };
+            const auto keyWords = PRIMITIVES_BENCHMARK_COUNT * static_cast<uint32_t>(vk_gpu_primitives::KeyWidth::Bits64);
+            const auto shuffledKeys = createBuffer(keyWords, hostVisible);
+            const auto flags = createBuffer(PRIMITIVES_BENCHMARK_COUNT, hostVisible);
+            const auto keys = createBuffer(keyWords, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            const auto values = createBuffer(PRIMITIVES_BENCHMARK_COUNT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            const auto compacted = createBuffer(PRIMITIVES_BENCHMARK_COUNT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            const auto compactedCount = createBuffer(1, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            const auto readback = createBuffer(keyWords, hostVisible);
+
+            auto random = std::mt19937 { 1 };
+            auto* keyData = static_cast<uint32_t*>(shuffledKeys.memory.get().mappedData);
+            for (uint32_t i = 0; i < keyWords; i++) {
+                keyData[i] = static_cast<uint32_t>(random());
+            }
+
+            auto* flagData = static_cast<uint32_t*>(flags.memory.get().mappedData);
+            for (uint32_t i = 0; i < PRIMITIVES_BENCHMARK_COUNT; i++) {
+                flagData[i] = random() & 1;
+            }
+
+            const auto commands = this->createBenchmarkCommands();
+
+            // Copies the first `words` words of a result into the readback buffer once the
+            // primitive's storage writes are done, and returns them.
+            const auto readBack = [this, &commands, &readback](const BenchmarkBuffer& result, uint32_t words) {
+                this->submitAndWait(commands, [&](VkCommandBuffer commandBuffer) {
+                    const auto copyBarrier = VkMemoryBarrier2 {
+                        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+                        .srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                        .srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                        .dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+                        .dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT,
+                    };
+                    const auto copyDependency = VkDependencyInfo {
+                        .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+                        .memoryBarrierCount = 1,
+                        .pMemoryBarriers = &copyBarrier,
+                    };
+                    vkCmdPipelineBarrier2(commandBuffer, &copyDependency);
+
+                    const auto copy = VkBufferCopy {
+                        .size = VkDeviceSize { words } * sizeof(uint32_t),
+                    };
+                    vkCmdCopyBuffer(commandBuffer, result.buffer.get(), readback.buffer.get(), 1, &copy);
+
+                    const auto hostBarrier = VkMemoryBarrier2 {
+                        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+                        .srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+                        .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                        .dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT,
+                        .dstAccessMask = VK_ACCESS_2_HOST_READ_BIT,
+                    };
+                    const auto hostDependency = VkDependencyInfo {
+                        .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+                        .memoryBarrierCount = 1,
+                        .pMemoryBarriers = &hostBarrier,
+                    };
+                    vkCmdPipelineBarrier2(commandBuffer, &hostDependency);
+                });
+
+                const auto* data = static_cast<const uint32_t*>(readback.memory.get().mappedData);
+                return std::vector<uint32_t>(data, data + words);
+            };
+
+            benchmark.run("gpuExclusiveScan", iterations, [this, &primitives, &commands, &flags, &values]() {
+                this->submitAndWait(commands, [&](VkCommandBuffer commandBuffer) {
+                    primitives.recordExclusiveScan(commandBuffer, flags.address, values.address, PRIMITIVES_BENCHMARK_COUNT);
+                });
+            });
+
+            auto expectedOffsets = std::vector<uint32_t>(PRIMITIVES_BENCHMARK_COUNT);
+            std::exclusive_scan(flagData, flagData + PRIMITIVES_BENCHMARK_COUNT, expectedOffsets.begin(), 0u);
+            if (readBack(values, PRIMITIVES_BENCHMARK_COUNT) != expectedOffsets) {
+                VK_LOG_WARNING("GPU exclusive scan does not match the CPU one");
+            }
+
+            benchmark.run("gpuCompact", iterations, [this, &primitives, &commands, &flags, &compacted, &compactedCount]() {
+                this->submitAndWait(commands, [&](VkCommandBuffer commandBuffer) {
+                    primitives.recordCompact(commandBuffer, 0, flags.address, PRIMITIVES_BENCHMARK_COUNT, compacted.address, compactedCount.address);
+                });
+            });
+
+            // Without a source, the compaction packs the indices of the flagged elements.
+            auto indices = std::vector<uint32_t>(PRIMITIVES_BENCHMARK_COUNT);
+            std::iota(indices.begin(), indices.end(), 0u);
+            auto expectedIndices = std::vector<uint32_t> {};
+            std::copy_if(indices.begin(), indices.end(), std::back_inserter(expectedIndices), [flagData](uint32_t index) {
+                return flagData[index] != 0;
+            });
+            const auto compactedWords = readBack(compactedCount, 1).front();
+            if (compactedWords != expectedIndices.size() || readBack(compacted, compactedWords) != expectedIndices) {
+                VK_LOG_WARNING("GPU compaction does not match the CPU one");
+            }
+
+            for (const auto keyWidth : { vk_gpu_primitives::KeyWidth::Bits32, vk_gpu_primitives::KeyWidth::Bits64 }) {
+                const auto name = keyWidth == vk_gpu_primitives::KeyWidth::Bits32 ? "gpuRadixSort32" : "gpuRadixSort64";
+                benchmark.run(name, iterations, [this, &primitives, &commands, &shuffledKeys, &keys, &values, keyWidth]() {
+                    this->submitAndWait(commands, [&](VkCommandBuffer commandBuffer) {
+                        const auto copy = VkBufferCopy {
+                            .size = VkDeviceSize { PRIMITIVES_BENCHMARK_COUNT } * static_cast<uint32_t>(keyWidth) * sizeof(uint32_t),
+                        };
+                        vkCmdCopyBuffer(commandBuffer, shuffledKeys.buffer.get(), keys.buffer.get(), 1, &copy);
+                        primitives.recordSort(commandBuffer, keys.address, values.address, PRIMITIVES_BENCHMARK_COUNT, keyWidth);
+                    });
+                });
+
+                // 64 bit keys are two words, the low word first, so they sort as integers
+                // widened from their pairs.
+                auto expectedKeys = std::vector<uint32_t>(keyData, keyData + PRIMITIVES_BENCHMARK_COUNT * static_cast<uint32_t>(keyWidth));
+                if (keyWidth == vk_gpu_primitives::KeyWidth::Bits32) {
+                    std::sort(expectedKeys.begin(), expectedKeys.end());
+                } else {
+                    auto wideKeys = std::vector<uint64_t>(PRIMITIVES_BENCHMARK_COUNT);
+                    for (uint32_t i = 0; i < PRIMITIVES_BENCHMARK_COUNT; i++) {
+                        wideKeys[i] = uint64_t { expectedKeys[2 * i] } | uint64_t { expectedKeys[2 * i + 1] } << 32;
+                    }
+                    std::sort(wideKeys.begin(), wideKeys.end());
+                    for (uint32_t i = 0; i < PRIMITIVES_BENCHMARK_COUNT; i++) {
+                        expectedKeys[2 * i] = static_cast<uint32_t>(wideKeys[i]);
+                        expectedKeys[2 * i + 1] = static_cast<uint32_t>(wideKeys[i] >> 32);
+                    }
+                }
+                if (readBack(keys, static_cast<uint32_t>(expectedKeys.size())) != expectedKeys) {
+                    VK_LOG_WARNING("GPU radix sort of {} bit keys does not match the CPU one", 32 * static_cast<uint32_t>(keyWidth));
+                }
+            }
+
+            primitives.destroy();
+        }
+
+        // Expanding an LZ4 blob of 16 MiB on the GPU, waiting for it, against expanding it on
+        // one CPU thread, which is what devices without the kernel fall back to. The data
+        // repeats like mesh and animation data does, with some noise.
+        void benchmarkGpuDecompression(vk_profiling::MicroBenchmark& benchmark, uint32_t iterations) {
+            constexpr uint32_t DECOMPRESSION_BENCHMARK_SIZE = 1 << 24;
+
+            const auto bufferDeviceAddress = vk_features::has(m_deviceFeatures, vk_features::Feature::BufferDeviceAddress);
+            const auto storageBuffer8BitAccess = vk_features::has(m_deviceFeatures, vk_features::Feature::StorageBuffer8BitAccess);
+            if (!vk_decompression::supports(m_computeTuning, bufferDeviceAddress, storageBuffer8BitAccess)) {
+                return;
+            }
+
+            auto random = std::mt19937 { 1 };
+            auto data = std::vector<std::byte>(DECOMPRESSION_BENCHMARK_SIZE);
+            for (size_t i = 0; i < data.size(); i++) {
+                const auto noise = random() % 16 == 0 ? static_cast<uint32_t>(random()) : 0;
+                data[i] = static_cast<std::byte>((i / 64) % 251 ^ (i % 7) ^ noise);
+            }
+
+            const auto blob = vk_assets::compressBlob(data);
+            const auto entry = vk_assets::PackEntry {
+                .kind = vk_assets::AssetKind::Buffer,
+                .size = blob.size(),
+                .compression = vk_assets::Compression::Lz4,
+                .chunkCount = vk_assets::chunkCount(data.size()),
+                .uncompressedSize = data.size(),
+            };
+
+            auto decompressor = vk_decompression::GpuDecompressor {};
+            decompressor.init(m_device, m_shaderLibrary, m_pipelineRegistry, m_computeTuning, m_hostAllocator.callbacks());
+
+            // Both ends are host visible, so the output can be checked against the data.
+            const auto createBuffer = [this](VkDeviceSize size) {
+                return this->createBenchmarkBuffer(
+                    size,
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+                );
+            };
+
+            const auto source = createBuffer(blob.size());
+            const auto destination = createBuffer(data.size());
+            std::memcpy(source.memory.get().mappedData, blob.data(), blob.size());
+
+            const auto commands = this->createBenchmarkCommands();
+
+            benchmark.run("gpuDecompression", iterations, [this, &decompressor, &entry, &source, &destination, &commands]() {
+                this->submitAndWait(commands, [&](VkCommandBuffer commandBuffer) {
+                    decompressor.recordDecompress(commandBuffer, entry, source.address, destination.address);
+                });
+            });
+
+            const auto* output = static_cast<const std::byte*>(destination.memory.get().mappedData);
+            if (std::memcmp(output, data.data(), data.size()) != 0) {
+                VK_LOG_WARNING("GPU decompression does not match the data it compressed");
+            }
+
+            auto expanded = std::vector<std::byte>(data.size());
+            auto expandedOnCpu = true;
+            benchmark.run("cpuDecompression", iterations, [&blob, &entry, &expanded, &expandedOnCpu]() {
+                expandedOnCpu = vk_assets::decompressBlob(blob, entry.chunkCount, expanded) && expandedOnCpu;
+            });
+            if (!expandedOnCpu) {
+                VK_LOG_WARNING("CPU decompression failed on the data it compressed");
+            }
+
+            VK_LOG_INFO(
+                "GPU decompression benchmark: {} bytes compressed to {}, {:.1f}%",
+                data.size(),
+                blob.size(),
+                100.0 * static_cast<double>(blob.size()) / static_cast<double>(data.size())
+            );
+
+            decompressor.destroy();
+        }
+
+        // Reading the pack's blobs, up to 64 MiB of them, into host visible staging memory the
+        // transfer queue could copy from: all at once through the asset reader, against one
+        // after another out of the mapping. Past the first iteration both mostly measure the
+        // page cache, which is what a pack that has been streamed before reads from.
+        void benchmarkAssetPackReads(vk_profiling::MicroBenchmark& benchmark, uint32_t iterations) {
+            constexpr VkDeviceSize ASSET_READ_BENCHMARK_SIZE = VkDeviceSize { 64 } << 20;
+
+            if (!m_assetPack.isOpen() || !m_assetReader.isOpen()) {
+                return;
+            }
+
+            struct BlobRead {
+                const vk_assets::PackEntry* entry;
+                VkDeviceSize offset;
+            };
+
+            auto reads = std::vector<BlobRead> {};
+            auto stagingSize = VkDeviceSize { 0 };
+            for (const auto& entry : m_assetPack.entries()) {
+                if (entry.size == 0 || entry.size > ASSET_READ_BENCHMARK_SIZE - stagingSize) {
+                    continue;
+                }
+
+                reads.push_back(BlobRead { .entry = &entry, .offset = stagingSize });
+                stagingSize = vk_assets::alignBlob(stagingSize + entry.size);
+            }
+            if (reads.empty()) {
+                return;
+            }
+
+            const auto bufferInfo = VkBufferCreateInfo {
+                .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                .size = stagingSize,
+                .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            };
+
+            auto buffer = VkBuffer {};
+            const auto bufferResult = vkCreateBuffer(m_device, &bufferInfo, m_hostAllocator.callbacks(), &buffer);
+            if (bufferResult != VK_SUCCESS) {
+                throw std::runtime_error("failed to create asset read benchmark buffer!");
+            }
+
+            const auto stagingBuffer = vk_handles::Buffer { m_device, buffer, m_hostAllocator.callbacks() };
+            const auto allocationInfo = vk_memory::AllocationCreateInfo {
+                .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                .kind = vk_memory::ResourceKind::Linear,
+            };
+            const auto staging = vk_memory::ScopedAllocation {
+                m_memoryAllocator,
+                m_memoryAllocator.allocateForBuffer(buffer, allocationInfo),
+            };
+            auto* stagingData = static_cast<std::byte*>(staging.get().mappedData);
+
+            auto failedReads = std::atomic<uint32_t> { 0 };
+            benchmark.run("asyncAssetPackReads", iterations, [this, &reads, stagingData, &failedReads]() {
+                for (const auto& read : reads) {
+                    const auto destination = std::span { stagingData + read.offset, static_cast<size_t>(read.entry->size) };
+                    const auto completion = [&failedReads](bool success) {
+                        if (!success) {
+                            failedReads.fetch_add(1, std::memory_order_relaxed);
+                        }
+                    };
+                    while (!m_assetPack.readBlob(m_assetReader, *read.entry, 0, destination, completion)) {
+                        m_assetReader.poll();
+                    }
+                }
+
+                m_assetReader.drain();
+            });
+            if (failedReads.load(std::memory_order_relaxed) > 0) {
+                VK_LOG_WARNING("{} asset pack reads failed through the {} reader", failedReads.load(std::memory_order_relaxed), vk_async_io::backendToString(m_assetReader.backend()));
+            }
+
+            benchmark.run("mappedAssetPackReads", iterations, [this, &reads, stagingData]() {
+                for (const auto& read : reads) {
+                    const auto data = m_assetPack.data(*read.entry);
+                    std::memcpy(stagingData + read.offset, data.data(), data.size());
+                }
+            });
+
+            // The same reads as load pipelines, each expanding its blob on a worker once it is
+            // read, if it is compressed.
+            auto scheduler = vk_coroutines::TaskScheduler {};
+            scheduler.init(m_jobSystem, m_device);
+            benchmark.run("coroutineAssetPackLoads", iterations, [this, &reads, stagingData, &scheduler]() {
+                for (const auto& read : reads) {
+                    scheduler.spawn(this->loadBlob(scheduler, *read.entry, std::span { stagingData + read.offset, static_cast<size_t>(read.entry->size) }));
+                }
+
+                scheduler.drain();
+            });
+
+            VK_LOG_INFO(
+                "Asset read benchmark: {} blobs, {} bytes, {} reads at a queue depth of {}",
+                reads.size(),
+                stagingSize,
+                vk_async_io::backendToString(m_assetReader.backend()),
+                m_assetReader.queueDepth()
+            );
+        }
+
+        // Reads a blob through the asset reader and expands it when it is compressed, the way
+        // any load pipeline strings its steps together.
+        vk_coroutines::Task<void> loadBlob(vk_coroutines::TaskScheduler& scheduler, const vk_assets::PackEntry& entry, std::span<std::byte> destination) {
+            const bool readAll = co_await scheduler.read(m_assetReader, entry.offset, destination);
+            if (!readAll) {
+                throw std::runtime_error("failed to read asset pack blob!");
+            } else if (entry.compression != vk_assets::Compression::Lz4) {
+                co_return;
+            }
+
+            // Reads complete on the job system, so this already runs on a worker.
+            auto expanded = std::vector<std::byte>(static_cast<size_t>(entry.uncompressedSize));
+            if (!vk_assets::decompressBlob(destination, entry.chunkCount, expanded)) {
+                throw std::runtime_error("failed to expand asset pack blob!");
+            }
+        }
+
+        bool isBenchmarkFinished() const {
+            return m_benchmarkSettings.has_value() && m_benchmark.isFinished();
+        }
+
+        // What the swapchains actually do, since both sharing modes are exclusive when the
+        // graphics and present families are the same. Every window shares them the same way.
+        const char* swapChainSharingToString() const {
+            if (this->isHeadless()) {
+                return "none";
+            } else if (m_presenters.front().ownershipTransfer) {
+                return "exclusive-transfer";
+            } else if (m_queueFamilyIndices.graphicsFamily != m_queueFamilyIndices.presentFamily) {
+                return "concurrent";
+            }
+
+            return "exclusive";
+        }
+
+        // How the GPU driven scene draws, for benchmark results.
+        const char* scenePathToString() const {
+            if (!m_indirectRenderer.isInitialized()) {
+                return "none";
+            }
+
+            return m_indirectRenderer.usesShaderObjects() ? "shaderObjects" : "pipeline";
+        }
+
+        void writeBenchmarkResults() const {
+            if (!m_benchmarkSettings.has_value()) {
+                return;
+            }
+
+            const auto& properties = m_physicalDeviceInfo.properties;
+            const auto environment = vk_profiling::BenchmarkEnvironment {
+                .deviceName = properties.deviceName,
+                .vendorID = properties.vendorID,
+                .deviceID = properties.deviceID,
+                .driverVersion = properties.driverVersion,
+                .apiVersion = properties.apiVersion,
+                .presentMode = this->isHeadless() ? "NONE" : presentModeToString(m_presenters.front().presentMode),
+                .swapChainSharing = this->swapChainSharingToString(),
+                .uploadStrategy = vk_memory::uploadStrategyToString(m_frameUploadArena.strategy()),
+                .scenePath = this->scenePathToString(),
+                .instanceCount = m_instanceCount,
+                .lightCount = m_lightCount,
+                .particleCount = m_particleCount,
+                .jobThreadCount = m_jobSystem.workerCount(),
+            };
+
+            const auto& output = m_benchmarkSettings->output;
+            m_benchmark.write(output, environment);
+            VK_LOG_INFO("Wrote benchmark results to {}", output.string());
+        }
+
+        void setRenderMode(RenderMode renderMode) {
+            m_renderMode = renderMode;
+            this->requestFrame();
+        }
+
+        // Switch the present mode policy at runtime. A swapchain created to switch to the new
+        // present mode presents with it from the next frame on, and any other is recreated with
+        // it at the end of the next frame. A switched swapchain keeps its image count.
+        void setPresentModePolicy(PresentModePolicy presentModePolicy) {
+            if (m_presentModePolicy != presentModePolicy) {
+                m_presentModePolicy = presentModePolicy;
+                for (auto& presenter : m_presenters) {
+                    const auto presentMode = this->selectSwapPresentMode(presenter.presentModes);
+                    if (std::ranges::find(presenter.switchablePresentModes, presentMode) == presenter.switchablePresentModes.end()) {
+                        presenter.swapChainOutdated = true;
+                    } else if (presentMode != presenter.presentMode) {
+                        presenter.presentMode = presentMode;
+                        VK_LOG_INFO("Swapchain {}: switched to {} present mode", presenter.index, presentModeToString(presentMode));
+                    }
+                }
+
+                this->requestFrame();
+            }
+        }
+
+        // Ask for a new frame in the on-demand render mode. This is safe to call from any
+        // thread: the main thread is woken up through an empty GLFW event.
+        void requestFrame() {
+            this->signalFrameRequest();
+            if (!m_presenters.empty() && m_presenters.front().window != nullptr) {
+                glfwPostEmptyEvent();
+            }
+        }
+    private:
+        // Declared first so that it outlives every object created with its callbacks.
+        vk_host_memory::HostAllocator m_hostAllocator;
+        // Only used by the thread drawing frames.
+        vk_allocation_tracking::FrameAllocationCheck m_allocationCheck;
+        // Transient arrays of the frame being drawn, reset at the start of every frame, and
+        // of the helpers before the first, which free theirs with an `ArenaScope`. Only the
+        // thread drawing frames uses it.
+        vk_host_memory::ScratchArena m_frameArena;
+
+        vk_handles::Instance m_instance;
+        vk_handles::DebugMessenger m_debugMessenger;
+        std::vector<WindowPresenter> m_presenters;
+        std::vector<PresentingWindow> m_presentingWindows;
+        uint32_t m_windowCount = windowCountFromEnvironment();
+        // With window compositing, the other windows show the first window's scene instead of
+        // rendering their own, and `m_frameComposited` is set for a frame that does.
+        bool m_windowCompositeRequested = windowCompositeFromEnvironment();
+        bool m_frameComposited = false;
+        VkExtent2D m_windowSize = windowSizeFromEnvironment();
+        std::optional<uint32_t> m_displayIndex = displayIndexFromEnvironment();
+        std::optional<uint32_t> m_fullscreenMonitor = fullscreenMonitorFromEnvironment();
+        // Found once the instance exists, and only selects GPUs that drive it.
+        std::optional<vk_display::DisplayTarget> m_displayTarget;
+
+        VkPhysicalDevice m_physicalDevice = VK_NULL_HANDLE;
+        PhysicalDeviceInfo m_physicalDeviceInfo;
+        // The suitable GPUs ranked below the selected one, tried in order when no device can
+        // be created on it.
+        std::vector<PhysicalDeviceInfo> m_fallbackPhysicalDevices;
+        vk_handles::Device m_device;
+        VkQueue m_graphicsQueue = VK_NULL_HANDLE;
+        VkQueue m_presentQueue = VK_NULL_HANDLE;
+        VkQueue m_computeQueue = VK_NULL_HANDLE;
+        VkQueue m_transferQueue = VK_NULL_HANDLE;
+        VkQueue m_videoEncodeQueue = VK_NULL_HANDLE;
+        QueueFamilyIndices m_queueFamilyIndices;
+        uint32_t m_computeQueueFamily = 0;
+        uint32_t m_transferQueueFamily = 0;
+
+        const uint32_t m_framesInFlight = framesInFlightFromEnvironment();
+        // How many of the frame slots the CPU may run ahead by, which the overlay lowers at
+        // runtime without giving up the slots themselves.
+        uint32_t m_frameQueueDepth = m_framesInFlight;
+        const uint32_t m_recordingThreadCount = recordingThreadCountFromEnvironment();
+        std::vector<vk_handles::CommandPool> m_commandPools;
+        std::vector<VkCommandBuffer> m_commandBuffers;
+        // The render graph's async compute passes are recorded into a command buffer per frame
+        // slot on the dedicated compute family, and submitted ahead of the graphics work, which
+        // waits on their timeline. Empty without a dedicated compute family.
+        bool m_asyncComputeRequested = asyncComputeFromEnvironment();
+        std::vector<vk_handles::CommandPool> m_asyncComputePools;
+        std::vector<VkCommandBuffer> m_asyncComputeCommandBuffers;
+        vk_handles::Semaphore m_asyncComputeSemaphore;
+        vk_profiling::GpuTimestampProfiler m_asyncComputeProfiler;
+        // The frame each slot last ran async compute in, so that the overlap is only measured
+        // between timestamps of the same frame.
+        std::vector<std::optional<uint64_t>> m_asyncComputeFrames;
+        vk_recording::ParallelCommandRecorder m_commandRecorder;
+        bool m_commandCacheRequested = commandCacheFromEnvironment();
+        // The scene draw of every window and frame in flight, recorded again only when it changes.
+        vk_recording::CommandBufferCache m_sceneCommandCache;
+        // Every queue's submissions of a frame, flushed together once it is recorded.
+        vk_submit::SubmitBatcher m_submitBatcher;
+        // The work items of the window whose main pass is being recorded.
+        std::vector<vk_recording::WorkItem> m_frameWorkItems;
+
+        vk_handles::Semaphore m_frameTimelineSemaphore;
+        uint32_t m_currentFrame = 0;
+        uint64_t m_frameCount = 0;
+
+        PresentModePolicy m_presentModePolicy = presentModePolicyFromEnvironment();
+        std::optional<uint32_t> m_swapchainImageCountOverride = swapchainImageCountFromEnvironment();
+        vk_surface::SurfaceFormatPolicy m_surfaceFormatPolicy = surfaceFormatPolicyFromEnvironment();
+        PresentPath m_presentPath = presentPathFromEnvironment();
+        vk_compute_present::ComputePresentPass m_computePresentPass;
+        SwapChainSharing m_swapChainSharing = swapChainSharingFromEnvironment();
+        bool m_presentOnComputeRequested = presentOnComputeFromEnvironment();
+        vk_device_group::DeviceGroupMode m_deviceGroupMode = deviceGroupModeFromEnvironment();
+        // The linked GPUs the device spans, in group order, empty without a device group.
+        std::vector<VkPhysicalDevice> m_deviceGroupDevices;
+        vk_device_group::FrameSynchronizer m_deviceGroupSync;
+        // The devices running the frame being drawn, for its acquire, submission and present.
+        uint32_t m_frameDeviceMask = 1;
+        // Swapchains retired by a recreation, against the frame count at which nothing uses
+        // them anymore.
+        vk_handles::DeferredDestructionQueue m_retiredSwapChains;
+        // Buffers, images, pipelines and materials addressed by generational handles, retired
+        // to `m_retiredSwapChains` like the swapchains.
+        vk_resources::ResourcePools m_resources;
+        // The views of the presented images, released with the images they view.
+        vk_image_views::ImageViewCache m_imageViews;
+        // With swapchain maintenance, swapchains retired until the fences of their last
+        // presents have signaled instead.
+        std::vector<RetiredSwapChain> m_fencedSwapChains;
+
+        vk_profiling::StartupProfiler m_startupProfiler;
+        // Set for the launches of the startup benchmark, which only time the startup.
+        const bool m_exitAfterStartup = exitAfterStartupFromEnvironment();
+        // The dispatch hooks the init benchmarks need go in when the table is loaded.
+        const uint32_t m_initBenchmarkIterations = initBenchmarkIterationsFromEnvironment();
+        vk_profiling::ReportFormat m_startupReportFormat = startupReportFormatFromEnvironment();
+        vk_profiling::GpuTimestampProfiler m_gpuProfiler;
+        vk_profiling::ClockCalibration m_clockCalibration;
+        // When each frame in flight was last submitted, to tell how long the GPU took to start
+        // on it once its timestamps are read back.
+        std::vector<std::optional<std::chrono::steady_clock::time_point>> m_frameSubmitTimes;
+        vk_profiling::FrameTelemetry m_frameTelemetry;
+        // Spreads the frame's streaming over the next frames once it has taken its share of
+        // the CPU, and counts the frames each subsystem went over.
+        vk_frame_budget::FrameBudget m_frameBudget;
+        vk_present::PresentLatencyMonitor m_presentLatencyMonitor;
+        vk_present::DisplayTimingPacer m_displayTimingPacer;
+        bool m_lowLatencyRequested = lowLatencyFromEnvironment();
+        vk_present::LowLatencyPacer m_lowLatencyPacer;
+        vk_frame_limiter::FrameLimiter m_frameLimiter;
+        PowerPolicy m_powerPolicy = powerPolicyFromEnvironment();
+        vk_power::PowerMonitor m_powerMonitor;
+        // What the power policy replaced while it saves power, and puts back once it stops.
+        std::optional<RenderSettings> m_powerRestoreSettings;
+        bool m_thermalGovernorRequested = thermalGovernorFromEnvironment();
+        vk_thermal::ThermalGovernor m_thermalGovernor;
+        // The render scale the quality tiers are shares of, taken when the first tier is left.
+        std::optional<double> m_thermalBaseScale;
+        // Below 1, windows on the raster path render at this fraction of their framebuffer
+        // size and are upscaled into the swapchain image.
+        double m_renderScale = renderScaleFromEnvironment();
+        // Scales the resolution below the render scale to hold the GPU frame time at a budget.
+        // The render targets are allocated at the render scale and only partly rendered to.
+        std::optional<double> m_gpuBudget = gpuBudgetFromEnvironment();
+        vk_resolution::DynamicResolutionController m_dynamicResolution;
+        // Upscales scaled frames from their jittered samples over time, instead of blitting.
+        vk_upscaling::Upscaler m_upscalerRequested = upscalerFromEnvironment();
+        vk_upscaling::TemporalUpscaler m_temporalUpscaler;
+        // Rebuilt every frame from the raster windows' passes. Places the barriers between them,
+        // and holds the transient images they render into.
+        vk_render_graph::RenderGraph m_renderGraph;
+        // The layouts of the windows' images from one frame to the next, which the barriers
+        // around the render graph, and of the paths without one, are placed from.
+        vk_barriers::ImageLayoutTracker m_imageLayouts;
+        // Culls and draws a field of instances on the GPU, in the raster windows' main pass.
+        uint32_t m_instanceCount = instanceCountFromEnvironment();
+        uint32_t m_lightCount = lightCountFromEnvironment();
+        bool m_meshShadingRequested = meshShadingFromEnvironment();
+        bool m_generatedCommandsRequested = generatedCommandsFromEnvironment();
+        bool m_descriptorBufferRequested = descriptorBufferFromEnvironment();
+        bool m_shaderObjectsRequested = shaderObjectsFromEnvironment();
+        bool m_depthPrepassRequested = depthPrepassFromEnvironment();
+        vk_gpu_driven::ShadowMode m_shadowsRequested = shadowsFromEnvironment();
+        float m_lodErrorRequested = lodErrorFromEnvironment();
+        bool m_animationRequested = animationFromEnvironment();
+        uint32_t m_msaaSamplesRequested = msaaSamplesFromEnvironment();
+        vk_shading_rate::Mode m_shadingRateRequested = shadingRateFromEnvironment();
+        vk_shading_rate::Mode m_shadingRate = vk_shading_rate::Mode::Off;
+        vk_gpu_driven::IndirectRenderer m_indirectRenderer;
+        // The scene is simulated at a fixed tick rate, a tick ahead on the job system, and each
+        // tick's state handed to the frame that takes it in a packet.
+        vk_frame_packets::FramePacketExchange<vk_gpu_driven::ScenePacket> m_scenePackets;
+        vk_simulation::FixedTimestep m_simulationClock;
+        // Fills the shading rate attachment of the scene's main passes with the foveated rate.
+        vk_shading_rate::FoveatedShadingRate m_foveatedShadingRate;
+        // A fountain of particles in the scene, simulated on the GPU, on the async compute queue
+        // when there is one, and drawn in the main pass after it.
+        uint32_t m_particleCount = particleCountFromEnvironment();
+        vk_gpu_primitives::GpuPrimitives m_gpuPrimitives;
+        vk_particles::ParticleSystem m_particleSystem;
+        // The scene's acceleration structures, for ray queried shadows and picking.
+        vk_ray_query::SceneAccelerationStructure m_sceneAccelerationStructure;
+        // Picks on the CPU instead, on devices without ray queries.
+        vk_bvh::SceneBvh m_sceneBvh;
+        // Clipmapped terrain under the scene, drawn in the main pass after it.
+        bool m_terrainRequested = terrainFromEnvironment();
+        vk_terrain::TerrainRenderer m_terrainRenderer;
+        vk_streaming::TextureStreamer m_textureStreamer;
+        VkDeviceSize m_textureStreamingBudget = bufferSizeFromEnvironment(TEXTURE_STREAMING_BUDGET_ENVIRONMENT_VARIABLE, DEFAULT_TEXTURE_STREAMING_BUDGET_MIB);
+        // Panes of glass drawn over the scene after its main pass, without sorting them.
+        std::optional<vk_transparency::Mode> m_transparencyRequested = transparencyFromEnvironment();
+        vk_transparency::TransparencyRenderer m_transparencyRenderer;
+        // Exposure, tonemapping, grading, the vignette and dithering in one pass between the
+        // scene's HDR color and the swapchain.
+        bool m_postProcessRequested = postProcessFromEnvironment();
+        vk_post::PostProcessStack m_postProcess;
+        // A grid of operator widgets over every window, drawn as sprites in a few batches.
+        uint32_t m_widgetCount = widgetCountFromEnvironment();
+        vk_sprites::SpriteBatcher m_spriteBatcher;
+        // The atlas lives in the image pool, and the sprites sample it through its index in the
+        // bindless heap.
+        vk_resources::ImageHandle m_iconAtlas;
+        vk_upload::UploadTicket m_iconAtlasUpload = 0;
+        std::optional<uint32_t> m_iconTexture;
+        vk_text::TextRenderer m_textRenderer;
+        // The tuning overlay over the first window, toggled with F1.
+        bool m_overlayRequested = overlayFromEnvironment();
+        vk_overlay::Overlay m_overlay;
+        // What the main passes of the frame being recorded draw the particles from.
+        std::optional<vk_particles::ParticleResources> m_frameParticles;
+        // What they draw the terrain from.
+        std::optional<vk_terrain::TerrainResources> m_frameTerrain;
+        // The feedback of streamed textures the terrain's draws write to.
+        std::optional<vk_render_graph::ResourceId> m_frameTextureFeedback;
+        // And what their transparent passes share.
+        vk_transparency::FrameResources m_frameTransparency;
+        // The id the frame being drawn presents with, and tags its latency markers with.
+        uint64_t m_framePresentId = 0;
+        bool m_frameTelemetryExport = frameTelemetryFromEnvironment();
+        std::optional<vk_socket::Endpoint> m_metricsEndpoint = metricsEndpointFromEnvironment();
+        // Serves the frame telemetry to Prometheus scrapes when asked to.
+        vk_metrics::MetricsServer m_metricsServer;
+        std::optional<vk_socket::Endpoint> m_serviceEndpoint = serviceEndpointFromEnvironment();
+        // Renders offscreen on request in service mode, with the device kept between requests.
+        vk_service::RenderService m_renderService;
+        std::optional<std::filesystem::path> m_frameExportPath = frameExportPathFromEnvironment();
+        // Shares the offscreen images and the frame timeline semaphore with other processes.
+        vk_frame_export::FrameExporter m_frameExporter;
+        std::optional<std::filesystem::path> m_videoEncodePath = videoEncodePathFromEnvironment();
+        // What the device encodes the offscreen images with, once they were made for it.
+        std::optional<vk_video_encode::EncodeSupport> m_videoEncodeSupport;
+        // Encodes the offscreen images on the video encode queue when asked to.
+        vk_video_encode::VideoEncoder m_videoEncoder;
+        bool m_pipelineStatisticsRequested = pipelineStatisticsFromEnvironment();
+        // Counts shader invocations and clipped primitives per render graph pass when asked to.
+        vk_profiling::PipelineStatisticsProfiler m_pipelineStatistics;
+        std::vector<std::string> m_performanceCounterPatterns = performanceCountersFromEnvironment();
+        // Reads hardware counters like cache hit rates and occupancy per render graph pass.
+        vk_profiling::PerformanceCounterProfiler m_performanceCounters;
+        bool m_crashDiagnosticsRequested = crashDiagnosticsFromEnvironment();
+        // Where every pass began and ended on the GPU, for when the device is lost.
+        vk_breadcrumbs::Breadcrumbs m_breadcrumbs;
+        bool m_deviceLostReported = false;
+        std::optional<std::chrono::steady_clock::time_point> m_lastFrameStart;
+        std::chrono::steady_clock::time_point m_lastFrameTelemetryExport = std::chrono::steady_clock::now();
+        vk_debug::DebugMessageSink m_debugMessageSink;
+        vk_extensions::InstanceExtensionIndex m_instanceExtensions;
+        vk_memory::DeviceMemoryAllocator m_memoryAllocator;
+        vk_memory::MemoryBudgetMonitor m_memoryBudget;
+        vk_memory::FrameUploadArena m_frameUploadArena;
+        VkDeviceSize m_frameUploadArenaSize = bufferSizeFromEnvironment(FRAME_UPLOAD_ARENA_ENVIRONMENT_VARIABLE, DEFAULT_FRAME_UPLOAD_ARENA_MIB);
+        std::optional<vk_memory::UploadStrategy> m_uploadStrategyOverride = uploadStrategyFromEnvironment();
+        vk_upload::UploadService m_uploadService;
+        VkDeviceSize m_stagingBufferSize = bufferSizeFromEnvironment(STAGING_BUFFER_ENVIRONMENT_VARIABLE, DEFAULT_STAGING_BUFFER_MIB);
+        bool m_hostImageCopyRequested = hostImageCopyFromEnvironment();
+        vk_readback::ReadbackService m_readbackService;
+        VkDeviceSize m_readbackBufferSize = bufferSizeFromEnvironment(READBACK_BUFFER_ENVIRONMENT_VARIABLE, DEFAULT_READBACK_BUFFER_MIB);
+        // F12 asks for a screenshot of the next frame, whose readback is written out once the
+        // frame it was copied in has finished.
+        bool m_screenshotRequested = false;
+        std::vector<Screenshot> m_pendingScreenshots;
+        uint32_t m_screenshotCount = 0;
+        vk_frame_dump::FrameDumper m_frameDumper;
+        std::chrono::milliseconds m_acquireTimeout = acquireTimeoutFromEnvironment();
+        uint64_t m_acquireCount = 0;
+        uint64_t m_acquiresBlocked = 0;
+        uint64_t m_acquireTimeouts = 0;
+        vk_assets::AssetPack m_assetPack;
+        vk_async_io::AsyncFileReader m_assetReader;
+        vk_textures::BlockCompression m_textureCompression = vk_textures::BlockCompression::None;
+        vk_jobs::JobSystem m_jobSystem;
+        std::optional<uint32_t> m_jobThreadCount = jobThreadCountFromEnvironment();
+        bool m_threadPlacementRequested = threadPlacementFromEnvironment();
+        vk_topology::CpuTopology m_cpuTopology;
+        vk_topology::ThreadPlacement m_threadPlacement;
+        vk_pipeline_cache::PipelineCache m_pipelineCache;
+        vk_pipelines::PipelineCompiler m_pipelineCompiler;
+        vk_pipelines::PipelineRegistry m_pipelineRegistry;
+        vk_compute::ComputeTuning m_computeTuning;
+        vk_shaders::ShaderLibrary m_shaderLibrary;
+        vk_descriptors::BindlessDescriptorHeap m_descriptorHeap;
+        vk_descriptors::DescriptorLayoutCache m_descriptorLayoutCache;
+        vk_descriptors::SamplerCache m_samplerCache;
+        vk_descriptors::FrameDescriptorAllocator m_frameDescriptors;
+        vk_features::FeatureSet m_deviceFeatures;
+        vk_features::Tier m_maxTier = maxTierFromEnvironment();
+        // Picked from `m_deviceFeatures`, nothing for a device below every tier.
+        std::optional<vk_features::Tier> m_tier;
+        vk_features::TierPaths m_tierPaths;
+
+        RenderMode m_renderMode = renderModeFromEnvironment();
+        vk_validation::ValidationPolicy m_validationPolicy = validationPolicyFromEnvironment();
+        bool m_debugLabelsRequested = debugLabelsFromEnvironment();
+        std::optional<uint64_t> m_headlessFrameCount = headlessFrameCountFromEnvironment();
+        std::optional<BenchmarkSettings> m_benchmarkSettings = benchmarkSettingsFromEnvironment();
+        vk_profiling::BenchmarkRecorder m_benchmark;
+        // Captures write down every submitted frame, and replays render a capture's frames
+        // headless, one per frame, in place of whatever the windows would have done.
+        vk_capture::CaptureWriter m_captureWriter;
+        std::optional<vk_capture::Capture> m_replay;
+        std::vector<vk_capture::CapturedWindow> m_frameCapturedWindows;
+        // Without a window, frames are rendered into images owned by the app instead of a
+        // swapchain, and never presented.
+        std::vector<vk_memory::Allocation> m_offscreenImageAllocations;
+        std::atomic<bool> m_frameRequested = true;
+
+        // With a render thread, the main thread only handles events, and the render thread
+        // owns acquire, submission and present. Input and framebuffer sizes cross over through
+        // the queue and the per window sizes, which only the main thread writes.
+        bool m_renderThreadEnabled = renderThreadFromEnvironment();
+        std::thread m_renderThread;
+        std::atomic<bool> m_renderThreadStop = false;
+        std::atomic<bool> m_renderThreadDone = false;
+        std::exception_ptr m_renderThreadError;
+        vk_result::Status m_renderThreadStatus;
+        vk_input::SpscQueue<vk_input::InputEvent, INPUT_QUEUE_CAPACITY> m_inputQueue;
+        std::array<vk_input::FramebufferSize, MAX_WINDOW_COUNT> m_framebufferSizes;
+        std::array<std::atomic<bool>, MAX_WINDOW_COUNT> m_windowsIconified {};
+        // Raised by the main thread when a window gets the focus back, which is when a window
+        // that lost exclusive fullscreen asks for it again.
+        std::array<std::atomic<bool>, MAX_WINDOW_COUNT> m_windowsRefocused {};
+        // The monitor each window is on, from `vk_fullscreen::windowMonitor` on the main thread
+        // whenever a window moves or its content scale changes.
+        std::array<std::atomic<GLFWmonitor*>, MAX_WINDOW_COUNT> m_windowMonitors {};
+        // The refresh rate of each of those monitors in Hz, or 0 where GLFW knows none.
+        std::array<std::atomic<int>, MAX_WINDOW_COUNT> m_windowRefreshRates {};
+        // Set while the frame limit follows `m_displayRefreshRate`, the refresh rate of the
+        // first window's monitor, which is until a limit is set from the keyboard.
+        bool m_frameLimitFollowsDisplay = false;
+        int m_displayRefreshRate = 0;
+        bool m_renderingSuspended = false;
+        // The input the current frame responds to, in the order it arrived. Reserved for a
+        // full queue up front, so draining never allocates.
+        std::vector<vk_input::InputEvent> m_frameInputEvents;
+
+
+        void createGLFWLibrary() {
+            // GLFW would otherwise open its own handle to the loader.
+            glfwInitVulkanLoader(vkGetInstanceProcAddr);
+
+            const auto result = glfwInit();
+            if (!result) {
+                glfwTerminate();
+
+                auto errorMessage = std::string { "Failed to initialize GLFW" };
+
+                throw std::runtime_error { errorMessage };
+            }
+
+            glfwSetMonitorCallback(vk_fullscreen::monitorCallback);
+        }
+
+        // Enumerate the instance layers and extensions once, for every check before
+        // `vkCreateInstance` to query. The validation layer's own extensions are indexed too.
+        void enumerateExtensions() {
+            m_instanceExtensions.build(VALIDATION_LAYERS);
+
+            if (vk_config::get(LIST_EXTENSIONS_ENVIRONMENT_VARIABLE) != nullptr) {
+                vk_log::flush();
+                m_instanceExtensions.report(std::cout);
+            }
+        }
+
+        // Allocated from the frame arena, so only for use within an `ArenaScope`.
+        std::pmr::vector<const char*> getRequiredExtensions() {
+            auto requiredExtensions = std::pmr::vector<const char*>(&m_frameArena);
+            if (m_displayIndex.has_value()) {
+                requiredExtensions.emplace_back(VK_KHR_SURFACE_EXTENSION_NAME);
+                requiredExtensions.emplace_back(VK_KHR_DISPLAY_EXTENSION_NAME);
+            } else if (!this->isHeadless()) {
+                uint32_t glfwExtensionCount = 0;
+                const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+                requiredExtensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+            }
+
+            if (this->isValidationEnabled() || this->usesDebugLabels()) {
+                requiredExtensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+            }
+
+            // The HDR color spaces are only reported to instances that enable it.
+            if (!this->isHeadless() && m_surfaceFormatPolicy == vk_surface::SurfaceFormatPolicy::Hdr) {
+                if (m_instanceExtensions.hasExtension(VK_EXT_SWAPCHAIN_COLOR_SPACE_EXTENSION_NAME)) {
+                    requiredExtensions.emplace_back(VK_EXT_SWAPCHAIN_COLOR_SPACE_EXTENSION_NAME);
+                }
+            }
+
+            // Swapchain maintenance on the device depends on these, which also tell which present
+            // modes a swapchain can switch between.
+            if (this->usesSurfaceMaintenance()) {
+                requiredExtensions.emplace_back(VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME);
+                requiredExtensions.emplace_back(VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME);
+            }
+
+            // Only portability implementations like MoltenVK advertise it, and enabling it
+            // anywhere else fails instance creation.
+            if (this->usesPortabilityEnumeration()) {
+                requiredExtensions.emplace_back(VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME);
+            }
+
+            return requiredExtensions;
+        }
+
+        bool usesSurfaceMaintenance() const {
+            return !this->isHeadless()
+                && m_instanceExtensions.hasExtension(VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME)
+                && m_instanceExtensions.hasExtension(VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME);
+        }
+
+        bool usesPortabilityEnumeration() const {
+            if constexpr (vk_platform::CurrentPlatform::REQUIRES_PORTABILITY_ENUMERATION) {
+                return true;
+            } else {
+                return m_instanceExtensions.hasExtension(VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME);
+            }
+        }
+
+        bool checkValidationLayerSupport() const {
+            return m_instanceExtensions.hasLayers(SORTED_VALIDATION_LAYERS);
+        }
+
+        static VkResult CreateDebugUtilsMessengerEXT(
+            VkInstance instance,
+            const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo,
+            const VkAllocationCallbacks* pAllocator,
+            VkDebugUtilsMessengerEXT* pDebugMessenger
+        ) {
+            if (vkCreateDebugUtilsMessengerEXT != nullptr) {
+                return vkCreateDebugUtilsMessengerEXT(instance, pCreateInfo, pAllocator, pDebugMessenger);
+            } else {
+                return VK_ERROR_EXTENSION_NOT_PRESENT;
+            }
+        }
+
+        static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
+            VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
+            VkDebugUtilsMessageTypeFlagsEXT messageType,
+            const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData,
+            void* pUserData
+        ) {
+            // This runs on whichever thread the driver raised the message on, possibly in the
+            // middle of a `vkQueueSubmit`, so it only hands the message to the sink's queue.
+            auto sink = reinterpret_cast<vk_debug::DebugMessageSink*>(pUserData);
+            sink->push(vk_debug::severityFromFlags(messageSeverity), pCallbackData->messageIdNumber, pCallbackData->pMessage);
+
+            return VK_FALSE;
+        }
+
+        bool isValidationEnabled() const {
+            return m_validationPolicy != vk_validation::ValidationPolicy::Off;
+        }
+
+        // Object names and command buffer labels come along with validation, and release
+        // builds ask for them with `HELLO_WINDOW_DEBUG_LABELS`, wherever the loader has the
+        // extension without the validation layer.
+        bool usesDebugLabels() const {
+            if (!HELLO_WINDOW_DEBUG_LABELS) {
+                return false;
+            }
+
+            return this->isValidationEnabled() || (m_debugLabelsRequested && m_instanceExtensions.hasExtension(VK_EXT_DEBUG_UTILS_EXTENSION_NAME));
+        }
+
+        // Whether the validation layer implements `VK_EXT_layer_settings`, which only older
+        // SDKs lack. Without it, the layer runs its default checks whatever the policy.
+        bool checkLayerSettingsSupport() const {
+            return m_instanceExtensions.hasExtension(VK_EXT_LAYER_SETTINGS_EXTENSION_NAME, VK_LAYER_KHRONOS_validation);
+        }
+
+        VkDebugUtilsMessengerCreateInfoEXT createDebugMessengerCreateInfo() {
+            if (this->isValidationEnabled()) {
+                return VkDebugUtilsMessengerCreateInfoEXT {
+                    .sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT,
+                    .messageSeverity = vk_validation::messageSeverities(m_validationPolicy),
+                    .messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | 
+                        VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | 
+                        VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT,
+                    .pfnUserCallback = debugCallback,
+                    .pUserData = &m_debugMessageSink,
+                };
+            }
+
+            return VkDebugUtilsMessengerCreateInfoEXT {};
+        }
+
+        vk_result::Status createInstance() {
+            this->enumerateExtensions();
+
+            if (this->isValidationEnabled() && !this->checkValidationLayerSupport()) {
+                throw std::runtime_error("validation layers requested, but not available!");
+            }
+
+            // The sink has to be running before `vkCreateInstance`, since the messenger chained
+            // into the instance create info reports messages raised during instance creation.
+            if (this->isValidationEnabled()) {
+                m_debugMessageSink.start(vk_config::get(VALIDATION_LOG_ENVIRONMENT_VARIABLE));
+            }
+
+            const auto appInfo = VkApplicationInfo {
+                .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+                .pApplicationName = "Hello Window",
+                .applicationVersion = VK_MAKE_VERSION(1, 0, 0),
+                .pEngineName = "No Engine",
+                .engineVersion = VK_MAKE_VERSION(1, 0, 0),
+                .apiVersion = VK_API_VERSION_1_3,
+            };
+            
+            const auto scope = vk_host_memory::ArenaScope { m_frameArena };
+            auto requiredExtensions = this->getRequiredExtensions();
+            const auto missingExtension = m_instanceExtensions.findMissingExtension(requiredExtensions);
+            if (missingExtension != nullptr) {
+                throw std::runtime_error(fmt::format("failed to find required instance extension {}!", missingExtension));
+            }
+
+            const bool layerSettings = this->isValidationEnabled() && this->checkLayerSettingsSupport();
+            if (layerSettings) {
+                requiredExtensions.push_back(VK_EXT_LAYER_SETTINGS_EXTENSION_NAME);
+            }
+
+            if (this->isValidationEnabled()) {
+                VK_LOG_INFO(
+                    "Validation: {}{}",
+                    vk_validation::validationPolicyToString(m_validationPolicy),
+                    layerSettings ? "" : " (the layer lacks VK_EXT_layer_settings, running its default checks)"
+                );
+            }
+
+            const auto flags = this->usesPortabilityEnumeration()
+                ? VkInstanceCreateFlags { VK_INSTANCE_CREATE_ENUMERATE_PORTABILITY_BIT_KHR }
+                : VkInstanceCreateFlags {};
+            
+            const auto debugCreateInfo = this->createDebugMessengerCreateInfo();
+            const auto debugCreateInfoPtr = [this, &debugCreateInfo]() -> const VkDebugUtilsMessengerCreateInfoEXT* {
+                if (this->isValidationEnabled()) {
+                    return &debugCreateInfo;
+                } else {
+                    return static_cast<VkDebugUtilsMessengerCreateInfoEXT*>(nullptr);
+                }
+            }();
+
+            auto validationSettings = vk_validation::LayerSettings { m_validationPolicy };
+            const auto instanceNext = layerSettings
+                ? static_cast<const void*>(validationSettings.chain(debugCreateInfoPtr))
+                : static_cast<const void*>(debugCreateInfoPtr);
+
+            const auto enabledLayerNames = this->isValidationEnabled() ? std::span<const char* const> { VALIDATION_LAYERS } : std::span<const char* const> {};
+
+            const auto createInfo = VkInstanceCreateInfo {
+                .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+                .pApplicationInfo = &appInfo,
+                .enabledExtensionCount = static_cast<uint32_t>(requiredExtensions.size()),
+                .ppEnabledExtensionNames = requiredExtensions.data(),
+                .flags = flags,
+                .enabledLayerCount = static_cast<uint32_t>(enabledLayerNames.size()),
+                .ppEnabledLayerNames = enabledLayerNames.data(),
+                .pNext = instanceNext,
+            };
+
+            auto instance = VkInstance {};
+            const auto result = vkCreateInstance(&createInfo, m_hostAllocator.callbacks(), &instance);
+            VK_RESULT_TRY(vk_result::check(result, "failed to create instance"));
+
+            vk_dispatch::loadInstance(instance);
+
+            m_instance = vk_handles::Instance { instance, m_hostAllocator.callbacks() };
+            if (this->usesDebugLabels()) {
+                vk_debug::enableLabels();
+            } else if (m_debugLabelsRequested) {
+                VK_LOG_WARNING("Debug labels unavailable, the loader has no {}", VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+            }
+
+            return vk_result::Status {};
+        }
+
+        vk_result::Status setupDebugMessenger() {
+            if (this->isValidationEnabled()) {
+                const auto createInfo = this->createDebugMessengerCreateInfo();
+
+                auto debugMessenger = VkDebugUtilsMessengerEXT {};
+                const auto result = App::CreateDebugUtilsMessengerEXT(m_instance, &createInfo, m_hostAllocator.callbacks(), &debugMessenger);
+                VK_RESULT_TRY(vk_result::check(result, "failed to set up debug messenger"));
+
+                m_debugMessenger = vk_handles::DebugMessenger { m_instance, debugMessenger, m_hostAllocator.callbacks() };
+            }
+
+            return vk_result::Status {};
+        }
+
+        vk_result::Status createSurfaces() {
+            if (m_displayIndex.has_value()) {
+                return this->createDisplaySurface();
+            }
+
+            for (auto& presenter : m_presenters) {
+                auto surface = VkSurfaceKHR {};
+                const auto result = glfwCreateWindowSurface(m_instance, presenter.window, m_hostAllocator.callbacks(), &surface);
+                VK_RESULT_TRY(vk_result::check(result, "failed to create window surface"));
+
+                presenter.surface = vk_handles::Surface { m_instance, surface, m_hostAllocator.callbacks() };
+            }
+
+            return vk_result::Status {};
+        }
+
+        // The surface covers the display's whole mode, which never changes, so the one
+        // presenter's framebuffer has that size from the start.
+        vk_result::Status createDisplaySurface() {
+            const auto& target = m_displayTarget.emplace(vk_display::findDisplay(m_instance, m_displayIndex.value()));
+            VK_LOG_INFO(
+                "Presenting directly to {}, {}x{} at {:.2f} Hz on plane {}",
+                target.name,
+                target.extent.width,
+                target.extent.height,
+                target.refreshRate / 1000.0,
+                target.planeIndex
+            );
+
+            const auto createInfo = vk_display::surfaceCreateInfo(target);
+            auto surface = VkSurfaceKHR {};
+            const auto result = vkCreateDisplayPlaneSurfaceKHR(m_instance, &createInfo, m_hostAllocator.callbacks(), &surface);
+            VK_RESULT_TRY(vk_result::check(result, "failed to create display surface"));
+
+            auto& presenter = m_presenters.front();
+            presenter.surface = vk_handles::Surface { m_instance, surface, m_hostAllocator.callbacks() };
+            presenter.framebufferExtent = target.extent;
+            m_framebufferSizes[presenter.index].store(target.extent.width, target.extent.height);
+
+            return vk_result::Status {};
+        }
+
+        // Every window is presented in the same `vkQueuePresentKHR` call, so a present family
+        // has to support all of their surfaces.
+        bool supportsPresent(VkPhysicalDevice device, uint32_t queueFamilyIndex) {
+            for (const auto& presenter : m_presenters) {
+                VkBool32 presentSupport = false;
+                vkGetPhysicalDeviceSurfaceSupportKHR(device, queueFamilyIndex, presenter.surface, &presentSupport);
+                if (!presentSupport) {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        bool checkDeviceExtensionSupport(const std::vector<VkExtensionProperties>& availableExtensions) {
+            return vk_extensions::containsAll(SORTED_DEVICE_EXTENSIONS, availableExtensions, [](const VkExtensionProperties& extension) {
+                return extension.extensionName;
+            });
+        }
+
+        bool isPhysicalDeviceSuitable(const PhysicalDeviceInfo& deviceInfo) {
+            const bool presentRequired = !this->isHeadless();
+            const bool extensionsSupported = !presentRequired || this->checkDeviceExtensionSupport(deviceInfo.extensions);
+            const bool swapChainAdequate = !presentRequired || (!deviceInfo.surfaceFormats.empty() && !deviceInfo.presentModes.empty());
+            // Frames are drawn with dynamic rendering and synchronization2, both core in 1.3.
+            const bool apiVersionSupported = deviceInfo.properties.apiVersion >= VK_API_VERSION_1_3;
+            const bool featuresSupported = vk_features::meetsRequirements(deviceInfo.features);
+            const bool drivesDisplay = !m_displayTarget.has_value() || m_displayTarget->physicalDevice == deviceInfo.physicalDevice;
+
+            return deviceInfo.queueFamilyIndices.isComplete(presentRequired)
+                && drivesDisplay
+                && extensionsSupported
+                && swapChainAdequate
+                && apiVersionSupported
+                && featuresSupported;
+        }
+
+        PhysicalDeviceInfo queryPhysicalDeviceInfo(VkPhysicalDevice device) {
+            auto deviceInfo = PhysicalDeviceInfo {};
+            deviceInfo.physicalDevice = device;
+            vkGetPhysicalDeviceProperties(device, &deviceInfo.properties);
+            vkGetPhysicalDeviceMemoryProperties(device, &deviceInfo.memoryProperties);
+            deviceInfo.uuid = App::getPhysicalDeviceUUID(device);
+
+            uint32_t queueFamilyCount = 0;
+            vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
+
+            deviceInfo.queueFamilies.resize(queueFamilyCount);
+            vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, deviceInfo.queueFamilies.data());
+
+            uint32_t extensionCount = 0;
+            vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+            deviceInfo.extensions.resize(extensionCount);
+            vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, deviceInfo.extensions.data());
+
+            deviceInfo.features = vk_features::FeatureChain::query(device, deviceInfo.properties.apiVersion, deviceInfo.extensions);
+
+            // The other windows are normally on the same display, and are checked once the
+            // device is selected.
+            if (!this->isHeadless()) {
+                const auto surface = m_presenters.front().surface.get();
+                uint32_t formatCount = 0;
+                vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, nullptr);
+
+                deviceInfo.surfaceFormats.resize(formatCount);
+                vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, deviceInfo.surfaceFormats.data());
+
+                uint32_t presentModeCount = 0;
+                vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, nullptr);
+
+                deviceInfo.presentModes.resize(presentModeCount);
+                vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, deviceInfo.presentModes.data());
+            }
+
+            if (this->isHeadless() && m_videoEncodePath.has_value() && vk_features::hasExtension(deviceInfo.extensions, VK_KHR_VIDEO_ENCODE_QUEUE_EXTENSION_NAME)) {
+                deviceInfo.videoEncodeCodecs = vk_video_encode::queueFamilyVideoCodecs(device);
+            }
+
+            deviceInfo.queueFamilyIndices = this->findQueueFamilies(device, deviceInfo.queueFamilies, deviceInfo.videoEncodeCodecs);
+
+            return deviceInfo;
+        }
+
+        // A family that both renders and presents is preferred over the first graphics family
+        // and the first present family, which may differ even when one family does both. Only a
+        // split pays for concurrent or transferred swapchain images and a cross queue present.
+        QueueFamilyIndices findQueueFamilies(
+            VkPhysicalDevice device,
+            const std::vector<VkQueueFamilyProperties>& queueFamilies,
+            const std::vector<VkVideoCodecOperationFlagsKHR>& videoEncodeCodecs
+        ) {
+            auto indices = QueueFamilyIndices {};
+            auto combinedFamily = std::optional<uint32_t> {};
+
+            uint32_t i = 0;
+            for (const auto& queueFamily : queueFamilies) {
+                const bool hasGraphics = queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT;
+                const bool hasCompute = queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT;
+                const bool hasTransfer = queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT;
+
+                if (hasGraphics && !indices.graphicsFamily.has_value()) {
+                    indices.graphicsFamily = i;
+                }
+
+                if (!this->isHeadless() && !combinedFamily.has_value()) {
+                    const bool presentSupport = this->supportsPresent(device, i);
+
+                    if (presentSupport && !indices.presentFamily.has_value()) {
+                        indices.presentFamily = i;
+                    }
+
+                    if (presentSupport && hasGraphics) {
+                        combinedFamily = i;
+                    }
+                }
+
+                if (!hasGraphics && hasCompute && !indices.computeFamily.has_value()) {
+                    indices.computeFamily = i;
+                }
+
+                if (!hasGraphics && !hasCompute && hasTransfer && !indices.transferFamily.has_value()) {
+                    indices.transferFamily = i;
+                }
+
+                const bool encodesH264 = i < videoEncodeCodecs.size() && (videoEncodeCodecs[i] & VK_VIDEO_CODEC_OPERATION_ENCODE_H264_BIT_KHR);
+                if (encodesH264 && !indices.videoEncodeFamily.has_value()) {
+                    indices.videoEncodeFamily = i;
+                }
+
+                i++;
+            }
+
+            if (combinedFamily.has_value()) {
+                indices.graphicsFamily = combinedFamily;
+                indices.presentFamily = combinedFamily;
+            }
+
+            // Presenting from the async compute family takes the present, and the acquire half
+            // of an exclusive image's ownership transfer, off the graphics queue, which can then
+            // start on the next frame as soon as it has rendered this one.
+            if (
+                m_presentOnComputeRequested
+                && !this->isHeadless()
+                && indices.computeFamily.has_value()
+                && this->supportsPresent(device, indices.computeFamily.value())
+            ) {
+                indices.presentFamily = indices.computeFamily;
+            }
+
+            return indices;
+        }
+
+        PhysicalDeviceScore scorePhysicalDevice(const PhysicalDeviceInfo& deviceInfo) {
+            const auto& properties = deviceInfo.properties;
+            const auto& memoryProperties = deviceInfo.memoryProperties;
+            const auto& features = deviceInfo.features.features2.features;
+
+            const uint32_t deviceTypeRank = [&properties]() -> uint32_t {
+                switch (properties.deviceType) {
+                    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: return 4;
+                    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return 3;
+                    case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: return 2;
+                    case VK_PHYSICAL_DEVICE_TYPE_CPU: return 1;
+                    default: return 0;
+                }
+            }();
+
+            VkDeviceSize deviceLocalHeapSize = 0;
+            for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+                if (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+                    deviceLocalHeapSize = std::max(deviceLocalHeapSize, memoryProperties.memoryHeaps[i].size);
+                }
+            }
+
+            // Families that can run compute or transfer work without graphics let those
+            // workloads overlap rendering instead of queueing behind it.
+            uint32_t queueCapabilities = 0;
+            for (const auto& queueFamily : deviceInfo.queueFamilies) {
+                const bool hasGraphics = queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT;
+                const bool hasCompute = queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT;
+                const bool hasTransfer = queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT;
+                if (!hasGraphics && hasCompute) {
+                    queueCapabilities++;
+                }
+
+                if (!hasGraphics && !hasCompute && hasTransfer) {
+                    queueCapabilities++;
+                }
+            }
+
+            const auto featureList = std::array<VkBool32, 6> {
+                features.samplerAnisotropy,
+                features.textureCompressionBC,
+                features.multiDrawIndirect,
+                features.drawIndirectFirstInstance,
+                features.fillModeNonSolid,
+                features.shaderInt64,
+            };
+            const auto supportedFeatures = static_cast<uint32_t>(std::count(featureList.begin(), featureList.end(), VK_TRUE));
+
+            return PhysicalDeviceScore {
+                .deviceTypeRank = deviceTypeRank,
+                .deviceLocalHeapSize = deviceLocalHeapSize,
+                .queueCapabilities = queueCapabilities,
+                .supportedFeatures = supportedFeatures,
+            };
+        }
+
+        static std::array<uint8_t, VK_UUID_SIZE> getPhysicalDeviceUUID(VkPhysicalDevice device) {
+            auto idProperties = VkPhysicalDeviceIDProperties {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES,
+            };
+            auto properties = VkPhysicalDeviceProperties2 {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+                .pNext = &idProperties,
+            };
+            vkGetPhysicalDeviceProperties2(device, &properties);
+
+            auto uuid = std::array<uint8_t, VK_UUID_SIZE> {};
+            std::copy(std::begin(idProperties.deviceUUID), std::end(idProperties.deviceUUID), uuid.begin());
+
+            return uuid;
+        }
+
+        static std::string formatUUID(const std::array<uint8_t, VK_UUID_SIZE>& uuid) {
+            auto formatted = std::string {};
+            for (size_t i = 0; i < uuid.size(); i++) {
+                if (i == 4 || i == 6 || i == 8 || i == 10) {
+                    formatted += '-';
+                }
+
+                formatted += fmt::format("{:02x}", uuid[i]);
+            }
+
+            return formatted;
+        }
+
+        // Pin a device with `HELLO_WINDOW_DEVICE`, either by its index in enumeration order or
+        // by its UUID, with or without dashes. Indices are not stable across driver updates or
+        // hardware changes, so deployments should prefer the UUID. `integrated` and `discrete`
+        // pin the first GPU of that type, which is how laptops keep the discrete GPU asleep.
+        bool matchesPhysicalDeviceOverride(const std::string& deviceOverride, const PhysicalDeviceInfo& deviceInfo, size_t index) {
+            if (deviceOverride == "integrated") {
+                return deviceInfo.properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU;
+            } else if (deviceOverride == "discrete") {
+                return deviceInfo.properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU;
+            }
+
+            const bool isIndex = !deviceOverride.empty() && std::all_of(deviceOverride.begin(), deviceOverride.end(), [](char c) { return std::isdigit(static_cast<unsigned char>(c)); });
+            if (isIndex) {
+                return std::stoul(deviceOverride) == index;
+            }
+
+            auto normalized = std::string {};
+            for (char c : deviceOverride) {
+                if (c != '-') {
+                    normalized += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+                }
+            }
+
+            auto uuid = App::formatUUID(deviceInfo.uuid);
+            std::erase(uuid, '-');
+
+            return normalized == uuid;
+        }
+
+        void selectPhysicalDevice() {
+            uint32_t physicalDeviceCount = 0;
+            vkEnumeratePhysicalDevices(m_instance, &physicalDeviceCount, nullptr);
+
+            if (physicalDeviceCount == 0) {
+                throw std::runtime_error("failed to find GPUs with Vulkan support!");
+            }
+
+            auto physicalDevices = std::vector<VkPhysicalDevice> { physicalDeviceCount };
+            vkEnumeratePhysicalDevices(m_instance, &physicalDeviceCount, physicalDevices.data());
+
+            auto deviceInfos = std::vector<PhysicalDeviceInfo> {};
+            deviceInfos.reserve(physicalDevices.size());
+            for (const auto physicalDevice : physicalDevices) {
+                deviceInfos.push_back(this->queryPhysicalDeviceInfo(physicalDevice));
+            }
+
+            const char* deviceOverrideValue = vk_config::get(DEVICE_OVERRIDE_ENVIRONMENT_VARIABLE);
+            if (deviceOverrideValue != nullptr) {
+                const auto deviceOverride = std::string { deviceOverrideValue };
+                for (size_t i = 0; i < deviceInfos.size(); i++) {
+                    if (!this->matchesPhysicalDeviceOverride(deviceOverride, deviceInfos[i], i)) {
+                        continue;
+                    }
+
+                    if (!this->isPhysicalDeviceSuitable(deviceInfos[i])) {
+                        throw std::runtime_error(fmt::format("the GPU selected by {}={} is not suitable!", DEVICE_OVERRIDE_ENVIRONMENT_VARIABLE, deviceOverride));
+                    }
+
+                    m_physicalDevice = deviceInfos[i].physicalDevice;
+                    m_physicalDeviceInfo = std::move(deviceInfos[i]);
+
+                    return;
+                }
+
+                throw std::runtime_error(fmt::format("no GPU matches {}={}!", DEVICE_OVERRIDE_ENVIRONMENT_VARIABLE, deviceOverride));
+            }
+
+            auto ranking = std::vector<std::pair<PhysicalDeviceScore, size_t>> {};
+            for (size_t i = 0; i < deviceInfos.size(); i++) {
+                const auto& deviceInfo = deviceInfos[i];
+                if (!this->isPhysicalDeviceSuitable(deviceInfo)) {
+                    VK_LOG_INFO("GPU {}: {} is not suitable", i, deviceInfo.properties.deviceName);
+                    continue;
+                }
+
+                const auto score = this->scorePhysicalDevice(deviceInfo);
+                VK_LOG_INFO(
+                    "GPU {}: {} [{}] type rank {}, {} MiB device local, {} async queue families, {} features",
+                    i,
+                    deviceInfo.properties.deviceName,
+                    App::formatUUID(deviceInfo.uuid),
+                    score.deviceTypeRank,
+                    score.deviceLocalHeapSize / (1024 * 1024),
+                    score.queueCapabilities,
+                    score.supportedFeatures
+                );
+
+                ranking.emplace_back(score, i);
+            }
+
+            if (ranking.empty()) {
+                throw std::runtime_error("failed to find a suitable GPU!");
+            }
+
+            // Ties keep the earlier device, so the selection stays deterministic.
+            std::stable_sort(ranking.begin(), ranking.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+            m_physicalDevice = deviceInfos[ranking.front().second].physicalDevice;
+            m_physicalDeviceInfo = std::move(deviceInfos[ranking.front().second]);
+            for (size_t i = 1; i < ranking.size(); i++) {
+                m_fallbackPhysicalDevices.push_back(std::move(deviceInfos[ranking[i].second]));
+            }
+        }
+
+        bool usesSwapchainMaintenance() const {
+            return vk_features::has(m_deviceFeatures, vk_features::Feature::SwapchainMaintenance1);
+        }
+
+        bool usesDeviceGroup() const {
+            return m_deviceGroupMode != vk_device_group::DeviceGroupMode::Off;
+        }
+
+        // Alternate frames take turns on the devices, split frames run on every device.
+        uint32_t frameDeviceMask() const {
+            const auto deviceCount = static_cast<uint32_t>(m_deviceGroupDevices.size());
+            if (m_deviceGroupMode == vk_device_group::DeviceGroupMode::Afr) {
+                return 1u << (m_frameCount % deviceCount);
+            }
+
+            return vk_device_group::allDevicesMask(std::max(deviceCount, 1u));
+        }
+
+        // Device groups drive a single window's raster pass, and share its swapchain between
+        // the graphics and present families concurrently, so that no frame has to transfer
+        // image ownership on each device.
+        void selectDeviceGroup() {
+            if (!this->usesDeviceGroup()) {
+                return;
+            }
+
+            const auto modeName = vk_device_group::deviceGroupModeToString(m_deviceGroupMode);
+            auto devices = vk_device_group::findLinkedDevices(m_instance, m_physicalDevice);
+            const char* reason = nullptr;
+            if (this->isHeadless()) {
+                reason = "rendering headless";
+            } else if (m_windowCount > 1) {
+                reason = "more than one window is open";
+            } else if (devices.empty()) {
+                reason = "the selected GPU is not linked to another";
+            }
+
+            if (reason != nullptr) {
+                VK_LOG_WARNING("Device group {} unavailable, {}, falling back to off", modeName, reason);
+                m_deviceGroupMode = vk_device_group::DeviceGroupMode::Off;
+
+                return;
+            }
+
+            if (m_presentPath == PresentPath::Compute) {
+                VK_LOG_WARNING("Compute present unavailable with device group {}, falling back to raster", modeName);
+                m_presentPath = PresentPath::Raster;
+            }
+
+            if (m_swapChainSharing == SwapChainSharing::Exclusive) {
+                VK_LOG_WARNING("Exclusive swapchain sharing unavailable with device group {}, falling back to concurrent", modeName);
+                m_swapChainSharing = SwapChainSharing::Concurrent;
+            }
+
+            VK_LOG_INFO("Device group {}: {} linked GPUs", modeName, devices.size());
+            m_deviceGroupDevices = std::move(devices);
+        }
+
+        // Presenting from the group can only be checked once the device exists. Without
+        // support the device still spans the group, so every command runs on each GPU and the
+        // first one presents, which is correct if wasteful.
+        void checkDeviceGroupSupport() {
+            if (!this->usesDeviceGroup()) {
+                return;
+            }
+
+            const auto deviceCount = static_cast<uint32_t>(m_deviceGroupDevices.size());
+            const bool splitFrames = m_deviceGroupMode == vk_device_group::DeviceGroupMode::Sfr;
+            const auto presentMask = splitFrames ? 1u : vk_device_group::allDevicesMask(deviceCount);
+            const char* reason = nullptr;
+            if (!vk_device_group::supportsLocalPresent(m_device, m_presenters.front().surface, presentMask)) {
+                reason = splitFrames ? "the first GPU cannot present" : "not every GPU can present";
+            } else if (splitFrames && !vk_device_group::supportsPeerRendering(m_device, this->deviceLocalHeapIndex(), deviceCount)) {
+                reason = "the GPUs cannot render into each other's memory";
+            }
+
+            if (reason != nullptr) {
+                VK_LOG_WARNING(
+                    "Device group {} unavailable, {}, falling back to off",
+                    vk_device_group::deviceGroupModeToString(m_deviceGroupMode),
+                    reason
+                );
+                m_deviceGroupMode = vk_device_group::DeviceGroupMode::Off;
+            }
+        }
+
+        // The heap swapchain images live in, as far as the device tells.
+        uint32_t deviceLocalHeapIndex() const {
+            const auto& memoryProperties = m_physicalDeviceInfo.memoryProperties;
+            for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+                if ((memoryProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) != 0) {
+                    return memoryProperties.memoryTypes[i].heapIndex;
+                }
+            }
+
+            return 0;
+        }
+
+        // A driver can reject a device it reported everything for, so creation falls back to
+        // fewer optional features and extensions on the selected GPU, and then to the next
+        // ranked GPU, and only fails once nothing is left to try.
+        vk_result::Status createLogicalDevice() {
+            while (true) {
+                const auto status = this->createLogicalDeviceOnSelectedGpu();
+                if (status || m_fallbackPhysicalDevices.empty()) {
+                    m_fallbackPhysicalDevices.clear();
+
+                    return status;
+                }
+
+                VK_LOG_WARNING(
+                    "No device could be created on {} ({}), falling back to {}",
+                    m_physicalDeviceInfo.properties.deviceName,
+                    vk_result::resultToString(status.error().result),
+                    m_fallbackPhysicalDevices.front().properties.deviceName
+                );
+                m_physicalDeviceInfo = std::move(m_fallbackPhysicalDevices.front());
+                m_fallbackPhysicalDevices.erase(m_fallbackPhysicalDevices.begin());
+                m_physicalDevice = m_physicalDeviceInfo.physicalDevice;
+                m_deviceGroupDevices.clear();
+                this->selectDeviceGroup();
+            }
+        }
+
+        vk_result::Status createLogicalDeviceOnSelectedGpu() {
+            const auto indices = m_physicalDeviceInfo.queueFamilyIndices;
+            auto queues = vk_create_info::QueueCreateInfos {};
+            queues.add(indices.graphicsFamily.value());
+            queues.add(indices.presentFamily.value_or(indices.graphicsFamily.value()));
+            for (const auto family : { indices.computeFamily, indices.transferFamily, indices.videoEncodeFamily }) {
+                if (family.has_value()) {
+                    queues.add(family.value());
+                }
+            }
+
+            const auto queueCreateInfos = queues.infos();
+            const auto enabledLayerNames = this->isValidationEnabled() ? std::span<const char* const> { VALIDATION_LAYERS } : std::span<const char* const> {};
+
+            // Required features and extensions are always enabled, optional ones only when the
+            // device supports them at the level tried, and the rest of the renderer checks
+            // `m_deviceFeatures`.
+            const auto requiredExtensions = this->isHeadless() ? std::span<const char* const> {} : std::span<const char* const> { DEVICE_EXTENSIONS };
+            auto negotiated = vk_features::NegotiatedFeatures {};
+            auto fullFeatures = vk_features::FeatureSet {};
+            auto device = VkDevice {};
+            auto result = VK_ERROR_INITIALIZATION_FAILED;
+            for (const auto level : vk_features::FEATURE_LEVELS) {
+                negotiated = vk_features::negotiate(
+                    m_physicalDeviceInfo.features,
+                    m_physicalDeviceInfo.extensions,
+                    requiredExtensions,
+                    !this->isHeadless(),
+                    this->usesSurfaceMaintenance(),
+                    level
+                );
+                if (level == vk_features::FeatureLevel::Full) {
+                    fullFeatures = negotiated.features;
+                }
+
+                // A device spanning linked GPUs runs every command buffer on each of them,
+                // unless a device mask says otherwise.
+                const auto deviceGroupInfo = VkDeviceGroupDeviceCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_DEVICE_CREATE_INFO,
+                    .pNext = &negotiated.enabled.features2,
+                    .physicalDeviceCount = static_cast<uint32_t>(m_deviceGroupDevices.size()),
+                    .pPhysicalDevices = m_deviceGroupDevices.data(),
+                };
+                const auto createInfo = VkDeviceCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+                    .pNext = m_deviceGroupDevices.empty() ? static_cast<const void*>(&negotiated.enabled.features2) : &deviceGroupInfo,
+                    .queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size()),
+                    .pQueueCreateInfos = queueCreateInfos.data(),
+                    .enabledLayerCount = static_cast<uint32_t>(enabledLayerNames.size()),
+                    .ppEnabledLayerNames = enabledLayerNames.data(),
+                    .enabledExtensionCount = static_cast<uint32_t>(negotiated.extensions.size()),
+                    .ppEnabledExtensionNames = negotiated.extensions.data(),
+                };
+
+                result = vkCreateDevice(m_physicalDevice, &createInfo, m_hostAllocator.callbacks(), &device);
+                if (result == VK_SUCCESS) {
+                    break;
+                }
+
+                VK_LOG_WARNING(
+                    "Device creation on {} with {} features failed ({})",
+                    m_physicalDeviceInfo.properties.deviceName,
+                    vk_features::featureLevelToString(level),
+                    vk_result::resultToString(result)
+                );
+            }
+
+            VK_RESULT_TRY(vk_result::check(result, "failed to create logical device"));
+            this->reportDroppedFeatures(fullFeatures & ~negotiated.features);
+
+            vk_dispatch::loadDevice(device);
+            m_device = vk_handles::Device { device, m_hostAllocator.callbacks() };
+
+            auto graphicsQueue = VkQueue {};
+            vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
+            
+            auto presentQueue = VkQueue {};
+            vkGetDeviceQueue(device, indices.presentFamily.value_or(indices.graphicsFamily.value()), 0, &presentQueue);
+
+            // Without a dedicated family, compute work goes to the graphics queue, and
+            // transfers go to whichever of the compute or graphics queue is asynchronous.
+            auto computeQueue = graphicsQueue;
+            if (indices.computeFamily.has_value()) {
+                vkGetDeviceQueue(device, indices.computeFamily.value(), 0, &computeQueue);
+            }
+
+            auto transferQueue = computeQueue;
+            if (indices.transferFamily.has_value()) {
+                vkGetDeviceQueue(device, indices.transferFamily.value(), 0, &transferQueue);
+            }
+
+            auto videoEncodeQueue = VkQueue {};
+            if (indices.videoEncodeFamily.has_value()) {
+                vkGetDeviceQueue(device, indices.videoEncodeFamily.value(), 0, &videoEncodeQueue);
+                vk_debug::setObjectName(device, VK_OBJECT_TYPE_QUEUE, videoEncodeQueue, "video encode");
+            }
+
+            // Queues standing in for several roles end up named after the one that matters most.
+            vk_debug::setObjectName(device, VK_OBJECT_TYPE_QUEUE, transferQueue, "transfer");
+            vk_debug::setObjectName(device, VK_OBJECT_TYPE_QUEUE, presentQueue, "present");
+            vk_debug::setObjectName(device, VK_OBJECT_TYPE_QUEUE, computeQueue, "compute");
+            vk_debug::setObjectName(device, VK_OBJECT_TYPE_QUEUE, graphicsQueue, "graphics");
+
+            m_deviceFeatures = negotiated.features;
+
+            for (size_t i = 0; i < m_deviceFeatures.size(); i++) {
+                if (m_deviceFeatures.test(i)) {
+                    VK_LOG_INFO("Enabled device feature: {}", vk_features::featureToString(static_cast<vk_features::Feature>(i)));
+                }
+            }
+
+            m_tier = vk_features::selectTier(m_deviceFeatures, m_maxTier);
+            m_tierPaths = vk_features::tierPaths(m_tier);
+            if (m_tier.has_value()) {
+                VK_LOG_INFO("Capability tier: {} ({})", vk_features::tierToString(m_tier.value()), vk_features::tierProfile(m_tier.value()));
+            } else {
+                VK_LOG_INFO("Capability tier: none, the device is below the portability tier");
+            }
+
+            // Textures are loaded in the variant of this family, picked once for the device.
+            m_textureCompression = vk_textures::selectBlockCompression(m_physicalDevice, m_deviceFeatures, true);
+            VK_LOG_INFO("Texture compression: {}", vk_textures::blockCompressionToString(m_textureCompression));
+
+            // The compute shaders are specialized for these.
+            const auto subgroups = vk_compute::querySubgroupProperties(
+                m_physicalDevice,
+                vk_features::has(m_deviceFeatures, vk_features::Feature::SubgroupSizeControl),
+                vk_features::has(m_deviceFeatures, vk_features::Feature::ComputeFullSubgroups)
+            );
+            m_computeTuning = vk_compute::selectComputeTuning(subgroups);
+            VK_LOG_INFO(
+                "Compute workgroups: {} invocations in subgroups of {}{}, {}x{} tiles, subgroup compaction {}, subgroup primitives {}, subgroup quads {}",
+                m_computeTuning.linear,
+                m_computeTuning.subgroupSize,
+                m_computeTuning.pinSubgroupSize ? " (pinned)" : "",
+                m_computeTuning.tile,
+                m_computeTuning.tile,
+                m_computeTuning.subgroupCompaction ? "on" : "off",
+                m_computeTuning.subgroupPrimitives ? "on" : "off",
+                m_computeTuning.subgroupQuads ? "on" : "off"
+            );
+            m_graphicsQueue = graphicsQueue;
+            m_presentQueue = presentQueue;
+            m_computeQueue = computeQueue;
+            m_transferQueue = transferQueue;
+            m_videoEncodeQueue = videoEncodeQueue;
+            m_queueFamilyIndices = indices;
+            m_computeQueueFamily = indices.computeFamily.value_or(indices.graphicsFamily.value());
+            m_transferQueueFamily = indices.transferFamily.value_or(m_computeQueueFamily);
+            if (m_presentOnComputeRequested && !this->isHeadless()) {
+                if (indices.computeFamily.has_value() && indices.presentFamily == indices.computeFamily) {
+                    VK_LOG_INFO("Present queue: async compute family {}", indices.computeFamily.value());
+                } else {
+                    VK_LOG_INFO("Present queue: no async compute family can present, presenting from family {}", indices.presentFamily.value());
+                }
+            }
+            this->checkDeviceGroupSupport();
+
+            return vk_result::Status {};
+        }
+
+        // The features the device had to be created without, which the renderer works around.
+        void reportDroppedFeatures(const vk_features::FeatureSet& dropped) const {
+            if (dropped.none()) {
+                return;
+            }
+
+            auto names = std::string {};
+            for (size_t i = 0; i < dropped.size(); i++) {
+                if (dropped.test(i)) {
+                    names += names.empty() ? "" : ", ";
+                    names += vk_features::featureToString(static_cast<vk_features::Feature>(i));
+                }
+            }
+
+            VK_LOG_WARNING("Device created without {} of its features: {}", dropped.count(), names);
+        }
+
+        void createUploadService() {
+            auto hostCopyLayouts = std::vector<VkImageLayout> {};
+            if (m_hostImageCopyRequested && vk_features::has(m_deviceFeatures, vk_features::Feature::HostImageCopy)) {
+                hostCopyLayouts = vk_upload::hostImageCopyLayouts(m_physicalDevice);
+                VK_LOG_INFO(
+                    "Image uploads of up to {} KiB are copied from the host, in {} layouts",
+                    vk_upload::HOST_IMAGE_COPY_MAX_SIZE / 1024,
+                    hostCopyLayouts.size()
+                );
+            }
+
+            m_uploadService.init(
+                m_device,
+                m_memoryAllocator,
+                m_transferQueue,
+                m_transferQueueFamily,
+                m_queueFamilyIndices.graphicsFamily.value(),
+                m_stagingBufferSize,
+                m_physicalDeviceInfo.properties.limits.optimalBufferCopyOffsetAlignment,
+                hostCopyLayouts
+            );
+
+            const auto cpuBudget = cpuBudgetFromEnvironment();
+            for (size_t i = 0; i < vk_frame_budget::SUBSYSTEM_COUNT; i++) {
+                m_frameBudget.setBudget(static_cast<vk_frame_budget::Subsystem>(i), cpuBudget);
+            }
+            if (cpuBudget > 0.0) {
+                VK_LOG_INFO("CPU budget: {} ms per subsystem per frame", cpuBudget);
+            }
+        }
+
+        void createReadbackService() {
+            m_readbackService.init(
+                m_device,
+                m_memoryAllocator,
+                m_readbackBufferSize,
+                m_physicalDeviceInfo.properties.limits.optimalBufferCopyOffsetAlignment
+            );
+        }
+
+        void importAssetPack() {
+            const bool externalMemoryHost = vk_features::has(m_deviceFeatures, vk_features::Feature::ExternalMemoryHost);
+            m_assetPack.importMapping(m_physicalDevice, m_device, m_memoryAllocator, externalMemoryHost);
+            VK_LOG_INFO(
+                "Asset pack: {} entries, uploaded {}, streamed with {} reads",
+                m_assetPack.entries().size(),
+                m_assetPack.isImported() ? "from imported host memory" : "through the staging ring",
+                vk_async_io::backendToString(m_assetReader.backend())
+            );
+        }
+
+        void createFrameUploadArena() {
+            const auto& limits = m_physicalDeviceInfo.properties.limits;
+            const auto minAlignment = std::max(
+                limits.minUniformBufferOffsetAlignment,
+                limits.minStorageBufferOffsetAlignment
+            );
+
+            const bool resizableBar = vk_memory::hasResizableBar(m_memoryAllocator.memoryProperties());
+            const auto strategy = m_uploadStrategyOverride.value_or(vk_memory::selectUploadStrategy(m_memoryAllocator.memoryProperties()));
+            m_frameUploadArena.init(m_device, m_memoryAllocator, m_frameUploadArenaSize, m_framesInFlight, minAlignment, strategy);
+            VK_LOG_INFO(
+                "Frame uploads: {} ({}resizable BAR)",
+                vk_memory::uploadStrategyToString(strategy),
+                resizableBar ? "" : "no "
+            );
+        }
+
+        // Size the heap to what the device can bind after update in a single stage, since every
+        // binding is visible to all stages.
+        void createDescriptorHeap() {
+            if (!m_tierPaths.bindless) {
+                VK_LOG_INFO("The capability tier has no descriptor indexing, the bindless descriptor heap is disabled");
+                return;
+            }
+
+            auto vulkan12Properties = VkPhysicalDeviceVulkan12Properties {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES,
+            };
+            auto properties = VkPhysicalDeviceProperties2 {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+                .pNext = &vulkan12Properties,
+            };
+            vkGetPhysicalDeviceProperties2(m_physicalDevice, &properties);
+
+            const auto defaults = vk_descriptors::HeapLimits {};
+            auto limits = vk_descriptors::HeapLimits {
+                .sampledImages = std::min({
+                    defaults.sampledImages,
+                    vulkan12Properties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+                    vulkan12Properties.maxDescriptorSetUpdateAfterBindSampledImages,
+                }),
+                .storageBuffers = std::min({
+                    defaults.storageBuffers,
+                    vulkan12Properties.maxPerStageDescriptorUpdateAfterBindStorageBuffers,
+                    vulkan12Properties.maxDescriptorSetUpdateAfterBindStorageBuffers,
+                }),
+                .samplers = std::min({
+                    defaults.samplers,
+                    vulkan12Properties.maxPerStageDescriptorUpdateAfterBindSamplers,
+                    vulkan12Properties.maxDescriptorSetUpdateAfterBindSamplers,
+                }),
+            };
+
+            // The three arrays also share one per stage budget.
+            const auto resourceBudget = vulkan12Properties.maxPerStageUpdateAfterBindResources;
+            if (limits.sampledImages + limits.storageBuffers + limits.samplers > resourceBudget) {
+                const auto remaining = resourceBudget > limits.samplers ? resourceBudget - limits.samplers : 0;
+                limits.sampledImages = std::min(limits.sampledImages, remaining / 2);
+                limits.storageBuffers = std::min(limits.storageBuffers, remaining / 2);
+            }
+
+            // A descriptor buffer layout is not update after bind, so it is held to the limits
+            // of ordinary sets, and falls back to update after bind when those are too low.
+            auto descriptorBuffer = std::optional<vk_descriptors::DescriptorBufferSupport> {};
+            if (m_descriptorBufferRequested && vk_features::has(m_deviceFeatures, vk_features::Feature::DescriptorBuffer)) {
+                const auto& deviceLimits = properties.properties.limits;
+                const auto bufferLimits = vk_descriptors::HeapLimits {
+                    .sampledImages = std::min({ limits.sampledImages, deviceLimits.maxPerStageDescriptorSampledImages, deviceLimits.maxDescriptorSetSampledImages }),
+                    .storageBuffers = std::min({ limits.storageBuffers, deviceLimits.maxPerStageDescriptorStorageBuffers, deviceLimits.maxDescriptorSetStorageBuffers }),
+                    .samplers = std::min({ limits.samplers, deviceLimits.maxPerStageDescriptorSamplers, deviceLimits.maxDescriptorSetSamplers }),
+                };
+                if (bufferLimits.sampledImages + bufferLimits.storageBuffers + bufferLimits.samplers <= deviceLimits.maxPerStageResources) {
+                    limits = bufferLimits;
+                    descriptorBuffer = vk_descriptors::DescriptorBufferSupport {
+                        .allocator = &m_memoryAllocator,
+                        .properties = vk_descriptors::descriptorBufferProperties(m_physicalDevice),
+                    };
+                }
+            }
+
+            m_descriptorHeap.init(m_device, limits, descriptorBuffer.has_value() ? &descriptorBuffer.value() : nullptr);
+            VK_LOG_INFO(
+                "Bindless descriptor heap: {} sampled images, {} storage buffers, {} samplers, in {}",
+                limits.sampledImages,
+                limits.storageBuffers,
+                limits.samplers,
+                m_descriptorHeap.usesDescriptorBuffer()
+                    ? fmt::format("a {} byte descriptor buffer", m_descriptorHeap.descriptorBufferSize())
+                    : std::string { "a descriptor set" }
+            );
+        }
+
+        // Sets that are rewritten every frame come out of pools reset once per frame in flight,
+        // sized for the depth pyramid's first level of every window, a sampled depth buffer and
+        // a storage image, and for its shadow page marks, a storage buffer with the same depth.
+        void createDescriptorAllocators() {
+            const auto ratios = std::array {
+                vk_descriptors::PoolSizeRatio { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1.0f },
+                vk_descriptors::PoolSizeRatio { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1.0f },
+                vk_descriptors::PoolSizeRatio { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1.0f },
+            };
+            m_descriptorLayoutCache.init(m_device, m_hostAllocator.callbacks());
+            m_samplerCache.init(m_device, m_physicalDeviceInfo.properties.limits.maxSamplerAllocationCount, m_hostAllocator.callbacks());
+            m_frameDescriptors.init(
+                m_device,
+                m_framesInFlight,
+                ratios,
+                static_cast<uint32_t>(m_presenters.size()),
+                m_hostAllocator.callbacks()
+            );
+        }
+
+        void createMemoryAllocator() {
+            m_memoryAllocator.init(
+                m_physicalDevice,
+                m_device,
+                vk_features::has(m_deviceFeatures, vk_features::Feature::MemoryPriority),
+                vk_features::has(m_deviceFeatures, vk_features::Feature::BufferDeviceAddress)
+            );
+            m_memoryBudget.init(m_physicalDevice, vk_features::has(m_deviceFeatures, vk_features::Feature::MemoryBudget));
+            m_memoryAllocator.setHeapBudgets(m_memoryBudget.heaps());
+
+            const auto& memoryProperties = m_memoryAllocator.memoryProperties();
+            for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+                const auto& heap = memoryProperties.memoryHeaps[i];
+                const auto budget = m_memoryBudget.isEnabled()
+                    ? fmt::format(", {} MiB budget", m_memoryBudget.heaps()[i].budget / (1024 * 1024))
+                    : std::string {};
+                VK_LOG_INFO(
+                    "Memory heap {}: {} MiB{}{}",
+                    i,
+                    heap.size / (1024 * 1024),
+                    budget,
+                    (heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? " (device local)" : ""
+                );
+            }
+
+            m_renderGraph.init(m_device, m_memoryAllocator, m_hostAllocator.callbacks());
+        }
+
+        // The first window's formats and present modes were queried during device selection.
+        // The other windows' surfaces are queried here, once, and have to be able to present.
+        // Only a fullscreen window asks for exclusivity, and only once its surface says the
+        // monitor allows it.
+        void queryFullScreenExclusive(WindowPresenter& presenter) {
+            if (
+                presenter.monitor == nullptr
+                || !vk_features::has(m_deviceFeatures, vk_features::Feature::FullScreenExclusive)
+                || !vk_fullscreen::supportsExclusive(m_physicalDevice, presenter.surface, presenter.window)
+            ) {
+                return;
+            }
+
+            presenter.exclusivity = vk_fullscreen::Exclusivity::Requested;
+        }
+
+        // Acquired before the image of a frame, once the window is up. A window that cannot
+        // have it right now keeps its application controlled swapchain, which presents
+        // composited, and tries again once it gets the focus back.
+        void acquireFullScreenExclusive(WindowPresenter& presenter) {
+            const auto result = vk_fullscreen::acquire(m_device, presenter.swapChain);
+            if (result == VK_SUCCESS) {
+                presenter.exclusivity = vk_fullscreen::Exclusivity::Acquired;
+                VK_LOG_INFO("Window {} is exclusive fullscreen", presenter.index);
+                return;
+            }
+
+            VK_LOG_WARNING("Window {} could not go exclusive fullscreen ({}), presenting composited", presenter.index, vk_result::resultToString(result));
+            presenter.exclusivity = vk_fullscreen::Exclusivity::Lost;
+        }
+
+        // The swapchain still works after the loss, but only composited, and recreating it
+        // disallowing exclusivity keeps the driver from taking the display back on its own.
+        void loseFullScreenExclusive(WindowPresenter& presenter) {
+            VK_LOG_WARNING("Window {} lost exclusive fullscreen, presenting composited until it has the focus again", presenter.index);
+            presenter.exclusivity = vk_fullscreen::Exclusivity::Lost;
+            presenter.swapChainOutdated = true;
+        }
+
+        void querySurfaceSupport(WindowPresenter& presenter) {
+            if (presenter.index == 0) {
+                presenter.surfaceSupport.insert(
+                    m_windowMonitors[0].load(std::memory_order_acquire),
+                    vk_surface::SurfaceSupport { m_physicalDeviceInfo.surfaceFormats, m_physicalDeviceInfo.presentModes }
+                );
+            }
+
+            this->refreshSurfaceSupport(presenter);
+        }
+
+        // Point the presenter at the support on the monitor its window is on now, which is only
+        // queried on a monitor the window has not been on, after monitors were connected or
+        // disconnected, or after an out of date swapchain no resize explains. Returns whether
+        // it differs from what the current swapchain was made with.
+        bool refreshSurfaceSupport(WindowPresenter& presenter) {
+            const auto monitor = m_windowMonitors[presenter.index].load(std::memory_order_acquire);
+            const auto monitorGeneration = vk_fullscreen::monitorGeneration.load(std::memory_order_acquire);
+            if (monitorGeneration != presenter.monitorGeneration) {
+                presenter.surfaceSupport.clear();
+            } else if (presenter.surfaceSupportOutdated) {
+                presenter.surfaceSupport.invalidate(monitor);
+            }
+            presenter.surfaceMonitor = monitor;
+            presenter.monitorGeneration = monitorGeneration;
+            presenter.surfaceSupportOutdated = false;
+
+            const auto& support = presenter.surfaceSupport.get(m_physicalDevice, presenter.surface, monitor);
+            if (support.formats.empty() || support.presentModes.empty()) {
+                throw std::runtime_error(fmt::format("the selected GPU cannot present to window {}!", presenter.index));
+            }
+
+            const bool changed = support.presentModes != presenter.presentModes
+                || !std::ranges::equal(support.formats, presenter.surfaceFormats, [](const VkSurfaceFormatKHR& a, const VkSurfaceFormatKHR& b) {
+                    return a.format == b.format && a.colorSpace == b.colorSpace;
+                });
+            presenter.surfaceFormats = support.formats;
+            presenter.presentModes = support.presentModes;
+
+            return changed;
+        }
+
+        // Only the surface capabilities are queried again, since the current extent follows the
+        // window size. The formats and present modes come from the presenter's cache.
+        SwapChainSupportDetails querySwapChainSupport(const WindowPresenter& presenter) {
+            auto details = SwapChainSupportDetails {};
+            vkGetPhysicalDeviceSurfaceCapabilitiesKHR(m_physicalDevice, presenter.surface, &details.capabilities);
+            details.formats = presenter.surfaceFormats;
+            details.presentModes = presenter.presentModes;
+
+            return details;
+        }
+
+        VkSurfaceFormatKHR selectSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats) {
+            return vk_surface::selectSurfaceFormat(availableFormats, m_surfaceFormatPolicy, vk_platform::CurrentPlatform::PREFERRED_SURFACE_FORMATS);
+        }
+
+        VkPresentModeKHR selectSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes) {
+            const auto preferredPresentModes = [this]() -> std::vector<VkPresentModeKHR> {
+                switch (m_presentModePolicy) {
+                    case PresentModePolicy::Latency:
+                        return { VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR };
+                    case PresentModePolicy::Throughput:
+                        return { VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR };
+                    case PresentModePolicy::Power:
+                        return {};
+                }
+
+                return {};
+            }();
+
+            for (const auto& preferredPresentMode : preferredPresentModes) {
+                const auto found = std::find(availablePresentModes.begin(), availablePresentModes.end(), preferredPresentMode);
+                if (found != availablePresentModes.end()) {
+                    return preferredPresentMode;
+                }
+            }
+
+            // FIFO is the only present mode every implementation has to support.
+            return VK_PRESENT_MODE_FIFO_KHR;
+        }
+
+        // The present modes of the surface compatible with `presentMode`, itself first, that a
+        // swapchain of `imageCount` images has enough images for.
+        std::vector<VkPresentModeKHR> querySwitchablePresentModes(const WindowPresenter& presenter, VkPresentModeKHR presentMode, uint32_t imageCount) {
+            auto surfacePresentMode = VkSurfacePresentModeEXT {
+                .sType = VK_STRUCTURE_TYPE_SURFACE_PRESENT_MODE_EXT,
+                .presentMode = presentMode,
+            };
+            const auto surfaceInfo = VkPhysicalDeviceSurfaceInfo2KHR {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SURFACE_INFO_2_KHR,
+                .pNext = &surfacePresentMode,
+                .surface = presenter.surface,
+            };
+            auto compatibility = VkSurfacePresentModeCompatibilityEXT {
+                .sType = VK_STRUCTURE_TYPE_SURFACE_PRESENT_MODE_COMPATIBILITY_EXT,
+            };
+            auto capabilities = VkSurfaceCapabilities2KHR {
+                .sType = VK_STRUCTURE_TYPE_SURFACE_CAPABILITIES_2_KHR,
+                .pNext = &compatibility,
+            };
+            if (vkGetPhysicalDeviceSurfaceCapabilities2KHR(m_physicalDevice, &surfaceInfo, &capabilities) != VK_SUCCESS) {
+                return { presentMode };
+            }
+
+            auto compatiblePresentModes = std::vector<VkPresentModeKHR>(compatibility.presentModeCount);
+            compatibility.pPresentModes = compatiblePresentModes.data();
+            if (vkGetPhysicalDeviceSurfaceCapabilities2KHR(m_physicalDevice, &surfaceInfo, &capabilities) != VK_SUCCESS) {
+                return { presentMode };
+            }
+            compatiblePresentModes.resize(compatibility.presentModeCount);
+
+            auto switchablePresentModes = std::vector<VkPresentModeKHR> { presentMode };
+            for (const auto compatiblePresentMode : compatiblePresentModes) {
+                if (compatiblePresentMode == presentMode || std::ranges::find(presenter.presentModes, compatiblePresentMode) == presenter.presentModes.end()) {
+                    continue;
+                }
+
+                surfacePresentMode.presentMode = compatiblePresentMode;
+                auto modeCapabilities = VkSurfaceCapabilities2KHR {
+                    .sType = VK_STRUCTURE_TYPE_SURFACE_CAPABILITIES_2_KHR,
+                };
+                const auto result = vkGetPhysicalDeviceSurfaceCapabilities2KHR(m_physicalDevice, &surfaceInfo, &modeCapabilities);
+                if (result == VK_SUCCESS && modeCapabilities.surfaceCapabilities.minImageCount <= imageCount) {
+                    switchablePresentModes.push_back(compatiblePresentMode);
+                }
+            }
+
+            return switchablePresentModes;
+        }
+
+        // Select just enough swapchain images that `vkAcquireNextImageKHR` never blocks with the
+        // target number of frames queued up, and no more, since every extra image adds a frame
+        // of latency and a full frame of memory.
+        // `HELLO_WINDOW_SWAPCHAIN_IMAGES` overrides the count, still within the surface limits.
+        SwapImageCountSelection selectSwapImageCount(const VkSurfaceCapabilitiesKHR& capabilities, VkPresentModeKHR presentMode) {
+            // The latency policy only ever queues one frame ahead of the display.
+            const uint32_t queueDepth = [this]() -> uint32_t {
+                if (m_presentModePolicy == PresentModePolicy::Latency) {
+                    return 1;
+                } else {
+                    return m_frameQueueDepth;
+                }
+            }();
+
+            // The presentation engine keeps the image currently on screen. Mailbox also keeps
+            // the latest queued image around to replace it on the next vertical blank.
+            const uint32_t presentationEngineImages = [presentMode]() -> uint32_t {
+                if (presentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
+                    return 2;
+                } else {
+                    return 1;
+                }
+            }();
+
+            if (m_swapchainImageCountOverride.has_value()) {
+                const auto imageCount = std::clamp(
+                    m_swapchainImageCountOverride.value(),
+                    capabilities.minImageCount,
+                    capabilities.maxImageCount > 0 ? capabilities.maxImageCount : std::numeric_limits<uint32_t>::max()
+                );
+
+                return SwapImageCountSelection { imageCount, fmt::format("set by {}, within the surface limits", SWAPCHAIN_IMAGES_ENVIRONMENT_VARIABLE) };
+            }
+
+            const uint32_t targetImageCount = queueDepth + presentationEngineImages;
+            if (targetImageCount < capabilities.minImageCount) {
+                const auto reason = fmt::format(
+                    "queue depth {} + {} held by the presentation engine, raised to the surface minimum",
+                    queueDepth,
+                    presentationEngineImages
+                );
+
+                return SwapImageCountSelection { capabilities.minImageCount, reason };
+            } else if (capabilities.maxImageCount > 0 && targetImageCount > capabilities.maxImageCount) {
+                const auto reason = fmt::format(
+                    "queue depth {} + {} held by the presentation engine, clamped to the surface maximum",
+                    queueDepth,
+                    presentationEngineImages
+                );
+
+                return SwapImageCountSelection { capabilities.maxImageCount, reason };
+            }
+
+            const auto reason = fmt::format(
+                "queue depth {} + {} held by the presentation engine",
+                queueDepth,
+                presentationEngineImages
+            );
+
+            return SwapImageCountSelection { targetImageCount, reason };
+        }
+
+        VkExtent2D selectSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities, VkExtent2D framebufferExtent) {
+            if (capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max()) {
+                return capabilities.currentExtent;
+            } else {
+                const uint32_t width = std::clamp(
+                    framebufferExtent.width,
+                    capabilities.minImageExtent.width,
+                    capabilities.maxImageExtent.width
+                );
+                const uint32_t height = std::clamp(
+                    framebufferExtent.height, 
+                    capabilities.minImageExtent.height, 
+                    capabilities.maxImageExtent.height
+                );
+                const auto actualExtent = VkExtent2D {
+                    .width = width,
+                    .height = height,
+                };
+
+                return actualExtent;
+            }
+        }
+
+        // The compute present path needs storage usage on the swapchain images, the formats
+        // to allow it, and storage image writes without a format in the shader.
+        std::optional<std::vector<VkSurfaceFormatKHR>> selectComputePresentFormats(const SwapChainSupportDetails& swapChainSupport) {
+            if (m_presentPath != PresentPath::Compute) {
+                return std::nullopt;
+            }
+
+            const auto [supported, reason] = [this, &swapChainSupport]() -> std::tuple<bool, const char*> {
+                if (!vk_features::has(m_deviceFeatures, vk_features::Feature::StorageImageWriteWithoutFormat)) {
+                    return std::make_tuple(false, "the device cannot write storage images without a format");
+                } else if ((swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_STORAGE_BIT) == 0) {
+                    return std::make_tuple(false, "the surface does not allow storage usage");
+                }
+
+                return std::make_tuple(true, "");
+            }();
+
+            auto formats = supported
+                ? vk_compute_present::storageFormats(m_physicalDevice, swapChainSupport.formats)
+                : std::vector<VkSurfaceFormatKHR> {};
+            if (!supported || formats.empty()) {
+                VK_LOG_WARNING("Compute present unavailable, {}, falling back to raster", supported ? "no surface format supports storage" : reason);
+                m_presentPath = PresentPath::Raster;
+
+                return std::nullopt;
+            }
+
+            return formats;
+        }
+
+        // Post processing renders the scene into an HDR image and writes the swapchain image
+        // from it in the sRGB color space, so it leaves compute present, split frames, which
+        // render into images aliasing the swapchain's, and HDR color spaces alone.
+        bool selectPostProcessing(VkSurfaceFormatKHR surfaceFormat, bool computePresent) const {
+            return m_postProcessRequested
+                && !computePresent
+                && m_deviceGroupMode != vk_device_group::DeviceGroupMode::Sfr
+                && surfaceFormat.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+        }
+
+        // The post processing pass writes the swapchain image from a compute shader where the
+        // surface allows storage usage on a format presented in the sRGB color space, and
+        // draws into it as a color attachment otherwise.
+        std::optional<std::vector<VkSurfaceFormatKHR>> selectPostStorageFormats(const SwapChainSupportDetails& swapChainSupport) const {
+            if (!vk_features::has(m_deviceFeatures, vk_features::Feature::StorageImageWriteWithoutFormat)
+                || (swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_STORAGE_BIT) == 0
+            ) {
+                return std::nullopt;
+            }
+
+            auto formats = vk_compute_present::storageFormats(m_physicalDevice, swapChainSupport.formats);
+            std::erase_if(formats, [](const auto& format) { return format.colorSpace != VK_COLOR_SPACE_SRGB_NONLINEAR_KHR; });
+            if (formats.empty()) {
+                return std::nullopt;
+            }
+
+            return formats;
+        }
+
+        // Upscaling blits the render target into the swapchain image with a linear filter, so
+        // the surface has to allow transfer writes and the format has to support both ends of
+        // a filtered blit. Compute present writes the swapchain image directly, and split frames
+        // render into images aliasing it, so neither has a render target to scale. Post
+        // processing samples the render target up itself, and needs neither.
+        bool selectScaledRendering(const SwapChainSupportDetails& swapChainSupport, VkFormat format, bool computePresent, bool postProcessed) {
+            const bool scaled = m_renderScale != 1.0 || m_dynamicResolution.isEnabled();
+            if (!scaled || computePresent || m_deviceGroupMode == vk_device_group::DeviceGroupMode::Sfr) {
+                return false;
+            } else if (postProcessed) {
+                return true;
+            }
+
+            auto properties = VkFormatProperties {};
+            vkGetPhysicalDeviceFormatProperties(m_physicalDevice, format, &properties);
+            const auto requiredFeatures = VkFormatFeatureFlags {
+                VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT
+                    | VK_FORMAT_FEATURE_BLIT_SRC_BIT
+                    | VK_FORMAT_FEATURE_BLIT_DST_BIT
+                    | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT
+            };
+            const auto [supported, reason] = [&]() -> std::tuple<bool, const char*> {
+                if ((swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT) == 0) {
+                    return std::make_tuple(false, "the surface does not allow transfer writes");
+                } else if ((properties.optimalTilingFeatures & requiredFeatures) != requiredFeatures) {
+                    return std::make_tuple(false, "the surface format cannot be blitted with a linear filter");
+                }
+
+                return std::make_tuple(true, "");
+            }();
+            if (!supported) {
+                VK_LOG_WARNING("Render scale unavailable, {}, rendering at full resolution", reason);
+                m_renderScale = 1.0;
+                m_dynamicResolution.init(0.0, 1.0, 1.0);
+            }
+
+            return supported;
+        }
+
+        // A window takes part in compositing with a swapchain it can blit the shared scene into
+        // with a linear filter, or blit it out of, for the first window, whose format the shared
+        // scene is in. Split frames render into images of their own, which it leaves out.
+        bool selectCompositing(
+            const WindowPresenter& presenter,
+            VkImageUsageFlags imageUsage,
+            bool computePresent,
+            bool scaledRendering,
+            bool postProcessed,
+            bool firstSwapChain
+        ) const {
+            if (!m_windowCompositeRequested || m_windowCount < 2 || this->usesDeviceGroup()) {
+                return false;
+            }
+
+            auto properties = VkFormatProperties {};
+            vkGetPhysicalDeviceFormatProperties(m_physicalDevice, presenter.imageFormat, &properties);
+            const auto requiredFeatures = VkFormatFeatureFlags {
+                VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT
+                    | VK_FORMAT_FEATURE_BLIT_SRC_BIT
+                    | VK_FORMAT_FEATURE_BLIT_DST_BIT
+                    | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT
+            };
+            const bool compositable = !computePresent
+                && !scaledRendering
+                && !postProcessed
+                && (imageUsage & VK_IMAGE_USAGE_TRANSFER_DST_BIT) != 0
+                && (properties.optimalTilingFeatures & requiredFeatures) == requiredFeatures;
+            if (!compositable && firstSwapChain) {
+                VK_LOG_WARNING("Window {} cannot take part in window compositing, it renders its own scene", presenter.index);
+            }
+
+            return compositable;
+        }
+
+        vk_result::Status createSwapChain(WindowPresenter& presenter, VkSwapchainKHR oldSwapChain) {
+            const auto swapChainSupport = this->querySwapChainSupport(presenter);
+            const auto computePresentFormats = this->selectComputePresentFormats(swapChainSupport);
+            const bool computePresent = computePresentFormats.has_value();
+            const auto preferredFormat = this->selectSwapSurfaceFormat(computePresent ? computePresentFormats.value() : swapChainSupport.formats);
+            const bool postProcessed = this->selectPostProcessing(preferredFormat, computePresent);
+            const auto postStorageFormats = postProcessed ? this->selectPostStorageFormats(swapChainSupport) : std::nullopt;
+            const bool postStorage = postStorageFormats.has_value();
+            const auto surfaceFormat = postStorage ? this->selectSwapSurfaceFormat(postStorageFormats.value()) : preferredFormat;
+            const bool scaledRendering = this->selectScaledRendering(swapChainSupport, surfaceFormat.format, computePresent, postProcessed);
+            // Transfers are only a convenience otherwise, writes for the first frame's clear and
+            // reads for screenshots.
+            const auto transferUsage = swapChainSupport.capabilities.supportedUsageFlags & (VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+            const auto imageUsage = [computePresent, scaledRendering, postProcessed, postStorage, transferUsage]() -> VkImageUsageFlags {
+                if (postStorage) {
+                    return VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_STORAGE_BIT | transferUsage;
+                } else if (scaledRendering && !postProcessed) {
+                    return VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | transferUsage;
+                } else if (!computePresent) {
+                    return VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | transferUsage;
+                }
+
+                return VK_IMAGE_USAGE_STORAGE_BIT | transferUsage;
+            }();
+            const auto presentMode = this->selectSwapPresentMode(swapChainSupport.presentModes);
+            const auto extent = this->selectSwapExtent(swapChainSupport.capabilities, presenter.framebufferExtent);
+            const auto imageCountSelection = this->selectSwapImageCount(swapChainSupport.capabilities, presentMode);
+            const auto imageCount = imageCountSelection.imageCount;
+            const auto indices = m_queueFamilyIndices;
+            const auto queueFamilyIndices = std::array<uint32_t, 2> {
+                indices.graphicsFamily.value(),
+                indices.presentFamily.value()
+            };
+            const bool concurrent = indices.graphicsFamily != indices.presentFamily && m_swapChainSharing == SwapChainSharing::Concurrent;
+            const auto imageSharingMode = [concurrent]() -> VkSharingMode {
+                if (concurrent) {
+                    return VK_SHARING_MODE_CONCURRENT;
+                } else {
+                    return VK_SHARING_MODE_EXCLUSIVE;
+                }
+            }();
+            const auto [queueFamilyIndicesPtr, queueFamilyIndexCount] = [concurrent, &queueFamilyIndices]() -> std::tuple<const uint32_t*, uint32_t> {
+                if (concurrent) {
+                    const auto data = queueFamilyIndices.data();
+                    const auto size = static_cast<uint32_t>(queueFamilyIndices.size());
+                
+                    return std::make_tuple(data, size);
+                } else {
+                    const auto data = static_cast<uint32_t*>(nullptr);
+                    const auto size = static_cast<uint32_t>(0);
+
+                    return std::make_tuple(data, size);
+                }
+            }();
+
+            // Every device of a group presents the images in its own memory, and split frames
+            // bind each image's strips across the devices' memory.
+            const bool splitFrames = m_deviceGroupMode == vk_device_group::DeviceGroupMode::Sfr;
+            const auto deviceGroupInfo = VkDeviceGroupSwapchainCreateInfoKHR {
+                .sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_SWAPCHAIN_CREATE_INFO_KHR,
+                .modes = VK_DEVICE_GROUP_PRESENT_MODE_LOCAL_BIT_KHR,
+            };
+            const void* swapChainNext = this->usesDeviceGroup() ? &deviceGroupInfo : nullptr;
+
+            // The driver only paces swapchains created for it.
+            const auto latencyInfo = VkSwapchainLatencyCreateInfoNV {
+                .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_LATENCY_CREATE_INFO_NV,
+                .pNext = swapChainNext,
+                .latencyModeEnable = VK_TRUE,
+            };
+            if (m_lowLatencyPacer.usesDriverPacing()) {
+                swapChainNext = &latencyInfo;
+            }
+
+            // Policy changes switch to these without recreating the swapchain.
+            const auto switchablePresentModes = this->usesSwapchainMaintenance()
+                ? this->querySwitchablePresentModes(presenter, presentMode, imageCount)
+                : std::vector<VkPresentModeKHR> {};
+            const auto presentModesInfo = VkSwapchainPresentModesCreateInfoEXT {
+                .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_PRESENT_MODES_CREATE_INFO_EXT,
+                .pNext = swapChainNext,
+                .presentModeCount = static_cast<uint32_t>(switchablePresentModes.size()),
+                .pPresentModes = switchablePresentModes.data(),
+            };
+            if (!switchablePresentModes.empty()) {
+                swapChainNext = &presentModesInfo;
+            }
+
+            auto exclusiveInfo = vk_fullscreen::ExclusiveInfo { presenter.window, presenter.exclusivity };
+            swapChainNext = exclusiveInfo.chain(swapChainNext);
+            // A new swapchain has to acquire exclusivity again.
+            if (presenter.exclusivity == vk_fullscreen::Exclusivity::Acquired) {
+                presenter.exclusivity = vk_fullscreen::Exclusivity::Requested;
+            }
+
+            // Handing the old swapchain to the driver lets it recycle the old images' memory and
+            // keep presenting the old images until the new ones are ready, which is what makes
+            // a resize cheap. The old swapchain is retired, and can no longer acquire images.
+            const auto createInfo = VkSwapchainCreateInfoKHR {
+                .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
+                .pNext = swapChainNext,
+                .flags = splitFrames ? VK_SWAPCHAIN_CREATE_SPLIT_INSTANCE_BIND_REGIONS_BIT_KHR : VkSwapchainCreateFlagsKHR { 0 },
+                .surface = presenter.surface,
+                .minImageCount = imageCount,
+                .imageFormat = surfaceFormat.format,
+                .imageColorSpace = surfaceFormat.colorSpace,
+                .imageExtent = extent,
+                .imageArrayLayers = 1,
+                .imageUsage = imageUsage,
+                .imageSharingMode = imageSharingMode,
+                .queueFamilyIndexCount = queueFamilyIndexCount,
+                .pQueueFamilyIndices = queueFamilyIndicesPtr,
+                .preTransform = swapChainSupport.capabilities.currentTransform,
+                .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
+                .presentMode = presentMode,
+                .clipped = VK_TRUE,
+                .oldSwapchain = oldSwapChain,
+            };
+
+            const auto oldPresentMode = presenter.presentMode;
+            const auto oldImageCount = static_cast<uint32_t>(presenter.images.size());
+
+            auto swapChain = VkSwapchainKHR {};
+            const auto result = vkCreateSwapchainKHR(m_device, &createInfo, m_hostAllocator.callbacks(), &swapChain);
+            VK_RESULT_TRY(vk_result::check(result, "failed to create swap chain"));
+
+            uint32_t swapChainImageCount = 0;
+            vkGetSwapchainImagesKHR(m_device, swapChain, &swapChainImageCount, nullptr);
+
+            auto swapChainImages = std::vector<VkImage> { swapChainImageCount, VK_NULL_HANDLE };
+            vkGetSwapchainImagesKHR(m_device, swapChain, &swapChainImageCount, swapChainImages.data());
+            if (vk_debug::labelsEnabled()) {
+                for (size_t i = 0; i < swapChainImages.size(); i++) {
+                    const auto name = fmt::format("window {} swapchain image {}", presenter.index, i);
+                    vk_debug::setObjectName(m_device, VK_OBJECT_TYPE_IMAGE, swapChainImages[i], name.c_str());
+                }
+            }
+
+            // Split frames render into images aliasing the swapchain's, whose strips are bound
+            // so that every device writes its own strip into the first device's memory.
+            if (splitFrames) {
+                const auto deviceCount = static_cast<uint32_t>(m_deviceGroupDevices.size());
+                const auto granularity = vk_device_group::splitGranularity(m_physicalDevice, surfaceFormat.format, imageUsage);
+                presenter.deviceRenderAreas = vk_device_group::splitRenderAreas(extent, deviceCount, granularity);
+                presenter.splitImages = vk_device_group::createSplitImages(
+                    m_device,
+                    swapChain,
+                    swapChainImageCount,
+                    surfaceFormat.format,
+                    extent,
+                    imageUsage,
+                    presenter.deviceRenderAreas,
+                    m_hostAllocator.callbacks()
+                );
+                swapChainImages = vk_handles::raw(presenter.splitImages);
+            }
+
+            presenter.swapChain = vk_handles::SwapChain { m_device, swapChain, m_hostAllocator.callbacks() };
+            for (const auto image : presenter.images) {
+                m_imageLayouts.forget(image);
+            }
+            for (const auto image : swapChainImages) {
+                m_imageLayouts.track(image, VK_IMAGE_ASPECT_COLOR_BIT, 1, 1);
+            }
+            presenter.images = std::move(swapChainImages);
+            presenter.imageFormat = surfaceFormat.format;
+            presenter.colorSpace = surfaceFormat.colorSpace;
+            presenter.extent = extent;
+            presenter.presentMode = presentMode;
+            presenter.switchablePresentModes = switchablePresentModes;
+            presenter.imageUsage = imageUsage;
+            presenter.computePresent = computePresent;
+            presenter.scaledRendering = scaledRendering;
+            presenter.postProcessed = postProcessed;
+            presenter.postStorage = postStorage;
+            presenter.compositable = this->selectCompositing(presenter, imageUsage, computePresent, scaledRendering, postProcessed, oldSwapChain == VK_NULL_HANDLE);
+            presenter.ownershipTransfer = indices.graphicsFamily != indices.presentFamily && !concurrent;
+
+            // Pacing follows a single display, the first window's.
+            if (presenter.index == 0) {
+                m_displayTimingPacer.setSwapChain(swapChain);
+                m_lowLatencyPacer.setSwapChain(swapChain);
+            }
+
+            if (oldSwapChain == VK_NULL_HANDLE || presentMode != oldPresentMode || swapChainImageCount != oldImageCount) {
+                VK_LOG_INFO(
+                    "Swapchain {}: {} present mode, requested {} images ({}), got {}",
+                    presenter.index,
+                    presentModeToString(presentMode),
+                    imageCount,
+                    imageCountSelection.reason,
+                    swapChainImageCount
+                );
+            }
+
+            return vk_result::Status {};
+        }
+
+        // Offscreen images are exported with this usage, which consumers have to create theirs
+        // with as well. The video encoder reads them as storage images.
+        VkImageUsageFlags offscreenImageUsage() const {
+            const auto usage = VkImageUsageFlags { VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT };
+
+            return m_videoEncodeSupport.has_value() ? usage | VK_IMAGE_USAGE_STORAGE_BIT : usage;
+        }
+
+        // Whether the offscreen images of `extent` can be encoded as `HELLO_WINDOW_VIDEO_ENCODE`
+        // asks, in which case the support the encoder is created with is kept. The conversion
+        // to the encoder's pictures writes their planes without naming a format, and device
+        // groups render every frame on several devices, which one encode queue cannot follow.
+        void prepareVideoEncode(VkExtent2D extent) {
+            if (!m_videoEncodePath.has_value()) {
+                return;
+            }
+
+            const auto reason = [&]() -> std::optional<std::string_view> {
+                if (m_replay.has_value()) {
+                    return "a replay renders its capture once";
+                } else if (this->usesDeviceGroup()) {
+                    return "device groups are not encoded";
+                } else if (!vk_features::has(m_deviceFeatures, vk_features::Feature::VideoEncodeH264) || !m_queueFamilyIndices.videoEncodeFamily.has_value()) {
+                    return "the device has no H.264 video encode queue";
+                } else if (!vk_features::has(m_deviceFeatures, vk_features::Feature::StorageImageWriteWithoutFormat)) {
+                    return "the device cannot write storage images without a format";
+                }
+
+                return std::nullopt;
+            }();
+            if (reason.has_value()) {
+                VK_LOG_WARNING("Ignoring {}, {}", VIDEO_ENCODE_ENVIRONMENT_VARIABLE, reason.value());
+                m_videoEncodePath.reset();
+                return;
+            }
+
+            m_videoEncodeSupport = vk_video_encode::querySupport(m_physicalDevice, extent);
+            if (!m_videoEncodeSupport.has_value()) {
+                VK_LOG_WARNING("Ignoring {}, the device does not encode the offscreen images", VIDEO_ENCODE_ENVIRONMENT_VARIABLE);
+                m_videoEncodePath.reset();
+            }
+        }
+
+        void createVideoEncoder() {
+            const auto& presenter = m_presenters.front();
+            m_videoEncoder.init(
+                m_device,
+                m_memoryAllocator,
+                m_descriptorLayoutCache,
+                m_frameDescriptors,
+                m_shaderLibrary,
+                m_pipelineRegistry,
+                m_computeTuning,
+                m_hostAllocator.callbacks(),
+                m_videoEncodeQueue,
+                m_queueFamilyIndices.videoEncodeFamily.value(),
+                m_queueFamilyIndices.graphicsFamily.value(),
+                m_videoEncodeSupport.value(),
+                presenter.extent,
+                m_framesInFlight,
+                vk_video_encode::EncodeSettings {
+                    .outputPath = m_videoEncodePath.value(),
+                    .bitrate = videoBitrateFromEnvironment(),
+                    .frameRate = VIDEO_FRAME_RATE,
+                }
+            );
+        }
+
+        // Whether the offscreen images, made with `createInfo`, and the frame timeline
+        // semaphore can be shared as `HELLO_WINDOW_FRAME_EXPORT` asks, in which case the
+        // exporter has their export chains ready. Device groups render every frame on several
+        // devices, which a consumer of one image cannot follow.
+        bool prepareFrameExport(const VkImageCreateInfo& createInfo) {
+            if (!m_frameExportPath.has_value()) {
+                return false;
+            }
+
+            const auto reason = [&]() -> std::optional<std::string_view> {
+                if (m_replay.has_value()) {
+                    return "a replay renders its capture once";
+                } else if (this->usesDeviceGroup()) {
+                    return "device groups are not exported";
+                } else if (!vk_features::has(m_deviceFeatures, vk_features::Feature::ExternalMemoryExport)) {
+                    return "the device has no external memory and semaphore handles";
+                } else if (!vk_frame_export::canExportImages(m_physicalDevice, createInfo)) {
+                    return "the driver does not export the offscreen images";
+                } else if (!vk_frame_export::canExportTimelineSemaphores(m_physicalDevice)) {
+                    return "the driver does not export timeline semaphores";
+                }
+
+                return std::nullopt;
+            }();
+            if (reason.has_value()) {
+                VK_LOG_WARNING("Ignoring {}, {}", FRAME_EXPORT_ENVIRONMENT_VARIABLE, reason.value());
+                m_frameExportPath.reset();
+                return false;
+            }
+
+            m_frameExporter.prepare(m_framesInFlight);
+
+            return true;
+        }
+
+        void startFrameExport() {
+            const auto& presenter = m_presenters.front();
+            auto images = vk_frame_export::ExportedImages {
+                .format = presenter.imageFormat,
+                .extent = presenter.extent,
+                .usage = this->offscreenImageUsage(),
+            };
+            for (const auto& allocation : m_offscreenImageAllocations) {
+                images.memories.push_back(allocation.memory);
+                images.sizes.push_back(allocation.size);
+                images.memoryTypeIndices.push_back(allocation.memoryTypeIndex);
+            }
+
+            m_frameExporter.start(m_frameExportPath.value(), m_physicalDevice, m_device, images, m_frameTimelineSemaphore);
+        }
+
+        // Stand in for the swapchain images when rendering headless. There is one image per
+        // frame in flight, and frame slot `i` always renders into image `i`, so waiting for the
+        // frame slot is all it takes before an image can be rendered to again.
+        vk_result::Status createOffscreenImages() {
+            const auto format = VK_FORMAT_R8G8B8A8_UNORM;
+            const auto extent = [this]() {
+                if (!m_replay.has_value()) {
+                    return m_windowSize;
+                }
+
+                const auto [width, height] = m_replay->maxExtent();
+
+                return VkExtent2D { width, height };
+            }();
+            this->prepareVideoEncode(extent);
+
+            const auto externalInfo = VkExternalMemoryImageCreateInfo {
+                .sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_IMAGE_CREATE_INFO,
+                .handleTypes = vk_frame_export::MEMORY_HANDLE_TYPE,
+            };
+            const bool exported = this->prepareFrameExport(VkImageCreateInfo {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+                .pNext = &externalInfo,
+                .imageType = VK_IMAGE_TYPE_2D,
+                .format = format,
+                .extent = VkExtent3D { extent.width, extent.height, 1 },
+                .mipLevels = 1,
+                .arrayLayers = 1,
+                .samples = VK_SAMPLE_COUNT_1_BIT,
+                .tiling = VK_IMAGE_TILING_OPTIMAL,
+                .usage = this->offscreenImageUsage(),
+                .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            });
+
+            auto images = std::vector<VkImage> { m_framesInFlight, VK_NULL_HANDLE };
+            auto allocations = std::vector<vk_memory::Allocation> { m_framesInFlight };
+            for (size_t i = 0; i < m_framesInFlight; i++) {
+                const auto createInfo = VkImageCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+                    .pNext = exported ? &externalInfo : nullptr,
+                    .imageType = VK_IMAGE_TYPE_2D,
+                    .format = format,
+                    .extent = VkExtent3D { extent.width, extent.height, 1 },
+                    .mipLevels = 1,
+                    .arrayLayers = 1,
+                    .samples = VK_SAMPLE_COUNT_1_BIT,
+                    .tiling = VK_IMAGE_TILING_OPTIMAL,
+                    .usage = this->offscreenImageUsage(),
+                    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                    .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                };
+
+                const auto result = vkCreateImage(m_device, &createInfo, m_hostAllocator.callbacks(), &images[i]);
+                VK_RESULT_TRY(vk_result::check(result, "failed to create offscreen image"));
+
+                if (vk_debug::labelsEnabled()) {
+                    const auto name = fmt::format("offscreen image {}", i);
+                    vk_debug::setObjectName(m_device, VK_OBJECT_TYPE_IMAGE, images[i], name.c_str());
+                }
+
+                allocations[i] = m_memoryAllocator.allocateForImage(images[i], vk_memory::AllocationCreateInfo {
+                    .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                    .kind = vk_memory::ResourceKind::Optimal,
+                    .priority = vk_memory::MemoryPriority::High,
+                    .exportInfo = exported ? m_frameExporter.memoryExportInfo(i) : nullptr,
+                });
+            }
+
+            for (const auto image : images) {
+                m_imageLayouts.track(image, VK_IMAGE_ASPECT_COLOR_BIT, 1, 1);
+            }
+            auto& presenter = m_presenters.emplace_back();
+            presenter.images = std::move(images);
+            presenter.imageFormat = format;
+            presenter.extent = extent;
+            m_offscreenImageAllocations = std::move(allocations);
+
+            if (m_serviceEndpoint.has_value()) {
+                VK_LOG_INFO("Rendering on request into {} offscreen images", m_framesInFlight);
+            } else {
+                VK_LOG_INFO("Rendering {} frames headless into {} offscreen images", m_headlessFrameCount.value(), m_framesInFlight);
+            }
+
+            return vk_result::Status {};
+        }
+
+        vk_result::Status createImageViews(WindowPresenter& presenter) {
+            const auto createInfo = vk_create_info::imageView2D(VK_NULL_HANDLE, presenter.imageFormat);
+
+            return m_imageViews.get(presenter.images, createInfo, presenter.imageViews);
+        }
+
+        vk_result::Status createPresenterImageViews() {
+            m_imageViews.init(m_device, m_hostAllocator.callbacks());
+            for (auto& presenter : m_presenters) {
+                VK_RESULT_TRY(this->createImageViews(presenter));
+            }
+
+            return vk_result::Status {};
+        }
+
+        // Shows the windows as soon as their swapchains exist, each with a cleared image, so a
+        // window appears before the pipelines, the scene and the profilers are ready rather
+        // than after, and the time to the first present in the startup report is the time
+        // until then. The clear is a transfer, which takes no pipeline and works the same for
+        // the compute present swapchains, and the command buffer and semaphores are thrown
+        // away once the queues are idle again. Windows whose surface allows no transfer
+        // writes, whose images change queue family before a present, or that belong to a
+        // device group are shown as they are, and get their first image from the first frame.
+        vk_result::Status presentFirstFrames() {
+            for (const auto& presenter : m_presenters) {
+                if (presenter.window != nullptr) {
+                    glfwShowWindow(presenter.window);
+                }
+            }
+
+            if (this->usesDeviceGroup()) {
+                return vk_result::Status {};
+            }
+
+            const auto poolInfo = VkCommandPoolCreateInfo {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+                .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+                .queueFamilyIndex = m_queueFamilyIndices.graphicsFamily.value(),
+            };
+            auto commandPool = VkCommandPool {};
+            const auto poolResult = vkCreateCommandPool(m_device, &poolInfo, m_hostAllocator.callbacks(), &commandPool);
+            VK_RESULT_TRY(vk_result::check(poolResult, "failed to create the first frame command pool"));
+            const auto ownedCommandPool = vk_handles::CommandPool { m_device, commandPool, m_hostAllocator.callbacks() };
+
+            const auto allocateInfo = VkCommandBufferAllocateInfo {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                .commandPool = commandPool,
+                .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                .commandBufferCount = 1,
+            };
+            auto commandBuffer = VkCommandBuffer {};
+            const auto allocateResult = vkAllocateCommandBuffers(m_device, &allocateInfo, &commandBuffer);
+            VK_RESULT_TRY(vk_result::check(allocateResult, "failed to allocate the first frame command buffer"));
+
+            const auto semaphoreInfo = VkSemaphoreCreateInfo {
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+            };
+            const auto createSemaphore = [this, &semaphoreInfo]() -> vk_result::Result<vk_handles::Semaphore> {
+                auto semaphore = VkSemaphore {};
+                const auto result = vkCreateSemaphore(m_device, &semaphoreInfo, m_hostAllocator.callbacks(), &semaphore);
+                VK_RESULT_TRY(vk_result::check(result, "failed to create the first frame semaphores"));
+
+                return vk_handles::Semaphore { m_device, semaphore, m_hostAllocator.callbacks() };
+            };
+
+            const auto beginInfo = VkCommandBufferBeginInfo {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+            };
+            vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+            auto barriers = vk_barriers::BarrierBatch {};
+            auto acquiredSemaphores = std::vector<vk_handles::Semaphore> {};
+            auto waitSemaphores = std::vector<VkSemaphore> {};
+            auto presenterIndices = std::vector<uint32_t> {};
+            auto swapChains = std::vector<VkSwapchainKHR> {};
+            auto imageIndices = std::vector<uint32_t> {};
+            acquiredSemaphores.reserve(m_presenters.size());
+            for (auto& presenter : m_presenters) {
+                if ((presenter.imageUsage & VK_IMAGE_USAGE_TRANSFER_DST_BIT) == 0 || presenter.ownershipTransfer || this->isMinimized(presenter)) {
+                    continue;
+                }
+
+                auto acquiredSemaphore = createSemaphore();
+                if (!acquiredSemaphore) {
+                    return acquiredSemaphore.error();
+                }
+
+                uint32_t imageIndex = 0;
+                const auto acquireResult = vkAcquireNextImageKHR(m_device, presenter.swapChain, std::numeric_limits<uint64_t>::max(), acquiredSemaphore.value(), VK_NULL_HANDLE, &imageIndex);
+                if (acquireResult == VK_ERROR_OUT_OF_DATE_KHR) {
+                    presenter.swapChainOutdated = true;
+                    continue;
+                }
+
+                this->reportIfDeviceLost(acquireResult);
+                VK_RESULT_TRY(vk_result::check(acquireResult, "failed to acquire the first swap chain image"));
+
+                // The acquire semaphore is waited on at the clear, which the barrier out of
+                // the undefined layout is ordered after. It goes out together with the previous
+                // window's barrier to the present layout.
+                const auto image = presenter.images[imageIndex];
+                m_imageLayouts.acquire(image, VK_PIPELINE_STAGE_2_CLEAR_BIT);
+                m_imageLayouts.transition(barriers, image, vk_render_graph::ResourceState {
+                    .stages = VK_PIPELINE_STAGE_2_CLEAR_BIT,
+                    .access = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                    .layout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                });
+                barriers.flush(commandBuffer);
+                const auto clearColor = VkClearColorValue { .float32 = { 0.0f, 0.0f, 0.0f, 1.0f } };
+                const auto range = VkImageSubresourceRange {
+                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                    .baseMipLevel = 0,
+                    .levelCount = 1,
+                    .baseArrayLayer = 0,
+                    .layerCount = 1,
+                };
+                vkCmdClearColorImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clearColor, 1, &range);
+                m_imageLayouts.transition(barriers, image, vk_render_graph::ResourceState {
+                    .layout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                });
+
+                waitSemaphores.push_back(acquiredSemaphore.value().get());
+                acquiredSemaphores.push_back(std::move(acquiredSemaphore.value()));
+                presenterIndices.push_back(presenter.index);
+                swapChains.push_back(presenter.swapChain);
+                imageIndices.push_back(imageIndex);
+            }
+
+            barriers.flush(commandBuffer);
+            VK_RESULT_TRY(vk_result::check(vkEndCommandBuffer(commandBuffer), "failed to record the first frame command buffer"));
+            if (swapChains.empty()) {
+                return vk_result::Status {};
+            }
+
+            auto clearedSemaphore = createSemaphore();
+            if (!clearedSemaphore) {
+                return clearedSemaphore.error();
+            }
+
+            const auto clearedSemaphoreHandle = clearedSemaphore.value().get();
+            const auto waitStages = std::vector<VkPipelineStageFlags>(waitSemaphores.size(), VK_PIPELINE_STAGE_TRANSFER_BIT);
+            const auto submitInfo = VkSubmitInfo {
+                .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+                .waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size()),
+                .pWaitSemaphores = waitSemaphores.data(),
+                .pWaitDstStageMask = waitStages.data(),
+                .commandBufferCount = 1,
+                .pCommandBuffers = &commandBuffer,
+                .signalSemaphoreCount = 1,
+                .pSignalSemaphores = &clearedSemaphoreHandle,
+            };
+            const auto submitResult = vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
+            this->reportIfDeviceLost(submitResult);
+            VK_RESULT_TRY(vk_result::check(submitResult, "failed to submit the first frame"));
+
+            auto presentResults = std::vector<VkResult> { swapChains.size(), VK_SUCCESS };
+            const auto presentInfo = VkPresentInfoKHR {
+                .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+                .waitSemaphoreCount = 1,
+                .pWaitSemaphores = &clearedSemaphoreHandle,
+                .swapchainCount = static_cast<uint32_t>(swapChains.size()),
+                .pSwapchains = swapChains.data(),
+                .pImageIndices = imageIndices.data(),
+                .pResults = presentResults.data(),
+            };
+            const auto presentResult = vkQueuePresentKHR(m_presentQueue, &presentInfo);
+            if (presentResult != VK_ERROR_OUT_OF_DATE_KHR) {
+                this->reportIfDeviceLost(presentResult);
+                VK_RESULT_TRY(vk_result::check(presentResult, "failed to present the first frame"));
+            }
+
+            m_startupProfiler.markFirstPresent();
+            for (size_t i = 0; i < presentResults.size(); i++) {
+                if (presentResults[i] == VK_ERROR_OUT_OF_DATE_KHR || presentResults[i] == VK_SUBOPTIMAL_KHR) {
+                    m_presenters[presenterIndices[i]].swapChainOutdated = true;
+                }
+            }
+
+            VK_RESULT_TRY(vk_result::check(vkQueueWaitIdle(m_graphicsQueue), "failed to wait for the first frame"));
+            if (m_presentQueue != m_graphicsQueue) {
+                VK_RESULT_TRY(vk_result::check(vkQueueWaitIdle(m_presentQueue), "failed to wait for the first present"));
+            }
+
+            return vk_result::Status {};
+        }
+
+        // Rounded, so that a scale of one half of an odd size loses no more than half a pixel.
+        static VkExtent2D scaledExtent(VkExtent2D extent, double scale) {
+            const auto scaleSize = [scale](uint32_t size) {
+                return std::max(static_cast<uint32_t>(std::lround(size * scale)), 1u);
+            };
+
+            return VkExtent2D { scaleSize(extent.width), scaleSize(extent.height) };
+        }
+
+        // The format the scene renders in: the HDR format post processing reads, or straight
+        // the swapchain's.
+        VkFormat sceneColorFormat(const WindowPresenter& presenter) const {
+            return presenter.postProcessed ? vk_post::SCENE_FORMAT : presenter.imageFormat;
+        }
+
+        // The render target of a scaled window is a transient image of the render graph, so
+        // windows rendering one after the other share its memory, and a resize only changes
+        // the image the graph compiles to.
+        VkExtent2D renderTargetSize(const WindowPresenter& presenter) const {
+            return App::scaledExtent(presenter.extent, m_renderScale);
+        }
+
+        // The part of the render target this frame renders to, all of it at a fixed scale.
+        VkExtent2D renderTargetExtent(const WindowPresenter& presenter) const {
+            const auto targetSize = this->renderTargetSize(presenter);
+            if (!m_dynamicResolution.isEnabled()) {
+                return targetSize;
+            }
+
+            const auto extent = App::scaledExtent(presenter.extent, m_dynamicResolution.scale());
+
+            return VkExtent2D {
+                std::min(extent.width, targetSize.width),
+                std::min(extent.height, targetSize.height),
+            };
+        }
+
+        void createComputePresentPass() {
+            m_computePresentPass.init(m_device, m_descriptorLayoutCache, m_shaderLibrary.shaderModule("present.comp"), m_pipelineRegistry, m_computeTuning);
+        }
+
+        // The storage image descriptors of a window's swapchain, for the compute present path.
+        void createPresentTargets(WindowPresenter& presenter) {
+            if (!presenter.computePresent) {
+                return;
+            }
+
+            if (!m_computePresentPass.isInitialized()) {
+                this->createComputePresentPass();
+            }
+
+            presenter.presentTargets = m_computePresentPass.createTargets(presenter.imageViews);
+        }
+
+        // The GPU driven scene culls on the GPU from the desktop tier on, given a depth buffer
+        // it can sample to build its depth pyramid, and otherwise culls on the job system.
+        // Split frames render a strip per device, which the pyramid knows nothing about, so
+        // device groups go without the scene.
+        void createIndirectRenderer() {
+            if (m_instanceCount == 0) {
+                return;
+            }
+
+            if (m_tierPaths.sceneCulling == vk_features::SceneCulling::None || this->usesDeviceGroup()) {
+                VK_LOG_INFO("GPU driven scene: unsupported, drawing no scene");
+                return;
+            }
+
+            const auto depthFormat = vk_gpu_driven::selectDepthFormat(m_physicalDevice);
+            const auto gpuCulling = m_tierPaths.sceneCulling == vk_features::SceneCulling::Gpu
+                && vk_gpu_driven::supportsDepthPyramid(m_physicalDevice, depthFormat);
+
+            // With fragment shading rates enabled, every draw sets one, the full rate when the
+            // scene is not shaded coarser. The foveated rate also needs an attachment format the
+            // compute pass can write.
+            auto shadingRate = std::optional<vk_shading_rate::DrawShadingRate> {};
+            if (vk_features::has(m_deviceFeatures, vk_features::Feature::FragmentShadingRate)) {
+                const auto texelSize = vk_shading_rate::attachmentTexelSize(m_physicalDevice);
+                m_shadingRate = m_shadingRateRequested == vk_shading_rate::Mode::Foveated && !texelSize.has_value()
+                    ? vk_shading_rate::Mode::Off
+                    : m_shadingRateRequested;
+                if (m_shadingRate == vk_shading_rate::Mode::Foveated) {
+                    m_foveatedShadingRate.init(
+                        m_device,
+                        m_descriptorLayoutCache,
+                        m_frameDescriptors,
+                        m_shaderLibrary,
+                        m_pipelineRegistry,
+                        m_computeTuning,
+                        m_hostAllocator.callbacks(),
+                        texelSize.value(),
+                        vk_shading_rate::FoveationSettings {}
+                    );
+                }
+
+                shadingRate = vk_shading_rate::drawShadingRate(m_shadingRate);
+            }
+
+            // Animated cubes would need their structures rebuilt from the skinned vertices every
+            // frame, and the CPU culling path goes without descriptors the shaders trace with.
+            const auto accelerationStructureProperties = m_tierPaths.rayQuery
+                ? std::optional { vk_ray_query::accelerationStructureProperties(m_physicalDevice) }
+                : std::nullopt;
+            if (
+                m_shadowsRequested == vk_gpu_driven::ShadowMode::RayQuery
+                && accelerationStructureProperties.has_value()
+                && vk_ray_query::supports(accelerationStructureProperties.value(), m_instanceCount)
+                && !m_animationRequested
+                && gpuCulling
+            ) {
+                auto queueFamilies = std::vector<uint32_t> { m_queueFamilyIndices.graphicsFamily.value() };
+                if (this->usesAsyncCompute()) {
+                    queueFamilies.push_back(m_queueFamilyIndices.computeFamily.value());
+                }
+
+                m_sceneAccelerationStructure.init(
+                    m_device,
+                    m_memoryAllocator,
+                    m_shaderLibrary,
+                    m_pipelineRegistry,
+                    m_hostAllocator.callbacks(),
+                    queueFamilies,
+                    accelerationStructureProperties.value(),
+                    m_framesInFlight,
+                    m_instanceCount
+                );
+            }
+
+            m_indirectRenderer.init(
+                m_device,
+                m_memoryAllocator,
+                m_frameUploadArena,
+                m_descriptorLayoutCache,
+                m_samplerCache,
+                m_frameDescriptors,
+                m_shaderLibrary,
+                m_pipelineRegistry,
+                m_pipelineCompiler,
+                m_computeTuning,
+                m_hostAllocator.callbacks(),
+                m_jobSystem,
+                m_instanceCount,
+                m_lightCount,
+                static_cast<uint32_t>(m_presenters.size()),
+                m_framesInFlight,
+                vk_gpu_driven::maxTaskWorkGroupCount(
+                    m_physicalDevice,
+                    m_meshShadingRequested && m_tierPaths.meshShading
+                ),
+                vk_gpu_driven::maxGeneratedSequenceCount(
+                    m_physicalDevice,
+                    m_generatedCommandsRequested && vk_features::has(m_deviceFeatures, vk_features::Feature::DeviceGeneratedCommands)
+                ),
+                vk_features::has(m_deviceFeatures, vk_features::Feature::BufferDeviceAddress),
+                vk_features::has(m_deviceFeatures, vk_features::Feature::ExtendedDynamicState3),
+                m_shaderObjectsRequested && vk_features::has(m_deviceFeatures, vk_features::Feature::ShaderObject),
+                m_depthPrepassRequested,
+                m_shadowsRequested,
+                m_sceneAccelerationStructure.isInitialized() ? &m_sceneAccelerationStructure : nullptr,
+                m_lodErrorRequested,
+                m_animationRequested ? &m_jobSystem : nullptr,
+                maxSampleCount(m_physicalDeviceInfo.properties.limits, m_msaaSamplesRequested),
+                depthFormat,
+                vk_gpu_driven::depthResolveMode(m_physicalDevice),
+                shadingRate,
+                gpuCulling ? nullptr : &m_jobSystem,
+                m_physicalDeviceInfo.properties.limits.maxDrawIndirectCount
+            );
+            m_scenePackets.init(vk_gpu_driven::SCENE_PACKET_ARENA_SIZE);
+            m_simulationClock.init(tickRateFromEnvironment());
+            this->simulateNextTick();
+            if (m_indirectRenderer.usesCpuCulling()) {
+                VK_LOG_INFO("GPU driven scene: {} instances, vertex pipeline culled on the CPU", m_instanceCount);
+            } else if (m_indirectRenderer.usesMeshShading()) {
+                VK_LOG_INFO("GPU driven scene: {} instances, mesh shading with {} meshlets each", m_instanceCount, m_indirectRenderer.meshletCount());
+            } else {
+                VK_LOG_INFO("GPU driven scene: {} instances, vertex pipeline", m_instanceCount);
+            }
+
+            if (depthFormat != vk_gpu_driven::DEPTH_FORMATS[0]) {
+                VK_LOG_INFO("GPU driven scene: float depth unsupported, reversed depth in a {} bit format", depthFormat == VK_FORMAT_D16_UNORM ? 16 : 24);
+            }
+
+            if (m_lightCount > 0) {
+                VK_LOG_INFO("GPU driven scene: {} lights in {} clusters", m_lightCount, vk_lights::CLUSTER_COUNT);
+            }
+
+            if (m_indirectRenderer.usesGeneratedCommands()) {
+                VK_LOG_INFO("GPU driven scene: drawn with device generated commands");
+            }
+
+            if (m_indirectRenderer.usesShaderObjects()) {
+                VK_LOG_INFO("GPU driven scene: drawn with shader objects");
+            } else if (m_shaderObjectsRequested) {
+                VK_LOG_INFO("GPU driven scene: shader objects unsupported, drawing with pipelines");
+            }
+
+            if (m_indirectRenderer.usesDepthPrepass()) {
+                VK_LOG_INFO("GPU driven scene: depth pre-pass, culled in two phases");
+            } else if (m_depthPrepassRequested) {
+                VK_LOG_INFO("GPU driven scene: depth pre-pass unsupported with CPU culling");
+            }
+
+            if (m_indirectRenderer.shadowMode() == vk_gpu_driven::ShadowMode::Virtual) {
+                VK_LOG_INFO(
+                    "GPU driven scene: virtual shadow map of {} pages in a {}x{} atlas",
+                    vk_virtual_shadows::PAGE_COUNT,
+                    vk_virtual_shadows::ATLAS_SIZE,
+                    vk_virtual_shadows::ATLAS_SIZE
+                );
+            } else if (m_indirectRenderer.shadowMode() == vk_gpu_driven::ShadowMode::RayQuery) {
+                VK_LOG_INFO(
+                    "GPU driven scene: {} shadow cascades of {}x{}, ray queried shadows past them, picking on the GPU",
+                    vk_shadows::FIRST_CACHED_CASCADE,
+                    vk_shadows::MAP_SIZE,
+                    vk_shadows::MAP_SIZE
+                );
+            } else if (m_indirectRenderer.usesShadows()) {
+                VK_LOG_INFO(
+                    "GPU driven scene: {} shadow cascades of {}x{}, the last {} cached",
+                    vk_shadows::CASCADE_COUNT,
+                    vk_shadows::MAP_SIZE,
+                    vk_shadows::MAP_SIZE,
+                    vk_shadows::CASCADE_COUNT - vk_shadows::FIRST_CACHED_CASCADE
+                );
+            }
+            if (m_shadowsRequested == vk_gpu_driven::ShadowMode::Virtual && m_indirectRenderer.shadowMode() != vk_gpu_driven::ShadowMode::Virtual) {
+                VK_LOG_INFO("GPU driven scene: virtual shadow map unsupported with CPU culling");
+            }
+            if (m_shadowsRequested == vk_gpu_driven::ShadowMode::RayQuery && m_indirectRenderer.shadowMode() != vk_gpu_driven::ShadowMode::RayQuery) {
+                m_sceneAccelerationStructure.destroy();
+                VK_LOG_INFO("GPU driven scene: ray queries unsupported, shadows through cascades");
+            }
+            if (!m_sceneAccelerationStructure.isInitialized()) {
+                m_sceneBvh.init(m_jobSystem, m_indirectRenderer.meshPositions(), m_indirectRenderer.meshIndices());
+                VK_LOG_INFO("GPU driven scene: picking on the CPU, {} triangles a cube", m_indirectRenderer.meshIndices().size() / 3);
+            }
+
+            if (m_indirectRenderer.usesLods()) {
+                VK_LOG_INFO("GPU driven scene: {} levels of detail and an impostor, within {} pixels of error", vk_gpu_driven::LOD_COUNT - 1, m_indirectRenderer.lodErrorPixels());
+            }
+
+            if (m_indirectRenderer.usesAnimation()) {
+                VK_LOG_INFO("GPU driven scene: animated, {} joints skinned in a compute pass", vk_gpu_driven::SKELETON_JOINT_COUNT);
+            } else if (m_animationRequested) {
+                VK_LOG_INFO("GPU driven scene: animation unsupported with mesh shading");
+            }
+
+            if (m_indirectRenderer.isMultisampled()) {
+                VK_LOG_INFO("GPU driven scene: {}x MSAA, resolved within the main pass", static_cast<uint32_t>(m_indirectRenderer.samples()));
+            } else if (m_msaaSamplesRequested > 1) {
+                VK_LOG_INFO("GPU driven scene: {}x MSAA unsupported, not multisampling", m_msaaSamplesRequested);
+            }
+
+            if (m_shadingRate == vk_shading_rate::Mode::Foveated) {
+                const auto texelSize = m_foveatedShadingRate.texelSize();
+                VK_LOG_INFO("GPU driven scene: foveated shading rate, from a {}x{} texel attachment", texelSize.width, texelSize.height);
+            } else if (m_shadingRate == vk_shading_rate::Mode::Coarse) {
+                VK_LOG_INFO("GPU driven scene: coarse shading rate, 2x2 pixels per fragment");
+            } else if (m_shadingRateRequested != vk_shading_rate::Mode::Off) {
+                VK_LOG_INFO("GPU driven scene: {} shading rate unsupported, shading at full rate", vk_shading_rate::modeToString(m_shadingRateRequested));
+            }
+        }
+
+        // The particles live in the scene, and are drawn against its depth from its camera.
+        // Its pipeline is only created once it is first shown, for the format of the window.
+        void createOverlay() {
+            if (this->isHeadless()) {
+                return;
+            }
+
+            m_overlay.init(m_device, m_shaderLibrary, m_pipelineRegistry, m_hostAllocator.callbacks());
+            m_overlay.setVisible(m_overlayRequested);
+        }
+
+        // The widgets' sprites index their icons in the bindless descriptor heap.
+        bool drawsWidgets() const {
+            return m_widgetCount > 0 && !this->isHeadless() && m_descriptorHeap.isInitialized();
+        }
+
+        void createWidgets() {
+            if (m_widgetCount == 0 || this->isHeadless()) {
+                return;
+            } else if (!this->drawsWidgets()) {
+                VK_LOG_INFO("Widgets: unsupported without the bindless descriptor heap, drawing no widgets");
+                return;
+            }
+
+            m_spriteBatcher.init(m_device, m_shaderLibrary, m_pipelineRegistry, m_descriptorHeap, m_samplerCache, m_hostAllocator.callbacks());
+            auto iconAtlas = vk_sprites::createIconAtlas(m_device, m_hostAllocator.callbacks(), m_memoryAllocator, m_uploadService);
+            const auto uploadTicket = iconAtlas.uploadTicket;
+            m_iconAtlas = m_resources.images.create(vk_resources::ImageResource {
+                .image = std::move(iconAtlas.image),
+                .memory = std::move(iconAtlas.memory),
+                .view = std::move(iconAtlas.view),
+            });
+            if (uploadTicket.has_value()) {
+                m_iconAtlasUpload = uploadTicket.value();
+                m_iconTexture = m_spriteBatcher.addTexture(m_resources.images.get(m_iconAtlas)->view.get());
+            }
+            m_textRenderer.init(m_device, m_hostAllocator.callbacks(), m_memoryAllocator, m_jobSystem, m_spriteBatcher);
+            VK_LOG_INFO("Widgets: {}, {}", m_widgetCount, m_iconTexture.has_value() ? "with icons" : "without icons");
+        }
+
+        void createParticleSystem() {
+            if (m_particleCount == 0) {
+                return;
+            }
+
+            const bool bufferDeviceAddress = vk_features::has(m_deviceFeatures, vk_features::Feature::BufferDeviceAddress);
+            if (!m_indirectRenderer.isInitialized() || !vk_gpu_primitives::supports(m_computeTuning, bufferDeviceAddress)) {
+                VK_LOG_INFO("Particles: unsupported, drawing no particles");
+                return;
+            }
+
+            auto queueFamilies = std::vector<uint32_t> { m_queueFamilyIndices.graphicsFamily.value() };
+            if (this->usesAsyncCompute()) {
+                queueFamilies.push_back(m_queueFamilyIndices.computeFamily.value());
+            }
+
+            m_gpuPrimitives.init(
+                m_device,
+                m_memoryAllocator,
+                m_shaderLibrary,
+                m_pipelineRegistry,
+                m_computeTuning,
+                m_hostAllocator.callbacks(),
+                m_particleCount
+            );
+            m_particleSystem.init(
+                m_device,
+                m_memoryAllocator,
+                m_shaderLibrary,
+                m_pipelineRegistry,
+                m_pipelineCompiler,
+                m_gpuPrimitives,
+                m_computeTuning,
+                m_hostAllocator.callbacks(),
+                queueFamilies,
+                m_indirectRenderer.samples(),
+                m_indirectRenderer.depthFormat(),
+                m_indirectRenderer.shadingRate(),
+                m_particleCount,
+                vk_particles::fountain(m_particleCount, m_indirectRenderer.fieldSize())
+            );
+            VK_LOG_INFO("Particles: {}, simulated on the {} queue", m_particleCount, this->usesAsyncCompute() ? "async compute" : "graphics");
+        }
+
+        // The terrain lies under the scene, and is drawn into its depth from its camera.
+        void createTerrain() {
+            if (!m_terrainRequested) {
+                return;
+            }
+
+            const bool bufferDeviceAddress = vk_features::has(m_deviceFeatures, vk_features::Feature::BufferDeviceAddress);
+            if (!m_indirectRenderer.isInitialized() || !bufferDeviceAddress) {
+                VK_LOG_INFO("Terrain: unsupported, drawing no terrain");
+                return;
+            }
+
+            m_terrainRenderer.init(
+                m_device,
+                m_memoryAllocator,
+                m_shaderLibrary,
+                m_pipelineRegistry,
+                m_pipelineCompiler,
+                m_hostAllocator.callbacks(),
+                m_indirectRenderer.samples(),
+                m_indirectRenderer.depthFormat(),
+                m_indirectRenderer.shadingRate(),
+                this->createTerrainAlbedo(),
+                vk_terrain::underField(m_indirectRenderer.fieldSize())
+            );
+            VK_LOG_INFO("Terrain: {} clipmap levels of {}x{} heights", m_terrainRenderer.levelCount(), vk_terrain::GRID_SIZE, vk_terrain::GRID_SIZE);
+        }
+
+        // The terrain's albedo is streamed out of the asset pack, in the block compression
+        // picked for the device, when the pack has one and the device can keep it partially
+        // resident. Sparse binds go on the graphics queue, which the frame thread owns.
+        std::optional<vk_terrain::TerrainAlbedo> createTerrainAlbedo() {
+            const auto name = std::string_view { "terrain_albedo" };
+            if (!m_assetPack.isOpen() || m_assetPack.find(vk_textures::packedLevelName(name, m_textureCompression, 0)) == nullptr) {
+                return std::nullopt;
+            }
+
+            const auto graphicsFamily = m_queueFamilyIndices.graphicsFamily.value();
+            const bool sparseQueue = (m_physicalDeviceInfo.queueFamilies[graphicsFamily].queueFlags & VK_QUEUE_SPARSE_BINDING_BIT) != 0;
+            const bool supported = vk_features::has(m_deviceFeatures, vk_features::Feature::SparseResidency)
+                && sparseQueue
+                && m_tierPaths.bindless
+                && vk_features::has(m_deviceFeatures, vk_features::Feature::FragmentStoresAndAtomics)
+                && vk_streaming::supportsStreaming(m_physicalDevice, vk_textures::formatFor(m_textureCompression, true));
+            if (!supported) {
+                VK_LOG_INFO("Texture streaming: unsupported, drawing the terrain's procedural albedo");
+                return std::nullopt;
+            }
+
+            const auto queueFamilies = std::array { graphicsFamily, m_transferQueueFamily };
+            m_textureStreamer.init(
+                m_physicalDevice,
+                m_device,
+                m_hostAllocator.callbacks(),
+                m_memoryAllocator,
+                m_graphicsQueue,
+                queueFamilies,
+                m_framesInFlight,
+                m_textureStreamingBudget
+            );
+            const auto texture = m_textureStreamer.addTexture(m_assetPack, name, m_textureCompression, true);
+            VK_LOG_INFO(
+                "Texture streaming: terrain albedo in {}, {} MiB budget",
+                vk_textures::blockCompressionToString(m_textureCompression),
+                m_textureStreamingBudget / (1024 * 1024)
+            );
+
+            return vk_terrain::TerrainAlbedo {
+                .descriptorHeap = &m_descriptorHeap,
+                .samplerCache = &m_samplerCache,
+                .streamer = &m_textureStreamer,
+                .texture = texture,
+            };
+        }
+
+        // The panes are drawn against the scene's depth from its camera. Linked lists need
+        // fragment shader atomics, and without them the panes are blended by weight instead.
+        // Their pool is sized for the largest window there is at startup.
+        void createTransparency() {
+            if (!m_transparencyRequested.has_value()) {
+                return;
+            }
+
+            const bool bufferDeviceAddress = vk_features::has(m_deviceFeatures, vk_features::Feature::BufferDeviceAddress);
+            const bool independentBlend = vk_features::has(m_deviceFeatures, vk_features::Feature::IndependentBlend);
+            const bool fragmentAtomics = vk_features::has(m_deviceFeatures, vk_features::Feature::FragmentStoresAndAtomics);
+            auto mode = m_transparencyRequested.value();
+            if (mode == vk_transparency::Mode::LinkedList && !fragmentAtomics) {
+                VK_LOG_INFO("Transparency: linked lists unsupported, blending by weight");
+                mode = vk_transparency::Mode::WeightedBlended;
+            }
+            if (!m_indirectRenderer.isInitialized() || !bufferDeviceAddress || (mode == vk_transparency::Mode::WeightedBlended && !independentBlend)) {
+                VK_LOG_INFO("Transparency: unsupported, drawing nothing transparent");
+                return;
+            }
+
+            auto maxPixels = uint64_t { 0 };
+            for (const auto& presenter : m_presenters) {
+                maxPixels = std::max(maxPixels, uint64_t { presenter.extent.width } * presenter.extent.height);
+            }
+            const auto panes = vk_transparency::scatterPanes(TRANSPARENT_PANE_COUNT, m_indirectRenderer.fieldSize());
+            m_transparencyRenderer.init(
+                m_device,
+                m_memoryAllocator,
+                m_descriptorLayoutCache,
+                m_samplerCache,
+                m_frameDescriptors,
+                m_shaderLibrary,
+                m_pipelineRegistry,
+                m_hostAllocator.callbacks(),
+                m_indirectRenderer.samples(),
+                m_indirectRenderer.depthFormat(),
+                mode,
+                panes,
+                maxPixels
+            );
+            VK_LOG_INFO("Transparency: {} panes, {}", m_transparencyRenderer.paneCount(), vk_transparency::modeToString(mode));
+        }
+
+        // Windows decide whether they post process with their swapchains, so the stack is there
+        // whenever it is asked for.
+        void createPostProcess() {
+            if (!m_postProcessRequested) {
+                return;
+            }
+
+            m_postProcess.init(
+                m_device,
+                m_memoryAllocator,
+                m_descriptorLayoutCache,
+                m_samplerCache,
+                m_frameDescriptors,
+                m_shaderLibrary,
+                m_pipelineRegistry,
+                m_computeTuning,
+                m_hostAllocator.callbacks(),
+                vk_features::has(m_deviceFeatures, vk_features::Feature::PushDescriptor),
+                vk_post::Settings {}
+            );
+            for (const auto& presenter : m_presenters) {
+                if (presenter.postProcessed) {
+                    VK_LOG_INFO("Post processing: window {} {}", presenter.index, presenter.postStorage ? "from a compute shader" : "as a color attachment");
+                }
+            }
+        }
+
+        // Only scaled windows are upscaled, but the render scale of a window can change with its
+        // swapchain, so the upscaler is there whenever it is asked for.
+        void createTemporalUpscaler() {
+            if (m_upscalerRequested != vk_upscaling::Upscaler::Temporal) {
+                return;
+            }
+
+            if (!vk_upscaling::supportsTemporalUpscaling(m_physicalDevice)) {
+                VK_LOG_INFO("Upscaler: temporal unsupported, upscaling linearly");
+                return;
+            }
+
+            m_temporalUpscaler.init(
+                m_device,
+                m_memoryAllocator,
+                m_descriptorLayoutCache,
+                m_samplerCache,
+                m_frameDescriptors,
+                m_shaderLibrary,
+                m_pipelineRegistry,
+                m_computeTuning,
+                m_hostAllocator.callbacks(),
+                static_cast<uint32_t>(m_presenters.size()),
+                vk_features::has(m_deviceFeatures, vk_features::Feature::PushDescriptor)
+            );
+            VK_LOG_INFO("Upscaler: temporal, {} jitter phases", vk_upscaling::JITTER_PHASE_COUNT);
+        }
+
+        // One pool per frame in flight and recording thread. A pool is only ever touched by its
+        // own thread, so recording needs no locks, and it is reset as a whole with
+        // `vkResetCommandPool` once its frame has completed instead of buffer by buffer.
+        vk_result::Status createCommandPools() {
+            const auto indices = m_queueFamilyIndices;
+            const auto createInfo = VkCommandPoolCreateInfo {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+                .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+                .queueFamilyIndex = indices.graphicsFamily.value(),
+            };
+
+            auto commandPools = std::vector<vk_handles::CommandPool> {};
+            for (size_t i = 0; i < m_framesInFlight * m_recordingThreadCount; i++) {
+                auto commandPool = VkCommandPool {};
+                const auto result = vkCreateCommandPool(m_device, &createInfo, m_hostAllocator.callbacks(), &commandPool);
+                VK_RESULT_TRY(vk_result::check(result, "failed to create command pool"));
+
+                commandPools.emplace_back(m_device, commandPool, m_hostAllocator.callbacks());
+            }
+
+            m_commandPools = std::move(commandPools);
+
+            return vk_result::Status {};
+        }
+
+        VkCommandPool commandPoolFor(uint32_t frameIndex, uint32_t threadIndex) const {
+            return m_commandPools[frameIndex * m_recordingThreadCount + threadIndex];
+        }
+
+        // The primary command buffer of each frame comes from the pool of the main thread.
+        vk_result::Status createCommandBuffers() {
+            auto commandBuffers = std::vector<VkCommandBuffer> { m_framesInFlight, VK_NULL_HANDLE };
+            for (uint32_t i = 0; i < m_framesInFlight; i++) {
+                const auto allocateInfo = VkCommandBufferAllocateInfo {
+                    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                    .commandPool = this->commandPoolFor(i, 0),
+                    .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                    .commandBufferCount = 1,
+                };
+
+                const auto result = vkAllocateCommandBuffers(m_device, &allocateInfo, &commandBuffers[i]);
+                VK_RESULT_TRY(vk_result::check(result, "failed to allocate command buffers"));
+
+                if (vk_debug::labelsEnabled()) {
+                    const auto name = fmt::format("frame {}", i);
+                    vk_debug::setObjectName(m_device, VK_OBJECT_TYPE_COMMAND_BUFFER, commandBuffers[i], name.c_str());
+                }
+            }
+
+            m_commandBuffers = std::move(commandBuffers);
+
+            return vk_result::Status {};
+        }
+
+        void resetCommandPools(uint32_t frameIndex) {
+            for (uint32_t i = 0; i < m_recordingThreadCount; i++) {
+                vkResetCommandPool(m_device, this->commandPoolFor(frameIndex, i), 0);
+            }
+        }
+
+        // Every window acquires its own image in each frame slot.
+        vk_result::Status createSyncObjects() {
+            const auto semaphoreInfo = VkSemaphoreCreateInfo {
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+            };
+            for (auto& presenter : m_presenters) {
+                auto imageAvailableSemaphores = std::vector<vk_handles::Semaphore> {};
+                for (size_t i = 0; i < m_framesInFlight; i++) {
+                    auto imageAvailableSemaphore = VkSemaphore {};
+                    const auto semaphoreResult = vkCreateSemaphore(m_device, &semaphoreInfo, m_hostAllocator.callbacks(), &imageAvailableSemaphore);
+                    VK_RESULT_TRY(vk_result::check(semaphoreResult, "failed to create synchronization objects for a frame"));
+
+                    imageAvailableSemaphores.emplace_back(m_device, imageAvailableSemaphore, m_hostAllocator.callbacks());
+                }
+
+                presenter.imageAvailableSemaphores = std::move(imageAvailableSemaphores);
+            }
+
+            // Frame `n` signals the value `n + 1` when its graphics work completes, so a single
+            // counter replaces a fence per frame slot and never has to be reset.
+            // Exported frames share it with their consumers, which wait on it for each frame.
+            const auto timelineInfo = VkSemaphoreTypeCreateInfo {
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+                .pNext = m_frameExporter.isPrepared() ? m_frameExporter.semaphoreExportInfo() : nullptr,
+                .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+                .initialValue = 0,
+            };
+            const auto timelineSemaphoreInfo = VkSemaphoreCreateInfo {
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+                .pNext = &timelineInfo,
+            };
+
+            auto frameTimelineSemaphore = VkSemaphore {};
+            const auto timelineResult = vkCreateSemaphore(m_device, &timelineSemaphoreInfo, m_hostAllocator.callbacks(), &frameTimelineSemaphore);
+            VK_RESULT_TRY(vk_result::check(timelineResult, "failed to create the frame timeline semaphore"));
+
+            m_frameTimelineSemaphore = vk_handles::Semaphore { m_device, frameTimelineSemaphore, m_hostAllocator.callbacks() };
+            if (this->usesDeviceGroup()) {
+                m_deviceGroupSync.init(m_device, static_cast<uint32_t>(m_deviceGroupDevices.size()), m_hostAllocator.callbacks());
+            }
+
+            return vk_result::Status {};
+        }
+
+        // Frames are only profiled on the graphics queue, which is where they are submitted.
+        // The driver's pacing leaves device group submissions out, which it cannot tie to a
+        // present, so device groups always pace on the estimates.
+        void createLowLatencyPacer() {
+            const bool driverPacing = vk_features::has(m_deviceFeatures, vk_features::Feature::LowLatency) && !this->usesDeviceGroup();
+            m_lowLatencyPacer.init(m_device, driverPacing, m_hostAllocator.callbacks());
+            VK_LOG_INFO("Low latency mode: {}", m_lowLatencyPacer.usesDriverPacing() ? "driver pacing" : "estimated pacing");
+        }
+
+        // Created even without a limit, so that one can be set from the keyboard. Benchmarks
+        // and the render service measure frames as fast as they come, so only a limit they are
+        // given holds them back.
+        void createFrameLimiter() {
+            m_frameLimiter.init();
+            auto frameLimit = frameLimitFromEnvironment();
+            if (!frameLimit.has_value() && (m_benchmarkSettings.has_value() || m_serviceEndpoint.has_value())) {
+                frameLimit = 0.0;
+            }
+            this->setFrameLimit(frameLimit);
+            if (m_frameLimiter.isEnabled()) {
+                VK_LOG_INFO("Frame limit: {} fps", m_frameLimiter.targetFps());
+            }
+        }
+
+        // Nothing follows the refresh rate of the first window's monitor from the next frame.
+        void setFrameLimit(std::optional<double> frameLimit) {
+            m_frameLimitFollowsDisplay = !frameLimit.has_value();
+            m_displayRefreshRate = 0;
+            m_frameLimiter.setTargetFps(frameLimit.value_or(0.0));
+        }
+
+        // A window on a 60 Hz monitor renders no frames at the rate of a 144 Hz one that the
+        // display would drop, and the limit moves with the window to another monitor. Without
+        // a window, or a refresh rate, the frame rate is left unlimited.
+        void followDisplayRefreshRate() {
+            if (!m_frameLimitFollowsDisplay) {
+                return;
+            }
+
+            const auto refreshRate = m_windowRefreshRates[0].load(std::memory_order_acquire);
+            if (refreshRate == m_displayRefreshRate) {
+                return;
+            }
+
+            m_displayRefreshRate = refreshRate;
+            m_frameLimiter.setTargetFps(refreshRate);
+            if (refreshRate > 0) {
+                VK_LOG_INFO("Frame limit: {} fps, following the refresh rate of window 0's monitor", refreshRate);
+            }
+        }
+
+        // Benchmarks and the render service measure what the settings they ask for cost, so
+        // they never save power. Each change wakes the frame loop, which may be parked in the
+        // on-demand render mode, to apply it.
+        void startPowerMonitor() {
+            if (m_powerPolicy == PowerPolicy::Off || m_benchmarkSettings.has_value() || m_serviceEndpoint.has_value()) {
+                return;
+            }
+
+            m_powerMonitor.start([this]() { this->requestFrame(); });
+            VK_LOG_INFO("Power policy: {}, running on {}", powerPolicyToString(m_powerPolicy), vk_power::describe(m_powerMonitor.state()));
+        }
+
+        // While it saves power, frames wait for the display to refresh, are capped and rendered
+        // smaller, and are only rendered when something changes, except on a display, which
+        // has no input to ask for them. The settings they replaced come back once it stops,
+        // and changes made from the keyboard in between are dropped then.
+        void applyPowerPolicy() {
+            if (!m_powerMonitor.isRunning()) {
+                return;
+            }
+
+            const auto state = m_powerMonitor.state();
+            const bool savesPower = m_powerPolicy == PowerPolicy::Always || state.savesPower();
+            if (savesPower == m_powerRestoreSettings.has_value()) {
+                return;
+            }
+
+            if (savesPower) {
+                m_powerRestoreSettings = RenderSettings {
+                    .presentModePolicy = m_presentModePolicy,
+                    .frameLimit = m_frameLimitFollowsDisplay ? std::nullopt : std::optional { m_frameLimiter.targetFps() },
+                    .renderScale = m_renderScale,
+                    .renderMode = m_renderMode,
+                };
+                const auto frameLimit = m_frameLimiter.isEnabled() ? std::min(m_frameLimiter.targetFps(), POWER_SAVING_FRAME_LIMIT) : POWER_SAVING_FRAME_LIMIT;
+                this->setPresentModePolicy(PresentModePolicy::Power);
+                this->setFrameLimit(frameLimit);
+                this->setRenderScale(std::min(m_renderScale, POWER_SAVING_RENDER_SCALE));
+                if (!m_displayTarget.has_value()) {
+                    this->setRenderMode(RenderMode::OnDemand);
+                }
+                VK_LOG_INFO("Saving power on {}: {} fps limit, render scale {}, rendering {}", vk_power::describe(state), frameLimit, m_renderScale, m_renderMode == RenderMode::OnDemand ? "on demand" : "continuously");
+            } else {
+                const auto settings = m_powerRestoreSettings.value();
+                m_powerRestoreSettings.reset();
+                this->setPresentModePolicy(settings.presentModePolicy);
+                this->setFrameLimit(settings.frameLimit);
+                this->setRenderScale(settings.renderScale);
+                this->setRenderMode(settings.renderMode);
+                VK_LOG_INFO("Stopped saving power on {}", vk_power::describe(state));
+            }
+        }
+
+        // Like the power policy, the governor stays out of benchmarks and the render service.
+        // Dynamic resolution already holds a GPU budget, by moving the same render scale.
+        void createThermalGovernor() {
+            if (!m_thermalGovernorRequested || m_benchmarkSettings.has_value() || m_serviceEndpoint.has_value()) {
+                return;
+            } else if (m_dynamicResolution.isEnabled()) {
+                VK_LOG_INFO("Thermal governor: off, dynamic resolution holds the GPU budget");
+                return;
+            }
+
+            m_thermalGovernor.init();
+            VK_LOG_INFO(
+                "Thermal governor: {} quality tiers, workload counted in {}",
+                vk_thermal::QUALITY_TIERS.size(),
+                m_pipelineStatistics.isEnabled() ? "shader invocations" : "pixels"
+            );
+        }
+
+        // Shader invocations, when pipeline statistics count them, and rendered pixels
+        // otherwise.
+        double frameWorkload() const {
+            if (m_pipelineStatistics.isEnabled()) {
+                const auto& counts = m_pipelineStatistics.lastFrameCounts();
+
+                return static_cast<double>(
+                    counts[static_cast<size_t>(vk_profiling::PipelineStatistic::VertexInvocations)]
+                        + counts[static_cast<size_t>(vk_profiling::PipelineStatistic::FragmentInvocations)]
+                        + counts[static_cast<size_t>(vk_profiling::PipelineStatistic::ComputeInvocations)]
+                );
+            }
+
+            auto pixels = 0.0;
+            for (const auto& presenter : m_presenters) {
+                if (!this->isMinimized(presenter)) {
+                    const auto extent = this->renderTargetExtent(presenter);
+                    pixels += static_cast<double>(extent.width) * static_cast<double>(extent.height);
+                }
+            }
+
+            return pixels;
+        }
+
+        // Paused while the power policy saves power, which owns the render scale until it
+        // stops, and whose frame limit leaves the GPU idle for most of every frame anyway.
+        void updateThermalGovernor(double gpuMilliseconds, double frameMilliseconds) {
+            if (!m_thermalGovernor.isEnabled() || m_powerRestoreSettings.has_value()) {
+                return;
+            }
+
+            const auto tier = m_thermalGovernor.update(gpuMilliseconds, frameMilliseconds, this->frameWorkload());
+            if (!tier.has_value()) {
+                return;
+            }
+
+            const auto& quality = vk_thermal::QUALITY_TIERS[tier.value()];
+            if (!m_thermalBaseScale.has_value()) {
+                m_thermalBaseScale = m_renderScale;
+            }
+            this->setRenderScale(m_thermalBaseScale.value() * quality.renderScale);
+            if (m_particleSystem.isInitialized()) {
+                m_particleSystem.setEmissionScale(static_cast<float>(quality.particleRate));
+            }
+            if (tier.value() == 0) {
+                m_thermalBaseScale.reset();
+            }
+            VK_LOG_INFO(
+                "Thermal governor: quality tier {} at {:.2f}x the GPU time of full clocks, render scale {}, particle rate {}",
+                tier.value(),
+                m_thermalGovernor.throttleFactor(),
+                m_renderScale,
+                quality.particleRate
+            );
+        }
+
+        // The controller runs on the GPU profiler's frame time, which needs timestamps on the
+        // graphics queue. It has to be set up before the swapchains, which only get render
+        // targets to scale when it is enabled or the render scale is below 1.
+        void createDynamicResolution() {
+            const auto graphicsFamily = m_queueFamilyIndices.graphicsFamily.value();
+            if (m_physicalDeviceInfo.queueFamilies[graphicsFamily].timestampValidBits == 0) {
+                VK_LOG_WARNING("Dynamic resolution unavailable, the graphics queue has no timestamps, leaving the resolution fixed");
+                return;
+            }
+
+            m_dynamicResolution.init(m_gpuBudget.value(), MIN_RENDER_SCALE, m_renderScale);
+            VK_LOG_INFO("Dynamic resolution: {} ms GPU budget, scale {} to {}", m_gpuBudget.value(), MIN_RENDER_SCALE, m_renderScale);
+        }
+
+        void createGpuProfiler() {
+            const auto graphicsFamily = m_queueFamilyIndices.graphicsFamily.value();
+            m_gpuProfiler.init(
+                m_device,
+                m_physicalDeviceInfo.properties.limits.timestampPeriod,
+                m_physicalDeviceInfo.queueFamilies[graphicsFamily].timestampValidBits,
+                m_framesInFlight
+            );
+            this->createPipelineStatistics();
+            this->createPerformanceCounters();
+        }
+
+        void createClockCalibration() {
+            m_frameSubmitTimes.assign(m_framesInFlight, std::nullopt);
+            if (!vk_features::has(m_deviceFeatures, vk_features::Feature::CalibratedTimestamps)) {
+                return;
+            }
+
+            m_clockCalibration.init(
+                m_physicalDevice,
+                m_device,
+                vk_features::hasExtension(m_physicalDeviceInfo.extensions, VK_KHR_CALIBRATED_TIMESTAMPS_EXTENSION_NAME),
+                m_physicalDeviceInfo.properties.limits.timestampPeriod
+            );
+            if (!m_clockCalibration.isEnabled()) {
+                VK_LOG_WARNING("Calibrated timestamps unavailable, the device cannot sample the host clock");
+            }
+        }
+
+        void createPipelineStatistics() {
+            if (!m_pipelineStatisticsRequested) {
+                return;
+            } else if (!vk_features::has(m_deviceFeatures, vk_features::Feature::PipelineStatisticsQuery)) {
+                VK_LOG_WARNING("Pipeline statistics unavailable, the device has no pipeline statistics or inherited queries");
+                return;
+            }
+
+            m_pipelineStatistics.init(m_device, m_framesInFlight);
+            m_renderGraph.setPipelineStatistics(&m_pipelineStatistics);
+        }
+
+        // The counters are the graphics queue's, like the passes they are read for.
+        void createPerformanceCounters() {
+            if (m_performanceCounterPatterns.empty()) {
+                return;
+            } else if (!vk_features::has(m_deviceFeatures, vk_features::Feature::PerformanceQuery)) {
+                VK_LOG_WARNING("Performance counters unavailable, the device has no performance query pools or host query reset");
+                return;
+            }
+
+            const auto graphicsFamily = m_queueFamilyIndices.graphicsFamily.value();
+            if (m_performanceCounterPatterns.front() == "list") {
+                vk_profiling::listPerformanceCounters(std::cout, vk_profiling::enumeratePerformanceCounters(m_physicalDevice, graphicsFamily));
+                return;
+            }
+
+            m_performanceCounters.init(m_physicalDevice, m_device, graphicsFamily, m_framesInFlight, m_performanceCounterPatterns);
+            if (!m_performanceCounters.isEnabled()) {
+                VK_LOG_WARNING("Performance counters unavailable, no counter matches {}", PERFORMANCE_COUNTERS_ENVIRONMENT_VARIABLE);
+                return;
+            }
+
+            VK_LOG_INFO("Performance counters: {} in {} groups, each read every {} frames", m_performanceCounters.counters().size(), m_performanceCounters.groupCount(), m_performanceCounters.groupCount());
+            m_renderGraph.setPerformanceCounters(&m_performanceCounters);
+        }
+
+        // Breadcrumbs cost a couple of commands per pass, and without either marker extension a
+        // barrier after every pass, so they are only left when asked for. The device fault is
+        // reported either way.
+        void createCrashDiagnostics() {
+            if (!m_crashDiagnosticsRequested) {
+                return;
+            }
+
+            const auto method = vk_features::has(m_deviceFeatures, vk_features::Feature::BufferMarker) ? vk_breadcrumbs::Method::BufferMarker
+                : vk_features::has(m_deviceFeatures, vk_features::Feature::DiagnosticCheckpoints) ? vk_breadcrumbs::Method::Checkpoints
+                : vk_breadcrumbs::Method::FillBuffer;
+            m_breadcrumbs.init(m_device, m_memoryAllocator, method);
+            m_renderGraph.setBreadcrumbs(&m_breadcrumbs);
+            VK_LOG_INFO("Crash diagnostics: breadcrumbs by {}", vk_breadcrumbs::methodToString(method));
+        }
+
+        // Says what the GPU was doing when the device was lost, once, before the error that ends
+        // the run is thrown. The queues are in the order of the render graph's `PassQueue`.
+        void reportIfDeviceLost(VkResult result) {
+            if (result != VK_ERROR_DEVICE_LOST || m_deviceLostReported) {
+                return;
+            }
+
+            m_deviceLostReported = true;
+            m_metricsServer.countDeviceLost();
+            VK_LOG_WARNING("Device lost after submitting frame {}", m_frameCount);
+            vk_log::flush();
+            const auto queues = std::array {
+                vk_breadcrumbs::Queue { "graphics", m_graphicsQueue },
+                vk_breadcrumbs::Queue { "async compute", this->usesAsyncCompute() ? m_computeQueue : VK_NULL_HANDLE },
+            };
+            m_breadcrumbs.report(std::cerr, queues);
+            if (vk_features::has(m_deviceFeatures, vk_features::Feature::DeviceFault)) {
+                vk_breadcrumbs::reportDeviceFault(
+                    std::cerr,
+                    m_device,
+                    vk_features::has(m_deviceFeatures, vk_features::Feature::DeviceFaultVendorBinary),
+                    DEVICE_FAULT_DUMP_FILE_NAME
+                );
+            }
+        }
+
+        // Split frames submit through the device group path, which has no compute submission.
+        vk_result::Status createAsyncCompute() {
+            const auto computeFamily = m_queueFamilyIndices.computeFamily;
+            if (!m_asyncComputeRequested || !computeFamily.has_value() || this->usesDeviceGroup()) {
+                VK_LOG_INFO("Async compute: off");
+                return vk_result::Status {};
+            }
+
+            const auto poolInfo = VkCommandPoolCreateInfo {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+                .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+                .queueFamilyIndex = computeFamily.value(),
+            };
+
+            m_asyncComputeFrames.assign(m_framesInFlight, std::nullopt);
+            auto commandPools = std::vector<vk_handles::CommandPool> {};
+            auto commandBuffers = std::vector<VkCommandBuffer>(m_framesInFlight, VK_NULL_HANDLE);
+            for (uint32_t i = 0; i < m_framesInFlight; i++) {
+                auto commandPool = VkCommandPool {};
+                const auto poolResult = vkCreateCommandPool(m_device, &poolInfo, m_hostAllocator.callbacks(), &commandPool);
+                VK_RESULT_TRY(vk_result::check(poolResult, "failed to create async compute command pool"));
+
+                commandPools.emplace_back(m_device, commandPool, m_hostAllocator.callbacks());
+
+                const auto allocateInfo = VkCommandBufferAllocateInfo {
+                    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                    .commandPool = commandPool,
+                    .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                    .commandBufferCount = 1,
+                };
+                const auto allocateResult = vkAllocateCommandBuffers(m_device, &allocateInfo, &commandBuffers[i]);
+                VK_RESULT_TRY(vk_result::check(allocateResult, "failed to allocate async compute command buffers"));
+
+                if (vk_debug::labelsEnabled()) {
+                    const auto name = fmt::format("frame {} async compute", i);
+                    vk_debug::setObjectName(m_device, VK_OBJECT_TYPE_COMMAND_BUFFER, commandBuffers[i], name.c_str());
+                }
+            }
+
+            // Frame `n` signals `n + 1` once its async work completes, like the frame timeline.
+            const auto timelineInfo = VkSemaphoreTypeCreateInfo {
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+                .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+                .initialValue = 0,
+            };
+            const auto semaphoreInfo = VkSemaphoreCreateInfo {
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+                .pNext = &timelineInfo,
+            };
+
+            auto semaphore = VkSemaphore {};
+            const auto semaphoreResult = vkCreateSemaphore(m_device, &semaphoreInfo, m_hostAllocator.callbacks(), &semaphore);
+            VK_RESULT_TRY(vk_result::check(semaphoreResult, "failed to create the async compute timeline semaphore"));
+
+            m_asyncComputePools = std::move(commandPools);
+            m_asyncComputeCommandBuffers = std::move(commandBuffers);
+            m_asyncComputeSemaphore = vk_handles::Semaphore { m_device, semaphore, m_hostAllocator.callbacks() };
+            m_asyncComputeProfiler.init(
+                m_device,
+                m_physicalDeviceInfo.properties.limits.timestampPeriod,
+                m_physicalDeviceInfo.queueFamilies[computeFamily.value()].timestampValidBits,
+                m_framesInFlight,
+                "async compute"
+            );
+            m_asyncComputeProfiler.traceTimeline(m_computeQueue, computeFamily.value(), 1, m_clockCalibration);
+            m_renderGraph.setAsyncComputeQueue(m_queueFamilyIndices.graphicsFamily.value(), computeFamily.value());
+            VK_LOG_INFO("Async compute: queue family {}", computeFamily.value());
+
+            return vk_result::Status {};
+        }
+
+        bool usesAsyncCompute() const {
+            return !m_asyncComputeCommandBuffers.empty();
+        }
+
+        // Block until frame `frameNumber` has finished executing on the graphics queue.
+        vk_result::Status waitForFrame(uint64_t frameNumber) {
+            VK_TRACING_ZONE("waitForFrame");
+            const auto waitValue = frameNumber + 1;
+            const auto frameTimelineSemaphore = m_frameTimelineSemaphore.get();
+            const auto waitInfo = VkSemaphoreWaitInfo {
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+                .semaphoreCount = 1,
+                .pSemaphores = &frameTimelineSemaphore,
+                .pValues = &waitValue,
+            };
+
+            const auto result = vkWaitSemaphores(m_device, &waitInfo, std::numeric_limits<uint64_t>::max());
+            this->reportIfDeviceLost(result);
+            VK_RESULT_TRY(vk_result::check(result, "failed to wait for a frame to complete"));
+
+            return vk_result::Status {};
+        }
+
+        vk_result::Status createRenderFinishedSemaphores(WindowPresenter& presenter) {
+            const auto semaphoreInfo = VkSemaphoreCreateInfo {
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+            };
+
+            // The presentation engine holds on to the render finished semaphore until the image
+            // is presented, so these are owned per swapchain image rather than per frame slot. An
+            // image cannot be acquired again before its previous present has consumed the semaphore.
+            auto renderFinishedSemaphores = std::vector<vk_handles::Semaphore> {};
+            for (size_t i = 0; i < presenter.images.size(); i++) {
+                auto renderFinishedSemaphore = VkSemaphore {};
+                const auto result = vkCreateSemaphore(m_device, &semaphoreInfo, m_hostAllocator.callbacks(), &renderFinishedSemaphore);
+                VK_RESULT_TRY(vk_result::check(result, "failed to create synchronization objects for a swapchain image"));
+
+                renderFinishedSemaphores.emplace_back(m_device, renderFinishedSemaphore, m_hostAllocator.callbacks());
+            }
+
+            presenter.renderFinishedSemaphores = std::move(renderFinishedSemaphores);
+
+            // Signaled until the image is first presented, so a present only ever waits for
+            // presents that were made.
+            const auto fenceInfo = VkFenceCreateInfo {
+                .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+                .flags = VK_FENCE_CREATE_SIGNALED_BIT,
+            };
+            auto presentFences = std::vector<vk_handles::Fence> {};
+            for (size_t i = 0; this->usesSwapchainMaintenance() && i < presenter.images.size(); i++) {
+                auto presentFence = VkFence {};
+                const auto result = vkCreateFence(m_device, &fenceInfo, m_hostAllocator.callbacks(), &presentFence);
+                VK_RESULT_TRY(vk_result::check(result, "failed to create synchronization objects for a swapchain image"));
+
+                presentFences.emplace_back(m_device, presentFence, m_hostAllocator.callbacks());
+            }
+
+            presenter.presentFences = std::move(presentFences);
+
+            return vk_result::Status {};
+        }
+
+        // The acquire half of each image's ownership transfer only depends on the image, so it
+        // is recorded once per swapchain and resubmitted every time the image is presented. An
+        // image is not acquired again before its present, which waits for the submission.
+        vk_result::Status createPresentOwnershipTransfer(WindowPresenter& presenter) {
+            if (!presenter.ownershipTransfer) {
+                return vk_result::Status {};
+            }
+
+            const auto indices = m_queueFamilyIndices;
+            const auto poolInfo = VkCommandPoolCreateInfo {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+                .queueFamilyIndex = indices.presentFamily.value(),
+            };
+
+            auto commandPool = VkCommandPool {};
+            const auto poolResult = vkCreateCommandPool(m_device, &poolInfo, m_hostAllocator.callbacks(), &commandPool);
+            VK_RESULT_TRY(vk_result::check(poolResult, "failed to create present command pool"));
+
+            const auto imageCount = static_cast<uint32_t>(presenter.images.size());
+            auto transfer = PresentOwnershipTransfer {
+                .commandPool = vk_handles::CommandPool { m_device, commandPool, m_hostAllocator.callbacks() },
+                .acquireCommandBuffers = std::vector<VkCommandBuffer> { imageCount, VK_NULL_HANDLE },
+                .acquiredSemaphores = std::vector<vk_handles::Semaphore> {},
+            };
+
+            const auto allocateInfo = VkCommandBufferAllocateInfo {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                .commandPool = commandPool,
+                .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                .commandBufferCount = imageCount,
+            };
+
+            const auto allocateResult = vkAllocateCommandBuffers(m_device, &allocateInfo, transfer.acquireCommandBuffers.data());
+            VK_RESULT_TRY(vk_result::check(allocateResult, "failed to allocate present command buffers"));
+
+            // The layouts have to match the graphics family's release barrier exactly, which
+            // moves the image from its last use, a blit into it for scaled frames, or a storage
+            // write for frames post processed from a compute shader. Widgets are drawn last.
+            const auto oldLayout = [this, &presenter]() {
+                if (presenter.computePresent) {
+                    return VK_IMAGE_LAYOUT_GENERAL;
+                } else if (this->drawsWidgets()) {
+                    return VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+                } else if (presenter.postStorage) {
+                    return VK_IMAGE_LAYOUT_GENERAL;
+                } else if (presenter.scaledRendering && !presenter.postProcessed) {
+                    return VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+                }
+
+                return VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+            }();
+            const auto semaphoreInfo = VkSemaphoreCreateInfo {
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+            };
+            for (uint32_t i = 0; i < imageCount; i++) {
+                const auto commandBuffer = transfer.acquireCommandBuffers[i];
+                const auto beginInfo = VkCommandBufferBeginInfo {
+                    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                };
+
+                const auto beginResult = vkBeginCommandBuffer(commandBuffer, &beginInfo);
+                VK_RESULT_TRY(vk_result::check(beginResult, "failed to begin recording present command buffer"));
+
+                this->transitionSwapChainImage(
+                    commandBuffer,
+                    presenter.images[i],
+                    oldLayout,
+                    VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                    VK_PIPELINE_STAGE_2_NONE,
+                    VK_ACCESS_2_NONE,
+                    VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                    VK_ACCESS_2_NONE,
+                    indices.graphicsFamily.value(),
+                    indices.presentFamily.value()
+                );
+
+                const auto endResult = vkEndCommandBuffer(commandBuffer);
+                VK_RESULT_TRY(vk_result::check(endResult, "failed to record present command buffer"));
+
+                auto acquiredSemaphore = VkSemaphore {};
+                const auto semaphoreResult = vkCreateSemaphore(m_device, &semaphoreInfo, m_hostAllocator.callbacks(), &acquiredSemaphore);
+                VK_RESULT_TRY(vk_result::check(semaphoreResult, "failed to create synchronization objects for a swapchain image"));
+
+                transfer.acquiredSemaphores.emplace_back(m_device, acquiredSemaphore, m_hostAllocator.callbacks());
+            }
+
+            presenter.presentOwnershipTransfer = std::move(transfer);
+
+            return vk_result::Status {};
+        }
+
+        // Submit the acquire half of the ownership transfer of every presented image that needs
+        // one on the present queue, in a single submission, and swap the semaphore its present
+        // waits on from the render finished one to the one the transfer signals.
+        vk_result::Status acquirePresentOwnership(std::span<VkSemaphore> presentWaitSemaphores) {
+            const auto windowCount = m_presentingWindows.size();
+            const auto waitStage = VkPipelineStageFlags { VK_PIPELINE_STAGE_ALL_COMMANDS_BIT };
+            auto renderFinishedSemaphores = std::pmr::vector<VkSemaphore>(&m_frameArena);
+            auto acquiredSemaphores = std::pmr::vector<VkSemaphore>(&m_frameArena);
+            auto submitInfos = std::pmr::vector<VkSubmitInfo>(&m_frameArena);
+            renderFinishedSemaphores.reserve(windowCount);
+            acquiredSemaphores.reserve(windowCount);
+            submitInfos.reserve(windowCount);
+            for (size_t i = 0; i < windowCount; i++) {
+                const auto [presenterIndex, imageIndex] = m_presentingWindows[i];
+                const auto& presenter = m_presenters[presenterIndex];
+                if (!presenter.ownershipTransfer) {
+                    continue;
+                }
+
+                const auto& transfer = presenter.presentOwnershipTransfer;
+                renderFinishedSemaphores.push_back(presentWaitSemaphores[i]);
+                acquiredSemaphores.push_back(transfer.acquiredSemaphores[imageIndex].get());
+                submitInfos.push_back(VkSubmitInfo {
+                    .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+                    .waitSemaphoreCount = 1,
+                    .pWaitSemaphores = &renderFinishedSemaphores.back(),
+                    .pWaitDstStageMask = &waitStage,
+                    .commandBufferCount = 1,
+                    .pCommandBuffers = &transfer.acquireCommandBuffers[imageIndex],
+                    .signalSemaphoreCount = 1,
+                    .pSignalSemaphores = &acquiredSemaphores.back(),
+                });
+                presentWaitSemaphores[i] = acquiredSemaphores.back();
+            }
+
+            if (submitInfos.empty()) {
+                return vk_result::Status {};
+            }
+
+            const auto result = vkQueueSubmit(m_presentQueue, static_cast<uint32_t>(submitInfos.size()), submitInfos.data(), VK_NULL_HANDLE);
+            this->reportIfDeviceLost(result);
+            VK_RESULT_TRY(vk_result::check(result, "failed to submit present ownership transfer"));
+
+            return vk_result::Status {};
+        }
+
+        // Every frame that could still reference a retired swapchain was submitted before it
+        // was retired. Once each frame slot has been waited on since then, all of those frames
+        // have finished executing, so nothing needs a `vkDeviceWaitIdle`. The extra frame of
+        // slack covers the present of the last image, which the frame timeline does not track.
+        // Present fences do track it: every frame using the swapchain presented from it, and
+        // each present's fence signals once the frame it waited for is done, so with swapchain
+        // maintenance the swapchain goes as soon as its fences have signaled.
+        void retireSwapChain(WindowPresenter& presenter) {
+            auto imageViews = std::vector<vk_handles::ImageView> {};
+            for (const auto image : presenter.images) {
+                m_imageViews.release(image, imageViews);
+            }
+
+            auto retiredSwapChain = RetiredSwapChain {
+                .swapChain = std::move(presenter.swapChain),
+                .splitImages = std::move(presenter.splitImages),
+                .imageViews = std::move(imageViews),
+                .renderFinishedSemaphores = std::move(presenter.renderFinishedSemaphores),
+                .presentFences = std::move(presenter.presentFences),
+                .presentTargets = std::move(presenter.presentTargets),
+                .ownershipTransfer = std::move(presenter.presentOwnershipTransfer),
+            };
+
+            if (this->usesSwapchainMaintenance()) {
+                m_fencedSwapChains.push_back(std::move(retiredSwapChain));
+            } else {
+                m_retiredSwapChains.retire(m_frameCount + m_framesInFlight, std::move(retiredSwapChain));
+            }
+            presenter.splitImages.clear();
+            presenter.imageViews.clear();
+            presenter.renderFinishedSemaphores.clear();
+            presenter.presentFences.clear();
+            presenter.presentTargets.descriptorSets.clear();
+            presenter.presentOwnershipTransfer.acquireCommandBuffers.clear();
+            presenter.presentOwnershipTransfer.acquiredSemaphores.clear();
+        }
+
+        void collectFencedSwapChains() {
+            std::erase_if(m_fencedSwapChains, [this](const RetiredSwapChain& retired) {
+                return std::ranges::all_of(retired.presentFences, [this](const vk_handles::Fence& fence) {
+                    return vkGetFenceStatus(m_device, fence) == VK_SUCCESS;
+                });
+            });
+        }
+
+        // A minimized window has a zero sized framebuffer, and a swapchain cannot be created
+        // with a zero extent, so a minimized window sits frames out until it is visible again.
+        // An iconified window keeps its size on X11 and macOS, but nobody sees its frames.
+        bool isMinimized(const WindowPresenter& presenter) const {
+            return presenter.iconified || presenter.framebufferExtent.width == 0 || presenter.framebufferExtent.height == 0;
+        }
+
+        vk_result::Status recreateSwapChain(WindowPresenter& presenter) {
+            // With dynamic rendering there are no render pass or framebuffer objects to rebuild,
+            // only the image views of the new swapchain.
+            const auto oldSwapChain = presenter.swapChain.get();
+            m_allocationCheck.exemptFrame();
+            m_presentLatencyMonitor.forgetSwapChain(oldSwapChain);
+            m_metricsServer.countSwapchainRecreation();
+            this->retireSwapChain(presenter);
+            if (presenter.framebufferResized) {
+                presenter.surfaceSupportOutdated = false;
+            }
+            this->refreshSurfaceSupport(presenter);
+            VK_RESULT_TRY(this->createSwapChain(presenter, oldSwapChain));
+            VK_RESULT_TRY(this->createImageViews(presenter));
+            this->createPresentTargets(presenter);
+            VK_RESULT_TRY(this->createRenderFinishedSemaphores(presenter));
+            VK_RESULT_TRY(this->createPresentOwnershipTransfer(presenter));
+
+            presenter.framebufferResized = false;
+            presenter.swapChainOutdated = false;
+
+            return vk_result::Status {};
+        }
+
+        // The compositor can report a zero extent before the zero framebuffer size reaches the
+        // renderer, and `selectSwapExtent` would then size the swapchain to nothing.
+        bool surfaceHasArea(const WindowPresenter& presenter) const {
+            auto capabilities = VkSurfaceCapabilitiesKHR {};
+            vkGetPhysicalDeviceSurfaceCapabilitiesKHR(m_physicalDevice, presenter.surface, &capabilities);
+
+            return capabilities.currentExtent.width != 0 && capabilities.currentExtent.height != 0;
+        }
+
+        // Minimized windows keep their flags, and are recreated once they are visible again.
+        vk_result::Status recreateOutdatedSwapChains() {
+            for (auto& presenter : m_presenters) {
+                if ((presenter.framebufferResized || presenter.swapChainOutdated) && !this->isMinimized(presenter) && this->surfaceHasArea(presenter)) {
+                    VK_RESULT_TRY(this->recreateSwapChain(presenter));
+                }
+            }
+
+            return vk_result::Status {};
+        }
+
+        // A barrier outside `m_imageLayouts`, for the command buffers recorded once for the
+        // present queue, whose layouts the frames never see.
+        void transitionSwapChainImage(
+            VkCommandBuffer commandBuffer,
+            VkImage image,
+            VkImageLayout oldLayout,
+            VkImageLayout newLayout,
+            VkPipelineStageFlags2 srcStageMask,
+            VkAccessFlags2 srcAccessMask,
+            VkPipelineStageFlags2 dstStageMask,
+            VkAccessFlags2 dstAccessMask,
+            uint32_t srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            uint32_t dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED
+        ) {
+            const auto barrier = VkImageMemoryBarrier2 {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+                .srcStageMask = srcStageMask,
+                .srcAccessMask = srcAccessMask,
+                .dstStageMask = dstStageMask,
+                .dstAccessMask = dstAccessMask,
+                .oldLayout = oldLayout,
+                .newLayout = newLayout,
+                .srcQueueFamilyIndex = srcQueueFamilyIndex,
+                .dstQueueFamilyIndex = dstQueueFamilyIndex,
+                .image = image,
+                .subresourceRange = VkImageSubresourceRange {
+                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                    .baseMipLevel = 0,
+                    .levelCount = 1,
+                    .baseArrayLayer = 0,
+                    .layerCount = 1,
+                },
+            };
+            const auto dependencyInfo = VkDependencyInfo {
+                .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+                .imageMemoryBarrierCount = 1,
+                .pImageMemoryBarriers = &barrier,
+            };
+
+            vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+        }
+
+        // The last barrier of a frame, moving its image to the present layout. With an
+        // exclusive swapchain shared by two families, it also releases the image to the present
+        // family, and the matching acquire runs on the present queue.
+        void releaseSwapChainImage(vk_barriers::BarrierBatch& barriers, const WindowPresenter& presenter, VkImage image) {
+            const auto [srcQueueFamilyIndex, dstQueueFamilyIndex] = [this, &presenter]() -> std::tuple<uint32_t, uint32_t> {
+                if (presenter.ownershipTransfer) {
+                    return std::make_tuple(m_queueFamilyIndices.graphicsFamily.value(), m_queueFamilyIndices.presentFamily.value());
+                } else {
+                    return std::make_tuple(VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED);
+                }
+            }();
+
+            m_imageLayouts.transition(
+                barriers,
+                image,
+                vk_render_graph::ResourceState { .layout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR },
+                srcQueueFamilyIndex,
+                dstQueueFamilyIndex
+            );
+        }
+
+        // With window compositing, the scene renders once a frame, for the first window, into an
+        // offscreen image every window taking part blits into its swapchain image, the first
+        // one included, stretched to its size. The other windows skip their cull, main and
+        // depth pyramid passes, and show the first window's camera, as picture in picture
+        // views of it. Without a second window taking part, each renders its own scene.
+        std::optional<SharedScene> addSharedScenePasses() {
+            if (!m_windowCompositeRequested || m_presentingWindows.size() < 2 || m_presentingWindows.front().presenterIndex != 0) {
+                return std::nullopt;
+            }
+
+            const auto& presenter = m_presenters[0];
+            const auto compositable = std::count_if(m_presentingWindows.begin(), m_presentingWindows.end(), [this](const PresentingWindow& window) {
+                return m_presenters[window.presenterIndex].compositable;
+            });
+            if (!presenter.compositable || compositable < 2) {
+                return std::nullopt;
+            }
+
+            const auto image = m_renderGraph.createImage(vk_render_graph::TransientImageInfo {
+                .format = presenter.imageFormat,
+                .extent = presenter.extent,
+                .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+            });
+            this->addScenePasses(presenter, image, presenter.extent, presenter.extent, glm::vec2 { 0.0f });
+
+            return SharedScene { image, presenter.extent };
+        }
+
+        bool composites(const WindowPresenter& presenter) const {
+            return m_frameComposited && presenter.compositable;
+        }
+
+        // A window's only pass with window compositing, which blits the shared scene into its
+        // swapchain image, 1:1 into the first window's, and returns the image's resource.
+        vk_render_graph::ResourceId addCompositePass(const WindowPresenter& presenter, uint32_t imageIndex, const SharedScene& scene) {
+            const auto swapChainImage = m_renderGraph.importImage(
+                presenter.images[imageIndex],
+                presenter.imageViews[imageIndex],
+                vk_render_graph::ResourceState { VK_PIPELINE_STAGE_2_BLIT_BIT, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_UNDEFINED }
+            );
+            m_renderGraph.exportResource(swapChainImage);
+
+            const bool sameSize = scene.extent.width == presenter.extent.width && scene.extent.height == presenter.extent.height;
+            m_renderGraph.addPass(
+                "composite",
+                {
+                    vk_render_graph::read(scene.image, VK_PIPELINE_STAGE_2_BLIT_BIT, VK_ACCESS_2_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL),
+                    vk_render_graph::write(swapChainImage, VK_PIPELINE_STAGE_2_BLIT_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL),
+                },
+                [this, &presenter, scene, swapChainImage, sameSize](VkCommandBuffer commandBuffer) {
+                    this->recordUpscale(
+                        commandBuffer,
+                        presenter,
+                        m_renderGraph.image(scene.image),
+                        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                        scene.extent,
+                        m_renderGraph.image(swapChainImage),
+                        sameSize ? VK_FILTER_NEAREST : VK_FILTER_LINEAR
+                    );
+                }
+            );
+
+            return swapChainImage;
+        }
+
+        // Adds a window's passes to the frame's render graph, and returns the resource of its
+        // swapchain image. The acquire semaphore is waited on at the stage of the image's first
+        // use: color attachment output, the blit stage when the frame is scaled, or the compute
+        // stage when post processing writes it as a storage image. A scaled or post processed
+        // frame renders into a transient image, which on the second and later windows reuses
+        // the memory of the first one's. The temporal upscaler first accumulates it into the
+        // window's history, which is then blitted 1:1, or post processed.
+        vk_render_graph::ResourceId addRasterPasses(const WindowPresenter& presenter, uint32_t imageIndex) {
+            const auto acquireStage = [&presenter]() -> VkPipelineStageFlags2 {
+                if (presenter.postStorage) {
+                    return VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+                } else if (presenter.scaledRendering && !presenter.postProcessed) {
+                    return VK_PIPELINE_STAGE_2_BLIT_BIT;
+                }
+
+                return VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+            }();
+            const auto swapChainImage = m_renderGraph.importImage(
+                presenter.images[imageIndex],
+                presenter.imageViews[imageIndex],
+                vk_render_graph::ResourceState { acquireStage, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_UNDEFINED }
+            );
+            m_renderGraph.exportResource(swapChainImage);
+
+            if (!presenter.scaledRendering && !presenter.postProcessed) {
+                this->addScenePasses(presenter, swapChainImage, presenter.extent, presenter.extent, glm::vec2 { 0.0f });
+                return swapChainImage;
+            }
+
+            const bool temporal = presenter.scaledRendering && m_temporalUpscaler.isInitialized();
+            const bool sampled = temporal || presenter.postProcessed;
+            const auto targetSize = presenter.scaledRendering ? this->renderTargetSize(presenter) : presenter.extent;
+            const auto renderTarget = m_renderGraph.createImage(vk_render_graph::TransientImageInfo {
+                .format = this->sceneColorFormat(presenter),
+                .extent = targetSize,
+                .usage = VkImageUsageFlags { VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT } | (sampled ? VK_IMAGE_USAGE_SAMPLED_BIT : VK_IMAGE_USAGE_TRANSFER_SRC_BIT),
+            });
+            const auto renderExtent = presenter.scaledRendering ? this->renderTargetExtent(presenter) : presenter.extent;
+            const auto jitter = temporal ? vk_upscaling::jitter(m_frameCount) : glm::vec2 { 0.0f };
+            this->addScenePasses(presenter, renderTarget, targetSize, renderExtent, jitter);
+            if (!temporal && presenter.postProcessed) {
+                this->addPostProcessPass(presenter, renderTarget, targetSize, renderExtent, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, swapChainImage);
+                return swapChainImage;
+            } else if (!temporal) {
+                m_renderGraph.addPass(
+                    "upscale",
+                    {
+                        vk_render_graph::read(renderTarget, VK_PIPELINE_STAGE_2_BLIT_BIT, VK_ACCESS_2_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL),
+                        vk_render_graph::write(swapChainImage, VK_PIPELINE_STAGE_2_BLIT_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL),
+                    },
+                    [this, &presenter, renderTarget, swapChainImage, renderExtent](VkCommandBuffer commandBuffer) {
+                        this->recordUpscale(
+                            commandBuffer,
+                            presenter,
+                            m_renderGraph.image(renderTarget),
+                            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                            renderExtent,
+                            m_renderGraph.image(swapChainImage),
+                            VK_FILTER_LINEAR
+                        );
+                    }
+                );
+
+                return swapChainImage;
+            }
+
+            const auto history = m_temporalUpscaler.importHistory(
+                m_renderGraph,
+                presenter.index,
+                presenter.extent,
+                m_retiredSwapChains,
+                m_frameCount + m_framesInFlight
+            );
+            auto upscaleAccesses = std::vector<vk_render_graph::ResourceAccess> {
+                vk_render_graph::read(renderTarget, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+            };
+            const auto historyAccesses = vk_upscaling::TemporalUpscaler::historyAccesses(history);
+            upscaleAccesses.insert(upscaleAccesses.end(), historyAccesses.begin(), historyAccesses.end());
+            m_renderGraph.addPass(
+                "temporalUpscale",
+                upscaleAccesses,
+                [this, &presenter, renderTarget, targetSize, renderExtent, jitter](VkCommandBuffer commandBuffer) {
+                    const auto upscaleScope = m_gpuProfiler.beginScope(commandBuffer, "temporalUpscale");
+                    m_temporalUpscaler.record(commandBuffer, presenter.index, m_renderGraph.imageView(renderTarget), targetSize, renderExtent, jitter);
+                    m_gpuProfiler.endScope(commandBuffer, upscaleScope);
+                }
+            );
+            if (presenter.postProcessed) {
+                this->addPostProcessPass(presenter, history.current, presenter.extent, presenter.extent, VK_IMAGE_LAYOUT_GENERAL, swapChainImage);
+                return swapChainImage;
+            }
+
+            m_renderGraph.addPass(
+                "upscale",
+                {
+                    vk_render_graph::read(history.current, VK_PIPELINE_STAGE_2_BLIT_BIT, VK_ACCESS_2_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL),
+                    vk_render_graph::write(swapChainImage, VK_PIPELINE_STAGE_2_BLIT_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL),
+                },
+                [this, &presenter, history, swapChainImage](VkCommandBuffer commandBuffer) {
+                    this->recordUpscale(
+                        commandBuffer,
+                        presenter,
+                        m_renderGraph.image(history.current),
+                        VK_IMAGE_LAYOUT_GENERAL,
+                        presenter.extent,
+                        m_renderGraph.image(swapChainImage),
+                        VK_FILTER_NEAREST
+                    );
+                }
+            );
+
+            return swapChainImage;
+        }
+
+        // Post processes `sourceExtent` of `source` into the whole swapchain image, which
+        // replaces the blit of a scaled frame.
+        void addPostProcessPass(
+            const WindowPresenter& presenter,
+            vk_render_graph::ResourceId source,
+            VkExtent2D sourceSize,
+            VkExtent2D sourceExtent,
+            VkImageLayout sourceLayout,
+            vk_render_graph::ResourceId swapChainImage
+        ) {
+            m_postProcess.addPass(
+                m_renderGraph,
+                source,
+                sourceSize,
+                sourceExtent,
+                sourceLayout,
+                swapChainImage,
+                presenter.imageFormat,
+                presenter.extent,
+                presenter.postStorage,
+                m_frameCount
+            );
+        }
+
+        // The widgets fill rows of cards from the top left of the window, each a card, a bar
+        // track, the bar moving along it, an icon once the atlas has been uploaded, and a label
+        // of its number and how full its bar is, which changes as the bar moves. Cards are the
+        // bottom layer, bars and icons above them and labels on top, so the whole grid takes
+        // three draws for the solid sprites, one for the icons and one for the labels.
+        void addWidgetPass(const WindowPresenter& presenter, vk_render_graph::ResourceId swapChainImage) {
+            constexpr float CARD_WIDTH = 112.0f;
+            constexpr float CARD_HEIGHT = 40.0f;
+            constexpr float GAP = 6.0f;
+            constexpr float ICON = 24.0f;
+            constexpr float LABEL = 8.0f;
+
+            m_spriteBatcher.beginFrame(presenter.extent);
+            // The icons are only drawn while the atlas they sample is alive in the image pool.
+            const bool icons = m_iconTexture.has_value()
+                && m_resources.images.contains(m_iconAtlas)
+                && m_uploadService.isComplete(m_iconAtlasUpload);
+            const auto columns = std::max(1u, static_cast<uint32_t>((static_cast<float>(presenter.extent.width) - GAP) / (CARD_WIDTH + GAP)));
+            const auto time = static_cast<float>(m_frameCount) / 120.0f;
+            for (uint32_t i = 0; i < m_widgetCount; i++) {
+                const auto x = GAP + static_cast<float>(i % columns) * (CARD_WIDTH + GAP);
+                const auto y = GAP + static_cast<float>(i / columns) * (CARD_HEIGHT + GAP);
+                if (y >= static_cast<float>(presenter.extent.height)) {
+                    break;
+                }
+
+                const auto fill = 0.5f + 0.5f * std::sin(time + 0.37f * static_cast<float>(i));
+                const auto color = fill > 0.8f ? vk_overlay::BAD : fill > 0.5f ? vk_overlay::WARNING : vk_overlay::GOOD;
+                const auto trackWidth = CARD_WIDTH - ICON - 3.0f * GAP;
+                const auto track = glm::vec4 { x + ICON + 2.0f * GAP, y + 0.5f * (CARD_HEIGHT - 8.0f), trackWidth, 8.0f };
+                m_spriteBatcher.add(0, vk_sprites::SOLID, glm::vec4 { x, y, CARD_WIDTH, CARD_HEIGHT }, glm::vec4 { 0.0f }, vk_overlay::BACKGROUND);
+                m_spriteBatcher.add(1, vk_sprites::SOLID, track, glm::vec4 { 0.0f }, vk_overlay::rgba(80, 80, 80));
+                m_spriteBatcher.add(2, vk_sprites::SOLID, glm::vec4 { track.x, track.y, track.z * fill, track.w }, glm::vec4 { 0.0f }, color);
+                if (icons) {
+                    const auto iconRect = glm::vec4 { x + GAP, y + 0.5f * (CARD_HEIGHT - ICON), ICON, ICON };
+                    m_spriteBatcher.add(2, m_iconTexture.value(), iconRect, vk_sprites::iconRect(i % vk_sprites::ICON_COUNT), vk_overlay::HEADING);
+                }
+
+                auto label = std::array<char, 12> {};
+                const auto percent = static_cast<uint32_t>(std::lround(fill * 100.0f));
+                const auto formatted = fmt::format_to_n(label.data(), label.size(), "{} {}%", i, percent);
+                const auto length = std::min(formatted.size, label.size());
+                m_textRenderer.draw(m_spriteBatcher, 3, std::string_view { label.data(), length }, glm::vec2 { track.x, y + 0.5f * GAP }, LABEL, vk_overlay::TEXT);
+            }
+
+            m_spriteBatcher.addPass(m_renderGraph, swapChainImage, presenter.imageFormat, presenter.extent, m_frameUploadArena);
+        }
+
+        // The overlay over the first window: the frame time graph, how long the GPU took for the
+        // frame and each of its passes, how busy the queues were, the memory budget, and the
+        // settings its keys change. The frame's own figures are the latest read back, a frame
+        // or two old.
+        void addOverlayPass(const WindowPresenter& presenter, vk_render_graph::ResourceId swapChainImage) {
+            VK_TRACING_ZONE("addOverlayPass");
+            m_overlay.beginFrame();
+            const auto cpuFrame = m_frameTelemetry.recent(vk_profiling::FrameMetric::CpuFrame, 0);
+            m_overlay.print(vk_overlay::HEADING, "Frame {:.2f} ms, {:.0f} fps", cpuFrame, 1000.0 / cpuFrame);
+            m_overlay.graph(OVERLAY_GRAPH_FRAMES, OVERLAY_GRAPH_HEIGHT, OVERLAY_GRAPH_MILLISECONDS, [this](size_t i) {
+                return m_frameTelemetry.recent(vk_profiling::FrameMetric::CpuFrame, OVERLAY_GRAPH_FRAMES - 1 - i);
+            });
+
+            // A queue is busy for as long as its work of a frame takes, out of every frame.
+            const auto busy = [cpuFrame](double milliseconds) {
+                return cpuFrame > 0.0 ? 100.0 * std::min(milliseconds / cpuFrame, 1.0) : 0.0;
+            };
+            if (const auto gpuFrame = m_gpuProfiler.lastMilliseconds("frame"); gpuFrame.has_value()) {
+                m_overlay.print(vk_overlay::TEXT, "GPU {:.2f} ms, graphics queue {:.0f}% busy", gpuFrame.value(), busy(gpuFrame.value()));
+            }
+            if (this->usesAsyncCompute()) {
+                if (const auto asyncFrame = m_asyncComputeProfiler.lastMilliseconds("asyncCompute"); asyncFrame.has_value()) {
+                    m_overlay.print(vk_overlay::TEXT, "Async compute {:.2f} ms, {:.0f}% busy", asyncFrame.value(), busy(asyncFrame.value()));
+                }
+            }
+            m_gpuProfiler.forEachLatest([this](const auto& name, double milliseconds) {
+                if (name != "frame") {
+                    m_overlay.print(vk_overlay::TEXT, "  {:<24}{:>8.2f} ms", name, milliseconds);
+                }
+            });
+
+            if (m_memoryBudget.isEnabled()) {
+                const auto heaps = m_memoryBudget.heaps();
+                for (size_t i = 0; i < heaps.size(); i++) {
+                    const auto& heap = heaps[i];
+                    const auto color = heap.usage > heap.budget
+                        ? vk_overlay::BAD
+                        : heap.usage > heap.budget / 10 * 9 ? vk_overlay::WARNING : vk_overlay::TEXT;
+                    m_overlay.print(color, "Heap {} {} of {} MiB", i, heap.usage / (1024 * 1024), heap.budget / (1024 * 1024));
+                }
+            } else {
+                m_overlay.print(vk_overlay::TEXT, "No memory budget");
+            }
+
+            m_overlay.print(vk_overlay::HEADING, "Present mode {} ({})", presentModePolicyToString(m_presentModePolicy), presentModeToString(presenter.presentMode));
+            if (m_dynamicResolution.isEnabled()) {
+                m_overlay.print(vk_overlay::HEADING, "Render scale {:.3f}, dynamic at {:.3f}", m_renderScale, m_dynamicResolution.scale());
+            } else {
+                m_overlay.print(vk_overlay::HEADING, "Render scale {:.3f}", m_renderScale);
+            }
+            if (m_frameLimiter.isEnabled()) {
+                m_overlay.print(vk_overlay::HEADING, "Frame limit {:.0f} fps", m_frameLimiter.targetFps());
+            } else {
+                m_overlay.print(vk_overlay::HEADING, "Frame limit off");
+            }
+            if (m_indirectRenderer.isInitialized() && m_indirectRenderer.shadowMode() == vk_gpu_driven::ShadowMode::Virtual) {
+                m_overlay.print(
+                    vk_overlay::HEADING,
+                    "Shadow pages resident {} of {}, {} drawn",
+                    m_indirectRenderer.residentPageCount(),
+                    vk_virtual_shadows::PHYSICAL_PAGE_COUNT,
+                    m_indirectRenderer.renderedPageCount()
+                );
+            } else if (m_indirectRenderer.isInitialized() && m_indirectRenderer.usesShadows()) {
+                m_overlay.print(vk_overlay::HEADING, "Shadow cascades drawn {} of {}", m_indirectRenderer.castCascadeCount(), vk_shadows::CASCADE_COUNT);
+            }
+            if (m_thermalGovernor.isEnabled()) {
+                m_overlay.print(vk_overlay::HEADING, "Quality tier {} of {}, throttled {:.2f}x", m_thermalGovernor.tier(), vk_thermal::QUALITY_TIERS.size() - 1, m_thermalGovernor.throttleFactor());
+            }
+            if (m_powerMonitor.isRunning()) {
+                m_overlay.print(vk_overlay::HEADING, "On {}{}", vk_power::describe(m_powerMonitor.state()), m_powerRestoreSettings.has_value() ? ", saving power" : "");
+            }
+            m_overlay.print(vk_overlay::HEADING, "Frames in flight {} of {}", m_frameQueueDepth, m_framesInFlight);
+            m_overlay.print(vk_overlay::TEXT, "P present mode, [ ] scale, - + limit");
+            m_overlay.print(vk_overlay::TEXT, "F frames in flight, F1 hide");
+
+            m_overlay.addPass(m_renderGraph, swapChainImage, presenter.imageFormat, presenter.extent, m_frameUploadArena);
+        }
+
+        // The main pass, and with the GPU driven scene, its cull passes before it and its depth
+        // pyramid and transparent passes after it. `targetSize` is the size of `target`, of
+        // which the frame renders to `renderExtent`, with the scene offset by `jitter` pixels.
+        void addScenePasses(
+            const WindowPresenter& presenter,
+            vk_render_graph::ResourceId target,
+            VkExtent2D targetSize,
+            VkExtent2D renderExtent,
+            glm::vec2 jitter
+        ) {
+            if (!m_indirectRenderer.isInitialized()) {
+                this->addMainPass(presenter, target, targetSize, renderExtent, std::nullopt);
+                return;
+            }
+
+            // Every pipeline the window's scene passes draw with exists before any of them
+            // records, created within the budget of the frame's pipeline creation.
+            {
+                const auto budget = m_frameBudget.begin(vk_frame_budget::Subsystem::PipelineCreation);
+                const auto colorFormat = this->sceneColorFormat(presenter);
+                m_indirectRenderer.prepareDraw(colorFormat, m_retiredSwapChains, m_frameCount + m_framesInFlight);
+                if (m_frameTerrain.has_value()) {
+                    m_terrainRenderer.prepareDraw(colorFormat);
+                }
+                if (m_frameParticles.has_value()) {
+                    m_particleSystem.prepareDraw(colorFormat);
+                }
+            }
+            const auto scene = m_indirectRenderer.addCullPasses(
+                m_renderGraph,
+                m_frameUploadArena,
+                m_retiredSwapChains,
+                m_frameCount + m_framesInFlight,
+                presenter.index,
+                this->sceneColorFormat(presenter),
+                targetSize,
+                presenter.extent,
+                renderExtent,
+                jitter,
+                m_frameCount
+            );
+            this->addMainPass(presenter, target, targetSize, renderExtent, scene);
+            m_indirectRenderer.addDepthPyramidPass(m_renderGraph, scene, presenter.index, renderExtent);
+            if (m_transparencyRenderer.isInitialized()) {
+                const auto transparencyTargets = vk_transparency::WindowTargets {
+                    .target = target,
+                    .depth = scene.depth,
+                    .colorFormat = this->sceneColorFormat(presenter),
+                    .targetSize = targetSize,
+                    .renderExtent = renderExtent,
+                };
+                m_transparencyRenderer.addPasses(m_renderGraph, m_frameTransparency, transparencyTargets, m_indirectRenderer.camera(presenter.index));
+            }
+        }
+
+        // A multisampled scene renders into a transient color image of its own, which only
+        // ever lives in tile memory on a tile based GPU, and is resolved into the target by the
+        // pass itself.
+        void addMainPass(
+            const WindowPresenter& presenter,
+            vk_render_graph::ResourceId target,
+            VkExtent2D targetSize,
+            VkExtent2D renderExtent,
+            const std::optional<vk_gpu_driven::SceneResources>& scene
+        ) {
+            auto accesses = std::vector<vk_render_graph::ResourceAccess> {
+                vk_render_graph::write(target, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL),
+            };
+            auto multisampled = std::optional<vk_render_graph::ResourceId> {};
+            if (scene.has_value() && m_indirectRenderer.isMultisampled()) {
+                multisampled = m_renderGraph.createImage(vk_render_graph::TransientImageInfo {
+                    .format = this->sceneColorFormat(presenter),
+                    .extent = targetSize,
+                    .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+                    .samples = m_indirectRenderer.samples(),
+                });
+                accesses.push_back(vk_render_graph::write(multisampled.value(), VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL));
+            }
+
+            auto depth = std::optional<vk_render_graph::ResourceId> {};
+            auto resolvedDepth = std::optional<vk_render_graph::ResourceId> {};
+            if (scene.has_value()) {
+                const auto sceneAccesses = m_indirectRenderer.mainPassAccesses(scene.value());
+                accesses.insert(accesses.end(), sceneAccesses.begin(), sceneAccesses.end());
+                depth = scene->depth;
+                resolvedDepth = scene->resolvedDepth;
+                if (m_frameParticles.has_value()) {
+                    const auto particleAccesses = m_particleSystem.drawAccesses(m_frameParticles.value());
+                    accesses.insert(accesses.end(), particleAccesses.begin(), particleAccesses.end());
+                }
+                if (m_frameTerrain.has_value()) {
+                    const auto terrainAccesses = m_terrainRenderer.drawAccesses(m_frameTerrain.value());
+                    accesses.insert(accesses.end(), terrainAccesses.begin(), terrainAccesses.end());
+                    if (m_frameTextureFeedback.has_value()) {
+                        accesses.push_back(vk_streaming::TextureStreamer::samplingAccess(m_frameTextureFeedback.value()));
+                    }
+                }
+            }
+
+            auto shadingRates = std::optional<vk_render_graph::ResourceId> {};
+            if (scene.has_value() && m_foveatedShadingRate.isInitialized()) {
+                shadingRates = m_foveatedShadingRate.addPass(m_renderGraph, targetSize, renderExtent);
+                accesses.push_back(vk_shading_rate::FoveatedShadingRate::attachmentAccess(shadingRates.value()));
+            }
+
+            m_renderGraph.addPass(
+                "mainPass",
+                accesses,
+                [this, &presenter, target, multisampled, depth, resolvedDepth, shadingRates, renderExtent](VkCommandBuffer commandBuffer) {
+                    const auto view = [this](const std::optional<vk_render_graph::ResourceId>& resource) {
+                        return resource.has_value() ? m_renderGraph.imageView(resource.value()) : VK_NULL_HANDLE;
+                    };
+                    this->recordMainPass(
+                        commandBuffer,
+                        presenter,
+                        m_renderGraph.imageView(target),
+                        view(multisampled),
+                        view(depth),
+                        view(resolvedDepth),
+                        view(shadingRates),
+                        renderExtent
+                    );
+                }
+            );
+        }
+
+        // Clears `renderExtent` of the target, and draws the frame's work items into it. With a
+        // depth view, the GPU driven scene and its particles are drawn first. With a
+        // `multisampledView`, the pass draws into that, and resolves it into the target, and
+        // its depth into `resolvedDepthView` when the depth pyramid needs it, within the pass,
+        // so the samples are never written out or read back. With a `shadingRateView`, the
+        // scene is shaded at the rates it holds.
+        void recordMainPass(
+            VkCommandBuffer commandBuffer,
+            const WindowPresenter& presenter,
+            VkImageView targetView,
+            VkImageView multisampledView,
+            VkImageView depthView,
+            VkImageView resolvedDepthView,
+            VkImageView shadingRateView,
+            VkExtent2D renderExtent
+        ) {
+            const bool drawsScene = depthView != VK_NULL_HANDLE;
+            const bool multisampled = multisampledView != VK_NULL_HANDLE;
+            const auto colorStoreOp = multisampled ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
+            const auto colorResolveMode = multisampled ? VK_RESOLVE_MODE_AVERAGE_BIT : VK_RESOLVE_MODE_NONE;
+            auto colorAttachment = VkRenderingAttachmentInfo {
+                .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+                .imageView = multisampled ? multisampledView : targetView,
+                .imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                .resolveMode = colorResolveMode,
+                .resolveImageView = multisampled ? targetView : VK_NULL_HANDLE,
+                .resolveImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+                .storeOp = colorStoreOp,
+                .clearValue = VkClearValue {
+                    .color = VkClearColorValue { .float32 = { 0.0f, 0.0f, 0.0f, 1.0f } },
+                },
+            };
+            // The depth is only stored or resolved when the depth pyramid pass reads it after the
+            // pass, so on a tile based GPU it otherwise never leaves tile memory. The transparent
+            // passes test against every sample of it, so they need it stored as it is. After a
+            // depth pre-pass, the pass draws against the depth the pre-pass left.
+            const bool resolvesDepth = multisampled && m_indirectRenderer.readsDepthAfterDraw();
+            const bool storesDepth = (m_indirectRenderer.readsDepthAfterDraw() && !multisampled) || m_transparencyRenderer.isInitialized();
+            const auto depthStoreOp = storesDepth ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            const auto depthResolveMode = resolvesDepth ? m_indirectRenderer.depthResolveMode() : VK_RESOLVE_MODE_NONE;
+            auto depthAttachment = VkRenderingAttachmentInfo {
+                .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+                .imageView = depthView,
+                .imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
+                .resolveMode = depthResolveMode,
+                .resolveImageView = resolvesDepth ? resolvedDepthView : VK_NULL_HANDLE,
+                .resolveImageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
+                .loadOp = m_indirectRenderer.usesDepthPrepass() ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR,
+                .storeOp = depthStoreOp,
+                .clearValue = VkClearValue {
+                    .depthStencil = VkClearDepthStencilValue { vk_gpu_driven::DEPTH_CLEAR_VALUE, 0 },
+                },
+            };
+
+            // Work items are recorded into secondary command buffers by the recording threads
+            // and executed in order. Without any, the clear is all there is to record.
+            const auto colorFormat = this->sceneColorFormat(presenter);
+            const auto inheritanceRenderingInfo = VkCommandBufferInheritanceRenderingInfo {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO,
+                .colorAttachmentCount = 1,
+                .pColorAttachmentFormats = &colorFormat,
+                .depthAttachmentFormat = drawsScene ? m_indirectRenderer.depthFormat() : VK_FORMAT_UNDEFINED,
+                .rasterizationSamples = multisampled ? m_indirectRenderer.samples() : VK_SAMPLE_COUNT_1_BIT,
+            };
+            const auto inheritanceInfo = VkCommandBufferInheritanceInfo {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+                .pNext = &inheritanceRenderingInfo,
+                .pipelineStatistics = m_pipelineStatistics.inheritedStatistics(),
+            };
+            // The scene draw is executed from the command buffer it was last recorded into in
+            // this frame slot, unless anything it was recorded from has changed since. Split
+            // frames and shading rate attachments record it every frame instead.
+            auto sceneCommandBuffer = VkCommandBuffer { VK_NULL_HANDLE };
+            if (drawsScene && m_sceneCommandCache.isInitialized() && shadingRateView == VK_NULL_HANDLE && presenter.deviceRenderAreas.empty()) {
+                auto hasher = vk_pipelines::StateHasher {};
+                hasher.add(m_indirectRenderer.drawHash(presenter.index, colorFormat, renderExtent));
+                hasher.add(inheritanceRenderingInfo.rasterizationSamples);
+                hasher.add(inheritanceInfo.pipelineStatistics);
+                const auto slot = size_t { presenter.index } * m_framesInFlight + m_currentFrame;
+                sceneCommandBuffer = m_sceneCommandCache.get(slot, hasher.value(), inheritanceInfo, [this, &presenter, colorFormat, renderExtent](VkCommandBuffer sceneCommands) {
+                    m_indirectRenderer.recordDraw(sceneCommands, presenter.index, colorFormat, renderExtent);
+                });
+            }
+
+            // With more than one recording thread, the scene, unless it is cached, the terrain
+            // and the particles are the frame's work items, each recorded on a thread of its
+            // own. Their pipelines were created with the window's scene passes. Like the
+            // cache, split frames and shading rate attachments keep the draws on the primary.
+            m_frameWorkItems.clear();
+            const bool recordsInParallel = drawsScene
+                && m_recordingThreadCount > 1
+                && shadingRateView == VK_NULL_HANDLE
+                && presenter.deviceRenderAreas.empty();
+            if (recordsInParallel) {
+                const auto& camera = m_indirectRenderer.camera(presenter.index);
+                if (sceneCommandBuffer == VK_NULL_HANDLE) {
+                    m_frameWorkItems.push_back([this, &presenter, colorFormat, renderExtent](VkCommandBuffer sceneCommands) {
+                        m_indirectRenderer.recordDraw(sceneCommands, presenter.index, colorFormat, renderExtent);
+                    });
+                }
+                if (m_frameTerrain.has_value()) {
+                    m_frameWorkItems.push_back([this, &camera, colorFormat, renderExtent](VkCommandBuffer terrainCommands) {
+                        m_terrainRenderer.recordDraw(terrainCommands, colorFormat, renderExtent, camera);
+                    });
+                }
+                if (m_frameParticles.has_value()) {
+                    m_frameWorkItems.push_back([this, &camera, colorFormat, renderExtent](VkCommandBuffer particleCommands) {
+                        m_particleSystem.recordDraw(particleCommands, m_frameParticles.value(), colorFormat, renderExtent, camera);
+                    });
+                }
+            }
+            auto secondaryCommandBuffers = std::vector<VkCommandBuffer> {};
+            if (!m_frameWorkItems.empty()) {
+                secondaryCommandBuffers = m_commandRecorder.record(m_currentFrame, inheritanceInfo, m_frameWorkItems);
+            }
+
+            // Each device of a split frame only renders its own strip, and the render area is
+            // ignored in favor of the strips.
+            const auto deviceGroupInfo = VkDeviceGroupRenderPassBeginInfo {
+                .sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_RENDER_PASS_BEGIN_INFO,
+                .deviceMask = m_frameDeviceMask,
+                .deviceRenderAreaCount = static_cast<uint32_t>(presenter.deviceRenderAreas.size()),
+                .pDeviceRenderAreas = presenter.deviceRenderAreas.data(),
+            };
+            const void* deviceGroupNext = presenter.deviceRenderAreas.empty() ? nullptr : &deviceGroupInfo;
+            const auto shadingRateAttachment = VkRenderingFragmentShadingRateAttachmentInfoKHR {
+                .sType = VK_STRUCTURE_TYPE_RENDERING_FRAGMENT_SHADING_RATE_ATTACHMENT_INFO_KHR,
+                .pNext = deviceGroupNext,
+                .imageView = shadingRateView,
+                .imageLayout = VK_IMAGE_LAYOUT_FRAGMENT_SHADING_RATE_ATTACHMENT_OPTIMAL_KHR,
+                .shadingRateAttachmentTexelSize = m_foveatedShadingRate.texelSize(),
+            };
+            const bool cachedScene = sceneCommandBuffer != VK_NULL_HANDLE;
+            const bool sceneInWorkItems = recordsInParallel && !cachedScene;
+            const bool executesFirst = cachedScene || sceneInWorkItems || (!drawsScene && !secondaryCommandBuffers.empty());
+            auto renderingInfo = VkRenderingInfo {
+                .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+                .pNext = shadingRateView != VK_NULL_HANDLE ? &shadingRateAttachment : deviceGroupNext,
+                .flags = executesFirst ? VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT : VkRenderingFlags { 0 },
+                .renderArea = VkRect2D {
+                    .offset = VkOffset2D { 0, 0 },
+                    .extent = renderExtent,
+                },
+                .layerCount = 1,
+                .colorAttachmentCount = 1,
+                .pColorAttachments = &colorAttachment,
+                .pDepthAttachment = drawsScene ? &depthAttachment : nullptr,
+            };
+
+            // A render pass continued by secondary command buffers cannot contain any other
+            // command, so the pass is timed from outside, and the terrain and the particles after
+            // a cached scene and the work items after the scene each go into another render pass
+            // that loads what the one before stored. Every render pass but the last stores the
+            // samples and the depth, and leaves the resolves to the last.
+            const bool drawsParticles = drawsScene && m_frameParticles.has_value() && !recordsInParallel;
+            const bool drawsTerrain = drawsScene && m_frameTerrain.has_value() && !recordsInParallel;
+            uint32_t remainingRenderings = 1;
+            if (cachedScene && (drawsParticles || drawsTerrain)) {
+                remainingRenderings++;
+            }
+            if (drawsScene && !sceneInWorkItems && !secondaryCommandBuffers.empty()) {
+                remainingRenderings++;
+            }
+            if (remainingRenderings > 1) {
+                colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+                colorAttachment.resolveMode = VK_RESOLVE_MODE_NONE;
+                depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+                depthAttachment.resolveMode = VK_RESOLVE_MODE_NONE;
+            }
+            const auto nextRendering = [&](VkRenderingFlags flags) {
+                vkCmdEndRendering(commandBuffer);
+                remainingRenderings--;
+                colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+                depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+                if (remainingRenderings == 1) {
+                    colorAttachment.storeOp = colorStoreOp;
+                    colorAttachment.resolveMode = colorResolveMode;
+                    depthAttachment.storeOp = depthStoreOp;
+                    depthAttachment.resolveMode = depthResolveMode;
+                }
+                // The work items' pipelines are not created for a shading rate attachment.
+                renderingInfo.pNext = deviceGroupNext;
+                renderingInfo.flags = flags;
+                vkCmdBeginRendering(commandBuffer, &renderingInfo);
+            };
+
+            const auto mainPassScope = m_gpuProfiler.beginScope(commandBuffer, "mainPass");
+            vkCmdBeginRendering(commandBuffer, &renderingInfo);
+            if (drawsScene) {
+                if (cachedScene) {
+                    vkCmdExecuteCommands(commandBuffer, 1, &sceneCommandBuffer);
+                    if (drawsParticles || drawsTerrain) {
+                        nextRendering(0);
+                    }
+                } else if (!sceneInWorkItems) {
+                    m_indirectRenderer.recordDraw(commandBuffer, presenter.index, colorFormat, renderExtent);
+                }
+                if (drawsTerrain) {
+                    m_terrainRenderer.recordDraw(commandBuffer, colorFormat, renderExtent, m_indirectRenderer.camera(presenter.index));
+                }
+                if (drawsParticles) {
+                    m_particleSystem.recordDraw(commandBuffer, m_frameParticles.value(), colorFormat, renderExtent, m_indirectRenderer.camera(presenter.index));
+                }
+                if (!sceneInWorkItems && !secondaryCommandBuffers.empty()) {
+                    nextRendering(VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT);
+                }
+            }
+
+            if (!secondaryCommandBuffers.empty()) {
+                vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(secondaryCommandBuffers.size()), secondaryCommandBuffers.data());
+            }
+
+            vkCmdEndRendering(commandBuffer);
+            m_gpuProfiler.endScope(commandBuffer, mainPassScope);
+        }
+
+        // Presentation is ordered by the render finished semaphore, so nothing after the
+        // release needs to wait for it. Offscreen images are left ready to be copied out, and
+        // exported ones are released to their consumers, which acquire them after the frame
+        // timeline semaphore. Encoded ones are first converted into the encoder's picture. The
+        // release is left in `barriers`, for the windows' releases to go out together.
+        void releaseRasterImage(
+            VkCommandBuffer commandBuffer,
+            vk_barriers::BarrierBatch& barriers,
+            const WindowPresenter& presenter,
+            uint32_t imageIndex,
+            vk_render_graph::ResourceId swapChainImage
+        ) {
+            const auto image = presenter.images[imageIndex];
+            m_imageLayouts.assume(image, m_renderGraph.finalState(swapChainImage));
+            this->recordReadbacks(commandBuffer, barriers, presenter, imageIndex);
+            if (this->isHeadless()) {
+                if (m_videoEncoder.isInitialized()) {
+                    m_imageLayouts.transition(barriers, image, vk_render_graph::ResourceState {
+                        .stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                        .access = VK_ACCESS_2_SHADER_STORAGE_READ_BIT,
+                        .layout = VK_IMAGE_LAYOUT_GENERAL,
+                    });
+                    barriers.flush(commandBuffer);
+                    m_videoEncoder.recordConversion(commandBuffer, imageIndex, presenter.imageViews[imageIndex]);
+                }
+
+                // Without an exporter, an image the readbacks left in the exported layout needs
+                // no barrier at all.
+                const bool exported = m_frameExporter.isRunning();
+                m_imageLayouts.transition(
+                    barriers,
+                    image,
+                    vk_render_graph::ResourceState { .layout = vk_frame_export::EXPORTED_LAYOUT },
+                    exported ? m_queueFamilyIndices.graphicsFamily.value() : VK_QUEUE_FAMILY_IGNORED,
+                    exported ? VK_QUEUE_FAMILY_EXTERNAL : VK_QUEUE_FAMILY_IGNORED
+                );
+            } else {
+                this->releaseSwapChainImage(barriers, presenter, image);
+            }
+        }
+
+        // Copies the window's finished image into the readback ring for a screenshot or the
+        // frame dump, and leaves it in the transfer source layout for the rest of its release.
+        // Only the first window released takes the screenshot, and a full ring puts it off a
+        // frame. The frame dump only takes the first window presenting, and drops the frame
+        // when the ring is full.
+        void recordReadbacks(VkCommandBuffer commandBuffer, vk_barriers::BarrierBatch& barriers, const WindowPresenter& presenter, uint32_t imageIndex) {
+            const bool dumpFrame = m_frameDumper.isRunning()
+                && &presenter == &m_presenters[m_presentingWindows.front().presenterIndex]
+                && m_frameDumper.wantsFrame(m_frameCount);
+            if (!m_screenshotRequested && !dumpFrame) {
+                return;
+            } else if ((presenter.imageUsage & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) == 0) {
+                if (m_screenshotRequested) {
+                    VK_LOG_WARNING("Screenshot skipped: the images of window {} cannot be copied from", presenter.index);
+                }
+                if (dumpFrame) {
+                    m_frameDumper.drop();
+                }
+                m_screenshotRequested = false;
+                return;
+            }
+
+            // The copy waits for the previous window's release as well.
+            m_imageLayouts.transition(barriers, presenter.images[imageIndex], vk_render_graph::ResourceState {
+                .stages = VK_PIPELINE_STAGE_2_COPY_BIT,
+                .access = VK_ACCESS_2_TRANSFER_READ_BIT,
+                .layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            });
+            barriers.flush(commandBuffer);
+
+            const auto readbackInfo = vk_readback::ImageReadbackInfo {
+                .image = presenter.images[imageIndex],
+                .layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                .extent = presenter.extent,
+                .texelSize = 4,
+            };
+            if (m_screenshotRequested) {
+                auto texels = m_readbackService.readImage(commandBuffer, readbackInfo, m_frameCount + 1);
+                if (texels.has_value()) {
+                    m_pendingScreenshots.push_back(Screenshot {
+                        .path = fmt::format("screenshot-{}.ppm", m_screenshotCount++),
+                        .format = presenter.imageFormat,
+                        .extent = presenter.extent,
+                        .texels = std::move(texels.value()),
+                    });
+                    m_screenshotRequested = false;
+                }
+            }
+            if (dumpFrame) {
+                auto texels = m_readbackService.readImage(commandBuffer, readbackInfo, m_frameCount + 1);
+                if (texels.has_value()) {
+                    m_frameDumper.enqueue(m_frameCount, presenter.imageFormat, presenter.extent, std::move(texels.value()));
+                } else {
+                    m_frameDumper.drop();
+                }
+            }
+        }
+
+        // Writes the screenshots whose frames have finished on the job system, so encoding them
+        // never holds up the frame loop.
+        void writeFinishedScreenshots() {
+            auto finished = std::ranges::partition(m_pendingScreenshots, [](const Screenshot& screenshot) {
+                return screenshot.texels.wait_for(std::chrono::seconds { 0 }) != std::future_status::ready;
+            });
+            for (auto& screenshot : finished) {
+                const auto texels = std::make_shared<std::vector<std::byte>>(screenshot.texels.get());
+                m_jobSystem.submit([path = screenshot.path, format = screenshot.format, extent = screenshot.extent, texels]() {
+                    if (vk_readback::writePortablePixmap(path, format, extent, *texels)) {
+                        VK_LOG_INFO("Screenshot written to {}", path.string());
+                    } else {
+                        VK_LOG_WARNING("Failed to write the screenshot to {}", path.string());
+                    }
+                }, {}, vk_jobs::JobPriority::Background);
+            }
+            m_pendingScreenshots.erase(finished.begin(), finished.end());
+        }
+
+        // Stretch `sourceExtent` of the source, the part of the render target the frame rendered
+        // to or the whole of the temporal upscaler's history, over the whole swapchain image.
+        // The render graph has already moved both images into their layouts for the blit.
+        void recordUpscale(
+            VkCommandBuffer commandBuffer,
+            const WindowPresenter& presenter,
+            VkImage source,
+            VkImageLayout sourceLayout,
+            VkExtent2D sourceExtent,
+            VkImage swapChainImage,
+            VkFilter filter
+        ) {
+            const auto subresource = VkImageSubresourceLayers {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .mipLevel = 0,
+                .baseArrayLayer = 0,
+                .layerCount = 1,
+            };
+            const auto region = VkImageBlit2 {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_BLIT_2,
+                .srcSubresource = subresource,
+                .srcOffsets = {
+                    VkOffset3D { 0, 0, 0 },
+                    VkOffset3D { static_cast<int32_t>(sourceExtent.width), static_cast<int32_t>(sourceExtent.height), 1 },
+                },
+                .dstSubresource = subresource,
+                .dstOffsets = {
+                    VkOffset3D { 0, 0, 0 },
+                    VkOffset3D { static_cast<int32_t>(presenter.extent.width), static_cast<int32_t>(presenter.extent.height), 1 },
+                },
+            };
+            const auto blitInfo = VkBlitImageInfo2 {
+                .sType = VK_STRUCTURE_TYPE_BLIT_IMAGE_INFO_2,
+                .srcImage = source,
+                .srcImageLayout = sourceLayout,
+                .dstImage = swapChainImage,
+                .dstImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                .regionCount = 1,
+                .pRegions = &region,
+                .filter = filter,
+            };
+
+            const auto upscaleScope = m_gpuProfiler.beginScope(commandBuffer, "upscale");
+            vkCmdBlitImage2(commandBuffer, &blitInfo);
+            m_gpuProfiler.endScope(commandBuffer, upscaleScope);
+        }
+
+        // The frame work items draw inside the raster pass, so they are not recorded here.
+        void recordComputePresentPass(VkCommandBuffer commandBuffer, vk_barriers::BarrierBatch& barriers, const WindowPresenter& presenter, uint32_t imageIndex) {
+            // The acquire semaphore is waited on at the compute shader stage on this path.
+            const auto swapChainImage = presenter.images[imageIndex];
+            m_imageLayouts.acquire(swapChainImage, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT);
+            m_imageLayouts.transition(barriers, swapChainImage, vk_render_graph::ResourceState {
+                .stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                .access = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                .layout = VK_IMAGE_LAYOUT_GENERAL,
+            });
+            barriers.flush(commandBuffer);
+
+            const auto pushConstants = vk_compute_present::PushConstants {
+                .color = { 0.0f, 0.0f, 0.0f, 1.0f },
+                .encodeSrgb = vk_compute_present::needsSrgbEncode(presenter.colorSpace) ? 1u : 0u,
+            };
+
+            const auto computePresentScope = m_gpuProfiler.beginScope(commandBuffer, "computePresent");
+            m_computePresentPass.record(commandBuffer, presenter.presentTargets.descriptorSets[imageIndex], presenter.extent, pushConstants);
+            m_gpuProfiler.endScope(commandBuffer, computePresentScope);
+
+            this->releaseSwapChainImage(barriers, presenter, swapChainImage);
+        }
+
+        // One command buffer renders the frame into the image of every window taking part.
+        // Returns whether the frame recorded async compute work, which `submitAsyncCompute`
+        // submits ahead of the graphics work.
+        vk_result::Result<bool> recordCommandBuffer(VkCommandBuffer commandBuffer, const std::optional<vk_upload::UploadSubmission>& uploads) {
+            VK_TRACING_ZONE("recordCommandBuffer");
+            const auto deviceGroupInfo = VkDeviceGroupCommandBufferBeginInfo {
+                .sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_COMMAND_BUFFER_BEGIN_INFO,
+                .deviceMask = m_frameDeviceMask,
+            };
+            const auto beginInfo = VkCommandBufferBeginInfo {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                .pNext = this->usesDeviceGroup() ? &deviceGroupInfo : nullptr,
+                .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+            };
+
+            const auto beginResult = vkBeginCommandBuffer(commandBuffer, &beginInfo);
+            VK_RESULT_TRY(vk_result::check(beginResult, "failed to begin recording command buffer"));
+
+            // The frame in this slot has finished, so its timestamps are ready to read back.
+            m_gpuProfiler.beginFrame(commandBuffer, m_currentFrame);
+            m_pipelineStatistics.beginFrame(commandBuffer, m_currentFrame);
+            m_performanceCounters.beginFrame(m_currentFrame);
+            m_breadcrumbs.beginFrame(m_frameCount);
+            const auto frameScope = m_gpuProfiler.beginScope(commandBuffer, "frame");
+
+            // Take ownership of whatever the transfer queue released to the graphics family.
+            if (uploads.has_value() && (!uploads->bufferAcquireBarriers.empty() || !uploads->imageAcquireBarriers.empty())) {
+                vkCmdPipelineBarrier(
+                    commandBuffer,
+                    VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                    VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                    0,
+                    0, nullptr,
+                    static_cast<uint32_t>(uploads->bufferAcquireBarriers.size()), uploads->bufferAcquireBarriers.data(),
+                    static_cast<uint32_t>(uploads->imageAcquireBarriers.size()), uploads->imageAcquireBarriers.data()
+                );
+            }
+
+            // Compute present windows write their swapchain images directly. The raster windows
+            // go through the render graph, whose images are retired with the swapchains.
+            m_renderGraph.reset();
+            // The particles are simulated before any window's passes, so that nothing on the
+            // graphics queue comes before them and they can move to the async compute queue.
+            m_frameParticles = std::nullopt;
+            if (m_particleSystem.isInitialized()) {
+                m_frameParticles = m_particleSystem.addPasses(m_renderGraph);
+            }
+            // Refitted on the async compute queue as well, before the shadow rays the main
+            // passes trace.
+            if (m_sceneAccelerationStructure.isInitialized()) {
+                m_sceneAccelerationStructure.addPasses(m_renderGraph, m_frameCount);
+                for (const auto& result : m_sceneAccelerationStructure.takePickResults()) {
+                    if (result.instance.has_value()) {
+                        VK_LOG_INFO("Pick {}: instance {} at {}", result.request, result.instance.value(), result.distance);
+                    } else {
+                        VK_LOG_INFO("Pick {}: nothing", result.request);
+                    }
+                }
+            }
+            // The terrain follows the first window's camera, as of its last frame.
+            m_frameTerrain = std::nullopt;
+            m_frameTextureFeedback = std::nullopt;
+            if (m_terrainRenderer.isInitialized()) {
+                m_frameTerrain = m_terrainRenderer.addPasses(m_renderGraph, m_frameUploadArena, m_indirectRenderer.camera(0));
+            }
+            // Last frame's feedback is read back and cleared ahead of the draws writing this one's.
+            if (m_textureStreamer.isInitialized()) {
+                m_frameTextureFeedback = m_textureStreamer.addFeedbackPasses(m_renderGraph, m_readbackService, m_frameCount + 1);
+            }
+            m_frameTransparency = vk_transparency::FrameResources {};
+            if (m_transparencyRenderer.isInitialized()) {
+                m_frameTransparency = m_transparencyRenderer.beginFrame(m_renderGraph);
+            }
+            // The windows' releases, and the barriers around them, go out in as few calls as their
+            // copies and conversions allow.
+            auto barriers = vk_barriers::BarrierBatch { &m_frameArena };
+            auto rasterImages = std::pmr::vector<vk_render_graph::ResourceId>(m_presentingWindows.size(), 0, &m_frameArena);
+            const auto sharedScene = this->addSharedScenePasses();
+            m_frameComposited = sharedScene.has_value();
+            for (size_t i = 0; i < m_presentingWindows.size(); i++) {
+                const auto [presenterIndex, imageIndex] = m_presentingWindows[i];
+                const auto& presenter = m_presenters[presenterIndex];
+                if (presenter.computePresent) {
+                    this->recordComputePresentPass(commandBuffer, barriers, presenter, imageIndex);
+                } else {
+                    rasterImages[i] = this->composites(presenter)
+                        ? this->addCompositePass(presenter, imageIndex, sharedScene.value())
+                        : this->addRasterPasses(presenter, imageIndex);
+                    if (m_spriteBatcher.isInitialized()) {
+                        this->addWidgetPass(presenter, rasterImages[i]);
+                    }
+                    if (presenter.index == 0 && m_overlay.isVisible() && m_deviceGroupMode != vk_device_group::DeviceGroupMode::Sfr) {
+                        this->addOverlayPass(presenter, rasterImages[i]);
+                    }
+                }
+            }
+
+            m_renderGraph.compile(m_retiredSwapChains, m_frameCount + m_framesInFlight);
+            // Every pass has allocated its frame data by now.
+            m_frameUploadArena.recordCopies(commandBuffer);
+            const bool asyncCompute = this->usesAsyncCompute() && m_renderGraph.hasAsyncPasses();
+            if (asyncCompute) {
+                const auto asyncCommandBuffer = m_asyncComputeCommandBuffers[m_currentFrame];
+                const auto asyncScope = this->beginAsyncCompute(asyncCommandBuffer);
+                if (!asyncScope) {
+                    return asyncScope.error();
+                }
+
+                m_renderGraph.execute(commandBuffer, asyncCommandBuffer);
+                VK_RESULT_TRY(this->endAsyncCompute(asyncCommandBuffer, asyncScope.value()));
+            } else {
+                m_renderGraph.execute(commandBuffer);
+            }
+            for (size_t i = 0; i < m_presentingWindows.size(); i++) {
+                const auto [presenterIndex, imageIndex] = m_presentingWindows[i];
+                const auto& presenter = m_presenters[presenterIndex];
+                if (!presenter.computePresent) {
+                    this->releaseRasterImage(commandBuffer, barriers, presenter, imageIndex, rasterImages[i]);
+                }
+            }
+            barriers.flush(commandBuffer);
+
+            m_gpuProfiler.endScope(commandBuffer, frameScope);
+
+            const auto endResult = vkEndCommandBuffer(commandBuffer);
+            VK_RESULT_TRY(vk_result::check(endResult, "failed to record command buffer"));
+
+            return asyncCompute;
+        }
+
+        // The slot's last frame has finished on both queues, so its pool can be reset and its
+        // timestamps read back. When that frame ran async compute as well, the overlap of its
+        // async work with its graphics work goes into the async profiler's statistics.
+        vk_result::Result<std::optional<vk_profiling::GpuScope>> beginAsyncCompute(VkCommandBuffer asyncCommandBuffer) {
+            vkResetCommandPool(m_device, m_asyncComputePools[m_currentFrame], 0);
+            const auto beginInfo = VkCommandBufferBeginInfo {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+            };
+
+            const auto beginResult = vkBeginCommandBuffer(asyncCommandBuffer, &beginInfo);
+            VK_RESULT_TRY(vk_result::check(beginResult, "failed to begin recording async compute command buffer"));
+
+            m_asyncComputeProfiler.beginFrame(asyncCommandBuffer, m_currentFrame);
+            const auto& lastAsyncFrame = m_asyncComputeFrames[m_currentFrame];
+            if (lastAsyncFrame.has_value() && lastAsyncFrame.value() + m_framesInFlight == m_frameCount) {
+                const auto graphicsInterval = m_gpuProfiler.interval("frame");
+                const auto asyncInterval = m_asyncComputeProfiler.interval("asyncCompute");
+                if (graphicsInterval.has_value() && asyncInterval.has_value()) {
+                    m_asyncComputeProfiler.addSample(
+                        "asyncComputeOverlap",
+                        m_asyncComputeProfiler.overlapMilliseconds(graphicsInterval.value(), asyncInterval.value())
+                    );
+                }
+            }
+            m_asyncComputeFrames[m_currentFrame] = m_frameCount;
+
+            return m_asyncComputeProfiler.beginScope(asyncCommandBuffer, "asyncCompute");
+        }
+
+        vk_result::Status endAsyncCompute(VkCommandBuffer asyncCommandBuffer, std::optional<vk_profiling::GpuScope> scope) {
+            m_asyncComputeProfiler.endScope(asyncCommandBuffer, scope);
+
+            const auto endResult = vkEndCommandBuffer(asyncCommandBuffer);
+
+            return vk_result::check(endResult, "failed to record async compute command buffer");
+        }
+
+        // The async work of frame `n` waits for frame `n - 1` to finish on the graphics queue,
+        // which orders it after every use of the resources the queues share in earlier frames.
+        // Waits for the previous frame's graphics work, which the async work's resources are
+        // shared with, and is submitted with the frame.
+        void submitAsyncCompute() {
+            const auto wait = vk_submit::semaphoreInfo(m_frameTimelineSemaphore, m_frameCount, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT);
+            const auto commandBufferInfo = vk_submit::commandBufferInfo(m_asyncComputeCommandBuffers[m_currentFrame]);
+            const auto signal = vk_submit::semaphoreInfo(m_asyncComputeSemaphore, m_frameCount + 1, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT);
+            m_submitBatcher.add(m_computeQueue, vk_submit::Submission {
+                .waits = std::span { &wait, 1 },
+                .commandBuffers = std::span { &commandBufferInfo, 1 },
+                .signals = std::span { &signal, 1 },
+            });
+        }
+
+        // Queue the images of the frame that was just submitted for presentation, every window's
+        // in one `vkQueuePresentKHR`. Called once the frame has been counted, so the frame
+        // timeline already covers it. Windows whose present reports their swapchain out of date
+        // or suboptimal are flagged for recreation, which are expected results rather than errors.
+        vk_result::Status presentFrame(std::chrono::steady_clock::time_point imageAcquiredAt, vk_profiling::FrameSample& sample) {
+            VK_TRACING_ZONE("presentFrame");
+            const auto windowCount = m_presentingWindows.size();
+            auto swapChains = std::pmr::vector<VkSwapchainKHR>(&m_frameArena);
+            auto imageIndices = std::pmr::vector<uint32_t>(&m_frameArena);
+            auto presentWaitSemaphores = std::pmr::vector<VkSemaphore>(&m_frameArena);
+            swapChains.reserve(windowCount);
+            imageIndices.reserve(windowCount);
+            presentWaitSemaphores.reserve(windowCount);
+            for (const auto [presenterIndex, imageIndex] : m_presentingWindows) {
+                const auto& presenter = m_presenters[presenterIndex];
+                swapChains.push_back(presenter.swapChain);
+                imageIndices.push_back(imageIndex);
+                presentWaitSemaphores.push_back(presenter.renderFinishedSemaphores[imageIndex]);
+            }
+
+            VK_RESULT_TRY(this->acquirePresentOwnership(presentWaitSemaphores));
+
+            // Presents are tagged with an id for the present latency monitor, and the first
+            // window is paced to the display's refresh cycle when the display timing extension
+            // is available. Ids only have to increase per swapchain, so every window shares one.
+            const void* presentNext = nullptr;
+            const bool tagPresent = m_presentLatencyMonitor.isEnabled() || m_lowLatencyPacer.usesDriverPacing();
+            const auto presentId = m_framePresentId;
+            const auto presentIds = std::pmr::vector<uint64_t>(windowCount, presentId, &m_frameArena);
+            const auto presentIdInfo = VkPresentIdKHR {
+                .sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR,
+                .swapchainCount = static_cast<uint32_t>(windowCount),
+                .pPresentIds = presentIds.data(),
+            };
+            if (tagPresent) {
+                presentNext = &presentIdInfo;
+            }
+
+            const bool pacedWindowPresenting = m_presentingWindows.front().presenterIndex == 0;
+            const auto presentTime = pacedWindowPresenting
+                ? m_displayTimingPacer.presentTime(static_cast<uint32_t>(presentId))
+                : std::nullopt;
+            auto presentTimes = std::pmr::vector<VkPresentTimeGOOGLE>(&m_frameArena);
+            if (presentTime.has_value()) {
+                // A desired present time of zero leaves the other windows unpaced.
+                presentTimes.resize(windowCount, VkPresentTimeGOOGLE { presentTime->presentID, 0 });
+                presentTimes.front() = presentTime.value();
+            }
+
+            const auto presentTimesInfo = VkPresentTimesInfoGOOGLE {
+                .sType = VK_STRUCTURE_TYPE_PRESENT_TIMES_INFO_GOOGLE,
+                .pNext = presentNext,
+                .swapchainCount = static_cast<uint32_t>(windowCount),
+                .pTimes = presentTimes.empty() ? nullptr : presentTimes.data(),
+            };
+            if (presentTime.has_value()) {
+                presentNext = &presentTimesInfo;
+            }
+
+            // A device group presents from the device whose memory holds the frame, the one
+            // that rendered it for alternate frames and the first one for split frames.
+            const auto presentDeviceMask = 1u << vk_device_group::primaryDeviceIndex(m_frameDeviceMask);
+            const auto deviceGroupInfo = VkDeviceGroupPresentInfoKHR {
+                .sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_PRESENT_INFO_KHR,
+                .pNext = presentNext,
+                .swapchainCount = static_cast<uint32_t>(windowCount),
+                .pDeviceMasks = &presentDeviceMask,
+                .mode = VK_DEVICE_GROUP_PRESENT_MODE_LOCAL_BIT_KHR,
+            };
+            if (this->usesDeviceGroup()) {
+                presentNext = &deviceGroupInfo;
+            }
+
+            // Each image's fence has signaled long before the image comes back from an acquire,
+            // so the wait is only a formality, and the present signals it again. Every present
+            // names its mode, which switches a swapchain the policy moved to another one.
+            auto presentFences = std::pmr::vector<VkFence>(&m_frameArena);
+            auto presentModes = std::pmr::vector<VkPresentModeKHR>(&m_frameArena);
+            if (this->usesSwapchainMaintenance()) {
+                for (const auto [presenterIndex, imageIndex] : m_presentingWindows) {
+                    const auto& presenter = m_presenters[presenterIndex];
+                    presentFences.push_back(presenter.presentFences[imageIndex]);
+                    presentModes.push_back(presenter.presentMode);
+                }
+
+                const auto fenceCount = static_cast<uint32_t>(presentFences.size());
+                const auto waitResult = vkWaitForFences(m_device, fenceCount, presentFences.data(), VK_TRUE, std::numeric_limits<uint64_t>::max());
+                this->reportIfDeviceLost(waitResult);
+                VK_RESULT_TRY(vk_result::check(waitResult, "failed to wait for the previous presents"));
+                VK_RESULT_TRY(vk_result::check(vkResetFences(m_device, fenceCount, presentFences.data()), "failed to reset the present fences"));
+            }
+
+            const auto presentFenceInfo = VkSwapchainPresentFenceInfoEXT {
+                .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_PRESENT_FENCE_INFO_EXT,
+                .pNext = presentNext,
+                .swapchainCount = static_cast<uint32_t>(presentFences.size()),
+                .pFences = presentFences.data(),
+            };
+            const auto presentModeInfo = VkSwapchainPresentModeInfoEXT {
+                .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_PRESENT_MODE_INFO_EXT,
+                .pNext = &presentFenceInfo,
+                .swapchainCount = static_cast<uint32_t>(presentModes.size()),
+                .pPresentModes = presentModes.data(),
+            };
+            if (this->usesSwapchainMaintenance()) {
+                presentNext = &presentModeInfo;
+            }
+
+            auto presentResults = std::pmr::vector<VkResult>(windowCount, VK_SUCCESS, &m_frameArena);
+            const auto presentInfo = VkPresentInfoKHR {
+                .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+                .pNext = presentNext,
+                .waitSemaphoreCount = static_cast<uint32_t>(presentWaitSemaphores.size()),
+                .pWaitSemaphores = presentWaitSemaphores.data(),
+                .swapchainCount = static_cast<uint32_t>(swapChains.size()),
+                .pSwapchains = swapChains.data(),
+                .pImageIndices = imageIndices.data(),
+                .pResults = presentResults.data(),
+            };
+
+            const auto presentStart = std::chrono::steady_clock::now();
+            const auto presentResult = [this, &presentInfo]() {
+                const auto lock = std::scoped_lock { m_presentLatencyMonitor.presentMutex() };
+
+                return vkQueuePresentKHR(m_presentQueue, &presentInfo);
+            }();
+            sample[static_cast<size_t>(vk_profiling::FrameMetric::Present)] = vk_profiling::millisecondsSince(presentStart);
+            if (presentResult != VK_ERROR_OUT_OF_DATE_KHR && presentResult != VK_ERROR_FULL_SCREEN_EXCLUSIVE_MODE_LOST_EXT) {
+                this->reportIfDeviceLost(presentResult);
+                VK_RESULT_TRY(vk_result::check(presentResult, "failed to present swap chain image"));
+            }
+
+            for (size_t i = 0; i < windowCount; i++) {
+                auto& presenter = m_presenters[m_presentingWindows[i].presenterIndex];
+                const auto result = presentResults[i];
+                if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+                    presenter.surfaceSupportOutdated |= result == VK_ERROR_OUT_OF_DATE_KHR;
+                    presenter.swapChainOutdated = true;
+                } else if (result == VK_ERROR_FULL_SCREEN_EXCLUSIVE_MODE_LOST_EXT) {
+                    this->loseFullScreenExclusive(presenter);
+                } else {
+                    this->reportIfDeviceLost(result);
+                    VK_RESULT_TRY(vk_result::check(result, "failed to present swap chain image"));
+                }
+
+                if (tagPresent && result != VK_ERROR_OUT_OF_DATE_KHR) {
+                    m_presentLatencyMonitor.track(presenter.swapChain, presentId, imageAcquiredAt);
+                }
+            }
+
+            return vk_result::Status {};
+        }
+
+        // Acquire an image from every window that can take part in this frame. A minimized
+        // window sits the frame out, and so does one whose swapchain turned out of date, which
+        // is recreated right away. Headless frame slot `i` always renders into offscreen image `i`.
+        vk_result::Status acquireImages() {
+            VK_TRACING_ZONE("acquireImages");
+            m_presentingWindows.clear();
+            if (this->isHeadless()) {
+                m_presentingWindows.push_back(PresentingWindow { 0, m_currentFrame });
+                return vk_result::Status {};
+            }
+
+            for (auto& presenter : m_presenters) {
+                if (this->isMinimized(presenter)) {
+                    continue;
+                }
+
+                if (presenter.exclusivity == vk_fullscreen::Exclusivity::Requested) {
+                    this->acquireFullScreenExclusive(presenter);
+                }
+
+                uint32_t imageIndex = 0;
+                const auto acquireResult = this->acquireNextImage(presenter, imageIndex);
+                if (acquireResult == VK_ERROR_OUT_OF_DATE_KHR) {
+                    presenter.surfaceSupportOutdated = true;
+                    VK_RESULT_TRY(this->recreateSwapChain(presenter));
+                    continue;
+                } else if (acquireResult == VK_ERROR_FULL_SCREEN_EXCLUSIVE_MODE_LOST_EXT) {
+                    this->loseFullScreenExclusive(presenter);
+                    VK_RESULT_TRY(this->recreateSwapChain(presenter));
+                    continue;
+                } else if (acquireResult == VK_TIMEOUT) {
+                    // The semaphore was never handed to the driver, and the frame slot reuses it.
+                    if (m_acquireTimeouts == 1) {
+                        VK_LOG_WARNING("No image of window {} came back within {} ms, it sits out frames while its images are held", presenter.index, m_acquireTimeout.count());
+                    }
+                    continue;
+                }
+
+                this->reportIfDeviceLost(acquireResult);
+                VK_RESULT_TRY(vk_result::check(acquireResult, "failed to acquire swap chain image"));
+                m_presentingWindows.push_back(PresentingWindow { presenter.index, imageIndex });
+            }
+
+            return vk_result::Status {};
+        }
+
+        // Never blocks in the driver for long: an acquire that finds no image ready runs the job
+        // system's queued work on the render thread in between short waits, so present
+        // backpressure overlaps with asset decoding, pipeline compiles and frame dump writes,
+        // and gives up with `VK_TIMEOUT` after `m_acquireTimeout`. A device group acquires the
+        // image for the devices rendering the frame.
+        VkResult acquireNextImage(const WindowPresenter& presenter, uint32_t& imageIndex) {
+            auto acquireInfo = VkAcquireNextImageInfoKHR {
+                .sType = VK_STRUCTURE_TYPE_ACQUIRE_NEXT_IMAGE_INFO_KHR,
+                .swapchain = presenter.swapChain,
+                .timeout = 0,
+                .semaphore = presenter.imageAvailableSemaphores[m_currentFrame],
+                .deviceMask = m_frameDeviceMask,
+            };
+            const auto acquire = [this, &acquireInfo, &imageIndex]() {
+                return this->usesDeviceGroup()
+                    ? vkAcquireNextImage2KHR(m_device, &acquireInfo, &imageIndex)
+                    : vkAcquireNextImageKHR(m_device, acquireInfo.swapchain, acquireInfo.timeout, acquireInfo.semaphore, VK_NULL_HANDLE, &imageIndex);
+            };
+
+            m_acquireCount++;
+            auto result = acquire();
+            if (result != VK_NOT_READY && result != VK_TIMEOUT) {
+                return result;
+            }
+
+            VK_TRACING_ZONE("acquireBlocked");
+            m_acquiresBlocked++;
+            m_metricsServer.countAcquireBlocked();
+            const auto deadline = std::chrono::steady_clock::now() + m_acquireTimeout;
+            while (result == VK_NOT_READY || result == VK_TIMEOUT) {
+                if (std::chrono::steady_clock::now() >= deadline) {
+                    m_acquireTimeouts++;
+                    m_metricsServer.countAcquireTimeout();
+                    return VK_TIMEOUT;
+                }
+
+                const bool ranJob = m_jobSystem.runPendingJob();
+                acquireInfo.timeout = ranJob ? 0 : static_cast<uint64_t>(std::chrono::nanoseconds { ACQUIRE_POLL_INTERVAL }.count());
+                result = acquire();
+            }
+
+            return result;
+        }
+
+        // Take the input queued since the last frame. This runs right before recording, after
+        // the acquire and uploads, so that the frame responds to the latest input it can. The
+        // age of the oldest event is what the frame adds to input latency.
+        void drainInput(vk_profiling::FrameSample& sample) {
+            m_frameInputEvents.clear();
+            while (const auto event = m_inputQueue.pop()) {
+                m_frameInputEvents.push_back(event.value());
+            }
+
+            if (!m_frameInputEvents.empty()) {
+                sample[static_cast<size_t>(vk_profiling::FrameMetric::InputAge)] = vk_profiling::millisecondsSince(m_frameInputEvents.front().timestamp);
+            }
+        }
+
+        // The plus and minus keys raise and lower the frame limit, down to no limit at all, F12
+        // takes a screenshot, and F1 shows and hides the overlay. While it is shown, P cycles the present mode policy,
+        // the bracket keys lower and raise the render scale, and F cycles the frames in flight. The
+        // left mouse button picks the instance under the cursor.
+        void handleInput() {
+            for (const auto& event : m_frameInputEvents) {
+                if (event.type == vk_input::InputEventType::MouseButton && event.code == GLFW_MOUSE_BUTTON_LEFT && event.action == GLFW_PRESS) {
+                    this->pick(event.windowIndex, glm::vec2 { event.x, event.y });
+                    continue;
+                } else if (event.type != vk_input::InputEventType::Key || event.action == GLFW_RELEASE) {
+                    continue;
+                }
+
+                if (this->handleOverlayKey(event.code)) {
+                    continue;
+                } else if (event.code == GLFW_KEY_F12) {
+                    m_screenshotRequested = true;
+                    continue;
+                }
+
+                auto step = 0.0;
+                if (event.code == GLFW_KEY_EQUAL || event.code == GLFW_KEY_KP_ADD) {
+                    step = FRAME_LIMIT_STEP;
+                } else if (event.code == GLFW_KEY_MINUS || event.code == GLFW_KEY_KP_SUBTRACT) {
+                    step = -FRAME_LIMIT_STEP;
+                } else {
+                    continue;
+                }
+
+                this->setFrameLimit(m_frameLimiter.targetFps() + step);
+                if (m_frameLimiter.isEnabled()) {
+                    VK_LOG_INFO("Frame limit: {} fps", m_frameLimiter.targetFps());
+                } else {
+                    VK_LOG_INFO("Frame limit: off");
+                }
+            }
+        }
+
+        // Traces a ray from the window's camera through `position`, a fraction of the window's
+        // size, whose hit `recordCommandBuffer` logs once the GPU has traced it, or through the
+        // scene's BVH right away without ray queries.
+        void pick(uint32_t windowIndex, glm::vec2 position) {
+            if (!m_indirectRenderer.isInitialized()) {
+                return;
+            }
 
-const char* VK_LAYER_KHRONOS_validation = "VK_LAYER_KHRONOS_validation";
-const char* VK_KHR_portability_subset = "VK_KHR_portability_subset";
+            const auto inverseViewProjection = glm::inverse(m_indirectRenderer.camera(windowIndex).viewProjection);
+            const auto unproject = [&inverseViewProjection, position](float depth) {
+                const auto point = inverseViewProjection * glm::vec4 { 2.0f * position - 1.0f, depth, 1.0f };
 
-const std::vector<const char*> VALIDATION_LAYERS = { 
-    VK_LAYER_KHRONOS_validation
-};
+                return glm::vec3 { point } / point.w;
+            };
+            // Depth is reversed, 1 at the near plane, and falls with the inverse of the distance,
+            // to 0 at infinity, so the ray is cut off at the scene's far plane.
+            const auto nearPoint = unproject(1.0f);
+            const auto farPoint = unproject(vk_gpu_driven::NEAR_PLANE / m_indirectRenderer.farPlane());
+            if (m_sceneAccelerationStructure.isInitialized()) {
+                const auto request = m_sceneAccelerationStructure.pick(nearPoint, farPoint - nearPoint, glm::length(farPoint - nearPoint));
+                VK_LOG_DEBUG("Pick {}: window {} at ({}, {})", request, windowIndex, position.x, position.y);
+                return;
+            } else if (!m_sceneBvh.isInitialized()) {
+                return;
+            }
 
-const std::vector<const char*> DEVICE_EXTENSIONS = {
-    VK_KHR_SWAPCHAIN_EXTENSION_NAME
-};
+            // The instances uploaded since the last pick join the tree before it is walked.
+            const auto pickedInstanceCount = m_sceneBvh.instanceCount();
+            const auto uploadedInstanceCount = m_indirectRenderer.uploadedInstanceCount();
+            if (pickedInstanceCount < uploadedInstanceCount) {
+                auto matrices = std::vector<vk_transforms::WorldMatrix>(uploadedInstanceCount - pickedInstanceCount);
+                m_indirectRenderer.composeWorldMatrices(pickedInstanceCount, static_cast<uint32_t>(matrices.size()), matrices.data());
+                m_sceneBvh.setInstances(pickedInstanceCount, matrices);
+            }
+            m_sceneBvh.update();
 
-#ifdef NDEBUG
-const bool ENABLE_VALIDATION_LAYERS = false;
-#else
-const bool ENABLE_VALIDATION_LAYERS = true;
-#endif
+            const auto hit = m_sceneBvh.pick(vk_bvh::Ray { .origin = nearPoint, .direction = farPoint - nearPoint, .maxDistance = 1.0f });
+            if (hit.has_value()) {
+                VK_LOG_INFO("Pick: instance {} at {}", hit->instance, hit->distance * glm::length(farPoint - nearPoint));
+            } else {
+                VK_LOG_INFO("Pick: nothing");
+            }
+        }
 
-const int MAX_FRAMES_IN_FLIGHT = 2;
+        // Every change takes effect through swapchain recreation at the end of the frame, except
+        // for the queue depth, whose swapchains are recreated for their image count.
+        bool handleOverlayKey(int32_t key) {
+            if (key == GLFW_KEY_F1 && m_overlay.isInitialized()) {
+                m_overlay.setVisible(!m_overlay.isVisible());
+                return true;
+            } else if (!m_overlay.isVisible()) {
+                return false;
+            }
 
+            if (key == GLFW_KEY_P) {
+                const auto next = [this]() {
+                    switch (m_presentModePolicy) {
+                        case PresentModePolicy::Latency: return PresentModePolicy::Throughput;
+                        case PresentModePolicy::Throughput: return PresentModePolicy::Power;
+                        case PresentModePolicy::Power: return PresentModePolicy::Latency;
+                    }
 
-namespace vk_platform {
-    enum class Platform {
-        Apple,
-        Linux,
-        Windows,
-        Unknown,
-    };
+                    return DEFAULT_PRESENT_MODE_POLICY;
+                }();
+                this->setPresentModePolicy(next);
+                VK_LOG_INFO("Present mode policy: {}", presentModePolicyToString(next));
+            } else if (key == GLFW_KEY_LEFT_BRACKET || key == GLFW_KEY_RIGHT_BRACKET) {
+                const auto step = key == GLFW_KEY_LEFT_BRACKET ? -RENDER_SCALE_STEP : RENDER_SCALE_STEP;
+                this->setRenderScale(m_renderScale + step);
+            } else if (key == GLFW_KEY_F) {
+                m_frameQueueDepth = m_frameQueueDepth % m_framesInFlight + 1;
+                this->outdateSwapChains();
+                VK_LOG_INFO("Frames in flight: {} of {}", m_frameQueueDepth, m_framesInFlight);
+            } else {
+                return false;
+            }
 
-    constexpr Platform detectOperatingSystem() {
-        #if defined(__APPLE__) || defined(__MACH__)
-        return Platform::Apple;
-        #elif defined(__LINUX__)
-        return Platform::Linux;
-        #elif defined(_WIN32)
-        return Platform::Windows;
-        #else
-        return Platform::Unknown;
-        #endif
-    }
-}
+            return true;
+        }
 
-struct QueueFamilyIndices {
-    std::optional<uint32_t> graphicsFamily;
-    std::optional<uint32_t> presentFamily;
+        // Up to full resolution, and with dynamic resolution, as the scale it starts from and
+        // never goes above.
+        void setRenderScale(double renderScale) {
+            const auto scale = std::clamp(renderScale, MIN_RENDER_SCALE, 1.0);
+            if (scale == m_renderScale) {
+                return;
+            }
 
-    bool isComplete() {
-        return graphicsFamily.has_value() && presentFamily.has_value();
-    }
-};
+            m_renderScale = scale;
+            if (m_dynamicResolution.isEnabled()) {
+                m_dynamicResolution.init(m_dynamicResolution.budgetMilliseconds(), MIN_RENDER_SCALE, scale);
+            }
+            this->outdateSwapChains();
+            VK_LOG_INFO("Render scale: {}", scale);
+        }
 
-struct SwapChainSupportDetails {
-    VkSurfaceCapabilitiesKHR capabilities;
-    std::vector<VkSurfaceFormatKHR> formats;
-    std::vector<VkPresentModeKHR> presentModes;
-};
+        void outdateSwapChains() {
+            for (auto& presenter : m_presenters) {
+                presenter.swapChainOutdated = true;
+            }
+        }
 
+        // Take the framebuffer sizes and iconified states the main thread reported since the
+        // last frame. A window whose size changed is flagged for swapchain recreation, and so
+        // is one that lost exclusive fullscreen and has the focus again, and one that moved to
+        // another monitor or whose monitors changed, whose surface support is refreshed with it.
+        // The frame limit follows the first window's monitor.
+        void takeFramebufferSizes() {
+            for (auto& presenter : m_presenters) {
+                presenter.iconified = m_windowsIconified[presenter.index].load(std::memory_order_acquire);
+                const bool refocused = m_windowsRefocused[presenter.index].exchange(false, std::memory_order_acq_rel);
+                if (refocused && presenter.exclusivity == vk_fullscreen::Exclusivity::Lost) {
+                    presenter.exclusivity = vk_fullscreen::Exclusivity::Requested;
+                    presenter.swapChainOutdated = true;
+                }
+                const auto [width, height] = m_framebufferSizes[presenter.index].load();
+                if (width != presenter.framebufferExtent.width || height != presenter.framebufferExtent.height) {
+                    presenter.framebufferExtent = VkExtent2D { width, height };
+                    presenter.framebufferResized = true;
+                }
+                if (presenter.window != nullptr
+                    && (m_windowMonitors[presenter.index].load(std::memory_order_acquire) != presenter.surfaceMonitor
+                        || vk_fullscreen::monitorGeneration.load(std::memory_order_acquire) != presenter.monitorGeneration)
+                ) {
+                    presenter.swapChainOutdated = true;
+                }
+            }
+            this->followDisplayRefreshRate();
+        }
 
-class App {
-    public:
-        explicit App() = default;
+        // With every window minimized nothing is acquired or submitted, and the thread blocks
+        // until an event arrives, which leaves the GPU to everyone else. The time spent
+        // suspended is not a frame, so the frame timings start over once rendering resumes.
+        void suspendRendering() {
+            m_renderingSuspended = true;
+            m_lastFrameStart.reset();
+            m_frameLimiter.pause();
+            this->waitForEvents();
+        }
 
-        ~App() {
-            this->cleanup();
+        // Some platforms leave the swapchain out of date without saying so while the window
+        // was away, and its surface may have changed size, so every visible window gets a new
+        // one.
+        void resumeRendering() {
+            m_renderingSuspended = false;
+            m_simulationClock.reset();
+            for (auto& presenter : m_presenters) {
+                presenter.swapChainOutdated = true;
+            }
         }
 
-        void run() {
-            this->createGLFWLibrary();
-            this->createWindow();
-            this->initVulkan();
-            this->mainLoop();
+        bool allWindowsMinimized() const {
+            return std::all_of(m_presenters.begin(), m_presenters.end(), [this](const WindowPresenter& presenter) {
+                return this->isMinimized(presenter);
+            });
         }
-    private:
-        GLFWwindow* m_window;
-        VkInstance m_instance;
-        VkDebugUtilsMessengerEXT m_debugMessenger;
-        VkSurfaceKHR m_surface;
-
-        VkPhysicalDevice m_physicalDevice;
-        VkDevice m_device;
-        VkQueue m_graphicsQueue;
-        VkQueue m_presentQueue;
-
-        VkSwapchainKHR m_swapChain;
-        std::vector<VkImage> m_swapChainImages;
-        VkFormat m_swapChainImageFormat;
-        VkExtent2D m_swapChainExtent;
-        std::vector<VkImageView> m_swapChainImageViews;
-        
-        
-        void createGLFWLibrary() {
-            const auto result = glfwInit();
-            if (!result) {
-                glfwTerminate();
 
-                auto errorMessage = std::string { "Failed to initialize GLFW" };
+        // A device group frame has the single window's image, and fans out to the devices
+        // running it and back in before signaling the frame timeline.
+        VkResult submitDeviceGroupFrame(VkCommandBuffer commandBuffer, const std::optional<vk_upload::UploadSubmission>& uploads) {
+            const auto [presenterIndex, imageIndex] = m_presentingWindows.front();
+            const auto& presenter = m_presenters[presenterIndex];
 
-                throw std::runtime_error { errorMessage };
-            }
+            return m_deviceGroupSync.submit(m_graphicsQueue, vk_device_group::FrameSubmitInfo {
+                .commandBuffer = commandBuffer,
+                .deviceMask = m_frameDeviceMask,
+                .imageAvailableSemaphore = presenter.imageAvailableSemaphores[m_currentFrame],
+                .renderFinishedSemaphore = presenter.renderFinishedSemaphores[imageIndex],
+                .uploadSemaphore = uploads.has_value() ? uploads->semaphore : VK_NULL_HANDLE,
+                .uploadValue = uploads.has_value() ? uploads->timelineValue : 0,
+                .frameTimelineSemaphore = m_frameTimelineSemaphore,
+                .frameNumber = m_frameCount,
+            });
         }
 
-        void enumerateExtensions() {
-            uint32_t extensionCount = 0;
-            vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+        // Only the frame before the previous one has to have completed, however many frames
+        // can be in flight, so the GPU never has more than one frame queued, and the pacer
+        // then holds the frame back until it has just enough time to be submitted.
+        vk_result::Status startLowLatencyFrame() {
+            if (m_frameCount >= 2) {
+                const auto retiredFrame = m_frameCount - 2;
+                auto completedValue = uint64_t { 0 };
+                vkGetSemaphoreCounterValue(m_device, m_frameTimelineSemaphore, &completedValue);
+                VK_RESULT_TRY(this->waitForFrame(retiredFrame));
+                m_lowLatencyPacer.frameRetired(std::chrono::steady_clock::now(), completedValue <= retiredFrame);
+            }
 
-            auto extensions = std::vector<VkExtensionProperties> { extensionCount };
-            vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, extensions.data());
+            m_lowLatencyPacer.waitForFrameStart(m_framePresentId);
+
+            return vk_result::Status {};
+        }
+
+        // Extracts the scene's next tick into a frame packet on the job system. The packet's
+        // slot was released by the tick before the one just taken, so this never waits.
+        void simulateNextTick() {
+            m_jobSystem.submit([this]() {
+                auto& packet = m_scenePackets.beginWrite();
+                m_indirectRenderer.extractFramePacket(packet, m_simulationClock.tickSeconds());
+                m_scenePackets.publish();
+            });
+        }
 
-            for (const auto& extension: extensions) {
-                fmt::println("NAME: {} ; VERSION: {}", extension.extensionName, extension.specVersion);
+        // Takes the packets of the ticks due this frame, each simulated while the frame before
+        // it was recorded, and starts simulating the tick after, then has the scene rendered
+        // between the last two. A display faster than the tick rate renders frames with no
+        // tick, and a slow frame runs a few at most. Offline frames have no display rate to
+        // keep up with, so each runs one tick and renders it.
+        void updateSimulation() {
+            const auto ticks = this->isHeadless()
+                ? vk_simulation::FrameTicks { .count = 1, .alpha = 1.0f }
+                : m_simulationClock.advance(vk_simulation::Clock::now());
+            for (uint32_t i = 0; i < ticks.count; i++) {
+                const auto& packet = m_scenePackets.acquire();
+                this->simulateNextTick();
+                m_indirectRenderer.takeFramePacket(packet.contents);
+                m_scenePackets.release();
             }
+
+            m_indirectRenderer.interpolate(ticks.alpha);
         }
 
-        std::vector<const char*> getRequiredExtensions() {
-            uint32_t glfwExtensionCount = 0;
-            const char** glfwExtensions;
-            glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        // Fails with what the driver returned when a frame cannot be rendered at all. An out of
+        // date or suboptimal swapchain is not a failure, only a swapchain to recreate.
+        vk_result::Status drawFrame() {
+            VK_TRACING_ZONE("drawFrame");
+            m_allocationCheck.beginFrame();
+            m_frameArena.reset();
+            m_frameLimiter.wait();
+            const auto frameStart = std::chrono::steady_clock::now();
+            auto sample = vk_profiling::FrameSample {};
+            sample.fill(std::numeric_limits<double>::quiet_NaN());
+            if (m_lastFrameStart.has_value()) {
+                sample[static_cast<size_t>(vk_profiling::FrameMetric::CpuFrame)] = vk_profiling::millisecondsSince(m_lastFrameStart.value());
+            }
 
-            auto requiredExtensions = std::vector<const char*> { glfwExtensions, glfwExtensions + glfwExtensionCount };
-            if (ENABLE_VALIDATION_LAYERS) {
-                requiredExtensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+            m_lastFrameStart = frameStart;
+            m_framePresentId = m_presentLatencyMonitor.isEnabled() ? m_presentLatencyMonitor.nextPresentId() : m_frameCount + 1;
+            if (m_lowLatencyPacer.isEnabled()) {
+                VK_RESULT_TRY(this->startLowLatencyFrame());
+            }
+
+            // Waiting for the frame that last used this frame slot only blocks when the GPU is
+            // more than `m_framesInFlight` frames behind, so the CPU records frame N + 1
+            // while the GPU is still executing frame N. A lower queue depth waits for a later
+            // frame, which has the slot's last frame finished as well.
+            if (m_frameCount >= m_frameQueueDepth) {
+                VK_RESULT_TRY(this->waitForFrame(m_frameCount - m_frameQueueDepth));
+            }
+            m_retiredSwapChains.collect(m_frameCount);
+            this->collectFencedSwapChains();
+            m_frameUploadArena.beginFrame(m_currentFrame);
+            m_frameDescriptors.beginFrame(m_currentFrame);
+            if (m_readbackService.pendingCount() > 0) {
+                auto completedValue = uint64_t { 0 };
+                vkGetSemaphoreCounterValue(m_device, m_frameTimelineSemaphore, &completedValue);
+                m_readbackService.collect(completedValue);
+                this->writeFinishedScreenshots();
+                m_frameDumper.writeFinished(m_jobSystem);
+            }
+            if (m_videoEncoder.isInitialized()) {
+                VK_RESULT_TRY(vk_result::check(m_videoEncoder.collect(m_currentFrame), "failed to collect the encoded frame"));
+            }
+            if (m_memoryBudget.isEnabled()) {
+                m_memoryBudget.query();
+                m_memoryAllocator.setHeapBudgets(m_memoryBudget.heaps());
+                m_metricsServer.publishHeaps(m_memoryBudget.heaps());
+                if (m_textureStreamer.isInitialized()) {
+                    m_textureStreamer.limitBudget(m_memoryBudget.deviceLocalHeadroom());
+                }
+            }
+            if (m_tierPaths.bindless) {
+                m_descriptorHeap.collect(m_frameCount >= m_framesInFlight ? m_frameCount - m_framesInFlight + 1 : 0);
+            }
+            if (m_textureStreamer.isInitialized()) {
+                m_textureStreamer.update(m_frameCount, m_currentFrame, m_uploadService);
             }
 
-            requiredExtensions.emplace_back(VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME);
+            m_frameDeviceMask = this->frameDeviceMask();
+            if (!this->isHeadless()) {
+                this->applyPowerPolicy();
+                this->takeFramebufferSizes();
+                if (this->allWindowsMinimized()) {
+                    this->suspendRendering();
+                    return vk_result::Status {};
+                } else if (m_renderingSuspended) {
+                    this->resumeRendering();
+                }
+            }
 
-            return requiredExtensions;
-        }
+            if (m_replay.has_value()) {
+                this->replayFrame();
+            }
 
-        bool checkValidationLayerSupport() {
-            uint32_t layerCount;
-            vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
+            const auto acquireStart = std::chrono::steady_clock::now();
+            VK_RESULT_TRY(this->acquireImages());
+            if (m_presentingWindows.empty()) {
+                m_frameLimiter.pause();
+                return vk_result::Status {};
+            }
+
+            const auto imageAcquiredAt = std::chrono::steady_clock::now();
+            sample[static_cast<size_t>(vk_profiling::FrameMetric::AcquireWait)] = std::chrono::duration<double, std::milli> { imageAcquiredAt - acquireStart }.count();
+            if (m_captureWriter.isOpen()) {
+                this->captureFrame();
+            }
 
-            std::vector<VkLayerProperties> availableLayers(layerCount);
-            vkEnumerateInstanceLayerProperties(&layerCount, availableLayers.data());
+            // Uploads enqueued since the last frame go out now, and this frame's graphics work
+            // waits for them on the GPU, never on the CPU. The scene streams its instances in
+            // through the same batch, and the widgets' labels the glyphs they asked for, as
+            // much of each as fits in its CPU budget.
+            m_uploadService.collect();
+            if (m_indirectRenderer.isInitialized()) {
+                {
+                    const auto budget = m_frameBudget.begin(vk_frame_budget::Subsystem::Simulation);
+                    this->updateSimulation();
+                }
+                auto budget = m_frameBudget.begin(vk_frame_budget::Subsystem::SceneUploads);
+                m_indirectRenderer.streamUploads(m_uploadService, budget);
+            }
+            if (m_textRenderer.isInitialized()) {
+                auto budget = m_frameBudget.begin(vk_frame_budget::Subsystem::GlyphUploads);
+                m_textRenderer.streamUploads(m_uploadService, budget);
+            }
+            const auto uploads = m_uploadService.submit(m_submitBatcher);
 
-            for (const char* layerName : VALIDATION_LAYERS) {
-                bool layerFound = false;
+            const auto commandBuffer = m_commandBuffers[m_currentFrame];
+            this->resetCommandPools(m_currentFrame);
+            m_commandRecorder.beginFrame(m_currentFrame);
+            if (!this->isHeadless()) {
+                this->drainInput(sample);
+                this->handleInput();
 
-                for (const auto& layerProperties : availableLayers) {
-                    if (strcmp(layerName, layerProperties.layerName) == 0) {
-                        layerFound = true;
-                        break;
-                    }
+                // The last frame time the profiler read back is the newest, and every frame
+                // reads back one more.
+                const auto gpuFrameTime = m_gpuProfiler.lastMilliseconds("frame");
+                if (gpuFrameTime.has_value()) {
+                    m_dynamicResolution.update(gpuFrameTime.value());
+                    this->updateThermalGovernor(gpuFrameTime.value(), sample[static_cast<size_t>(vk_profiling::FrameMetric::CpuFrame)]);
                 }
+                m_lowLatencyPacer.mark(m_framePresentId, VK_LATENCY_MARKER_INPUT_SAMPLE_NV);
+            }
 
-                if (!layerFound) {
-                    return false;
+            const auto recorded = this->recordCommandBuffer(commandBuffer, uploads);
+            if (!recorded) {
+                return recorded.error();
+            }
+
+            const bool asyncCompute = recorded.value();
+            m_lowLatencyPacer.mark(m_framePresentId, VK_LATENCY_MARKER_SIMULATION_END_NV);
+
+            // The frame waits for the image of every window taking part and signals each of
+            // their render finished semaphores. Headless frames have no image to wait for and
+            // nothing to present, so they only wait for uploads and signal the frame timeline.
+            // Values paired with the binary semaphores are ignored.
+            auto waits = std::pmr::vector<VkSemaphoreSubmitInfo>(&m_frameArena);
+            auto signals = std::pmr::vector<VkSemaphoreSubmitInfo>(&m_frameArena);
+            signals.push_back(vk_submit::semaphoreInfo(m_frameTimelineSemaphore, m_frameCount + 1, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT));
+            if (!this->isHeadless()) {
+                for (const auto [presenterIndex, imageIndex] : m_presentingWindows) {
+                    const auto& presenter = m_presenters[presenterIndex];
+                    const auto imageAvailableStage = [this, &presenter]() -> VkPipelineStageFlags2 {
+                        if (presenter.computePresent || presenter.postStorage) {
+                            return VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+                        } else if (this->composites(presenter) || (presenter.scaledRendering && !presenter.postProcessed)) {
+                            return VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT;
+                        }
+
+                        return VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+                    }();
+                    waits.push_back(vk_submit::semaphoreInfo(presenter.imageAvailableSemaphores[m_currentFrame], 0, imageAvailableStage));
+                    signals.push_back(vk_submit::semaphoreInfo(presenter.renderFinishedSemaphores[imageIndex], 0, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT));
                 }
             }
 
-            return true;
+            // The scene's cull pass reads uploaded instances from a compute shader.
+            if (uploads.has_value()) {
+                waits.push_back(vk_submit::semaphoreInfo(
+                    uploads->semaphore,
+                    uploads->timelineValue,
+                    VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT
+                ));
+            }
+
+            // Graphics work that does not use the async results runs alongside them.
+            if (asyncCompute) {
+                this->submitAsyncCompute();
+                const auto asyncWaitStages = m_renderGraph.asyncWaitStages();
+                const auto asyncWaitStage = asyncWaitStages == VK_PIPELINE_STAGE_2_NONE ? VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT : asyncWaitStages;
+                waits.push_back(vk_submit::semaphoreInfo(m_asyncComputeSemaphore, m_frameCount + 1, asyncWaitStage));
+            }
+
+            // Tells the driver's pacing which present the submission belongs to.
+            const auto latencySubmissionInfo = VkLatencySubmissionPresentIdNV {
+                .sType = VK_STRUCTURE_TYPE_LATENCY_SUBMISSION_PRESENT_ID_NV,
+                .presentID = m_framePresentId,
+            };
+            const auto commandBufferInfo = vk_submit::commandBufferInfo(commandBuffer);
+            // A device group frame is split across the devices by its own submission, which
+            // goes after the rest of the batch.
+            if (!this->usesDeviceGroup()) {
+                m_submitBatcher.add(m_graphicsQueue, vk_submit::Submission {
+                    .waits = waits,
+                    .commandBuffers = std::span { &commandBufferInfo, 1 },
+                    .signals = signals,
+                    .next = m_lowLatencyPacer.usesDriverPacing() ? &latencySubmissionInfo : nullptr,
+                });
+            }
+
+            // The encode waits for the frame on the timeline, so it goes in the same batch.
+            if (m_videoEncoder.isInitialized()) {
+                const auto encodeResult = m_videoEncoder.submit(m_currentFrame, m_frameCount, m_frameTimelineSemaphore, m_submitBatcher);
+                this->reportIfDeviceLost(encodeResult);
+                VK_RESULT_TRY(vk_result::check(encodeResult, "failed to record the video encode command buffer"));
+            }
+
+            // The slot's last frame was read back while this one was recorded.
+            const auto gpuFrame = m_gpuProfiler.hostInterval("frame", m_clockCalibration);
+            if (const auto lastSubmit = m_frameSubmitTimes[m_currentFrame]; gpuFrame.has_value() && lastSubmit.has_value()) {
+                sample[static_cast<size_t>(vk_profiling::FrameMetric::GpuStart)] = std::chrono::duration<double, std::milli> { gpuFrame->begin - lastSubmit.value() }.count();
+            }
+            if (m_clockCalibration.recalibrate(std::chrono::steady_clock::now())) {
+                m_gpuProfiler.syncTimeline(m_clockCalibration);
+                m_asyncComputeProfiler.syncTimeline(m_clockCalibration);
+            }
+
+            const auto submitStart = std::chrono::steady_clock::now();
+            m_frameSubmitTimes[m_currentFrame] = submitStart;
+            m_lowLatencyPacer.mark(m_framePresentId, VK_LATENCY_MARKER_RENDERSUBMIT_START_NV);
+            const auto submitResult = [&]() {
+                VK_TRACING_ZONE("submit");
+
+                const auto batchResult = m_submitBatcher.flush();
+                if (batchResult != VK_SUCCESS || !this->usesDeviceGroup()) {
+                    return batchResult;
+                }
+
+                return this->submitDeviceGroupFrame(commandBuffer, uploads);
+            }();
+            sample[static_cast<size_t>(vk_profiling::FrameMetric::Submit)] = vk_profiling::millisecondsSince(submitStart);
+            this->reportIfDeviceLost(submitResult);
+            VK_RESULT_TRY(vk_result::check(submitResult, "failed to submit draw command buffer"));
+
+            m_lowLatencyPacer.mark(m_framePresentId, VK_LATENCY_MARKER_RENDERSUBMIT_END_NV);
+            if (m_lowLatencyPacer.isEnabled()) {
+                m_lowLatencyPacer.frameSubmitted(std::chrono::steady_clock::now(), m_gpuProfiler.lastMilliseconds("frame"));
+            }
+
+            m_frameExporter.publish(m_frameCount, m_currentFrame);
+            m_currentFrame = (m_currentFrame + 1) % m_framesInFlight;
+            m_frameCount++;
+
+            if (!this->isHeadless()) {
+                m_lowLatencyPacer.mark(m_framePresentId, VK_LATENCY_MARKER_PRESENT_START_NV);
+                VK_RESULT_TRY(this->presentFrame(imageAcquiredAt, sample));
+                m_lowLatencyPacer.mark(m_framePresentId, VK_LATENCY_MARKER_PRESENT_END_NV);
+            }
+
+            m_startupProfiler.markFirstPresent();
+
+            // GPU timings lag behind by `m_framesInFlight` frames, since a frame's
+            // timestamps are only read back once its slot is reused.
+            const auto gpuFrameTime = m_gpuProfiler.lastMilliseconds("frame");
+            if (gpuFrameTime.has_value()) {
+                sample[static_cast<size_t>(vk_profiling::FrameMetric::Gpu)] = gpuFrameTime.value();
+            }
+
+            m_frameTelemetry.record(sample);
+            if (m_benchmarkSettings.has_value()) {
+                m_benchmark.record(sample);
+            }
+
+            if (!this->isHeadless()) {
+                VK_RESULT_TRY(this->recreateOutdatedSwapChains());
+            }
+
+            m_allocationCheck.endFrame();
+            VK_TRACING_FRAME();
+
+            return vk_result::Status {};
         }
 
-        static VkResult CreateDebugUtilsMessengerEXT(
-            VkInstance instance,
-            const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo,
-            const VkAllocationCallbacks* pAllocator,
-            VkDebugUtilsMessengerEXT* pDebugMessenger
-        ) {
-            auto func = (PFN_vkCreateDebugUtilsMessengerEXT) vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
-            if (func != nullptr) {
-                return func(instance, pCreateInfo, pAllocator, pDebugMessenger);
-            } else {
-                return VK_ERROR_EXTENSION_NOT_PRESENT;
+        void createWindows() {
+            glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+            glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
+            // Windows keep their physical size on high density monitors, and their framebuffers
+            // have every pixel of it, where the platform lets the application choose.
+            glfwWindowHint(GLFW_SCALE_TO_MONITOR, GLFW_TRUE);
+            glfwWindowHint(GLFW_SCALE_FRAMEBUFFER, GLFW_TRUE);
+            // Shown by `presentFirstFrames`, once there is an image to show.
+            glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+            m_presenters.reserve(m_windowCount);
+            m_frameInputEvents.reserve(INPUT_QUEUE_CAPACITY);
+            for (uint32_t i = 0; i < m_windowCount; i++) {
+                const auto title = i == 0 ? std::string { "Hello, Window!" } : fmt::format("Hello, Window! ({})", i + 1);
+                auto* monitor = i == 0 ? this->selectFullscreenMonitor() : nullptr;
+                auto windowSize = m_windowSize;
+                if (monitor != nullptr) {
+                    // The monitor's current mode, so going fullscreen changes no display mode.
+                    const auto* videoMode = glfwGetVideoMode(monitor);
+                    glfwWindowHint(GLFW_REFRESH_RATE, videoMode->refreshRate);
+                    windowSize = VkExtent2D { static_cast<uint32_t>(videoMode->width), static_cast<uint32_t>(videoMode->height) };
+                }
+
+                auto window = glfwCreateWindow(static_cast<int>(windowSize.width), static_cast<int>(windowSize.height), title.c_str(), monitor, nullptr);
+                if (window == nullptr) {
+                    throw std::runtime_error("failed to create window!");
+                }
+
+                glfwSetWindowUserPointer(window, this);
+                glfwSetKeyCallback(window, App::keyCallback);
+                glfwSetCursorPosCallback(window, App::cursorPosCallback);
+                glfwSetMouseButtonCallback(window, App::mouseButtonCallback);
+                glfwSetScrollCallback(window, App::scrollCallback);
+                glfwSetFramebufferSizeCallback(window, App::framebufferSizeCallback);
+                glfwSetWindowRefreshCallback(window, App::windowRefreshCallback);
+                glfwSetWindowIconifyCallback(window, App::windowIconifyCallback);
+                glfwSetWindowFocusCallback(window, App::windowFocusCallback);
+                glfwSetWindowContentScaleCallback(window, App::windowContentScaleCallback);
+                glfwSetWindowPosCallback(window, App::windowPosCallback);
+                this->trackWindowMonitor(i, window);
+
+                int width = 0;
+                int height = 0;
+                glfwGetFramebufferSize(window, &width, &height);
+                m_framebufferSizes[i].store(width, height);
+
+                auto& presenter = m_presenters.emplace_back();
+                presenter.index = i;
+                presenter.window = window;
+                presenter.monitor = monitor;
+                presenter.framebufferExtent = VkExtent2D { static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
             }
         }
 
-        static void DestroyDebugUtilsMessengerEXT(
-            VkInstance instance,
-            VkDebugUtilsMessengerEXT debugMessenger,
-            const VkAllocationCallbacks* pAllocator
-        ) {
-            auto func = (PFN_vkDestroyDebugUtilsMessengerEXT) vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT");
-            if (func != nullptr) {
-                func(instance, debugMessenger, pAllocator);
+        GLFWmonitor* selectFullscreenMonitor() const {
+            if (!m_fullscreenMonitor.has_value()) {
+                return nullptr;
+            }
+
+            auto* monitor = vk_fullscreen::findMonitor(m_fullscreenMonitor.value());
+            if (monitor == nullptr) {
+                VK_LOG_WARNING("No monitor {} to go fullscreen on, opening a window", m_fullscreenMonitor.value());
             }
+
+            return monitor;
         }
 
-        static const std::string& messageSeverityToString(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity) {
-            static const std::string MESSAGE_SEVERITY_INFO  = std::string { "INFO " };
-            static const std::string MESSAGE_SEVERITY_WARN  = std::string { "WARN " };
-            static const std::string MESSAGE_SEVERITY_ERROR = std::string { "ERROR" };
+        bool isAnyWindowClosing() const {
+            return std::any_of(m_presenters.begin(), m_presenters.end(), [](const WindowPresenter& presenter) {
+                return presenter.window != nullptr && glfwWindowShouldClose(presenter.window);
+            });
+        }
 
-            if (messageSeverity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT) {
-                return MESSAGE_SEVERITY_ERROR;
-            } else if (messageSeverity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT) {
-                return MESSAGE_SEVERITY_WARN;
-            } else {
-                return MESSAGE_SEVERITY_INFO;
+        static App* appFromWindow(GLFWwindow* window) {
+            return reinterpret_cast<App*>(glfwGetWindowUserPointer(window));
+        }
+
+        // The windows never change once created, so any thread can look them up.
+        uint32_t presenterIndex(GLFWwindow* window) const {
+            for (const auto& presenter : m_presenters) {
+                if (presenter.window == window) {
+                    return presenter.index;
+                }
             }
+
+            return 0;
         }
 
-        static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
-            VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
-            VkDebugUtilsMessageTypeFlagsEXT messageType,
-            const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData,
-            void* pUserData
-        ) {
-            auto messageSeverityString = App::messageSeverityToString(messageSeverity);
-            fmt::println(std::cerr, "[{}] {}", messageSeverityString, pCallbackData->pMessage);
+        // Wakes the render thread, or the main loop, up for another frame.
+        void signalFrameRequest() {
+            m_frameRequested.store(true, std::memory_order_release);
+            m_frameRequested.notify_one();
+        }
 
-            return VK_FALSE;
+        // Park until an event arrives. Only the main thread can wait on GLFW, so a render
+        // thread waits for the frame request the event callbacks raise instead.
+        void waitForEvents() {
+            if (!m_renderThreadEnabled) {
+                glfwWaitEvents();
+                return;
+            }
+
+            // A resize or iconify reported after this frame took the sizes has already raised its
+            // request.
+            m_frameRequested.store(false, std::memory_order_release);
+            const bool changed = std::any_of(m_presenters.begin(), m_presenters.end(), [this](const WindowPresenter& presenter) {
+                const auto [width, height] = m_framebufferSizes[presenter.index].load();
+
+                return width != presenter.framebufferExtent.width
+                    || height != presenter.framebufferExtent.height
+                    || m_windowsIconified[presenter.index].load(std::memory_order_acquire) != presenter.iconified;
+            });
+            if (!changed) {
+                m_frameRequested.wait(false, std::memory_order_acquire);
+            }
         }
 
-        VkDebugUtilsMessengerCreateInfoEXT createDebugMessengerCreateInfo() {
-            if (ENABLE_VALIDATION_LAYERS) {
-                return VkDebugUtilsMessengerCreateInfoEXT {
-                    .sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT,
-                    .messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | 
-                        VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | 
-                        VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT,
-                    .messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | 
-                        VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | 
-                        VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT,
-                    .pfnUserCallback = debugCallback,
-                };
+        // Stamped as the callback runs, which is as close to the OS event as GLFW gets.
+        void pushInput(vk_input::InputEvent event) {
+            event.timestamp = std::chrono::steady_clock::now();
+            m_inputQueue.push(event);
+            this->signalFrameRequest();
+        }
+
+        // Any input or change to the window contents is a reason to render another frame
+        // in the on-demand render mode. These callbacks run on the main thread from inside
+        // `glfwPollEvents` or `glfwWaitEventsTimeout`, and only hand their arguments over to
+        // the renderer.
+        static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+            auto app = App::appFromWindow(window);
+            app->pushInput(vk_input::InputEvent {
+                .type = vk_input::InputEventType::Key,
+                .windowIndex = app->presenterIndex(window),
+                .code = key,
+                .scancode = scancode,
+                .action = action,
+                .mods = mods,
+            });
+        }
+
+        static void cursorPosCallback(GLFWwindow* window, double x, double y) {
+            auto app = App::appFromWindow(window);
+            app->pushInput(vk_input::InputEvent {
+                .type = vk_input::InputEventType::CursorPosition,
+                .windowIndex = app->presenterIndex(window),
+                .x = x,
+                .y = y,
+            });
+        }
+
+        // Where the cursor was, as a fraction of the window's size, which picking looks through.
+        static void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods) {
+            auto app = App::appFromWindow(window);
+            auto x = 0.0;
+            auto y = 0.0;
+            glfwGetCursorPos(window, &x, &y);
+            auto width = 0;
+            auto height = 0;
+            glfwGetWindowSize(window, &width, &height);
+            app->pushInput(vk_input::InputEvent {
+                .type = vk_input::InputEventType::MouseButton,
+                .windowIndex = app->presenterIndex(window),
+                .code = button,
+                .action = action,
+                .mods = mods,
+                .x = x / std::max(width, 1),
+                .y = y / std::max(height, 1),
+            });
+        }
+
+        static void scrollCallback(GLFWwindow* window, double xOffset, double yOffset) {
+            auto app = App::appFromWindow(window);
+            app->pushInput(vk_input::InputEvent {
+                .type = vk_input::InputEventType::Scroll,
+                .windowIndex = app->presenterIndex(window),
+                .x = xOffset,
+                .y = yOffset,
+            });
+        }
+
+        // The renderer picks the new size up at the start of its next frame.
+        static void framebufferSizeCallback(GLFWwindow* window, int width, int height) {
+            auto app = App::appFromWindow(window);
+            app->m_framebufferSizes[app->presenterIndex(window)].store(width, height);
+            app->signalFrameRequest();
+        }
+
+        static void windowRefreshCallback(GLFWwindow* window) {
+            App::appFromWindow(window)->signalFrameRequest();
+        }
+
+        static void windowIconifyCallback(GLFWwindow* window, int iconified) {
+            auto app = App::appFromWindow(window);
+            app->m_windowsIconified[app->presenterIndex(window)].store(iconified == GLFW_TRUE, std::memory_order_release);
+            app->signalFrameRequest();
+        }
+
+        // A window moved to a monitor with another content scale gets a framebuffer of another
+        // size. Some platforms report the scale before the size, so the size is read again
+        // here rather than waiting for the framebuffer size callback.
+        static void windowContentScaleCallback(GLFWwindow* window, float xScale, float yScale) {
+            auto app = App::appFromWindow(window);
+            int width = 0;
+            int height = 0;
+            glfwGetFramebufferSize(window, &width, &height);
+            app->m_framebufferSizes[app->presenterIndex(window)].store(width, height);
+            app->trackWindowMonitor(app->presenterIndex(window), window);
+            app->signalFrameRequest();
+        }
+
+        // A window dragged onto another monitor gets a swapchain for that monitor's support
+        // with the next frame.
+        static void windowPosCallback(GLFWwindow* window, [[maybe_unused]] int x, [[maybe_unused]] int y) {
+            auto app = App::appFromWindow(window);
+            if (app->trackWindowMonitor(app->presenterIndex(window), window)) {
+                app->signalFrameRequest();
             }
+        }
 
-            return VkDebugUtilsMessengerCreateInfoEXT {};
+        // Publishes the monitor `window` is on, and its refresh rate, to the render thread.
+        // Returns whether the window is on another monitor than before.
+        bool trackWindowMonitor(size_t index, GLFWwindow* window) {
+            const auto monitor = vk_fullscreen::windowMonitor(window);
+            m_windowRefreshRates[index].store(vk_fullscreen::refreshRate(monitor), std::memory_order_release);
+
+            return m_windowMonitors[index].exchange(monitor, std::memory_order_acq_rel) != monitor;
         }
 
-        void createInstance() {
-            if (ENABLE_VALIDATION_LAYERS && !this->checkValidationLayerSupport()) {
-                throw std::runtime_error("validation layers requested, but not available!");
+        // An unfocused window can still be in full view, so losing focus suspends nothing, but
+        // a window brought back to the front repaints right away in the on-demand render mode,
+        // and asks for exclusive fullscreen again if it lost it.
+        static void windowFocusCallback(GLFWwindow* window, int focused) {
+            if (focused == GLFW_TRUE) {
+                auto app = App::appFromWindow(window);
+                app->m_windowsRefocused[app->presenterIndex(window)].store(true, std::memory_order_release);
+                app->signalFrameRequest();
             }
+        }
 
-            const auto appInfo = VkApplicationInfo {
-                .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
-                .pApplicationName = "Hello Window",
-                .applicationVersion = VK_MAKE_VERSION(1, 0, 0),
-                .pEngineName = "No Engine",
-                .engineVersion = VK_MAKE_VERSION(1, 0, 0),
-                .apiVersion = VK_API_VERSION_1_3,
-            };
-            
-            const auto requiredExtensions = this->getRequiredExtensions();
-            const auto flags = (VkInstanceCreateFlags {}) | VK_INSTANCE_CREATE_ENUMERATE_PORTABILITY_BIT_KHR;
-            
-            const auto debugCreateInfo = this->createDebugMessengerCreateInfo();
-            const auto debugCreateInfoPtr = [&debugCreateInfo]() -> const VkDebugUtilsMessengerCreateInfoEXT* {
-                if (ENABLE_VALIDATION_LAYERS) {
-                    return &debugCreateInfo;
-                } else {
-                    return static_cast<VkDebugUtilsMessengerCreateInfoEXT*>(nullptr);
-                }
-            }();
+        // Leave a core for the main thread, which records and submits frames, unless told
+        // how many workers to start. On hybrid and multi socket systems, as many workers as
+        // there are efficiency cores, or cores off the first node, only run background jobs.
+        void startJobSystem() {
+            const auto hardwareThreads = std::thread::hardware_concurrency();
+            const auto workerCount = m_jobThreadCount.value_or(hardwareThreads > 1 ? hardwareThreads - 1 : 1);
+            if (m_threadPlacementRequested) {
+                m_cpuTopology = vk_topology::detect();
+            }
+            m_jobSystem.start(workerCount, vk_topology::backgroundWorkerCount(m_cpuTopology, workerCount));
+            if (const auto frameDump = frameDumpFromEnvironment(); frameDump.has_value()) {
+                m_frameDumper.start(frameDump.value());
+            }
+        }
 
-            const auto enabledLayerNames = []() -> std::vector<const char*> {
-                if (ENABLE_VALIDATION_LAYERS) {
-                    return VALIDATION_LAYERS;
-                } else {
-                    return std::vector<const char*> {};
+        // Pins the main and render threads and the normal workers to the performance cores of
+        // the GPU's NUMA node, and the background workers and the log writer to the rest,
+        // once the GPU is known. Device creation may still fall back to another GPU, which is
+        // left with the placement of the first.
+        void placeThreads() {
+            if (m_cpuTopology.cpus.empty()) {
+                return;
+            }
+
+            const auto gpuNode = vk_topology::gpuNumaNode(m_physicalDevice, m_physicalDeviceInfo.extensions);
+            m_threadPlacement = vk_topology::placeThreads(m_cpuTopology, gpuNode);
+            const auto pinnedWorkers = m_jobSystem.pinWorkers(m_threadPlacement.latencyCpus, m_threadPlacement.backgroundCpus);
+            vk_topology::pinCurrentThread(m_threadPlacement.latencyCpus);
+            vk_log::logger().pinWriter(m_threadPlacement.backgroundCpus);
+
+            VK_LOG_INFO(
+                "CPU topology: {} logical processors, {} efficiency, {} NUMA nodes, GPU on {}; {} of {} workers pinned, {} for background jobs",
+                m_cpuTopology.cpus.size(),
+                m_cpuTopology.efficiencyCount(),
+                m_cpuTopology.numaNodeCount(),
+                gpuNode.has_value() ? fmt::format("node {}", gpuNode.value()) : std::string { "an unknown node" },
+                pinnedWorkers,
+                m_jobSystem.workerCount(),
+                m_jobSystem.backgroundWorkerCount()
+            );
+        }
+
+        // Loader and driver discovery in `vkCreateInstance` and window creation do not depend
+        // on each other, so the instance is created on a worker while the main thread, the
+        // only one GLFW lets create windows, creates the window. Only GLFW's list of required
+        // instance extensions has to be ready first. Both are joined before the surfaces are
+        // created from them.
+        vk_result::Status initInstanceAndWindow() {
+            if (this->usesWindowSystem()) {
+                m_startupProfiler.measure("createGLFWLibrary", [this]() { this->createGLFWLibrary(); });
+            }
+
+            auto instanceStatus = vk_result::Status {};
+            auto startup = vk_jobs::TaskGroup { m_jobSystem };
+            startup.run([this, &instanceStatus]() {
+                instanceStatus = m_startupProfiler.measure("createInstance", [this]() { return this->createInstance(); });
+            });
+
+            if (this->usesWindowSystem()) {
+                m_startupProfiler.measure("createWindows", [this]() { this->createWindows(); });
+            } else if (m_displayIndex.has_value()) {
+                m_presenters.emplace_back().index = 0;
+            }
+
+            startup.wait();
+
+            return instanceStatus;
+        }
+
+        // Only the stages the first present needs, up to the swapchains, run before the windows
+        // are shown with a cleared image, and the stages after them run while the window is
+        // already up. Reading the pipeline cache and creating the pipeline compiler, mapping
+        // the asset pack and setting up the profilers run on the job system meanwhile, and are
+        // joined before the stages that build pipelines or upload the scene. A stage that fails
+        // returns the error the driver reported. The background tasks still running then
+        // finish while `backgroundTasks` is destroyed.
+        vk_result::Status initVulkan() {
+            VK_RESULT_TRY(m_startupProfiler.measure("setupDebugMessenger", [this]() { return this->setupDebugMessenger(); }));
+            if (!this->isHeadless()) {
+                VK_RESULT_TRY(m_startupProfiler.measure("createSurfaces", [this]() { return this->createSurfaces(); }));
+            }
+
+            m_startupProfiler.measure("selectPhysicalDevice", [this]() {
+                this->selectPhysicalDevice();
+                this->selectDeviceGroup();
+            });
+            this->placeThreads();
+
+            // The pipeline cache file only depends on the physical device, so it is read and
+            // validated on a worker while the logical device is created, and the cache and the
+            // pipeline compiler are created there while the main thread carries on with the
+            // stages that allocate device memory.
+            // The read works on its own copy of the properties, since device creation may still
+            // fall back to another GPU, whose cache is then read instead.
+            auto backgroundTasks = vk_jobs::TaskGroup { m_jobSystem };
+            const auto readPhysicalDevice = m_physicalDevice;
+            const auto readPipelineCache = backgroundTasks.run([this, properties = m_physicalDeviceInfo.properties]() {
+                m_startupProfiler.measure("readPipelineCache", [this, &properties]() {
+                    m_pipelineCache.read(properties, pipelineCacheDirectoryFromEnvironment());
+                });
+            });
+
+            // Mapping the asset pack only reads its index, and the blobs are paged in as they
+            // are uploaded.
+            if (const auto assetPackPath = assetPackPathFromEnvironment(); assetPackPath.has_value()) {
+                backgroundTasks.run([this, path = assetPackPath.value()]() {
+                    m_startupProfiler.measure("mapAssetPack", [this, &path]() {
+                        m_assetPack.open(path);
+                        m_assetReader.open(path, m_jobSystem);
+                    });
+                });
+            }
+
+            VK_RESULT_TRY(m_startupProfiler.measure("createLogicalDevice", [this]() { return this->createLogicalDevice(); }));
+            backgroundTasks.run(
+                [this, reread = m_physicalDevice != readPhysicalDevice]() {
+                    if (reread) {
+                        m_pipelineCache.read(m_physicalDeviceInfo.properties, pipelineCacheDirectoryFromEnvironment());
+                    }
+
+                    m_startupProfiler.measure("createPipelineCache", [this]() { m_pipelineCache.create(m_device); });
+                    m_startupProfiler.measure("createPipelineCompiler", [this]() {
+                        const bool cacheControl = vk_features::has(m_deviceFeatures, vk_features::Feature::PipelineCreationCacheControl);
+                        m_pipelineCompiler.init(m_device, m_pipelineCache.handle(), m_jobSystem, cacheControl);
+                    });
+                    m_pipelineRegistry.init(m_device, m_pipelineCache.handle(), m_hostAllocator.callbacks(), [this](VkShaderModule shaderModule) {
+                        return m_shaderLibrary.codeHash(shaderModule);
+                    });
+                },
+                std::span { &readPipelineCache, 1 }
+            );
+            // Only creates query pools, which take no queue. Calibrating the timeline does, and
+            // waits until the job has been joined.
+            backgroundTasks.run([this]() {
+                m_startupProfiler.measure("createGpuProfiler", [this]() { this->createGpuProfiler(); });
+            });
+
+            // The swapchains are set up for the pacers and the render scale, so those come first.
+            m_startupProfiler.measure("createDisplayTimingPacer", [this]() {
+                m_displayTimingPacer.init(m_device, vk_features::has(m_deviceFeatures, vk_features::Feature::DisplayTiming));
+            });
+            m_startupProfiler.measure("createClockCalibration", [this]() { this->createClockCalibration(); });
+            if (m_lowLatencyRequested && !this->isHeadless()) {
+                m_startupProfiler.measure("createLowLatencyPacer", [this]() { this->createLowLatencyPacer(); });
+            }
+            if (m_gpuBudget.has_value() && !this->isHeadless()) {
+                m_startupProfiler.measure("createDynamicResolution", [this]() { this->createDynamicResolution(); });
+            }
+            if (!this->isHeadless()) {
+                VK_RESULT_TRY(m_startupProfiler.measure("createSwapChains", [this]() -> vk_result::Status {
+                    for (auto& presenter : m_presenters) {
+                        this->querySurfaceSupport(presenter);
+                        this->queryFullScreenExclusive(presenter);
+                        VK_RESULT_TRY(this->createSwapChain(presenter, VK_NULL_HANDLE));
+                    }
+
+                    return vk_result::Status {};
+                }));
+                VK_RESULT_TRY(m_startupProfiler.measure("createImageViews", [this]() { return this->createPresenterImageViews(); }));
+                VK_RESULT_TRY(m_startupProfiler.measure("presentFirstFrames", [this]() { return this->presentFirstFrames(); }));
+            }
+
+            m_startupProfiler.measure("createMemoryAllocator", [this]() { this->createMemoryAllocator(); });
+            m_startupProfiler.measure("createDescriptorHeap", [this]() { this->createDescriptorHeap(); });
+            m_startupProfiler.measure("createDescriptorAllocators", [this]() { this->createDescriptorAllocators(); });
+            m_startupProfiler.measure("createShaderLibrary", [this]() {
+                m_shaderLibrary.init(m_device, m_jobSystem, HELLO_WINDOW_SHADER_SOURCE_DIR, HELLO_WINDOW_SHADER_BINARY_DIR, HELLO_WINDOW_GLSLC);
+            });
+            m_startupProfiler.measure("createFrameUploadArena", [this]() { this->createFrameUploadArena(); });
+            m_startupProfiler.measure("createUploadService", [this]() { this->createUploadService(); });
+            m_startupProfiler.measure("createReadbackService", [this]() { this->createReadbackService(); });
+            if (!this->isHeadless()) {
+                m_startupProfiler.measure("createFrameLimiter", [this]() { this->createFrameLimiter(); });
+                m_startupProfiler.measure("startPowerMonitor", [this]() { this->startPowerMonitor(); });
+                m_startupProfiler.measure("createThermalGovernor", [this]() { this->createThermalGovernor(); });
+            }
+            if (this->isHeadless()) {
+                VK_RESULT_TRY(m_startupProfiler.measure("createOffscreenImages", [this]() { return this->createOffscreenImages(); }));
+                VK_RESULT_TRY(m_startupProfiler.measure("createImageViews", [this]() { return this->createPresenterImageViews(); }));
+            }
+
+            VK_RESULT_TRY(m_startupProfiler.measure("createCommandPools", [this]() { return this->createCommandPools(); }));
+            VK_RESULT_TRY(m_startupProfiler.measure("createCommandBuffers", [this]() -> vk_result::Status {
+                VK_RESULT_TRY(this->createCommandBuffers());
+                m_commandRecorder.start(m_device, vk_handles::raw(m_commandPools), m_recordingThreadCount);
+                if (m_commandCacheRequested) {
+                    m_sceneCommandCache.init(m_device, m_queueFamilyIndices.graphicsFamily.value(), m_hostAllocator.callbacks());
                 }
-            }();
 
-            const auto createInfo = VkInstanceCreateInfo {
-                .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
-                .pApplicationInfo = &appInfo,
-                .enabledExtensionCount = static_cast<uint32_t>(requiredExtensions.size()),
-                .ppEnabledExtensionNames = requiredExtensions.data(),
-                .flags = flags,
-                .enabledLayerCount = static_cast<uint32_t>(enabledLayerNames.size()),
-                .ppEnabledLayerNames = enabledLayerNames.data(),
-                .pNext = debugCreateInfoPtr,
-            };
+                return vk_result::Status {};
+            }));
+            VK_RESULT_TRY(m_startupProfiler.measure("createSyncObjects", [this]() -> vk_result::Status {
+                VK_RESULT_TRY(this->createSyncObjects());
+                for (auto& presenter : m_presenters) {
+                    VK_RESULT_TRY(this->createRenderFinishedSemaphores(presenter));
+                    VK_RESULT_TRY(this->createPresentOwnershipTransfer(presenter));
+                }
 
-            auto instance = VkInstance {};
-            const auto result = vkCreateInstance(&createInfo, nullptr, &instance);
-            if (result != VK_SUCCESS) {
-                throw std::runtime_error("failed to create instance!");
+                return vk_result::Status {};
+            }));
+            VK_RESULT_TRY(m_startupProfiler.measure("createAsyncCompute", [this]() { return this->createAsyncCompute(); }));
+            m_startupProfiler.measure("createCrashDiagnostics", [this]() { this->createCrashDiagnostics(); });
+            m_startupProfiler.measure("startPresentLatencyMonitor", [this]() {
+                m_presentLatencyMonitor.start(m_device, vk_features::has(m_deviceFeatures, vk_features::Feature::PresentWait));
+            });
+            if (m_metricsEndpoint.has_value()) {
+                m_startupProfiler.measure("startMetricsServer", [this]() { m_metricsServer.start(m_metricsEndpoint.value(), m_frameTelemetry, m_frameBudget); });
+            }
+            if (m_frameExporter.isPrepared()) {
+                m_startupProfiler.measure("startFrameExport", [this]() { this->startFrameExport(); });
             }
 
-            m_instance = instance;
-        }
+            backgroundTasks.wait();
+            m_gpuProfiler.traceTimeline(m_graphicsQueue, m_queueFamilyIndices.graphicsFamily.value(), 0, m_clockCalibration);
 
-        void setupDebugMessenger() {
-            if (ENABLE_VALIDATION_LAYERS) {
-                const auto createInfo = this->createDebugMessengerCreateInfo();
+            if (m_assetPack.isOpen()) {
+                m_startupProfiler.measure("importAssetPack", [this]() { this->importAssetPack(); });
+            }
 
-                auto debugMessenger = VkDebugUtilsMessengerEXT {};
-                const auto result = App::CreateDebugUtilsMessengerEXT(m_instance, &createInfo, nullptr, &debugMessenger);
-                if (result != VK_SUCCESS) {
-                    throw std::runtime_error("failed to set up debug messenger!");
+            // The compute present pipeline goes through the pipeline cache.
+            m_startupProfiler.measure("createPresentTargets", [this]() {
+                for (auto& presenter : m_presenters) {
+                    this->createPresentTargets(presenter);
                 }
+            });
+            m_startupProfiler.measure("createIndirectRenderer", [this]() { this->createIndirectRenderer(); });
+            m_startupProfiler.measure("createParticleSystem", [this]() { this->createParticleSystem(); });
+            m_startupProfiler.measure("createTerrain", [this]() { this->createTerrain(); });
+            m_startupProfiler.measure("createTransparency", [this]() { this->createTransparency(); });
+            m_startupProfiler.measure("createPostProcess", [this]() { this->createPostProcess(); });
+            m_startupProfiler.measure("createTemporalUpscaler", [this]() { this->createTemporalUpscaler(); });
+            m_startupProfiler.measure("createOverlay", [this]() { this->createOverlay(); });
+            m_startupProfiler.measure("createWidgets", [this]() { this->createWidgets(); });
+            if (m_videoEncodeSupport.has_value()) {
+                m_startupProfiler.measure("createVideoEncoder", [this]() { this->createVideoEncoder(); });
+            }
+
+            return vk_result::Status {};
+        }
+
+        void exportFrameTelemetry() {
+            if (!m_frameTelemetryExport) {
+                return;
+            }
+
+            const auto now = std::chrono::steady_clock::now();
+            if (now - m_lastFrameTelemetryExport < FRAME_TELEMETRY_EXPORT_INTERVAL) {
+                return;
+            }
 
-                m_debugMessenger = debugMessenger;
+            m_lastFrameTelemetryExport = now;
+            m_frameTelemetry.reportJson(std::cout);
+            if (m_memoryBudget.isEnabled()) {
+                m_memoryBudget.reportJson(std::cout);
+            }
+            if (m_pipelineStatistics.isEnabled()) {
+                m_pipelineStatistics.reportJson(std::cout);
+            }
+            if (m_performanceCounters.isEnabled()) {
+                m_performanceCounters.reportJson(std::cout);
             }
         }
 
-        void createSurface() {
-            auto surface = VkSurfaceKHR {};
-            const auto result = glfwCreateWindowSurface(m_instance, m_window, nullptr, &surface);
-            if (result != VK_SUCCESS) {
-                throw std::runtime_error("failed to create window surface!");
+        // Render the requested number of frames back to back, as fast as the GPU allows.
+        vk_result::Status headlessLoop() {
+            while (m_frameCount < m_headlessFrameCount.value() && !this->isBenchmarkFinished()) {
+                m_shaderLibrary.poll();
+                VK_RESULT_TRY(this->drawFrame());
+                this->exportFrameTelemetry();
             }
 
-            m_surface = surface;
+            vkDeviceWaitIdle(m_device);
+
+            return vk_result::Status {};
         }
 
-        bool checkDeviceExtensionSupport(VkPhysicalDevice device) {
-            uint32_t extensionCount = 0;
-            vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+        // Renders what the service's clients ask for until one of them asks it to quit. A frame
+        // that fails is reported to the client that asked for it before it ends the service.
+        vk_result::Status serviceLoop() {
+            const auto& offscreen = m_presenters.front();
+            while (const auto request = m_renderService.waitForRequest()) {
+                if (request->command == vk_service::Command::Status) {
+                    m_renderService.reply(fmt::format(
+                        "ok frames={} device=\"{}\" extent={}x{}",
+                        m_frameCount,
+                        m_physicalDeviceInfo.properties.deviceName,
+                        offscreen.extent.width,
+                        offscreen.extent.height
+                    ));
+                    continue;
+                }
 
-            auto availableExtensions = std::vector<VkExtensionProperties> { extensionCount };
-            vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+                const auto start = std::chrono::steady_clock::now();
+                m_headlessFrameCount = m_frameCount + request->frames;
+                while (m_frameCount < m_headlessFrameCount.value()) {
+                    m_shaderLibrary.poll();
+                    if (const auto status = this->drawFrame(); !status) {
+                        m_renderService.reply(fmt::format("error {}", status.error().message()));
+                        return status;
+                    }
 
-            auto requiredExtensions = std::set<std::string> { DEVICE_EXTENSIONS.begin(), DEVICE_EXTENSIONS.end() };
+                    this->exportFrameTelemetry();
+                }
 
-            for (const auto& extension : availableExtensions) {
-                requiredExtensions.erase(extension.extensionName);
+                m_renderService.reply(fmt::format(
+                    "ok frames={} milliseconds={:.3f} {}",
+                    request->frames,
+                    vk_profiling::millisecondsSince(start),
+                    vk_service::summarizeFrames(m_frameTelemetry, request->frames)
+                ));
             }
 
-            return requiredExtensions.empty();
+            vkDeviceWaitIdle(m_device);
+
+            return vk_result::Status {};
         }
 
-        bool isPhysicalDeviceSuitable(VkPhysicalDevice device) {
-            auto indices = this->findQueueFamilies(device);
+        // Runs on the render thread, and keeps rendering while the main thread is stuck in a
+        // modal loop, like the one Windows and macOS run while a window is moved or resized.
+        void renderLoop() {
+            vk_tracing::setThreadName("render");
+            vk_topology::pinCurrentThread(m_threadPlacement.latencyCpus);
+            try {
+                while (!m_renderThreadStop.load(std::memory_order_acquire) && !this->isBenchmarkFinished()) {
+                    if (m_renderMode == RenderMode::OnDemand) {
+                        m_frameRequested.wait(false, std::memory_order_acquire);
+                        if (!m_frameRequested.exchange(false, std::memory_order_acq_rel) || m_renderThreadStop.load(std::memory_order_acquire)) {
+                            continue;
+                        }
+                    }
+
+                    m_shaderLibrary.poll();
+                    m_renderThreadStatus = this->drawFrame();
+                    if (!m_renderThreadStatus) {
+                        break;
+                    }
 
-            const bool extensionsSupported = this->checkDeviceExtensionSupport(device);
+                    this->exportFrameTelemetry();
+                }
 
-            bool swapChainAdequate = false;
-            if (extensionsSupported) {
-                SwapChainSupportDetails swapChainSupport = this->querySwapChainSupport(device);
-                swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
+                vkDeviceWaitIdle(m_device);
+            } catch (...) {
+                m_renderThreadError = std::current_exception();
             }
 
-            return indices.isComplete() && extensionsSupported && swapChainAdequate;
+            m_renderThreadDone.store(true, std::memory_order_release);
+            glfwPostEmptyEvent();
         }
 
-        QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device) {
-            auto indices = QueueFamilyIndices {};
+        // The main thread only handles events until a window closes or the render thread
+        // is done, and then stops the render thread and hands on whatever it failed with.
+        vk_result::Status threadedLoop() {
+            m_renderThread = std::thread { [this]() { this->renderLoop(); } };
+            while (!this->isAnyWindowClosing() && !m_renderThreadDone.load(std::memory_order_acquire)) {
+                glfwWaitEvents();
+            }
 
-            uint32_t queueFamilyCount = 0;
-            vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
+            m_renderThreadStop.store(true, std::memory_order_release);
+            this->signalFrameRequest();
+            m_renderThread.join();
 
-            auto queueFamilies = std::vector<VkQueueFamilyProperties> { queueFamilyCount };
-            vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
+            if (m_renderThreadError) {
+                std::rethrow_exception(m_renderThreadError);
+            }
 
-            int i = 0;
-            for (const auto& queueFamily : queueFamilies) {
-                if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-                    indices.graphicsFamily = i;
-                }
+            return m_renderThreadStatus;
+        }
 
-                VkBool32 presentSupport = false;
-                vkGetPhysicalDeviceSurfaceSupportKHR(device, i, m_surface, &presentSupport);
+        vk_result::Status mainLoop() {
+            if (m_serviceEndpoint.has_value()) {
+                return this->serviceLoop();
+            } else if (this->isHeadless()) {
+                return this->headlessLoop();
+            } else if (m_renderThreadEnabled) {
+                return this->threadedLoop();
+            }
 
-                if (presentSupport) {
-                    indices.presentFamily = i;
-                }
+            while (!this->isAnyWindowClosing() && !this->isBenchmarkFinished()) {
+                if (m_renderMode == RenderMode::OnDemand) {
+                    // Park the thread until something happens instead of spinning on
+                    // `glfwPollEvents`. The timeout bounds how long a frame requested without
+                    // an accompanying empty event can go unnoticed.
+                    if (!m_frameRequested.load(std::memory_order_acquire)) {
+                        glfwWaitEventsTimeout(IDLE_WAIT_TIMEOUT);
+                    } else {
+                        glfwPollEvents();
+                    }
 
-                if (indices.isComplete()) {
-                    break;
+                    if (!m_frameRequested.exchange(false, std::memory_order_acq_rel)) {
+                        continue;
+                    }
+                } else if (this->usesWindowSystem()) {
+                    glfwPollEvents();
                 }
 
-                i++;
+                m_shaderLibrary.poll();
+                VK_RESULT_TRY(this->drawFrame());
+                this->exportFrameTelemetry();
             }
 
-            return indices;
-        }
+            vkDeviceWaitIdle(m_device);
 
-        void selectPhysicalDevice() {
-            uint32_t physicalDeviceCount = 0;
-            vkEnumeratePhysicalDevices(m_instance, &physicalDeviceCount, nullptr);
+            return vk_result::Status {};
+        }
 
-            if (physicalDeviceCount == 0) {
-                throw std::runtime_error("failed to find GPUs with Vulkan support!");
+        // Bounded, since a lost device or surface may never signal them.
+        void waitForPresentFences() {
+            auto fences = std::vector<VkFence> {};
+            for (const auto& presenter : m_presenters) {
+                for (const auto& fence : presenter.presentFences) {
+                    fences.push_back(fence);
+                }
             }
-
-            auto physicalDevices = std::vector<VkPhysicalDevice> { physicalDeviceCount };
-            vkEnumeratePhysicalDevices(m_instance, &physicalDeviceCount, physicalDevices.data());
-
-            auto selectedPhysicalDevice = VkPhysicalDevice {};
-            for (const auto& physicalDevice : physicalDevices) {
-                if (this->isPhysicalDeviceSuitable(physicalDevice)) {
-                    selectedPhysicalDevice = physicalDevice;
-                    break;
+            for (const auto& retired : m_fencedSwapChains) {
+                for (const auto& fence : retired.presentFences) {
+                    fences.push_back(fence);
                 }
             }
 
-            if (selectedPhysicalDevice == VK_NULL_HANDLE) {
-                throw std::runtime_error("failed to find a suitable GPU!");
+            if (!fences.empty()) {
+                const auto timeout = std::chrono::nanoseconds { std::chrono::seconds { 1 } }.count();
+                vkWaitForFences(m_device, static_cast<uint32_t>(fences.size()), fences.data(), VK_TRUE, static_cast<uint64_t>(timeout));
             }
-
-            m_physicalDevice = selectedPhysicalDevice;
         }
 
-        void createLogicalDevice() {
-            const auto indices = this->findQueueFamilies(m_physicalDevice);
-            const auto uniqueQueueFamilies = std::set<uint32_t> {
-                indices.graphicsFamily.value(),
-                indices.presentFamily.value()
-            };
-            
-            const float queuePriority = 1.0f;
-            auto queueCreateInfos = std::vector<VkDeviceQueueCreateInfo> {};
-            for (uint32_t queueFamily : uniqueQueueFamilies) {
-                const auto queueCreateInfo =  VkDeviceQueueCreateInfo {
-                    .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-                    .queueFamilyIndex = queueFamily,
-                    .queueCount = 1,
-                    .pQueuePriorities = &queuePriority,
-                };
+        // Ends the process after a successful run without destroying anything, which takes the
+        // driver longer the more the scene holds, and leaves the rest to the driver and the OS
+        // as the process goes. What outlives the process is written out first, and the GPU is
+        // idle, so no work is cut off. Returns without exiting in leak check builds, and with
+        // validation, whose leak reports need the full teardown of `cleanup`.
+        void exitFast(int exitCode) {
+            if (HELLO_WINDOW_LEAK_CHECK || this->isValidationEnabled()) {
+                return;
+            }
 
-                queueCreateInfos.push_back(queueCreateInfo);
+            m_assetReader.close();
+            m_jobSystem.stop();
+            m_frameDumper.stop();
+            this->logTeardownStatistics();
+            m_presentLatencyMonitor.stop();
+            m_metricsServer.stop();
+            m_renderService.stop();
+            m_powerMonitor.stop();
+            m_frameExporter.stop();
+            if (m_device) {
+                vkDeviceWaitIdle(m_device);
+                m_videoEncoder.finish();
+                this->waitForPresentFences();
+                m_pipelineCache.save();
             }
 
-            const auto deviceFeatures = VkPhysicalDeviceFeatures {};
-            const auto enabledExtensions = []() {
-                auto _enabledExtensions = std::vector<const char*> { VK_KHR_portability_subset };
-                for (const char* deviceExtension : DEVICE_EXTENSIONS) {
-                    _enabledExtensions.emplace_back(deviceExtension);
+            VK_LOG_INFO("Exiting without teardown");
+            vk_log::flush();
+            std::cout.flush();
+            std::quick_exit(exitCode);
+        }
+
+        void logTeardownStatistics() const {
+            if (m_acquireCount > 0) {
+                VK_LOG_INFO("Swapchain acquires: {} of {} found no image ready, {} timed out", m_acquiresBlocked, m_acquireCount, m_acquireTimeouts);
+            }
+            VK_LOG_INFO("Frame arena: {} bytes in {} block allocations", m_frameArena.capacity(), m_frameArena.blockAllocationCount());
+            VK_LOG_INFO("Image views: {} created, {} reused from the cache", m_imageViews.createdCount(), m_imageViews.hitCount());
+            VK_LOG_INFO("Image barriers: {} recorded, {} redundant left out", m_imageLayouts.barrierCount(), m_imageLayouts.skippedCount());
+            VK_LOG_INFO("Samplers: {} created, {} shared from the cache", m_samplerCache.samplerCount(), m_samplerCache.sharedCount());
+            for (size_t i = 0; i < vk_frame_budget::SUBSYSTEM_COUNT; i++) {
+                const auto subsystem = static_cast<vk_frame_budget::Subsystem>(i);
+                const auto statistics = m_frameBudget.statistics(subsystem);
+                if (statistics.frameCount > 0) {
+                    VK_LOG_INFO(
+                        "CPU budget of {}: {} of {} frames over, {} left work for the next frame, worst {:.3f} ms",
+                        vk_frame_budget::subsystemToString(subsystem),
+                        statistics.overrunCount,
+                        statistics.frameCount,
+                        statistics.deferredCount,
+                        statistics.worstMilliseconds
+                    );
                 }
+            }
+            for (const auto& presenter : m_presenters) {
+                if (presenter.window != nullptr) {
+                    VK_LOG_INFO("Window {} surface support: {} queries, {} reused from the cache", presenter.index, presenter.surfaceSupport.queryCount(), presenter.surfaceSupport.hitCount());
+                }
+            }
+        }
 
-                return _enabledExtensions;
-            }();
-            const auto enabledLayerNames = []() -> std::vector<const char*> {
-                if (ENABLE_VALIDATION_LAYERS) {
-                    return VALIDATION_LAYERS;
-                } else {
-                    return std::vector<const char*> {};
+        // Runs from the destructor, so also after `run` failed partway through. The handles
+        // that were never created are empty and destroy nothing, and everything that depends
+        // on the device is skipped when there is none.
+        void cleanup() {
+            // Its reads complete on the job system, so it goes first.
+            m_assetReader.close();
+            m_jobSystem.stop();
+            m_frameDumper.stop();
+            this->logTeardownStatistics();
+            m_presentLatencyMonitor.stop();
+            m_metricsServer.stop();
+            m_renderService.stop();
+            m_powerMonitor.stop();
+            m_frameLimiter.destroy();
+
+            // Consumers hold on to what they imported, which outlives the handles.
+            m_frameExporter.stop();
+
+            if (m_device) {
+                vkDeviceWaitIdle(m_device);
+
+                // The last frames are written out before the stream closes.
+                m_videoEncoder.finish();
+                m_videoEncoder.destroy();
+                m_retiredSwapChains.flush();
+                // A device wait does not cover presents, whose fences are the only way to know
+                // the presentation engine is done with a swapchain.
+                this->waitForPresentFences();
+                m_fencedSwapChains.clear();
+                // Compiles still queued read from the renderers that requested them.
+                m_pipelineCompiler.destroy();
+                m_renderGraph.destroy();
+                m_particleSystem.destroy();
+                m_sceneAccelerationStructure.destroy();
+                m_sceneBvh.destroy();
+                m_terrainRenderer.destroy();
+                m_textureStreamer.destroy();
+                m_transparencyRenderer.destroy();
+                m_postProcess.destroy();
+                m_textRenderer.destroy();
+                m_spriteBatcher.destroy();
+                m_resources.clear();
+                m_overlay.destroy();
+                m_gpuPrimitives.destroy();
+                m_temporalUpscaler.destroy();
+                m_foveatedShadingRate.destroy();
+                m_indirectRenderer.destroy();
+                for (auto& presenter : m_presenters) {
+                    presenter.renderFinishedSemaphores.clear();
+                    presenter.imageAvailableSemaphores.clear();
                 }
-            }();
 
-            const auto createInfo = VkDeviceCreateInfo {
-                .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-                .queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size()),
-                .pQueueCreateInfos = queueCreateInfos.data(),
-                .pEnabledFeatures = &deviceFeatures,
-                .enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size()),
-                .ppEnabledExtensionNames = enabledExtensions.data(),
-                .enabledLayerCount = static_cast<uint32_t>(enabledLayerNames.size()),
-                .ppEnabledLayerNames = enabledLayerNames.data(),
-            };
+                m_frameTimelineSemaphore.reset();
+                m_asyncComputeSemaphore.reset();
+                m_lowLatencyPacer.destroy();
+                m_deviceGroupSync.destroy();
 
-            auto device = VkDevice {};
-            const auto result = vkCreateDevice(m_physicalDevice, &createInfo, nullptr, &device);
-            if (result != VK_SUCCESS) {
-                throw std::runtime_error("failed to create logical device!");
-            }
+                m_commandRecorder.stop();
+                m_sceneCommandCache.destroy();
+                m_commandPools.clear();
+                m_asyncComputeCommandBuffers.clear();
+                m_asyncComputePools.clear();
+                for (auto& presenter : m_presenters) {
+                    presenter.presentTargets.descriptorSets.clear();
+                    presenter.presentTargets.descriptorPool.reset();
+                    presenter.presentOwnershipTransfer.acquireCommandBuffers.clear();
+                    presenter.presentOwnershipTransfer.acquiredSemaphores.clear();
+                    presenter.presentOwnershipTransfer.commandPool.reset();
+                    presenter.imageViews.clear();
+                }
+                m_imageViews.clear();
+                for (auto& presenter : m_presenters) {
+                    presenter.splitImages.clear();
+                }
 
-            auto graphicsQueue = VkQueue {};
-            vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
-            
-            auto presentQueue = VkQueue {};
-            vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+                m_computePresentPass.destroy();
 
-            m_device = device;
-            m_graphicsQueue = graphicsQueue;
-            m_presentQueue = presentQueue;
-        }
+                for (auto& presenter : m_presenters) {
+                    if (this->isHeadless()) {
+                        for (size_t i = 0; i < presenter.images.size(); i++) {
+                            m_imageLayouts.forget(presenter.images[i]);
+                            vkDestroyImage(m_device, presenter.images[i], m_hostAllocator.callbacks());
+                            m_memoryAllocator.free(m_offscreenImageAllocations[i]);
+                        }
 
-        SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device) {
-            auto details = SwapChainSupportDetails {};
-            vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, m_surface, &details.capabilities);
+                        presenter.images.clear();
+                    } else {
+                        presenter.swapChain.reset();
+                    }
+                }
+
+                m_gpuProfiler.destroy();
+                m_pipelineStatistics.destroy();
+                m_performanceCounters.destroy();
+                m_breadcrumbs.destroy();
+                m_asyncComputeProfiler.destroy();
+                m_shaderLibrary.destroy();
+                m_descriptorHeap.destroy();
+                m_frameDescriptors.destroy();
+                m_descriptorLayoutCache.destroy();
+                m_samplerCache.destroy();
+                m_pipelineRegistry.destroy();
+                m_pipelineCache.save();
+                m_pipelineCache.destroy();
+                m_assetPack.close();
+                m_uploadService.destroy(m_memoryAllocator);
+                m_readbackService.destroy(m_memoryAllocator);
+                m_frameUploadArena.destroy(m_memoryAllocator);
+                m_memoryAllocator.destroy();
+                m_device.reset();
+            }
 
-            uint32_t formatCount = 0;
-            vkGetPhysicalDeviceSurfaceFormatsKHR(device, m_surface, &formatCount, nullptr);
+            m_debugMessenger.reset();
+            for (auto& presenter : m_presenters) {
+                presenter.surface.reset();
+            }
 
-            if (formatCount != 0) {
-                details.formats.resize(formatCount);
-                vkGetPhysicalDeviceSurfaceFormatsKHR(device, m_surface, &formatCount, details.formats.data());
+            m_instance.reset();
+            m_debugMessageSink.stop();
+            for (auto& presenter : m_presenters) {
+                if (presenter.window != nullptr) {
+                    glfwDestroyWindow(presenter.window);
+                    presenter.window = nullptr;
+                }
             }
 
-            uint32_t presentModeCount = 0;
-            vkGetPhysicalDeviceSurfacePresentModesKHR(device, m_surface, &presentModeCount, nullptr);
+            m_presenters.clear();
 
-            if (presentModeCount != 0) {
-                details.presentModes.resize(presentModeCount);
-                vkGetPhysicalDeviceSurfacePresentModesKHR(device, m_surface, &presentModeCount, details.presentModes.data());
+            if (this->usesWindowSystem()) {
+                glfwTerminate();
             }
 
-            return details;
+            vk_dispatch::unloadLoader();
         }
+};
 
-        VkSurfaceFormatKHR selectSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats) {
-            for (const auto& availableFormat : availableFormats) {
-                if (availableFormat.format == VK_FORMAT_B8G8R8A8_SRGB && availableFormat.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
-                    return availableFormat;
-                }
-            }
+// Runs the app once, with the settings as they are, and logs why if it fails. The last run in
+// the process exits from here when it succeeds, without tearing the app down.
+static bool runApp(bool lastRun) {
+    auto app = App {};
 
-            return availableFormats[0];
+    try {
+        const auto status = app.run();
+        if (!status) {
+            VK_LOG_ERROR("{}", status.error().message());
+            vk_log::flush();
+            return false;
         }
+    } catch (const std::exception& e) {
+        VK_LOG_ERROR("{}", e.what());
+        vk_log::flush();
+        return false;
+    }
 
-        VkPresentModeKHR selectSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes) {
-            for (const auto& availablePresentMode : availablePresentModes) {
-                if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
-                    return availablePresentMode;
-                }
+    if (lastRun) {
+        app.exitFast(EXIT_SUCCESS);
+    }
+
+    return true;
+}
+
+// Where one point of a sweep writes its results, next to the sweep's, like
+// `bench-instance-count-1000.json` for `bench.json`.
+static std::filesystem::path sweepPointOutput(const std::filesystem::path& output, const std::string& setting, const std::string& value) {
+    const auto name = fmt::format("{}-{}-{}{}", output.stem().string(), setting, value, output.extension().string());
+
+    return output.parent_path() / name;
+}
+
+// Gathers the results of every point into `output`, CSV rows under one header or the JSON
+// objects in an array, so a sweep plots from one file.
+static void writeSweepResults(const std::filesystem::path& output, std::span<const std::filesystem::path> points) {
+    auto out = std::ofstream { output };
+    if (!out) {
+        throw std::runtime_error(fmt::format("failed to open benchmark output `{}`!", output.string()));
+    }
+
+    const auto csv = output.extension() == ".csv";
+    if (!csv) {
+        fmt::println(out, "[");
+    }
+
+    for (size_t i = 0; i < points.size(); i++) {
+        auto in = std::ifstream { points[i] };
+        if (!in) {
+            throw std::runtime_error(fmt::format("failed to open benchmark output `{}`!", points[i].string()));
+        }
+
+        auto line = std::string {};
+        for (size_t lineNumber = 0; std::getline(in, line); lineNumber++) {
+            if (line.empty() || (csv && i > 0 && lineNumber == 0)) {
+                continue;
             }
 
-            return VK_PRESENT_MODE_FIFO_KHR;
+            fmt::println(out, "{}{}", line, !csv && i + 1 < points.size() ? "," : "");
         }
+    }
 
-        VkExtent2D selectSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities) {
-            if (capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max()) {
-                return capabilities.currentExtent;
-            } else {
-                int _width, _height;
-                glfwGetWindowSize(m_window, &_width, &_height);
+    if (!csv) {
+        fmt::println(out, "]");
+    }
+}
 
-                const uint32_t width = std::clamp(
-                    static_cast<uint32_t>(_width),
-                    capabilities.minImageExtent.width,
-                    capabilities.maxImageExtent.width
-                );
-                const uint32_t height = std::clamp(
-                    static_cast<uint32_t>(_height), 
-                    capabilities.minImageExtent.height, 
-                    capabilities.maxImageExtent.height
-                );
-                const auto actualExtent = VkExtent2D {
-                    .width = width,
-                    .height = height,
-                };
+// Sets the environment variable `name` of this process, which the processes it launches
+// inherit, or removes it when `value` is null.
+static void setEnvironmentVariable(const char* name, const char* value) {
+#if defined(_WIN32)
+    _putenv_s(name, value != nullptr ? value : "");
+#else
+    if (value != nullptr) {
+        setenv(name, value, 1);
+    } else {
+        unsetenv(name);
+    }
+#endif
+}
 
-                return actualExtent;
-            }
+// Quotes `argument` for the shell `popen` runs commands with.
+static std::string quoteArgument(std::string_view argument) {
+#if defined(_WIN32)
+    auto quoted = std::string { "\"" };
+    for (const char c : argument) {
+        if (c == '"') {
+            quoted += '\\';
         }
+        quoted += c;
+    }
 
-        void createSwapChain() {
-            const auto swapChainSupport = this->querySwapChainSupport(m_physicalDevice);
-            const auto surfaceFormat = this->selectSwapSurfaceFormat(swapChainSupport.formats);
-            const auto presentMode = this->selectSwapPresentMode(swapChainSupport.presentModes);
-            const auto extent = this->selectSwapExtent(swapChainSupport.capabilities);
-            const auto imageCount = [&swapChainSupport]() {
-                uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
-                if (swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount) {
-                    return swapChainSupport.capabilities.maxImageCount;
-                }
+    return quoted + "\"";
+#else
+    auto quoted = std::string { "'" };
+    for (const char c : argument) {
+        if (c == '\'') {
+            quoted += "'\\''";
+        } else {
+            quoted += c;
+        }
+    }
 
-                return imageCount;
-            }();
-            const auto indices = this->findQueueFamilies(m_physicalDevice);
-            const auto queueFamilyIndices = std::array<uint32_t, 2> {
-                indices.graphicsFamily.value(),
-                indices.presentFamily.value()
-            };
-            const auto imageSharingMode = [&indices]() -> VkSharingMode {
-                if (indices.graphicsFamily != indices.presentFamily) {
-                    return VK_SHARING_MODE_CONCURRENT;
-                } else {
-                    return VK_SHARING_MODE_EXCLUSIVE;
-                }
-            }();
-            const auto [queueFamilyIndicesPtr, queueFamilyIndexCount] = [&indices, &queueFamilyIndices]() -> std::tuple<const uint32_t*, uint32_t> {
-                if (indices.graphicsFamily != indices.presentFamily) {
-                    const auto data = queueFamilyIndices.data();
-                    const auto size = static_cast<uint32_t>(queueFamilyIndices.size());
-                
-                    return std::make_tuple(data, size);
-                } else {
-                    const auto data = static_cast<uint32_t*>(nullptr);
-                    const auto size = static_cast<uint32_t>(0);
+    return quoted + "'";
+#endif
+}
 
-                    return std::make_tuple(data, size);
-                }
-            }();
+// Runs `command` and reads back the startup report it prints, or nothing when it fails or
+// prints none. Everything else it prints to stdout is dropped.
+static std::optional<vk_profiling::StartupRun> launchStartupRun(const std::string& command) {
+#if defined(_WIN32)
+    // `cmd /c` strips the outer quotes of a command that starts with one.
+    FILE* pipe = _popen(fmt::format("\"{}\"", command).c_str(), "r");
+#else
+    FILE* pipe = popen(command.c_str(), "r");
+#endif
+    if (pipe == nullptr) {
+        return std::nullopt;
+    }
 
-            const auto createInfo = VkSwapchainCreateInfoKHR {
-                .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
-                .surface = m_surface,
-                .minImageCount = imageCount,
-                .imageFormat = surfaceFormat.format,
-                .imageColorSpace = surfaceFormat.colorSpace,
-                .imageExtent = extent,
-                .imageArrayLayers = 1,
-                .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-                .imageSharingMode = imageSharingMode,
-                .queueFamilyIndexCount = queueFamilyIndexCount,
-                .pQueueFamilyIndices = queueFamilyIndicesPtr,
-                .preTransform = swapChainSupport.capabilities.currentTransform,
-                .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
-                .presentMode = presentMode,
-                .clipped = VK_TRUE,
-                .oldSwapchain = VK_NULL_HANDLE,
-            };
+    auto run = std::optional<vk_profiling::StartupRun> {};
+    auto line = std::string {};
+    auto buffer = std::array<char, 4096> {};
+    while (std::fgets(buffer.data(), static_cast<int>(buffer.size()), pipe) != nullptr) {
+        line += buffer.data();
+        if (line.back() != '\n') {
+            continue;
+        }
 
-            auto swapChain = VkSwapchainKHR {};
-            const auto result = vkCreateSwapchainKHR(m_device, &createInfo, nullptr, &swapChain);
-            if (result != VK_SUCCESS) {
-                throw std::runtime_error("failed to create swap chain!");
-            }
+        if (auto report = vk_profiling::parseStartupReport(line); report.has_value()) {
+            run = std::move(report);
+        }
+        line.clear();
+    }
 
-            uint32_t swapChainImageCount = 0;
-            vkGetSwapchainImagesKHR(m_device, swapChain, &swapChainImageCount, nullptr);
+#if defined(_WIN32)
+    const auto exitCode = _pclose(pipe);
+#else
+    const auto exitCode = pclose(pipe);
+#endif
+    if (exitCode != 0) {
+        return std::nullopt;
+    }
 
-            auto swapChainImages = std::vector<VkImage> { swapChainImageCount, VK_NULL_HANDLE };
-            vkGetSwapchainImagesKHR(m_device, swapChain, &swapChainImageCount, swapChainImages.data());
+    return run;
+}
 
-            m_swapChain = swapChain;
-            m_swapChainImages = std::move(swapChainImages);
-            m_swapChainImageFormat = surfaceFormat.format;
-            m_swapChainExtent = extent;
-        }
-
-        void createImageViews() {
-            auto swapChainImageViews = std::vector<VkImageView> { m_swapChainImages.size(), VK_NULL_HANDLE };
-            for (size_t i = 0; i < m_swapChainImages.size(); i++) {
-                const auto createInfo = VkImageViewCreateInfo {
-                    .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-                    .image = m_swapChainImages[i],
-                    .viewType = VK_IMAGE_VIEW_TYPE_2D,
-                    .format = m_swapChainImageFormat,
-                    .components.r = VK_COMPONENT_SWIZZLE_IDENTITY,
-                    .components.g = VK_COMPONENT_SWIZZLE_IDENTITY,
-                    .components.b = VK_COMPONENT_SWIZZLE_IDENTITY,
-                    .components.a = VK_COMPONENT_SWIZZLE_IDENTITY,
-                    .subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                    .subresourceRange.baseMipLevel = 0,
-                    .subresourceRange.levelCount = 1,
-                    .subresourceRange.baseArrayLayer = 0,
-                    .subresourceRange.layerCount = 1,
-                };
+// Launches this binary `runCount` times cold, each with an empty pipeline cache directory of
+// its own and the driver shader caches turned off, then primes the caches with one launch and
+// launches it `runCount` times warm. Every launch passes this one's command line on and exits
+// once started, and the stage times of each condition are reported apart.
+static int runStartupBenchmark(int argc, char** argv, uint32_t runCount) {
+    auto command = quoteArgument(argv[0]);
+    for (int i = 1; i < argc; i++) {
+        command += ' ';
+        command += quoteArgument(argv[i]);
+    }
 
-                auto swapChainImageView = VkImageView {};
-                const auto result = vkCreateImageView(m_device, &createInfo, nullptr, &swapChainImageView);
-                if (result != VK_SUCCESS) {
-                    throw std::runtime_error("failed to create image views!");
-                }
+    // Later options win over the ones passed on.
+    command += " --startup-bench=0 --startup-report=json --exit-after-startup";
 
-                swapChainImageViews[i] = swapChainImageView;
-            }
+    auto benchmark = vk_profiling::StartupBenchmark {};
+    // Without `run`, the launch only primes the caches and is not counted.
+    const auto launch = [&benchmark, runCount](vk_profiling::StartupCondition condition, const std::string& launchCommand, std::optional<uint32_t> run) {
+        const auto* conditionName = vk_profiling::startupConditionToString(condition);
+        const auto startup = launchStartupRun(launchCommand);
+        if (!startup.has_value()) {
+            VK_LOG_ERROR("Startup benchmark: a {} launch failed or reported no startup times", conditionName);
 
-            m_swapChainImageViews = std::move(swapChainImageViews);
+            return false;
         }
 
-        void createWindow() {
-            glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-            glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
-            auto window = glfwCreateWindow(WIDTH, HEIGHT, "Hello, Window!", nullptr, nullptr);
+        const auto milliseconds = startup->firstPresentMilliseconds.value_or(startup->totalMilliseconds);
+        if (!run.has_value()) {
+            VK_LOG_INFO("Startup benchmark: priming launch took {:.1f} ms", milliseconds);
 
-            m_window = window;
+            return true;
         }
 
-        void initVulkan() {
-            this->createInstance();
-            this->setupDebugMessenger();
-            this->createSurface();
-            this->selectPhysicalDevice();
-            this->createLogicalDevice();
-            this->createSwapChain();
-            this->createImageViews();
-        }
+        VK_LOG_INFO("Startup benchmark: {} launch {} of {} took {:.1f} ms", conditionName, run.value() + 1, runCount, milliseconds);
+        benchmark.add(condition, startup.value());
 
-        void mainLoop() {
-            while (!glfwWindowShouldClose(m_window)) {
-                glfwPollEvents();
-            }
+        return true;
+    };
+
+    auto driverEnvironment = std::vector<std::optional<std::string>> {};
+    for (const auto& [name, value] : COLD_START_DRIVER_ENVIRONMENT) {
+        const char* previous = std::getenv(name);
+        driverEnvironment.push_back(previous != nullptr ? std::optional<std::string> { previous } : std::nullopt);
+        setEnvironmentVariable(name, value);
+    }
+
+    auto coldStatus = true;
+    const auto coldDirectory = std::filesystem::temp_directory_path() / "hello_window_cold_start";
+    for (uint32_t run = 0; run < runCount && coldStatus; run++) {
+        std::filesystem::remove_all(coldDirectory);
+        std::filesystem::create_directories(coldDirectory);
+        const auto coldCommand = fmt::format("{} --pipeline-cache-dir={}", command, quoteArgument(coldDirectory.string()));
+        coldStatus = launch(vk_profiling::StartupCondition::Cold, coldCommand, run);
+    }
+
+    std::filesystem::remove_all(coldDirectory);
+    for (size_t i = 0; i < COLD_START_DRIVER_ENVIRONMENT.size(); i++) {
+        const auto& previous = driverEnvironment[i];
+        setEnvironmentVariable(COLD_START_DRIVER_ENVIRONMENT[i].first, previous.has_value() ? previous->c_str() : nullptr);
+    }
+
+    // The priming launch is not counted.
+    if (!coldStatus || !launch(vk_profiling::StartupCondition::Warm, command, std::nullopt)) {
+        return EXIT_FAILURE;
+    }
+
+    for (uint32_t run = 0; run < runCount; run++) {
+        if (!launch(vk_profiling::StartupCondition::Warm, command, run)) {
+            return EXIT_FAILURE;
         }
+    }
 
-        void cleanup() {
-            for (auto imageView : m_swapChainImageViews) {
-                vkDestroyImageView(m_device, imageView, nullptr);
-            }
+    benchmark.report(std::cout);
+    const auto output = startupBenchOutputFromEnvironment();
+    benchmark.write(output);
+    VK_LOG_INFO("Wrote startup benchmark results to {}", output.string());
 
-            vkDestroySwapchainKHR(m_device, m_swapChain, nullptr);
-            vkDestroyDevice(m_device, nullptr);
+    return EXIT_SUCCESS;
+}
 
-            if (ENABLE_VALIDATION_LAYERS) {
-                App::DestroyDebugUtilsMessengerEXT(m_instance, m_debugMessenger, nullptr);
-            }
+int main(int argc, char** argv) {
+    // The app reads its settings as it is constructed.
+    try {
+        vk_config::config().load(argc, argv);
+    } catch (const std::exception& e) {
+        VK_LOG_ERROR("{}", e.what());
+        vk_log::flush();
+        return EXIT_FAILURE;
+    }
 
-            vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
-            vkDestroyInstance(m_instance, nullptr);
-            glfwDestroyWindow(m_window);
-            glfwTerminate();
+    if (const auto startupRuns = startupBenchRunsFromEnvironment(); startupRuns > 0) {
+        try {
+            return runStartupBenchmark(argc, argv, startupRuns);
+        } catch (const std::exception& e) {
+            VK_LOG_ERROR("{}", e.what());
+            vk_log::flush();
+            return EXIT_FAILURE;
         }
-};
+    }
 
-int main() {
-    auto app = App {};
+    const auto sweep = benchmarkSweepFromEnvironment();
+    if (sweep.empty()) {
+        return runApp(true) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
+    const auto benchmarkSettings = benchmarkSettingsFromEnvironment();
+    if (!benchmarkSettings.has_value()) {
+        VK_LOG_WARNING("{} needs {} or {}, running once", BENCH_SWEEP_ENVIRONMENT_VARIABLE, BENCH_FRAMES_ENVIRONMENT_VARIABLE, BENCH_SECONDS_ENVIRONMENT_VARIABLE);
+
+        return runApp(true) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // A fresh app per point, since the scene and the job system are sized as it starts.
+    auto& config = vk_config::config();
+    auto points = std::vector<std::filesystem::path> {};
+    for (const auto& axis : sweep) {
+        for (const auto& value : axis.values) {
+            points.push_back(sweepPointOutput(benchmarkSettings->output, axis.setting, value));
+            config.clearOverrides();
+            config.override(vk_config::settingName(axis.setting), value);
+            config.override(BENCH_OUTPUT_ENVIRONMENT_VARIABLE, points.back().string());
+            VK_LOG_INFO("Benchmark sweep: {} = {}", axis.setting, value);
+            if (!runApp(false)) {
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    config.clearOverrides();
     try {
-        app.run();
+        writeSweepResults(benchmarkSettings->output, points);
     } catch (const std::exception& e) {
-        std::cerr << e.what() << std::endl;
+        VK_LOG_ERROR("{}", e.what());
+        vk_log::flush();
         return EXIT_FAILURE;
     }
 
+    VK_LOG_INFO("Wrote benchmark sweep results to {}", benchmarkSettings->output.string());
+
     return EXIT_SUCCESS;
 }
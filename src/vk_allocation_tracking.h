@@ -0,0 +1,342 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+
+#include <fmt/core.h>
+#include <fmt/ostream.h>
+
+// Set by the build with the `HELLO_WINDOW_ALLOCATION_TRACKING` option, which replaces the global
+// `operator new` and `operator delete` in main.cpp with ones that count every allocation.
+// Without it nothing is counted and every tag below compiles to nothing.
+#ifndef HELLO_WINDOW_ALLOCATION_TRACKING
+#define HELLO_WINDOW_ALLOCATION_TRACKING 0
+#endif
+
+#if HELLO_WINDOW_ALLOCATION_TRACKING
+// Attributes the allocations up to the end of the enclosing scope to a call site named by a
+// string literal.
+#define VK_ALLOCATION_TAG(name) const auto vkAllocationTag = ::vk_allocation_tracking::ScopedTag { name }
+#else
+#define VK_ALLOCATION_TAG(name)
+#endif
+
+
+namespace vk_allocation_tracking {
+    // What the frame loop does with the allocations it counts.
+    //
+    // * `Off` counts them, and only prints the totals at exit.
+    // * `Report` also prints the threads and call sites that allocated the most at exit.
+    // * `Assert` also fails the first steady state frame that allocated on the thread drawing
+    //   it, after printing the call sites that did.
+    enum class AllocationCheck {
+        Off,
+        Report,
+        Assert,
+    };
+
+    inline constexpr size_t MAX_THREADS = 64;
+    inline constexpr size_t MAX_TAGS = 256;
+    inline constexpr size_t THREAD_NAME_SIZE = 32;
+    // Frames up to this one fill the caches, pools and arenas the rest reuse, so they are
+    // allowed to allocate.
+    inline constexpr uint64_t WARMUP_FRAMES = 8;
+    inline constexpr const char* UNTAGGED = "untagged";
+
+    struct ThreadCounters {
+        std::atomic<uint64_t> allocationCount = 0;
+        std::atomic<uint64_t> allocatedBytes = 0;
+        std::array<char, THREAD_NAME_SIZE> name {};
+    };
+
+    struct TagCounters {
+        std::atomic<const char*> tag = nullptr;
+        std::atomic<uint64_t> allocationCount = 0;
+        std::atomic<uint64_t> allocatedBytes = 0;
+    };
+
+    // Counts allocations by thread and by call site, without allocating itself, since it runs
+    // inside `operator new`. Constant initialized, so allocations made before `main` count too.
+    //
+    // A thread takes a slot the first time it allocates, and the threads past `MAX_THREADS`
+    // share the last one. A call site is the innermost `VK_ALLOCATION_TAG` around the
+    // allocation, which every `VK_TRACING_ZONE` also sets, told apart by the address of its
+    // name, and the call sites past `MAX_TAGS` count as untagged.
+    class AllocationTracker {
+        public:
+            constexpr AllocationTracker() = default;
+
+            AllocationTracker(const AllocationTracker& other) = delete;
+            AllocationTracker& operator=(const AllocationTracker& other) = delete;
+
+            void record(size_t size) {
+                auto& thread = m_threads[this->threadIndex()];
+                thread.allocationCount.fetch_add(1, std::memory_order_relaxed);
+                thread.allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+
+                auto& tag = m_tags[this->tagIndex(currentTag())];
+                tag.allocationCount.fetch_add(1, std::memory_order_relaxed);
+                tag.allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+            }
+
+            // The name the report shows the calling thread under, cut to fit its slot.
+            void nameThread(std::string_view name) {
+                auto& slot = m_threads[this->threadIndex()].name;
+                const auto size = std::min(name.size(), slot.size() - 1);
+                std::memcpy(slot.data(), name.data(), size);
+                slot[size] = '\0';
+            }
+
+            // The allocations the calling thread made so far.
+            uint64_t threadAllocationCount() {
+                return m_threads[this->threadIndex()].allocationCount.load(std::memory_order_relaxed);
+            }
+
+            uint64_t tagAllocationCount(size_t index) const {
+                return m_tags[index].allocationCount.load(std::memory_order_relaxed);
+            }
+
+            const char* tagName(size_t index) const {
+                const auto* tag = m_tags[index].tag.load(std::memory_order_acquire);
+
+                return tag != nullptr ? tag : UNTAGGED;
+            }
+
+            void report(std::ostream& out, AllocationCheck check) const {
+                auto totalCount = uint64_t { 0 };
+                auto totalBytes = uint64_t { 0 };
+                for (const auto& thread : m_threads) {
+                    totalCount += thread.allocationCount.load(std::memory_order_relaxed);
+                    totalBytes += thread.allocatedBytes.load(std::memory_order_relaxed);
+                }
+
+                fmt::println(out, "Heap allocations: {} totalling {} bytes", totalCount, totalBytes);
+                if (check == AllocationCheck::Off) {
+                    return;
+                }
+
+                const auto threadCount = std::min(m_threadCount.load(std::memory_order_relaxed), MAX_THREADS);
+                fmt::println(out, "{:<32} {:>12} {:>16}", "Thread", "Allocations", "Bytes");
+                for (size_t i = 0; i < threadCount; i++) {
+                    const auto& thread = m_threads[i];
+                    fmt::println(
+                        out,
+                        "{:<32} {:>12} {:>16}",
+                        thread.name[0] != '\0' ? thread.name.data() : (i == 0 ? "main" : "unnamed"),
+                        thread.allocationCount.load(std::memory_order_relaxed),
+                        thread.allocatedBytes.load(std::memory_order_relaxed)
+                    );
+                }
+
+                auto order = std::array<size_t, MAX_TAGS + 1> {};
+                for (size_t i = 0; i < order.size(); i++) {
+                    order[i] = i;
+                }
+
+                std::sort(order.begin(), order.end(), [this](size_t lhs, size_t rhs) {
+                    return this->tagAllocationCount(lhs) > this->tagAllocationCount(rhs);
+                });
+                fmt::println(out, "{:<32} {:>12} {:>16}", "Call site", "Allocations", "Bytes");
+                for (const auto index : order) {
+                    if (this->tagAllocationCount(index) == 0) {
+                        break;
+                    }
+
+                    fmt::println(out, "{:<32} {:>12} {:>16}", this->tagName(index), this->tagAllocationCount(index), m_tags[index].allocatedBytes.load(std::memory_order_relaxed));
+                }
+            }
+
+            static const char*& currentTag() {
+                thread_local const char* tag = nullptr;
+
+                return tag;
+            }
+        private:
+            std::array<ThreadCounters, MAX_THREADS> m_threads {};
+            std::atomic<size_t> m_threadCount = 0;
+            // The last slot is the untagged one, never claimed by a call site.
+            std::array<TagCounters, MAX_TAGS + 1> m_tags {};
+
+            size_t threadIndex() {
+                thread_local size_t index = std::min(m_threadCount.fetch_add(1, std::memory_order_relaxed), MAX_THREADS - 1);
+
+                return index;
+            }
+
+            // Probes from the hash of the name's address, and claims the first empty slot for
+            // a name it has not seen.
+            size_t tagIndex(const char* name) {
+                if (name == nullptr) {
+                    return MAX_TAGS;
+                }
+
+                const auto hash = (reinterpret_cast<uintptr_t>(name) >> 3) * 0x9E3779B97F4A7C15ull;
+                for (size_t probe = 0; probe < MAX_TAGS; probe++) {
+                    const auto index = (hash + probe) % MAX_TAGS;
+                    auto* expected = m_tags[index].tag.load(std::memory_order_acquire);
+                    if (expected == name) {
+                        return index;
+                    }
+
+                    if (expected == nullptr) {
+                        if (m_tags[index].tag.compare_exchange_strong(expected, name, std::memory_order_acq_rel) || expected == name) {
+                            return index;
+                        }
+                    }
+                }
+
+                return MAX_TAGS;
+            }
+    };
+
+    constinit inline AllocationTracker tracker;
+
+    // Sets the call site the calling thread's allocations count against, and puts the one
+    // around it back at the end of the scope.
+    class ScopedTag {
+        public:
+            explicit ScopedTag(const char* name) : m_previous { AllocationTracker::currentTag() } {
+                AllocationTracker::currentTag() = name;
+            }
+
+            ~ScopedTag() {
+                AllocationTracker::currentTag() = m_previous;
+            }
+
+            ScopedTag(const ScopedTag& other) = delete;
+            ScopedTag& operator=(const ScopedTag& other) = delete;
+        private:
+            const char* m_previous;
+    };
+
+    // The heap behind the replaced operators. Aligned blocks come from the platform's aligned
+    // allocator, which on Windows needs its own free.
+    inline void* allocate(size_t size) {
+        tracker.record(size);
+        if (void* memory = std::malloc(size == 0 ? 1 : size)) {
+            return memory;
+        }
+
+        throw std::bad_alloc {};
+    }
+
+    inline void* allocateAligned(size_t size, size_t alignment) {
+        tracker.record(size);
+        const auto padded = (std::max<size_t>(size, 1) + alignment - 1) / alignment * alignment;
+#if defined(_WIN32)
+        void* memory = _aligned_malloc(padded, alignment);
+#else
+        void* memory = std::aligned_alloc(alignment, padded);
+#endif
+        if (memory != nullptr) {
+            return memory;
+        }
+
+        throw std::bad_alloc {};
+    }
+
+    inline void deallocate(void* memory) {
+        std::free(memory);
+    }
+
+    inline void deallocateAligned(void* memory) {
+#if defined(_WIN32)
+        _aligned_free(memory);
+#else
+        std::free(memory);
+#endif
+    }
+
+    // Checks that the frame loop stays allocation free once it is warmed up. Only the thread
+    // drawing frames is checked, since the others also run work unrelated to the frame; the
+    // report at exit shows what they allocated.
+    class FrameAllocationCheck {
+        public:
+            explicit FrameAllocationCheck() = default;
+
+            FrameAllocationCheck(const FrameAllocationCheck& other) = delete;
+            FrameAllocationCheck& operator=(const FrameAllocationCheck& other) = delete;
+
+            void init(AllocationCheck check) {
+                m_check = check;
+            }
+
+            void beginFrame() {
+                m_frameStart = tracker.threadAllocationCount();
+                if (m_check == AllocationCheck::Assert) {
+                    for (size_t i = 0; i < m_tagCounts.size(); i++) {
+                        m_tagCounts[i] = tracker.tagAllocationCount(i);
+                    }
+                }
+            }
+
+            // Lets the current frame allocate, for one that rebuilds what the frames after it
+            // reuse, like a swapchain.
+            void exemptFrame() {
+                m_exempt = true;
+            }
+
+            // Throws if a steady state frame allocated in `Assert` mode.
+            void endFrame() {
+                const auto allocations = tracker.threadAllocationCount() - m_frameStart;
+                const auto exempt = std::exchange(m_exempt, false) || m_frameCount < WARMUP_FRAMES;
+                m_frameCount++;
+                if (allocations == 0 || exempt) {
+                    return;
+                }
+
+                m_allocatingFrames++;
+                if (m_check != AllocationCheck::Assert) {
+                    return;
+                }
+
+                // Taken before printing, which allocates too.
+                for (size_t i = 0; i < m_tagCounts.size(); i++) {
+                    m_tagCounts[i] = tracker.tagAllocationCount(i) - m_tagCounts[i];
+                }
+
+                fmt::println(std::cerr, "Frame {} made {} heap allocations:", m_frameCount - 1, allocations);
+                for (size_t i = 0; i < m_tagCounts.size(); i++) {
+                    if (m_tagCounts[i] > 0) {
+                        fmt::println(std::cerr, "    {}: {}", tracker.tagName(i), m_tagCounts[i]);
+                    }
+                }
+
+                throw std::runtime_error("failed to keep the frame loop allocation free!");
+            }
+
+            // The steady state frames that allocated on the thread drawing them.
+            uint64_t allocatingFrames() const {
+                return m_allocatingFrames;
+            }
+
+            void report(std::ostream& out) const {
+                if (!HELLO_WINDOW_ALLOCATION_TRACKING) {
+                    return;
+                }
+
+                tracker.report(out, m_check);
+                fmt::println(out, "Steady state frames that allocated: {}", m_allocatingFrames);
+            }
+        private:
+            AllocationCheck m_check = AllocationCheck::Off;
+            uint64_t m_frameStart = 0;
+            uint64_t m_frameCount = 0;
+            uint64_t m_allocatingFrames = 0;
+            bool m_exempt = false;
+            // Every call site's count at the start of the frame, which the counts at its end
+            // are compared with. Other threads count too, so a failed frame can list a few
+            // allocations that were not its own.
+            std::array<uint64_t, MAX_TAGS + 1> m_tagCounts {};
+    };
+}
@@ -0,0 +1,280 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "vk_jobs.h"
+#include "vk_transforms.h"
+#include "vk_vertex_format.h"
+
+
+namespace vk_animation {
+    // The most joints a skeleton may have, the size of the joint palette `skin.comp` reads.
+    // Matches `SKIN_MAX_JOINTS`.
+    constexpr uint32_t MAX_JOINTS = 64;
+
+    // A unit quaternion in 48 bits, as the three components besides the largest: each lies
+    // within [-1/sqrt(2), 1/sqrt(2)] and takes 15 bits, and the largest, which is made positive
+    // and follows from the others, is named by two bits tucked into the first two components'
+    // top bits. The error is well below a hundredth of a degree.
+    struct QuantizedRotation {
+        std::array<uint16_t, 3> components;
+    };
+
+    inline QuantizedRotation quantizeRotation(glm::quat rotation) {
+        rotation = glm::normalize(rotation);
+        const auto values = std::array { rotation.x, rotation.y, rotation.z, rotation.w };
+        auto largest = size_t { 0 };
+        for (size_t i = 1; i < values.size(); i++) {
+            if (std::abs(values[i]) > std::abs(values[largest])) {
+                largest = i;
+            }
+        }
+
+        // q and -q are the same rotation.
+        const auto sign = values[largest] < 0.0f ? -1.0f : 1.0f;
+        auto quantized = QuantizedRotation {};
+        auto component = size_t { 0 };
+        for (size_t i = 0; i < values.size(); i++) {
+            if (i == largest) {
+                continue;
+            }
+
+            const auto normalized = std::clamp(sign * values[i] * std::sqrt(2.0f) * 0.5f + 0.5f, 0.0f, 1.0f);
+            auto bits = static_cast<uint16_t>(std::round(normalized * 32767.0f));
+            if (component < 2) {
+                bits |= static_cast<uint16_t>(((largest >> component) & 1) << 15);
+            }
+            quantized.components[component++] = bits;
+        }
+
+        return quantized;
+    }
+
+    inline glm::quat dequantizeRotation(const QuantizedRotation& quantized) {
+        const auto largest = static_cast<size_t>((quantized.components[0] >> 15) | ((quantized.components[1] >> 15) << 1));
+        auto values = std::array<float, 4> {};
+        auto sum = 0.0f;
+        auto component = size_t { 0 };
+        for (size_t i = 0; i < values.size(); i++) {
+            if (i == largest) {
+                continue;
+            }
+
+            const auto bits = quantized.components[component++] & 0x7fff;
+            values[i] = (static_cast<float>(bits) / 32767.0f * 2.0f - 1.0f) / std::sqrt(2.0f);
+            sum += values[i] * values[i];
+        }
+        values[largest] = std::sqrt(std::max(1.0f - sum, 0.0f));
+
+        return glm::quat { values[3], values[0], values[1], values[2] };
+    }
+
+    // A clip sampled at a fixed rate, every key of every joint quantized: rotations to 48
+    // bits, and translations to 16 bits a component relative to the box each joint's
+    // translations span over the clip. Scales are left out, joints only rotate and move.
+    // Keys are stored frame by frame, the joints of a frame next to each other, so sampling a
+    // whole skeleton reads two runs of memory.
+    struct CompressedClip {
+        float sampleRate = 30.0f;
+        uint32_t frameCount = 0;
+        uint32_t jointCount = 0;
+        std::vector<QuantizedRotation> rotations;
+        std::vector<std::array<uint16_t, 3>> translations;
+        std::vector<vk_vertex_format::QuantizationBounds> translationBounds;
+
+        // The last frame is the first one again, so the clip loops without a seam.
+        float duration() const {
+            return static_cast<float>(frameCount) / sampleRate;
+        }
+    };
+
+    // Compresses `frameCount` frames of `jointCount` joints each, frame by frame, sampled at
+    // `sampleRate` frames a second.
+    inline CompressedClip compressClip(std::span<const vk_transforms::LocalTransform> frames, uint32_t jointCount, float sampleRate) {
+        if (jointCount == 0 || frames.size() % jointCount != 0) {
+            throw std::runtime_error("failed to compress animation clip, frames must hold every joint!");
+        }
+
+        auto clip = CompressedClip {
+            .sampleRate = sampleRate,
+            .frameCount = static_cast<uint32_t>(frames.size() / jointCount),
+            .jointCount = jointCount,
+        };
+        for (uint32_t joint = 0; joint < jointCount; joint++) {
+            auto positions = std::vector<glm::vec3> {};
+            for (uint32_t frame = 0; frame < clip.frameCount; frame++) {
+                positions.push_back(frames[frame * jointCount + joint].position);
+            }
+            clip.translationBounds.push_back(vk_vertex_format::computeBounds(positions));
+        }
+
+        clip.rotations.reserve(frames.size());
+        clip.translations.reserve(frames.size());
+        for (size_t key = 0; key < frames.size(); key++) {
+            const auto position = vk_vertex_format::quantizePosition(frames[key].position, clip.translationBounds[key % jointCount]);
+            clip.rotations.push_back(vk_animation::quantizeRotation(frames[key].rotation));
+            clip.translations.push_back({ position[0], position[1], position[2] });
+        }
+
+        return clip;
+    }
+
+    // The pose of `joint` at `seconds` into the looping clip, between the two keys around it.
+    inline vk_transforms::LocalTransform sampleJoint(const CompressedClip& clip, uint32_t joint, float seconds) {
+        const auto frames = static_cast<float>(clip.frameCount);
+        const auto position = std::fmod(std::max(seconds, 0.0f) * clip.sampleRate, frames);
+        const auto first = std::min(static_cast<uint32_t>(position), clip.frameCount - 1);
+        const auto second = (first + 1) % clip.frameCount;
+        const auto blend = position - static_cast<float>(first);
+
+        const auto& bounds = clip.translationBounds[joint];
+        const auto translation = [&](uint32_t frame) {
+            const auto& quantized = clip.translations[frame * clip.jointCount + joint];
+
+            return bounds.min + glm::vec3 { quantized[0], quantized[1], quantized[2] } / 65535.0f * bounds.extent;
+        };
+
+        // The shorter way around, and normalized, which is as good as a slerp between keys
+        // this close.
+        const auto from = vk_animation::dequantizeRotation(clip.rotations[first * clip.jointCount + joint]);
+        auto to = vk_animation::dequantizeRotation(clip.rotations[second * clip.jointCount + joint]);
+        if (glm::dot(from, to) < 0.0f) {
+            to = -to;
+        }
+
+        return vk_transforms::LocalTransform {
+            .position = glm::mix(translation(first), translation(second), blend),
+            .rotation = glm::normalize(from * (1.0f - blend) + to * blend),
+            .scale = 1.0f,
+        };
+    }
+
+    // Joints in breadth first order, every joint's parent before it, with the pose the mesh
+    // was bound to them in.
+    struct Skeleton {
+        std::vector<uint32_t> parents;
+        std::vector<vk_transforms::LocalTransform> bindPose;
+    };
+
+    // Plays a clip on a skeleton, and keeps the joint palette that skins a mesh to the pose:
+    // each joint's world matrix times the inverse of its world matrix in the bind pose.
+    //
+    // Jobs of `JOINTS_PER_JOB` sample the clip's joints, the skeleton's world matrices are then
+    // updated a level at a time by `vk_transforms::TransformHierarchy`, and the palette is
+    // composed from them in jobs again, with glm's vector math, which the SIMD paths take with
+    // `GLM_FORCE_INTRINSICS`.
+    class Animator {
+        public:
+            static constexpr size_t JOINTS_PER_JOB = 16;
+
+            explicit Animator() = default;
+
+            Animator(const Animator& other) = delete;
+            Animator& operator=(const Animator& other) = delete;
+
+            void init(const Skeleton& skeleton, CompressedClip clip) {
+                const auto jointCount = skeleton.parents.size();
+                if (jointCount == 0 || jointCount > MAX_JOINTS || skeleton.bindPose.size() != jointCount || clip.jointCount != jointCount) {
+                    throw std::runtime_error("failed to create animator, the skeleton and the clip do not match!");
+                }
+
+                m_clip = std::move(clip);
+                m_hierarchy.clear();
+                m_inverseBindMatrices.clear();
+                auto bindWorlds = std::vector<vk_transforms::WorldMatrix> {};
+                for (size_t joint = 0; joint < jointCount; joint++) {
+                    const auto parent = skeleton.parents[joint];
+                    m_hierarchy.addNode(parent, skeleton.bindPose[joint]);
+
+                    const auto local = vk_transforms::toMatrix(skeleton.bindPose[joint]);
+                    bindWorlds.push_back(parent == vk_transforms::TransformHierarchy::NO_PARENT ? local : vk_transforms::multiply(bindWorlds[parent], local));
+                    m_inverseBindMatrices.push_back(Animator::inverse(bindWorlds.back()));
+                }
+
+                m_locals.assign(jointCount, vk_transforms::LocalTransform {});
+                m_palette.assign(jointCount, vk_transforms::WorldMatrix {});
+            }
+
+            bool isInitialized() const {
+                return !m_palette.empty();
+            }
+
+            size_t jointCount() const {
+                return m_palette.size();
+            }
+
+            // Poses the skeleton `seconds` into the clip, and recomposes the palette.
+            void update(vk_jobs::JobSystem& jobSystem, float seconds) {
+                const auto jointCount = m_palette.size();
+                const auto jobCount = (jointCount + JOINTS_PER_JOB - 1) / JOINTS_PER_JOB;
+                {
+                    auto tasks = vk_jobs::TaskGroup { jobSystem };
+                    for (size_t job = 0; job < jobCount; job++) {
+                        tasks.run([this, seconds, begin = job * JOINTS_PER_JOB, end = std::min((job + 1) * JOINTS_PER_JOB, jointCount)]() {
+                            for (auto joint = begin; joint < end; joint++) {
+                                m_locals[joint] = vk_animation::sampleJoint(m_clip, static_cast<uint32_t>(joint), seconds);
+                            }
+                        });
+                    }
+                    tasks.wait();
+                }
+
+                for (size_t joint = 0; joint < jointCount; joint++) {
+                    m_hierarchy.setLocal(static_cast<uint32_t>(joint), m_locals[joint]);
+                }
+                m_hierarchy.update(jobSystem);
+
+                auto tasks = vk_jobs::TaskGroup { jobSystem };
+                for (size_t job = 0; job < jobCount; job++) {
+                    tasks.run([this, begin = job * JOINTS_PER_JOB, end = std::min((job + 1) * JOINTS_PER_JOB, jointCount)]() {
+                        for (auto joint = begin; joint < end; joint++) {
+                            m_palette[joint] = vk_transforms::multiply(m_hierarchy.world(static_cast<uint32_t>(joint)), m_inverseBindMatrices[joint]);
+                        }
+                    });
+                }
+                tasks.wait();
+            }
+
+            // A matrix per joint, in the layout of `vk_transforms::WorldMatrix`, valid as of the
+            // last `update`.
+            std::span<const vk_transforms::WorldMatrix> palette() const {
+                return m_palette;
+            }
+        private:
+            CompressedClip m_clip;
+            vk_transforms::TransformHierarchy m_hierarchy;
+            std::vector<vk_transforms::WorldMatrix> m_inverseBindMatrices;
+            std::vector<vk_transforms::LocalTransform> m_locals;
+            std::vector<vk_transforms::WorldMatrix> m_palette;
+
+            // The inverse of an affine transform that rotates, scales uniformly and moves.
+            static vk_transforms::WorldMatrix inverse(const vk_transforms::WorldMatrix& matrix) {
+                auto linear = glm::mat3 {};
+                for (glm::length_t row = 0; row < 3; row++) {
+                    for (glm::length_t column = 0; column < 3; column++) {
+                        linear[column][row] = matrix.rows[row][column];
+                    }
+                }
+
+                const auto inverseLinear = glm::inverse(linear);
+                const auto translation = -(inverseLinear * glm::vec3 { matrix.rows[0].w, matrix.rows[1].w, matrix.rows[2].w });
+                auto inverted = vk_transforms::WorldMatrix {};
+                for (glm::length_t row = 0; row < 3; row++) {
+                    inverted.rows[row] = glm::vec4 { inverseLinear[0][row], inverseLinear[1][row], inverseLinear[2][row], translation[row] };
+                }
+
+                return inverted;
+            }
+    };
+}
@@ -0,0 +1,786 @@
+#pragma once
+
+// Pulls in `windows.h` on Windows, with the same macros as everywhere else.
+#include "vk_dispatch.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "vk_async_io.h"
+#include "vk_memory.h"
+#include "vk_upload.h"
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+namespace vk_assets {
+    // An asset pack is one file: a header, the index of its entries sorted by name, and the
+    // blobs, each starting on a `BLOB_ALIGNMENT` boundary. Blobs hold exactly the bytes the GPU
+    // reads, vertex and index data or tightly packed texels of a mip level, so loading one is
+    // nothing more than pointing a copy at it. Blobs may instead be compressed, see
+    // `Compression`, to be expanded on the GPU after a smaller copy.
+    constexpr std::array<char, 8> PACK_MAGIC = { 'H', 'W', 'P', 'A', 'C', 'K', '\0', '\0' };
+    constexpr uint32_t PACK_VERSION = 2;
+
+    // A page on every desktop system, which is also the `minImportedHostPointerAlignment` of
+    // every driver that reports one. The file is padded to a multiple of it, so the whole
+    // mapping can be imported.
+    constexpr uint64_t BLOB_ALIGNMENT = 4096;
+
+    enum class AssetKind : uint32_t {
+        Buffer,
+        Image,
+    };
+
+    // How a blob is stored.
+    //
+    // * `None` stores the bytes as they are.
+    // * `Lz4` splits them into chunks of `COMPRESSION_CHUNK_SIZE` bytes, each compressed on its
+    //   own in the LZ4 block format, so that every chunk can be expanded in parallel. The blob
+    //   starts with `chunkCount + 1` little endian 32 bit offsets from the start of the blob,
+    //   the last being its end, and chunk `i` lies between offsets `i` and `i + 1`. A chunk
+    //   that would not get any smaller is stored as it is, which is the case exactly when its
+    //   stored size is its uncompressed size.
+    enum class Compression : uint32_t {
+        None,
+        Lz4,
+    };
+
+    // Large enough that the LZ4 window of 64 KiB fits in a chunk, small enough that a blob of
+    // a few megabytes spreads over every subgroup of the GPU.
+    constexpr uint32_t COMPRESSION_CHUNK_SIZE = 65536;
+
+    struct PackHeader {
+        std::array<char, 8> magic;
+        uint32_t version;
+        uint32_t entryCount;
+        uint64_t fileSize;
+    };
+
+    static_assert(sizeof(PackHeader) == 24, "PackHeader must match the asset pack layout");
+
+    // `format`, `width` and `height` describe image blobs and are zero for buffers. `name` is
+    // zero terminated. `size` is what the blob takes up in the pack, and `uncompressedSize`
+    // what it expands to, the same for uncompressed blobs, which have no chunks.
+    struct PackEntry {
+        std::array<char, 48> name;
+        AssetKind kind;
+        VkFormat format;
+        uint32_t width;
+        uint32_t height;
+        uint64_t offset;
+        uint64_t size;
+        Compression compression;
+        uint32_t chunkCount;
+        uint64_t uncompressedSize;
+
+        std::string_view nameView() const {
+            return std::string_view { name.data(), ::strnlen(name.data(), name.size()) };
+        }
+    };
+
+    static_assert(sizeof(PackEntry) == 96, "PackEntry must match the asset pack layout");
+
+    inline uint64_t alignBlob(uint64_t offset) {
+        return (offset + BLOB_ALIGNMENT - 1) / BLOB_ALIGNMENT * BLOB_ALIGNMENT;
+    }
+
+    inline uint32_t chunkCount(uint64_t uncompressedSize) {
+        return static_cast<uint32_t>((uncompressedSize + COMPRESSION_CHUNK_SIZE - 1) / COMPRESSION_CHUNK_SIZE);
+    }
+
+    // Compresses one chunk as an LZ4 block, appending it to `output`. A greedy matcher over a
+    // hash of the next four bytes, which is what the asset pipeline can afford, and follows the
+    // format's end of block rules, so any LZ4 decoder reads its output.
+    inline void compressChunk(std::span<const std::byte> input, std::vector<std::byte>& output) {
+        constexpr size_t MIN_MATCH = 4;
+        // The last five bytes are always literals, and the last match starts 12 bytes before
+        // the end at the latest.
+        constexpr size_t LAST_LITERALS = 5;
+        constexpr size_t MATCH_LIMIT = 12;
+        constexpr size_t MAX_OFFSET = 65535;
+        constexpr uint32_t HASH_BITS = 12;
+        constexpr uint32_t NO_POSITION = UINT32_MAX;
+
+        const auto read32 = [&input](size_t position) {
+            uint32_t value = 0;
+            std::memcpy(&value, input.data() + position, sizeof(value));
+
+            return value;
+        };
+        const auto put = [&output](size_t value) {
+            output.push_back(static_cast<std::byte>(value));
+        };
+        const auto putLength = [&put](size_t length) {
+            for (; length >= 255; length -= 255) {
+                put(255);
+            }
+            put(length);
+        };
+        const auto putLiterals = [&output, &input, &put, &putLength](size_t first, size_t last, size_t matchToken) {
+            const auto length = last - first;
+            put((std::min(length, size_t { 15 }) << 4) | matchToken);
+            if (length >= 15) {
+                putLength(length - 15);
+            }
+            output.insert(output.end(), input.begin() + static_cast<std::ptrdiff_t>(first), input.begin() + static_cast<std::ptrdiff_t>(last));
+        };
+
+        auto table = std::vector<uint32_t>(size_t { 1 } << HASH_BITS, NO_POSITION);
+        size_t anchor = 0;
+        size_t position = 0;
+        if (input.size() > MATCH_LIMIT) {
+            const auto matchEnd = input.size() - LAST_LITERALS;
+            const auto searchEnd = input.size() - MATCH_LIMIT;
+            while (position <= searchEnd) {
+                const auto value = read32(position);
+                const auto hash = (value * 2654435761u) >> (32 - HASH_BITS);
+                const auto candidate = table[hash];
+                table[hash] = static_cast<uint32_t>(position);
+                if (candidate == NO_POSITION || position - candidate > MAX_OFFSET || read32(candidate) != value) {
+                    position++;
+                    continue;
+                }
+
+                auto length = MIN_MATCH;
+                while (position + length < matchEnd && input[candidate + length] == input[position + length]) {
+                    length++;
+                }
+
+                const auto matchLength = length - MIN_MATCH;
+                putLiterals(anchor, position, std::min(matchLength, size_t { 15 }));
+                const auto offset = position - candidate;
+                put(offset & 0xFF);
+                put(offset >> 8);
+                if (matchLength >= 15) {
+                    putLength(matchLength - 15);
+                }
+
+                position += length;
+                anchor = position;
+            }
+        }
+
+        putLiterals(anchor, input.size(), 0);
+    }
+
+    // Expands an LZ4 block into `output`, which it has to fill exactly. Returns false for
+    // a malformed block rather than reading or writing out of bounds.
+    inline bool decompressChunk(std::span<const std::byte> input, std::span<std::byte> output) {
+        size_t in = 0;
+        size_t out = 0;
+        const auto readLength = [&input, &in](size_t& length) {
+            auto value = size_t { 255 };
+            while (value == 255) {
+                if (in == input.size()) {
+                    return false;
+                }
+                value = static_cast<size_t>(input[in++]);
+                length += value;
+            }
+
+            return true;
+        };
+
+        while (in < input.size()) {
+            const auto token = static_cast<size_t>(input[in++]);
+            auto literalLength = token >> 4;
+            if (literalLength == 15 && !readLength(literalLength)) {
+                return false;
+            }
+            if (literalLength > input.size() - in || literalLength > output.size() - out) {
+                return false;
+            }
+
+            std::memcpy(output.data() + out, input.data() + in, literalLength);
+            in += literalLength;
+            out += literalLength;
+            if (in == input.size()) {
+                break;
+            }
+
+            if (input.size() - in < 2) {
+                return false;
+            }
+            const auto offset = static_cast<size_t>(input[in]) | (static_cast<size_t>(input[in + 1]) << 8);
+            in += 2;
+            auto matchLength = (token & 15) + 4;
+            if ((token & 15) == 15 && !readLength(matchLength)) {
+                return false;
+            }
+            if (offset == 0 || offset > out || matchLength > output.size() - out) {
+                return false;
+            }
+
+            // Matches may overlap what they write, which repeats their first `offset` bytes.
+            for (size_t i = 0; i < matchLength; i++) {
+                output[out + i] = output[out + i - offset];
+            }
+            out += matchLength;
+        }
+
+        return out == output.size();
+    }
+
+    // A blob of `Compression::Lz4`, chunk table first.
+    inline std::vector<std::byte> compressBlob(std::span<const std::byte> data) {
+        const auto count = chunkCount(data.size());
+        auto blob = std::vector<std::byte>((size_t { count } + 1) * sizeof(uint32_t));
+        auto offsets = std::vector<uint32_t>(size_t { count } + 1);
+        auto compressed = std::vector<std::byte> {};
+        for (uint32_t chunk = 0; chunk < count; chunk++) {
+            offsets[chunk] = static_cast<uint32_t>(blob.size());
+
+            const auto first = size_t { chunk } * COMPRESSION_CHUNK_SIZE;
+            const auto input = data.subspan(first, std::min<size_t>(COMPRESSION_CHUNK_SIZE, data.size() - first));
+            compressed.clear();
+            compressChunk(input, compressed);
+            if (compressed.size() < input.size()) {
+                blob.insert(blob.end(), compressed.begin(), compressed.end());
+            } else {
+                blob.insert(blob.end(), input.begin(), input.end());
+            }
+
+            if (blob.size() > UINT32_MAX) {
+                throw std::runtime_error("failed to compress asset, blob is larger than 4 GiB!");
+            }
+        }
+
+        offsets[count] = static_cast<uint32_t>(blob.size());
+        std::memcpy(blob.data(), offsets.data(), offsets.size() * sizeof(uint32_t));
+
+        return blob;
+    }
+
+    // Expands a blob of `Compression::Lz4` on the CPU, for devices without the GPU
+    // decompressor. Returns false for a malformed blob.
+    inline bool decompressBlob(std::span<const std::byte> blob, uint32_t count, std::span<std::byte> output) {
+        if (chunkCount(output.size()) != count || blob.size() < (size_t { count } + 1) * sizeof(uint32_t)) {
+            return false;
+        }
+
+        auto offsets = std::vector<uint32_t>(size_t { count } + 1);
+        std::memcpy(offsets.data(), blob.data(), offsets.size() * sizeof(uint32_t));
+        for (uint32_t chunk = 0; chunk < count; chunk++) {
+            if (offsets[chunk] > offsets[chunk + 1] || offsets[chunk + 1] > blob.size()) {
+                return false;
+            }
+
+            const auto first = size_t { chunk } * COMPRESSION_CHUNK_SIZE;
+            const auto destination = output.subspan(first, std::min<size_t>(COMPRESSION_CHUNK_SIZE, output.size() - first));
+            const auto source = blob.subspan(offsets[chunk], offsets[chunk + 1] - offsets[chunk]);
+            if (source.size() == destination.size()) {
+                std::memcpy(destination.data(), source.data(), source.size());
+            } else if (!decompressChunk(source, destination)) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // A read only view of a whole file. The pages are read in by the first access to them, so
+    // opening a pack is cheap and only the blobs that are uploaded are ever read from disk.
+    class MappedFile {
+        public:
+            explicit MappedFile() = default;
+
+            MappedFile(const MappedFile& other) = delete;
+            MappedFile& operator=(const MappedFile& other) = delete;
+
+            ~MappedFile() {
+                this->close();
+            }
+
+            void open(const std::filesystem::path& path) {
+                this->close();
+
+#if defined(_WIN32)
+                m_file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+                if (m_file == INVALID_HANDLE_VALUE) {
+                    throw std::runtime_error("failed to open asset pack!");
+                }
+
+                auto size = LARGE_INTEGER {};
+                if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0) {
+                    this->close();
+                    throw std::runtime_error("failed to open asset pack!");
+                }
+
+                m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                if (m_mapping == nullptr) {
+                    this->close();
+                    throw std::runtime_error("failed to map asset pack!");
+                }
+
+                m_data = static_cast<const std::byte*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+                if (m_data == nullptr) {
+                    this->close();
+                    throw std::runtime_error("failed to map asset pack!");
+                }
+
+                m_size = static_cast<size_t>(size.QuadPart);
+#else
+                m_file = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+                if (m_file < 0) {
+                    throw std::runtime_error("failed to open asset pack!");
+                }
+
+                struct stat status = {};
+                if (::fstat(m_file, &status) != 0 || status.st_size == 0) {
+                    this->close();
+                    throw std::runtime_error("failed to open asset pack!");
+                }
+
+                auto* data = ::mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, m_file, 0);
+                if (data == MAP_FAILED) {
+                    this->close();
+                    throw std::runtime_error("failed to map asset pack!");
+                }
+
+                m_data = static_cast<const std::byte*>(data);
+                m_size = static_cast<size_t>(status.st_size);
+
+                // Blobs are uploaded front to back, so aggressive read ahead keeps the disk busy
+                // while earlier blobs are being copied.
+                ::posix_madvise(data, m_size, POSIX_MADV_SEQUENTIAL);
+#endif
+            }
+
+            void close() {
+#if defined(_WIN32)
+                if (m_data != nullptr) {
+                    UnmapViewOfFile(m_data);
+                }
+                if (m_mapping != nullptr) {
+                    CloseHandle(m_mapping);
+                }
+                if (m_file != INVALID_HANDLE_VALUE) {
+                    CloseHandle(m_file);
+                }
+
+                m_mapping = nullptr;
+                m_file = INVALID_HANDLE_VALUE;
+#else
+                if (m_data != nullptr) {
+                    ::munmap(const_cast<std::byte*>(m_data), m_size);
+                }
+                if (m_file >= 0) {
+                    ::close(m_file);
+                }
+
+                m_file = -1;
+#endif
+                m_data = nullptr;
+                m_size = 0;
+            }
+
+            bool isOpen() const {
+                return m_data != nullptr;
+            }
+
+            // Starts reading the pages of a range in the background, so a later copy out of it
+            // does not fault them in one at a time.
+            void prefetch([[maybe_unused]] size_t offset, [[maybe_unused]] size_t size) const {
+#if !defined(_WIN32)
+                const auto pageSize = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+                const auto first = offset / pageSize * pageSize;
+                ::posix_madvise(const_cast<std::byte*>(m_data) + first, std::min(offset + size, m_size) - first, POSIX_MADV_WILLNEED);
+#endif
+            }
+
+            std::span<const std::byte> bytes() const {
+                return std::span { m_data, m_size };
+            }
+        private:
+#if defined(_WIN32)
+            HANDLE m_file = INVALID_HANDLE_VALUE;
+            HANDLE m_mapping = nullptr;
+#else
+            int m_file = -1;
+#endif
+            const std::byte* m_data = nullptr;
+            size_t m_size = 0;
+    };
+
+    // What `writePack` stores for one asset.
+    struct AssetSource {
+        std::string name;
+        AssetKind kind = AssetKind::Buffer;
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        std::span<const std::byte> data;
+        Compression compression = Compression::None;
+    };
+
+    // Writes the assets to `path` as an asset pack, which is what the asset pipeline runs once
+    // per build so that nothing is decoded at startup.
+    inline void writePack(const std::filesystem::path& path, std::span<const AssetSource> sources) {
+        auto entries = std::vector<PackEntry>(sources.size());
+        auto compressedBlobs = std::vector<std::vector<std::byte>>(sources.size());
+        auto blobs = std::vector<std::span<const std::byte>>(sources.size());
+        auto offset = alignBlob(sizeof(PackHeader) + sources.size() * sizeof(PackEntry));
+        for (size_t i = 0; i < sources.size(); i++) {
+            const auto& source = sources[i];
+            if (source.name.empty() || source.name.size() >= entries[i].name.size()) {
+                throw std::runtime_error("failed to write asset pack, bad asset name!");
+            }
+
+            blobs[i] = source.data;
+            if (source.compression == Compression::Lz4) {
+                compressedBlobs[i] = compressBlob(source.data);
+                blobs[i] = compressedBlobs[i];
+            }
+
+            entries[i] = PackEntry {
+                .name = {},
+                .kind = source.kind,
+                .format = source.format,
+                .width = source.width,
+                .height = source.height,
+                .offset = offset,
+                .size = blobs[i].size(),
+                .compression = source.compression,
+                .chunkCount = source.compression == Compression::Lz4 ? chunkCount(source.data.size()) : 0,
+                .uncompressedSize = source.data.size(),
+            };
+            std::memcpy(entries[i].name.data(), source.name.data(), source.name.size());
+            offset = alignBlob(offset + blobs[i].size());
+        }
+
+        // Blobs stay in the order they were given, which is the order they are expected to be
+        // uploaded in, and only the index is sorted for lookups.
+        std::sort(entries.begin(), entries.end(), [](const PackEntry& a, const PackEntry& b) {
+            return a.nameView() < b.nameView();
+        });
+        const auto duplicate = std::adjacent_find(entries.begin(), entries.end(), [](const PackEntry& a, const PackEntry& b) {
+            return a.nameView() == b.nameView();
+        });
+        if (duplicate != entries.end()) {
+            throw std::runtime_error("failed to write asset pack, duplicate asset name!");
+        }
+
+        const auto header = PackHeader {
+            .magic = PACK_MAGIC,
+            .version = PACK_VERSION,
+            .entryCount = static_cast<uint32_t>(entries.size()),
+            .fileSize = offset,
+        };
+
+        auto file = std::ofstream { path, std::ios::binary | std::ios::trunc };
+        if (!file) {
+            throw std::runtime_error("failed to write asset pack!");
+        }
+
+        const auto padTo = [&file](uint64_t position) {
+            static constexpr auto zeros = std::array<char, BLOB_ALIGNMENT> {};
+            const auto padding = position - static_cast<uint64_t>(file.tellp());
+            file.write(zeros.data(), static_cast<std::streamsize>(padding));
+        };
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(entries.data()), static_cast<std::streamsize>(entries.size() * sizeof(PackEntry)));
+        offset = alignBlob(sizeof(PackHeader) + sources.size() * sizeof(PackEntry));
+        for (const auto& blob : blobs) {
+            padTo(offset);
+            file.write(reinterpret_cast<const char*>(blob.data()), static_cast<std::streamsize>(blob.size()));
+            offset = alignBlob(offset + blob.size());
+        }
+        padTo(offset);
+
+        if (!file) {
+            throw std::runtime_error("failed to write asset pack!");
+        }
+    }
+
+    // A mapped asset pack. Blobs are uploaded from the mapping as they are, either with one
+    // copy into the staging ring, or, where the device can import host memory, with no CPU copy
+    // at all: the whole mapping is imported as a transfer source buffer and the transfer queue
+    // reads the blobs straight out of the page cache.
+    class AssetPack {
+        public:
+            explicit AssetPack() = default;
+
+            AssetPack(const AssetPack& other) = delete;
+            AssetPack& operator=(const AssetPack& other) = delete;
+
+            // Maps and validates the pack. Needs no device, so it can run while the device is
+            // being created.
+            void open(const std::filesystem::path& path) {
+                this->close();
+                m_file.open(path);
+
+                const auto bytes = m_file.bytes();
+                auto header = PackHeader {};
+                if (bytes.size() < sizeof(header)) {
+                    m_file.close();
+                    throw std::runtime_error("failed to open asset pack, file is truncated!");
+                }
+                std::memcpy(&header, bytes.data(), sizeof(header));
+
+                if (header.magic != PACK_MAGIC || header.version != PACK_VERSION) {
+                    m_file.close();
+                    throw std::runtime_error("failed to open asset pack, unknown format!");
+                }
+
+                const auto indexEnd = sizeof(PackHeader) + uint64_t { header.entryCount } * sizeof(PackEntry);
+                if (header.fileSize != bytes.size() || indexEnd > bytes.size()) {
+                    m_file.close();
+                    throw std::runtime_error("failed to open asset pack, file is truncated!");
+                }
+
+                // The index is the only part that is read up front, and it is copied out so that
+                // its entries are properly aligned.
+                m_entries.resize(header.entryCount);
+                std::memcpy(m_entries.data(), bytes.data() + sizeof(PackHeader), m_entries.size() * sizeof(PackEntry));
+                for (const auto& entry : m_entries) {
+                    const bool compressed = entry.compression == Compression::Lz4;
+                    const bool sized = compressed
+                        ? entry.chunkCount == chunkCount(entry.uncompressedSize) && entry.size >= (uint64_t { entry.chunkCount } + 1) * sizeof(uint32_t)
+                        : entry.compression == Compression::None && entry.chunkCount == 0 && entry.uncompressedSize == entry.size;
+                    if (entry.offset % BLOB_ALIGNMENT != 0 || entry.offset < indexEnd || entry.size > bytes.size() - entry.offset || !sized) {
+                        this->close();
+                        throw std::runtime_error("failed to open asset pack, bad entry!");
+                    }
+                }
+            }
+
+            // Imports the mapping as a buffer the transfer queue can copy from, if the device
+            // supports it. Falls back to the staging ring when the driver refuses the mapping,
+            // which some do for read only or file backed pages.
+            void importMapping(VkPhysicalDevice physicalDevice, VkDevice device, const vk_memory::DeviceMemoryAllocator& allocator, bool externalMemoryHost) {
+                if (!externalMemoryHost || !m_file.isOpen() || m_importedBuffer != VK_NULL_HANDLE) {
+                    return;
+                }
+
+                auto hostMemoryProperties = VkPhysicalDeviceExternalMemoryHostPropertiesEXT {
+                    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT,
+                };
+                auto properties = VkPhysicalDeviceProperties2 {
+                    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+                    .pNext = &hostMemoryProperties,
+                };
+                vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+                const auto bytes = m_file.bytes();
+                auto* hostPointer = const_cast<std::byte*>(bytes.data());
+                const auto alignment = hostMemoryProperties.minImportedHostPointerAlignment;
+                if (alignment == 0 || reinterpret_cast<uintptr_t>(hostPointer) % alignment != 0 || bytes.size() % alignment != 0) {
+                    return;
+                }
+
+                auto pointerProperties = VkMemoryHostPointerPropertiesEXT {
+                    .sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT,
+                };
+                const auto pointerResult = vkGetMemoryHostPointerPropertiesEXT(
+                    device,
+                    VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT,
+                    hostPointer,
+                    &pointerProperties
+                );
+                if (pointerResult != VK_SUCCESS) {
+                    return;
+                }
+
+                const auto externalInfo = VkExternalMemoryBufferCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO,
+                    .handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT,
+                };
+                const auto bufferInfo = VkBufferCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                    .pNext = &externalInfo,
+                    .size = bytes.size(),
+                    .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                };
+
+                auto buffer = VkBuffer {};
+                if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
+                    return;
+                }
+
+                auto requirements = VkMemoryRequirements2 {
+                    .sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2,
+                };
+                const auto requirementsInfo = VkBufferMemoryRequirementsInfo2 {
+                    .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2,
+                    .buffer = buffer,
+                };
+                vkGetBufferMemoryRequirements2(device, &requirementsInfo, &requirements);
+
+                // The pages live in system memory whatever type is picked, and cached types are
+                // the ones the CPU filled them through.
+                const auto memoryTypeIndex = allocator.findMemoryType(
+                    requirements.memoryRequirements.memoryTypeBits & pointerProperties.memoryTypeBits,
+                    0,
+                    VK_MEMORY_PROPERTY_HOST_CACHED_BIT
+                );
+                if (!memoryTypeIndex.has_value()) {
+                    vkDestroyBuffer(device, buffer, nullptr);
+                    return;
+                }
+
+                // Imports are dedicated allocations of their own, so they bypass the allocator's
+                // pools and count once against `maxMemoryAllocationCount`.
+                const auto importInfo = VkImportMemoryHostPointerInfoEXT {
+                    .sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT,
+                    .handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT,
+                    .pHostPointer = hostPointer,
+                };
+                const auto allocateInfo = VkMemoryAllocateInfo {
+                    .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+                    .pNext = &importInfo,
+                    .allocationSize = bytes.size(),
+                    .memoryTypeIndex = memoryTypeIndex.value(),
+                };
+
+                auto memory = VkDeviceMemory {};
+                if (vkAllocateMemory(device, &allocateInfo, nullptr, &memory) != VK_SUCCESS) {
+                    vkDestroyBuffer(device, buffer, nullptr);
+                    return;
+                }
+
+                if (vkBindBufferMemory(device, buffer, memory, 0) != VK_SUCCESS) {
+                    vkFreeMemory(device, memory, nullptr);
+                    vkDestroyBuffer(device, buffer, nullptr);
+                    return;
+                }
+
+                m_device = device;
+                m_importedBuffer = buffer;
+                m_importedMemory = memory;
+            }
+
+            // The caller must make sure no upload from the pack is still in flight.
+            void close() {
+                if (m_importedBuffer != VK_NULL_HANDLE) {
+                    vkDestroyBuffer(m_device, m_importedBuffer, nullptr);
+                    vkFreeMemory(m_device, m_importedMemory, nullptr);
+                }
+
+                m_importedBuffer = VK_NULL_HANDLE;
+                m_importedMemory = VK_NULL_HANDLE;
+                m_device = VK_NULL_HANDLE;
+                m_entries.clear();
+                m_file.close();
+            }
+
+            bool isOpen() const {
+                return m_file.isOpen();
+            }
+
+            bool isImported() const {
+                return m_importedBuffer != VK_NULL_HANDLE;
+            }
+
+            std::span<const PackEntry> entries() const {
+                return m_entries;
+            }
+
+            const PackEntry* find(std::string_view name) const {
+                const auto entry = std::lower_bound(m_entries.begin(), m_entries.end(), name, [](const PackEntry& entry, std::string_view name) {
+                    return entry.nameView() < name;
+                });
+                if (entry == m_entries.end() || entry->nameView() != name) {
+                    return nullptr;
+                }
+
+                return &*entry;
+            }
+
+            std::span<const std::byte> data(const PackEntry& entry) const {
+                return m_file.bytes().subspan(entry.offset, entry.size);
+            }
+
+            // Copies `size` bytes of a buffer blob from `sourceOffset` on to `buffer` at
+            // `offset`, so large blobs can be streamed through a staging ring smaller than
+            // them. Like `vk_upload::UploadService::uploadBuffer`, refuses the upload when it
+            // does not fit in the ring right now, which never happens once the pack is imported.
+            // Compressed blobs are copied as they are stored, chunk table and all, for
+            // `vk_decompression::GpuDecompressor` to expand, which is what keeps the copy small.
+            std::optional<vk_upload::UploadTicket> uploadBuffer(
+                vk_upload::UploadService& uploadService,
+                const PackEntry& entry,
+                VkDeviceSize sourceOffset,
+                VkDeviceSize size,
+                VkBuffer buffer,
+                VkDeviceSize offset,
+                VkAccessFlags dstAccessMask
+            ) const {
+                if (entry.kind != AssetKind::Buffer || sourceOffset > entry.size || size > entry.size - sourceOffset) {
+                    throw std::runtime_error("failed to upload asset, not a buffer or out of range!");
+                }
+
+                if (this->isImported()) {
+                    return uploadService.copyBuffer(m_importedBuffer, entry.offset + sourceOffset, buffer, offset, size, dstAccessMask);
+                }
+
+                return uploadService.uploadBuffer(buffer, offset, this->data(entry).data() + sourceOffset, size, dstAccessMask);
+            }
+
+            // Reads `destination.size()` bytes of a blob from `sourceOffset` on through `reader`,
+            // opened on the same file, without touching the mapping. This is the streaming path:
+            // many blobs read at once straight into host visible staging memory, and handed from
+            // their completions to `vk_upload::UploadService::copyBuffer`. Returns false when the
+            // reader is full, like `read` does.
+            bool readBlob(
+                vk_async_io::AsyncFileReader& reader,
+                const PackEntry& entry,
+                uint64_t sourceOffset,
+                std::span<std::byte> destination,
+                vk_async_io::ReadCompletion completion
+            ) const {
+                if (sourceOffset > entry.size || destination.size() > entry.size - sourceOffset) {
+                    throw std::runtime_error("failed to read asset, out of range!");
+                }
+
+                return reader.read(entry.offset + sourceOffset, destination, std::move(completion));
+            }
+
+            // Copies an image blob to mip level `imageInfo.mipLevel` of `imageInfo.image`, whose
+            // extent and format must match the entry's. Blobs the upload service copies from the host are read
+            // from the mapped pack even once it is imported.
+            std::optional<vk_upload::UploadTicket> uploadImage(
+                vk_upload::UploadService& uploadService,
+                const PackEntry& entry,
+                const vk_upload::ImageUploadInfo& imageInfo,
+                VkAccessFlags dstAccessMask
+            ) const {
+                if (entry.kind != AssetKind::Image || imageInfo.extent.width != entry.width || imageInfo.extent.height != entry.height) {
+                    throw std::runtime_error("failed to upload asset, not a matching image!");
+                } else if (entry.compression != Compression::None) {
+                    throw std::runtime_error("failed to upload asset, compressed images have to be expanded into a buffer first!");
+                }
+
+                if (this->isImported() && !uploadService.canCopyFromHost(imageInfo, entry.size)) {
+                    return uploadService.copyBufferToImage(imageInfo, m_importedBuffer, entry.offset, dstAccessMask);
+                }
+
+                return uploadService.uploadImage(imageInfo, this->data(entry).data(), entry.size, dstAccessMask);
+            }
+        private:
+            MappedFile m_file;
+            std::vector<PackEntry> m_entries;
+            VkDevice m_device = VK_NULL_HANDLE;
+            VkBuffer m_importedBuffer = VK_NULL_HANDLE;
+            VkDeviceMemory m_importedMemory = VK_NULL_HANDLE;
+    };
+}
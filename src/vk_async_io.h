@@ -0,0 +1,508 @@
+#pragma once
+
+// Pulls in `windows.h` on Windows, with the same macros as everywhere else.
+#include "vk_dispatch.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "vk_jobs.h"
+
+#if defined(__linux__)
+#include <cerrno>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#elif !defined(_WIN32)
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+namespace vk_async_io {
+    // How an `AsyncFileReader` reaches the disk.
+    //
+    // * `IoUring` queues reads in a ring shared with the kernel on Linux, and hands it every
+    //   read queued since the last poll in one system call.
+    // * `Overlapped` issues reads that complete to an I/O completion port on Windows.
+    // * `Blocking` runs a `pread` per read on the job system, where the kernel has no
+    //   `io_uring`, or refuses it, as container seccomp policies often do. It keeps the disk
+    //   only as busy as the job system has workers.
+    enum class Backend {
+        Blocking,
+        IoUring,
+        Overlapped,
+    };
+
+    inline const char* backendToString(Backend backend) {
+        switch (backend) {
+            case Backend::Blocking: return "blocking";
+            case Backend::IoUring: return "io_uring";
+            case Backend::Overlapped: return "overlapped";
+        }
+
+        return "unknown";
+    }
+
+    // Runs on the job system once a read is done, with whether every byte it asked for was
+    // read. The destination may be handed on from there, to an upload for instance.
+    using ReadCompletion = std::function<void(bool)>;
+
+    // Reads ranges of one file straight into memory the caller owns, like a host visible
+    // staging buffer, with up to `queueDepth` reads in flight at once and not a thread
+    // waiting on any of them. That queue depth is what keeps an NVMe drive busy, where one
+    // read at a time, or a read per page fault out of a mapping, leaves most of it idle.
+    //
+    // One thread, usually the one streaming assets, owns the reader and calls `read` and
+    // `poll`; the completions run as background jobs. Reads finish in any order.
+    class AsyncFileReader {
+        public:
+            static constexpr uint32_t DEFAULT_QUEUE_DEPTH = 64;
+
+            explicit AsyncFileReader() = default;
+
+            AsyncFileReader(const AsyncFileReader& other) = delete;
+            AsyncFileReader& operator=(const AsyncFileReader& other) = delete;
+
+            ~AsyncFileReader() {
+                this->close();
+            }
+
+            void open(const std::filesystem::path& path, vk_jobs::JobSystem& jobSystem, uint32_t queueDepth = DEFAULT_QUEUE_DEPTH) {
+                this->close();
+
+                m_jobSystem = &jobSystem;
+                m_queueDepth = std::max(queueDepth, 1u);
+                m_slots = std::vector<Slot>(m_queueDepth);
+                m_freeSlots.clear();
+                for (uint32_t i = m_queueDepth; i > 0; i--) {
+                    m_freeSlots.push_back(i - 1);
+                }
+
+#if defined(_WIN32)
+                m_file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, nullptr);
+                if (m_file == INVALID_HANDLE_VALUE) {
+                    throw std::runtime_error("failed to open file for asynchronous reads!");
+                }
+
+                m_port = CreateIoCompletionPort(m_file, nullptr, 0, 1);
+                if (m_port == nullptr) {
+                    this->close();
+                    throw std::runtime_error("failed to create I/O completion port!");
+                }
+
+                m_backend = Backend::Overlapped;
+#else
+                m_file = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+                if (m_file < 0) {
+                    throw std::runtime_error("failed to open file for asynchronous reads!");
+                }
+
+                m_backend = Backend::Blocking;
+#if defined(__linux__)
+                if (this->createRing()) {
+                    m_backend = Backend::IoUring;
+                }
+#endif
+#endif
+            }
+
+            // Waits for every read still in flight, and for its completion.
+            void close() {
+                if (!this->isOpen()) {
+                    return;
+                }
+
+                this->drain();
+
+#if defined(_WIN32)
+                if (m_port != nullptr) {
+                    CloseHandle(m_port);
+                }
+                CloseHandle(m_file);
+
+                m_port = nullptr;
+                m_file = INVALID_HANDLE_VALUE;
+#else
+#if defined(__linux__)
+                this->destroyRing();
+#endif
+                ::close(m_file);
+
+                m_file = -1;
+#endif
+                m_slots.clear();
+                m_freeSlots.clear();
+                m_completionJobs.clear();
+                m_jobSystem = nullptr;
+            }
+
+            bool isOpen() const {
+#if defined(_WIN32)
+                return m_file != INVALID_HANDLE_VALUE;
+#else
+                return m_file >= 0;
+#endif
+            }
+
+            Backend backend() const {
+                return m_backend;
+            }
+
+            uint32_t queueDepth() const {
+                return m_queueDepth;
+            }
+
+            // Reads that have not completed yet.
+            uint32_t inFlight() const {
+                if (m_backend == Backend::Blocking) {
+                    return static_cast<uint32_t>(std::count_if(m_completionJobs.begin(), m_completionJobs.end(), [](const vk_jobs::JobHandle& job) {
+                        return !job.isFinished();
+                    }));
+                }
+
+                return m_queueDepth - static_cast<uint32_t>(m_freeSlots.size());
+            }
+
+            // Reads `destination.size()` bytes from `offset` on into `destination`, which has to
+            // stay alive until `completion` runs. Refuses the read while `queueDepth` reads are in
+            // flight, so the caller can `poll` and try again. With `io_uring`, the read reaches
+            // the kernel at the next `poll`, together with every other read queued before it.
+            bool read(uint64_t offset, std::span<std::byte> destination, ReadCompletion completion) {
+                this->pruneCompletionJobs();
+                if (m_backend == Backend::Blocking) {
+                    if (m_completionJobs.size() >= m_queueDepth) {
+                        return false;
+                    }
+
+                    m_completionJobs.push_back(m_jobSystem->submit([file = m_file, offset, destination, completion = std::move(completion)]() {
+                        completion(readBlocking(file, offset, destination));
+                    }, {}, vk_jobs::JobPriority::Background));
+
+                    return true;
+                } else if (m_freeSlots.empty()) {
+                    return false;
+                }
+
+                const auto index = m_freeSlots.back();
+                m_freeSlots.pop_back();
+
+                auto& slot = m_slots[index];
+                slot.offset = offset;
+                slot.destination = destination.data();
+                slot.remaining = destination.size();
+                slot.completion = std::move(completion);
+                if (slot.remaining == 0) {
+                    this->finish(index, true);
+                } else {
+                    this->issue(index);
+                }
+
+                return true;
+            }
+
+            // Hands queued reads to the kernel and the completions of finished ones to the job
+            // system, without waiting for either. Returns how many reads completed.
+            uint32_t poll() {
+                this->pruneCompletionJobs();
+
+                return this->reap(false);
+            }
+
+            // Waits for every read in flight, and for its completion to have run.
+            void drain() {
+                while (m_backend != Backend::Blocking && this->inFlight() > 0) {
+                    this->reap(true);
+                }
+
+                for (const auto& job : m_completionJobs) {
+                    m_jobSystem->wait(job);
+                }
+                m_completionJobs.clear();
+            }
+        private:
+            // Below what either kernel reads in one go, so large reads are split rather than cut
+            // short.
+            static constexpr size_t MAX_READ_SIZE = size_t { 1 } << 30;
+
+            // A read in flight. Slots never move, since the kernel holds on to their addresses.
+            struct Slot {
+#if defined(_WIN32)
+                // First, so the completion port's `OVERLAPPED` pointer leads back to the slot.
+                OVERLAPPED overlapped {};
+#elif defined(__linux__)
+                iovec vector {};
+#endif
+                uint64_t offset = 0;
+                std::byte* destination = nullptr;
+                size_t remaining = 0;
+                ReadCompletion completion;
+            };
+
+            vk_jobs::JobSystem* m_jobSystem = nullptr;
+            Backend m_backend = Backend::Blocking;
+            uint32_t m_queueDepth = 0;
+            std::vector<Slot> m_slots;
+            std::vector<uint32_t> m_freeSlots;
+            std::vector<vk_jobs::JobHandle> m_completionJobs;
+
+#if defined(_WIN32)
+            HANDLE m_file = INVALID_HANDLE_VALUE;
+            HANDLE m_port = nullptr;
+#else
+            int m_file = -1;
+#endif
+
+#if defined(__linux__)
+            int m_ring = -1;
+            void* m_submissionRing = nullptr;
+            size_t m_submissionRingSize = 0;
+            void* m_completionRing = nullptr;
+            size_t m_completionRingSize = 0;
+            io_uring_sqe* m_entries = nullptr;
+            size_t m_entriesSize = 0;
+            unsigned* m_submissionTail = nullptr;
+            unsigned m_submissionMask = 0;
+            unsigned* m_submissionArray = nullptr;
+            unsigned* m_completionHead = nullptr;
+            unsigned* m_completionTail = nullptr;
+            unsigned m_completionMask = 0;
+            io_uring_cqe* m_completions = nullptr;
+            uint32_t m_unsubmitted = 0;
+
+            template<typename T>
+            static T* ringField(void* ring, uint32_t offset) {
+                return reinterpret_cast<T*>(static_cast<std::byte*>(ring) + offset);
+            }
+
+            // Sets up a ring with room for every slot, and leaves the reader blocking when the
+            // kernel has none to give.
+            bool createRing() {
+                auto params = io_uring_params {};
+                m_ring = static_cast<int>(::syscall(__NR_io_uring_setup, m_queueDepth, &params));
+                if (m_ring < 0) {
+                    m_ring = -1;
+                    return false;
+                }
+
+                m_submissionRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+                m_completionRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+                const bool singleMapping = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+                if (singleMapping) {
+                    m_submissionRingSize = std::max(m_submissionRingSize, m_completionRingSize);
+                    m_completionRingSize = 0;
+                }
+
+                auto* submissionRing = ::mmap(nullptr, m_submissionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_SQ_RING);
+                m_submissionRing = submissionRing == MAP_FAILED ? nullptr : submissionRing;
+                if (!singleMapping && m_submissionRing != nullptr) {
+                    auto* completionRing = ::mmap(nullptr, m_completionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_CQ_RING);
+                    m_completionRing = completionRing == MAP_FAILED ? nullptr : completionRing;
+                }
+                m_entriesSize = params.sq_entries * sizeof(io_uring_sqe);
+                auto* entries = ::mmap(nullptr, m_entriesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_SQES);
+                m_entries = entries == MAP_FAILED ? nullptr : static_cast<io_uring_sqe*>(entries);
+                if (m_submissionRing == nullptr || (!singleMapping && m_completionRing == nullptr) || m_entries == nullptr) {
+                    this->destroyRing();
+                    return false;
+                }
+
+                auto* completionRing = singleMapping ? m_submissionRing : m_completionRing;
+                m_submissionTail = ringField<unsigned>(m_submissionRing, params.sq_off.tail);
+                m_submissionMask = *ringField<unsigned>(m_submissionRing, params.sq_off.ring_mask);
+                m_submissionArray = ringField<unsigned>(m_submissionRing, params.sq_off.array);
+                m_completionHead = ringField<unsigned>(completionRing, params.cq_off.head);
+                m_completionTail = ringField<unsigned>(completionRing, params.cq_off.tail);
+                m_completionMask = *ringField<unsigned>(completionRing, params.cq_off.ring_mask);
+                m_completions = ringField<io_uring_cqe>(completionRing, params.cq_off.cqes);
+                m_unsubmitted = 0;
+
+                return true;
+            }
+
+            void destroyRing() {
+                if (m_entries != nullptr) {
+                    ::munmap(m_entries, m_entriesSize);
+                }
+                if (m_completionRing != nullptr) {
+                    ::munmap(m_completionRing, m_completionRingSize);
+                }
+                if (m_submissionRing != nullptr) {
+                    ::munmap(m_submissionRing, m_submissionRingSize);
+                }
+                if (m_ring >= 0) {
+                    ::close(m_ring);
+                }
+
+                m_entries = nullptr;
+                m_completionRing = nullptr;
+                m_submissionRing = nullptr;
+                m_ring = -1;
+            }
+
+            // Submits the queued reads and, when `wait` is set, blocks for at least one
+            // completion. Interrupted or busy calls are retried at the next one.
+            void enter(bool wait) {
+                const auto flags = wait ? IORING_ENTER_GETEVENTS : 0u;
+                const auto submitted = ::syscall(__NR_io_uring_enter, m_ring, m_unsubmitted, wait ? 1u : 0u, flags, nullptr, 0);
+                if (submitted >= 0) {
+                    m_unsubmitted -= static_cast<uint32_t>(submitted);
+                } else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                    throw std::runtime_error("failed to submit asynchronous reads!");
+                }
+            }
+#endif
+
+            // Moves the slot's read to the kernel, from where it left off.
+            void issue(uint32_t index) {
+                auto& slot = m_slots[index];
+                const auto size = std::min(slot.remaining, MAX_READ_SIZE);
+
+#if defined(_WIN32)
+                slot.overlapped = OVERLAPPED {};
+                slot.overlapped.Offset = static_cast<DWORD>(slot.offset);
+                slot.overlapped.OffsetHigh = static_cast<DWORD>(slot.offset >> 32);
+                if (!ReadFile(m_file, slot.destination, static_cast<DWORD>(size), nullptr, &slot.overlapped) && GetLastError() != ERROR_IO_PENDING) {
+                    this->finish(index, false);
+                }
+#elif defined(__linux__)
+                slot.vector = iovec { .iov_base = slot.destination, .iov_len = size };
+
+                // Only this thread writes the tail, so it is only published with release.
+                const auto tail = *m_submissionTail;
+                const auto entryIndex = tail & m_submissionMask;
+                auto& entry = m_entries[entryIndex];
+                entry = io_uring_sqe {};
+                entry.opcode = IORING_OP_READV;
+                entry.fd = m_file;
+                entry.off = slot.offset;
+                entry.addr = reinterpret_cast<uint64_t>(&slot.vector);
+                entry.len = 1;
+                entry.user_data = index;
+                m_submissionArray[entryIndex] = entryIndex;
+                std::atomic_ref { *m_submissionTail }.store(tail + 1, std::memory_order_release);
+                m_unsubmitted++;
+#else
+                static_cast<void>(size);
+#endif
+            }
+
+            // Retires `bytesRead` of the slot's read, negative for a failure, and issues the rest
+            // of a read the kernel cut short.
+            void complete(uint32_t index, int64_t bytesRead) {
+                auto& slot = m_slots[index];
+                if (bytesRead <= 0 || static_cast<uint64_t>(bytesRead) > slot.remaining) {
+                    this->finish(index, false);
+                    return;
+                }
+
+                slot.offset += static_cast<uint64_t>(bytesRead);
+                slot.destination += bytesRead;
+                slot.remaining -= static_cast<size_t>(bytesRead);
+                if (slot.remaining == 0) {
+                    this->finish(index, true);
+                } else {
+                    this->issue(index);
+                }
+            }
+
+            void finish(uint32_t index, bool success) {
+                auto& slot = m_slots[index];
+                m_completionJobs.push_back(m_jobSystem->submit([completion = std::move(slot.completion), success]() {
+                    completion(success);
+                }, {}, vk_jobs::JobPriority::Background));
+                slot.completion = nullptr;
+                m_freeSlots.push_back(index);
+            }
+
+            // Collects finished reads, waiting for at least one when `wait` is set and any are
+            // in flight.
+            uint32_t reap(bool wait) {
+                uint32_t completed = 0;
+#if defined(_WIN32)
+                auto entries = std::array<OVERLAPPED_ENTRY, 16> {};
+                auto removed = ULONG { 0 };
+                if (!GetQueuedCompletionStatusEx(m_port, entries.data(), static_cast<ULONG>(entries.size()), &removed, wait ? INFINITE : 0, FALSE)) {
+                    return 0;
+                }
+
+                for (ULONG i = 0; i < removed; i++) {
+                    auto* slot = reinterpret_cast<Slot*>(entries[i].lpOverlapped);
+                    const auto index = static_cast<uint32_t>(slot - m_slots.data());
+                    // `Internal` holds the read's status, which is zero for success.
+                    const bool success = entries[i].lpOverlapped->Internal == 0;
+                    this->complete(index, success ? int64_t { entries[i].dwNumberOfBytesTransferred } : -1);
+                    completed++;
+                }
+#elif defined(__linux__)
+                if (m_backend != Backend::IoUring) {
+                    return 0;
+                }
+
+                const bool waiting = wait && this->inFlight() > 0;
+                if (m_unsubmitted > 0 || waiting) {
+                    this->enter(waiting);
+                }
+
+                auto head = *m_completionHead;
+                const auto tail = std::atomic_ref { *m_completionTail }.load(std::memory_order_acquire);
+                for (; head != tail; head++) {
+                    const auto& entry = m_completions[head & m_completionMask];
+                    const auto index = static_cast<uint32_t>(entry.user_data);
+                    if (entry.res == -EAGAIN || entry.res == -EINTR) {
+                        this->issue(index);
+                    } else {
+                        this->complete(index, entry.res);
+                        completed++;
+                    }
+                }
+                std::atomic_ref { *m_completionHead }.store(head, std::memory_order_release);
+
+                // Reads issued again while reaping go out with this poll rather than the next.
+                if (m_unsubmitted > 0) {
+                    this->enter(false);
+                }
+#else
+                static_cast<void>(wait);
+#endif
+
+                return completed;
+            }
+
+            // Forgets completions that have run, so the handles do not pile up.
+            void pruneCompletionJobs() {
+                std::erase_if(m_completionJobs, [](const vk_jobs::JobHandle& job) { return job.isFinished(); });
+            }
+
+#if !defined(_WIN32)
+            static bool readBlocking(int file, uint64_t offset, std::span<std::byte> destination) {
+                while (!destination.empty()) {
+                    const auto result = ::pread(file, destination.data(), std::min(destination.size(), MAX_READ_SIZE), static_cast<off_t>(offset));
+                    if (result < 0 && errno == EINTR) {
+                        continue;
+                    } else if (result <= 0) {
+                        return false;
+                    }
+
+                    offset += static_cast<uint64_t>(result);
+                    destination = destination.subspan(static_cast<size_t>(result));
+                }
+
+                return true;
+            }
+#endif
+    };
+}
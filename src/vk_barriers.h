@@ -0,0 +1,325 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "vk_render_graph.h"
+
+
+namespace vk_barriers {
+    // The accesses that write, which a later access has to wait for and have made visible to it.
+    constexpr VkAccessFlags2 WRITE_ACCESS = VK_ACCESS_2_SHADER_WRITE_BIT
+        | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT
+        | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT
+        | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
+        | VK_ACCESS_2_TRANSFER_WRITE_BIT
+        | VK_ACCESS_2_HOST_WRITE_BIT
+        | VK_ACCESS_2_MEMORY_WRITE_BIT
+        | VK_ACCESS_2_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+
+    // Where one subresource of an image is: its layout, the last write, or layout change, that
+    // the next write or layout change waits for with every read since, and what that write has
+    // been made visible to, which a read needs no barrier for.
+    struct SubresourceState {
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags2 writeStages = VK_PIPELINE_STAGE_2_NONE;
+        VkAccessFlags2 writeAccess = VK_ACCESS_2_NONE;
+        VkPipelineStageFlags2 readStages = VK_PIPELINE_STAGE_2_NONE;
+        VkPipelineStageFlags2 visibleStages = VK_PIPELINE_STAGE_2_NONE;
+        VkAccessFlags2 visibleAccess = VK_ACCESS_2_NONE;
+
+        bool operator==(const SubresourceState& other) const = default;
+    };
+
+    // Image barriers collected for a single `vkCmdPipelineBarrier2`, so the transitions of
+    // several images, or of several subresources of one, share one call. A barrier that
+    // continues the last one added over the next layers, or the next levels, with the same
+    // masks and layouts, extends it instead.
+    class BarrierBatch {
+        public:
+            explicit BarrierBatch(std::pmr::memory_resource* memory = std::pmr::get_default_resource())
+                : m_barriers { memory }
+            {
+            }
+
+            BarrierBatch(const BarrierBatch& other) = delete;
+            BarrierBatch& operator=(const BarrierBatch& other) = delete;
+
+            void add(const VkImageMemoryBarrier2& barrier) {
+                if (!m_barriers.empty() && BarrierBatch::extends(m_barriers.back(), barrier)) {
+                    auto& range = m_barriers.back().subresourceRange;
+                    const auto& next = barrier.subresourceRange;
+                    if (range.baseArrayLayer == next.baseArrayLayer && range.layerCount == next.layerCount) {
+                        range.levelCount += next.levelCount;
+                    } else {
+                        range.layerCount += next.layerCount;
+                    }
+                    return;
+                }
+
+                m_barriers.push_back(barrier);
+            }
+
+            bool empty() const {
+                return m_barriers.empty();
+            }
+
+            size_t size() const {
+                return m_barriers.size();
+            }
+
+            // Records every barrier added since the last flush, if there are any.
+            void flush(VkCommandBuffer commandBuffer) {
+                if (m_barriers.empty()) {
+                    return;
+                }
+
+                const auto dependencyInfo = VkDependencyInfo {
+                    .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+                    .imageMemoryBarrierCount = static_cast<uint32_t>(m_barriers.size()),
+                    .pImageMemoryBarriers = m_barriers.data(),
+                };
+                vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+                m_barriers.clear();
+            }
+        private:
+            std::pmr::vector<VkImageMemoryBarrier2> m_barriers;
+
+            static bool extends(const VkImageMemoryBarrier2& last, const VkImageMemoryBarrier2& next) {
+                const auto& a = last.subresourceRange;
+                const auto& b = next.subresourceRange;
+                const bool sameBarrier = last.image == next.image
+                    && last.srcStageMask == next.srcStageMask
+                    && last.srcAccessMask == next.srcAccessMask
+                    && last.dstStageMask == next.dstStageMask
+                    && last.dstAccessMask == next.dstAccessMask
+                    && last.oldLayout == next.oldLayout
+                    && last.newLayout == next.newLayout
+                    && last.srcQueueFamilyIndex == next.srcQueueFamilyIndex
+                    && last.dstQueueFamilyIndex == next.dstQueueFamilyIndex
+                    && a.aspectMask == b.aspectMask;
+                const bool nextLevels = a.baseArrayLayer == b.baseArrayLayer
+                    && a.layerCount == b.layerCount
+                    && a.baseMipLevel + a.levelCount == b.baseMipLevel;
+                const bool nextLayers = a.baseMipLevel == b.baseMipLevel
+                    && a.levelCount == b.levelCount
+                    && a.baseArrayLayer + a.layerCount == b.baseArrayLayer;
+
+                return sameBarrier && (nextLevels || nextLayers);
+            }
+    };
+
+    // The layout and last accesses of every subresource of the images it tracks, like the
+    // swapchain images, which live from one frame to the next outside the render graph. A
+    // transition only adds the barriers a subresource needs: none when it is already in the
+    // layout asked for and the access is a read its last write was already made visible to,
+    // or there is nothing before it to wait for. Only used from the thread drawing frames.
+    class ImageLayoutTracker {
+        public:
+            explicit ImageLayoutTracker() = default;
+
+            ImageLayoutTracker(const ImageLayoutTracker& other) = delete;
+            ImageLayoutTracker& operator=(const ImageLayoutTracker& other) = delete;
+
+            // Starts tracking `image`, every subresource in `layout` with nothing to wait for,
+            // like an image just created, or just returned by `vkGetSwapchainImagesKHR`.
+            void track(VkImage image, VkImageAspectFlags aspectMask, uint32_t levelCount, uint32_t layerCount, VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED) {
+                m_images[image] = TrackedImage {
+                    .aspectMask = aspectMask,
+                    .levelCount = levelCount,
+                    .layerCount = layerCount,
+                    .subresources = std::vector<SubresourceState>(size_t { levelCount } * layerCount, SubresourceState { .layout = layout }),
+                };
+            }
+
+            void forget(VkImage image) {
+                m_images.erase(image);
+            }
+
+            bool isTracked(VkImage image) const {
+                return m_images.contains(image);
+            }
+
+            VkImageLayout layout(VkImage image, uint32_t level = 0, uint32_t layer = 0) const {
+                const auto& trackedImage = this->tracked(image);
+
+                return trackedImage.subresources[trackedImage.index(level, layer)].layout;
+            }
+
+            // The image's contents are discarded, and its next use waits for `stages`, like a
+            // swapchain image whose acquire semaphore is waited on there.
+            void acquire(VkImage image, VkPipelineStageFlags2 stages) {
+                for (auto& subresource : this->tracked(image).subresources) {
+                    subresource = SubresourceState { .writeStages = stages };
+                }
+            }
+
+            // Every subresource of `image` was left in `state` by something the tracker does not
+            // see, like the render graph, whose last access counts as a write to wait for.
+            void assume(VkImage image, const vk_render_graph::ResourceState& state) {
+                for (auto& subresource : this->tracked(image).subresources) {
+                    subresource = SubresourceState {
+                        .layout = state.layout,
+                        .writeStages = state.stages,
+                        .writeAccess = state.access & WRITE_ACCESS,
+                        .readStages = state.stages,
+                    };
+                }
+            }
+
+            // Adds the barriers taking `range` of `image` to `state` into `batch`, one for each
+            // run of subresources that were in the same state. A layout of undefined in `state`
+            // keeps the layout each subresource is in. Differing queue families transfer the
+            // range's ownership, which always takes a barrier.
+            void transition(
+                BarrierBatch& batch,
+                VkImage image,
+                VkImageSubresourceRange range,
+                const vk_render_graph::ResourceState& state,
+                uint32_t srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                uint32_t dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED
+            ) {
+                auto& trackedImage = this->tracked(image);
+                if (range.levelCount == VK_REMAINING_MIP_LEVELS) {
+                    range.levelCount = trackedImage.levelCount - range.baseMipLevel;
+                }
+                if (range.layerCount == VK_REMAINING_ARRAY_LAYERS) {
+                    range.layerCount = trackedImage.layerCount - range.baseArrayLayer;
+                }
+                if (range.baseMipLevel + range.levelCount > trackedImage.levelCount || range.baseArrayLayer + range.layerCount > trackedImage.layerCount) {
+                    throw std::runtime_error("failed to transition an image, the range is out of its subresources!");
+                }
+
+                const bool write = (state.access & WRITE_ACCESS) != 0;
+                const bool ownershipTransfer = srcQueueFamilyIndex != dstQueueFamilyIndex;
+                for (uint32_t layer = range.baseArrayLayer; layer < range.baseArrayLayer + range.layerCount; layer++) {
+                    for (uint32_t level = range.baseMipLevel; level < range.baseMipLevel + range.levelCount; level++) {
+                        auto& subresource = trackedImage.subresources[trackedImage.index(level, layer)];
+                        const auto layout = state.layout == VK_IMAGE_LAYOUT_UNDEFINED ? subresource.layout : state.layout;
+                        const bool layoutChange = layout != subresource.layout;
+                        const auto srcStageMask = subresource.writeStages | (write || layoutChange ? subresource.readStages : VK_PIPELINE_STAGE_2_NONE);
+                        const bool visible = (subresource.visibleStages & state.stages) == state.stages
+                            && (subresource.visibleAccess & state.access) == state.access;
+                        const bool redundant = !layoutChange
+                            && !ownershipTransfer
+                            && (srcStageMask == VK_PIPELINE_STAGE_2_NONE || (!write && visible));
+                        if (redundant) {
+                            m_skippedCount++;
+                        } else {
+                            batch.add(VkImageMemoryBarrier2 {
+                                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+                                .srcStageMask = srcStageMask,
+                                .srcAccessMask = subresource.writeAccess,
+                                .dstStageMask = state.stages,
+                                .dstAccessMask = state.access,
+                                .oldLayout = subresource.layout,
+                                .newLayout = layout,
+                                .srcQueueFamilyIndex = srcQueueFamilyIndex,
+                                .dstQueueFamilyIndex = dstQueueFamilyIndex,
+                                .image = image,
+                                .subresourceRange = VkImageSubresourceRange {
+                                    .aspectMask = range.aspectMask,
+                                    .baseMipLevel = level,
+                                    .levelCount = 1,
+                                    .baseArrayLayer = layer,
+                                    .layerCount = 1,
+                                },
+                            });
+                            m_barrierCount++;
+                        }
+
+                        // A layout change is a write of its own, made visible to the accesses
+                        // it waits before.
+                        if (write) {
+                            subresource = SubresourceState {
+                                .layout = layout,
+                                .writeStages = state.stages,
+                                .writeAccess = state.access & WRITE_ACCESS,
+                            };
+                        } else if (layoutChange || ownershipTransfer) {
+                            subresource = SubresourceState {
+                                .layout = layout,
+                                .writeStages = state.stages,
+                                .readStages = state.stages,
+                                .visibleStages = state.stages,
+                                .visibleAccess = state.access,
+                            };
+                        } else if (!redundant) {
+                            subresource.readStages |= state.stages;
+                            subresource.visibleStages |= state.stages;
+                            subresource.visibleAccess |= state.access;
+                        } else {
+                            subresource.readStages |= state.stages;
+                        }
+                    }
+                }
+            }
+
+            // `transition` over every subresource of `image`.
+            void transition(
+                BarrierBatch& batch,
+                VkImage image,
+                const vk_render_graph::ResourceState& state,
+                uint32_t srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                uint32_t dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED
+            ) {
+                const auto range = VkImageSubresourceRange {
+                    .aspectMask = this->tracked(image).aspectMask,
+                    .baseMipLevel = 0,
+                    .levelCount = VK_REMAINING_MIP_LEVELS,
+                    .baseArrayLayer = 0,
+                    .layerCount = VK_REMAINING_ARRAY_LAYERS,
+                };
+                this->transition(batch, image, range, state, srcQueueFamilyIndex, dstQueueFamilyIndex);
+            }
+
+            // Subresource barriers recorded, and transitions left out as redundant.
+            uint64_t barrierCount() const {
+                return m_barrierCount;
+            }
+
+            uint64_t skippedCount() const {
+                return m_skippedCount;
+            }
+        private:
+            struct TrackedImage {
+                VkImageAspectFlags aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+                uint32_t levelCount = 1;
+                uint32_t layerCount = 1;
+                // Level major within each layer.
+                std::vector<SubresourceState> subresources;
+
+                size_t index(uint32_t level, uint32_t layer) const {
+                    return size_t { layer } * levelCount + level;
+                }
+            };
+
+            std::unordered_map<VkImage, TrackedImage> m_images;
+            uint64_t m_barrierCount = 0;
+            uint64_t m_skippedCount = 0;
+
+            TrackedImage& tracked(VkImage image) {
+                const auto existing = m_images.find(image);
+                if (existing == m_images.end()) {
+                    throw std::runtime_error("failed to find the layout of an untracked image!");
+                }
+
+                return existing->second;
+            }
+
+            const TrackedImage& tracked(VkImage image) const {
+                const auto existing = m_images.find(image);
+                if (existing == m_images.end()) {
+                    throw std::runtime_error("failed to find the layout of an untracked image!");
+                }
+
+                return existing->second;
+            }
+    };
+}
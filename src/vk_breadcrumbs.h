@@ -0,0 +1,334 @@
+#pragma once
+
+#include "vk_dispatch.h"
+#include "vk_handles.h"
+#include "vk_memory.h"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#include <fmt/core.h>
+#include <fmt/ostream.h>
+
+
+namespace vk_breadcrumbs {
+    // How the GPU leaves its breadcrumbs, from the most to the least precise.
+    enum class Method {
+        // `VK_AMD_buffer_marker` writes a marker once every earlier command has reached a
+        // pipeline stage, without stalling anything.
+        BufferMarker,
+        // `VK_NV_device_diagnostic_checkpoints` keeps the markers in the driver, which reports
+        // the last stage each one reached.
+        Checkpoints,
+        // Plain transfer writes, each end marker behind a barrier on everything before it, so
+        // passes on the same queue no longer overlap.
+        FillBuffer,
+    };
+
+    inline const char* methodToString(Method method) {
+        switch (method) {
+            case Method::BufferMarker: return "buffer markers";
+            case Method::Checkpoints: return "checkpoints";
+            case Method::FillBuffer: return "fill buffer";
+        }
+
+        return "unknown";
+    }
+
+    // A queue breadcrumbs are recorded on, by its index in the render graph's queues.
+    struct Queue {
+        const char* name;
+        VkQueue queue;
+    };
+
+    // Marks where every pass of the render graph began and ended on the GPU, so when the device
+    // is lost the pass it died in can be named without reproducing the hang. Each marker is a
+    // number that goes up by one, and the host remembers the pass and frame of the last
+    // `HISTORY_SIZE` of them. Markers that are written to memory go into a host visible buffer
+    // with a begun and a completed slot per queue, which stays readable after the device is
+    // gone.
+    class Breadcrumbs {
+        public:
+            static constexpr uint32_t MAX_QUEUES = 2;
+            static constexpr uint32_t HISTORY_SIZE = 1024;
+
+            explicit Breadcrumbs() = default;
+
+            Breadcrumbs(const Breadcrumbs& other) = delete;
+            Breadcrumbs& operator=(const Breadcrumbs& other) = delete;
+
+            void init(VkDevice device, vk_memory::DeviceMemoryAllocator& allocator, Method method) {
+                m_device = device;
+                m_method = method;
+                m_enabled = true;
+                if (method == Method::Checkpoints) {
+                    return;
+                }
+
+                const auto bufferInfo = VkBufferCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                    .size = MAX_QUEUES * SLOTS_PER_QUEUE * sizeof(uint32_t),
+                    .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                };
+
+                auto buffer = VkBuffer {};
+                const auto result = vkCreateBuffer(m_device, &bufferInfo, nullptr, &buffer);
+                if (result != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create breadcrumb buffer!");
+                }
+
+                m_buffer = vk_handles::Buffer { m_device, buffer, nullptr };
+                m_memory = vk_memory::ScopedAllocation {
+                    allocator,
+                    allocator.allocateForBuffer(buffer, vk_memory::AllocationCreateInfo {
+                        .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                        .kind = vk_memory::ResourceKind::Linear,
+                        .dedicated = true,
+                    }),
+                };
+                std::memset(m_memory.get().mappedData, 0, bufferInfo.size);
+            }
+
+            // The queue must be idle.
+            void destroy() {
+                m_buffer = vk_handles::Buffer();
+                m_memory = vk_memory::ScopedAllocation();
+                m_enabled = false;
+            }
+
+            bool isEnabled() const {
+                return m_enabled;
+            }
+
+            Method method() const {
+                return m_method;
+            }
+
+            // Tags the markers recorded from here on with `frameNumber`.
+            void beginFrame(uint64_t frameNumber) {
+                m_frameNumber = frameNumber;
+            }
+
+            // Marks the start of pass `name` on queue `queue`, before any of its commands.
+            // `name` must outlive the breadcrumbs, a string literal in practice. Returns the
+            // marker to pass to `endPass`.
+            uint32_t beginPass(VkCommandBuffer commandBuffer, uint32_t queue, const char* name) {
+                const auto marker = this->remember(queue, name, false);
+                switch (m_method) {
+                    case Method::BufferMarker:
+                        vkCmdWriteBufferMarkerAMD(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_buffer, this->offset(queue, BEGUN), marker);
+                        break;
+                    case Method::Checkpoints:
+                        vkCmdSetCheckpointNV(commandBuffer, Breadcrumbs::toCheckpoint(marker));
+                        break;
+                    case Method::FillBuffer:
+                        vkCmdFillBuffer(commandBuffer, m_buffer, this->offset(queue, BEGUN), sizeof(uint32_t), marker);
+                        break;
+                }
+
+                return marker;
+            }
+
+            // Marks the end of the pass, once every command before it has completed.
+            void endPass(VkCommandBuffer commandBuffer, uint32_t queue, uint32_t beginMarker) {
+                const auto marker = this->remember(queue, m_history[beginMarker % HISTORY_SIZE].name, true);
+                switch (m_method) {
+                    case Method::BufferMarker:
+                        vkCmdWriteBufferMarkerAMD(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_buffer, this->offset(queue, COMPLETED), marker);
+                        break;
+                    case Method::Checkpoints:
+                        vkCmdSetCheckpointNV(commandBuffer, Breadcrumbs::toCheckpoint(marker));
+                        break;
+                    case Method::FillBuffer: {
+                        const auto barrier = VkMemoryBarrier2 {
+                            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+                            .srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                            .dstStageMask = VK_PIPELINE_STAGE_2_CLEAR_BIT,
+                        };
+                        const auto dependencyInfo = VkDependencyInfo {
+                            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+                            .memoryBarrierCount = 1,
+                            .pMemoryBarriers = &barrier,
+                        };
+                        vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+                        vkCmdFillBuffer(commandBuffer, m_buffer, this->offset(queue, COMPLETED), sizeof(uint32_t), marker);
+                        break;
+                    }
+                }
+            }
+
+            // What the GPU got to on each queue before the device was lost. The last pass that
+            // began without completing is the one to look at first.
+            void report(std::ostream& out, std::span<const Queue> queues) const {
+                if (!this->isEnabled()) {
+                    return;
+                }
+
+                fmt::println(out, "Breadcrumbs ({}), last marker recorded {}:", methodToString(m_method), m_nextMarker - 1);
+                for (uint32_t queue = 0; queue < queues.size() && queue < MAX_QUEUES; queue++) {
+                    if (queues[queue].queue == VK_NULL_HANDLE) {
+                        continue;
+                    }
+
+                    if (m_method == Method::Checkpoints) {
+                        this->reportCheckpoints(out, queues[queue]);
+                        continue;
+                    }
+
+                    const auto* slots = static_cast<const volatile uint32_t*>(m_memory.get().mappedData);
+                    const auto begun = slots[queue * SLOTS_PER_QUEUE + BEGUN];
+                    const auto completed = slots[queue * SLOTS_PER_QUEUE + COMPLETED];
+                    fmt::println(out, "  {} queue", queues[queue].name);
+                    this->reportMarker(out, "last begun", begun);
+                    this->reportMarker(out, "last completed", completed);
+                }
+            }
+        private:
+            // A marker the host still knows the pass of.
+            struct Record {
+                uint32_t marker = 0;
+                uint64_t frameNumber = 0;
+                const char* name = nullptr;
+                uint32_t queue = 0;
+                bool end = false;
+            };
+
+            static constexpr uint32_t SLOTS_PER_QUEUE = 2;
+            static constexpr uint32_t BEGUN = 0;
+            static constexpr uint32_t COMPLETED = 1;
+
+            VkDevice m_device = VK_NULL_HANDLE;
+            Method m_method = Method::FillBuffer;
+            bool m_enabled = false;
+            vk_handles::Buffer m_buffer;
+            vk_memory::ScopedAllocation m_memory;
+            uint64_t m_frameNumber = 0;
+            // Zero is what the slots hold before any marker lands.
+            uint32_t m_nextMarker = 1;
+            std::array<Record, HISTORY_SIZE> m_history {};
+
+            static const void* toCheckpoint(uint32_t marker) {
+                return reinterpret_cast<const void*>(static_cast<uintptr_t>(marker));
+            }
+
+            VkDeviceSize offset(uint32_t queue, uint32_t slot) const {
+                return (queue * SLOTS_PER_QUEUE + slot) * sizeof(uint32_t);
+            }
+
+            uint32_t remember(uint32_t queue, const char* name, bool end) {
+                const auto marker = m_nextMarker++;
+                m_history[marker % HISTORY_SIZE] = Record {
+                    .marker = marker,
+                    .frameNumber = m_frameNumber,
+                    .name = name,
+                    .queue = queue,
+                    .end = end,
+                };
+
+                return marker;
+            }
+
+            void reportMarker(std::ostream& out, const char* what, uint32_t marker) const {
+                const auto& record = m_history[marker % HISTORY_SIZE];
+                if (marker == 0) {
+                    fmt::println(out, "    {:<16} nothing", what);
+                } else if (record.marker != marker) {
+                    fmt::println(out, "    {:<16} marker {}, too old to name", what, marker);
+                } else {
+                    fmt::println(out, "    {:<16} marker {}, {} of pass '{}' in frame {}", what, marker, record.end ? "end" : "start", record.name, record.frameNumber);
+                }
+            }
+
+            void reportCheckpoints(std::ostream& out, const Queue& queue) const {
+                uint32_t checkpointCount = 0;
+                vkGetQueueCheckpointDataNV(queue.queue, &checkpointCount, nullptr);
+                auto checkpoints = std::vector<VkCheckpointDataNV>(checkpointCount, VkCheckpointDataNV {
+                    .sType = VK_STRUCTURE_TYPE_CHECKPOINT_DATA_NV,
+                });
+                vkGetQueueCheckpointDataNV(queue.queue, &checkpointCount, checkpoints.data());
+
+                fmt::println(out, "  {} queue", queue.name);
+                for (const auto& checkpoint : checkpoints) {
+                    const auto marker = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(checkpoint.pCheckpointMarker));
+                    const auto* stage = checkpoint.stage == VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT ? "last begun"
+                        : checkpoint.stage == VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT ? "last completed"
+                        : "last reached";
+                    this->reportMarker(out, stage, marker);
+                }
+            }
+    };
+
+    inline const char* faultAddressTypeToString(VkDeviceFaultAddressTypeEXT addressType) {
+        switch (addressType) {
+            case VK_DEVICE_FAULT_ADDRESS_TYPE_NONE_EXT: return "none";
+            case VK_DEVICE_FAULT_ADDRESS_TYPE_READ_INVALID_EXT: return "invalid read";
+            case VK_DEVICE_FAULT_ADDRESS_TYPE_WRITE_INVALID_EXT: return "invalid write";
+            case VK_DEVICE_FAULT_ADDRESS_TYPE_EXECUTE_INVALID_EXT: return "invalid execute";
+            case VK_DEVICE_FAULT_ADDRESS_TYPE_INSTRUCTION_POINTER_UNKNOWN_EXT: return "instruction pointer, unknown";
+            case VK_DEVICE_FAULT_ADDRESS_TYPE_INSTRUCTION_POINTER_INVALID_EXT: return "instruction pointer, invalid";
+            case VK_DEVICE_FAULT_ADDRESS_TYPE_INSTRUCTION_POINTER_FAULT_EXT: return "instruction pointer, fault";
+            default: return "unknown";
+        }
+    }
+
+    // What the driver knows about why the device was lost, from `VK_EXT_device_fault`. The
+    // vendor's binary crash dump, when `withVendorBinary` and there is one, is written to
+    // `vendorBinaryPath` for the vendor's tools to decode.
+    inline void reportDeviceFault(std::ostream& out, VkDevice device, bool withVendorBinary, const std::filesystem::path& vendorBinaryPath) {
+        auto counts = VkDeviceFaultCountsEXT {
+            .sType = VK_STRUCTURE_TYPE_DEVICE_FAULT_COUNTS_EXT,
+        };
+        auto result = vkGetDeviceFaultInfoEXT(device, &counts, nullptr);
+        if (result != VK_SUCCESS) {
+            fmt::println(out, "Device fault: unavailable");
+            return;
+        }
+
+        auto addressInfos = std::vector<VkDeviceFaultAddressInfoEXT>(counts.addressInfoCount);
+        auto vendorInfos = std::vector<VkDeviceFaultVendorInfoEXT>(counts.vendorInfoCount);
+        auto vendorBinary = std::vector<char>(withVendorBinary ? counts.vendorBinarySize : 0);
+        counts.vendorBinarySize = vendorBinary.size();
+        auto faultInfo = VkDeviceFaultInfoEXT {
+            .sType = VK_STRUCTURE_TYPE_DEVICE_FAULT_INFO_EXT,
+            .pAddressInfos = addressInfos.data(),
+            .pVendorInfos = vendorInfos.data(),
+            .pVendorBinaryData = vendorBinary.empty() ? nullptr : vendorBinary.data(),
+        };
+        result = vkGetDeviceFaultInfoEXT(device, &counts, &faultInfo);
+        if (result != VK_SUCCESS && result != VK_INCOMPLETE) {
+            fmt::println(out, "Device fault: unavailable");
+            return;
+        }
+
+        fmt::println(out, "Device fault: {}", faultInfo.description);
+        for (uint32_t i = 0; i < counts.addressInfoCount; i++) {
+            const auto& addressInfo = addressInfos[i];
+            fmt::println(
+                out,
+                "  {:<28} 0x{:016x} (+/- 0x{:x})",
+                faultAddressTypeToString(addressInfo.addressType),
+                addressInfo.reportedAddress,
+                addressInfo.addressPrecision
+            );
+        }
+
+        for (uint32_t i = 0; i < counts.vendorInfoCount; i++) {
+            const auto& vendorInfo = vendorInfos[i];
+            fmt::println(out, "  {} (code 0x{:x}, data 0x{:x})", vendorInfo.description, vendorInfo.vendorFaultCode, vendorInfo.vendorFaultData);
+        }
+
+        if (counts.vendorBinarySize > 0) {
+            auto file = std::ofstream { vendorBinaryPath, std::ios::binary | std::ios::trunc };
+            file.write(vendorBinary.data(), static_cast<std::streamsize>(counts.vendorBinarySize));
+            fmt::println(out, "  vendor crash dump written to {}", vendorBinaryPath.string());
+        }
+    }
+}
@@ -0,0 +1,713 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "vk_jobs.h"
+#include "vk_math.h"
+#include "vk_transforms.h"
+
+
+namespace vk_bvh {
+    // A node has a child per lane, so traversal tests all of them at once.
+    constexpr uint32_t NODE_WIDTH = vk_transforms::LANE_COUNT;
+    constexpr uint32_t MAX_LEAF_SIZE = 4;
+    // The candidate split planes per axis of the binned surface area heuristic, one fewer than
+    // the bins.
+    constexpr uint32_t BIN_COUNT = 16;
+    // Ranges of at least this many primitives build their children as jobs of their own,
+    // which keeps the jobs of a million primitive build in the hundreds.
+    constexpr size_t PRIMITIVES_PER_BUILD_JOB = 16 * 1024;
+    constexpr uint32_t INVALID_INDEX = 0xFFFFFFFF;
+
+    using vk_math::Aabb;
+    using vk_math::transformBox;
+
+    // Points at `origin + t * direction` for `t` up to `maxDistance`. `direction` need not be
+    // normalized, `t` is in units of its length.
+    struct Ray {
+        glm::vec3 origin;
+        glm::vec3 direction;
+        float maxDistance = std::numeric_limits<float>::max();
+    };
+
+    // A bounding volume hierarchy over boxes, four children to a node.
+    //
+    // A node keeps its children's boxes as a structure of arrays, one child per lane, so a ray
+    // or a region is tested against all four with a handful of `vk_transforms::Lanes`
+    // operations, and a node is two cache lines. Children are either nodes, or leaves of up to
+    // `MAX_LEAF_SIZE` primitives, which are ranges of the primitive order the build leaves
+    // behind, so leaves take no nodes of their own.
+    //
+    // The build splits a range of primitives in two at the cheapest of the binned surface area
+    // heuristic's planes, and splits the larger half again until the node has four children.
+    // Children of large ranges are built as jobs of their own, claiming their nodes from a
+    // shared counter, so a parent's index is always below its children's. `update` changes a
+    // primitive's box and `refit` grows the boxes of the nodes above the changed primitives
+    // back around them, in reverse index order so children come before their parents, which
+    // keeps the tree's topology and is far cheaper than a build, at the cost of the tree
+    // getting looser the further the primitives move.
+    class Bvh4 {
+        public:
+            struct alignas(64) Node {
+                std::array<float, NODE_WIDTH> minX;
+                std::array<float, NODE_WIDTH> minY;
+                std::array<float, NODE_WIDTH> minZ;
+                std::array<float, NODE_WIDTH> maxX;
+                std::array<float, NODE_WIDTH> maxY;
+                std::array<float, NODE_WIDTH> maxZ;
+                // The child node, or the leaf's first index into the primitive order, and
+                // `INVALID_INDEX` for unused lanes.
+                std::array<uint32_t, NODE_WIDTH> child;
+                // How many primitives a leaf holds, and zero for child nodes.
+                std::array<uint32_t, NODE_WIDTH> count;
+            };
+
+            static_assert(sizeof(Node) == 128, "a node should span two cache lines");
+
+            explicit Bvh4() = default;
+
+            Bvh4(const Bvh4& other) = delete;
+            Bvh4& operator=(const Bvh4& other) = delete;
+
+            void build(vk_jobs::JobSystem& jobSystem, std::span<const Aabb> boxes) {
+                m_boxes.assign(boxes.begin(), boxes.end());
+                m_changed.clear();
+                m_order.resize(m_boxes.size());
+                m_centers.resize(m_boxes.size());
+                m_leafNodes.assign(m_boxes.size(), INVALID_INDEX);
+                for (uint32_t i = 0; i < m_boxes.size(); i++) {
+                    m_order[i] = i;
+                    m_centers[i] = m_boxes[i].center();
+                }
+
+                // Every node but the root has at least two children, so there are fewer nodes
+                // than primitives.
+                m_nodes.resize(std::max<size_t>(m_boxes.size(), 1));
+                m_parents.assign(m_nodes.size(), INVALID_INDEX);
+                auto nodeCount = std::atomic<uint32_t> { 1 };
+                this->buildNode(jobSystem, nodeCount, 0, 0, static_cast<uint32_t>(m_boxes.size()));
+                m_nodes.resize(nodeCount.load());
+                m_parents.resize(nodeCount.load());
+                m_centers = std::vector<glm::vec3> {};
+            }
+
+            void clear() {
+                m_nodes = std::vector<Node> {};
+                m_parents = std::vector<uint32_t> {};
+                m_boxes = std::vector<Aabb> {};
+                m_order = std::vector<uint32_t> {};
+                m_leafNodes = std::vector<uint32_t> {};
+                m_changed = std::vector<uint32_t> {};
+            }
+
+            size_t size() const {
+                return m_boxes.size();
+            }
+
+            size_t nodeCount() const {
+                return m_nodes.size();
+            }
+
+            const Aabb& box(uint32_t primitive) const {
+                return m_boxes[primitive];
+            }
+
+            // The box of the whole tree.
+            Aabb bounds() const {
+                auto bounds = Aabb {};
+                if (m_nodes.empty()) {
+                    return bounds;
+                }
+
+                for (uint32_t lane = 0; lane < NODE_WIDTH; lane++) {
+                    if (m_nodes[0].child[lane] != INVALID_INDEX) {
+                        bounds.grow(childBox(m_nodes[0], lane));
+                    }
+                }
+
+                return bounds;
+            }
+
+            // Moves a primitive the tree was built with, which `refit` catches up on.
+            void update(uint32_t primitive, const Aabb& box) {
+                m_boxes[primitive] = box;
+                m_changed.push_back(primitive);
+            }
+
+            bool needsRefit() const {
+                return !m_changed.empty();
+            }
+
+            void refit() {
+                if (m_changed.empty()) {
+                    return;
+                }
+
+                // The nodes above every changed primitive, each once.
+                auto dirty = std::vector<uint32_t> {};
+                auto marked = std::vector<bool>(m_nodes.size(), false);
+                for (const auto primitive : m_changed) {
+                    for (auto node = m_leafNodes[primitive]; node != INVALID_INDEX && !marked[node]; node = m_parents[node]) {
+                        marked[node] = true;
+                        dirty.push_back(node);
+                    }
+                }
+                m_changed.clear();
+
+                std::sort(dirty.begin(), dirty.end(), std::greater<uint32_t> {});
+                for (const auto index : dirty) {
+                    auto& node = m_nodes[index];
+                    for (uint32_t lane = 0; lane < NODE_WIDTH; lane++) {
+                        if (node.child[lane] == INVALID_INDEX) {
+                            continue;
+                        }
+
+                        auto box = Aabb {};
+                        if (node.count[lane] > 0) {
+                            for (uint32_t i = 0; i < node.count[lane]; i++) {
+                                box.grow(m_boxes[m_order[node.child[lane] + i]]);
+                            }
+                        } else {
+                            const auto& child = m_nodes[node.child[lane]];
+                            for (uint32_t childLane = 0; childLane < NODE_WIDTH; childLane++) {
+                                if (child.child[childLane] != INVALID_INDEX) {
+                                    box.grow(childBox(child, childLane));
+                                }
+                            }
+                        }
+                        setChildBox(node, lane, box);
+                    }
+                }
+            }
+
+            // Calls `hit(primitive, maxDistance)` for every primitive whose box the ray enters
+            // within `maxDistance`, nearest node first, where `hit` returns the distance the
+            // ray still has to reach: the distance of whatever it hit, or `maxDistance` if it
+            // missed. Boxes beyond the nearest hit so far are skipped. Returns the final
+            // distance.
+            template <typename HitPrimitive>
+            float intersect(const Ray& ray, HitPrimitive&& hit) const {
+                using vk_transforms::Lanes;
+
+                auto maxDistance = ray.maxDistance;
+                if (m_nodes.empty()) {
+                    return maxDistance;
+                }
+
+                // Slabs of zero width along an axis the ray runs parallel to give infinities of
+                // matching sign, which the comparisons order correctly.
+                const auto inverse = 1.0f / ray.direction;
+                const auto originX = Lanes { ray.origin.x };
+                const auto originY = Lanes { ray.origin.y };
+                const auto originZ = Lanes { ray.origin.z };
+                const auto inverseX = Lanes { inverse.x };
+                const auto inverseY = Lanes { inverse.y };
+                const auto inverseZ = Lanes { inverse.z };
+
+                auto stack = std::vector<uint32_t> { 0 };
+                stack.reserve(64);
+                while (!stack.empty()) {
+                    const auto& node = m_nodes[stack.back()];
+                    stack.pop_back();
+
+                    const auto nearX = (load(node.minX) - originX) * inverseX;
+                    const auto farX = (load(node.maxX) - originX) * inverseX;
+                    const auto nearY = (load(node.minY) - originY) * inverseY;
+                    const auto farY = (load(node.maxY) - originY) * inverseY;
+                    const auto nearZ = (load(node.minZ) - originZ) * inverseZ;
+                    const auto farZ = (load(node.maxZ) - originZ) * inverseZ;
+                    const auto entry = glm::max(glm::max(glm::min(nearX, farX), glm::min(nearY, farY)), glm::max(glm::min(nearZ, farZ), Lanes { 0.0f }));
+                    const auto exit = glm::min(glm::min(glm::max(nearX, farX), glm::max(nearY, farY)), glm::min(glm::max(nearZ, farZ), Lanes { maxDistance }));
+
+                    // The lanes entered, nearest first.
+                    auto entered = std::array<std::pair<float, uint32_t>, NODE_WIDTH> {};
+                    uint32_t enteredCount = 0;
+                    for (uint32_t lane = 0; lane < NODE_WIDTH; lane++) {
+                        const auto l = static_cast<glm::length_t>(lane);
+                        if (node.child[lane] != INVALID_INDEX && entry[l] <= exit[l]) {
+                            entered[enteredCount++] = { entry[l], lane };
+                        }
+                    }
+                    std::sort(entered.begin(), entered.begin() + enteredCount);
+
+                    // Leaves right away, nodes onto the stack furthest first.
+                    for (uint32_t i = 0; i < enteredCount; i++) {
+                        const auto [distance, lane] = entered[i];
+                        if (node.count[lane] == 0 || distance > maxDistance) {
+                            continue;
+                        }
+
+                        for (uint32_t j = 0; j < node.count[lane]; j++) {
+                            maxDistance = hit(m_order[node.child[lane] + j], maxDistance);
+                        }
+                    }
+                    for (uint32_t i = enteredCount; i > 0; i--) {
+                        const auto [distance, lane] = entered[i - 1];
+                        if (node.count[lane] == 0 && distance <= maxDistance) {
+                            stack.push_back(node.child[lane]);
+                        }
+                    }
+                }
+
+                return maxDistance;
+            }
+
+            // Calls `visit(primitive)` for every primitive whose box overlaps `region`.
+            template <typename VisitPrimitive>
+            void query(const Aabb& region, VisitPrimitive&& visit) const {
+                using vk_transforms::Lanes;
+
+                if (m_nodes.empty()) {
+                    return;
+                }
+
+                const auto regionMinX = Lanes { region.min.x };
+                const auto regionMinY = Lanes { region.min.y };
+                const auto regionMinZ = Lanes { region.min.z };
+                const auto regionMaxX = Lanes { region.max.x };
+                const auto regionMaxY = Lanes { region.max.y };
+                const auto regionMaxZ = Lanes { region.max.z };
+
+                auto stack = std::vector<uint32_t> { 0 };
+                stack.reserve(64);
+                while (!stack.empty()) {
+                    const auto& node = m_nodes[stack.back()];
+                    stack.pop_back();
+
+                    // Positive where a lane's box reaches past the region's near side and
+                    // starts before its far side on every axis.
+                    const auto gap = glm::min(
+                        glm::min(glm::min(load(node.maxX) - regionMinX, regionMaxX - load(node.minX)), glm::min(load(node.maxY) - regionMinY, regionMaxY - load(node.minY))),
+                        glm::min(load(node.maxZ) - regionMinZ, regionMaxZ - load(node.minZ))
+                    );
+                    for (uint32_t lane = 0; lane < NODE_WIDTH; lane++) {
+                        if (node.child[lane] == INVALID_INDEX || gap[static_cast<glm::length_t>(lane)] < 0.0f) {
+                            continue;
+                        }
+
+                        if (node.count[lane] == 0) {
+                            stack.push_back(node.child[lane]);
+                            continue;
+                        }
+
+                        for (uint32_t i = 0; i < node.count[lane]; i++) {
+                            const auto primitive = m_order[node.child[lane] + i];
+                            if (m_boxes[primitive].overlaps(region)) {
+                                visit(primitive);
+                            }
+                        }
+                    }
+                }
+            }
+        private:
+            struct Range {
+                uint32_t first;
+                uint32_t end;
+
+                uint32_t size() const {
+                    return end - first;
+                }
+            };
+
+            std::vector<Node> m_nodes;
+            std::vector<uint32_t> m_parents;
+            std::vector<Aabb> m_boxes;
+            // Only kept during the build.
+            std::vector<glm::vec3> m_centers;
+            // The primitives in leaf order.
+            std::vector<uint32_t> m_order;
+            // The node whose leaf holds each primitive.
+            std::vector<uint32_t> m_leafNodes;
+            std::vector<uint32_t> m_changed;
+
+            static vk_transforms::Lanes load(const std::array<float, NODE_WIDTH>& array) {
+                auto lanes = vk_transforms::Lanes {};
+                std::memcpy(&lanes, array.data(), sizeof(lanes));
+
+                return lanes;
+            }
+
+            static Aabb childBox(const Node& node, uint32_t lane) {
+                return Aabb {
+                    .min = glm::vec3 { node.minX[lane], node.minY[lane], node.minZ[lane] },
+                    .max = glm::vec3 { node.maxX[lane], node.maxY[lane], node.maxZ[lane] },
+                };
+            }
+
+            static void setChildBox(Node& node, uint32_t lane, const Aabb& box) {
+                node.minX[lane] = box.min.x;
+                node.minY[lane] = box.min.y;
+                node.minZ[lane] = box.min.z;
+                node.maxX[lane] = box.max.x;
+                node.maxY[lane] = box.max.y;
+                node.maxZ[lane] = box.max.z;
+            }
+
+            Aabb rangeBox(Range range) const {
+                auto box = Aabb {};
+                for (auto i = range.first; i < range.end; i++) {
+                    box.grow(m_boxes[m_order[i]]);
+                }
+
+                return box;
+            }
+
+            // Splits `range` in two at the cheapest plane of the binned surface area heuristic
+            // over the centers of its primitives, and at the median of the widest axis where
+            // the centers cannot be told apart. Returns where the second half starts.
+            uint32_t split(Range range) {
+                auto centerBox = Aabb {};
+                for (auto i = range.first; i < range.end; i++) {
+                    centerBox.grow(m_centers[m_order[i]]);
+                }
+
+                const auto extent = centerBox.max - centerBox.min;
+                struct Bin {
+                    Aabb box;
+                    uint32_t count = 0;
+                };
+                auto bestCost = std::numeric_limits<float>::max();
+                auto bestAxis = glm::length_t { -1 };
+                auto bestPlane = uint32_t { 0 };
+                for (glm::length_t axis = 0; axis < 3; axis++) {
+                    if (extent[axis] <= 0.0f) {
+                        continue;
+                    }
+
+                    auto bins = std::array<Bin, BIN_COUNT> {};
+                    const auto scale = static_cast<float>(BIN_COUNT) / extent[axis];
+                    for (auto i = range.first; i < range.end; i++) {
+                        const auto primitive = m_order[i];
+                        const auto bin = std::min(static_cast<uint32_t>((m_centers[primitive][axis] - centerBox.min[axis]) * scale), BIN_COUNT - 1);
+                        bins[bin].box.grow(m_boxes[primitive]);
+                        bins[bin].count++;
+                    }
+
+                    // The cost of the planes after each bin, swept from both sides.
+                    auto rightCosts = std::array<float, BIN_COUNT> {};
+                    auto right = Bin {};
+                    for (auto bin = BIN_COUNT - 1; bin > 0; bin--) {
+                        right.box.grow(bins[bin].box);
+                        right.count += bins[bin].count;
+                        rightCosts[bin - 1] = right.count == 0 ? 0.0f : right.box.halfArea() * static_cast<float>(right.count);
+                    }
+                    auto left = Bin {};
+                    for (uint32_t plane = 0; plane < BIN_COUNT - 1; plane++) {
+                        left.box.grow(bins[plane].box);
+                        left.count += bins[plane].count;
+                        const auto cost = (left.count == 0 ? 0.0f : left.box.halfArea() * static_cast<float>(left.count)) + rightCosts[plane];
+                        if (left.count > 0 && left.count < range.size() && cost < bestCost) {
+                            bestCost = cost;
+                            bestAxis = axis;
+                            bestPlane = plane;
+                        }
+                    }
+                }
+
+                if (bestAxis >= 0) {
+                    const auto scale = static_cast<float>(BIN_COUNT) / extent[bestAxis];
+                    const auto middle = std::partition(m_order.begin() + range.first, m_order.begin() + range.end, [&](uint32_t primitive) {
+                        return std::min(static_cast<uint32_t>((m_centers[primitive][bestAxis] - centerBox.min[bestAxis]) * scale), BIN_COUNT - 1) <= bestPlane;
+                    });
+
+                    return static_cast<uint32_t>(middle - m_order.begin());
+                }
+
+                const auto axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+                const auto middle = range.first + range.size() / 2;
+                std::nth_element(m_order.begin() + range.first, m_order.begin() + middle, m_order.begin() + range.end, [&](uint32_t a, uint32_t b) {
+                    return m_centers[a][axis] < m_centers[b][axis];
+                });
+
+                return middle;
+            }
+
+            // Fills node `index` with the children of `range`, and builds the nodes below it.
+            void buildNode(vk_jobs::JobSystem& jobSystem, std::atomic<uint32_t>& nodeCount, uint32_t index, uint32_t first, uint32_t end) {
+                auto children = std::array<Range, NODE_WIDTH> {};
+                auto childCount = uint32_t { 1 };
+                children[0] = Range { first, end };
+                while (childCount < NODE_WIDTH) {
+                    // The largest range left that is too large for a leaf.
+                    auto largest = childCount;
+                    for (uint32_t i = 0; i < childCount; i++) {
+                        if (children[i].size() > MAX_LEAF_SIZE && (largest == childCount || children[i].size() > children[largest].size())) {
+                            largest = i;
+                        }
+                    }
+                    if (largest == childCount) {
+                        break;
+                    }
+
+                    const auto middle = this->split(children[largest]);
+                    children[childCount++] = Range { middle, children[largest].end };
+                    children[largest].end = middle;
+                }
+
+                auto& node = m_nodes[index];
+                node.child.fill(INVALID_INDEX);
+                node.count.fill(0);
+                auto tasks = vk_jobs::TaskGroup { jobSystem };
+                for (uint32_t lane = 0; lane < NODE_WIDTH; lane++) {
+                    setChildBox(node, lane, Aabb {});
+                    if (lane >= childCount || children[lane].size() == 0) {
+                        continue;
+                    }
+
+                    const auto range = children[lane];
+                    setChildBox(node, lane, this->rangeBox(range));
+                    if (range.size() <= MAX_LEAF_SIZE) {
+                        node.child[lane] = range.first;
+                        node.count[lane] = range.size();
+                        for (auto i = range.first; i < range.end; i++) {
+                            m_leafNodes[m_order[i]] = index;
+                        }
+                        continue;
+                    }
+
+                    const auto child = nodeCount.fetch_add(1, std::memory_order_relaxed);
+                    node.child[lane] = child;
+                    m_parents[child] = index;
+                    if (range.size() >= PRIMITIVES_PER_BUILD_JOB) {
+                        tasks.run([this, &jobSystem, &nodeCount, child, range]() {
+                            this->buildNode(jobSystem, nodeCount, child, range.first, range.end);
+                        });
+                    } else {
+                        this->buildNode(jobSystem, nodeCount, child, range.first, range.end);
+                    }
+                }
+
+                tasks.wait();
+            }
+    };
+
+    // What a ray hit: the instance, the triangle of the mesh, and the distance along the ray.
+    struct Hit {
+        uint32_t instance;
+        uint32_t triangle;
+        float distance;
+    };
+
+    // A scene of instances of one triangle mesh, for picking and region queries on the CPU.
+    //
+    // Two levels of `Bvh4`: one over the mesh's triangles in its own space, built once, and
+    // one over the instances' world space boxes. A ray walks the instances' tree, and is
+    // moved into the space of every instance whose box it enters to walk the mesh's tree, so
+    // a million instances of a cube of a couple of hundred triangles are hundreds of millions
+    // of triangles the ray only ever tests a few dozen of. The instance tree is built again
+    // once instances are added, and refitted when instances move.
+    class SceneBvh {
+        public:
+            explicit SceneBvh() = default;
+
+            SceneBvh(const SceneBvh& other) = delete;
+            SceneBvh& operator=(const SceneBvh& other) = delete;
+
+            // The mesh every instance draws, as a triangle list, whose tree is built right away.
+            void init(vk_jobs::JobSystem& jobSystem, std::span<const glm::vec3> positions, std::span<const uint32_t> indices) {
+                m_jobSystem = &jobSystem;
+                m_positions.assign(positions.begin(), positions.end());
+                m_indices.assign(indices.begin(), indices.end());
+                m_meshBox = Aabb {};
+                for (const auto& position : m_positions) {
+                    m_meshBox.grow(position);
+                }
+
+                auto triangleBoxes = std::vector<Aabb>(m_indices.size() / 3);
+                for (size_t triangle = 0; triangle < triangleBoxes.size(); triangle++) {
+                    for (uint32_t corner = 0; corner < 3; corner++) {
+                        triangleBoxes[triangle].grow(m_positions[m_indices[3 * triangle + corner]]);
+                    }
+                }
+                m_meshTree.build(jobSystem, triangleBoxes);
+                m_instances.clear();
+                m_inverses.clear();
+                m_builtInstanceCount = 0;
+            }
+
+            void destroy() {
+                m_jobSystem = nullptr;
+                m_positions = std::vector<glm::vec3> {};
+                m_indices = std::vector<uint32_t> {};
+                m_meshTree.clear();
+                m_instanceTree.clear();
+                m_instances = std::vector<vk_transforms::WorldMatrix> {};
+                m_inverses = std::vector<vk_transforms::WorldMatrix> {};
+                m_builtInstanceCount = 0;
+            }
+
+            bool isInitialized() const {
+                return m_jobSystem != nullptr;
+            }
+
+            uint32_t instanceCount() const {
+                return static_cast<uint32_t>(m_instances.size());
+            }
+
+            size_t triangleCount() const {
+                return m_meshTree.size() * m_instances.size();
+            }
+
+            // Sets the world matrices of the instances from `first` on, adding the ones past
+            // the last. `update` catches the trees up.
+            void setInstances(uint32_t first, std::span<const vk_transforms::WorldMatrix> matrices) {
+                const auto end = first + static_cast<uint32_t>(matrices.size());
+                if (end > m_instances.size()) {
+                    m_instances.resize(end);
+                    m_inverses.resize(end);
+                }
+
+                for (uint32_t i = 0; i < matrices.size(); i++) {
+                    const auto instance = first + i;
+                    m_instances[instance] = matrices[i];
+                    m_inverses[instance] = inverseMatrix(matrices[i]);
+                    if (instance < m_builtInstanceCount) {
+                        m_instanceTree.update(instance, transformBox(matrices[i], m_meshBox));
+                    }
+                }
+            }
+
+            // Builds the instance tree again when instances were added since the last build,
+            // and refits it around the instances that moved otherwise.
+            void update() {
+                if (m_builtInstanceCount == m_instances.size()) {
+                    m_instanceTree.refit();
+                    return;
+                }
+
+                auto boxes = std::vector<Aabb>(m_instances.size());
+                vk_math::transformBoxInstances(m_instances, m_meshBox, boxes.data());
+                m_instanceTree.build(*m_jobSystem, boxes);
+                m_builtInstanceCount = static_cast<uint32_t>(m_instances.size());
+            }
+
+            // The nearest triangle the ray hits, as of the last `update`.
+            std::optional<Hit> pick(const Ray& ray) const {
+                auto closest = std::optional<Hit> {};
+                m_instanceTree.intersect(ray, [this, &ray, &closest](uint32_t instance, float maxDistance) {
+                    // The local direction is the world one under the inverse, unnormalized, so
+                    // distances along both rays agree.
+                    const auto& inverse = m_inverses[instance];
+                    const auto localRay = Ray {
+                        .origin = transformPoint(inverse, ray.origin),
+                        .direction = transformDirection(inverse, ray.direction),
+                        .maxDistance = maxDistance,
+                    };
+
+                    return m_meshTree.intersect(localRay, [this, &localRay, &closest, instance](uint32_t triangle, float triangleMaxDistance) {
+                        const auto distance = this->intersectTriangle(localRay, triangle);
+                        if (!distance.has_value() || distance.value() >= triangleMaxDistance) {
+                            return triangleMaxDistance;
+                        }
+
+                        closest = Hit { .instance = instance, .triangle = triangle, .distance = distance.value() };
+
+                        return distance.value();
+                    });
+                });
+
+                return closest;
+            }
+
+            // The instances whose boxes overlap `region`, as of the last `update`.
+            std::vector<uint32_t> query(const Aabb& region) const {
+                auto instances = std::vector<uint32_t> {};
+                m_instanceTree.query(region, [&instances](uint32_t instance) {
+                    instances.push_back(instance);
+                });
+
+                return instances;
+            }
+        private:
+            vk_jobs::JobSystem* m_jobSystem = nullptr;
+            std::vector<glm::vec3> m_positions;
+            std::vector<uint32_t> m_indices;
+            Aabb m_meshBox;
+            Bvh4 m_meshTree;
+            Bvh4 m_instanceTree;
+            std::vector<vk_transforms::WorldMatrix> m_instances;
+            std::vector<vk_transforms::WorldMatrix> m_inverses;
+            uint32_t m_builtInstanceCount = 0;
+
+            static vk_transforms::WorldMatrix inverseMatrix(const vk_transforms::WorldMatrix& matrix) {
+                // glm's matrices are column major, so the rows go in transposed.
+                const auto linear = glm::transpose(glm::mat3 {
+                    glm::vec3 { matrix.rows[0] },
+                    glm::vec3 { matrix.rows[1] },
+                    glm::vec3 { matrix.rows[2] },
+                });
+                const auto inverse = glm::inverse(linear);
+                const auto translation = -(inverse * glm::vec3 { matrix.rows[0].w, matrix.rows[1].w, matrix.rows[2].w });
+
+                return vk_transforms::WorldMatrix {
+                    .rows = {
+                        glm::vec4 { inverse[0][0], inverse[1][0], inverse[2][0], translation.x },
+                        glm::vec4 { inverse[0][1], inverse[1][1], inverse[2][1], translation.y },
+                        glm::vec4 { inverse[0][2], inverse[1][2], inverse[2][2], translation.z },
+                    },
+                };
+            }
+
+            static glm::vec3 transformPoint(const vk_transforms::WorldMatrix& matrix, const glm::vec3& point) {
+                const auto p = glm::vec4 { point, 1.0f };
+
+                return glm::vec3 { glm::dot(matrix.rows[0], p), glm::dot(matrix.rows[1], p), glm::dot(matrix.rows[2], p) };
+            }
+
+            static glm::vec3 transformDirection(const vk_transforms::WorldMatrix& matrix, const glm::vec3& direction) {
+                const auto d = glm::vec4 { direction, 0.0f };
+
+                return glm::vec3 { glm::dot(matrix.rows[0], d), glm::dot(matrix.rows[1], d), glm::dot(matrix.rows[2], d) };
+            }
+
+            // Möller and Trumbore's test, from either side.
+            std::optional<float> intersectTriangle(const Ray& ray, uint32_t triangle) const {
+                constexpr float EPSILON = 1.0e-8f;
+
+                const auto& a = m_positions[m_indices[3 * triangle]];
+                const auto& b = m_positions[m_indices[3 * triangle + 1]];
+                const auto& c = m_positions[m_indices[3 * triangle + 2]];
+                const auto edge1 = b - a;
+                const auto edge2 = c - a;
+                const auto p = glm::cross(ray.direction, edge2);
+                const auto determinant = glm::dot(edge1, p);
+                if (std::abs(determinant) < EPSILON) {
+                    return std::nullopt;
+                }
+
+                const auto inverseDeterminant = 1.0f / determinant;
+                const auto toOrigin = ray.origin - a;
+                const auto u = glm::dot(toOrigin, p) * inverseDeterminant;
+                if (u < 0.0f || u > 1.0f) {
+                    return std::nullopt;
+                }
+
+                const auto q = glm::cross(toOrigin, edge1);
+                const auto v = glm::dot(ray.direction, q) * inverseDeterminant;
+                if (v < 0.0f || u + v > 1.0f) {
+                    return std::nullopt;
+                }
+
+                const auto distance = glm::dot(edge2, q) * inverseDeterminant;
+                if (distance < 0.0f) {
+                    return std::nullopt;
+                }
+
+                return distance;
+            }
+    };
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+
+namespace vk_capture {
+    // A capture is one file: a header with the scene it was taken with, then one record per
+    // submitted frame. A record is a `FrameHeader` followed by `windowCount` windows. Everything
+    // a frame renders follows from these and the scene: the camera and the temporal jitter from
+    // the frame number, the instance, light and particle uploads from the scene, and the draws
+    // from what the cull passes make of the camera.
+    constexpr std::array<char, 8> CAPTURE_MAGIC = { 'H', 'W', 'C', 'A', 'P', 'T', '\0', '\0' };
+    constexpr uint32_t CAPTURE_VERSION = 1;
+
+    struct CaptureHeader {
+        std::array<char, 8> magic;
+        uint32_t version;
+        uint32_t instanceCount;
+        uint32_t lightCount;
+        uint32_t particleCount;
+        uint32_t windowCount;
+        uint32_t reserved;
+    };
+
+    static_assert(sizeof(CaptureHeader) == 32, "CaptureHeader must match the capture layout");
+
+    struct FrameHeader {
+        uint64_t frameNumber;
+        uint32_t windowCount;
+        uint32_t reserved;
+    };
+
+    static_assert(sizeof(FrameHeader) == 16, "FrameHeader must match the capture layout");
+
+    // A window that took part in the frame, and the extent it rendered at.
+    struct CapturedWindow {
+        uint32_t windowIndex;
+        uint32_t width;
+        uint32_t height;
+    };
+
+    static_assert(sizeof(CapturedWindow) == 12, "CapturedWindow must match the capture layout");
+
+    struct CapturedFrame {
+        uint64_t frameNumber;
+        std::vector<CapturedWindow> windows;
+    };
+
+    struct Capture {
+        CaptureHeader header;
+        std::vector<CapturedFrame> frames;
+
+        // The largest extent any window renders at anywhere in the capture, which replay sizes
+        // its offscreen images to.
+        std::array<uint32_t, 2> maxExtent() const {
+            auto extent = std::array<uint32_t, 2> { 1, 1 };
+            for (const auto& frame : this->frames) {
+                for (const auto& window : frame.windows) {
+                    extent[0] = std::max(extent[0], window.width);
+                    extent[1] = std::max(extent[1], window.height);
+                }
+            }
+
+            return extent;
+        }
+    };
+
+    // Appends a record per frame to the file. The stream buffers the writes, so a frame costs
+    // a couple of copies on the render thread, and the file is complete once it is closed.
+    class CaptureWriter {
+        public:
+            explicit CaptureWriter() = default;
+
+            CaptureWriter(const CaptureWriter& other) = delete;
+            CaptureWriter& operator=(const CaptureWriter& other) = delete;
+
+            void open(const std::filesystem::path& path, uint32_t instanceCount, uint32_t lightCount, uint32_t particleCount, uint32_t windowCount) {
+                m_file = std::ofstream { path, std::ios::binary | std::ios::trunc };
+                if (!m_file) {
+                    throw std::runtime_error("failed to open capture file!");
+                }
+
+                const auto header = CaptureHeader {
+                    .magic = CAPTURE_MAGIC,
+                    .version = CAPTURE_VERSION,
+                    .instanceCount = instanceCount,
+                    .lightCount = lightCount,
+                    .particleCount = particleCount,
+                    .windowCount = windowCount,
+                    .reserved = 0,
+                };
+                m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            }
+
+            bool isOpen() const {
+                return m_file.is_open();
+            }
+
+            void writeFrame(uint64_t frameNumber, std::span<const CapturedWindow> windows) {
+                const auto frameHeader = FrameHeader {
+                    .frameNumber = frameNumber,
+                    .windowCount = static_cast<uint32_t>(windows.size()),
+                    .reserved = 0,
+                };
+                m_file.write(reinterpret_cast<const char*>(&frameHeader), sizeof(frameHeader));
+                m_file.write(reinterpret_cast<const char*>(windows.data()), static_cast<std::streamsize>(windows.size_bytes()));
+                if (!m_file) {
+                    throw std::runtime_error("failed to write capture file!");
+                }
+            }
+
+            void close() {
+                if (!m_file.is_open()) {
+                    return;
+                }
+
+                m_file.close();
+                if (!m_file) {
+                    throw std::runtime_error("failed to write capture file!");
+                }
+            }
+        private:
+            std::ofstream m_file;
+    };
+
+    // Reads the whole capture up front, so replay does no file IO while frames are measured.
+    inline Capture readCapture(const std::filesystem::path& path) {
+        auto file = std::ifstream { path, std::ios::binary };
+        if (!file) {
+            throw std::runtime_error("failed to open capture file!");
+        }
+
+        auto capture = Capture {};
+        if (!file.read(reinterpret_cast<char*>(&capture.header), sizeof(capture.header))) {
+            throw std::runtime_error("failed to open capture file, file is truncated!");
+        }
+
+        if (capture.header.magic != CAPTURE_MAGIC || capture.header.version != CAPTURE_VERSION) {
+            throw std::runtime_error("failed to open capture file, unknown format!");
+        }
+
+        auto frameHeader = FrameHeader {};
+        while (file.read(reinterpret_cast<char*>(&frameHeader), sizeof(frameHeader))) {
+            if (frameHeader.windowCount == 0 || frameHeader.windowCount > capture.header.windowCount) {
+                throw std::runtime_error("failed to open capture file, bad frame!");
+            }
+
+            auto& frame = capture.frames.emplace_back(CapturedFrame { frameHeader.frameNumber, {} });
+            frame.windows.resize(frameHeader.windowCount);
+            const auto windowBytes = static_cast<std::streamsize>(frame.windows.size() * sizeof(CapturedWindow));
+            if (!file.read(reinterpret_cast<char*>(frame.windows.data()), windowBytes)) {
+                throw std::runtime_error("failed to open capture file, file is truncated!");
+            }
+        }
+
+        if (file.gcount() != 0) {
+            throw std::runtime_error("failed to open capture file, file is truncated!");
+        }
+
+        return capture;
+    }
+}
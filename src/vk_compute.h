@@ -0,0 +1,162 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <algorithm>
+#include <cstdint>
+
+
+namespace vk_compute {
+    constexpr uint32_t VENDOR_ID_AMD = 0x1002;
+    constexpr uint32_t VENDOR_ID_APPLE = 0x106b;
+    constexpr uint32_t VENDOR_ID_INTEL = 0x8086;
+    constexpr uint32_t VENDOR_ID_NVIDIA = 0x10de;
+
+    // What the device's compute subgroups look like. The size may only be pinned with
+    // `subgroupSizeControl` enabled, and then anywhere between the minimum and the maximum.
+    // Workgroups may only require full subgroups with `computeFullSubgroups` enabled.
+    struct SubgroupProperties {
+        uint32_t vendorID = 0;
+        uint32_t subgroupSize = 0;
+        uint32_t minSubgroupSize = 0;
+        uint32_t maxSubgroupSize = 0;
+        VkSubgroupFeatureFlags operations = 0;
+        bool sizeControl = false;
+        bool fullSubgroups = false;
+        uint32_t maxComputeWorkGroupSize[2] {};
+        uint32_t maxComputeWorkGroupInvocations = 0;
+    };
+
+    inline SubgroupProperties querySubgroupProperties(VkPhysicalDevice physicalDevice, bool subgroupSizeControl, bool computeFullSubgroups) {
+        auto sizeControlProperties = VkPhysicalDeviceSubgroupSizeControlProperties {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_SIZE_CONTROL_PROPERTIES,
+        };
+        auto subgroupProperties = VkPhysicalDeviceSubgroupProperties {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES,
+            .pNext = &sizeControlProperties,
+        };
+        auto properties = VkPhysicalDeviceProperties2 {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+            .pNext = &subgroupProperties,
+        };
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+        const auto& limits = properties.properties.limits;
+        const auto computeOperations = (subgroupProperties.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) != 0;
+
+        return SubgroupProperties {
+            .vendorID = properties.properties.vendorID,
+            .subgroupSize = subgroupProperties.subgroupSize,
+            .minSubgroupSize = sizeControlProperties.minSubgroupSize,
+            .maxSubgroupSize = sizeControlProperties.maxSubgroupSize,
+            .operations = computeOperations ? subgroupProperties.supportedOperations : VkSubgroupFeatureFlags { 0 },
+            .sizeControl = subgroupSizeControl && (sizeControlProperties.requiredSubgroupSizeStages & VK_SHADER_STAGE_COMPUTE_BIT) != 0,
+            .fullSubgroups = computeFullSubgroups,
+            .maxComputeWorkGroupSize = { limits.maxComputeWorkGroupSize[0], limits.maxComputeWorkGroupSize[1] },
+            .maxComputeWorkGroupInvocations = limits.maxComputeWorkGroupInvocations,
+        };
+    }
+
+    // How the compute kernels are dispatched on the device, which they take as specialization
+    // constants. Linear kernels run `linear` invocations a workgroup, in subgroups of
+    // `subgroupSize`, which is pinned on the pipeline unless `pinSubgroupSize` is false and
+    // the driver picks. Tiled kernels run square workgroups of `tile` a side. With
+    // `subgroupCompaction`, kernels that append to a buffer count their survivors with a
+    // ballot and take one atomic per subgroup instead of one per survivor. With
+    // `subgroupPrimitives`, linear kernels can run in full subgroups with subgroup arithmetic
+    // and ballots, which the scans, sorts and compactions of `vk_gpu_primitives` are built on.
+    // With `subgroupQuads`, kernels that reduce 2x2 blocks can swap values within quads of full
+    // subgroups, as the downsampler of `vk_downsample` does.
+    struct ComputeTuning {
+        uint32_t linear = 64;
+        uint32_t tile = 8;
+        uint32_t subgroupSize = 32;
+        bool pinSubgroupSize = false;
+        bool subgroupCompaction = false;
+        bool subgroupPrimitives = false;
+        bool subgroupQuads = false;
+    };
+
+    // The subgroup size the device runs the linear kernels best in, or zero to leave it to the
+    // driver. NVIDIA and Apple GPUs only have 32 wide subgroups. AMD's RDNA runs both 32 and 64
+    // wide waves and its driver usually picks wave32 for compute, but the kernels here are
+    // memory bound appends, which issue fewer, wider requests in wave64, the only width GCN
+    // has. Intel's compiler picks SIMD8, 16 or 32 per kernel from its register pressure, which
+    // is best left to it.
+    inline uint32_t preferredSubgroupSize(const SubgroupProperties& properties) {
+        switch (properties.vendorID) {
+            case VENDOR_ID_AMD:
+                return 64;
+            case VENDOR_ID_NVIDIA:
+            case VENDOR_ID_APPLE:
+                return 32;
+            default:
+                return 0;
+        }
+    }
+
+    // Linear workgroups span two subgroups, and at least 64 invocations, so that a workgroup
+    // never leaves a subgroup idle, and tiles are the largest square of a power of two side
+    // that fits in one. Both stay within the device's workgroup limits.
+    inline ComputeTuning selectComputeTuning(const SubgroupProperties& properties) {
+        auto tuning = ComputeTuning {};
+        tuning.subgroupSize = std::max(properties.subgroupSize, 1u);
+
+        const auto preferred = preferredSubgroupSize(properties);
+        if (
+            properties.sizeControl
+            && preferred != 0
+            && preferred != properties.subgroupSize
+            && preferred >= properties.minSubgroupSize
+            && preferred <= properties.maxSubgroupSize
+        ) {
+            tuning.subgroupSize = preferred;
+            tuning.pinSubgroupSize = true;
+        }
+
+        const auto maxLinear = std::min(properties.maxComputeWorkGroupSize[0], properties.maxComputeWorkGroupInvocations);
+        const auto wanted = std::min(std::max(2 * tuning.subgroupSize, 64u), maxLinear);
+        tuning.linear = 1;
+        while (tuning.linear * 2 <= wanted) {
+            tuning.linear *= 2;
+        }
+
+        const auto maxTile = std::min(properties.maxComputeWorkGroupSize[0], properties.maxComputeWorkGroupSize[1]);
+        tuning.tile = 1;
+        while ((tuning.tile * 2) * (tuning.tile * 2) <= tuning.linear && tuning.tile * 2 <= maxTile) {
+            tuning.tile *= 2;
+        }
+
+        const auto ballot = VkSubgroupFeatureFlags { VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_BALLOT_BIT };
+        tuning.subgroupCompaction = (properties.operations & ballot) == ballot;
+
+        // Full subgroups need a workgroup that is a multiple of every size the driver may pick,
+        // or of the pinned one.
+        const auto primitives = ballot | VK_SUBGROUP_FEATURE_ARITHMETIC_BIT;
+        const auto fullSubgroupSize = tuning.pinSubgroupSize ? tuning.subgroupSize : std::max(properties.maxSubgroupSize, tuning.subgroupSize);
+        tuning.subgroupPrimitives = properties.fullSubgroups
+            && tuning.linear % fullSubgroupSize == 0
+            && (properties.operations & primitives) == primitives;
+
+        const auto quads = VkSubgroupFeatureFlags { VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_QUAD_BIT };
+        tuning.subgroupQuads = properties.fullSubgroups && (properties.operations & quads) == quads;
+
+        return tuning;
+    }
+
+    // Pins the tuned subgroup size on a linear kernel's stage, by chaining `requiredSize` to
+    // its `pNext`. Returns null when the driver picks, and `requiredSize`, which has to outlive
+    // the pipeline's creation, otherwise.
+    inline const void* requiredSubgroupSize(const ComputeTuning& tuning, VkPipelineShaderStageRequiredSubgroupSizeCreateInfo& requiredSize) {
+        if (!tuning.pinSubgroupSize) {
+            return nullptr;
+        }
+
+        requiredSize = VkPipelineShaderStageRequiredSubgroupSizeCreateInfo {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_REQUIRED_SUBGROUP_SIZE_CREATE_INFO,
+            .requiredSubgroupSize = tuning.subgroupSize,
+        };
+
+        return &requiredSize;
+    }
+}
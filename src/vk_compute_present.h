@@ -0,0 +1,219 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#include "vk_compute.h"
+#include "vk_descriptors.h"
+#include "vk_handles.h"
+#include "vk_pipelines.h"
+
+
+namespace vk_compute_present {
+    // The specialization constant ids of `local_size_x` and `local_size_y` in `present.comp`.
+    constexpr uint32_t WORKGROUP_WIDTH_ID = 0;
+    constexpr uint32_t WORKGROUP_HEIGHT_ID = 1;
+
+    struct PushConstants {
+        std::array<float, 4> color;
+        uint32_t encodeSrgb;
+    };
+
+    // Whether swapchain images of `format` can be bound as storage images.
+    inline bool supportsStorage(VkPhysicalDevice physicalDevice, VkFormat format) {
+        auto properties = VkFormatProperties {};
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+
+        return (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT) != 0;
+    }
+
+    // The formats among `availableFormats` whose images can be bound as storage images. sRGB
+    // formats almost never can, so the shader encodes to sRGB itself.
+    inline std::vector<VkSurfaceFormatKHR> storageFormats(VkPhysicalDevice physicalDevice, const std::vector<VkSurfaceFormatKHR>& availableFormats) {
+        auto formats = std::vector<VkSurfaceFormatKHR> {};
+        for (const auto& availableFormat : availableFormats) {
+            if (supportsStorage(physicalDevice, availableFormat.format)) {
+                formats.push_back(availableFormat);
+            }
+        }
+
+        return formats;
+    }
+
+    // A linear format presented in the sRGB color space has to be written sRGB encoded.
+    inline bool needsSrgbEncode(VkColorSpaceKHR colorSpace) {
+        return colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+    }
+
+    // One storage image descriptor per swapchain image. They live in their own pool, so that
+    // they can be retired along with the swapchain they point into.
+    struct PresentTargets {
+        vk_handles::DescriptorPool descriptorPool;
+        std::vector<VkDescriptorSet> descriptorSets;
+    };
+
+    // Writes the frame straight into the swapchain image from a compute shader, which skips
+    // the raster pass and any copy into the swapchain. The swapchain has to be created with
+    // `VK_IMAGE_USAGE_STORAGE_BIT` and a format that supports storage images.
+    class ComputePresentPass {
+        public:
+            explicit ComputePresentPass() = default;
+
+            ComputePresentPass(const ComputePresentPass& other) = delete;
+            ComputePresentPass& operator=(const ComputePresentPass& other) = delete;
+
+            // The set layout comes from `layoutCache` and the pipeline from `pipelineRegistry`,
+            // which keep them. The shader runs in square workgroups of `computeTuning.tile`.
+            void init(
+                VkDevice device,
+                vk_descriptors::DescriptorLayoutCache& layoutCache,
+                VkShaderModule shaderModule,
+                vk_pipelines::PipelineRegistry& pipelineRegistry,
+                const vk_compute::ComputeTuning& computeTuning
+            ) {
+                m_device = device;
+                m_workgroupSize = computeTuning.tile;
+
+                const auto binding = VkDescriptorSetLayoutBinding {
+                    .binding = 0,
+                    .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                    .descriptorCount = 1,
+                    .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                };
+                m_descriptorSetLayout = layoutCache.layout(std::span { &binding, 1 });
+
+                const auto pushConstantRange = VkPushConstantRange {
+                    .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                    .offset = 0,
+                    .size = sizeof(PushConstants),
+                };
+                const auto pipelineLayoutInfo = VkPipelineLayoutCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+                    .setLayoutCount = 1,
+                    .pSetLayouts = &m_descriptorSetLayout,
+                    .pushConstantRangeCount = 1,
+                    .pPushConstantRanges = &pushConstantRange,
+                };
+
+                const auto pipelineLayoutResult = vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &m_pipelineLayout);
+                if (pipelineLayoutResult != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create compute present pipeline layout!");
+                }
+
+                auto constants = vk_pipelines::SpecializationConstants {};
+                constants.set(WORKGROUP_WIDTH_ID, m_workgroupSize).set(WORKGROUP_HEIGHT_ID, m_workgroupSize);
+                const auto pipelineInfo = VkComputePipelineCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+                    .stage = VkPipelineShaderStageCreateInfo {
+                        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                        .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                        .module = shaderModule,
+                        .pName = "main",
+                        .pSpecializationInfo = constants.info(),
+                    },
+                    .layout = m_pipelineLayout,
+                };
+
+                // Every frame needs this pipeline, so there is nothing to fall back to while a
+                // background compile runs, and it is created right away.
+                m_pipeline = pipelineRegistry.computePipeline(pipelineInfo);
+            }
+
+            void destroy() {
+                if (m_device == VK_NULL_HANDLE) {
+                    return;
+                }
+
+                vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+                m_device = VK_NULL_HANDLE;
+            }
+
+            bool isInitialized() const {
+                return m_device != VK_NULL_HANDLE;
+            }
+
+            // Storage image descriptors for the views of a new swapchain, in `GENERAL` layout.
+            PresentTargets createTargets(std::span<const VkImageView> imageViews) const {
+                const auto imageCount = static_cast<uint32_t>(imageViews.size());
+                const auto poolSize = VkDescriptorPoolSize { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, imageCount };
+                const auto poolInfo = VkDescriptorPoolCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+                    .maxSets = imageCount,
+                    .poolSizeCount = 1,
+                    .pPoolSizes = &poolSize,
+                };
+
+                auto descriptorPool = VkDescriptorPool {};
+                const auto poolResult = vkCreateDescriptorPool(m_device, &poolInfo, nullptr, &descriptorPool);
+                if (poolResult != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create compute present descriptor pool!");
+                }
+
+                auto targets = PresentTargets {
+                    .descriptorPool = vk_handles::DescriptorPool { m_device, descriptorPool, nullptr },
+                    .descriptorSets = std::vector<VkDescriptorSet> { imageCount, VK_NULL_HANDLE },
+                };
+
+                const auto setLayouts = std::vector<VkDescriptorSetLayout> { imageCount, m_descriptorSetLayout };
+                const auto allocateInfo = VkDescriptorSetAllocateInfo {
+                    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+                    .descriptorPool = descriptorPool,
+                    .descriptorSetCount = imageCount,
+                    .pSetLayouts = setLayouts.data(),
+                };
+
+                const auto allocateResult = vkAllocateDescriptorSets(m_device, &allocateInfo, targets.descriptorSets.data());
+                if (allocateResult != VK_SUCCESS) {
+                    throw std::runtime_error("failed to allocate compute present descriptor sets!");
+                }
+
+                auto imageInfos = std::vector<VkDescriptorImageInfo> {};
+                auto writes = std::vector<VkWriteDescriptorSet> {};
+                imageInfos.reserve(imageCount);
+                writes.reserve(imageCount);
+                for (uint32_t i = 0; i < imageCount; i++) {
+                    imageInfos.push_back(VkDescriptorImageInfo {
+                        .imageView = imageViews[i],
+                        .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+                    });
+                    writes.push_back(VkWriteDescriptorSet {
+                        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                        .dstSet = targets.descriptorSets[i],
+                        .dstBinding = 0,
+                        .dstArrayElement = 0,
+                        .descriptorCount = 1,
+                        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                        .pImageInfo = &imageInfos.back(),
+                    });
+                }
+
+                vkUpdateDescriptorSets(m_device, imageCount, writes.data(), 0, nullptr);
+
+                return targets;
+            }
+
+            // Fill the whole image behind `descriptorSet`, which has to be in `GENERAL` layout.
+            void record(VkCommandBuffer commandBuffer, VkDescriptorSet descriptorSet, VkExtent2D extent, const PushConstants& pushConstants) const {
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+                vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+                vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+                vkCmdDispatch(
+                    commandBuffer,
+                    (extent.width + m_workgroupSize - 1) / m_workgroupSize,
+                    (extent.height + m_workgroupSize - 1) / m_workgroupSize,
+                    1
+                );
+            }
+        private:
+            VkDevice m_device = VK_NULL_HANDLE;
+            VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
+            VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+            VkPipeline m_pipeline = VK_NULL_HANDLE;
+            uint32_t m_workgroupSize = 1;
+    };
+}
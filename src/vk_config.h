@@ -0,0 +1,201 @@
+#pragma once
+
+#include "vk_log.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include <fmt/core.h>
+
+
+namespace vk_config {
+    // Every setting is named after its environment variable.
+    constexpr std::string_view NAME_PREFIX = "HELLO_WINDOW_";
+    constexpr const char* CONFIG_ENVIRONMENT_VARIABLE = "HELLO_WINDOW_CONFIG";
+
+    // `frames-in-flight`, `frames_in_flight` and `FRAMES_IN_FLIGHT` all name the setting
+    // `HELLO_WINDOW_FRAMES_IN_FLIGHT`, and so does the full name.
+    inline std::string settingName(std::string_view key) {
+        auto name = std::string {};
+        name.reserve(NAME_PREFIX.size() + key.size());
+        for (const char c : key) {
+            name += c == '-' || c == '.' ? '_' : static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+        }
+
+        if (!name.starts_with(NAME_PREFIX)) {
+            name.insert(0, NAME_PREFIX);
+        }
+
+        return name;
+    }
+
+    inline std::string_view trim(std::string_view text) {
+        const auto first = text.find_first_not_of(" \t\r");
+        if (first == std::string_view::npos) {
+            return {};
+        }
+
+        const auto last = text.find_last_not_of(" \t\r");
+
+        return text.substr(first, last - first + 1);
+    }
+
+    // Settings are read once at startup, from three places. An option on the command line,
+    // `--frames-in-flight=3`, or `--render-thread` for `on`, wins over the environment
+    // variable, which wins over the config file. The file is named by `--config=<file>` or
+    // `HELLO_WINDOW_CONFIG`, and takes the TOML subset of one `key = value` per line, with `#`
+    // comments, optionally quoted values and `[table]` headers, whose name prefixes the keys
+    // below them, so `frames = 500` under `[bench]` sets `HELLO_WINDOW_BENCH_FRAMES`. Values
+    // are the strings the environment variables take.
+    class Config {
+        public:
+            explicit Config() = default;
+
+            Config(const Config& other) = delete;
+            Config& operator=(const Config& other) = delete;
+
+            void load(int argc, char** argv) {
+                auto configPath = std::string {};
+                if (const char* value = std::getenv(CONFIG_ENVIRONMENT_VARIABLE); value != nullptr) {
+                    configPath = value;
+                }
+
+                for (int i = 1; i < argc; i++) {
+                    const auto argument = std::string_view { argv[i] };
+                    if (!argument.starts_with("--") || argument.size() == 2) {
+                        throw std::runtime_error(fmt::format("unexpected command line argument `{}`!", argument));
+                    }
+
+                    const auto option = argument.substr(2);
+                    const auto separator = option.find('=');
+                    const auto key = option.substr(0, separator);
+                    const auto value = separator == std::string_view::npos ? std::string_view { "on" } : option.substr(separator + 1);
+                    if (key == "config") {
+                        configPath = value;
+                    } else {
+                        m_commandLine[settingName(key)] = value;
+                    }
+                }
+
+                if (!configPath.empty()) {
+                    this->readFile(configPath);
+                }
+            }
+
+            // The value of the setting `name`, like `HELLO_WINDOW_PRESENT_MODE`, or null when
+            // it is not set anywhere. The value lives as long as the config, or until the
+            // overrides are cleared.
+            const char* get(const char* name) const {
+                {
+                    const auto lock = std::scoped_lock { m_readMutex };
+                    m_read.emplace(name);
+                }
+
+                if (const auto found = m_overrides.find(name); found != m_overrides.end()) {
+                    return found->second.c_str();
+                }
+
+                if (const auto found = m_commandLine.find(name); found != m_commandLine.end()) {
+                    return found->second.c_str();
+                }
+
+                if (const char* value = std::getenv(name); value != nullptr) {
+                    return value;
+                }
+
+                if (const auto found = m_file.find(name); found != m_file.end()) {
+                    return found->second.c_str();
+                }
+
+                return nullptr;
+            }
+
+            // Sets `name` over every other source, for the benchmark sweep, which runs the app
+            // once per value. Only between runs, since nothing rereads a setting.
+            void override(std::string_view name, std::string_view value) {
+                m_overrides[std::string { name }] = value;
+            }
+
+            void clearOverrides() {
+                m_overrides.clear();
+            }
+
+            // Settings from the command line or the file that nothing asked for, which are either
+            // misspelled or belong to a feature that is off.
+            void reportUnused() const {
+                const auto lock = std::scoped_lock { m_readMutex };
+                for (const auto* settings : { &m_commandLine, &m_file }) {
+                    for (const auto& [name, value] : *settings) {
+                        if (!m_read.contains(name)) {
+                            VK_LOG_WARNING("Setting {} = `{}` was never used, check its name", name, value);
+                        }
+                    }
+                }
+            }
+        private:
+            std::map<std::string, std::string, std::less<>> m_commandLine;
+            std::map<std::string, std::string, std::less<>> m_file;
+            std::map<std::string, std::string, std::less<>> m_overrides;
+            mutable std::mutex m_readMutex;
+            mutable std::set<std::string, std::less<>> m_read;
+
+            void readFile(const std::filesystem::path& path) {
+                auto file = std::ifstream { path };
+                if (!file) {
+                    throw std::runtime_error(fmt::format("failed to open config file `{}`!", path.string()));
+                }
+
+                auto table = std::string {};
+                auto line = std::string {};
+                for (size_t lineNumber = 1; std::getline(file, line); lineNumber++) {
+                    auto text = std::string_view { line };
+                    if (const auto comment = text.find('#'); comment != std::string_view::npos && text.find('"') > comment) {
+                        text = text.substr(0, comment);
+                    }
+
+                    text = trim(text);
+                    if (text.empty()) {
+                        continue;
+                    }
+
+                    if (text.front() == '[' && text.back() == ']') {
+                        table = trim(text.substr(1, text.size() - 2));
+                        continue;
+                    }
+
+                    const auto separator = text.find('=');
+                    const auto key = trim(text.substr(0, separator));
+                    if (separator == std::string_view::npos || key.empty()) {
+                        throw std::runtime_error(fmt::format("failed to parse config file `{}` at line {}, expected `key = value`!", path.string(), lineNumber));
+                    }
+
+                    auto value = trim(text.substr(separator + 1));
+                    if (value.size() >= 2 && value.front() == '"' && value.back() == '"') {
+                        value = value.substr(1, value.size() - 2);
+                    }
+
+                    const auto name = table.empty() ? settingName(key) : settingName(table + "_" + std::string { key });
+                    m_file[name] = value;
+                }
+            }
+    };
+
+    // The process's settings, loaded by `main` before anything reads them.
+    inline Config& config() {
+        static Config instance;
+
+        return instance;
+    }
+
+    inline const char* get(const char* name) {
+        return config().get(name);
+    }
+}
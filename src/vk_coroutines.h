@@ -0,0 +1,447 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "vk_async_io.h"
+#include "vk_jobs.h"
+#include "vk_upload.h"
+
+
+namespace vk_coroutines {
+    template<typename T = void>
+    class Task;
+
+    namespace detail {
+        // Hands control back to whoever awaited the task, so a chain of tasks finishes without
+        // growing the stack.
+        struct FinalAwaiter {
+            bool await_ready() const noexcept {
+                return false;
+            }
+
+            template<typename Promise>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) const noexcept {
+                const auto continuation = handle.promise().continuation;
+
+                return continuation != nullptr ? continuation : std::noop_coroutine();
+            }
+
+            void await_resume() const noexcept {}
+        };
+
+        struct PromiseBase {
+            std::coroutine_handle<> continuation;
+            std::exception_ptr exception;
+
+            std::suspend_always initial_suspend() const noexcept {
+                return {};
+            }
+
+            FinalAwaiter final_suspend() const noexcept {
+                return {};
+            }
+
+            void unhandled_exception() {
+                exception = std::current_exception();
+            }
+        };
+
+        template<typename T>
+        struct Promise : PromiseBase {
+            std::optional<T> value;
+
+            Task<T> get_return_object();
+
+            void return_value(T result) {
+                value.emplace(std::move(result));
+            }
+
+            T result() {
+                if (exception != nullptr) {
+                    std::rethrow_exception(exception);
+                }
+
+                return std::move(value.value());
+            }
+        };
+
+        template<>
+        struct Promise<void> : PromiseBase {
+            Task<void> get_return_object();
+
+            void return_void() {}
+
+            void result() {
+                if (exception != nullptr) {
+                    std::rethrow_exception(exception);
+                }
+            }
+        };
+
+        // Owns nothing, and frees its own frame once it has run to the end.
+        struct DetachedTask {
+            struct promise_type {
+                DetachedTask get_return_object() {
+                    return DetachedTask { std::coroutine_handle<promise_type>::from_promise(*this) };
+                }
+
+                std::suspend_always initial_suspend() const noexcept {
+                    return {};
+                }
+
+                std::suspend_never final_suspend() const noexcept {
+                    return {};
+                }
+
+                void return_void() {}
+
+                void unhandled_exception() {
+                    std::terminate();
+                }
+            };
+
+            std::coroutine_handle<promise_type> handle;
+        };
+
+        struct PendingWait {
+            // Null waits for the next pump only.
+            std::function<bool()> ready;
+            std::coroutine_handle<> handle;
+        };
+
+        // Parks the awaiting task with `ready` on the scheduler's waits.
+        struct WaitAwaiter {
+            std::mutex* mutex;
+            std::vector<PendingWait>* waits;
+            std::function<bool()> ready;
+
+            bool await_ready() const noexcept {
+                return false;
+            }
+
+            void await_suspend(std::coroutine_handle<> handle) {
+                const auto lock = std::scoped_lock { *mutex };
+                waits->push_back(PendingWait { .ready = std::move(ready), .handle = handle });
+            }
+
+            void await_resume() const noexcept {}
+        };
+    }
+
+    // A coroutine that starts when it is awaited, and resumes its awaiter when it finishes,
+    // with its result or by rethrowing its exception. Load pipelines are written as one of
+    // these, `co_await`ing each step on a `TaskScheduler`, and a suspended task is only its
+    // frame: no thread waits for it.
+    template<typename T>
+    class [[nodiscard]] Task {
+        public:
+            using promise_type = detail::Promise<T>;
+
+            explicit Task() = default;
+
+            explicit Task(std::coroutine_handle<promise_type> handle)
+                : m_handle { handle }
+            {
+            }
+
+            Task(Task&& other) noexcept
+                : m_handle { std::exchange(other.m_handle, nullptr) }
+            {
+            }
+
+            Task& operator=(Task&& other) noexcept {
+                if (this != &other) {
+                    this->reset();
+                    m_handle = std::exchange(other.m_handle, nullptr);
+                }
+
+                return *this;
+            }
+
+            Task(const Task& other) = delete;
+            Task& operator=(const Task& other) = delete;
+
+            ~Task() {
+                this->reset();
+            }
+
+            auto operator co_await() && noexcept {
+                struct Awaiter {
+                    std::coroutine_handle<promise_type> handle;
+
+                    bool await_ready() const noexcept {
+                        return handle == nullptr || handle.done();
+                    }
+
+                    std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) const noexcept {
+                        handle.promise().continuation = continuation;
+
+                        return handle;
+                    }
+
+                    T await_resume() const {
+                        return handle.promise().result();
+                    }
+                };
+
+                return Awaiter { m_handle };
+            }
+        private:
+            std::coroutine_handle<promise_type> m_handle;
+
+            void reset() {
+                if (m_handle != nullptr) {
+                    m_handle.destroy();
+                }
+
+                m_handle = nullptr;
+            }
+    };
+
+    template<typename T>
+    Task<T> detail::Promise<T>::get_return_object() {
+        return Task<T> { std::coroutine_handle<Promise<T>>::from_promise(*this) };
+    }
+
+    inline Task<void> detail::Promise<void>::get_return_object() {
+        return Task<void> { std::coroutine_handle<Promise<void>>::from_promise(*this) };
+    }
+
+    // What tasks await: a worker of the job system, a read through an
+    // `vk_async_io::AsyncFileReader`, a value of a timeline semaphore, or the next pump. Reads
+    // and GPU waits are parked until `pump` finds them ready, and every task continues as a
+    // background job, so the readers stay with the thread that pumps, usually the frame loop,
+    // and a task can do CPU work right after any step without holding up a frame.
+    //
+    // Tasks may be spawned and awaited from any thread. The first exception a spawned task
+    // throws is rethrown by `pump` or `drain`, the way `vk_jobs::TaskGroup::wait` does.
+    class TaskScheduler {
+        public:
+            explicit TaskScheduler() = default;
+
+            TaskScheduler(const TaskScheduler& other) = delete;
+            TaskScheduler& operator=(const TaskScheduler& other) = delete;
+
+            void init(vk_jobs::JobSystem& jobSystem, VkDevice device) {
+                m_jobSystem = &jobSystem;
+                m_device = device;
+            }
+
+            // Starts `task` on the job system, with nobody awaiting it.
+            void spawn(Task<void> task) {
+                m_activeTasks.fetch_add(1, std::memory_order_relaxed);
+                this->resumeOnJobSystem(runDetached(this, std::move(task)).handle);
+            }
+
+            bool isIdle() const {
+                return m_activeTasks.load(std::memory_order_acquire) == 0;
+            }
+
+            // Continues on a worker of the job system.
+            auto schedule() {
+                struct Awaiter {
+                    TaskScheduler* scheduler;
+
+                    bool await_ready() const noexcept {
+                        return false;
+                    }
+
+                    void await_suspend(std::coroutine_handle<> handle) const {
+                        scheduler->resumeOnJobSystem(handle);
+                    }
+
+                    void await_resume() const noexcept {}
+                };
+
+                return Awaiter { this };
+            }
+
+            // Reads `destination.size()` bytes from `offset` on through `reader`, which only the
+            // pumping thread may otherwise use, and continues with whether all of them were read.
+            // The reader has to stay open until the read has completed.
+            auto read(vk_async_io::AsyncFileReader& reader, uint64_t offset, std::span<std::byte> destination) {
+                struct Awaiter {
+                    TaskScheduler* scheduler;
+                    PendingRead read;
+                    bool success = false;
+
+                    bool await_ready() const noexcept {
+                        return false;
+                    }
+
+                    void await_suspend(std::coroutine_handle<> handle) {
+                        read.success = &success;
+                        read.handle = handle;
+                        scheduler->park(read);
+                    }
+
+                    bool await_resume() const noexcept {
+                        return success;
+                    }
+                };
+
+                return Awaiter { this, PendingRead { .reader = &reader, .offset = offset, .destination = destination } };
+            }
+
+            // Continues once `semaphore`, a timeline semaphore, has reached `value`.
+            detail::WaitAwaiter wait(VkSemaphore semaphore, uint64_t value) {
+                return this->until([device = m_device, semaphore, value]() {
+                    uint64_t completedValue = 0;
+                    vkGetSemaphoreCounterValue(device, semaphore, &completedValue);
+
+                    return completedValue >= value;
+                });
+            }
+
+            // Continues once the upload service has finished the copies of `ticket`.
+            detail::WaitAwaiter wait(const vk_upload::UploadService& uploadService, vk_upload::UploadTicket ticket) {
+                return this->until([&uploadService, ticket]() { return uploadService.isComplete(ticket); });
+            }
+
+            // Continues after the next pump, to try again what was refused for now, like an
+            // upload that does not fit in the staging ring.
+            detail::WaitAwaiter nextPump() {
+                return this->until(nullptr);
+            }
+
+            // Hands parked reads to their readers, and resumes the tasks whose waits are over.
+            // Never blocks, so the frame loop calls it once per frame.
+            void pump() {
+                m_pumpReads.clear();
+                m_pumpWaits.clear();
+                {
+                    const auto lock = std::scoped_lock { m_mutex };
+                    std::swap(m_pumpReads, m_reads);
+                    std::swap(m_pumpWaits, m_waits);
+                }
+
+                // In order, and the rest stays parked behind the first read a reader refuses.
+                m_refusedReads.clear();
+                for (auto& read : m_pumpReads) {
+                    const auto completion = [success = read.success, handle = read.handle](bool readAll) {
+                        *success = readAll;
+                        handle.resume();
+                    };
+                    if (!m_refusedReads.empty() || !read.reader->read(read.offset, read.destination, completion)) {
+                        m_refusedReads.push_back(read);
+                    }
+                }
+
+                for (auto& read : m_pumpReads) {
+                    if (std::find(m_readers.begin(), m_readers.end(), read.reader) == m_readers.end()) {
+                        m_readers.push_back(read.reader);
+                    }
+                }
+                for (auto* reader : m_readers) {
+                    reader->poll();
+                }
+                std::erase_if(m_readers, [](const vk_async_io::AsyncFileReader* reader) { return reader->inFlight() == 0; });
+
+                m_stillWaiting.clear();
+                for (auto& wait : m_pumpWaits) {
+                    if (wait.ready == nullptr || wait.ready()) {
+                        this->resumeOnJobSystem(wait.handle);
+                    } else {
+                        m_stillWaiting.push_back(std::move(wait));
+                    }
+                }
+
+                {
+                    const auto lock = std::scoped_lock { m_mutex };
+                    m_reads.insert(m_reads.begin(), m_refusedReads.begin(), m_refusedReads.end());
+                    m_waits.insert(m_waits.end(), std::make_move_iterator(m_stillWaiting.begin()), std::make_move_iterator(m_stillWaiting.end()));
+                }
+
+                this->rethrowFailure();
+            }
+
+            // Pumps until every spawned task has finished, running jobs on the calling thread
+            // meanwhile, which has to be the pumping thread.
+            void drain() {
+                while (!this->isIdle()) {
+                    this->pump();
+                    if (!m_jobSystem->runPendingJob()) {
+                        std::this_thread::yield();
+                    }
+                }
+
+                this->rethrowFailure();
+            }
+        private:
+            struct PendingRead {
+                vk_async_io::AsyncFileReader* reader = nullptr;
+                uint64_t offset = 0;
+                std::span<std::byte> destination;
+                bool* success = nullptr;
+                std::coroutine_handle<> handle;
+            };
+
+            vk_jobs::JobSystem* m_jobSystem = nullptr;
+            VkDevice m_device = VK_NULL_HANDLE;
+            std::atomic<uint32_t> m_activeTasks = 0;
+
+            std::mutex m_mutex;
+            std::vector<PendingRead> m_reads;
+            std::vector<detail::PendingWait> m_waits;
+            std::exception_ptr m_exception;
+
+            // Only touched by `pump`, and kept to reuse their storage.
+            std::vector<PendingRead> m_pumpReads;
+            std::vector<PendingRead> m_refusedReads;
+            std::vector<detail::PendingWait> m_pumpWaits;
+            std::vector<detail::PendingWait> m_stillWaiting;
+            std::vector<vk_async_io::AsyncFileReader*> m_readers;
+
+            static detail::DetachedTask runDetached(TaskScheduler* scheduler, Task<void> task) {
+                try {
+                    co_await std::move(task);
+                } catch (...) {
+                    const auto lock = std::scoped_lock { scheduler->m_mutex };
+                    if (scheduler->m_exception == nullptr) {
+                        scheduler->m_exception = std::current_exception();
+                    }
+                }
+
+                scheduler->m_activeTasks.fetch_sub(1, std::memory_order_release);
+            }
+
+            void resumeOnJobSystem(std::coroutine_handle<> handle) {
+                m_jobSystem->submit([handle]() { handle.resume(); }, {}, vk_jobs::JobPriority::Background);
+            }
+
+            void park(const PendingRead& read) {
+                const auto lock = std::scoped_lock { m_mutex };
+                m_reads.push_back(read);
+            }
+
+            detail::WaitAwaiter until(std::function<bool()> ready) {
+                return detail::WaitAwaiter { &m_mutex, &m_waits, std::move(ready) };
+            }
+
+            void rethrowFailure() {
+                auto exception = std::exception_ptr {};
+                {
+                    const auto lock = std::scoped_lock { m_mutex };
+                    exception = std::exchange(m_exception, nullptr);
+                }
+
+                if (exception != nullptr) {
+                    std::rethrow_exception(exception);
+                }
+            }
+    };
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "vk_jobs.h"
+#include "vk_math.h"
+#include "vk_transforms.h"
+
+
+namespace vk_cpu_culling {
+    // A job culls this many boxes, a multiple of `vk_transforms::LANE_COUNT`, which keeps a
+    // 100k box scene spread over a handful of workers without drowning them in jobs.
+    constexpr size_t BOXES_PER_JOB = 16 * 1024;
+
+    using vk_math::FrustumPlanes;
+    using vk_math::extractFrustumPlanes;
+
+    // Axis aligned bounding boxes as a structure of arrays of centers and half extents, padded
+    // to a multiple of `vk_transforms::LANE_COUNT` so the kernel never needs a scalar tail.
+    class BoundsStore {
+        public:
+            explicit BoundsStore() = default;
+
+            BoundsStore(const BoundsStore& other) = delete;
+            BoundsStore& operator=(const BoundsStore& other) = delete;
+
+            void resize(size_t count) {
+                const auto padded = (count + vk_transforms::LANE_COUNT - 1) / vk_transforms::LANE_COUNT * vk_transforms::LANE_COUNT;
+                for (auto* array : this->arrays()) {
+                    array->resize(padded, 0.0f);
+                }
+
+                m_count = count;
+            }
+
+            void clear() {
+                for (auto* array : this->arrays()) {
+                    *array = vk_transforms::AlignedFloats {};
+                }
+
+                m_count = 0;
+            }
+
+            size_t size() const {
+                return m_count;
+            }
+
+            // The box around a cube of `halfExtent` centered on the origin, under `matrix`.
+            void set(size_t index, const vk_transforms::WorldMatrix& matrix, float halfExtent) {
+                const auto center = std::array { &m_centerX, &m_centerY, &m_centerZ };
+                const auto extent = std::array { &m_extentX, &m_extentY, &m_extentZ };
+                for (size_t row = 0; row < matrix.rows.size(); row++) {
+                    const auto& r = matrix.rows[row];
+                    (*center[row])[index] = r.w;
+                    (*extent[row])[index] = (std::abs(r.x) + std::abs(r.y) + std::abs(r.z)) * halfExtent;
+                }
+            }
+
+            // Appends the indices of the boxes from `first` to `end` that are at least partly
+            // inside `planes` to `visible`. `first` is a multiple of the lane count.
+            //
+            // A box lies outside a plane when even its corner furthest along the plane's normal
+            // does, which is its center's distance plus the extents projected on the normal's
+            // magnitude. The kernel tests `vk_transforms::LANE_COUNT` boxes per iteration, one per
+            // lane, and keeps the smallest distance over the six planes, so the only branch is the
+            // one appending the survivors.
+            void cull(const FrustumPlanes& planes, size_t first, size_t end, std::vector<uint32_t>& visible) const {
+                using vk_transforms::Lanes;
+                using vk_transforms::LANE_COUNT;
+
+                const auto load = [](const vk_transforms::AlignedFloats& array, size_t group) {
+                    auto lanes = Lanes {};
+                    std::memcpy(&lanes, array.data() + group, sizeof(lanes));
+
+                    return lanes;
+                };
+
+                for (auto group = first; group < end; group += LANE_COUNT) {
+                    const auto centerX = load(m_centerX, group);
+                    const auto centerY = load(m_centerY, group);
+                    const auto centerZ = load(m_centerZ, group);
+                    const auto extentX = load(m_extentX, group);
+                    const auto extentY = load(m_extentY, group);
+                    const auto extentZ = load(m_extentZ, group);
+
+                    auto distance = Lanes { std::numeric_limits<float>::max() };
+                    for (const auto& plane : planes) {
+                        const auto reach = extentX * std::abs(plane.x) + extentY * std::abs(plane.y) + extentZ * std::abs(plane.z);
+                        const auto centerDistance = centerX * plane.x + centerY * plane.y + centerZ * plane.z + plane.w;
+                        distance = glm::min(distance, centerDistance + reach);
+                    }
+
+                    for (size_t lane = 0; lane < LANE_COUNT; lane++) {
+                        const auto index = group + lane;
+                        if (index < end && distance[static_cast<glm::length_t>(lane)] >= 0.0f) {
+                            visible.push_back(static_cast<uint32_t>(index));
+                        }
+                    }
+                }
+            }
+        private:
+            vk_transforms::AlignedFloats m_centerX;
+            vk_transforms::AlignedFloats m_centerY;
+            vk_transforms::AlignedFloats m_centerZ;
+            vk_transforms::AlignedFloats m_extentX;
+            vk_transforms::AlignedFloats m_extentY;
+            vk_transforms::AlignedFloats m_extentZ;
+            size_t m_count = 0;
+
+            std::array<vk_transforms::AlignedFloats*, 6> arrays() {
+                return { &m_centerX, &m_centerY, &m_centerZ, &m_extentX, &m_extentY, &m_extentZ };
+            }
+    };
+
+    // Culls a `BoundsStore` against a frustum on the job system, `BOXES_PER_JOB` boxes per job.
+    // Every job appends to a list of its own, kept between frames so they stop allocating once
+    // they have grown, and the lists come back in job order, so the survivors stay sorted.
+    class FrustumCuller {
+        public:
+            explicit FrustumCuller() = default;
+
+            FrustumCuller(const FrustumCuller& other) = delete;
+            FrustumCuller& operator=(const FrustumCuller& other) = delete;
+
+            // Culls the first `count` boxes of `bounds`, and returns the lists of survivors.
+            const std::vector<std::vector<uint32_t>>& cull(vk_jobs::JobSystem& jobSystem, const BoundsStore& bounds, size_t count, const FrustumPlanes& planes) {
+                const auto jobCount = (count + BOXES_PER_JOB - 1) / BOXES_PER_JOB;
+                m_visible.resize(jobCount);
+
+                auto tasks = vk_jobs::TaskGroup { jobSystem };
+                for (size_t job = 0; job < jobCount; job++) {
+                    tasks.run([this, &bounds, &planes, count, job]() {
+                        auto& visible = m_visible[job];
+                        visible.clear();
+                        bounds.cull(planes, job * BOXES_PER_JOB, std::min((job + 1) * BOXES_PER_JOB, count), visible);
+                    });
+                }
+
+                tasks.wait();
+
+                return m_visible;
+            }
+
+            void clear() {
+                m_visible.clear();
+            }
+        private:
+            std::vector<std::vector<uint32_t>> m_visible;
+    };
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+
+namespace vk_create_info {
+    // Every queue is created at the same priority, so one constant serves every create info.
+    inline constexpr float QUEUE_PRIORITY = 1.0f;
+    // The graphics, present, compute, transfer and video encode families.
+    inline constexpr size_t MAX_QUEUE_FAMILIES = 5;
+
+    // A 2D view of the first level and layer of `image`, identity swizzled.
+    constexpr VkImageViewCreateInfo imageView2D(VkImage image, VkFormat format, VkImageAspectFlags aspectMask = VK_IMAGE_ASPECT_COLOR_BIT) {
+        return VkImageViewCreateInfo {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .image = image,
+            .viewType = VK_IMAGE_VIEW_TYPE_2D,
+            .format = format,
+            .components = VkComponentMapping {
+                .r = VK_COMPONENT_SWIZZLE_IDENTITY,
+                .g = VK_COMPONENT_SWIZZLE_IDENTITY,
+                .b = VK_COMPONENT_SWIZZLE_IDENTITY,
+                .a = VK_COMPONENT_SWIZZLE_IDENTITY,
+            },
+            .subresourceRange = VkImageSubresourceRange {
+                .aspectMask = aspectMask,
+                .baseMipLevel = 0,
+                .levelCount = 1,
+                .baseArrayLayer = 0,
+                .layerCount = 1,
+            },
+        };
+    }
+
+    constexpr VkDeviceQueueCreateInfo queue(uint32_t queueFamily) {
+        return VkDeviceQueueCreateInfo {
+            .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+            .queueFamilyIndex = queueFamily,
+            .queueCount = 1,
+            .pQueuePriorities = &QUEUE_PRIORITY,
+        };
+    }
+
+    // One queue of every distinct family added, in a fixed array, since a device has a few
+    // queue roles at most and several may share a family.
+    class QueueCreateInfos {
+        public:
+            constexpr void add(uint32_t queueFamily) {
+                const auto existing = std::find_if(m_infos.begin(), m_infos.begin() + m_count, [queueFamily](const VkDeviceQueueCreateInfo& info) {
+                    return info.queueFamilyIndex == queueFamily;
+                });
+                if (existing == m_infos.begin() + m_count) {
+                    m_infos[m_count++] = queue(queueFamily);
+                }
+            }
+
+            constexpr std::span<const VkDeviceQueueCreateInfo> infos() const {
+                return { m_infos.data(), m_count };
+            }
+        private:
+            std::array<VkDeviceQueueCreateInfo, MAX_QUEUE_FAMILIES> m_infos {};
+            size_t m_count = 0;
+    };
+
+    // The fixed parts are assembled at compile time; only the handles and formats are patched in
+    // at runtime.
+    static_assert(imageView2D(VK_NULL_HANDLE, VK_FORMAT_B8G8R8A8_SRGB).subresourceRange.layerCount == 1);
+    static_assert([]() {
+        auto queues = QueueCreateInfos {};
+        queues.add(0);
+        queues.add(2);
+        queues.add(0);
+
+        return queues.infos().size() == 2 && queues.infos()[1].pQueuePriorities == &QUEUE_PRIORITY;
+    }());
+}
@@ -0,0 +1,356 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <atomic>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include <fmt/core.h>
+
+// Set to 0 to compile the object names and command buffer labels out altogether, so that every
+// call below is an empty inline function.
+#ifndef HELLO_WINDOW_DEBUG_LABELS
+#define HELLO_WINDOW_DEBUG_LABELS 1
+#endif
+
+
+namespace vk_debug {
+    enum class Severity : uint32_t {
+        Verbose,
+        Info,
+        Warning,
+        Error,
+    };
+
+    inline Severity severityFromFlags(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity) {
+        if (messageSeverity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT) {
+            return Severity::Error;
+        } else if (messageSeverity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT) {
+            return Severity::Warning;
+        } else if (messageSeverity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT) {
+            return Severity::Info;
+        } else {
+            return Severity::Verbose;
+        }
+    }
+
+    inline const char* severityToString(Severity severity) {
+        switch (severity) {
+            case Severity::Verbose: return "VERB ";
+            case Severity::Info: return "INFO ";
+            case Severity::Warning: return "WARN ";
+            case Severity::Error: return "ERROR";
+        }
+
+        return "INFO ";
+    }
+
+    // Collects validation messages from whatever thread the driver raises them on, and writes
+    // them out from a background thread.
+    //
+    // The producer side never blocks and never allocates: a message is copied into a slot of a
+    // bounded multi-producer ring buffer, or dropped when the ring is full. Before that, each
+    // severity has a per-second message budget, and each `messageIdNumber` is only reported
+    // `MAX_REPEATS_PER_MESSAGE_ID` times, so a validation storm costs the calling thread a few
+    // atomic operations per message instead of a write to stderr.
+    class DebugMessageSink {
+        public:
+            static constexpr size_t RING_CAPACITY = 1024;
+            static constexpr size_t MAX_MESSAGE_LENGTH = 1024;
+            static constexpr size_t MESSAGE_ID_TABLE_SIZE = 512;
+            static constexpr uint32_t MAX_REPEATS_PER_MESSAGE_ID = 8;
+            static constexpr std::array<uint32_t, 4> MESSAGES_PER_SECOND = { 20, 50, 200, 1000 };
+
+            explicit DebugMessageSink() {
+                for (size_t i = 0; i < m_slots.size(); i++) {
+                    m_slots[i].sequence.store(i, std::memory_order_relaxed);
+                }
+            }
+
+            DebugMessageSink(const DebugMessageSink& other) = delete;
+            DebugMessageSink& operator=(const DebugMessageSink& other) = delete;
+
+            ~DebugMessageSink() {
+                this->stop();
+            }
+
+            // Start the writer thread. Messages go to the file at `path`, or to stderr when
+            // `path` is null or the file cannot be opened.
+            void start(const char* path) {
+                if (m_writer.joinable()) {
+                    return;
+                }
+
+                m_output = stderr;
+                if (path != nullptr) {
+                    auto file = std::fopen(path, "w");
+                    if (file != nullptr) {
+                        m_output = file;
+                    } else {
+                        fmt::println(stderr, "failed to open validation log `{}`, writing to stderr", path);
+                    }
+                }
+
+                m_running.store(true, std::memory_order_release);
+                m_writer = std::thread { [this]() { this->writerLoop(); } };
+            }
+
+            // Stop the writer thread once everything queued has been written, and report how
+            // many messages were suppressed.
+            void stop() {
+                if (!m_writer.joinable()) {
+                    return;
+                }
+
+                m_running.store(false, std::memory_order_release);
+                m_pending.fetch_add(1, std::memory_order_release);
+                m_pending.notify_one();
+                m_writer.join();
+
+                this->drain();
+                this->reportSuppressed();
+
+                if (m_output != stderr) {
+                    std::fclose(m_output);
+                }
+
+                m_output = stderr;
+            }
+
+            void push(Severity severity, int32_t messageIdNumber, const char* message) {
+                if (!this->withinRateLimit(severity) || !this->withinRepeatLimit(messageIdNumber)) {
+                    return;
+                }
+
+                // Bounded multi-producer queue after Dmitry Vyukov: each slot carries a sequence
+                // number telling producers and the consumer whose turn it is.
+                auto position = m_enqueuePosition.load(std::memory_order_relaxed);
+                Slot* slot = nullptr;
+                while (true) {
+                    slot = &m_slots[position % RING_CAPACITY];
+                    const auto sequence = slot->sequence.load(std::memory_order_acquire);
+                    const auto difference = static_cast<int64_t>(sequence) - static_cast<int64_t>(position);
+                    if (difference == 0) {
+                        if (m_enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                            break;
+                        }
+                    } else if (difference < 0) {
+                        m_droppedMessages.fetch_add(1, std::memory_order_relaxed);
+                        return;
+                    } else {
+                        position = m_enqueuePosition.load(std::memory_order_relaxed);
+                    }
+                }
+
+                slot->severity = severity;
+                slot->messageIdNumber = messageIdNumber;
+                std::strncpy(slot->message.data(), message, MAX_MESSAGE_LENGTH - 1);
+                slot->message[MAX_MESSAGE_LENGTH - 1] = '\0';
+                slot->sequence.store(position + 1, std::memory_order_release);
+
+                m_pending.fetch_add(1, std::memory_order_release);
+                m_pending.notify_one();
+            }
+        private:
+            struct Slot {
+                std::atomic<uint64_t> sequence;
+                Severity severity;
+                int32_t messageIdNumber;
+                std::array<char, MAX_MESSAGE_LENGTH> message;
+            };
+
+            struct MessageIdEntry {
+                std::atomic<bool> occupied = false;
+                std::atomic<int32_t> messageIdNumber = 0;
+                std::atomic<uint32_t> count = 0;
+            };
+
+            struct RateLimit {
+                std::atomic<int64_t> windowStart = 0;
+                std::atomic<uint32_t> count = 0;
+                std::atomic<uint64_t> suppressed = 0;
+            };
+
+            std::array<Slot, RING_CAPACITY> m_slots;
+            std::atomic<uint64_t> m_enqueuePosition = 0;
+            uint64_t m_dequeuePosition = 0;
+
+            std::array<MessageIdEntry, MESSAGE_ID_TABLE_SIZE> m_messageIds;
+            std::array<RateLimit, 4> m_rateLimits;
+            std::atomic<uint64_t> m_droppedMessages = 0;
+            std::atomic<uint64_t> m_repeatedMessages = 0;
+
+            std::atomic<uint32_t> m_pending = 0;
+            std::atomic<bool> m_running = false;
+            std::thread m_writer;
+            std::FILE* m_output = stderr;
+
+            bool withinRateLimit(Severity severity) {
+                auto& rateLimit = m_rateLimits[static_cast<size_t>(severity)];
+                const auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()
+                ).count();
+
+                auto windowStart = rateLimit.windowStart.load(std::memory_order_relaxed);
+                if (now - windowStart >= 1000) {
+                    if (rateLimit.windowStart.compare_exchange_strong(windowStart, now, std::memory_order_relaxed)) {
+                        rateLimit.count.store(0, std::memory_order_relaxed);
+                    }
+                }
+
+                if (rateLimit.count.fetch_add(1, std::memory_order_relaxed) >= MESSAGES_PER_SECOND[static_cast<size_t>(severity)]) {
+                    rateLimit.suppressed.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+
+                return true;
+            }
+
+            // Open addressing over a fixed table. When the table is full the message is let
+            // through, since losing deduplication is better than losing the message.
+            bool withinRepeatLimit(int32_t messageIdNumber) {
+                const auto hash = static_cast<uint32_t>(messageIdNumber) * 2654435761u;
+                for (size_t probe = 0; probe < MESSAGE_ID_TABLE_SIZE; probe++) {
+                    auto& entry = m_messageIds[(hash + probe) % MESSAGE_ID_TABLE_SIZE];
+                    if (!entry.occupied.load(std::memory_order_acquire)) {
+                        bool expected = false;
+                        if (entry.occupied.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
+                            entry.messageIdNumber.store(messageIdNumber, std::memory_order_release);
+                            entry.count.store(1, std::memory_order_release);
+
+                            return true;
+                        }
+                    }
+
+                    // Another thread may have claimed the entry without publishing its id yet.
+                    // Treating that as a different id at worst lets a duplicate through.
+                    if (entry.messageIdNumber.load(std::memory_order_acquire) == messageIdNumber && entry.count.load(std::memory_order_acquire) != 0) {
+                        if (entry.count.fetch_add(1, std::memory_order_relaxed) >= MAX_REPEATS_PER_MESSAGE_ID) {
+                            m_repeatedMessages.fetch_add(1, std::memory_order_relaxed);
+                            return false;
+                        }
+
+                        return true;
+                    }
+                }
+
+                return true;
+            }
+
+            bool tryPop(Severity& severity, int32_t& messageIdNumber, std::array<char, MAX_MESSAGE_LENGTH>& message) {
+                auto& slot = m_slots[m_dequeuePosition % RING_CAPACITY];
+                const auto sequence = slot.sequence.load(std::memory_order_acquire);
+                if (sequence != m_dequeuePosition + 1) {
+                    return false;
+                }
+
+                severity = slot.severity;
+                messageIdNumber = slot.messageIdNumber;
+                message = slot.message;
+                slot.sequence.store(m_dequeuePosition + RING_CAPACITY, std::memory_order_release);
+                m_dequeuePosition++;
+
+                return true;
+            }
+
+            void drain() {
+                auto severity = Severity::Info;
+                int32_t messageIdNumber = 0;
+                auto message = std::array<char, MAX_MESSAGE_LENGTH> {};
+                while (this->tryPop(severity, messageIdNumber, message)) {
+                    fmt::println(m_output, "[{}] {}", severityToString(severity), message.data());
+                }
+
+                std::fflush(m_output);
+            }
+
+            void writerLoop() {
+                while (m_running.load(std::memory_order_acquire)) {
+                    const auto pending = m_pending.load(std::memory_order_acquire);
+                    this->drain();
+                    m_pending.wait(pending, std::memory_order_acquire);
+                }
+            }
+
+            void reportSuppressed() {
+                const auto dropped = m_droppedMessages.load(std::memory_order_relaxed);
+                const auto repeated = m_repeatedMessages.load(std::memory_order_relaxed);
+                uint64_t rateLimited = 0;
+                for (const auto& rateLimit : m_rateLimits) {
+                    rateLimited += rateLimit.suppressed.load(std::memory_order_relaxed);
+                }
+
+                if (dropped != 0 || repeated != 0 || rateLimited != 0) {
+                    fmt::println(
+                        m_output,
+                        "[INFO ] validation messages suppressed: {} rate limited, {} repeated, {} dropped on a full queue",
+                        rateLimited,
+                        repeated,
+                        dropped
+                    );
+                }
+            }
+    };
+
+    // Object names and command buffer labels for capture tools like RenderDoc, Nsight and RGP,
+    // from `VK_EXT_debug_utils`. They are off until `enableLabels` is called once the instance
+    // enables the extension, and while off each call is one branch on a flag the CPU predicts
+    // every time, with no Vulkan call behind it.
+    inline bool& labelsFlag() {
+        static auto enabled = false;
+
+        return enabled;
+    }
+
+    inline void enableLabels() {
+        labelsFlag() = true;
+    }
+
+    inline bool labelsEnabled() {
+        return HELLO_WINDOW_DEBUG_LABELS && labelsFlag();
+    }
+
+    // `handle` is any Vulkan handle, dispatchable or not, of the type `objectType` names.
+    template <typename Handle>
+    void setObjectName(VkDevice device, VkObjectType objectType, Handle handle, const char* name) {
+        if (!labelsEnabled()) {
+            return;
+        }
+
+        const auto nameInfo = VkDebugUtilsObjectNameInfoEXT {
+            .sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_OBJECT_NAME_INFO_EXT,
+            .objectType = objectType,
+            .objectHandle = reinterpret_cast<uint64_t>(handle),
+            .pObjectName = name,
+        };
+        vkSetDebugUtilsObjectNameEXT(device, &nameInfo);
+    }
+
+    // Opens a region of `commandBuffer` that ends at the matching `endLabel`. Regions nest.
+    inline void beginLabel(VkCommandBuffer commandBuffer, const char* name) {
+        if (!labelsEnabled()) {
+            return;
+        }
+
+        const auto labelInfo = VkDebugUtilsLabelEXT {
+            .sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT,
+            .pLabelName = name,
+            .color = { 0.0f, 0.0f, 0.0f, 0.0f },
+        };
+        vkCmdBeginDebugUtilsLabelEXT(commandBuffer, &labelInfo);
+    }
+
+    inline void endLabel(VkCommandBuffer commandBuffer) {
+        if (!labelsEnabled()) {
+            return;
+        }
+
+        vkCmdEndDebugUtilsLabelEXT(commandBuffer);
+    }
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+
+#include "vk_assets.h"
+#include "vk_compute.h"
+#include "vk_pipelines.h"
+#include "vk_shaders.h"
+
+
+namespace vk_decompression {
+    // The specialization constant id of the kernel's workgroup size.
+    constexpr uint32_t WORKGROUP_SIZE_ID = 0;
+
+    struct DecompressPushConstants {
+        VkDeviceAddress chunkTable;
+        VkDeviceAddress source;
+        VkDeviceAddress destination;
+        uint32_t chunkCount;
+        uint32_t lastChunkSize;
+        uint32_t sourceSize;
+    };
+
+    // The kernel reaches its buffers through their device addresses, writes single bytes, and
+    // spreads each chunk over a subgroup, which has to be full for the lanes to cover it.
+    inline bool supports(const vk_compute::ComputeTuning& computeTuning, bool bufferDeviceAddress, bool storageBuffer8BitAccess) {
+        return computeTuning.subgroupPrimitives && bufferDeviceAddress && storageBuffer8BitAccess;
+    }
+
+    // Expands blobs of `vk_assets::Compression::Lz4` on the GPU, so that only the compressed
+    // bytes cross the bus and the CPU never touches them. The blob is copied as it is stored,
+    // through the upload service or from the imported pack, to a buffer the kernel reads, and
+    // expanded from there straight into the destination buffer on a compute capable queue.
+    //
+    // `VK_NV_memory_decompression` is left out: it only reads GDeflate, which the pack does not
+    // store, and the chunks here decode at least as fast from a subgroup each.
+    class GpuDecompressor {
+        public:
+            explicit GpuDecompressor() = default;
+
+            GpuDecompressor(const GpuDecompressor& other) = delete;
+            GpuDecompressor& operator=(const GpuDecompressor& other) = delete;
+
+            // The pipeline comes from `pipelineRegistry`, which keeps it, and is specialized for
+            // `computeTuning`, which has to support the decompressor.
+            void init(
+                VkDevice device,
+                vk_shaders::ShaderLibrary& shaderLibrary,
+                vk_pipelines::PipelineRegistry& pipelineRegistry,
+                const vk_compute::ComputeTuning& computeTuning,
+                const VkAllocationCallbacks* allocator
+            ) {
+                if (!computeTuning.subgroupPrimitives) {
+                    throw std::runtime_error("failed to create GPU decompressor, full subgroups are unsupported!");
+                }
+
+                m_device = device;
+                m_allocator = allocator;
+                m_computeTuning = computeTuning;
+
+                const auto pushConstantRange = VkPushConstantRange {
+                    .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                    .offset = 0,
+                    .size = sizeof(DecompressPushConstants),
+                };
+                const auto pipelineLayoutInfo = VkPipelineLayoutCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+                    .pushConstantRangeCount = 1,
+                    .pPushConstantRanges = &pushConstantRange,
+                };
+
+                const auto pipelineLayoutResult = vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, m_allocator, &m_pipelineLayout);
+                if (pipelineLayoutResult != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create GPU decompressor pipeline layout!");
+                }
+
+                auto constants = vk_pipelines::SpecializationConstants {};
+                constants.set(WORKGROUP_SIZE_ID, m_computeTuning.linear);
+                auto requiredSize = VkPipelineShaderStageRequiredSubgroupSizeCreateInfo {};
+                const auto pipelineInfo = VkComputePipelineCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+                    .stage = VkPipelineShaderStageCreateInfo {
+                        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                        .pNext = vk_compute::requiredSubgroupSize(m_computeTuning, requiredSize),
+                        .flags = VK_PIPELINE_SHADER_STAGE_CREATE_REQUIRE_FULL_SUBGROUPS_BIT,
+                        .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                        .module = shaderLibrary.shaderModule("decompress_lz4.comp"),
+                        .pName = "main",
+                        .pSpecializationInfo = constants.info(),
+                    },
+                    .layout = m_pipelineLayout,
+                };
+                m_pipeline = pipelineRegistry.computePipeline(pipelineInfo);
+            }
+
+            void destroy() {
+                if (m_device == VK_NULL_HANDLE) {
+                    return;
+                }
+
+                vkDestroyPipelineLayout(m_device, m_pipelineLayout, m_allocator);
+                m_pipelineLayout = VK_NULL_HANDLE;
+                m_pipeline = VK_NULL_HANDLE;
+                m_device = VK_NULL_HANDLE;
+            }
+
+            bool isInitialized() const {
+                return m_device != VK_NULL_HANDLE;
+            }
+
+            // Expands the blob of `entry` at `source`, 4 byte aligned, to the
+            // `entry.uncompressedSize` bytes at `destination`. Both buffers need
+            // `VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT` and `VK_BUFFER_USAGE_STORAGE_BUFFER_BIT`.
+            // Like the GPU primitives, the caller makes the copy of the blob visible to compute
+            // shader reads first, and waits for compute shader storage writes before using the
+            // output.
+            void recordDecompress(VkCommandBuffer commandBuffer, const vk_assets::PackEntry& entry, VkDeviceAddress source, VkDeviceAddress destination) const {
+                if (entry.compression != vk_assets::Compression::Lz4 || entry.size > UINT32_MAX) {
+                    throw std::runtime_error("failed to record GPU decompression, the blob is not LZ4 chunks!");
+                } else if (entry.chunkCount == 0) {
+                    return;
+                }
+
+                const auto pushConstants = DecompressPushConstants {
+                    .chunkTable = source,
+                    .source = source,
+                    .destination = destination,
+                    .chunkCount = entry.chunkCount,
+                    .lastChunkSize = static_cast<uint32_t>(entry.uncompressedSize - uint64_t { entry.chunkCount - 1 } * vk_assets::COMPRESSION_CHUNK_SIZE),
+                    .sourceSize = static_cast<uint32_t>(entry.size),
+                };
+
+                // The kernel loops over the chunks, so more subgroups per workgroup than the
+                // tuned size assumes, where the driver picks a narrower one, only go unused.
+                const auto subgroupsPerWorkgroup = std::max(m_computeTuning.linear / m_computeTuning.subgroupSize, 1u);
+                const auto workgroupCount = std::min((entry.chunkCount + subgroupsPerWorkgroup - 1) / subgroupsPerWorkgroup, MAX_WORKGROUP_COUNT);
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+                vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+                vkCmdDispatch(commandBuffer, workgroupCount, 1, 1);
+            }
+        private:
+            // Every device can dispatch this many workgroups along x.
+            static constexpr uint32_t MAX_WORKGROUP_COUNT = 65535;
+
+            VkDevice m_device = VK_NULL_HANDLE;
+            const VkAllocationCallbacks* m_allocator = nullptr;
+            vk_compute::ComputeTuning m_computeTuning {};
+            VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+            VkPipeline m_pipeline = VK_NULL_HANDLE;
+    };
+}
@@ -0,0 +1,986 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "vk_memory.h"
+
+
+namespace vk_descriptors {
+    enum class DescriptorKind : uint32_t {
+        SampledImage,
+        StorageBuffer,
+        Sampler,
+    };
+
+    constexpr uint32_t DESCRIPTOR_KIND_COUNT = 3;
+
+    // Every pipeline shares this layout, so a draw only pushes the indices of its resources.
+    constexpr uint32_t PUSH_CONSTANT_SIZE = 128;
+
+    struct HeapLimits {
+        uint32_t sampledImages = 65536;
+        uint32_t storageBuffers = 65536;
+        uint32_t samplers = 1024;
+    };
+
+    // What the heap needs to keep its descriptors in a buffer with `VK_EXT_descriptor_buffer`.
+    struct DescriptorBufferSupport {
+        vk_memory::DeviceMemoryAllocator* allocator = nullptr;
+        VkPhysicalDeviceDescriptorBufferPropertiesEXT properties {};
+    };
+
+    inline VkPhysicalDeviceDescriptorBufferPropertiesEXT descriptorBufferProperties(VkPhysicalDevice physicalDevice) {
+        auto descriptorBufferProperties = VkPhysicalDeviceDescriptorBufferPropertiesEXT {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_PROPERTIES_EXT,
+        };
+        auto properties = VkPhysicalDeviceProperties2 {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+            .pNext = &descriptorBufferProperties,
+        };
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+        return descriptorBufferProperties;
+    }
+
+    // Hands out and recycles slots of one binding. A released slot may still be read by frames
+    // in flight, so it only becomes free again once the frame it was released in has completed.
+    class SlotAllocator {
+        public:
+            explicit SlotAllocator() = default;
+
+            explicit SlotAllocator(uint32_t capacity)
+                : m_capacity { capacity }
+            {
+            }
+
+            std::optional<uint32_t> allocate() {
+                if (!m_freeSlots.empty()) {
+                    const auto slot = m_freeSlots.back();
+                    m_freeSlots.pop_back();
+
+                    return slot;
+                }
+
+                if (m_nextSlot == m_capacity) {
+                    return std::nullopt;
+                }
+
+                return m_nextSlot++;
+            }
+
+            void release(uint32_t slot, uint64_t frameNumber) {
+                m_releasedSlots.push_back(ReleasedSlot { slot, frameNumber });
+            }
+
+            void collect(uint64_t completedFrameCount) {
+                std::erase_if(m_releasedSlots, [&](const ReleasedSlot& releasedSlot) {
+                    if (releasedSlot.frameNumber < completedFrameCount) {
+                        m_freeSlots.push_back(releasedSlot.slot);
+                        return true;
+                    }
+
+                    return false;
+                });
+            }
+        private:
+            struct ReleasedSlot {
+                uint32_t slot;
+                uint64_t frameNumber;
+            };
+
+            uint32_t m_capacity = 0;
+            uint32_t m_nextSlot = 0;
+            std::vector<uint32_t> m_freeSlots;
+            std::vector<ReleasedSlot> m_releasedSlots;
+    };
+
+    // One large update-after-bind descriptor set with an array per descriptor kind, bound once
+    // per command buffer. Shaders index the arrays with values from push constants, so binding a
+    // new material costs a `vkCmdPushConstants` instead of a descriptor set update and bind.
+    //
+    // Binding 0 holds sampled images, binding 1 storage buffers and binding 2 samplers. All of
+    // them are partially bound, so unused slots never need to be written.
+    //
+    // With `DescriptorBufferSupport`, the set lives in a host visible buffer instead, bound by
+    // its address, and a new descriptor is written straight into the mapped slot with
+    // `vkGetDescriptorEXT`. That needs neither a pool nor `vkUpdateDescriptorSets`, and so
+    // none of the driver's bookkeeping for update after bind. A layout larger than the device
+    // lets a descriptor buffer hold falls back to the descriptor set.
+    class BindlessDescriptorHeap {
+        public:
+            explicit BindlessDescriptorHeap() = default;
+
+            BindlessDescriptorHeap(const BindlessDescriptorHeap& other) = delete;
+            BindlessDescriptorHeap& operator=(const BindlessDescriptorHeap& other) = delete;
+
+            static constexpr VkBufferUsageFlags DESCRIPTOR_BUFFER_USAGE =
+                VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT
+                | VK_BUFFER_USAGE_SAMPLER_DESCRIPTOR_BUFFER_BIT_EXT
+                | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+
+            void init(VkDevice device, const HeapLimits& limits, const DescriptorBufferSupport* descriptorBuffer = nullptr) {
+                m_device = device;
+                m_limits = limits;
+                m_slots = {
+                    SlotAllocator { limits.sampledImages },
+                    SlotAllocator { limits.storageBuffers },
+                    SlotAllocator { limits.samplers },
+                };
+
+                const auto bindings = std::array<VkDescriptorSetLayoutBinding, DESCRIPTOR_KIND_COUNT> {
+                    VkDescriptorSetLayoutBinding {
+                        .binding = 0,
+                        .descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+                        .descriptorCount = limits.sampledImages,
+                        .stageFlags = VK_SHADER_STAGE_ALL,
+                    },
+                    VkDescriptorSetLayoutBinding {
+                        .binding = 1,
+                        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                        .descriptorCount = limits.storageBuffers,
+                        .stageFlags = VK_SHADER_STAGE_ALL,
+                    },
+                    VkDescriptorSetLayoutBinding {
+                        .binding = 2,
+                        .descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER,
+                        .descriptorCount = limits.samplers,
+                        .stageFlags = VK_SHADER_STAGE_ALL,
+                    },
+                };
+
+                if (descriptorBuffer == nullptr || !this->createDescriptorBuffer(bindings, *descriptorBuffer)) {
+                    this->createDescriptorSet(bindings);
+                }
+
+                const auto pushConstantRange = VkPushConstantRange {
+                    .stageFlags = VK_SHADER_STAGE_ALL,
+                    .offset = 0,
+                    .size = PUSH_CONSTANT_SIZE,
+                };
+                const auto pipelineLayoutInfo = VkPipelineLayoutCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+                    .setLayoutCount = 1,
+                    .pSetLayouts = &m_descriptorSetLayout,
+                    .pushConstantRangeCount = 1,
+                    .pPushConstantRanges = &pushConstantRange,
+                };
+
+                const auto pipelineLayoutResult = vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &m_pipelineLayout);
+                if (pipelineLayoutResult != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create bindless pipeline layout!");
+                }
+            }
+
+            void destroy() {
+                if (m_device == VK_NULL_HANDLE) {
+                    return;
+                }
+
+                vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+                if (m_descriptorBuffer != VK_NULL_HANDLE) {
+                    vkDestroyBuffer(m_device, m_descriptorBuffer, nullptr);
+                    m_memoryAllocator->free(m_descriptorAllocation);
+                    m_descriptorBuffer = VK_NULL_HANDLE;
+                    m_descriptorAllocation = vk_memory::Allocation {};
+                }
+                vkDestroyDescriptorPool(m_device, m_descriptorPool, nullptr);
+                vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, nullptr);
+                m_descriptorPool = VK_NULL_HANDLE;
+                m_descriptorSet = VK_NULL_HANDLE;
+                m_device = VK_NULL_HANDLE;
+            }
+
+            bool isInitialized() const {
+                return m_device != VK_NULL_HANDLE;
+            }
+
+            std::optional<uint32_t> addSampledImage(VkImageView imageView, VkImageLayout imageLayout) {
+                const auto slot = m_slots[static_cast<uint32_t>(DescriptorKind::SampledImage)].allocate();
+                if (slot.has_value()) {
+                    const auto imageInfo = VkDescriptorImageInfo {
+                        .imageView = imageView,
+                        .imageLayout = imageLayout,
+                    };
+                    this->write(DescriptorKind::SampledImage, slot.value(), &imageInfo, nullptr);
+                }
+
+                return slot;
+            }
+
+            std::optional<uint32_t> addStorageBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) {
+                const auto slot = m_slots[static_cast<uint32_t>(DescriptorKind::StorageBuffer)].allocate();
+                if (slot.has_value()) {
+                    const auto bufferInfo = VkDescriptorBufferInfo {
+                        .buffer = buffer,
+                        .offset = offset,
+                        .range = range,
+                    };
+                    this->write(DescriptorKind::StorageBuffer, slot.value(), nullptr, &bufferInfo);
+                }
+
+                return slot;
+            }
+
+            std::optional<uint32_t> addSampler(VkSampler sampler) {
+                const auto slot = m_slots[static_cast<uint32_t>(DescriptorKind::Sampler)].allocate();
+                if (slot.has_value()) {
+                    const auto imageInfo = VkDescriptorImageInfo {
+                        .sampler = sampler,
+                    };
+                    this->write(DescriptorKind::Sampler, slot.value(), &imageInfo, nullptr);
+                }
+
+                return slot;
+            }
+
+            // Give `slot` back once frame `frameNumber`, the last one that may use it, completes.
+            void release(DescriptorKind kind, uint32_t slot, uint64_t frameNumber) {
+                m_slots[static_cast<uint32_t>(kind)].release(slot, frameNumber);
+            }
+
+            void collect(uint64_t completedFrameCount) {
+                for (auto& slots : m_slots) {
+                    slots.collect(completedFrameCount);
+                }
+            }
+
+            // A descriptor buffer replaces every descriptor buffer bound to the command buffer
+            // before, and invalidates its descriptor sets.
+            void bind(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint) const {
+                if (m_descriptorBuffer != VK_NULL_HANDLE) {
+                    const auto bindingInfo = VkDescriptorBufferBindingInfoEXT {
+                        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_BUFFER_BINDING_INFO_EXT,
+                        .address = m_descriptorBufferAddress,
+                        .usage = DESCRIPTOR_BUFFER_USAGE,
+                    };
+                    vkCmdBindDescriptorBuffersEXT(commandBuffer, 1, &bindingInfo);
+
+                    const uint32_t bufferIndex = 0;
+                    const VkDeviceSize offset = 0;
+                    vkCmdSetDescriptorBufferOffsetsEXT(commandBuffer, bindPoint, m_pipelineLayout, 0, 1, &bufferIndex, &offset);
+                    return;
+                }
+
+                vkCmdBindDescriptorSets(commandBuffer, bindPoint, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, nullptr);
+            }
+
+            bool usesDescriptorBuffer() const {
+                return m_descriptorBuffer != VK_NULL_HANDLE;
+            }
+
+            // Pipelines created with the heap's layout need these, since a descriptor buffer
+            // layout only works with pipelines that know it is one.
+            VkPipelineCreateFlags pipelineCreateFlags() const {
+                return m_descriptorBuffer != VK_NULL_HANDLE ? VkPipelineCreateFlags { VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT } : 0;
+            }
+
+            // The bytes of the descriptor buffer, or 0 for the descriptor set.
+            VkDeviceSize descriptorBufferSize() const {
+                return m_descriptorBuffer != VK_NULL_HANDLE ? m_descriptorAllocation.size : 0;
+            }
+
+            VkDescriptorSetLayout descriptorSetLayout() const {
+                return m_descriptorSetLayout;
+            }
+
+            VkPipelineLayout pipelineLayout() const {
+                return m_pipelineLayout;
+            }
+        private:
+            VkDevice m_device = VK_NULL_HANDLE;
+            HeapLimits m_limits;
+            std::array<SlotAllocator, DESCRIPTOR_KIND_COUNT> m_slots;
+            VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
+            VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+            VkDescriptorSet m_descriptorSet = VK_NULL_HANDLE;
+            VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+            vk_memory::DeviceMemoryAllocator* m_memoryAllocator = nullptr;
+            VkBuffer m_descriptorBuffer = VK_NULL_HANDLE;
+            vk_memory::Allocation m_descriptorAllocation;
+            VkDeviceAddress m_descriptorBufferAddress = 0;
+            // Where each binding's array starts in the buffer, and how far apart its slots are.
+            std::array<VkDeviceSize, DESCRIPTOR_KIND_COUNT> m_bindingOffsets {};
+            std::array<size_t, DESCRIPTOR_KIND_COUNT> m_descriptorSizes {};
+
+            static constexpr auto DESCRIPTOR_TYPES = std::array<VkDescriptorType, DESCRIPTOR_KIND_COUNT> {
+                VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+                VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                VK_DESCRIPTOR_TYPE_SAMPLER,
+            };
+
+            void createDescriptorSet(std::span<const VkDescriptorSetLayoutBinding> bindings) {
+                const VkDescriptorBindingFlags bindingFlag =
+                    VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT
+                    | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT
+                    | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+                m_descriptorSetLayout = this->createLayout(bindings, VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT, bindingFlag);
+
+                const auto poolSizes = std::array<VkDescriptorPoolSize, DESCRIPTOR_KIND_COUNT> {
+                    VkDescriptorPoolSize { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, m_limits.sampledImages },
+                    VkDescriptorPoolSize { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_limits.storageBuffers },
+                    VkDescriptorPoolSize { VK_DESCRIPTOR_TYPE_SAMPLER, m_limits.samplers },
+                };
+                const auto poolInfo = VkDescriptorPoolCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+                    .flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT,
+                    .maxSets = 1,
+                    .poolSizeCount = static_cast<uint32_t>(poolSizes.size()),
+                    .pPoolSizes = poolSizes.data(),
+                };
+
+                const auto poolResult = vkCreateDescriptorPool(m_device, &poolInfo, nullptr, &m_descriptorPool);
+                if (poolResult != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create bindless descriptor pool!");
+                }
+
+                const auto allocateInfo = VkDescriptorSetAllocateInfo {
+                    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+                    .descriptorPool = m_descriptorPool,
+                    .descriptorSetCount = 1,
+                    .pSetLayouts = &m_descriptorSetLayout,
+                };
+
+                const auto allocateResult = vkAllocateDescriptorSets(m_device, &allocateInfo, &m_descriptorSet);
+                if (allocateResult != VK_SUCCESS) {
+                    throw std::runtime_error("failed to allocate bindless descriptor set!");
+                }
+            }
+
+            // Leaves nothing behind and returns false when the layout does not fit in a
+            // descriptor buffer. Update after bind does not apply to descriptor buffers, whose
+            // slots are plain memory the host may write while the device reads others.
+            bool createDescriptorBuffer(std::span<const VkDescriptorSetLayoutBinding> bindings, const DescriptorBufferSupport& support) {
+                const auto& properties = support.properties;
+                const auto layout = this->createLayout(bindings, VK_DESCRIPTOR_SET_LAYOUT_CREATE_DESCRIPTOR_BUFFER_BIT_EXT, VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT);
+
+                auto layoutSize = VkDeviceSize {};
+                vkGetDescriptorSetLayoutSizeEXT(m_device, layout, &layoutSize);
+
+                // The one buffer holds samplers and resources alike, so it has to fit both ranges.
+                const auto maxSize = std::min({
+                    properties.maxResourceDescriptorBufferRange,
+                    properties.maxSamplerDescriptorBufferRange,
+                    properties.descriptorBufferAddressSpaceSize,
+                    properties.resourceDescriptorBufferAddressSpaceSize,
+                    properties.samplerDescriptorBufferAddressSpaceSize,
+                });
+                if (layoutSize == 0 || layoutSize > maxSize || properties.maxDescriptorBufferBindings == 0) {
+                    vkDestroyDescriptorSetLayout(m_device, layout, nullptr);
+                    return false;
+                }
+
+                m_descriptorSetLayout = layout;
+                m_memoryAllocator = support.allocator;
+                for (uint32_t binding = 0; binding < DESCRIPTOR_KIND_COUNT; binding++) {
+                    vkGetDescriptorSetLayoutBindingOffsetEXT(m_device, m_descriptorSetLayout, binding, &m_bindingOffsets[binding]);
+                }
+                m_descriptorSizes = {
+                    properties.sampledImageDescriptorSize,
+                    properties.storageBufferDescriptorSize,
+                    properties.samplerDescriptorSize,
+                };
+
+                const auto bufferInfo = VkBufferCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                    .size = layoutSize,
+                    .usage = DESCRIPTOR_BUFFER_USAGE,
+                    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                };
+                const auto bufferResult = vkCreateBuffer(m_device, &bufferInfo, nullptr, &m_descriptorBuffer);
+                if (bufferResult != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create bindless descriptor buffer!");
+                }
+
+                // Coherent so a written descriptor needs no flush. Device local memory, where
+                // there is a BAR, saves the device reading descriptors across the bus. A
+                // dedicated allocation starts at offset 0, which keeps the address aligned to
+                // `descriptorBufferOffsetAlignment`.
+                m_descriptorAllocation = m_memoryAllocator->allocateForBuffer(m_descriptorBuffer, vk_memory::AllocationCreateInfo {
+                    .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                    .preferredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                    .kind = vk_memory::ResourceKind::Linear,
+                    .priority = vk_memory::MemoryPriority::High,
+                    .dedicated = true,
+                    .userData = this,
+                });
+                if (m_descriptorAllocation.mappedData == nullptr) {
+                    throw std::runtime_error("failed to map bindless descriptor buffer!");
+                }
+                m_descriptorBufferAddress = vk_memory::bufferDeviceAddress(m_device, m_descriptorBuffer);
+
+                return true;
+            }
+
+            VkDescriptorSetLayout createLayout(
+                std::span<const VkDescriptorSetLayoutBinding> bindings,
+                VkDescriptorSetLayoutCreateFlags flags,
+                VkDescriptorBindingFlags bindingFlag
+            ) const {
+                const auto bindingFlags = std::array<VkDescriptorBindingFlags, DESCRIPTOR_KIND_COUNT> { bindingFlag, bindingFlag, bindingFlag };
+                const auto bindingFlagsInfo = VkDescriptorSetLayoutBindingFlagsCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+                    .bindingCount = static_cast<uint32_t>(bindingFlags.size()),
+                    .pBindingFlags = bindingFlags.data(),
+                };
+                const auto layoutInfo = VkDescriptorSetLayoutCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+                    .pNext = &bindingFlagsInfo,
+                    .flags = flags,
+                    .bindingCount = static_cast<uint32_t>(bindings.size()),
+                    .pBindings = bindings.data(),
+                };
+
+                auto layout = VkDescriptorSetLayout {};
+                const auto layoutResult = vkCreateDescriptorSetLayout(m_device, &layoutInfo, nullptr, &layout);
+                if (layoutResult != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create bindless descriptor set layout!");
+                }
+
+                return layout;
+            }
+
+            void write(DescriptorKind kind, uint32_t slot, const VkDescriptorImageInfo* imageInfo, const VkDescriptorBufferInfo* bufferInfo) {
+                if (m_descriptorBuffer != VK_NULL_HANDLE) {
+                    this->writeToBuffer(kind, slot, imageInfo, bufferInfo);
+                    return;
+                }
+
+                const auto write = VkWriteDescriptorSet {
+                    .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                    .dstSet = m_descriptorSet,
+                    .dstBinding = static_cast<uint32_t>(kind),
+                    .dstArrayElement = slot,
+                    .descriptorCount = 1,
+                    .descriptorType = DESCRIPTOR_TYPES[static_cast<uint32_t>(kind)],
+                    .pImageInfo = imageInfo,
+                    .pBufferInfo = bufferInfo,
+                };
+
+                vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
+            }
+
+            // Storage buffers are written by address, so they need
+            // `VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT` and a range other than `VK_WHOLE_SIZE`.
+            void writeToBuffer(DescriptorKind kind, uint32_t slot, const VkDescriptorImageInfo* imageInfo, const VkDescriptorBufferInfo* bufferInfo) {
+                const auto index = static_cast<uint32_t>(kind);
+                auto addressInfo = VkDescriptorAddressInfoEXT {
+                    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_ADDRESS_INFO_EXT,
+                };
+                auto data = VkDescriptorDataEXT {};
+                switch (kind) {
+                    case DescriptorKind::SampledImage:
+                        data.pSampledImage = imageInfo;
+                        break;
+                    case DescriptorKind::StorageBuffer:
+                        if (bufferInfo->range == VK_WHOLE_SIZE) {
+                            throw std::runtime_error("failed to write a bindless storage buffer descriptor without a range!");
+                        }
+
+                        addressInfo.address = vk_memory::bufferDeviceAddress(m_device, bufferInfo->buffer) + bufferInfo->offset;
+                        addressInfo.range = bufferInfo->range;
+                        data.pStorageBuffer = &addressInfo;
+                        break;
+                    case DescriptorKind::Sampler:
+                        data.pSampler = &imageInfo->sampler;
+                        break;
+                }
+
+                const auto getInfo = VkDescriptorGetInfoEXT {
+                    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT,
+                    .type = DESCRIPTOR_TYPES[index],
+                    .data = data,
+                };
+                auto* destination = static_cast<std::byte*>(m_descriptorAllocation.mappedData) + m_bindingOffsets[index] + slot * m_descriptorSizes[index];
+                vkGetDescriptorEXT(m_device, &getInfo, m_descriptorSizes[index], destination);
+            }
+    };
+
+    // Creates every distinct descriptor set layout once. Layouts are looked up by a hash of
+    // their flags and bindings, in any binding order, so modules asking for the same bindings
+    // share one. The cache owns the layouts, and outlives everything created with them.
+    class DescriptorLayoutCache {
+        public:
+            explicit DescriptorLayoutCache() = default;
+
+            DescriptorLayoutCache(const DescriptorLayoutCache& other) = delete;
+            DescriptorLayoutCache& operator=(const DescriptorLayoutCache& other) = delete;
+
+            void init(VkDevice device, const VkAllocationCallbacks* allocator) {
+                m_device = device;
+                m_allocator = allocator;
+            }
+
+            void destroy() {
+                if (m_device == VK_NULL_HANDLE) {
+                    return;
+                }
+
+                for (const auto& [key, layout] : m_layouts) {
+                    vkDestroyDescriptorSetLayout(m_device, layout, m_allocator);
+                }
+
+                m_layouts.clear();
+                m_device = VK_NULL_HANDLE;
+            }
+
+            bool isInitialized() const {
+                return m_device != VK_NULL_HANDLE;
+            }
+
+            VkDescriptorSetLayout layout(std::span<const VkDescriptorSetLayoutBinding> bindings, VkDescriptorSetLayoutCreateFlags flags = 0) {
+                auto key = LayoutKey {
+                    .flags = flags,
+                    .bindings = std::vector<VkDescriptorSetLayoutBinding>(bindings.begin(), bindings.end()),
+                };
+                std::sort(key.bindings.begin(), key.bindings.end(), [](const auto& a, const auto& b) {
+                    return a.binding < b.binding;
+                });
+                for (const auto& binding : key.bindings) {
+                    if (binding.pImmutableSamplers != nullptr) {
+                        key.immutableSamplers.insert(key.immutableSamplers.end(), binding.pImmutableSamplers, binding.pImmutableSamplers + binding.descriptorCount);
+                    }
+                }
+
+                const auto found = m_layouts.find(key);
+                if (found != m_layouts.end()) {
+                    return found->second;
+                }
+
+                const auto layoutInfo = VkDescriptorSetLayoutCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+                    .flags = flags,
+                    .bindingCount = static_cast<uint32_t>(bindings.size()),
+                    .pBindings = bindings.data(),
+                };
+
+                auto layout = VkDescriptorSetLayout {};
+                const auto result = vkCreateDescriptorSetLayout(m_device, &layoutInfo, m_allocator, &layout);
+                if (result != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create descriptor set layout!");
+                }
+
+                // The key keeps the samplers by value, so it must not point into the caller's.
+                for (auto& binding : key.bindings) {
+                    binding.pImmutableSamplers = nullptr;
+                }
+
+                m_layouts.emplace(std::move(key), layout);
+
+                return layout;
+            }
+
+            size_t layoutCount() const {
+                return m_layouts.size();
+            }
+        private:
+            struct LayoutKey {
+                VkDescriptorSetLayoutCreateFlags flags = 0;
+                std::vector<VkDescriptorSetLayoutBinding> bindings;
+                std::vector<VkSampler> immutableSamplers;
+
+                bool operator==(const LayoutKey& other) const {
+                    const auto sameBinding = [](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b) {
+                        return a.binding == b.binding
+                            && a.descriptorType == b.descriptorType
+                            && a.descriptorCount == b.descriptorCount
+                            && a.stageFlags == b.stageFlags
+                            && (a.pImmutableSamplers == nullptr) == (b.pImmutableSamplers == nullptr);
+                    };
+
+                    return flags == other.flags
+                        && std::equal(bindings.begin(), bindings.end(), other.bindings.begin(), other.bindings.end(), sameBinding)
+                        && immutableSamplers == other.immutableSamplers;
+                }
+            };
+
+            // FNV-1a over the fields that tell two layouts apart.
+            struct LayoutKeyHash {
+                size_t operator()(const LayoutKey& key) const {
+                    uint64_t hash = 14695981039346656037ull;
+                    const auto mix = [&hash](uint64_t value) {
+                        hash ^= value;
+                        hash *= 1099511628211ull;
+                    };
+
+                    mix(key.flags);
+                    for (const auto& binding : key.bindings) {
+                        mix(binding.binding);
+                        mix(binding.descriptorType);
+                        mix(binding.descriptorCount);
+                        mix(binding.stageFlags);
+                    }
+
+                    for (const auto sampler : key.immutableSamplers) {
+                        mix(reinterpret_cast<uint64_t>(sampler));
+                    }
+
+                    return static_cast<size_t>(hash);
+                }
+            };
+
+            VkDevice m_device = VK_NULL_HANDLE;
+            const VkAllocationCallbacks* m_allocator = nullptr;
+            std::unordered_map<LayoutKey, VkDescriptorSetLayout, LayoutKeyHash> m_layouts;
+    };
+
+    // Creates every distinct sampler once, and hands out the same one to every module asking
+    // for its state, since a frame samples with a handful of states. Samplers are looked up by
+    // a hash of their create info, which must have no `pNext` chain. The cache owns the
+    // samplers, outlives everything using them, and never makes more than the device's
+    // `maxSamplerAllocationCount`.
+    class SamplerCache {
+        public:
+            explicit SamplerCache() = default;
+
+            SamplerCache(const SamplerCache& other) = delete;
+            SamplerCache& operator=(const SamplerCache& other) = delete;
+
+            void init(VkDevice device, uint32_t maxSamplerAllocationCount, const VkAllocationCallbacks* allocator) {
+                m_device = device;
+                m_maxSamplerCount = maxSamplerAllocationCount;
+                m_allocator = allocator;
+            }
+
+            void destroy() {
+                if (m_device == VK_NULL_HANDLE) {
+                    return;
+                }
+
+                for (const auto& [key, sampler] : m_samplers) {
+                    vkDestroySampler(m_device, sampler, m_allocator);
+                }
+
+                m_samplers.clear();
+                m_device = VK_NULL_HANDLE;
+            }
+
+            bool isInitialized() const {
+                return m_device != VK_NULL_HANDLE;
+            }
+
+            VkSampler sampler(const VkSamplerCreateInfo& samplerInfo) {
+                if (samplerInfo.pNext != nullptr) {
+                    throw std::runtime_error("failed to cache a sampler with a create info chain!");
+                }
+
+                auto key = samplerInfo;
+                key.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+                const auto found = m_samplers.find(key);
+                if (found != m_samplers.end()) {
+                    m_sharedCount++;
+
+                    return found->second;
+                }
+
+                if (m_samplers.size() >= m_maxSamplerCount) {
+                    throw std::runtime_error("failed to create sampler, the device's sampler limit is reached!");
+                }
+
+                auto sampler = VkSampler {};
+                const auto result = vkCreateSampler(m_device, &samplerInfo, m_allocator, &sampler);
+                if (result != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create sampler!");
+                }
+
+                m_samplers.emplace(key, sampler);
+
+                return sampler;
+            }
+
+            size_t samplerCount() const {
+                return m_samplers.size();
+            }
+
+            // The requests answered with a sampler made for an earlier one.
+            uint64_t sharedCount() const {
+                return m_sharedCount;
+            }
+        private:
+            // The floats are compared by their bits, like they are hashed.
+            struct SamplerKeyEqual {
+                bool operator()(const VkSamplerCreateInfo& a, const VkSamplerCreateInfo& b) const {
+                    return a.flags == b.flags
+                        && a.magFilter == b.magFilter
+                        && a.minFilter == b.minFilter
+                        && a.mipmapMode == b.mipmapMode
+                        && a.addressModeU == b.addressModeU
+                        && a.addressModeV == b.addressModeV
+                        && a.addressModeW == b.addressModeW
+                        && std::bit_cast<uint32_t>(a.mipLodBias) == std::bit_cast<uint32_t>(b.mipLodBias)
+                        && a.anisotropyEnable == b.anisotropyEnable
+                        && std::bit_cast<uint32_t>(a.maxAnisotropy) == std::bit_cast<uint32_t>(b.maxAnisotropy)
+                        && a.compareEnable == b.compareEnable
+                        && a.compareOp == b.compareOp
+                        && std::bit_cast<uint32_t>(a.minLod) == std::bit_cast<uint32_t>(b.minLod)
+                        && std::bit_cast<uint32_t>(a.maxLod) == std::bit_cast<uint32_t>(b.maxLod)
+                        && a.borderColor == b.borderColor
+                        && a.unnormalizedCoordinates == b.unnormalizedCoordinates;
+                }
+            };
+
+            // FNV-1a over the same fields, with the floats by their bits.
+            struct SamplerKeyHash {
+                size_t operator()(const VkSamplerCreateInfo& key) const {
+                    uint64_t hash = 14695981039346656037ull;
+                    const auto mix = [&hash](uint64_t value) {
+                        hash ^= value;
+                        hash *= 1099511628211ull;
+                    };
+
+                    mix(key.flags);
+                    mix(key.magFilter);
+                    mix(key.minFilter);
+                    mix(key.mipmapMode);
+                    mix(key.addressModeU);
+                    mix(key.addressModeV);
+                    mix(key.addressModeW);
+                    mix(std::bit_cast<uint32_t>(key.mipLodBias));
+                    mix(key.anisotropyEnable);
+                    mix(std::bit_cast<uint32_t>(key.maxAnisotropy));
+                    mix(key.compareEnable);
+                    mix(key.compareOp);
+                    mix(std::bit_cast<uint32_t>(key.minLod));
+                    mix(std::bit_cast<uint32_t>(key.maxLod));
+                    mix(key.borderColor);
+                    mix(key.unnormalizedCoordinates);
+
+                    return static_cast<size_t>(hash);
+                }
+            };
+
+            VkDevice m_device = VK_NULL_HANDLE;
+            const VkAllocationCallbacks* m_allocator = nullptr;
+            uint32_t m_maxSamplerCount = 0;
+            uint64_t m_sharedCount = 0;
+            std::unordered_map<VkSamplerCreateInfo, VkSampler, SamplerKeyHash, SamplerKeyEqual> m_samplers;
+    };
+
+    // How many descriptors of `type` a pool holds for every set it can allocate.
+    struct PoolSizeRatio {
+        VkDescriptorType type;
+        float ratio;
+    };
+
+    // Descriptor sets that only live for the frame they were allocated in, out of pools kept
+    // per frame in flight. Running out of a pool moves on to another, created on demand with
+    // twice the sets of the last up to `MAX_SETS_PER_POOL`, and `beginFrame` resets every pool
+    // of its frame at once with `vkResetDescriptorPool`, so no set is ever freed on its own.
+    // Not thread safe: sets are allocated while the frame is recorded on one thread.
+    class FrameDescriptorAllocator {
+        public:
+            static constexpr uint32_t MAX_SETS_PER_POOL = 4096;
+
+            explicit FrameDescriptorAllocator() = default;
+
+            FrameDescriptorAllocator(const FrameDescriptorAllocator& other) = delete;
+            FrameDescriptorAllocator& operator=(const FrameDescriptorAllocator& other) = delete;
+
+            void init(
+                VkDevice device,
+                uint32_t framesInFlight,
+                std::span<const PoolSizeRatio> ratios,
+                uint32_t initialSetsPerPool,
+                const VkAllocationCallbacks* allocator
+            ) {
+                m_device = device;
+                m_allocator = allocator;
+                m_ratios.assign(ratios.begin(), ratios.end());
+                m_frames.clear();
+                m_frames.resize(framesInFlight);
+                for (auto& frame : m_frames) {
+                    frame.setsPerPool = std::clamp(initialSetsPerPool, 1u, MAX_SETS_PER_POOL);
+                }
+
+                m_frameIndex = 0;
+            }
+
+            void destroy() {
+                if (m_device == VK_NULL_HANDLE) {
+                    return;
+                }
+
+                for (auto& frame : m_frames) {
+                    for (const auto pool : frame.pools) {
+                        vkDestroyDescriptorPool(m_device, pool, m_allocator);
+                    }
+                }
+
+                m_frames.clear();
+                m_device = VK_NULL_HANDLE;
+            }
+
+            bool isInitialized() const {
+                return m_device != VK_NULL_HANDLE;
+            }
+
+            // The frame that last used `frameIndex` has to have completed.
+            void beginFrame(uint32_t frameIndex) {
+                m_frameIndex = frameIndex;
+                auto& frame = m_frames[frameIndex];
+                for (const auto pool : frame.pools) {
+                    vkResetDescriptorPool(m_device, pool, 0);
+                }
+
+                frame.currentPool = 0;
+            }
+
+            VkDescriptorSet allocate(VkDescriptorSetLayout layout) {
+                auto& frame = m_frames[m_frameIndex];
+                while (true) {
+                    const auto created = frame.currentPool == frame.pools.size();
+                    const auto largestPool = frame.setsPerPool == MAX_SETS_PER_POOL;
+                    if (created) {
+                        frame.pools.push_back(this->createPool(frame.setsPerPool));
+                        frame.setsPerPool = std::min(frame.setsPerPool * 2, MAX_SETS_PER_POOL);
+                    }
+
+                    const auto allocateInfo = VkDescriptorSetAllocateInfo {
+                        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+                        .descriptorPool = frame.pools[frame.currentPool],
+                        .descriptorSetCount = 1,
+                        .pSetLayouts = &layout,
+                    };
+
+                    auto set = VkDescriptorSet {};
+                    const auto result = vkAllocateDescriptorSets(m_device, &allocateInfo, &set);
+                    if (result == VK_SUCCESS) {
+                        return set;
+                    }
+
+                    // A set that does not fit a new pool of the largest size does not fit any.
+                    if ((result != VK_ERROR_OUT_OF_POOL_MEMORY && result != VK_ERROR_FRAGMENTED_POOL) || (created && largestPool)) {
+                        throw std::runtime_error("failed to allocate frame descriptor set!");
+                    }
+
+                    frame.currentPool++;
+                }
+            }
+
+            // Across every frame in flight.
+            size_t poolCount() const {
+                auto count = size_t { 0 };
+                for (const auto& frame : m_frames) {
+                    count += frame.pools.size();
+                }
+
+                return count;
+            }
+        private:
+            // Pools before `currentPool` have run out this frame.
+            struct FramePools {
+                std::vector<VkDescriptorPool> pools;
+                size_t currentPool = 0;
+                uint32_t setsPerPool = 1;
+            };
+
+            VkDevice m_device = VK_NULL_HANDLE;
+            const VkAllocationCallbacks* m_allocator = nullptr;
+            std::vector<PoolSizeRatio> m_ratios;
+            std::vector<FramePools> m_frames;
+            uint32_t m_frameIndex = 0;
+
+            VkDescriptorPool createPool(uint32_t setCount) const {
+                auto poolSizes = std::vector<VkDescriptorPoolSize> {};
+                poolSizes.reserve(m_ratios.size());
+                for (const auto& ratio : m_ratios) {
+                    poolSizes.push_back(VkDescriptorPoolSize {
+                        .type = ratio.type,
+                        .descriptorCount = std::max(static_cast<uint32_t>(ratio.ratio * static_cast<float>(setCount)), 1u),
+                    });
+                }
+
+                const auto poolInfo = VkDescriptorPoolCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+                    .maxSets = setCount,
+                    .poolSizeCount = static_cast<uint32_t>(poolSizes.size()),
+                    .pPoolSizes = poolSizes.data(),
+                };
+
+                auto pool = VkDescriptorPool {};
+                const auto result = vkCreateDescriptorPool(m_device, &poolInfo, m_allocator, &pool);
+                if (result != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create frame descriptor pool!");
+                }
+
+                return pool;
+            }
+    };
+
+    // The few bindings a pass rewrites for every dispatch or draw, which stay outside the
+    // bindless heap. With `VK_KHR_push_descriptor` they are written straight into the command
+    // buffer, and otherwise into a set from the frame's pools, bound in their place, so a pass
+    // records the same either way.
+    class PerDrawDescriptors {
+        public:
+            explicit PerDrawDescriptors() = default;
+
+            PerDrawDescriptors(const PerDrawDescriptors& other) = delete;
+            PerDrawDescriptors& operator=(const PerDrawDescriptors& other) = delete;
+
+            // The set layout comes from `layoutCache`, made for pushing with `pushDescriptors`.
+            void init(
+                VkDevice device,
+                DescriptorLayoutCache& layoutCache,
+                FrameDescriptorAllocator& frameDescriptors,
+                std::span<const VkDescriptorSetLayoutBinding> bindings,
+                bool pushDescriptors
+            ) {
+                m_device = device;
+                m_frameDescriptors = &frameDescriptors;
+                m_pushDescriptors = pushDescriptors;
+                m_setLayout = layoutCache.layout(bindings, pushDescriptors ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR : 0);
+            }
+
+            VkDescriptorSetLayout setLayout() const {
+                return m_setLayout;
+            }
+
+            bool pushesDescriptors() const {
+                return m_pushDescriptors;
+            }
+
+            // Writes `writes`, whose `dstSet` is filled in here, and binds them as set `set` of
+            // `pipelineLayout`.
+            void bind(
+                VkCommandBuffer commandBuffer,
+                VkPipelineBindPoint bindPoint,
+                VkPipelineLayout pipelineLayout,
+                uint32_t set,
+                std::span<VkWriteDescriptorSet> writes
+            ) const {
+                if (m_pushDescriptors) {
+                    vkCmdPushDescriptorSetKHR(commandBuffer, bindPoint, pipelineLayout, set, static_cast<uint32_t>(writes.size()), writes.data());
+                    return;
+                }
+
+                const auto descriptorSet = m_frameDescriptors->allocate(m_setLayout);
+                for (auto& write : writes) {
+                    write.dstSet = descriptorSet;
+                }
+
+                vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+                vkCmdBindDescriptorSets(commandBuffer, bindPoint, pipelineLayout, set, 1, &descriptorSet, 0, nullptr);
+            }
+
+            void reset() {
+                m_setLayout = VK_NULL_HANDLE;
+                m_device = VK_NULL_HANDLE;
+            }
+        private:
+            VkDevice m_device = VK_NULL_HANDLE;
+            FrameDescriptorAllocator* m_frameDescriptors = nullptr;
+            VkDescriptorSetLayout m_setLayout = VK_NULL_HANDLE;
+            bool m_pushDescriptors = false;
+    };
+}
@@ -0,0 +1,445 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include "vk_handles.h"
+
+
+namespace vk_device_group {
+    // How the GPUs of a device group share the frames of one swapchain.
+    //
+    // * `Off` renders on a single GPU, even when it is linked to others.
+    // * `Afr` renders alternate frames on alternate GPUs, and each GPU presents its own frames.
+    //   Throughput scales with the GPU count, latency does not.
+    // * `Sfr` splits every frame into horizontal strips, one per GPU. Each GPU writes its strip
+    //   straight into the first GPU's instance of the swapchain image through peer memory,
+    //   and the first GPU presents the whole image.
+    enum class DeviceGroupMode {
+        Off,
+        Afr,
+        Sfr,
+    };
+
+    inline const char* deviceGroupModeToString(DeviceGroupMode mode) {
+        switch (mode) {
+            case DeviceGroupMode::Off: return "off";
+            case DeviceGroupMode::Afr: return "afr";
+            case DeviceGroupMode::Sfr: return "sfr";
+        }
+
+        return "unknown";
+    }
+
+    inline std::optional<DeviceGroupMode> deviceGroupModeFromString(std::string_view name) {
+        for (const auto mode : { DeviceGroupMode::Off, DeviceGroupMode::Afr, DeviceGroupMode::Sfr }) {
+            if (name == deviceGroupModeToString(mode)) {
+                return mode;
+            }
+        }
+
+        return std::nullopt;
+    }
+
+    inline uint32_t allDevicesMask(uint32_t deviceCount) {
+        return (1u << deviceCount) - 1;
+    }
+
+    // The lowest device in `deviceMask`, which runs the frame's semaphore operations.
+    inline uint32_t primaryDeviceIndex(uint32_t deviceMask) {
+        return static_cast<uint32_t>(std::countr_zero(deviceMask));
+    }
+
+    // The physical devices of the group `physicalDevice` belongs to, in group order, or none
+    // when it is not linked to any other device.
+    inline std::vector<VkPhysicalDevice> findLinkedDevices(VkInstance instance, VkPhysicalDevice physicalDevice) {
+        uint32_t groupCount = 0;
+        vkEnumeratePhysicalDeviceGroups(instance, &groupCount, nullptr);
+
+        auto groups = std::vector<VkPhysicalDeviceGroupProperties> { groupCount, VkPhysicalDeviceGroupProperties {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GROUP_PROPERTIES,
+        } };
+        vkEnumeratePhysicalDeviceGroups(instance, &groupCount, groups.data());
+
+        for (const auto& group : groups) {
+            const auto begin = std::begin(group.physicalDevices);
+            const auto end = begin + group.physicalDeviceCount;
+            if (group.physicalDeviceCount > 1 && std::find(begin, end, physicalDevice) != end) {
+                return std::vector<VkPhysicalDevice> { begin, end };
+            }
+        }
+
+        return {};
+    }
+
+    // Whether every device in `deviceMask` can present the swapchain images in its own memory.
+    inline bool supportsLocalPresent(VkDevice device, VkSurfaceKHR surface, uint32_t deviceMask) {
+        auto capabilities = VkDeviceGroupPresentCapabilitiesKHR {
+            .sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_PRESENT_CAPABILITIES_KHR,
+        };
+        if (vkGetDeviceGroupPresentCapabilitiesKHR(device, &capabilities) != VK_SUCCESS) {
+            return false;
+        }
+
+        auto surfaceModes = VkDeviceGroupPresentModeFlagsKHR {};
+        if (vkGetDeviceGroupSurfacePresentModesKHR(device, surface, &surfaceModes) != VK_SUCCESS) {
+            return false;
+        }
+
+        if ((capabilities.modes & surfaceModes & VK_DEVICE_GROUP_PRESENT_MODE_LOCAL_BIT_KHR) == 0) {
+            return false;
+        }
+
+        for (uint32_t i = 0; i < VK_MAX_DEVICE_GROUP_SIZE; i++) {
+            const auto bit = 1u << i;
+            if ((deviceMask & bit) != 0 && (capabilities.presentMask[i] & bit) == 0) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Whether every other device can render into the first device's instance of memory in
+    // `heapIndex`, which split frame rendering does for all but the first strip.
+    inline bool supportsPeerRendering(VkDevice device, uint32_t heapIndex, uint32_t deviceCount) {
+        for (uint32_t i = 1; i < deviceCount; i++) {
+            auto features = VkPeerMemoryFeatureFlags {};
+            vkGetDeviceGroupPeerMemoryFeatures(device, heapIndex, i, 0, &features);
+            if ((features & VK_PEER_MEMORY_FEATURE_GENERIC_DST_BIT) == 0) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // The height in rows of the format's sparse image blocks, or 1 when it has none.
+    inline uint32_t splitGranularity(VkPhysicalDevice physicalDevice, VkFormat format, VkImageUsageFlags usage) {
+        uint32_t propertyCount = 0;
+        vkGetPhysicalDeviceSparseImageFormatProperties(
+            physicalDevice, format, VK_IMAGE_TYPE_2D, VK_SAMPLE_COUNT_1_BIT, usage, VK_IMAGE_TILING_OPTIMAL, &propertyCount, nullptr
+        );
+        if (propertyCount == 0) {
+            return 1;
+        }
+
+        auto properties = std::vector<VkSparseImageFormatProperties> { propertyCount, VkSparseImageFormatProperties {} };
+        vkGetPhysicalDeviceSparseImageFormatProperties(
+            physicalDevice, format, VK_IMAGE_TYPE_2D, VK_SAMPLE_COUNT_1_BIT, usage, VK_IMAGE_TILING_OPTIMAL, &propertyCount, properties.data()
+        );
+
+        return std::max(properties.front().imageGranularity.height, 1u);
+    }
+
+    // One horizontal strip of `extent` per device. Strip boundaries are aligned to
+    // `granularity` rows, the sparse block height of the format, as split instance binds
+    // require of every region but the last.
+    inline std::vector<VkRect2D> splitRenderAreas(VkExtent2D extent, uint32_t deviceCount, uint32_t granularity) {
+        const auto alignment = std::max(granularity, 1u);
+        auto areas = std::vector<VkRect2D> {};
+        areas.reserve(deviceCount);
+
+        uint32_t top = 0;
+        for (uint32_t i = 0; i < deviceCount; i++) {
+            const auto bottom = i + 1 == deviceCount
+                ? extent.height
+                : std::min(extent.height, (extent.height * (i + 1) / deviceCount + alignment - 1) / alignment * alignment);
+            areas.push_back(VkRect2D {
+                .offset = VkOffset2D { 0, static_cast<int32_t>(top) },
+                .extent = VkExtent2D { extent.width, bottom - top },
+            });
+            top = bottom;
+        }
+
+        return areas;
+    }
+
+    // The `VkBindImageMemoryDeviceGroupInfo` regions that give device `i` strip `i` from the
+    // first device's memory. Element `i * N + j` is the region of image instance `i` bound to
+    // memory instance `j`, so each instance's strips are rotated through the memory instances:
+    // strip `s` of instance `i` comes from instance `(s - i) mod N`.
+    inline std::vector<VkRect2D> splitInstanceBindRegions(std::span<const VkRect2D> renderAreas) {
+        const auto deviceCount = static_cast<uint32_t>(renderAreas.size());
+        auto regions = std::vector<VkRect2D> { deviceCount * deviceCount, VkRect2D {} };
+        for (uint32_t image = 0; image < deviceCount; image++) {
+            for (uint32_t strip = 0; strip < deviceCount; strip++) {
+                const auto memory = (strip + deviceCount - image) % deviceCount;
+                regions[image * deviceCount + memory] = renderAreas[strip];
+            }
+        }
+
+        return regions;
+    }
+
+    // Images aliasing each swapchain image with split instance bind regions, which the frame
+    // renders into in split frame mode. Layout transitions on them apply to the swapchain image.
+    inline std::vector<vk_handles::Image> createSplitImages(
+        VkDevice device,
+        VkSwapchainKHR swapChain,
+        uint32_t imageCount,
+        VkFormat format,
+        VkExtent2D extent,
+        VkImageUsageFlags usage,
+        std::span<const VkRect2D> renderAreas,
+        const VkAllocationCallbacks* allocator
+    ) {
+        const auto bindRegions = splitInstanceBindRegions(renderAreas);
+        auto images = std::vector<vk_handles::Image> {};
+        images.reserve(imageCount);
+        for (uint32_t i = 0; i < imageCount; i++) {
+            const auto swapChainCreateInfo = VkImageSwapchainCreateInfoKHR {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_SWAPCHAIN_CREATE_INFO_KHR,
+                .swapchain = swapChain,
+            };
+            const auto createInfo = VkImageCreateInfo {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+                .pNext = &swapChainCreateInfo,
+                .flags = VK_IMAGE_CREATE_SPLIT_INSTANCE_BIND_REGIONS_BIT | VK_IMAGE_CREATE_ALIAS_BIT,
+                .imageType = VK_IMAGE_TYPE_2D,
+                .format = format,
+                .extent = VkExtent3D { extent.width, extent.height, 1 },
+                .mipLevels = 1,
+                .arrayLayers = 1,
+                .samples = VK_SAMPLE_COUNT_1_BIT,
+                .tiling = VK_IMAGE_TILING_OPTIMAL,
+                .usage = usage,
+                .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            };
+
+            auto image = VkImage {};
+            const auto createResult = vkCreateImage(device, &createInfo, allocator, &image);
+            if (createResult != VK_SUCCESS) {
+                throw std::runtime_error("failed to create split swapchain image!");
+            }
+
+            images.emplace_back(device, image, allocator);
+
+            const auto deviceGroupInfo = VkBindImageMemoryDeviceGroupInfo {
+                .sType = VK_STRUCTURE_TYPE_BIND_IMAGE_MEMORY_DEVICE_GROUP_INFO,
+                .splitInstanceBindRegionCount = static_cast<uint32_t>(bindRegions.size()),
+                .pSplitInstanceBindRegions = bindRegions.data(),
+            };
+            const auto swapChainBindInfo = VkBindImageMemorySwapchainInfoKHR {
+                .sType = VK_STRUCTURE_TYPE_BIND_IMAGE_MEMORY_SWAPCHAIN_INFO_KHR,
+                .pNext = &deviceGroupInfo,
+                .swapchain = swapChain,
+                .imageIndex = i,
+            };
+            const auto bindInfo = VkBindImageMemoryInfo {
+                .sType = VK_STRUCTURE_TYPE_BIND_IMAGE_MEMORY_INFO,
+                .pNext = &swapChainBindInfo,
+                .image = image,
+            };
+
+            const auto bindResult = vkBindImageMemory2(device, 1, &bindInfo);
+            if (bindResult != VK_SUCCESS) {
+                throw std::runtime_error("failed to bind split swapchain image!");
+            }
+        }
+
+        return images;
+    }
+
+    // What one frame waits for and signals, on top of running its command buffer.
+    struct FrameSubmitInfo {
+        VkCommandBuffer commandBuffer;
+        // The devices running the command buffer, one for alternate frames, all for split ones.
+        uint32_t deviceMask;
+        VkSemaphore imageAvailableSemaphore;
+        VkSemaphore renderFinishedSemaphore;
+        // Null when the frame has no uploads to wait for.
+        VkSemaphore uploadSemaphore;
+        uint64_t uploadValue;
+        VkSemaphore frameTimelineSemaphore;
+        uint64_t frameNumber;
+    };
+
+    // Submits frames whose command buffer runs on several devices, or on another device every
+    // frame. A binary semaphore is waited on by one device and signaled by one device, and a
+    // device only signals once its own part of a batch has completed, so a frame goes out as
+    // three batches:
+    //
+    // 1. The first device of the frame waits for the image and the uploads, and signals a
+    //    start semaphore for every device of the frame.
+    // 2. Every device waits for its start semaphore, runs the command buffer and signals its
+    //    join semaphore.
+    // 3. The first device waits for every join semaphore and for the previous frame, and
+    //    signals the render finished semaphore and the frame timeline. Waiting for the
+    //    previous frame keeps the timeline increasing when frames complete out of order on
+    //    different devices, without holding up any device's rendering.
+    class FrameSynchronizer {
+        public:
+            explicit FrameSynchronizer() = default;
+
+            FrameSynchronizer(const FrameSynchronizer& other) = delete;
+            FrameSynchronizer& operator=(const FrameSynchronizer& other) = delete;
+
+            // Batches are submitted in order, so one start and one join semaphore per device
+            // are always waited on before the next frame signals them again.
+            void init(VkDevice device, uint32_t deviceCount, const VkAllocationCallbacks* allocator) {
+                const auto semaphoreInfo = VkSemaphoreCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+                };
+                for (uint32_t i = 0; i < deviceCount * 2; i++) {
+                    auto semaphore = VkSemaphore {};
+                    const auto result = vkCreateSemaphore(device, &semaphoreInfo, allocator, &semaphore);
+                    if (result != VK_SUCCESS) {
+                        throw std::runtime_error("failed to create device group semaphores!");
+                    }
+
+                    auto& semaphores = i < deviceCount ? m_startSemaphores : m_joinSemaphores;
+                    semaphores.emplace_back(device, semaphore, allocator);
+                }
+            }
+
+            void destroy() {
+                m_startSemaphores.clear();
+                m_joinSemaphores.clear();
+            }
+
+            bool isInitialized() const {
+                return !m_startSemaphores.empty();
+            }
+
+            VkResult submit(VkQueue queue, const FrameSubmitInfo& info) {
+                const auto primaryDevice = primaryDeviceIndex(info.deviceMask);
+                auto devices = std::vector<uint32_t> {};
+                for (uint32_t i = 0; i < m_startSemaphores.size(); i++) {
+                    if ((info.deviceMask & (1u << i)) != 0) {
+                        devices.push_back(i);
+                    }
+                }
+
+                const auto deviceCount = static_cast<uint32_t>(devices.size());
+                auto startSemaphores = std::vector<VkSemaphore> {};
+                auto joinSemaphores = std::vector<VkSemaphore> {};
+                for (const auto device : devices) {
+                    startSemaphores.push_back(m_startSemaphores[device]);
+                    joinSemaphores.push_back(m_joinSemaphores[device]);
+                }
+
+                const auto primaryDevices = std::vector<uint32_t>(std::max(deviceCount, 2u), primaryDevice);
+                const auto allCommands = std::vector<VkPipelineStageFlags>(std::max(deviceCount, 2u), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+                const auto zeroValues = std::vector<uint64_t>(std::max(deviceCount, 2u), 0);
+
+                // Batch 1. Values paired with binary semaphores are ignored.
+                auto fanOutWaits = std::vector<VkSemaphore> { info.imageAvailableSemaphore };
+                auto fanOutWaitValues = std::vector<uint64_t> { 0 };
+                if (info.uploadSemaphore != VK_NULL_HANDLE) {
+                    fanOutWaits.push_back(info.uploadSemaphore);
+                    fanOutWaitValues.push_back(info.uploadValue);
+                }
+
+                const auto fanOutTimeline = VkTimelineSemaphoreSubmitInfo {
+                    .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+                    .waitSemaphoreValueCount = static_cast<uint32_t>(fanOutWaitValues.size()),
+                    .pWaitSemaphoreValues = fanOutWaitValues.data(),
+                    .signalSemaphoreValueCount = deviceCount,
+                    .pSignalSemaphoreValues = zeroValues.data(),
+                };
+                const auto fanOutDeviceGroup = VkDeviceGroupSubmitInfo {
+                    .sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_SUBMIT_INFO,
+                    .pNext = &fanOutTimeline,
+                    .waitSemaphoreCount = static_cast<uint32_t>(fanOutWaits.size()),
+                    .pWaitSemaphoreDeviceIndices = primaryDevices.data(),
+                    .signalSemaphoreCount = deviceCount,
+                    .pSignalSemaphoreDeviceIndices = primaryDevices.data(),
+                };
+
+                // Batch 2.
+                const auto renderTimeline = VkTimelineSemaphoreSubmitInfo {
+                    .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+                    .waitSemaphoreValueCount = deviceCount,
+                    .pWaitSemaphoreValues = zeroValues.data(),
+                    .signalSemaphoreValueCount = deviceCount,
+                    .pSignalSemaphoreValues = zeroValues.data(),
+                };
+                const auto renderDeviceGroup = VkDeviceGroupSubmitInfo {
+                    .sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_SUBMIT_INFO,
+                    .pNext = &renderTimeline,
+                    .waitSemaphoreCount = deviceCount,
+                    .pWaitSemaphoreDeviceIndices = devices.data(),
+                    .commandBufferCount = 1,
+                    .pCommandBufferDeviceMasks = &info.deviceMask,
+                    .signalSemaphoreCount = deviceCount,
+                    .pSignalSemaphoreDeviceIndices = devices.data(),
+                };
+
+                // Batch 3. Frame `n` signals `n + 1`, so waiting for the value `n` waits for
+                // the previous frame, and is already satisfied for the first one.
+                auto joinWaits = joinSemaphores;
+                auto joinWaitValues = zeroValues;
+                joinWaitValues.resize(deviceCount);
+                joinWaits.push_back(info.frameTimelineSemaphore);
+                joinWaitValues.push_back(info.frameNumber);
+
+                const auto joinSignals = std::array<VkSemaphore, 2> { info.renderFinishedSemaphore, info.frameTimelineSemaphore };
+                const auto joinSignalValues = std::array<uint64_t, 2> { 0, info.frameNumber + 1 };
+                const auto joinWaitDevices = std::vector<uint32_t>(deviceCount + 1, primaryDevice);
+                const auto joinWaitStages = std::vector<VkPipelineStageFlags>(deviceCount + 1, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+                const auto joinTimeline = VkTimelineSemaphoreSubmitInfo {
+                    .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+                    .waitSemaphoreValueCount = static_cast<uint32_t>(joinWaitValues.size()),
+                    .pWaitSemaphoreValues = joinWaitValues.data(),
+                    .signalSemaphoreValueCount = static_cast<uint32_t>(joinSignalValues.size()),
+                    .pSignalSemaphoreValues = joinSignalValues.data(),
+                };
+                const auto joinDeviceGroup = VkDeviceGroupSubmitInfo {
+                    .sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_SUBMIT_INFO,
+                    .pNext = &joinTimeline,
+                    .waitSemaphoreCount = static_cast<uint32_t>(joinWaits.size()),
+                    .pWaitSemaphoreDeviceIndices = joinWaitDevices.data(),
+                    .signalSemaphoreCount = static_cast<uint32_t>(joinSignals.size()),
+                    .pSignalSemaphoreDeviceIndices = primaryDevices.data(),
+                };
+
+                const auto submitInfos = std::array<VkSubmitInfo, 3> {
+                    VkSubmitInfo {
+                        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+                        .pNext = &fanOutDeviceGroup,
+                        .waitSemaphoreCount = static_cast<uint32_t>(fanOutWaits.size()),
+                        .pWaitSemaphores = fanOutWaits.data(),
+                        .pWaitDstStageMask = allCommands.data(),
+                        .signalSemaphoreCount = deviceCount,
+                        .pSignalSemaphores = startSemaphores.data(),
+                    },
+                    VkSubmitInfo {
+                        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+                        .pNext = &renderDeviceGroup,
+                        .waitSemaphoreCount = deviceCount,
+                        .pWaitSemaphores = startSemaphores.data(),
+                        .pWaitDstStageMask = allCommands.data(),
+                        .commandBufferCount = 1,
+                        .pCommandBuffers = &info.commandBuffer,
+                        .signalSemaphoreCount = deviceCount,
+                        .pSignalSemaphores = joinSemaphores.data(),
+                    },
+                    VkSubmitInfo {
+                        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+                        .pNext = &joinDeviceGroup,
+                        .waitSemaphoreCount = static_cast<uint32_t>(joinWaits.size()),
+                        .pWaitSemaphores = joinWaits.data(),
+                        .pWaitDstStageMask = joinWaitStages.data(),
+                        .signalSemaphoreCount = static_cast<uint32_t>(joinSignals.size()),
+                        .pSignalSemaphores = joinSignals.data(),
+                    },
+                };
+
+                return vkQueueSubmit(queue, static_cast<uint32_t>(submitInfos.size()), submitInfos.data(), VK_NULL_HANDLE);
+            }
+        private:
+            std::vector<vk_handles::Semaphore> m_startSemaphores;
+            std::vector<vk_handles::Semaphore> m_joinSemaphores;
+    };
+}
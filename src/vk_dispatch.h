@@ -0,0 +1,482 @@
+#pragma once
+
+// Every Vulkan function is called through a pointer loaded here instead of through the loader's
+// exported trampolines, so this must be seen before any other include of the Vulkan headers.
+// The build defines it for the whole target.
+#ifndef VK_NO_PROTOTYPES
+#define VK_NO_PROTOTYPES
+#endif
+
+#include <vulkan/vulkan.h>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <vulkan/vulkan_win32.h>
+#else
+#include <dlfcn.h>
+#endif
+
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+
+
+// Functions exported by the loader itself, callable without an instance.
+#define VK_DISPATCH_LOADER_FUNCTIONS(X) \
+    X(vkCreateInstance) \
+    X(vkEnumerateInstanceExtensionProperties) \
+    X(vkEnumerateInstanceLayerProperties)
+
+// Functions dispatched on an instance or physical device. The debug utils, surface and display
+// functions stay null unless their extensions were enabled on the instance.
+#define VK_DISPATCH_INSTANCE_FUNCTIONS(X) \
+    X(vkDestroyInstance) \
+    X(vkEnumeratePhysicalDevices) \
+    X(vkEnumeratePhysicalDeviceGroups) \
+    X(vkEnumerateDeviceExtensionProperties) \
+    X(vkGetPhysicalDeviceFeatures) \
+    X(vkGetPhysicalDeviceFeatures2) \
+    X(vkGetPhysicalDeviceFormatProperties) \
+    X(vkGetPhysicalDeviceSparseImageFormatProperties) \
+    X(vkGetPhysicalDeviceProperties) \
+    X(vkGetPhysicalDeviceProperties2) \
+    X(vkGetPhysicalDeviceMemoryProperties) \
+    X(vkGetPhysicalDeviceMemoryProperties2) \
+    X(vkGetPhysicalDeviceImageFormatProperties2) \
+    X(vkGetPhysicalDeviceExternalSemaphoreProperties) \
+    X(vkGetPhysicalDeviceQueueFamilyProperties) \
+    X(vkGetPhysicalDeviceQueueFamilyProperties2) \
+    X(vkGetPhysicalDeviceVideoCapabilitiesKHR) \
+    X(vkGetPhysicalDeviceVideoFormatPropertiesKHR) \
+    X(vkGetPhysicalDeviceSurfaceSupportKHR) \
+    X(vkGetPhysicalDeviceSurfaceCapabilitiesKHR) \
+    X(vkGetPhysicalDeviceSurfaceCapabilities2KHR) \
+    X(vkGetPhysicalDeviceSurfaceFormatsKHR) \
+    X(vkGetPhysicalDeviceSurfacePresentModesKHR) \
+    X(vkGetPhysicalDeviceDisplayPropertiesKHR) \
+    X(vkGetPhysicalDeviceDisplayPlanePropertiesKHR) \
+    X(vkGetDisplayPlaneSupportedDisplaysKHR) \
+    X(vkGetDisplayModePropertiesKHR) \
+    X(vkGetDisplayPlaneCapabilitiesKHR) \
+    X(vkCreateDisplayPlaneSurfaceKHR) \
+    X(vkEnumeratePhysicalDeviceQueueFamilyPerformanceQueryCountersKHR) \
+    X(vkGetPhysicalDeviceQueueFamilyPerformanceQueryPassesKHR) \
+    X(vkGetPhysicalDeviceCalibrateableTimeDomainsKHR) \
+    X(vkGetPhysicalDeviceCalibrateableTimeDomainsEXT) \
+    X(vkDestroySurfaceKHR) \
+    X(vkCreateDebugUtilsMessengerEXT) \
+    X(vkDestroyDebugUtilsMessengerEXT) \
+    X(vkSetDebugUtilsObjectNameEXT) \
+    X(vkCmdBeginDebugUtilsLabelEXT) \
+    X(vkCmdEndDebugUtilsLabelEXT) \
+    X(vkCreateDevice) \
+    X(vkGetDeviceProcAddr)
+
+// The functions exporting memory and semaphores to other processes, which hand out file
+// descriptors everywhere but on Windows, where they hand out handles. Exclusive fullscreen is
+// only offered on Windows.
+#if defined(_WIN32)
+#define VK_DISPATCH_PLATFORM_DEVICE_FUNCTIONS(X) \
+    X(vkGetMemoryWin32HandleKHR) \
+    X(vkGetSemaphoreWin32HandleKHR) \
+    X(vkAcquireFullScreenExclusiveModeEXT)
+#else
+#define VK_DISPATCH_PLATFORM_DEVICE_FUNCTIONS(X) \
+    X(vkGetMemoryFdKHR) \
+    X(vkGetSemaphoreFdKHR)
+#endif
+
+// Functions dispatched on a device, queue or command buffer. The swapchain, present timing,
+// extended dynamic state 3, shader object, profiling lock, crash diagnostics, calibrated
+// timestamp, acceleration structure and export functions stay null unless their extensions
+// were enabled on the device.
+#define VK_DISPATCH_DEVICE_FUNCTIONS(X) \
+    X(vkDestroyDevice) \
+    X(vkDeviceWaitIdle) \
+    X(vkGetDeviceQueue) \
+    X(vkQueueSubmit) \
+    X(vkQueueSubmit2) \
+    X(vkQueueWaitIdle) \
+    X(vkQueueBindSparse) \
+    X(vkCreateSemaphore) \
+    X(vkDestroySemaphore) \
+    X(vkGetSemaphoreCounterValue) \
+    X(vkWaitSemaphores) \
+    X(vkCreateFence) \
+    X(vkDestroyFence) \
+    X(vkWaitForFences) \
+    X(vkResetFences) \
+    X(vkGetFenceStatus) \
+    X(vkAllocateMemory) \
+    X(vkFreeMemory) \
+    X(vkMapMemory) \
+    X(vkUnmapMemory) \
+    X(vkCreateBuffer) \
+    X(vkDestroyBuffer) \
+    X(vkBindBufferMemory) \
+    X(vkGetBufferMemoryRequirements2) \
+    X(vkGetBufferDeviceAddress) \
+    X(vkCreateImage) \
+    X(vkDestroyImage) \
+    X(vkBindImageMemory) \
+    X(vkBindImageMemory2) \
+    X(vkGetImageMemoryRequirements2) \
+    X(vkGetImageSparseMemoryRequirements2) \
+    X(vkCreateImageView) \
+    X(vkDestroyImageView) \
+    X(vkCreateSampler) \
+    X(vkDestroySampler) \
+    X(vkCreateShaderModule) \
+    X(vkDestroyShaderModule) \
+    X(vkCreateShadersEXT) \
+    X(vkDestroyShaderEXT) \
+    X(vkCreatePipelineCache) \
+    X(vkDestroyPipelineCache) \
+    X(vkGetPipelineCacheData) \
+    X(vkCreatePipelineLayout) \
+    X(vkDestroyPipelineLayout) \
+    X(vkCreateGraphicsPipelines) \
+    X(vkCreateComputePipelines) \
+    X(vkDestroyPipeline) \
+    X(vkCreateIndirectExecutionSetEXT) \
+    X(vkDestroyIndirectExecutionSetEXT) \
+    X(vkCreateIndirectCommandsLayoutEXT) \
+    X(vkDestroyIndirectCommandsLayoutEXT) \
+    X(vkGetGeneratedCommandsMemoryRequirementsEXT) \
+    X(vkCreateDescriptorSetLayout) \
+    X(vkDestroyDescriptorSetLayout) \
+    X(vkCreateDescriptorPool) \
+    X(vkDestroyDescriptorPool) \
+    X(vkAllocateDescriptorSets) \
+    X(vkResetDescriptorPool) \
+    X(vkUpdateDescriptorSets) \
+    X(vkGetDescriptorSetLayoutSizeEXT) \
+    X(vkGetDescriptorSetLayoutBindingOffsetEXT) \
+    X(vkGetDescriptorEXT) \
+    X(vkCopyMemoryToImageEXT) \
+    X(vkTransitionImageLayoutEXT) \
+    X(vkCreateQueryPool) \
+    X(vkDestroyQueryPool) \
+    X(vkGetQueryPoolResults) \
+    X(vkGetCalibratedTimestampsKHR) \
+    X(vkGetCalibratedTimestampsEXT) \
+    X(vkResetQueryPool) \
+    X(vkAcquireProfilingLockKHR) \
+    X(vkReleaseProfilingLockKHR) \
+    X(vkCreateCommandPool) \
+    X(vkDestroyCommandPool) \
+    X(vkResetCommandPool) \
+    X(vkAllocateCommandBuffers) \
+    X(vkResetCommandBuffer) \
+    X(vkBeginCommandBuffer) \
+    X(vkEndCommandBuffer) \
+    X(vkCmdBeginRendering) \
+    X(vkCmdEndRendering) \
+    X(vkCmdBindPipeline) \
+    X(vkCmdBindShadersEXT) \
+    X(vkCmdBindDescriptorSets) \
+    X(vkCmdPushConstants) \
+    X(vkCmdSetViewport) \
+    X(vkCmdSetScissor) \
+    X(vkCmdSetViewportWithCount) \
+    X(vkCmdSetScissorWithCount) \
+    X(vkCmdSetCullMode) \
+    X(vkCmdSetFrontFace) \
+    X(vkCmdSetPrimitiveTopology) \
+    X(vkCmdSetPrimitiveRestartEnable) \
+    X(vkCmdSetRasterizerDiscardEnable) \
+    X(vkCmdSetDepthTestEnable) \
+    X(vkCmdSetDepthWriteEnable) \
+    X(vkCmdSetDepthCompareOp) \
+    X(vkCmdSetDepthBiasEnable) \
+    X(vkCmdSetStencilTestEnable) \
+    X(vkCmdSetPolygonModeEXT) \
+    X(vkCmdSetRasterizationSamplesEXT) \
+    X(vkCmdSetSampleMaskEXT) \
+    X(vkCmdSetAlphaToCoverageEnableEXT) \
+    X(vkCmdSetVertexInputEXT) \
+    X(vkCmdSetColorBlendEnableEXT) \
+    X(vkCmdSetColorBlendEquationEXT) \
+    X(vkCmdSetColorWriteMaskEXT) \
+    X(vkCmdBindVertexBuffers) \
+    X(vkCmdBindIndexBuffer) \
+    X(vkCmdDraw) \
+    X(vkCmdDrawIndexed) \
+    X(vkCmdDrawIndirect) \
+    X(vkCmdDrawIndexedIndirect) \
+    X(vkCmdDrawIndexedIndirectCount) \
+    X(vkCmdDispatch) \
+    X(vkCmdFillBuffer) \
+    X(vkCmdClearAttachments) \
+    X(vkCmdClearColorImage) \
+    X(vkCmdCopyBuffer) \
+    X(vkCmdCopyBufferToImage) \
+    X(vkCmdCopyImageToBuffer) \
+    X(vkCmdBlitImage2) \
+    X(vkCmdExecuteCommands) \
+    X(vkCmdPipelineBarrier) \
+    X(vkCmdPipelineBarrier2) \
+    X(vkCmdResetQueryPool) \
+    X(vkCmdBeginQuery) \
+    X(vkCmdEndQuery) \
+    X(vkCmdWriteTimestamp2) \
+    X(vkCreateSwapchainKHR) \
+    X(vkDestroySwapchainKHR) \
+    X(vkGetSwapchainImagesKHR) \
+    X(vkAcquireNextImageKHR) \
+    X(vkAcquireNextImage2KHR) \
+    X(vkGetDeviceGroupPresentCapabilitiesKHR) \
+    X(vkGetDeviceGroupSurfacePresentModesKHR) \
+    X(vkGetDeviceGroupPeerMemoryFeatures) \
+    X(vkQueuePresentKHR) \
+    X(vkWaitForPresentKHR) \
+    X(vkGetRefreshCycleDurationGOOGLE) \
+    X(vkGetPastPresentationTimingGOOGLE) \
+    X(vkSetLatencySleepModeNV) \
+    X(vkLatencySleepNV) \
+    X(vkSetLatencyMarkerNV) \
+    X(vkCmdDrawMeshTasksIndirectEXT) \
+    X(vkCmdExecuteGeneratedCommandsEXT) \
+    X(vkCmdBindDescriptorBuffersEXT) \
+    X(vkCmdSetDescriptorBufferOffsetsEXT) \
+    X(vkCmdPushDescriptorSetKHR) \
+    X(vkCmdSetFragmentShadingRateKHR) \
+    X(vkGetMemoryHostPointerPropertiesEXT) \
+    X(vkCmdWriteBufferMarkerAMD) \
+    X(vkCmdSetCheckpointNV) \
+    X(vkGetQueueCheckpointDataNV) \
+    X(vkGetDeviceFaultInfoEXT) \
+    X(vkCreateVideoSessionKHR) \
+    X(vkDestroyVideoSessionKHR) \
+    X(vkGetVideoSessionMemoryRequirementsKHR) \
+    X(vkBindVideoSessionMemoryKHR) \
+    X(vkCreateVideoSessionParametersKHR) \
+    X(vkDestroyVideoSessionParametersKHR) \
+    X(vkGetEncodedVideoSessionParametersKHR) \
+    X(vkCmdBeginVideoCodingKHR) \
+    X(vkCmdEndVideoCodingKHR) \
+    X(vkCmdControlVideoCodingKHR) \
+    X(vkCmdEncodeVideoKHR) \
+    X(vkCreateAccelerationStructureKHR) \
+    X(vkDestroyAccelerationStructureKHR) \
+    X(vkGetAccelerationStructureBuildSizesKHR) \
+    X(vkGetAccelerationStructureDeviceAddressKHR) \
+    X(vkCmdBuildAccelerationStructuresKHR) \
+    X(vkCmdCopyAccelerationStructureKHR) \
+    X(vkCmdWriteAccelerationStructuresPropertiesKHR) \
+    VK_DISPATCH_PLATFORM_DEVICE_FUNCTIONS(X)
+
+// The pointers live in the global namespace under the names of the prototypes they replace, so
+// call sites read the same as with the loader's exports.
+#define VK_DISPATCH_DEFINE_FUNCTION(name) inline PFN_##name name = nullptr;
+
+inline PFN_vkGetInstanceProcAddr vkGetInstanceProcAddr = nullptr;
+VK_DISPATCH_LOADER_FUNCTIONS(VK_DISPATCH_DEFINE_FUNCTION)
+VK_DISPATCH_INSTANCE_FUNCTIONS(VK_DISPATCH_DEFINE_FUNCTION)
+VK_DISPATCH_DEVICE_FUNCTIONS(VK_DISPATCH_DEFINE_FUNCTION)
+
+#undef VK_DISPATCH_DEFINE_FUNCTION
+
+
+namespace vk_dispatch {
+#if defined(_WIN32)
+    using LibraryHandle = HMODULE;
+#else
+    using LibraryHandle = void*;
+#endif
+
+    // The calls the calling thread made through the table under `DispatchHooks`.
+    inline uint64_t& threadCallCount() {
+        thread_local auto count = uint64_t { 0 };
+
+        return count;
+    }
+
+    // What the hooks do with the calls of a thread.
+    //
+    // * `Off`, which every thread starts in, forwards the call to the driver.
+    // * `Count` counts the call and forwards it to the driver.
+    // * `Mock` counts the call and succeeds without reaching the driver, leaving every output
+    //   untouched, so what is measured is the caller's own work.
+    enum class HookMode {
+        Off,
+        Count,
+        Mock,
+    };
+
+    inline HookMode& threadHookMode() {
+        thread_local auto mode = HookMode::Off;
+
+        return mode;
+    }
+
+    namespace detail {
+        inline bool& hooksEnabled() {
+            static auto enabled = false;
+
+            return enabled;
+        }
+
+        // Stands in for the function behind the pointer at `Slot`, which it keeps in `next`.
+        template <auto* Slot, typename Function = std::remove_reference_t<decltype(*Slot)>>
+        struct Hook;
+
+        template <auto* Slot, typename Result, typename... Args>
+        struct Hook<Slot, Result (VKAPI_PTR*)(Args...)> {
+            using Function = Result (VKAPI_PTR*)(Args...);
+
+            static inline Function next = nullptr;
+
+            static Result VKAPI_PTR call(Args... args) {
+                const auto mode = threadHookMode();
+                if (mode != HookMode::Off) {
+                    threadCallCount()++;
+                }
+
+                if (mode == HookMode::Mock) {
+                    if constexpr (std::is_same_v<Result, VkResult>) {
+                        return VK_SUCCESS;
+                    } else if constexpr (!std::is_void_v<Result>) {
+                        return Result {};
+                    } else {
+                        return;
+                    }
+                }
+
+                return next(args...);
+            }
+
+            // What the table stores for `function`. Functions that were not loaded stay null, so
+            // callers take the same paths with the hooks as without.
+            static Function wrap(Function function) {
+                if (!hooksEnabled() || function == nullptr) {
+                    return function;
+                }
+
+                next = function;
+
+                return &Hook::call;
+            }
+        };
+    }
+
+    // Puts a hook in front of every function the table loads from then on, for `DispatchHooks`
+    // to count driver calls with, or to run without a driver. Only for the microbenchmarks, as
+    // every call then costs an extra jump, so it must come before `loadLoader`.
+    inline void enableHooks() {
+        detail::hooksEnabled() = true;
+    }
+
+    inline LibraryHandle& loaderLibrary() {
+        static auto library = LibraryHandle {};
+
+        return library;
+    }
+
+    // Open the Vulkan loader at runtime and fetch `vkGetInstanceProcAddr` from it, so the
+    // executable does not link against the loader at all.
+    inline void loadLoader() {
+        auto& library = loaderLibrary();
+        if (library != nullptr) {
+            return;
+        }
+
+#if defined(_WIN32)
+        const auto libraryNames = std::array { "vulkan-1.dll" };
+#elif defined(__APPLE__)
+        const auto libraryNames = std::array { "libvulkan.dylib", "libvulkan.1.dylib", "libMoltenVK.dylib" };
+#else
+        const auto libraryNames = std::array { "libvulkan.so.1", "libvulkan.so" };
+#endif
+
+        for (const auto libraryName : libraryNames) {
+#if defined(_WIN32)
+            library = LoadLibraryA(libraryName);
+#else
+            library = dlopen(libraryName, RTLD_NOW | RTLD_LOCAL);
+#endif
+            if (library != nullptr) {
+                break;
+            }
+        }
+
+        if (library == nullptr) {
+            throw std::runtime_error("failed to load the Vulkan loader!");
+        }
+
+#if defined(_WIN32)
+        vkGetInstanceProcAddr = reinterpret_cast<PFN_vkGetInstanceProcAddr>(
+            reinterpret_cast<void*>(GetProcAddress(library, "vkGetInstanceProcAddr"))
+        );
+#else
+        vkGetInstanceProcAddr = reinterpret_cast<PFN_vkGetInstanceProcAddr>(dlsym(library, "vkGetInstanceProcAddr"));
+#endif
+        if (vkGetInstanceProcAddr == nullptr) {
+            throw std::runtime_error("failed to find vkGetInstanceProcAddr in the Vulkan loader!");
+        }
+
+#define VK_DISPATCH_LOAD_FUNCTION(name) name = detail::Hook<&::name>::wrap(reinterpret_cast<PFN_##name>(vkGetInstanceProcAddr(VK_NULL_HANDLE, #name)));
+        VK_DISPATCH_LOADER_FUNCTIONS(VK_DISPATCH_LOAD_FUNCTION)
+#undef VK_DISPATCH_LOAD_FUNCTION
+    }
+
+    // Fetch the instance level functions once the instance exists.
+    inline void loadInstance(VkInstance instance) {
+#define VK_DISPATCH_LOAD_FUNCTION(name) name = detail::Hook<&::name>::wrap(reinterpret_cast<PFN_##name>(vkGetInstanceProcAddr(instance, #name)));
+        VK_DISPATCH_INSTANCE_FUNCTIONS(VK_DISPATCH_LOAD_FUNCTION)
+#undef VK_DISPATCH_LOAD_FUNCTION
+    }
+
+    // Fetch the device level functions straight from the driver, which skips the loader's
+    // dispatch on every call. The renderer has one device, so the table is global.
+    inline void loadDevice(VkDevice device) {
+#define VK_DISPATCH_LOAD_FUNCTION(name) name = detail::Hook<&::name>::wrap(reinterpret_cast<PFN_##name>(vkGetDeviceProcAddr(device, #name)));
+        VK_DISPATCH_DEVICE_FUNCTIONS(VK_DISPATCH_LOAD_FUNCTION)
+#undef VK_DISPATCH_LOAD_FUNCTION
+    }
+
+    // Only once nothing, GLFW included, calls into Vulkan anymore.
+    inline void unloadLoader() {
+        auto& library = loaderLibrary();
+        if (library == nullptr) {
+            return;
+        }
+
+#if defined(_WIN32)
+        FreeLibrary(library);
+#else
+        dlclose(library);
+#endif
+        library = nullptr;
+        vkGetInstanceProcAddr = nullptr;
+    }
+
+    // Switches the hooks of the calling thread to `mode` and back when destroyed. The table
+    // itself is never rewritten, so the other threads keep calling the driver as before.
+    class DispatchHooks {
+        public:
+            explicit DispatchHooks(HookMode mode) : m_previous(threadHookMode()) {
+                if (!detail::hooksEnabled()) {
+                    throw std::runtime_error("dispatch hooks were not enabled before loading the table!");
+                }
+
+                threadHookMode() = mode;
+            }
+
+            ~DispatchHooks() {
+                threadHookMode() = m_previous;
+            }
+
+            DispatchHooks(const DispatchHooks& other) = delete;
+            DispatchHooks& operator=(const DispatchHooks& other) = delete;
+        private:
+            const HookMode m_previous;
+    };
+}
@@ -0,0 +1,188 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <fmt/core.h>
+
+
+namespace vk_display {
+    // A display plane to present to, without a window system in between. Found with
+    // `findDisplay`, and turned into a surface with `surfaceCreateInfo`.
+    struct DisplayTarget {
+        VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+        VkDisplayKHR display = VK_NULL_HANDLE;
+        std::string name;
+        VkDisplayModeKHR mode = VK_NULL_HANDLE;
+        VkExtent2D extent {};
+        // In millihertz.
+        uint32_t refreshRate = 0;
+        uint32_t planeIndex = 0;
+        uint32_t planeStackIndex = 0;
+        VkDisplayPlaneAlphaFlagBitsKHR alphaMode = VK_DISPLAY_PLANE_ALPHA_OPAQUE_BIT_KHR;
+        VkSurfaceTransformFlagBitsKHR transform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
+    };
+
+    // The display's native resolution at the highest refresh rate it offers there. A display
+    // that reports no native mode gets its largest one.
+    inline std::optional<VkDisplayModePropertiesKHR> selectDisplayMode(
+        const VkDisplayPropertiesKHR& display,
+        const std::vector<VkDisplayModePropertiesKHR>& modes
+    ) {
+        auto selected = std::optional<VkDisplayModePropertiesKHR> {};
+        const auto rank = [&display](const VkDisplayModeParametersKHR& parameters) {
+            const auto extent = parameters.visibleRegion;
+            const bool native = extent.width == display.physicalResolution.width && extent.height == display.physicalResolution.height;
+
+            return std::tuple { native, uint64_t { extent.width } * extent.height, parameters.refreshRate };
+        };
+
+        for (const auto& mode : modes) {
+            if (!selected.has_value() || rank(mode.parameters) > rank(selected->parameters)) {
+                selected = mode;
+            }
+        }
+
+        return selected;
+    }
+
+    // Opaque scanout if the plane can, since nothing is composited below it anyway.
+    inline std::optional<VkDisplayPlaneAlphaFlagBitsKHR> selectAlphaMode(VkDisplayPlaneAlphaFlagsKHR supportedAlpha) {
+        for (const auto alphaMode : {
+            VK_DISPLAY_PLANE_ALPHA_OPAQUE_BIT_KHR,
+            VK_DISPLAY_PLANE_ALPHA_GLOBAL_BIT_KHR,
+            VK_DISPLAY_PLANE_ALPHA_PER_PIXEL_BIT_KHR,
+            VK_DISPLAY_PLANE_ALPHA_PER_PIXEL_PREMULTIPLIED_BIT_KHR,
+        }) {
+            if ((supportedAlpha & alphaMode) != 0) {
+                return alphaMode;
+            }
+        }
+
+        return std::nullopt;
+    }
+
+    inline std::vector<VkDisplayPropertiesKHR> getDisplays(VkPhysicalDevice physicalDevice) {
+        uint32_t displayCount = 0;
+        vkGetPhysicalDeviceDisplayPropertiesKHR(physicalDevice, &displayCount, nullptr);
+        auto displays = std::vector<VkDisplayPropertiesKHR>(displayCount);
+        vkGetPhysicalDeviceDisplayPropertiesKHR(physicalDevice, &displayCount, displays.data());
+        displays.resize(displayCount);
+
+        return displays;
+    }
+
+    // The first plane that can show `display`, is not showing another display already, and
+    // can scan out the whole mode.
+    inline bool selectPlane(VkPhysicalDevice physicalDevice, VkDisplayKHR display, DisplayTarget& target) {
+        uint32_t planeCount = 0;
+        vkGetPhysicalDeviceDisplayPlanePropertiesKHR(physicalDevice, &planeCount, nullptr);
+        auto planes = std::vector<VkDisplayPlanePropertiesKHR>(planeCount);
+        vkGetPhysicalDeviceDisplayPlanePropertiesKHR(physicalDevice, &planeCount, planes.data());
+        planes.resize(planeCount);
+
+        for (uint32_t planeIndex = 0; planeIndex < planes.size(); planeIndex++) {
+            const auto& plane = planes[planeIndex];
+            if (plane.currentDisplay != VK_NULL_HANDLE && plane.currentDisplay != display) {
+                continue;
+            }
+
+            uint32_t supportedCount = 0;
+            vkGetDisplayPlaneSupportedDisplaysKHR(physicalDevice, planeIndex, &supportedCount, nullptr);
+            auto supportedDisplays = std::vector<VkDisplayKHR>(supportedCount);
+            vkGetDisplayPlaneSupportedDisplaysKHR(physicalDevice, planeIndex, &supportedCount, supportedDisplays.data());
+            supportedDisplays.resize(supportedCount);
+            if (std::find(supportedDisplays.begin(), supportedDisplays.end(), display) == supportedDisplays.end()) {
+                continue;
+            }
+
+            auto capabilities = VkDisplayPlaneCapabilitiesKHR {};
+            vkGetDisplayPlaneCapabilitiesKHR(physicalDevice, target.mode, planeIndex, &capabilities);
+            const auto alphaMode = selectAlphaMode(capabilities.supportedAlpha);
+            if (!alphaMode.has_value()
+                || capabilities.maxDstExtent.width < target.extent.width
+                || capabilities.maxDstExtent.height < target.extent.height) {
+                continue;
+            }
+
+            target.planeIndex = planeIndex;
+            target.planeStackIndex = plane.currentStackIndex;
+            target.alphaMode = alphaMode.value();
+
+            return true;
+        }
+
+        return false;
+    }
+
+    // The display `displayIndex`, counting the displays of every physical device in the order
+    // they are enumerated, in its selected mode, on a plane that can show it. The display has
+    // to be free: a display a compositor or X server holds is not reported at all, so this is
+    // meant for a session on a bare virtual terminal.
+    inline DisplayTarget findDisplay(VkInstance instance, uint32_t displayIndex) {
+        uint32_t deviceCount = 0;
+        vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
+        auto physicalDevices = std::vector<VkPhysicalDevice>(deviceCount);
+        vkEnumeratePhysicalDevices(instance, &deviceCount, physicalDevices.data());
+        physicalDevices.resize(deviceCount);
+
+        uint32_t index = 0;
+        for (const auto physicalDevice : physicalDevices) {
+            for (const auto& display : getDisplays(physicalDevice)) {
+                if (index++ != displayIndex) {
+                    continue;
+                }
+
+                uint32_t modeCount = 0;
+                vkGetDisplayModePropertiesKHR(physicalDevice, display.display, &modeCount, nullptr);
+                auto modes = std::vector<VkDisplayModePropertiesKHR>(modeCount);
+                vkGetDisplayModePropertiesKHR(physicalDevice, display.display, &modeCount, modes.data());
+                modes.resize(modeCount);
+
+                const auto mode = selectDisplayMode(display, modes);
+                if (!mode.has_value()) {
+                    throw std::runtime_error("failed to find a mode for the display!");
+                }
+
+                auto target = DisplayTarget {
+                    .physicalDevice = physicalDevice,
+                    .display = display.display,
+                    .name = display.displayName != nullptr ? std::string { display.displayName } : fmt::format("display {}", displayIndex),
+                    .mode = mode->displayMode,
+                    .extent = mode->parameters.visibleRegion,
+                    .refreshRate = mode->parameters.refreshRate,
+                };
+                if ((display.supportedTransforms & VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR) == 0) {
+                    target.transform = static_cast<VkSurfaceTransformFlagBitsKHR>(display.supportedTransforms & ~(display.supportedTransforms - 1));
+                }
+                if (!selectPlane(physicalDevice, display.display, target)) {
+                    throw std::runtime_error("failed to find a display plane that can show the display!");
+                }
+
+                return target;
+            }
+        }
+
+        throw std::runtime_error(fmt::format("failed to find display {}, only {} are available!", displayIndex, index));
+    }
+
+    inline VkDisplaySurfaceCreateInfoKHR surfaceCreateInfo(const DisplayTarget& target) {
+        return VkDisplaySurfaceCreateInfoKHR {
+            .sType = VK_STRUCTURE_TYPE_DISPLAY_SURFACE_CREATE_INFO_KHR,
+            .displayMode = target.mode,
+            .planeIndex = target.planeIndex,
+            .planeStackIndex = target.planeStackIndex,
+            .transform = target.transform,
+            .globalAlpha = 1.0f,
+            .alphaMode = target.alphaMode,
+            .imageExtent = target.extent,
+        };
+    }
+}
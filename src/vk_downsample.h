@@ -0,0 +1,275 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+
+#include "vk_compute.h"
+#include "vk_descriptors.h"
+#include "vk_pipelines.h"
+#include "vk_shaders.h"
+
+
+namespace vk_downsample {
+    // Matches `MAX_LEVELS` and `TILE_SIZE` in `downsample.glsl`. A workgroup reduces a tile of
+    // level 0 through six levels below it, and the last one those texels through six more, so
+    // level 0 can be at most `MAX_EXTENT` a side.
+    constexpr uint32_t MAX_LEVELS = 13;
+    constexpr uint32_t TILE_SIZE = 64;
+    constexpr uint32_t MAX_EXTENT = 1u << (MAX_LEVELS - 1);
+
+    // Matches `local_size_x` in `downsample.glsl`.
+    constexpr uint32_t WORKGROUP_SIZE = 256;
+
+    // The specialization constant id of the reduction in `downsample.glsl`.
+    constexpr uint32_t REDUCTION_ID = 0;
+
+    // How the texels a texel covers are combined: the farthest depth for a depth pyramid, which
+    // is the smallest with reversed depth, or their average for a mip chain.
+    enum class Reduction : uint32_t {
+        Max,
+        Average,
+        Min,
+    };
+
+    // Matches `PushConstants` in `downsample.glsl`.
+    struct PushConstants {
+        std::array<uint32_t, 2> sourceSize;
+        std::array<uint32_t, 2> levelSize;
+        uint32_t levelCount;
+    };
+
+    // Matches `Scratch` in `downsample.glsl`, before the texels of the tiles.
+    struct Scratch {
+        uint32_t finishedWorkgroups;
+        uint32_t padding[3];
+    };
+
+    // The levels of a chain whose level 0 is `extent`, down to a single texel.
+    inline uint32_t levelCount(VkExtent2D extent) {
+        return static_cast<uint32_t>(std::bit_width(std::max({ extent.width, extent.height, 1u })));
+    }
+
+    // The workgroups, a tile of level 0 each, which leave a texel each in the scratch buffer.
+    inline VkExtent2D tileCount(VkExtent2D extent) {
+        return VkExtent2D {
+            (std::max(extent.width, 1u) + TILE_SIZE - 1) / TILE_SIZE,
+            (std::max(extent.height, 1u) + TILE_SIZE - 1) / TILE_SIZE,
+        };
+    }
+
+    // The size of the scratch buffer of a chain whose level 0 is `extent`, which has to be
+    // zeroed before its first dispatch, and is left zeroed by every dispatch after.
+    inline VkDeviceSize scratchSize(VkExtent2D extent) {
+        const auto tiles = tileCount(extent);
+
+        return sizeof(Scratch) + VkDeviceSize { tiles.width } * tiles.height * sizeof(float);
+    }
+
+    // Builds every level of a single channel, 32 bit float image in one dispatch, instead of a
+    // dispatch and a barrier per level, in the manner of AMD's single pass downsampler.
+    //
+    // Level 0 is reduced from a sampled source of any size, and every level after it halves the
+    // one before, so level 0 has to be a power of two a side, at most `MAX_EXTENT`. Each
+    // workgroup reduces a tile of level 0 down to a single texel in registers and shared
+    // memory, swapping texels within subgroup quads where the device can. The last workgroup
+    // to finish, which it finds out from an atomic counter in a scratch buffer, reduces those
+    // texels through the remaining levels. Dispatches that share a scratch buffer have to be
+    // ordered by a barrier on compute shader storage writes.
+    class SinglePassDownsampler {
+        public:
+            explicit SinglePassDownsampler() = default;
+
+            SinglePassDownsampler(const SinglePassDownsampler& other) = delete;
+            SinglePassDownsampler& operator=(const SinglePassDownsampler& other) = delete;
+
+            // The pipeline comes from `pipelineRegistry`, which keeps it, and the set layout
+            // from `layoutCache`.
+            void init(
+                VkDevice device,
+                vk_descriptors::DescriptorLayoutCache& layoutCache,
+                vk_shaders::ShaderLibrary& shaderLibrary,
+                vk_pipelines::PipelineRegistry& pipelineRegistry,
+                const vk_compute::ComputeTuning& computeTuning,
+                const VkAllocationCallbacks* allocator,
+                Reduction reduction
+            ) {
+                m_device = device;
+                m_allocator = allocator;
+
+                const auto bindings = std::array {
+                    VkDescriptorSetLayoutBinding {
+                        .binding = 0,
+                        .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                        .descriptorCount = 1,
+                        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                    },
+                    VkDescriptorSetLayoutBinding {
+                        .binding = 1,
+                        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                        .descriptorCount = MAX_LEVELS,
+                        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                    },
+                    VkDescriptorSetLayoutBinding {
+                        .binding = 2,
+                        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                        .descriptorCount = 1,
+                        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                    },
+                };
+                m_setLayout = layoutCache.layout(bindings);
+
+                const auto pushConstantRange = VkPushConstantRange {
+                    .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                    .offset = 0,
+                    .size = sizeof(PushConstants),
+                };
+                const auto pipelineLayoutInfo = VkPipelineLayoutCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+                    .setLayoutCount = 1,
+                    .pSetLayouts = &m_setLayout,
+                    .pushConstantRangeCount = 1,
+                    .pPushConstantRanges = &pushConstantRange,
+                };
+
+                const auto pipelineLayoutResult = vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, m_allocator, &m_pipelineLayout);
+                if (pipelineLayoutResult != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create downsample pipeline layout!");
+                }
+
+                this->createPipeline(shaderLibrary, pipelineRegistry, computeTuning, reduction);
+            }
+
+            // The set layout belongs to the layout cache.
+            void destroy() {
+                if (m_device == VK_NULL_HANDLE) {
+                    return;
+                }
+
+                vkDestroyPipelineLayout(m_device, m_pipelineLayout, m_allocator);
+                m_pipelineLayout = VK_NULL_HANDLE;
+                m_pipeline = VK_NULL_HANDLE;
+                m_setLayout = VK_NULL_HANDLE;
+                m_device = VK_NULL_HANDLE;
+            }
+
+            bool isInitialized() const {
+                return m_device != VK_NULL_HANDLE;
+            }
+
+            VkDescriptorSetLayout setLayout() const {
+                return m_setLayout;
+            }
+
+            // Points `set` at `source`, sampled through `sampler` in `sourceLayout`, at the
+            // views of single levels in `levels`, in the general layout, and at `scratch`. The
+            // bindings past the last level repeat it, and are never written.
+            void writeSet(
+                VkDescriptorSet set,
+                VkSampler sampler,
+                VkImageView source,
+                VkImageLayout sourceLayout,
+                std::span<const VkImageView> levels,
+                VkBuffer scratch
+            ) const {
+                if (levels.empty() || levels.size() > MAX_LEVELS) {
+                    throw std::runtime_error("failed to write downsample descriptors, unsupported level count!");
+                }
+
+                const auto sourceInfo = VkDescriptorImageInfo { sampler, source, sourceLayout };
+                auto levelInfos = std::array<VkDescriptorImageInfo, MAX_LEVELS> {};
+                for (uint32_t level = 0; level < MAX_LEVELS; level++) {
+                    levelInfos[level] = VkDescriptorImageInfo { VK_NULL_HANDLE, levels[std::min<size_t>(level, levels.size() - 1)], VK_IMAGE_LAYOUT_GENERAL };
+                }
+                const auto scratchInfo = VkDescriptorBufferInfo { scratch, 0, VK_WHOLE_SIZE };
+                const auto writes = std::array {
+                    VkWriteDescriptorSet {
+                        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                        .dstSet = set,
+                        .dstBinding = 0,
+                        .descriptorCount = 1,
+                        .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                        .pImageInfo = &sourceInfo,
+                    },
+                    VkWriteDescriptorSet {
+                        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                        .dstSet = set,
+                        .dstBinding = 1,
+                        .descriptorCount = MAX_LEVELS,
+                        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                        .pImageInfo = levelInfos.data(),
+                    },
+                    VkWriteDescriptorSet {
+                        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                        .dstSet = set,
+                        .dstBinding = 2,
+                        .descriptorCount = 1,
+                        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                        .pBufferInfo = &scratchInfo,
+                    },
+                };
+                vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+            }
+
+            // Builds `levelCount` levels from level 0 of `levelSize`, reduced from `sourceSize`
+            // of the source, with the images and scratch `set` points at.
+            void record(VkCommandBuffer commandBuffer, VkDescriptorSet set, VkExtent2D sourceSize, VkExtent2D levelSize, uint32_t levelCount) const {
+                if (levelCount == 0 || levelCount > MAX_LEVELS || std::max(levelSize.width, levelSize.height) > MAX_EXTENT) {
+                    throw std::runtime_error("failed to record downsample, too many levels!");
+                }
+
+                const auto pushConstants = PushConstants {
+                    .sourceSize = { std::max(sourceSize.width, 1u), std::max(sourceSize.height, 1u) },
+                    .levelSize = { levelSize.width, levelSize.height },
+                    .levelCount = levelCount,
+                };
+                const auto tiles = tileCount(levelSize);
+
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+                vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &set, 0, nullptr);
+                vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+                vkCmdDispatch(commandBuffer, tiles.width, tiles.height, 1);
+            }
+        private:
+            VkDevice m_device = VK_NULL_HANDLE;
+            const VkAllocationCallbacks* m_allocator = nullptr;
+            VkDescriptorSetLayout m_setLayout = VK_NULL_HANDLE;
+            VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+            VkPipeline m_pipeline = VK_NULL_HANDLE;
+
+            // The subgroup variant needs quads, which not every device has in compute, so it is
+            // a module of its own. Its quads are only 2x2 blocks in full subgroups, whose size it
+            // runs in when it is pinned.
+            void createPipeline(
+                vk_shaders::ShaderLibrary& shaderLibrary,
+                vk_pipelines::PipelineRegistry& pipelineRegistry,
+                const vk_compute::ComputeTuning& computeTuning,
+                Reduction reduction
+            ) {
+                auto constants = vk_pipelines::SpecializationConstants {};
+                constants.set(REDUCTION_ID, static_cast<uint32_t>(reduction));
+                const bool quads = computeTuning.subgroupQuads;
+                auto requiredSize = VkPipelineShaderStageRequiredSubgroupSizeCreateInfo {};
+                const auto pipelineInfo = VkComputePipelineCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+                    .stage = VkPipelineShaderStageCreateInfo {
+                        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                        .pNext = quads ? vk_compute::requiredSubgroupSize(computeTuning, requiredSize) : nullptr,
+                        .flags = quads ? VkPipelineShaderStageCreateFlags { VK_PIPELINE_SHADER_STAGE_CREATE_REQUIRE_FULL_SUBGROUPS_BIT } : VkPipelineShaderStageCreateFlags { 0 },
+                        .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                        .module = shaderLibrary.shaderModule(quads ? "downsample_subgroup.comp" : "downsample.comp"),
+                        .pName = "main",
+                        .pSpecializationInfo = constants.info(),
+                    },
+                    .layout = m_pipelineLayout,
+                };
+
+                m_pipeline = pipelineRegistry.computePipeline(pipelineInfo);
+            }
+    };
+}
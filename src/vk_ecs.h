@@ -0,0 +1,475 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "vk_jobs.h"
+
+
+namespace vk_ecs {
+    // Every chunk is this large, which keeps the arrays of a chunk in the L1 and L2 caches
+    // while a system walks them.
+    constexpr size_t CHUNK_SIZE = 16 * 1024;
+    // The arrays of a chunk start on a cache line.
+    constexpr size_t COLUMN_ALIGNMENT = 64;
+    // A signature is a bitmask of component ids.
+    constexpr uint32_t MAX_COMPONENT_TYPES = 64;
+    constexpr uint32_t INVALID_INDEX = 0xFFFFFFFF;
+
+    using Signature = uint64_t;
+
+    // An entity's index is reused once it is destroyed, under a new generation, so a stale
+    // entity never aliases the one that took its place.
+    struct Entity {
+        uint32_t index = INVALID_INDEX;
+        uint32_t generation = 0;
+
+        bool operator==(const Entity& other) const = default;
+    };
+
+    namespace detail {
+        inline uint32_t nextComponentId() {
+            static auto next = std::atomic<uint32_t> { 0 };
+
+            return next.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Components are plain data, copied between chunks with `memcpy`, and identified by an
+    // id handed out the first time a type is used.
+    template <typename T>
+    uint32_t componentId() {
+        static_assert(std::is_trivially_copyable_v<T> && std::is_trivially_destructible_v<T>, "components must be plain data");
+        static const auto id = detail::nextComponentId();
+        if (id >= MAX_COMPONENT_TYPES) {
+            throw std::runtime_error("failed to register component, too many component types!");
+        }
+
+        return id;
+    }
+
+    template <typename... Components>
+    Signature signatureOf() {
+        return (Signature { 0 } | ... | (Signature { 1 } << componentId<Components>()));
+    }
+
+    struct ComponentInfo {
+        size_t size = 0;
+        size_t alignment = 0;
+    };
+
+    // The entities of one signature, in chunks of `CHUNK_SIZE` bytes. A chunk holds the
+    // entities followed by one array per component, in the order of the component ids, each as
+    // long as the chunk's capacity, so a system reads every component it needs contiguously.
+    // Entities are kept packed: only the last chunk may have room, and removing an entity moves
+    // the archetype's last one into its place.
+    class Archetype {
+        public:
+            struct Location {
+                uint32_t chunk;
+                uint32_t slot;
+            };
+
+            explicit Archetype(Signature signature, const std::array<ComponentInfo, MAX_COMPONENT_TYPES>& components)
+                : m_signature { signature }
+            {
+                m_columnOf.fill(INVALID_INDEX);
+
+                auto bytesPerEntity = sizeof(Entity);
+                for (auto bits = signature; bits != 0; bits &= bits - 1) {
+                    const auto id = static_cast<uint32_t>(std::countr_zero(bits));
+                    m_columnOf[id] = static_cast<uint32_t>(m_columns.size());
+                    m_columns.push_back(Column { .size = components[id].size });
+                    bytesPerEntity += components[id].size;
+                }
+
+                // Every array may need up to a cache line of padding.
+                const auto padding = COLUMN_ALIGNMENT * (m_columns.size() + 1);
+                m_capacity = static_cast<uint32_t>((CHUNK_SIZE - padding) / bytesPerEntity);
+                if (m_capacity == 0) {
+                    throw std::runtime_error("failed to create archetype, its components do not fit a chunk!");
+                }
+
+                auto offset = alignUp(sizeof(Entity) * m_capacity);
+                for (auto& column : m_columns) {
+                    column.offset = offset;
+                    offset = alignUp(offset + column.size * m_capacity);
+                }
+            }
+
+            Archetype(const Archetype& other) = delete;
+            Archetype& operator=(const Archetype& other) = delete;
+
+            Signature signature() const {
+                return m_signature;
+            }
+
+            uint32_t capacity() const {
+                return m_capacity;
+            }
+
+            size_t chunkCount() const {
+                return m_chunks.size();
+            }
+
+            uint32_t count(size_t chunk) const {
+                return m_counts[chunk];
+            }
+
+            Entity* entities(size_t chunk) const {
+                return reinterpret_cast<Entity*>(m_chunks[chunk]->bytes);
+            }
+
+            bool hasComponent(uint32_t id) const {
+                return m_columnOf[id] != INVALID_INDEX;
+            }
+
+            // The array of component `id` in a chunk, which the archetype must have.
+            std::byte* column(size_t chunk, uint32_t id) const {
+                return m_chunks[chunk]->bytes + m_columns[m_columnOf[id]].offset;
+            }
+
+            std::byte* component(Location location, uint32_t id) const {
+                return this->column(location.chunk, id) + m_columns[m_columnOf[id]].size * location.slot;
+            }
+
+            size_t componentSize(uint32_t id) const {
+                return m_columns[m_columnOf[id]].size;
+            }
+
+            // Appends an entity whose components are left for the caller to write.
+            Location append(Entity entity) {
+                if (m_chunks.empty() || m_counts.back() == m_capacity) {
+                    m_chunks.push_back(std::make_unique<Chunk>());
+                    m_counts.push_back(0);
+                }
+
+                const auto location = Location {
+                    .chunk = static_cast<uint32_t>(m_chunks.size() - 1),
+                    .slot = m_counts.back()++,
+                };
+                this->entities(location.chunk)[location.slot] = entity;
+
+                return location;
+            }
+
+            // Removes the entity at `location` by moving the last entity into its place, and
+            // returns the moved entity, or an invalid one when the removed entity was the last.
+            Entity remove(Location location) {
+                const auto last = Location {
+                    .chunk = static_cast<uint32_t>(m_chunks.size() - 1),
+                    .slot = m_counts.back() - 1,
+                };
+
+                auto moved = Entity {};
+                if (last.chunk != location.chunk || last.slot != location.slot) {
+                    moved = this->entities(last.chunk)[last.slot];
+                    this->entities(location.chunk)[location.slot] = moved;
+                    for (const auto& column : m_columns) {
+                        std::memcpy(
+                            m_chunks[location.chunk]->bytes + column.offset + column.size * location.slot,
+                            m_chunks[last.chunk]->bytes + column.offset + column.size * last.slot,
+                            column.size
+                        );
+                    }
+                }
+
+                if (--m_counts.back() == 0) {
+                    m_chunks.pop_back();
+                    m_counts.pop_back();
+                }
+
+                return moved;
+            }
+
+            void clear() {
+                m_chunks.clear();
+                m_counts.clear();
+            }
+        private:
+            struct alignas(COLUMN_ALIGNMENT) Chunk {
+                std::byte bytes[CHUNK_SIZE];
+            };
+
+            struct Column {
+                size_t size = 0;
+                size_t offset = 0;
+            };
+
+            static size_t alignUp(size_t offset) {
+                return (offset + COLUMN_ALIGNMENT - 1) / COLUMN_ALIGNMENT * COLUMN_ALIGNMENT;
+            }
+
+            Signature m_signature = 0;
+            std::vector<Column> m_columns;
+            std::array<uint32_t, MAX_COMPONENT_TYPES> m_columnOf {};
+            uint32_t m_capacity = 0;
+            std::vector<std::unique_ptr<Chunk>> m_chunks;
+            std::vector<uint32_t> m_counts;
+    };
+
+    // One chunk of an archetype, as a system sees it: the chunk's entities and its arrays of
+    // the components the archetype has.
+    class ChunkView {
+        public:
+            explicit ChunkView(const Archetype& archetype, size_t chunk)
+                : m_archetype { &archetype }
+                , m_chunk { chunk }
+            {
+            }
+
+            size_t size() const {
+                return m_archetype->count(m_chunk);
+            }
+
+            std::span<const Entity> entities() const {
+                return { m_archetype->entities(m_chunk), this->size() };
+            }
+
+            template <typename T>
+            std::span<T> components() const {
+                return { reinterpret_cast<T*>(m_archetype->column(m_chunk, componentId<std::remove_const_t<T>>())), this->size() };
+            }
+        private:
+            const Archetype* m_archetype = nullptr;
+            size_t m_chunk = 0;
+    };
+
+    // The entities of a scene and their components, grouped by signature into archetypes.
+    //
+    // Systems do not look entities up one at a time: `chunks` and `forEachChunk` hand them
+    // every chunk holding a set of components, whose arrays they walk front to back, and the
+    // parallel `forEachChunk` runs a job per chunk, which is safe as long as the system writes
+    // to the chunk it was given only. Creating, destroying or changing the components of
+    // entities moves others between slots, so it invalidates chunk views and must not happen
+    // while systems run. An archetype's chunks keep its entities in the order they were
+    // created in, until one is destroyed or moved to another archetype.
+    class World {
+        public:
+            explicit World() = default;
+
+            World(const World& other) = delete;
+            World& operator=(const World& other) = delete;
+
+            template <typename... Components>
+            Entity create(const Components&... components) {
+                (this->registerComponent<Components>(), ...);
+                auto& archetype = this->archetype(signatureOf<Components...>());
+                const auto entity = this->allocateEntity();
+                const auto location = archetype.append(entity);
+                (this->write(archetype, location, components), ...);
+
+                m_records[entity.index].archetype = m_archetypeIndices.at(archetype.signature());
+                m_records[entity.index].location = location;
+
+                return entity;
+            }
+
+            void destroy(Entity entity) {
+                if (!this->isAlive(entity)) {
+                    return;
+                }
+
+                auto& record = m_records[entity.index];
+                this->removeFromArchetype(record);
+                record.archetype = INVALID_INDEX;
+                record.generation++;
+                m_freeIndices.push_back(entity.index);
+                m_size--;
+            }
+
+            bool isAlive(Entity entity) const {
+                return entity.index < m_records.size()
+                    && m_records[entity.index].generation == entity.generation
+                    && m_records[entity.index].archetype != INVALID_INDEX;
+            }
+
+            template <typename T>
+            bool has(Entity entity) const {
+                return this->isAlive(entity) && m_archetypes[m_records[entity.index].archetype]->hasComponent(componentId<T>());
+            }
+
+            template <typename T>
+            T& get(Entity entity) {
+                if (!this->has<T>(entity)) {
+                    throw std::runtime_error("failed to get component, the entity does not have it!");
+                }
+
+                const auto& record = m_records[entity.index];
+
+                return *reinterpret_cast<T*>(m_archetypes[record.archetype]->component(record.location, componentId<T>()));
+            }
+
+            // Adds a component, or overwrites it if the entity has it already. Adding one moves
+            // the entity to the archetype of its new signature.
+            template <typename T>
+            void add(Entity entity, const T& component) {
+                this->registerComponent<T>();
+                if (this->has<T>(entity)) {
+                    this->get<T>(entity) = component;
+                    return;
+                }
+
+                if (!this->isAlive(entity)) {
+                    throw std::runtime_error("failed to add component, the entity is not alive!");
+                }
+
+                const auto& record = m_records[entity.index];
+                auto& archetype = this->migrate(entity, m_archetypes[record.archetype]->signature() | (Signature { 1 } << componentId<T>()));
+                this->write(archetype, m_records[entity.index].location, component);
+            }
+
+            template <typename T>
+            void remove(Entity entity) {
+                if (!this->has<T>(entity)) {
+                    return;
+                }
+
+                const auto& record = m_records[entity.index];
+                this->migrate(entity, m_archetypes[record.archetype]->signature() & ~(Signature { 1 } << componentId<T>()));
+            }
+
+            // Every chunk of the archetypes that have all of `Components`, in the order the
+            // archetypes were created, and each archetype's chunks in order.
+            template <typename... Components>
+            std::vector<ChunkView> chunks() const {
+                const auto signature = signatureOf<Components...>();
+                auto views = std::vector<ChunkView> {};
+                for (const auto& archetype : m_archetypes) {
+                    if ((archetype->signature() & signature) != signature) {
+                        continue;
+                    }
+
+                    for (size_t chunk = 0; chunk < archetype->chunkCount(); chunk++) {
+                        views.emplace_back(*archetype, chunk);
+                    }
+                }
+
+                return views;
+            }
+
+            template <typename... Components, typename Function>
+            void forEachChunk(Function&& function) const {
+                for (const auto& chunk : this->chunks<Components...>()) {
+                    function(chunk);
+                }
+            }
+
+            template <typename... Components, typename Function>
+            void forEachChunk(vk_jobs::JobSystem& jobSystem, Function&& function) const {
+                forEachChunk(jobSystem, this->chunks<Components...>(), function);
+            }
+
+            // Runs `function` on each of `chunks` as a job of its own, and waits for them.
+            template <typename Function>
+            static void forEachChunk(vk_jobs::JobSystem& jobSystem, std::span<const ChunkView> chunks, Function&& function) {
+                auto tasks = vk_jobs::TaskGroup { jobSystem };
+                for (const auto& chunk : chunks) {
+                    tasks.run([&function, chunk]() {
+                        function(chunk);
+                    });
+                }
+
+                tasks.wait();
+            }
+
+            size_t size() const {
+                return m_size;
+            }
+
+            // Destroys every entity, and forgets the generations of their indices.
+            void clear() {
+                m_archetypes.clear();
+                m_archetypeIndices.clear();
+                m_records.clear();
+                m_freeIndices.clear();
+                m_size = 0;
+            }
+        private:
+            struct Record {
+                uint32_t archetype = INVALID_INDEX;
+                uint32_t generation = 0;
+                Archetype::Location location {};
+            };
+
+            template <typename T>
+            void registerComponent() {
+                static_assert(alignof(T) <= COLUMN_ALIGNMENT, "components must not be aligned beyond a cache line");
+                m_components[componentId<T>()] = ComponentInfo { .size = sizeof(T), .alignment = alignof(T) };
+            }
+
+            template <typename T>
+            static void write(Archetype& archetype, Archetype::Location location, const T& component) {
+                std::memcpy(archetype.component(location, componentId<T>()), &component, sizeof(T));
+            }
+
+            Archetype& archetype(Signature signature) {
+                const auto found = m_archetypeIndices.find(signature);
+                if (found != m_archetypeIndices.end()) {
+                    return *m_archetypes[found->second];
+                }
+
+                m_archetypeIndices.emplace(signature, static_cast<uint32_t>(m_archetypes.size()));
+                m_archetypes.push_back(std::make_unique<Archetype>(signature, m_components));
+
+                return *m_archetypes.back();
+            }
+
+            Entity allocateEntity() {
+                m_size++;
+                if (!m_freeIndices.empty()) {
+                    const auto index = m_freeIndices.back();
+                    m_freeIndices.pop_back();
+
+                    return Entity { .index = index, .generation = m_records[index].generation };
+                }
+
+                m_records.push_back(Record {});
+
+                return Entity { .index = static_cast<uint32_t>(m_records.size() - 1), .generation = 0 };
+            }
+
+            void removeFromArchetype(const Record& record) {
+                const auto moved = m_archetypes[record.archetype]->remove(record.location);
+                if (moved.index != INVALID_INDEX) {
+                    m_records[moved.index].location = record.location;
+                }
+            }
+
+            // Moves an entity to the archetype of `signature`, copying the components both
+            // archetypes have.
+            Archetype& migrate(Entity entity, Signature signature) {
+                auto& record = m_records[entity.index];
+                auto& source = *m_archetypes[record.archetype];
+                auto& destination = this->archetype(signature);
+                const auto location = destination.append(entity);
+                for (auto bits = source.signature() & signature; bits != 0; bits &= bits - 1) {
+                    const auto id = static_cast<uint32_t>(std::countr_zero(bits));
+                    std::memcpy(destination.component(location, id), source.component(record.location, id), source.componentSize(id));
+                }
+
+                this->removeFromArchetype(record);
+                record.archetype = m_archetypeIndices.at(signature);
+                record.location = location;
+
+                return destination;
+            }
+
+            std::array<ComponentInfo, MAX_COMPONENT_TYPES> m_components {};
+            std::vector<std::unique_ptr<Archetype>> m_archetypes;
+            std::unordered_map<Signature, uint32_t> m_archetypeIndices;
+            std::vector<Record> m_records;
+            std::vector<uint32_t> m_freeIndices;
+            size_t m_size = 0;
+    };
+}
@@ -0,0 +1,194 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <span>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#include <fmt/core.h>
+#include <fmt/ostream.h>
+
+
+namespace vk_extensions {
+    // Sort a fixed list of extension or layer names at compile time, so lookups against it
+    // are binary searches over string views instead of string allocations.
+    template <size_t N>
+    constexpr std::array<std::string_view, N> sortedNames(const std::array<const char*, N>& names) {
+        auto sorted = std::array<std::string_view, N> {};
+        for (size_t i = 0; i < N; i++) {
+            sorted[i] = std::string_view { names[i] };
+        }
+
+        std::sort(sorted.begin(), sorted.end());
+
+        return sorted;
+    }
+
+    // Tracks which of a sorted set of required names have been seen, without allocating.
+    template <size_t N>
+    class RequiredNameMatcher {
+        public:
+            constexpr explicit RequiredNameMatcher(const std::array<std::string_view, N>& sortedRequiredNames)
+                : m_sortedRequiredNames { sortedRequiredNames }
+            {
+            }
+
+            constexpr void mark(std::string_view name) {
+                const auto found = std::lower_bound(m_sortedRequiredNames.begin(), m_sortedRequiredNames.end(), name);
+                if (found != m_sortedRequiredNames.end() && *found == name) {
+                    m_found.set(static_cast<size_t>(found - m_sortedRequiredNames.begin()));
+                }
+            }
+
+            constexpr bool allFound() const {
+                return m_found.all();
+            }
+        private:
+            const std::array<std::string_view, N>& m_sortedRequiredNames;
+            std::bitset<N> m_found;
+    };
+
+    // Check that every name in `sortedRequiredNames` appears among `available`, where
+    // `nameOf` projects an element of `available` onto its null terminated name.
+    template <size_t N, typename Range, typename Projection>
+    bool containsAll(const std::array<std::string_view, N>& sortedRequiredNames, const Range& available, Projection nameOf) {
+        auto matcher = RequiredNameMatcher<N> { sortedRequiredNames };
+        for (const auto& element : available) {
+            matcher.mark(std::string_view { nameOf(element) });
+        }
+
+        return matcher.allFound();
+    }
+
+    // Every instance layer, every instance extension, and the extensions of a few chosen
+    // layers, enumerated once at startup. Each of them is a flat array sorted by name, so every
+    // support check afterwards is a binary search instead of another round of enumeration
+    // calls into the loader and the layers' manifests.
+    class InstanceExtensionIndex {
+        public:
+            explicit InstanceExtensionIndex() = default;
+
+            InstanceExtensionIndex(const InstanceExtensionIndex& other) = delete;
+            InstanceExtensionIndex& operator=(const InstanceExtensionIndex& other) = delete;
+
+            // Enumerate the layers and extensions, along with the extensions of those layers in
+            // `indexedLayers` that are present. Later lookups of other layers' extensions fail.
+            void build(std::span<const char* const> indexedLayers) {
+                uint32_t layerCount = 0;
+                vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
+                m_layerProperties.resize(layerCount);
+                vkEnumerateInstanceLayerProperties(&layerCount, m_layerProperties.data());
+                m_layerProperties.resize(layerCount);
+
+                // The names point into the property arrays, which no longer change once filled.
+                m_layers.clear();
+                m_layers.reserve(m_layerProperties.size());
+                for (const auto& layer : m_layerProperties) {
+                    m_layers.push_back(std::string_view { layer.layerName });
+                }
+                std::sort(m_layers.begin(), m_layers.end());
+
+                m_extensionProperties.clear();
+                m_extensionLayers.clear();
+                this->appendExtensions(nullptr, {});
+                for (const auto layerName : indexedLayers) {
+                    const auto layer = std::lower_bound(m_layers.begin(), m_layers.end(), std::string_view { layerName });
+                    if (layer != m_layers.end() && *layer == layerName) {
+                        this->appendExtensions(layerName, *layer);
+                    }
+                }
+
+                m_extensions.clear();
+                m_extensions.reserve(m_extensionProperties.size());
+                for (size_t i = 0; i < m_extensionProperties.size(); i++) {
+                    m_extensions.push_back(Entry {
+                        .layer = m_extensionLayers[i],
+                        .name = std::string_view { m_extensionProperties[i].extensionName },
+                        .specVersion = m_extensionProperties[i].specVersion,
+                    });
+                }
+                std::sort(m_extensions.begin(), m_extensions.end(), [](const Entry& a, const Entry& b) {
+                    return std::tie(a.layer, a.name) < std::tie(b.layer, b.name);
+                });
+            }
+
+            bool hasLayer(std::string_view name) const {
+                return std::binary_search(m_layers.begin(), m_layers.end(), name);
+            }
+
+            template <size_t N>
+            bool hasLayers(const std::array<std::string_view, N>& names) const {
+                return std::all_of(names.begin(), names.end(), [this](std::string_view name) {
+                    return this->hasLayer(name);
+                });
+            }
+
+            // Whether the loader, or with a `layer` that layer, implements the extension.
+            bool hasExtension(std::string_view name, std::string_view layer = {}) const {
+                const auto key = std::tie(layer, name);
+                const auto found = std::lower_bound(m_extensions.begin(), m_extensions.end(), key, [](const Entry& entry, const auto& key) {
+                    return std::tie(entry.layer, entry.name) < key;
+                });
+
+                return found != m_extensions.end() && found->layer == layer && found->name == name;
+            }
+
+            // The first of `names` the loader does not implement, or null if it implements all.
+            const char* findMissingExtension(std::span<const char* const> names) const {
+                for (const auto name : names) {
+                    if (!this->hasExtension(name)) {
+                        return name;
+                    }
+                }
+
+                return nullptr;
+            }
+
+            void report(std::ostream& out) const {
+                for (const auto& extension : m_extensions) {
+                    if (extension.layer.empty()) {
+                        fmt::println(out, "NAME: {} ; VERSION: {}", extension.name, extension.specVersion);
+                    } else {
+                        fmt::println(out, "NAME: {} ; VERSION: {} ; LAYER: {}", extension.name, extension.specVersion, extension.layer);
+                    }
+                }
+
+                for (const auto layer : m_layers) {
+                    fmt::println(out, "LAYER: {}", layer);
+                }
+            }
+        private:
+            struct Entry {
+                std::string_view layer;
+                std::string_view name;
+                uint32_t specVersion;
+            };
+
+            std::vector<VkLayerProperties> m_layerProperties;
+            std::vector<VkExtensionProperties> m_extensionProperties;
+            // The layer each of `m_extensionProperties` came from, empty for the loader's own.
+            std::vector<std::string_view> m_extensionLayers;
+            std::vector<std::string_view> m_layers;
+            std::vector<Entry> m_extensions;
+
+            // `layer` names the layer like `layerName` does, but points into the layer properties.
+            void appendExtensions(const char* layerName, std::string_view layer) {
+                uint32_t extensionCount = 0;
+                vkEnumerateInstanceExtensionProperties(layerName, &extensionCount, nullptr);
+
+                const auto offset = m_extensionProperties.size();
+                m_extensionProperties.resize(offset + extensionCount);
+                vkEnumerateInstanceExtensionProperties(layerName, &extensionCount, m_extensionProperties.data() + offset);
+                m_extensionProperties.resize(offset + extensionCount);
+                m_extensionLayers.resize(m_extensionProperties.size(), layer);
+            }
+    };
+}
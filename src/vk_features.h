@@ -0,0 +1,980 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+
+namespace vk_features {
+    // Capabilities the renderer can branch on once the logical device exists.
+    enum class Feature : uint32_t {
+        TimelineSemaphore,
+        Synchronization2,
+        DynamicRendering,
+        PipelineCreationCacheControl,
+        BufferDeviceAddress,
+        DescriptorIndexing,
+        SamplerAnisotropy,
+        MemoryBudget,
+        MemoryPriority,
+        PageableDeviceLocalMemory,
+        PortabilitySubset,
+        PresentId,
+        PresentWait,
+        DisplayTiming,
+        LowLatency,
+        StorageImageWriteWithoutFormat,
+        MultiDrawIndirect,
+        DrawIndirectCount,
+        MeshShader,
+        ExternalMemoryHost,
+        TextureCompressionBC,
+        TextureCompressionASTC,
+        TextureCompressionETC2,
+        SparseResidency,
+        ExtendedDynamicState3,
+        ShaderObject,
+        SubgroupSizeControl,
+        ComputeFullSubgroups,
+        FragmentShadingRate,
+        PipelineStatisticsQuery,
+        PerformanceQuery,
+        BufferMarker,
+        DiagnosticCheckpoints,
+        DeviceFault,
+        DeviceFaultVendorBinary,
+        ExternalMemoryExport,
+        VideoEncodeH264,
+        SwapchainMaintenance1,
+        FullScreenExclusive,
+        CalibratedTimestamps,
+        DeviceGeneratedCommands,
+        DescriptorBuffer,
+        PushDescriptor,
+        HostImageCopy,
+        StorageBuffer8BitAccess,
+        IndependentBlend,
+        FragmentStoresAndAtomics,
+        RayQuery,
+        Count,
+    };
+
+    using FeatureSet = std::bitset<static_cast<size_t>(Feature::Count)>;
+
+    inline bool has(const FeatureSet& features, Feature feature) {
+        return features.test(static_cast<size_t>(feature));
+    }
+
+    inline const char* featureToString(Feature feature) {
+        switch (feature) {
+            case Feature::TimelineSemaphore: return "timelineSemaphore";
+            case Feature::Synchronization2: return "synchronization2";
+            case Feature::DynamicRendering: return "dynamicRendering";
+            case Feature::PipelineCreationCacheControl: return "pipelineCreationCacheControl";
+            case Feature::BufferDeviceAddress: return "bufferDeviceAddress";
+            case Feature::DescriptorIndexing: return "descriptorIndexing";
+            case Feature::SamplerAnisotropy: return "samplerAnisotropy";
+            case Feature::MemoryBudget: return "memoryBudget";
+            case Feature::MemoryPriority: return "memoryPriority";
+            case Feature::PageableDeviceLocalMemory: return "pageableDeviceLocalMemory";
+            case Feature::PortabilitySubset: return "portabilitySubset";
+            case Feature::PresentId: return "presentId";
+            case Feature::PresentWait: return "presentWait";
+            case Feature::DisplayTiming: return "displayTiming";
+            case Feature::LowLatency: return "lowLatency";
+            case Feature::StorageImageWriteWithoutFormat: return "shaderStorageImageWriteWithoutFormat";
+            case Feature::MultiDrawIndirect: return "multiDrawIndirect";
+            case Feature::DrawIndirectCount: return "drawIndirectCount";
+            case Feature::MeshShader: return "meshShader";
+            case Feature::ExternalMemoryHost: return "externalMemoryHost";
+            case Feature::TextureCompressionBC: return "textureCompressionBC";
+            case Feature::TextureCompressionASTC: return "textureCompressionASTC_LDR";
+            case Feature::TextureCompressionETC2: return "textureCompressionETC2";
+            case Feature::SparseResidency: return "sparseResidencyImage2D";
+            case Feature::ExtendedDynamicState3: return "extendedDynamicState3";
+            case Feature::ShaderObject: return "shaderObject";
+            case Feature::SubgroupSizeControl: return "subgroupSizeControl";
+            case Feature::ComputeFullSubgroups: return "computeFullSubgroups";
+            case Feature::FragmentShadingRate: return "fragmentShadingRate";
+            case Feature::PipelineStatisticsQuery: return "pipelineStatisticsQuery";
+            case Feature::PerformanceQuery: return "performanceCounterQueryPools";
+            case Feature::BufferMarker: return "bufferMarker";
+            case Feature::DiagnosticCheckpoints: return "diagnosticCheckpoints";
+            case Feature::DeviceFault: return "deviceFault";
+            case Feature::DeviceFaultVendorBinary: return "deviceFaultVendorBinary";
+            case Feature::ExternalMemoryExport: return "externalMemoryExport";
+            case Feature::VideoEncodeH264: return "videoEncodeH264";
+            case Feature::SwapchainMaintenance1: return "swapchainMaintenance1";
+            case Feature::FullScreenExclusive: return "fullScreenExclusive";
+            case Feature::CalibratedTimestamps: return "calibratedTimestamps";
+            case Feature::DeviceGeneratedCommands: return "deviceGeneratedCommands";
+            case Feature::DescriptorBuffer: return "descriptorBuffer";
+            case Feature::PushDescriptor: return "pushDescriptor";
+            case Feature::HostImageCopy: return "hostImageCopy";
+            case Feature::StorageBuffer8BitAccess: return "storageBuffer8BitAccess";
+            case Feature::IndependentBlend: return "independentBlend";
+            case Feature::FragmentStoresAndAtomics: return "fragmentStoresAndAtomics";
+            case Feature::RayQuery: return "rayQuery";
+            case Feature::Count: break;
+        }
+
+        return "unknown";
+    }
+
+    inline bool hasExtension(const std::vector<VkExtensionProperties>& available, const char* name) {
+        for (const auto& extension : available) {
+            if (std::strcmp(extension.extensionName, name) == 0) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // The core feature structures of Vulkan 1.0 through 1.3, and those of the optional
+    // extensions the renderer knows about, linked into one `pNext` chain. Only the structures
+    // the device's API version and extensions know about are linked, since chaining anything
+    // else is invalid usage. Copying relinks the chain, so a `FeatureChain` can be passed
+    // around by value.
+    struct FeatureChain {
+        VkPhysicalDeviceFeatures2 features2;
+        VkPhysicalDeviceVulkan11Features vulkan11;
+        VkPhysicalDeviceVulkan12Features vulkan12;
+        VkPhysicalDeviceVulkan13Features vulkan13;
+        VkPhysicalDevicePresentIdFeaturesKHR presentId;
+        VkPhysicalDevicePresentWaitFeaturesKHR presentWait;
+        VkPhysicalDeviceMeshShaderFeaturesEXT meshShader;
+        VkPhysicalDeviceMemoryPriorityFeaturesEXT memoryPriority;
+        VkPhysicalDevicePageableDeviceLocalMemoryFeaturesEXT pageableDeviceLocalMemory;
+        VkPhysicalDeviceExtendedDynamicState3FeaturesEXT extendedDynamicState3;
+        VkPhysicalDeviceShaderObjectFeaturesEXT shaderObject;
+        VkPhysicalDeviceFragmentShadingRateFeaturesKHR fragmentShadingRate;
+        VkPhysicalDevicePerformanceQueryFeaturesKHR performanceQuery;
+        VkPhysicalDeviceFaultFeaturesEXT deviceFault;
+        VkPhysicalDeviceSwapchainMaintenance1FeaturesEXT swapchainMaintenance1;
+        VkPhysicalDeviceMaintenance5FeaturesKHR maintenance5;
+        VkPhysicalDeviceDeviceGeneratedCommandsFeaturesEXT deviceGeneratedCommands;
+        VkPhysicalDeviceDescriptorBufferFeaturesEXT descriptorBuffer;
+        VkPhysicalDeviceHostImageCopyFeaturesEXT hostImageCopy;
+        VkPhysicalDeviceAccelerationStructureFeaturesKHR accelerationStructure;
+        VkPhysicalDeviceRayQueryFeaturesKHR rayQuery;
+
+        uint32_t apiVersion;
+        bool chainPresentId;
+        bool chainPresentWait;
+        bool chainMeshShader;
+        bool chainMemoryPriority;
+        bool chainPageableDeviceLocalMemory;
+        bool chainExtendedDynamicState3;
+        bool chainShaderObject;
+        bool chainFragmentShadingRate;
+        bool chainPerformanceQuery;
+        bool chainDeviceFault;
+        bool chainSwapchainMaintenance1;
+        bool chainMaintenance5;
+        bool chainDeviceGeneratedCommands;
+        bool chainDescriptorBuffer;
+        bool chainHostImageCopy;
+        bool chainAccelerationStructure;
+        bool chainRayQuery;
+
+        FeatureChain() {
+            std::memset(this, 0, sizeof(*this));
+            features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+            vulkan11.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
+            vulkan12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+            vulkan13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+            presentId.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+            presentWait.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+            meshShader.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+            memoryPriority.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PRIORITY_FEATURES_EXT;
+            pageableDeviceLocalMemory.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PAGEABLE_DEVICE_LOCAL_MEMORY_FEATURES_EXT;
+            extendedDynamicState3.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT;
+            shaderObject.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_OBJECT_FEATURES_EXT;
+            fragmentShadingRate.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_SHADING_RATE_FEATURES_KHR;
+            performanceQuery.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PERFORMANCE_QUERY_FEATURES_KHR;
+            deviceFault.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FAULT_FEATURES_EXT;
+            swapchainMaintenance1.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SWAPCHAIN_MAINTENANCE_1_FEATURES_EXT;
+            maintenance5.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MAINTENANCE_5_FEATURES_KHR;
+            deviceGeneratedCommands.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DEVICE_GENERATED_COMMANDS_FEATURES_EXT;
+            descriptorBuffer.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT;
+            hostImageCopy.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_IMAGE_COPY_FEATURES_EXT;
+            accelerationStructure.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR;
+            rayQuery.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_QUERY_FEATURES_KHR;
+            apiVersion = VK_API_VERSION_1_3;
+            this->link();
+        }
+
+        FeatureChain(const FeatureChain& other) {
+            std::memcpy(this, &other, sizeof(*this));
+            this->link();
+        }
+
+        FeatureChain& operator=(const FeatureChain& other) {
+            std::memcpy(this, &other, sizeof(*this));
+            this->link();
+
+            return *this;
+        }
+
+        void link() {
+            void** tail = &features2.pNext;
+            const auto append = [&tail](auto& features) {
+                *tail = &features;
+                tail = &features.pNext;
+            };
+
+            if (apiVersion >= VK_API_VERSION_1_1) {
+                append(vulkan11);
+            }
+
+            if (apiVersion >= VK_API_VERSION_1_2) {
+                append(vulkan12);
+            }
+
+            if (apiVersion >= VK_API_VERSION_1_3) {
+                append(vulkan13);
+            }
+
+            if (chainPresentId) {
+                append(presentId);
+            }
+
+            if (chainPresentWait) {
+                append(presentWait);
+            }
+
+            if (chainMeshShader) {
+                append(meshShader);
+            }
+
+            if (chainMemoryPriority) {
+                append(memoryPriority);
+            }
+
+            if (chainPageableDeviceLocalMemory) {
+                append(pageableDeviceLocalMemory);
+            }
+
+            if (chainExtendedDynamicState3) {
+                append(extendedDynamicState3);
+            }
+
+            if (chainShaderObject) {
+                append(shaderObject);
+            }
+
+            if (chainFragmentShadingRate) {
+                append(fragmentShadingRate);
+            }
+
+            if (chainPerformanceQuery) {
+                append(performanceQuery);
+            }
+
+            if (chainDeviceFault) {
+                append(deviceFault);
+            }
+
+            if (chainSwapchainMaintenance1) {
+                append(swapchainMaintenance1);
+            }
+
+            if (chainMaintenance5) {
+                append(maintenance5);
+            }
+
+            if (chainDeviceGeneratedCommands) {
+                append(deviceGeneratedCommands);
+            }
+
+            if (chainDescriptorBuffer) {
+                append(descriptorBuffer);
+            }
+
+            if (chainHostImageCopy) {
+                append(hostImageCopy);
+            }
+
+            if (chainAccelerationStructure) {
+                append(accelerationStructure);
+            }
+
+            if (chainRayQuery) {
+                append(rayQuery);
+            }
+
+            *tail = nullptr;
+        }
+
+        // Structures left out of the chain stay all false.
+        static FeatureChain query(
+            VkPhysicalDevice physicalDevice,
+            uint32_t apiVersion,
+            const std::vector<VkExtensionProperties>& availableExtensions
+        ) {
+            auto chain = FeatureChain {};
+            chain.apiVersion = apiVersion;
+            chain.chainPresentId = hasExtension(availableExtensions, VK_KHR_PRESENT_ID_EXTENSION_NAME);
+            chain.chainPresentWait = hasExtension(availableExtensions, VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+            chain.chainMeshShader = hasExtension(availableExtensions, VK_EXT_MESH_SHADER_EXTENSION_NAME);
+            chain.chainMemoryPriority = hasExtension(availableExtensions, VK_EXT_MEMORY_PRIORITY_EXTENSION_NAME);
+            chain.chainPageableDeviceLocalMemory = hasExtension(availableExtensions, VK_EXT_PAGEABLE_DEVICE_LOCAL_MEMORY_EXTENSION_NAME);
+            chain.chainExtendedDynamicState3 = hasExtension(availableExtensions, VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME);
+            chain.chainShaderObject = hasExtension(availableExtensions, VK_EXT_SHADER_OBJECT_EXTENSION_NAME);
+            chain.chainFragmentShadingRate = hasExtension(availableExtensions, VK_KHR_FRAGMENT_SHADING_RATE_EXTENSION_NAME);
+            chain.chainPerformanceQuery = hasExtension(availableExtensions, VK_KHR_PERFORMANCE_QUERY_EXTENSION_NAME);
+            chain.chainDeviceFault = hasExtension(availableExtensions, VK_EXT_DEVICE_FAULT_EXTENSION_NAME);
+            chain.chainSwapchainMaintenance1 = hasExtension(availableExtensions, VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME);
+            chain.chainMaintenance5 = hasExtension(availableExtensions, VK_KHR_MAINTENANCE_5_EXTENSION_NAME);
+            chain.chainDeviceGeneratedCommands = hasExtension(availableExtensions, VK_EXT_DEVICE_GENERATED_COMMANDS_EXTENSION_NAME);
+            chain.chainDescriptorBuffer = hasExtension(availableExtensions, VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME);
+            chain.chainHostImageCopy = hasExtension(availableExtensions, VK_EXT_HOST_IMAGE_COPY_EXTENSION_NAME);
+            chain.chainAccelerationStructure = hasExtension(availableExtensions, VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME)
+                && hasExtension(availableExtensions, VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME);
+            chain.chainRayQuery = hasExtension(availableExtensions, VK_KHR_RAY_QUERY_EXTENSION_NAME);
+            chain.link();
+
+            if (apiVersion < VK_API_VERSION_1_1) {
+                vkGetPhysicalDeviceFeatures(physicalDevice, &chain.features2.features);
+            } else {
+                vkGetPhysicalDeviceFeatures2(physicalDevice, &chain.features2);
+            }
+
+            return chain;
+        }
+    };
+
+    // What to enable on the logical device: the feature chain for `VkDeviceCreateInfo::pNext`,
+    // the device extensions, and the resulting capabilities.
+    struct NegotiatedFeatures {
+        FeatureChain enabled;
+        std::vector<const char*> extensions;
+        FeatureSet features;
+    };
+
+    // The renderer cannot run without these.
+    inline bool meetsRequirements(const FeatureChain& supported) {
+        return supported.vulkan12.timelineSemaphore
+            && supported.vulkan13.synchronization2
+            && supported.vulkan13.dynamicRendering;
+    }
+
+    // How much of what the device reports to enable. A driver can still reject a device that
+    // enables only what it reports, so device creation falls back one level at a time.
+    enum class FeatureLevel : uint32_t {
+        // Every optional feature and extension.
+        Full,
+        // The optional features of the core structures, and no optional extension.
+        Core,
+        // Only what the renderer cannot run without.
+        Required,
+    };
+
+    constexpr auto FEATURE_LEVELS = std::array { FeatureLevel::Full, FeatureLevel::Core, FeatureLevel::Required };
+
+    inline const char* featureLevelToString(FeatureLevel level) {
+        switch (level) {
+            case FeatureLevel::Full: return "full";
+            case FeatureLevel::Core: return "core";
+            case FeatureLevel::Required: return "required";
+        }
+
+        return "unknown";
+    }
+
+    // What the device supports, as far as `level` looks.
+    inline FeatureChain reduceFeatures(const FeatureChain& supported, FeatureLevel level) {
+        if (level == FeatureLevel::Full) {
+            return supported;
+        }
+
+        auto reduced = FeatureChain {};
+        reduced.apiVersion = supported.apiVersion;
+        if (level == FeatureLevel::Core) {
+            reduced.features2.features = supported.features2.features;
+            reduced.vulkan11 = supported.vulkan11;
+            reduced.vulkan12 = supported.vulkan12;
+            reduced.vulkan13 = supported.vulkan13;
+        } else {
+            reduced.vulkan12.timelineSemaphore = supported.vulkan12.timelineSemaphore;
+            reduced.vulkan13.synchronization2 = supported.vulkan13.synchronization2;
+            reduced.vulkan13.dynamicRendering = supported.vulkan13.dynamicRendering;
+        }
+
+        // The copied structures still point into `supported`.
+        reduced.link();
+
+        return reduced;
+    }
+
+    // The extensions the device has, as far as `level` looks. The portability subset stays at
+    // every level, since it must be enabled whenever it is present.
+    inline std::vector<VkExtensionProperties> reduceExtensions(const std::vector<VkExtensionProperties>& available, FeatureLevel level) {
+        if (level == FeatureLevel::Full) {
+            return available;
+        }
+
+        auto reduced = std::vector<VkExtensionProperties> {};
+        for (const auto& extension : available) {
+            if (std::strcmp(extension.extensionName, "VK_KHR_portability_subset") == 0) {
+                reduced.push_back(extension);
+            }
+        }
+
+        return reduced;
+    }
+
+    // Enable every required feature and extension, and each optional one the device supports
+    // at `level`. The present extensions all depend on `VK_KHR_swapchain`, so they are left out
+    // when `presentation` is false, and swapchain maintenance also on the instance enabling
+    // `VK_EXT_surface_maintenance1`, which `surfaceMaintenance` says.
+    inline NegotiatedFeatures negotiate(
+        const FeatureChain& deviceFeatures,
+        const std::vector<VkExtensionProperties>& deviceExtensions,
+        std::span<const char* const> requiredExtensions,
+        bool presentation,
+        bool surfaceMaintenance,
+        FeatureLevel level
+    ) {
+        const auto supported = reduceFeatures(deviceFeatures, level);
+        const auto availableExtensions = reduceExtensions(deviceExtensions, level);
+        if (!meetsRequirements(supported)) {
+            throw std::runtime_error("the physical device is missing required features!");
+        }
+
+        auto negotiated = NegotiatedFeatures {};
+        auto& enabled = negotiated.enabled;
+        enabled.apiVersion = supported.apiVersion;
+        auto set = [&negotiated](Feature feature) {
+            negotiated.features.set(static_cast<size_t>(feature));
+        };
+
+        enabled.vulkan12.timelineSemaphore = VK_TRUE;
+        enabled.vulkan13.synchronization2 = VK_TRUE;
+        enabled.vulkan13.dynamicRendering = VK_TRUE;
+        set(Feature::TimelineSemaphore);
+        set(Feature::Synchronization2);
+        set(Feature::DynamicRendering);
+
+        if (supported.vulkan13.pipelineCreationCacheControl) {
+            enabled.vulkan13.pipelineCreationCacheControl = VK_TRUE;
+            set(Feature::PipelineCreationCacheControl);
+        }
+
+        if (supported.vulkan12.bufferDeviceAddress) {
+            enabled.vulkan12.bufferDeviceAddress = VK_TRUE;
+            set(Feature::BufferDeviceAddress);
+        }
+
+        // Lets compute kernels pin the subgroup size they were tuned for.
+        if (supported.vulkan13.subgroupSizeControl) {
+            enabled.vulkan13.subgroupSizeControl = VK_TRUE;
+            set(Feature::SubgroupSizeControl);
+        }
+
+        // Lets kernels that scan across a workgroup count on every subgroup in it being full.
+        if (supported.vulkan13.computeFullSubgroups) {
+            enabled.vulkan13.computeFullSubgroups = VK_TRUE;
+            set(Feature::ComputeFullSubgroups);
+        }
+
+        // Update after bind and partially bound arrays, which the bindless descriptor heap
+        // relies on, are optional even on Vulkan 1.3.
+        const auto& vulkan12 = supported.vulkan12;
+        if (
+            vulkan12.descriptorIndexing
+            && vulkan12.runtimeDescriptorArray
+            && vulkan12.descriptorBindingPartiallyBound
+            && vulkan12.descriptorBindingUpdateUnusedWhilePending
+            && vulkan12.descriptorBindingSampledImageUpdateAfterBind
+            && vulkan12.descriptorBindingStorageBufferUpdateAfterBind
+            && vulkan12.shaderSampledImageArrayNonUniformIndexing
+        ) {
+            enabled.vulkan12.descriptorIndexing = VK_TRUE;
+            enabled.vulkan12.runtimeDescriptorArray = VK_TRUE;
+            enabled.vulkan12.descriptorBindingPartiallyBound = VK_TRUE;
+            enabled.vulkan12.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+            enabled.vulkan12.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+            enabled.vulkan12.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+            enabled.vulkan12.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+            set(Feature::DescriptorIndexing);
+        }
+
+        // Lets the asset decompressor write its output a byte at a time.
+        if (vulkan12.storageBuffer8BitAccess) {
+            enabled.vulkan12.storageBuffer8BitAccess = VK_TRUE;
+            set(Feature::StorageBuffer8BitAccess);
+        }
+
+        if (supported.features2.features.samplerAnisotropy) {
+            enabled.features2.features.samplerAnisotropy = VK_TRUE;
+            set(Feature::SamplerAnisotropy);
+        }
+
+        // Textures ship in whichever block compressed family the device samples, desktop
+        // GPUs usually only BC and mobile ones ASTC and ETC2, so every family supported is on.
+        if (supported.features2.features.textureCompressionBC) {
+            enabled.features2.features.textureCompressionBC = VK_TRUE;
+            set(Feature::TextureCompressionBC);
+        }
+
+        if (supported.features2.features.textureCompressionASTC_LDR) {
+            enabled.features2.features.textureCompressionASTC_LDR = VK_TRUE;
+            set(Feature::TextureCompressionASTC);
+        }
+
+        if (supported.features2.features.textureCompressionETC2) {
+            enabled.features2.features.textureCompressionETC2 = VK_TRUE;
+            set(Feature::TextureCompressionETC2);
+        }
+
+        // Streamed textures are partially resident images, with memory bound tile by tile.
+        if (supported.features2.features.sparseBinding && supported.features2.features.sparseResidencyImage2D) {
+            enabled.features2.features.sparseBinding = VK_TRUE;
+            enabled.features2.features.sparseResidencyImage2D = VK_TRUE;
+            set(Feature::SparseResidency);
+        }
+
+        // Swapchain formats like `B8G8R8A8_UNORM` have no SPIR-V image format, so the compute
+        // present path can only write them through storage images declared without one.
+        if (supported.features2.features.shaderStorageImageWriteWithoutFormat) {
+            enabled.features2.features.shaderStorageImageWriteWithoutFormat = VK_TRUE;
+            set(Feature::StorageImageWriteWithoutFormat);
+        }
+
+        // The GPU driven path draws every visible instance from one indirect buffer, each
+        // draw picking its instance through `firstInstance`, with the count written on the GPU.
+        // Without indirect count draws, the CPU culls and records the count itself.
+        if (supported.features2.features.multiDrawIndirect && supported.features2.features.drawIndirectFirstInstance) {
+            enabled.features2.features.multiDrawIndirect = VK_TRUE;
+            enabled.features2.features.drawIndirectFirstInstance = VK_TRUE;
+            set(Feature::MultiDrawIndirect);
+
+            if (supported.vulkan12.drawIndirectCount) {
+                enabled.vulkan12.drawIndirectCount = VK_TRUE;
+                set(Feature::DrawIndirectCount);
+            }
+        }
+
+        // Weighted blended transparency adds into one of its targets and multiplies into the
+        // other, and its per pixel lists are built by fragment shaders with atomics.
+        if (supported.features2.features.independentBlend) {
+            enabled.features2.features.independentBlend = VK_TRUE;
+            set(Feature::IndependentBlend);
+        }
+
+        if (supported.features2.features.fragmentStoresAndAtomics) {
+            enabled.features2.features.fragmentStoresAndAtomics = VK_TRUE;
+            set(Feature::FragmentStoresAndAtomics);
+        }
+
+        // Pipeline statistics are counted per render graph pass, and the main pass executes
+        // secondary command buffers inside its query, which they can only do by inheriting it.
+        if (supported.features2.features.pipelineStatisticsQuery && supported.features2.features.inheritedQueries) {
+            enabled.features2.features.pipelineStatisticsQuery = VK_TRUE;
+            enabled.features2.features.inheritedQueries = VK_TRUE;
+            set(Feature::PipelineStatisticsQuery);
+        }
+
+        negotiated.extensions.assign(requiredExtensions.begin(), requiredExtensions.end());
+
+        if (hasExtension(availableExtensions, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)) {
+            negotiated.extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+            set(Feature::MemoryBudget);
+        }
+
+        // Implementations that only partially conform, like MoltenVK, expose this extension,
+        // and it must be enabled whenever it is present.
+        if (hasExtension(availableExtensions, "VK_KHR_portability_subset")) {
+            negotiated.extensions.push_back("VK_KHR_portability_subset");
+            set(Feature::PortabilitySubset);
+        }
+
+        // Present ids tag each present so that present wait can block until it has reached
+        // the display. Present wait is useless without them.
+        if (presentation && supported.chainPresentId && supported.presentId.presentId) {
+            enabled.chainPresentId = true;
+            enabled.presentId.presentId = VK_TRUE;
+            negotiated.extensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+            set(Feature::PresentId);
+
+            if (supported.chainPresentWait && supported.presentWait.presentWait) {
+                enabled.chainPresentWait = true;
+                enabled.presentWait.presentWait = VK_TRUE;
+                negotiated.extensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+                set(Feature::PresentWait);
+            }
+        }
+
+        // The GPU driven scene culls and draws meshlets with task and mesh shaders where it
+        // can. Neither stage is of any use without the other.
+        if (supported.chainMeshShader && supported.meshShader.taskShader && supported.meshShader.meshShader) {
+            enabled.chainMeshShader = true;
+            enabled.meshShader.taskShader = VK_TRUE;
+            enabled.meshShader.meshShader = VK_TRUE;
+            negotiated.extensions.push_back(VK_EXT_MESH_SHADER_EXTENSION_NAME);
+            set(Feature::MeshShader);
+        }
+
+        // Vulkan 1.3 makes the rasterization, depth and input assembly state of extended dynamic
+        // state 1 and 2 core. Blend state can only be left dynamic with extended dynamic state 3,
+        // and only all of it is of use.
+        const auto& extendedDynamicState3 = supported.extendedDynamicState3;
+        if (
+            supported.chainExtendedDynamicState3
+            && extendedDynamicState3.extendedDynamicState3ColorBlendEnable
+            && extendedDynamicState3.extendedDynamicState3ColorBlendEquation
+            && extendedDynamicState3.extendedDynamicState3ColorWriteMask
+        ) {
+            enabled.chainExtendedDynamicState3 = true;
+            enabled.extendedDynamicState3.extendedDynamicState3ColorBlendEnable = VK_TRUE;
+            enabled.extendedDynamicState3.extendedDynamicState3ColorBlendEquation = VK_TRUE;
+            enabled.extendedDynamicState3.extendedDynamicState3ColorWriteMask = VK_TRUE;
+            negotiated.extensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME);
+            set(Feature::ExtendedDynamicState3);
+        }
+
+        // Shader objects stand in for the scene's pipelines when asked for. Enabling the feature
+        // costs nothing when they are not used.
+        if (supported.chainShaderObject && supported.shaderObject.shaderObject) {
+            enabled.chainShaderObject = true;
+            enabled.shaderObject.shaderObject = VK_TRUE;
+            negotiated.extensions.push_back(VK_EXT_SHADER_OBJECT_EXTENSION_NAME);
+            set(Feature::ShaderObject);
+        }
+
+        // The GPU driven scene's cull shader picks the pipeline and push constants of every
+        // draw it writes, which device generated commands then execute, with pipelines and
+        // buffers flagged through maintenance 5 and inputs reached by their addresses.
+        if (
+            supported.chainMaintenance5
+            && supported.maintenance5.maintenance5
+            && supported.chainDeviceGeneratedCommands
+            && supported.deviceGeneratedCommands.deviceGeneratedCommands
+            && supported.vulkan12.bufferDeviceAddress
+        ) {
+            enabled.chainMaintenance5 = true;
+            enabled.maintenance5.maintenance5 = VK_TRUE;
+            enabled.chainDeviceGeneratedCommands = true;
+            enabled.deviceGeneratedCommands.deviceGeneratedCommands = VK_TRUE;
+            negotiated.extensions.push_back(VK_KHR_MAINTENANCE_5_EXTENSION_NAME);
+            negotiated.extensions.push_back(VK_EXT_DEVICE_GENERATED_COMMANDS_EXTENSION_NAME);
+            set(Feature::DeviceGeneratedCommands);
+        }
+
+        // The bindless heap writes its descriptors straight into a buffer it binds by address,
+        // instead of a set from a pool.
+        if (
+            supported.chainDescriptorBuffer
+            && supported.descriptorBuffer.descriptorBuffer
+            && supported.vulkan12.bufferDeviceAddress
+        ) {
+            enabled.chainDescriptorBuffer = true;
+            enabled.descriptorBuffer.descriptorBuffer = VK_TRUE;
+            negotiated.extensions.push_back(VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME);
+            set(Feature::DescriptorBuffer);
+        }
+
+        // The few bindings rewritten for every dispatch or draw outside the bindless heap are
+        // pushed into the command buffer, instead of written into a set from a pool.
+        if (hasExtension(availableExtensions, VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME)) {
+            negotiated.extensions.push_back(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+            set(Feature::PushDescriptor);
+        }
+
+        // Lets the upload service write small textures from the CPU straight into their
+        // optimally tiled images, without a staging copy on the transfer queue.
+        if (supported.chainHostImageCopy && supported.hostImageCopy.hostImageCopy) {
+            enabled.chainHostImageCopy = true;
+            enabled.hostImageCopy.hostImageCopy = VK_TRUE;
+            negotiated.extensions.push_back(VK_EXT_HOST_IMAGE_COPY_EXTENSION_NAME);
+            set(Feature::HostImageCopy);
+        }
+
+        // Shadows beyond the near cascades, and picking, trace rays against acceleration
+        // structures of the scene from shaders. The acceleration structure extension needs
+        // deferred host operations enabled, though builds are only ever recorded on the GPU.
+        if (
+            supported.chainAccelerationStructure
+            && supported.accelerationStructure.accelerationStructure
+            && supported.chainRayQuery
+            && supported.rayQuery.rayQuery
+            && supported.vulkan12.bufferDeviceAddress
+        ) {
+            enabled.chainAccelerationStructure = true;
+            enabled.accelerationStructure.accelerationStructure = VK_TRUE;
+            enabled.chainRayQuery = true;
+            enabled.rayQuery.rayQuery = VK_TRUE;
+            negotiated.extensions.push_back(VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME);
+            negotiated.extensions.push_back(VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME);
+            negotiated.extensions.push_back(VK_KHR_RAY_QUERY_EXTENSION_NAME);
+            set(Feature::RayQuery);
+        }
+
+        // Variable rate shading sets a rate per draw, and per tile of the render area from an
+        // attachment a compute shader fills, which it writes as an `r8ui` storage image.
+        // With it enabled, draws with shader objects have to set a rate.
+        const auto& fragmentShadingRate = supported.fragmentShadingRate;
+        if (
+            supported.chainFragmentShadingRate
+            && fragmentShadingRate.pipelineFragmentShadingRate
+            && fragmentShadingRate.attachmentFragmentShadingRate
+            && supported.features2.features.shaderStorageImageExtendedFormats
+        ) {
+            enabled.chainFragmentShadingRate = true;
+            enabled.fragmentShadingRate.pipelineFragmentShadingRate = VK_TRUE;
+            enabled.fragmentShadingRate.attachmentFragmentShadingRate = VK_TRUE;
+            enabled.features2.features.shaderStorageImageExtendedFormats = VK_TRUE;
+            negotiated.extensions.push_back(VK_KHR_FRAGMENT_SHADING_RATE_EXTENSION_NAME);
+            set(Feature::FragmentShadingRate);
+        }
+
+        // Allocations carry a priority, so that when device memory is oversubscribed, the
+        // driver pages out streamed assets before render targets. Pageable device local memory
+        // lets the OS do the same across processes, by the same priorities, and depends on it.
+        if (supported.chainMemoryPriority && supported.memoryPriority.memoryPriority) {
+            enabled.chainMemoryPriority = true;
+            enabled.memoryPriority.memoryPriority = VK_TRUE;
+            negotiated.extensions.push_back(VK_EXT_MEMORY_PRIORITY_EXTENSION_NAME);
+            set(Feature::MemoryPriority);
+
+            if (supported.chainPageableDeviceLocalMemory && supported.pageableDeviceLocalMemory.pageableDeviceLocalMemory) {
+                enabled.chainPageableDeviceLocalMemory = true;
+                enabled.pageableDeviceLocalMemory.pageableDeviceLocalMemory = VK_TRUE;
+                negotiated.extensions.push_back(VK_EXT_PAGEABLE_DEVICE_LOCAL_MEMORY_EXTENSION_NAME);
+                set(Feature::PageableDeviceLocalMemory);
+            }
+        }
+
+        // Hardware counters are read per render graph pass from performance query pools. A
+        // command buffer must not reset such a query and also begin it, so the pools are reset
+        // from the host once their frame has finished.
+        if (supported.chainPerformanceQuery && supported.performanceQuery.performanceCounterQueryPools && supported.vulkan12.hostQueryReset) {
+            enabled.chainPerformanceQuery = true;
+            enabled.performanceQuery.performanceCounterQueryPools = VK_TRUE;
+            enabled.vulkan12.hostQueryReset = VK_TRUE;
+            negotiated.extensions.push_back(VK_KHR_PERFORMANCE_QUERY_EXTENSION_NAME);
+            set(Feature::PerformanceQuery);
+        }
+
+        // When the device is lost, crash diagnostics find the pass the GPU died in by the
+        // breadcrumbs it left, written by buffer markers or checkpoints where the driver has
+        // them, and ask the driver what faulted. None of them cost anything until used.
+        if (hasExtension(availableExtensions, VK_AMD_BUFFER_MARKER_EXTENSION_NAME)) {
+            negotiated.extensions.push_back(VK_AMD_BUFFER_MARKER_EXTENSION_NAME);
+            set(Feature::BufferMarker);
+        }
+
+        if (hasExtension(availableExtensions, VK_NV_DEVICE_DIAGNOSTIC_CHECKPOINTS_EXTENSION_NAME)) {
+            negotiated.extensions.push_back(VK_NV_DEVICE_DIAGNOSTIC_CHECKPOINTS_EXTENSION_NAME);
+            set(Feature::DiagnosticCheckpoints);
+        }
+
+        if (supported.chainDeviceFault && supported.deviceFault.deviceFault) {
+            enabled.chainDeviceFault = true;
+            enabled.deviceFault.deviceFault = VK_TRUE;
+            negotiated.extensions.push_back(VK_EXT_DEVICE_FAULT_EXTENSION_NAME);
+            set(Feature::DeviceFault);
+
+            if (supported.deviceFault.deviceFaultVendorBinary) {
+                enabled.deviceFault.deviceFaultVendorBinary = VK_TRUE;
+                set(Feature::DeviceFaultVendorBinary);
+            }
+        }
+
+        // Asset packs map straight into device visible memory through host pointer imports,
+        // which need no feature bits, only the extension.
+        if (hasExtension(availableExtensions, VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME)) {
+            negotiated.extensions.push_back(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+            set(Feature::ExternalMemoryHost);
+        }
+
+        // GPU timestamps are put on the host clock with pairs of timestamps sampled together.
+        // The KHR extension is the EXT one promoted, and is preferred where both are offered.
+        if (hasExtension(availableExtensions, VK_KHR_CALIBRATED_TIMESTAMPS_EXTENSION_NAME)) {
+            negotiated.extensions.push_back(VK_KHR_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+            set(Feature::CalibratedTimestamps);
+        } else if (hasExtension(availableExtensions, VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME)) {
+            negotiated.extensions.push_back(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+            set(Feature::CalibratedTimestamps);
+        }
+
+        // Headless frames can be shared with other processes, which import the offscreen
+        // images and the frame timeline semaphore. The external memory and semaphore
+        // extensions are core, only the handle types are not.
+        #if defined(_WIN32)
+        constexpr auto exportMemoryExtension = VK_KHR_EXTERNAL_MEMORY_WIN32_EXTENSION_NAME;
+        constexpr auto exportSemaphoreExtension = VK_KHR_EXTERNAL_SEMAPHORE_WIN32_EXTENSION_NAME;
+        #else
+        constexpr auto exportMemoryExtension = VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME;
+        constexpr auto exportSemaphoreExtension = VK_KHR_EXTERNAL_SEMAPHORE_FD_EXTENSION_NAME;
+        #endif
+        if (!presentation && hasExtension(availableExtensions, exportMemoryExtension) && hasExtension(availableExtensions, exportSemaphoreExtension)) {
+            negotiated.extensions.push_back(exportMemoryExtension);
+            negotiated.extensions.push_back(exportSemaphoreExtension);
+            set(Feature::ExternalMemoryExport);
+        }
+
+        // Headless frames can also be encoded on a video encode queue, which only needs the
+        // extensions, the queue family and the profile are looked up when encoding starts.
+        if (
+            !presentation
+            && hasExtension(availableExtensions, VK_KHR_VIDEO_QUEUE_EXTENSION_NAME)
+            && hasExtension(availableExtensions, VK_KHR_VIDEO_ENCODE_QUEUE_EXTENSION_NAME)
+            && hasExtension(availableExtensions, VK_KHR_VIDEO_ENCODE_H264_EXTENSION_NAME)
+        ) {
+            negotiated.extensions.push_back(VK_KHR_VIDEO_QUEUE_EXTENSION_NAME);
+            negotiated.extensions.push_back(VK_KHR_VIDEO_ENCODE_QUEUE_EXTENSION_NAME);
+            negotiated.extensions.push_back(VK_KHR_VIDEO_ENCODE_H264_EXTENSION_NAME);
+            set(Feature::VideoEncodeH264);
+        }
+
+        // Present fences tell exactly when a retired swapchain and its semaphores are free,
+        // and swapchains switch between compatible present modes without being recreated.
+        if (presentation && surfaceMaintenance && supported.chainSwapchainMaintenance1 && supported.swapchainMaintenance1.swapchainMaintenance1) {
+            enabled.chainSwapchainMaintenance1 = true;
+            enabled.swapchainMaintenance1.swapchainMaintenance1 = VK_TRUE;
+            negotiated.extensions.push_back(VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME);
+            set(Feature::SwapchainMaintenance1);
+        }
+
+        // Fullscreen windows scan out of their swapchains directly instead of being composited.
+        // The surface queries that tell whether a monitor allows it take the capabilities2
+        // instance extension, which surface maintenance enables.
+        #if defined(_WIN32)
+        if (presentation && surfaceMaintenance && hasExtension(availableExtensions, VK_EXT_FULL_SCREEN_EXCLUSIVE_EXTENSION_NAME)) {
+            negotiated.extensions.push_back(VK_EXT_FULL_SCREEN_EXCLUSIVE_EXTENSION_NAME);
+            set(Feature::FullScreenExclusive);
+        }
+        #endif
+
+        if (presentation && hasExtension(availableExtensions, VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME)) {
+            negotiated.extensions.push_back(VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME);
+            set(Feature::DisplayTiming);
+        }
+
+        // The driver's frame pacing ties latency markers and submissions to presents by their
+        // present ids, so it needs those as well.
+        if (presentation && has(negotiated.features, Feature::PresentId) && hasExtension(availableExtensions, VK_NV_LOW_LATENCY_2_EXTENSION_NAME)) {
+            negotiated.extensions.push_back(VK_NV_LOW_LATENCY_2_EXTENSION_NAME);
+            set(Feature::LowLatency);
+        }
+
+        enabled.link();
+
+        return negotiated;
+    }
+
+    // Capability tiers, each the features the renderer takes from a Vulkan profile, and the
+    // fastest path of every subsystem that relies on them. The tier is picked once from what
+    // the device enabled, so each subsystem asks its tier instead of checking features itself.
+    enum class Tier : uint32_t {
+        // After `VP_LUNARG_minimum_requirements_1_3`, what mobile and portability devices offer,
+        // with multi draw indirect, without which no scene is drawn.
+        Portability,
+        // After `VP_LUNARG_desktop_baseline_2023`.
+        Desktop,
+        // The desktop baseline with mesh shaders and ray queries.
+        HighEnd,
+    };
+
+    constexpr auto TIERS = std::array { Tier::HighEnd, Tier::Desktop, Tier::Portability };
+
+    inline const char* tierToString(Tier tier) {
+        switch (tier) {
+            case Tier::Portability: return "portability";
+            case Tier::Desktop: return "desktop";
+            case Tier::HighEnd: return "high-end";
+        }
+
+        return "unknown";
+    }
+
+    inline const char* tierProfile(Tier tier) {
+        switch (tier) {
+            case Tier::Portability: return "VP_LUNARG_minimum_requirements_1_3";
+            case Tier::Desktop: return "VP_LUNARG_desktop_baseline_2023";
+            case Tier::HighEnd: return "VP_LUNARG_desktop_baseline_2023 with VK_EXT_mesh_shader and VK_KHR_ray_query";
+        }
+
+        return "unknown";
+    }
+
+    // Only the features of the profile some path relies on. The required ones every tier has.
+    inline FeatureSet tierFeatures(Tier tier) {
+        auto features = FeatureSet {};
+        const auto set = [&features](Feature feature) {
+            features.set(static_cast<size_t>(feature));
+        };
+
+        set(Feature::MultiDrawIndirect);
+        if (tier == Tier::Portability) {
+            return features;
+        }
+
+        set(Feature::DrawIndirectCount);
+        set(Feature::DescriptorIndexing);
+        set(Feature::BufferDeviceAddress);
+        set(Feature::SamplerAnisotropy);
+        if (tier == Tier::Desktop) {
+            return features;
+        }
+
+        set(Feature::MeshShader);
+        set(Feature::RayQuery);
+
+        return features;
+    }
+
+    // The highest tier `features` cover, no higher than `maxTier`, or nothing below the lowest.
+    inline std::optional<Tier> selectTier(const FeatureSet& features, Tier maxTier = Tier::HighEnd) {
+        for (const auto tier : TIERS) {
+            const auto required = tierFeatures(tier);
+            if (tier <= maxTier && (features & required) == required) {
+                return tier;
+            }
+        }
+
+        return std::nullopt;
+    }
+
+    // How the GPU driven scene culls: not at all when there is no scene, on the job system
+    // with multi draw indirect, or on the GPU with indirect count draws.
+    enum class SceneCulling : uint32_t {
+        None,
+        Cpu,
+        Gpu,
+    };
+
+    // The fastest path of each subsystem on a tier. Below every tier, all of them are off.
+    struct TierPaths {
+        // The bindless descriptor heap.
+        bool bindless = false;
+        SceneCulling sceneCulling = SceneCulling::None;
+        // Task and mesh shaders instead of the vertex pipeline in the GPU driven scene.
+        bool meshShading = false;
+        // Shadows and picking traced against acceleration structures.
+        bool rayQuery = false;
+    };
+
+    inline TierPaths tierPaths(std::optional<Tier> tier) {
+        if (!tier.has_value()) {
+            return TierPaths {};
+        }
+
+        return TierPaths {
+            .bindless = tier.value() >= Tier::Desktop,
+            .sceneCulling = tier.value() >= Tier::Desktop ? SceneCulling::Gpu : SceneCulling::Cpu,
+            .meshShading = tier.value() == Tier::HighEnd,
+            .rayQuery = tier.value() == Tier::HighEnd,
+        };
+    }
+}
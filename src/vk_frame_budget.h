@@ -0,0 +1,167 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+
+namespace vk_frame_budget {
+    using Clock = std::chrono::steady_clock;
+
+    // The per frame CPU work that is timed against a budget. The upload subsystems work
+    // through queues in chunks, and leave what does not fit for the next frame. The
+    // simulation cannot skip ticks without falling behind its clock, and a window cannot draw
+    // without its pipelines, so those two are only measured. Pipeline creation on the frame
+    // path is the cache probe and the unoptimized fallback of `PipelineCompiler`, whose
+    // optimized compiles run on the job system.
+    enum class Subsystem : uint32_t {
+        Simulation,
+        SceneUploads,
+        GlyphUploads,
+        PipelineCreation,
+        Count,
+    };
+
+    inline constexpr size_t SUBSYSTEM_COUNT = static_cast<size_t>(Subsystem::Count);
+
+    inline const char* subsystemToString(Subsystem subsystem) {
+        switch (subsystem) {
+            case Subsystem::Simulation: return "simulation";
+            case Subsystem::SceneUploads: return "sceneUploads";
+            case Subsystem::GlyphUploads: return "glyphUploads";
+            case Subsystem::PipelineCreation: return "pipelineCreation";
+            case Subsystem::Count: break;
+        }
+
+        return "unknown";
+    }
+
+    struct SubsystemStatistics {
+        // Frames the subsystem ran in.
+        uint64_t frameCount;
+        // Frames it went over its budget in, and frames it left work for the next one in.
+        uint64_t overrunCount;
+        uint64_t deferredCount;
+        double worstMilliseconds;
+    };
+
+    // Gives every subsystem a soft CPU time budget per frame. A subsystem opens a `Scope`
+    // around its work, and a chunked one asks the scope whether the budget has time left
+    // after every chunk, so a frame always makes progress on at least one chunk and stops
+    // once it has spent its share. Going over is never an error: the chunk in flight
+    // finishes, and the scope counts the frame as an overrun.
+    //
+    // The frame loop is the only writer. The counters are relaxed atomics, so the metrics
+    // server reads them from its own thread, like the frame telemetry.
+    class FrameBudget {
+        public:
+            // Enough for a few hundred small copies into the staging ring, which is most of a
+            // frame's streaming, at a fraction of a 60 Hz frame.
+            static constexpr double DEFAULT_BUDGET_MILLISECONDS = 1.0;
+
+            class Scope {
+                public:
+                    Scope(const Scope& other) = delete;
+                    Scope& operator=(const Scope& other) = delete;
+
+                    ~Scope() {
+                        m_budget.finish(m_subsystem, m_start, m_deferred);
+                    }
+
+                    // Whether another chunk fits in the frame. Without a budget there is always
+                    // time left.
+                    bool hasTimeLeft() const {
+                        return m_deadline == Clock::time_point::max() || Clock::now() < m_deadline;
+                    }
+
+                    // Marks that work is left for the next frame.
+                    void defer() {
+                        m_deferred = true;
+                    }
+                private:
+                    friend class FrameBudget;
+
+                    Scope(FrameBudget& budget, Subsystem subsystem, Clock::time_point start, Clock::time_point deadline)
+                        : m_budget { budget }, m_subsystem { subsystem }, m_start { start }, m_deadline { deadline } {}
+
+                    FrameBudget& m_budget;
+                    Subsystem m_subsystem;
+                    Clock::time_point m_start;
+                    Clock::time_point m_deadline;
+                    bool m_deferred = false;
+            };
+
+            explicit FrameBudget() {
+                m_budgets.fill(DEFAULT_BUDGET_MILLISECONDS);
+            }
+
+            FrameBudget(const FrameBudget& other) = delete;
+            FrameBudget& operator=(const FrameBudget& other) = delete;
+
+            // A budget of zero milliseconds leaves the subsystem unlimited, and only measured.
+            void setBudget(Subsystem subsystem, double milliseconds) {
+                m_budgets[static_cast<size_t>(subsystem)] = milliseconds > 0.0 ? milliseconds : 0.0;
+            }
+
+            double budget(Subsystem subsystem) const {
+                return m_budgets[static_cast<size_t>(subsystem)];
+            }
+
+            Scope begin(Subsystem subsystem) {
+                const auto start = Clock::now();
+                const auto milliseconds = this->budget(subsystem);
+                const auto deadline = milliseconds > 0.0
+                    ? start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli> { milliseconds })
+                    : Clock::time_point::max();
+
+                return Scope { *this, subsystem, start, deadline };
+            }
+
+            SubsystemStatistics statistics(Subsystem subsystem) const {
+                const auto& counters = m_counters[static_cast<size_t>(subsystem)];
+
+                return SubsystemStatistics {
+                    .frameCount = counters.frameCount.load(std::memory_order_relaxed),
+                    .overrunCount = counters.overrunCount.load(std::memory_order_relaxed),
+                    .deferredCount = counters.deferredCount.load(std::memory_order_relaxed),
+                    .worstMilliseconds = counters.worstMilliseconds.load(std::memory_order_relaxed),
+                };
+            }
+
+            // What the subsystem took in the frame it last ran in, in milliseconds.
+            double lastMilliseconds(Subsystem subsystem) const {
+                return m_counters[static_cast<size_t>(subsystem)].lastMilliseconds.load(std::memory_order_relaxed);
+            }
+        private:
+            struct Counters {
+                std::atomic<uint64_t> frameCount = 0;
+                std::atomic<uint64_t> overrunCount = 0;
+                std::atomic<uint64_t> deferredCount = 0;
+                std::atomic<double> lastMilliseconds = 0.0;
+                std::atomic<double> worstMilliseconds = 0.0;
+            };
+
+            std::array<double, SUBSYSTEM_COUNT> m_budgets {};
+            std::array<Counters, SUBSYSTEM_COUNT> m_counters {};
+
+            void finish(Subsystem subsystem, Clock::time_point start, bool deferred) {
+                const auto milliseconds = std::chrono::duration<double, std::milli> { Clock::now() - start }.count();
+                const auto budget = this->budget(subsystem);
+                auto& counters = m_counters[static_cast<size_t>(subsystem)];
+                counters.frameCount.fetch_add(1, std::memory_order_relaxed);
+                if (budget > 0.0 && milliseconds > budget) {
+                    counters.overrunCount.fetch_add(1, std::memory_order_relaxed);
+                }
+                if (deferred) {
+                    counters.deferredCount.fetch_add(1, std::memory_order_relaxed);
+                }
+
+                counters.lastMilliseconds.store(milliseconds, std::memory_order_relaxed);
+                if (milliseconds > counters.worstMilliseconds.load(std::memory_order_relaxed)) {
+                    counters.worstMilliseconds.store(milliseconds, std::memory_order_relaxed);
+                }
+            }
+    };
+}
@@ -0,0 +1,262 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <span>
+#include <system_error>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "vk_jobs.h"
+#include "vk_log.h"
+
+
+namespace vk_frame_dump {
+    // Encodes 8 bit RGBA or BGRA texels, read back tightly packed, as a QOI image of their
+    // colour, which drops the alpha. QOI compresses rendered frames about as well as a fast
+    // PNG at a fraction of the cost, and needs nothing beyond this loop. Returns nothing when
+    // the format has other texels.
+    inline std::vector<std::byte> encodeQoi(VkFormat format, VkExtent2D extent, std::span<const std::byte> texels) {
+        const bool bgra = format == VK_FORMAT_B8G8R8A8_UNORM || format == VK_FORMAT_B8G8R8A8_SRGB;
+        const bool rgba = format == VK_FORMAT_R8G8B8A8_UNORM || format == VK_FORMAT_R8G8B8A8_SRGB;
+        const auto pixelCount = size_t { extent.width } * extent.height;
+        if ((!bgra && !rgba) || texels.size() < pixelCount * 4) {
+            return {};
+        }
+
+        auto output = std::vector<std::byte> {};
+        // The worst case, every pixel written out in full, and the header and end marker.
+        output.reserve(pixelCount * 4 + 22);
+        const auto put = [&output](uint32_t value) {
+            output.push_back(static_cast<std::byte>(value));
+        };
+        const auto putBigEndian = [&put](uint32_t value) {
+            put(value >> 24);
+            put((value >> 16) & 0xFF);
+            put((value >> 8) & 0xFF);
+            put(value & 0xFF);
+        };
+
+        put('q');
+        put('o');
+        put('i');
+        put('f');
+        putBigEndian(extent.width);
+        putBigEndian(extent.height);
+        // Three channels of sRGB colour.
+        put(3);
+        put(0);
+
+        // Every pixel is opaque, while the index starts out transparent black.
+        using Pixel = std::array<uint8_t, 4>;
+        auto index = std::array<Pixel, 64> {};
+        auto previous = Pixel { 0, 0, 0, 255 };
+        uint32_t run = 0;
+        for (size_t i = 0; i < pixelCount; i++) {
+            const auto* texel = texels.data() + i * 4;
+            const auto pixel = Pixel {
+                static_cast<uint8_t>(texel[bgra ? 2 : 0]),
+                static_cast<uint8_t>(texel[1]),
+                static_cast<uint8_t>(texel[bgra ? 0 : 2]),
+                255,
+            };
+
+            if (pixel == previous) {
+                run++;
+                if (run == 62 || i + 1 == pixelCount) {
+                    put(0xC0 | (run - 1));
+                    run = 0;
+                }
+
+                continue;
+            }
+
+            if (run > 0) {
+                put(0xC0 | (run - 1));
+                run = 0;
+            }
+
+            const auto hash = (pixel[0] * 3 + pixel[1] * 5 + pixel[2] * 7 + pixel[3] * 11) % 64;
+            if (index[hash] == pixel) {
+                put(hash);
+            } else {
+                index[hash] = pixel;
+
+                const auto red = static_cast<int8_t>(pixel[0] - previous[0]);
+                const auto green = static_cast<int8_t>(pixel[1] - previous[1]);
+                const auto blue = static_cast<int8_t>(pixel[2] - previous[2]);
+                const auto redFromGreen = red - green;
+                const auto blueFromGreen = blue - green;
+                if (red >= -2 && red <= 1 && green >= -2 && green <= 1 && blue >= -2 && blue <= 1) {
+                    put(0x40 | ((red + 2) << 4) | ((green + 2) << 2) | (blue + 2));
+                } else if (green >= -32 && green <= 31 && redFromGreen >= -8 && redFromGreen <= 7 && blueFromGreen >= -8 && blueFromGreen <= 7) {
+                    put(0x80 | (green + 32));
+                    put(((redFromGreen + 8) << 4) | (blueFromGreen + 8));
+                } else {
+                    put(0xFE);
+                    put(pixel[0]);
+                    put(pixel[1]);
+                    put(pixel[2]);
+                }
+            }
+
+            previous = pixel;
+        }
+
+        for (uint32_t i = 0; i < 7; i++) {
+            put(0);
+        }
+        put(1);
+
+        return output;
+    }
+
+    struct FrameDumpSettings {
+        std::filesystem::path directory;
+        // Every frame whose number is a multiple of it is dumped.
+        uint32_t interval = 1;
+        // The frames read back or being encoded at once, beyond which frames are dropped.
+        uint32_t queueDepth = 8;
+    };
+
+    // Dumps every Nth frame to `directory` as `frame-<number>.qoi`. The frame loop reads the
+    // frames back, hands them over with `enqueue`, and `writeFinished` encodes and writes the
+    // ones whose readbacks are done on the job system. Nothing ever waits on the disk: a frame
+    // that comes up while the queue is full, or that does not fit in the readback ring, is
+    // dropped, so the renderer keeps its frame rate and the dump thins out instead.
+    class FrameDumper {
+        public:
+            explicit FrameDumper() = default;
+
+            FrameDumper(const FrameDumper& other) = delete;
+            FrameDumper& operator=(const FrameDumper& other) = delete;
+
+            void start(const FrameDumpSettings& settings) {
+                auto error = std::error_code {};
+                std::filesystem::create_directories(settings.directory, error);
+                if (error) {
+                    VK_LOG_WARNING("Failed to create the frame dump directory {}: {}", settings.directory.string(), error.message());
+                    return;
+                }
+
+                m_settings = settings;
+                m_running = true;
+                VK_LOG_INFO("Dumping one frame in {} to {}", m_settings.interval, m_settings.directory.string());
+            }
+
+            // The job system has to be stopped, which finishes every write still queued.
+            void stop() {
+                if (!m_running) {
+                    return;
+                }
+
+                m_pending.clear();
+                m_running = false;
+                VK_LOG_INFO(
+                    "Frame dump: {} frames written, {} dropped, {} failed",
+                    m_written.load(std::memory_order_relaxed),
+                    m_dropped,
+                    m_failed.load(std::memory_order_relaxed)
+                );
+            }
+
+            bool isRunning() const {
+                return m_running;
+            }
+
+            // Whether frame `frameNumber` is due and there is room in the queue for it. A due
+            // frame without room is counted as dropped.
+            bool wantsFrame(uint64_t frameNumber) {
+                if (!m_running || frameNumber % m_settings.interval != 0) {
+                    return false;
+                } else if (m_queued.load(std::memory_order_acquire) >= m_settings.queueDepth) {
+                    m_dropped++;
+                    return false;
+                }
+
+                return true;
+            }
+
+            // For a due frame that could not be read back.
+            void drop() {
+                m_dropped++;
+            }
+
+            void enqueue(uint64_t frameNumber, VkFormat format, VkExtent2D extent, std::future<std::vector<std::byte>> texels) {
+                m_queued.fetch_add(1, std::memory_order_acq_rel);
+                m_pending.push_back(PendingFrame {
+                    .frameNumber = frameNumber,
+                    .format = format,
+                    .extent = extent,
+                    .texels = std::move(texels),
+                });
+            }
+
+            // Hands the frames whose readbacks are done to the job system, in any order.
+            void writeFinished(vk_jobs::JobSystem& jobSystem) {
+                for (size_t i = 0; i < m_pending.size();) {
+                    auto& pending = m_pending[i];
+                    if (pending.texels.wait_for(std::chrono::seconds { 0 }) != std::future_status::ready) {
+                        i++;
+                        continue;
+                    }
+
+                    const auto texels = std::make_shared<std::vector<std::byte>>(pending.texels.get());
+                    const auto path = m_settings.directory / fmt::format("frame-{:06}.qoi", pending.frameNumber);
+                    jobSystem.submit([this, path, format = pending.format, extent = pending.extent, texels]() {
+                        this->write(path, format, extent, *texels);
+                    }, {}, vk_jobs::JobPriority::Background);
+
+                    m_pending[i] = std::move(m_pending.back());
+                    m_pending.pop_back();
+                }
+            }
+        private:
+            struct PendingFrame {
+                uint64_t frameNumber = 0;
+                VkFormat format = VK_FORMAT_UNDEFINED;
+                VkExtent2D extent {};
+                std::future<std::vector<std::byte>> texels;
+            };
+
+            FrameDumpSettings m_settings;
+            bool m_running = false;
+            std::vector<PendingFrame> m_pending;
+            // From `enqueue` until the frame is on disk, counted on the job system's threads.
+            std::atomic<uint32_t> m_queued = 0;
+            std::atomic<uint64_t> m_written = 0;
+            std::atomic<uint64_t> m_failed = 0;
+            uint64_t m_dropped = 0;
+
+            void write(const std::filesystem::path& path, VkFormat format, VkExtent2D extent, std::span<const std::byte> texels) {
+                const auto image = encodeQoi(format, extent, texels);
+                bool written = false;
+                if (!image.empty()) {
+                    auto file = std::ofstream { path, std::ios::binary | std::ios::trunc };
+                    file.write(reinterpret_cast<const char*>(image.data()), static_cast<std::streamsize>(image.size()));
+                    written = static_cast<bool>(file);
+                }
+
+                if (!written) {
+                    // Only the first failure is worth a warning, the rest fail the same way.
+                    if (m_failed.fetch_add(1, std::memory_order_relaxed) == 0) {
+                        VK_LOG_WARNING("Failed to dump a frame to {}", path.string());
+                    }
+                } else {
+                    m_written.fetch_add(1, std::memory_order_relaxed);
+                }
+
+                m_queued.fetch_sub(1, std::memory_order_acq_rel);
+            }
+    };
+}
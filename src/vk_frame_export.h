@@ -0,0 +1,465 @@
+#pragma once
+
+#include "vk_dispatch.h"
+#include "vk_log.h"
+#include "vk_socket.h"
+#include "vk_tracing.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <iterator>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fmt/core.h>
+#include <fmt/format.h>
+
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+
+
+namespace vk_frame_export {
+    // Opaque handles only import into the same driver on the same device, which is what a
+    // compositor or an encoder on the same GPU has.
+    #if defined(_WIN32)
+    constexpr auto MEMORY_HANDLE_TYPE = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_WIN32_BIT;
+    constexpr auto SEMAPHORE_HANDLE_TYPE = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_WIN32_BIT;
+    using Handle = HANDLE;
+    #else
+    constexpr auto MEMORY_HANDLE_TYPE = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT;
+    constexpr auto SEMAPHORE_HANDLE_TYPE = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_FD_BIT;
+    using Handle = int;
+    #endif
+
+    // The layout, and the usage consumers create their images with, of every exported frame.
+    // Frames are released to `VK_QUEUE_FAMILY_EXTERNAL` in this layout.
+    constexpr auto EXPORTED_LAYOUT = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+    // Whether the driver exports images made with `createInfo`, and whether it only exports
+    // them with memory of their own.
+    inline bool canExportImages(VkPhysicalDevice physicalDevice, const VkImageCreateInfo& createInfo) {
+        const auto externalInfo = VkPhysicalDeviceExternalImageFormatInfo {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_IMAGE_FORMAT_INFO,
+            .handleType = MEMORY_HANDLE_TYPE,
+        };
+        const auto formatInfo = VkPhysicalDeviceImageFormatInfo2 {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGE_FORMAT_INFO_2,
+            .pNext = &externalInfo,
+            .format = createInfo.format,
+            .type = createInfo.imageType,
+            .tiling = createInfo.tiling,
+            .usage = createInfo.usage,
+            .flags = createInfo.flags,
+        };
+        auto externalProperties = VkExternalImageFormatProperties {
+            .sType = VK_STRUCTURE_TYPE_EXTERNAL_IMAGE_FORMAT_PROPERTIES,
+        };
+        auto properties = VkImageFormatProperties2 {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_FORMAT_PROPERTIES_2,
+            .pNext = &externalProperties,
+        };
+
+        const auto result = vkGetPhysicalDeviceImageFormatProperties2(physicalDevice, &formatInfo, &properties);
+
+        return result == VK_SUCCESS && (externalProperties.externalMemoryProperties.externalMemoryFeatures & VK_EXTERNAL_MEMORY_FEATURE_EXPORTABLE_BIT);
+    }
+
+    inline bool canExportTimelineSemaphores(VkPhysicalDevice physicalDevice) {
+        const auto typeInfo = VkSemaphoreTypeCreateInfo {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+            .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+            .initialValue = 0,
+        };
+        const auto externalInfo = VkPhysicalDeviceExternalSemaphoreInfo {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_SEMAPHORE_INFO,
+            .pNext = &typeInfo,
+            .handleType = SEMAPHORE_HANDLE_TYPE,
+        };
+        auto properties = VkExternalSemaphoreProperties {
+            .sType = VK_STRUCTURE_TYPE_EXTERNAL_SEMAPHORE_PROPERTIES,
+        };
+
+        vkGetPhysicalDeviceExternalSemaphoreProperties(physicalDevice, &externalInfo, &properties);
+
+        return properties.externalSemaphoreFeatures & VK_EXTERNAL_SEMAPHORE_FEATURE_EXPORTABLE_BIT;
+    }
+
+    // What consumers need to create and import their own copies of the exported images.
+    struct ExportedImages {
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        VkExtent2D extent = {};
+        VkImageUsageFlags usage = 0;
+        std::vector<VkDeviceMemory> memories;
+        std::vector<VkDeviceSize> sizes;
+        std::vector<uint32_t> memoryTypeIndices;
+    };
+
+    // Shares the offscreen images of a headless run, and the frame timeline semaphore, with
+    // other processes on the same machine, like a video encoder or a compositor, which import
+    // them and read the frames where the renderer left them, without a copy or a readback.
+    //
+    // Consumers connect to a local socket and first get one line describing the images:
+    //
+    //     hello images=<n> width=<w> height=<h> format=<VkFormat> usage=<VkImageUsageFlags>
+    //         layout=<VkImageLayout> deviceUuid=<hex> driverUuid=<hex> sizes=<s,...>
+    //         memoryTypes=<i,...> dedicated=1
+    //
+    // on one line, sent along with a file descriptor for the memory of every image and then
+    // one for the timeline semaphore. On Windows, which cannot send handles over a socket,
+    // the line ends with `handles=<name,...>`, the names of the same objects, for consumers
+    // to import by name. Then each frame sends `frame <n> image <i> value <v>`: frame `n`
+    // rendered into image `i`, which is ready once the timeline semaphore reaches `v`. The
+    // line goes out when the frame is submitted, so a consumer waits for the value on the
+    // GPU, and consumers that fall behind only get the newest frame.
+    //
+    // The renderer never waits for consumers. Image `i` is rendered to again by the frame
+    // `framesInFlight` after the one that last used it, which starts once the timeline
+    // semaphore reaches the value of the frame before that, so a consumer has to be done
+    // with an image within `framesInFlight - 1` frames, or copy it. Consumers whose socket
+    // fills up are dropped.
+    class FrameExporter {
+        public:
+            static constexpr auto POLL_INTERVAL = std::chrono::milliseconds { 100 };
+            static constexpr size_t MAX_CONSUMERS = 8;
+
+            explicit FrameExporter() = default;
+
+            FrameExporter(const FrameExporter& other) = delete;
+            FrameExporter& operator=(const FrameExporter& other) = delete;
+
+            ~FrameExporter() {
+                this->stop();
+            }
+
+            // Makes the export chains of `imageCount` images and the timeline semaphore, which
+            // must be handed to their creation before `start`.
+            void prepare(size_t imageCount) {
+                m_memoryExportInfos.assign(imageCount, VkExportMemoryAllocateInfo {
+                    .sType = VK_STRUCTURE_TYPE_EXPORT_MEMORY_ALLOCATE_INFO,
+                    .handleTypes = MEMORY_HANDLE_TYPE,
+                });
+                m_semaphoreExportInfo = VkExportSemaphoreCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_EXPORT_SEMAPHORE_CREATE_INFO,
+                    .handleTypes = SEMAPHORE_HANDLE_TYPE,
+                };
+
+                #if defined(_WIN32)
+                // Named objects live as long as a handle to them is open, which the exporter
+                // keeps until it stops.
+                const auto processId = GetCurrentProcessId();
+                m_handleNames.clear();
+                for (size_t i = 0; i < imageCount; i++) {
+                    m_handleNames.push_back(fmt::format("Local\\HelloWindow-{}-image-{}", processId, i));
+                }
+                m_handleNames.push_back(fmt::format("Local\\HelloWindow-{}-frames", processId));
+
+                m_wideHandleNames.clear();
+                for (const auto& name : m_handleNames) {
+                    m_wideHandleNames.emplace_back(name.begin(), name.end());
+                }
+
+                m_memoryWin32ExportInfos.clear();
+                for (size_t i = 0; i < imageCount; i++) {
+                    m_memoryWin32ExportInfos.push_back(VkExportMemoryWin32HandleInfoKHR {
+                        .sType = VK_STRUCTURE_TYPE_EXPORT_MEMORY_WIN32_HANDLE_INFO_KHR,
+                        .dwAccess = GENERIC_ALL,
+                        .name = m_wideHandleNames[i].c_str(),
+                    });
+                }
+                for (size_t i = 0; i < imageCount; i++) {
+                    m_memoryExportInfos[i].pNext = &m_memoryWin32ExportInfos[i];
+                }
+
+                m_semaphoreWin32ExportInfo = VkExportSemaphoreWin32HandleInfoKHR {
+                    .sType = VK_STRUCTURE_TYPE_EXPORT_SEMAPHORE_WIN32_HANDLE_INFO_KHR,
+                    .dwAccess = GENERIC_ALL,
+                    .name = m_wideHandleNames.back().c_str(),
+                };
+                m_semaphoreExportInfo.pNext = &m_semaphoreWin32ExportInfo;
+                #endif
+            }
+
+            bool isPrepared() const {
+                return !m_memoryExportInfos.empty();
+            }
+
+            // For `vk_memory::AllocationCreateInfo::exportInfo`.
+            const void* memoryExportInfo(size_t imageIndex) const {
+                return &m_memoryExportInfos[imageIndex];
+            }
+
+            // For the `pNext` of the timeline semaphore's `VkSemaphoreTypeCreateInfo`.
+            const void* semaphoreExportInfo() const {
+                return &m_semaphoreExportInfo;
+            }
+
+            void start(
+                const std::filesystem::path& path,
+                VkPhysicalDevice physicalDevice,
+                VkDevice device,
+                const ExportedImages& images,
+                VkSemaphore frameTimelineSemaphore
+            ) {
+                if (m_thread.joinable()) {
+                    return;
+                }
+
+                m_device = device;
+                this->exportHandles(images, frameTimelineSemaphore);
+                m_hello = this->describe(physicalDevice, images);
+                try {
+                    m_listener.listen(path, "frame consumers");
+                } catch (...) {
+                    this->closeHandles();
+                    throw;
+                }
+
+                m_running = true;
+                m_thread = std::thread { [this]() { this->serveLoop(); } };
+                VK_LOG_INFO("Exporting {} offscreen images to frame consumers at {}", images.memories.size(), path.string());
+            }
+
+            void stop() {
+                {
+                    const auto lock = std::scoped_lock { m_mutex };
+                    m_running = false;
+                }
+
+                m_changed.notify_all();
+                if (m_thread.joinable()) {
+                    m_thread.join();
+                }
+
+                m_listener.close();
+                this->closeHandles();
+            }
+
+            bool isRunning() const {
+                const auto lock = std::scoped_lock { m_mutex };
+
+                return m_running;
+            }
+
+            // Tells consumers frame `frame` went into image `imageIndex`, at the cost of a short
+            // lock once a frame.
+            void publish(uint64_t frame, uint32_t imageIndex) {
+                {
+                    const auto lock = std::scoped_lock { m_mutex };
+                    if (!m_running) {
+                        return;
+                    }
+
+                    m_latest = PublishedFrame { .frame = frame, .imageIndex = imageIndex };
+                }
+
+                m_changed.notify_one();
+            }
+        private:
+            struct PublishedFrame {
+                uint64_t frame = 0;
+                uint32_t imageIndex = 0;
+            };
+
+            std::vector<VkExportMemoryAllocateInfo> m_memoryExportInfos;
+            VkExportSemaphoreCreateInfo m_semaphoreExportInfo = {};
+            #if defined(_WIN32)
+            std::vector<std::string> m_handleNames;
+            std::vector<std::wstring> m_wideHandleNames;
+            std::vector<VkExportMemoryWin32HandleInfoKHR> m_memoryWin32ExportInfos;
+            VkExportSemaphoreWin32HandleInfoKHR m_semaphoreWin32ExportInfo = {};
+            #endif
+
+            VkDevice m_device = VK_NULL_HANDLE;
+            // The images' handles, then the semaphore's.
+            std::vector<Handle> m_handles;
+            std::string m_hello;
+
+            std::thread m_thread;
+            vk_socket::Listener m_listener;
+            mutable std::mutex m_mutex;
+            std::condition_variable m_changed;
+            bool m_running = false;
+            std::optional<PublishedFrame> m_latest;
+
+            // The server thread's.
+            std::vector<vk_socket::Socket> m_consumers;
+
+            void exportHandles(const ExportedImages& images, VkSemaphore frameTimelineSemaphore) {
+                for (const auto memory : images.memories) {
+                    #if defined(_WIN32)
+                    const auto getInfo = VkMemoryGetWin32HandleInfoKHR {
+                        .sType = VK_STRUCTURE_TYPE_MEMORY_GET_WIN32_HANDLE_INFO_KHR,
+                        .memory = memory,
+                        .handleType = MEMORY_HANDLE_TYPE,
+                    };
+                    auto handle = Handle {};
+                    const auto result = vkGetMemoryWin32HandleKHR(m_device, &getInfo, &handle);
+                    #else
+                    const auto getInfo = VkMemoryGetFdInfoKHR {
+                        .sType = VK_STRUCTURE_TYPE_MEMORY_GET_FD_INFO_KHR,
+                        .memory = memory,
+                        .handleType = MEMORY_HANDLE_TYPE,
+                    };
+                    auto handle = Handle { -1 };
+                    const auto result = vkGetMemoryFdKHR(m_device, &getInfo, &handle);
+                    #endif
+                    if (result != VK_SUCCESS) {
+                        this->closeHandles();
+                        throw std::runtime_error("failed to export the memory of an offscreen image!");
+                    }
+
+                    m_handles.push_back(handle);
+                }
+
+                #if defined(_WIN32)
+                const auto getInfo = VkSemaphoreGetWin32HandleInfoKHR {
+                    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_GET_WIN32_HANDLE_INFO_KHR,
+                    .semaphore = frameTimelineSemaphore,
+                    .handleType = SEMAPHORE_HANDLE_TYPE,
+                };
+                auto handle = Handle {};
+                const auto result = vkGetSemaphoreWin32HandleKHR(m_device, &getInfo, &handle);
+                #else
+                const auto getInfo = VkSemaphoreGetFdInfoKHR {
+                    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_GET_FD_INFO_KHR,
+                    .semaphore = frameTimelineSemaphore,
+                    .handleType = SEMAPHORE_HANDLE_TYPE,
+                };
+                auto handle = Handle { -1 };
+                const auto result = vkGetSemaphoreFdKHR(m_device, &getInfo, &handle);
+                #endif
+                if (result != VK_SUCCESS) {
+                    this->closeHandles();
+                    throw std::runtime_error("failed to export the frame timeline semaphore!");
+                }
+
+                m_handles.push_back(handle);
+            }
+
+            void closeHandles() {
+                for (const auto handle : m_handles) {
+                    #if defined(_WIN32)
+                    CloseHandle(handle);
+                    #else
+                    close(handle);
+                    #endif
+                }
+
+                m_handles.clear();
+            }
+
+            std::string describe(VkPhysicalDevice physicalDevice, const ExportedImages& images) const {
+                auto idProperties = VkPhysicalDeviceIDProperties {
+                    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES,
+                };
+                auto properties = VkPhysicalDeviceProperties2 {
+                    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+                    .pNext = &idProperties,
+                };
+                vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+                auto hello = fmt::memory_buffer {};
+                auto out = std::back_inserter(hello);
+                fmt::format_to(
+                    out,
+                    "hello images={} width={} height={} format={} usage={} layout={} deviceUuid={:02x} driverUuid={:02x} sizes={} memoryTypes={} dedicated=1",
+                    images.memories.size(),
+                    images.extent.width,
+                    images.extent.height,
+                    static_cast<int32_t>(images.format),
+                    images.usage,
+                    static_cast<int32_t>(EXPORTED_LAYOUT),
+                    fmt::join(idProperties.deviceUUID, ""),
+                    fmt::join(idProperties.driverUUID, ""),
+                    fmt::join(images.sizes, ","),
+                    fmt::join(images.memoryTypeIndices, ",")
+                );
+                #if defined(_WIN32)
+                fmt::format_to(out, " handles={}", fmt::join(m_handleNames, ","));
+                #endif
+                hello.push_back('\n');
+
+                return fmt::to_string(hello);
+            }
+
+            void serveLoop() {
+                vk_tracing::setThreadName("frame export");
+                auto sentFrame = std::optional<uint64_t> {};
+                while (true) {
+                    auto latest = std::optional<PublishedFrame> {};
+                    {
+                        auto lock = std::unique_lock { m_mutex };
+                        m_changed.wait_for(lock, POLL_INTERVAL, [this, &sentFrame]() {
+                            return !m_running || (m_latest.has_value() && m_latest->frame != sentFrame);
+                        });
+                        if (!m_running) {
+                            break;
+                        }
+
+                        latest = m_latest;
+                    }
+
+                    while (const auto consumer = m_listener.accept(std::chrono::milliseconds { 0 })) {
+                        this->welcome(consumer.value());
+                    }
+
+                    if (latest.has_value() && latest->frame != sentFrame) {
+                        this->broadcast(latest.value());
+                        sentFrame = latest->frame;
+                    }
+                }
+
+                for (const auto consumer : m_consumers) {
+                    vk_socket::closeSocket(consumer);
+                }
+
+                m_consumers.clear();
+            }
+
+            // The description blocks, since the consumer only just connected, and nothing
+            // after it does.
+            void welcome(vk_socket::Socket consumer) {
+                if (m_consumers.size() >= MAX_CONSUMERS) {
+                    vk_socket::sendAll(consumer, "error too many frame consumers\n");
+                    vk_socket::closeSocket(consumer);
+                    return;
+                }
+
+                #if defined(_WIN32)
+                const bool sent = vk_socket::sendAll(consumer, m_hello);
+                #else
+                const bool sent = vk_socket::sendWithDescriptors(consumer, m_hello, m_handles);
+                #endif
+                if (!sent) {
+                    vk_socket::closeSocket(consumer);
+                    return;
+                }
+
+                vk_socket::setNonBlocking(consumer);
+                m_consumers.push_back(consumer);
+                VK_LOG_INFO("A frame consumer connected, {} connected", m_consumers.size());
+            }
+
+            void broadcast(const PublishedFrame& published) {
+                const auto line = fmt::format("frame {} image {} value {}\n", published.frame, published.imageIndex, published.frame + 1);
+                std::erase_if(m_consumers, [&line](vk_socket::Socket consumer) {
+                    if (vk_socket::sendAll(consumer, line)) {
+                        return false;
+                    }
+
+                    vk_socket::closeSocket(consumer);
+                    VK_LOG_INFO("A frame consumer disconnected or fell behind");
+
+                    return true;
+                });
+            }
+    };
+}
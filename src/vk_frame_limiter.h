@@ -0,0 +1,162 @@
+#pragma once
+
+// Pulls in `windows.h` on Windows, with the same macros as everywhere else.
+#include "vk_dispatch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+
+#if defined(_WIN32)
+// High resolution waitable timers need Windows 10 1803, and older SDKs lack the flag.
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#elif defined(__linux__)
+#include <cerrno>
+#include <time.h>
+#endif
+
+
+namespace vk_frame_limiter {
+    using Clock = std::chrono::steady_clock;
+
+    // Caps the frame rate at a target, so present modes that never block, like mailbox and
+    // immediate, do not render frames nobody sees at full power. Each frame sleeps until its
+    // slot with the platform's high resolution timer, stopping short of it by a margin, and
+    // spins through the margin, which would otherwise be lost to the timer's wake-up
+    // latency. The margin follows the worst recent oversleep, so the sleep gets as close as
+    // the timer allows on this machine, and the spin stays short.
+    class FrameLimiter {
+        public:
+            // The margin never shrinks below what a wake-up costs on a quiet machine, and never
+            // grows past what a busy one costs.
+            static constexpr auto MIN_SPIN_MARGIN = std::chrono::microseconds { 50 };
+            static constexpr auto MAX_SPIN_MARGIN = std::chrono::milliseconds { 4 };
+            static constexpr auto SPIN_HEADROOM = std::chrono::microseconds { 100 };
+
+            explicit FrameLimiter() = default;
+
+            FrameLimiter(const FrameLimiter& other) = delete;
+            FrameLimiter& operator=(const FrameLimiter& other) = delete;
+
+            void init() {
+                #if defined(_WIN32)
+                // Older versions only get the scheduler tick, which the margin then grows to
+                // cover.
+                m_timer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+                if (m_timer == nullptr) {
+                    m_timer = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+                }
+                if (m_timer == nullptr) {
+                    throw std::runtime_error("failed to create frame limiter timer!");
+                }
+                #endif
+            }
+
+            void destroy() {
+                #if defined(_WIN32)
+                if (m_timer != nullptr) {
+                    CloseHandle(m_timer);
+                    m_timer = nullptr;
+                }
+                #endif
+            }
+
+            // A target of zero frames per second turns the limiter off.
+            void setTargetFps(double targetFps) {
+                m_targetFps = std::max(targetFps, 0.0);
+                m_period = m_targetFps > 0.0
+                    ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double> { 1.0 / m_targetFps })
+                    : Clock::duration::zero();
+                m_nextFrame.reset();
+            }
+
+            double targetFps() const {
+                return m_targetFps;
+            }
+
+            bool isEnabled() const {
+                return m_period > Clock::duration::zero();
+            }
+
+            // While nothing is rendered, like when every window is minimized, the schedule is
+            // dropped, so the first frame after does not count as late.
+            void pause() {
+                m_nextFrame.reset();
+            }
+
+            // Blocks until the next frame's slot. A frame that is over a whole period late
+            // starts the schedule over instead of letting the frames after it catch up in a
+            // burst.
+            void wait() {
+                if (!this->isEnabled()) {
+                    return;
+                }
+
+                const auto now = Clock::now();
+                if (!m_nextFrame.has_value() || now > m_nextFrame.value() + m_period) {
+                    m_nextFrame = now + m_period;
+                    return;
+                }
+
+                const auto deadline = m_nextFrame.value();
+                this->sleepUntil(deadline);
+                m_nextFrame = deadline + m_period;
+            }
+        private:
+            double m_targetFps = 0.0;
+            Clock::duration m_period = Clock::duration::zero();
+            std::optional<Clock::time_point> m_nextFrame;
+            std::chrono::nanoseconds m_spinMargin = std::chrono::milliseconds { 1 };
+            #if defined(_WIN32)
+            HANDLE m_timer = nullptr;
+            #endif
+
+            void sleepUntil(Clock::time_point deadline) {
+                const auto wakeAt = deadline - m_spinMargin;
+                if (Clock::now() < wakeAt) {
+                    this->coarseSleepUntil(wakeAt);
+
+                    // Grow right away to cover an oversleep, and shrink slowly after one.
+                    const auto overshoot = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - wakeAt);
+                    const auto decayed = m_spinMargin - m_spinMargin / 64;
+                    m_spinMargin = std::clamp<std::chrono::nanoseconds>(
+                        std::max<std::chrono::nanoseconds>(overshoot + SPIN_HEADROOM, decayed),
+                        MIN_SPIN_MARGIN,
+                        MAX_SPIN_MARGIN
+                    );
+                }
+
+                while (Clock::now() < deadline) {
+                    std::this_thread::yield();
+                }
+            }
+
+            void coarseSleepUntil(Clock::time_point wakeAt) {
+                #if defined(_WIN32)
+                // Negative due times are relative, in 100 nanosecond units.
+                const auto remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(wakeAt - Clock::now());
+                auto dueTime = LARGE_INTEGER {};
+                dueTime.QuadPart = -std::max<LONGLONG>(remaining.count() / 100, 1);
+                if (SetWaitableTimer(m_timer, &dueTime, 0, nullptr, nullptr, FALSE)) {
+                    WaitForSingleObject(m_timer, INFINITE);
+                }
+                #elif defined(__linux__)
+                // `steady_clock` is `CLOCK_MONOTONIC` on Linux, so the deadline is absolute and
+                // time spent getting here does not add to the sleep.
+                const auto sinceEpoch = std::chrono::duration_cast<std::chrono::nanoseconds>(wakeAt.time_since_epoch());
+                const auto request = timespec {
+                    .tv_sec = static_cast<time_t>(sinceEpoch.count() / 1'000'000'000),
+                    .tv_nsec = static_cast<long>(sinceEpoch.count() % 1'000'000'000),
+                };
+                while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &request, nullptr) == EINTR) {
+                }
+                #else
+                std::this_thread::sleep_until(wakeAt);
+                #endif
+            }
+    };
+}
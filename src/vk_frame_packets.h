@@ -0,0 +1,161 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+
+
+namespace vk_frame_packets {
+    // The simulation writes one packet while the render thread reads the other.
+    constexpr size_t PACKET_COUNT = 2;
+    constexpr size_t ARENA_ALIGNMENT = 64;
+
+    // Bump allocates the arrays of a packet from one block, and frees them all at once when the
+    // packet is written again, so a tick's snapshot costs no heap allocations.
+    class LinearArena {
+        public:
+            explicit LinearArena() = default;
+
+            LinearArena(const LinearArena& other) = delete;
+            LinearArena& operator=(const LinearArena& other) = delete;
+
+            void init(size_t capacity) {
+                m_memory.reset(static_cast<std::byte*>(::operator new(capacity, std::align_val_t { ARENA_ALIGNMENT })));
+                m_capacity = capacity;
+                m_used = 0;
+            }
+
+            void reset() {
+                m_used = 0;
+            }
+
+            // An array of `count` default initialized elements, aligned to at least a cache line.
+            template <typename T>
+            std::span<T> allocate(size_t count) {
+                static_assert(std::is_trivially_destructible_v<T>, "the arena never runs destructors");
+                static_assert(alignof(T) <= ARENA_ALIGNMENT, "arena allocations are aligned to a cache line");
+                const auto offset = (m_used + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT;
+                if (offset + count * sizeof(T) > m_capacity) {
+                    throw std::runtime_error("failed to allocate from the frame packet arena, out of space!");
+                }
+
+                m_used = offset + count * sizeof(T);
+                auto* elements = reinterpret_cast<T*>(m_memory.get() + offset);
+                std::uninitialized_default_construct_n(elements, count);
+
+                return { elements, count };
+            }
+
+            size_t used() const {
+                return m_used;
+            }
+
+            size_t capacity() const {
+                return m_capacity;
+            }
+        private:
+            struct Deleter {
+                void operator()(std::byte* memory) const {
+                    ::operator delete(memory, std::align_val_t { ARENA_ALIGNMENT });
+                }
+            };
+
+            std::unique_ptr<std::byte, Deleter> m_memory;
+            size_t m_capacity = 0;
+            size_t m_used = 0;
+    };
+
+    // The snapshot of one simulation tick: whatever the renderer needs of it in `contents`,
+    // whose arrays live in `arena`.
+    template <typename Contents>
+    struct FramePacket {
+        uint64_t tick = 0;
+        LinearArena arena;
+        Contents contents {};
+    };
+
+    // Hands packets from one simulation thread to one render thread, without locks, so the
+    // simulation of tick N + 1 overlaps the rendering of tick N.
+    //
+    // The simulation writes packets in turn and publishes each one whole, after which it is
+    // immutable, and the render thread acquires every packet in the order they were published
+    // and releases it once it is done reading. Two counters order the handoff: a packet's slot
+    // is only written again once the render thread released the packet before it, and a
+    // packet is only read once it was published. Either side waits on the other's counter
+    // when it gets two packets ahead, which with one packet being written and one being read
+    // only happens when one side falls a whole tick behind.
+    template <typename Contents>
+    class FramePacketExchange {
+        public:
+            using Packet = FramePacket<Contents>;
+
+            explicit FramePacketExchange() = default;
+
+            FramePacketExchange(const FramePacketExchange& other) = delete;
+            FramePacketExchange& operator=(const FramePacketExchange& other) = delete;
+
+            // Every packet's arena holds `arenaCapacity` bytes. Not thread safe, the
+            // exchange has to be idle.
+            void init(size_t arenaCapacity) {
+                for (auto& packet : m_packets) {
+                    packet.arena.init(arenaCapacity);
+                    packet.contents = Contents {};
+                }
+
+                m_written = 0;
+                m_acquired = 0;
+                m_published.store(0, std::memory_order_relaxed);
+                m_released.store(0, std::memory_order_relaxed);
+            }
+
+            // The simulation side: the next packet to fill, with its arena emptied, once the
+            // render thread released the packet that last used its slot.
+            Packet& beginWrite() {
+                for (auto released = m_released.load(std::memory_order_acquire); m_written - released >= PACKET_COUNT; released = m_released.load(std::memory_order_acquire)) {
+                    m_released.wait(released, std::memory_order_acquire);
+                }
+
+                auto& packet = m_packets[m_written % PACKET_COUNT];
+                packet.tick = m_written;
+                packet.arena.reset();
+                packet.contents = Contents {};
+
+                return packet;
+            }
+
+            void publish() {
+                m_written++;
+                m_published.store(m_written, std::memory_order_release);
+                m_published.notify_one();
+            }
+
+            // The render side: the next packet in order, once it was published.
+            const Packet& acquire() {
+                for (auto published = m_published.load(std::memory_order_acquire); published <= m_acquired; published = m_published.load(std::memory_order_acquire)) {
+                    m_published.wait(published, std::memory_order_acquire);
+                }
+
+                return m_packets[m_acquired % PACKET_COUNT];
+            }
+
+            void release() {
+                m_acquired++;
+                m_released.store(m_acquired, std::memory_order_release);
+                m_released.notify_one();
+            }
+        private:
+            std::array<Packet, PACKET_COUNT> m_packets;
+            // Only the simulation side touches `m_written`, and only the render side
+            // `m_acquired`.
+            uint64_t m_written = 0;
+            uint64_t m_acquired = 0;
+            alignas(64) std::atomic<uint64_t> m_published = 0;
+            alignas(64) std::atomic<uint64_t> m_released = 0;
+    };
+}
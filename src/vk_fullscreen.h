@@ -0,0 +1,193 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <atomic>
+#include <cstdint>
+
+#include <GLFW/glfw3.h>
+
+#if defined(_WIN32)
+#define GLFW_EXPOSE_NATIVE_WIN32
+#include <GLFW/glfw3native.h>
+#endif
+
+
+namespace vk_fullscreen {
+    // How far a fullscreen window got with `VK_EXT_full_screen_exclusive`, which only Windows
+    // drivers offer.
+    //
+    // * `Unavailable` leaves the swapchain to the driver, which is also what every window that
+    //   is not fullscreen gets.
+    // * `Requested` creates the swapchain application controlled, and acquires exclusivity
+    //   before the next image.
+    // * `Acquired` scans out of the swapchain directly, with flip model presents that DWM does
+    //   not compose, so immediate presents tear free of the compositor's latency.
+    // * `Lost` went back to a composited swapchain that disallows exclusivity, after an alt-tab
+    //   or another application took the display, until the window has the focus again.
+    enum class Exclusivity {
+        Unavailable,
+        Requested,
+        Acquired,
+        Lost,
+    };
+
+    inline const char* exclusivityToString(Exclusivity exclusivity) {
+        switch (exclusivity) {
+            case Exclusivity::Unavailable: return "unavailable";
+            case Exclusivity::Requested: return "requested";
+            case Exclusivity::Acquired: return "acquired";
+            case Exclusivity::Lost: return "lost";
+        }
+
+        return "unknown";
+    }
+
+    // Monitor `index` in GLFW's order, which starts with the primary monitor, or null when
+    // there are fewer.
+    inline GLFWmonitor* findMonitor(uint32_t index) {
+        int monitorCount = 0;
+        GLFWmonitor** monitors = glfwGetMonitors(&monitorCount);
+        if (monitors == nullptr || index >= static_cast<uint32_t>(monitorCount)) {
+            return nullptr;
+        }
+
+        return monitors[index];
+    }
+
+    // The monitor `window` is shown on: the one it is fullscreen on, or else the one its
+    // center is on, or the primary monitor where it is on none, like on Wayland, which keeps
+    // window positions to itself. GLFW only answers on the main thread.
+    inline GLFWmonitor* windowMonitor(GLFWwindow* window) {
+        if (auto* fullscreenMonitor = glfwGetWindowMonitor(window); fullscreenMonitor != nullptr) {
+            return fullscreenMonitor;
+        }
+
+        int x = 0;
+        int y = 0;
+        int width = 0;
+        int height = 0;
+        glfwGetWindowPos(window, &x, &y);
+        glfwGetWindowSize(window, &width, &height);
+        const int centerX = x + width / 2;
+        const int centerY = y + height / 2;
+
+        int monitorCount = 0;
+        GLFWmonitor** monitors = glfwGetMonitors(&monitorCount);
+        for (int i = 0; monitors != nullptr && i < monitorCount; i++) {
+            int monitorX = 0;
+            int monitorY = 0;
+            glfwGetMonitorPos(monitors[i], &monitorX, &monitorY);
+            const auto* videoMode = glfwGetVideoMode(monitors[i]);
+            if (videoMode != nullptr
+                && centerX >= monitorX && centerX < monitorX + videoMode->width
+                && centerY >= monitorY && centerY < monitorY + videoMode->height
+            ) {
+                return monitors[i];
+            }
+        }
+
+        return glfwGetPrimaryMonitor();
+    }
+
+    // The refresh rate of `monitor`'s current mode in Hz, or 0 without a monitor or a mode.
+    inline int refreshRate(GLFWmonitor* monitor) {
+        const auto* videoMode = monitor != nullptr ? glfwGetVideoMode(monitor) : nullptr;
+
+        return videoMode != nullptr ? videoMode->refreshRate : 0;
+    }
+
+    // Counts the monitors connected and disconnected, which the render thread compares
+    // against without calling into GLFW. A disconnected monitor's handle can come back for
+    // another monitor, so whatever was cached by monitor handle goes with every change.
+    inline std::atomic<uint32_t> monitorGeneration = 0;
+
+    inline void monitorCallback([[maybe_unused]] GLFWmonitor* monitor, [[maybe_unused]] int event) {
+        monitorGeneration.fetch_add(1, std::memory_order_release);
+    }
+
+    // The structures a swapchain of `window` and the queries of its surface chain, pointing
+    // into themselves, so they are neither copied nor moved. Everywhere but on Windows, and for
+    // `Unavailable`, the chain is empty and `chain` hands `next` back.
+    class ExclusiveInfo {
+        public:
+            explicit ExclusiveInfo([[maybe_unused]] GLFWwindow* window, Exclusivity exclusivity)
+                : m_exclusivity { exclusivity }
+            {
+#if defined(_WIN32)
+                m_win32Info = VkSurfaceFullScreenExclusiveWin32InfoEXT {
+                    .sType = VK_STRUCTURE_TYPE_SURFACE_FULL_SCREEN_EXCLUSIVE_WIN32_INFO_EXT,
+                    .hmonitor = MonitorFromWindow(glfwGetWin32Window(window), MONITOR_DEFAULTTONEAREST),
+                };
+                m_info = VkSurfaceFullScreenExclusiveInfoEXT {
+                    .sType = VK_STRUCTURE_TYPE_SURFACE_FULL_SCREEN_EXCLUSIVE_INFO_EXT,
+                    .pNext = &m_win32Info,
+                    .fullScreenExclusive = exclusivity == Exclusivity::Lost
+                        ? VK_FULL_SCREEN_EXCLUSIVE_DISALLOWED_EXT
+                        : VK_FULL_SCREEN_EXCLUSIVE_APPLICATION_CONTROLLED_EXT,
+                };
+#endif
+            }
+
+            ExclusiveInfo(const ExclusiveInfo& other) = delete;
+            ExclusiveInfo& operator=(const ExclusiveInfo& other) = delete;
+
+            // Puts the chain in front of `next`, which it has to be the only user of.
+            const void* chain(const void* next) {
+#if defined(_WIN32)
+                if (m_exclusivity != Exclusivity::Unavailable) {
+                    m_win32Info.pNext = next;
+
+                    return &m_info;
+                }
+#endif
+
+                return next;
+            }
+        private:
+            Exclusivity m_exclusivity = Exclusivity::Unavailable;
+#if defined(_WIN32)
+            VkSurfaceFullScreenExclusiveWin32InfoEXT m_win32Info {};
+            VkSurfaceFullScreenExclusiveInfoEXT m_info {};
+#endif
+    };
+
+    // Whether `window`'s surface can be made exclusive on its monitor. Needs
+    // `VK_KHR_get_surface_capabilities2` on the instance and the extension on the device.
+    inline bool supportsExclusive(
+        [[maybe_unused]] VkPhysicalDevice physicalDevice,
+        [[maybe_unused]] VkSurfaceKHR surface,
+        [[maybe_unused]] GLFWwindow* window
+    ) {
+#if defined(_WIN32)
+        auto info = ExclusiveInfo { window, Exclusivity::Requested };
+        const auto surfaceInfo = VkPhysicalDeviceSurfaceInfo2KHR {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SURFACE_INFO_2_KHR,
+            .pNext = info.chain(nullptr),
+            .surface = surface,
+        };
+        auto exclusiveCapabilities = VkSurfaceCapabilitiesFullScreenExclusiveEXT {
+            .sType = VK_STRUCTURE_TYPE_SURFACE_CAPABILITIES_FULL_SCREEN_EXCLUSIVE_EXT,
+        };
+        auto capabilities = VkSurfaceCapabilities2KHR {
+            .sType = VK_STRUCTURE_TYPE_SURFACE_CAPABILITIES_2_KHR,
+            .pNext = &exclusiveCapabilities,
+        };
+        const auto result = vkGetPhysicalDeviceSurfaceCapabilities2KHR(physicalDevice, &surfaceInfo, &capabilities);
+
+        return result == VK_SUCCESS && exclusiveCapabilities.fullScreenExclusiveSupported == VK_TRUE;
+#else
+        return false;
+#endif
+    }
+
+    // Fails while the window is not in front, or the display is taken, and the swapchain then
+    // presents composited like any other.
+    inline VkResult acquire([[maybe_unused]] VkDevice device, [[maybe_unused]] VkSwapchainKHR swapChain) {
+#if defined(_WIN32)
+        return vkAcquireFullScreenExclusiveModeEXT(device, swapChain);
+#else
+        return VK_ERROR_EXTENSION_NOT_PRESENT;
+#endif
+    }
+}
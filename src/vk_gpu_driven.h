@@ -0,0 +1,3951 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <optional>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "vk_animation.h"
+#include "vk_cpu_culling.h"
+#include "vk_descriptors.h"
+#include "vk_downsample.h"
+#include "vk_ecs.h"
+#include "vk_frame_budget.h"
+#include "vk_frame_packets.h"
+#include "vk_compute.h"
+#include "vk_handles.h"
+#include "vk_jobs.h"
+#include "vk_lights.h"
+#include "vk_math.h"
+#include "vk_memory.h"
+#include "vk_meshlets.h"
+#include "vk_pipelines.h"
+#include "vk_ray_query.h"
+#include "vk_render_graph.h"
+#include "vk_shader_layouts.h"
+#include "vk_shaders.h"
+#include "vk_shading_rate.h"
+#include "vk_shadows.h"
+#include "vk_transforms.h"
+#include "vk_upload.h"
+#include "vk_vertex_format.h"
+#include "vk_virtual_shadows.h"
+
+
+namespace vk_gpu_driven {
+    // Matches `local_size_x` in `scene.task`. The cull shader takes it as a specialization
+    // constant, the workgroup sizes of both compute shaders as well.
+    constexpr uint32_t MESHLET_TASKS_PER_WORKGROUP = 32;
+
+    // The specialization constant ids of `cull.comp`, `shadow_pages.comp`, `skin.comp` and
+    // `scene.vert`.
+    constexpr uint32_t CULL_WORKGROUP_SIZE_ID = 0;
+    constexpr uint32_t CULL_MESH_SHADING_ID = 1;
+    constexpr uint32_t CULL_MESHLET_TASKS_PER_WORKGROUP_ID = 2;
+    constexpr uint32_t CULL_PHASE_ID = 3;
+    constexpr uint32_t CULL_GENERATED_COMMANDS_ID = 4;
+    constexpr uint32_t PAGE_MARK_WORKGROUP_WIDTH_ID = 0;
+    constexpr uint32_t PAGE_MARK_WORKGROUP_HEIGHT_ID = 1;
+    constexpr uint32_t SKIN_WORKGROUP_SIZE_ID = 0;
+    constexpr uint32_t SCENE_GENERATED_COMMANDS_ID = 0;
+
+    // How the directional light casts shadows, the value of `directionalLight.w` in
+    // `scene.glsl`.
+    enum class ShadowMode : uint32_t {
+        Off,
+        Cascades,
+        Virtual,
+        // The near cascades, and rays traced against the scene's acceleration structures past
+        // them.
+        RayQuery,
+    };
+
+    // Matches `CULL_PHASE` in `cull.glsl`.
+    enum class CullPhase : uint32_t {
+        Single,
+        Early,
+        Late,
+    };
+
+    // Every face of the cube is a grid of this many quads a side, which gives its meshlets
+    // something to cull.
+    constexpr uint32_t FACE_SUBDIVISIONS = 4;
+
+    // The scene is drawn with reversed depth, 1 at the near plane falling to 0 at infinity, see
+    // `vk_math::perspectiveReversedZ`, so nearer is greater and the depth buffer clears to 0.
+    constexpr VkCompareOp DEPTH_COMPARE_OP = VK_COMPARE_OP_GREATER;
+    constexpr float DEPTH_CLEAR_VALUE = 0.0f;
+
+    // The depth formats the scene is drawn with, in order of preference. Reversed depth is most
+    // precise in a float format; the fixed point formats only halve or quarter the bandwidth on
+    // devices without it.
+    constexpr auto DEPTH_FORMATS = std::array {
+        VK_FORMAT_D32_SFLOAT,
+        VK_FORMAT_X8_D24_UNORM_PACK32,
+        VK_FORMAT_D16_UNORM,
+    };
+    constexpr VkFormat PYRAMID_FORMAT = VK_FORMAT_R32_SFLOAT;
+
+    // World matrices are composed in chunks, so a large scene streams in over a few frames
+    // instead of stalling the first one.
+    constexpr uint32_t INSTANCES_PER_FRAME = 256 * 1024;
+
+    // Half the size of the unit cube every instance draws, which bounds it for CPU culling.
+    constexpr float MESH_HALF_EXTENT = 0.5f;
+
+    // The cube's levels of detail after the first are grids of fewer quads a face. Its faces are
+    // flat, so what a coarser grid loses is only the quads the finer one splits it into, and
+    // the error of a level is the side of its quads. The last level is an impostor, a square
+    // facing the camera with the cube's mean silhouette area, whose error is the cube's whole
+    // width. Matches `MESH_LOD_COUNT` in `scene.glsl`.
+    constexpr std::array<uint32_t, 3> LOD_FACE_SUBDIVISIONS = { FACE_SUBDIVISIONS, 2, 1 };
+    constexpr uint32_t LOD_COUNT = static_cast<uint32_t>(LOD_FACE_SUBDIVISIONS.size()) + 1;
+    constexpr uint32_t IMPOSTOR_LOD = LOD_COUNT - 1;
+
+    // Half the side of the impostor's square, whose area is the mean area of the unit cube's
+    // silhouette, a quarter of its surface area. Matches `MESH_IMPOSTOR_HALF_EXTENT`.
+    constexpr float IMPOSTOR_HALF_EXTENT = 0.61237244f;
+
+    // The pixels of error a level of detail may show, unless the renderer is given others.
+    constexpr float DEFAULT_LOD_ERROR_PIXELS = 2.0f;
+
+    // The cube's skeleton is a chain of joints up its height, the first at its bottom face and
+    // the last at its top, each turned about y from the one below by a clip of
+    // `ANIMATION_KEY_COUNT` keys that loops. Turning about y keeps every vertex as far from the
+    // axis as it was, so a twisted cube stays within its bounding sphere, and within a box of
+    // `ANIMATED_MESH_HALF_EXTENT` in x and z.
+    constexpr uint32_t SKELETON_JOINT_COUNT = 4;
+    constexpr uint32_t ANIMATION_KEY_COUNT = 60;
+    constexpr float ANIMATION_SAMPLE_RATE = 30.0f;
+    constexpr float ANIMATION_TWIST = 0.6f;
+    constexpr float ANIMATED_MESH_HALF_EXTENT = 0.70710678f;
+
+    // The clip plays at the pace of the simulation's ticks, which the camera circles the
+    // field at as well.
+    constexpr double CAMERA_RADIANS_PER_SECOND = 0.12;
+
+    // Towards the directional light the scene is lit and shadowed by.
+    inline const glm::vec3 LIGHT_DIRECTION = glm::normalize(glm::vec3 { 0.4f, 0.8f, 0.45f });
+
+    // The camera's near plane, and how far from it shadows reach, in field sizes, which from
+    // anywhere on the camera's circle is past the far side of the field.
+    constexpr float NEAR_PLANE = 0.1f;
+    constexpr float SHADOW_DISTANCE = 1.75f;
+
+    // A scene entity's instance, its index in the instance buffer.
+    struct SceneInstance {
+        uint32_t index;
+    };
+
+    // The state of a simulation tick the renderer needs, which `extractFramePacket` writes and
+    // `takeFramePacket` reads: the tick's time, where the camera is, and the world matrices of
+    // the instances to upload next, from `firstInstance` on, in the packet's arena.
+    struct ScenePacket {
+        double time = 0.0;
+        glm::vec3 cameraEye { 0.0f };
+        uint32_t firstInstance = 0;
+        std::span<const vk_transforms::WorldMatrix> worldMatrices;
+    };
+
+    using SceneFramePacket = vk_frame_packets::FramePacket<ScenePacket>;
+
+    // Every instance a packet uploads fits its arena.
+    constexpr size_t SCENE_PACKET_ARENA_SIZE = INSTANCES_PER_FRAME * sizeof(vk_transforms::WorldMatrix) + vk_frame_packets::ARENA_ALIGNMENT;
+
+    // The mesh's vertices in half the size of floats: the position quantized to 16 bits
+    // relative to the mesh's bounds, and the normal octahedral encoded. See `vk_vertex_format`.
+    struct Vertex {
+        std::array<uint16_t, 4> position;
+        std::array<int16_t, 2> normal;
+    };
+
+    static_assert(sizeof(Vertex) == 12, "Vertex must match the std430 layout of `scene.mesh`");
+
+    // The two joints of the skeleton a vertex follows and how much of each, as fractions of
+    // 255, which `skin.comp` reads as a `uvec2`. Room is left for four.
+    struct SkinWeights {
+        std::array<uint8_t, 4> joints;
+        std::array<uint8_t, 4> weights;
+    };
+
+    static_assert(sizeof(SkinWeights) == 8, "SkinWeights must match the std430 layout of `skin.comp`");
+
+    // The std140 layout of the uniform block in `scene.glsl`.
+    struct SceneUniforms {
+        glm::mat4 view;
+        glm::mat4 viewProjection;
+        std::array<glm::vec4, 6> frustumPlanes;
+        glm::vec4 projection;
+        std::array<uint32_t, 4> cull;
+        std::array<uint32_t, 4> mesh;
+        glm::vec4 meshBoundsMin;
+        glm::vec4 meshBoundsExtent;
+        glm::vec4 clusters;
+        std::array<uint32_t, 4> lights;
+        std::array<glm::mat4, vk_shadows::CASCADE_COUNT> shadowMatrices;
+        glm::vec4 shadowSplits;
+        glm::vec4 shadowRadii;
+        glm::vec4 directionalLight;
+        glm::vec4 virtualShadows;
+        std::array<std::array<uint32_t, 4>, LOD_COUNT> lods;
+        glm::vec4 lodSelection;
+    };
+
+    static_assert(sizeof(SceneUniforms) == 736, "SceneUniforms must match the std140 layout of the shaders");
+    VK_SHADER_LAYOUT_CHECK(scene_vert, SceneUniforms, SceneUniforms)
+
+    // A level of detail of the mesh: the range of the index buffer it draws, and how far from
+    // the first level it strays, in the mesh's units.
+    struct MeshLod {
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        float error;
+    };
+
+    struct SceneCamera {
+        glm::mat4 view;
+        glm::mat4 viewProjection;
+    };
+
+    // The push constants of `shadow_pages.comp`.
+    struct PageMarkPushConstants {
+        std::array<uint32_t, 2> renderExtent;
+    };
+
+    // The push constants of `skin.comp`.
+    struct SkinPushConstants {
+        uint32_t vertexCount;
+    };
+
+    // The push constants of `scene.task` and `scene.mesh`, in `scene_addresses.glsl`: the
+    // addresses of the buffers every window's draw reads, which need no descriptors.
+    struct SceneAddresses {
+        VkDeviceAddress instances;
+        VkDeviceAddress meshlets;
+        VkDeviceAddress meshletVertices;
+        VkDeviceAddress meshletTriangles;
+        VkDeviceAddress vertices;
+    };
+
+    static_assert(sizeof(SceneAddresses) == 40, "SceneAddresses must match the push constants of the shaders");
+    VK_SHADER_LAYOUT_CHECK(scene_task, SceneAddresses, SceneAddresses)
+
+    // The push constants of `shadow.vert`: the projection of the cascade or page it draws.
+    struct ShadowConstants {
+        glm::mat4 viewProjection;
+    };
+
+    VK_SHADER_LAYOUT_CHECK(shadow_vert, ShadowConstants, ShadowConstants)
+
+    // The push constants of `scene.vert`, which only device generated commands push.
+    struct DrawConstants {
+        uint32_t instanceIndex;
+    };
+
+    // A sequence of device generated commands, the layout of `GeneratedDraw` in `cull.glsl`,
+    // whose tokens bind a pipeline of the execution set, push `DrawConstants` and draw.
+    struct GeneratedDraw {
+        uint32_t pipelineIndex;
+        DrawConstants constants;
+        VkDrawIndexedIndirectCommand draw;
+    };
+
+    static_assert(sizeof(GeneratedDraw) == 7 * sizeof(uint32_t), "GeneratedDraw must match the std430 layout of `cull.glsl`");
+
+    inline bool supportsDepthFormat(VkPhysicalDevice physicalDevice, VkFormat format, VkFormatFeatureFlags required) {
+        auto properties = VkFormatProperties {};
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+
+        return (properties.optimalTilingFeatures & required) == required;
+    }
+
+    // The first of `DEPTH_FORMATS` the device can draw to and sample, for the depth pyramid,
+    // or else the first it can draw to at all.
+    inline VkFormat selectDepthFormat(VkPhysicalDevice physicalDevice) {
+        for (const auto required : { VkFormatFeatureFlags { VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT }, VkFormatFeatureFlags { VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT } }) {
+            for (const auto format : DEPTH_FORMATS) {
+                if (supportsDepthFormat(physicalDevice, format, required)) {
+                    return format;
+                }
+            }
+        }
+
+        throw std::runtime_error("failed to find a supported depth format!");
+    }
+
+    // The depth buffer is sampled to build the depth pyramid, which not every device supports
+    // for every depth format.
+    inline bool supportsDepthPyramid(VkPhysicalDevice physicalDevice, VkFormat depthFormat) {
+        return supportsDepthFormat(physicalDevice, depthFormat, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
+    }
+
+    // How a multisampled depth buffer is resolved for the depth pyramid. The farthest sample,
+    // the smallest with reversed depth, keeps occlusion culling conservative where the device
+    // can resolve to it, and any sample is close enough otherwise.
+    inline VkResolveModeFlagBits depthResolveMode(VkPhysicalDevice physicalDevice) {
+        auto resolveProperties = VkPhysicalDeviceDepthStencilResolveProperties {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DEPTH_STENCIL_RESOLVE_PROPERTIES,
+        };
+        auto properties = VkPhysicalDeviceProperties2 {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+            .pNext = &resolveProperties,
+        };
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+        return (resolveProperties.supportedDepthResolveModes & VK_RESOLVE_MODE_MIN_BIT) != 0 ? VK_RESOLVE_MODE_MIN_BIT : VK_RESOLVE_MODE_SAMPLE_ZERO_BIT;
+    }
+
+    // The most task workgroups one mesh tasks draw may launch, or zero without mesh shaders.
+    inline uint32_t maxTaskWorkGroupCount(VkPhysicalDevice physicalDevice, bool meshShader) {
+        if (!meshShader) {
+            return 0;
+        }
+
+        auto meshShaderProperties = VkPhysicalDeviceMeshShaderPropertiesEXT {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_PROPERTIES_EXT,
+        };
+        auto properties = VkPhysicalDeviceProperties2 {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+            .pNext = &meshShaderProperties,
+        };
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+        return std::min(meshShaderProperties.maxTaskWorkGroupCount[0], meshShaderProperties.maxTaskWorkGroupTotalCount);
+    }
+
+    // The most sequences one execution of device generated commands may run, or zero without
+    // them, or where they cannot bind the scene's vertex and fragment stages with pipelines.
+    inline uint32_t maxGeneratedSequenceCount(VkPhysicalDevice physicalDevice, bool deviceGeneratedCommands) {
+        if (!deviceGeneratedCommands) {
+            return 0;
+        }
+
+        auto generatedCommandsProperties = VkPhysicalDeviceDeviceGeneratedCommandsPropertiesEXT {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DEVICE_GENERATED_COMMANDS_PROPERTIES_EXT,
+        };
+        auto properties = VkPhysicalDeviceProperties2 {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+            .pNext = &generatedCommandsProperties,
+        };
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+        const auto stages = VkShaderStageFlags { VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT };
+        if (
+            (generatedCommandsProperties.supportedIndirectCommandsShaderStages & stages) != stages
+            || (generatedCommandsProperties.supportedIndirectCommandsShaderStagesPipelineBinding & stages) != stages
+            || generatedCommandsProperties.maxIndirectPipelineCount == 0
+        ) {
+            return 0;
+        }
+
+        return generatedCommandsProperties.maxIndirectSequenceCount;
+    }
+
+    // The render graph resources of a window's scene, which its main pass draws with and
+    // renders depth into. Multisampled depth is resolved into `resolvedDepth` for the depth
+    // pyramid, which is `depth` itself otherwise.
+    struct SceneResources {
+        vk_render_graph::ResourceId drawCommands;
+        vk_render_graph::ResourceId drawCount;
+        vk_render_graph::ResourceId depth;
+        vk_render_graph::ResourceId resolvedDepth;
+        vk_render_graph::ResourceId depthPyramid;
+        vk_render_graph::ResourceId lightClusters;
+        // Shared by every window, which samples it in the main pass, with the page table of
+        // the virtual shadow map.
+        vk_render_graph::ResourceId shadowMap;
+        std::optional<vk_render_graph::ResourceId> shadowPageTable;
+        // Shared by every window as well, the mesh skinned to the frame's pose, which every draw
+        // of the scene reads in place of its vertex buffer when it is animated.
+        std::optional<vk_render_graph::ResourceId> skinnedVertices;
+        // The preprocess buffer of the device generated commands, and `drawCommands` without
+        // them.
+        vk_render_graph::ResourceId preprocess;
+    };
+
+    // Draws a field of instanced cubes without the CPU ever looking at the instances.
+    //
+    // The instances live in a storage buffer. Every frame a compute pass culls them against
+    // the view frustum and against a depth pyramid built from the previous frame's depth
+    // buffer, appends a `VkDrawIndexedIndirectCommand` for each one left, and counts them.
+    // The main pass then draws them all with one `vkCmdDrawIndexedIndirectCount`, so the CPU
+    // records the same handful of commands whether the scene holds a hundred instances or a
+    // million. Culling against the previous frame's depth lets an instance that just came
+    // into view stay hidden for a frame, which the slowly moving camera keeps from showing.
+    //
+    // With mesh shaders, the cull pass lists the instances it keeps instead, and the main pass
+    // draws them with one `vkCmdDrawMeshTasksIndirectEXT`. Its task shader culls every
+    // meshlet of every listed instance against the frustum, its normal cone and the depth
+    // pyramid, and only the meshlets left fetch vertices, so back facing and hidden parts of
+    // an instance cost next to nothing. The meshlets are built once on the CPU, from the mesh
+    // in vertex cache order. The task and mesh shaders read the instances, meshlets and
+    // vertices through buffer device addresses in push constants, so only the buffers that
+    // differ per window are bound through the scene set.
+    //
+    // With a depth pre-pass, culling runs in two phases instead, so nothing that comes into view
+    // is hidden for a frame. The early phase keeps the instances visible at the end of the last
+    // frame, which the pre-pass draws into the depth buffer, and the depth pyramid is built from
+    // that right away. The late phase then culls every instance against the new pyramid, which
+    // the main pass draws, shading only the fragments left in front.
+    //
+    // Devices without indirect count draws cull on the CPU instead, against the frustum only:
+    // jobs test the instances' bounding boxes, and the survivors' draws are written to a mapped
+    // buffer per frame in flight, which one `vkCmdDrawIndexedIndirect` draws with the count the
+    // CPU knows.
+    //
+    // With device generated commands, the cull shader writes each draw as a sequence that also
+    // binds its pipeline out of an execution set and pushes its instance to the vertex shader,
+    // and the main pass executes every sequence with one `vkCmdExecuteGeneratedCommandsEXT`,
+    // so instances drawn with different pipelines would not need a draw of their own from the
+    // CPU either. The scene has a single pipeline so far, which every sequence binds.
+    //
+    // The scene's point lights are binned into a grid of view space clusters every frame by a
+    // compute pass per window, on every path, and the fragment shader only shades with the
+    // lights of its fragment's cluster, so thousands of lights cost what the few near each
+    // fragment do.
+    //
+    // On the vertex pipeline's GPU culling paths, the cull shader also picks each instance's
+    // level of detail, the coarsest whose error, projected from the nearest point of its
+    // bounding sphere, stays within the pixels the renderer was given, and its draw covers
+    // that level's range of the index buffer. The last level is an impostor that the vertex
+    // shader turns to face the camera, two triangles in place of the cube past where its
+    // shape still shows. The mesh shading path keeps the first level, as its task shader
+    // culls the meshlets of far instances down to the few facing the camera already, and CPU
+    // culling and the shadow passes draw the first level as well.
+    //
+    // The directional light casts shadows through cascades fitted to the first window's view
+    // once a frame, see `vk_shadows::ShadowCascades`. Each cascade is a layer of one shadow
+    // map, into which every instance is drawn with a depth only vertex shader, which moves the
+    // instances the cascade misses out of the clip volume. Every caster is static, so the far
+    // cascades are only drawn again when the view leaves them or more instances are uploaded.
+    //
+    // The virtual shadow map replaces the cascades with one map of the whole scene, of which
+    // only the pages the windows' depth buffers fall into are rendered, into an atlas of pages
+    // the page table points into: see `vk_virtual_shadows::VirtualShadowMap`. A compute pass
+    // after each window's depth pyramid marks the pages it needs, and the CPU reads the marks
+    // once the frame is done, so a page rendered for what a frame saw is first sampled a cycle
+    // of frames in flight later, and a coarser page stands in until then.
+    //
+    // With ray queries, only the near cascades are rendered, and fragments past them trace a
+    // ray toward the light through the scene's acceleration structures instead, see
+    // `vk_ray_query::SceneAccelerationStructure`, which an async compute pass refits every
+    // frame. The far cascades' resolution runs out across the scene, where a ray is as sharp
+    // up close as far away.
+    //
+    // When the scene is animated, every cube twists to a compressed clip of its skeleton, see
+    // `vk_animation`. The first window to cull in a frame samples the clip and composes the
+    // joint palette on the job system, and a compute pass skins the mesh's vertices with it into
+    // a vertex buffer, which the depth pre-pass, the shadow passes and the main passes of every
+    // window draw from. Every instance strikes the same pose, so the mesh is skinned once a frame
+    // and not once an instance. The casters move, so cached cascades and resident pages are
+    // rendered again every frame. The mesh shading path is left unanimated, its meshlets' bounds
+    // and normal cones are those of the rest pose.
+    class IndirectRenderer {
+        public:
+            explicit IndirectRenderer() = default;
+
+            IndirectRenderer(const IndirectRenderer& other) = delete;
+            IndirectRenderer& operator=(const IndirectRenderer& other) = delete;
+
+            // Generates `instanceCount` instances, entities of a `vk_ecs::World` whose world
+            // matrices `extractFramePacket` then composes on `sceneJobSystem`, for
+            // `streamUploads` to copy into the instance buffer, and `lightCount` point lights. Takes the
+            // mesh shading path when `maxTaskWorkGroups`, from `maxTaskWorkGroupCount`, covers
+            // the meshlets of every instance, and with `bufferDeviceAddress`, which its shaders
+            // need and `memoryAllocator` must have been initialized with. With a
+            // `cullingJobSystem`, culls on it instead of on the GPU, in draws of at most
+            // `maxDrawIndirectCount`. Set layouts come from `layoutCache`, samplers from
+            // `samplerCache`, and the sets rewritten every frame from `frameDescriptors`. The compute shaders are specialized for
+            // `computeTuning`. With `shaderObjects`, which needs the
+            // `shaderObject` feature, the scene draws with shader objects instead of pipelines.
+            // `depthPrepass` culls in two phases around a depth pre-pass, on the GPU culling
+            // paths. Where `maxGeneratedSequences`, from `maxGeneratedSequenceCount`, covers every
+            // instance, the vertex pipeline's GPU culling path draws with device generated
+            // commands, whose inputs `bufferDeviceAddress` reaches. `shadows` is how the directional
+            // light casts shadows. The virtual shadow map marks its pages from the depth the GPU
+            // culling paths sample, and the CPU culling path uses the cascades instead. Levels of
+            // detail may show `lodErrorPixels` of error, and zero draws every instance in full.
+            // With an `animationJobSystem`, the cubes are animated on the vertex pipeline, their
+            // poses computed on it. Ray queried shadows need an `accelerationStructure` to trace
+            // against, initialized for `instanceCount` instances, which gets the mesh and the
+            // instances' world matrices, and fall back to the cascades without one, or when the
+            // cubes are animated or culled on the CPU.
+            void init(
+                VkDevice device,
+                vk_memory::DeviceMemoryAllocator& memoryAllocator,
+                const vk_memory::FrameUploadArena& uploadArena,
+                vk_descriptors::DescriptorLayoutCache& layoutCache,
+                vk_descriptors::SamplerCache& samplerCache,
+                vk_descriptors::FrameDescriptorAllocator& frameDescriptors,
+                vk_shaders::ShaderLibrary& shaderLibrary,
+                vk_pipelines::PipelineRegistry& pipelineRegistry,
+                vk_pipelines::PipelineCompiler& pipelineCompiler,
+                const vk_compute::ComputeTuning& computeTuning,
+                const VkAllocationCallbacks* allocator,
+                vk_jobs::JobSystem& sceneJobSystem,
+                uint32_t instanceCount,
+                uint32_t lightCount,
+                uint32_t windowCount,
+                uint32_t framesInFlight,
+                uint32_t maxTaskWorkGroups,
+                uint32_t maxGeneratedSequences,
+                bool bufferDeviceAddress,
+                bool extendedDynamicState3,
+                bool shaderObjects,
+                bool depthPrepass,
+                ShadowMode shadows,
+                vk_ray_query::SceneAccelerationStructure* accelerationStructure,
+                float lodErrorPixels,
+                vk_jobs::JobSystem* animationJobSystem,
+                VkSampleCountFlagBits samples,
+                VkFormat depthFormat,
+                VkResolveModeFlagBits depthResolveMode,
+                std::optional<vk_shading_rate::DrawShadingRate> shadingRate,
+                vk_jobs::JobSystem* cullingJobSystem,
+                uint32_t maxDrawIndirectCount
+            ) {
+                m_device = device;
+                m_memoryAllocator = &memoryAllocator;
+                m_uniformBuffer = uploadArena.buffer();
+                m_layoutCache = &layoutCache;
+                m_samplerCache = &samplerCache;
+                m_frameDescriptors = &frameDescriptors;
+                m_shaderLibrary = &shaderLibrary;
+                m_pipelineRegistry = &pipelineRegistry;
+                m_pipelineCompiler = &pipelineCompiler;
+                m_computeTuning = computeTuning;
+                m_allocator = allocator;
+                m_sceneJobSystem = &sceneJobSystem;
+                m_instanceCount = instanceCount;
+                m_lightCount = lightCount;
+                m_framesInFlight = framesInFlight;
+                m_cullingJobSystem = cullingJobSystem;
+                m_maxDrawIndirectCount = std::max(maxDrawIndirectCount, 1u);
+                m_animationJobSystem = animationJobSystem;
+
+                this->generateScene();
+                const auto meshletCount = static_cast<uint64_t>(m_meshlets.meshlets.size());
+                const auto taskWorkGroups = (uint64_t { m_instanceCount } * meshletCount + MESHLET_TASKS_PER_WORKGROUP - 1) / MESHLET_TASKS_PER_WORKGROUP;
+                m_meshShading = !this->usesCpuCulling() && bufferDeviceAddress && maxTaskWorkGroups > 0 && taskWorkGroups <= maxTaskWorkGroups;
+                m_shaderObjects = shaderObjects;
+                m_generatedCommands = !this->usesCpuCulling()
+                    && !m_meshShading
+                    && !m_shaderObjects
+                    && bufferDeviceAddress
+                    && maxGeneratedSequences >= std::max(m_instanceCount, 1u);
+                m_depthPrepass = depthPrepass && !this->usesCpuCulling();
+                if (m_meshShading) {
+                    m_animationJobSystem = nullptr;
+                }
+                m_shadowMode = shadows;
+                if (shadows == ShadowMode::Virtual && this->usesCpuCulling()) {
+                    m_shadowMode = ShadowMode::Cascades;
+                } else if (shadows == ShadowMode::RayQuery && (accelerationStructure == nullptr || this->usesAnimation() || this->usesCpuCulling())) {
+                    m_shadowMode = ShadowMode::Cascades;
+                }
+                m_accelerationStructure = m_shadowMode == ShadowMode::RayQuery ? accelerationStructure : nullptr;
+                if (m_accelerationStructure != nullptr) {
+                    m_accelerationStructure->setMesh(this->meshPositions(), this->meshIndices());
+                }
+                m_lodErrorPixels = std::max(lodErrorPixels, 0.0f);
+                m_samples = samples;
+                m_depthFormat = depthFormat;
+                m_depthResolveMode = depthResolveMode;
+                m_shadingRate = shadingRate;
+                m_dynamicStates = vk_pipelines::DynamicRasterStates {
+                    .inputAssembly = !m_meshShading,
+                    .blend = extendedDynamicState3 || shaderObjects,
+                };
+
+                this->createLayouts();
+                if (m_generatedCommands) {
+                    this->createCommandsLayouts();
+                }
+                this->createComputePipelines();
+                if (m_shaderObjects) {
+                    m_sceneShaders = this->createSceneShaders();
+                }
+                m_sceneShadersReloaded = false;
+                for (const auto* shaderName : this->sceneShaderNames()) {
+                    shaderLibrary.onReload(shaderName, [this](VkShaderModule) { m_sceneShadersReloaded = true; });
+                }
+                this->createSampler();
+                this->createSceneBuffers();
+                this->createShadowMap();
+                this->createShadowPageBuffers();
+                if (this->usesAnimation()) {
+                    this->createSkinDescriptors();
+                }
+                if (this->usesShadows()) {
+                    this->createShadowPipeline();
+                }
+                // A cube scaled by at most one lies within this of the origin.
+                const auto sceneRadius = std::sqrt(3.0f) * (0.5f * m_fieldSize + MESH_HALF_EXTENT);
+                m_shadowCascades.init(LIGHT_DIRECTION, sceneRadius);
+                m_virtualShadows.init(LIGHT_DIRECTION, sceneRadius);
+                m_shadowFrame.reset();
+                m_shadowCasterCount = 0;
+                m_castCascadeCount = 0;
+                m_renderedPageCount = 0;
+                m_skinFrame.reset();
+                m_skinnedVerticesDrawn = false;
+
+                m_windows.clear();
+                m_windows.resize(windowCount);
+                const auto drawCommandsSize = VkDeviceSize { std::max(m_instanceCount, 1u) } * sizeof(VkDrawIndexedIndirectCommand);
+                // Device generated commands read their sequences and their count by address.
+                const auto addressUsage = m_generatedCommands ? VkBufferUsageFlags { VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT } : VkBufferUsageFlags { 0 };
+                for (auto& window : m_windows) {
+                    // The cull shader's buffers are still bound on the CPU culling path, so they
+                    // exist, just too small to matter.
+                    const auto gpuDrawCommandsSize = this->usesCpuCulling()
+                        ? VkDeviceSize { sizeof(VkDrawIndexedIndirectCommand) }
+                        : m_generatedCommands ? VkDeviceSize { std::max(m_instanceCount, 1u) } * sizeof(GeneratedDraw) : drawCommandsSize;
+                    window.drawCommands = this->createBuffer(gpuDrawCommandsSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | addressUsage);
+                    window.drawCount = this->createBuffer(
+                        sizeof(DrawCount),
+                        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | addressUsage
+                    );
+                    window.lightClusters = this->createBuffer(vk_lights::CLUSTER_BUFFER_SIZE, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+                    window.visibility = this->createBuffer(
+                        m_depthPrepass ? VkDeviceSize { std::max(m_instanceCount, 1u) } * sizeof(uint32_t) : VkDeviceSize { sizeof(uint32_t) },
+                        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT
+                    );
+                    if (!this->usesCpuCulling()) {
+                        continue;
+                    }
+
+                    for (uint32_t i = 0; i < m_framesInFlight; i++) {
+                        window.hostDrawCommands.push_back(this->createBuffer(
+                            drawCommandsSize,
+                            VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                            vk_memory::AllocationCreateInfo {
+                                .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                .preferredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                .priority = vk_memory::MemoryPriority::High,
+                            }
+                        ));
+                    }
+                }
+            }
+
+            // The device has to be idle, and retired depth pyramids destroyed.
+            void destroy() {
+                if (m_device == VK_NULL_HANDLE) {
+                    return;
+                }
+
+                m_windows.clear();
+                m_vertexBuffer = BufferAllocation();
+                m_indexBuffer = BufferAllocation();
+                m_instanceBuffer = BufferAllocation();
+                m_lightBuffer = BufferAllocation();
+                m_lights = std::vector<vk_lights::Light> {};
+                m_sceneAddresses = SceneAddresses {};
+                m_scene.clear();
+                m_bounds.clear();
+                m_culler.clear();
+                m_meshPositions = std::vector<glm::vec3> {};
+                m_accelerationStructure = nullptr;
+                m_meshletBuffer = BufferAllocation();
+                m_meshletVertexBuffer = BufferAllocation();
+                m_meshletTriangleBuffer = BufferAllocation();
+                m_sampler = VK_NULL_HANDLE;
+                m_shadowMap = ShadowMap();
+                m_shadowPageTable = BufferAllocation();
+                m_shadowPageRequests = BufferAllocation();
+                m_shadowPageReadbacks.clear();
+                m_skinWeightBuffer = BufferAllocation();
+                m_skinnedVertexBuffer = BufferAllocation();
+                m_skinWeights = std::vector<SkinWeights> {};
+                m_skinDescriptorPool.reset();
+                m_skinSet = VK_NULL_HANDLE;
+
+                // The pipelines belong to the registry and the compiler, their execution sets do not.
+                for (const auto& [format, executionSet] : m_executionSets) {
+                    vkDestroyIndirectExecutionSetEXT(m_device, executionSet, m_allocator);
+                }
+                m_executionSets.clear();
+                for (auto& commandsLayout : m_commandsLayouts) {
+                    vkDestroyIndirectCommandsLayoutEXT(m_device, commandsLayout, m_allocator);
+                    commandsLayout = VK_NULL_HANDLE;
+                }
+                m_drawPipelines.clear();
+                m_compilingDrawPipelines.clear();
+                m_sceneShaders.clear();
+                m_pyramidDownsampler.destroy();
+                vkDestroyPipelineLayout(m_device, m_scenePipelineLayout, m_allocator);
+                vkDestroyPipelineLayout(m_device, m_shadowPipelineLayout, m_allocator);
+                vkDestroyPipelineLayout(m_device, m_pageMarkPipelineLayout, m_allocator);
+                m_pageMarkPipelineLayout = VK_NULL_HANDLE;
+                vkDestroyPipelineLayout(m_device, m_skinPipelineLayout, m_allocator);
+                m_skinPipelineLayout = VK_NULL_HANDLE;
+                m_device = VK_NULL_HANDLE;
+            }
+
+            bool isInitialized() const {
+                return m_device != VK_NULL_HANDLE;
+            }
+
+            uint32_t instanceCount() const {
+                return m_instanceCount;
+            }
+
+            uint32_t uploadedInstanceCount() const {
+                return m_uploadedInstanceCount;
+            }
+
+            // The first level of detail, the full mesh, as a triangle list.
+            std::span<const glm::vec3> meshPositions() const {
+                return m_meshPositions;
+            }
+
+            std::span<const uint32_t> meshIndices() const {
+                return std::span { m_indices }.first(m_lods[0].indexCount);
+            }
+
+            // The world matrices of instances `first` to `first + count`, as
+            // `extractFramePacket` composes them.
+            void composeWorldMatrices(uint32_t first, uint32_t count, vk_transforms::WorldMatrix* destination) const {
+                const auto end = first + count;
+                m_scene.forEachChunk<vk_transforms::LocalTransform, SceneInstance>([&](const vk_ecs::ChunkView& chunk) {
+                    const auto chunkFirst = chunk.components<const SceneInstance>().front().index;
+                    const auto chunkEnd = chunkFirst + static_cast<uint32_t>(chunk.size());
+                    if (chunkEnd <= first || chunkFirst >= end) {
+                        return;
+                    }
+
+                    const auto begin = std::max(first, chunkFirst);
+                    vk_transforms::composeWorldMatrices(
+                        chunk.components<const vk_transforms::LocalTransform>().subspan(begin - chunkFirst, std::min(end, chunkEnd) - begin),
+                        destination + (begin - first)
+                    );
+                });
+            }
+
+            bool usesMeshShading() const {
+                return m_meshShading;
+            }
+
+            bool usesShaderObjects() const {
+                return m_shaderObjects;
+            }
+
+            bool usesGeneratedCommands() const {
+                return m_generatedCommands;
+            }
+
+            // Whether the scene's depth is already in the depth buffer when the main pass
+            // draws, which then has to load it rather than clear it.
+            bool usesDepthPrepass() const {
+                return m_depthPrepass;
+            }
+
+            // Whether the cull shader picks levels of detail, on the vertex pipeline's GPU culling
+            // paths.
+            bool usesLods() const {
+                return m_lodErrorPixels > 0.0f && !m_meshShading && !this->usesCpuCulling();
+            }
+
+            float lodErrorPixels() const {
+                return m_lodErrorPixels;
+            }
+
+            // Whether the cubes twist to their skeleton's clip, skinned on the GPU every frame.
+            bool usesAnimation() const {
+                return m_animationJobSystem != nullptr;
+            }
+
+            bool usesShadows() const {
+                return m_shadowMode != ShadowMode::Off;
+            }
+
+            ShadowMode shadowMode() const {
+                return m_shadowMode;
+            }
+
+            // How many of the shadow cascades the last frame drew, the others were cached.
+            uint32_t castCascadeCount() const {
+                return m_castCascadeCount;
+            }
+
+            // The pages of the virtual shadow map in the atlas, and how many of them the last
+            // frame rendered.
+            uint32_t residentPageCount() const {
+                return m_virtualShadows.residentCount();
+            }
+
+            uint32_t renderedPageCount() const {
+                return m_renderedPageCount;
+            }
+
+            // Whether the depth pyramid is built from the depth the main pass leaves, which then
+            // has to store it, or resolve it when multisampled. Otherwise the depth never has to
+            // leave tile memory.
+            bool readsDepthAfterDraw() const {
+                return !this->usesCpuCulling() && !m_depthPrepass;
+            }
+
+            // The sample count of the scene's pipelines and depth, which the main pass's color
+            // attachment has to match.
+            VkSampleCountFlagBits samples() const {
+                return m_samples;
+            }
+
+            bool isMultisampled() const {
+                return m_samples != VK_SAMPLE_COUNT_1_BIT;
+            }
+
+            VkFormat depthFormat() const {
+                return m_depthFormat;
+            }
+
+            VkResolveModeFlagBits depthResolveMode() const {
+                return m_depthResolveMode;
+            }
+
+            const std::optional<vk_shading_rate::DrawShadingRate>& shadingRate() const {
+                return m_shadingRate;
+            }
+
+            // Compile the scene's stages once the way each path does, bypassing the pipeline
+            // registry and cache, and destroy the result again. For the init benchmarks, which
+            // compare the cost of linking a pipeline with that of creating shader objects.
+            void compileDrawPipeline(VkFormat colorFormat) const {
+                this->withDrawPipelineInfo(colorFormat, 0, [this](const VkGraphicsPipelineCreateInfo& pipelineInfo) {
+                    auto pipeline = VkPipeline {};
+                    const auto result = vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, m_allocator, &pipeline);
+                    if (result != VK_SUCCESS) {
+                        throw std::runtime_error("failed to create scene pipeline!");
+                    }
+
+                    vkDestroyPipeline(m_device, pipeline, m_allocator);
+                });
+            }
+
+            void compileSceneShaders() const {
+                this->createSceneShaders();
+            }
+
+            bool usesCpuCulling() const {
+                return m_cullingJobSystem != nullptr;
+            }
+
+            uint32_t meshletCount() const {
+                return static_cast<uint32_t>(m_meshlets.meshlets.size());
+            }
+
+            // The side of the box the scene's instances are scattered through, centered on the
+            // origin.
+            uint32_t lightCount() const {
+                return m_lightCount;
+            }
+
+            float fieldSize() const {
+                return m_fieldSize;
+            }
+
+            // How far the scene reaches from the camera. The projection has no far plane, but the
+            // light clusters and picking stop here.
+            float farPlane() const {
+                return 4.0f * m_fieldSize;
+            }
+
+            // The camera a window's scene was last culled and drawn with, for whatever else is
+            // drawn into its depth buffer.
+            const SceneCamera& camera(uint32_t windowIndex) const {
+                return m_windows[windowIndex].camera;
+            }
+
+            // Writes the state of `packet`'s tick: the camera, circling the field just inside its
+            // edge so the near cubes hide a good share of the far ones, and the world matrices of
+            // the next batch of the scene's chunks, composed on the scene's job system, a job per chunk.
+            // Runs on the simulation side, and only reads the scene, so it may overlap
+            // everything but `init` and `destroy`.
+            // Ticks are `tickSeconds` apart.
+            void extractFramePacket(SceneFramePacket& packet, double tickSeconds) {
+                packet.contents.time = static_cast<double>(packet.tick) * tickSeconds;
+                const auto angle = static_cast<float>(std::fmod(packet.contents.time * CAMERA_RADIANS_PER_SECOND, 2.0 * glm::pi<double>()));
+                packet.contents.cameraEye = glm::vec3 { std::cos(angle), 0.15f, std::sin(angle) } * (0.75f * m_fieldSize);
+                packet.contents.firstInstance = m_extractedInstanceCount;
+                if (m_extractedInstanceCount == m_instanceCount) {
+                    return;
+                }
+
+                // The scene's entities are never destroyed, so its chunks hold the instances
+                // in order, and the ones extracted so far are whole chunks.
+                auto batch = std::vector<vk_ecs::ChunkView> {};
+                auto count = 0u;
+                for (const auto& chunk : m_scene.chunks<vk_transforms::LocalTransform, SceneInstance>()) {
+                    if (chunk.components<const SceneInstance>().front().index < m_extractedInstanceCount) {
+                        continue;
+                    }
+                    if (count + chunk.size() > INSTANCES_PER_FRAME) {
+                        break;
+                    }
+
+                    batch.push_back(chunk);
+                    count += static_cast<uint32_t>(chunk.size());
+                }
+
+                const auto worldMatrices = packet.arena.allocate<vk_transforms::WorldMatrix>(count);
+                const auto first = m_extractedInstanceCount;
+                vk_ecs::World::forEachChunk(*m_sceneJobSystem, batch, [worldMatrices, first](const vk_ecs::ChunkView& chunk) {
+                    const auto index = chunk.components<const SceneInstance>().front().index;
+                    vk_transforms::composeWorldMatrices(chunk.components<const vk_transforms::LocalTransform>(), worldMatrices.data() + (index - first));
+                });
+                packet.contents.worldMatrices = worldMatrices;
+                m_extractedInstanceCount += count;
+            }
+
+            // Takes a tick's state from `packet`, in the order the ticks ran: its time and camera,
+            // which become the latest of the two states frames interpolate between, and its
+            // world matrices, copied into the mapped instance buffer, which the GPU reads in
+            // place. Nothing of the packet is kept, so it can be released right after. CPU
+            // culling needs the bounds of the instances as well, and ray queries their
+            // matrices, which are taken from the packet too.
+            void takeFramePacket(const ScenePacket& packet) {
+                m_previousTick = m_tookFirstPacket ? m_latestTick : packet;
+                m_latestTick = packet;
+                m_latestTick.worldMatrices = {};
+                m_tookFirstPacket = true;
+
+                const auto count = static_cast<uint32_t>(packet.worldMatrices.size());
+                if (count == 0) {
+                    return;
+                }
+
+                auto* worldMatrices = static_cast<vk_transforms::WorldMatrix*>(m_instanceBuffer.memory.get().mappedData);
+                std::memcpy(worldMatrices + packet.firstInstance, packet.worldMatrices.data(), count * sizeof(vk_transforms::WorldMatrix));
+                if (m_accelerationStructure != nullptr) {
+                    m_accelerationStructure->setInstances(packet.firstInstance, packet.worldMatrices);
+                }
+                for (uint32_t i = 0; i < count && this->usesCpuCulling(); i++) {
+                    m_bounds.set(packet.firstInstance + i, packet.worldMatrices[i], this->usesAnimation() ? ANIMATED_MESH_HALF_EXTENT : MESH_HALF_EXTENT);
+                }
+                m_streamedInstanceCount = packet.firstInstance + count;
+            }
+
+            // How far the frame is from the previous tick's state to the latest, as a fraction
+            // of a tick. The camera and the animation clip are rendered in between.
+            void interpolate(float alpha) {
+                m_tickAlpha = std::clamp(alpha, 0.0f, 1.0f);
+            }
+
+            // Hands the mesh to the upload service. Called every frame before the service
+            // submits, after the frame's packets were taken. Culling only ever looks at the
+            // instances taken so far, once the mesh is up, which the GPU has not read before,
+            // and sees the host's writes once the frame is submitted. The buffers that do not
+            // fit in the ring or in `budget` wait for the next frame.
+            void streamUploads(vk_upload::UploadService& uploadService, vk_frame_budget::FrameBudget::Scope& budget) {
+                while (m_uploadedMeshBufferCount < m_meshUploads.size()) {
+                    const auto& upload = m_meshUploads[m_uploadedMeshBufferCount];
+                    const auto ticket = uploadService.uploadBuffer(upload.buffer, 0, upload.data, upload.size, upload.dstAccessMask);
+                    if (!ticket.has_value()) {
+                        break;
+                    }
+
+                    m_uploadedMeshBufferCount++;
+                    if (m_uploadedMeshBufferCount < m_meshUploads.size() && !budget.hasTimeLeft()) {
+                        budget.defer();
+                        break;
+                    }
+                }
+
+                if (m_uploadedMeshBufferCount == m_meshUploads.size()) {
+                    m_uploadedInstanceCount = m_streamedInstanceCount;
+                }
+            }
+
+            // Creates the pipelines or shader objects a window with `colorFormat` draws with, and
+            // swaps in the ones that finished compiling, which `addCullPasses` and the draws
+            // expect. What a rebuilt shader or a swapped pipeline replaces is retired against
+            // `retireValue`.
+            void prepareDraw(VkFormat colorFormat, vk_handles::DeferredDestructionQueue& retiredResources, uint64_t retireValue) {
+                if (m_sceneShadersReloaded) {
+                    this->retireSceneShaders(retiredResources, retireValue);
+                }
+                if (!m_shaderObjects) {
+                    this->updateDrawPipelines(retiredResources, retireValue);
+                    this->drawPipeline(colorFormat);
+                    if (m_depthPrepass) {
+                        this->drawPipeline(VK_FORMAT_UNDEFINED);
+                    }
+                }
+            }
+
+            // Adds the passes that cull a window's instances, and creates its depth buffer.
+            // The main pass writes `depth` and reads the draws, and `addDepthPyramidPass` comes
+            // after it. `targetSize` is the size of the render target, which sizes the depth
+            // pyramid, and `renderExtent` the part of it the frame renders, which the light
+            // clusters tile. The scene is drawn offset by `jitter` pixels for the temporal
+            // upscaler, and with none otherwise. A pyramid of the wrong size is retired against
+            // `retireValue`, and occlusion culling skips the frame that builds the new one. On
+            // the CPU culling path, culls right away instead, and only adds the light culling
+            // pass. The first window of a frame adds the shadow passes as well, and every window's
+            // main pass has to sample the shadow map, as `mainPassAccesses` lists. With the virtual
+            // shadow map, the pass that marks the pages the window needs comes after its depth
+            // pyramid, here with a depth pre-pass and in `addDepthPyramidPass` otherwise.
+            SceneResources addCullPasses(
+                vk_render_graph::RenderGraph& graph,
+                vk_memory::FrameUploadArena& uploadArena,
+                vk_handles::DeferredDestructionQueue& retiredResources,
+                uint64_t retireValue,
+                uint32_t windowIndex,
+                VkFormat colorFormat,
+                VkExtent2D targetSize,
+                VkExtent2D viewExtent,
+                VkExtent2D renderExtent,
+                glm::vec2 jitter,
+                uint64_t frameNumber
+            ) {
+                auto& window = m_windows[windowIndex];
+                this->prepareDepthPyramid(window, targetSize, retiredResources, retireValue);
+                this->preparePreprocessBuffer(window, colorFormat, retiredResources, retireValue);
+
+                const auto uniforms = uploadArena.allocate(sizeof(SceneUniforms));
+                if (!uniforms.has_value()) {
+                    throw std::runtime_error("failed to allocate scene uniforms!");
+                }
+
+                auto sceneUniforms = this->sceneUniforms(window, viewExtent, renderExtent, jitter);
+                const auto skinnedVertices = this->addSkinningPass(graph, uploadArena, windowIndex, frameNumber);
+                const auto shadowMap = this->addShadowPasses(graph, uploadArena, windowIndex, frameNumber, renderExtent, sceneUniforms);
+                window.camera = SceneCamera { sceneUniforms.view, sceneUniforms.viewProjection };
+                std::memcpy(uniforms->mappedData, &sceneUniforms, sizeof(SceneUniforms));
+                window.uniformOffset = static_cast<uint32_t>(uniforms->offset);
+                window.earlyUniformOffset = window.uniformOffset;
+                if (m_depthPrepass) {
+                    this->writePrepassUniforms(window, uploadArena, sceneUniforms);
+                }
+
+                // Last frame's main pass is the last use of the light clusters.
+                const auto lightClusters = graph.importBuffer(window.lightClusters.buffer, vk_render_graph::ResourceState { VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_NONE });
+                this->addLightCullPass(graph, lightClusters, windowIndex);
+
+                // The buffer of a frame in flight was last drawn from a whole cycle of frames
+                // ago, which has completed. There is no count buffer, the draw is recorded with
+                // the count.
+                if (this->usesCpuCulling()) {
+                    this->cullOnHost(window, static_cast<uint32_t>(frameNumber % m_framesInFlight), sceneUniforms.frustumPlanes);
+                    const auto drawCommands = graph.importBuffer(window.hostDrawCommands[window.hostDrawSlot].buffer, vk_render_graph::ResourceState {});
+
+                    // Nothing samples the depth, which is then only ever an attachment.
+                    const auto depth = graph.createImage(vk_render_graph::TransientImageInfo {
+                        .format = m_depthFormat,
+                        .extent = targetSize,
+                        .usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+                        .aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
+                        .samples = m_samples,
+                    });
+
+                    return SceneResources {
+                        .drawCommands = drawCommands,
+                        .drawCount = drawCommands,
+                        .depth = depth,
+                        .resolvedDepth = depth,
+                        .depthPyramid = graph.importImage(window.pyramid.image, window.pyramid.view, vk_render_graph::ResourceState {}),
+                        .lightClusters = lightClusters,
+                        .shadowMap = shadowMap,
+                        .shadowPageTable = std::nullopt,
+                        .skinnedVertices = skinnedVertices,
+                        .preprocess = drawCommands,
+                    };
+                }
+
+                // Last frame's draw is the last use of the draw buffers and the preprocess buffer,
+                // and its pyramid pass the last use of the pyramid.
+                // Multisampled depth is only ever an attachment, and resolved for the pyramid.
+                const auto drawStages = this->drawStages();
+                const auto depth = graph.createImage(vk_render_graph::TransientImageInfo {
+                    .format = m_depthFormat,
+                    .extent = targetSize,
+                    .usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | (this->isMultisampled() ? VkImageUsageFlags { 0 } : VkImageUsageFlags { VK_IMAGE_USAGE_SAMPLED_BIT }),
+                    .aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
+                    .samples = m_samples,
+                });
+                const auto drawCommands = graph.importBuffer(window.drawCommands.buffer, vk_render_graph::ResourceState { drawStages, VK_ACCESS_2_NONE });
+                const auto resources = SceneResources {
+                    .drawCommands = drawCommands,
+                    .drawCount = graph.importBuffer(window.drawCount.buffer, vk_render_graph::ResourceState { drawStages, VK_ACCESS_2_NONE }),
+                    .depth = depth,
+                    .resolvedDepth = this->isMultisampled()
+                        ? graph.createImage(vk_render_graph::TransientImageInfo {
+                            .format = m_depthFormat,
+                            .extent = targetSize,
+                            .usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                            .aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
+                        })
+                        : depth,
+                    .depthPyramid = graph.importImage(
+                        window.pyramid.image,
+                        window.pyramid.view,
+                        window.pyramid.built
+                            ? vk_render_graph::ResourceState { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL }
+                            : vk_render_graph::ResourceState {}
+                    ),
+                    .lightClusters = lightClusters,
+                    .shadowMap = shadowMap,
+                    .shadowPageTable = m_shadowMode == ShadowMode::Virtual ? std::optional { m_shadowPageTableResource } : std::nullopt,
+                    .skinnedVertices = skinnedVertices,
+                    .preprocess = m_generatedCommands
+                        ? graph.importBuffer(
+                            window.preprocess.buffer,
+                            vk_render_graph::ResourceState { VK_PIPELINE_STAGE_2_COMMAND_PREPROCESS_BIT_EXT, VK_ACCESS_2_COMMAND_PREPROCESS_WRITE_BIT_EXT }
+                        )
+                        : drawCommands,
+                };
+                graph.exportResource(resources.depthPyramid);
+
+                if (!m_depthPrepass) {
+                    this->addCullPass(graph, resources, windowIndex, CullPhase::Single, "cullReset", "cull");
+
+                    return resources;
+                }
+
+                // Last frame's late cull is the last use of the visibility, which starts out
+                // with nothing visible.
+                const auto visibility = graph.importBuffer(
+                    window.visibility.buffer,
+                    window.visibilityCleared
+                        ? vk_render_graph::ResourceState { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT }
+                        : vk_render_graph::ResourceState {}
+                );
+                if (!window.visibilityCleared) {
+                    window.visibilityCleared = true;
+                    graph.addPass(
+                        "visibilityReset",
+                        {
+                            vk_render_graph::write(visibility, VK_PIPELINE_STAGE_2_CLEAR_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT),
+                        },
+                        [this, windowIndex](VkCommandBuffer commandBuffer) {
+                            vkCmdFillBuffer(commandBuffer, m_windows[windowIndex].visibility.buffer, 0, VK_WHOLE_SIZE, 0);
+                        }
+                    );
+                }
+
+                this->addCullPass(graph, resources, windowIndex, CullPhase::Early, "earlyCullReset", "earlyCull", visibility);
+                auto prepassAccesses = this->drawAccesses(resources);
+                prepassAccesses.push_back(vk_render_graph::write(
+                    resources.depth,
+                    VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+                    VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                    VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL
+                ));
+                if (this->isMultisampled()) {
+                    prepassAccesses.push_back(this->depthResolveAccess(resources));
+                }
+                graph.addPass(
+                    "depthPrepass",
+                    prepassAccesses,
+                    [this, &graph, resources, windowIndex, renderExtent](VkCommandBuffer commandBuffer) {
+                        this->recordDepthPrepass(commandBuffer, windowIndex, graph.imageView(resources.depth), graph.imageView(resources.resolvedDepth), renderExtent);
+                    }
+                );
+                this->addPyramidPass(graph, resources, windowIndex, renderExtent);
+                this->addShadowPageMarkPass(graph, resources, windowIndex, renderExtent);
+                this->addCullPass(graph, resources, windowIndex, CullPhase::Late, "lateCullReset", "lateCull", visibility);
+
+                return resources;
+            }
+
+            // The accesses of the main pass that draws the scene, besides its color target. The
+            // task shader reads the instance list, the counts and the depth pyramid as well, and
+            // the fragment shader the light clusters, the shadow map and its page table, and with
+            // ray queries the acceleration structures, whose passes this frame has to have added.
+            std::vector<vk_render_graph::ResourceAccess> mainPassAccesses(const SceneResources& resources) const {
+                auto accesses = std::vector<vk_render_graph::ResourceAccess> {
+                    vk_render_graph::write(
+                        resources.depth,
+                        VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+                        VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                        VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL
+                    ),
+                };
+                if (this->isMultisampled() && this->readsDepthAfterDraw()) {
+                    accesses.push_back(this->depthResolveAccess(resources));
+                }
+                if (m_lightCount > 0) {
+                    accesses.push_back(vk_render_graph::read(resources.lightClusters, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT));
+                }
+                // Sampled even without shadows, to find out there are none.
+                accesses.push_back(vk_render_graph::read(
+                    resources.shadowMap,
+                    VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+                    VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+                ));
+                if (resources.shadowPageTable.has_value()) {
+                    accesses.push_back(vk_render_graph::read(resources.shadowPageTable.value(), VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT));
+                }
+                if (m_accelerationStructure != nullptr) {
+                    const auto traceAccesses = m_accelerationStructure->traceAccesses(VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT);
+                    accesses.insert(accesses.end(), traceAccesses.begin(), traceAccesses.end());
+                }
+
+                const auto drawAccesses = this->drawAccesses(resources);
+                accesses.insert(accesses.end(), drawAccesses.begin(), drawAccesses.end());
+
+                return accesses;
+            }
+
+            // Downsamples the depth the main pass left in `renderExtent` into the window's depth
+            // pyramid, for the next frame's culling, and marks the virtual shadow map's pages it
+            // needs. CPU culling needs no pyramid, and with a depth pre-pass, the pyramid is built
+            // from the pre-pass instead.
+            void addDepthPyramidPass(vk_render_graph::RenderGraph& graph, const SceneResources& resources, uint32_t windowIndex, VkExtent2D renderExtent) {
+                if (this->usesCpuCulling() || m_depthPrepass) {
+                    return;
+                }
+
+                this->addPyramidPass(graph, resources, windowIndex, renderExtent);
+                this->addShadowPageMarkPass(graph, resources, windowIndex, renderExtent);
+            }
+
+            // Draws every instance the cull pass kept, inside a render pass with a `colorFormat`
+            // color attachment and a `depthFormat()` depth attachment. After a depth pre-pass,
+            // the depth buffer has to hold what the pre-pass left.
+            void recordDraw(VkCommandBuffer commandBuffer, uint32_t windowIndex, VkFormat colorFormat, VkExtent2D renderExtent) const {
+                this->recordSceneDraw(commandBuffer, m_windows[windowIndex], colorFormat, renderExtent, m_windows[windowIndex].uniformOffset, this->drawRasterState());
+            }
+
+            // Everything `recordDraw` records from. The cull pass writes the draws on the GPU,
+            // and the uniforms are reached through their offset, so a scene the CPU does not
+            // cull records the same draw every frame its frame slot's uniforms land in the same
+            // place, and a recording of it can be executed again while the hash stays the same.
+            uint64_t drawHash(uint32_t windowIndex, VkFormat colorFormat, VkExtent2D renderExtent) const {
+                const auto& window = m_windows[windowIndex];
+                auto hasher = vk_pipelines::StateHasher {};
+                hasher.add(colorFormat);
+                hasher.add(renderExtent.width);
+                hasher.add(renderExtent.height);
+                hasher.add(m_shaderObjects);
+                // A reload may hand back the same pipeline in a new execution set.
+                hasher.add(m_shaderGeneration);
+                if (m_shaderObjects) {
+                    for (const auto& shader : m_sceneShaders) {
+                        hasher.add(shader.get());
+                    }
+                    hasher.add(m_samples);
+                } else {
+                    for (const auto& [format, pipeline] : m_drawPipelines) {
+                        if (format == colorFormat) {
+                            hasher.add(pipeline);
+                        }
+                    }
+                }
+
+                vk_pipelines::hashRasterState(hasher, this->drawRasterState());
+                hasher.add(m_dynamicStates.inputAssembly);
+                hasher.add(m_dynamicStates.blend);
+                hasher.add(m_shadingRate.has_value());
+                if (m_shadingRate.has_value()) {
+                    hasher.add(m_shadingRate->fragmentSize.width);
+                    hasher.add(m_shadingRate->fragmentSize.height);
+                    hasher.add(m_shadingRate->combinerOps[0]);
+                    hasher.add(m_shadingRate->combinerOps[1]);
+                    hasher.add(m_shadingRate->attachment);
+                }
+
+                hasher.add(window.pyramid.generation);
+                hasher.add(window.uniformOffset);
+                hasher.add(m_meshShading);
+                if (m_meshShading) {
+                    hasher.add(m_sceneAddresses.instances);
+                    hasher.add(m_sceneAddresses.meshlets);
+                    hasher.add(m_sceneAddresses.meshletVertices);
+                    hasher.add(m_sceneAddresses.meshletTriangles);
+                    hasher.add(m_sceneAddresses.vertices);
+                    hasher.add(window.drawCount.buffer.get());
+
+                    return hasher.value();
+                }
+
+                hasher.add(this->drawnVertexBuffer());
+                hasher.add(m_indexBuffer.buffer.get());
+                if (this->usesCpuCulling()) {
+                    hasher.add(window.hostDrawCommands[window.hostDrawSlot].buffer.get());
+                    hasher.add(window.hostDrawCount);
+                    hasher.add(m_maxDrawIndirectCount);
+                } else {
+                    hasher.add(window.drawCommands.buffer.get());
+                    hasher.add(window.drawCount.buffer.get());
+                    hasher.add(m_instanceCount);
+                }
+
+                hasher.add(m_generatedCommands);
+                if (m_generatedCommands) {
+                    hasher.add(this->executionSet(colorFormat));
+                    hasher.add(window.preprocess.buffer.get());
+                    hasher.add(window.preprocessSize);
+                }
+
+                return hasher.value();
+            }
+        private:
+            // The cull pass counts visible instances, and on the mesh shading path also sets the
+            // task workgroup count of the draw, the layout of `DrawCount` in `cull.comp`.
+            struct DrawCount {
+                uint32_t drawCount;
+                VkDrawMeshTasksIndirectCommandEXT taskGroupCount;
+            };
+
+            static_assert(sizeof(DrawCount) == 4 * sizeof(uint32_t), "DrawCount must match the std430 layout of the shaders");
+
+            struct MeshUpload {
+                VkBuffer buffer;
+                const void* data;
+                VkDeviceSize size;
+                VkAccessFlags dstAccessMask;
+            };
+
+            // Members are destroyed in reverse order, so the buffer goes before its memory. Buffers
+            // created with `VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT` know their `address`.
+            struct BufferAllocation {
+                vk_memory::ScopedAllocation memory;
+                vk_handles::Buffer buffer;
+                VkDeviceAddress address = 0;
+            };
+
+            // A window's depth pyramid, with a view of every level, the downsampler's scratch
+            // buffer, and the scene set that points into it, which are replaced together when the
+            // render target is resized. The pyramid is built from a depth buffer the render graph
+            // may recreate, so the downsampler's set comes from the frame descriptor allocator
+            // every frame instead.
+            struct DepthPyramid {
+                VkExtent2D extent {};
+                uint32_t levelCount = 0;
+                bool built = false;
+                vk_memory::ScopedAllocation memory;
+                vk_handles::Image image;
+                vk_handles::ImageView view;
+                std::vector<vk_handles::ImageView> levelViews;
+                BufferAllocation scratch;
+                vk_handles::DescriptorPool descriptorPool;
+                VkDescriptorSet sceneSet = VK_NULL_HANDLE;
+                // Tells a pyramid apart from the one it replaced, whose handles may be reused.
+                uint64_t generation = 0;
+            };
+
+            // The shadow map, with a view of each cascade's layer to render into, and one of every
+            // layer for the scene to sample through the compare sampler. The virtual shadow map's
+            // atlas is a single layer, and without shadows the map is a single texel, which the
+            // fragment shader binds all the same.
+            struct ShadowMap {
+                uint32_t size = 0;
+                uint32_t layerCount = 0;
+                // Once a main pass has sampled it, the map is left in the layout it samples in.
+                bool sampled = false;
+                vk_memory::ScopedAllocation memory;
+                vk_handles::Image image;
+                vk_handles::ImageView view;
+                std::vector<vk_handles::ImageView> layerViews;
+                VkSampler sampler = VK_NULL_HANDLE;
+            };
+
+            // On the CPU culling path, `hostDrawCommands` holds a mapped buffer per frame in
+            // flight, of which the current frame draws `hostDrawCount` from `hostDrawSlot`.
+            struct WindowResources {
+                BufferAllocation drawCommands;
+                BufferAllocation drawCount;
+                BufferAllocation lightClusters;
+                BufferAllocation visibility;
+                bool visibilityCleared = false;
+                DepthPyramid pyramid;
+                // Sized for every draw of the window with device generated commands.
+                BufferAllocation preprocess;
+                VkDeviceSize preprocessSize = 0;
+                uint32_t uniformOffset = 0;
+                // The uniforms of the early cull and the depth pre-pass, which cull nothing
+                // against the pyramid.
+                uint32_t earlyUniformOffset = 0;
+                SceneCamera camera {};
+                std::vector<BufferAllocation> hostDrawCommands;
+                uint32_t hostDrawSlot = 0;
+                uint32_t hostDrawCount = 0;
+            };
+
+            static constexpr auto VERTEX_BINDING = VkVertexInputBindingDescription {
+                .binding = 0,
+                .stride = sizeof(Vertex),
+                .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
+            };
+            static constexpr auto VERTEX_ATTRIBUTES = std::array {
+                VkVertexInputAttributeDescription {
+                    .location = 0,
+                    .binding = 0,
+                    .format = VK_FORMAT_R16G16B16A16_UNORM,
+                    .offset = offsetof(Vertex, position),
+                },
+                VkVertexInputAttributeDescription {
+                    .location = 1,
+                    .binding = 0,
+                    .format = VK_FORMAT_R16G16_SNORM,
+                    .offset = offsetof(Vertex, normal),
+                },
+            };
+
+            VkDevice m_device = VK_NULL_HANDLE;
+            vk_memory::DeviceMemoryAllocator* m_memoryAllocator = nullptr;
+            VkBuffer m_uniformBuffer = VK_NULL_HANDLE;
+            vk_descriptors::DescriptorLayoutCache* m_layoutCache = nullptr;
+            vk_descriptors::SamplerCache* m_samplerCache = nullptr;
+            vk_descriptors::FrameDescriptorAllocator* m_frameDescriptors = nullptr;
+            vk_shaders::ShaderLibrary* m_shaderLibrary = nullptr;
+            vk_pipelines::PipelineRegistry* m_pipelineRegistry = nullptr;
+            vk_pipelines::PipelineCompiler* m_pipelineCompiler = nullptr;
+            vk_compute::ComputeTuning m_computeTuning;
+            const VkAllocationCallbacks* m_allocator = nullptr;
+            uint32_t m_framesInFlight = 1;
+            vk_jobs::JobSystem* m_cullingJobSystem = nullptr;
+            vk_jobs::JobSystem* m_sceneJobSystem = nullptr;
+            uint32_t m_maxDrawIndirectCount = 1;
+
+            VkDescriptorSetLayout m_sceneSetLayout = VK_NULL_HANDLE;
+            VkPipelineLayout m_scenePipelineLayout = VK_NULL_HANDLE;
+            // Indexed by `CullPhase`, of which only the phases the renderer runs exist.
+            std::array<VkPipeline, 3> m_cullPipelines {};
+            vk_downsample::SinglePassDownsampler m_pyramidDownsampler;
+            VkPipeline m_lightCullPipeline = VK_NULL_HANDLE;
+            std::vector<std::pair<VkFormat, VkPipeline>> m_drawPipelines;
+            // The draw pipelines still drawing unoptimized while the compiler builds them.
+            std::vector<std::pair<VkFormat, vk_pipelines::PipelineHandle>> m_compilingDrawPipelines;
+            bool m_shaderObjects = false;
+            bool m_generatedCommands = false;
+            // Indexed by whether the draw is depth only, which binds no fragment stage.
+            std::array<VkIndirectCommandsLayoutEXT, 2> m_commandsLayouts {};
+            // Per draw pipeline, which starts out as the only pipeline of its set.
+            std::vector<std::pair<VkFormat, VkIndirectExecutionSetEXT>> m_executionSets;
+            bool m_depthPrepass = false;
+            float m_lodErrorPixels = 0.0f;
+            VkSampleCountFlagBits m_samples = VK_SAMPLE_COUNT_1_BIT;
+            VkFormat m_depthFormat = VK_FORMAT_D32_SFLOAT;
+            VkResolveModeFlagBits m_depthResolveMode = VK_RESOLVE_MODE_NONE;
+            // Set whenever fragment shading rates are enabled, which every draw then sets.
+            std::optional<vk_shading_rate::DrawShadingRate> m_shadingRate;
+            std::vector<vk_handles::Shader> m_sceneShaders;
+            // Set by the shader library when one of `sceneShaderNames` was rebuilt, and counted
+            // up every time the pipelines and shaders built from them are dropped.
+            bool m_sceneShadersReloaded = false;
+            uint64_t m_shaderGeneration = 0;
+            VkSampler m_sampler = VK_NULL_HANDLE;
+
+            std::vector<Vertex> m_vertices;
+            vk_vertex_format::QuantizationBounds m_meshBounds;
+            // Every level's indices follow the one before's, the first level's from the start.
+            std::array<MeshLod, LOD_COUNT> m_lods {};
+            std::vector<uint32_t> m_indices;
+            // Every instance is an entity with a `LocalTransform` and a `SceneInstance`.
+            vk_ecs::World m_scene;
+            uint32_t m_instanceCount = 0;
+            // Instances are extracted into frame packets, copied into the instance buffer from
+            // them, and drawn once the mesh is up as well.
+            uint32_t m_extractedInstanceCount = 0;
+            uint32_t m_streamedInstanceCount = 0;
+            uint32_t m_uploadedInstanceCount = 0;
+            // The states of the last two ticks taken, without their world matrices, and where
+            // frames are between them.
+            ScenePacket m_previousTick;
+            ScenePacket m_latestTick;
+            bool m_tookFirstPacket = false;
+            float m_tickAlpha = 0.0f;
+            std::vector<MeshUpload> m_meshUploads;
+            size_t m_uploadedMeshBufferCount = 0;
+            float m_fieldSize = 0.0f;
+            BufferAllocation m_vertexBuffer;
+            BufferAllocation m_indexBuffer;
+            BufferAllocation m_instanceBuffer;
+            uint32_t m_lightCount = 0;
+            std::vector<vk_lights::Light> m_lights;
+            BufferAllocation m_lightBuffer;
+            vk_cpu_culling::BoundsStore m_bounds;
+            vk_cpu_culling::FrustumCuller m_culler;
+            // The first level's positions, which its indices index from zero, for the structures
+            // rays are traced through.
+            std::vector<glm::vec3> m_meshPositions;
+            vk_ray_query::SceneAccelerationStructure* m_accelerationStructure = nullptr;
+
+            bool m_meshShading = false;
+            vk_pipelines::DynamicRasterStates m_dynamicStates;
+            vk_pipelines::DynamicRasterState m_rasterState { .depthCompareOp = DEPTH_COMPARE_OP };
+            vk_meshlets::MeshletMesh m_meshlets;
+            BufferAllocation m_meshletBuffer;
+            BufferAllocation m_meshletVertexBuffer;
+            BufferAllocation m_meshletTriangleBuffer;
+            SceneAddresses m_sceneAddresses {};
+
+            std::vector<WindowResources> m_windows;
+            uint64_t m_pyramidGeneration = 0;
+
+            ShadowMode m_shadowMode = ShadowMode::Off;
+            ShadowMap m_shadowMap;
+            VkPipelineLayout m_shadowPipelineLayout = VK_NULL_HANDLE;
+            VkPipeline m_shadowPipeline = VK_NULL_HANDLE;
+            vk_shadows::ShadowCascades m_shadowCascades;
+            // The frame the cascades were last fitted for, whose graph the map was imported
+            // into as `m_shadowMapResource`.
+            std::optional<uint64_t> m_shadowFrame;
+            vk_render_graph::ResourceId m_shadowMapResource = 0;
+            // The instances the cached cascades and the resident pages hold the shadows of.
+            uint32_t m_shadowCasterCount = 0;
+            uint32_t m_castCascadeCount = 0;
+
+            // The virtual shadow map's page table, which a single entry stands in for without
+            // it. The windows' page mark passes flag the pages they need in `m_shadowPageRequests`
+            // all frame, and the next frame copies the flags into the mapped readback buffer of
+            // its frame slot, which is pending until the CPU reads it a cycle of frames later.
+            vk_virtual_shadows::VirtualShadowMap m_virtualShadows;
+            BufferAllocation m_shadowPageTable;
+            bool m_shadowPageTableSampled = false;
+            BufferAllocation m_shadowPageRequests;
+            bool m_shadowPageRequestsMarked = false;
+            std::vector<BufferAllocation> m_shadowPageReadbacks;
+            std::vector<bool> m_shadowPageReadbacksPending;
+            vk_render_graph::ResourceId m_shadowPageTableResource = 0;
+            vk_render_graph::ResourceId m_shadowPageRequestsResource = 0;
+            VkDescriptorSetLayout m_pageMarkSetLayout = VK_NULL_HANDLE;
+            VkPipelineLayout m_pageMarkPipelineLayout = VK_NULL_HANDLE;
+            VkPipeline m_pageMarkPipeline = VK_NULL_HANDLE;
+            uint32_t m_renderedPageCount = 0;
+
+            // Where the scene is animated, the rest pose stays in `m_vertexBuffer`, which the skin
+            // pass reads with `m_skinWeights`, and the first window to cull in a frame skins it
+            // into `m_skinnedVertexBuffer`, imported into that frame's graph as
+            // `m_skinnedVertexResource`.
+            vk_jobs::JobSystem* m_animationJobSystem = nullptr;
+            vk_animation::Animator m_animator;
+            std::vector<SkinWeights> m_skinWeights;
+            BufferAllocation m_skinWeightBuffer;
+            BufferAllocation m_skinnedVertexBuffer;
+            bool m_skinnedVerticesDrawn = false;
+            std::optional<uint64_t> m_skinFrame;
+            vk_render_graph::ResourceId m_skinnedVertexResource = 0;
+            VkDescriptorSetLayout m_skinSetLayout = VK_NULL_HANDLE;
+            VkPipelineLayout m_skinPipelineLayout = VK_NULL_HANDLE;
+            VkPipeline m_skinPipeline = VK_NULL_HANDLE;
+            vk_handles::DescriptorPool m_skinDescriptorPool;
+            VkDescriptorSet m_skinSet = VK_NULL_HANDLE;
+
+            // The vertices the vertex pipeline draws, skinned when the scene is animated.
+            VkBuffer drawnVertexBuffer() const {
+                return this->usesAnimation() ? m_skinnedVertexBuffer.buffer.get() : m_vertexBuffer.buffer.get();
+            }
+
+            // After a depth pre-pass, the draw only shades what is already in the depth buffer.
+            vk_pipelines::DynamicRasterState drawRasterState() const {
+                auto rasterState = m_rasterState;
+                if (m_depthPrepass) {
+                    rasterState.depthCompareOp = VK_COMPARE_OP_GREATER_OR_EQUAL;
+                }
+
+                return rasterState;
+            }
+
+            // The stages the main pass reads the draw buffers in. Device generated commands are
+            // preprocessed from them as well, within the execution.
+            VkPipelineStageFlags2 drawStages() const {
+                if (m_meshShading) {
+                    return VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_TASK_SHADER_BIT_EXT;
+                } else if (m_generatedCommands) {
+                    return VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_COMMAND_PREPROCESS_BIT_EXT;
+                }
+
+                return VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT;
+            }
+
+            // The mesh shading stages cannot be named without the feature. Their shaders reach the
+            // instances and the meshlets through `SceneAddresses` instead of the scene set.
+            void createLayouts() {
+                const auto taskStage = m_meshShading ? VkShaderStageFlags { VK_SHADER_STAGE_TASK_BIT_EXT } : VkShaderStageFlags { 0 };
+                const auto meshStages = m_meshShading ? VkShaderStageFlags { VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT } : VkShaderStageFlags { 0 };
+                const auto binding = [](uint32_t index, VkDescriptorType type, VkShaderStageFlags stages) {
+                    return VkDescriptorSetLayoutBinding {
+                        .binding = index,
+                        .descriptorType = type,
+                        .descriptorCount = 1,
+                        .stageFlags = stages,
+                    };
+                };
+
+                auto sceneBindings = std::vector {
+                    binding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_VERTEX_BIT | meshStages | VK_SHADER_STAGE_FRAGMENT_BIT),
+                    binding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_VERTEX_BIT),
+                    binding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT),
+                    binding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT | taskStage),
+                    binding(4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT | taskStage),
+                    binding(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT | taskStage),
+                    binding(6, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT),
+                    binding(7, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT),
+                    binding(8, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT),
+                    binding(9, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT),
+                    binding(10, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT),
+                };
+                if (m_shadowMode == ShadowMode::RayQuery) {
+                    sceneBindings.push_back(binding(11, VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, VK_SHADER_STAGE_FRAGMENT_BIT));
+                }
+                m_sceneSetLayout = m_layoutCache->layout(sceneBindings);
+
+                // The cull and draw pipelines share the scene set, and so a layout.
+                const auto scenePushConstantRange = this->scenePushConstantRange();
+                m_scenePipelineLayout = this->createPipelineLayout({ m_sceneSetLayout }, &scenePushConstantRange);
+
+                // The shadow pass draws with the scene set of the window that fitted the cascades.
+                const auto shadowPushConstantRange = VkPushConstantRange {
+                    .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+                    .offset = 0,
+                    .size = sizeof(ShadowConstants),
+                };
+                m_shadowPipelineLayout = this->createPipelineLayout({ m_sceneSetLayout }, &shadowPushConstantRange);
+                if (this->usesAnimation()) {
+                    // The skin pass reads the mesh's bounds from the first window's scene set, and
+                    // the palette, the rest pose and the weights from a set of its own.
+                    const auto skinBindings = std::array {
+                        binding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_COMPUTE_BIT),
+                        binding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT),
+                        binding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT),
+                        binding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT),
+                    };
+                    m_skinSetLayout = m_layoutCache->layout(skinBindings);
+                    const auto skinPushConstantRange = VkPushConstantRange {
+                        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                        .offset = 0,
+                        .size = sizeof(SkinPushConstants),
+                    };
+                    m_skinPipelineLayout = this->createPipelineLayout({ m_sceneSetLayout, m_skinSetLayout }, &skinPushConstantRange);
+                }
+                if (m_shadowMode != ShadowMode::Virtual) {
+                    return;
+                }
+
+                // The page mark pass reads the window's scene set for its uniforms, and a set of
+                // the frame for the depth buffer and the frame slot's page requests.
+                const auto pageMarkBindings = std::array {
+                    binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT),
+                    binding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT),
+                };
+                m_pageMarkSetLayout = m_layoutCache->layout(pageMarkBindings);
+                const auto pageMarkPushConstantRange = VkPushConstantRange {
+                    .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                    .offset = 0,
+                    .size = sizeof(PageMarkPushConstants),
+                };
+                m_pageMarkPipelineLayout = this->createPipelineLayout({ m_sceneSetLayout, m_pageMarkSetLayout }, &pageMarkPushConstantRange);
+            }
+
+            // The scene's addresses on the mesh shading path, and `DrawConstants` otherwise,
+            // which `scene.vert` declares whether or not anything pushes them.
+            VkPushConstantRange scenePushConstantRange() const {
+                return m_meshShading
+                    ? VkPushConstantRange {
+                        .stageFlags = VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT,
+                        .offset = 0,
+                        .size = sizeof(SceneAddresses),
+                    }
+                    : VkPushConstantRange {
+                        .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+                        .offset = 0,
+                        .size = sizeof(DrawConstants),
+                    };
+            }
+
+            // The shader stages the scene's pipelines bind, which are the stages of the execution
+            // sets and commands layouts as well.
+            static VkShaderStageFlags generatedStages(bool depthOnly) {
+                return depthOnly
+                    ? VkShaderStageFlags { VK_SHADER_STAGE_VERTEX_BIT }
+                    : VkShaderStageFlags { VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT };
+            }
+
+            // Every sequence binds a pipeline of the execution set, pushes the instance to
+            // `scene.vert`, and draws it, in the layout of `GeneratedDraw`. The index and vertex
+            // buffers stay bound from the CPU.
+            void createCommandsLayouts() {
+                const auto pushConstantToken = VkIndirectCommandsPushConstantTokenEXT {
+                    .updateRange = this->scenePushConstantRange(),
+                };
+                for (const bool depthOnly : { false, true }) {
+                    const auto executionSetToken = VkIndirectCommandsExecutionSetTokenEXT {
+                        .type = VK_INDIRECT_EXECUTION_SET_INFO_TYPE_PIPELINES_EXT,
+                        .shaderStages = generatedStages(depthOnly),
+                    };
+                    const auto tokens = std::array {
+                        VkIndirectCommandsLayoutTokenEXT {
+                            .sType = VK_STRUCTURE_TYPE_INDIRECT_COMMANDS_LAYOUT_TOKEN_EXT,
+                            .type = VK_INDIRECT_COMMANDS_TOKEN_TYPE_EXECUTION_SET_EXT,
+                            .data = VkIndirectCommandsTokenDataEXT { .pExecutionSet = &executionSetToken },
+                            .offset = offsetof(GeneratedDraw, pipelineIndex),
+                        },
+                        VkIndirectCommandsLayoutTokenEXT {
+                            .sType = VK_STRUCTURE_TYPE_INDIRECT_COMMANDS_LAYOUT_TOKEN_EXT,
+                            .type = VK_INDIRECT_COMMANDS_TOKEN_TYPE_PUSH_CONSTANT_EXT,
+                            .data = VkIndirectCommandsTokenDataEXT { .pPushConstant = &pushConstantToken },
+                            .offset = offsetof(GeneratedDraw, constants),
+                        },
+                        VkIndirectCommandsLayoutTokenEXT {
+                            .sType = VK_STRUCTURE_TYPE_INDIRECT_COMMANDS_LAYOUT_TOKEN_EXT,
+                            .type = VK_INDIRECT_COMMANDS_TOKEN_TYPE_DRAW_INDEXED_EXT,
+                            .offset = offsetof(GeneratedDraw, draw),
+                        },
+                    };
+                    const auto layoutInfo = VkIndirectCommandsLayoutCreateInfoEXT {
+                        .sType = VK_STRUCTURE_TYPE_INDIRECT_COMMANDS_LAYOUT_CREATE_INFO_EXT,
+                        .shaderStages = generatedStages(depthOnly),
+                        .indirectStride = sizeof(GeneratedDraw),
+                        .pipelineLayout = m_scenePipelineLayout,
+                        .tokenCount = static_cast<uint32_t>(tokens.size()),
+                        .pTokens = tokens.data(),
+                    };
+
+                    const auto result = vkCreateIndirectCommandsLayoutEXT(m_device, &layoutInfo, m_allocator, &m_commandsLayouts[depthOnly ? 1 : 0]);
+                    if (result != VK_SUCCESS) {
+                        throw std::runtime_error("failed to create scene indirect commands layout!");
+                    }
+                }
+            }
+
+            VkIndirectExecutionSetEXT createExecutionSet(VkPipeline pipeline) const {
+                const auto pipelineInfo = VkIndirectExecutionSetPipelineInfoEXT {
+                    .sType = VK_STRUCTURE_TYPE_INDIRECT_EXECUTION_SET_PIPELINE_INFO_EXT,
+                    .initialPipeline = pipeline,
+                    .maxPipelineCount = 1,
+                };
+                const auto setInfo = VkIndirectExecutionSetCreateInfoEXT {
+                    .sType = VK_STRUCTURE_TYPE_INDIRECT_EXECUTION_SET_CREATE_INFO_EXT,
+                    .type = VK_INDIRECT_EXECUTION_SET_INFO_TYPE_PIPELINES_EXT,
+                    .info = VkIndirectExecutionSetInfoEXT { .pPipelineInfo = &pipelineInfo },
+                };
+
+                auto executionSet = VkIndirectExecutionSetEXT {};
+                const auto result = vkCreateIndirectExecutionSetEXT(m_device, &setInfo, m_allocator, &executionSet);
+                if (result != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create scene indirect execution set!");
+                }
+
+                return executionSet;
+            }
+
+            VkIndirectExecutionSetEXT executionSet(VkFormat colorFormat) const {
+                for (const auto& [format, executionSet] : m_executionSets) {
+                    if (format == colorFormat) {
+                        return executionSet;
+                    }
+                }
+
+                throw std::runtime_error("failed to find scene indirect execution set!");
+            }
+
+            // The preprocess space the draw of `colorFormat` needs for a sequence per instance.
+            VkDeviceSize preprocessSize(VkFormat colorFormat) const {
+                const auto requirementsInfo = VkGeneratedCommandsMemoryRequirementsInfoEXT {
+                    .sType = VK_STRUCTURE_TYPE_GENERATED_COMMANDS_MEMORY_REQUIREMENTS_INFO_EXT,
+                    .indirectExecutionSet = this->executionSet(colorFormat),
+                    .indirectCommandsLayout = m_commandsLayouts[colorFormat == VK_FORMAT_UNDEFINED ? 1 : 0],
+                    .maxSequenceCount = std::max(m_instanceCount, 1u),
+                };
+                auto requirements = VkMemoryRequirements2 {
+                    .sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2,
+                };
+                vkGetGeneratedCommandsMemoryRequirementsEXT(m_device, &requirementsInfo, &requirements);
+
+                return requirements.memoryRequirements.size;
+            }
+
+            // The window's draws take turns with its preprocess buffer, in the order the render
+            // graph runs them, so it is sized for the largest. A window that moves to a format
+            // that needs more gets a larger one, and the old one is retired against
+            // `retireValue`.
+            void preparePreprocessBuffer(WindowResources& window, VkFormat colorFormat, vk_handles::DeferredDestructionQueue& retiredResources, uint64_t retireValue) {
+                if (!m_generatedCommands) {
+                    return;
+                }
+
+                auto size = this->preprocessSize(colorFormat);
+                if (m_depthPrepass) {
+                    size = std::max(size, this->preprocessSize(VK_FORMAT_UNDEFINED));
+                }
+                if (window.preprocess.buffer && size <= window.preprocessSize) {
+                    return;
+                }
+
+                if (window.preprocess.buffer) {
+                    retiredResources.retire(retireValue, std::move(window.preprocess));
+                    window.preprocess = BufferAllocation();
+                }
+
+                // The usage of maintenance 5 replaces the one of the create info, which still
+                // tells `createBuffer` to look up the address. A device that needs no preprocess
+                // space still gets a buffer, for the render graph to order the draws by.
+                const auto usage = VkBufferUsageFlags2CreateInfoKHR {
+                    .sType = VK_STRUCTURE_TYPE_BUFFER_USAGE_FLAGS_2_CREATE_INFO_KHR,
+                    .usage = VK_BUFFER_USAGE_2_PREPROCESS_BUFFER_BIT_EXT | VK_BUFFER_USAGE_2_SHADER_DEVICE_ADDRESS_BIT_KHR,
+                };
+                window.preprocess = this->createBuffer(
+                    std::max(size, VkDeviceSize { 4 }),
+                    VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                    vk_memory::AllocationCreateInfo {
+                        .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                        .priority = vk_memory::MemoryPriority::High,
+                    },
+                    &usage
+                );
+                window.preprocessSize = size;
+            }
+
+            VkPipelineLayout createPipelineLayout(std::initializer_list<VkDescriptorSetLayout> setLayouts, const VkPushConstantRange* pushConstantRange) const {
+                const auto layoutInfo = VkPipelineLayoutCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+                    .setLayoutCount = static_cast<uint32_t>(setLayouts.size()),
+                    .pSetLayouts = setLayouts.begin(),
+                    .pushConstantRangeCount = pushConstantRange != nullptr ? 1u : 0u,
+                    .pPushConstantRanges = pushConstantRange,
+                };
+
+                auto layout = VkPipelineLayout {};
+                const auto result = vkCreatePipelineLayout(m_device, &layoutInfo, m_allocator, &layout);
+                if (result != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create scene pipeline layout!");
+                }
+
+                return layout;
+            }
+
+            VkPipeline createComputePipeline(
+                const char* shaderName,
+                VkPipelineLayout layout,
+                vk_pipelines::SpecializationConstants& constants,
+                const void* stageNext = nullptr
+            ) const {
+                const auto pipelineInfo = VkComputePipelineCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+                    .stage = VkPipelineShaderStageCreateInfo {
+                        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                        .pNext = stageNext,
+                        .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                        .module = m_shaderLibrary->shaderModule(shaderName),
+                        .pName = "main",
+                        .pSpecializationInfo = constants.info(),
+                    },
+                    .layout = layout,
+                };
+
+                return m_pipelineRegistry->computePipeline(pipelineInfo);
+            }
+
+            // The cull shader folds away the path the renderer does not take, and the phases it
+            // is not running in, and runs in the subgroup size it was tuned for. The subgroup
+            // variant needs ballots, which not every device has in compute, so it is a module of
+            // its own rather than a constant.
+            void createComputePipelines() {
+                const auto phases = m_depthPrepass
+                    ? std::vector { CullPhase::Early, CullPhase::Late }
+                    : std::vector { CullPhase::Single };
+                m_cullPipelines = {};
+                for (const auto phase : phases) {
+                    auto cullConstants = vk_pipelines::SpecializationConstants {};
+                    cullConstants
+                        .set(CULL_WORKGROUP_SIZE_ID, m_computeTuning.linear)
+                        .set(CULL_MESH_SHADING_ID, m_meshShading)
+                        .set(CULL_MESHLET_TASKS_PER_WORKGROUP_ID, MESHLET_TASKS_PER_WORKGROUP)
+                        .set(CULL_PHASE_ID, static_cast<uint32_t>(phase))
+                        .set(CULL_GENERATED_COMMANDS_ID, m_generatedCommands);
+                    auto requiredSize = VkPipelineShaderStageRequiredSubgroupSizeCreateInfo {};
+                    m_cullPipelines[static_cast<size_t>(phase)] = this->createComputePipeline(
+                        m_computeTuning.subgroupCompaction ? "cull_subgroup.comp" : "cull.comp",
+                        m_scenePipelineLayout,
+                        cullConstants,
+                        vk_compute::requiredSubgroupSize(m_computeTuning, requiredSize)
+                    );
+                }
+
+                m_pyramidDownsampler.init(
+                    m_device,
+                    *m_layoutCache,
+                    *m_shaderLibrary,
+                    *m_pipelineRegistry,
+                    m_computeTuning,
+                    m_allocator,
+                    vk_downsample::Reduction::Min
+                );
+
+                auto lightCullConstants = vk_pipelines::SpecializationConstants {};
+                lightCullConstants.set(vk_lights::LIGHT_CULL_WORKGROUP_SIZE_ID, m_computeTuning.linear);
+                m_lightCullPipeline = this->createComputePipeline("light_cull.comp", m_scenePipelineLayout, lightCullConstants);
+                if (this->usesAnimation()) {
+                    auto skinConstants = vk_pipelines::SpecializationConstants {};
+                    skinConstants.set(SKIN_WORKGROUP_SIZE_ID, m_computeTuning.linear);
+                    m_skinPipeline = this->createComputePipeline("skin.comp", m_skinPipelineLayout, skinConstants);
+                }
+                if (m_shadowMode != ShadowMode::Virtual) {
+                    return;
+                }
+
+                auto pageMarkConstants = vk_pipelines::SpecializationConstants {};
+                pageMarkConstants
+                    .set(PAGE_MARK_WORKGROUP_WIDTH_ID, m_computeTuning.tile)
+                    .set(PAGE_MARK_WORKGROUP_HEIGHT_ID, m_computeTuning.tile);
+                m_pageMarkPipeline = this->createComputePipeline("shadow_pages.comp", m_pageMarkPipelineLayout, pageMarkConstants);
+            }
+
+            // The pyramid is read with `texelFetch`, so the sampler only has to allow every level.
+            void createSampler() {
+                const auto samplerInfo = VkSamplerCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+                    .magFilter = VK_FILTER_NEAREST,
+                    .minFilter = VK_FILTER_NEAREST,
+                    .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+                    .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                    .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                    .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                    .minLod = 0.0f,
+                    .maxLod = VK_LOD_CLAMP_NONE,
+                };
+                m_sampler = m_samplerCache->sampler(samplerInfo);
+            }
+
+            // Without shadows the map is a single texel, which only the fragment shader's binding
+            // needs. The compare sampler tests a depth against a single texel, and the fragment
+            // shader filters the results of the 3x3 texels around it.
+            void createShadowMap() {
+                auto& shadowMap = m_shadowMap;
+                shadowMap.size = m_shadowMode == ShadowMode::Virtual ? vk_virtual_shadows::ATLAS_SIZE : this->usesShadows() ? vk_shadows::MAP_SIZE : 1;
+                shadowMap.layerCount = m_shadowMode == ShadowMode::Virtual ? 1 : vk_shadows::CASCADE_COUNT;
+                const auto imageInfo = VkImageCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+                    .imageType = VK_IMAGE_TYPE_2D,
+                    .format = vk_shadows::MAP_FORMAT,
+                    .extent = VkExtent3D { shadowMap.size, shadowMap.size, 1 },
+                    .mipLevels = 1,
+                    .arrayLayers = shadowMap.layerCount,
+                    .samples = VK_SAMPLE_COUNT_1_BIT,
+                    .tiling = VK_IMAGE_TILING_OPTIMAL,
+                    .usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                    .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                };
+
+                auto image = VkImage {};
+                const auto imageResult = vkCreateImage(m_device, &imageInfo, m_allocator, &image);
+                if (imageResult != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create shadow map!");
+                }
+
+                shadowMap.image = vk_handles::Image { m_device, image, m_allocator };
+                shadowMap.memory = vk_memory::ScopedAllocation {
+                    *m_memoryAllocator,
+                    m_memoryAllocator->allocateForImage(image, vk_memory::AllocationCreateInfo {
+                        .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                        .kind = vk_memory::ResourceKind::Optimal,
+                        .priority = vk_memory::MemoryPriority::High,
+                    }),
+                };
+
+                shadowMap.view = this->createShadowMapView(image, VK_IMAGE_VIEW_TYPE_2D_ARRAY, 0, shadowMap.layerCount);
+                for (uint32_t layer = 0; layer < shadowMap.layerCount; layer++) {
+                    shadowMap.layerViews.push_back(this->createShadowMapView(image, VK_IMAGE_VIEW_TYPE_2D, layer, 1));
+                }
+
+                const auto samplerInfo = VkSamplerCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+                    .magFilter = VK_FILTER_NEAREST,
+                    .minFilter = VK_FILTER_NEAREST,
+                    .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+                    .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                    .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                    .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                    .compareEnable = VK_TRUE,
+                    .compareOp = VK_COMPARE_OP_LESS_OR_EQUAL,
+                    .minLod = 0.0f,
+                    .maxLod = 0.0f,
+                };
+                shadowMap.sampler = m_samplerCache->sampler(samplerInfo);
+            }
+
+            vk_handles::ImageView createShadowMapView(VkImage image, VkImageViewType viewType, uint32_t baseLayer, uint32_t layerCount) const {
+                const auto viewInfo = VkImageViewCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+                    .image = image,
+                    .viewType = viewType,
+                    .format = vk_shadows::MAP_FORMAT,
+                    .subresourceRange = VkImageSubresourceRange {
+                        .aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
+                        .baseMipLevel = 0,
+                        .levelCount = 1,
+                        .baseArrayLayer = baseLayer,
+                        .layerCount = layerCount,
+                    },
+                };
+
+                auto imageView = VkImageView {};
+                const auto result = vkCreateImageView(m_device, &viewInfo, m_allocator, &imageView);
+                if (result != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create shadow map view!");
+                }
+
+                return vk_handles::ImageView { m_device, imageView, m_allocator };
+            }
+
+            // The page requests are read by the CPU a word at a time, which is slow from write
+            // combined memory, and are copied there from where the GPU marks them.
+            void createShadowPageBuffers() {
+                const auto virtualShadows = m_shadowMode == ShadowMode::Virtual;
+                const auto pageTableSize = virtualShadows ? VkDeviceSize { vk_virtual_shadows::PAGE_COUNT } * sizeof(uint32_t) : VkDeviceSize { sizeof(uint32_t) };
+                m_shadowPageTable = this->createBuffer(pageTableSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+                m_shadowPageTableSampled = false;
+                m_shadowPageRequests = BufferAllocation();
+                m_shadowPageRequestsMarked = false;
+                m_shadowPageReadbacks.clear();
+                m_shadowPageReadbacksPending.assign(m_framesInFlight, false);
+                if (!virtualShadows) {
+                    return;
+                }
+
+                m_shadowPageRequests = this->createBuffer(
+                    pageTableSize,
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT
+                );
+                for (uint32_t i = 0; i < m_framesInFlight; i++) {
+                    m_shadowPageReadbacks.push_back(this->createBuffer(
+                        pageTableSize,
+                        VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                        vk_memory::AllocationCreateInfo {
+                            .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                            .preferredFlags = VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+                        }
+                    ));
+                }
+            }
+
+            // The skin pass's set never changes: the palette is reached through its dynamic
+            // offset into the upload arena, and the buffers are the scene's own.
+            void createSkinDescriptors() {
+                const auto poolSizes = std::array {
+                    VkDescriptorPoolSize { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1 },
+                    VkDescriptorPoolSize { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3 },
+                };
+                const auto poolInfo = VkDescriptorPoolCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+                    .maxSets = 1,
+                    .poolSizeCount = static_cast<uint32_t>(poolSizes.size()),
+                    .pPoolSizes = poolSizes.data(),
+                };
+
+                auto descriptorPool = VkDescriptorPool {};
+                const auto poolResult = vkCreateDescriptorPool(m_device, &poolInfo, m_allocator, &descriptorPool);
+                if (poolResult != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create skin descriptor pool!");
+                }
+
+                m_skinDescriptorPool = vk_handles::DescriptorPool { m_device, descriptorPool, m_allocator };
+                const auto allocateInfo = VkDescriptorSetAllocateInfo {
+                    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+                    .descriptorPool = descriptorPool,
+                    .descriptorSetCount = 1,
+                    .pSetLayouts = &m_skinSetLayout,
+                };
+
+                const auto allocateResult = vkAllocateDescriptorSets(m_device, &allocateInfo, &m_skinSet);
+                if (allocateResult != VK_SUCCESS) {
+                    throw std::runtime_error("failed to allocate skin descriptor set!");
+                }
+
+                const auto bufferInfos = std::array {
+                    VkDescriptorBufferInfo { m_uniformBuffer, 0, vk_animation::MAX_JOINTS * sizeof(vk_transforms::WorldMatrix) },
+                    VkDescriptorBufferInfo { m_vertexBuffer.buffer, 0, VK_WHOLE_SIZE },
+                    VkDescriptorBufferInfo { m_skinWeightBuffer.buffer, 0, VK_WHOLE_SIZE },
+                    VkDescriptorBufferInfo { m_skinnedVertexBuffer.buffer, 0, VK_WHOLE_SIZE },
+                };
+                auto writes = std::array<VkWriteDescriptorSet, bufferInfos.size()> {};
+                for (uint32_t binding = 0; binding < writes.size(); binding++) {
+                    writes[binding] = VkWriteDescriptorSet {
+                        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                        .dstSet = m_skinSet,
+                        .dstBinding = binding,
+                        .descriptorCount = 1,
+                        .descriptorType = binding == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                        .pBufferInfo = &bufferInfos[binding],
+                    };
+                }
+
+                vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+            }
+
+            // Depth only, with its state baked in: every face is drawn, since the cascades'
+            // projections do not flip y the way the camera's does, and the depth is biased by its
+            // slope, which keeps lit surfaces at a grazing angle from shadowing themselves.
+            void createShadowPipeline() {
+                const auto stage = VkPipelineShaderStageCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                    .stage = VK_SHADER_STAGE_VERTEX_BIT,
+                    .module = m_shaderLibrary->shaderModule("shadow.vert"),
+                    .pName = "main",
+                };
+                const auto vertexBinding = VERTEX_BINDING;
+                const auto vertexAttribute = VERTEX_ATTRIBUTES[0];
+                const auto vertexInputState = VkPipelineVertexInputStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+                    .vertexBindingDescriptionCount = 1,
+                    .pVertexBindingDescriptions = &vertexBinding,
+                    .vertexAttributeDescriptionCount = 1,
+                    .pVertexAttributeDescriptions = &vertexAttribute,
+                };
+                const auto inputAssemblyState = VkPipelineInputAssemblyStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+                    .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+                };
+                const auto viewportState = VkPipelineViewportStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+                    .viewportCount = 1,
+                    .scissorCount = 1,
+                };
+                const auto rasterizationState = VkPipelineRasterizationStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+                    .polygonMode = VK_POLYGON_MODE_FILL,
+                    .cullMode = VK_CULL_MODE_NONE,
+                    .depthBiasEnable = VK_TRUE,
+                    .depthBiasConstantFactor = 1.25f,
+                    .depthBiasSlopeFactor = 1.75f,
+                    .lineWidth = 1.0f,
+                };
+                const auto multisampleState = VkPipelineMultisampleStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+                    .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+                };
+                const auto depthStencilState = VkPipelineDepthStencilStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+                    .depthTestEnable = VK_TRUE,
+                    .depthWriteEnable = VK_TRUE,
+                    .depthCompareOp = VK_COMPARE_OP_LESS,
+                };
+                const auto colorBlendState = VkPipelineColorBlendStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+                };
+                const auto dynamicStates = std::array { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+                const auto dynamicState = VkPipelineDynamicStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+                    .dynamicStateCount = static_cast<uint32_t>(dynamicStates.size()),
+                    .pDynamicStates = dynamicStates.data(),
+                };
+                const auto renderingInfo = VkPipelineRenderingCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
+                    .depthAttachmentFormat = vk_shadows::MAP_FORMAT,
+                };
+                const auto pipelineInfo = VkGraphicsPipelineCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+                    .pNext = &renderingInfo,
+                    .stageCount = 1,
+                    .pStages = &stage,
+                    .pVertexInputState = &vertexInputState,
+                    .pInputAssemblyState = &inputAssemblyState,
+                    .pViewportState = &viewportState,
+                    .pRasterizationState = &rasterizationState,
+                    .pMultisampleState = &multisampleState,
+                    .pDepthStencilState = &depthStencilState,
+                    .pColorBlendState = &colorBlendState,
+                    .pDynamicState = &dynamicState,
+                    .layout = m_shadowPipelineLayout,
+                };
+
+                m_shadowPipeline = m_pipelineRegistry->graphicsPipeline(pipelineInfo);
+            }
+
+            // One graphics pipeline per swapchain format, requested from the pipeline compiler the
+            // first time a window with that format draws, with an execution set of its own for
+            // device generated commands. Until the optimized pipeline lands, the window draws
+            // with one built without optimizations, see `updateDrawPipelines`.
+            VkPipeline drawPipeline(VkFormat colorFormat) {
+                for (const auto& [format, pipeline] : m_drawPipelines) {
+                    if (format == colorFormat) {
+                        return pipeline;
+                    }
+                }
+
+                const auto handle = vk_pipelines::requestGraphicsPipeline(*m_pipelineCompiler, *m_pipelineRegistry, m_device, [this, colorFormat](VkPipelineCreateFlags flags, auto&& create) {
+                    return this->withDrawPipelineInfo(colorFormat, flags, create);
+                });
+                const auto pipeline = m_pipelineCompiler->pipeline(handle);
+                m_drawPipelines.emplace_back(colorFormat, pipeline);
+                if (!m_pipelineCompiler->isReady(handle)) {
+                    m_compilingDrawPipelines.emplace_back(colorFormat, handle);
+                }
+                if (m_generatedCommands) {
+                    m_executionSets.emplace_back(colorFormat, this->createExecutionSet(pipeline));
+                }
+
+                return pipeline;
+            }
+
+            // Swaps in the optimized draw pipelines that have compiled since the last frame. An
+            // execution set is created for the one pipeline it starts out with, so the set of a
+            // swapped pipeline is replaced, and the old one retired with the frame. A pipeline
+            // whose compile failed keeps drawing unoptimized.
+            void updateDrawPipelines(vk_handles::DeferredDestructionQueue& retiredResources, uint64_t retireValue) {
+                std::erase_if(m_compilingDrawPipelines, [this, &retiredResources, retireValue](const auto& entry) {
+                    const auto& [colorFormat, handle] = entry;
+                    if (m_pipelineCompiler->hasFailed(handle)) {
+                        return true;
+                    }
+                    if (!m_pipelineCompiler->isReady(handle)) {
+                        return false;
+                    }
+
+                    const auto pipeline = m_pipelineCompiler->pipeline(handle);
+                    for (auto& [format, drawPipeline] : m_drawPipelines) {
+                        if (format == colorFormat) {
+                            drawPipeline = pipeline;
+                        }
+                    }
+                    for (auto& [format, executionSet] : m_executionSets) {
+                        if (format == colorFormat) {
+                            retiredResources.retire(retireValue, vk_handles::IndirectExecutionSet { m_device, executionSet, m_allocator });
+                            executionSet = this->createExecutionSet(pipeline);
+                        }
+                    }
+
+                    return true;
+                });
+            }
+
+            // Calls `create` with the create info of the scene pipeline for `colorFormat`, which
+            // only lives for the call, with `extraFlags` added to its create flags.
+            // `VK_FORMAT_UNDEFINED` is the depth pre-pass, which has no color attachment and no
+            // fragment stage.
+            template <typename Create>
+            std::invoke_result_t<Create, const VkGraphicsPipelineCreateInfo&> withDrawPipelineInfo(VkFormat colorFormat, VkPipelineCreateFlags extraFlags, Create&& create) const {
+                const auto stage = [this](VkShaderStageFlagBits stage, const char* shaderName) {
+                    return VkPipelineShaderStageCreateInfo {
+                        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                        .stage = stage,
+                        .module = m_shaderLibrary->shaderModule(shaderName),
+                        .pName = "main",
+                    };
+                };
+                auto stages = m_meshShading
+                    ? std::vector {
+                        stage(VK_SHADER_STAGE_TASK_BIT_EXT, "scene.task"),
+                        stage(VK_SHADER_STAGE_MESH_BIT_EXT, "scene.mesh"),
+                    }
+                    : std::vector {
+                        stage(VK_SHADER_STAGE_VERTEX_BIT, "scene.vert"),
+                    };
+                auto vertexConstants = vk_pipelines::SpecializationConstants {};
+                if (!m_meshShading) {
+                    vertexConstants.set(SCENE_GENERATED_COMMANDS_ID, m_generatedCommands);
+                    stages.front().pSpecializationInfo = vertexConstants.info();
+                }
+                const auto depthOnly = colorFormat == VK_FORMAT_UNDEFINED;
+                if (!depthOnly) {
+                    stages.push_back(stage(VK_SHADER_STAGE_FRAGMENT_BIT, this->sceneFragmentShader()));
+                }
+                const auto vertexBinding = VERTEX_BINDING;
+                const auto vertexAttributes = VERTEX_ATTRIBUTES;
+                const auto vertexInputState = VkPipelineVertexInputStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+                    .vertexBindingDescriptionCount = 1,
+                    .pVertexBindingDescriptions = &vertexBinding,
+                    .vertexAttributeDescriptionCount = static_cast<uint32_t>(vertexAttributes.size()),
+                    .pVertexAttributeDescriptions = vertexAttributes.data(),
+                };
+                const auto inputAssemblyState = VkPipelineInputAssemblyStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+                    .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+                };
+                const auto viewportState = VkPipelineViewportStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+                    .viewportCount = 1,
+                    .scissorCount = 1,
+                };
+                // Culling, depth and blend state are set per draw from `m_rasterState`. The
+                // projection flips y, which turns the mesh's counter clockwise front faces back
+                // to counter clockwise in framebuffer coordinates.
+                const auto rasterizationState = VkPipelineRasterizationStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+                    .polygonMode = VK_POLYGON_MODE_FILL,
+                    .lineWidth = 1.0f,
+                };
+                const auto multisampleState = VkPipelineMultisampleStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+                    .rasterizationSamples = m_samples,
+                };
+                const auto depthStencilState = VkPipelineDepthStencilStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+                };
+                // Without extended dynamic state 3 the blend state stays baked in.
+                const auto colorBlendAttachment = VkPipelineColorBlendAttachmentState {
+                    .blendEnable = static_cast<VkBool32>(m_rasterState.blend),
+                    .srcColorBlendFactor = m_rasterState.blendEquation.srcColorBlendFactor,
+                    .dstColorBlendFactor = m_rasterState.blendEquation.dstColorBlendFactor,
+                    .colorBlendOp = m_rasterState.blendEquation.colorBlendOp,
+                    .srcAlphaBlendFactor = m_rasterState.blendEquation.srcAlphaBlendFactor,
+                    .dstAlphaBlendFactor = m_rasterState.blendEquation.dstAlphaBlendFactor,
+                    .alphaBlendOp = m_rasterState.blendEquation.alphaBlendOp,
+                    .colorWriteMask = m_rasterState.colorWriteMask,
+                };
+                const auto colorBlendState = VkPipelineColorBlendStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+                    .attachmentCount = depthOnly ? 0u : 1u,
+                    .pAttachments = &colorBlendAttachment,
+                };
+                auto dynamicStates = vk_pipelines::dynamicRasterStates(m_dynamicStates);
+                if (m_shadingRate.has_value()) {
+                    dynamicStates.push_back(VK_DYNAMIC_STATE_FRAGMENT_SHADING_RATE_KHR);
+                }
+                const auto dynamicState = VkPipelineDynamicStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+                    .dynamicStateCount = static_cast<uint32_t>(dynamicStates.size()),
+                    .pDynamicStates = dynamicStates.data(),
+                };
+                // The depth pre-pass is drawn without the attachment, whose rates only matter
+                // to fragment shading.
+                const auto shadingRateAttachment = !depthOnly && m_shadingRate.has_value() && m_shadingRate->attachment;
+                const auto renderingInfo = VkPipelineRenderingCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
+                    .colorAttachmentCount = depthOnly ? 0u : 1u,
+                    .pColorAttachmentFormats = &colorFormat,
+                    .depthAttachmentFormat = m_depthFormat,
+                };
+                const auto flags = extraFlags | (shadingRateAttachment
+                    ? VkPipelineCreateFlags { VK_PIPELINE_CREATE_RENDERING_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR }
+                    : VkPipelineCreateFlags { 0 });
+                // Only pipelines created indirect bindable go into an execution set, a flag of
+                // maintenance 5, whose flags replace the create info's.
+                const auto createFlags = VkPipelineCreateFlags2CreateInfoKHR {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_CREATE_FLAGS_2_CREATE_INFO_KHR,
+                    .pNext = &renderingInfo,
+                    .flags = VkPipelineCreateFlags2KHR { flags } | VK_PIPELINE_CREATE_2_INDIRECT_BINDABLE_BIT_EXT,
+                };
+                const auto pipelineInfo = VkGraphicsPipelineCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+                    .pNext = m_generatedCommands ? static_cast<const void*>(&createFlags) : &renderingInfo,
+                    .flags = flags,
+                    .stageCount = static_cast<uint32_t>(stages.size()),
+                    .pStages = stages.data(),
+                    // Mesh shading pipelines have no vertex input.
+                    .pVertexInputState = m_meshShading ? nullptr : &vertexInputState,
+                    .pInputAssemblyState = m_meshShading ? nullptr : &inputAssemblyState,
+                    .pViewportState = &viewportState,
+                    .pRasterizationState = &rasterizationState,
+                    .pMultisampleState = &multisampleState,
+                    .pDepthStencilState = &depthStencilState,
+                    .pColorBlendState = &colorBlendState,
+                    .pDynamicState = &dynamicState,
+                    .layout = m_scenePipelineLayout,
+                };
+
+                return create(pipelineInfo);
+            }
+
+            // Tracing rays needs a newer shading language than the rest of the scene's shaders,
+            // so ray queried shadows shade with a variant of their own.
+            const char* sceneFragmentShader() const {
+                return m_shadowMode == ShadowMode::RayQuery ? "scene_ray_query.frag" : "scene.frag";
+            }
+
+            std::vector<const char*> sceneShaderNames() const {
+                return m_meshShading
+                    ? std::vector { "scene.task", "scene.mesh", this->sceneFragmentShader() }
+                    : std::vector { "scene.vert", this->sceneFragmentShader() };
+            }
+
+            // Drops what was built from the scene's shaders once one of them was rebuilt, so the
+            // next draw builds it again from the new modules. The registry keeps the pipelines
+            // alive, and the execution sets and shader objects are retired with the frame.
+            void retireSceneShaders(vk_handles::DeferredDestructionQueue& retiredResources, uint64_t retireValue) {
+                m_sceneShadersReloaded = false;
+                m_shaderGeneration++;
+                for (const auto& [format, executionSet] : m_executionSets) {
+                    retiredResources.retire(retireValue, vk_handles::IndirectExecutionSet { m_device, executionSet, m_allocator });
+                }
+                m_executionSets.clear();
+                m_drawPipelines.clear();
+                m_compilingDrawPipelines.clear();
+                if (m_shaderObjects) {
+                    retiredResources.retire(retireValue, std::move(m_sceneShaders));
+                    m_sceneShaders = this->createSceneShaders();
+                }
+            }
+
+            // One unlinked shader object per stage of the scene, created against the same set
+            // layout and push constants as `m_scenePipelineLayout`. They never draw with device
+            // generated commands, so `scene.vert` keeps its default constants.
+            std::vector<vk_handles::Shader> createSceneShaders() const {
+                struct SceneStage {
+                    VkShaderStageFlagBits stage;
+                    VkShaderStageFlags nextStage;
+                    const char* shaderName;
+                };
+                const auto stages = m_meshShading
+                    ? std::vector {
+                        SceneStage { VK_SHADER_STAGE_TASK_BIT_EXT, VK_SHADER_STAGE_MESH_BIT_EXT, "scene.task" },
+                        SceneStage { VK_SHADER_STAGE_MESH_BIT_EXT, VK_SHADER_STAGE_FRAGMENT_BIT, "scene.mesh" },
+                        SceneStage { VK_SHADER_STAGE_FRAGMENT_BIT, 0, this->sceneFragmentShader() },
+                    }
+                    : std::vector {
+                        SceneStage { VK_SHADER_STAGE_VERTEX_BIT, VK_SHADER_STAGE_FRAGMENT_BIT, "scene.vert" },
+                        SceneStage { VK_SHADER_STAGE_FRAGMENT_BIT, 0, this->sceneFragmentShader() },
+                    };
+
+                const auto pushConstantRange = this->scenePushConstantRange();
+                const auto shadingRateAttachment = m_shadingRate.has_value() && m_shadingRate->attachment;
+                auto createInfos = std::vector<VkShaderCreateInfoEXT> {};
+                for (const auto& stage : stages) {
+                    const auto& code = m_shaderLibrary->code(stage.shaderName);
+                    createInfos.push_back(VkShaderCreateInfoEXT {
+                        .sType = VK_STRUCTURE_TYPE_SHADER_CREATE_INFO_EXT,
+                        .flags = stage.stage == VK_SHADER_STAGE_FRAGMENT_BIT && shadingRateAttachment
+                            ? VkShaderCreateFlagsEXT { VK_SHADER_CREATE_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_EXT }
+                            : VkShaderCreateFlagsEXT { 0 },
+                        .stage = stage.stage,
+                        .nextStage = stage.nextStage,
+                        .codeType = VK_SHADER_CODE_TYPE_SPIRV_EXT,
+                        .codeSize = code.size() * sizeof(uint32_t),
+                        .pCode = code.data(),
+                        .pName = "main",
+                        .setLayoutCount = 1,
+                        .pSetLayouts = &m_sceneSetLayout,
+                        .pushConstantRangeCount = 1,
+                        .pPushConstantRanges = &pushConstantRange,
+                    });
+                }
+
+                auto shaders = std::vector<VkShaderEXT>(createInfos.size());
+                const auto result = vkCreateShadersEXT(m_device, static_cast<uint32_t>(createInfos.size()), createInfos.data(), m_allocator, shaders.data());
+                if (result != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create scene shader objects!");
+                }
+
+                auto sceneShaders = std::vector<vk_handles::Shader> {};
+                for (const auto shader : shaders) {
+                    sceneShaders.emplace_back(m_device, shader, m_allocator);
+                }
+
+                return sceneShaders;
+            }
+
+            // Shader objects leave every stage to be bound and every piece of state to be set
+            // before the draw, without a pipeline to fall back on. Stages the scene does not use
+            // are bound to null, which is valid whether or not their features are enabled. The
+            // depth pre-pass binds no fragment shader either.
+            void bindSceneShaders(VkCommandBuffer commandBuffer, const VkViewport& viewport, const VkRect2D& scissor, bool depthOnly) const {
+                const auto allStages = std::array {
+                    VK_SHADER_STAGE_VERTEX_BIT,
+                    VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT,
+                    VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT,
+                    VK_SHADER_STAGE_GEOMETRY_BIT,
+                    VK_SHADER_STAGE_FRAGMENT_BIT,
+                    VK_SHADER_STAGE_TASK_BIT_EXT,
+                    VK_SHADER_STAGE_MESH_BIT_EXT,
+                };
+                auto shaders = std::array<VkShaderEXT, allStages.size()> {};
+                const auto sceneStages = m_meshShading
+                    ? std::vector { VK_SHADER_STAGE_TASK_BIT_EXT, VK_SHADER_STAGE_MESH_BIT_EXT, VK_SHADER_STAGE_FRAGMENT_BIT }
+                    : std::vector { VK_SHADER_STAGE_VERTEX_BIT, VK_SHADER_STAGE_FRAGMENT_BIT };
+                for (size_t i = 0; i < allStages.size(); i++) {
+                    const auto sceneStage = std::find(sceneStages.begin(), sceneStages.end(), allStages[i]);
+                    if (sceneStage != sceneStages.end() && !(depthOnly && allStages[i] == VK_SHADER_STAGE_FRAGMENT_BIT)) {
+                        shaders[i] = m_sceneShaders[static_cast<size_t>(sceneStage - sceneStages.begin())].get();
+                    }
+                }
+                vkCmdBindShadersEXT(commandBuffer, static_cast<uint32_t>(allStages.size()), allStages.data(), shaders.data());
+
+                vk_pipelines::setShaderObjectState(commandBuffer, viewport, scissor, m_samples);
+                if (!m_meshShading) {
+                    const auto binding = VkVertexInputBindingDescription2EXT {
+                        .sType = VK_STRUCTURE_TYPE_VERTEX_INPUT_BINDING_DESCRIPTION_2_EXT,
+                        .binding = VERTEX_BINDING.binding,
+                        .stride = VERTEX_BINDING.stride,
+                        .inputRate = VERTEX_BINDING.inputRate,
+                        .divisor = 1,
+                    };
+                    auto attributes = std::array<VkVertexInputAttributeDescription2EXT, VERTEX_ATTRIBUTES.size()> {};
+                    for (size_t i = 0; i < VERTEX_ATTRIBUTES.size(); i++) {
+                        attributes[i] = VkVertexInputAttributeDescription2EXT {
+                            .sType = VK_STRUCTURE_TYPE_VERTEX_INPUT_ATTRIBUTE_DESCRIPTION_2_EXT,
+                            .location = VERTEX_ATTRIBUTES[i].location,
+                            .binding = VERTEX_ATTRIBUTES[i].binding,
+                            .format = VERTEX_ATTRIBUTES[i].format,
+                            .offset = VERTEX_ATTRIBUTES[i].offset,
+                        };
+                    }
+                    vkCmdSetVertexInputEXT(commandBuffer, 1, &binding, static_cast<uint32_t>(attributes.size()), attributes.data());
+                }
+            }
+
+            BufferAllocation createBuffer(
+                VkDeviceSize size,
+                VkBufferUsageFlags usage,
+                const vk_memory::AllocationCreateInfo& memoryInfo = vk_memory::AllocationCreateInfo {
+                    .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                    .priority = vk_memory::MemoryPriority::High,
+                },
+                const void* next = nullptr
+            ) const {
+                const auto bufferInfo = VkBufferCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                    .pNext = next,
+                    .size = size,
+                    .usage = usage,
+                    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                };
+
+                auto buffer = VkBuffer {};
+                const auto result = vkCreateBuffer(m_device, &bufferInfo, m_allocator, &buffer);
+                if (result != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create scene buffer!");
+                }
+
+                auto allocation = BufferAllocation();
+                allocation.buffer = vk_handles::Buffer { m_device, buffer, m_allocator };
+                allocation.memory = vk_memory::ScopedAllocation {
+                    *m_memoryAllocator,
+                    m_memoryAllocator->allocateForBuffer(buffer, memoryInfo),
+                };
+                if (usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) {
+                    allocation.address = vk_memory::bufferDeviceAddress(m_device, buffer);
+                }
+
+                return allocation;
+            }
+
+            struct LodMesh {
+                std::vector<glm::vec3> positions;
+                std::vector<glm::vec3> normals;
+                std::vector<uint32_t> indices;
+            };
+
+            // A unit cube with a normal per face, wound counter clockwise seen from outside, every
+            // face a grid of `subdivisions` quads a side.
+            static LodMesh generateCube(uint32_t subdivisions) {
+                struct Face {
+                    glm::vec3 normal;
+                    glm::vec3 u;
+                    glm::vec3 v;
+                };
+
+                const auto faces = std::array {
+                    Face { { 1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f } },
+                    Face { { -1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 0.0f, 1.0f, 0.0f } },
+                    Face { { 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 1.0f, 0.0f, 0.0f } },
+                    Face { { 0.0f, -1.0f, 0.0f }, { 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f } },
+                    Face { { 0.0f, 0.0f, 1.0f }, { 1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f } },
+                    Face { { 0.0f, 0.0f, -1.0f }, { 0.0f, 1.0f, 0.0f }, { 1.0f, 0.0f, 0.0f } },
+                };
+                const auto faceVertices = subdivisions + 1;
+
+                auto mesh = LodMesh {};
+                for (const auto& face : faces) {
+                    const auto firstVertex = static_cast<uint32_t>(mesh.positions.size());
+                    for (uint32_t j = 0; j < faceVertices; j++) {
+                        for (uint32_t i = 0; i < faceVertices; i++) {
+                            const auto corner = glm::vec2 { static_cast<float>(i), static_cast<float>(j) } / static_cast<float>(subdivisions) - 0.5f;
+                            mesh.positions.push_back(face.normal * 0.5f + face.u * corner.x + face.v * corner.y);
+                            mesh.normals.push_back(face.normal);
+                        }
+                    }
+
+                    for (uint32_t j = 0; j < subdivisions; j++) {
+                        for (uint32_t i = 0; i < subdivisions; i++) {
+                            const auto corner = firstVertex + j * faceVertices + i;
+                            for (const auto offset : { 0u, 1u, faceVertices + 1, faceVertices + 1, faceVertices, 0u }) {
+                                mesh.indices.push_back(corner + offset);
+                            }
+                        }
+                    }
+                }
+
+                return mesh;
+            }
+
+            // The impostor's square, the corners of [-0.5, 0.5] in xy, which `scene.vert` turns
+            // to face the camera and scales to the impostor's size.
+            static LodMesh generateImpostor() {
+                return LodMesh {
+                    .positions = {
+                        { -0.5f, -0.5f, 0.0f },
+                        { 0.5f, -0.5f, 0.0f },
+                        { 0.5f, 0.5f, 0.0f },
+                        { -0.5f, 0.5f, 0.0f },
+                    },
+                    .normals = std::vector<glm::vec3>(4, glm::vec3 { 0.0f, 0.0f, 1.0f }),
+                    .indices = { 0, 1, 2, 2, 3, 0 },
+                };
+            }
+
+            // The cube's levels of detail, see `LOD_FACE_SUBDIVISIONS`, each in vertex cache order,
+            // the first also split into meshlets, as the mesh shading path draws no other, and a
+            // field of cubes scattered through a box whose size grows with the instance count, so
+            // the density stays the same. Asked to animate, the mesh is quantized within the box
+            // its twist reaches, and skinned to its skeleton, before the path is known.
+            void generateScene() {
+                auto lodMeshes = std::vector<LodMesh> {};
+                for (const auto subdivisions : LOD_FACE_SUBDIVISIONS) {
+                    lodMeshes.push_back(generateCube(subdivisions));
+                }
+                lodMeshes.push_back(generateImpostor());
+
+                // Every level lies within the first's bounds.
+                m_meshBounds = vk_vertex_format::computeBounds(lodMeshes.front().positions);
+                if (this->usesAnimation()) {
+                    m_meshBounds.min = glm::vec3 { -ANIMATED_MESH_HALF_EXTENT, m_meshBounds.min.y, -ANIMATED_MESH_HALF_EXTENT };
+                    m_meshBounds.extent = glm::vec3 { 2.0f * ANIMATED_MESH_HALF_EXTENT, m_meshBounds.extent.y, 2.0f * ANIMATED_MESH_HALF_EXTENT };
+                }
+                m_vertices.clear();
+                m_skinWeights.clear();
+                m_indices.clear();
+                auto meshletPositions = std::vector<glm::vec3> {};
+                for (uint32_t lod = 0; lod < LOD_COUNT; lod++) {
+                    const auto& mesh = lodMeshes[lod];
+
+                    // Triangles in vertex cache order first, then vertices in the order those
+                    // triangles fetch them, after the levels before.
+                    auto indices = vk_meshlets::optimizeVertexCache(mesh.indices, mesh.positions.size());
+                    const auto vertexOrder = vk_meshlets::optimizeVertexFetch(indices, mesh.positions.size());
+                    const auto firstVertex = static_cast<uint32_t>(m_vertices.size());
+                    for (const auto vertex : vertexOrder) {
+                        auto position = vk_vertex_format::quantizePosition(mesh.positions[vertex], m_meshBounds);
+                        // The impostor's vertices are told apart by the w the position leaves free.
+                        position[3] = lod == IMPOSTOR_LOD ? uint16_t { 65535 } : uint16_t { 0 };
+                        m_vertices.push_back(Vertex {
+                            .position = position,
+                            .normal = vk_vertex_format::encodeOctahedral(mesh.normals[vertex]),
+                        });
+                        if (this->usesAnimation()) {
+                            m_skinWeights.push_back(skinWeights(mesh.positions[vertex]));
+                        }
+                        if (lod == 0) {
+                            meshletPositions.push_back(mesh.positions[vertex]);
+                        }
+                    }
+
+                    m_lods[lod] = MeshLod {
+                        .firstIndex = static_cast<uint32_t>(m_indices.size()),
+                        .indexCount = static_cast<uint32_t>(indices.size()),
+                        .error = lod == 0 ? 0.0f
+                            : lod == IMPOSTOR_LOD ? 2.0f * std::sqrt(3.0f) * MESH_HALF_EXTENT
+                            : 1.0f / static_cast<float>(LOD_FACE_SUBDIVISIONS[lod]),
+                    };
+                    for (const auto index : indices) {
+                        m_indices.push_back(firstVertex + index);
+                    }
+                }
+
+                m_meshlets = vk_meshlets::buildMeshlets(meshletPositions, std::span { m_indices }.first(m_lods[0].indexCount));
+                m_meshPositions = std::move(meshletPositions);
+                if (this->usesAnimation()) {
+                    this->createAnimation();
+                }
+
+                constexpr float SPACING = 2.5f;
+                m_fieldSize = SPACING * std::cbrt(static_cast<float>(std::max(m_instanceCount, 1u)));
+                auto random = std::mt19937 { 1 };
+                auto position = std::uniform_real_distribution<float> { -0.5f * m_fieldSize, 0.5f * m_fieldSize };
+                auto scale = std::uniform_real_distribution<float> { 0.4f, 1.0f };
+                // Normalized four dimensional normal samples are uniformly distributed rotations.
+                auto rotation = std::normal_distribution<float> { 0.0f, 1.0f };
+                m_scene.clear();
+                m_bounds.resize(this->usesCpuCulling() ? m_instanceCount : 0);
+                for (uint32_t i = 0; i < m_instanceCount; i++) {
+                    const auto center = glm::vec3 { position(random), position(random), position(random) };
+                    const auto orientation = glm::normalize(glm::quat { rotation(random), rotation(random), rotation(random), rotation(random) });
+                    m_scene.create(
+                        vk_transforms::LocalTransform { .position = center, .rotation = orientation, .scale = scale(random) },
+                        SceneInstance { .index = i }
+                    );
+                }
+
+                m_lights = vk_lights::generateLights(m_lightCount, m_fieldSize, SPACING);
+            }
+
+            // A vertex follows the two joints around its height, blended linearly between them.
+            static SkinWeights skinWeights(glm::vec3 position) {
+                const auto segments = static_cast<float>(SKELETON_JOINT_COUNT - 1);
+                const auto height = std::clamp((position.y + MESH_HALF_EXTENT) / (2.0f * MESH_HALF_EXTENT) * segments, 0.0f, segments);
+                const auto joint = std::min(static_cast<uint32_t>(height), SKELETON_JOINT_COUNT - 2);
+                const auto weight = static_cast<uint8_t>(std::round((height - static_cast<float>(joint)) * 255.0f));
+
+                return SkinWeights {
+                    .joints = { static_cast<uint8_t>(joint), static_cast<uint8_t>(joint + 1), 0, 0 },
+                    .weights = { static_cast<uint8_t>(255 - weight), weight, 0, 0 },
+                };
+            }
+
+            // The cube's skeleton, see `SKELETON_JOINT_COUNT`, and its clip, a twist that runs up
+            // the chain. The first joint stays where it is, and every joint after it turns back
+            // and forth a little behind the one below.
+            void createAnimation() {
+                auto skeleton = vk_animation::Skeleton {};
+                const auto spacing = 2.0f * MESH_HALF_EXTENT / static_cast<float>(SKELETON_JOINT_COUNT - 1);
+                for (uint32_t joint = 0; joint < SKELETON_JOINT_COUNT; joint++) {
+                    skeleton.parents.push_back(joint == 0 ? vk_transforms::TransformHierarchy::NO_PARENT : joint - 1);
+                    skeleton.bindPose.push_back(vk_transforms::LocalTransform {
+                        .position = joint == 0 ? glm::vec3 { 0.0f, -MESH_HALF_EXTENT, 0.0f } : glm::vec3 { 0.0f, spacing, 0.0f },
+                    });
+                }
+
+                auto keys = std::vector<vk_transforms::LocalTransform> {};
+                keys.reserve(ANIMATION_KEY_COUNT * SKELETON_JOINT_COUNT);
+                for (uint32_t key = 0; key < ANIMATION_KEY_COUNT; key++) {
+                    const auto phase = 2.0f * glm::pi<float>() * static_cast<float>(key) / static_cast<float>(ANIMATION_KEY_COUNT);
+                    for (uint32_t joint = 0; joint < SKELETON_JOINT_COUNT; joint++) {
+                        auto pose = skeleton.bindPose[joint];
+                        if (joint > 0) {
+                            pose.rotation = glm::angleAxis(ANIMATION_TWIST * std::sin(phase - 0.8f * static_cast<float>(joint)), glm::vec3 { 0.0f, 1.0f, 0.0f });
+                        }
+                        keys.push_back(pose);
+                    }
+                }
+
+                m_animator.init(skeleton, vk_animation::compressClip(keys, SKELETON_JOINT_COUNT, ANIMATION_SAMPLE_RATE));
+            }
+
+            // The mesh shader reads the vertex buffer through its address, and the meshlets in
+            // place of the index buffer.
+            //
+            // The instance buffer is persistently mapped, in the resizable BAR heap when there is
+            // one, so world matrices are copied from the frame packets straight into it.
+            void createSceneBuffers() {
+                const auto addressUsage = m_meshShading ? VkBufferUsageFlags { VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT } : VkBufferUsageFlags { 0 };
+                m_instanceBuffer = this->createBuffer(
+                    VkDeviceSize { std::max(m_instanceCount, 1u) } * sizeof(vk_transforms::WorldMatrix),
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | addressUsage,
+                    vk_memory::AllocationCreateInfo {
+                        .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                        .preferredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                        .priority = vk_memory::MemoryPriority::High,
+                    }
+                );
+
+                m_meshUploads.clear();
+                m_uploadedMeshBufferCount = 0;
+                m_extractedInstanceCount = 0;
+                m_streamedInstanceCount = 0;
+                m_uploadedInstanceCount = 0;
+                m_tookFirstPacket = false;
+                m_lightBuffer = this->createBuffer(
+                    VkDeviceSize { std::max(m_lightCount, 1u) } * sizeof(vk_lights::Light),
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT
+                );
+                if (!m_lights.empty()) {
+                    m_meshUploads.push_back(MeshUpload { m_lightBuffer.buffer, m_lights.data(), m_lights.size() * sizeof(vk_lights::Light), VK_ACCESS_SHADER_READ_BIT });
+                }
+                if (this->usesAnimation()) {
+                    // The skin pass reads the rest pose in place of the draws, and rewrites the
+                    // skinned vertices every frame, so they need no upload.
+                    const auto verticesSize = m_vertices.size() * sizeof(Vertex);
+                    m_vertexBuffer = this->createBuffer(verticesSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+                    m_skinWeightBuffer = this->createBuffer(m_skinWeights.size() * sizeof(SkinWeights), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+                    m_skinnedVertexBuffer = this->createBuffer(verticesSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+                    m_indexBuffer = this->createBuffer(m_indices.size() * sizeof(uint32_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+                    m_meshUploads.push_back(MeshUpload { m_vertexBuffer.buffer, m_vertices.data(), verticesSize, VK_ACCESS_SHADER_READ_BIT });
+                    m_meshUploads.push_back(MeshUpload {
+                        m_skinWeightBuffer.buffer,
+                        m_skinWeights.data(),
+                        m_skinWeights.size() * sizeof(SkinWeights),
+                        VK_ACCESS_SHADER_READ_BIT,
+                    });
+                    m_meshUploads.push_back(MeshUpload { m_indexBuffer.buffer, m_indices.data(), m_indices.size() * sizeof(uint32_t), VK_ACCESS_INDEX_READ_BIT });
+
+                    return;
+                }
+                if (!m_meshShading) {
+                    m_vertexBuffer = this->createBuffer(m_vertices.size() * sizeof(Vertex), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+                    m_indexBuffer = this->createBuffer(m_indices.size() * sizeof(uint32_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+                    m_meshUploads.push_back(MeshUpload { m_vertexBuffer.buffer, m_vertices.data(), m_vertices.size() * sizeof(Vertex), VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT });
+                    m_meshUploads.push_back(MeshUpload { m_indexBuffer.buffer, m_indices.data(), m_indices.size() * sizeof(uint32_t), VK_ACCESS_INDEX_READ_BIT });
+
+                    return;
+                }
+
+                // The shadow pass draws with the vertex pipeline on every path.
+                const auto& meshlets = m_meshlets;
+                const auto storageUsage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | addressUsage;
+                const auto shadowUsage = this->usesShadows() ? VkBufferUsageFlags { VK_BUFFER_USAGE_VERTEX_BUFFER_BIT } : VkBufferUsageFlags { 0 };
+                m_vertexBuffer = this->createBuffer(m_vertices.size() * sizeof(Vertex), storageUsage | shadowUsage);
+                m_meshletBuffer = this->createBuffer(meshlets.meshlets.size() * sizeof(vk_meshlets::Meshlet), storageUsage);
+                m_meshletVertexBuffer = this->createBuffer(meshlets.vertices.size() * sizeof(uint32_t), storageUsage);
+                m_meshletTriangleBuffer = this->createBuffer(meshlets.triangles.size() * sizeof(uint32_t), storageUsage);
+                m_meshUploads.push_back(MeshUpload {
+                    m_vertexBuffer.buffer,
+                    m_vertices.data(),
+                    m_vertices.size() * sizeof(Vertex),
+                    VK_ACCESS_SHADER_READ_BIT | (this->usesShadows() ? VkAccessFlags { VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT } : VkAccessFlags { 0 }),
+                });
+                m_meshUploads.push_back(MeshUpload { m_meshletBuffer.buffer, meshlets.meshlets.data(), meshlets.meshlets.size() * sizeof(vk_meshlets::Meshlet), VK_ACCESS_SHADER_READ_BIT });
+                m_meshUploads.push_back(MeshUpload { m_meshletVertexBuffer.buffer, meshlets.vertices.data(), meshlets.vertices.size() * sizeof(uint32_t), VK_ACCESS_SHADER_READ_BIT });
+                m_meshUploads.push_back(MeshUpload { m_meshletTriangleBuffer.buffer, meshlets.triangles.data(), meshlets.triangles.size() * sizeof(uint32_t), VK_ACCESS_SHADER_READ_BIT });
+                if (this->usesShadows()) {
+                    m_indexBuffer = this->createBuffer(m_indices.size() * sizeof(uint32_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+                    m_meshUploads.push_back(MeshUpload { m_indexBuffer.buffer, m_indices.data(), m_indices.size() * sizeof(uint32_t), VK_ACCESS_INDEX_READ_BIT });
+                }
+                m_sceneAddresses = SceneAddresses {
+                    .instances = m_instanceBuffer.address,
+                    .meshlets = m_meshletBuffer.address,
+                    .meshletVertices = m_meshletVertexBuffer.address,
+                    .meshletTriangles = m_meshletTriangleBuffer.address,
+                    .vertices = m_vertexBuffer.address,
+                };
+            }
+
+            // The camera between the last two ticks' cameras, looking at the field's center. The projection
+            // maps depth to [0, 1] and flips y for
+            // Vulkan's framebuffer coordinates, then moves the image by `jitter` pixels of
+            // `renderExtent`. The lights are left out until their buffer is uploaded, the last
+            // of the mesh uploads.
+            SceneUniforms sceneUniforms(
+                const WindowResources& window,
+                VkExtent2D viewExtent,
+                VkExtent2D renderExtent,
+                glm::vec2 jitter
+            ) const {
+                const auto eye = glm::mix(m_previousTick.cameraEye, m_latestTick.cameraEye, m_tickAlpha);
+                const auto view = glm::lookAtRH(eye, glm::vec3 { 0.0f }, glm::vec3 { 0.0f, 1.0f, 0.0f });
+                const auto aspect = static_cast<float>(viewExtent.width) / static_cast<float>(std::max(viewExtent.height, 1u));
+                const auto nearPlane = NEAR_PLANE;
+                const auto farPlane = this->farPlane();
+                auto projection = vk_math::perspectiveReversedZ(glm::radians(60.0f), aspect, nearPlane);
+                projection[1][1] *= -1.0f;
+                const auto jitterOffset = glm::vec3 {
+                    2.0f * jitter.x / static_cast<float>(std::max(renderExtent.width, 1u)),
+                    2.0f * jitter.y / static_cast<float>(std::max(renderExtent.height, 1u)),
+                    0.0f,
+                };
+                projection = glm::translate(glm::mat4 { 1.0f }, jitterOffset) * projection;
+                const auto viewProjection = projection * view;
+
+                auto uniforms = SceneUniforms {
+                    .view = view,
+                    .viewProjection = viewProjection,
+                    .frustumPlanes = {},
+                    .projection = glm::vec4 { projection[0][0], projection[1][1], projection[2][2], projection[3][2] },
+                    .cull = {
+                        m_uploadedInstanceCount,
+                        window.pyramid.built || m_depthPrepass ? 1u : 0u,
+                        window.pyramid.extent.width,
+                        window.pyramid.extent.height,
+                    },
+                    .mesh = { m_lods[0].indexCount, m_lods[0].firstIndex, 0, m_meshShading ? this->meshletCount() : 0 },
+                    .meshBoundsMin = glm::vec4 { m_meshBounds.min, 0.0f },
+                    .meshBoundsExtent = glm::vec4 { m_meshBounds.extent, 0.0f },
+                    .clusters = vk_lights::clusterScale(renderExtent, nearPlane, farPlane),
+                    .lights = { m_uploadedMeshBufferCount == m_meshUploads.size() ? m_lightCount : 0, 0, 0, 0 },
+                    .shadowMatrices = {},
+                    .shadowSplits = {},
+                    .shadowRadii = {},
+                    .directionalLight = {},
+                    .virtualShadows = {},
+                    .lods = {},
+                    .lodSelection = {},
+                };
+                for (uint32_t lod = 0; lod < LOD_COUNT; lod++) {
+                    uniforms.lods[lod] = { m_lods[lod].indexCount, m_lods[lod].firstIndex, std::bit_cast<uint32_t>(m_lods[lod].error), 0 };
+                }
+                // A level is drawn where its error times this, and the instance's scale, is within
+                // the view depth: a pixel of `renderExtent` covers 2 / (P11 * height) units of view
+                // per unit of view depth.
+                uniforms.lodSelection = glm::vec4 {
+                    this->usesLods() ? 0.5f * std::abs(projection[1][1]) * static_cast<float>(renderExtent.height) / m_lodErrorPixels : 0.0f,
+                    static_cast<float>(this->usesLods() ? LOD_COUNT : 1),
+                    0.0f,
+                    0.0f,
+                };
+
+                const auto planes = vk_cpu_culling::extractFrustumPlanes(viewProjection);
+                std::copy(planes.begin(), planes.end(), uniforms.frustumPlanes.begin());
+
+                return uniforms;
+            }
+
+            // The pyramid's first level is the largest power of two no larger than the render
+            // target, so every level halves the one before it exactly, and no larger than the
+            // downsampler builds in a single dispatch.
+            void prepareDepthPyramid(WindowResources& window, VkExtent2D targetSize, vk_handles::DeferredDestructionQueue& retiredResources, uint64_t retireValue) {
+                const auto extent = VkExtent2D {
+                    std::min(std::bit_floor(std::max(targetSize.width, 1u)), vk_downsample::MAX_EXTENT),
+                    std::min(std::bit_floor(std::max(targetSize.height, 1u)), vk_downsample::MAX_EXTENT),
+                };
+                if (window.pyramid.image && window.pyramid.extent.width == extent.width && window.pyramid.extent.height == extent.height) {
+                    return;
+                }
+
+                if (window.pyramid.image) {
+                    retiredResources.retire(retireValue, std::move(window.pyramid));
+                    window.pyramid = DepthPyramid();
+                }
+
+                this->createDepthPyramid(window, extent);
+            }
+
+            void createDepthPyramid(WindowResources& window, VkExtent2D extent) {
+                auto& pyramid = window.pyramid;
+                pyramid.extent = extent;
+                pyramid.generation = ++m_pyramidGeneration;
+                pyramid.levelCount = vk_downsample::levelCount(extent);
+
+                const auto imageInfo = VkImageCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+                    .imageType = VK_IMAGE_TYPE_2D,
+                    .format = PYRAMID_FORMAT,
+                    .extent = VkExtent3D { extent.width, extent.height, 1 },
+                    .mipLevels = pyramid.levelCount,
+                    .arrayLayers = 1,
+                    .samples = VK_SAMPLE_COUNT_1_BIT,
+                    .tiling = VK_IMAGE_TILING_OPTIMAL,
+                    .usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                    .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                };
+
+                auto image = VkImage {};
+                const auto imageResult = vkCreateImage(m_device, &imageInfo, m_allocator, &image);
+                if (imageResult != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create depth pyramid!");
+                }
+
+                pyramid.image = vk_handles::Image { m_device, image, m_allocator };
+                pyramid.memory = vk_memory::ScopedAllocation {
+                    *m_memoryAllocator,
+                    m_memoryAllocator->allocateForImage(image, vk_memory::AllocationCreateInfo {
+                        .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                        .kind = vk_memory::ResourceKind::Optimal,
+                        .priority = vk_memory::MemoryPriority::High,
+                    }),
+                };
+
+                pyramid.view = this->createPyramidView(image, 0, pyramid.levelCount);
+                for (uint32_t level = 0; level < pyramid.levelCount; level++) {
+                    pyramid.levelViews.push_back(this->createPyramidView(image, level, 1));
+                }
+
+                // Zeroed before the pyramid is first built.
+                pyramid.scratch = this->createBuffer(
+                    vk_downsample::scratchSize(extent),
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT
+                );
+
+                auto poolSizes = std::vector {
+                    VkDescriptorPoolSize { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1 },
+                    VkDescriptorPoolSize { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 8 },
+                    VkDescriptorPoolSize { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2 },
+                };
+                if (m_accelerationStructure != nullptr) {
+                    poolSizes.push_back(VkDescriptorPoolSize { VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, 1 });
+                }
+                const auto poolInfo = VkDescriptorPoolCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+                    .maxSets = 1,
+                    .poolSizeCount = static_cast<uint32_t>(poolSizes.size()),
+                    .pPoolSizes = poolSizes.data(),
+                };
+
+                auto descriptorPool = VkDescriptorPool {};
+                const auto poolResult = vkCreateDescriptorPool(m_device, &poolInfo, m_allocator, &descriptorPool);
+                if (poolResult != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create scene descriptor pool!");
+                }
+
+                pyramid.descriptorPool = vk_handles::DescriptorPool { m_device, descriptorPool, m_allocator };
+
+                const auto allocateInfo = VkDescriptorSetAllocateInfo {
+                    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+                    .descriptorPool = descriptorPool,
+                    .descriptorSetCount = 1,
+                    .pSetLayouts = &m_sceneSetLayout,
+                };
+
+                const auto allocateResult = vkAllocateDescriptorSets(m_device, &allocateInfo, &pyramid.sceneSet);
+                if (allocateResult != VK_SUCCESS) {
+                    throw std::runtime_error("failed to allocate scene descriptor sets!");
+                }
+
+                auto bufferInfos = std::vector<VkDescriptorBufferInfo> {};
+                auto imageInfos = std::vector<VkDescriptorImageInfo> {};
+                auto writes = std::vector<VkWriteDescriptorSet> {};
+                bufferInfos.reserve(9);
+                imageInfos.reserve(2);
+
+                const auto writeBuffer = [&](uint32_t binding, VkDescriptorType type, VkBuffer buffer, VkDeviceSize range) {
+                    bufferInfos.push_back(VkDescriptorBufferInfo { buffer, 0, range });
+                    writes.push_back(VkWriteDescriptorSet {
+                        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                        .dstSet = pyramid.sceneSet,
+                        .dstBinding = binding,
+                        .descriptorCount = 1,
+                        .descriptorType = type,
+                        .pBufferInfo = &bufferInfos.back(),
+                    });
+                };
+                const auto writeImage = [&](uint32_t binding, VkSampler sampler, VkImageView imageView, VkImageLayout layout) {
+                    imageInfos.push_back(VkDescriptorImageInfo { sampler, imageView, layout });
+                    writes.push_back(VkWriteDescriptorSet {
+                        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                        .dstSet = pyramid.sceneSet,
+                        .dstBinding = binding,
+                        .descriptorCount = 1,
+                        .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                        .pImageInfo = &imageInfos.back(),
+                    });
+                };
+
+                writeBuffer(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, m_uniformBuffer, sizeof(SceneUniforms));
+                writeBuffer(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_instanceBuffer.buffer, VK_WHOLE_SIZE);
+                writeBuffer(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, window.drawCommands.buffer, VK_WHOLE_SIZE);
+                writeBuffer(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, window.drawCount.buffer, VK_WHOLE_SIZE);
+                writeBuffer(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, window.drawCommands.buffer, VK_WHOLE_SIZE);
+                writeBuffer(6, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_lightBuffer.buffer, VK_WHOLE_SIZE);
+                writeBuffer(7, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, window.lightClusters.buffer, VK_WHOLE_SIZE);
+                writeBuffer(8, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, window.visibility.buffer, VK_WHOLE_SIZE);
+                writeBuffer(10, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_shadowPageTable.buffer, VK_WHOLE_SIZE);
+                writeImage(4, m_sampler, pyramid.view, VK_IMAGE_LAYOUT_GENERAL);
+                writeImage(9, m_shadowMap.sampler, m_shadowMap.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+                // The top level structure keeps its handle, however often it is built.
+                const auto topLevel = m_accelerationStructure != nullptr ? m_accelerationStructure->topLevel() : VK_NULL_HANDLE;
+                const auto accelerationStructureWrite = VkWriteDescriptorSetAccelerationStructureKHR {
+                    .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR,
+                    .accelerationStructureCount = 1,
+                    .pAccelerationStructures = &topLevel,
+                };
+                if (m_accelerationStructure != nullptr) {
+                    writes.push_back(VkWriteDescriptorSet {
+                        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                        .pNext = &accelerationStructureWrite,
+                        .dstSet = pyramid.sceneSet,
+                        .dstBinding = 11,
+                        .descriptorCount = 1,
+                        .descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR,
+                    });
+                }
+
+                vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+            }
+
+            vk_handles::ImageView createPyramidView(VkImage image, uint32_t baseLevel, uint32_t levelCount) const {
+                const auto viewInfo = VkImageViewCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+                    .image = image,
+                    .viewType = VK_IMAGE_VIEW_TYPE_2D,
+                    .format = PYRAMID_FORMAT,
+                    .subresourceRange = VkImageSubresourceRange {
+                        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                        .baseMipLevel = baseLevel,
+                        .levelCount = levelCount,
+                        .baseArrayLayer = 0,
+                        .layerCount = 1,
+                    },
+                };
+
+                auto imageView = VkImageView {};
+                const auto result = vkCreateImageView(m_device, &viewInfo, m_allocator, &imageView);
+                if (result != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create depth pyramid view!");
+                }
+
+                return vk_handles::ImageView { m_device, imageView, m_allocator };
+            }
+
+            // Writes the instances inside the frustum to the frame's mapped draw buffer, in the
+            // layout `cull.comp` writes them in. Every instance draws the same mesh with the same
+            // pipeline and bindings, and the vertex shader finds its instance by
+            // `gl_InstanceIndex`, so each run of consecutive survivors is merged into a single
+            // instanced draw. The survivors come sorted, so every stretch of the scene's
+            // instances that is wholly in view takes one draw.
+            void cullOnHost(WindowResources& window, uint32_t slot, const vk_cpu_culling::FrustumPlanes& planes) {
+                const auto& visible = m_culler.cull(*m_cullingJobSystem, m_bounds, m_uploadedInstanceCount, planes);
+                auto* drawCommands = static_cast<VkDrawIndexedIndirectCommand*>(window.hostDrawCommands[slot].memory.get().mappedData);
+                auto drawCount = uint32_t { 0 };
+                // The run is kept here and written once it ends, since the buffer may be write
+                // combined memory, which is slow to read back.
+                auto runFirst = uint32_t { 0 };
+                auto runCount = uint32_t { 0 };
+                const auto endRun = [&]() {
+                    if (runCount > 0) {
+                        drawCommands[drawCount++] = VkDrawIndexedIndirectCommand {
+                            .indexCount = m_lods[0].indexCount,
+                            .instanceCount = runCount,
+                            .firstIndex = m_lods[0].firstIndex,
+                            .vertexOffset = 0,
+                            .firstInstance = runFirst,
+                        };
+                    }
+                };
+                for (const auto& instances : visible) {
+                    for (const auto instance : instances) {
+                        if (runCount > 0 && runFirst + runCount == instance) {
+                            runCount++;
+                            continue;
+                        }
+
+                        endRun();
+                        runFirst = instance;
+                        runCount = 1;
+                    }
+                }
+                endRun();
+
+                window.hostDrawSlot = slot;
+                window.hostDrawCount = drawCount;
+            }
+
+            void addPyramidPass(vk_render_graph::RenderGraph& graph, const SceneResources& resources, uint32_t windowIndex, VkExtent2D renderExtent) {
+                graph.addPass(
+                    "depthPyramid",
+                    {
+                        vk_render_graph::read(resources.resolvedDepth, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+                        vk_render_graph::write(resources.depthPyramid, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL),
+                    },
+                    [this, &graph, depth = resources.resolvedDepth, windowIndex, renderExtent](VkCommandBuffer commandBuffer) {
+                        this->recordDepthPyramid(commandBuffer, m_windows[windowIndex], graph.imageView(depth), renderExtent);
+                    }
+                );
+            }
+
+            // Draws the instances the last cull pass kept with `rasterState`, and the scene
+            // uniforms at `uniformOffset`. Without a `colorFormat`, draws their depth alone.
+            void recordSceneDraw(
+                VkCommandBuffer commandBuffer,
+                const WindowResources& window,
+                VkFormat colorFormat,
+                VkExtent2D renderExtent,
+                uint32_t uniformOffset,
+                const vk_pipelines::DynamicRasterState& rasterState
+            ) const {
+                const auto viewport = VkViewport {
+                    .x = 0.0f,
+                    .y = 0.0f,
+                    .width = static_cast<float>(renderExtent.width),
+                    .height = static_cast<float>(renderExtent.height),
+                    .minDepth = 0.0f,
+                    .maxDepth = 1.0f,
+                };
+                const auto scissor = VkRect2D {
+                    .offset = VkOffset2D { 0, 0 },
+                    .extent = renderExtent,
+                };
+                if (m_shaderObjects) {
+                    this->bindSceneShaders(commandBuffer, viewport, scissor, colorFormat == VK_FORMAT_UNDEFINED);
+                } else {
+                    const auto pipeline = std::find_if(m_drawPipelines.begin(), m_drawPipelines.end(), [colorFormat](const auto& entry) {
+                        return entry.first == colorFormat;
+                    });
+                    if (pipeline == m_drawPipelines.end()) {
+                        throw std::runtime_error("failed to find scene pipeline!");
+                    }
+
+                    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->second);
+                    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+                    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+                }
+                vk_pipelines::setDynamicRasterState(commandBuffer, rasterState, m_dynamicStates);
+                if (m_shadingRate.has_value()) {
+                    vk_shading_rate::setDrawShadingRate(commandBuffer, *m_shadingRate);
+                }
+                vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_scenePipelineLayout, 0, 1, &window.pyramid.sceneSet, 1, &uniformOffset);
+
+                if (m_meshShading) {
+                    vkCmdPushConstants(
+                        commandBuffer,
+                        m_scenePipelineLayout,
+                        VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT,
+                        0,
+                        sizeof(SceneAddresses),
+                        &m_sceneAddresses
+                    );
+                    vkCmdDrawMeshTasksIndirectEXT(commandBuffer, window.drawCount.buffer, offsetof(DrawCount, taskGroupCount), 1, sizeof(VkDrawMeshTasksIndirectCommandEXT));
+                    return;
+                }
+
+                const auto vertexOffset = VkDeviceSize { 0 };
+                const auto vertexBuffer = this->drawnVertexBuffer();
+                vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, &vertexOffset);
+                vkCmdBindIndexBuffer(commandBuffer, m_indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+                if (this->usesCpuCulling()) {
+                    const auto drawCommands = window.hostDrawCommands[window.hostDrawSlot].buffer.get();
+                    for (uint32_t first = 0; first < window.hostDrawCount; first += m_maxDrawIndirectCount) {
+                        const auto drawCount = std::min(window.hostDrawCount - first, m_maxDrawIndirectCount);
+                        vkCmdDrawIndexedIndirect(commandBuffer, drawCommands, VkDeviceSize { first } * sizeof(VkDrawIndexedIndirectCommand), drawCount, sizeof(VkDrawIndexedIndirectCommand));
+                    }
+
+                    return;
+                }
+
+                // The bound pipeline is the first of the execution set, which the cull shader
+                // picks from, and the count is the cull shader's draw count.
+                if (m_generatedCommands) {
+                    const auto depthOnly = colorFormat == VK_FORMAT_UNDEFINED;
+                    const auto maxSequenceCount = std::max(m_instanceCount, 1u);
+                    const auto generatedCommandsInfo = VkGeneratedCommandsInfoEXT {
+                        .sType = VK_STRUCTURE_TYPE_GENERATED_COMMANDS_INFO_EXT,
+                        .shaderStages = generatedStages(depthOnly),
+                        .indirectExecutionSet = this->executionSet(colorFormat),
+                        .indirectCommandsLayout = m_commandsLayouts[depthOnly ? 1 : 0],
+                        .indirectAddress = window.drawCommands.address,
+                        .indirectAddressSize = VkDeviceSize { maxSequenceCount } * sizeof(GeneratedDraw),
+                        .preprocessAddress = window.preprocessSize > 0 ? window.preprocess.address : 0,
+                        .preprocessSize = window.preprocessSize,
+                        .maxSequenceCount = maxSequenceCount,
+                        .sequenceCountAddress = window.drawCount.address + offsetof(DrawCount, drawCount),
+                    };
+                    vkCmdExecuteGeneratedCommandsEXT(commandBuffer, VK_FALSE, &generatedCommandsInfo);
+
+                    return;
+                }
+
+                vkCmdDrawIndexedIndirectCount(
+                    commandBuffer,
+                    window.drawCommands.buffer,
+                    0,
+                    window.drawCount.buffer,
+                    0,
+                    std::max(m_instanceCount, 1u),
+                    sizeof(VkDrawIndexedIndirectCommand)
+                );
+            }
+
+            // The first window to cull in a frame fits the cascades to its view, and the shadow
+            // pass draws the cascades that need it with that window's scene set and uniforms.
+            // With the virtual shadow map, it renders the pages the frame slot's requests ask for
+            // instead. Every window's uniforms carry the same cascades. The main passes of the
+            // frame are the map's last use, with whatever cascades or pages were cached left as
+            // they were.
+            vk_render_graph::ResourceId addShadowPasses(
+                vk_render_graph::RenderGraph& graph,
+                vk_memory::FrameUploadArena& uploadArena,
+                uint32_t windowIndex,
+                uint64_t frameNumber,
+                VkExtent2D renderExtent,
+                SceneUniforms& uniforms
+            ) {
+                if (m_shadowFrame == frameNumber) {
+                    this->writeShadowUniforms(uniforms, renderExtent);
+
+                    return m_shadowMapResource;
+                }
+
+                m_shadowFrame = frameNumber;
+                m_shadowMapResource = graph.importImage(
+                    m_shadowMap.image,
+                    m_shadowMap.view,
+                    m_shadowMap.sampled
+                        ? vk_render_graph::ResourceState { VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL }
+                        : vk_render_graph::ResourceState {},
+                    VK_IMAGE_ASPECT_DEPTH_BIT
+                );
+                graph.exportResource(m_shadowMapResource);
+                m_shadowMap.sampled = true;
+                m_castCascadeCount = 0;
+                m_renderedPageCount = 0;
+                if (!this->usesShadows()) {
+                    this->writeShadowUniforms(uniforms, renderExtent);
+
+                    return m_shadowMapResource;
+                }
+
+                // Animated casters move every frame.
+                if (m_shadowCasterCount != m_uploadedInstanceCount || this->usesAnimation()) {
+                    m_shadowCasterCount = m_uploadedInstanceCount;
+                    m_shadowCascades.invalidate();
+                    m_virtualShadows.invalidate();
+                }
+                if (m_shadowMode == ShadowMode::Virtual) {
+                    this->addShadowPagePasses(graph, uploadArena, windowIndex, frameNumber);
+                    this->writeShadowUniforms(uniforms, renderExtent);
+
+                    return m_shadowMapResource;
+                }
+
+                auto cascades = m_shadowCascades.update(
+                    uniforms.view,
+                    uniforms.projection.x,
+                    uniforms.projection.y,
+                    NEAR_PLANE,
+                    SHADOW_DISTANCE * m_fieldSize
+                );
+                // Rays stand in for the cached cascades, which are fitted all the same, as their
+                // splits tell `scene_shading.glsl` where the rays start.
+                if (m_shadowMode == ShadowMode::RayQuery) {
+                    cascades &= (1u << vk_shadows::FIRST_CACHED_CASCADE) - 1;
+                }
+                this->writeShadowUniforms(uniforms, renderExtent);
+                m_castCascadeCount = static_cast<uint32_t>(std::popcount(cascades));
+                if (cascades == 0) {
+                    return m_shadowMapResource;
+                }
+
+                graph.addPass(
+                    "shadowCascades",
+                    this->shadowDrawAccesses(),
+                    [this, windowIndex, cascades, fitted = m_shadowCascades.cascades(), casterCount = m_shadowCasterCount](VkCommandBuffer commandBuffer) {
+                        this->recordShadowCascades(commandBuffer, m_windows[windowIndex], fitted, cascades, casterCount);
+                    }
+                );
+
+                return m_shadowMapResource;
+            }
+
+            vk_render_graph::ResourceAccess shadowMapAttachmentAccess() const {
+                return vk_render_graph::write(
+                    m_shadowMapResource,
+                    VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+                    VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                    VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL
+                );
+            }
+
+            // The shadow passes draw into the map, from the skinned vertices when animated.
+            std::vector<vk_render_graph::ResourceAccess> shadowDrawAccesses() const {
+                auto accesses = std::vector<vk_render_graph::ResourceAccess> {
+                    this->shadowMapAttachmentAccess(),
+                };
+                if (this->usesAnimation()) {
+                    accesses.push_back(vk_render_graph::read(m_skinnedVertexResource, VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT, VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT));
+                }
+
+                return accesses;
+            }
+
+            // Reads the requests the frame slot's readback buffer got a cycle of frames ago,
+            // copies last frame's into it, and starts over for this frame's page mark passes.
+            // The pages the requests call for are rendered into the atlas, and the page table
+            // is brought up to date with them before any main pass samples it.
+            void addShadowPagePasses(vk_render_graph::RenderGraph& graph, vk_memory::FrameUploadArena& uploadArena, uint32_t windowIndex, uint64_t frameNumber) {
+                const auto slot = static_cast<uint32_t>(frameNumber % m_framesInFlight);
+                auto requests = std::span<const uint32_t> {};
+                if (m_shadowPageReadbacksPending[slot]) {
+                    requests = std::span { static_cast<const uint32_t*>(m_shadowPageReadbacks[slot].memory.get().mappedData), vk_virtual_shadows::PAGE_COUNT };
+                    m_shadowPageReadbacksPending[slot] = false;
+                }
+                const auto& pages = m_virtualShadows.update(requests);
+                m_renderedPageCount = static_cast<uint32_t>(pages.size());
+
+                // Last frame's page mark passes are the last use of the requests.
+                m_shadowPageRequestsResource = graph.importBuffer(
+                    m_shadowPageRequests.buffer,
+                    m_shadowPageRequestsMarked
+                        ? vk_render_graph::ResourceState { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT }
+                        : vk_render_graph::ResourceState {}
+                );
+                graph.exportResource(m_shadowPageRequestsResource);
+                if (m_shadowPageRequestsMarked) {
+                    const auto readback = graph.importBuffer(m_shadowPageReadbacks[slot].buffer, vk_render_graph::ResourceState {});
+                    graph.exportResource(readback);
+                    m_shadowPageReadbacksPending[slot] = true;
+                    graph.addPass(
+                        "shadowPageReadback",
+                        {
+                            vk_render_graph::read(m_shadowPageRequestsResource, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_READ_BIT),
+                            vk_render_graph::write(readback, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT),
+                        },
+                        [this, slot](VkCommandBuffer commandBuffer) {
+                            const auto region = VkBufferCopy {
+                                .srcOffset = 0,
+                                .dstOffset = 0,
+                                .size = VkDeviceSize { vk_virtual_shadows::PAGE_COUNT } * sizeof(uint32_t),
+                            };
+                            vkCmdCopyBuffer(commandBuffer, m_shadowPageRequests.buffer, m_shadowPageReadbacks[slot].buffer, 1, &region);
+
+                            // The CPU reads the copy once the frame is done.
+                            const auto toHost = VkMemoryBarrier2 {
+                                .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+                                .srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+                                .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                                .dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT,
+                                .dstAccessMask = VK_ACCESS_2_HOST_READ_BIT,
+                            };
+                            const auto dependencyInfo = VkDependencyInfo {
+                                .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+                                .memoryBarrierCount = 1,
+                                .pMemoryBarriers = &toHost,
+                            };
+                            vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+                        }
+                    );
+                }
+                m_shadowPageRequestsMarked = true;
+                graph.addPass(
+                    "shadowPageRequestsReset",
+                    {
+                        vk_render_graph::write(m_shadowPageRequestsResource, VK_PIPELINE_STAGE_2_CLEAR_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT),
+                    },
+                    [this](VkCommandBuffer commandBuffer) {
+                        vkCmdFillBuffer(commandBuffer, m_shadowPageRequests.buffer, 0, VK_WHOLE_SIZE, 0);
+                    }
+                );
+
+                // The main passes are the last use of the page table.
+                m_shadowPageTableResource = graph.importBuffer(
+                    m_shadowPageTable.buffer,
+                    m_shadowPageTableSampled
+                        ? vk_render_graph::ResourceState { VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_NONE }
+                        : vk_render_graph::ResourceState {}
+                );
+                m_shadowPageTableSampled = true;
+                const auto& dirtyRange = m_virtualShadows.dirtyRange();
+                if (dirtyRange.has_value()) {
+                    const auto size = VkDeviceSize { dirtyRange->count } * sizeof(uint32_t);
+                    const auto upload = uploadArena.allocate(size);
+                    if (!upload.has_value()) {
+                        throw std::runtime_error("failed to allocate shadow page table upload!");
+                    }
+
+                    std::memcpy(upload->mappedData, m_virtualShadows.pageTable().data() + dirtyRange->first, size);
+                    const auto region = VkBufferCopy {
+                        .srcOffset = upload->offset,
+                        .dstOffset = VkDeviceSize { dirtyRange->first } * sizeof(uint32_t),
+                        .size = size,
+                    };
+                    m_virtualShadows.clearDirtyRange();
+                    graph.addPass(
+                        "shadowPageTableUpload",
+                        {
+                            vk_render_graph::write(m_shadowPageTableResource, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT),
+                        },
+                        [this, region](VkCommandBuffer commandBuffer) {
+                            vkCmdCopyBuffer(commandBuffer, m_uniformBuffer, m_shadowPageTable.buffer, 1, &region);
+                        }
+                    );
+                }
+
+                if (pages.empty()) {
+                    return;
+                }
+
+                graph.addPass(
+                    "shadowPages",
+                    this->shadowDrawAccesses(),
+                    [this, windowIndex, pages, casterCount = m_shadowCasterCount](VkCommandBuffer commandBuffer) {
+                        this->recordShadowPages(commandBuffer, m_windows[windowIndex], pages, casterCount);
+                    }
+                );
+            }
+
+            // The direction is the light's whether or not it casts shadows, and the fragment
+            // shader looks for how it does in its w. The virtual shadow map's levels are picked
+            // by the size of a pixel of `renderExtent`.
+            void writeShadowUniforms(SceneUniforms& uniforms, VkExtent2D renderExtent) const {
+                uniforms.directionalLight = glm::vec4 { m_shadowCascades.lightDirection(), static_cast<float>(m_shadowMode) };
+                if (m_shadowMode == ShadowMode::Virtual) {
+                    // A pixel covers twice its view depth over P11 and the render height.
+                    const auto pixelSize = 2.0f / (std::abs(uniforms.projection.y) * static_cast<float>(std::max(renderExtent.height, 1u)));
+                    uniforms.shadowMatrices = {};
+                    uniforms.shadowMatrices[0] = m_virtualShadows.viewProjection();
+                    uniforms.shadowSplits = {};
+                    uniforms.shadowRadii = glm::vec4 { m_virtualShadows.sceneRadius(), 0.0f, 0.0f, 0.0f };
+                    uniforms.virtualShadows = glm::vec4 { pixelSize / m_virtualShadows.texelSize(0), 0.0f, 0.0f, 0.0f };
+
+                    return;
+                }
+
+                const auto& cascades = m_shadowCascades.cascades();
+                for (uint32_t i = 0; i < vk_shadows::CASCADE_COUNT; i++) {
+                    uniforms.shadowMatrices[i] = cascades[i].viewProjection;
+                    uniforms.shadowSplits[i] = cascades[i].splitDepth;
+                    uniforms.shadowRadii[i] = cascades[i].radius;
+                }
+            }
+
+            // Binds what every shadow draw draws with: the depth only pipeline, `window`'s scene
+            // set and uniforms for the instances, and the mesh.
+            void bindShadowDraw(VkCommandBuffer commandBuffer, const WindowResources& window) const {
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_shadowPipeline);
+                vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_shadowPipelineLayout, 0, 1, &window.pyramid.sceneSet, 1, &window.uniformOffset);
+                const auto vertexOffset = VkDeviceSize { 0 };
+                const auto vertexBuffer = this->drawnVertexBuffer();
+                vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, &vertexOffset);
+                vkCmdBindIndexBuffer(commandBuffer, m_indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+            }
+
+            // Clears and draws each cascade in `cascades`, a bit per cascade, with all of the
+            // first `casterCount` instances. The transitions into the attachment layout keep the
+            // layers of the cascades left out.
+            void recordShadowCascades(
+                VkCommandBuffer commandBuffer,
+                const WindowResources& window,
+                const std::array<vk_shadows::Cascade, vk_shadows::CASCADE_COUNT>& fitted,
+                uint32_t cascades,
+                uint32_t casterCount
+            ) const {
+                const auto extent = VkExtent2D { m_shadowMap.size, m_shadowMap.size };
+                const auto viewport = VkViewport {
+                    .x = 0.0f,
+                    .y = 0.0f,
+                    .width = static_cast<float>(extent.width),
+                    .height = static_cast<float>(extent.height),
+                    .minDepth = 0.0f,
+                    .maxDepth = 1.0f,
+                };
+                const auto scissor = VkRect2D {
+                    .offset = VkOffset2D { 0, 0 },
+                    .extent = extent,
+                };
+                this->bindShadowDraw(commandBuffer, window);
+                vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+                vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+                for (uint32_t cascade = 0; cascade < vk_shadows::CASCADE_COUNT; cascade++) {
+                    if ((cascades & (1u << cascade)) == 0) {
+                        continue;
+                    }
+
+                    const auto depthAttachment = VkRenderingAttachmentInfo {
+                        .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+                        .imageView = m_shadowMap.layerViews[cascade],
+                        .imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
+                        .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+                        .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+                        .clearValue = VkClearValue {
+                            .depthStencil = VkClearDepthStencilValue { 1.0f, 0 },
+                        },
+                    };
+                    const auto renderingInfo = VkRenderingInfo {
+                        .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+                        .renderArea = scissor,
+                        .layerCount = 1,
+                        .pDepthAttachment = &depthAttachment,
+                    };
+                    const auto constants = ShadowConstants { fitted[cascade].viewProjection };
+
+                    vkCmdBeginRendering(commandBuffer, &renderingInfo);
+                    if (casterCount > 0) {
+                        vkCmdPushConstants(commandBuffer, m_shadowPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(ShadowConstants), &constants);
+                        vkCmdDrawIndexed(commandBuffer, m_lods[0].indexCount, casterCount, m_lods[0].firstIndex, 0, 0);
+                    }
+                    vkCmdEndRendering(commandBuffer);
+                }
+            }
+
+            // Clears each of `pages`' tile of the atlas and draws all of the first `casterCount`
+            // instances into it, in one render pass that keeps the rest of the atlas.
+            void recordShadowPages(
+                VkCommandBuffer commandBuffer,
+                const WindowResources& window,
+                const std::vector<vk_virtual_shadows::PageRender>& pages,
+                uint32_t casterCount
+            ) const {
+                const auto depthAttachment = VkRenderingAttachmentInfo {
+                    .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+                    .imageView = m_shadowMap.layerViews[0],
+                    .imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
+                    .loadOp = VK_ATTACHMENT_LOAD_OP_LOAD,
+                    .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+                };
+                const auto renderingInfo = VkRenderingInfo {
+                    .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+                    .renderArea = VkRect2D {
+                        .offset = VkOffset2D { 0, 0 },
+                        .extent = VkExtent2D { m_shadowMap.size, m_shadowMap.size },
+                    },
+                    .layerCount = 1,
+                    .pDepthAttachment = &depthAttachment,
+                };
+
+                vkCmdBeginRendering(commandBuffer, &renderingInfo);
+                this->bindShadowDraw(commandBuffer, window);
+                for (const auto& page : pages) {
+                    const auto tile = VkRect2D {
+                        .offset = VkOffset2D {
+                            static_cast<int32_t>(page.physicalPage % vk_virtual_shadows::ATLAS_PAGES_PER_SIDE * vk_virtual_shadows::PAGE_SIZE),
+                            static_cast<int32_t>(page.physicalPage / vk_virtual_shadows::ATLAS_PAGES_PER_SIDE * vk_virtual_shadows::PAGE_SIZE),
+                        },
+                        .extent = VkExtent2D { vk_virtual_shadows::PAGE_SIZE, vk_virtual_shadows::PAGE_SIZE },
+                    };
+                    const auto viewport = VkViewport {
+                        .x = static_cast<float>(tile.offset.x),
+                        .y = static_cast<float>(tile.offset.y),
+                        .width = static_cast<float>(tile.extent.width),
+                        .height = static_cast<float>(tile.extent.height),
+                        .minDepth = 0.0f,
+                        .maxDepth = 1.0f,
+                    };
+                    const auto clearAttachment = VkClearAttachment {
+                        .aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
+                        .clearValue = VkClearValue {
+                            .depthStencil = VkClearDepthStencilValue { 1.0f, 0 },
+                        },
+                    };
+                    const auto clearRect = VkClearRect {
+                        .rect = tile,
+                        .baseArrayLayer = 0,
+                        .layerCount = 1,
+                    };
+                    const auto constants = ShadowConstants { m_virtualShadows.pageViewProjection(page.page) };
+
+                    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+                    vkCmdSetScissor(commandBuffer, 0, 1, &tile);
+                    vkCmdClearAttachments(commandBuffer, 1, &clearAttachment, 1, &clearRect);
+                    if (casterCount > 0) {
+                        vkCmdPushConstants(commandBuffer, m_shadowPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(ShadowConstants), &constants);
+                        vkCmdDrawIndexed(commandBuffer, m_lods[0].indexCount, casterCount, m_lods[0].firstIndex, 0, 0);
+                    }
+                }
+                vkCmdEndRendering(commandBuffer);
+            }
+
+            // Flags the virtual shadow map's pages the depth a window's pyramid was just built
+            // from needs, in this frame's page requests.
+            void addShadowPageMarkPass(vk_render_graph::RenderGraph& graph, const SceneResources& resources, uint32_t windowIndex, VkExtent2D renderExtent) {
+                if (m_shadowMode != ShadowMode::Virtual) {
+                    return;
+                }
+
+                graph.addPass(
+                    "shadowPageMark",
+                    {
+                        vk_render_graph::read(resources.resolvedDepth, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+                        vk_render_graph::write(m_shadowPageRequestsResource, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT),
+                    },
+                    [this, &graph, depth = resources.resolvedDepth, windowIndex, renderExtent](VkCommandBuffer commandBuffer) {
+                        this->recordShadowPageMarks(commandBuffer, m_windows[windowIndex], graph.imageView(depth), renderExtent);
+                    }
+                );
+            }
+
+            void recordShadowPageMarks(VkCommandBuffer commandBuffer, const WindowResources& window, VkImageView depthView, VkExtent2D renderExtent) {
+                const auto set = m_frameDescriptors->allocate(m_pageMarkSetLayout);
+                const auto imageInfo = VkDescriptorImageInfo { m_sampler, depthView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+                const auto bufferInfo = VkDescriptorBufferInfo { m_shadowPageRequests.buffer, 0, VK_WHOLE_SIZE };
+                const auto writes = std::array {
+                    VkWriteDescriptorSet {
+                        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                        .dstSet = set,
+                        .dstBinding = 0,
+                        .descriptorCount = 1,
+                        .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                        .pImageInfo = &imageInfo,
+                    },
+                    VkWriteDescriptorSet {
+                        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                        .dstSet = set,
+                        .dstBinding = 1,
+                        .descriptorCount = 1,
+                        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                        .pBufferInfo = &bufferInfo,
+                    },
+                };
+                vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+
+                const auto sets = std::array { window.pyramid.sceneSet, set };
+                const auto pushConstants = PageMarkPushConstants {
+                    .renderExtent = { renderExtent.width, renderExtent.height },
+                };
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pageMarkPipeline);
+                vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pageMarkPipelineLayout, 0, static_cast<uint32_t>(sets.size()), sets.data(), 1, &window.uniformOffset);
+                vkCmdPushConstants(commandBuffer, m_pageMarkPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PageMarkPushConstants), &pushConstants);
+                vkCmdDispatch(
+                    commandBuffer,
+                    (renderExtent.width + m_computeTuning.tile - 1) / m_computeTuning.tile,
+                    (renderExtent.height + m_computeTuning.tile - 1) / m_computeTuning.tile,
+                    1
+                );
+            }
+
+            // The first window to cull in a frame poses the skeleton for the frame, writes the
+            // palette to the upload arena and skins the mesh with it, which every window's draws
+            // then read. Last frame's draws are the last use of the skinned vertices. Until the
+            // mesh is uploaded there is nothing to skin, and no instance to draw it.
+            std::optional<vk_render_graph::ResourceId> addSkinningPass(
+                vk_render_graph::RenderGraph& graph,
+                vk_memory::FrameUploadArena& uploadArena,
+                uint32_t windowIndex,
+                uint64_t frameNumber
+            ) {
+                if (!this->usesAnimation()) {
+                    return std::nullopt;
+                } else if (m_skinFrame == frameNumber) {
+                    return m_skinnedVertexResource;
+                }
+
+                m_skinFrame = frameNumber;
+                m_skinnedVertexResource = graph.importBuffer(
+                    m_skinnedVertexBuffer.buffer,
+                    m_skinnedVerticesDrawn
+                        ? vk_render_graph::ResourceState { VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT, VK_ACCESS_2_NONE }
+                        : vk_render_graph::ResourceState {}
+                );
+                if (m_uploadedMeshBufferCount < m_meshUploads.size()) {
+                    return m_skinnedVertexResource;
+                }
+
+                // Wrapped to a loop in double precision, so the time stays exact however long it
+                // runs.
+                const auto time = m_previousTick.time + (m_latestTick.time - m_previousTick.time) * static_cast<double>(m_tickAlpha);
+                const auto loopSeconds = static_cast<double>(ANIMATION_KEY_COUNT) / static_cast<double>(ANIMATION_SAMPLE_RATE);
+                m_animator.update(*m_animationJobSystem, static_cast<float>(std::fmod(time, loopSeconds)));
+
+                const auto palette = uploadArena.allocate(vk_animation::MAX_JOINTS * sizeof(vk_transforms::WorldMatrix));
+                if (!palette.has_value()) {
+                    throw std::runtime_error("failed to allocate joint palette!");
+                }
+
+                std::memcpy(palette->mappedData, m_animator.palette().data(), m_animator.palette().size_bytes());
+                m_skinnedVerticesDrawn = true;
+                graph.addPass(
+                    "skin",
+                    {
+                        vk_render_graph::write(m_skinnedVertexResource, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT),
+                    },
+                    [this, windowIndex, paletteOffset = static_cast<uint32_t>(palette->offset)](VkCommandBuffer commandBuffer) {
+                        this->recordSkinning(commandBuffer, m_windows[windowIndex], paletteOffset);
+                    }
+                );
+
+                return m_skinnedVertexResource;
+            }
+
+            void recordSkinning(VkCommandBuffer commandBuffer, const WindowResources& window, uint32_t paletteOffset) const {
+                const auto sets = std::array { window.pyramid.sceneSet, m_skinSet };
+                const auto offsets = std::array { window.uniformOffset, paletteOffset };
+                const auto pushConstants = SkinPushConstants {
+                    .vertexCount = static_cast<uint32_t>(m_vertices.size()),
+                };
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_skinPipeline);
+                vkCmdBindDescriptorSets(
+                    commandBuffer,
+                    VK_PIPELINE_BIND_POINT_COMPUTE,
+                    m_skinPipelineLayout,
+                    0,
+                    static_cast<uint32_t>(sets.size()),
+                    sets.data(),
+                    static_cast<uint32_t>(offsets.size()),
+                    offsets.data()
+                );
+                vkCmdPushConstants(commandBuffer, m_skinPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SkinPushConstants), &pushConstants);
+                const auto workgroupSize = m_computeTuning.linear;
+                vkCmdDispatch(commandBuffer, (pushConstants.vertexCount + workgroupSize - 1) / workgroupSize, 1, 1);
+            }
+
+            // Without lights, the clusters are never read, and there is nothing to bin.
+            void addLightCullPass(vk_render_graph::RenderGraph& graph, vk_render_graph::ResourceId lightClusters, uint32_t windowIndex) const {
+                if (m_lightCount == 0) {
+                    return;
+                }
+
+                graph.addPass(
+                    "lightCull",
+                    {
+                        vk_render_graph::write(lightClusters, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT),
+                    },
+                    [this, windowIndex](VkCommandBuffer commandBuffer) {
+                        const auto& window = m_windows[windowIndex];
+                        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_lightCullPipeline);
+                        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_scenePipelineLayout, 0, 1, &window.pyramid.sceneSet, 1, &window.uniformOffset);
+                        const auto workgroupSize = m_computeTuning.linear;
+                        vkCmdDispatch(commandBuffer, (vk_lights::CLUSTER_COUNT + workgroupSize - 1) / workgroupSize, 1, 1);
+                    }
+                );
+            }
+
+            // The draw buffers are reset and refilled by every phase. The late phase reads the
+            // visibility the early one did, and the next frame's early phase what it wrote.
+            void addCullPass(
+                vk_render_graph::RenderGraph& graph,
+                const SceneResources& resources,
+                uint32_t windowIndex,
+                CullPhase phase,
+                const char* resetName,
+                const char* cullName,
+                std::optional<vk_render_graph::ResourceId> visibility = std::nullopt
+            ) {
+                graph.addPass(
+                    resetName,
+                    {
+                        vk_render_graph::write(resources.drawCount, VK_PIPELINE_STAGE_2_CLEAR_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT),
+                    },
+                    [this, windowIndex](VkCommandBuffer commandBuffer) {
+                        vkCmdFillBuffer(commandBuffer, m_windows[windowIndex].drawCount.buffer, 0, VK_WHOLE_SIZE, 0);
+                    }
+                );
+
+                auto accesses = std::vector<vk_render_graph::ResourceAccess> {
+                    vk_render_graph::write(resources.drawCount, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT),
+                    vk_render_graph::write(resources.drawCommands, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT),
+                };
+                if (phase != CullPhase::Early) {
+                    accesses.push_back(vk_render_graph::read(resources.depthPyramid, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_GENERAL));
+                }
+                if (phase == CullPhase::Early) {
+                    accesses.push_back(vk_render_graph::read(visibility.value(), VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT));
+                } else if (phase == CullPhase::Late) {
+                    accesses.push_back(vk_render_graph::write(visibility.value(), VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT));
+                }
+
+                graph.addPass(
+                    cullName,
+                    accesses,
+                    [this, windowIndex, phase](VkCommandBuffer commandBuffer) {
+                        this->recordCull(commandBuffer, m_windows[windowIndex], phase);
+                    }
+                );
+            }
+
+            // Resolves write through the color attachment output stage, depth included.
+            vk_render_graph::ResourceAccess depthResolveAccess(const SceneResources& resources) const {
+                return vk_render_graph::write(
+                    resources.resolvedDepth,
+                    VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+                    VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+                    VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL
+                );
+            }
+
+            // What drawing the instances the last cull pass kept reads, besides the scene's
+            // buffers, which never change, and the skinned vertices, which do. The task shader
+            // reads the instance list, the counts and the depth pyramid as well. Device generated
+            // commands are preprocessed from the draw buffers into the preprocess buffer, which
+            // every draw of the window rewrites.
+            std::vector<vk_render_graph::ResourceAccess> drawAccesses(const SceneResources& resources) const {
+                auto accesses = std::vector<vk_render_graph::ResourceAccess> {};
+                if (resources.skinnedVertices.has_value()) {
+                    accesses.push_back(vk_render_graph::read(
+                        resources.skinnedVertices.value(),
+                        VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT,
+                        VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT
+                    ));
+                }
+                if (m_generatedCommands) {
+                    const auto stages = this->drawStages();
+                    const auto access = VkAccessFlags2 { VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_2_COMMAND_PREPROCESS_READ_BIT_EXT };
+                    accesses.push_back(vk_render_graph::read(resources.drawCommands, stages, access));
+                    accesses.push_back(vk_render_graph::read(resources.drawCount, stages, access));
+                    accesses.push_back(vk_render_graph::write(
+                        resources.preprocess,
+                        VK_PIPELINE_STAGE_2_COMMAND_PREPROCESS_BIT_EXT,
+                        VK_ACCESS_2_COMMAND_PREPROCESS_READ_BIT_EXT | VK_ACCESS_2_COMMAND_PREPROCESS_WRITE_BIT_EXT
+                    ));
+
+                    return accesses;
+                } else if (!m_meshShading) {
+                    accesses.push_back(vk_render_graph::read(resources.drawCommands, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT));
+                    if (this->usesCpuCulling()) {
+                        return accesses;
+                    }
+
+                    accesses.push_back(vk_render_graph::read(resources.drawCount, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT));
+
+                    return accesses;
+                }
+
+                accesses.push_back(vk_render_graph::read(resources.drawCommands, VK_PIPELINE_STAGE_2_TASK_SHADER_BIT_EXT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT));
+                accesses.push_back(vk_render_graph::read(
+                    resources.drawCount,
+                    VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_TASK_SHADER_BIT_EXT,
+                    VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT
+                ));
+                accesses.push_back(vk_render_graph::read(resources.depthPyramid, VK_PIPELINE_STAGE_2_TASK_SHADER_BIT_EXT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_GENERAL));
+
+                return accesses;
+            }
+
+            // The early phase culls nothing against the pyramid: what it keeps was visible last
+            // frame, and the pyramid is rebuilt from it. Everything after it culls against the
+            // new pyramid, which the frame always builds.
+            void writePrepassUniforms(WindowResources& window, vk_memory::FrameUploadArena& uploadArena, const SceneUniforms& sceneUniforms) const {
+                const auto uniforms = uploadArena.allocate(sizeof(SceneUniforms));
+                if (!uniforms.has_value()) {
+                    throw std::runtime_error("failed to allocate scene uniforms!");
+                }
+
+                auto earlyUniforms = sceneUniforms;
+                earlyUniforms.cull[1] = 0;
+                std::memcpy(uniforms->mappedData, &earlyUniforms, sizeof(SceneUniforms));
+                window.earlyUniformOffset = static_cast<uint32_t>(uniforms->offset);
+            }
+
+            // Only depth is written, and only the instances visible last frame are drawn, so
+            // the pass costs a fraction of the main pass. Multisampled depth is resolved into
+            // `resolvedView` for the pyramid, within the pass.
+            void recordDepthPrepass(VkCommandBuffer commandBuffer, uint32_t windowIndex, VkImageView depthView, VkImageView resolvedView, VkExtent2D renderExtent) const {
+                const auto depthAttachment = VkRenderingAttachmentInfo {
+                    .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+                    .imageView = depthView,
+                    .imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
+                    .resolveMode = this->isMultisampled() ? m_depthResolveMode : VK_RESOLVE_MODE_NONE,
+                    .resolveImageView = this->isMultisampled() ? resolvedView : VK_NULL_HANDLE,
+                    .resolveImageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
+                    .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+                    .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+                    .clearValue = VkClearValue {
+                        .depthStencil = VkClearDepthStencilValue { DEPTH_CLEAR_VALUE, 0 },
+                    },
+                };
+                const auto renderingInfo = VkRenderingInfo {
+                    .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+                    .renderArea = VkRect2D {
+                        .offset = VkOffset2D { 0, 0 },
+                        .extent = renderExtent,
+                    },
+                    .layerCount = 1,
+                    .pDepthAttachment = &depthAttachment,
+                };
+
+                const auto& window = m_windows[windowIndex];
+                vkCmdBeginRendering(commandBuffer, &renderingInfo);
+                this->recordSceneDraw(commandBuffer, window, VK_FORMAT_UNDEFINED, renderExtent, window.earlyUniformOffset, m_rasterState);
+                vkCmdEndRendering(commandBuffer);
+            }
+
+            void recordCull(VkCommandBuffer commandBuffer, const WindowResources& window, CullPhase phase) const {
+                if (m_uploadedInstanceCount == 0) {
+                    return;
+                }
+
+                const auto uniformOffset = phase == CullPhase::Early ? window.earlyUniformOffset : window.uniformOffset;
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullPipelines[static_cast<size_t>(phase)]);
+                vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_scenePipelineLayout, 0, 1, &window.pyramid.sceneSet, 1, &uniformOffset);
+                const auto cullWorkgroupSize = m_computeTuning.linear;
+                vkCmdDispatch(commandBuffer, (m_uploadedInstanceCount + cullWorkgroupSize - 1) / cullWorkgroupSize, 1, 1);
+            }
+
+            // A single dispatch builds every level, whose writes the render graph orders against
+            // the next frame's culling. The scratch buffer is the downsampler's own: zeroed before
+            // the first build, and left zeroed by every build after, which the barrier orders
+            // against this one's.
+            void recordDepthPyramid(VkCommandBuffer commandBuffer, WindowResources& window, VkImageView depthView, VkExtent2D renderExtent) {
+                auto& pyramid = window.pyramid;
+                const auto set = m_frameDescriptors->allocate(m_pyramidDownsampler.setLayout());
+                const auto levelViews = std::vector<VkImageView>(pyramid.levelViews.begin(), pyramid.levelViews.end());
+                m_pyramidDownsampler.writeSet(set, m_sampler, depthView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, levelViews, pyramid.scratch.buffer);
+
+                if (!pyramid.built) {
+                    vkCmdFillBuffer(commandBuffer, pyramid.scratch.buffer, 0, VK_WHOLE_SIZE, 0);
+                }
+
+                const auto barrier = VkBufferMemoryBarrier2 {
+                    .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+                    .srcStageMask = pyramid.built ? VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT : VK_PIPELINE_STAGE_2_CLEAR_BIT,
+                    .srcAccessMask = pyramid.built ? VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT : VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                    .dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                    .dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                    .buffer = pyramid.scratch.buffer,
+                    .offset = 0,
+                    .size = VK_WHOLE_SIZE,
+                };
+                const auto dependencyInfo = VkDependencyInfo {
+                    .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+                    .bufferMemoryBarrierCount = 1,
+                    .pBufferMemoryBarriers = &barrier,
+                };
+                vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+
+                m_pyramidDownsampler.record(commandBuffer, set, renderExtent, pyramid.extent, pyramid.levelCount);
+
+                pyramid.built = true;
+            }
+    };
+}
@@ -0,0 +1,451 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+
+#include "vk_compute.h"
+#include "vk_handles.h"
+#include "vk_memory.h"
+#include "vk_pipelines.h"
+#include "vk_shaders.h"
+
+
+namespace vk_gpu_primitives {
+    // The specialization constant ids every kernel shares, see `primitives.glsl`.
+    constexpr uint32_t WORKGROUP_SIZE_ID = 0;
+    constexpr uint32_t ITEMS_PER_INVOCATION_ID = 1;
+
+    // Each invocation goes over this many elements, so that a workgroup has enough work to
+    // hide its barriers, and a million elements fit in a few thousand workgroups.
+    constexpr uint32_t ITEMS_PER_INVOCATION = 8;
+
+    // The radix sort goes over its keys a byte a pass.
+    constexpr uint32_t RADIX_BITS = 8;
+    constexpr uint32_t RADIX = 1u << RADIX_BITS;
+
+    // Every device can dispatch this many workgroups along x.
+    constexpr uint32_t MAX_WORKGROUP_COUNT = 65535;
+
+    // The keys are one or two words each, the low word first.
+    enum class KeyWidth : uint32_t {
+        Bits32 = 1,
+        Bits64 = 2,
+    };
+
+    struct ScanReducePushConstants {
+        VkDeviceAddress source;
+        VkDeviceAddress blockSums;
+        uint32_t count;
+    };
+
+    struct ScanDownsweepPushConstants {
+        VkDeviceAddress source;
+        VkDeviceAddress destination;
+        VkDeviceAddress blockOffsets;
+        uint32_t count;
+        uint32_t hasBlockOffsets;
+    };
+
+    struct CompactPushConstants {
+        VkDeviceAddress source;
+        VkDeviceAddress flags;
+        VkDeviceAddress offsets;
+        VkDeviceAddress destination;
+        VkDeviceAddress destinationCount;
+        uint32_t count;
+        uint32_t elementWords;
+        uint32_t hasSource;
+    };
+
+    struct RadixHistogramPushConstants {
+        VkDeviceAddress keys;
+        VkDeviceAddress histogram;
+        uint32_t count;
+        uint32_t keyWords;
+        uint32_t shift;
+        uint32_t blockCount;
+    };
+
+    struct RadixScatterPushConstants {
+        VkDeviceAddress keys;
+        VkDeviceAddress values;
+        VkDeviceAddress sortedKeys;
+        VkDeviceAddress sortedValues;
+        VkDeviceAddress offsets;
+        uint32_t count;
+        uint32_t keyWords;
+        uint32_t shift;
+        uint32_t blockCount;
+        uint32_t hasValues;
+    };
+
+    constexpr uint32_t PUSH_CONSTANTS_SIZE = static_cast<uint32_t>(std::max({
+        sizeof(ScanReducePushConstants),
+        sizeof(ScanDownsweepPushConstants),
+        sizeof(CompactPushConstants),
+        sizeof(RadixHistogramPushConstants),
+        sizeof(RadixScatterPushConstants),
+    }));
+
+    // The kernels reach every buffer through its device address, and scan across workgroups
+    // of full subgroups.
+    inline bool supports(const vk_compute::ComputeTuning& computeTuning, bool bufferDeviceAddress) {
+        return computeTuning.subgroupPrimitives && bufferDeviceAddress;
+    }
+
+    // Makes the storage writes of one dispatch visible to the storage reads and writes of the
+    // next, or, from every stage, whatever was written before a primitive was recorded.
+    inline void recordComputeDependency(
+        VkCommandBuffer commandBuffer,
+        VkPipelineStageFlags2 srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+        VkAccessFlags2 srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT
+    ) {
+        const auto barrier = VkMemoryBarrier2 {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+            .srcStageMask = srcStageMask,
+            .srcAccessMask = srcAccessMask,
+            .dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+            .dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+        };
+        const auto dependencyInfo = VkDependencyInfo {
+            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+            .memoryBarrierCount = 1,
+            .pMemoryBarriers = &barrier,
+        };
+        vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+    }
+
+    // Exclusive scans, stream compaction and radix sorts of 32 and 64 bit keys over buffers of
+    // 32 bit words, recorded into compute command buffers. Every buffer is passed by its
+    // device address, so it has to be created with `VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT`
+    // and `VK_BUFFER_USAGE_STORAGE_BUFFER_BIT`.
+    //
+    // The primitives share one scratch buffer, sized at init for up to `maxCount` elements.
+    // Each waits for everything recorded before it on the queue, which keeps primitives of
+    // frames in flight from racing on the scratch, but the results have to be waited for with
+    // a barrier on compute shader storage writes.
+    class GpuPrimitives {
+        public:
+            explicit GpuPrimitives() = default;
+
+            GpuPrimitives(const GpuPrimitives& other) = delete;
+            GpuPrimitives& operator=(const GpuPrimitives& other) = delete;
+
+            // The pipelines come from `pipelineRegistry`, which keeps them, and are specialized
+            // for `computeTuning`, which has to support the primitives.
+            void init(
+                VkDevice device,
+                vk_memory::DeviceMemoryAllocator& memoryAllocator,
+                vk_shaders::ShaderLibrary& shaderLibrary,
+                vk_pipelines::PipelineRegistry& pipelineRegistry,
+                const vk_compute::ComputeTuning& computeTuning,
+                const VkAllocationCallbacks* allocator,
+                uint32_t maxCount
+            ) {
+                if (!computeTuning.subgroupPrimitives) {
+                    throw std::runtime_error("failed to create GPU primitives, subgroup arithmetic in full subgroups is unsupported!");
+                }
+
+                m_device = device;
+                m_allocator = allocator;
+                m_computeTuning = computeTuning;
+                m_blockSize = computeTuning.linear * ITEMS_PER_INVOCATION;
+                m_maxCount = maxCount;
+                if (this->blockCount(maxCount) > MAX_WORKGROUP_COUNT) {
+                    throw std::runtime_error("failed to create GPU primitives, too many elements for one dispatch!");
+                }
+
+                const auto pushConstantRange = VkPushConstantRange {
+                    .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                    .offset = 0,
+                    .size = PUSH_CONSTANTS_SIZE,
+                };
+                const auto pipelineLayoutInfo = VkPipelineLayoutCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+                    .pushConstantRangeCount = 1,
+                    .pPushConstantRanges = &pushConstantRange,
+                };
+
+                const auto pipelineLayoutResult = vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, m_allocator, &m_pipelineLayout);
+                if (pipelineLayoutResult != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create GPU primitives pipeline layout!");
+                }
+
+                m_scanReducePipeline = this->createPipeline(shaderLibrary, pipelineRegistry, "scan_reduce.comp");
+                m_scanDownsweepPipeline = this->createPipeline(shaderLibrary, pipelineRegistry, "scan_downsweep.comp");
+                m_compactPipeline = this->createPipeline(shaderLibrary, pipelineRegistry, "compact_scatter.comp");
+                m_radixHistogramPipeline = this->createPipeline(shaderLibrary, pipelineRegistry, "radix_histogram.comp");
+                m_radixScatterPipeline = this->createPipeline(shaderLibrary, pipelineRegistry, "radix_scatter.comp");
+
+                this->createScratch(memoryAllocator);
+            }
+
+            void destroy() {
+                if (m_device == VK_NULL_HANDLE) {
+                    return;
+                }
+
+                m_scratch = vk_handles::Buffer();
+                m_scratchMemory = vk_memory::ScopedAllocation();
+                vkDestroyPipelineLayout(m_device, m_pipelineLayout, m_allocator);
+                m_pipelineLayout = VK_NULL_HANDLE;
+                m_device = VK_NULL_HANDLE;
+            }
+
+            bool isInitialized() const {
+                return m_device != VK_NULL_HANDLE;
+            }
+
+            uint32_t maxCount() const {
+                return m_maxCount;
+            }
+
+            // Writes to `destination` the sum of the `count` words before each one at `source`,
+            // which may be the same buffer.
+            void recordExclusiveScan(VkCommandBuffer commandBuffer, VkDeviceAddress source, VkDeviceAddress destination, uint32_t count) const {
+                this->checkCount(count);
+                if (count == 0) {
+                    return;
+                }
+
+                recordComputeDependency(commandBuffer, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_MEMORY_WRITE_BIT);
+                this->recordScanLevel(commandBuffer, source, destination, count, m_scanScratchAddress);
+            }
+
+            // Packs the elements of `elementWords` words at `source` whose flag at `flags`, a word
+            // each and zero or one, is set to the front of `destination` in order, and writes
+            // their count to the word at `destinationCount`. Without a source, packs the indices
+            // of the flagged elements, which compacts a visibility mask into a list.
+            void recordCompact(
+                VkCommandBuffer commandBuffer,
+                VkDeviceAddress source,
+                VkDeviceAddress flags,
+                uint32_t count,
+                VkDeviceAddress destination,
+                VkDeviceAddress destinationCount,
+                uint32_t elementWords = 1
+            ) const {
+                this->checkCount(count);
+                recordComputeDependency(commandBuffer, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_MEMORY_WRITE_BIT);
+                if (count != 0) {
+                    this->recordScanLevel(commandBuffer, flags, m_offsetsAddress, count, m_scanScratchAddress);
+                    recordComputeDependency(commandBuffer);
+                }
+
+                const auto pushConstants = CompactPushConstants {
+                    .source = source,
+                    .flags = flags,
+                    .offsets = m_offsetsAddress,
+                    .destination = destination,
+                    .destinationCount = destinationCount,
+                    .count = count,
+                    .elementWords = source != 0 ? elementWords : 1,
+                    .hasSource = source != 0,
+                };
+                this->recordDispatch(commandBuffer, m_compactPipeline, pushConstants, std::max(this->blockCount(count), 1u));
+            }
+
+            // Sorts the `count` keys at `keys` in place, least significant byte first, and the
+            // words at `values`, when there are any, along with them. Equal keys keep their order.
+            void recordSort(VkCommandBuffer commandBuffer, VkDeviceAddress keys, VkDeviceAddress values, uint32_t count, KeyWidth keyWidth) const {
+                this->checkCount(count);
+                if (count <= 1) {
+                    return;
+                }
+
+                const auto keyWords = static_cast<uint32_t>(keyWidth);
+                const auto blockCount = this->blockCount(count);
+                auto source = std::pair { keys, values };
+                auto sorted = std::pair { m_sortKeysAddress, values != 0 ? m_sortValuesAddress : VkDeviceAddress { 0 } };
+
+                // An even number of passes leaves the keys where they started.
+                recordComputeDependency(commandBuffer, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_MEMORY_WRITE_BIT);
+                for (uint32_t shift = 0; shift < keyWords * 32; shift += RADIX_BITS) {
+                    if (shift != 0) {
+                        recordComputeDependency(commandBuffer);
+                    }
+
+                    const auto histogram = RadixHistogramPushConstants {
+                        .keys = source.first,
+                        .histogram = m_histogramAddress,
+                        .count = count,
+                        .keyWords = keyWords,
+                        .shift = shift,
+                        .blockCount = blockCount,
+                    };
+                    this->recordDispatch(commandBuffer, m_radixHistogramPipeline, histogram, blockCount);
+                    recordComputeDependency(commandBuffer);
+
+                    this->recordScanLevel(commandBuffer, m_histogramAddress, m_histogramAddress, RADIX * blockCount, m_scanScratchAddress);
+                    recordComputeDependency(commandBuffer);
+
+                    const auto scatter = RadixScatterPushConstants {
+                        .keys = source.first,
+                        .values = source.second,
+                        .sortedKeys = sorted.first,
+                        .sortedValues = sorted.second,
+                        .offsets = m_histogramAddress,
+                        .count = count,
+                        .keyWords = keyWords,
+                        .shift = shift,
+                        .blockCount = blockCount,
+                        .hasValues = values != 0,
+                    };
+                    this->recordDispatch(commandBuffer, m_radixScatterPipeline, scatter, blockCount);
+
+                    std::swap(source, sorted);
+                }
+            }
+        private:
+            VkDevice m_device = VK_NULL_HANDLE;
+            const VkAllocationCallbacks* m_allocator = nullptr;
+            vk_compute::ComputeTuning m_computeTuning {};
+            uint32_t m_blockSize = 0;
+            uint32_t m_maxCount = 0;
+            VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+            VkPipeline m_scanReducePipeline = VK_NULL_HANDLE;
+            VkPipeline m_scanDownsweepPipeline = VK_NULL_HANDLE;
+            VkPipeline m_compactPipeline = VK_NULL_HANDLE;
+            VkPipeline m_radixHistogramPipeline = VK_NULL_HANDLE;
+            VkPipeline m_radixScatterPipeline = VK_NULL_HANDLE;
+            vk_memory::ScopedAllocation m_scratchMemory;
+            vk_handles::Buffer m_scratch;
+            VkDeviceAddress m_sortKeysAddress = 0;
+            VkDeviceAddress m_sortValuesAddress = 0;
+            VkDeviceAddress m_offsetsAddress = 0;
+            VkDeviceAddress m_histogramAddress = 0;
+            VkDeviceAddress m_scanScratchAddress = 0;
+
+            uint32_t blockCount(uint32_t count) const {
+                return (count + m_blockSize - 1) / m_blockSize;
+            }
+
+            // The block sums of every level of a scan of `count` words but the last, which fits
+            // in one block.
+            uint32_t scanScratchWords(uint32_t count) const {
+                auto words = uint32_t { 0 };
+                for (auto blocks = this->blockCount(count); blocks > 1; blocks = this->blockCount(blocks)) {
+                    words += blocks;
+                }
+
+                return words;
+            }
+
+            void checkCount(uint32_t count) const {
+                if (count > m_maxCount) {
+                    throw std::runtime_error("failed to record GPU primitive, more elements than its scratch holds!");
+                }
+            }
+
+            // Every kernel runs in full subgroups of the tuned size, which the scans rely on to
+            // tell apart where each invocation's elements are.
+            VkPipeline createPipeline(vk_shaders::ShaderLibrary& shaderLibrary, vk_pipelines::PipelineRegistry& pipelineRegistry, const char* shaderName) const {
+                auto constants = vk_pipelines::SpecializationConstants {};
+                constants
+                    .set(WORKGROUP_SIZE_ID, m_computeTuning.linear)
+                    .set(ITEMS_PER_INVOCATION_ID, ITEMS_PER_INVOCATION);
+                auto requiredSize = VkPipelineShaderStageRequiredSubgroupSizeCreateInfo {};
+                const auto pipelineInfo = VkComputePipelineCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+                    .stage = VkPipelineShaderStageCreateInfo {
+                        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                        .pNext = vk_compute::requiredSubgroupSize(m_computeTuning, requiredSize),
+                        .flags = VK_PIPELINE_SHADER_STAGE_CREATE_REQUIRE_FULL_SUBGROUPS_BIT,
+                        .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                        .module = shaderLibrary.shaderModule(shaderName),
+                        .pName = "main",
+                        .pSpecializationInfo = constants.info(),
+                    },
+                    .layout = m_pipelineLayout,
+                };
+
+                return pipelineRegistry.computePipeline(pipelineInfo);
+            }
+
+            // One buffer holds the sort's second copy of the keys and values, the compaction's
+            // offsets, the sort's histogram and the block sums of every scan. The compaction's
+            // offsets are the sort's values, the two never run at once.
+            void createScratch(vk_memory::DeviceMemoryAllocator& memoryAllocator) {
+                const auto count = VkDeviceSize { std::max(m_maxCount, 1u) };
+                const auto histogramWords = VkDeviceSize { RADIX } * this->blockCount(m_maxCount);
+                const auto scanWords = std::max(this->scanScratchWords(m_maxCount), this->scanScratchWords(static_cast<uint32_t>(histogramWords)));
+                const auto sortKeysOffset = VkDeviceSize { 0 };
+                const auto sortValuesOffset = sortKeysOffset + count * static_cast<uint32_t>(KeyWidth::Bits64) * sizeof(uint32_t);
+                const auto histogramOffset = sortValuesOffset + count * sizeof(uint32_t);
+                const auto scanOffset = histogramOffset + histogramWords * sizeof(uint32_t);
+
+                const auto bufferInfo = VkBufferCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                    .size = scanOffset + std::max(VkDeviceSize { scanWords }, VkDeviceSize { 1 }) * sizeof(uint32_t),
+                    .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                };
+
+                auto buffer = VkBuffer {};
+                const auto result = vkCreateBuffer(m_device, &bufferInfo, m_allocator, &buffer);
+                if (result != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create GPU primitives scratch buffer!");
+                }
+
+                m_scratch = vk_handles::Buffer { m_device, buffer, m_allocator };
+                m_scratchMemory = vk_memory::ScopedAllocation {
+                    memoryAllocator,
+                    memoryAllocator.allocateForBuffer(buffer, vk_memory::AllocationCreateInfo {
+                        .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                    }),
+                };
+
+                const auto address = vk_memory::bufferDeviceAddress(m_device, buffer);
+                m_sortKeysAddress = address + sortKeysOffset;
+                m_sortValuesAddress = address + sortValuesOffset;
+                m_offsetsAddress = m_sortValuesAddress;
+                m_histogramAddress = address + histogramOffset;
+                m_scanScratchAddress = address + scanOffset;
+            }
+
+            template<typename PushConstants>
+            void recordDispatch(VkCommandBuffer commandBuffer, VkPipeline pipeline, const PushConstants& pushConstants, uint32_t workgroupCount) const {
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+                vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+                vkCmdDispatch(commandBuffer, workgroupCount, 1, 1);
+            }
+
+            // Scans up to a block in one go. Larger scans sum their blocks, scan the sums with
+            // the scratch after them, and push each block's prefix back down.
+            void recordScanLevel(
+                VkCommandBuffer commandBuffer,
+                VkDeviceAddress source,
+                VkDeviceAddress destination,
+                uint32_t count,
+                VkDeviceAddress scratch
+            ) const {
+                const auto blockCount = this->blockCount(count);
+                auto downsweep = ScanDownsweepPushConstants {
+                    .source = source,
+                    .destination = destination,
+                    .count = count,
+                };
+                if (blockCount > 1) {
+                    const auto reduce = ScanReducePushConstants {
+                        .source = source,
+                        .blockSums = scratch,
+                        .count = count,
+                    };
+                    this->recordDispatch(commandBuffer, m_scanReducePipeline, reduce, blockCount);
+                    recordComputeDependency(commandBuffer);
+
+                    this->recordScanLevel(commandBuffer, scratch, scratch, blockCount, scratch + VkDeviceSize { blockCount } * sizeof(uint32_t));
+                    recordComputeDependency(commandBuffer);
+
+                    downsweep.blockOffsets = scratch;
+                    downsweep.hasBlockOffsets = 1;
+                }
+
+                this->recordDispatch(commandBuffer, m_scanDownsweepPipeline, downsweep, blockCount);
+            }
+    };
+}
@@ -0,0 +1,342 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+namespace vk_handles {
+    // The parent of the objects that are destroyed without one, the instance and the device.
+    struct NoParent {};
+
+    // Owns one Vulkan object, destroyed through the dispatch table entry `Destroy` along with
+    // the allocation callbacks it was created with. Only moves transfer ownership, and a
+    // default constructed or moved from handle owns nothing, so destroying it is a no-op.
+    //
+    // Handles convert to the raw handle implicitly, so they can be passed straight to Vulkan
+    // calls and create info structures.
+    template <typename Handle, typename Parent, auto* Destroy>
+    class UniqueHandle {
+        public:
+            explicit UniqueHandle() = default;
+
+            explicit UniqueHandle(Handle handle, const VkAllocationCallbacks* allocator) requires std::is_same_v<Parent, NoParent>
+                : m_handle { handle }
+                , m_allocator { allocator }
+            {
+            }
+
+            explicit UniqueHandle(Parent parent, Handle handle, const VkAllocationCallbacks* allocator) requires (!std::is_same_v<Parent, NoParent>)
+                : m_parent { parent }
+                , m_handle { handle }
+                , m_allocator { allocator }
+            {
+            }
+
+            UniqueHandle(const UniqueHandle& other) = delete;
+            UniqueHandle& operator=(const UniqueHandle& other) = delete;
+
+            UniqueHandle(UniqueHandle&& other) noexcept
+                : m_parent { other.m_parent }
+                , m_handle { std::exchange(other.m_handle, Handle { VK_NULL_HANDLE }) }
+                , m_allocator { other.m_allocator }
+            {
+            }
+
+            UniqueHandle& operator=(UniqueHandle&& other) noexcept {
+                if (this != &other) {
+                    this->reset();
+                    m_parent = other.m_parent;
+                    m_handle = std::exchange(other.m_handle, Handle { VK_NULL_HANDLE });
+                    m_allocator = other.m_allocator;
+                }
+
+                return *this;
+            }
+
+            ~UniqueHandle() {
+                this->reset();
+            }
+
+            Handle get() const {
+                return m_handle;
+            }
+
+            operator Handle() const {
+                return m_handle;
+            }
+
+            explicit operator bool() const {
+                return m_handle != VK_NULL_HANDLE;
+            }
+
+            // Give up ownership without destroying the object.
+            Handle release() {
+                return std::exchange(m_handle, Handle { VK_NULL_HANDLE });
+            }
+
+            void reset() {
+                if (m_handle == VK_NULL_HANDLE) {
+                    return;
+                }
+
+                if constexpr (std::is_same_v<Parent, NoParent>) {
+                    (*Destroy)(m_handle, m_allocator);
+                } else {
+                    (*Destroy)(m_parent, m_handle, m_allocator);
+                }
+
+                m_handle = VK_NULL_HANDLE;
+            }
+        private:
+            [[no_unique_address]] Parent m_parent {};
+            Handle m_handle = VK_NULL_HANDLE;
+            const VkAllocationCallbacks* m_allocator = nullptr;
+    };
+
+    using Instance = UniqueHandle<VkInstance, NoParent, &vkDestroyInstance>;
+    using DebugMessenger = UniqueHandle<VkDebugUtilsMessengerEXT, VkInstance, &vkDestroyDebugUtilsMessengerEXT>;
+    using Surface = UniqueHandle<VkSurfaceKHR, VkInstance, &vkDestroySurfaceKHR>;
+    using Device = UniqueHandle<VkDevice, NoParent, &vkDestroyDevice>;
+    using SwapChain = UniqueHandle<VkSwapchainKHR, VkDevice, &vkDestroySwapchainKHR>;
+    using Buffer = UniqueHandle<VkBuffer, VkDevice, &vkDestroyBuffer>;
+    using Image = UniqueHandle<VkImage, VkDevice, &vkDestroyImage>;
+    using ImageView = UniqueHandle<VkImageView, VkDevice, &vkDestroyImageView>;
+    using Semaphore = UniqueHandle<VkSemaphore, VkDevice, &vkDestroySemaphore>;
+    using Fence = UniqueHandle<VkFence, VkDevice, &vkDestroyFence>;
+    using CommandPool = UniqueHandle<VkCommandPool, VkDevice, &vkDestroyCommandPool>;
+    using DescriptorPool = UniqueHandle<VkDescriptorPool, VkDevice, &vkDestroyDescriptorPool>;
+    using Sampler = UniqueHandle<VkSampler, VkDevice, &vkDestroySampler>;
+    using Pipeline = UniqueHandle<VkPipeline, VkDevice, &vkDestroyPipeline>;
+    using Shader = UniqueHandle<VkShaderEXT, VkDevice, &vkDestroyShaderEXT>;
+    using IndirectExecutionSet = UniqueHandle<VkIndirectExecutionSetEXT, VkDevice, &vkDestroyIndirectExecutionSetEXT>;
+    using QueryPool = UniqueHandle<VkQueryPool, VkDevice, &vkDestroyQueryPool>;
+    using AccelerationStructure = UniqueHandle<VkAccelerationStructureKHR, VkDevice, &vkDestroyAccelerationStructureKHR>;
+
+    // The raw handles, for APIs that take arrays of them.
+    template <typename Handle, typename Parent, auto* Destroy>
+    std::vector<Handle> raw(const std::vector<UniqueHandle<Handle, Parent, Destroy>>& handles) {
+        auto rawHandles = std::vector<Handle> {};
+        rawHandles.reserve(handles.size());
+        for (const auto& handle : handles) {
+            rawHandles.push_back(handle.get());
+        }
+
+        return rawHandles;
+    }
+
+    // Keeps retired objects alive until the GPU can no longer be using them, so that replacing
+    // them never needs a `vkDeviceWaitIdle`. Anything movable can be retired, most usefully
+    // handles or structures of handles, and destroying it destroys the objects it owns.
+    //
+    // Objects are retired against a value of a monotonic counter, like a frame number or a
+    // timeline semaphore value, and destroyed by the first `collect` that reports the counter
+    // has reached it.
+    class DeferredDestructionQueue {
+        public:
+            explicit DeferredDestructionQueue() = default;
+
+            DeferredDestructionQueue(const DeferredDestructionQueue& other) = delete;
+            DeferredDestructionQueue& operator=(const DeferredDestructionQueue& other) = delete;
+
+            template <typename T>
+            void retire(uint64_t retireValue, T&& object) {
+                m_entries.push_back(Entry {
+                    .retireValue = retireValue,
+                    .object = std::make_unique<RetiredValue<std::decay_t<T>>>(std::forward<T>(object)),
+                });
+            }
+
+            // Destroy every object retired against a value up to `completedValue`.
+            void collect(uint64_t completedValue) {
+                std::erase_if(m_entries, [completedValue](const Entry& entry) {
+                    return entry.retireValue <= completedValue;
+                });
+            }
+
+            // Destroy everything, once the device is idle.
+            void flush() {
+                m_entries.clear();
+            }
+
+            size_t size() const {
+                return m_entries.size();
+            }
+        private:
+            struct RetiredObject {
+                virtual ~RetiredObject() = default;
+            };
+
+            template <typename T>
+            struct RetiredValue final : RetiredObject {
+                explicit RetiredValue(T&& value) : value { std::move(value) } {}
+                explicit RetiredValue(const T& value) : value { value } {}
+
+                T value;
+            };
+
+            struct Entry {
+                uint64_t retireValue;
+                std::unique_ptr<RetiredObject> object;
+            };
+
+            std::vector<Entry> m_entries;
+    };
+
+    // Addresses an object in a `Pool<T>` in 32 bits: the index of its slot and the generation
+    // the slot had when the object was created, so a handle to an object that was destroyed
+    // no longer resolves, even once its slot holds another. The default handle is null, since
+    // generations start at 1.
+    template <typename T>
+    struct PoolHandle {
+        static constexpr uint32_t INDEX_BITS = 20;
+        static constexpr uint32_t GENERATION_BITS = 32 - INDEX_BITS;
+        static constexpr uint32_t MAX_INDEX = (1u << INDEX_BITS) - 1;
+        static constexpr uint32_t GENERATION_MASK = (1u << GENERATION_BITS) - 1;
+
+        uint32_t bits = 0;
+
+        uint32_t index() const {
+            return bits & MAX_INDEX;
+        }
+
+        uint32_t generation() const {
+            return bits >> INDEX_BITS;
+        }
+
+        bool isNull() const {
+            return bits == 0;
+        }
+
+        friend bool operator==(PoolHandle lhs, PoolHandle rhs) = default;
+    };
+
+    // Owns objects of one type in a dense array, which hot loops walk without chasing pointers,
+    // and hands out `PoolHandle`s to them. A slot table maps a handle to the object's place in
+    // the array, which changes when another object is destroyed, so only handles are held on to,
+    // never pointers or references.
+    //
+    // Objects the GPU may still be using are destroyed with `retire`, which moves them into a
+    // `DeferredDestructionQueue`.
+    template <typename T>
+    class Pool {
+        public:
+            using Handle = PoolHandle<T>;
+
+            explicit Pool() = default;
+
+            Pool(const Pool& other) = delete;
+            Pool& operator=(const Pool& other) = delete;
+
+            Handle create(T&& value) {
+                auto slotIndex = uint32_t { 0 };
+                if (!m_freeSlots.empty()) {
+                    slotIndex = m_freeSlots.back();
+                    m_freeSlots.pop_back();
+                } else {
+                    if (m_slots.size() > Handle::MAX_INDEX) {
+                        throw std::runtime_error("failed to create a pooled object, out of handles!");
+                    }
+
+                    slotIndex = static_cast<uint32_t>(m_slots.size());
+                    m_slots.push_back(Slot {});
+                }
+
+                auto& slot = m_slots[slotIndex];
+                slot.denseIndex = static_cast<uint32_t>(m_values.size());
+                m_values.push_back(std::move(value));
+                m_denseSlots.push_back(slotIndex);
+
+                return Handle { .bits = (slot.generation << Handle::INDEX_BITS) | slotIndex };
+            }
+
+            bool contains(Handle handle) const {
+                return handle.index() < m_slots.size()
+                    && m_slots[handle.index()].generation == handle.generation()
+                    && m_slots[handle.index()].denseIndex != INVALID_INDEX;
+            }
+
+            // Null for a stale or null handle.
+            T* get(Handle handle) {
+                return this->contains(handle) ? &m_values[m_slots[handle.index()].denseIndex] : nullptr;
+            }
+
+            const T* get(Handle handle) const {
+                return this->contains(handle) ? &m_values[m_slots[handle.index()].denseIndex] : nullptr;
+            }
+
+            // Moves the object out, and frees its slot for the next generation. The last
+            // object takes its place in the array.
+            T take(Handle handle) {
+                if (!this->contains(handle)) {
+                    throw std::runtime_error("failed to take a pooled object, stale handle!");
+                }
+
+                auto& slot = m_slots[handle.index()];
+                const auto denseIndex = slot.denseIndex;
+                auto value = std::move(m_values[denseIndex]);
+                if (denseIndex + 1 != m_values.size()) {
+                    m_values[denseIndex] = std::move(m_values.back());
+                    m_denseSlots[denseIndex] = m_denseSlots.back();
+                    m_slots[m_denseSlots[denseIndex]].denseIndex = denseIndex;
+                }
+
+                m_values.pop_back();
+                m_denseSlots.pop_back();
+                slot.denseIndex = INVALID_INDEX;
+                slot.generation = slot.generation == Handle::GENERATION_MASK ? 1 : slot.generation + 1;
+                m_freeSlots.push_back(handle.index());
+
+                return value;
+            }
+
+            void destroy(Handle handle) {
+                static_cast<void>(this->take(handle));
+            }
+
+            // Destroys the object once `retireValue` is collected from `queue`, and makes its
+            // handle stale right away.
+            void retire(Handle handle, DeferredDestructionQueue& queue, uint64_t retireValue) {
+                queue.retire(retireValue, this->take(handle));
+            }
+
+            std::span<T> values() {
+                return m_values;
+            }
+
+            std::span<const T> values() const {
+                return m_values;
+            }
+
+            size_t size() const {
+                return m_values.size();
+            }
+
+            // Destroys every object, and makes every handle stale.
+            void clear() {
+                while (!m_values.empty()) {
+                    const auto slotIndex = m_denseSlots.back();
+                    this->destroy(Handle { .bits = (m_slots[slotIndex].generation << Handle::INDEX_BITS) | slotIndex });
+                }
+            }
+        private:
+            static constexpr uint32_t INVALID_INDEX = UINT32_MAX;
+
+            struct Slot {
+                uint32_t denseIndex = INVALID_INDEX;
+                uint32_t generation = 1;
+            };
+
+            std::vector<T> m_values;
+            // The slot of every object in `m_values`, to fix up when one is moved.
+            std::vector<uint32_t> m_denseSlots;
+            std::vector<Slot> m_slots;
+            std::vector<uint32_t> m_freeSlots;
+    };
+}
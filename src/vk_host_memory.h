@@ -0,0 +1,458 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <vector>
+
+#include <fmt/core.h>
+#include <fmt/ostream.h>
+
+
+namespace vk_host_memory {
+    // Where host allocations made by the driver come from.
+    //
+    // * `Driver` passes no callbacks, so the driver uses its own allocator.
+    // * `Tracking` serves every allocation from `malloc`, counting it by allocation scope.
+    // * `Arena` also bump allocates instance scope memory from large blocks, which are only
+    //   released with the allocator. Instance scope memory lives as long as the instance, so
+    //   this keeps it out of the general heap.
+    enum class HostAllocatorMode {
+        Driver,
+        Tracking,
+        Arena,
+    };
+
+    inline constexpr size_t SCOPE_COUNT = 5;
+
+    inline const char* scopeToString(VkSystemAllocationScope scope) {
+        switch (scope) {
+            case VK_SYSTEM_ALLOCATION_SCOPE_COMMAND: return "command";
+            case VK_SYSTEM_ALLOCATION_SCOPE_OBJECT: return "object";
+            case VK_SYSTEM_ALLOCATION_SCOPE_CACHE: return "cache";
+            case VK_SYSTEM_ALLOCATION_SCOPE_DEVICE: return "device";
+            case VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE: return "instance";
+            default: break;
+        }
+
+        return "unknown";
+    }
+
+    struct ScopeStatistics {
+        size_t liveBytes = 0;
+        size_t peakBytes = 0;
+        uint64_t allocationCount = 0;
+        size_t liveInternalBytes = 0;
+        size_t peakInternalBytes = 0;
+    };
+
+    // Implements `VkAllocationCallbacks`, recording the live and peak bytes the driver holds in
+    // each `VkSystemAllocationScope`, including the internal allocations it only reports. The
+    // callbacks may be called from any thread.
+    class HostAllocator {
+        public:
+            static constexpr size_t ARENA_BLOCK_SIZE = 256 * 1024;
+
+            explicit HostAllocator() = default;
+
+            HostAllocator(const HostAllocator& other) = delete;
+            HostAllocator& operator=(const HostAllocator& other) = delete;
+
+            // Objects must be destroyed with the callbacks they were created with, so the mode
+            // cannot change once anything was created.
+            void init(HostAllocatorMode mode) {
+                m_mode = mode;
+                m_callbacks = VkAllocationCallbacks {
+                    .pUserData = this,
+                    .pfnAllocation = &HostAllocator::allocate,
+                    .pfnReallocation = &HostAllocator::reallocate,
+                    .pfnFree = &HostAllocator::free,
+                    .pfnInternalAllocation = &HostAllocator::internalAllocate,
+                    .pfnInternalFree = &HostAllocator::internalFree,
+                };
+            }
+
+            // The callbacks to hand to every create and destroy call, null in `Driver` mode.
+            const VkAllocationCallbacks* callbacks() const {
+                if (m_mode == HostAllocatorMode::Driver) {
+                    return nullptr;
+                }
+
+                return &m_callbacks;
+            }
+
+            ScopeStatistics statistics(VkSystemAllocationScope scope) const {
+                const auto& counters = m_scopes[this->scopeIndex(scope)];
+
+                return ScopeStatistics {
+                    .liveBytes = counters.liveBytes.load(std::memory_order_relaxed),
+                    .peakBytes = counters.peakBytes.load(std::memory_order_relaxed),
+                    .allocationCount = counters.allocationCount.load(std::memory_order_relaxed),
+                    .liveInternalBytes = counters.liveInternalBytes.load(std::memory_order_relaxed),
+                    .peakInternalBytes = counters.peakInternalBytes.load(std::memory_order_relaxed),
+                };
+            }
+
+            void report(std::ostream& out) const {
+                if (m_mode == HostAllocatorMode::Driver) {
+                    return;
+                }
+
+                fmt::println(out, "{:<10} {:>14} {:>14} {:>12} {:>16} {:>16}", "Scope", "Live (bytes)", "Peak (bytes)", "Allocations", "Internal live", "Internal peak");
+                for (uint32_t i = 0; i < SCOPE_COUNT; i++) {
+                    const auto scope = static_cast<VkSystemAllocationScope>(i);
+                    const auto statistics = this->statistics(scope);
+                    fmt::println(
+                        out,
+                        "{:<10} {:>14} {:>14} {:>12} {:>16} {:>16}",
+                        scopeToString(scope),
+                        statistics.liveBytes,
+                        statistics.peakBytes,
+                        statistics.allocationCount,
+                        statistics.liveInternalBytes,
+                        statistics.peakInternalBytes
+                    );
+                }
+
+                if (m_mode == HostAllocatorMode::Arena) {
+                    const auto lock = std::scoped_lock { m_arenaMutex };
+                    fmt::println(out, "Instance arena: {} blocks, {} bytes reserved", m_arenaBlocks.size(), m_arenaReservedBytes);
+                }
+            }
+        private:
+            // Stored right before every allocation handed out. `HEADER_SIZE` keeps the header
+            // itself aligned, since the user pointer is aligned to at least `max_align_t`.
+            struct Header {
+                size_t size;
+                size_t offset;
+                uint32_t scope;
+                bool fromArena;
+            };
+
+            static constexpr size_t MIN_ALIGNMENT = alignof(std::max_align_t);
+            static constexpr size_t HEADER_SIZE = (sizeof(Header) + MIN_ALIGNMENT - 1) & ~(MIN_ALIGNMENT - 1);
+
+            struct ScopeCounters {
+                std::atomic<size_t> liveBytes = 0;
+                std::atomic<size_t> peakBytes = 0;
+                std::atomic<uint64_t> allocationCount = 0;
+                std::atomic<size_t> liveInternalBytes = 0;
+                std::atomic<size_t> peakInternalBytes = 0;
+            };
+
+            struct ArenaBlock {
+                std::unique_ptr<std::byte[]> data;
+                size_t size;
+                size_t used;
+            };
+
+            HostAllocatorMode m_mode = HostAllocatorMode::Driver;
+            VkAllocationCallbacks m_callbacks {};
+            std::array<ScopeCounters, SCOPE_COUNT> m_scopes;
+
+            mutable std::mutex m_arenaMutex;
+            std::vector<ArenaBlock> m_arenaBlocks;
+            size_t m_arenaReservedBytes = 0;
+
+            size_t scopeIndex(VkSystemAllocationScope scope) const {
+                return std::min(static_cast<size_t>(scope), SCOPE_COUNT - 1);
+            }
+
+            static void raisePeak(std::atomic<size_t>& peak, size_t value) {
+                auto current = peak.load(std::memory_order_relaxed);
+                while (current < value && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+                }
+            }
+
+            static Header* headerOf(void* memory) {
+                return reinterpret_cast<Header*>(static_cast<std::byte*>(memory) - HEADER_SIZE);
+            }
+
+            static size_t paddedSize(size_t size, size_t alignment) {
+                return size + HEADER_SIZE + alignment - 1;
+            }
+
+            static std::byte* alignUp(std::byte* base, size_t alignment) {
+                const auto address = reinterpret_cast<uintptr_t>(base + HEADER_SIZE);
+                const auto aligned = (address + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+
+                return reinterpret_cast<std::byte*>(aligned);
+            }
+
+            // The caller holds `m_arenaMutex`.
+            std::byte* arenaAllocate(size_t size) {
+                if (m_arenaBlocks.empty() || m_arenaBlocks.back().size - m_arenaBlocks.back().used < size) {
+                    const auto blockSize = std::max(size, ARENA_BLOCK_SIZE);
+                    m_arenaBlocks.push_back(ArenaBlock {
+                        .data = std::make_unique<std::byte[]>(blockSize),
+                        .size = blockSize,
+                        .used = 0,
+                    });
+                    m_arenaReservedBytes += blockSize;
+                }
+
+                auto& block = m_arenaBlocks.back();
+                auto* memory = block.data.get() + block.used;
+                block.used += size;
+
+                return memory;
+            }
+
+            void* allocateTracked(size_t size, size_t alignment, VkSystemAllocationScope scope) {
+                alignment = std::max(alignment, MIN_ALIGNMENT);
+                const auto padded = paddedSize(size, alignment);
+                const auto fromArena = m_mode == HostAllocatorMode::Arena && scope == VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE;
+
+                std::byte* base = nullptr;
+                if (fromArena) {
+                    const auto lock = std::scoped_lock { m_arenaMutex };
+                    base = this->arenaAllocate(padded);
+                } else {
+                    base = static_cast<std::byte*>(std::malloc(padded));
+                }
+
+                if (base == nullptr) {
+                    return nullptr;
+                }
+
+                auto* memory = alignUp(base, alignment);
+                *headerOf(memory) = Header {
+                    .size = size,
+                    .offset = static_cast<size_t>(memory - base),
+                    .scope = static_cast<uint32_t>(this->scopeIndex(scope)),
+                    .fromArena = fromArena,
+                };
+
+                auto& counters = m_scopes[this->scopeIndex(scope)];
+                const auto live = counters.liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+                raisePeak(counters.peakBytes, live);
+                counters.allocationCount.fetch_add(1, std::memory_order_relaxed);
+
+                return memory;
+            }
+
+            void freeTracked(void* memory) {
+                if (memory == nullptr) {
+                    return;
+                }
+
+                const auto header = *headerOf(memory);
+                m_scopes[header.scope].liveBytes.fetch_sub(header.size, std::memory_order_relaxed);
+
+                // Arena memory is reclaimed with the whole arena.
+                if (!header.fromArena) {
+                    std::free(static_cast<std::byte*>(memory) - header.offset);
+                }
+            }
+
+            static VKAPI_ATTR void* VKAPI_CALL allocate(
+                void* pUserData,
+                size_t size,
+                size_t alignment,
+                VkSystemAllocationScope allocationScope
+            ) {
+                auto allocator = static_cast<HostAllocator*>(pUserData);
+
+                return allocator->allocateTracked(size, alignment, allocationScope);
+            }
+
+            static VKAPI_ATTR void* VKAPI_CALL reallocate(
+                void* pUserData,
+                void* pOriginal,
+                size_t size,
+                size_t alignment,
+                VkSystemAllocationScope allocationScope
+            ) {
+                auto allocator = static_cast<HostAllocator*>(pUserData);
+                if (pOriginal == nullptr) {
+                    return allocator->allocateTracked(size, alignment, allocationScope);
+                }
+
+                if (size == 0) {
+                    allocator->freeTracked(pOriginal);
+
+                    return nullptr;
+                }
+
+                auto* memory = allocator->allocateTracked(size, alignment, allocationScope);
+                if (memory == nullptr) {
+                    return nullptr;
+                }
+
+                std::memcpy(memory, pOriginal, std::min(size, headerOf(pOriginal)->size));
+                allocator->freeTracked(pOriginal);
+
+                return memory;
+            }
+
+            static VKAPI_ATTR void VKAPI_CALL free(void* pUserData, void* pMemory) {
+                auto allocator = static_cast<HostAllocator*>(pUserData);
+                allocator->freeTracked(pMemory);
+            }
+
+            static VKAPI_ATTR void VKAPI_CALL internalAllocate(
+                void* pUserData,
+                size_t size,
+                VkInternalAllocationType allocationType,
+                VkSystemAllocationScope allocationScope
+            ) {
+                auto allocator = static_cast<HostAllocator*>(pUserData);
+                auto& counters = allocator->m_scopes[allocator->scopeIndex(allocationScope)];
+                const auto live = counters.liveInternalBytes.fetch_add(size, std::memory_order_relaxed) + size;
+                raisePeak(counters.peakInternalBytes, live);
+            }
+
+            static VKAPI_ATTR void VKAPI_CALL internalFree(
+                void* pUserData,
+                size_t size,
+                VkInternalAllocationType allocationType,
+                VkSystemAllocationScope allocationScope
+            ) {
+                auto allocator = static_cast<HostAllocator*>(pUserData);
+                auto& counters = allocator->m_scopes[allocator->scopeIndex(allocationScope)];
+                counters.liveInternalBytes.fetch_sub(size, std::memory_order_relaxed);
+            }
+    };
+
+    // Bump allocates transient data, like the arrays a frame fills in for Vulkan calls, and
+    // `std::pmr` containers through its `memory_resource` interface. Deallocating does nothing:
+    // everything is freed at once when the arena is reset, at the start of every frame, or
+    // rewound by an `ArenaScope`. Memory comes in blocks, and a reset that finds more than one
+    // block used since the last replaces them all with one as large, so once the arena has
+    // seen its largest frame, frames make no heap allocations at all. Not thread safe, an
+    // arena belongs to one thread at a time.
+    class ScratchArena final : public std::pmr::memory_resource {
+        public:
+            static constexpr size_t DEFAULT_BLOCK_SIZE = 64 * 1024;
+
+            struct Marker {
+                size_t block = 0;
+                size_t offset = 0;
+            };
+
+            explicit ScratchArena(size_t blockSize = DEFAULT_BLOCK_SIZE)
+                : m_blockSize { blockSize }
+            {
+            }
+
+            ScratchArena(const ScratchArena& other) = delete;
+            ScratchArena& operator=(const ScratchArena& other) = delete;
+
+            Marker mark() const {
+                return Marker { .block = m_block, .offset = m_offset };
+            }
+
+            // Frees everything allocated since `marker` was taken.
+            void rewind(Marker marker) {
+                m_block = marker.block;
+                m_offset = marker.offset;
+            }
+
+            void reset() {
+                if (m_lastUsedBlock > 0) {
+                    auto capacity = size_t { 0 };
+                    for (const auto& block : m_blocks) {
+                        capacity += block.size;
+                    }
+
+                    m_blocks.clear();
+                    this->addBlock(capacity);
+                }
+
+                m_block = 0;
+                m_offset = 0;
+                m_lastUsedBlock = 0;
+            }
+
+            // How many blocks the arena allocated from the heap, which stops growing once it
+            // is large enough for every frame.
+            uint64_t blockAllocationCount() const {
+                return m_blockAllocationCount;
+            }
+
+            size_t capacity() const {
+                auto capacity = size_t { 0 };
+                for (const auto& block : m_blocks) {
+                    capacity += block.size;
+                }
+
+                return capacity;
+            }
+        private:
+            struct Block {
+                std::unique_ptr<std::byte[]> memory;
+                size_t size;
+            };
+
+            void addBlock(size_t size) {
+                m_blocks.push_back(Block { .memory = std::make_unique_for_overwrite<std::byte[]>(size), .size = size });
+                m_blockAllocationCount++;
+            }
+
+            void* do_allocate(size_t bytes, size_t alignment) override {
+                while (true) {
+                    if (m_block == m_blocks.size()) {
+                        this->addBlock(std::max(m_blockSize, bytes + alignment));
+                    }
+
+                    auto& block = m_blocks[m_block];
+                    const auto base = reinterpret_cast<uintptr_t>(block.memory.get());
+                    const auto aligned = (base + m_offset + alignment - 1) / alignment * alignment;
+                    if (aligned + bytes <= base + block.size) {
+                        m_offset = aligned + bytes - base;
+                        m_lastUsedBlock = std::max(m_lastUsedBlock, m_block);
+
+                        return reinterpret_cast<void*>(aligned);
+                    }
+
+                    m_block++;
+                    m_offset = 0;
+                }
+            }
+
+            void do_deallocate(void*, size_t, size_t) override {
+            }
+
+            bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+                return this == &other;
+            }
+
+            size_t m_blockSize = DEFAULT_BLOCK_SIZE;
+            std::vector<Block> m_blocks;
+            size_t m_block = 0;
+            size_t m_offset = 0;
+            size_t m_lastUsedBlock = 0;
+            uint64_t m_blockAllocationCount = 0;
+    };
+
+    // Rewinds an arena to where it was when the scope began, so whatever the scope allocated
+    // from it is freed when it ends. Nothing allocated in the scope may outlive it.
+    class ArenaScope {
+        public:
+            explicit ArenaScope(ScratchArena& arena)
+                : m_arena { &arena }
+                , m_marker { arena.mark() }
+            {
+            }
+
+            ArenaScope(const ArenaScope& other) = delete;
+            ArenaScope& operator=(const ArenaScope& other) = delete;
+
+            ~ArenaScope() {
+                m_arena->rewind(m_marker);
+            }
+        private:
+            ScratchArena* m_arena;
+            ScratchArena::Marker m_marker;
+    };
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include "vk_dispatch.h"
+#include "vk_handles.h"
+#include "vk_result.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+
+namespace vk_image_views {
+    // Everything that tells two views of an image apart, for the view create infos without a
+    // `pNext` chain, which are all the renderer makes.
+    struct ImageViewKey {
+        VkImage image = VK_NULL_HANDLE;
+        VkImageViewType viewType = VK_IMAGE_VIEW_TYPE_2D;
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        VkComponentMapping components {};
+        VkImageSubresourceRange subresourceRange {};
+
+        static ImageViewKey of(const VkImageViewCreateInfo& createInfo) {
+            return ImageViewKey {
+                .image = createInfo.image,
+                .viewType = createInfo.viewType,
+                .format = createInfo.format,
+                .components = createInfo.components,
+                .subresourceRange = createInfo.subresourceRange,
+            };
+        }
+
+        bool operator==(const ImageViewKey& other) const {
+            return image == other.image
+                && viewType == other.viewType
+                && format == other.format
+                && components.r == other.components.r
+                && components.g == other.components.g
+                && components.b == other.components.b
+                && components.a == other.components.a
+                && subresourceRange.aspectMask == other.subresourceRange.aspectMask
+                && subresourceRange.baseMipLevel == other.subresourceRange.baseMipLevel
+                && subresourceRange.levelCount == other.subresourceRange.levelCount
+                && subresourceRange.baseArrayLayer == other.subresourceRange.baseArrayLayer
+                && subresourceRange.layerCount == other.subresourceRange.layerCount;
+        }
+    };
+
+    struct ImageViewKeyHash {
+        size_t operator()(const ImageViewKey& key) const {
+            auto hash = std::hash<VkImage> {}(key.image);
+            const auto combine = [&hash](uint64_t value) {
+                hash ^= std::hash<uint64_t> {}(value) + 0x9E3779B97F4A7C15ull + (hash << 6) + (hash >> 2);
+            };
+            combine(static_cast<uint64_t>(key.viewType) << 32 | static_cast<uint32_t>(key.format));
+            combine(
+                static_cast<uint64_t>(key.components.r) << 48
+                    | static_cast<uint64_t>(key.components.g) << 32
+                    | static_cast<uint64_t>(key.components.b) << 16
+                    | static_cast<uint64_t>(key.components.a)
+            );
+            combine(static_cast<uint64_t>(key.subresourceRange.aspectMask) << 32 | key.subresourceRange.baseMipLevel);
+            combine(static_cast<uint64_t>(key.subresourceRange.levelCount) << 32 | key.subresourceRange.baseArrayLayer);
+            combine(key.subresourceRange.layerCount);
+
+            return hash;
+        }
+    };
+
+    // Owns the views of the images it is asked about, one per distinct create info, so asking
+    // again for a view already made costs a lookup instead of a `vkCreateImageView`. A view
+    // lives as long as its image: whoever retires an image releases its views with it, and
+    // retires them against the same frame. Only used from the thread drawing frames.
+    class ImageViewCache {
+        public:
+            explicit ImageViewCache() = default;
+
+            ImageViewCache(const ImageViewCache& other) = delete;
+            ImageViewCache& operator=(const ImageViewCache& other) = delete;
+
+            void init(VkDevice device, const VkAllocationCallbacks* allocator) {
+                m_device = device;
+                m_allocator = allocator;
+            }
+
+            vk_result::Result<VkImageView> get(const VkImageViewCreateInfo& createInfo) {
+                if (createInfo.pNext != nullptr) {
+                    throw std::runtime_error("failed to cache an image view with a create info chain!");
+                }
+
+                const auto key = ImageViewKey::of(createInfo);
+                if (const auto existing = m_views.find(key); existing != m_views.end()) {
+                    m_hitCount++;
+
+                    return existing->second.get();
+                }
+
+                auto imageView = VkImageView {};
+                const auto result = vkCreateImageView(m_device, &createInfo, m_allocator, &imageView);
+                VK_RESULT_TRY(vk_result::check(result, "failed to create image view"));
+
+                m_createdCount++;
+                m_views.emplace(key, vk_handles::ImageView { m_device, imageView, m_allocator });
+
+                return imageView;
+            }
+
+            // The views of every image in `images` made from the same create info, like the
+            // views of a swapchain, which are all made at once.
+            vk_result::Status get(std::span<const VkImage> images, VkImageViewCreateInfo createInfo, std::vector<VkImageView>& imageViews) {
+                imageViews.clear();
+                imageViews.reserve(images.size());
+                for (const auto image : images) {
+                    createInfo.image = image;
+                    auto imageView = this->get(createInfo);
+                    VK_RESULT_TRY(imageView);
+                    imageViews.push_back(imageView.value());
+                }
+
+                return vk_result::Status {};
+            }
+
+            // Hands the views of `image` over to the caller, who destroys them with the image.
+            void release(VkImage image, std::vector<vk_handles::ImageView>& imageViews) {
+                for (auto it = m_views.begin(); it != m_views.end();) {
+                    if (it->first.image == image) {
+                        imageViews.push_back(std::move(it->second));
+                        it = m_views.erase(it);
+                    } else {
+                        ++it;
+                    }
+                }
+            }
+
+            size_t size() const {
+                return m_views.size();
+            }
+
+            uint64_t hitCount() const {
+                return m_hitCount;
+            }
+
+            uint64_t createdCount() const {
+                return m_createdCount;
+            }
+
+            // Destroys every view, once the device is idle.
+            void clear() {
+                m_views.clear();
+            }
+        private:
+            VkDevice m_device = VK_NULL_HANDLE;
+            const VkAllocationCallbacks* m_allocator = nullptr;
+            std::unordered_map<ImageViewKey, vk_handles::ImageView, ImageViewKeyHash> m_views;
+            uint64_t m_hitCount = 0;
+            uint64_t m_createdCount = 0;
+    };
+}
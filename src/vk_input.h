@@ -0,0 +1,104 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+
+namespace vk_input {
+    enum class InputEventType : uint32_t {
+        Key,
+        CursorPosition,
+        MouseButton,
+        Scroll,
+    };
+
+    // One GLFW input callback, with the arguments the callback received and when it ran. Keys
+    // and mouse buttons use `code`, `scancode`, `action` and `mods`, the cursor position and
+    // scroll offsets use `x` and `y`. Mouse buttons use `x` and `y` too, for where the cursor
+    // was as a fraction of the window's size.
+    struct InputEvent {
+        std::chrono::steady_clock::time_point timestamp;
+        InputEventType type;
+        uint32_t windowIndex;
+        int32_t code;
+        int32_t scancode;
+        int32_t action;
+        int32_t mods;
+        double x;
+        double y;
+    };
+
+    // A bounded single-producer single-consumer ring buffer. Both sides only ever touch their
+    // own position and read the other's, so pushing and popping are a couple of atomic loads
+    // and one release store, and neither side ever blocks or allocates. The positions sit on
+    // their own cache lines so that the two threads do not contend for one.
+    template <typename T, size_t Capacity>
+    class SpscQueue {
+        public:
+            static_assert((Capacity & (Capacity - 1)) == 0, "the capacity must be a power of two");
+
+            explicit SpscQueue() = default;
+
+            SpscQueue(const SpscQueue& other) = delete;
+            SpscQueue& operator=(const SpscQueue& other) = delete;
+
+            // Producer side. Returns false and drops `value` when the queue is full.
+            bool push(const T& value) {
+                const auto tail = m_tail.load(std::memory_order_relaxed);
+                if (tail - m_head.load(std::memory_order_acquire) == Capacity) {
+                    return false;
+                }
+
+                m_slots[tail % Capacity] = value;
+                m_tail.store(tail + 1, std::memory_order_release);
+
+                return true;
+            }
+
+            // Consumer side.
+            std::optional<T> pop() {
+                const auto head = m_head.load(std::memory_order_relaxed);
+                if (head == m_tail.load(std::memory_order_acquire)) {
+                    return std::nullopt;
+                }
+
+                const auto value = m_slots[head % Capacity];
+                m_head.store(head + 1, std::memory_order_release);
+
+                return value;
+            }
+        private:
+            static constexpr size_t CACHE_LINE_SIZE = 64;
+
+            alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> m_head = 0;
+            alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> m_tail = 0;
+            alignas(CACHE_LINE_SIZE) std::array<T, Capacity> m_slots {};
+    };
+
+    // A window's framebuffer size as last reported by GLFW, written by the thread handling
+    // events and read by the thread rendering, packed so that both halves change together.
+    class FramebufferSize {
+        public:
+            explicit FramebufferSize() = default;
+
+            FramebufferSize(const FramebufferSize& other) = delete;
+            FramebufferSize& operator=(const FramebufferSize& other) = delete;
+
+            void store(int width, int height) {
+                const auto packed = (static_cast<uint64_t>(static_cast<uint32_t>(width)) << 32) | static_cast<uint32_t>(height);
+                m_packed.store(packed, std::memory_order_release);
+            }
+
+            std::array<uint32_t, 2> load() const {
+                const auto packed = m_packed.load(std::memory_order_acquire);
+
+                return { static_cast<uint32_t>(packed >> 32), static_cast<uint32_t>(packed) };
+            }
+        private:
+            std::atomic<uint64_t> m_packed = 0;
+    };
+}
@@ -0,0 +1,458 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "vk_topology.h"
+#include "vk_tracing.h"
+
+
+namespace vk_jobs {
+    class JobSystem;
+
+    // Background jobs, like pipeline compiles, asset decoding and file writes, go to the
+    // background workers only, where the job system has any, so they never hold up a frame's
+    // jobs and can run on slower cores. Everything else is normal, and runs on the workers
+    // latency critical work is placed on.
+    enum class JobPriority {
+        Normal,
+        Background,
+    };
+
+    namespace detail {
+        struct JobState {
+            std::function<void()> task;
+            JobPriority priority = JobPriority::Normal;
+            // One count per unfinished dependency, plus one held by `submit` until every
+            // dependency has been registered, so the job cannot start halfway through.
+            std::atomic<uint32_t> remainingDependencies = 1;
+            std::atomic<bool> finished = false;
+            std::mutex continuationsMutex;
+            std::vector<std::shared_ptr<JobState>> continuations;
+        };
+    }
+
+    class JobHandle {
+        public:
+            explicit JobHandle() = default;
+
+            bool isValid() const {
+                return m_state != nullptr;
+            }
+
+            bool isFinished() const {
+                return m_state == nullptr || m_state->finished.load(std::memory_order_acquire);
+            }
+        private:
+            friend class JobSystem;
+
+            explicit JobHandle(std::shared_ptr<detail::JobState> state)
+                : m_state { std::move(state) }
+            {
+            }
+
+            std::shared_ptr<detail::JobState> m_state;
+    };
+
+    struct WorkerStatistics {
+        uint64_t jobsExecuted = 0;
+        uint64_t jobsStolen = 0;
+        std::chrono::nanoseconds busyTime = {};
+        // Fraction of the time since the job system started spent running jobs.
+        double utilization = 0.0;
+        bool background = false;
+    };
+
+    // A fixed pool of worker threads for engine side tasks like culling, animation, asset
+    // decoding and pipeline compilation.
+    //
+    // Every worker owns a deque. A worker pushes and pops jobs it spawns at the back of its own
+    // deque, which keeps recently spawned, cache warm jobs on the same core, and steals from the
+    // front of another worker's deque when its own runs dry. Jobs submitted from outside the
+    // pool are spread over the deques round robin. A job may depend on other jobs, and only
+    // becomes runnable once all of them have finished.
+    //
+    // The last `backgroundWorkerCount` workers only run background jobs, and steal only from
+    // each other, while the rest never run them. Threads outside the pool help with either.
+    class JobSystem {
+        public:
+            explicit JobSystem() = default;
+
+            JobSystem(const JobSystem& other) = delete;
+            JobSystem& operator=(const JobSystem& other) = delete;
+
+            ~JobSystem() {
+                this->stop();
+            }
+
+            // At least one worker runs normal jobs, however many background workers are asked
+            // for.
+            void start(uint32_t workerCount, uint32_t backgroundWorkerCount = 0) {
+                if (!m_threads.empty()) {
+                    return;
+                }
+
+                workerCount = std::max(workerCount, 1u);
+                m_backgroundWorkerCount = std::min(backgroundWorkerCount, workerCount - 1);
+                m_workers.clear();
+                for (uint32_t i = 0; i < workerCount; i++) {
+                    m_workers.push_back(std::make_unique<Worker>());
+                    m_workers.back()->background = i >= workerCount - m_backgroundWorkerCount;
+                }
+
+                m_startTime = std::chrono::steady_clock::now();
+                m_running.store(true, std::memory_order_release);
+                for (uint32_t i = 0; i < workerCount; i++) {
+                    m_threads.emplace_back([this, i]() { this->workerLoop(i); });
+                }
+            }
+
+            // Finish every job already queued, then join the workers.
+            void stop() {
+                if (m_threads.empty()) {
+                    return;
+                }
+
+                m_running.store(false, std::memory_order_release);
+                m_wakeEpoch.fetch_add(1, std::memory_order_release);
+                m_wakeEpoch.notify_all();
+                for (auto& thread : m_threads) {
+                    thread.join();
+                }
+
+                m_threads.clear();
+            }
+
+            JobHandle submit(std::function<void()> task, std::span<const JobHandle> dependencies = {}, JobPriority priority = JobPriority::Normal) {
+                auto state = std::make_shared<detail::JobState>();
+                state->task = std::move(task);
+                state->priority = priority;
+
+                for (const auto& dependency : dependencies) {
+                    if (!dependency.isValid()) {
+                        continue;
+                    }
+
+                    const auto lock = std::scoped_lock { dependency.m_state->continuationsMutex };
+                    if (!dependency.m_state->finished.load(std::memory_order_acquire)) {
+                        state->remainingDependencies.fetch_add(1, std::memory_order_relaxed);
+                        dependency.m_state->continuations.push_back(state);
+                    }
+                }
+
+                if (state->remainingDependencies.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                    this->enqueue(state);
+                }
+
+                return JobHandle { state };
+            }
+
+            // Wait for `handle` to finish, running queued jobs on the calling thread meanwhile.
+            void wait(const JobHandle& handle) {
+                while (!handle.isFinished()) {
+                    auto job = this->findJob(t_workerIndex);
+                    if (job != nullptr) {
+                        this->execute(std::move(job), t_workerIndex);
+                    } else {
+                        std::this_thread::yield();
+                    }
+                }
+            }
+
+            // Run one queued job on the calling thread, for threads with time to spare. Whether
+            // there was one.
+            bool runPendingJob() {
+                auto job = this->findJob(t_workerIndex);
+                if (job == nullptr) {
+                    return false;
+                }
+
+                this->execute(std::move(job), t_workerIndex);
+
+                return true;
+            }
+
+            uint32_t workerCount() const {
+                return static_cast<uint32_t>(m_workers.size());
+            }
+
+            uint32_t backgroundWorkerCount() const {
+                return m_backgroundWorkerCount;
+            }
+
+            // Restricts the normal workers to `latencyCpus` and the background ones to
+            // `backgroundCpus`, either of which may be empty to leave them where they are.
+            // Returns how many workers were moved.
+            uint32_t pinWorkers(std::span<const uint32_t> latencyCpus, std::span<const uint32_t> backgroundCpus) {
+                uint32_t pinned = 0;
+                for (size_t i = 0; i < m_threads.size(); i++) {
+                    const auto cpus = m_workers[i]->background ? backgroundCpus : latencyCpus;
+                    if (vk_topology::pinThread(m_threads[i].native_handle(), cpus)) {
+                        pinned++;
+                    }
+                }
+
+                return pinned;
+            }
+
+            std::vector<WorkerStatistics> statistics() const {
+                const auto elapsed = std::chrono::steady_clock::now() - m_startTime;
+                auto statistics = std::vector<WorkerStatistics> {};
+                for (const auto& worker : m_workers) {
+                    const auto busyTime = std::chrono::nanoseconds { worker->busyNanoseconds.load(std::memory_order_relaxed) };
+                    statistics.push_back(WorkerStatistics {
+                        .jobsExecuted = worker->jobsExecuted.load(std::memory_order_relaxed),
+                        .jobsStolen = worker->jobsStolen.load(std::memory_order_relaxed),
+                        .busyTime = busyTime,
+                        .utilization = elapsed.count() > 0
+                            ? static_cast<double>(busyTime.count()) / static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count())
+                            : 0.0,
+                        .background = worker->background,
+                    });
+                }
+
+                return statistics;
+            }
+        private:
+            using Job = std::shared_ptr<detail::JobState>;
+
+            static constexpr uint32_t NO_WORKER = UINT32_MAX;
+
+            struct Worker {
+                std::mutex mutex;
+                std::deque<Job> jobs;
+                std::atomic<uint64_t> jobsExecuted = 0;
+                std::atomic<uint64_t> jobsStolen = 0;
+                std::atomic<uint64_t> busyNanoseconds = 0;
+                bool background = false;
+            };
+
+            static inline thread_local uint32_t t_workerIndex = NO_WORKER;
+
+            std::vector<std::unique_ptr<Worker>> m_workers;
+            std::vector<std::thread> m_threads;
+            std::atomic<bool> m_running = false;
+            std::atomic<uint32_t> m_wakeEpoch = 0;
+            std::atomic<uint32_t> m_nextWorker = 0;
+            uint32_t m_backgroundWorkerCount = 0;
+            std::chrono::steady_clock::time_point m_startTime;
+
+            bool runsInBackground(const Job& job) const {
+                return job->priority == JobPriority::Background && m_backgroundWorkerCount > 0;
+            }
+
+            // The first worker of a kind and how many there are, normal ones first.
+            std::pair<uint32_t, uint32_t> workerRange(bool background) const {
+                const auto normalWorkerCount = static_cast<uint32_t>(m_workers.size()) - m_backgroundWorkerCount;
+
+                return background
+                    ? std::pair { normalWorkerCount, m_backgroundWorkerCount }
+                    : std::pair { 0u, normalWorkerCount };
+            }
+
+            // Onto the spawning worker's own deque when it runs jobs of the kind, and otherwise
+            // round robin over the workers that do.
+            void enqueue(Job job) {
+                const auto background = this->runsInBackground(job);
+                const auto [first, count] = this->workerRange(background);
+                const auto workerIndex = t_workerIndex != NO_WORKER && m_workers[t_workerIndex]->background == background
+                    ? t_workerIndex
+                    : first + m_nextWorker.fetch_add(1, std::memory_order_relaxed) % count;
+
+                {
+                    auto& worker = *m_workers[workerIndex];
+                    const auto lock = std::scoped_lock { worker.mutex };
+                    worker.jobs.push_back(std::move(job));
+                }
+
+                // A single wake could go to a worker of the other kind, which would find nothing
+                // and sleep again with the job still queued.
+                m_wakeEpoch.fetch_add(1, std::memory_order_release);
+                if (m_backgroundWorkerCount > 0) {
+                    m_wakeEpoch.notify_all();
+                } else {
+                    m_wakeEpoch.notify_one();
+                }
+            }
+
+            Job findJob(uint32_t workerIndex) {
+                if (workerIndex != NO_WORKER) {
+                    auto& worker = *m_workers[workerIndex];
+                    const auto lock = std::scoped_lock { worker.mutex };
+                    if (!worker.jobs.empty()) {
+                        auto job = std::move(worker.jobs.back());
+                        worker.jobs.pop_back();
+
+                        return job;
+                    }
+                }
+
+                // Workers only steal from their own kind, and other threads from anyone.
+                const auto [first, workerCount] = workerIndex != NO_WORKER
+                    ? this->workerRange(m_workers[workerIndex]->background)
+                    : std::pair { 0u, static_cast<uint32_t>(m_workers.size()) };
+                const auto start = workerIndex != NO_WORKER ? workerIndex + 1 - first : 0;
+                for (uint32_t i = 0; i < workerCount; i++) {
+                    const auto victimIndex = first + (start + i) % workerCount;
+                    if (victimIndex == workerIndex) {
+                        continue;
+                    }
+
+                    auto& victim = *m_workers[victimIndex];
+                    const auto lock = std::scoped_lock { victim.mutex };
+                    if (!victim.jobs.empty()) {
+                        auto job = std::move(victim.jobs.front());
+                        victim.jobs.pop_front();
+                        if (workerIndex != NO_WORKER) {
+                            m_workers[workerIndex]->jobsStolen.fetch_add(1, std::memory_order_relaxed);
+                        }
+
+                        return job;
+                    }
+                }
+
+                return nullptr;
+            }
+
+            void execute(Job job, uint32_t workerIndex) {
+                const auto begin = std::chrono::steady_clock::now();
+                {
+                    VK_TRACING_ZONE("job");
+                    job->task();
+                }
+                const auto end = std::chrono::steady_clock::now();
+
+                if (workerIndex != NO_WORKER) {
+                    auto& worker = *m_workers[workerIndex];
+                    worker.jobsExecuted.fetch_add(1, std::memory_order_relaxed);
+                    worker.busyNanoseconds.fetch_add(
+                        static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count()),
+                        std::memory_order_relaxed
+                    );
+                }
+
+                auto continuations = std::vector<Job> {};
+                {
+                    const auto lock = std::scoped_lock { job->continuationsMutex };
+                    job->finished.store(true, std::memory_order_release);
+                    continuations.swap(job->continuations);
+                }
+
+                for (auto& continuation : continuations) {
+                    if (continuation->remainingDependencies.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                        this->enqueue(std::move(continuation));
+                    }
+                }
+            }
+
+            void workerLoop(uint32_t workerIndex) {
+                t_workerIndex = workerIndex;
+                if (m_workers[workerIndex]->background) {
+                    vk_topology::markBackgroundThread();
+                    vk_tracing::setThreadName("background worker " + std::to_string(workerIndex));
+                } else {
+                    vk_tracing::setThreadName("worker " + std::to_string(workerIndex));
+                }
+                while (true) {
+                    // Read the epoch before looking for work, so a job enqueued after the search
+                    // came up empty bumps it and the wait below returns right away.
+                    const auto epoch = m_wakeEpoch.load(std::memory_order_acquire);
+                    auto job = this->findJob(workerIndex);
+                    if (job != nullptr) {
+                        this->execute(std::move(job), workerIndex);
+                        continue;
+                    }
+
+                    if (!m_running.load(std::memory_order_acquire)) {
+                        return;
+                    }
+
+                    m_wakeEpoch.wait(epoch, std::memory_order_acquire);
+                }
+            }
+    };
+
+    // Tasks that run on a job system and are joined together, like independent startup stages.
+    // The first exception a task throws is rethrown by `wait`, and once a task has failed the
+    // tasks that have not started yet are skipped, since they usually depend on its results.
+    class TaskGroup {
+        public:
+            explicit TaskGroup(JobSystem& jobSystem)
+                : m_jobSystem { &jobSystem }
+            {
+            }
+
+            TaskGroup(const TaskGroup& other) = delete;
+            TaskGroup& operator=(const TaskGroup& other) = delete;
+
+            // A task captures its state by reference, so every task has to finish before the
+            // group goes out of scope, even while an exception unwinds past it.
+            ~TaskGroup() {
+                for (const auto& handle : m_handles) {
+                    m_jobSystem->wait(handle);
+                }
+            }
+
+            JobHandle run(std::function<void()> task, std::span<const JobHandle> dependencies = {}) {
+                auto handle = m_jobSystem->submit(
+                    [this, task = std::move(task)]() {
+                        if (m_failed.load(std::memory_order_acquire)) {
+                            return;
+                        }
+
+                        try {
+                            task();
+                        } catch (...) {
+                            const auto lock = std::scoped_lock { m_exceptionMutex };
+                            if (m_exception == nullptr) {
+                                m_exception = std::current_exception();
+                            }
+
+                            m_failed.store(true, std::memory_order_release);
+                        }
+                    },
+                    dependencies
+                );
+                m_handles.push_back(handle);
+
+                return handle;
+            }
+
+            // Wait for every task, running queued jobs on the calling thread meanwhile.
+            void wait() {
+                for (const auto& handle : m_handles) {
+                    m_jobSystem->wait(handle);
+                }
+
+                m_handles.clear();
+
+                auto exception = std::exception_ptr {};
+                {
+                    const auto lock = std::scoped_lock { m_exceptionMutex };
+                    exception = std::exchange(m_exception, nullptr);
+                }
+
+                if (exception != nullptr) {
+                    std::rethrow_exception(exception);
+                }
+            }
+        private:
+            JobSystem* m_jobSystem;
+            std::vector<JobHandle> m_handles;
+            std::atomic<bool> m_failed = false;
+            std::mutex m_exceptionMutex;
+            std::exception_ptr m_exception;
+    };
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+
+namespace vk_lights {
+    // Match `clusters.glsl`. The grid tiles the render area in x and y and slices the view
+    // depth exponentially, whatever the size of the window, so its buffers never resize.
+    constexpr uint32_t CLUSTER_GRID_X = 16;
+    constexpr uint32_t CLUSTER_GRID_Y = 9;
+    constexpr uint32_t CLUSTER_GRID_Z = 24;
+    constexpr uint32_t CLUSTER_COUNT = CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z;
+    constexpr uint32_t MAX_LIGHTS_PER_CLUSTER = 128;
+
+    // The light counts of the clusters, then their light lists.
+    constexpr VkDeviceSize CLUSTER_BUFFER_SIZE = VkDeviceSize { CLUSTER_COUNT } * (1 + MAX_LIGHTS_PER_CLUSTER) * sizeof(uint32_t);
+
+    // The specialization constant id of `local_size_x` in `light_cull.comp`.
+    constexpr uint32_t LIGHT_CULL_WORKGROUP_SIZE_ID = 0;
+
+    // A point light, which falls off to nothing at its radius, so it is bounded by a sphere.
+    struct Light {
+        glm::vec4 positionRadius;
+        glm::vec4 color;
+    };
+
+    static_assert(sizeof(Light) == 32, "Light must match the std430 layout of `clusters.glsl`");
+
+    // `count` lights scattered through a box of `fieldSize` around the origin, each reaching a
+    // few of the scene's cubes, in saturated colors.
+    inline std::vector<Light> generateLights(uint32_t count, float fieldSize, float spacing) {
+        auto random = std::mt19937 { 2 };
+        auto position = std::uniform_real_distribution<float> { -0.5f * fieldSize, 0.5f * fieldSize };
+        auto radius = std::uniform_real_distribution<float> { 1.5f * spacing, 3.0f * spacing };
+        auto hue = std::uniform_real_distribution<float> { 0.0f, 6.0f };
+
+        auto lights = std::vector<Light> {};
+        lights.reserve(count);
+        for (uint32_t i = 0; i < count; i++) {
+            const auto h = hue(random);
+            const auto color = glm::clamp(
+                glm::vec3 { std::abs(h - 3.0f) - 1.0f, 2.0f - std::abs(h - 2.0f), 2.0f - std::abs(h - 4.0f) },
+                glm::vec3 { 0.0f },
+                glm::vec3 { 1.0f }
+            );
+            lights.push_back(Light {
+                .positionRadius = glm::vec4 { position(random), position(random), position(random), radius(random) },
+                .color = glm::vec4 { color * 1.5f, 0.0f },
+            });
+        }
+
+        return lights;
+    }
+
+    // The `clusters` of the scene uniforms: the clusters per pixel of `renderExtent`, and the
+    // scale and bias that map the log of the view depth to the slices between `nearPlane` and
+    // `farPlane`.
+    inline glm::vec4 clusterScale(VkExtent2D renderExtent, float nearPlane, float farPlane) {
+        const auto sliceScale = static_cast<float>(CLUSTER_GRID_Z) / std::log(farPlane / nearPlane);
+
+        return glm::vec4 {
+            static_cast<float>(CLUSTER_GRID_X) / static_cast<float>(std::max(renderExtent.width, 1u)),
+            static_cast<float>(CLUSTER_GRID_Y) / static_cast<float>(std::max(renderExtent.height, 1u)),
+            sliceScale,
+            -sliceScale * std::log(nearPlane),
+        };
+    }
+}
@@ -0,0 +1,286 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fmt/core.h>
+#include <fmt/compile.h>
+#include <fmt/format.h>
+
+#include "vk_topology.h"
+
+// The least severe level that is compiled in, by its `vk_log::Level`. Set by the build with the
+// `HELLO_WINDOW_LOG_LEVEL` option; every message below it compiles to nothing.
+#ifndef HELLO_WINDOW_LOG_LEVEL
+#define HELLO_WINDOW_LOG_LEVEL 1
+#endif
+
+// Each takes a string literal format, which is compiled along with the call, and its arguments.
+#define VK_LOG(level, format, ...) \
+    do { \
+        if constexpr (::vk_log::isCompiledIn(level)) { \
+            ::vk_log::logger().log(level, FMT_COMPILE(format) __VA_OPT__(,) __VA_ARGS__); \
+        } \
+    } while (false)
+#define VK_LOG_TRACE(format, ...) VK_LOG(::vk_log::Level::Trace, format __VA_OPT__(,) __VA_ARGS__)
+#define VK_LOG_DEBUG(format, ...) VK_LOG(::vk_log::Level::Debug, format __VA_OPT__(,) __VA_ARGS__)
+#define VK_LOG_INFO(format, ...) VK_LOG(::vk_log::Level::Info, format __VA_OPT__(,) __VA_ARGS__)
+#define VK_LOG_WARNING(format, ...) VK_LOG(::vk_log::Level::Warning, format __VA_OPT__(,) __VA_ARGS__)
+#define VK_LOG_ERROR(format, ...) VK_LOG(::vk_log::Level::Error, format __VA_OPT__(,) __VA_ARGS__)
+
+
+namespace vk_log {
+    enum class Level : uint32_t {
+        Trace,
+        Debug,
+        Info,
+        Warning,
+        Error,
+    };
+
+    inline const char* levelToString(Level level) {
+        switch (level) {
+            case Level::Trace: return "trace";
+            case Level::Debug: return "debug";
+            case Level::Info: return "info";
+            case Level::Warning: return "warning";
+            case Level::Error: return "error";
+        }
+
+        return "info";
+    }
+
+    constexpr bool isCompiledIn(Level level) {
+        return static_cast<uint32_t>(level) >= HELLO_WINDOW_LOG_LEVEL;
+    }
+
+    // Text writes each message as it is, warnings and errors to stderr and the rest to stdout.
+    // JSON writes one object per line with the time since the logger started, the level, the
+    // thread and the message, to the same streams.
+    enum class Format : uint32_t {
+        Text,
+        Json,
+    };
+
+    // Messages are formatted on the calling thread, straight into that thread's own ring of
+    // fixed size records, so logging takes no lock, allocates nothing after a thread's first
+    // message, and makes no system call. A writer thread wakes every `FLUSH_INTERVAL`, merges
+    // what every thread logged since by time, and writes each stream with a single call.
+    // A thread that logs faster than that drops the traces, debug and info messages that do
+    // not fit, and the writer reports how many. Warnings and errors are never dropped: a full
+    // ring is flushed on the logging thread itself to make room for them. Messages longer
+    // than `MAX_MESSAGE_LENGTH` are cut short.
+    class Logger {
+        public:
+            static constexpr size_t RING_CAPACITY = 256;
+            static constexpr size_t MAX_MESSAGE_LENGTH = 256;
+            static constexpr std::chrono::milliseconds FLUSH_INTERVAL { 10 };
+
+            explicit Logger()
+                : m_start { std::chrono::steady_clock::now() }
+            {
+                m_running.store(true, std::memory_order_release);
+                m_writer = std::thread { [this]() { this->writerLoop(); } };
+            }
+
+            Logger(const Logger& other) = delete;
+            Logger& operator=(const Logger& other) = delete;
+
+            ~Logger() {
+                m_running.store(false, std::memory_order_release);
+                m_writer.join();
+                this->flush();
+            }
+
+            // Moves the writer to `cpus`, where it keeps out of the way of latency critical
+            // threads.
+            bool pinWriter(std::span<const uint32_t> cpus) {
+                return vk_topology::pinThread(m_writer.native_handle(), cpus);
+            }
+
+            void setFormat(Format format) {
+                m_format.store(format, std::memory_order_relaxed);
+            }
+
+            template<typename CompiledFormat, typename... Args>
+            void log(Level level, const CompiledFormat& format, const Args&... args) {
+                auto& ring = this->threadRing();
+                const auto head = ring.head.load(std::memory_order_relaxed);
+                if (head - ring.tail.load(std::memory_order_acquire) == RING_CAPACITY) {
+                    if (level < Level::Warning) {
+                        ring.dropped.fetch_add(1, std::memory_order_relaxed);
+                        m_droppedCount.fetch_add(1, std::memory_order_relaxed);
+                        return;
+                    }
+
+                    // Hands every record of the ring back, this thread's included.
+                    this->flush();
+                }
+
+                auto& record = ring.records[head % RING_CAPACITY];
+                const auto result = fmt::format_to_n(record.text.data(), record.text.size(), format, args...);
+                record.length = static_cast<uint32_t>(std::min(result.size, record.text.size()));
+                record.level = level;
+                record.nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count();
+                ring.head.store(head + 1, std::memory_order_release);
+            }
+
+            // The messages dropped since the logger started, over every thread.
+            uint64_t droppedCount() const {
+                return m_droppedCount.load(std::memory_order_relaxed);
+            }
+
+            // Writes out everything logged so far, from any thread.
+            void flush() {
+                const auto lock = std::scoped_lock { m_flushMutex };
+                {
+                    const auto ringsLock = std::scoped_lock { m_ringsMutex };
+                    m_flushRings.assign(m_rings.size(), nullptr);
+                    std::transform(m_rings.begin(), m_rings.end(), m_flushRings.begin(), [](const auto& ring) { return ring.get(); });
+                }
+
+                m_pending.clear();
+                for (auto* ring : m_flushRings) {
+                    ring->flushedHead = ring->head.load(std::memory_order_acquire);
+                    for (auto position = ring->tail.load(std::memory_order_relaxed); position < ring->flushedHead; position++) {
+                        m_pending.push_back(Pending { &ring->records[position % RING_CAPACITY], ring->index });
+                    }
+                }
+
+                std::stable_sort(m_pending.begin(), m_pending.end(), [](const Pending& a, const Pending& b) {
+                    return a.record->nanoseconds < b.record->nanoseconds;
+                });
+
+                m_stdout.clear();
+                m_stderr.clear();
+                const auto format = m_format.load(std::memory_order_relaxed);
+                for (const auto& pending : m_pending) {
+                    const auto& record = *pending.record;
+                    auto& out = record.level >= Level::Warning ? m_stderr : m_stdout;
+                    this->write(out, format, record.level, record.nanoseconds, pending.thread, std::string_view { record.text.data(), record.length });
+                }
+
+                // Only now are the records free for their threads to reuse.
+                for (auto* ring : m_flushRings) {
+                    ring->tail.store(ring->flushedHead, std::memory_order_release);
+                    const auto dropped = ring->dropped.exchange(0, std::memory_order_relaxed);
+                    if (dropped > 0) {
+                        const auto message = fmt::format("dropped {} log messages of thread {}", dropped, ring->index);
+                        this->write(m_stderr, format, Level::Warning, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count(), ring->index, message);
+                    }
+                }
+
+                if (m_stdout.size() > 0) {
+                    std::fwrite(m_stdout.data(), 1, m_stdout.size(), stdout);
+                    std::fflush(stdout);
+                }
+                if (m_stderr.size() > 0) {
+                    std::fwrite(m_stderr.data(), 1, m_stderr.size(), stderr);
+                    std::fflush(stderr);
+                }
+            }
+        private:
+            struct Record {
+                Level level;
+                uint32_t length;
+                int64_t nanoseconds;
+                std::array<char, MAX_MESSAGE_LENGTH> text;
+            };
+
+            // Written by its thread at `head`, read by the writer up to `flushedHead` and handed
+            // back by moving `tail` there.
+            struct ThreadRing {
+                std::array<Record, RING_CAPACITY> records;
+                std::atomic<uint64_t> head = 0;
+                std::atomic<uint64_t> tail = 0;
+                std::atomic<uint64_t> dropped = 0;
+                uint64_t flushedHead = 0;
+                uint32_t index = 0;
+            };
+
+            struct Pending {
+                const Record* record;
+                uint32_t thread;
+            };
+
+            const std::chrono::steady_clock::time_point m_start;
+            std::atomic<Format> m_format = Format::Text;
+            std::atomic<bool> m_running = false;
+            std::atomic<uint64_t> m_droppedCount = 0;
+            std::thread m_writer;
+
+            std::mutex m_ringsMutex;
+            std::vector<std::unique_ptr<ThreadRing>> m_rings;
+
+            // The writer's, under `m_flushMutex`.
+            std::mutex m_flushMutex;
+            std::vector<ThreadRing*> m_flushRings;
+            std::vector<Pending> m_pending;
+            fmt::memory_buffer m_stdout;
+            fmt::memory_buffer m_stderr;
+
+            // A ring outlives its thread, so whatever the thread logged last is still written.
+            ThreadRing& threadRing() {
+                thread_local ThreadRing* ring = nullptr;
+                if (ring == nullptr) {
+                    const auto lock = std::scoped_lock { m_ringsMutex };
+                    auto& created = m_rings.emplace_back(std::make_unique<ThreadRing>());
+                    created->index = static_cast<uint32_t>(m_rings.size() - 1);
+                    ring = created.get();
+                }
+
+                return *ring;
+            }
+
+            void write(fmt::memory_buffer& out, Format format, Level level, int64_t nanoseconds, uint32_t thread, std::string_view message) const {
+                auto inserter = std::back_inserter(out);
+                if (format == Format::Text) {
+                    fmt::format_to(inserter, FMT_COMPILE("{}\n"), message);
+                    return;
+                }
+
+                fmt::format_to(inserter, FMT_COMPILE("{{\"time\":{:.6f},\"level\":\"{}\",\"thread\":{},\"message\":\""), static_cast<double>(nanoseconds) / 1.0e9, levelToString(level), thread);
+                for (const char c : message) {
+                    if (c == '"' || c == '\\') {
+                        out.push_back('\\');
+                        out.push_back(c);
+                    } else if (static_cast<unsigned char>(c) < 0x20) {
+                        fmt::format_to(inserter, FMT_COMPILE("\\u{:04x}"), static_cast<unsigned int>(c));
+                    } else {
+                        out.push_back(c);
+                    }
+                }
+                fmt::format_to(inserter, FMT_COMPILE("\"}}\n"));
+            }
+
+            void writerLoop() {
+                vk_topology::markBackgroundThread();
+                while (m_running.load(std::memory_order_acquire)) {
+                    std::this_thread::sleep_for(FLUSH_INTERVAL);
+                    this->flush();
+                }
+            }
+    };
+
+    // The process's logger, started by the first message.
+    inline Logger& logger() {
+        static Logger instance;
+
+        return instance;
+    }
+
+    inline void flush() {
+        logger().flush();
+    }
+}
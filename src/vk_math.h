@@ -0,0 +1,206 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <span>
+
+#include <glm/glm.hpp>
+
+#include "vk_transforms.h"
+
+
+namespace vk_math {
+    // World space planes `dot(plane.xyz, p) + plane.w >= 0` inside, normalized.
+    using FrustumPlanes = std::array<glm::vec4, 6>;
+
+    struct Aabb {
+        glm::vec3 min { std::numeric_limits<float>::max() };
+        glm::vec3 max { -std::numeric_limits<float>::max() };
+
+        void grow(const glm::vec3& point) {
+            min = glm::min(min, point);
+            max = glm::max(max, point);
+        }
+
+        void grow(const Aabb& other) {
+            min = glm::min(min, other.min);
+            max = glm::max(max, other.max);
+        }
+
+        glm::vec3 center() const {
+            return 0.5f * (min + max);
+        }
+
+        // Half the surface area, which is all the heuristic of a tree build compares.
+        float halfArea() const {
+            const auto extent = glm::max(max - min, glm::vec3 { 0.0f });
+
+            return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+        }
+
+        bool overlaps(const Aabb& other) const {
+            return glm::all(glm::lessThanEqual(min, other.max)) && glm::all(glm::lessThanEqual(other.min, max));
+        }
+    };
+
+    // The planes of the clip space frustum, `-w <= x, y <= w` and `0 <= z <= w`, in world
+    // space, normalized so they give distances. A plane at infinity, like the far plane of
+    // `perspectiveReversedZ`, has no normal, and becomes one every point is inside.
+    inline FrustumPlanes extractFrustumPlanes(const glm::mat4& viewProjection) {
+        const auto row = [&viewProjection](int i) {
+            return glm::vec4 { viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i] };
+        };
+
+        auto planes = FrustumPlanes {
+            row(3) + row(0),
+            row(3) - row(0),
+            row(3) + row(1),
+            row(3) - row(1),
+            row(2),
+            row(3) - row(2),
+        };
+        for (auto& plane : planes) {
+            const auto length = glm::length(glm::vec3 { plane });
+            plane = length > 0.0f ? plane / length : glm::vec4 { 0.0f, 0.0f, 0.0f, 1.0f };
+        }
+
+        return planes;
+    }
+
+    // A right handed perspective projection like `glm::perspectiveRH_ZO`, but with depth 1 at
+    // `nearPlane` falling to 0 at an infinite distance. Floats are densest near 0, which
+    // reversing puts in the distance, where a standard projection runs out of precision, and
+    // there is no far plane to clip the scene against. Depth tests against it compare greater,
+    // and clear to 0. Like any projection here, y is flipped by the caller for Vulkan.
+    inline glm::mat4 perspectiveReversedZ(float fovY, float aspect, float nearPlane) {
+        const auto focalLength = 1.0f / std::tan(0.5f * fovY);
+
+        auto projection = glm::mat4 { 0.0f };
+        projection[0][0] = focalLength / aspect;
+        projection[1][1] = focalLength;
+        projection[2][3] = -1.0f;
+        projection[3][2] = nearPlane;
+
+        return projection;
+    }
+
+    // Writes `matrix * vec4(point, 1)` for every point to `destination`, like the clip space
+    // positions of a projection.
+    //
+    // The points are read `vk_transforms::LANE_COUNT` at a time into glm vectors, one point per
+    // lane, so every product works on four points at once in glm's SSE or NEON paths, and is
+    // transposed back to one vector per point on the way out.
+    inline void transformPoints(const glm::mat4& matrix, std::span<const glm::vec3> points, glm::vec4* destination) {
+        using vk_transforms::Lanes;
+        using vk_transforms::LANE_COUNT;
+
+        for (size_t group = 0; group < points.size(); group += LANE_COUNT) {
+            const auto laneCount = std::min(LANE_COUNT, points.size() - group);
+
+            auto x = Lanes { 0.0f };
+            auto y = Lanes { 0.0f };
+            auto z = Lanes { 0.0f };
+            for (size_t lane = 0; lane < laneCount; lane++) {
+                const auto& point = points[group + lane];
+                const auto index = static_cast<glm::length_t>(lane);
+                x[index] = point.x;
+                y[index] = point.y;
+                z[index] = point.z;
+            }
+
+            const auto coordinate = [&matrix, &x, &y, &z](glm::length_t row) {
+                return x * matrix[0][row] + y * matrix[1][row] + z * matrix[2][row] + Lanes { matrix[3][row] };
+            };
+
+            const auto transformed = glm::transpose(vk_transforms::LaneMatrix { coordinate(0), coordinate(1), coordinate(2), coordinate(3) });
+            for (size_t lane = 0; lane < laneCount; lane++) {
+                destination[group + lane] = glm::vec4 { transformed[static_cast<glm::length_t>(lane)] };
+            }
+        }
+    }
+
+    // The box around `box` under `matrix`, from its center and the extents projected on the
+    // matrix's rows, like `vk_cpu_culling::BoundsStore::set`.
+    inline Aabb transformBox(const vk_transforms::WorldMatrix& matrix, const Aabb& box) {
+        const auto center = box.center();
+        const auto halfExtent = 0.5f * (box.max - box.min);
+        auto result = Aabb {};
+        for (glm::length_t row = 0; row < 3; row++) {
+            const auto& r = matrix.rows[static_cast<size_t>(row)];
+            const auto worldCenter = r.x * center.x + r.y * center.y + r.z * center.z + r.w;
+            const auto worldExtent = std::abs(r.x) * halfExtent.x + std::abs(r.y) * halfExtent.y + std::abs(r.z) * halfExtent.z;
+            result.min[row] = worldCenter - worldExtent;
+            result.max[row] = worldCenter + worldExtent;
+        }
+
+        return result;
+    }
+
+    // `transformBox` of every box under one matrix, four boxes at a time, one per lane.
+    inline void transformBoxes(const vk_transforms::WorldMatrix& matrix, std::span<const Aabb> boxes, Aabb* destination) {
+        using vk_transforms::Lanes;
+        using vk_transforms::LANE_COUNT;
+
+        for (size_t group = 0; group < boxes.size(); group += LANE_COUNT) {
+            const auto laneCount = std::min(LANE_COUNT, boxes.size() - group);
+
+            auto center = std::array { Lanes { 0.0f }, Lanes { 0.0f }, Lanes { 0.0f } };
+            auto halfExtent = std::array { Lanes { 0.0f }, Lanes { 0.0f }, Lanes { 0.0f } };
+            for (size_t lane = 0; lane < laneCount; lane++) {
+                const auto& box = boxes[group + lane];
+                const auto index = static_cast<glm::length_t>(lane);
+                for (glm::length_t axis = 0; axis < 3; axis++) {
+                    center[static_cast<size_t>(axis)][index] = 0.5f * (box.min[axis] + box.max[axis]);
+                    halfExtent[static_cast<size_t>(axis)][index] = 0.5f * (box.max[axis] - box.min[axis]);
+                }
+            }
+
+            for (glm::length_t row = 0; row < 3; row++) {
+                const auto& r = matrix.rows[static_cast<size_t>(row)];
+                const auto worldCenter = center[0] * r.x + center[1] * r.y + center[2] * r.z + Lanes { r.w };
+                const auto worldExtent = halfExtent[0] * std::abs(r.x) + halfExtent[1] * std::abs(r.y) + halfExtent[2] * std::abs(r.z);
+                const auto min = worldCenter - worldExtent;
+                const auto max = worldCenter + worldExtent;
+                for (size_t lane = 0; lane < laneCount; lane++) {
+                    const auto index = static_cast<glm::length_t>(lane);
+                    destination[group + lane].min[row] = min[index];
+                    destination[group + lane].max[row] = max[index];
+                }
+            }
+        }
+    }
+
+    // `transformBox` of one box under every matrix, like the boxes of the instances of a mesh,
+    // four matrices at a time, one per lane.
+    inline void transformBoxInstances(std::span<const vk_transforms::WorldMatrix> matrices, const Aabb& box, Aabb* destination) {
+        using vk_transforms::Lanes;
+        using vk_transforms::LANE_COUNT;
+
+        const auto center = box.center();
+        const auto halfExtent = 0.5f * (box.max - box.min);
+        for (size_t group = 0; group < matrices.size(); group += LANE_COUNT) {
+            const auto laneCount = std::min(LANE_COUNT, matrices.size() - group);
+            for (size_t row = 0; row < 3; row++) {
+                // One column of the row per vector, one matrix per lane.
+                auto columns = vk_transforms::LaneMatrix { 0.0f };
+                for (size_t lane = 0; lane < laneCount; lane++) {
+                    columns[static_cast<glm::length_t>(lane)] = matrices[group + lane].rows[row];
+                }
+                columns = glm::transpose(columns);
+
+                const auto worldCenter = columns[0] * center.x + columns[1] * center.y + columns[2] * center.z + columns[3];
+                const auto worldExtent = glm::abs(columns[0]) * halfExtent.x + glm::abs(columns[1]) * halfExtent.y + glm::abs(columns[2]) * halfExtent.z;
+                const auto min = worldCenter - worldExtent;
+                const auto max = worldCenter + worldExtent;
+                for (size_t lane = 0; lane < laneCount; lane++) {
+                    const auto index = static_cast<glm::length_t>(lane);
+                    destination[group + lane].min[static_cast<glm::length_t>(row)] = min[index];
+                    destination[group + lane].max[static_cast<glm::length_t>(row)] = max[index];
+                }
+            }
+        }
+    }
+}
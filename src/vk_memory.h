@@ -0,0 +1,1097 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <set>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <fmt/core.h>
+#include <fmt/ostream.h>
+
+
+namespace vk_memory {
+    // Buffers and linear images can share a block, as can optimally tiled images, but the two
+    // kinds are kept in separate pools so `bufferImageGranularity` never has to be honored
+    // between neighboring allocations.
+    enum class ResourceKind : uint32_t {
+        Linear,
+        Optimal,
+    };
+
+    // Which allocations the driver, and with pageable device local memory the OS, pages out
+    // first when device memory is oversubscribed: streamed assets before everything else, and
+    // render targets and buffers every frame touches last.
+    enum class MemoryPriority : uint32_t {
+        Low,
+        Normal,
+        High,
+    };
+
+    constexpr uint32_t MEMORY_PRIORITY_COUNT = 3;
+
+    // The values of `VkMemoryPriorityAllocateInfoEXT`, where 0.5 is what allocations without one
+    // get.
+    inline float memoryPriorityValue(MemoryPriority priority) {
+        switch (priority) {
+            case MemoryPriority::Low: return 0.25f;
+            case MemoryPriority::Normal: return 0.5f;
+            case MemoryPriority::High: return 1.0f;
+        }
+
+        return 0.5f;
+    }
+
+    struct AllocationCreateInfo {
+        VkMemoryPropertyFlags requiredFlags = 0;
+        VkMemoryPropertyFlags preferredFlags = 0;
+        ResourceKind kind = ResourceKind::Linear;
+        MemoryPriority priority = MemoryPriority::Normal;
+        bool dedicated = false;
+        void* userData = nullptr;
+        // A chain starting with a `VkExportMemoryAllocateInfo`, for images other processes
+        // import, which always get memory of their own.
+        const void* exportInfo = nullptr;
+    };
+
+    struct Allocation {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = 0;
+        void* mappedData = nullptr;
+        uint32_t memoryTypeIndex = 0;
+        uint32_t poolIndex = 0;
+        uint32_t blockIndex = 0;
+        bool dedicated = false;
+        void* userData = nullptr;
+
+        bool isValid() const {
+            return memory != VK_NULL_HANDLE;
+        }
+    };
+
+    // The address shaders reach `buffer` at through `GL_EXT_buffer_reference`. The buffer needs
+    // `VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT`, and memory from an allocator initialized with
+    // `bufferDeviceAddress`.
+    inline VkDeviceAddress bufferDeviceAddress(VkDevice device, VkBuffer buffer) {
+        const auto addressInfo = VkBufferDeviceAddressInfo {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+            .buffer = buffer,
+        };
+
+        return vkGetBufferDeviceAddress(device, &addressInfo);
+    }
+
+    // What a heap has in use across every process, and what the driver estimates this process
+    // can have in use before allocations start failing or paging out.
+    struct HeapBudget {
+        VkDeviceSize usage = 0;
+        VkDeviceSize budget = 0;
+    };
+
+    struct AllocatorStatistics {
+        uint32_t blockCount = 0;
+        uint32_t dedicatedAllocationCount = 0;
+        uint32_t allocationCount = 0;
+        VkDeviceSize blockBytes = 0;
+        VkDeviceSize allocatedBytes = 0;
+    };
+
+    // Binary buddy allocator over the range `[0, size)`, where `size` is a power of two. Every
+    // allocation is rounded up to a power of two at least as large as its alignment, so a block
+    // of order `k` always starts at a multiple of `2^k` and alignment comes for free.
+    class BuddyAllocator {
+        public:
+            static constexpr VkDeviceSize MIN_BLOCK_SIZE = 256;
+
+            explicit BuddyAllocator(VkDeviceSize size)
+                : m_size { size }
+                , m_maxOrder { static_cast<uint32_t>(std::countr_zero(size)) }
+                , m_freeLists(m_maxOrder + 1)
+            {
+                m_freeLists[m_maxOrder].insert(0);
+            }
+
+            std::optional<VkDeviceSize> allocate(VkDeviceSize size, VkDeviceSize alignment) {
+                const auto blockSize = std::bit_ceil(std::max({ size, alignment, MIN_BLOCK_SIZE }));
+                if (blockSize > m_size) {
+                    return std::nullopt;
+                }
+
+                const auto order = static_cast<uint32_t>(std::countr_zero(blockSize));
+                auto freeOrder = order;
+                while (freeOrder <= m_maxOrder && m_freeLists[freeOrder].empty()) {
+                    freeOrder++;
+                }
+
+                if (freeOrder > m_maxOrder) {
+                    return std::nullopt;
+                }
+
+                const auto offset = *m_freeLists[freeOrder].begin();
+                m_freeLists[freeOrder].erase(m_freeLists[freeOrder].begin());
+
+                // Split the free block down to the requested order, returning the upper halves.
+                while (freeOrder > order) {
+                    freeOrder--;
+                    m_freeLists[freeOrder].insert(offset + (VkDeviceSize { 1 } << freeOrder));
+                }
+
+                m_allocatedOrders.emplace(offset, order);
+                m_allocatedBytes += blockSize;
+
+                return offset;
+            }
+
+            void free(VkDeviceSize offset) {
+                const auto found = m_allocatedOrders.find(offset);
+                if (found == m_allocatedOrders.end()) {
+                    return;
+                }
+
+                auto order = found->second;
+                m_allocatedOrders.erase(found);
+                m_allocatedBytes -= VkDeviceSize { 1 } << order;
+
+                // Merge with the buddy for as long as the buddy is free too.
+                auto blockOffset = offset;
+                while (order < m_maxOrder) {
+                    const auto buddyOffset = blockOffset ^ (VkDeviceSize { 1 } << order);
+                    auto& freeList = m_freeLists[order];
+                    const auto buddy = freeList.find(buddyOffset);
+                    if (buddy == freeList.end()) {
+                        break;
+                    }
+
+                    freeList.erase(buddy);
+                    blockOffset = std::min(blockOffset, buddyOffset);
+                    order++;
+                }
+
+                m_freeLists[order].insert(blockOffset);
+            }
+
+            VkDeviceSize allocatedBytes() const {
+                return m_allocatedBytes;
+            }
+
+            bool isEmpty() const {
+                return m_allocatedOrders.empty();
+            }
+        private:
+            VkDeviceSize m_size;
+            uint32_t m_maxOrder;
+            std::vector<std::set<VkDeviceSize>> m_freeLists;
+            std::map<VkDeviceSize, uint32_t> m_allocatedOrders;
+            VkDeviceSize m_allocatedBytes = 0;
+    };
+
+    // Sub-allocates device memory out of large `VkDeviceMemory` blocks, with one pool per memory
+    // type and resource kind. Large resources, and resources the driver asks to be dedicated, get
+    // a `VkDeviceMemory` of their own. Host visible blocks are persistently mapped.
+    class DeviceMemoryAllocator {
+        public:
+            static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 256 * 1024 * 1024;
+
+            explicit DeviceMemoryAllocator() = default;
+
+            DeviceMemoryAllocator(const DeviceMemoryAllocator& other) = delete;
+            DeviceMemoryAllocator& operator=(const DeviceMemoryAllocator& other) = delete;
+
+            // Priorities are set on each `VkDeviceMemory`, so with `memoryPriority` every memory
+            // type and resource kind gets a pool per priority. Without it, all share one. With
+            // `bufferDeviceAddress`, all memory is allocated with
+            // `VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT`, so any buffer may take its address.
+            void init(VkPhysicalDevice physicalDevice, VkDevice device, bool memoryPriority = false, bool bufferDeviceAddress = false) {
+                m_device = device;
+                m_memoryPriority = memoryPriority;
+                m_bufferDeviceAddress = bufferDeviceAddress;
+                vkGetPhysicalDeviceMemoryProperties(physicalDevice, &m_memoryProperties);
+
+                auto properties = VkPhysicalDeviceProperties {};
+                vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+                m_maxMemoryAllocationCount = properties.limits.maxMemoryAllocationCount;
+
+                // Small heaps, like the 256 MiB host visible device local heap most discrete GPUs
+                // expose without resizable BAR, get blocks small enough that a few fit.
+                m_blockSizes.resize(m_memoryProperties.memoryTypeCount);
+                for (uint32_t i = 0; i < m_memoryProperties.memoryTypeCount; i++) {
+                    const auto heapSize = m_memoryProperties.memoryHeaps[m_memoryProperties.memoryTypes[i].heapIndex].size;
+                    const auto heapBlockSize = std::bit_floor(std::max(heapSize / 8, VkDeviceSize { BuddyAllocator::MIN_BLOCK_SIZE }));
+                    m_blockSizes[i] = std::min(DEFAULT_BLOCK_SIZE, heapBlockSize);
+                }
+
+                m_pools.clear();
+                m_pools.resize(m_memoryProperties.memoryTypeCount * POOLS_PER_MEMORY_TYPE);
+                m_heapBytes.assign(m_memoryProperties.memoryHeapCount, 0);
+                m_heapBudgets.clear();
+            }
+
+            void destroy() {
+                for (auto& pool : m_pools) {
+                    for (auto& block : pool.blocks) {
+                        if (block != nullptr) {
+                            vkFreeMemory(m_device, block->memory, nullptr);
+                        }
+                    }
+
+                    pool.blocks.clear();
+                }
+
+                for (const auto& [memory, allocation] : m_dedicatedAllocations) {
+                    vkFreeMemory(m_device, memory, nullptr);
+                }
+
+                m_dedicatedAllocations.clear();
+                m_memoryAllocationCount = 0;
+                std::fill(m_heapBytes.begin(), m_heapBytes.end(), 0);
+            }
+
+            const VkPhysicalDeviceMemoryProperties& memoryProperties() const {
+                return m_memoryProperties;
+            }
+
+            // Usage and budgets from `VK_EXT_memory_budget`, sampled once a frame. Until the next
+            // sample, memory allocated or freed since is added to or taken from the usage, as the
+            // driver only sees it at the next query.
+            void setHeapBudgets(std::span<const HeapBudget> budgets) {
+                m_heapBudgets.assign(budgets.begin(), budgets.end());
+                m_heapBytesAtBudget = m_heapBytes;
+            }
+
+            // How much more the heap can take before it goes over budget. Without budgets, the
+            // heap's size less what this allocator has in it.
+            VkDeviceSize heapHeadroom(uint32_t heapIndex) const {
+                if (heapIndex >= m_heapBudgets.size()) {
+                    const auto size = m_memoryProperties.memoryHeaps[heapIndex].size;
+                    return size > m_heapBytes[heapIndex] ? size - m_heapBytes[heapIndex] : 0;
+                }
+
+                const auto& heap = m_heapBudgets[heapIndex];
+                const auto usage = heap.usage + m_heapBytes[heapIndex];
+                const auto estimatedUsage = usage > m_heapBytesAtBudget[heapIndex] ? usage - m_heapBytesAtBudget[heapIndex] : 0;
+
+                return heap.budget > estimatedUsage ? heap.budget - estimatedUsage : 0;
+            }
+
+            // Pick the memory type allowed by `memoryTypeBits` that has all `requiredFlags` and
+            // the most `preferredFlags`, favoring lower indices on a tie, as the driver lists the
+            // fastest types first.
+            std::optional<uint32_t> findMemoryType(uint32_t memoryTypeBits, VkMemoryPropertyFlags requiredFlags, VkMemoryPropertyFlags preferredFlags) const {
+                auto bestIndex = std::optional<uint32_t> {};
+                int bestScore = -1;
+                for (uint32_t i = 0; i < m_memoryProperties.memoryTypeCount; i++) {
+                    const auto flags = m_memoryProperties.memoryTypes[i].propertyFlags;
+                    if (!(memoryTypeBits & (1u << i)) || (flags & requiredFlags) != requiredFlags) {
+                        continue;
+                    }
+
+                    const int score = std::popcount(flags & preferredFlags);
+                    if (score > bestScore) {
+                        bestIndex = i;
+                        bestScore = score;
+                    }
+                }
+
+                return bestIndex;
+            }
+
+            // Of the types `findMemoryType` would consider, the best one whose heap has `size`
+            // bytes of headroom, so a preferred heap that other applications have filled gives
+            // way to one that still has room, rather than failing or paging.
+            std::optional<uint32_t> findMemoryTypeWithinBudget(uint32_t memoryTypeBits, VkMemoryPropertyFlags requiredFlags, VkMemoryPropertyFlags preferredFlags, VkDeviceSize size) const {
+                auto withinBudgetBits = uint32_t { 0 };
+                for (uint32_t i = 0; i < m_memoryProperties.memoryTypeCount; i++) {
+                    if ((memoryTypeBits & (1u << i)) && this->heapHeadroom(m_memoryProperties.memoryTypes[i].heapIndex) >= size) {
+                        withinBudgetBits |= 1u << i;
+                    }
+                }
+
+                const auto withinBudget = this->findMemoryType(withinBudgetBits, requiredFlags, preferredFlags);
+                if (withinBudget.has_value()) {
+                    return withinBudget;
+                }
+
+                return this->findMemoryType(memoryTypeBits, requiredFlags, preferredFlags);
+            }
+
+            Allocation allocate(const VkMemoryRequirements& requirements, const AllocationCreateInfo& createInfo) {
+                return this->allocate(requirements, createInfo, nullptr);
+            }
+
+            Allocation allocateForBuffer(VkBuffer buffer, AllocationCreateInfo createInfo) {
+                const auto requirements = this->getBufferMemoryRequirements(buffer);
+                createInfo.kind = ResourceKind::Linear;
+                createInfo.dedicated = createInfo.dedicated || requirements.prefersDedicated || requirements.requiresDedicated;
+
+                const auto dedicatedInfo = VkMemoryDedicatedAllocateInfo {
+                    .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO,
+                    .buffer = buffer,
+                };
+                const auto allocation = this->allocate(requirements.requirements, createInfo, &dedicatedInfo);
+                const auto result = vkBindBufferMemory(m_device, buffer, allocation.memory, allocation.offset);
+                if (result != VK_SUCCESS) {
+                    this->free(allocation);
+                    throw std::runtime_error("failed to bind buffer memory!");
+                }
+
+                return allocation;
+            }
+
+            // Other processes import the whole `VkDeviceMemory` of an exported image, so it
+            // holds the image alone, and drivers that only export dedicated memory are told
+            // which image that is.
+            Allocation allocateForImage(VkImage image, AllocationCreateInfo createInfo) {
+                const auto requirements = this->getImageMemoryRequirements(image);
+                createInfo.dedicated = createInfo.dedicated || requirements.prefersDedicated || requirements.requiresDedicated || createInfo.exportInfo != nullptr;
+
+                const auto dedicatedInfo = VkMemoryDedicatedAllocateInfo {
+                    .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO,
+                    .pNext = createInfo.exportInfo,
+                    .image = image,
+                };
+                const auto allocation = this->allocate(requirements.requirements, createInfo, &dedicatedInfo);
+                const auto result = vkBindImageMemory(m_device, image, allocation.memory, allocation.offset);
+                if (result != VK_SUCCESS) {
+                    this->free(allocation);
+                    throw std::runtime_error("failed to bind image memory!");
+                }
+
+                return allocation;
+            }
+
+            void free(const Allocation& allocation) {
+                if (!allocation.isValid()) {
+                    return;
+                }
+
+                if (allocation.dedicated) {
+                    if (allocation.mappedData != nullptr) {
+                        vkUnmapMemory(m_device, allocation.memory);
+                    }
+
+                    vkFreeMemory(m_device, allocation.memory, nullptr);
+                    m_dedicatedAllocations.erase(allocation.memory);
+                    m_memoryAllocationCount--;
+                    m_heapBytes[this->heapIndex(allocation.memoryTypeIndex)] -= allocation.size;
+
+                    return;
+                }
+
+                auto& pool = m_pools[allocation.poolIndex];
+                auto& block = pool.blocks[allocation.blockIndex];
+                block->allocator.free(allocation.offset);
+                block->userData.erase(allocation.offset);
+
+                this->releaseEmptyBlocks(pool);
+            }
+
+            AllocatorStatistics statistics() const {
+                auto statistics = AllocatorStatistics {};
+                for (const auto& pool : m_pools) {
+                    for (const auto& block : pool.blocks) {
+                        if (block != nullptr) {
+                            statistics.blockCount++;
+                            statistics.blockBytes += block->size;
+                            statistics.allocatedBytes += block->allocator.allocatedBytes();
+                            statistics.allocationCount += static_cast<uint32_t>(block->userData.size());
+                        }
+                    }
+                }
+
+                for (const auto& [memory, size] : m_dedicatedAllocations) {
+                    statistics.dedicatedAllocationCount++;
+                    statistics.allocatedBytes += size;
+                }
+
+                return statistics;
+            }
+        private:
+            struct Block {
+                VkDeviceMemory memory;
+                VkDeviceSize size;
+                uint32_t heapIndex;
+                void* mappedData;
+                BuddyAllocator allocator;
+                std::map<VkDeviceSize, void*> userData;
+            };
+
+            struct Pool {
+                std::vector<std::unique_ptr<Block>> blocks;
+            };
+
+            struct ResourceMemoryRequirements {
+                VkMemoryRequirements requirements;
+                bool prefersDedicated;
+                bool requiresDedicated;
+            };
+
+            VkDevice m_device = VK_NULL_HANDLE;
+            bool m_memoryPriority = false;
+            bool m_bufferDeviceAddress = false;
+            VkPhysicalDeviceMemoryProperties m_memoryProperties = {};
+            uint32_t m_maxMemoryAllocationCount = 0;
+            uint32_t m_memoryAllocationCount = 0;
+            std::vector<VkDeviceSize> m_blockSizes;
+            // The bytes of `VkDeviceMemory` allocated from each heap, now and at the last budget.
+            std::vector<VkDeviceSize> m_heapBytes;
+            std::vector<VkDeviceSize> m_heapBytesAtBudget;
+            std::vector<HeapBudget> m_heapBudgets;
+            std::vector<Pool> m_pools;
+            std::map<VkDeviceMemory, VkDeviceSize> m_dedicatedAllocations;
+
+            static void* offsetPointer(void* base, VkDeviceSize offset) {
+                if (base == nullptr) {
+                    return nullptr;
+                }
+
+                return static_cast<char*>(base) + offset;
+            }
+
+            // Pools are laid out by memory type, then priority, then resource kind.
+            static constexpr uint32_t POOLS_PER_MEMORY_TYPE = MEMORY_PRIORITY_COUNT * 2;
+
+            uint32_t poolIndex(uint32_t memoryTypeIndex, ResourceKind kind, MemoryPriority priority) const {
+                const auto poolPriority = m_memoryPriority ? priority : MemoryPriority::Normal;
+
+                return (memoryTypeIndex * MEMORY_PRIORITY_COUNT + static_cast<uint32_t>(poolPriority)) * 2 + static_cast<uint32_t>(kind);
+            }
+
+            static uint32_t poolMemoryType(uint32_t poolIndex) {
+                return poolIndex / POOLS_PER_MEMORY_TYPE;
+            }
+
+            static MemoryPriority poolPriority(uint32_t poolIndex) {
+                return static_cast<MemoryPriority>(poolIndex / 2 % MEMORY_PRIORITY_COUNT);
+            }
+
+            uint32_t heapIndex(uint32_t memoryTypeIndex) const {
+                return m_memoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+            }
+
+            bool isHostVisible(uint32_t memoryTypeIndex) const {
+                return m_memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+            }
+
+            VkDeviceMemory allocateDeviceMemory(VkDeviceSize size, uint32_t memoryTypeIndex, MemoryPriority priority, void** mappedData, const void* next = nullptr) {
+                if (m_memoryAllocationCount >= m_maxMemoryAllocationCount) {
+                    throw std::runtime_error("exceeded maxMemoryAllocationCount!");
+                }
+
+                const auto priorityInfo = VkMemoryPriorityAllocateInfoEXT {
+                    .sType = VK_STRUCTURE_TYPE_MEMORY_PRIORITY_ALLOCATE_INFO_EXT,
+                    .pNext = next,
+                    .priority = memoryPriorityValue(priority),
+                };
+                const auto* priorityNext = m_memoryPriority ? &priorityInfo : next;
+                const auto flagsInfo = VkMemoryAllocateFlagsInfo {
+                    .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO,
+                    .pNext = priorityNext,
+                    .flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT,
+                };
+                const auto allocateInfo = VkMemoryAllocateInfo {
+                    .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+                    .pNext = m_bufferDeviceAddress ? static_cast<const void*>(&flagsInfo) : priorityNext,
+                    .allocationSize = size,
+                    .memoryTypeIndex = memoryTypeIndex,
+                };
+
+                auto memory = VkDeviceMemory {};
+                const auto result = vkAllocateMemory(m_device, &allocateInfo, nullptr, &memory);
+                if (result != VK_SUCCESS) {
+                    return VK_NULL_HANDLE;
+                }
+
+                m_memoryAllocationCount++;
+                m_heapBytes[this->heapIndex(memoryTypeIndex)] += size;
+
+                *mappedData = nullptr;
+                if (this->isHostVisible(memoryTypeIndex)) {
+                    const auto mapResult = vkMapMemory(m_device, memory, 0, VK_WHOLE_SIZE, 0, mappedData);
+                    if (mapResult != VK_SUCCESS) {
+                        vkFreeMemory(m_device, memory, nullptr);
+                        m_memoryAllocationCount--;
+                        m_heapBytes[this->heapIndex(memoryTypeIndex)] -= size;
+                        throw std::runtime_error("failed to map device memory!");
+                    }
+                }
+
+                return memory;
+            }
+
+            Allocation allocateDedicated(VkDeviceSize size, uint32_t memoryTypeIndex, MemoryPriority priority, void* userData, const void* next = nullptr) {
+                void* mappedData = nullptr;
+                const auto memory = this->allocateDeviceMemory(size, memoryTypeIndex, priority, &mappedData, next);
+                if (memory == VK_NULL_HANDLE) {
+                    throw std::runtime_error("failed to allocate dedicated device memory!");
+                }
+
+                m_dedicatedAllocations.emplace(memory, size);
+
+                return Allocation {
+                    .memory = memory,
+                    .offset = 0,
+                    .size = size,
+                    .mappedData = mappedData,
+                    .memoryTypeIndex = memoryTypeIndex,
+                    .poolIndex = 0,
+                    .blockIndex = 0,
+                    .dedicated = true,
+                    .userData = userData,
+                };
+            }
+
+            // Memory of its own is allocated with `dedicatedInfo` chained, when it names the
+            // resource the memory is for, which some drivers place better, and a driver that
+            // requires it for the resource needs. Such memory is never sub-allocated.
+            Allocation allocate(const VkMemoryRequirements& requirements, const AllocationCreateInfo& createInfo, const VkMemoryDedicatedAllocateInfo* dedicatedInfo) {
+                const auto memoryTypeIndex = this->findMemoryTypeWithinBudget(requirements.memoryTypeBits, createInfo.requiredFlags, createInfo.preferredFlags, requirements.size);
+                if (!memoryTypeIndex.has_value()) {
+                    throw std::runtime_error("failed to find a suitable memory type!");
+                }
+
+                const auto blockSize = m_blockSizes[memoryTypeIndex.value()];
+                if (createInfo.dedicated || requirements.size > blockSize / 2) {
+                    return this->allocateDedicated(requirements.size, memoryTypeIndex.value(), createInfo.priority, createInfo.userData, dedicatedInfo);
+                }
+
+                const auto poolIndex = this->poolIndex(memoryTypeIndex.value(), createInfo.kind, createInfo.priority);
+                auto allocation = this->allocateFromPool(poolIndex, requirements.size, requirements.alignment);
+                if (!allocation.has_value()) {
+                    throw std::runtime_error("failed to allocate device memory!");
+                }
+
+                allocation->userData = createInfo.userData;
+                m_pools[poolIndex].blocks[allocation->blockIndex]->userData[allocation->offset] = createInfo.userData;
+
+                return allocation.value();
+            }
+
+            std::optional<Allocation> allocateFromPool(uint32_t poolIndex, VkDeviceSize size, VkDeviceSize alignment) {
+                auto& pool = m_pools[poolIndex];
+                const auto memoryTypeIndex = poolMemoryType(poolIndex);
+
+                auto tryBlock = [&](uint32_t blockIndex) -> std::optional<Allocation> {
+                    auto& block = pool.blocks[blockIndex];
+                    const auto offset = block->allocator.allocate(size, alignment);
+                    if (!offset.has_value()) {
+                        return std::nullopt;
+                    }
+
+                    block->userData[offset.value()] = nullptr;
+
+                    return Allocation {
+                        .memory = block->memory,
+                        .offset = offset.value(),
+                        .size = size,
+                        .mappedData = this->offsetPointer(block->mappedData, offset.value()),
+                        .memoryTypeIndex = memoryTypeIndex,
+                        .poolIndex = poolIndex,
+                        .blockIndex = blockIndex,
+                        .dedicated = false,
+                        .userData = nullptr,
+                    };
+                };
+
+                for (uint32_t i = 0; i < pool.blocks.size(); i++) {
+                    if (pool.blocks[i] == nullptr) {
+                        continue;
+                    }
+
+                    auto allocation = tryBlock(i);
+                    if (allocation.has_value()) {
+                        return allocation;
+                    }
+                }
+
+                // Near the budget, a block only as large as the headroom, down to one just large
+                // enough for the allocation, so the pool grows by what it can afford.
+                const auto smallestBlockSize = std::bit_ceil(std::max({ size, alignment, VkDeviceSize { BuddyAllocator::MIN_BLOCK_SIZE } }));
+                const auto headroomBlockSize = std::bit_floor(std::max(this->heapHeadroom(this->heapIndex(memoryTypeIndex)), VkDeviceSize { 1 }));
+                const auto blockSize = std::max(smallestBlockSize, std::min(m_blockSizes[memoryTypeIndex], headroomBlockSize));
+                void* mappedData = nullptr;
+                const auto memory = this->allocateDeviceMemory(blockSize, memoryTypeIndex, poolPriority(poolIndex), &mappedData);
+                if (memory == VK_NULL_HANDLE) {
+                    return std::nullopt;
+                }
+
+                auto block = std::make_unique<Block>(Block {
+                    .memory = memory,
+                    .size = blockSize,
+                    .heapIndex = this->heapIndex(memoryTypeIndex),
+                    .mappedData = mappedData,
+                    .allocator = BuddyAllocator { blockSize },
+                    .userData = {},
+                });
+
+                // Reuse the slot of a released block so block indices of live allocations stay put.
+                auto freeSlot = std::find(pool.blocks.begin(), pool.blocks.end(), nullptr);
+                if (freeSlot != pool.blocks.end()) {
+                    *freeSlot = std::move(block);
+                    return tryBlock(static_cast<uint32_t>(freeSlot - pool.blocks.begin()));
+                }
+
+                pool.blocks.push_back(std::move(block));
+
+                return tryBlock(static_cast<uint32_t>(pool.blocks.size() - 1));
+            }
+
+            // Keep one empty block around per pool, so a resource that is freed and created again
+            // every frame does not cost a `vkAllocateMemory` each time.
+            void releaseEmptyBlocks(Pool& pool) {
+                bool keptEmptyBlock = false;
+                for (auto& block : pool.blocks) {
+                    if (block == nullptr || !block->allocator.isEmpty()) {
+                        continue;
+                    }
+
+                    if (!keptEmptyBlock) {
+                        keptEmptyBlock = true;
+                        continue;
+                    }
+
+                    vkFreeMemory(m_device, block->memory, nullptr);
+                    m_memoryAllocationCount--;
+                    m_heapBytes[block->heapIndex] -= block->size;
+                    block.reset();
+                }
+            }
+
+            ResourceMemoryRequirements getBufferMemoryRequirements(VkBuffer buffer) const {
+                auto dedicatedRequirements = VkMemoryDedicatedRequirements {
+                    .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS,
+                };
+                auto requirements = VkMemoryRequirements2 {
+                    .sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2,
+                    .pNext = &dedicatedRequirements,
+                };
+                const auto info = VkBufferMemoryRequirementsInfo2 {
+                    .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2,
+                    .buffer = buffer,
+                };
+                vkGetBufferMemoryRequirements2(m_device, &info, &requirements);
+
+                return ResourceMemoryRequirements {
+                    .requirements = requirements.memoryRequirements,
+                    .prefersDedicated = dedicatedRequirements.prefersDedicatedAllocation == VK_TRUE,
+                    .requiresDedicated = dedicatedRequirements.requiresDedicatedAllocation == VK_TRUE,
+                };
+            }
+
+            ResourceMemoryRequirements getImageMemoryRequirements(VkImage image) const {
+                auto dedicatedRequirements = VkMemoryDedicatedRequirements {
+                    .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS,
+                };
+                auto requirements = VkMemoryRequirements2 {
+                    .sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2,
+                    .pNext = &dedicatedRequirements,
+                };
+                const auto info = VkImageMemoryRequirementsInfo2 {
+                    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2,
+                    .image = image,
+                };
+                vkGetImageMemoryRequirements2(m_device, &info, &requirements);
+
+                return ResourceMemoryRequirements {
+                    .requirements = requirements.memoryRequirements,
+                    .prefersDedicated = dedicatedRequirements.prefersDedicatedAllocation == VK_TRUE,
+                    .requiresDedicated = dedicatedRequirements.requiresDedicatedAllocation == VK_TRUE,
+                };
+            }
+    };
+
+    // An allocation that goes back to its allocator when destroyed, so it can be retired in a
+    // `vk_handles::DeferredDestructionQueue` along with the resource bound to it. Declare it
+    // before the resource, so the resource is destroyed first.
+    class ScopedAllocation {
+        public:
+            explicit ScopedAllocation() = default;
+
+            explicit ScopedAllocation(DeviceMemoryAllocator& allocator, Allocation allocation)
+                : m_allocator { &allocator }
+                , m_allocation { allocation }
+            {
+            }
+
+            ~ScopedAllocation() {
+                this->reset();
+            }
+
+            ScopedAllocation(const ScopedAllocation& other) = delete;
+            ScopedAllocation& operator=(const ScopedAllocation& other) = delete;
+
+            ScopedAllocation(ScopedAllocation&& other) noexcept
+                : m_allocator { std::exchange(other.m_allocator, nullptr) }
+                , m_allocation { std::exchange(other.m_allocation, Allocation {}) }
+            {
+            }
+
+            ScopedAllocation& operator=(ScopedAllocation&& other) noexcept {
+                if (this != &other) {
+                    this->reset();
+                    m_allocator = std::exchange(other.m_allocator, nullptr);
+                    m_allocation = std::exchange(other.m_allocation, Allocation {});
+                }
+
+                return *this;
+            }
+
+            void reset() {
+                if (m_allocator != nullptr) {
+                    m_allocator->free(m_allocation);
+                    m_allocator = nullptr;
+                    m_allocation = Allocation {};
+                }
+            }
+
+            const Allocation& get() const {
+                return m_allocation;
+            }
+        private:
+            DeviceMemoryAllocator* m_allocator = nullptr;
+            Allocation m_allocation {};
+    };
+
+    struct UploadAllocation {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = 0;
+        void* mappedData = nullptr;
+    };
+
+    // How data the CPU writes every frame reaches the GPU. `Direct` writes it straight into
+    // device local memory through a host visible mapping, `Staged` writes it to system memory
+    // and copies it to device local memory at the start of the frame.
+    enum class UploadStrategy : uint32_t {
+        Direct,
+        Staged,
+    };
+
+    inline const char* uploadStrategyToString(UploadStrategy strategy) {
+        switch (strategy) {
+            case UploadStrategy::Direct: return "direct";
+            case UploadStrategy::Staged: return "staged";
+        }
+
+        return "unknown";
+    }
+
+    // Without resizable BAR, the CPU only sees a 256 MiB window of device local memory, which
+    // the driver itself needs some of. A larger host visible device local heap is either a
+    // resizable BAR, or all memory on a unified memory architecture.
+    constexpr VkDeviceSize RESIZABLE_BAR_MIN_HEAP_SIZE = VkDeviceSize { 256 } * 1024 * 1024;
+
+    inline bool hasResizableBar(const VkPhysicalDeviceMemoryProperties& memoryProperties) {
+        constexpr auto flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+            const auto& type = memoryProperties.memoryTypes[i];
+            if ((type.propertyFlags & flags) == flags && memoryProperties.memoryHeaps[type.heapIndex].size > RESIZABLE_BAR_MIN_HEAP_SIZE) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    inline UploadStrategy selectUploadStrategy(const VkPhysicalDeviceMemoryProperties& memoryProperties) {
+        return hasResizableBar(memoryProperties) ? UploadStrategy::Direct : UploadStrategy::Staged;
+    }
+
+    // Linear allocator for data the CPU writes every frame, like uniforms and dynamic vertices.
+    // One persistently mapped buffer is split into a region per frame in flight, and a region is
+    // only rewound once the frame that last wrote it has completed, so handing out memory is a
+    // pointer bump and the writes of a frame stay contiguous for the write combining buffers.
+    //
+    // With `UploadStrategy::Staged`, the mapped buffer is in system memory, and allocations
+    // point into a device local buffer of the same layout, which `recordCopies` brings up to
+    // date. The copy is recorded on the graphics queue, so only graphics queue work may read
+    // what the arena hands out.
+    class FrameUploadArena {
+        public:
+            static constexpr VkBufferUsageFlags BUFFER_USAGE =
+                VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT
+                | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT
+                | VK_BUFFER_USAGE_INDEX_BUFFER_BIT
+                | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+            // What reads the data once it has been copied, for the barrier after the copy.
+            static constexpr VkAccessFlags READ_ACCESS =
+                VK_ACCESS_UNIFORM_READ_BIT
+                | VK_ACCESS_SHADER_READ_BIT
+                | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT
+                | VK_ACCESS_INDEX_READ_BIT;
+
+            explicit FrameUploadArena() = default;
+
+            FrameUploadArena(const FrameUploadArena& other) = delete;
+            FrameUploadArena& operator=(const FrameUploadArena& other) = delete;
+
+            void init(
+                VkDevice device,
+                DeviceMemoryAllocator& allocator,
+                VkDeviceSize regionSize,
+                uint32_t regionCount,
+                VkDeviceSize minAlignment,
+                UploadStrategy strategy = UploadStrategy::Direct
+            ) {
+                m_device = device;
+                m_strategy = strategy;
+                m_regionSize = regionSize;
+                m_regionCount = regionCount;
+                m_minAlignment = std::max(minAlignment, VkDeviceSize { 1 });
+                m_currentRegion = 0;
+                m_cursor = 0;
+
+                // Coherent memory is required so nothing has to be flushed before submission.
+                // Direct uploads prefer device local memory, which picks the resizable BAR heap.
+                // Staged ones leave the little BAR there is to the driver.
+                const auto createInfo = AllocationCreateInfo {
+                    .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                    .preferredFlags = strategy == UploadStrategy::Direct ? VkMemoryPropertyFlags { VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT } : VkMemoryPropertyFlags {},
+                    .kind = ResourceKind::Linear,
+                    .priority = MemoryPriority::High,
+                    .dedicated = true,
+                    .userData = this,
+                };
+                m_buffer = this->createBuffer(BUFFER_USAGE);
+                m_allocation = allocator.allocateForBuffer(m_buffer, createInfo);
+
+                if (strategy == UploadStrategy::Staged) {
+                    m_deviceBuffer = this->createBuffer((BUFFER_USAGE & ~VK_BUFFER_USAGE_TRANSFER_SRC_BIT) | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+                    m_deviceAllocation = allocator.allocateForBuffer(m_deviceBuffer, AllocationCreateInfo {
+                        .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                        .kind = ResourceKind::Linear,
+                        .priority = MemoryPriority::High,
+                        .dedicated = true,
+                        .userData = this,
+                    });
+                }
+            }
+
+            void destroy(DeviceMemoryAllocator& allocator) {
+                if (m_buffer == VK_NULL_HANDLE) {
+                    return;
+                }
+
+                vkDestroyBuffer(m_device, m_buffer, nullptr);
+                allocator.free(m_allocation);
+                m_buffer = VK_NULL_HANDLE;
+                m_allocation = Allocation {};
+
+                if (m_deviceBuffer != VK_NULL_HANDLE) {
+                    vkDestroyBuffer(m_device, m_deviceBuffer, nullptr);
+                    allocator.free(m_deviceAllocation);
+                    m_deviceBuffer = VK_NULL_HANDLE;
+                    m_deviceAllocation = Allocation {};
+                }
+            }
+
+            // Rewind the region of `frameIndex`. The caller must have waited for the previous frame
+            // using that region, since the GPU may still be reading the previous contents until then.
+            void beginFrame(uint32_t frameIndex) {
+                m_currentRegion = frameIndex % m_regionCount;
+                m_cursor = 0;
+            }
+
+            std::optional<UploadAllocation> allocate(VkDeviceSize size, VkDeviceSize alignment = 1) {
+                const auto effectiveAlignment = std::max(alignment, m_minAlignment);
+                const auto offset = (m_cursor + effectiveAlignment - 1) / effectiveAlignment * effectiveAlignment;
+                if (offset + size > m_regionSize) {
+                    return std::nullopt;
+                }
+
+                m_cursor = offset + size;
+
+                const auto bufferOffset = m_currentRegion * m_regionSize + offset;
+
+                return UploadAllocation {
+                    .buffer = this->buffer(),
+                    .offset = bufferOffset,
+                    .size = size,
+                    .mappedData = static_cast<char*>(m_allocation.mappedData) + bufferOffset,
+                };
+            }
+
+            // Copies what the frame has written so far to device local memory. Called once the
+            // frame's data has all been allocated, before any of it is read. The frame that last
+            // read the region has completed, so only the reads after the copy wait for it.
+            void recordCopies(VkCommandBuffer commandBuffer) const {
+                if (m_strategy != UploadStrategy::Staged || m_cursor == 0) {
+                    return;
+                }
+
+                const auto regionOffset = m_currentRegion * m_regionSize;
+                const auto region = VkBufferCopy {
+                    .srcOffset = regionOffset,
+                    .dstOffset = regionOffset,
+                    .size = m_cursor,
+                };
+                vkCmdCopyBuffer(commandBuffer, m_buffer, m_deviceBuffer, 1, &region);
+
+                const auto barrier = VkBufferMemoryBarrier {
+                    .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+                    .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                    .dstAccessMask = READ_ACCESS,
+                    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                    .buffer = m_deviceBuffer,
+                    .offset = regionOffset,
+                    .size = m_cursor,
+                };
+                vkCmdPipelineBarrier(
+                    commandBuffer,
+                    VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                    0,
+                    0, nullptr,
+                    1, &barrier,
+                    0, nullptr
+                );
+            }
+
+            // The buffer shaders read, which allocations point into.
+            VkBuffer buffer() const {
+                return m_strategy == UploadStrategy::Staged ? m_deviceBuffer : m_buffer;
+            }
+
+            UploadStrategy strategy() const {
+                return m_strategy;
+            }
+
+            VkDeviceSize bytesUsed() const {
+                return m_cursor;
+            }
+        private:
+            VkBuffer createBuffer(VkBufferUsageFlags usage) const {
+                const auto bufferInfo = VkBufferCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                    .size = m_regionSize * m_regionCount,
+                    .usage = usage,
+                    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                };
+
+                auto buffer = VkBuffer {};
+                const auto result = vkCreateBuffer(m_device, &bufferInfo, nullptr, &buffer);
+                if (result != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create upload arena buffer!");
+                }
+
+                return buffer;
+            }
+
+            VkDevice m_device = VK_NULL_HANDLE;
+            UploadStrategy m_strategy = UploadStrategy::Direct;
+            VkBuffer m_buffer = VK_NULL_HANDLE;
+            Allocation m_allocation;
+            VkBuffer m_deviceBuffer = VK_NULL_HANDLE;
+            Allocation m_deviceAllocation;
+            VkDeviceSize m_regionSize = 0;
+            uint32_t m_regionCount = 1;
+            VkDeviceSize m_minAlignment = 1;
+            uint32_t m_currentRegion = 0;
+            VkDeviceSize m_cursor = 0;
+    };
+
+    // Samples every heap's usage and budget from `VK_EXT_memory_budget` once a frame. Other
+    // applications on the same GPU move the budget under us, so the sample is handed to those
+    // allocating device memory, which back off before the driver starts failing allocations.
+    class MemoryBudgetMonitor {
+        public:
+            explicit MemoryBudgetMonitor() = default;
+
+            MemoryBudgetMonitor(const MemoryBudgetMonitor& other) = delete;
+            MemoryBudgetMonitor& operator=(const MemoryBudgetMonitor& other) = delete;
+
+            // Without the extension the monitor stays disabled, and `query` does nothing.
+            void init(VkPhysicalDevice physicalDevice, bool memoryBudget) {
+                m_physicalDevice = memoryBudget ? physicalDevice : VK_NULL_HANDLE;
+                m_heaps.clear();
+                m_deviceLocalHeaps.clear();
+                if (!this->isEnabled()) {
+                    return;
+                }
+
+                this->query();
+            }
+
+            bool isEnabled() const {
+                return m_physicalDevice != VK_NULL_HANDLE;
+            }
+
+            void query() {
+                if (!this->isEnabled()) {
+                    return;
+                }
+
+                auto budgetProperties = VkPhysicalDeviceMemoryBudgetPropertiesEXT {
+                    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT,
+                };
+                auto memoryProperties = VkPhysicalDeviceMemoryProperties2 {
+                    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2,
+                    .pNext = &budgetProperties,
+                };
+                vkGetPhysicalDeviceMemoryProperties2(m_physicalDevice, &memoryProperties);
+
+                const auto heapCount = memoryProperties.memoryProperties.memoryHeapCount;
+                m_heaps.resize(heapCount);
+                m_deviceLocalHeaps.resize(heapCount);
+                for (uint32_t i = 0; i < heapCount; i++) {
+                    m_heaps[i] = HeapBudget {
+                        .usage = budgetProperties.heapUsage[i],
+                        .budget = budgetProperties.heapBudget[i],
+                    };
+                    m_deviceLocalHeaps[i] = (memoryProperties.memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+                }
+            }
+
+            std::span<const HeapBudget> heaps() const {
+                return m_heaps;
+            }
+
+            // What the device local heaps can still take, across all of them, for the budgets
+            // of systems that only ever allocate device local memory.
+            VkDeviceSize deviceLocalHeadroom() const {
+                auto headroom = VkDeviceSize { 0 };
+                for (size_t i = 0; i < m_heaps.size(); i++) {
+                    if (m_deviceLocalHeaps[i] && m_heaps[i].budget > m_heaps[i].usage) {
+                        headroom += m_heaps[i].budget - m_heaps[i].usage;
+                    }
+                }
+
+                return headroom;
+            }
+
+            // One JSON object per line, like `vk_profiling::FrameTelemetry::reportJson`.
+            void reportJson(std::ostream& out) const {
+                fmt::print(out, "{{\"memoryHeaps\":[");
+                for (size_t i = 0; i < m_heaps.size(); i++) {
+                    fmt::print(
+                        out,
+                        "{}{{\"heap\":{},\"deviceLocal\":{},\"usageBytes\":{},\"budgetBytes\":{}}}",
+                        i == 0 ? "" : ",",
+                        i,
+                        m_deviceLocalHeaps[i] ? "true" : "false",
+                        m_heaps[i].usage,
+                        m_heaps[i].budget
+                    );
+                }
+
+                fmt::println(out, "]}}");
+            }
+        private:
+            VkPhysicalDevice m_physicalDevice = VK_NULL_HANDLE;
+            std::vector<HeapBudget> m_heaps;
+            std::vector<bool> m_deviceLocalHeaps;
+    };
+}
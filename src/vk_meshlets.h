@@ -0,0 +1,320 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+
+namespace vk_meshlets {
+    // The sizes vendors recommend for mesh shader workgroups, and well inside the minimum
+    // limits of `VK_EXT_mesh_shader`. Triangles address their vertices with 8 bits.
+    constexpr uint32_t MAX_VERTICES = 64;
+    constexpr uint32_t MAX_TRIANGLES = 124;
+
+    // The vertex cache the triangle order is tuned for. Real caches differ, but an order that is
+    // good for one size is good for the sizes around it.
+    constexpr size_t VERTEX_CACHE_SIZE = 32;
+
+    // The std430 layout of `Meshlet` in `scene.task` and `scene.mesh`.
+    //
+    // The bounding sphere and the normal cone are in mesh space. The cone contains every
+    // triangle normal of the meshlet, so a camera for which `dot(normalize(coneApex - camera),
+    // coneAxis) >= coneCutoff` sees only back faces of it. Meshlets whose normals spread over
+    // more than a hemisphere get a cutoff above one, which never culls.
+    struct Meshlet {
+        std::array<float, 3> center;
+        float radius;
+        std::array<float, 3> coneApex;
+        float coneCutoff;
+        std::array<float, 3> coneAxis;
+        uint32_t vertexOffset;
+        uint32_t triangleOffset;
+        uint32_t vertexCount;
+        uint32_t triangleCount;
+        uint32_t padding;
+    };
+
+    static_assert(sizeof(Meshlet) == 64, "Meshlet must match the std430 layout of the shaders");
+
+    // `vertices` maps each meshlet's local vertices to indices into the mesh's vertex buffer,
+    // and `triangles` holds three local indices of 8 bits per triangle, one triangle per word.
+    struct MeshletMesh {
+        std::vector<Meshlet> meshlets;
+        std::vector<uint32_t> vertices;
+        std::vector<uint32_t> triangles;
+    };
+
+    // Reorders the triangles of `indices` so consecutive triangles share vertices, after Tom
+    // Forsyth's "Linear-Speed Vertex Cache Optimisation". Every step emits the triangle whose
+    // vertices score best, a vertex scoring higher the more recently it was used and the fewer
+    // triangles are left that use it, which finishes off regions instead of leaving islands.
+    inline std::vector<uint32_t> optimizeVertexCache(std::span<const uint32_t> indices, size_t vertexCount) {
+        constexpr float CACHE_DECAY_POWER = 1.5f;
+        constexpr float LAST_TRIANGLE_SCORE = 0.75f;
+        constexpr float VALENCE_BOOST_SCALE = 2.0f;
+        constexpr float VALENCE_BOOST_POWER = 0.5f;
+
+        const auto triangleCount = indices.size() / 3;
+
+        // The triangles using each vertex, as ranges of one array.
+        auto remaining = std::vector<uint32_t>(vertexCount, 0);
+        for (const auto index : indices) {
+            remaining[index]++;
+        }
+
+        auto firstTriangle = std::vector<uint32_t>(vertexCount + 1, 0);
+        for (size_t vertex = 0; vertex < vertexCount; vertex++) {
+            firstTriangle[vertex + 1] = firstTriangle[vertex] + remaining[vertex];
+        }
+
+        auto vertexTriangles = std::vector<uint32_t>(indices.size(), 0);
+        auto cursor = std::vector<uint32_t>(firstTriangle.begin(), firstTriangle.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++) {
+            vertexTriangles[cursor[indices[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+
+        auto cachePosition = std::vector<int32_t>(vertexCount, -1);
+        const auto vertexScore = [&](uint32_t vertex) {
+            if (remaining[vertex] == 0) {
+                return -1.0f;
+            }
+
+            auto score = 0.0f;
+            const auto position = cachePosition[vertex];
+            if (position >= 0 && position < 3) {
+                score = LAST_TRIANGLE_SCORE;
+            } else if (position >= 3) {
+                const auto decay = 1.0f - static_cast<float>(position - 3) / static_cast<float>(VERTEX_CACHE_SIZE - 3);
+                score = std::pow(decay, CACHE_DECAY_POWER);
+            }
+
+            return score + VALENCE_BOOST_SCALE * std::pow(static_cast<float>(remaining[vertex]), -VALENCE_BOOST_POWER);
+        };
+
+        auto scores = std::vector<float>(vertexCount, 0.0f);
+        for (uint32_t vertex = 0; vertex < vertexCount; vertex++) {
+            scores[vertex] = vertexScore(vertex);
+        }
+
+        auto emitted = std::vector<bool>(triangleCount, false);
+        const auto triangleScore = [&](uint32_t triangle) {
+            return scores[indices[3 * triangle]] + scores[indices[3 * triangle + 1]] + scores[indices[3 * triangle + 2]];
+        };
+
+        auto optimized = std::vector<uint32_t> {};
+        optimized.reserve(indices.size());
+        auto cache = std::vector<uint32_t> {};
+        auto nextCache = std::vector<uint32_t> {};
+        // Where to look for a triangle to start over from once the cache holds no triangles.
+        size_t scanCursor = 0;
+        auto best = std::optional<uint32_t> {};
+
+        for (size_t step = 0; step < triangleCount; step++) {
+            if (!best.has_value()) {
+                while (emitted[scanCursor]) {
+                    scanCursor++;
+                }
+
+                best = static_cast<uint32_t>(scanCursor);
+            }
+
+            const auto triangle = best.value();
+            emitted[triangle] = true;
+            const auto corners = std::array { indices[3 * triangle], indices[3 * triangle + 1], indices[3 * triangle + 2] };
+            for (const auto vertex : corners) {
+                optimized.push_back(vertex);
+                remaining[vertex]--;
+            }
+
+            // The triangle's vertices move to the front, and whatever falls off the end leaves
+            // the cache.
+            nextCache.assign(corners.begin(), corners.end());
+            for (const auto vertex : cache) {
+                if (std::find(corners.begin(), corners.end(), vertex) == corners.end()) {
+                    nextCache.push_back(vertex);
+                }
+            }
+
+            for (size_t i = VERTEX_CACHE_SIZE; i < nextCache.size(); i++) {
+                cachePosition[nextCache[i]] = -1;
+                scores[nextCache[i]] = vertexScore(nextCache[i]);
+            }
+
+            nextCache.resize(std::min(nextCache.size(), VERTEX_CACHE_SIZE));
+            std::swap(cache, nextCache);
+            for (size_t i = 0; i < cache.size(); i++) {
+                cachePosition[cache[i]] = static_cast<int32_t>(i);
+                scores[cache[i]] = vertexScore(cache[i]);
+            }
+
+            // Only the triangles around cached vertices changed score, and the best of them
+            // goes next.
+            best.reset();
+            auto bestScore = 0.0f;
+            for (const auto vertex : cache) {
+                for (auto i = firstTriangle[vertex]; i < firstTriangle[vertex + 1]; i++) {
+                    const auto candidate = vertexTriangles[i];
+                    if (emitted[candidate]) {
+                        continue;
+                    }
+
+                    const auto score = triangleScore(candidate);
+                    if (!best.has_value() || score > bestScore) {
+                        best = candidate;
+                        bestScore = score;
+                    }
+                }
+            }
+        }
+
+        return optimized;
+    }
+
+    // Renumbers the vertices in the order `indices`, already in vertex cache order, first uses
+    // them, so vertex fetch walks the vertex buffer front to back instead of jumping around
+    // it. Rewrites `indices` in place, and returns the old index of every new vertex, to
+    // reorder the vertex data with. Vertices no triangle uses are dropped.
+    inline std::vector<uint32_t> optimizeVertexFetch(std::span<uint32_t> indices, size_t vertexCount) {
+        constexpr uint32_t UNUSED = UINT32_MAX;
+
+        auto newIndices = std::vector<uint32_t>(vertexCount, UNUSED);
+        auto oldIndices = std::vector<uint32_t> {};
+        for (auto& index : indices) {
+            if (newIndices[index] == UNUSED) {
+                newIndices[index] = static_cast<uint32_t>(oldIndices.size());
+                oldIndices.push_back(index);
+            }
+
+            index = newIndices[index];
+        }
+
+        return oldIndices;
+    }
+
+    // Splits the triangles of `indices` into meshlets of at most `MAX_VERTICES` vertices and
+    // `MAX_TRIANGLES` triangles, in the order they come in. Fed a cache optimized order,
+    // neighboring triangles land in the same meshlet, so its vertices are shared by as many
+    // of its triangles as possible, and its bounds and normal cone stay tight.
+    inline MeshletMesh buildMeshlets(std::span<const glm::vec3> positions, std::span<const uint32_t> indices) {
+        constexpr uint8_t NOT_IN_MESHLET = 0xff;
+
+        auto mesh = MeshletMesh {};
+        auto localIndices = std::vector<uint8_t>(positions.size(), NOT_IN_MESHLET);
+        auto current = Meshlet {};
+
+        const auto finish = [&]() {
+            if (current.triangleCount == 0) {
+                return;
+            }
+
+            for (uint32_t i = 0; i < current.vertexCount; i++) {
+                localIndices[mesh.vertices[current.vertexOffset + i]] = NOT_IN_MESHLET;
+            }
+
+            mesh.meshlets.push_back(current);
+            current = Meshlet {
+                .vertexOffset = static_cast<uint32_t>(mesh.vertices.size()),
+                .triangleOffset = static_cast<uint32_t>(mesh.triangles.size()),
+            };
+        };
+
+        for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+            const auto corners = std::array { indices[i], indices[i + 1], indices[i + 2] };
+            auto newVertices = 0u;
+            for (const auto vertex : corners) {
+                newVertices += localIndices[vertex] == NOT_IN_MESHLET ? 1 : 0;
+            }
+
+            if (current.vertexCount + newVertices > MAX_VERTICES || current.triangleCount + 1 > MAX_TRIANGLES) {
+                finish();
+            }
+
+            auto packed = uint32_t { 0 };
+            for (size_t corner = 0; corner < corners.size(); corner++) {
+                auto& localIndex = localIndices[corners[corner]];
+                if (localIndex == NOT_IN_MESHLET) {
+                    localIndex = static_cast<uint8_t>(current.vertexCount++);
+                    mesh.vertices.push_back(corners[corner]);
+                }
+
+                packed |= uint32_t { localIndex } << (8 * corner);
+            }
+
+            mesh.triangles.push_back(packed);
+            current.triangleCount++;
+        }
+
+        finish();
+
+        for (auto& meshlet : mesh.meshlets) {
+            const auto position = [&](uint32_t triangle, uint32_t corner) {
+                const auto local = (mesh.triangles[meshlet.triangleOffset + triangle] >> (8 * corner)) & 0xff;
+                return positions[mesh.vertices[meshlet.vertexOffset + local]];
+            };
+
+            // The sphere around the vertices' centroid, which is loose by a few percent at
+            // most for the compact clusters this builds.
+            auto center = glm::vec3 { 0.0f };
+            for (uint32_t i = 0; i < meshlet.vertexCount; i++) {
+                center += positions[mesh.vertices[meshlet.vertexOffset + i]];
+            }
+
+            center /= static_cast<float>(meshlet.vertexCount);
+            auto radius = 0.0f;
+            for (uint32_t i = 0; i < meshlet.vertexCount; i++) {
+                radius = std::max(radius, glm::length(positions[mesh.vertices[meshlet.vertexOffset + i]] - center));
+            }
+
+            meshlet.center = { center.x, center.y, center.z };
+            meshlet.radius = radius;
+
+            // The cone around the average normal, through the narrowest normal, with its apex
+            // moved back along the axis until every triangle's plane faces away from any camera
+            // inside the cone, as in meshoptimizer's `meshopt_computeMeshletBounds`.
+            auto normals = std::vector<glm::vec3> {};
+            auto axis = glm::vec3 { 0.0f };
+            for (uint32_t triangle = 0; triangle < meshlet.triangleCount; triangle++) {
+                const auto normal = glm::cross(position(triangle, 1) - position(triangle, 0), position(triangle, 2) - position(triangle, 0));
+                const auto length = glm::length(normal);
+                normals.push_back(length > 0.0f ? normal / length : glm::vec3 { 0.0f });
+                axis += normals.back();
+            }
+
+            const auto axisLength = glm::length(axis);
+            auto minDot = 1.0f;
+            if (axisLength > 0.0f) {
+                axis /= axisLength;
+                for (const auto& normal : normals) {
+                    minDot = std::min(minDot, glm::dot(axis, normal));
+                }
+            }
+
+            if (axisLength <= 0.0f || minDot <= 0.0f) {
+                meshlet.coneApex = meshlet.center;
+                meshlet.coneAxis = { 0.0f, 0.0f, 0.0f };
+                meshlet.coneCutoff = 2.0f;
+                continue;
+            }
+
+            auto apexDistance = 0.0f;
+            for (uint32_t triangle = 0; triangle < meshlet.triangleCount; triangle++) {
+                const auto distance = glm::dot(center - position(triangle, 0), normals[triangle]) / glm::dot(axis, normals[triangle]);
+                apexDistance = std::max(apexDistance, distance);
+            }
+
+            const auto apex = center - axis * apexDistance;
+            meshlet.coneApex = { apex.x, apex.y, apex.z };
+            meshlet.coneAxis = { axis.x, axis.y, axis.z };
+            meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+        }
+
+        return mesh;
+    }
+}
@@ -0,0 +1,295 @@
+#pragma once
+
+#include "vk_frame_budget.h"
+#include "vk_log.h"
+#include "vk_memory.h"
+#include "vk_profiling.h"
+#include "vk_socket.h"
+#include "vk_tracing.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fmt/core.h>
+#include <fmt/format.h>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+
+namespace vk_metrics {
+    // Only the port listens on every interface.
+    constexpr std::string_view DEFAULT_ADDRESS = "0.0.0.0";
+
+    // Serves the frame telemetry in the Prometheus text format at `/metrics`, for dashboards
+    // to scrape from machines nobody watches. A thread at the lowest priority the platform
+    // gives out answers one request at a time, and reads the telemetry ring on its own, since
+    // the ring is made to be read while the frame loop writes it. What the ring does not
+    // hold, the memory budgets and the counts of swapchain recreations, blocked acquires and
+    // lost devices, the frame loop hands over through `publishHeaps` and the counters, which
+    // cost it an atomic add, or a short lock once a frame, and nothing at all while the server
+    // is stopped. The CPU budget overruns are read from the frame budget's own counters.
+    class MetricsServer {
+        public:
+            // How long the thread waits for a connection before it checks whether to stop, and
+            // for a client to send its request.
+            static constexpr auto POLL_INTERVAL = std::chrono::milliseconds { 100 };
+            static constexpr auto REQUEST_TIMEOUT = std::chrono::seconds { 1 };
+            static constexpr size_t MAX_REQUEST_SIZE = 4096;
+
+            explicit MetricsServer() = default;
+
+            MetricsServer(const MetricsServer& other) = delete;
+            MetricsServer& operator=(const MetricsServer& other) = delete;
+
+            ~MetricsServer() {
+                this->stop();
+            }
+
+            void start(const vk_socket::Endpoint& endpoint, const vk_profiling::FrameTelemetry& telemetry, const vk_frame_budget::FrameBudget& frameBudget) {
+                if (m_thread.joinable()) {
+                    return;
+                }
+
+                m_listener.listen(endpoint, "metrics scrapes");
+
+                m_telemetry = &telemetry;
+                m_frameBudget = &frameBudget;
+                m_running.store(true, std::memory_order_release);
+                m_thread = std::thread { [this]() { this->serveLoop(); } };
+                VK_LOG_INFO("Serving metrics at http://{}:{}/metrics", endpoint.address, endpoint.port);
+            }
+
+            void stop() {
+                m_running.store(false, std::memory_order_release);
+                if (m_thread.joinable()) {
+                    m_thread.join();
+                }
+
+                m_listener.close();
+                m_telemetry = nullptr;
+                m_frameBudget = nullptr;
+            }
+
+            bool isRunning() const {
+                return m_running.load(std::memory_order_acquire);
+            }
+
+            void publishHeaps(std::span<const vk_memory::HeapBudget> heaps) {
+                if (!this->isRunning()) {
+                    return;
+                }
+
+                const auto lock = std::scoped_lock { m_heapsMutex };
+                m_heaps.assign(heaps.begin(), heaps.end());
+            }
+
+            void countSwapchainRecreation() {
+                m_swapchainRecreations.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            void countAcquireBlocked() {
+                m_acquiresBlocked.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            void countAcquireTimeout() {
+                m_acquireTimeouts.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            void countDeviceLost() {
+                m_devicesLost.fetch_add(1, std::memory_order_relaxed);
+            }
+        private:
+            std::thread m_thread;
+            std::atomic<bool> m_running = false;
+            vk_socket::Listener m_listener;
+            const vk_profiling::FrameTelemetry* m_telemetry = nullptr;
+            const vk_frame_budget::FrameBudget* m_frameBudget = nullptr;
+            std::atomic<uint64_t> m_swapchainRecreations = 0;
+            std::atomic<uint64_t> m_acquiresBlocked = 0;
+            std::atomic<uint64_t> m_acquireTimeouts = 0;
+            std::atomic<uint64_t> m_devicesLost = 0;
+            std::mutex m_heapsMutex;
+            std::vector<vk_memory::HeapBudget> m_heaps;
+
+            // The server thread's.
+            std::vector<vk_memory::HeapBudget> m_scrapeHeaps;
+            fmt::memory_buffer m_response;
+            fmt::memory_buffer m_body;
+
+            // Scrapes never compete with the frame loop or the workers for a core. Linux runs
+            // an idle thread only when nothing else wants the core, Windows at the lowest
+            // priority, and the other platforms leave the thread as it is.
+            static void lowerThreadPriority() {
+                #if defined(_WIN32)
+                SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+                #elif defined(__linux__)
+                const auto parameters = sched_param {};
+                pthread_setschedparam(pthread_self(), SCHED_IDLE, &parameters);
+                #endif
+            }
+
+            void serveLoop() {
+                vk_tracing::setThreadName("metrics");
+                lowerThreadPriority();
+                while (m_running.load(std::memory_order_acquire)) {
+                    if (const auto client = m_listener.accept(POLL_INTERVAL); client.has_value()) {
+                        this->serve(client.value());
+                        vk_socket::closeSocket(client.value());
+                    }
+                }
+            }
+
+            void serve(vk_socket::Socket client) {
+                auto request = std::array<char, MAX_REQUEST_SIZE> {};
+                auto received = size_t { 0 };
+                const auto deadline = std::chrono::steady_clock::now() + REQUEST_TIMEOUT;
+                while (std::string_view { request.data(), received }.find("\r\n\r\n") == std::string_view::npos) {
+                    if (received == request.size() || std::chrono::steady_clock::now() > deadline || !vk_socket::waitReadable(client, POLL_INTERVAL)) {
+                        return;
+                    }
+
+                    const auto count = vk_socket::receive(client, request.data() + received, request.size() - received);
+                    if (count == 0) {
+                        return;
+                    }
+
+                    received += count;
+                }
+
+                const auto line = std::string_view { request.data(), received };
+                m_body.clear();
+                auto status = std::string_view { "404 Not Found" };
+                if (line.starts_with("GET /metrics ") || line.starts_with("GET /metrics?")) {
+                    status = "200 OK";
+                    this->writeMetrics();
+                }
+
+                m_response.clear();
+                fmt::format_to(
+                    std::back_inserter(m_response),
+                    "HTTP/1.1 {}\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\nContent-Length: {}\r\nConnection: close\r\n\r\n",
+                    status,
+                    m_body.size()
+                );
+                m_response.append(m_body.begin(), m_body.end());
+                vk_socket::sendAll(client, std::string_view { m_response.data(), m_response.size() });
+            }
+
+            void writeMetrics() {
+                auto out = std::back_inserter(m_body);
+                const auto& telemetry = *m_telemetry;
+
+                fmt::format_to(out, "# HELP hello_window_frames_total Frames rendered since the start.\n");
+                fmt::format_to(out, "# TYPE hello_window_frames_total counter\n");
+                fmt::format_to(out, "hello_window_frames_total {}\n", telemetry.frameCount());
+
+                fmt::format_to(out, "# HELP hello_window_frame_milliseconds Frame timings over the last {} frames, by quantile.\n", vk_profiling::FrameTelemetry::CAPACITY);
+                fmt::format_to(out, "# TYPE hello_window_frame_milliseconds gauge\n");
+                for (uint32_t i = 0; i < static_cast<uint32_t>(vk_profiling::FrameMetric::Count); i++) {
+                    const auto metric = static_cast<vk_profiling::FrameMetric>(i);
+                    const auto percentiles = telemetry.percentiles(metric);
+                    if (percentiles.sampleCount == 0) {
+                        continue;
+                    }
+
+                    const auto name = vk_profiling::frameMetricToString(metric);
+                    fmt::format_to(out, "hello_window_frame_milliseconds{{metric=\"{}\",quantile=\"0.5\"}} {:.3f}\n", name, percentiles.p50);
+                    fmt::format_to(out, "hello_window_frame_milliseconds{{metric=\"{}\",quantile=\"0.95\"}} {:.3f}\n", name, percentiles.p95);
+                    fmt::format_to(out, "hello_window_frame_milliseconds{{metric=\"{}\",quantile=\"0.99\"}} {:.3f}\n", name, percentiles.p99);
+                    fmt::format_to(out, "hello_window_frame_milliseconds{{metric=\"{}\",quantile=\"1\"}} {:.3f}\n", name, percentiles.max);
+                }
+
+                if (const auto utilization = gpuUtilization(telemetry); utilization.has_value()) {
+                    fmt::format_to(out, "# HELP hello_window_gpu_utilization_ratio GPU frame time over frame interval, over the last {} frames.\n", vk_profiling::FrameTelemetry::CAPACITY);
+                    fmt::format_to(out, "# TYPE hello_window_gpu_utilization_ratio gauge\n");
+                    fmt::format_to(out, "hello_window_gpu_utilization_ratio {:.4f}\n", utilization.value());
+                }
+
+                {
+                    const auto lock = std::scoped_lock { m_heapsMutex };
+                    m_scrapeHeaps.assign(m_heaps.begin(), m_heaps.end());
+                }
+                if (!m_scrapeHeaps.empty()) {
+                    fmt::format_to(out, "# HELP hello_window_memory_heap_usage_bytes Device memory the process uses, by heap.\n");
+                    fmt::format_to(out, "# TYPE hello_window_memory_heap_usage_bytes gauge\n");
+                    for (size_t i = 0; i < m_scrapeHeaps.size(); i++) {
+                        fmt::format_to(out, "hello_window_memory_heap_usage_bytes{{heap=\"{}\"}} {}\n", i, m_scrapeHeaps[i].usage);
+                    }
+
+                    fmt::format_to(out, "# HELP hello_window_memory_heap_budget_bytes Device memory the driver lets the process use, by heap.\n");
+                    fmt::format_to(out, "# TYPE hello_window_memory_heap_budget_bytes gauge\n");
+                    for (size_t i = 0; i < m_scrapeHeaps.size(); i++) {
+                        fmt::format_to(out, "hello_window_memory_heap_budget_bytes{{heap=\"{}\"}} {}\n", i, m_scrapeHeaps[i].budget);
+                    }
+                }
+
+                fmt::format_to(out, "# HELP hello_window_swapchain_recreations_total Swapchains recreated after resizes and out of date presents.\n");
+                fmt::format_to(out, "# TYPE hello_window_swapchain_recreations_total counter\n");
+                fmt::format_to(out, "hello_window_swapchain_recreations_total {}\n", m_swapchainRecreations.load(std::memory_order_relaxed));
+
+                fmt::format_to(out, "# HELP hello_window_acquire_blocked_total Swapchain acquires that found no image ready.\n");
+                fmt::format_to(out, "# TYPE hello_window_acquire_blocked_total counter\n");
+                fmt::format_to(out, "hello_window_acquire_blocked_total {}\n", m_acquiresBlocked.load(std::memory_order_relaxed));
+
+                fmt::format_to(out, "# HELP hello_window_acquire_timeouts_total Swapchain acquires that gave up, leaving the window out of the frame.\n");
+                fmt::format_to(out, "# TYPE hello_window_acquire_timeouts_total counter\n");
+                fmt::format_to(out, "hello_window_acquire_timeouts_total {}\n", m_acquireTimeouts.load(std::memory_order_relaxed));
+
+                fmt::format_to(out, "# HELP hello_window_device_lost_total Times the device was lost.\n");
+                fmt::format_to(out, "# TYPE hello_window_device_lost_total counter\n");
+                fmt::format_to(out, "hello_window_device_lost_total {}\n", m_devicesLost.load(std::memory_order_relaxed));
+
+                fmt::format_to(out, "# HELP hello_window_cpu_budget_overruns_total Frames a subsystem took longer than its CPU budget in.\n");
+                fmt::format_to(out, "# TYPE hello_window_cpu_budget_overruns_total counter\n");
+                for (size_t i = 0; i < vk_frame_budget::SUBSYSTEM_COUNT; i++) {
+                    const auto subsystem = static_cast<vk_frame_budget::Subsystem>(i);
+                    const auto statistics = m_frameBudget->statistics(subsystem);
+                    fmt::format_to(out, "hello_window_cpu_budget_overruns_total{{subsystem=\"{}\"}} {}\n", vk_frame_budget::subsystemToString(subsystem), statistics.overrunCount);
+                }
+
+                fmt::format_to(out, "# HELP hello_window_cpu_budget_deferrals_total Frames a subsystem left work for the next frame in, once out of CPU budget.\n");
+                fmt::format_to(out, "# TYPE hello_window_cpu_budget_deferrals_total counter\n");
+                for (size_t i = 0; i < vk_frame_budget::SUBSYSTEM_COUNT; i++) {
+                    const auto subsystem = static_cast<vk_frame_budget::Subsystem>(i);
+                    const auto statistics = m_frameBudget->statistics(subsystem);
+                    fmt::format_to(out, "hello_window_cpu_budget_deferrals_total{{subsystem=\"{}\"}} {}\n", vk_frame_budget::subsystemToString(subsystem), statistics.deferredCount);
+                }
+            }
+
+            // How much of the frame interval the GPU was busy, across the frames in the ring
+            // that measured both. GPU timings lag a few frames behind, which evens out across
+            // the ring.
+            static std::optional<double> gpuUtilization(const vk_profiling::FrameTelemetry& telemetry) {
+                auto gpuMilliseconds = 0.0;
+                auto frameMilliseconds = 0.0;
+                for (size_t i = 0; i < vk_profiling::FrameTelemetry::CAPACITY; i++) {
+                    const auto gpu = telemetry.recent(vk_profiling::FrameMetric::Gpu, i);
+                    const auto frame = telemetry.recent(vk_profiling::FrameMetric::CpuFrame, i);
+                    if (!std::isnan(gpu) && !std::isnan(frame)) {
+                        gpuMilliseconds += gpu;
+                        frameMilliseconds += frame;
+                    }
+                }
+
+                if (frameMilliseconds <= 0.0) {
+                    return std::nullopt;
+                }
+
+                return std::min(1.0, gpuMilliseconds / frameMilliseconds);
+            }
+    };
+}
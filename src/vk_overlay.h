@@ -0,0 +1,406 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <fmt/core.h>
+#include <fmt/format.h>
+
+#include <glm/glm.hpp>
+
+#include "vk_memory.h"
+#include "vk_pipelines.h"
+#include "vk_render_graph.h"
+#include "vk_shaders.h"
+
+
+namespace vk_overlay {
+    // Matches `GLYPH_COUNT` and `SOLID` in `overlay.frag`. Glyph `i` is the ASCII character
+    // `FIRST_CHARACTER + i`.
+    constexpr uint32_t GLYPH_COUNT = 64;
+    constexpr char FIRST_CHARACTER = ' ';
+    constexpr uint32_t SOLID = 0xffffffff;
+
+    // Matches `GLYPHS` in `overlay.frag`: each glyph's rows of three columns in three bits, the
+    // top row in the lowest, and the left column in the lowest bit of its row.
+    constexpr std::array<uint32_t, GLYPH_COUNT> GLYPH_BITMAPS = {
+        0x0000, 0x2092, 0x002d, 0x5f7d, 0x3c9e, 0x42a1, 0x6aaa, 0x0012,
+        0x4494, 0x1491, 0x0aa8, 0x05d0, 0x1400, 0x01c0, 0x2000, 0x12a4,
+        0x7b6f, 0x749a, 0x73e7, 0x79a7, 0x49ed, 0x79cf, 0x7bcf, 0x2527,
+        0x7bef, 0x79ef, 0x0410, 0x1410, 0x4454, 0x0e38, 0x1511, 0x20a7,
+        0x636f, 0x5bea, 0x3aeb, 0x624e, 0x3b6b, 0x72cf, 0x12cf, 0x6b4e,
+        0x5bed, 0x7497, 0x2b24, 0x5aed, 0x7249, 0x5bfd, 0x5b6b, 0x2b6a,
+        0x12eb, 0x676a, 0x5aeb, 0x388e, 0x2497, 0x7b6d, 0x2b6d, 0x5fed,
+        0x5aad, 0x24ad, 0x72a7, 0x324b, 0x4889, 0x6926, 0x002a, 0x7000,
+    };
+
+    // The glyph of `c`, where the space is glyph zero and draws nothing. Lowercase letters are
+    // drawn as uppercase, and characters the font does not have as `?`.
+    inline uint32_t glyphIndex(char c) {
+        const auto upper = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+        const auto index = static_cast<uint32_t>(static_cast<unsigned char>(upper)) - static_cast<uint32_t>(FIRST_CHARACTER);
+        if (index >= GLYPH_COUNT) {
+            return static_cast<uint32_t>('?' - FIRST_CHARACTER);
+        }
+
+        return index;
+    }
+
+    // Glyphs are three by five pixels, drawn `GLYPH_SCALE` times as large, with a column
+    // between characters and two rows between lines.
+    constexpr float GLYPH_SCALE = 2.0f;
+    constexpr float ADVANCE = 4.0f * GLYPH_SCALE;
+    constexpr float LINE_HEIGHT = 7.0f * GLYPH_SCALE;
+    constexpr float PADDING = 8.0f;
+
+    // The most quads a frame draws, which also caps what it takes from the upload arena.
+    constexpr size_t MAX_QUADS = 4096;
+
+    // Colors as the fragment shader reads them, red in the lowest byte.
+    constexpr uint32_t rgba(uint8_t r, uint8_t g, uint8_t b, uint8_t a = 255) {
+        return uint32_t { r } | uint32_t { g } << 8 | uint32_t { b } << 16 | uint32_t { a } << 24;
+    }
+
+    constexpr uint32_t TEXT = rgba(230, 230, 230);
+    constexpr uint32_t HEADING = rgba(120, 200, 255);
+    constexpr uint32_t GOOD = rgba(90, 210, 90);
+    constexpr uint32_t WARNING = rgba(240, 190, 60);
+    constexpr uint32_t BAD = rgba(240, 80, 60);
+    constexpr uint32_t BACKGROUND = rgba(0, 0, 0, 170);
+
+    // Matches the vertex inputs of `overlay.vert`, one instance each.
+    struct Quad {
+        glm::vec4 rect;
+        uint32_t glyph;
+        uint32_t color;
+    };
+
+    static_assert(sizeof(Quad) == 24, "Quad must match the vertex input layout of the overlay pipeline");
+
+    // A panel of text and bar graphs drawn over the first window, built from scratch every
+    // frame. The glyphs are a built in bitmap font, so the overlay needs no texture and no
+    // descriptors: each frame's quads go through the frame upload arena as instanced vertex
+    // data, and one draw blends them over the finished frame.
+    class Overlay {
+        public:
+            explicit Overlay() = default;
+
+            Overlay(const Overlay& other) = delete;
+            Overlay& operator=(const Overlay& other) = delete;
+
+            void init(
+                VkDevice device,
+                vk_shaders::ShaderLibrary& shaderLibrary,
+                vk_pipelines::PipelineRegistry& pipelineRegistry,
+                const VkAllocationCallbacks* allocator
+            ) {
+                m_device = device;
+                m_allocator = allocator;
+                m_shaderLibrary = &shaderLibrary;
+                m_pipelineRegistry = &pipelineRegistry;
+                m_quads.reserve(MAX_QUADS);
+
+                const auto pushConstantRange = VkPushConstantRange {
+                    .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+                    .offset = 0,
+                    .size = sizeof(glm::vec2),
+                };
+                const auto layoutInfo = VkPipelineLayoutCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+                    .pushConstantRangeCount = 1,
+                    .pPushConstantRanges = &pushConstantRange,
+                };
+
+                const auto result = vkCreatePipelineLayout(m_device, &layoutInfo, m_allocator, &m_pipelineLayout);
+                if (result != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create overlay pipeline layout!");
+                }
+            }
+
+            // The device has to be idle.
+            void destroy() {
+                if (m_device == VK_NULL_HANDLE) {
+                    return;
+                }
+
+                m_pipelines.clear();
+                vkDestroyPipelineLayout(m_device, m_pipelineLayout, m_allocator);
+                m_pipelineLayout = VK_NULL_HANDLE;
+                m_device = VK_NULL_HANDLE;
+            }
+
+            bool isInitialized() const {
+                return m_device != VK_NULL_HANDLE;
+            }
+
+            bool isVisible() const {
+                return this->isInitialized() && m_visible;
+            }
+
+            void setVisible(bool visible) {
+                m_visible = visible;
+            }
+
+            // Starts the frame's panel in the top left corner, behind everything added to it.
+            void beginFrame() {
+                m_quads.clear();
+                m_quads.push_back(Quad { glm::vec4 { 0.0f }, SOLID, BACKGROUND });
+                m_cursorY = PADDING;
+                m_width = 0.0f;
+            }
+
+            // One line of text. Lowercase letters are drawn as uppercase, and characters the
+            // font does not have as `?`.
+            template <typename... Args>
+            void print(uint32_t color, fmt::format_string<Args...> format, Args&&... args) {
+                m_line.clear();
+                fmt::format_to(std::back_inserter(m_line), format, std::forward<Args>(args)...);
+
+                auto x = PADDING;
+                for (const char c : std::string_view { m_line.data(), m_line.size() }) {
+                    const auto glyph = glyphIndex(c);
+                    if (glyph != 0) {
+                        this->addQuad(glm::vec4 { x, m_cursorY, 3.0f * GLYPH_SCALE, 5.0f * GLYPH_SCALE }, glyph, color);
+                    }
+                    x += ADVANCE;
+                }
+
+                m_width = std::max(m_width, x - PADDING);
+                m_cursorY += LINE_HEIGHT;
+            }
+
+            // A bar graph of `count` values, the oldest on the left, `height` pixels tall for
+            // `maxValue`. Bars under half of it are drawn in `GOOD`, the rest in `WARNING`,
+            // and the ones past it cut off in `BAD`. `valueAt(i)` is the value of bar `i`, and
+            // a NaN leaves a gap.
+            template <typename F>
+            void graph(size_t count, float height, double maxValue, F&& valueAt) {
+                constexpr float BAR_WIDTH = 2.0f;
+                for (size_t i = 0; i < count; i++) {
+                    const double value = valueAt(i);
+                    if (!(value > 0.0)) {
+                        continue;
+                    }
+
+                    const auto color = value > maxValue ? BAD : value > 0.5 * maxValue ? WARNING : GOOD;
+                    const auto barHeight = height * static_cast<float>(std::min(value / maxValue, 1.0));
+                    const auto x = PADDING + static_cast<float>(i) * BAR_WIDTH;
+                    this->addQuad(glm::vec4 { x, m_cursorY + height - barHeight, BAR_WIDTH, barHeight }, SOLID, color);
+                }
+
+                m_width = std::max(m_width, static_cast<float>(count) * BAR_WIDTH);
+                m_cursorY += height + LINE_HEIGHT - 5.0f * GLYPH_SCALE;
+            }
+
+            // Adds the pass that draws the panel over `target`, the `format` image of `extent`
+            // the window presents. The quads are copied into `uploadArena` right away, so the
+            // pass has to be added before the arena's copies are recorded.
+            void addPass(
+                vk_render_graph::RenderGraph& graph,
+                vk_render_graph::ResourceId target,
+                VkFormat format,
+                VkExtent2D extent,
+                vk_memory::FrameUploadArena& uploadArena
+            ) {
+                if (m_quads.size() <= 1) {
+                    return;
+                }
+
+                m_quads.front().rect = glm::vec4 { 0.0f, 0.0f, m_width + 2.0f * PADDING, m_cursorY + PADDING - (LINE_HEIGHT - 5.0f * GLYPH_SCALE) };
+                const auto size = static_cast<VkDeviceSize>(m_quads.size() * sizeof(Quad));
+                const auto allocation = uploadArena.allocate(size, alignof(Quad));
+                if (!allocation.has_value()) {
+                    return;
+                }
+
+                std::memcpy(allocation->mappedData, m_quads.data(), size);
+                const auto quadCount = static_cast<uint32_t>(m_quads.size());
+                const auto buffer = allocation->buffer;
+                const auto offset = allocation->offset;
+                graph.addPass(
+                    "overlay",
+                    {
+                        vk_render_graph::write(target, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL),
+                    },
+                    [this, &graph, target, format, extent, buffer, offset, quadCount](VkCommandBuffer commandBuffer) {
+                        this->record(commandBuffer, graph.imageView(target), format, extent, buffer, offset, quadCount);
+                    }
+                );
+            }
+        private:
+            VkDevice m_device = VK_NULL_HANDLE;
+            const VkAllocationCallbacks* m_allocator = nullptr;
+            vk_shaders::ShaderLibrary* m_shaderLibrary = nullptr;
+            vk_pipelines::PipelineRegistry* m_pipelineRegistry = nullptr;
+            VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+            std::vector<std::pair<VkFormat, VkPipeline>> m_pipelines;
+            bool m_visible = false;
+
+            // The frame's panel, its background first.
+            std::vector<Quad> m_quads;
+            fmt::memory_buffer m_line;
+            float m_cursorY = 0.0f;
+            float m_width = 0.0f;
+
+            void addQuad(const glm::vec4& rect, uint32_t glyph, uint32_t color) {
+                if (m_quads.size() < MAX_QUADS) {
+                    m_quads.push_back(Quad { rect, glyph, color });
+                }
+            }
+
+            void record(VkCommandBuffer commandBuffer, VkImageView targetView, VkFormat format, VkExtent2D extent, VkBuffer buffer, VkDeviceSize offset, uint32_t quadCount) {
+                const auto colorAttachment = VkRenderingAttachmentInfo {
+                    .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+                    .imageView = targetView,
+                    .imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                    .loadOp = VK_ATTACHMENT_LOAD_OP_LOAD,
+                    .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+                };
+                const auto renderingInfo = VkRenderingInfo {
+                    .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+                    .renderArea = VkRect2D { VkOffset2D { 0, 0 }, extent },
+                    .layerCount = 1,
+                    .colorAttachmentCount = 1,
+                    .pColorAttachments = &colorAttachment,
+                };
+                const auto viewport = VkViewport {
+                    .x = 0.0f,
+                    .y = 0.0f,
+                    .width = static_cast<float>(extent.width),
+                    .height = static_cast<float>(extent.height),
+                    .minDepth = 0.0f,
+                    .maxDepth = 1.0f,
+                };
+                const auto scissor = VkRect2D {
+                    .offset = VkOffset2D { 0, 0 },
+                    .extent = extent,
+                };
+                const auto pushConstants = glm::vec2 { static_cast<float>(extent.width), static_cast<float>(extent.height) };
+
+                vkCmdBeginRendering(commandBuffer, &renderingInfo);
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->pipeline(format));
+                vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+                vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+                vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(pushConstants), &pushConstants);
+                vkCmdBindVertexBuffers(commandBuffer, 0, 1, &buffer, &offset);
+                vkCmdDraw(commandBuffer, 6, quadCount, 0, 0);
+                vkCmdEndRendering(commandBuffer);
+            }
+
+            // Blended over the frame without depth. Only the viewport and scissor are dynamic,
+            // which also overrides whatever state the passes before left dynamic.
+            VkPipeline pipeline(VkFormat colorFormat) {
+                const auto existing = std::find_if(m_pipelines.begin(), m_pipelines.end(), [colorFormat](const auto& entry) {
+                    return entry.first == colorFormat;
+                });
+                if (existing != m_pipelines.end()) {
+                    return existing->second;
+                }
+
+                const auto stage = [this](VkShaderStageFlagBits stage, const char* shaderName) {
+                    return VkPipelineShaderStageCreateInfo {
+                        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                        .stage = stage,
+                        .module = m_shaderLibrary->shaderModule(shaderName),
+                        .pName = "main",
+                    };
+                };
+                const auto stages = std::array {
+                    stage(VK_SHADER_STAGE_VERTEX_BIT, "overlay.vert"),
+                    stage(VK_SHADER_STAGE_FRAGMENT_BIT, "overlay.frag"),
+                };
+                const auto binding = VkVertexInputBindingDescription {
+                    .binding = 0,
+                    .stride = sizeof(Quad),
+                    .inputRate = VK_VERTEX_INPUT_RATE_INSTANCE,
+                };
+                const auto attributes = std::array {
+                    VkVertexInputAttributeDescription { 0, 0, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(Quad, rect) },
+                    VkVertexInputAttributeDescription { 1, 0, VK_FORMAT_R32_UINT, offsetof(Quad, glyph) },
+                    VkVertexInputAttributeDescription { 2, 0, VK_FORMAT_R8G8B8A8_UNORM, offsetof(Quad, color) },
+                };
+                const auto vertexInputState = VkPipelineVertexInputStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+                    .vertexBindingDescriptionCount = 1,
+                    .pVertexBindingDescriptions = &binding,
+                    .vertexAttributeDescriptionCount = static_cast<uint32_t>(attributes.size()),
+                    .pVertexAttributeDescriptions = attributes.data(),
+                };
+                const auto inputAssemblyState = VkPipelineInputAssemblyStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+                    .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+                };
+                const auto viewportState = VkPipelineViewportStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+                    .viewportCount = 1,
+                    .scissorCount = 1,
+                };
+                const auto rasterizationState = VkPipelineRasterizationStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+                    .polygonMode = VK_POLYGON_MODE_FILL,
+                    .cullMode = VK_CULL_MODE_NONE,
+                    .lineWidth = 1.0f,
+                };
+                const auto multisampleState = VkPipelineMultisampleStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+                    .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+                };
+                const auto colorBlendAttachment = VkPipelineColorBlendAttachmentState {
+                    .blendEnable = VK_TRUE,
+                    .srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA,
+                    .dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+                    .colorBlendOp = VK_BLEND_OP_ADD,
+                    .srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
+                    .dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+                    .alphaBlendOp = VK_BLEND_OP_ADD,
+                    .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+                };
+                const auto colorBlendState = VkPipelineColorBlendStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+                    .attachmentCount = 1,
+                    .pAttachments = &colorBlendAttachment,
+                };
+                const auto dynamicStates = std::array { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+                const auto dynamicState = VkPipelineDynamicStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+                    .dynamicStateCount = static_cast<uint32_t>(dynamicStates.size()),
+                    .pDynamicStates = dynamicStates.data(),
+                };
+                const auto renderingInfo = VkPipelineRenderingCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
+                    .colorAttachmentCount = 1,
+                    .pColorAttachmentFormats = &colorFormat,
+                };
+                const auto pipelineInfo = VkGraphicsPipelineCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+                    .pNext = &renderingInfo,
+                    .stageCount = static_cast<uint32_t>(stages.size()),
+                    .pStages = stages.data(),
+                    .pVertexInputState = &vertexInputState,
+                    .pInputAssemblyState = &inputAssemblyState,
+                    .pViewportState = &viewportState,
+                    .pRasterizationState = &rasterizationState,
+                    .pMultisampleState = &multisampleState,
+                    .pColorBlendState = &colorBlendState,
+                    .pDynamicState = &dynamicState,
+                    .layout = m_pipelineLayout,
+                };
+
+                const auto pipeline = m_pipelineRegistry->graphicsPipeline(pipelineInfo);
+                m_pipelines.emplace_back(colorFormat, pipeline);
+
+                return pipeline;
+            }
+    };
+}
@@ -0,0 +1,639 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "vk_compute.h"
+#include "vk_gpu_driven.h"
+#include "vk_gpu_primitives.h"
+#include "vk_handles.h"
+#include "vk_memory.h"
+#include "vk_pipelines.h"
+#include "vk_render_graph.h"
+#include "vk_shader_layouts.h"
+#include "vk_shaders.h"
+#include "vk_shading_rate.h"
+
+
+namespace vk_particles {
+    // The specialization constant id of `local_size_x` in the particle kernels.
+    constexpr uint32_t WORKGROUP_SIZE_ID = 0;
+
+    // The particles advance by a fixed step every frame, like the scene's camera, so that
+    // benchmark runs see the same particles frame for frame.
+    constexpr float SIMULATION_STEP = 1.0f / 60.0f;
+
+    // Matches `Particle` in `particles.glsl`.
+    struct Particle {
+        glm::vec4 positionAge;
+        glm::vec4 velocityLifetime;
+    };
+
+    static_assert(sizeof(Particle) == 32, "Particle must match the std430 layout of the shaders");
+
+    constexpr uint32_t PARTICLE_WORDS = sizeof(Particle) / sizeof(uint32_t);
+
+    // Matches `ParticleState` in `particles.glsl`.
+    struct ParticleState {
+        VkDrawIndirectCommand draw;
+        uint32_t survivorCount;
+    };
+
+    struct SimulatePushConstants {
+        VkDeviceAddress particles;
+        VkDeviceAddress alive;
+        VkDeviceAddress state;
+        float deltaTime;
+        uint32_t capacity;
+        glm::vec4 gravity;
+    };
+
+    struct EmitPushConstants {
+        VkDeviceAddress particles;
+        VkDeviceAddress state;
+        glm::vec4 origin;
+        uint32_t emitCount;
+        uint32_t seed;
+        uint32_t capacity;
+        float speed;
+        float lifetime;
+    };
+
+    struct DrawPushConstants {
+        glm::mat4 viewProjection;
+        glm::vec4 cameraRight;
+        glm::vec4 cameraUp;
+        VkDeviceAddress particles;
+    };
+
+    static_assert(offsetof(SimulatePushConstants, gravity) == 32, "SimulatePushConstants must match the std430 layout of the shader");
+    static_assert(offsetof(EmitPushConstants, origin) == 16, "EmitPushConstants must match the std430 layout of the shader");
+    static_assert(offsetof(DrawPushConstants, particles) == 96, "DrawPushConstants must match the std430 layout of the shader");
+    VK_SHADER_LAYOUT_CHECK(particle_simulate_comp, PushConstants, SimulatePushConstants)
+    VK_SHADER_LAYOUT_CHECK(particle_emit_comp, PushConstants, EmitPushConstants)
+    VK_SHADER_LAYOUT_CHECK(particle_vert, PushConstants, DrawPushConstants)
+
+    // A fountain of particles. New particles leave `position` upwards at up to `speed`, live up
+    // to `lifetime` seconds, and fall under `gravity`. Half a lifetime is as short as they get,
+    // so at `rate` particles a second, about `rate * 0.75 * lifetime` are alive at once.
+    struct EmitterSettings {
+        glm::vec3 position { 0.0f };
+        glm::vec3 gravity { 0.0f, -9.81f, 0.0f };
+        float rate = 0.0f;
+        float speed = 10.0f;
+        float lifetime = 4.0f;
+        float size = 0.1f;
+    };
+
+    // A fountain in the middle of a scene of `fieldSize`, rising about halfway to its top,
+    // that keeps about nine tenths of `capacity` alive.
+    inline EmitterSettings fountain(uint32_t capacity, float fieldSize) {
+        auto settings = EmitterSettings {};
+        settings.speed = 0.5f * fieldSize;
+        settings.gravity = glm::vec3 { 0.0f, -0.25f * fieldSize, 0.0f };
+        settings.rate = 0.9f * static_cast<float>(capacity) / (0.75f * settings.lifetime);
+        settings.size = 0.002f * fieldSize + 0.05f;
+
+        return settings;
+    }
+
+    // The render graph resources of a frame's particles, once simulated, for the passes that
+    // draw them.
+    struct ParticleResources {
+        vk_render_graph::ResourceId particles;
+        vk_render_graph::ResourceId state;
+        VkDeviceAddress particlesAddress = 0;
+        VkBuffer stateBuffer = VK_NULL_HANDLE;
+    };
+
+    // Particles that are emitted, simulated and compacted on the GPU, and drawn with one
+    // indirect draw whose instance count the GPU writes, so the CPU never touches a particle.
+    //
+    // Every frame, one async compute pass moves the live particles on and flags the dead
+    // ones, compacts the survivors into the other of two particle buffers, and appends the
+    // frame's new particles after them. With an async compute queue, the buffers are shared
+    // with its family and the pass runs there, overlapping the graphics work before the draw.
+    class ParticleSystem {
+        public:
+            explicit ParticleSystem() = default;
+
+            ParticleSystem(const ParticleSystem& other) = delete;
+            ParticleSystem& operator=(const ParticleSystem& other) = delete;
+
+            // `primitives` has to outlive the particles and hold `capacity` elements. The
+            // buffers are shared between `queueFamilies` when there is more than one.
+            void init(
+                VkDevice device,
+                vk_memory::DeviceMemoryAllocator& memoryAllocator,
+                vk_shaders::ShaderLibrary& shaderLibrary,
+                vk_pipelines::PipelineRegistry& pipelineRegistry,
+                vk_pipelines::PipelineCompiler& pipelineCompiler,
+                const vk_gpu_primitives::GpuPrimitives& primitives,
+                const vk_compute::ComputeTuning& computeTuning,
+                const VkAllocationCallbacks* allocator,
+                std::span<const uint32_t> queueFamilies,
+                VkSampleCountFlagBits samples,
+                VkFormat depthFormat,
+                std::optional<vk_shading_rate::DrawShadingRate> shadingRate,
+                uint32_t capacity,
+                const EmitterSettings& settings
+            ) {
+                if (capacity > primitives.maxCount()) {
+                    throw std::runtime_error("failed to create particle system, more particles than the GPU primitives hold!");
+                }
+
+                m_device = device;
+                m_allocator = allocator;
+                m_memoryAllocator = &memoryAllocator;
+                m_shaderLibrary = &shaderLibrary;
+                m_pipelineRegistry = &pipelineRegistry;
+                m_pipelineCompiler = &pipelineCompiler;
+                m_primitives = &primitives;
+                m_workgroupSize = computeTuning.linear;
+                m_samples = samples;
+                m_depthFormat = depthFormat;
+                m_shadingRate = shadingRate;
+                m_capacity = capacity;
+                m_settings = settings;
+                m_current = 0;
+                m_frameCount = 0;
+                m_emitRemainder = 0.0f;
+                m_emissionScale = 1.0f;
+
+                m_queueFamilies.assign(queueFamilies.begin(), queueFamilies.end());
+                std::sort(m_queueFamilies.begin(), m_queueFamilies.end());
+                m_queueFamilies.erase(std::unique(m_queueFamilies.begin(), m_queueFamilies.end()), m_queueFamilies.end());
+
+                this->createPipelineLayouts();
+                this->createComputePipelines();
+                // The registry keeps the pipelines of a rebuilt shader alive for the frames still
+                // recorded with them, so a reload only replaces the handles.
+                shaderLibrary.onReload("particle_simulate.comp", [this](VkShaderModule) {
+                    m_simulatePipeline = this->createComputePipeline("particle_simulate.comp");
+                });
+                shaderLibrary.onReload("particle_emit.comp", [this](VkShaderModule) {
+                    m_emitPipeline = this->createComputePipeline("particle_emit.comp");
+                });
+                for (const auto* shaderName : { "particle.vert", "particle.frag" }) {
+                    shaderLibrary.onReload(shaderName, [this](VkShaderModule) { m_drawPipelines.clear(); });
+                }
+
+                const auto usage = VkBufferUsageFlags { VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT };
+                const auto particlesSize = VkDeviceSize { std::max(capacity, 1u) } * sizeof(Particle);
+                for (auto& particles : m_particles) {
+                    particles = this->createBuffer(particlesSize, usage);
+                }
+                m_alive = this->createBuffer(VkDeviceSize { std::max(capacity, 1u) } * sizeof(uint32_t), usage);
+                m_state = this->createBuffer(sizeof(ParticleState), usage | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+            }
+
+            // The device has to be idle.
+            void destroy() {
+                if (m_device == VK_NULL_HANDLE) {
+                    return;
+                }
+
+                for (auto& particles : m_particles) {
+                    particles = BufferAllocation();
+                }
+                m_alive = BufferAllocation();
+                m_state = BufferAllocation();
+                m_drawPipelines.clear();
+                vkDestroyPipelineLayout(m_device, m_drawPipelineLayout, m_allocator);
+                vkDestroyPipelineLayout(m_device, m_computePipelineLayout, m_allocator);
+                m_drawPipelineLayout = VK_NULL_HANDLE;
+                m_computePipelineLayout = VK_NULL_HANDLE;
+                m_device = VK_NULL_HANDLE;
+            }
+
+            bool isInitialized() const {
+                return m_device != VK_NULL_HANDLE;
+            }
+
+            uint32_t capacity() const {
+                return m_capacity;
+            }
+
+            // Emits `scale` of the particles the emitter settings ask for, from the next frame
+            // on. The ones alive live out their lifetime, so the count follows within one.
+            void setEmissionScale(float scale) {
+                m_emissionScale = std::clamp(scale, 0.0f, 1.0f);
+            }
+
+            // The frame's simulation pass, which has to come before any graphics pass of the
+            // frame to be moved to the async compute queue. The previous frame drew from the
+            // buffer the survivors are compacted out of, and compacted into the other one.
+            ParticleResources addPasses(vk_render_graph::RenderGraph& graph) {
+                const auto source = m_current;
+                const auto destination = 1 - m_current;
+                const bool first = m_frameCount == 0;
+                const auto sourceState = first
+                    ? vk_render_graph::ResourceState {}
+                    : vk_render_graph::ResourceState { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT };
+                const auto destinationState = first
+                    ? vk_render_graph::ResourceState {}
+                    : vk_render_graph::ResourceState { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT };
+                const auto stateState = first
+                    ? vk_render_graph::ResourceState {}
+                    : vk_render_graph::ResourceState { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT };
+
+                const auto resources = ParticleResources {
+                    .particles = graph.importBuffer(m_particles[destination].buffer, destinationState),
+                    .state = graph.importBuffer(m_state.buffer, stateState),
+                    .particlesAddress = m_particles[destination].address,
+                    .stateBuffer = m_state.buffer,
+                };
+                const auto sourceResource = graph.importBuffer(m_particles[source].buffer, sourceState);
+                if (m_queueFamilies.size() > 1) {
+                    graph.shareAcrossQueues(resources.particles);
+                    graph.shareAcrossQueues(resources.state);
+                    graph.shareAcrossQueues(sourceResource);
+                }
+                // The next frame simulates on from them, whether or not this one draws them.
+                graph.exportResource(resources.particles);
+                graph.exportResource(resources.state);
+
+                const auto storage = VkAccessFlags2 { VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT };
+                graph.addPass(
+                    "particles",
+                    {
+                        vk_render_graph::write(sourceResource, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, storage),
+                        vk_render_graph::write(resources.particles, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, storage),
+                        vk_render_graph::write(resources.state, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_CLEAR_BIT, storage | VK_ACCESS_2_TRANSFER_WRITE_BIT),
+                    },
+                    [this, source, destination](VkCommandBuffer commandBuffer) {
+                        this->recordSimulation(commandBuffer, source, destination);
+                    },
+                    vk_render_graph::PassQueue::AsyncCompute
+                );
+
+                return resources;
+            }
+
+            // What the pass that draws the particles reads.
+            std::array<vk_render_graph::ResourceAccess, 2> drawAccesses(const ParticleResources& resources) const {
+                return {
+                    vk_render_graph::read(resources.particles, VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT),
+                    vk_render_graph::read(resources.state, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT),
+                };
+            }
+
+            // Creates the pipeline `recordDraw` draws with into a `colorFormat` color attachment
+            // ahead of the draw, so that creating it never lands in the middle of recording.
+            void prepareDraw(VkFormat colorFormat) {
+                this->drawPipeline(colorFormat);
+            }
+
+            // Draws the particles into a render pass with a `colorFormat` color attachment and
+            // the GPU driven scene's depth buffer, which they are tested against but not written
+            // to, seen by `camera`.
+            void recordDraw(
+                VkCommandBuffer commandBuffer,
+                const ParticleResources& resources,
+                VkFormat colorFormat,
+                VkExtent2D renderExtent,
+                const vk_gpu_driven::SceneCamera& camera
+            ) {
+                const auto viewport = VkViewport {
+                    .x = 0.0f,
+                    .y = 0.0f,
+                    .width = static_cast<float>(renderExtent.width),
+                    .height = static_cast<float>(renderExtent.height),
+                    .minDepth = 0.0f,
+                    .maxDepth = 1.0f,
+                };
+                const auto scissor = VkRect2D {
+                    .offset = VkOffset2D { 0, 0 },
+                    .extent = renderExtent,
+                };
+
+                // The rows of the view's rotation are the camera's axes in world space.
+                const auto& view = camera.view;
+                const auto pushConstants = DrawPushConstants {
+                    .viewProjection = camera.viewProjection,
+                    .cameraRight = glm::vec4 { view[0][0], view[1][0], view[2][0], m_settings.size },
+                    .cameraUp = glm::vec4 { view[0][1], view[1][1], view[2][1], 0.0f },
+                    .particles = resources.particlesAddress,
+                };
+
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->drawPipeline(colorFormat));
+                vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+                vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+                if (m_shadingRate.has_value()) {
+                    vk_shading_rate::setDrawShadingRate(commandBuffer, *m_shadingRate);
+                }
+                vkCmdPushConstants(commandBuffer, m_drawPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(DrawPushConstants), &pushConstants);
+                vkCmdDrawIndirect(commandBuffer, resources.stateBuffer, offsetof(ParticleState, draw), 1, sizeof(VkDrawIndirectCommand));
+            }
+        private:
+            struct BufferAllocation {
+                vk_memory::ScopedAllocation memory;
+                vk_handles::Buffer buffer;
+                VkDeviceAddress address = 0;
+            };
+
+            VkDevice m_device = VK_NULL_HANDLE;
+            const VkAllocationCallbacks* m_allocator = nullptr;
+            vk_memory::DeviceMemoryAllocator* m_memoryAllocator = nullptr;
+            vk_shaders::ShaderLibrary* m_shaderLibrary = nullptr;
+            vk_pipelines::PipelineRegistry* m_pipelineRegistry = nullptr;
+            vk_pipelines::PipelineCompiler* m_pipelineCompiler = nullptr;
+            const vk_gpu_primitives::GpuPrimitives* m_primitives = nullptr;
+            std::vector<uint32_t> m_queueFamilies;
+            uint32_t m_workgroupSize = 64;
+            VkSampleCountFlagBits m_samples = VK_SAMPLE_COUNT_1_BIT;
+            VkFormat m_depthFormat = VK_FORMAT_D32_SFLOAT;
+            std::optional<vk_shading_rate::DrawShadingRate> m_shadingRate;
+            uint32_t m_capacity = 0;
+            EmitterSettings m_settings {};
+            std::array<BufferAllocation, 2> m_particles;
+            BufferAllocation m_alive;
+            BufferAllocation m_state;
+            VkPipelineLayout m_computePipelineLayout = VK_NULL_HANDLE;
+            VkPipelineLayout m_drawPipelineLayout = VK_NULL_HANDLE;
+            VkPipeline m_simulatePipeline = VK_NULL_HANDLE;
+            VkPipeline m_emitPipeline = VK_NULL_HANDLE;
+            std::vector<std::pair<VkFormat, vk_pipelines::PipelineHandle>> m_drawPipelines;
+            // The buffer the live particles are in at the start of the next frame.
+            uint32_t m_current = 0;
+            uint64_t m_frameCount = 0;
+            // The fraction of a particle left over from the emission of the frames before.
+            float m_emitRemainder = 0.0f;
+            float m_emissionScale = 1.0f;
+
+            BufferAllocation createBuffer(VkDeviceSize size, VkBufferUsageFlags usage) const {
+                const bool concurrent = m_queueFamilies.size() > 1;
+                const auto bufferInfo = VkBufferCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                    .size = size,
+                    .usage = usage,
+                    .sharingMode = concurrent ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+                    .queueFamilyIndexCount = concurrent ? static_cast<uint32_t>(m_queueFamilies.size()) : 0,
+                    .pQueueFamilyIndices = concurrent ? m_queueFamilies.data() : nullptr,
+                };
+
+                auto buffer = VkBuffer {};
+                const auto result = vkCreateBuffer(m_device, &bufferInfo, m_allocator, &buffer);
+                if (result != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create particle buffer!");
+                }
+
+                auto allocation = BufferAllocation();
+                allocation.buffer = vk_handles::Buffer { m_device, buffer, m_allocator };
+                allocation.memory = vk_memory::ScopedAllocation {
+                    *m_memoryAllocator,
+                    m_memoryAllocator->allocateForBuffer(buffer, vk_memory::AllocationCreateInfo {
+                        .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                        .priority = vk_memory::MemoryPriority::High,
+                    }),
+                };
+                allocation.address = vk_memory::bufferDeviceAddress(m_device, buffer);
+
+                return allocation;
+            }
+
+            void createPipelineLayouts() {
+                const auto computeRange = VkPushConstantRange {
+                    .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                    .offset = 0,
+                    .size = static_cast<uint32_t>(std::max(sizeof(SimulatePushConstants), sizeof(EmitPushConstants))),
+                };
+                const auto computeLayoutInfo = VkPipelineLayoutCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+                    .pushConstantRangeCount = 1,
+                    .pPushConstantRanges = &computeRange,
+                };
+
+                const auto computeResult = vkCreatePipelineLayout(m_device, &computeLayoutInfo, m_allocator, &m_computePipelineLayout);
+                if (computeResult != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create particle compute pipeline layout!");
+                }
+
+                const auto drawRange = VkPushConstantRange {
+                    .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+                    .offset = 0,
+                    .size = sizeof(DrawPushConstants),
+                };
+                const auto drawLayoutInfo = VkPipelineLayoutCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+                    .pushConstantRangeCount = 1,
+                    .pPushConstantRanges = &drawRange,
+                };
+
+                const auto drawResult = vkCreatePipelineLayout(m_device, &drawLayoutInfo, m_allocator, &m_drawPipelineLayout);
+                if (drawResult != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create particle draw pipeline layout!");
+                }
+            }
+
+            VkPipeline createComputePipeline(const char* shaderName) const {
+                auto constants = vk_pipelines::SpecializationConstants {};
+                constants.set(WORKGROUP_SIZE_ID, m_workgroupSize);
+                const auto pipelineInfo = VkComputePipelineCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+                    .stage = VkPipelineShaderStageCreateInfo {
+                        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                        .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                        .module = m_shaderLibrary->shaderModule(shaderName),
+                        .pName = "main",
+                        .pSpecializationInfo = constants.info(),
+                    },
+                    .layout = m_computePipelineLayout,
+                };
+
+                return m_pipelineRegistry->computePipeline(pipelineInfo);
+            }
+
+            void createComputePipelines() {
+                m_simulatePipeline = this->createComputePipeline("particle_simulate.comp");
+                m_emitPipeline = this->createComputePipeline("particle_emit.comp");
+            }
+
+            // The particles are added onto the scene behind them, tested against its depth
+            // without writing it, so they need no sorting. Only the viewport and scissor are
+            // dynamic, which also overrides whatever state the scene left dynamic.
+            //
+            // The pipeline is requested from the pipeline compiler, and draws unoptimized until
+            // the optimized one has compiled.
+            VkPipeline drawPipeline(VkFormat colorFormat) {
+                const auto existing = std::find_if(m_drawPipelines.begin(), m_drawPipelines.end(), [colorFormat](const auto& entry) {
+                    return entry.first == colorFormat;
+                });
+                if (existing != m_drawPipelines.end()) {
+                    return m_pipelineCompiler->pipeline(existing->second);
+                }
+
+                const auto handle = vk_pipelines::requestGraphicsPipeline(*m_pipelineCompiler, *m_pipelineRegistry, m_device, [this, colorFormat](VkPipelineCreateFlags flags, auto&& create) {
+                    return this->withDrawPipelineInfo(colorFormat, flags, create);
+                });
+                m_drawPipelines.emplace_back(colorFormat, handle);
+
+                return m_pipelineCompiler->pipeline(handle);
+            }
+
+            // Calls `create` with the create info of the draw pipeline for `colorFormat`, which
+            // only lives for the call, with `extraFlags` added to its create flags.
+            template <typename Create>
+            std::invoke_result_t<Create, const VkGraphicsPipelineCreateInfo&> withDrawPipelineInfo(VkFormat colorFormat, VkPipelineCreateFlags extraFlags, Create&& create) const {
+                const auto stage = [this](VkShaderStageFlagBits stage, const char* shaderName) {
+                    return VkPipelineShaderStageCreateInfo {
+                        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                        .stage = stage,
+                        .module = m_shaderLibrary->shaderModule(shaderName),
+                        .pName = "main",
+                    };
+                };
+                const auto stages = std::array {
+                    stage(VK_SHADER_STAGE_VERTEX_BIT, "particle.vert"),
+                    stage(VK_SHADER_STAGE_FRAGMENT_BIT, "particle.frag"),
+                };
+                const auto vertexInputState = VkPipelineVertexInputStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+                };
+                const auto inputAssemblyState = VkPipelineInputAssemblyStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+                    .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+                };
+                const auto viewportState = VkPipelineViewportStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+                    .viewportCount = 1,
+                    .scissorCount = 1,
+                };
+                const auto rasterizationState = VkPipelineRasterizationStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+                    .polygonMode = VK_POLYGON_MODE_FILL,
+                    .cullMode = VK_CULL_MODE_NONE,
+                    .lineWidth = 1.0f,
+                };
+                const auto multisampleState = VkPipelineMultisampleStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+                    .rasterizationSamples = m_samples,
+                };
+                const auto depthStencilState = VkPipelineDepthStencilStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+                    .depthTestEnable = VK_TRUE,
+                    .depthWriteEnable = VK_FALSE,
+                    .depthCompareOp = vk_gpu_driven::DEPTH_COMPARE_OP,
+                };
+                const auto colorBlendAttachment = VkPipelineColorBlendAttachmentState {
+                    .blendEnable = VK_TRUE,
+                    .srcColorBlendFactor = VK_BLEND_FACTOR_ONE,
+                    .dstColorBlendFactor = VK_BLEND_FACTOR_ONE,
+                    .colorBlendOp = VK_BLEND_OP_ADD,
+                    .srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
+                    .dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+                    .alphaBlendOp = VK_BLEND_OP_ADD,
+                    .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+                };
+                const auto colorBlendState = VkPipelineColorBlendStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+                    .attachmentCount = 1,
+                    .pAttachments = &colorBlendAttachment,
+                };
+                auto dynamicStates = std::vector { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+                if (m_shadingRate.has_value()) {
+                    dynamicStates.push_back(VK_DYNAMIC_STATE_FRAGMENT_SHADING_RATE_KHR);
+                }
+                const auto dynamicState = VkPipelineDynamicStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+                    .dynamicStateCount = static_cast<uint32_t>(dynamicStates.size()),
+                    .pDynamicStates = dynamicStates.data(),
+                };
+                const auto renderingInfo = VkPipelineRenderingCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
+                    .colorAttachmentCount = 1,
+                    .pColorAttachmentFormats = &colorFormat,
+                    .depthAttachmentFormat = m_depthFormat,
+                };
+                const auto pipelineInfo = VkGraphicsPipelineCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+                    .pNext = &renderingInfo,
+                    .flags = extraFlags | (m_shadingRate.has_value() && m_shadingRate->attachment
+                        ? VkPipelineCreateFlags { VK_PIPELINE_CREATE_RENDERING_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR }
+                        : VkPipelineCreateFlags { 0 }),
+                    .stageCount = static_cast<uint32_t>(stages.size()),
+                    .pStages = stages.data(),
+                    .pVertexInputState = &vertexInputState,
+                    .pInputAssemblyState = &inputAssemblyState,
+                    .pViewportState = &viewportState,
+                    .pRasterizationState = &rasterizationState,
+                    .pMultisampleState = &multisampleState,
+                    .pDepthStencilState = &depthStencilState,
+                    .pColorBlendState = &colorBlendState,
+                    .pDynamicState = &dynamicState,
+                    .layout = m_drawPipelineLayout,
+                };
+
+                return create(pipelineInfo);
+            }
+
+            // Grid stride loops cover whatever one dispatch along x cannot.
+            uint32_t workgroupCount(uint32_t count) const {
+                return std::clamp((count + m_workgroupSize - 1) / m_workgroupSize, 1u, vk_gpu_primitives::MAX_WORKGROUP_COUNT);
+            }
+
+            void recordSimulation(VkCommandBuffer commandBuffer, uint32_t source, uint32_t destination) {
+                if (m_frameCount == 0) {
+                    vkCmdFillBuffer(commandBuffer, m_state.buffer, 0, VK_WHOLE_SIZE, 0);
+                    vk_gpu_primitives::recordComputeDependency(commandBuffer, VK_PIPELINE_STAGE_2_CLEAR_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT);
+                }
+
+                const auto simulate = SimulatePushConstants {
+                    .particles = m_particles[source].address,
+                    .alive = m_alive.address,
+                    .state = m_state.address,
+                    .deltaTime = SIMULATION_STEP,
+                    .capacity = m_capacity,
+                    .gravity = glm::vec4 { m_settings.gravity, 0.0f },
+                };
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_simulatePipeline);
+                vkCmdPushConstants(commandBuffer, m_computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SimulatePushConstants), &simulate);
+                vkCmdDispatch(commandBuffer, this->workgroupCount(m_capacity), 1, 1);
+
+                m_primitives->recordCompact(
+                    commandBuffer,
+                    m_particles[source].address,
+                    m_alive.address,
+                    m_capacity,
+                    m_particles[destination].address,
+                    m_state.address + offsetof(ParticleState, survivorCount),
+                    PARTICLE_WORDS
+                );
+                vk_gpu_primitives::recordComputeDependency(commandBuffer);
+
+                const auto emitted = m_settings.rate * m_emissionScale * SIMULATION_STEP + m_emitRemainder;
+                const auto emitCount = static_cast<uint32_t>(std::min(std::floor(emitted), static_cast<float>(m_capacity)));
+                m_emitRemainder = emitted - std::floor(emitted);
+
+                const auto emit = EmitPushConstants {
+                    .particles = m_particles[destination].address,
+                    .state = m_state.address,
+                    .origin = glm::vec4 { m_settings.position, 0.0f },
+                    .emitCount = emitCount,
+                    .seed = static_cast<uint32_t>(m_frameCount * 0x9e3779b9u),
+                    .capacity = m_capacity,
+                    .speed = m_settings.speed,
+                    .lifetime = m_settings.lifetime,
+                };
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_emitPipeline);
+                vkCmdPushConstants(commandBuffer, m_computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(EmitPushConstants), &emit);
+                vkCmdDispatch(commandBuffer, this->workgroupCount(emitCount), 1, 1);
+
+                m_current = destination;
+                m_frameCount++;
+            }
+    };
+}
@@ -0,0 +1,204 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "vk_log.h"
+
+
+namespace vk_pipeline_cache {
+    // Prepended to the blob returned by `vkGetPipelineCacheData`. The blob carries
+    // `pipelineCacheUUID` itself, but not the driver version, and nothing guards against a
+    // truncated or corrupted file, so those are checked here before the driver ever sees it.
+    struct FileHeader {
+        std::array<char, 8> magic;
+        uint32_t version;
+        uint32_t vendorID;
+        uint32_t deviceID;
+        uint32_t driverVersion;
+        std::array<uint8_t, VK_UUID_SIZE> pipelineCacheUUID;
+        uint64_t dataSize;
+        uint64_t dataChecksum;
+    };
+
+    constexpr auto FILE_MAGIC = std::array<char, 8> { 'V', 'K', 'P', 'C', 'A', 'C', 'H', 'E' };
+    constexpr uint32_t FILE_VERSION = 1;
+
+    // FNV-1a, which is plenty to catch a torn write.
+    inline uint64_t checksum(const uint8_t* data, size_t size) {
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < size; i++) {
+            hash ^= data[i];
+            hash *= 1099511628211ull;
+        }
+
+        return hash;
+    }
+
+    inline std::string cacheFileName(const VkPhysicalDeviceProperties& properties) {
+        auto uuid = std::string {};
+        for (const auto byte : properties.pipelineCacheUUID) {
+            uuid += fmt::format("{:02x}", byte);
+        }
+
+        return fmt::format("pipeline_cache_{:04x}_{:04x}_{}.bin", properties.vendorID, properties.deviceID, uuid);
+    }
+
+    // A `VkPipelineCache` backed by a file per device. Loading falls back to an empty cache
+    // whenever the file is missing or does not match the device and driver exactly, and saving
+    // writes to a temporary file that is renamed over the old one, so a crash mid-write never
+    // leaves a half written cache behind.
+    class PipelineCache {
+        public:
+            explicit PipelineCache() = default;
+
+            PipelineCache(const PipelineCache& other) = delete;
+            PipelineCache& operator=(const PipelineCache& other) = delete;
+
+            void load(VkDevice device, const VkPhysicalDeviceProperties& properties, const std::filesystem::path& directory) {
+                this->read(properties, directory);
+                this->create(device);
+            }
+
+            // The file only depends on the physical device, so it can be read while the logical
+            // device is still being created.
+            void read(const VkPhysicalDeviceProperties& properties, const std::filesystem::path& directory) {
+                m_properties = properties;
+                m_path = directory / cacheFileName(properties);
+                m_initialData = this->readCacheFile();
+            }
+
+            // Create the cache from the data `read` found.
+            void create(VkDevice device) {
+                m_device = device;
+                const auto createInfo = VkPipelineCacheCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+                    .initialDataSize = m_initialData.size(),
+                    .pInitialData = m_initialData.empty() ? nullptr : m_initialData.data(),
+                };
+
+                const auto result = vkCreatePipelineCache(m_device, &createInfo, nullptr, &m_pipelineCache);
+                m_initialData = {};
+                if (result != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create pipeline cache!");
+                }
+            }
+
+            void save() const {
+                if (m_pipelineCache == VK_NULL_HANDLE) {
+                    return;
+                }
+
+                size_t dataSize = 0;
+                if (vkGetPipelineCacheData(m_device, m_pipelineCache, &dataSize, nullptr) != VK_SUCCESS) {
+                    return;
+                }
+
+                auto data = std::vector<uint8_t>(dataSize);
+                if (vkGetPipelineCacheData(m_device, m_pipelineCache, &dataSize, data.data()) != VK_SUCCESS) {
+                    return;
+                }
+
+                data.resize(dataSize);
+
+                auto header = FileHeader {
+                    .magic = FILE_MAGIC,
+                    .version = FILE_VERSION,
+                    .vendorID = m_properties.vendorID,
+                    .deviceID = m_properties.deviceID,
+                    .driverVersion = m_properties.driverVersion,
+                    .pipelineCacheUUID = {},
+                    .dataSize = data.size(),
+                    .dataChecksum = checksum(data.data(), data.size()),
+                };
+                std::memcpy(header.pipelineCacheUUID.data(), m_properties.pipelineCacheUUID, VK_UUID_SIZE);
+
+                auto temporaryPath = m_path;
+                temporaryPath += ".tmp";
+                {
+                    auto file = std::ofstream { temporaryPath, std::ios::binary | std::ios::trunc };
+                    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+                    file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+                    if (!file) {
+                        VK_LOG_WARNING("failed to write pipeline cache `{}`", temporaryPath.string());
+                        return;
+                    }
+                }
+
+                auto error = std::error_code {};
+                std::filesystem::rename(temporaryPath, m_path, error);
+                if (error) {
+                    VK_LOG_WARNING("failed to replace pipeline cache `{}`: {}", m_path.string(), error.message());
+                    std::filesystem::remove(temporaryPath, error);
+                }
+            }
+
+            void destroy() {
+                if (m_pipelineCache != VK_NULL_HANDLE) {
+                    vkDestroyPipelineCache(m_device, m_pipelineCache, nullptr);
+                    m_pipelineCache = VK_NULL_HANDLE;
+                }
+            }
+
+            VkPipelineCache handle() const {
+                return m_pipelineCache;
+            }
+        private:
+            VkDevice m_device = VK_NULL_HANDLE;
+            VkPhysicalDeviceProperties m_properties = {};
+            std::filesystem::path m_path;
+            VkPipelineCache m_pipelineCache = VK_NULL_HANDLE;
+            std::vector<uint8_t> m_initialData;
+
+            std::vector<uint8_t> readCacheFile() const {
+                auto file = std::ifstream { m_path, std::ios::binary };
+                if (!file) {
+                    return {};
+                }
+
+                const auto contents = std::vector<uint8_t> { std::istreambuf_iterator<char> { file }, std::istreambuf_iterator<char> {} };
+                if (contents.size() < sizeof(FileHeader)) {
+                    return this->rejectCacheFile("truncated header");
+                }
+
+                auto header = FileHeader {};
+                std::memcpy(&header, contents.data(), sizeof(header));
+                if (header.magic != FILE_MAGIC || header.version != FILE_VERSION) {
+                    return this->rejectCacheFile("unknown format");
+                }
+
+                const bool sameDevice = header.vendorID == m_properties.vendorID
+                    && header.deviceID == m_properties.deviceID
+                    && header.driverVersion == m_properties.driverVersion
+                    && std::memcmp(header.pipelineCacheUUID.data(), m_properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+                if (!sameDevice) {
+                    return this->rejectCacheFile("written by a different device or driver");
+                }
+
+                const auto data = std::vector<uint8_t> { contents.begin() + sizeof(FileHeader), contents.end() };
+                if (data.size() != header.dataSize || checksum(data.data(), data.size()) != header.dataChecksum) {
+                    return this->rejectCacheFile("corrupted data");
+                }
+
+                return data;
+            }
+
+            std::vector<uint8_t> rejectCacheFile(const char* reason) const {
+                VK_LOG_WARNING("ignoring pipeline cache `{}`: {}", m_path.string(), reason);
+
+                return {};
+            }
+    };
+}
@@ -0,0 +1,700 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "vk_jobs.h"
+
+
+namespace vk_pipelines {
+    // Creates one graphics or compute pipeline with the given extra create flags. The builder
+    // owns whatever the create info points to, since it may run on a worker thread after the
+    // caller has moved on.
+    using PipelineBuilder = std::function<VkResult(VkPipelineCreateFlags flags, VkPipelineCache pipelineCache, VkPipeline* pipeline)>;
+
+    using PipelineHandle = uint32_t;
+
+    // Compiles pipelines on the job system so the first use of a material never stalls a frame.
+    //
+    // A request first tries the pipeline cache with
+    // `VK_PIPELINE_CREATE_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT`, which either returns a
+    // pipeline right away or fails fast with `VK_PIPELINE_COMPILE_REQUIRED`. Only then is the
+    // full compile queued on a worker, and until it lands `pipeline` hands out the fallback the
+    // caller provided, typically a simpler variant that is already compiled, or the same one
+    // built without optimizations as `requestGraphicsPipeline` does.
+    class PipelineCompiler {
+        public:
+            explicit PipelineCompiler() = default;
+
+            PipelineCompiler(const PipelineCompiler& other) = delete;
+            PipelineCompiler& operator=(const PipelineCompiler& other) = delete;
+
+            void init(VkDevice device, VkPipelineCache pipelineCache, vk_jobs::JobSystem& jobSystem, bool pipelineCreationCacheControl) {
+                m_device = device;
+                m_pipelineCache = pipelineCache;
+                m_jobSystem = &jobSystem;
+                m_pipelineCreationCacheControl = pipelineCreationCacheControl;
+            }
+
+            // Wait for compiles still in flight, then destroy every pipeline created here. The
+            // fallback pipelines belong to the caller.
+            void destroy() {
+                auto entries = std::vector<std::unique_ptr<Entry>> {};
+                {
+                    const auto lock = std::scoped_lock { m_mutex };
+                    entries.swap(m_entries);
+                }
+
+                for (auto& entry : entries) {
+                    m_jobSystem->wait(entry->job);
+
+                    const auto pipeline = entry->pipeline.load(std::memory_order_acquire);
+                    if (pipeline != VK_NULL_HANDLE) {
+                        vkDestroyPipeline(m_device, pipeline, nullptr);
+                    }
+                }
+            }
+
+            PipelineHandle request(PipelineBuilder builder, VkPipeline fallback) {
+                auto entry = std::make_unique<Entry>();
+                entry->fallback = fallback;
+
+                if (m_pipelineCreationCacheControl) {
+                    auto pipeline = VkPipeline {};
+                    const auto result = builder(VK_PIPELINE_CREATE_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT, m_pipelineCache, &pipeline);
+                    if (result == VK_SUCCESS) {
+                        entry->pipeline.store(pipeline, std::memory_order_release);
+                    } else if (result != VK_PIPELINE_COMPILE_REQUIRED) {
+                        throw std::runtime_error("failed to create pipeline!");
+                    }
+                }
+
+                if (entry->pipeline.load(std::memory_order_relaxed) == VK_NULL_HANDLE) {
+                    auto* target = entry.get();
+                    entry->job = m_jobSystem->submit([this, target, builder = std::move(builder)]() {
+                        auto pipeline = VkPipeline {};
+                        const auto result = builder(0, m_pipelineCache, &pipeline);
+                        if (result == VK_SUCCESS) {
+                            target->pipeline.store(pipeline, std::memory_order_release);
+                        } else {
+                            target->failed.store(true, std::memory_order_release);
+                        }
+                    }, {}, vk_jobs::JobPriority::Background);
+                }
+
+                const auto lock = std::scoped_lock { m_mutex };
+                m_entries.push_back(std::move(entry));
+
+                return static_cast<PipelineHandle>(m_entries.size() - 1);
+            }
+
+            // The optimized pipeline once it has compiled, the fallback until then, or for good
+            // when the compile failed.
+            VkPipeline pipeline(PipelineHandle handle) const {
+                const auto lock = std::scoped_lock { m_mutex };
+                const auto& entry = m_entries[handle];
+                const auto pipeline = entry->pipeline.load(std::memory_order_acquire);
+
+                return pipeline != VK_NULL_HANDLE ? pipeline : entry->fallback;
+            }
+
+            bool isReady(PipelineHandle handle) const {
+                const auto lock = std::scoped_lock { m_mutex };
+
+                return m_entries[handle]->pipeline.load(std::memory_order_acquire) != VK_NULL_HANDLE;
+            }
+
+            bool hasFailed(PipelineHandle handle) const {
+                const auto lock = std::scoped_lock { m_mutex };
+
+                return m_entries[handle]->failed.load(std::memory_order_acquire);
+            }
+        private:
+            struct Entry {
+                std::atomic<VkPipeline> pipeline = VK_NULL_HANDLE;
+                std::atomic<bool> failed = false;
+                VkPipeline fallback = VK_NULL_HANDLE;
+                vk_jobs::JobHandle job;
+            };
+
+            VkDevice m_device = VK_NULL_HANDLE;
+            VkPipelineCache m_pipelineCache = VK_NULL_HANDLE;
+            vk_jobs::JobSystem* m_jobSystem = nullptr;
+            bool m_pipelineCreationCacheControl = false;
+
+            mutable std::mutex m_mutex;
+            std::vector<std::unique_ptr<Entry>> m_entries;
+    };
+
+    // The specialization constants of one shader stage, which pin values the stage would
+    // otherwise take from a preprocessor define, so that one SPIR-V module serves every variant
+    // and the driver still folds the constants when it creates the pipeline. Booleans are
+    // stored as `VkBool32`, as SPIR-V expects.
+    class SpecializationConstants {
+        public:
+            explicit SpecializationConstants() = default;
+
+            SpecializationConstants& set(uint32_t constantID, uint32_t value) {
+                return this->append(constantID, &value, sizeof(value));
+            }
+
+            SpecializationConstants& set(uint32_t constantID, int32_t value) {
+                return this->append(constantID, &value, sizeof(value));
+            }
+
+            SpecializationConstants& set(uint32_t constantID, float value) {
+                return this->append(constantID, &value, sizeof(value));
+            }
+
+            SpecializationConstants& set(uint32_t constantID, bool value) {
+                return this->set(constantID, static_cast<uint32_t>(value ? VK_TRUE : VK_FALSE));
+            }
+
+            // Null without any constants. Points into this object, which has to outlive the
+            // creation of the pipelines or shader objects it is passed to, and to stay unchanged
+            // until then.
+            const VkSpecializationInfo* info() {
+                if (m_entries.empty()) {
+                    return nullptr;
+                }
+
+                m_info = VkSpecializationInfo {
+                    .mapEntryCount = static_cast<uint32_t>(m_entries.size()),
+                    .pMapEntries = m_entries.data(),
+                    .dataSize = m_data.size(),
+                    .pData = m_data.data(),
+                };
+
+                return &m_info;
+            }
+        private:
+            std::vector<VkSpecializationMapEntry> m_entries;
+            std::vector<std::byte> m_data;
+            VkSpecializationInfo m_info {};
+
+            SpecializationConstants& append(uint32_t constantID, const void* value, size_t size) {
+                m_entries.push_back(VkSpecializationMapEntry {
+                    .constantID = constantID,
+                    .offset = static_cast<uint32_t>(m_data.size()),
+                    .size = size,
+                });
+                const auto bytes = static_cast<const std::byte*>(value);
+                m_data.insert(m_data.end(), bytes, bytes + size);
+
+                return *this;
+            }
+    };
+
+    // Fixed function state that pipelines leave dynamic and draws set on the command buffer
+    // instead, so that pipelines differing only in it are one pipeline. Vulkan 1.3 makes the
+    // rasterization, depth and input assembly state of extended dynamic state 1 and 2 core, and
+    // `VK_EXT_extended_dynamic_state3` adds the blend state of the first color attachment.
+    struct DynamicRasterState {
+        VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+        VkFrontFace frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+        VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        bool depthTest = true;
+        bool depthWrite = true;
+        VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS;
+        bool depthBias = false;
+        bool blend = false;
+        VkColorBlendEquationEXT blendEquation {
+            .srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA,
+            .dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+            .colorBlendOp = VK_BLEND_OP_ADD,
+            .srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+            .dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
+            .alphaBlendOp = VK_BLEND_OP_ADD,
+        };
+        VkColorComponentFlags colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    };
+
+    // Which of `DynamicRasterState` a pipeline leaves dynamic. Mesh shading pipelines have no
+    // input assembly, whose states they must not list.
+    struct DynamicRasterStates {
+        bool inputAssembly = true;
+        bool blend = false;
+    };
+
+    // The dynamic states of a pipeline drawn with `setDynamicRasterState`, viewport and scissor
+    // included.
+    inline std::vector<VkDynamicState> dynamicRasterStates(DynamicRasterStates states) {
+        auto dynamicStates = std::vector {
+            VK_DYNAMIC_STATE_VIEWPORT,
+            VK_DYNAMIC_STATE_SCISSOR,
+            VK_DYNAMIC_STATE_CULL_MODE,
+            VK_DYNAMIC_STATE_FRONT_FACE,
+            VK_DYNAMIC_STATE_RASTERIZER_DISCARD_ENABLE,
+            VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE,
+            VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE,
+            VK_DYNAMIC_STATE_DEPTH_COMPARE_OP,
+            VK_DYNAMIC_STATE_DEPTH_BIAS_ENABLE,
+        };
+        if (states.inputAssembly) {
+            dynamicStates.push_back(VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY);
+            dynamicStates.push_back(VK_DYNAMIC_STATE_PRIMITIVE_RESTART_ENABLE);
+        }
+
+        if (states.blend) {
+            dynamicStates.push_back(VK_DYNAMIC_STATE_COLOR_BLEND_ENABLE_EXT);
+            dynamicStates.push_back(VK_DYNAMIC_STATE_COLOR_BLEND_EQUATION_EXT);
+            dynamicStates.push_back(VK_DYNAMIC_STATE_COLOR_WRITE_MASK_EXT);
+        }
+
+        return dynamicStates;
+    }
+
+    // Every state `dynamicRasterStates(states)` lists but viewport and scissor. Primitive
+    // restart and rasterizer discard stay off.
+    inline void setDynamicRasterState(VkCommandBuffer commandBuffer, const DynamicRasterState& state, DynamicRasterStates states) {
+        vkCmdSetCullMode(commandBuffer, state.cullMode);
+        vkCmdSetFrontFace(commandBuffer, state.frontFace);
+        vkCmdSetRasterizerDiscardEnable(commandBuffer, VK_FALSE);
+        vkCmdSetDepthTestEnable(commandBuffer, state.depthTest ? VK_TRUE : VK_FALSE);
+        vkCmdSetDepthWriteEnable(commandBuffer, state.depthWrite ? VK_TRUE : VK_FALSE);
+        vkCmdSetDepthCompareOp(commandBuffer, state.depthCompareOp);
+        vkCmdSetDepthBiasEnable(commandBuffer, state.depthBias ? VK_TRUE : VK_FALSE);
+        if (states.inputAssembly) {
+            vkCmdSetPrimitiveTopology(commandBuffer, state.topology);
+            vkCmdSetPrimitiveRestartEnable(commandBuffer, VK_FALSE);
+        }
+
+        if (states.blend) {
+            const auto blend = static_cast<VkBool32>(state.blend);
+            vkCmdSetColorBlendEnableEXT(commandBuffer, 0, 1, &blend);
+            vkCmdSetColorBlendEquationEXT(commandBuffer, 0, 1, &state.blendEquation);
+            vkCmdSetColorWriteMaskEXT(commandBuffer, 0, 1, &state.colorWriteMask);
+        }
+    }
+
+    // The state that drawing with shader objects needs set on top of `setDynamicRasterState`,
+    // which a pipeline would have baked in: one viewport and scissor, filled polygons with
+    // `samples` samples and every one of them covered, and no stencil test or alpha to
+    // coverage. Vertex input is left to the caller.
+    inline void setShaderObjectState(VkCommandBuffer commandBuffer, const VkViewport& viewport, const VkRect2D& scissor, VkSampleCountFlagBits samples) {
+        const auto sampleMask = std::array<VkSampleMask, 2> { ~0u, ~0u };
+        vkCmdSetViewportWithCount(commandBuffer, 1, &viewport);
+        vkCmdSetScissorWithCount(commandBuffer, 1, &scissor);
+        vkCmdSetPolygonModeEXT(commandBuffer, VK_POLYGON_MODE_FILL);
+        vkCmdSetRasterizationSamplesEXT(commandBuffer, samples);
+        vkCmdSetSampleMaskEXT(commandBuffer, samples, sampleMask.data());
+        vkCmdSetAlphaToCoverageEnableEXT(commandBuffer, VK_FALSE);
+        vkCmdSetStencilTestEnable(commandBuffer, VK_FALSE);
+    }
+
+    // FNV-1a, fed one field at a time so that struct padding never reaches the hash.
+    class StateHasher {
+        public:
+            template <typename T>
+                requires std::is_scalar_v<T>
+            void add(T value) {
+                this->addBytes(&value, sizeof(value));
+            }
+
+            void add(const char* string) {
+                this->addBytes(string, string != nullptr ? std::strlen(string) + 1 : 0);
+            }
+
+            void addBytes(const void* data, size_t size) {
+                const auto* bytes = static_cast<const uint8_t*>(data);
+                for (size_t i = 0; i < size; i++) {
+                    m_hash ^= bytes[i];
+                    m_hash *= 1099511628211ull;
+                }
+            }
+
+            uint64_t value() const {
+                return m_hash;
+            }
+        private:
+            uint64_t m_hash = 14695981039346656037ull;
+    };
+
+    // The hash of the SPIR-V a shader module was created from, or zero when it is not known.
+    using ShaderCodeHash = std::function<uint64_t(VkShaderModule shaderModule)>;
+
+    // A module is hashed by its code where `codeHash` knows it, and by its handle otherwise.
+    inline void hashShaderStage(StateHasher& hasher, const VkPipelineShaderStageCreateInfo& stage, const ShaderCodeHash& codeHash) {
+        hasher.add(stage.flags);
+        hasher.add(stage.stage);
+        const auto code = codeHash ? codeHash(stage.module) : 0;
+        if (code != 0) {
+            hasher.add(code);
+        } else {
+            hasher.add(stage.module);
+        }
+        hasher.add(stage.pName);
+        for (auto* next = static_cast<const VkBaseInStructure*>(stage.pNext); next != nullptr; next = next->pNext) {
+            hasher.add(next->sType);
+            if (next->sType == VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_REQUIRED_SUBGROUP_SIZE_CREATE_INFO) {
+                hasher.add(reinterpret_cast<const VkPipelineShaderStageRequiredSubgroupSizeCreateInfo*>(next)->requiredSubgroupSize);
+            }
+        }
+        hasher.add(stage.pSpecializationInfo != nullptr);
+        if (stage.pSpecializationInfo == nullptr) {
+            return;
+        }
+
+        const auto& specialization = *stage.pSpecializationInfo;
+        for (uint32_t i = 0; i < specialization.mapEntryCount; i++) {
+            hasher.add(specialization.pMapEntries[i].constantID);
+            hasher.add(specialization.pMapEntries[i].offset);
+            hasher.add(specialization.pMapEntries[i].size);
+        }
+
+        hasher.addBytes(specialization.pData, specialization.dataSize);
+    }
+
+    inline void hashStencilOp(StateHasher& hasher, const VkStencilOpState& state) {
+        hasher.add(state.failOp);
+        hasher.add(state.passOp);
+        hasher.add(state.depthFailOp);
+        hasher.add(state.compareOp);
+        hasher.add(state.compareMask);
+        hasher.add(state.writeMask);
+        hasher.add(state.reference);
+    }
+
+    inline void hashRasterState(StateHasher& hasher, const DynamicRasterState& state) {
+        hasher.add(state.cullMode);
+        hasher.add(state.frontFace);
+        hasher.add(state.topology);
+        hasher.add(state.depthTest);
+        hasher.add(state.depthWrite);
+        hasher.add(state.depthCompareOp);
+        hasher.add(state.depthBias);
+        hasher.add(state.blend);
+        hasher.add(state.blendEquation.srcColorBlendFactor);
+        hasher.add(state.blendEquation.dstColorBlendFactor);
+        hasher.add(state.blendEquation.colorBlendOp);
+        hasher.add(state.blendEquation.srcAlphaBlendFactor);
+        hasher.add(state.blendEquation.dstAlphaBlendFactor);
+        hasher.add(state.blendEquation.alphaBlendOp);
+        hasher.add(state.colorWriteMask);
+    }
+
+    // Dynamic topologies may only switch within the class the pipeline was created with.
+    inline uint32_t topologyClass(VkPrimitiveTopology topology) {
+        switch (topology) {
+            case VK_PRIMITIVE_TOPOLOGY_POINT_LIST:
+                return 0;
+            case VK_PRIMITIVE_TOPOLOGY_LINE_LIST:
+            case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP:
+            case VK_PRIMITIVE_TOPOLOGY_LINE_LIST_WITH_ADJACENCY:
+            case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP_WITH_ADJACENCY:
+                return 1;
+            case VK_PRIMITIVE_TOPOLOGY_PATCH_LIST:
+                return 3;
+            default:
+                return 2;
+        }
+    }
+
+    // A stable hash of everything that makes two graphics pipelines differ: the shader stages
+    // with their specialization, the vertex input, the fixed function state, the dynamic
+    // states, the layout and the attachment formats of dynamic rendering. State the pipeline
+    // leaves dynamic is skipped, so requests differing only in it share a pipeline. Of the
+    // other structures chained to the create info only the type is hashed.
+    inline uint64_t hashGraphicsPipeline(const VkGraphicsPipelineCreateInfo& info, const ShaderCodeHash& codeHash = {}) {
+        const auto dynamicStates = info.pDynamicState != nullptr
+            ? std::span { info.pDynamicState->pDynamicStates, info.pDynamicState->dynamicStateCount }
+            : std::span<const VkDynamicState> {};
+        const auto isDynamic = [dynamicStates](VkDynamicState state) {
+            return std::find(dynamicStates.begin(), dynamicStates.end(), state) != dynamicStates.end();
+        };
+
+        auto hasher = StateHasher {};
+        hasher.add(info.flags);
+        for (uint32_t i = 0; i < info.stageCount; i++) {
+            hashShaderStage(hasher, info.pStages[i], codeHash);
+        }
+
+        hasher.add(info.pVertexInputState != nullptr);
+        if (const auto* state = info.pVertexInputState; state != nullptr) {
+            for (uint32_t i = 0; i < state->vertexBindingDescriptionCount; i++) {
+                hasher.add(state->pVertexBindingDescriptions[i].binding);
+                hasher.add(state->pVertexBindingDescriptions[i].stride);
+                hasher.add(state->pVertexBindingDescriptions[i].inputRate);
+            }
+
+            for (uint32_t i = 0; i < state->vertexAttributeDescriptionCount; i++) {
+                hasher.add(state->pVertexAttributeDescriptions[i].location);
+                hasher.add(state->pVertexAttributeDescriptions[i].binding);
+                hasher.add(state->pVertexAttributeDescriptions[i].format);
+                hasher.add(state->pVertexAttributeDescriptions[i].offset);
+            }
+        }
+
+        hasher.add(info.pInputAssemblyState != nullptr);
+        if (const auto* state = info.pInputAssemblyState; state != nullptr) {
+            hasher.add(isDynamic(VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY) ? topologyClass(state->topology) : static_cast<uint32_t>(state->topology));
+            hasher.add(isDynamic(VK_DYNAMIC_STATE_PRIMITIVE_RESTART_ENABLE) ? VK_FALSE : state->primitiveRestartEnable);
+        }
+
+        hasher.add(info.pViewportState != nullptr);
+        if (const auto* state = info.pViewportState; state != nullptr) {
+            hasher.add(state->viewportCount);
+            hasher.add(state->scissorCount);
+            if (state->pViewports != nullptr && !isDynamic(VK_DYNAMIC_STATE_VIEWPORT)) {
+                hasher.addBytes(state->pViewports, state->viewportCount * sizeof(VkViewport));
+            }
+            if (state->pScissors != nullptr && !isDynamic(VK_DYNAMIC_STATE_SCISSOR)) {
+                hasher.addBytes(state->pScissors, state->scissorCount * sizeof(VkRect2D));
+            }
+        }
+
+        hasher.add(info.pRasterizationState != nullptr);
+        if (const auto* state = info.pRasterizationState; state != nullptr) {
+            hasher.add(state->depthClampEnable);
+            hasher.add(isDynamic(VK_DYNAMIC_STATE_RASTERIZER_DISCARD_ENABLE) ? VK_FALSE : state->rasterizerDiscardEnable);
+            hasher.add(state->polygonMode);
+            hasher.add(isDynamic(VK_DYNAMIC_STATE_CULL_MODE) ? 0 : state->cullMode);
+            hasher.add(isDynamic(VK_DYNAMIC_STATE_FRONT_FACE) ? VK_FRONT_FACE_COUNTER_CLOCKWISE : state->frontFace);
+            hasher.add(isDynamic(VK_DYNAMIC_STATE_DEPTH_BIAS_ENABLE) ? VK_FALSE : state->depthBiasEnable);
+            hasher.add(state->depthBiasConstantFactor);
+            hasher.add(state->depthBiasClamp);
+            hasher.add(state->depthBiasSlopeFactor);
+            hasher.add(state->lineWidth);
+        }
+
+        hasher.add(info.pMultisampleState != nullptr);
+        if (const auto* state = info.pMultisampleState; state != nullptr) {
+            hasher.add(state->rasterizationSamples);
+            hasher.add(state->sampleShadingEnable);
+            hasher.add(state->minSampleShading);
+            hasher.add(state->alphaToCoverageEnable);
+            hasher.add(state->alphaToOneEnable);
+            if (state->pSampleMask != nullptr) {
+                hasher.addBytes(state->pSampleMask, (state->rasterizationSamples + 31) / 32 * sizeof(VkSampleMask));
+            }
+        }
+
+        hasher.add(info.pDepthStencilState != nullptr);
+        if (const auto* state = info.pDepthStencilState; state != nullptr) {
+            hasher.add(isDynamic(VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE) ? VK_FALSE : state->depthTestEnable);
+            hasher.add(isDynamic(VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE) ? VK_FALSE : state->depthWriteEnable);
+            hasher.add(isDynamic(VK_DYNAMIC_STATE_DEPTH_COMPARE_OP) ? VK_COMPARE_OP_NEVER : state->depthCompareOp);
+            hasher.add(state->depthBoundsTestEnable);
+            hasher.add(state->stencilTestEnable);
+            hashStencilOp(hasher, state->front);
+            hashStencilOp(hasher, state->back);
+            hasher.add(state->minDepthBounds);
+            hasher.add(state->maxDepthBounds);
+        }
+
+        hasher.add(info.pColorBlendState != nullptr);
+        if (const auto* state = info.pColorBlendState; state != nullptr) {
+            hasher.add(state->logicOpEnable);
+            hasher.add(state->logicOp);
+            hasher.add(state->attachmentCount);
+            const auto dynamicBlendEnable = isDynamic(VK_DYNAMIC_STATE_COLOR_BLEND_ENABLE_EXT);
+            const auto dynamicBlendEquation = isDynamic(VK_DYNAMIC_STATE_COLOR_BLEND_EQUATION_EXT);
+            const auto dynamicWriteMask = isDynamic(VK_DYNAMIC_STATE_COLOR_WRITE_MASK_EXT);
+            for (uint32_t i = 0; i < state->attachmentCount && state->pAttachments != nullptr; i++) {
+                const auto& attachment = state->pAttachments[i];
+                if (!dynamicBlendEnable) {
+                    hasher.add(attachment.blendEnable);
+                }
+                if (!dynamicBlendEquation) {
+                    hasher.add(attachment.srcColorBlendFactor);
+                    hasher.add(attachment.dstColorBlendFactor);
+                    hasher.add(attachment.colorBlendOp);
+                    hasher.add(attachment.srcAlphaBlendFactor);
+                    hasher.add(attachment.dstAlphaBlendFactor);
+                    hasher.add(attachment.alphaBlendOp);
+                }
+                if (!dynamicWriteMask) {
+                    hasher.add(attachment.colorWriteMask);
+                }
+            }
+
+            for (const auto constant : state->blendConstants) {
+                hasher.add(constant);
+            }
+        }
+
+        hasher.add(info.pDynamicState != nullptr);
+        if (const auto* state = info.pDynamicState; state != nullptr) {
+            for (uint32_t i = 0; i < state->dynamicStateCount; i++) {
+                hasher.add(state->pDynamicStates[i]);
+            }
+        }
+
+        hasher.add(info.layout);
+        hasher.add(info.renderPass);
+        hasher.add(info.subpass);
+
+        for (auto* next = static_cast<const VkBaseInStructure*>(info.pNext); next != nullptr; next = next->pNext) {
+            hasher.add(next->sType);
+            if (next->sType == VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO) {
+                const auto* rendering = reinterpret_cast<const VkPipelineRenderingCreateInfo*>(next);
+                hasher.add(rendering->viewMask);
+                for (uint32_t i = 0; i < rendering->colorAttachmentCount; i++) {
+                    hasher.add(rendering->pColorAttachmentFormats[i]);
+                }
+
+                hasher.add(rendering->depthAttachmentFormat);
+                hasher.add(rendering->stencilAttachmentFormat);
+            } else if (next->sType == VK_STRUCTURE_TYPE_PIPELINE_CREATE_FLAGS_2_CREATE_INFO_KHR) {
+                hasher.add(reinterpret_cast<const VkPipelineCreateFlags2CreateInfoKHR*>(next)->flags);
+            }
+        }
+
+        return hasher.value();
+    }
+
+    inline uint64_t hashComputePipeline(const VkComputePipelineCreateInfo& info, const ShaderCodeHash& codeHash = {}) {
+        auto hasher = StateHasher {};
+        hasher.add(info.flags);
+        hashShaderStage(hasher, info.stage, codeHash);
+        hasher.add(info.layout);
+
+        return hasher.value();
+    }
+
+    // Hands out one `VkPipeline` per distinct pipeline state, keyed by `hashGraphicsPipeline` and
+    // `hashComputePipeline`, and compiles each through the on-disk pipeline cache only once. A
+    // request for a pipeline another thread is still compiling waits for that compile instead of
+    // starting its own. Shader modules are keyed by the hash of their SPIR-V, so a handle the
+    // driver hands out again after a reload never answers with a pipeline of the old code.
+    // Layouts are keyed by handle, so one must not be destroyed and recreated while pipelines
+    // built from it may still be requested. The registry owns the pipelines.
+    class PipelineRegistry {
+        public:
+            explicit PipelineRegistry() = default;
+
+            PipelineRegistry(const PipelineRegistry& other) = delete;
+            PipelineRegistry& operator=(const PipelineRegistry& other) = delete;
+
+            // `codeHash` has to be safe to call from any thread.
+            void init(VkDevice device, VkPipelineCache pipelineCache, const VkAllocationCallbacks* allocator, ShaderCodeHash codeHash) {
+                m_device = device;
+                m_pipelineCache = pipelineCache;
+                m_allocator = allocator;
+                m_codeHash = std::move(codeHash);
+            }
+
+            // No request may be in flight.
+            void destroy() {
+                if (m_device == VK_NULL_HANDLE) {
+                    return;
+                }
+
+                for (auto& [key, pipeline] : m_pipelines) {
+                    vkDestroyPipeline(m_device, pipeline.get(), m_allocator);
+                }
+
+                m_pipelines.clear();
+                m_device = VK_NULL_HANDLE;
+            }
+
+            bool isInitialized() const {
+                return m_device != VK_NULL_HANDLE;
+            }
+
+            VkPipeline graphicsPipeline(const VkGraphicsPipelineCreateInfo& info) {
+                return this->findOrCreate(hashGraphicsPipeline(info, m_codeHash), [this, &info](VkPipeline* pipeline) {
+                    return vkCreateGraphicsPipelines(m_device, m_pipelineCache, 1, &info, m_allocator, pipeline);
+                });
+            }
+
+            VkPipeline computePipeline(const VkComputePipelineCreateInfo& info) {
+                return this->findOrCreate(hashComputePipeline(info, m_codeHash), [this, &info](VkPipeline* pipeline) {
+                    return vkCreateComputePipelines(m_device, m_pipelineCache, 1, &info, m_allocator, pipeline);
+                });
+            }
+
+            size_t pipelineCount() const {
+                const auto lock = std::scoped_lock { m_mutex };
+
+                return m_pipelines.size();
+            }
+
+            // Requests answered with a pipeline that already existed or was being compiled.
+            uint64_t hitCount() const {
+                return m_hitCount.load(std::memory_order_relaxed);
+            }
+        private:
+            VkDevice m_device = VK_NULL_HANDLE;
+            VkPipelineCache m_pipelineCache = VK_NULL_HANDLE;
+            const VkAllocationCallbacks* m_allocator = nullptr;
+            ShaderCodeHash m_codeHash;
+
+            mutable std::mutex m_mutex;
+            std::unordered_map<uint64_t, std::shared_future<VkPipeline>> m_pipelines;
+            std::atomic<uint64_t> m_hitCount = 0;
+
+            // The first request for `key` compiles outside the lock, and everyone else waits on
+            // its future. A failed compile is forgotten, so a later request tries again.
+            template <typename Create>
+            VkPipeline findOrCreate(uint64_t key, Create create) {
+                auto promise = std::promise<VkPipeline> {};
+                auto future = std::shared_future<VkPipeline> {};
+                {
+                    const auto lock = std::scoped_lock { m_mutex };
+                    const auto found = m_pipelines.find(key);
+                    if (found != m_pipelines.end()) {
+                        future = found->second;
+                    } else {
+                        m_pipelines.emplace(key, promise.get_future().share());
+                    }
+                }
+
+                if (future.valid()) {
+                    m_hitCount.fetch_add(1, std::memory_order_relaxed);
+
+                    return future.get();
+                }
+
+                auto pipeline = VkPipeline {};
+                const auto result = create(&pipeline);
+                if (result != VK_SUCCESS) {
+                    {
+                        const auto lock = std::scoped_lock { m_mutex };
+                        m_pipelines.erase(key);
+                    }
+
+                    promise.set_exception(std::make_exception_ptr(std::runtime_error("failed to create pipeline!")));
+                    throw std::runtime_error("failed to create pipeline!");
+                }
+
+                promise.set_value(pipeline);
+
+                return pipeline;
+            }
+    };
+
+    // Requests the graphics pipeline `withInfo` describes from `compiler`, behind a fallback that
+    // `registry` creates right away with `VK_PIPELINE_CREATE_DISABLE_OPTIMIZATION_BIT`, which
+    // drivers build in a fraction of the time. `withInfo` is called with the extra create flags
+    // and a function to call with the create info, and is called again on a worker for the
+    // optimized compile, so whatever it reads has to stay alive and unchanged until then.
+    template <typename WithInfo>
+    PipelineHandle requestGraphicsPipeline(PipelineCompiler& compiler, PipelineRegistry& registry, VkDevice device, WithInfo withInfo) {
+        const auto fallback = withInfo(VK_PIPELINE_CREATE_DISABLE_OPTIMIZATION_BIT, [&registry](const VkGraphicsPipelineCreateInfo& info) {
+            return registry.graphicsPipeline(info);
+        });
+
+        return compiler.request([device, withInfo](VkPipelineCreateFlags flags, VkPipelineCache pipelineCache, VkPipeline* pipeline) {
+            return withInfo(flags, [device, pipelineCache, pipeline](const VkGraphicsPipelineCreateInfo& info) {
+                return vkCreateGraphicsPipelines(device, pipelineCache, 1, &info, nullptr, pipeline);
+            });
+        }, fallback);
+    }
+}
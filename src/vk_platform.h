@@ -0,0 +1,76 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <array>
+
+
+namespace vk_platform {
+    enum class Platform {
+        Apple,
+        Linux,
+        Windows,
+        Unknown,
+    };
+
+    constexpr Platform detectOperatingSystem() {
+        #if defined(__APPLE__) || defined(__MACH__)
+        return Platform::Apple;
+        #elif defined(__linux__)
+        return Platform::Linux;
+        #elif defined(_WIN32)
+        return Platform::Windows;
+        #else
+        return Platform::Unknown;
+        #endif
+    }
+
+    // What the renderer does differently on each platform, decided at compile time, so each
+    // binary only carries the path of the platform it was built for.
+    //
+    // * `REQUIRES_PORTABILITY_ENUMERATION` is set where the only implementation is a
+    //   portability one, so `VK_KHR_portability_enumeration` is always enabled instead of
+    //   looked up. Elsewhere it is only enabled when a layered implementation like Dozen
+    //   advertises it.
+    // * `PREFER_FIFO_BY_DEFAULT` makes the power policy the default. MoltenVK implements
+    //   immediate present by turning off display sync on the Metal layer, which tears and burns
+    //   power for no gain in a windowed compositor.
+    // * `PREFERRED_SURFACE_FORMATS` are tried in order before falling back to the first format
+    //   the surface reports. Wayland compositors often only offer the RGBA order.
+    // * `UNIFIED_MEMORY` is set where the GPU shares memory with the CPU, so host visible
+    //   staging memory should also be device local.
+    template <Platform P>
+    struct PlatformTraits {
+        static constexpr bool REQUIRES_PORTABILITY_ENUMERATION = false;
+        static constexpr bool PREFER_FIFO_BY_DEFAULT = false;
+        static constexpr auto PREFERRED_SURFACE_FORMATS = std::array<VkFormat, 2> {
+            VK_FORMAT_B8G8R8A8_SRGB,
+            VK_FORMAT_R8G8B8A8_SRGB,
+        };
+        static constexpr bool UNIFIED_MEMORY = false;
+    };
+
+    template <>
+    struct PlatformTraits<Platform::Apple> {
+        static constexpr bool REQUIRES_PORTABILITY_ENUMERATION = true;
+        static constexpr bool PREFER_FIFO_BY_DEFAULT = true;
+        static constexpr auto PREFERRED_SURFACE_FORMATS = std::array<VkFormat, 1> {
+            VK_FORMAT_B8G8R8A8_SRGB,
+        };
+        static constexpr bool UNIFIED_MEMORY = true;
+    };
+
+    template <>
+    struct PlatformTraits<Platform::Windows> {
+        static constexpr bool REQUIRES_PORTABILITY_ENUMERATION = false;
+        static constexpr bool PREFER_FIFO_BY_DEFAULT = false;
+        static constexpr auto PREFERRED_SURFACE_FORMATS = std::array<VkFormat, 1> {
+            VK_FORMAT_B8G8R8A8_SRGB,
+        };
+        static constexpr bool UNIFIED_MEMORY = false;
+    };
+
+    inline constexpr Platform CURRENT_PLATFORM = detectOperatingSystem();
+
+    using CurrentPlatform = PlatformTraits<CURRENT_PLATFORM>;
+}
@@ -0,0 +1,547 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#include "vk_compute.h"
+#include "vk_descriptors.h"
+#include "vk_handles.h"
+#include "vk_memory.h"
+#include "vk_pipelines.h"
+#include "vk_render_graph.h"
+#include "vk_shaders.h"
+
+
+namespace vk_post {
+    // The scene's color before post processing, in linear light and past 1 where it is
+    // brighter than the display shows.
+    constexpr VkFormat SCENE_FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;
+
+    // Matches `LUT_SIZE` in `post.glsl`.
+    constexpr uint32_t LUT_SIZE = 16;
+
+    // The specialization constant ids of `local_size_x` and `local_size_y` in `post.comp`.
+    constexpr uint32_t WORKGROUP_WIDTH_ID = 0;
+    constexpr uint32_t WORKGROUP_HEIGHT_ID = 1;
+
+    // Matches `PushConstants` in `post.glsl`.
+    struct PushConstants {
+        std::array<float, 2> sourceScale;
+        std::array<uint32_t, 2> outputSize;
+        float exposure;
+        float vignette;
+        float ditherAmplitude;
+        uint32_t encodeSrgb;
+        uint32_t frame;
+    };
+
+    // How the scene's color is scaled before the filmic curve: `exposure` times, and darkened
+    // towards the corners by `vignette`, a fraction of it at the middle of each edge.
+    struct Settings {
+        float exposure = 1.0f;
+        float vignette = 0.15f;
+    };
+
+    // Formats the hardware encodes to sRGB on write, which the shader then writes linear.
+    inline bool isSrgbFormat(VkFormat format) {
+        switch (format) {
+            case VK_FORMAT_R8G8B8A8_SRGB:
+            case VK_FORMAT_B8G8R8A8_SRGB:
+            case VK_FORMAT_A8B8G8R8_SRGB_PACK32:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // One step of `format`'s color channels, which is as far as the dither moves a color.
+    inline float quantizationStep(VkFormat format) {
+        switch (format) {
+            case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+            case VK_FORMAT_A2R10G10B10_UNORM_PACK32:
+                return 1.0f / 1023.0f;
+            case VK_FORMAT_R16G16B16A16_SFLOAT:
+                return 0.0f;
+            default:
+                return 1.0f / 255.0f;
+        }
+    }
+
+    // The grading LUT, indexed and filled with sRGB encoded colors, packed as RGBA8. A gentle
+    // S-curve for contrast, a little more saturation, and shadows pushed towards teal against
+    // highlights pushed towards orange.
+    inline std::vector<uint32_t> gradingLut() {
+        const auto pack = [](float value) {
+            return static_cast<uint32_t>(std::lround(std::clamp(value, 0.0f, 1.0f) * 255.0f));
+        };
+
+        auto texels = std::vector<uint32_t> {};
+        texels.reserve(LUT_SIZE * LUT_SIZE * LUT_SIZE);
+        for (uint32_t blue = 0; blue < LUT_SIZE; blue++) {
+            for (uint32_t green = 0; green < LUT_SIZE; green++) {
+                for (uint32_t red = 0; red < LUT_SIZE; red++) {
+                    auto color = std::array {
+                        static_cast<float>(red) / (LUT_SIZE - 1),
+                        static_cast<float>(green) / (LUT_SIZE - 1),
+                        static_cast<float>(blue) / (LUT_SIZE - 1),
+                    };
+                    const float luma = 0.2126f * color[0] + 0.7152f * color[1] + 0.0722f * color[2];
+                    const auto split = std::array { -0.03f + 0.06f * luma, 0.01f, 0.04f - 0.07f * luma };
+                    for (size_t channel = 0; channel < color.size(); channel++) {
+                        const float saturated = luma + 1.1f * (color[channel] - luma);
+                        const float curved = saturated + 0.25f * saturated * (1.0f - saturated) * (2.0f * saturated - 1.0f);
+                        color[channel] = curved + split[channel];
+                    }
+                    texels.push_back(pack(color[0]) | (pack(color[1]) << 8) | (pack(color[2]) << 16) | (255u << 24));
+                }
+            }
+        }
+
+        return texels;
+    }
+
+    // Exposure, the vignette, the filmic curve, the grading LUT and dithering fused into a
+    // single pass, which reads the scene's HDR color once and writes the swapchain image once,
+    // instead of a fullscreen read and write of an intermediate image for every step.
+    //
+    // The pass writes the swapchain image as a storage image from `post.comp` where the
+    // swapchain allows it, and as a color attachment from `post.frag` otherwise. It samples the
+    // part of its source the frame rendered with a linear filter, so a scaled frame is
+    // upscaled in the same pass, with no blit into the swapchain.
+    class PostProcessStack {
+        public:
+            explicit PostProcessStack() = default;
+
+            PostProcessStack(const PostProcessStack& other) = delete;
+            PostProcessStack& operator=(const PostProcessStack& other) = delete;
+
+            // The set layout comes from `layoutCache`, the sampler from `samplerCache` and the
+            // pipelines from `pipelineRegistry`, which keep them. With `pushDescriptors`, the
+            // bindings are pushed instead of allocated from `frameDescriptors`. The compute pass runs in square workgroups of
+            // `computeTuning.tile`, and the raster pipelines are created per format on first use.
+            void init(
+                VkDevice device,
+                vk_memory::DeviceMemoryAllocator& memoryAllocator,
+                vk_descriptors::DescriptorLayoutCache& layoutCache,
+                vk_descriptors::SamplerCache& samplerCache,
+                vk_descriptors::FrameDescriptorAllocator& frameDescriptors,
+                vk_shaders::ShaderLibrary& shaderLibrary,
+                vk_pipelines::PipelineRegistry& pipelineRegistry,
+                const vk_compute::ComputeTuning& computeTuning,
+                const VkAllocationCallbacks* allocator,
+                bool pushDescriptors,
+                const Settings& settings
+            ) {
+                m_device = device;
+                m_allocator = allocator;
+                m_memoryAllocator = &memoryAllocator;
+                m_shaderLibrary = &shaderLibrary;
+                m_pipelineRegistry = &pipelineRegistry;
+                m_workgroupSize = computeTuning.tile;
+                m_settings = settings;
+
+                this->createLut();
+                this->createSampler(samplerCache);
+
+                const auto bindings = std::array {
+                    VkDescriptorSetLayoutBinding {
+                        .binding = 0,
+                        .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                        .descriptorCount = 1,
+                        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+                    },
+                    VkDescriptorSetLayoutBinding {
+                        .binding = 1,
+                        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                        .descriptorCount = 1,
+                        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+                    },
+                    VkDescriptorSetLayoutBinding {
+                        .binding = 2,
+                        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                        .descriptorCount = 1,
+                        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                    },
+                };
+                m_descriptors.init(m_device, layoutCache, frameDescriptors, bindings, pushDescriptors);
+                const auto setLayout = m_descriptors.setLayout();
+
+                const auto pushConstantRange = VkPushConstantRange {
+                    .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+                    .offset = 0,
+                    .size = sizeof(PushConstants),
+                };
+                const auto pipelineLayoutInfo = VkPipelineLayoutCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+                    .setLayoutCount = 1,
+                    .pSetLayouts = &setLayout,
+                    .pushConstantRangeCount = 1,
+                    .pPushConstantRanges = &pushConstantRange,
+                };
+
+                const auto pipelineLayoutResult = vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, m_allocator, &m_pipelineLayout);
+                if (pipelineLayoutResult != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create post processing pipeline layout!");
+                }
+
+                auto constants = vk_pipelines::SpecializationConstants {};
+                constants.set(WORKGROUP_WIDTH_ID, m_workgroupSize).set(WORKGROUP_HEIGHT_ID, m_workgroupSize);
+                const auto pipelineInfo = VkComputePipelineCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+                    .stage = VkPipelineShaderStageCreateInfo {
+                        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                        .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                        .module = m_shaderLibrary->shaderModule("post.comp"),
+                        .pName = "main",
+                        .pSpecializationInfo = constants.info(),
+                    },
+                    .layout = m_pipelineLayout,
+                };
+                m_computePipeline = m_pipelineRegistry->computePipeline(pipelineInfo);
+            }
+
+            // The device has to be idle. The set layout and the sampler belong to their caches.
+            void destroy() {
+                if (m_device == VK_NULL_HANDLE) {
+                    return;
+                }
+
+                m_lut = BufferAllocation();
+                m_sampler = VK_NULL_HANDLE;
+                m_computePipeline = VK_NULL_HANDLE;
+                m_rasterPipelines.clear();
+                vkDestroyPipelineLayout(m_device, m_pipelineLayout, m_allocator);
+                m_pipelineLayout = VK_NULL_HANDLE;
+                m_descriptors.reset();
+                m_device = VK_NULL_HANDLE;
+            }
+
+            bool isInitialized() const {
+                return m_device != VK_NULL_HANDLE;
+            }
+
+            const Settings& settings() const {
+                return m_settings;
+            }
+
+            // Post processes `sourceExtent` of `source`, of `sourceSize`, read in `sourceLayout`,
+            // into all of `target`, of `targetFormat` and `targetExtent`. With `storage`, the
+            // target is written as a storage image in the general layout, and as a color
+            // attachment otherwise. `frame` moves the dither.
+            void addPass(
+                vk_render_graph::RenderGraph& graph,
+                vk_render_graph::ResourceId source,
+                VkExtent2D sourceSize,
+                VkExtent2D sourceExtent,
+                VkImageLayout sourceLayout,
+                vk_render_graph::ResourceId target,
+                VkFormat targetFormat,
+                VkExtent2D targetExtent,
+                bool storage,
+                uint64_t frame
+            ) {
+                const auto stage = storage ? VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT : VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+                const auto targetAccess = storage
+                    ? vk_render_graph::write(target, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL)
+                    : vk_render_graph::write(target, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+                const auto pushConstants = PushConstants {
+                    .sourceScale = {
+                        static_cast<float>(sourceExtent.width) / static_cast<float>(std::max(sourceSize.width, 1u)),
+                        static_cast<float>(sourceExtent.height) / static_cast<float>(std::max(sourceSize.height, 1u)),
+                    },
+                    .outputSize = { targetExtent.width, targetExtent.height },
+                    .exposure = m_settings.exposure,
+                    .vignette = m_settings.vignette,
+                    .ditherAmplitude = quantizationStep(targetFormat),
+                    .encodeSrgb = storage || !isSrgbFormat(targetFormat) ? 1u : 0u,
+                    .frame = static_cast<uint32_t>(frame),
+                };
+
+                graph.addPass(
+                    "postProcess",
+                    {
+                        vk_render_graph::read(source, stage, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, sourceLayout),
+                        targetAccess,
+                    },
+                    [this, &graph, source, sourceLayout, target, targetFormat, targetExtent, storage, pushConstants](VkCommandBuffer commandBuffer) {
+                        if (storage) {
+                            this->recordCompute(commandBuffer, graph.imageView(source), sourceLayout, graph.imageView(target), targetExtent, pushConstants);
+                        } else {
+                            this->recordRaster(commandBuffer, graph.imageView(source), sourceLayout, graph.imageView(target), targetFormat, targetExtent, pushConstants);
+                        }
+                    }
+                );
+            }
+        private:
+            struct BufferAllocation {
+                vk_memory::ScopedAllocation memory;
+                vk_handles::Buffer buffer;
+            };
+
+            struct PipelineEntry {
+                VkFormat colorFormat = VK_FORMAT_UNDEFINED;
+                VkPipeline pipeline = VK_NULL_HANDLE;
+            };
+
+            VkDevice m_device = VK_NULL_HANDLE;
+            const VkAllocationCallbacks* m_allocator = nullptr;
+            vk_memory::DeviceMemoryAllocator* m_memoryAllocator = nullptr;
+            vk_descriptors::PerDrawDescriptors m_descriptors;
+            vk_shaders::ShaderLibrary* m_shaderLibrary = nullptr;
+            vk_pipelines::PipelineRegistry* m_pipelineRegistry = nullptr;
+            uint32_t m_workgroupSize = 1;
+            Settings m_settings;
+            BufferAllocation m_lut;
+            VkSampler m_sampler = VK_NULL_HANDLE;
+            VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+            VkPipeline m_computePipeline = VK_NULL_HANDLE;
+            std::vector<PipelineEntry> m_rasterPipelines;
+
+            // The LUT is 16 KiB, written once, and read from where the device can map it.
+            void createLut() {
+                const auto texels = gradingLut();
+                const auto size = static_cast<VkDeviceSize>(texels.size() * sizeof(uint32_t));
+                const auto bufferInfo = VkBufferCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                    .size = size,
+                    .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                };
+
+                auto buffer = VkBuffer {};
+                const auto result = vkCreateBuffer(m_device, &bufferInfo, m_allocator, &buffer);
+                if (result != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create grading LUT buffer!");
+                }
+
+                m_lut.buffer = vk_handles::Buffer { m_device, buffer, m_allocator };
+                m_lut.memory = vk_memory::ScopedAllocation {
+                    *m_memoryAllocator,
+                    m_memoryAllocator->allocateForBuffer(buffer, vk_memory::AllocationCreateInfo {
+                        .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                        .preferredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                    }),
+                };
+                std::memcpy(m_lut.memory.get().mappedData, texels.data(), size);
+            }
+
+            // The source is filtered, so scaled frames are upscaled as they are read.
+            void createSampler(vk_descriptors::SamplerCache& samplerCache) {
+                const auto samplerInfo = VkSamplerCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+                    .magFilter = VK_FILTER_LINEAR,
+                    .minFilter = VK_FILTER_LINEAR,
+                    .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+                    .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                    .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                    .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                    .minLod = 0.0f,
+                    .maxLod = 0.0f,
+                };
+                m_sampler = samplerCache.sampler(samplerInfo);
+            }
+
+            // The raster pass binds no storage image, which its fragment shader never reads.
+            void bindDescriptors(
+                VkCommandBuffer commandBuffer,
+                VkPipelineBindPoint bindPoint,
+                VkImageView sourceView,
+                VkImageLayout sourceLayout,
+                VkImageView targetView
+            ) const {
+                const auto sourceInfo = VkDescriptorImageInfo { m_sampler, sourceView, sourceLayout };
+                const auto lutInfo = VkDescriptorBufferInfo { m_lut.buffer, 0, VK_WHOLE_SIZE };
+                const auto targetInfo = VkDescriptorImageInfo { VK_NULL_HANDLE, targetView, VK_IMAGE_LAYOUT_GENERAL };
+                auto writes = std::array {
+                    VkWriteDescriptorSet {
+                        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                        .dstBinding = 0,
+                        .descriptorCount = 1,
+                        .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                        .pImageInfo = &sourceInfo,
+                    },
+                    VkWriteDescriptorSet {
+                        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                        .dstBinding = 1,
+                        .descriptorCount = 1,
+                        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                        .pBufferInfo = &lutInfo,
+                    },
+                    VkWriteDescriptorSet {
+                        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                        .dstBinding = 2,
+                        .descriptorCount = 1,
+                        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                        .pImageInfo = &targetInfo,
+                    },
+                };
+                const auto writeCount = targetView != VK_NULL_HANDLE ? writes.size() : writes.size() - 1;
+                m_descriptors.bind(commandBuffer, bindPoint, m_pipelineLayout, 0, std::span { writes.data(), writeCount });
+            }
+
+            void recordCompute(
+                VkCommandBuffer commandBuffer,
+                VkImageView sourceView,
+                VkImageLayout sourceLayout,
+                VkImageView targetView,
+                VkExtent2D targetExtent,
+                const PushConstants& pushConstants
+            ) const {
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_computePipeline);
+                this->bindDescriptors(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, sourceView, sourceLayout, targetView);
+                vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstants), &pushConstants);
+                vkCmdDispatch(
+                    commandBuffer,
+                    (targetExtent.width + m_workgroupSize - 1) / m_workgroupSize,
+                    (targetExtent.height + m_workgroupSize - 1) / m_workgroupSize,
+                    1
+                );
+            }
+
+            // Every pixel of the target is written, so it is never loaded.
+            void recordRaster(
+                VkCommandBuffer commandBuffer,
+                VkImageView sourceView,
+                VkImageLayout sourceLayout,
+                VkImageView targetView,
+                VkFormat targetFormat,
+                VkExtent2D targetExtent,
+                const PushConstants& pushConstants
+            ) {
+                const auto colorAttachment = VkRenderingAttachmentInfo {
+                    .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+                    .imageView = targetView,
+                    .imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                    .loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                    .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+                };
+                const auto renderingInfo = VkRenderingInfo {
+                    .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+                    .renderArea = VkRect2D {
+                        .offset = VkOffset2D { 0, 0 },
+                        .extent = targetExtent,
+                    },
+                    .layerCount = 1,
+                    .colorAttachmentCount = 1,
+                    .pColorAttachments = &colorAttachment,
+                };
+                const auto viewport = VkViewport {
+                    .x = 0.0f,
+                    .y = 0.0f,
+                    .width = static_cast<float>(targetExtent.width),
+                    .height = static_cast<float>(targetExtent.height),
+                    .minDepth = 0.0f,
+                    .maxDepth = 1.0f,
+                };
+                const auto scissor = VkRect2D {
+                    .offset = VkOffset2D { 0, 0 },
+                    .extent = targetExtent,
+                };
+
+                vkCmdBeginRendering(commandBuffer, &renderingInfo);
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->rasterPipeline(targetFormat));
+                vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+                vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+                this->bindDescriptors(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, sourceView, sourceLayout, VK_NULL_HANDLE);
+                vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstants), &pushConstants);
+                vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+                vkCmdEndRendering(commandBuffer);
+            }
+
+            VkPipeline rasterPipeline(VkFormat colorFormat) {
+                const auto existing = std::find_if(m_rasterPipelines.begin(), m_rasterPipelines.end(), [colorFormat](const auto& entry) {
+                    return entry.colorFormat == colorFormat;
+                });
+                if (existing != m_rasterPipelines.end()) {
+                    return existing->pipeline;
+                }
+
+                const auto stages = std::array {
+                    VkPipelineShaderStageCreateInfo {
+                        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                        .stage = VK_SHADER_STAGE_VERTEX_BIT,
+                        .module = m_shaderLibrary->shaderModule("fullscreen.vert"),
+                        .pName = "main",
+                    },
+                    VkPipelineShaderStageCreateInfo {
+                        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                        .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+                        .module = m_shaderLibrary->shaderModule("post.frag"),
+                        .pName = "main",
+                    },
+                };
+                const auto vertexInputState = VkPipelineVertexInputStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+                };
+                const auto inputAssemblyState = VkPipelineInputAssemblyStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+                    .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+                };
+                const auto viewportState = VkPipelineViewportStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+                    .viewportCount = 1,
+                    .scissorCount = 1,
+                };
+                const auto rasterizationState = VkPipelineRasterizationStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+                    .polygonMode = VK_POLYGON_MODE_FILL,
+                    .cullMode = VK_CULL_MODE_NONE,
+                    .lineWidth = 1.0f,
+                };
+                const auto multisampleState = VkPipelineMultisampleStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+                    .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+                };
+                const auto depthStencilState = VkPipelineDepthStencilStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+                };
+                const auto blendAttachment = VkPipelineColorBlendAttachmentState {
+                    .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+                };
+                const auto colorBlendState = VkPipelineColorBlendStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+                    .attachmentCount = 1,
+                    .pAttachments = &blendAttachment,
+                };
+                const auto dynamicStates = std::array { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+                const auto dynamicState = VkPipelineDynamicStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+                    .dynamicStateCount = static_cast<uint32_t>(dynamicStates.size()),
+                    .pDynamicStates = dynamicStates.data(),
+                };
+                const auto renderingInfo = VkPipelineRenderingCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
+                    .colorAttachmentCount = 1,
+                    .pColorAttachmentFormats = &colorFormat,
+                };
+                const auto pipelineInfo = VkGraphicsPipelineCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+                    .pNext = &renderingInfo,
+                    .stageCount = static_cast<uint32_t>(stages.size()),
+                    .pStages = stages.data(),
+                    .pVertexInputState = &vertexInputState,
+                    .pInputAssemblyState = &inputAssemblyState,
+                    .pViewportState = &viewportState,
+                    .pRasterizationState = &rasterizationState,
+                    .pMultisampleState = &multisampleState,
+                    .pDepthStencilState = &depthStencilState,
+                    .pColorBlendState = &colorBlendState,
+                    .pDynamicState = &dynamicState,
+                    .layout = m_pipelineLayout,
+                };
+
+                const auto pipeline = m_pipelineRegistry->graphicsPipeline(pipelineInfo);
+                m_rasterPipelines.push_back(PipelineEntry { colorFormat, pipeline });
+
+                return pipeline;
+            }
+    };
+}
@@ -0,0 +1,211 @@
+#pragma once
+
+// Pulls in `windows.h` on Windows, with the same macros as everywhere else.
+#include "vk_dispatch.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
+#include <fmt/core.h>
+
+#include "vk_topology.h"
+#include "vk_tracing.h"
+
+#if defined(__linux__)
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+#elif defined(__APPLE__)
+#include <CoreFoundation/CoreFoundation.h>
+#include <IOKit/ps/IOPowerSources.h>
+#endif
+
+
+namespace vk_power {
+    // What the machine runs on. Desktops without a battery, and platforms nothing is known
+    // about, report mains power and no low power mode, and never save power on their own.
+    struct PowerState {
+        bool onBattery = false;
+        // Battery saver on Windows, the `low-power` platform profile on Linux, and the low
+        // battery warning on macOS.
+        bool lowPowerMode = false;
+        std::optional<uint32_t> batteryPercent;
+
+        bool savesPower() const {
+            return this->onBattery || this->lowPowerMode;
+        }
+
+        bool operator==(const PowerState& other) const = default;
+    };
+
+    inline std::string describe(const PowerState& state) {
+        auto description = std::string { state.onBattery ? "battery" : "mains power" };
+        if (state.batteryPercent.has_value()) {
+            description += fmt::format(" ({}% charged)", state.batteryPercent.value());
+        }
+        if (state.lowPowerMode) {
+            description += ", low power mode";
+        }
+
+        return description;
+    }
+
+    namespace detail {
+        #if defined(__linux__)
+        inline std::string readLine(const std::filesystem::path& path) {
+            auto file = std::ifstream { path };
+            auto line = std::string {};
+            std::getline(file, line);
+
+            return line;
+        }
+        #endif
+    }
+
+    // Cheap enough to call every few seconds: a handful of small sysfs reads on Linux, and a
+    // single call on Windows and macOS.
+    inline PowerState query() {
+        auto state = PowerState {};
+
+        #if defined(_WIN32)
+        auto status = SYSTEM_POWER_STATUS {};
+        if (GetSystemPowerStatus(&status)) {
+            state.onBattery = status.ACLineStatus == 0;
+            state.lowPowerMode = status.SystemStatusFlag == 1;
+            if (status.BatteryLifePercent <= 100) {
+                state.batteryPercent = status.BatteryLifePercent;
+            }
+        }
+        #elif defined(__linux__)
+        // A laptop on its charger can still list a discharging battery for a moment, so only
+        // a discharging battery without any supply online counts.
+        auto supplyOnline = false;
+        auto discharging = false;
+        auto error = std::error_code {};
+        for (const auto& entry : std::filesystem::directory_iterator { "/sys/class/power_supply", error }) {
+            const auto type = detail::readLine(entry.path() / "type");
+            if (type == "Battery") {
+                if (detail::readLine(entry.path() / "scope") == "Device") {
+                    // The batteries of mice and headsets.
+                    continue;
+                }
+
+                discharging = discharging || detail::readLine(entry.path() / "status") == "Discharging";
+                try {
+                    state.batteryPercent = static_cast<uint32_t>(std::stoul(detail::readLine(entry.path() / "capacity")));
+                } catch (const std::exception&) {
+                }
+            } else if (detail::readLine(entry.path() / "online") == "1") {
+                supplyOnline = true;
+            }
+        }
+        state.onBattery = discharging && !supplyOnline;
+        state.lowPowerMode = detail::readLine("/sys/firmware/acpi/platform_profile") == "low-power";
+        #elif defined(__APPLE__)
+        const auto info = IOPSCopyPowerSourcesInfo();
+        if (info != nullptr) {
+            const auto type = IOPSGetProvidingPowerSourceType(info);
+            state.onBattery = type != nullptr && CFStringCompare(type, CFSTR(kIOPSBatteryPowerValue), 0) == kCFCompareEqualTo;
+            CFRelease(info);
+        }
+        state.lowPowerMode = IOPSGetBatteryWarningLevel() != kIOPSLowBatteryWarningNone;
+        #endif
+
+        return state;
+    }
+
+    // Polls the power state on a thread of its own, on the background cores, and calls
+    // `onChange` there whenever it changes, so that a frame loop parked until the next event
+    // finds out without waking up to poll. None of the platforms' change notifications reach
+    // a process that has no window procedure or run loop of its own to receive them.
+    class PowerMonitor {
+        public:
+            using ChangeCallback = std::function<void()>;
+
+            // How often the state is read, unless `start` is told otherwise.
+            static constexpr auto DEFAULT_POLL_INTERVAL = std::chrono::seconds { 5 };
+
+            explicit PowerMonitor() = default;
+
+            PowerMonitor(const PowerMonitor& other) = delete;
+            PowerMonitor& operator=(const PowerMonitor& other) = delete;
+
+            ~PowerMonitor() {
+                this->stop();
+            }
+
+            // The state is read once before this returns, so `state` is current from the
+            // first frame on.
+            void start(ChangeCallback onChange, std::chrono::milliseconds pollInterval = DEFAULT_POLL_INTERVAL) {
+                if (m_thread.joinable()) {
+                    return;
+                }
+
+                m_onChange = std::move(onChange);
+                m_pollInterval = pollInterval;
+                m_state = vk_power::query();
+                m_running = true;
+                m_thread = std::thread { [this]() { this->pollLoop(); } };
+            }
+
+            void stop() {
+                {
+                    const auto lock = std::scoped_lock { m_mutex };
+                    m_running = false;
+                }
+
+                m_stopped.notify_all();
+                if (m_thread.joinable()) {
+                    m_thread.join();
+                }
+
+                m_onChange = nullptr;
+            }
+
+            bool isRunning() const {
+                const auto lock = std::scoped_lock { m_mutex };
+
+                return m_running;
+            }
+
+            PowerState state() const {
+                const auto lock = std::scoped_lock { m_mutex };
+
+                return m_state;
+            }
+        private:
+            std::thread m_thread;
+            mutable std::mutex m_mutex;
+            std::condition_variable m_stopped;
+            bool m_running = false;
+            PowerState m_state;
+            ChangeCallback m_onChange;
+            std::chrono::milliseconds m_pollInterval = DEFAULT_POLL_INTERVAL;
+
+            void pollLoop() {
+                vk_tracing::setThreadName("power monitor");
+                vk_topology::markBackgroundThread();
+
+                auto lock = std::unique_lock { m_mutex };
+                while (!m_stopped.wait_for(lock, m_pollInterval, [this]() { return !m_running; })) {
+                    lock.unlock();
+                    const auto state = vk_power::query();
+                    lock.lock();
+                    if (state == m_state) {
+                        continue;
+                    }
+
+                    m_state = state;
+                    lock.unlock();
+                    m_onChange();
+                    lock.lock();
+                }
+            }
+    };
+}
@@ -0,0 +1,476 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <fmt/core.h>
+#include <fmt/ostream.h>
+
+
+namespace vk_present {
+    using Clock = std::chrono::steady_clock;
+
+    // Measures how long it takes from acquiring a swapchain image until the present it was
+    // queued for reaches the display, using `VK_KHR_present_id` and `VK_KHR_present_wait`.
+    //
+    // Every present is tagged with an increasing id, and a helper thread waits for it with
+    // `vkWaitForPresentKHR`. The swapchain must be externally synchronized between that wait and
+    // `vkQueuePresentKHR`, so the helper thread only waits in `WAIT_SLICE` steps while holding
+    // `presentMutex`, which the frame loop also holds while presenting. A present is delayed by
+    // at most one slice, and latencies are measured to within one slice.
+    class PresentLatencyMonitor {
+        public:
+            static constexpr auto WAIT_SLICE = std::chrono::microseconds { 500 };
+            static constexpr size_t SAMPLE_COUNT = 256;
+
+            explicit PresentLatencyMonitor() = default;
+
+            PresentLatencyMonitor(const PresentLatencyMonitor& other) = delete;
+            PresentLatencyMonitor& operator=(const PresentLatencyMonitor& other) = delete;
+
+            ~PresentLatencyMonitor() {
+                this->stop();
+            }
+
+            // Does nothing unless both extensions were enabled on `device`.
+            void start(VkDevice device, bool presentWaitEnabled) {
+                if (!presentWaitEnabled || m_thread.joinable()) {
+                    return;
+                }
+
+                m_device = device;
+                m_waitForPresent = vkWaitForPresentKHR;
+                if (m_waitForPresent == nullptr) {
+                    return;
+                }
+
+                m_running = true;
+                m_thread = std::thread { [this]() { this->waitLoop(); } };
+            }
+
+            void stop() {
+                {
+                    const auto lock = std::scoped_lock { m_mutex };
+                    m_running = false;
+                    m_pending.clear();
+                }
+
+                m_workAvailable.notify_all();
+                if (m_thread.joinable()) {
+                    m_thread.join();
+                }
+            }
+
+            bool isEnabled() const {
+                return m_waitForPresent != nullptr;
+            }
+
+            // Held by the frame loop around `vkQueuePresentKHR`.
+            std::mutex& presentMutex() {
+                return m_presentMutex;
+            }
+
+            uint64_t nextPresentId() {
+                return ++m_lastPresentId;
+            }
+
+            // Wait for a queued present on the helper thread. `acquiredAt` is when its image was
+            // acquired.
+            void track(VkSwapchainKHR swapChain, uint64_t presentId, Clock::time_point acquiredAt) {
+                if (!this->isEnabled()) {
+                    return;
+                }
+
+                {
+                    const auto lock = std::scoped_lock { m_mutex };
+                    m_pending.push_back(PendingPresent { swapChain, presentId, acquiredAt });
+                }
+
+                m_workAvailable.notify_one();
+            }
+
+            // Drop the presents still pending on `swapChain`, and return once the helper thread
+            // is no longer waiting on it, so that it can be destroyed.
+            void forgetSwapChain(VkSwapchainKHR swapChain) {
+                auto lock = std::unique_lock { m_mutex };
+                std::erase_if(m_pending, [swapChain](const PendingPresent& present) {
+                    return present.swapChain == swapChain;
+                });
+
+                m_forgetting = swapChain;
+                m_waitDone.wait(lock, [this, swapChain]() { return m_waitingOn != swapChain; });
+                m_forgetting = VK_NULL_HANDLE;
+            }
+
+            // The percentile of the recorded latencies in milliseconds, like 0.99 for the p99.
+            std::optional<double> latencyPercentile(double percentile) const {
+                const auto lock = std::scoped_lock { m_mutex };
+                if (m_sampleCount == 0) {
+                    return std::nullopt;
+                }
+
+                const auto count = std::min(m_sampleCount, SAMPLE_COUNT);
+                auto sorted = std::vector<double> { m_samples.begin(), m_samples.begin() + count };
+                std::sort(sorted.begin(), sorted.end());
+
+                return sorted[std::min(count - 1, static_cast<size_t>(static_cast<double>(count) * percentile))];
+            }
+
+            void report(std::ostream& out) const {
+                if (!this->isEnabled()) {
+                    return;
+                }
+
+                const auto p50 = this->latencyPercentile(0.50);
+                const auto p99 = this->latencyPercentile(0.99);
+                if (!p50.has_value() || !p99.has_value()) {
+                    return;
+                }
+
+                fmt::println(out, "Acquire to display latency: p50 {:.3f} ms, p99 {:.3f} ms", p50.value(), p99.value());
+            }
+        private:
+            struct PendingPresent {
+                VkSwapchainKHR swapChain;
+                uint64_t presentId;
+                Clock::time_point acquiredAt;
+            };
+
+            VkDevice m_device = VK_NULL_HANDLE;
+            PFN_vkWaitForPresentKHR m_waitForPresent = nullptr;
+            uint64_t m_lastPresentId = 0;
+
+            std::thread m_thread;
+            std::mutex m_presentMutex;
+            mutable std::mutex m_mutex;
+            std::condition_variable m_workAvailable;
+            std::condition_variable m_waitDone;
+            bool m_running = false;
+            std::deque<PendingPresent> m_pending;
+            VkSwapchainKHR m_waitingOn = VK_NULL_HANDLE;
+            VkSwapchainKHR m_forgetting = VK_NULL_HANDLE;
+
+            std::vector<double> m_samples = std::vector<double>(SAMPLE_COUNT);
+            size_t m_sampleCount = 0;
+
+            void waitLoop() {
+                while (true) {
+                    auto present = PendingPresent {};
+                    {
+                        auto lock = std::unique_lock { m_mutex };
+                        m_workAvailable.wait(lock, [this]() { return !m_running || !m_pending.empty(); });
+                        if (!m_running) {
+                            return;
+                        }
+
+                        present = m_pending.front();
+                        m_pending.pop_front();
+                        m_waitingOn = present.swapChain;
+                    }
+
+                    const auto result = this->waitForPresent(present);
+
+                    {
+                        const auto lock = std::scoped_lock { m_mutex };
+                        m_waitingOn = VK_NULL_HANDLE;
+                        if (result == VK_SUCCESS) {
+                            const auto latency = std::chrono::duration<double, std::milli> { Clock::now() - present.acquiredAt };
+                            m_samples[m_sampleCount % SAMPLE_COUNT] = latency.count();
+                            m_sampleCount++;
+                        }
+                    }
+
+                    m_waitDone.notify_all();
+                }
+            }
+
+            // Gives up when the present was dropped, for example because the swapchain went out
+            // of date, or when the swapchain is being forgotten.
+            VkResult waitForPresent(const PendingPresent& present) {
+                const auto timeout = static_cast<uint64_t>(std::chrono::nanoseconds { WAIT_SLICE }.count());
+                while (true) {
+                    auto result = VK_TIMEOUT;
+                    {
+                        const auto lock = std::scoped_lock { m_presentMutex };
+                        result = m_waitForPresent(m_device, present.swapChain, present.presentId, timeout);
+                    }
+
+                    if (result != VK_TIMEOUT) {
+                        return result;
+                    }
+
+                    const auto lock = std::scoped_lock { m_mutex };
+                    if (!m_running || m_forgetting == present.swapChain) {
+                        return VK_TIMEOUT;
+                    }
+                }
+            }
+    };
+
+    // Paces presents to the display's refresh cycle with `VK_GOOGLE_display_timing`. Each
+    // present asks for the refresh slot right after the last one the display actually showed,
+    // as reported by the past presentation timings, which keeps the frame rate from beating
+    // against the refresh rate.
+    class DisplayTimingPacer {
+        public:
+            explicit DisplayTimingPacer() = default;
+
+            DisplayTimingPacer(const DisplayTimingPacer& other) = delete;
+            DisplayTimingPacer& operator=(const DisplayTimingPacer& other) = delete;
+
+            // Does nothing unless the extension was enabled on `device`.
+            void init(VkDevice device, bool displayTimingEnabled) {
+                if (!displayTimingEnabled) {
+                    return;
+                }
+
+                m_device = device;
+                m_getRefreshCycleDuration = vkGetRefreshCycleDurationGOOGLE;
+                m_getPastPresentationTiming = vkGetPastPresentationTimingGOOGLE;
+            }
+
+            bool isEnabled() const {
+                return m_getRefreshCycleDuration != nullptr && m_getPastPresentationTiming != nullptr;
+            }
+
+            void setSwapChain(VkSwapchainKHR swapChain) {
+                m_swapChain = swapChain;
+                m_lastActualPresentTime = 0;
+                m_lastPresentId = 0;
+                m_refreshDuration = 0;
+                if (!this->isEnabled()) {
+                    return;
+                }
+
+                auto refreshCycle = VkRefreshCycleDurationGOOGLE {};
+                if (m_getRefreshCycleDuration(m_device, m_swapChain, &refreshCycle) == VK_SUCCESS) {
+                    m_refreshDuration = refreshCycle.refreshDuration;
+                }
+            }
+
+            // The present time to request for present `presentId`, or nothing until the display
+            // has reported a present to count refresh cycles from.
+            std::optional<VkPresentTimeGOOGLE> presentTime(uint32_t presentId) {
+                if (!this->isEnabled() || m_refreshDuration == 0) {
+                    return std::nullopt;
+                }
+
+                uint32_t timingCount = 0;
+                m_getPastPresentationTiming(m_device, m_swapChain, &timingCount, nullptr);
+                if (timingCount > 0) {
+                    m_timings.resize(timingCount);
+                    const auto result = m_getPastPresentationTiming(m_device, m_swapChain, &timingCount, m_timings.data());
+                    if (result == VK_SUCCESS || result == VK_INCOMPLETE) {
+                        for (uint32_t i = 0; i < timingCount; i++) {
+                            if (m_timings[i].presentID >= m_lastPresentId) {
+                                m_lastPresentId = m_timings[i].presentID;
+                                m_lastActualPresentTime = m_timings[i].actualPresentTime;
+                            }
+                        }
+                    }
+                }
+
+                if (m_lastActualPresentTime == 0 || presentId <= m_lastPresentId) {
+                    return std::nullopt;
+                }
+
+                const auto cycles = static_cast<uint64_t>(presentId - m_lastPresentId);
+
+                return VkPresentTimeGOOGLE {
+                    .presentID = presentId,
+                    .desiredPresentTime = m_lastActualPresentTime + cycles * m_refreshDuration,
+                };
+            }
+        private:
+            VkDevice m_device = VK_NULL_HANDLE;
+            PFN_vkGetRefreshCycleDurationGOOGLE m_getRefreshCycleDuration = nullptr;
+            PFN_vkGetPastPresentationTimingGOOGLE m_getPastPresentationTiming = nullptr;
+            VkSwapchainKHR m_swapChain = VK_NULL_HANDLE;
+            uint64_t m_refreshDuration = 0;
+            uint64_t m_lastActualPresentTime = 0;
+            uint32_t m_lastPresentId = 0;
+            std::vector<VkPastPresentationTimingGOOGLE> m_timings;
+    };
+
+    // Starts each frame just in time for its submission to reach the GPU as the GPU runs out
+    // of work, instead of queuing frames ahead of it, after NVIDIA Reflex and AMD Anti-Lag.
+    // A frame queued behind another waits for the GPU with its input already sampled, so
+    // every queued frame adds a GPU frame time to the input latency.
+    //
+    // With `VK_NV_low_latency2` the driver paces the frames: the frame loop sleeps in
+    // `vkLatencySleepNV` and reports each stage of the frame with a latency marker. Otherwise
+    // the pacer keeps at most one frame queued, estimates when the GPU will finish it from the
+    // GPU frame time and the CPU time from frame start to submit, and sleeps until the next
+    // frame has to start to be submitted by then.
+    class LowLatencyPacer {
+        public:
+            // Started this much early, to absorb CPU times above the average.
+            static constexpr auto SAFETY_MARGIN = std::chrono::microseconds { 500 };
+            // Never sleeps longer, whatever the estimates say.
+            static constexpr auto MAX_DELAY = std::chrono::milliseconds { 50 };
+            // Weight of the newest sample in the moving averages.
+            static constexpr double SMOOTHING = 0.1;
+
+            explicit LowLatencyPacer() = default;
+
+            LowLatencyPacer(const LowLatencyPacer& other) = delete;
+            LowLatencyPacer& operator=(const LowLatencyPacer& other) = delete;
+
+            void init(VkDevice device, bool lowLatencyEnabled, const VkAllocationCallbacks* allocator) {
+                m_device = device;
+                m_allocator = allocator;
+                if (!lowLatencyEnabled || vkLatencySleepNV == nullptr || vkSetLatencySleepModeNV == nullptr || vkSetLatencyMarkerNV == nullptr) {
+                    return;
+                }
+
+                const auto timelineInfo = VkSemaphoreTypeCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+                    .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+                    .initialValue = 0,
+                };
+                const auto semaphoreInfo = VkSemaphoreCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+                    .pNext = &timelineInfo,
+                };
+
+                const auto result = vkCreateSemaphore(m_device, &semaphoreInfo, m_allocator, &m_sleepSemaphore);
+                if (result != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create the latency sleep semaphore!");
+                }
+            }
+
+            void destroy() {
+                if (m_sleepSemaphore != VK_NULL_HANDLE) {
+                    vkDestroySemaphore(m_device, m_sleepSemaphore, m_allocator);
+                    m_sleepSemaphore = VK_NULL_HANDLE;
+                }
+
+                m_device = VK_NULL_HANDLE;
+            }
+
+            bool isEnabled() const {
+                return m_device != VK_NULL_HANDLE;
+            }
+
+            // Whether the driver paces frames, which needs the swapchain to be created with
+            // `VkSwapchainLatencyCreateInfoNV` and every frame to report latency markers.
+            bool usesDriverPacing() const {
+                return m_sleepSemaphore != VK_NULL_HANDLE;
+            }
+
+            void setSwapChain(VkSwapchainKHR swapChain) {
+                m_swapChain = swapChain;
+                if (!this->usesDriverPacing()) {
+                    return;
+                }
+
+                const auto sleepModeInfo = VkLatencySleepModeInfoNV {
+                    .sType = VK_STRUCTURE_TYPE_LATENCY_SLEEP_MODE_INFO_NV,
+                    .lowLatencyMode = VK_TRUE,
+                    .lowLatencyBoost = VK_TRUE,
+                    .minimumIntervalUs = 0,
+                };
+                vkSetLatencySleepModeNV(m_device, m_swapChain, &sleepModeInfo);
+            }
+
+            // The latest frame retired, at `retiredAt`. A frame loop that had to wait for it
+            // saw the GPU finish it, and the GPU started on the next queued frame right then.
+            void frameRetired(Clock::time_point retiredAt, bool waited) {
+                if (waited && m_gpuFrameTime.has_value()) {
+                    m_predictedIdle = retiredAt + this->gpuFrameTime();
+                }
+            }
+
+            // Block until the frame tagged `presentId` has to start.
+            void waitForFrameStart(uint64_t presentId) {
+                if (this->usesDriverPacing()) {
+                    m_sleepValue++;
+                    const auto sleepInfo = VkLatencySleepInfoNV {
+                        .sType = VK_STRUCTURE_TYPE_LATENCY_SLEEP_INFO_NV,
+                        .signalSemaphore = m_sleepSemaphore,
+                        .value = m_sleepValue,
+                    };
+                    if (m_swapChain != VK_NULL_HANDLE && vkLatencySleepNV(m_device, m_swapChain, &sleepInfo) == VK_SUCCESS) {
+                        const auto waitInfo = VkSemaphoreWaitInfo {
+                            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+                            .semaphoreCount = 1,
+                            .pSemaphores = &m_sleepSemaphore,
+                            .pValues = &m_sleepValue,
+                        };
+                        vkWaitSemaphores(m_device, &waitInfo, std::numeric_limits<uint64_t>::max());
+                    }
+
+                    this->mark(presentId, VK_LATENCY_MARKER_SIMULATION_START_NV);
+                } else if (m_predictedIdle.has_value() && m_cpuFrameTime.has_value()) {
+                    const auto now = Clock::now();
+                    const auto cpuFrameTime = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli> { m_cpuFrameTime.value() });
+                    const auto startAt = m_predictedIdle.value() - cpuFrameTime - SAFETY_MARGIN;
+                    if (startAt > now) {
+                        std::this_thread::sleep_until(std::min<Clock::time_point>(startAt, now + MAX_DELAY));
+                    }
+                }
+
+                m_frameStart = Clock::now();
+            }
+
+            // The frame was submitted at `submittedAt` and runs for `gpuFrameTime` milliseconds
+            // on the GPU as far as the GPU profiler last measured, if it could.
+            void frameSubmitted(Clock::time_point submittedAt, std::optional<double> gpuFrameTime) {
+                const auto cpuFrameTime = std::chrono::duration<double, std::milli> { submittedAt - m_frameStart }.count();
+                m_cpuFrameTime = LowLatencyPacer::smooth(m_cpuFrameTime, cpuFrameTime);
+                if (gpuFrameTime.has_value()) {
+                    m_gpuFrameTime = LowLatencyPacer::smooth(m_gpuFrameTime, gpuFrameTime.value());
+                }
+
+                if (m_gpuFrameTime.has_value()) {
+                    const auto start = m_predictedIdle.has_value() ? std::max(submittedAt, m_predictedIdle.value()) : submittedAt;
+                    m_predictedIdle = start + this->gpuFrameTime();
+                }
+            }
+
+            void mark(uint64_t presentId, VkLatencyMarkerNV marker) const {
+                if (!this->usesDriverPacing() || m_swapChain == VK_NULL_HANDLE) {
+                    return;
+                }
+
+                const auto markerInfo = VkSetLatencyMarkerInfoNV {
+                    .sType = VK_STRUCTURE_TYPE_SET_LATENCY_MARKER_INFO_NV,
+                    .presentID = presentId,
+                    .marker = marker,
+                };
+                vkSetLatencyMarkerNV(m_device, m_swapChain, &markerInfo);
+            }
+        private:
+            VkDevice m_device = VK_NULL_HANDLE;
+            const VkAllocationCallbacks* m_allocator = nullptr;
+            VkSwapchainKHR m_swapChain = VK_NULL_HANDLE;
+            VkSemaphore m_sleepSemaphore = VK_NULL_HANDLE;
+            uint64_t m_sleepValue = 0;
+
+            Clock::time_point m_frameStart {};
+            // When the GPU is expected to run out of submitted work.
+            std::optional<Clock::time_point> m_predictedIdle;
+            std::optional<double> m_cpuFrameTime;
+            std::optional<double> m_gpuFrameTime;
+
+            Clock::duration gpuFrameTime() const {
+                return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli> { m_gpuFrameTime.value() });
+            }
+
+            static double smooth(std::optional<double> average, double sample) {
+                return average.has_value() ? average.value() + SMOOTHING * (sample - average.value()) : sample;
+            }
+    };
+}
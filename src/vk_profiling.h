@@ -0,0 +1,2138 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <optional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include <fmt/core.h>
+#include <fmt/ostream.h>
+
+#include "vk_allocation_tracking.h"
+#include "vk_log.h"
+#include "vk_tracing.h"
+
+
+namespace vk_profiling {
+    enum class ReportFormat {
+        Table,
+        Json,
+    };
+
+    // Records how long each startup stage takes, and when the first frame reached the
+    // presentation engine, relative to when the profiler was created. Stages may be measured
+    // from several threads at once, and are reported in the order they started.
+    class StartupProfiler {
+        public:
+            using Clock = std::chrono::steady_clock;
+
+            explicit StartupProfiler()
+                : m_startTime { Clock::now() }
+            {
+            }
+
+            // Returns what the stage returns, so a stage that fails with a `vk_result::Result`
+            // is still measured and its error handed on.
+            template <typename F>
+            auto measure(const char* stageName, F&& stage) {
+                VK_TRACING_ZONE_TRANSIENT(stageName);
+                const auto stageStart = Clock::now();
+                if constexpr (std::is_void_v<std::invoke_result_t<F&>>) {
+                    stage();
+                    this->recordStage(stageName, stageStart);
+                } else {
+                    auto result = stage();
+                    this->recordStage(stageName, stageStart);
+
+                    return result;
+                }
+            }
+
+            void markFirstPresent() {
+                if (!m_firstPresent.has_value()) {
+                    m_firstPresent = Clock::now() - m_startTime;
+                }
+            }
+
+            void report(std::ostream& out, ReportFormat format) const {
+                const auto lock = std::scoped_lock { m_mutex };
+                auto stages = m_stages;
+                std::stable_sort(stages.begin(), stages.end(), [](const StageTiming& a, const StageTiming& b) {
+                    return a.offset < b.offset;
+                });
+
+                if (format == ReportFormat::Json) {
+                    this->reportJson(out, stages);
+                } else {
+                    this->reportTable(out, stages);
+                }
+            }
+        private:
+            struct StageTiming {
+                const char* name;
+                Clock::duration offset;
+                Clock::duration duration;
+            };
+
+            Clock::time_point m_startTime;
+            mutable std::mutex m_mutex;
+            std::vector<StageTiming> m_stages;
+            std::optional<Clock::duration> m_firstPresent;
+
+            static double toMilliseconds(Clock::duration duration) {
+                return std::chrono::duration<double, std::milli> { duration }.count();
+            }
+
+            void recordStage(const char* stageName, Clock::time_point stageStart) {
+                const auto stageEnd = Clock::now();
+
+                const auto lock = std::scoped_lock { m_mutex };
+                m_stages.push_back(StageTiming { stageName, stageStart - m_startTime, stageEnd - stageStart });
+            }
+
+            void reportTable(std::ostream& out, const std::vector<StageTiming>& stages) const {
+                fmt::println(out, "{:<28} {:>12} {:>12}", "Startup stage", "Start (ms)", "Time (ms)");
+                for (const auto& stage : stages) {
+                    fmt::println(out, "{:<28} {:>12.3f} {:>12.3f}", stage.name, toMilliseconds(stage.offset), toMilliseconds(stage.duration));
+                }
+
+                if (m_firstPresent.has_value()) {
+                    fmt::println(out, "{:<28} {:>12.3f}", "firstPresent", toMilliseconds(m_firstPresent.value()));
+                }
+            }
+
+            void reportJson(std::ostream& out, const std::vector<StageTiming>& stages) const {
+                fmt::print(out, "{{\"stages\":[");
+                for (size_t i = 0; i < stages.size(); i++) {
+                    const auto& stage = stages[i];
+                    fmt::print(
+                        out,
+                        "{}{{\"name\":\"{}\",\"startMilliseconds\":{:.3f},\"milliseconds\":{:.3f}}}",
+                        i == 0 ? "" : ",",
+                        stage.name,
+                        toMilliseconds(stage.offset),
+                        toMilliseconds(stage.duration)
+                    );
+                }
+
+                fmt::print(out, "]");
+                if (m_firstPresent.has_value()) {
+                    fmt::print(out, ",\"firstPresentMilliseconds\":{:.3f}", toMilliseconds(m_firstPresent.value()));
+                }
+
+                fmt::println(out, "}}");
+            }
+    };
+
+    // Rolling GPU time of one profiled pass, in milliseconds.
+    struct PassTiming {
+        std::string name;
+        double minMilliseconds;
+        double averageMilliseconds;
+        double p99Milliseconds;
+        size_t sampleCount;
+    };
+
+    // One startup, as `StartupProfiler` reports it in JSON, read back by the startup benchmark
+    // from the processes it launches.
+    struct StartupRun {
+        std::vector<std::pair<std::string, double>> stages;
+        std::optional<double> firstPresentMilliseconds;
+        // When the last stage ended, which is all a headless startup has without a present.
+        double totalMilliseconds = 0.0;
+    };
+
+    // Nothing when `line` is not a startup report.
+    inline std::optional<StartupRun> parseStartupReport(std::string_view line) {
+        if (!line.starts_with("{\"stages\":[")) {
+            return std::nullopt;
+        }
+
+        const auto numberAfter = [line](std::string_view key, size_t from) -> std::optional<double> {
+            const auto at = line.find(key, from);
+            if (at == std::string_view::npos) {
+                return std::nullopt;
+            }
+
+            try {
+                return std::stod(std::string { line.substr(at + key.size()) });
+            } catch (const std::exception&) {
+                return std::nullopt;
+            }
+        };
+
+        constexpr auto NAME_KEY = std::string_view { "{\"name\":\"" };
+        auto run = StartupRun {};
+        for (auto at = line.find(NAME_KEY); at != std::string_view::npos; at = line.find(NAME_KEY, at + 1)) {
+            const auto nameStart = at + NAME_KEY.size();
+            const auto nameEnd = line.find('"', nameStart);
+            if (nameEnd == std::string_view::npos) {
+                return std::nullopt;
+            }
+
+            const auto start = numberAfter(",\"startMilliseconds\":", nameEnd);
+            const auto duration = numberAfter(",\"milliseconds\":", nameEnd);
+            if (!start.has_value() || !duration.has_value()) {
+                return std::nullopt;
+            }
+
+            run.stages.emplace_back(std::string { line.substr(nameStart, nameEnd - nameStart) }, duration.value());
+            run.totalMilliseconds = std::max(run.totalMilliseconds, start.value() + duration.value());
+        }
+
+        run.firstPresentMilliseconds = numberAfter(",\"firstPresentMilliseconds\":", 0);
+
+        return run;
+    }
+
+    enum class StartupCondition {
+        // Every pipeline and shader cache emptied, as after a driver update.
+        Cold,
+        // The caches filled by an earlier launch.
+        Warm,
+    };
+
+    inline const char* startupConditionToString(StartupCondition condition) {
+        return condition == StartupCondition::Cold ? "cold" : "warm";
+    }
+
+    // The startups of repeated launches, summarized apart for each condition, so a regression
+    // that only shows cold, like a pipeline compiled at startup, is not averaged away by the
+    // warm launches, and the other way around. `firstPresent` and `total` are summarized next
+    // to the stages.
+    class StartupBenchmark {
+        public:
+            explicit StartupBenchmark() = default;
+
+            StartupBenchmark(const StartupBenchmark& other) = delete;
+            StartupBenchmark& operator=(const StartupBenchmark& other) = delete;
+
+            void add(StartupCondition condition, const StartupRun& run) {
+                auto& stages = m_stages[static_cast<size_t>(condition)];
+                for (const auto& [name, milliseconds] : run.stages) {
+                    this->sample(stages, name, milliseconds);
+                }
+
+                if (run.firstPresentMilliseconds.has_value()) {
+                    this->sample(stages, "firstPresent", run.firstPresentMilliseconds.value());
+                }
+
+                this->sample(stages, "total", run.totalMilliseconds);
+            }
+
+            void report(std::ostream& out) const {
+                for (const auto condition : { StartupCondition::Cold, StartupCondition::Warm }) {
+                    fmt::println(out, "{:<28} {:>10} {:>10} {:>10} {:>10}", fmt::format("Startup stage, {}", startupConditionToString(condition)), "Mean (ms)", "p50 (ms)", "Min (ms)", "Max (ms)");
+                    for (const auto& stage : m_stages[static_cast<size_t>(condition)]) {
+                        const auto summary = summarize(stage.milliseconds);
+                        fmt::println(out, "{:<28} {:>10.3f} {:>10.3f} {:>10.3f} {:>10.3f}", stage.name, summary.mean, summary.p50, summary.min, summary.max);
+                    }
+                }
+            }
+
+            // Writes CSV when `path` ends in `.csv`, and JSON otherwise.
+            void write(const std::filesystem::path& path) const {
+                auto out = std::ofstream { path };
+                if (!out) {
+                    throw std::runtime_error(fmt::format("failed to open startup benchmark output `{}`!", path.string()));
+                }
+
+                const auto csv = path.extension() == ".csv";
+                if (csv) {
+                    fmt::println(out, "condition,stage,mean,p50,min,max,samples");
+                } else {
+                    fmt::print(out, "{{");
+                }
+
+                for (const auto condition : { StartupCondition::Cold, StartupCondition::Warm }) {
+                    const auto& stages = m_stages[static_cast<size_t>(condition)];
+                    if (!csv) {
+                        fmt::print(out, "{}\"{}\":[", condition == StartupCondition::Cold ? "" : ",", startupConditionToString(condition));
+                    }
+
+                    for (size_t i = 0; i < stages.size(); i++) {
+                        const auto summary = summarize(stages[i].milliseconds);
+                        if (csv) {
+                            fmt::println(
+                                out,
+                                "{},{},{:.3f},{:.3f},{:.3f},{:.3f},{}",
+                                startupConditionToString(condition),
+                                stages[i].name,
+                                summary.mean,
+                                summary.p50,
+                                summary.min,
+                                summary.max,
+                                stages[i].milliseconds.size()
+                            );
+                        } else {
+                            fmt::print(
+                                out,
+                                "{}{{\"name\":\"{}\",\"mean\":{:.3f},\"p50\":{:.3f},\"min\":{:.3f},\"max\":{:.3f},\"samples\":{}}}",
+                                i == 0 ? "" : ",",
+                                stages[i].name,
+                                summary.mean,
+                                summary.p50,
+                                summary.min,
+                                summary.max,
+                                stages[i].milliseconds.size()
+                            );
+                        }
+                    }
+
+                    if (!csv) {
+                        fmt::print(out, "]");
+                    }
+                }
+
+                if (!csv) {
+                    fmt::println(out, "}}");
+                }
+            }
+        private:
+            struct StageSamples {
+                std::string name;
+                std::vector<double> milliseconds;
+            };
+
+            struct Summary {
+                double mean;
+                double p50;
+                double min;
+                double max;
+            };
+
+            // In the order the stages first ran.
+            std::array<std::vector<StageSamples>, 2> m_stages;
+
+            static void sample(std::vector<StageSamples>& stages, std::string_view name, double milliseconds) {
+                auto stage = std::find_if(stages.begin(), stages.end(), [name](const StageSamples& other) {
+                    return other.name == name;
+                });
+                if (stage == stages.end()) {
+                    stage = stages.insert(stages.end(), StageSamples { .name = std::string { name } });
+                }
+
+                stage->milliseconds.push_back(milliseconds);
+            }
+
+            static Summary summarize(std::vector<double> values) {
+                std::sort(values.begin(), values.end());
+                auto total = 0.0;
+                for (const auto value : values) {
+                    total += value;
+                }
+
+                return Summary {
+                    .mean = total / static_cast<double>(values.size()),
+                    .p50 = values[values.size() / 2],
+                    .min = values.front(),
+                    .max = values.back(),
+                };
+            }
+    };
+
+    using GpuScope = uint32_t;
+
+    // The raw timestamps a scope began and ended at.
+    struct TimestampInterval {
+        uint64_t begin;
+        uint64_t end;
+    };
+
+    // When a scope began and ended on the host clock.
+    struct HostInterval {
+        std::chrono::steady_clock::time_point begin;
+        std::chrono::steady_clock::time_point end;
+    };
+
+    // Puts the raw timestamps of the device's queues on `std::chrono::steady_clock`, the clock
+    // every CPU timing of the app is taken with, from a device and a host timestamp that
+    // `VK_KHR_calibrated_timestamps` samples together. The clocks drift apart by microseconds a
+    // second, so `recalibrate` samples them again every `RECALIBRATION_INTERVAL`, keeps the
+    // tightest of a few tries, and measures how fast the device clock actually runs from two
+    // samples that far apart. Only the host domain `steady_clock` counts in will do, which is
+    // `CLOCK_MONOTONIC`, or the performance counter on Windows.
+    class ClockCalibration {
+        public:
+            using Clock = std::chrono::steady_clock;
+
+            static constexpr auto RECALIBRATION_INTERVAL = std::chrono::seconds { 1 };
+            static constexpr uint32_t SAMPLE_TRIES = 4;
+            // A measured period further than this from the reported one is a bad sample.
+            static constexpr double MAX_PERIOD_ERROR = 0.001;
+
+#if defined(_WIN32)
+            static constexpr auto HOST_TIME_DOMAIN = VK_TIME_DOMAIN_QUERY_PERFORMANCE_COUNTER_KHR;
+#else
+            static constexpr auto HOST_TIME_DOMAIN = VK_TIME_DOMAIN_CLOCK_MONOTONIC_KHR;
+#endif
+
+            explicit ClockCalibration() = default;
+
+            ClockCalibration(const ClockCalibration& other) = delete;
+            ClockCalibration& operator=(const ClockCalibration& other) = delete;
+
+            // `khr` picks the functions of the KHR extension over the EXT one's. Stays disabled
+            // when the device cannot sample the host domain.
+            void init(VkPhysicalDevice physicalDevice, VkDevice device, bool khr, float timestampPeriod) {
+                m_device = device;
+                m_getCalibratedTimestamps = khr ? vkGetCalibratedTimestampsKHR : vkGetCalibratedTimestampsEXT;
+                const auto getTimeDomains = khr ? vkGetPhysicalDeviceCalibrateableTimeDomainsKHR : vkGetPhysicalDeviceCalibrateableTimeDomainsEXT;
+                if (m_getCalibratedTimestamps == nullptr || getTimeDomains == nullptr) {
+                    return;
+                }
+
+                uint32_t timeDomainCount = 0;
+                getTimeDomains(physicalDevice, &timeDomainCount, nullptr);
+                auto timeDomains = std::vector<VkTimeDomainKHR>(timeDomainCount);
+                getTimeDomains(physicalDevice, &timeDomainCount, timeDomains.data());
+                const auto supports = [&timeDomains](VkTimeDomainKHR timeDomain) {
+                    return std::find(timeDomains.begin(), timeDomains.end(), timeDomain) != timeDomains.end();
+                };
+                if (!supports(VK_TIME_DOMAIN_DEVICE_KHR) || !supports(HOST_TIME_DOMAIN)) {
+                    return;
+                }
+
+                m_nominalPeriod = timestampPeriod;
+                m_period = timestampPeriod;
+                const auto sample = this->sample();
+                if (!sample.has_value()) {
+                    return;
+                }
+
+                m_sample = sample.value();
+                m_lastCalibration = Clock::now();
+                m_enabled = true;
+            }
+
+            bool isEnabled() const {
+                return m_enabled;
+            }
+
+            // Called once a frame, and samples the clocks once they are due. Returns whether it
+            // did, and the timelines then line up with the new sample.
+            bool recalibrate(Clock::time_point now) {
+                if (!m_enabled || now - m_lastCalibration < RECALIBRATION_INTERVAL) {
+                    return false;
+                }
+
+                m_lastCalibration = now;
+                const auto sample = this->sample();
+                if (!sample.has_value()) {
+                    return false;
+                }
+
+                // Both clocks move forward, so a sample that went backwards is a bad one.
+                const auto ticks = sample->deviceTicks - m_sample.deviceTicks;
+                const auto nanoseconds = std::chrono::duration<double, std::nano> { sample->hostTime - m_sample.hostTime }.count();
+                if (ticks > 0 && ticks < (uint64_t { 1 } << 62) && nanoseconds > 0.0) {
+                    const auto period = nanoseconds / static_cast<double>(ticks);
+                    if (std::abs(period / m_nominalPeriod - 1.0) <= MAX_PERIOD_ERROR) {
+                        m_period = period;
+                    }
+                }
+
+                m_sample = sample.value();
+
+                return true;
+            }
+
+            // Where `ticks`, a timestamp whose valid bits are `mask`, falls on the host clock.
+            // Timestamps on either side of the latest sample work, as long as they are less
+            // than half the valid range away from it.
+            Clock::time_point hostTime(uint64_t ticks, uint64_t mask) const {
+                const auto delta = (ticks - m_sample.deviceTicks) & mask;
+                const auto half = mask / 2 + 1;
+                const auto signedDelta = delta >= half ? -static_cast<double>((mask - delta) + 1) : static_cast<double>(delta);
+
+                return m_sample.hostTime + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::nano> { signedDelta * m_period });
+            }
+
+            // The device timestamp at host time `time`, within `mask`.
+            uint64_t deviceTicks(Clock::time_point time, uint64_t mask) const {
+                const auto nanoseconds = std::chrono::duration<double, std::nano> { time - m_sample.hostTime }.count();
+                const auto ticks = static_cast<int64_t>(std::llround(nanoseconds / m_period));
+
+                return (m_sample.deviceTicks + static_cast<uint64_t>(ticks)) & mask;
+            }
+
+            void report(std::ostream& out) const {
+                if (!m_enabled) {
+                    return;
+                }
+
+                fmt::println(
+                    out,
+                    "Clock calibration: {} samples, max deviation {:.3f} us, device clock {:+.2f} ppm from its reported period",
+                    m_sampleCount,
+                    static_cast<double>(m_maxDeviation) / 1000.0,
+                    (m_period / m_nominalPeriod - 1.0) * 1'000'000.0
+                );
+            }
+        private:
+            struct Sample {
+                uint64_t deviceTicks = 0;
+                Clock::time_point hostTime;
+            };
+
+            VkDevice m_device = VK_NULL_HANDLE;
+            PFN_vkGetCalibratedTimestampsKHR m_getCalibratedTimestamps = nullptr;
+            bool m_enabled = false;
+            float m_nominalPeriod = 1.0f;
+            // Nanoseconds per device tick, as measured against the host clock.
+            double m_period = 1.0;
+            Sample m_sample;
+            Clock::time_point m_lastCalibration;
+            uint64_t m_sampleCount = 0;
+            // In nanoseconds, of the samples kept.
+            uint64_t m_maxDeviation = 0;
+
+            // The tries that deviate least are the ones the thread was not preempted in.
+            std::optional<Sample> sample() {
+                const auto timestampInfos = std::array {
+                    VkCalibratedTimestampInfoKHR {
+                        .sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_KHR,
+                        .timeDomain = VK_TIME_DOMAIN_DEVICE_KHR,
+                    },
+                    VkCalibratedTimestampInfoKHR {
+                        .sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_KHR,
+                        .timeDomain = HOST_TIME_DOMAIN,
+                    },
+                };
+
+                auto best = std::optional<Sample> {};
+                auto bestDeviation = std::numeric_limits<uint64_t>::max();
+                for (uint32_t i = 0; i < SAMPLE_TRIES; i++) {
+                    auto timestamps = std::array<uint64_t, 2> {};
+                    uint64_t deviation = 0;
+                    const auto result = m_getCalibratedTimestamps(
+                        m_device,
+                        static_cast<uint32_t>(timestampInfos.size()),
+                        timestampInfos.data(),
+                        timestamps.data(),
+                        &deviation
+                    );
+                    if (result != VK_SUCCESS || deviation >= bestDeviation) {
+                        continue;
+                    }
+
+                    best = Sample { timestamps[0], ClockCalibration::hostTimePoint(timestamps[1]) };
+                    bestDeviation = deviation;
+                }
+
+                if (best.has_value()) {
+                    m_sampleCount++;
+                    m_maxDeviation = std::max(m_maxDeviation, bestDeviation);
+                }
+
+                return best;
+            }
+
+            // `steady_clock` counts the host domain's ticks from the same epoch.
+            static Clock::time_point hostTimePoint(uint64_t value) {
+#if defined(_WIN32)
+                auto frequency = LARGE_INTEGER {};
+                QueryPerformanceFrequency(&frequency);
+                const auto countsPerSecond = static_cast<uint64_t>(frequency.QuadPart);
+                const auto nanoseconds = (value / countsPerSecond) * 1'000'000'000 + (value % countsPerSecond) * 1'000'000'000 / countsPerSecond;
+#else
+                const auto nanoseconds = value;
+#endif
+
+                return Clock::time_point { std::chrono::duration_cast<Clock::duration>(std::chrono::nanoseconds { nanoseconds }) };
+            }
+    };
+
+    // Measures how long each pass of a frame takes on the GPU with timestamp queries.
+    //
+    // Every frame in flight has its own query pool, so the timestamps of a frame are read back
+    // when its slot comes around again, after the caller has waited for that frame to finish.
+    // By then every query is available, and `vkGetQueryPoolResults` never blocks. Passes are
+    // identified by name, and keep the last `SAMPLE_COUNT` durations for the statistics.
+    class GpuTimestampProfiler {
+        public:
+            static constexpr uint32_t MAX_SCOPES_PER_FRAME = 64;
+            static constexpr size_t SAMPLE_COUNT = 256;
+
+            explicit GpuTimestampProfiler() = default;
+
+            GpuTimestampProfiler(const GpuTimestampProfiler& other) = delete;
+            GpuTimestampProfiler& operator=(const GpuTimestampProfiler& other) = delete;
+
+            // `timestampValidBits` comes from the queue family the frames are submitted to. A
+            // family without timestamp support reports zero, and the profiler stays disabled.
+            void init(VkDevice device, float timestampPeriod, uint32_t timestampValidBits, uint32_t framesInFlight, const char* queueName = "graphics") {
+                m_device = device;
+                m_queueName = queueName;
+                m_timestampPeriod = timestampPeriod;
+                m_timestampMask = timestampValidBits >= 64 ? ~uint64_t { 0 } : (uint64_t { 1 } << timestampValidBits) - 1;
+                if (timestampValidBits == 0) {
+                    return;
+                }
+
+                m_frames.resize(framesInFlight);
+                for (auto& frame : m_frames) {
+                    const auto createInfo = VkQueryPoolCreateInfo {
+                        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+                        .queryType = VK_QUERY_TYPE_TIMESTAMP,
+                        .queryCount = MAX_SCOPES_PER_FRAME * 2,
+                    };
+
+                    const auto result = vkCreateQueryPool(m_device, &createInfo, nullptr, &frame.queryPool);
+                    if (result != VK_SUCCESS) {
+                        throw std::runtime_error("failed to create timestamp query pool!");
+                    }
+                }
+            }
+
+            void destroy() {
+                for (auto& frame : m_frames) {
+                    vkDestroyQueryPool(m_device, frame.queryPool, nullptr);
+                }
+
+                m_frames.clear();
+            }
+
+            bool isEnabled() const {
+                return !m_frames.empty();
+            }
+
+            // From now on, feed every scope read back into the timeline of a Tracy build, as GPU
+            // context `context`. The context is lined up with the CPU clock by `calibration`,
+            // and kept in line by `syncTimeline`. Without calibrated timestamps it is lined up
+            // by a timestamp written on `queue` while the CPU waits for it instead, which blocks
+            // for a submission and drifts.
+            void traceTimeline(VkQueue queue, uint32_t queueFamilyIndex, uint8_t context, const ClockCalibration& calibration) {
+                if (!this->isEnabled() || !HELLO_WINDOW_TRACY) {
+                    return;
+                }
+
+                const auto referenceTicks = calibration.isEnabled()
+                    ? calibration.deviceTicks(ClockCalibration::Clock::now(), m_timestampMask)
+                    : this->submitReferenceTimestamp(queue, queueFamilyIndex);
+                m_timeline.init(context, m_queueName, referenceTicks, m_timestampPeriod);
+            }
+
+            // Lines the timeline up with a new calibration of the clocks.
+            void syncTimeline(const ClockCalibration& calibration) {
+                if (m_timeline.isInitialized() && calibration.isEnabled()) {
+                    m_timeline.sync(calibration.deviceTicks(ClockCalibration::Clock::now(), m_timestampMask));
+                }
+            }
+
+            // Collect the timestamps the previous use of `frameIndex` wrote, then reset its
+            // queries. The frame must have finished executing, and this has to be recorded
+            // before any scope and outside of a render pass.
+            void beginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex) {
+                if (!this->isEnabled()) {
+                    return;
+                }
+
+                m_currentFrame = frameIndex;
+                auto& frame = m_frames[frameIndex];
+                this->collect(frame);
+
+                vkCmdResetQueryPool(commandBuffer, frame.queryPool, 0, MAX_SCOPES_PER_FRAME * 2);
+                frame.scopeNames.clear();
+            }
+
+            // `name` must outlive the profiler, a string literal in practice. Returns the scope
+            // to pass to `endScope`, or nothing when every query of the frame is in use.
+            std::optional<GpuScope> beginScope(VkCommandBuffer commandBuffer, const char* name) {
+                if (!this->isEnabled()) {
+                    return std::nullopt;
+                }
+
+                auto& frame = m_frames[m_currentFrame];
+                if (frame.scopeNames.size() == MAX_SCOPES_PER_FRAME) {
+                    return std::nullopt;
+                }
+
+                const auto scope = static_cast<GpuScope>(frame.scopeNames.size());
+                frame.scopeNames.push_back(name);
+                vkCmdWriteTimestamp2(commandBuffer, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, frame.queryPool, scope * 2);
+
+                return scope;
+            }
+
+            void endScope(VkCommandBuffer commandBuffer, std::optional<GpuScope> scope) {
+                if (!scope.has_value()) {
+                    return;
+                }
+
+                const auto& frame = m_frames[m_currentFrame];
+                vkCmdWriteTimestamp2(commandBuffer, VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT, frame.queryPool, scope.value() * 2 + 1);
+            }
+
+            std::vector<PassTiming> statistics() const {
+                auto timings = std::vector<PassTiming> {};
+                for (const auto& [name, samples] : m_samples) {
+                    const auto count = std::min(samples.count, SAMPLE_COUNT);
+                    auto sorted = std::vector<double> { samples.values.begin(), samples.values.begin() + count };
+                    std::sort(sorted.begin(), sorted.end());
+
+                    auto total = 0.0;
+                    for (const auto value : sorted) {
+                        total += value;
+                    }
+
+                    timings.push_back(PassTiming {
+                        .name = name,
+                        .minMilliseconds = sorted.front(),
+                        .averageMilliseconds = total / static_cast<double>(count),
+                        .p99Milliseconds = sorted[std::min(count - 1, count * 99 / 100)],
+                        .sampleCount = count,
+                    });
+                }
+
+                return timings;
+            }
+
+            // The latest duration of the pass called `name`, if it has been measured yet.
+            std::optional<double> lastMilliseconds(const std::string& name) const {
+                const auto found = m_samples.find(name);
+                if (found == m_samples.end()) {
+                    return std::nullopt;
+                }
+
+                const auto& samples = found->second;
+
+                return samples.values[(samples.count - 1) % SAMPLE_COUNT];
+            }
+
+            // Calls `visit` with the name and latest duration of every pass measured so far, in
+            // the order of their names.
+            template <typename F>
+            void forEachLatest(F&& visit) const {
+                for (const auto& [name, samples] : m_samples) {
+                    visit(name, samples.values[(samples.count - 1) % SAMPLE_COUNT]);
+                }
+            }
+
+            // The timestamps of the scope called `name` in the frame the last `beginFrame` read
+            // back, if it had one.
+            std::optional<TimestampInterval> interval(const std::string& name) const {
+                const auto found = m_intervals.find(name);
+                if (found == m_intervals.end()) {
+                    return std::nullopt;
+                }
+
+                return found->second;
+            }
+
+            // The interval `interval` returns, on the host clock.
+            std::optional<HostInterval> hostInterval(const std::string& name, const ClockCalibration& calibration) const {
+                const auto found = m_intervals.find(name);
+                if (found == m_intervals.end() || !calibration.isEnabled()) {
+                    return std::nullopt;
+                }
+
+                return HostInterval {
+                    .begin = calibration.hostTime(found->second.begin, m_timestampMask),
+                    .end = calibration.hostTime(found->second.end, m_timestampMask),
+                };
+            }
+
+            // How long two intervals overlap, in milliseconds. Timestamps from every queue of the
+            // device are in the same time domain, so the intervals may come from another queue's
+            // profiler.
+            double overlapMilliseconds(const TimestampInterval& a, const TimestampInterval& b) const {
+                const auto begin = std::max(a.begin, b.begin);
+                const auto end = std::min(a.end, b.end);
+                if (end <= begin) {
+                    return 0.0;
+                }
+
+                return static_cast<double>(end - begin) * m_timestampPeriod / 1'000'000.0;
+            }
+
+            // Adds a duration measured outside of the scopes, like an overlap, to the statistics.
+            void addSample(const std::string& name, double milliseconds) {
+                auto& samples = m_samples[name];
+                samples.values[samples.count % SAMPLE_COUNT] = milliseconds;
+                samples.count++;
+            }
+
+            void report(std::ostream& out) const {
+                if (!this->isEnabled()) {
+                    fmt::println(out, "GPU timestamps are not supported on the {} queue", m_queueName);
+                    return;
+                }
+
+                fmt::println(out, "{:<28} {:>12} {:>12} {:>12}", "GPU pass", "Min (ms)", "Avg (ms)", "p99 (ms)");
+                for (const auto& timing : this->statistics()) {
+                    fmt::println(
+                        out,
+                        "{:<28} {:>12.3f} {:>12.3f} {:>12.3f}",
+                        timing.name,
+                        timing.minMilliseconds,
+                        timing.averageMilliseconds,
+                        timing.p99Milliseconds
+                    );
+                }
+            }
+        private:
+            struct FrameQueries {
+                VkQueryPool queryPool = VK_NULL_HANDLE;
+                std::vector<const char*> scopeNames;
+            };
+
+            // A ring of the latest durations of one pass.
+            struct Samples {
+                std::vector<double> values = std::vector<double>(SAMPLE_COUNT);
+                size_t count = 0;
+            };
+
+            VkDevice m_device = VK_NULL_HANDLE;
+            const char* m_queueName = "graphics";
+            float m_timestampPeriod = 1.0f;
+            uint64_t m_timestampMask = 0;
+            std::vector<FrameQueries> m_frames;
+            uint32_t m_currentFrame = 0;
+            std::map<std::string, Samples> m_samples;
+            std::map<std::string, TimestampInterval> m_intervals;
+            std::vector<uint64_t> m_results;
+            vk_tracing::GpuTimeline m_timeline;
+            std::vector<vk_tracing::GpuZone> m_timelineZones;
+
+            // A timestamp of `queue`, taken right before this returns.
+            uint64_t submitReferenceTimestamp(VkQueue queue, uint32_t queueFamilyIndex) {
+                const auto poolInfo = VkCommandPoolCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+                    .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+                    .queueFamilyIndex = queueFamilyIndex,
+                };
+                auto commandPool = VkCommandPool {};
+                if (vkCreateCommandPool(m_device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create timestamp calibration command pool!");
+                }
+
+                const auto allocateInfo = VkCommandBufferAllocateInfo {
+                    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                    .commandPool = commandPool,
+                    .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                    .commandBufferCount = 1,
+                };
+                auto commandBuffer = VkCommandBuffer {};
+                vkAllocateCommandBuffers(m_device, &allocateInfo, &commandBuffer);
+
+                // The first frame resets its queries before using them, so borrowing one is safe.
+                const auto queryPool = m_frames.front().queryPool;
+                const auto beginInfo = VkCommandBufferBeginInfo {
+                    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                    .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+                };
+                vkBeginCommandBuffer(commandBuffer, &beginInfo);
+                vkCmdResetQueryPool(commandBuffer, queryPool, 0, 1);
+                vkCmdWriteTimestamp2(commandBuffer, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, queryPool, 0);
+                vkEndCommandBuffer(commandBuffer);
+
+                const auto submitInfo = VkSubmitInfo {
+                    .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+                    .commandBufferCount = 1,
+                    .pCommandBuffers = &commandBuffer,
+                };
+                const auto submitResult = vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
+                if (submitResult != VK_SUCCESS || vkQueueWaitIdle(queue) != VK_SUCCESS) {
+                    vkDestroyCommandPool(m_device, commandPool, nullptr);
+                    throw std::runtime_error("failed to submit timestamp calibration!");
+                }
+
+                uint64_t referenceTicks = 0;
+                const auto result = vkGetQueryPoolResults(
+                    m_device,
+                    queryPool,
+                    0,
+                    1,
+                    sizeof(referenceTicks),
+                    &referenceTicks,
+                    sizeof(referenceTicks),
+                    VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT
+                );
+                vkDestroyCommandPool(m_device, commandPool, nullptr);
+                if (result != VK_SUCCESS) {
+                    throw std::runtime_error("failed to read timestamp calibration!");
+                }
+
+                return referenceTicks & m_timestampMask;
+            }
+
+            void collect(const FrameQueries& frame) {
+                m_intervals.clear();
+                if (frame.scopeNames.empty()) {
+                    return;
+                }
+
+                // Each query comes back as its value followed by its availability.
+                const auto queryCount = static_cast<uint32_t>(frame.scopeNames.size() * 2);
+                m_results.resize(queryCount * 2);
+                const auto result = vkGetQueryPoolResults(
+                    m_device,
+                    frame.queryPool,
+                    0,
+                    queryCount,
+                    m_results.size() * sizeof(uint64_t),
+                    m_results.data(),
+                    sizeof(uint64_t) * 2,
+                    VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT
+                );
+                if (result != VK_SUCCESS && result != VK_NOT_READY) {
+                    throw std::runtime_error("failed to read timestamp queries!");
+                }
+
+                for (size_t scope = 0; scope < frame.scopeNames.size(); scope++) {
+                    const auto begin = m_results[scope * 4];
+                    const auto beginAvailable = m_results[scope * 4 + 1];
+                    const auto end = m_results[scope * 4 + 2];
+                    const auto endAvailable = m_results[scope * 4 + 3];
+                    if (beginAvailable == 0 || endAvailable == 0) {
+                        continue;
+                    }
+
+                    // Only the low `timestampValidBits` are meaningful, so the subtraction wraps
+                    // within them.
+                    const auto ticks = (end - begin) & m_timestampMask;
+                    const auto milliseconds = static_cast<double>(ticks) * m_timestampPeriod / 1'000'000.0;
+                    m_intervals[frame.scopeNames[scope]] = TimestampInterval { begin & m_timestampMask, end & m_timestampMask };
+                    this->addSample(frame.scopeNames[scope], milliseconds);
+                }
+
+                if (m_timeline.isInitialized()) {
+                    m_timelineZones.clear();
+                    for (const auto& [name, interval] : m_intervals) {
+                        m_timelineZones.push_back(vk_tracing::GpuZone { name, interval.begin, interval.end });
+                    }
+
+                    m_timeline.emit(m_timelineZones);
+                }
+            }
+    };
+
+    // The counters a pipeline statistics query collects, in the order the query writes them,
+    // which is the order of their bits in `PIPELINE_STATISTICS`.
+    enum class PipelineStatistic : uint32_t {
+        VertexInvocations,
+        ClippingInvocations,
+        ClippingPrimitives,
+        FragmentInvocations,
+        ComputeInvocations,
+        Count,
+    };
+
+    constexpr VkQueryPipelineStatisticFlags PIPELINE_STATISTICS =
+        VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT
+        | VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT
+        | VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT
+        | VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT
+        | VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+
+    inline const char* pipelineStatisticToString(PipelineStatistic statistic) {
+        switch (statistic) {
+            case PipelineStatistic::VertexInvocations: return "vertexInvocations";
+            case PipelineStatistic::ClippingInvocations: return "clippingInvocations";
+            case PipelineStatistic::ClippingPrimitives: return "clippingPrimitives";
+            case PipelineStatistic::FragmentInvocations: return "fragmentInvocations";
+            case PipelineStatistic::ComputeInvocations: return "computeInvocations";
+            case PipelineStatistic::Count: break;
+        }
+
+        return "unknown";
+    }
+
+    using PipelineStatisticCounts = std::array<uint64_t, static_cast<size_t>(PipelineStatistic::Count)>;
+
+    // The mean counts of one pass over its latest samples.
+    struct PassStatistics {
+        std::string name;
+        std::array<double, static_cast<size_t>(PipelineStatistic::Count)> mean;
+        size_t sampleCount;
+    };
+
+    // Counts the vertex, fragment and compute shader invocations and the primitives clipped in
+    // each pass of a frame with pipeline statistics queries, so a regression can be told apart
+    // as geometry, overdraw or compute.
+    //
+    // Queries of one type cannot be active at the same time, so scopes must not nest, unlike
+    // the timestamp profiler's, and the counters include graphics work, so scopes are only
+    // recorded on a queue of the graphics family. Otherwise this works like
+    // `GpuTimestampProfiler`: a query pool per frame in flight, read back once the frame's slot
+    // comes around again, and the last `SAMPLE_COUNT` samples of every pass kept by name.
+    class PipelineStatisticsProfiler {
+        public:
+            static constexpr uint32_t MAX_SCOPES_PER_FRAME = 64;
+            static constexpr size_t SAMPLE_COUNT = 256;
+
+            explicit PipelineStatisticsProfiler() = default;
+
+            PipelineStatisticsProfiler(const PipelineStatisticsProfiler& other) = delete;
+            PipelineStatisticsProfiler& operator=(const PipelineStatisticsProfiler& other) = delete;
+
+            // The device must have `pipelineStatisticsQuery` and `inheritedQueries` enabled.
+            void init(VkDevice device, uint32_t framesInFlight) {
+                m_device = device;
+                m_frames.resize(framesInFlight);
+                for (auto& frame : m_frames) {
+                    const auto createInfo = VkQueryPoolCreateInfo {
+                        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+                        .queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS,
+                        .queryCount = MAX_SCOPES_PER_FRAME,
+                        .pipelineStatistics = PIPELINE_STATISTICS,
+                    };
+
+                    const auto result = vkCreateQueryPool(m_device, &createInfo, nullptr, &frame.queryPool);
+                    if (result != VK_SUCCESS) {
+                        throw std::runtime_error("failed to create pipeline statistics query pool!");
+                    }
+                }
+            }
+
+            void destroy() {
+                for (auto& frame : m_frames) {
+                    vkDestroyQueryPool(m_device, frame.queryPool, nullptr);
+                }
+
+                m_frames.clear();
+            }
+
+            bool isEnabled() const {
+                return !m_frames.empty();
+            }
+
+            // What secondary command buffers executed inside a scope inherit.
+            VkQueryPipelineStatisticFlags inheritedStatistics() const {
+                return this->isEnabled() ? PIPELINE_STATISTICS : 0;
+            }
+
+            // Collect the counts the previous use of `frameIndex` wrote, then reset its queries.
+            // The frame must have finished executing, and this has to be recorded before any
+            // scope and outside of a render pass.
+            void beginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex) {
+                if (!this->isEnabled()) {
+                    return;
+                }
+
+                m_currentFrame = frameIndex;
+                auto& frame = m_frames[frameIndex];
+                this->collect(frame);
+
+                vkCmdResetQueryPool(commandBuffer, frame.queryPool, 0, MAX_SCOPES_PER_FRAME);
+                frame.scopeNames.clear();
+            }
+
+            // `name` must outlive the profiler, a string literal in practice. Returns the scope
+            // to pass to `endScope`, or nothing when every query of the frame is in use.
+            std::optional<uint32_t> beginScope(VkCommandBuffer commandBuffer, const char* name) {
+                if (!this->isEnabled()) {
+                    return std::nullopt;
+                }
+
+                auto& frame = m_frames[m_currentFrame];
+                if (frame.scopeNames.size() == MAX_SCOPES_PER_FRAME) {
+                    return std::nullopt;
+                }
+
+                const auto scope = static_cast<uint32_t>(frame.scopeNames.size());
+                frame.scopeNames.push_back(name);
+                vkCmdBeginQuery(commandBuffer, frame.queryPool, scope, 0);
+
+                return scope;
+            }
+
+            void endScope(VkCommandBuffer commandBuffer, std::optional<uint32_t> scope) {
+                if (!scope.has_value()) {
+                    return;
+                }
+
+                vkCmdEndQuery(commandBuffer, m_frames[m_currentFrame].queryPool, scope.value());
+            }
+
+            std::vector<PassStatistics> statistics() const {
+                auto statistics = std::vector<PassStatistics> {};
+                for (const auto& [name, samples] : m_samples) {
+                    const auto count = std::min(samples.count, SAMPLE_COUNT);
+                    auto mean = std::array<double, static_cast<size_t>(PipelineStatistic::Count)> {};
+                    for (size_t i = 0; i < count; i++) {
+                        for (size_t statistic = 0; statistic < mean.size(); statistic++) {
+                            mean[statistic] += static_cast<double>(samples.values[i][statistic]);
+                        }
+                    }
+
+                    for (auto& value : mean) {
+                        value /= static_cast<double>(count);
+                    }
+
+                    statistics.push_back(PassStatistics { .name = name, .mean = mean, .sampleCount = count });
+                }
+
+                return statistics;
+            }
+
+            // The counts of every pass of the frame read back last, added up.
+            const PipelineStatisticCounts& lastFrameCounts() const {
+                return m_lastFrameCounts;
+            }
+
+            void report(std::ostream& out) const {
+                if (!this->isEnabled()) {
+                    return;
+                }
+
+                fmt::print(out, "{:<28}", "Pipeline statistics (mean)");
+                for (size_t statistic = 0; statistic < static_cast<size_t>(PipelineStatistic::Count); statistic++) {
+                    fmt::print(out, " {:>20}", pipelineStatisticToString(static_cast<PipelineStatistic>(statistic)));
+                }
+                fmt::println(out, "");
+
+                for (const auto& pass : this->statistics()) {
+                    fmt::print(out, "{:<28}", pass.name);
+                    for (const auto value : pass.mean) {
+                        fmt::print(out, " {:>20.0f}", value);
+                    }
+                    fmt::println(out, "");
+                }
+            }
+
+            // One JSON object per line, like the frame telemetry it is exported with.
+            void reportJson(std::ostream& out) const {
+                fmt::print(out, "{{\"pipelineStatistics\":[");
+                const auto statistics = this->statistics();
+                for (size_t i = 0; i < statistics.size(); i++) {
+                    const auto& pass = statistics[i];
+                    fmt::print(out, "{}{{\"pass\":\"{}\",\"samples\":{}", i == 0 ? "" : ",", pass.name, pass.sampleCount);
+                    for (size_t statistic = 0; statistic < pass.mean.size(); statistic++) {
+                        fmt::print(out, ",\"{}\":{:.0f}", pipelineStatisticToString(static_cast<PipelineStatistic>(statistic)), pass.mean[statistic]);
+                    }
+                    fmt::print(out, "}}");
+                }
+
+                fmt::println(out, "]}}");
+            }
+        private:
+            struct FrameQueries {
+                VkQueryPool queryPool = VK_NULL_HANDLE;
+                std::vector<const char*> scopeNames;
+            };
+
+            struct Samples {
+                std::vector<PipelineStatisticCounts> values = std::vector<PipelineStatisticCounts>(SAMPLE_COUNT);
+                size_t count = 0;
+            };
+
+            // Each query comes back as its counters followed by its availability.
+            static constexpr size_t RESULT_STRIDE = static_cast<size_t>(PipelineStatistic::Count) + 1;
+
+            VkDevice m_device = VK_NULL_HANDLE;
+            std::vector<FrameQueries> m_frames;
+            uint32_t m_currentFrame = 0;
+            std::map<std::string, Samples> m_samples;
+            std::vector<uint64_t> m_results;
+            PipelineStatisticCounts m_lastFrameCounts {};
+
+            void collect(const FrameQueries& frame) {
+                if (frame.scopeNames.empty()) {
+                    return;
+                }
+
+                const auto queryCount = static_cast<uint32_t>(frame.scopeNames.size());
+                m_results.resize(queryCount * RESULT_STRIDE);
+                const auto result = vkGetQueryPoolResults(
+                    m_device,
+                    frame.queryPool,
+                    0,
+                    queryCount,
+                    m_results.size() * sizeof(uint64_t),
+                    m_results.data(),
+                    RESULT_STRIDE * sizeof(uint64_t),
+                    VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT
+                );
+                if (result != VK_SUCCESS && result != VK_NOT_READY) {
+                    throw std::runtime_error("failed to read pipeline statistics queries!");
+                }
+
+                m_lastFrameCounts.fill(0);
+                for (size_t scope = 0; scope < frame.scopeNames.size(); scope++) {
+                    const auto first = m_results.begin() + static_cast<std::ptrdiff_t>(scope * RESULT_STRIDE);
+                    if (first[RESULT_STRIDE - 1] == 0) {
+                        continue;
+                    }
+
+                    auto& samples = m_samples[frame.scopeNames[scope]];
+                    std::copy(first, first + (RESULT_STRIDE - 1), samples.values[samples.count % SAMPLE_COUNT].begin());
+                    samples.count++;
+                    for (size_t statistic = 0; statistic < m_lastFrameCounts.size(); statistic++) {
+                        m_lastFrameCounts[statistic] += first[statistic];
+                    }
+                }
+            }
+    };
+
+    inline const char* performanceCounterUnitToString(VkPerformanceCounterUnitKHR unit) {
+        switch (unit) {
+            case VK_PERFORMANCE_COUNTER_UNIT_GENERIC_KHR: return "";
+            case VK_PERFORMANCE_COUNTER_UNIT_PERCENTAGE_KHR: return "%";
+            case VK_PERFORMANCE_COUNTER_UNIT_NANOSECONDS_KHR: return "ns";
+            case VK_PERFORMANCE_COUNTER_UNIT_BYTES_KHR: return "B";
+            case VK_PERFORMANCE_COUNTER_UNIT_BYTES_PER_SECOND_KHR: return "B/s";
+            case VK_PERFORMANCE_COUNTER_UNIT_KELVIN_KHR: return "K";
+            case VK_PERFORMANCE_COUNTER_UNIT_WATTS_KHR: return "W";
+            case VK_PERFORMANCE_COUNTER_UNIT_VOLTS_KHR: return "V";
+            case VK_PERFORMANCE_COUNTER_UNIT_AMPS_KHR: return "A";
+            case VK_PERFORMANCE_COUNTER_UNIT_HERTZ_KHR: return "Hz";
+            case VK_PERFORMANCE_COUNTER_UNIT_CYCLES_KHR: return "cycles";
+            default: return "";
+        }
+    }
+
+    // A hardware counter of a queue family, as the driver describes it. `index` is its place
+    // in the driver's enumeration, which query pools select counters by.
+    struct PerformanceCounter {
+        uint32_t index;
+        std::string name;
+        std::string category;
+        std::string description;
+        VkPerformanceCounterUnitKHR unit;
+        VkPerformanceCounterScopeKHR scope;
+        VkPerformanceCounterStorageKHR storage;
+    };
+
+    // Every counter the device exposes on `queueFamily`. The device needs
+    // `VK_KHR_performance_query`.
+    inline std::vector<PerformanceCounter> enumeratePerformanceCounters(VkPhysicalDevice physicalDevice, uint32_t queueFamily) {
+        uint32_t counterCount = 0;
+        auto result = vkEnumeratePhysicalDeviceQueueFamilyPerformanceQueryCountersKHR(physicalDevice, queueFamily, &counterCount, nullptr, nullptr);
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("failed to enumerate performance counters!");
+        }
+
+        auto counters = std::vector<VkPerformanceCounterKHR>(counterCount, VkPerformanceCounterKHR {
+            .sType = VK_STRUCTURE_TYPE_PERFORMANCE_COUNTER_KHR,
+        });
+        auto descriptions = std::vector<VkPerformanceCounterDescriptionKHR>(counterCount, VkPerformanceCounterDescriptionKHR {
+            .sType = VK_STRUCTURE_TYPE_PERFORMANCE_COUNTER_DESCRIPTION_KHR,
+        });
+        result = vkEnumeratePhysicalDeviceQueueFamilyPerformanceQueryCountersKHR(physicalDevice, queueFamily, &counterCount, counters.data(), descriptions.data());
+        if (result != VK_SUCCESS && result != VK_INCOMPLETE) {
+            throw std::runtime_error("failed to enumerate performance counters!");
+        }
+
+        auto performanceCounters = std::vector<PerformanceCounter> {};
+        for (uint32_t i = 0; i < counterCount; i++) {
+            performanceCounters.push_back(PerformanceCounter {
+                .index = i,
+                .name = descriptions[i].name,
+                .category = descriptions[i].category,
+                .description = descriptions[i].description,
+                .unit = counters[i].unit,
+                .scope = counters[i].scope,
+                .storage = counters[i].storage,
+            });
+        }
+
+        return performanceCounters;
+    }
+
+    inline void listPerformanceCounters(std::ostream& out, const std::vector<PerformanceCounter>& counters) {
+        fmt::println(out, "{:<24} {:<40} {:<8} {}", "Category", "Performance counter", "Unit", "Description");
+        for (const auto& counter : counters) {
+            fmt::println(out, "{:<24} {:<40} {:<8} {}", counter.category, counter.name, performanceCounterUnitToString(counter.unit), counter.description);
+        }
+    }
+
+    // The mean of every counter of one pass over its latest samples. A counter the pass has no
+    // samples of yet has a `sampleCounts` of 0.
+    struct PassCounters {
+        std::string name;
+        std::vector<double> mean;
+        std::vector<size_t> sampleCounts;
+    };
+
+    // Reads hardware counters, like cache hit rates, occupancy and memory bandwidth, for each
+    // pass of a frame with `VK_KHR_performance_query`, for the regressions the timestamps and
+    // pipeline statistics cannot explain.
+    //
+    // A driver can only count so many counters at once, and a query pool of more needs its
+    // command buffers submitted once per counter pass, which a frame loop does not do. So the
+    // selected counters are split into groups the driver counts in one pass each, and the
+    // frames take turns on the groups: with `n` groups, each counter is sampled every `n`th
+    // frame. A counter that alone takes several passes is left out.
+    //
+    // Only counters with a per command scope are selected, since the scopes are the render
+    // graph's passes. Like pipeline statistics, the scopes must not nest and are only recorded
+    // on the queue family the counters were enumerated for. Unlike them, they must not contain
+    // secondary command buffers, and a command buffer must not both reset a query and begin
+    // it, so the pools are reset from the host. The device has to be held in profiling mode
+    // while any command buffer with a scope is recorded or executed, which the profiler does
+    // from `init` to `destroy`.
+    class PerformanceCounterProfiler {
+        public:
+            static constexpr uint32_t MAX_SCOPES_PER_FRAME = 64;
+            static constexpr size_t SAMPLE_COUNT = 256;
+
+            explicit PerformanceCounterProfiler() = default;
+
+            PerformanceCounterProfiler(const PerformanceCounterProfiler& other) = delete;
+            PerformanceCounterProfiler& operator=(const PerformanceCounterProfiler& other) = delete;
+
+            // Selects every counter whose name contains one of `patterns`, ignoring case. The
+            // device must have `performanceCounterQueryPools` and `hostQueryReset` enabled.
+            // Nothing is enabled when no counter matches.
+            void init(
+                VkPhysicalDevice physicalDevice,
+                VkDevice device,
+                uint32_t queueFamily,
+                uint32_t framesInFlight,
+                const std::vector<std::string>& patterns
+            ) {
+                m_device = device;
+                for (auto& counter : enumeratePerformanceCounters(physicalDevice, queueFamily)) {
+                    if (counter.scope != VK_PERFORMANCE_COUNTER_SCOPE_COMMAND_KHR || !matchesAny(counter.name, patterns)) {
+                        continue;
+                    }
+
+                    if (PerformanceCounterProfiler::passCount(physicalDevice, queueFamily, { counter.index }) != 1) {
+                        VK_LOG_WARNING("Performance counter '{}' takes more than one pass, leaving it out", counter.name);
+                        continue;
+                    }
+
+                    auto indices = m_groups.empty() ? std::vector<uint32_t> {} : m_groups.back().counterIndices;
+                    indices.push_back(counter.index);
+                    if (m_groups.empty() || PerformanceCounterProfiler::passCount(physicalDevice, queueFamily, indices) != 1) {
+                        m_groups.emplace_back();
+                    }
+
+                    auto& group = m_groups.back();
+                    group.counterIndices.push_back(counter.index);
+                    group.counters.push_back(static_cast<uint32_t>(m_counters.size()));
+                    m_counters.push_back(std::move(counter));
+                }
+
+                if (m_groups.empty()) {
+                    return;
+                }
+
+                const auto lockInfo = VkAcquireProfilingLockInfoKHR {
+                    .sType = VK_STRUCTURE_TYPE_ACQUIRE_PROFILING_LOCK_INFO_KHR,
+                    .timeout = UINT64_MAX,
+                };
+                if (vkAcquireProfilingLockKHR(m_device, &lockInfo) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to acquire the profiling lock!");
+                }
+                m_profilingLock = true;
+
+                m_frames.resize(framesInFlight);
+                for (auto& frame : m_frames) {
+                    for (const auto& group : m_groups) {
+                        const auto performanceInfo = VkQueryPoolPerformanceCreateInfoKHR {
+                            .sType = VK_STRUCTURE_TYPE_QUERY_POOL_PERFORMANCE_CREATE_INFO_KHR,
+                            .queueFamilyIndex = queueFamily,
+                            .counterIndexCount = static_cast<uint32_t>(group.counterIndices.size()),
+                            .pCounterIndices = group.counterIndices.data(),
+                        };
+                        const auto createInfo = VkQueryPoolCreateInfo {
+                            .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+                            .pNext = &performanceInfo,
+                            .queryType = VK_QUERY_TYPE_PERFORMANCE_QUERY_KHR,
+                            .queryCount = MAX_SCOPES_PER_FRAME,
+                        };
+
+                        auto queryPool = VkQueryPool { VK_NULL_HANDLE };
+                        const auto result = vkCreateQueryPool(m_device, &createInfo, nullptr, &queryPool);
+                        if (result != VK_SUCCESS) {
+                            throw std::runtime_error("failed to create performance query pool!");
+                        }
+
+                        vkResetQueryPool(m_device, queryPool, 0, MAX_SCOPES_PER_FRAME);
+                        frame.queryPools.push_back(queryPool);
+                    }
+                }
+            }
+
+            void destroy() {
+                for (auto& frame : m_frames) {
+                    for (const auto queryPool : frame.queryPools) {
+                        vkDestroyQueryPool(m_device, queryPool, nullptr);
+                    }
+                }
+
+                m_frames.clear();
+                if (m_profilingLock) {
+                    vkReleaseProfilingLockKHR(m_device);
+                    m_profilingLock = false;
+                }
+            }
+
+            bool isEnabled() const {
+                return !m_frames.empty();
+            }
+
+            const std::vector<PerformanceCounter>& counters() const {
+                return m_counters;
+            }
+
+            size_t groupCount() const {
+                return m_groups.size();
+            }
+
+            // Collect the counters the previous use of `frameIndex` wrote, which must have
+            // finished executing, then reset its queries and hand the frame the next group.
+            void beginFrame(uint32_t frameIndex) {
+                if (!this->isEnabled()) {
+                    return;
+                }
+
+                m_currentFrame = frameIndex;
+                auto& frame = m_frames[frameIndex];
+                this->collect(frame);
+
+                vkResetQueryPool(m_device, frame.queryPools[frame.group], 0, MAX_SCOPES_PER_FRAME);
+                frame.scopeNames.clear();
+                frame.group = m_nextGroup;
+                m_nextGroup = (m_nextGroup + 1) % static_cast<uint32_t>(m_groups.size());
+            }
+
+            // `name` must outlive the profiler, a string literal in practice. Returns the scope
+            // to pass to `endScope`, or nothing when every query of the frame is in use.
+            std::optional<uint32_t> beginScope(VkCommandBuffer commandBuffer, const char* name) {
+                if (!this->isEnabled()) {
+                    return std::nullopt;
+                }
+
+                auto& frame = m_frames[m_currentFrame];
+                if (frame.scopeNames.size() == MAX_SCOPES_PER_FRAME) {
+                    return std::nullopt;
+                }
+
+                const auto scope = static_cast<uint32_t>(frame.scopeNames.size());
+                frame.scopeNames.push_back(name);
+                vkCmdBeginQuery(commandBuffer, frame.queryPools[frame.group], scope, 0);
+
+                return scope;
+            }
+
+            void endScope(VkCommandBuffer commandBuffer, std::optional<uint32_t> scope) {
+                if (!scope.has_value()) {
+                    return;
+                }
+
+                const auto& frame = m_frames[m_currentFrame];
+                vkCmdEndQuery(commandBuffer, frame.queryPools[frame.group], scope.value());
+            }
+
+            std::vector<PassCounters> statistics() const {
+                auto statistics = std::vector<PassCounters> {};
+                for (const auto& [name, passSamples] : m_samples) {
+                    auto pass = PassCounters {
+                        .name = name,
+                        .mean = std::vector<double>(m_counters.size(), 0.0),
+                        .sampleCounts = std::vector<size_t>(m_counters.size(), 0),
+                    };
+                    for (size_t counter = 0; counter < m_counters.size(); counter++) {
+                        const auto& samples = passSamples[counter];
+                        const auto count = std::min(samples.count, SAMPLE_COUNT);
+                        for (size_t i = 0; i < count; i++) {
+                            pass.mean[counter] += samples.values[i];
+                        }
+
+                        pass.mean[counter] = count == 0 ? 0.0 : pass.mean[counter] / static_cast<double>(count);
+                        pass.sampleCounts[counter] = count;
+                    }
+
+                    statistics.push_back(std::move(pass));
+                }
+
+                return statistics;
+            }
+
+            void report(std::ostream& out) const {
+                if (!this->isEnabled()) {
+                    return;
+                }
+
+                fmt::println(out, "{:<28} {:<40} {:>16} {:<8}", "Performance counters (mean)", "Counter", "Mean", "Unit");
+                for (const auto& pass : this->statistics()) {
+                    for (size_t counter = 0; counter < m_counters.size(); counter++) {
+                        if (pass.sampleCounts[counter] == 0) {
+                            continue;
+                        }
+
+                        fmt::println(
+                            out,
+                            "{:<28} {:<40} {:>16.2f} {:<8}",
+                            pass.name,
+                            m_counters[counter].name,
+                            pass.mean[counter],
+                            performanceCounterUnitToString(m_counters[counter].unit)
+                        );
+                    }
+                }
+            }
+
+            // One JSON object per line, like the frame telemetry it is exported with.
+            void reportJson(std::ostream& out) const {
+                fmt::print(out, "{{\"performanceCounters\":[");
+                const auto statistics = this->statistics();
+                for (size_t i = 0; i < statistics.size(); i++) {
+                    const auto& pass = statistics[i];
+                    fmt::print(out, "{}{{\"pass\":\"{}\",\"counters\":[", i == 0 ? "" : ",", pass.name);
+                    bool first = true;
+                    for (size_t counter = 0; counter < m_counters.size(); counter++) {
+                        if (pass.sampleCounts[counter] == 0) {
+                            continue;
+                        }
+
+                        fmt::print(
+                            out,
+                            "{}{{\"name\":\"{}\",\"unit\":\"{}\",\"samples\":{},\"mean\":{:.3f}}}",
+                            first ? "" : ",",
+                            m_counters[counter].name,
+                            performanceCounterUnitToString(m_counters[counter].unit),
+                            pass.sampleCounts[counter],
+                            pass.mean[counter]
+                        );
+                        first = false;
+                    }
+                    fmt::print(out, "]}}");
+                }
+
+                fmt::println(out, "]}}");
+            }
+        private:
+            // Counters the driver counts together in a single pass. `counterIndices` are the
+            // driver's indices, `counters` the same counters' places in `m_counters`.
+            struct CounterGroup {
+                std::vector<uint32_t> counterIndices;
+                std::vector<uint32_t> counters;
+            };
+
+            // A pool per group, of which the frame uses the one of `group`.
+            struct FrameQueries {
+                std::vector<VkQueryPool> queryPools;
+                uint32_t group = 0;
+                std::vector<const char*> scopeNames;
+            };
+
+            struct Samples {
+                std::vector<double> values = std::vector<double>(SAMPLE_COUNT);
+                size_t count = 0;
+            };
+
+            VkDevice m_device = VK_NULL_HANDLE;
+            bool m_profilingLock = false;
+            std::vector<PerformanceCounter> m_counters;
+            std::vector<CounterGroup> m_groups;
+            std::vector<FrameQueries> m_frames;
+            uint32_t m_currentFrame = 0;
+            uint32_t m_nextGroup = 0;
+            // Per pass, the samples of every counter, in the order of `m_counters`.
+            std::map<std::string, std::vector<Samples>> m_samples;
+            std::vector<VkPerformanceCounterResultKHR> m_results;
+
+            static bool matchesAny(const std::string& name, const std::vector<std::string>& patterns) {
+                const auto lower = [](std::string text) {
+                    std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+                    return text;
+                };
+
+                const auto lowerName = lower(name);
+                return std::any_of(patterns.begin(), patterns.end(), [&](const std::string& pattern) {
+                    return !pattern.empty() && lowerName.find(lower(pattern)) != std::string::npos;
+                });
+            }
+
+            static uint32_t passCount(VkPhysicalDevice physicalDevice, uint32_t queueFamily, const std::vector<uint32_t>& counterIndices) {
+                const auto performanceInfo = VkQueryPoolPerformanceCreateInfoKHR {
+                    .sType = VK_STRUCTURE_TYPE_QUERY_POOL_PERFORMANCE_CREATE_INFO_KHR,
+                    .queueFamilyIndex = queueFamily,
+                    .counterIndexCount = static_cast<uint32_t>(counterIndices.size()),
+                    .pCounterIndices = counterIndices.data(),
+                };
+
+                uint32_t passes = 0;
+                vkGetPhysicalDeviceQueueFamilyPerformanceQueryPassesKHR(physicalDevice, &performanceInfo, &passes);
+
+                return passes;
+            }
+
+            static double toDouble(const VkPerformanceCounterResultKHR& result, VkPerformanceCounterStorageKHR storage) {
+                switch (storage) {
+                    case VK_PERFORMANCE_COUNTER_STORAGE_INT32_KHR: return static_cast<double>(result.int32);
+                    case VK_PERFORMANCE_COUNTER_STORAGE_INT64_KHR: return static_cast<double>(result.int64);
+                    case VK_PERFORMANCE_COUNTER_STORAGE_UINT32_KHR: return static_cast<double>(result.uint32);
+                    case VK_PERFORMANCE_COUNTER_STORAGE_UINT64_KHR: return static_cast<double>(result.uint64);
+                    case VK_PERFORMANCE_COUNTER_STORAGE_FLOAT32_KHR: return static_cast<double>(result.float32);
+                    case VK_PERFORMANCE_COUNTER_STORAGE_FLOAT64_KHR: return result.float64;
+                    default: return 0.0;
+                }
+            }
+
+            // Performance queries come back without availability, so a frame is only read when
+            // every one of its queries is.
+            void collect(const FrameQueries& frame) {
+                if (frame.scopeNames.empty()) {
+                    return;
+                }
+
+                const auto& group = m_groups[frame.group];
+                const auto stride = group.counters.size();
+                const auto queryCount = static_cast<uint32_t>(frame.scopeNames.size());
+                m_results.resize(queryCount * stride);
+                const auto result = vkGetQueryPoolResults(
+                    m_device,
+                    frame.queryPools[frame.group],
+                    0,
+                    queryCount,
+                    m_results.size() * sizeof(VkPerformanceCounterResultKHR),
+                    m_results.data(),
+                    stride * sizeof(VkPerformanceCounterResultKHR),
+                    0
+                );
+                if (result == VK_NOT_READY) {
+                    return;
+                } else if (result != VK_SUCCESS) {
+                    throw std::runtime_error("failed to read performance queries!");
+                }
+
+                for (size_t scope = 0; scope < frame.scopeNames.size(); scope++) {
+                    auto& passSamples = m_samples[frame.scopeNames[scope]];
+                    passSamples.resize(m_counters.size());
+                    for (size_t i = 0; i < stride; i++) {
+                        const auto counter = group.counters[i];
+                        auto& samples = passSamples[counter];
+                        samples.values[samples.count % SAMPLE_COUNT] = toDouble(m_results[scope * stride + i], m_counters[counter].storage);
+                        samples.count++;
+                    }
+                }
+            }
+    };
+
+    inline double millisecondsSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli> { std::chrono::steady_clock::now() - start }.count();
+    }
+
+    enum class FrameMetric : uint32_t {
+        CpuFrame,
+        AcquireWait,
+        Submit,
+        Present,
+        Gpu,
+        // How long after its submission the GPU started on a frame, on the host clock.
+        GpuStart,
+        // How long the oldest input a frame responds to had waited when the frame took it.
+        InputAge,
+        Count,
+    };
+
+    inline const char* frameMetricToString(FrameMetric metric) {
+        switch (metric) {
+            case FrameMetric::CpuFrame: return "cpuFrame";
+            case FrameMetric::AcquireWait: return "acquireWait";
+            case FrameMetric::Submit: return "submit";
+            case FrameMetric::Present: return "present";
+            case FrameMetric::Gpu: return "gpu";
+            case FrameMetric::GpuStart: return "gpuStart";
+            case FrameMetric::InputAge: return "inputAge";
+            case FrameMetric::Count: break;
+        }
+
+        return "unknown";
+    }
+
+    // The timings of one frame in milliseconds, indexed by `FrameMetric`. A metric that was
+    // not measured for the frame is NaN and left out of the histograms.
+    using FrameSample = std::array<double, static_cast<size_t>(FrameMetric::Count)>;
+
+    struct FramePercentiles {
+        double p50;
+        double p95;
+        double p99;
+        double max;
+        size_t sampleCount;
+    };
+
+    // Collects per frame timings into a fixed size ring and summarizes the most recent ones as
+    // percentiles.
+    //
+    // The frame loop is the only writer, and never blocks: every value is a relaxed atomic and
+    // the write index is published with release semantics, so a reader on another thread sees
+    // whole values, at worst from a frame newer than the index it loaded. That is good enough
+    // for percentiles, and keeps a telemetry reader from ever stalling a frame.
+    class FrameTelemetry {
+        public:
+            static constexpr size_t CAPACITY = 1024;
+
+            explicit FrameTelemetry() = default;
+
+            FrameTelemetry(const FrameTelemetry& other) = delete;
+            FrameTelemetry& operator=(const FrameTelemetry& other) = delete;
+
+            void record(const FrameSample& sample) {
+                const auto index = m_writeIndex.load(std::memory_order_relaxed);
+                auto& slot = m_ring[index % CAPACITY];
+                for (size_t i = 0; i < sample.size(); i++) {
+                    slot[i].store(sample[i], std::memory_order_relaxed);
+                }
+
+                m_writeIndex.store(index + 1, std::memory_order_release);
+            }
+
+            uint64_t frameCount() const {
+                return m_writeIndex.load(std::memory_order_acquire);
+            }
+
+            // The `metric` of the frame `framesAgo` frames before the latest one, NaN when it
+            // was not measured or has left the ring.
+            double recent(FrameMetric metric, size_t framesAgo) const {
+                const auto frameCount = this->frameCount();
+                if (framesAgo >= std::min<uint64_t>(frameCount, CAPACITY)) {
+                    return std::numeric_limits<double>::quiet_NaN();
+                }
+
+                return m_ring[(frameCount - 1 - framesAgo) % CAPACITY][static_cast<size_t>(metric)].load(std::memory_order_relaxed);
+            }
+
+            // Over the latest `frames` frames the ring still holds.
+            FramePercentiles percentiles(FrameMetric metric, size_t frames = CAPACITY) const {
+                const auto frameCount = this->frameCount();
+                const auto available = static_cast<size_t>(std::min<uint64_t>(frameCount, std::min(frames, CAPACITY)));
+
+                auto values = std::vector<double> {};
+                values.reserve(available);
+                for (size_t i = 0; i < available; i++) {
+                    const auto& slot = m_ring[(frameCount - 1 - i) % CAPACITY];
+                    const auto value = slot[static_cast<size_t>(metric)].load(std::memory_order_relaxed);
+                    if (!std::isnan(value)) {
+                        values.push_back(value);
+                    }
+                }
+
+                if (values.empty()) {
+                    return FramePercentiles {};
+                }
+
+                std::sort(values.begin(), values.end());
+                const auto at = [&values](size_t percent) {
+                    return values[std::min(values.size() - 1, values.size() * percent / 100)];
+                };
+
+                return FramePercentiles {
+                    .p50 = at(50),
+                    .p95 = at(95),
+                    .p99 = at(99),
+                    .max = values.back(),
+                    .sampleCount = values.size(),
+                };
+            }
+
+            // One JSON object per line, so the output can be piped into a log shipper as is.
+            void reportJson(std::ostream& out) const {
+                fmt::print(out, "{{\"frames\":{}", this->frameCount());
+                for (uint32_t i = 0; i < static_cast<uint32_t>(FrameMetric::Count); i++) {
+                    const auto metric = static_cast<FrameMetric>(i);
+                    const auto percentiles = this->percentiles(metric);
+                    fmt::print(
+                        out,
+                        ",\"{}Milliseconds\":{{\"p50\":{:.3f},\"p95\":{:.3f},\"p99\":{:.3f},\"max\":{:.3f},\"samples\":{}}}",
+                        frameMetricToString(metric),
+                        percentiles.p50,
+                        percentiles.p95,
+                        percentiles.p99,
+                        percentiles.max,
+                        percentiles.sampleCount
+                    );
+                }
+
+                fmt::println(out, "}}");
+            }
+        private:
+            using Slot = std::array<std::atomic<double>, static_cast<size_t>(FrameMetric::Count)>;
+
+            std::array<Slot, CAPACITY> m_ring {};
+            std::atomic<uint64_t> m_writeIndex = 0;
+    };
+
+    // Identifies the GPU and driver a benchmark ran on, so that results are only ever compared
+    // against runs on the same configuration, and the size of the scene and the job system,
+    // which a sweep plots the frame times against.
+    struct BenchmarkEnvironment {
+        std::string deviceName;
+        uint32_t vendorID;
+        uint32_t deviceID;
+        uint32_t driverVersion;
+        uint32_t apiVersion;
+        std::string presentMode;
+        std::string swapChainSharing;
+        std::string uploadStrategy;
+        std::string scenePath;
+        uint32_t instanceCount;
+        uint32_t lightCount;
+        uint32_t particleCount;
+        uint32_t jobThreadCount;
+    };
+
+    // Keeps every frame sample of a benchmark run, unlike `FrameTelemetry`, so the statistics
+    // cover the whole run. The first `warmupFrames` frames are dropped, since they include
+    // pipeline compiles and the swapchain settling in.
+    class BenchmarkRecorder {
+        public:
+            explicit BenchmarkRecorder() = default;
+
+            BenchmarkRecorder(const BenchmarkRecorder& other) = delete;
+            BenchmarkRecorder& operator=(const BenchmarkRecorder& other) = delete;
+
+            // The run ends after `frameCount` measured frames or `duration`, whichever is set
+            // and comes first.
+            void start(std::optional<uint64_t> frameCount, std::optional<std::chrono::duration<double>> duration, uint64_t warmupFrames) {
+                m_frameCount = frameCount;
+                m_duration = duration;
+                m_warmupFrames = warmupFrames;
+                m_samples.clear();
+                if (frameCount.has_value()) {
+                    m_samples.reserve(frameCount.value());
+                }
+            }
+
+            void record(const FrameSample& sample) {
+                if (m_skippedFrames < m_warmupFrames) {
+                    m_skippedFrames++;
+                    return;
+                }
+
+                if (m_samples.empty()) {
+                    m_startTime = std::chrono::steady_clock::now();
+                }
+
+                m_samples.push_back(sample);
+            }
+
+            bool isFinished() const {
+                if (m_frameCount.has_value() && m_samples.size() >= m_frameCount.value()) {
+                    return true;
+                }
+
+                return m_duration.has_value()
+                    && !m_samples.empty()
+                    && std::chrono::steady_clock::now() - m_startTime >= m_duration.value();
+            }
+
+            // Writes CSV when `path` ends in `.csv`, and JSON otherwise.
+            void write(const std::filesystem::path& path, const BenchmarkEnvironment& environment) const {
+                auto out = std::ofstream { path };
+                if (!out) {
+                    throw std::runtime_error(fmt::format("failed to open benchmark output `{}`!", path.string()));
+                }
+
+                if (path.extension() == ".csv") {
+                    this->writeCsv(out, environment);
+                } else {
+                    this->writeJson(out, environment);
+                }
+            }
+        private:
+            struct Summary {
+                double mean;
+                double p50;
+                double p95;
+                double p99;
+                double max;
+                size_t sampleCount;
+            };
+
+            std::optional<uint64_t> m_frameCount;
+            std::optional<std::chrono::duration<double>> m_duration;
+            uint64_t m_warmupFrames = 0;
+            uint64_t m_skippedFrames = 0;
+            std::chrono::steady_clock::time_point m_startTime;
+            std::vector<FrameSample> m_samples;
+
+            Summary summarize(FrameMetric metric) const {
+                auto values = std::vector<double> {};
+                values.reserve(m_samples.size());
+                for (const auto& sample : m_samples) {
+                    const auto value = sample[static_cast<size_t>(metric)];
+                    if (!std::isnan(value)) {
+                        values.push_back(value);
+                    }
+                }
+
+                if (values.empty()) {
+                    return Summary {};
+                }
+
+                std::sort(values.begin(), values.end());
+                auto total = 0.0;
+                for (const auto value : values) {
+                    total += value;
+                }
+
+                const auto at = [&values](size_t percent) {
+                    return values[std::min(values.size() - 1, values.size() * percent / 100)];
+                };
+
+                return Summary {
+                    .mean = total / static_cast<double>(values.size()),
+                    .p50 = at(50),
+                    .p95 = at(95),
+                    .p99 = at(99),
+                    .max = values.back(),
+                    .sampleCount = values.size(),
+                };
+            }
+
+            void writeJson(std::ostream& out, const BenchmarkEnvironment& environment) const {
+                fmt::print(
+                    out,
+                    "{{\"deviceName\":\"{}\",\"vendorID\":{},\"deviceID\":{},\"driverVersion\":{},\"apiVersion\":\"{}.{}.{}\",\"presentMode\":\"{}\",\"swapChainSharing\":\"{}\",\"uploadStrategy\":\"{}\",\"scenePath\":\"{}\",\"instanceCount\":{},\"lightCount\":{},\"particleCount\":{},\"jobThreadCount\":{},\"frames\":{}",
+                    environment.deviceName,
+                    environment.vendorID,
+                    environment.deviceID,
+                    environment.driverVersion,
+                    VK_API_VERSION_MAJOR(environment.apiVersion),
+                    VK_API_VERSION_MINOR(environment.apiVersion),
+                    VK_API_VERSION_PATCH(environment.apiVersion),
+                    environment.presentMode,
+                    environment.swapChainSharing,
+                    environment.uploadStrategy,
+                    environment.scenePath,
+                    environment.instanceCount,
+                    environment.lightCount,
+                    environment.particleCount,
+                    environment.jobThreadCount,
+                    m_samples.size()
+                );
+
+                for (uint32_t i = 0; i < static_cast<uint32_t>(FrameMetric::Count); i++) {
+                    const auto metric = static_cast<FrameMetric>(i);
+                    const auto summary = this->summarize(metric);
+                    fmt::print(
+                        out,
+                        ",\"{}Milliseconds\":{{\"mean\":{:.4f},\"p50\":{:.4f},\"p95\":{:.4f},\"p99\":{:.4f},\"max\":{:.4f},\"samples\":{}}}",
+                        frameMetricToString(metric),
+                        summary.mean,
+                        summary.p50,
+                        summary.p95,
+                        summary.p99,
+                        summary.max,
+                        summary.sampleCount
+                    );
+                }
+
+                fmt::println(out, "}}");
+            }
+
+            // One row per metric, with the environment repeated on every row so that results
+            // from several runs can be concatenated and filtered.
+            void writeCsv(std::ostream& out, const BenchmarkEnvironment& environment) const {
+                fmt::println(out, "deviceName,vendorID,deviceID,driverVersion,apiVersion,presentMode,swapChainSharing,uploadStrategy,scenePath,instanceCount,lightCount,particleCount,jobThreadCount,metric,mean,p50,p95,p99,max,samples");
+                for (uint32_t i = 0; i < static_cast<uint32_t>(FrameMetric::Count); i++) {
+                    const auto metric = static_cast<FrameMetric>(i);
+                    const auto summary = this->summarize(metric);
+                    fmt::println(
+                        out,
+                        "\"{}\",{},{},{},{}.{}.{},{},{},{},{},{},{},{},{},{},{:.4f},{:.4f},{:.4f},{:.4f},{:.4f},{}",
+                        environment.deviceName,
+                        environment.vendorID,
+                        environment.deviceID,
+                        environment.driverVersion,
+                        VK_API_VERSION_MAJOR(environment.apiVersion),
+                        VK_API_VERSION_MINOR(environment.apiVersion),
+                        VK_API_VERSION_PATCH(environment.apiVersion),
+                        environment.presentMode,
+                        environment.swapChainSharing,
+                        environment.uploadStrategy,
+                        environment.scenePath,
+                        environment.instanceCount,
+                        environment.lightCount,
+                        environment.particleCount,
+                        environment.jobThreadCount,
+                        frameMetricToString(metric),
+                        summary.mean,
+                        summary.p50,
+                        summary.p95,
+                        summary.p99,
+                        summary.max,
+                        summary.sampleCount
+                    );
+                }
+            }
+    };
+
+    // Keeps the compiler from discarding `value`, and with it the work that produced it.
+    template <typename T>
+    inline void doNotOptimize(const T& value) {
+#if defined(_MSC_VER) && !defined(__clang__)
+        static const void* volatile sink = nullptr;
+        sink = &value;
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+#else
+        asm volatile("" : : "r,m"(value) : "memory");
+#endif
+    }
+
+    // Times small functions over many iterations, reporting the fastest, median and mean call.
+    // The fastest call is the most stable number across runs, the median shows what a typical
+    // call costs once caches and the driver have warmed up.
+    //
+    // Each call's heap allocations and driver calls on the calling thread are averaged too, to
+    // catch the regressions the timings hide. Allocations are only counted in builds with
+    // `HELLO_WINDOW_ALLOCATION_TRACKING`, and driver calls while `vk_dispatch::DispatchHooks`
+    // are installed, which is also how the functions run against a mock driver.
+    class MicroBenchmark {
+        public:
+            using Clock = std::chrono::steady_clock;
+
+            explicit MicroBenchmark() = default;
+
+            MicroBenchmark(const MicroBenchmark& other) = delete;
+            MicroBenchmark& operator=(const MicroBenchmark& other) = delete;
+
+            // Run `function` `iterations` times, passing what it returns to `doNotOptimize`.
+            template <typename F>
+            void run(const char* name, uint32_t iterations, F&& function) {
+                this->run(name, iterations, std::forward<F>(function), []() {});
+            }
+
+            // Like `run`, with an untimed `teardown` after every call that undoes its side
+            // effects, like destroying the objects it created.
+            template <typename F, typename T>
+            void run(const char* name, uint32_t iterations, F&& function, T&& teardown) {
+                auto durations = std::vector<double> {};
+                durations.reserve(iterations);
+                auto allocations = uint64_t { 0 };
+                auto driverCalls = uint64_t { 0 };
+                for (uint32_t i = 0; i < iterations; i++) {
+                    const auto allocationsBefore = vk_allocation_tracking::tracker.threadAllocationCount();
+                    const auto driverCallsBefore = vk_dispatch::threadCallCount();
+                    const auto start = Clock::now();
+                    if constexpr (std::is_void_v<std::invoke_result_t<F&>>) {
+                        function();
+                    } else {
+                        doNotOptimize(function());
+                    }
+                    const auto end = Clock::now();
+                    allocations += vk_allocation_tracking::tracker.threadAllocationCount() - allocationsBefore;
+                    driverCalls += vk_dispatch::threadCallCount() - driverCallsBefore;
+
+                    durations.push_back(std::chrono::duration<double, std::micro> { end - start }.count());
+                    teardown();
+                }
+
+                if (durations.empty()) {
+                    return;
+                }
+
+                std::sort(durations.begin(), durations.end());
+                auto total = 0.0;
+                for (const auto duration : durations) {
+                    total += duration;
+                }
+
+                m_results.push_back(Result {
+                    .name = name,
+                    .driver = m_driver,
+                    .iterations = iterations,
+                    .minMicroseconds = durations.front(),
+                    .medianMicroseconds = durations[durations.size() / 2],
+                    .meanMicroseconds = total / static_cast<double>(durations.size()),
+                    .allocationsPerCall = static_cast<double>(allocations) / static_cast<double>(iterations),
+                    .driverCallsPerCall = static_cast<double>(driverCalls) / static_cast<double>(iterations),
+                });
+            }
+
+            // The driver the following runs are reported against, `real` until changed.
+            void setDriver(const char* driver) {
+                m_driver = driver;
+            }
+
+            void report(std::ostream& out, ReportFormat format) const {
+                if (format == ReportFormat::Json) {
+                    this->reportJson(out);
+                } else {
+                    this->reportTable(out);
+                }
+            }
+        private:
+            struct Result {
+                const char* name;
+                const char* driver;
+                uint32_t iterations;
+                double minMicroseconds;
+                double medianMicroseconds;
+                double meanMicroseconds;
+                double allocationsPerCall;
+                double driverCallsPerCall;
+            };
+
+            std::vector<Result> m_results;
+            const char* m_driver = "real";
+
+            void reportTable(std::ostream& out) const {
+                fmt::println(
+                    out,
+                    "{:<28} {:<6} {:>10} {:>12} {:>12} {:>12} {:>12} {:>12}",
+                    "Init helper",
+                    "Driver",
+                    "Iterations",
+                    "Min (us)",
+                    "Median (us)",
+                    "Mean (us)",
+                    "Allocations",
+                    "Driver calls"
+                );
+                for (const auto& result : m_results) {
+                    fmt::println(
+                        out,
+                        "{:<28} {:<6} {:>10} {:>12.3f} {:>12.3f} {:>12.3f} {:>12.1f} {:>12.1f}",
+                        result.name,
+                        result.driver,
+                        result.iterations,
+                        result.minMicroseconds,
+                        result.medianMicroseconds,
+                        result.meanMicroseconds,
+                        result.allocationsPerCall,
+                        result.driverCallsPerCall
+                    );
+                }
+            }
+
+            void reportJson(std::ostream& out) const {
+                fmt::print(out, "{{\"microbenchmarks\":[");
+                for (size_t i = 0; i < m_results.size(); i++) {
+                    const auto& result = m_results[i];
+                    fmt::print(
+                        out,
+                        "{}{{\"name\":\"{}\",\"driver\":\"{}\",\"iterations\":{},\"minMicroseconds\":{:.3f},\"medianMicroseconds\":{:.3f},\"meanMicroseconds\":{:.3f},\"allocationsPerCall\":{:.1f},\"driverCallsPerCall\":{:.1f}}}",
+                        i == 0 ? "" : ",",
+                        result.name,
+                        result.driver,
+                        result.iterations,
+                        result.minMicroseconds,
+                        result.medianMicroseconds,
+                        result.meanMicroseconds,
+                        result.allocationsPerCall,
+                        result.driverCallsPerCall
+                    );
+                }
+
+                fmt::println(out, "]}}");
+            }
+    };
+}
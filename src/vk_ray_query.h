@@ -0,0 +1,831 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "vk_handles.h"
+#include "vk_memory.h"
+#include "vk_pipelines.h"
+#include "vk_render_graph.h"
+#include "vk_shaders.h"
+#include "vk_transforms.h"
+
+
+namespace vk_ray_query {
+    // Matches `local_size_x` and the arrays of `PickSlot` in `pick.comp`. Picks asked for
+    // beyond it wait for a later frame.
+    constexpr uint32_t MAX_PICKS_PER_FRAME = 16;
+
+    // The instance of a pick that hit nothing, matches `pick.comp`.
+    constexpr uint32_t NO_INSTANCE = 0xFFFFFFFF;
+
+    // Matches `PickRay` in `pick.comp`, with the distance the ray reaches in `direction.w`.
+    struct PickRay {
+        glm::vec4 origin;
+        glm::vec4 direction;
+    };
+
+    // Matches `PickHit` in `pick.comp`.
+    struct PickHit {
+        uint32_t instance;
+        float distance;
+        uint32_t primitive;
+        uint32_t padding;
+    };
+
+    // Matches `PickSlot` in `pick.comp`, a frame slot's rays and what they hit.
+    struct PickSlot {
+        std::array<PickRay, MAX_PICKS_PER_FRAME> rays;
+        std::array<PickHit, MAX_PICKS_PER_FRAME> hits;
+    };
+
+    static_assert(sizeof(PickSlot) == MAX_PICKS_PER_FRAME * 48, "PickSlot must match the std430 layout of the shader");
+
+    struct PickPushConstants {
+        VkDeviceAddress topLevel;
+        VkDeviceAddress slot;
+        uint32_t count;
+    };
+
+    // The answer to a pick: the request `pick` returned, and the instance its ray hit first
+    // and how far along the ray, or no instance and the distance the ray reached.
+    struct PickResult {
+        uint64_t request;
+        std::optional<uint32_t> instance;
+        float distance;
+    };
+
+    inline VkPhysicalDeviceAccelerationStructurePropertiesKHR accelerationStructureProperties(VkPhysicalDevice physicalDevice) {
+        auto accelerationStructureProperties = VkPhysicalDeviceAccelerationStructurePropertiesKHR {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR,
+        };
+        auto properties = VkPhysicalDeviceProperties2 {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+            .pNext = &accelerationStructureProperties,
+        };
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+        return accelerationStructureProperties;
+    }
+
+    // Whether a top level structure holds `instanceCount` instances, each told apart by the
+    // 24 bits of its custom index.
+    inline bool supports(const VkPhysicalDeviceAccelerationStructurePropertiesKHR& properties, uint32_t instanceCount) {
+        return instanceCount <= properties.maxInstanceCount && instanceCount <= (1u << 24);
+    }
+
+    // Acceleration structures of a scene whose instances all draw the same mesh, for shaders
+    // that trace rays with ray queries, and picking on the GPU with them.
+    //
+    // The mesh's bottom level structure is built once, allowing compaction. Once the GPU has
+    // written the size it compacts to, a later frame copies it into a structure of that size,
+    // and the original is destroyed a cycle of frames in flight after. The top level structure
+    // is sized for every instance up front, so its handle never changes and descriptors of it
+    // are written once. The CPU writes an instance's record as its world matrix is uploaded,
+    // into a mapped buffer the GPU only ever reads the records before it from, and every frame
+    // an async compute pass builds the top level structure over the records when their count
+    // or the mesh's structure changed, and refits it otherwise. Compaction moves the mesh's
+    // structure, so the records are rewritten into a buffer of their own that no frame in
+    // flight reads, rather than under the builds of the frames still reading them.
+    //
+    // Picks are rays the CPU hands over, traced by a compute pass after the build into the
+    // mapped buffer of the frame slot, and read back once the slot comes around again.
+    class SceneAccelerationStructure {
+        public:
+            explicit SceneAccelerationStructure() = default;
+
+            SceneAccelerationStructure(const SceneAccelerationStructure& other) = delete;
+            SceneAccelerationStructure& operator=(const SceneAccelerationStructure& other) = delete;
+
+            // Holds up to `maxInstanceCount` instances. `memoryAllocator` must have been
+            // initialized with buffer device addresses, and the buffers are shared between
+            // `queueFamilies` when there is more than one. `properties` come from
+            // `accelerationStructureProperties`.
+            void init(
+                VkDevice device,
+                vk_memory::DeviceMemoryAllocator& memoryAllocator,
+                vk_shaders::ShaderLibrary& shaderLibrary,
+                vk_pipelines::PipelineRegistry& pipelineRegistry,
+                const VkAllocationCallbacks* allocator,
+                std::span<const uint32_t> queueFamilies,
+                const VkPhysicalDeviceAccelerationStructurePropertiesKHR& properties,
+                uint32_t framesInFlight,
+                uint32_t maxInstanceCount
+            ) {
+                if (!supports(properties, maxInstanceCount)) {
+                    throw std::runtime_error("failed to create scene acceleration structure, more instances than a top level structure holds!");
+                }
+
+                m_device = device;
+                m_allocator = allocator;
+                m_memoryAllocator = &memoryAllocator;
+                m_shaderLibrary = &shaderLibrary;
+                m_pipelineRegistry = &pipelineRegistry;
+                m_scratchAlignment = std::max<VkDeviceSize>(properties.minAccelerationStructureScratchOffsetAlignment, 1);
+                m_framesInFlight = framesInFlight;
+                m_maxInstanceCount = maxInstanceCount;
+                m_instanceCount = 0;
+                m_builtInstanceCount = 0;
+                m_topLevelBuilt = false;
+                m_topLevelStale = true;
+                m_bottomLevelState = BottomLevelState::Unbuilt;
+                m_nextPick = 0;
+
+                m_queueFamilies.assign(queueFamilies.begin(), queueFamilies.end());
+                std::sort(m_queueFamilies.begin(), m_queueFamilies.end());
+                m_queueFamilies.erase(std::unique(m_queueFamilies.begin(), m_queueFamilies.end()), m_queueFamilies.end());
+
+                this->createPickPipeline();
+                m_instances = this->createInstanceBuffer();
+
+                // The top level structure, and the scratch of whichever build is the largest.
+                const auto geometry = this->instanceGeometry();
+                auto buildInfo = VkAccelerationStructureBuildGeometryInfoKHR {
+                    .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
+                    .type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR,
+                    .flags = TOP_LEVEL_FLAGS,
+                    .mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR,
+                    .geometryCount = 1,
+                    .pGeometries = &geometry,
+                };
+                auto sizes = VkAccelerationStructureBuildSizesInfoKHR {
+                    .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR,
+                };
+                const auto instanceCount = std::max(maxInstanceCount, 1u);
+                vkGetAccelerationStructureBuildSizesKHR(m_device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &buildInfo, &instanceCount, &sizes);
+                m_topLevel = this->createStructure(VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR, sizes.accelerationStructureSize);
+                m_scratchSize = std::max(sizes.buildScratchSize, sizes.updateScratchSize);
+
+                m_pickSlots.clear();
+                m_slotPicks.assign(m_framesInFlight, {});
+                for (uint32_t i = 0; i < m_framesInFlight; i++) {
+                    m_pickSlots.push_back(this->createBuffer(
+                        sizeof(PickSlot),
+                        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                        vk_memory::AllocationCreateInfo {
+                            .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                            .preferredFlags = VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+                        }
+                    ));
+                }
+            }
+
+            // The device has to be idle.
+            void destroy() {
+                if (m_device == VK_NULL_HANDLE) {
+                    return;
+                }
+
+                m_retired.flush();
+                m_bottomLevel = Structure();
+                m_topLevel = Structure();
+                m_vertices = BufferAllocation();
+                m_indices = BufferAllocation();
+                m_instances = BufferAllocation();
+                m_scratch = BufferAllocation();
+                m_pickSlots.clear();
+                m_slotPicks.clear();
+                m_pendingPicks.clear();
+                m_pickResults.clear();
+                m_compactedSizeQuery.reset();
+                vkDestroyPipelineLayout(m_device, m_pickPipelineLayout, m_allocator);
+                m_pickPipelineLayout = VK_NULL_HANDLE;
+                m_device = VK_NULL_HANDLE;
+            }
+
+            bool isInitialized() const {
+                return m_device != VK_NULL_HANDLE;
+            }
+
+            bool isCompacted() const {
+                return m_bottomLevelState == BottomLevelState::Compacted;
+            }
+
+            // The size of the mesh's bottom level structure, compacted or not.
+            VkDeviceSize bottomLevelSize() const {
+                return m_bottomLevel.size;
+            }
+
+            VkAccelerationStructureKHR topLevel() const {
+                return m_topLevel.structure;
+            }
+
+            // The mesh every instance draws, as a triangle list. The first frame after builds
+            // its structure.
+            void setMesh(std::span<const glm::vec3> positions, std::span<const uint32_t> indices) {
+                const auto inputUsage = VkBufferUsageFlags { VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT };
+                const auto hostMemory = vk_memory::AllocationCreateInfo {
+                    .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                };
+                m_vertices = this->createBuffer(positions.size_bytes(), inputUsage, hostMemory);
+                m_indices = this->createBuffer(indices.size_bytes(), inputUsage, hostMemory);
+                std::memcpy(m_vertices.memory.get().mappedData, positions.data(), positions.size_bytes());
+                std::memcpy(m_indices.memory.get().mappedData, indices.data(), indices.size_bytes());
+                m_vertexCount = static_cast<uint32_t>(positions.size());
+                m_triangleCount = static_cast<uint32_t>(indices.size() / 3);
+
+                const auto geometry = this->meshGeometry();
+                auto buildInfo = VkAccelerationStructureBuildGeometryInfoKHR {
+                    .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
+                    .type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
+                    .flags = BOTTOM_LEVEL_FLAGS,
+                    .mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR,
+                    .geometryCount = 1,
+                    .pGeometries = &geometry,
+                };
+                auto sizes = VkAccelerationStructureBuildSizesInfoKHR {
+                    .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR,
+                };
+                vkGetAccelerationStructureBuildSizesKHR(m_device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &buildInfo, &m_triangleCount, &sizes);
+                m_bottomLevel = this->createStructure(VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR, sizes.accelerationStructureSize);
+                m_bottomLevelState = BottomLevelState::Unbuilt;
+                m_bottomLevelImported = false;
+                m_topLevelStale = true;
+                m_scratchSize = std::max(m_scratchSize, sizes.buildScratchSize);
+                m_scratch = this->createBuffer(
+                    m_scratchSize + m_scratchAlignment,
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT
+                );
+
+                const auto queryInfo = VkQueryPoolCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+                    .queryType = VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR,
+                    .queryCount = 1,
+                };
+                auto queryPool = VkQueryPool {};
+                const auto result = vkCreateQueryPool(m_device, &queryInfo, m_allocator, &queryPool);
+                if (result != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create acceleration structure query pool!");
+                }
+
+                m_compactedSizeQuery = vk_handles::QueryPool { m_device, queryPool, m_allocator };
+            }
+
+            // Writes the records of the instances from `first` on, whose world matrices are
+            // `matrices`. Only ever called for instances after the ones written before, which
+            // no build in flight reads yet.
+            void setInstances(uint32_t first, std::span<const vk_transforms::WorldMatrix> matrices) {
+                auto* records = static_cast<VkAccelerationStructureInstanceKHR*>(m_instances.memory.get().mappedData);
+                for (size_t i = 0; i < matrices.size(); i++) {
+                    records[first + i] = this->instanceRecord(first + static_cast<uint32_t>(i), matrices[i]);
+                }
+                m_instanceCount = std::max(m_instanceCount, first + static_cast<uint32_t>(matrices.size()));
+            }
+
+            // Asks which instance a ray from `origin` along `direction` hits first, within
+            // `maxDistance`. The answer comes out of `takePickResults` a cycle of frames in flight
+            // after the frame that traces it, tagged with the request returned here.
+            uint64_t pick(glm::vec3 origin, glm::vec3 direction, float maxDistance) {
+                const auto request = m_nextPick++;
+                m_pendingPicks.push_back(PendingPick {
+                    .request = request,
+                    .ray = PickRay {
+                        .origin = glm::vec4 { origin, 0.0f },
+                        .direction = glm::vec4 { glm::normalize(direction), maxDistance },
+                    },
+                });
+
+                return request;
+            }
+
+            std::vector<PickResult> takePickResults() {
+                return std::exchange(m_pickResults, {});
+            }
+
+            // The frame's build pass, which has to come before any graphics pass of the frame
+            // to be moved to the async compute queue, and the pass that traces the picks asked
+            // for since the last frame. Reads back the picks the frame slot traced a cycle of
+            // frames ago first.
+            void addPasses(vk_render_graph::RenderGraph& graph, uint64_t frameNumber) {
+                const auto slot = static_cast<uint32_t>(frameNumber % m_framesInFlight);
+                this->readPicks(slot);
+                m_retired.collect(frameNumber);
+                this->prepareCompaction(frameNumber);
+
+                const auto buildStages = VkPipelineStageFlags2 { VK_PIPELINE_STAGE_2_ACCELERATION_STRUCTURE_BUILD_BIT_KHR };
+                const auto buildAccess = VkAccessFlags2 { VK_ACCESS_2_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_2_ACCELERATION_STRUCTURE_WRITE_BIT_KHR };
+                const auto tracedStages = VkPipelineStageFlags2 { buildStages | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT };
+                // The frames before only read the structures once they were built, and the
+                // builds of the frames before wrote them.
+                m_topLevelResource = graph.importBuffer(
+                    m_topLevel.buffer.buffer,
+                    m_topLevelBuilt ? vk_render_graph::ResourceState { tracedStages, VK_ACCESS_2_NONE } : vk_render_graph::ResourceState {}
+                );
+                m_bottomLevelResource = graph.importBuffer(
+                    m_bottomLevel.buffer.buffer,
+                    m_bottomLevelImported ? vk_render_graph::ResourceState { tracedStages, VK_ACCESS_2_NONE } : vk_render_graph::ResourceState {}
+                );
+                m_bottomLevelImported = true;
+                const auto build = m_bottomLevelState == BottomLevelState::Unbuilt;
+                const auto compact = std::exchange(m_compacting, false);
+                const auto refit = m_topLevelBuilt && !m_topLevelStale && m_builtInstanceCount == m_instanceCount;
+                const auto instanceCount = m_instanceCount;
+                auto accesses = std::vector<vk_render_graph::ResourceAccess> {
+                    vk_render_graph::write(m_topLevelResource, buildStages, buildAccess),
+                    !build && !compact
+                        ? vk_render_graph::read(m_bottomLevelResource, buildStages, VK_ACCESS_2_ACCELERATION_STRUCTURE_READ_BIT_KHR)
+                        : vk_render_graph::write(m_bottomLevelResource, buildStages, buildAccess),
+                };
+                auto sourceResource = std::optional<vk_render_graph::ResourceId> {};
+                if (compact) {
+                    sourceResource = graph.importBuffer(m_compactionSource.buffer, vk_render_graph::ResourceState { tracedStages, VK_ACCESS_2_NONE });
+                    accesses.push_back(vk_render_graph::read(sourceResource.value(), buildStages, VK_ACCESS_2_ACCELERATION_STRUCTURE_READ_BIT_KHR));
+                }
+                if (m_queueFamilies.size() > 1) {
+                    graph.shareAcrossQueues(m_topLevelResource);
+                    graph.shareAcrossQueues(m_bottomLevelResource);
+                    if (sourceResource.has_value()) {
+                        graph.shareAcrossQueues(sourceResource.value());
+                    }
+                }
+                // The next frame refits what this one built, whether or not anything traces it.
+                graph.exportResource(m_topLevelResource);
+                graph.exportResource(m_bottomLevelResource);
+
+                graph.addPass(
+                    "accelerationStructures",
+                    accesses,
+                    [this, build, compact, refit, instanceCount](VkCommandBuffer commandBuffer) {
+                        this->recordBuilds(commandBuffer, build, compact, refit, instanceCount);
+                    },
+                    vk_render_graph::PassQueue::AsyncCompute
+                );
+                if (build) {
+                    m_bottomLevelState = BottomLevelState::Built;
+                }
+                m_builtInstanceCount = instanceCount;
+                m_topLevelBuilt = true;
+                m_topLevelStale = false;
+
+                this->addPickPass(graph, slot);
+            }
+
+            // What a pass that traces rays against the structures from `stages` reads.
+            std::array<vk_render_graph::ResourceAccess, 2> traceAccesses(VkPipelineStageFlags2 stages) const {
+                return {
+                    vk_render_graph::read(m_topLevelResource, stages, VK_ACCESS_2_ACCELERATION_STRUCTURE_READ_BIT_KHR),
+                    vk_render_graph::read(m_bottomLevelResource, stages, VK_ACCESS_2_ACCELERATION_STRUCTURE_READ_BIT_KHR),
+                };
+            }
+        private:
+            // Compaction only pays off for structures traced far more often than they are built.
+            static constexpr VkBuildAccelerationStructureFlagsKHR BOTTOM_LEVEL_FLAGS = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR
+                | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR;
+            static constexpr VkBuildAccelerationStructureFlagsKHR TOP_LEVEL_FLAGS = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR
+                | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR;
+
+            enum class BottomLevelState : uint32_t {
+                Unbuilt,
+                // Built, and the size it compacts to on its way back.
+                Built,
+                Compacted,
+            };
+
+            struct BufferAllocation {
+                vk_memory::ScopedAllocation memory;
+                vk_handles::Buffer buffer;
+                VkDeviceAddress address = 0;
+            };
+
+            struct Structure {
+                BufferAllocation buffer;
+                vk_handles::AccelerationStructure structure;
+                VkDeviceAddress address = 0;
+                VkDeviceSize size = 0;
+            };
+
+            // What compaction replaced, destroyed once the frames in flight that used it are done.
+            struct Retired {
+                Structure bottomLevel;
+                BufferAllocation vertices;
+                BufferAllocation indices;
+                BufferAllocation instances;
+            };
+
+            struct PendingPick {
+                uint64_t request;
+                PickRay ray;
+            };
+
+            VkDevice m_device = VK_NULL_HANDLE;
+            const VkAllocationCallbacks* m_allocator = nullptr;
+            vk_memory::DeviceMemoryAllocator* m_memoryAllocator = nullptr;
+            vk_shaders::ShaderLibrary* m_shaderLibrary = nullptr;
+            vk_pipelines::PipelineRegistry* m_pipelineRegistry = nullptr;
+            std::vector<uint32_t> m_queueFamilies;
+            VkDeviceSize m_scratchAlignment = 1;
+            VkDeviceSize m_scratchSize = 0;
+            uint32_t m_framesInFlight = 1;
+            uint32_t m_maxInstanceCount = 0;
+            uint32_t m_vertexCount = 0;
+            uint32_t m_triangleCount = 0;
+            BufferAllocation m_vertices;
+            BufferAllocation m_indices;
+            BufferAllocation m_instances;
+            BufferAllocation m_scratch;
+            Structure m_bottomLevel;
+            Structure m_topLevel;
+            vk_handles::QueryPool m_compactedSizeQuery;
+            vk_handles::DeferredDestructionQueue m_retired;
+            // The structure the frame compacting the mesh's structure copies from, retired already.
+            struct {
+                VkAccelerationStructureKHR structure = VK_NULL_HANDLE;
+                VkBuffer buffer = VK_NULL_HANDLE;
+            } m_compactionSource;
+            BottomLevelState m_bottomLevelState = BottomLevelState::Unbuilt;
+            bool m_bottomLevelImported = false;
+            // Set on the frame that copies the mesh's structure into its compacted one.
+            bool m_compacting = false;
+            // The records written so far, and how many the last build covered.
+            uint32_t m_instanceCount = 0;
+            uint32_t m_builtInstanceCount = 0;
+            bool m_topLevelBuilt = false;
+            // Set when the records point at another bottom level structure, which a refit
+            // cannot take.
+            bool m_topLevelStale = true;
+            vk_render_graph::ResourceId m_topLevelResource = 0;
+            vk_render_graph::ResourceId m_bottomLevelResource = 0;
+            VkPipelineLayout m_pickPipelineLayout = VK_NULL_HANDLE;
+            VkPipeline m_pickPipeline = VK_NULL_HANDLE;
+            std::vector<BufferAllocation> m_pickSlots;
+            // The requests each frame slot traced, in the order of its rays.
+            std::vector<std::vector<uint64_t>> m_slotPicks;
+            std::vector<PendingPick> m_pendingPicks;
+            std::vector<PickResult> m_pickResults;
+            uint64_t m_nextPick = 0;
+
+            BufferAllocation createBuffer(
+                VkDeviceSize size,
+                VkBufferUsageFlags usage,
+                const vk_memory::AllocationCreateInfo& allocationInfo = vk_memory::AllocationCreateInfo {
+                    .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                    .priority = vk_memory::MemoryPriority::High,
+                }
+            ) const {
+                const bool concurrent = m_queueFamilies.size() > 1;
+                const auto bufferInfo = VkBufferCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                    .size = size,
+                    .usage = usage,
+                    .sharingMode = concurrent ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+                    .queueFamilyIndexCount = concurrent ? static_cast<uint32_t>(m_queueFamilies.size()) : 0,
+                    .pQueueFamilyIndices = concurrent ? m_queueFamilies.data() : nullptr,
+                };
+
+                auto buffer = VkBuffer {};
+                const auto result = vkCreateBuffer(m_device, &bufferInfo, m_allocator, &buffer);
+                if (result != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create acceleration structure buffer!");
+                }
+
+                auto allocation = BufferAllocation();
+                allocation.buffer = vk_handles::Buffer { m_device, buffer, m_allocator };
+                allocation.memory = vk_memory::ScopedAllocation { *m_memoryAllocator, m_memoryAllocator->allocateForBuffer(buffer, allocationInfo) };
+                allocation.address = vk_memory::bufferDeviceAddress(m_device, buffer);
+
+                return allocation;
+            }
+
+            // The records are read by the builds only, and written a record at a time by the CPU,
+            // so they are write combined where the device has memory the CPU can write directly.
+            BufferAllocation createInstanceBuffer() const {
+                return this->createBuffer(
+                    VkDeviceSize { std::max(m_maxInstanceCount, 1u) } * sizeof(VkAccelerationStructureInstanceKHR),
+                    VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                    vk_memory::AllocationCreateInfo {
+                        .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                        .preferredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                    }
+                );
+            }
+
+            Structure createStructure(VkAccelerationStructureTypeKHR type, VkDeviceSize size) const {
+                auto structure = Structure();
+                structure.size = size;
+                structure.buffer = this->createBuffer(size, VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+                const auto createInfo = VkAccelerationStructureCreateInfoKHR {
+                    .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR,
+                    .buffer = structure.buffer.buffer,
+                    .offset = 0,
+                    .size = size,
+                    .type = type,
+                };
+
+                auto accelerationStructure = VkAccelerationStructureKHR {};
+                const auto result = vkCreateAccelerationStructureKHR(m_device, &createInfo, m_allocator, &accelerationStructure);
+                if (result != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create acceleration structure!");
+                }
+
+                structure.structure = vk_handles::AccelerationStructure { m_device, accelerationStructure, m_allocator };
+                const auto addressInfo = VkAccelerationStructureDeviceAddressInfoKHR {
+                    .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR,
+                    .accelerationStructure = accelerationStructure,
+                };
+                structure.address = vkGetAccelerationStructureDeviceAddressKHR(m_device, &addressInfo);
+
+                return structure;
+            }
+
+            void createPickPipeline() {
+                const auto pushConstantRange = VkPushConstantRange {
+                    .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                    .offset = 0,
+                    .size = sizeof(PickPushConstants),
+                };
+                const auto layoutInfo = VkPipelineLayoutCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+                    .pushConstantRangeCount = 1,
+                    .pPushConstantRanges = &pushConstantRange,
+                };
+
+                const auto result = vkCreatePipelineLayout(m_device, &layoutInfo, m_allocator, &m_pickPipelineLayout);
+                if (result != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create pick pipeline layout!");
+                }
+
+                const auto pipelineInfo = VkComputePipelineCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+                    .stage = VkPipelineShaderStageCreateInfo {
+                        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                        .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                        .module = m_shaderLibrary->shaderModule("pick.comp"),
+                        .pName = "main",
+                    },
+                    .layout = m_pickPipelineLayout,
+                };
+                m_pickPipeline = m_pipelineRegistry->computePipeline(pipelineInfo);
+            }
+
+            VkAccelerationStructureGeometryKHR meshGeometry() const {
+                return VkAccelerationStructureGeometryKHR {
+                    .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR,
+                    .geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR,
+                    .geometry = VkAccelerationStructureGeometryDataKHR {
+                        .triangles = VkAccelerationStructureGeometryTrianglesDataKHR {
+                            .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR,
+                            .vertexFormat = VK_FORMAT_R32G32B32_SFLOAT,
+                            .vertexData = VkDeviceOrHostAddressConstKHR { .deviceAddress = m_vertices.address },
+                            .vertexStride = sizeof(glm::vec3),
+                            .maxVertex = std::max(m_vertexCount, 1u) - 1,
+                            .indexType = VK_INDEX_TYPE_UINT32,
+                            .indexData = VkDeviceOrHostAddressConstKHR { .deviceAddress = m_indices.address },
+                        },
+                    },
+                    .flags = VK_GEOMETRY_OPAQUE_BIT_KHR,
+                };
+            }
+
+            VkAccelerationStructureGeometryKHR instanceGeometry() const {
+                return VkAccelerationStructureGeometryKHR {
+                    .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR,
+                    .geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR,
+                    .geometry = VkAccelerationStructureGeometryDataKHR {
+                        .instances = VkAccelerationStructureGeometryInstancesDataKHR {
+                            .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR,
+                            .arrayOfPointers = VK_FALSE,
+                            .data = VkDeviceOrHostAddressConstKHR { .deviceAddress = m_instances.address },
+                        },
+                    },
+                    .flags = VK_GEOMETRY_OPAQUE_BIT_KHR,
+                };
+            }
+
+            // The instance's custom index is its index, which is what a ray query reports. Both
+            // sides of the cubes' faces block rays.
+            VkAccelerationStructureInstanceKHR instanceRecord(uint32_t instance, const vk_transforms::WorldMatrix& matrix) const {
+                auto record = VkAccelerationStructureInstanceKHR {};
+                for (uint32_t row = 0; row < 3; row++) {
+                    for (uint32_t column = 0; column < 4; column++) {
+                        record.transform.matrix[row][column] = matrix.rows[row][column];
+                    }
+                }
+                record.instanceCustomIndex = instance;
+                record.mask = 0xFF;
+                record.instanceShaderBindingTableRecordOffset = 0;
+                record.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
+                record.accelerationStructureReference = m_bottomLevel.address;
+
+                return record;
+            }
+
+            VkDeviceAddress scratchAddress() const {
+                return (m_scratch.address + m_scratchAlignment - 1) / m_scratchAlignment * m_scratchAlignment;
+            }
+
+            // Once the GPU has written the size the mesh's structure compacts to, creates the
+            // compacted structure, which this frame copies into, and rewrites every record to
+            // point at it into a new buffer. What it replaces is retired.
+            void prepareCompaction(uint64_t frameNumber) {
+                if (m_bottomLevelState != BottomLevelState::Built) {
+                    return;
+                }
+
+                auto compactedSize = uint64_t { 0 };
+                const auto result = vkGetQueryPoolResults(
+                    m_device,
+                    m_compactedSizeQuery,
+                    0,
+                    1,
+                    sizeof(compactedSize),
+                    &compactedSize,
+                    sizeof(compactedSize),
+                    VK_QUERY_RESULT_64_BIT
+                );
+                if (result == VK_NOT_READY) {
+                    return;
+                } else if (result != VK_SUCCESS) {
+                    throw std::runtime_error("failed to read compacted acceleration structure size!");
+                }
+
+                auto retired = Retired {
+                    .bottomLevel = std::move(m_bottomLevel),
+                    .vertices = std::move(m_vertices),
+                    .indices = std::move(m_indices),
+                    .instances = std::move(m_instances),
+                };
+                m_bottomLevel = this->createStructure(VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR, compactedSize);
+                m_instances = this->createInstanceBuffer();
+                const auto* source = static_cast<const VkAccelerationStructureInstanceKHR*>(retired.instances.memory.get().mappedData);
+                auto* records = static_cast<VkAccelerationStructureInstanceKHR*>(m_instances.memory.get().mappedData);
+                for (uint32_t i = 0; i < m_instanceCount; i++) {
+                    auto record = source[i];
+                    record.accelerationStructureReference = m_bottomLevel.address;
+                    records[i] = record;
+                }
+                m_compactionSource.structure = retired.bottomLevel.structure;
+                m_compactionSource.buffer = retired.bottomLevel.buffer.buffer;
+                m_retired.retire(frameNumber + m_framesInFlight, std::move(retired));
+                m_bottomLevelState = BottomLevelState::Compacted;
+                m_bottomLevelImported = false;
+                m_compacting = true;
+                m_topLevelStale = true;
+                m_compactedSizeQuery.reset();
+            }
+
+            // Every build waits for the one before it, which shares its scratch, and reads
+            // structures the one before it wrote.
+            static void recordBuildBarrier(VkCommandBuffer commandBuffer) {
+                const auto barrier = VkMemoryBarrier2 {
+                    .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+                    .srcStageMask = VK_PIPELINE_STAGE_2_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                    .srcAccessMask = VK_ACCESS_2_ACCELERATION_STRUCTURE_WRITE_BIT_KHR,
+                    .dstStageMask = VK_PIPELINE_STAGE_2_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                    .dstAccessMask = VK_ACCESS_2_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_2_ACCELERATION_STRUCTURE_WRITE_BIT_KHR,
+                };
+                const auto dependencyInfo = VkDependencyInfo {
+                    .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+                    .memoryBarrierCount = 1,
+                    .pMemoryBarriers = &barrier,
+                };
+                vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+            }
+
+            void recordBuilds(VkCommandBuffer commandBuffer, bool build, bool compact, bool refit, uint32_t instanceCount) {
+                // The last frame's build may still be using the scratch on this queue.
+                recordBuildBarrier(commandBuffer);
+                if (build) {
+                    const auto geometry = this->meshGeometry();
+                    const auto buildInfo = VkAccelerationStructureBuildGeometryInfoKHR {
+                        .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
+                        .type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
+                        .flags = BOTTOM_LEVEL_FLAGS,
+                        .mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR,
+                        .dstAccelerationStructure = m_bottomLevel.structure,
+                        .geometryCount = 1,
+                        .pGeometries = &geometry,
+                        .scratchData = VkDeviceOrHostAddressKHR { .deviceAddress = this->scratchAddress() },
+                    };
+                    const auto range = VkAccelerationStructureBuildRangeInfoKHR { .primitiveCount = m_triangleCount };
+                    const auto* ranges = &range;
+                    vkCmdBuildAccelerationStructuresKHR(commandBuffer, 1, &buildInfo, &ranges);
+                    recordBuildBarrier(commandBuffer);
+
+                    const auto structure = m_bottomLevel.structure.get();
+                    vkCmdResetQueryPool(commandBuffer, m_compactedSizeQuery, 0, 1);
+                    vkCmdWriteAccelerationStructuresPropertiesKHR(
+                        commandBuffer,
+                        1,
+                        &structure,
+                        VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR,
+                        m_compactedSizeQuery,
+                        0
+                    );
+                }
+                if (compact) {
+                    const auto copyInfo = VkCopyAccelerationStructureInfoKHR {
+                        .sType = VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_INFO_KHR,
+                        .src = m_compactionSource.structure,
+                        .dst = m_bottomLevel.structure,
+                        .mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_COMPACT_KHR,
+                    };
+                    vkCmdCopyAccelerationStructureKHR(commandBuffer, &copyInfo);
+                    recordBuildBarrier(commandBuffer);
+                }
+
+                const auto geometry = this->instanceGeometry();
+                const auto buildInfo = VkAccelerationStructureBuildGeometryInfoKHR {
+                    .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
+                    .type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR,
+                    .flags = TOP_LEVEL_FLAGS,
+                    .mode = refit ? VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR : VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR,
+                    .srcAccelerationStructure = refit ? m_topLevel.structure.get() : VK_NULL_HANDLE,
+                    .dstAccelerationStructure = m_topLevel.structure,
+                    .geometryCount = 1,
+                    .pGeometries = &geometry,
+                    .scratchData = VkDeviceOrHostAddressKHR { .deviceAddress = this->scratchAddress() },
+                };
+                const auto range = VkAccelerationStructureBuildRangeInfoKHR { .primitiveCount = instanceCount };
+                const auto* ranges = &range;
+                vkCmdBuildAccelerationStructuresKHR(commandBuffer, 1, &buildInfo, &ranges);
+            }
+
+            // The rays asked for since the last frame that fit, traced into the frame slot's
+            // buffer, which the CPU reads once the frame is done.
+            void addPickPass(vk_render_graph::RenderGraph& graph, uint32_t slot) {
+                if (m_pendingPicks.empty()) {
+                    return;
+                }
+
+                const auto count = std::min(static_cast<uint32_t>(m_pendingPicks.size()), MAX_PICKS_PER_FRAME);
+                auto* pickSlot = static_cast<PickSlot*>(m_pickSlots[slot].memory.get().mappedData);
+                for (uint32_t i = 0; i < count; i++) {
+                    pickSlot->rays[i] = m_pendingPicks[i].ray;
+                    m_slotPicks[slot].push_back(m_pendingPicks[i].request);
+                }
+                m_pendingPicks.erase(m_pendingPicks.begin(), m_pendingPicks.begin() + count);
+
+                const auto hits = graph.importBuffer(m_pickSlots[slot].buffer, vk_render_graph::ResourceState {});
+                if (m_queueFamilies.size() > 1) {
+                    graph.shareAcrossQueues(hits);
+                }
+                graph.exportResource(hits);
+                const auto traced = this->traceAccesses(VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT);
+                graph.addPass(
+                    "pick",
+                    {
+                        traced[0],
+                        traced[1],
+                        vk_render_graph::write(hits, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT),
+                    },
+                    [this, slot, count](VkCommandBuffer commandBuffer) {
+                        const auto pushConstants = PickPushConstants {
+                            .topLevel = m_topLevel.address,
+                            .slot = m_pickSlots[slot].address,
+                            .count = count,
+                        };
+                        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pickPipeline);
+                        vkCmdPushConstants(commandBuffer, m_pickPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PickPushConstants), &pushConstants);
+                        vkCmdDispatch(commandBuffer, 1, 1, 1);
+
+                        // The CPU reads the hits once the frame is done.
+                        const auto toHost = VkMemoryBarrier2 {
+                            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+                            .srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                            .srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                            .dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT,
+                            .dstAccessMask = VK_ACCESS_2_HOST_READ_BIT,
+                        };
+                        const auto dependencyInfo = VkDependencyInfo {
+                            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+                            .memoryBarrierCount = 1,
+                            .pMemoryBarriers = &toHost,
+                        };
+                        vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+                    },
+                    vk_render_graph::PassQueue::AsyncCompute
+                );
+            }
+
+            // The frame that last used the slot is done.
+            void readPicks(uint32_t slot) {
+                auto& requests = m_slotPicks[slot];
+                if (requests.empty()) {
+                    return;
+                }
+
+                const auto* pickSlot = static_cast<const PickSlot*>(m_pickSlots[slot].memory.get().mappedData);
+                for (size_t i = 0; i < requests.size(); i++) {
+                    const auto& hit = pickSlot->hits[i];
+                    m_pickResults.push_back(PickResult {
+                        .request = requests[i],
+                        .instance = hit.instance == NO_INSTANCE ? std::nullopt : std::optional { hit.instance },
+                        .distance = hit.distance,
+                    });
+                }
+                requests.clear();
+            }
+    };
+}
@@ -0,0 +1,306 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <numeric>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "vk_memory.h"
+
+
+namespace vk_readback {
+    // A region of an image to read back, which the caller has moved into `layout`, either
+    // `VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL` or `VK_IMAGE_LAYOUT_GENERAL`, with the writes to
+    // it made available to transfers. The image must be created with
+    // `VK_IMAGE_USAGE_TRANSFER_SRC_BIT`.
+    struct ImageReadbackInfo {
+        VkImage image = VK_NULL_HANDLE;
+        VkImageLayout layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        VkImageAspectFlags aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        VkExtent2D extent = {};
+        uint32_t mipLevel = 0;
+        uint32_t arrayLayer = 0;
+        // The size of a texel of the image's format, which the texels are packed tightly by.
+        uint32_t texelSize = 4;
+    };
+
+    // Copies images and buffers into a persistently mapped ring of host cached memory, in the
+    // command buffer of a frame, and hands the bytes out through futures once the frame
+    // timeline semaphore says the frame is done. Nothing ever waits on the GPU for a readback:
+    // the frame loop calls `collect` with the frame timeline's value once per frame, which
+    // fulfills every finished readback, and a readback that does not fit in the ring right
+    // now is refused so the caller can try again next frame.
+    //
+    // Readbacks are recorded and collected on the frame loop, and their futures can be waited
+    // on from any thread.
+    class ReadbackService {
+        public:
+            explicit ReadbackService() = default;
+
+            ReadbackService(const ReadbackService& other) = delete;
+            ReadbackService& operator=(const ReadbackService& other) = delete;
+
+            void init(
+                VkDevice device,
+                vk_memory::DeviceMemoryAllocator& allocator,
+                VkDeviceSize ringSize,
+                VkDeviceSize copyOffsetAlignment
+            ) {
+                m_device = device;
+                m_ringSize = ringSize;
+                // Image copies need offsets that are a multiple of both the texel size and 4.
+                m_copyOffsetAlignment = std::max(copyOffsetAlignment, VkDeviceSize { 16 });
+
+                const auto bufferInfo = VkBufferCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                    .size = ringSize,
+                    .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                };
+
+                const auto bufferResult = vkCreateBuffer(m_device, &bufferInfo, nullptr, &m_ringBuffer);
+                if (bufferResult != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create readback buffer!");
+                }
+
+                // The CPU reads every byte back, which is slow from write combined memory.
+                m_ringAllocation = allocator.allocateForBuffer(m_ringBuffer, vk_memory::AllocationCreateInfo {
+                    .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                    .preferredFlags = VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+                    .kind = vk_memory::ResourceKind::Linear,
+                    .dedicated = true,
+                    .userData = this,
+                });
+            }
+
+            // The device has to be idle. Readbacks still pending are broken off, and their
+            // futures throw.
+            void destroy(vk_memory::DeviceMemoryAllocator& allocator) {
+                if (m_device == VK_NULL_HANDLE) {
+                    return;
+                }
+
+                vkDestroyBuffer(m_device, m_ringBuffer, nullptr);
+                allocator.free(m_ringAllocation);
+
+                m_pending.clear();
+                m_ringHead = 0;
+                m_ringUsed = 0;
+                m_device = VK_NULL_HANDLE;
+            }
+
+            bool isInitialized() const {
+                return m_device != VK_NULL_HANDLE;
+            }
+
+            // Records the copy of `size` bytes of `buffer` at `offset`, whose writes the caller
+            // has made available to transfers, into the frame's command buffer. The bytes are
+            // ready once the frame timeline semaphore reaches `completionValue`.
+            std::optional<std::future<std::vector<std::byte>>> readBuffer(
+                VkCommandBuffer commandBuffer,
+                VkBuffer buffer,
+                VkDeviceSize offset,
+                VkDeviceSize size,
+                uint64_t completionValue
+            ) {
+                const auto ringOffset = this->allocateRing(size, 4);
+                if (!ringOffset.has_value()) {
+                    return std::nullopt;
+                }
+
+                const auto region = VkBufferCopy {
+                    .srcOffset = offset,
+                    .dstOffset = ringOffset.value(),
+                    .size = size,
+                };
+                vkCmdCopyBuffer(commandBuffer, buffer, m_ringBuffer, 1, &region);
+
+                return this->finishRecording(commandBuffer, ringOffset.value(), size, completionValue);
+            }
+
+            // Records the copy of an image region into the frame's command buffer, which reads
+            // back as tightly packed rows of texels. The bytes are ready once the frame
+            // timeline semaphore reaches `completionValue`.
+            std::optional<std::future<std::vector<std::byte>>> readImage(
+                VkCommandBuffer commandBuffer,
+                const ImageReadbackInfo& imageInfo,
+                uint64_t completionValue
+            ) {
+                const auto size = VkDeviceSize { imageInfo.extent.width } * imageInfo.extent.height * imageInfo.texelSize;
+                const auto alignment = std::lcm(m_copyOffsetAlignment, VkDeviceSize { imageInfo.texelSize });
+                const auto ringOffset = this->allocateRing(size, alignment);
+                if (!ringOffset.has_value()) {
+                    return std::nullopt;
+                }
+
+                const auto region = VkBufferImageCopy {
+                    .bufferOffset = ringOffset.value(),
+                    .bufferRowLength = 0,
+                    .bufferImageHeight = 0,
+                    .imageSubresource = VkImageSubresourceLayers {
+                        .aspectMask = imageInfo.aspectMask,
+                        .mipLevel = imageInfo.mipLevel,
+                        .baseArrayLayer = imageInfo.arrayLayer,
+                        .layerCount = 1,
+                    },
+                    .imageOffset = VkOffset3D { 0, 0, 0 },
+                    .imageExtent = VkExtent3D { imageInfo.extent.width, imageInfo.extent.height, 1 },
+                };
+                vkCmdCopyImageToBuffer(commandBuffer, imageInfo.image, imageInfo.layout, m_ringBuffer, 1, &region);
+
+                return this->finishRecording(commandBuffer, ringOffset.value(), size, completionValue);
+            }
+
+            // Hands out the bytes of every readback finished by `completedValue` of the frame
+            // timeline semaphore, and frees their space in the ring.
+            void collect(uint64_t completedValue) {
+                while (!m_pending.empty() && m_pending.front().completionValue <= completedValue) {
+                    auto& pending = m_pending.front();
+                    const auto* data = static_cast<const std::byte*>(m_ringAllocation.mappedData) + pending.offset;
+                    pending.promise.set_value(std::vector<std::byte>(data, data + pending.size));
+
+                    m_ringUsed -= pending.consumed;
+                    m_pending.pop_front();
+                }
+
+                if (m_ringUsed == 0) {
+                    m_ringHead = 0;
+                }
+            }
+
+            size_t pendingCount() const {
+                return m_pending.size();
+            }
+        private:
+            struct PendingReadback {
+                std::promise<std::vector<std::byte>> promise;
+                VkDeviceSize offset = 0;
+                VkDeviceSize size = 0;
+                // The ring bytes it holds, including the alignment padding before it or the end
+                // of the ring it skipped.
+                VkDeviceSize consumed = 0;
+                uint64_t completionValue = 0;
+            };
+
+            VkDevice m_device = VK_NULL_HANDLE;
+
+            VkBuffer m_ringBuffer = VK_NULL_HANDLE;
+            vk_memory::Allocation m_ringAllocation;
+            VkDeviceSize m_ringSize = 0;
+            VkDeviceSize m_ringHead = 0;
+            VkDeviceSize m_ringUsed = 0;
+            VkDeviceSize m_copyOffsetAlignment = 16;
+            // The bytes `allocateRing` took for the readback being recorded.
+            VkDeviceSize m_lastConsumed = 0;
+
+            // In the order they were recorded, which is the order they complete in.
+            std::deque<PendingReadback> m_pending;
+
+            // Makes the copy visible to the host once the frame is done, since the semaphore
+            // signal alone only orders it for the device.
+            std::future<std::vector<std::byte>> finishRecording(VkCommandBuffer commandBuffer, VkDeviceSize offset, VkDeviceSize size, uint64_t completionValue) {
+                const auto barrier = VkBufferMemoryBarrier2 {
+                    .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+                    .srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+                    .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                    .dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT,
+                    .dstAccessMask = VK_ACCESS_2_HOST_READ_BIT,
+                    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                    .buffer = m_ringBuffer,
+                    .offset = offset,
+                    .size = size,
+                };
+                const auto dependencyInfo = VkDependencyInfo {
+                    .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+                    .bufferMemoryBarrierCount = 1,
+                    .pBufferMemoryBarriers = &barrier,
+                };
+                vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+
+                auto& pending = m_pending.emplace_back(PendingReadback {
+                    .offset = offset,
+                    .size = size,
+                    .consumed = m_lastConsumed,
+                    .completionValue = completionValue,
+                });
+
+                return pending.promise.get_future();
+            }
+
+            // Space for `size` bytes after the readbacks still pending, wrapping around to the
+            // start of the ring, or nothing when the ring is too full right now.
+            std::optional<VkDeviceSize> allocateRing(VkDeviceSize size, VkDeviceSize alignment) {
+                if (size > m_ringSize) {
+                    throw std::runtime_error(fmt::format("failed to read back {} bytes, which do not fit in the {} byte readback buffer!", size, m_ringSize));
+                }
+
+                const auto tail = (m_ringHead + m_ringSize - m_ringUsed) % m_ringSize;
+                const auto alignedHead = (m_ringHead + alignment - 1) / alignment * alignment;
+
+                auto offset = VkDeviceSize { 0 };
+                auto consumed = VkDeviceSize { 0 };
+                if (m_ringUsed == 0 || m_ringHead > tail) {
+                    if (alignedHead + size <= m_ringSize) {
+                        offset = alignedHead;
+                        consumed = alignedHead + size - m_ringHead;
+                    } else if (m_ringUsed == 0 || size <= tail) {
+                        offset = 0;
+                        consumed = m_ringSize - m_ringHead + size;
+                    } else {
+                        return std::nullopt;
+                    }
+                } else if (alignedHead + size <= tail) {
+                    offset = alignedHead;
+                    consumed = alignedHead + size - m_ringHead;
+                } else {
+                    return std::nullopt;
+                }
+
+                m_ringHead = (offset + size) % m_ringSize;
+                m_ringUsed += consumed;
+                m_lastConsumed = consumed;
+
+                return offset;
+            }
+    };
+
+    // Writes 8 bit RGBA or BGRA texels, read back tightly packed, as a binary PPM, which drops
+    // the alpha. Returns false when the format has other texels or the file cannot be written.
+    inline bool writePortablePixmap(const std::filesystem::path& path, VkFormat format, VkExtent2D extent, std::span<const std::byte> texels) {
+        const bool bgra = format == VK_FORMAT_B8G8R8A8_UNORM || format == VK_FORMAT_B8G8R8A8_SRGB;
+        const bool rgba = format == VK_FORMAT_R8G8B8A8_UNORM || format == VK_FORMAT_R8G8B8A8_SRGB;
+        const auto pixelCount = size_t { extent.width } * extent.height;
+        if ((!bgra && !rgba) || texels.size() < pixelCount * 4) {
+            return false;
+        }
+
+        auto pixels = std::vector<char>(pixelCount * 3);
+        for (size_t i = 0; i < pixelCount; i++) {
+            const auto* texel = texels.data() + i * 4;
+            pixels[i * 3 + 0] = static_cast<char>(texel[bgra ? 2 : 0]);
+            pixels[i * 3 + 1] = static_cast<char>(texel[1]);
+            pixels[i * 3 + 2] = static_cast<char>(texel[bgra ? 0 : 2]);
+        }
+
+        auto file = std::ofstream { path, std::ios::binary | std::ios::trunc };
+        const auto header = fmt::format("P6\n{} {}\n255\n", extent.width, extent.height);
+        file.write(header.data(), static_cast<std::streamsize>(header.size()));
+        file.write(pixels.data(), static_cast<std::streamsize>(pixels.size()));
+
+        return static_cast<bool>(file);
+    }
+}
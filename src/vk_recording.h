@@ -0,0 +1,349 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <fmt/core.h>
+#include <fmt/ostream.h>
+
+
+namespace vk_recording {
+    // A piece of a frame, recorded into a secondary command buffer that continues the current
+    // dynamic rendering instance. Work items may run on any recording thread and must only
+    // touch the command buffer they are given.
+    using WorkItem = std::function<void(VkCommandBuffer)>;
+
+    // Records the work items of a frame in parallel. Thread `i` owns the command pools at
+    // `i` of every frame in flight, so recording never shares a pool between threads. The items
+    // are split into contiguous ranges, one per thread, and the secondary command buffers come
+    // back in item order for the primary command buffer to execute.
+    class ParallelCommandRecorder {
+        public:
+            explicit ParallelCommandRecorder() = default;
+
+            ParallelCommandRecorder(const ParallelCommandRecorder& other) = delete;
+            ParallelCommandRecorder& operator=(const ParallelCommandRecorder& other) = delete;
+
+            ~ParallelCommandRecorder() {
+                this->stop();
+            }
+
+            // `commandPools` holds `threadCount` pools per frame in flight, indexed as
+            // `frameIndex * threadCount + threadIndex`. The calling thread records as thread 0.
+            void start(VkDevice device, std::vector<VkCommandPool> commandPools, uint32_t threadCount) {
+                if (!m_workers.empty()) {
+                    return;
+                }
+
+                m_device = device;
+                m_commandPools = std::move(commandPools);
+                m_threadCount = threadCount;
+                m_secondaryCommandBuffers.assign(m_commandPools.size(), {});
+                m_usedCommandBuffers.assign(m_commandPools.size(), 0);
+                m_running = true;
+
+                for (uint32_t i = 1; i < threadCount; i++) {
+                    m_workers.emplace_back([this, i]() { this->workerLoop(i); });
+                }
+            }
+
+            void stop() {
+                {
+                    const auto lock = std::scoped_lock { m_mutex };
+                    m_running = false;
+                }
+
+                m_workAvailable.notify_all();
+                for (auto& worker : m_workers) {
+                    worker.join();
+                }
+
+                m_workers.clear();
+            }
+
+            // The command pools of `frameIndex` have just been reset, so every secondary command
+            // buffer allocated from them can be recorded again.
+            void beginFrame(uint32_t frameIndex) {
+                for (uint32_t i = 0; i < m_threadCount; i++) {
+                    m_usedCommandBuffers[frameIndex * m_threadCount + i] = 0;
+                }
+            }
+
+            std::vector<VkCommandBuffer> record(
+                uint32_t frameIndex,
+                const VkCommandBufferInheritanceInfo& inheritanceInfo,
+                const std::vector<WorkItem>& workItems
+            ) {
+                m_results.assign(m_threadCount, VK_NULL_HANDLE);
+                m_errors.assign(m_threadCount, nullptr);
+                {
+                    const auto lock = std::scoped_lock { m_mutex };
+                    m_frameIndex = frameIndex;
+                    m_inheritanceInfo = &inheritanceInfo;
+                    m_workItems = &workItems;
+                    m_remainingWorkers = m_threadCount - 1;
+                    m_generation++;
+                }
+
+                m_workAvailable.notify_all();
+                this->recordRange(0);
+
+                {
+                    auto lock = std::unique_lock { m_mutex };
+                    m_workDone.wait(lock, [this]() { return m_remainingWorkers == 0; });
+                }
+
+                for (const auto& error : m_errors) {
+                    if (error != nullptr) {
+                        std::rethrow_exception(error);
+                    }
+                }
+
+                auto commandBuffers = std::vector<VkCommandBuffer> {};
+                for (const auto commandBuffer : m_results) {
+                    if (commandBuffer != VK_NULL_HANDLE) {
+                        commandBuffers.push_back(commandBuffer);
+                    }
+                }
+
+                return commandBuffers;
+            }
+        private:
+            VkDevice m_device = VK_NULL_HANDLE;
+            std::vector<VkCommandPool> m_commandPools;
+            uint32_t m_threadCount = 1;
+
+            // Secondary command buffers allocated from each pool, reused once the pool is reset.
+            std::vector<std::vector<VkCommandBuffer>> m_secondaryCommandBuffers;
+            std::vector<size_t> m_usedCommandBuffers;
+
+            std::vector<std::thread> m_workers;
+            std::mutex m_mutex;
+            std::condition_variable m_workAvailable;
+            std::condition_variable m_workDone;
+            bool m_running = false;
+            uint64_t m_generation = 0;
+            uint32_t m_remainingWorkers = 0;
+
+            uint32_t m_frameIndex = 0;
+            const VkCommandBufferInheritanceInfo* m_inheritanceInfo = nullptr;
+            const std::vector<WorkItem>* m_workItems = nullptr;
+            std::vector<VkCommandBuffer> m_results;
+            std::vector<std::exception_ptr> m_errors;
+
+            void workerLoop(uint32_t threadIndex) {
+                uint64_t seenGeneration = 0;
+                while (true) {
+                    {
+                        auto lock = std::unique_lock { m_mutex };
+                        m_workAvailable.wait(lock, [&]() { return !m_running || m_generation != seenGeneration; });
+                        if (!m_running) {
+                            return;
+                        }
+
+                        seenGeneration = m_generation;
+                    }
+
+                    this->recordRange(threadIndex);
+
+                    {
+                        const auto lock = std::scoped_lock { m_mutex };
+                        m_remainingWorkers--;
+                    }
+
+                    m_workDone.notify_one();
+                }
+            }
+
+            void recordRange(uint32_t threadIndex) {
+                const auto itemCount = m_workItems->size();
+                const auto begin = itemCount * threadIndex / m_threadCount;
+                const auto end = itemCount * (threadIndex + 1) / m_threadCount;
+                if (begin == end) {
+                    return;
+                }
+
+                try {
+                    const auto commandBuffer = this->acquireCommandBuffer(m_frameIndex * m_threadCount + threadIndex);
+                    const auto beginInfo = VkCommandBufferBeginInfo {
+                        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+                        .pInheritanceInfo = m_inheritanceInfo,
+                    };
+
+                    const auto beginResult = vkBeginCommandBuffer(commandBuffer, &beginInfo);
+                    if (beginResult != VK_SUCCESS) {
+                        throw std::runtime_error("failed to begin recording secondary command buffer!");
+                    }
+
+                    for (auto i = begin; i < end; i++) {
+                        (*m_workItems)[i](commandBuffer);
+                    }
+
+                    const auto endResult = vkEndCommandBuffer(commandBuffer);
+                    if (endResult != VK_SUCCESS) {
+                        throw std::runtime_error("failed to record secondary command buffer!");
+                    }
+
+                    m_results[threadIndex] = commandBuffer;
+                } catch (...) {
+                    m_errors[threadIndex] = std::current_exception();
+                }
+            }
+
+            VkCommandBuffer acquireCommandBuffer(size_t poolIndex) {
+                auto& commandBuffers = m_secondaryCommandBuffers[poolIndex];
+                auto& used = m_usedCommandBuffers[poolIndex];
+                if (used == commandBuffers.size()) {
+                    const auto allocateInfo = VkCommandBufferAllocateInfo {
+                        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                        .commandPool = m_commandPools[poolIndex],
+                        .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+                        .commandBufferCount = 1,
+                    };
+
+                    auto commandBuffer = VkCommandBuffer {};
+                    const auto result = vkAllocateCommandBuffers(m_device, &allocateInfo, &commandBuffer);
+                    if (result != VK_SUCCESS) {
+                        throw std::runtime_error("failed to allocate secondary command buffer!");
+                    }
+
+                    commandBuffers.push_back(commandBuffer);
+                }
+
+                return commandBuffers[used++];
+            }
+    };
+
+    // Secondary command buffers that are recorded once and executed again for as long as what
+    // they were recorded from stays the same, for passes that record the same commands every
+    // frame. Every buffer has a slot, one per frame in flight and whatever else tells its
+    // recordings apart, and remembers the hash of the inputs it was recorded from, which has
+    // to cover every handle and value it records: `get` records it again whenever the hash
+    // differs. A slot is only used again once the GPU is done with its last frame, so the
+    // buffers are never pending twice and need no simultaneous use.
+    class CommandBufferCache {
+        public:
+            explicit CommandBufferCache() = default;
+
+            CommandBufferCache(const CommandBufferCache& other) = delete;
+            CommandBufferCache& operator=(const CommandBufferCache& other) = delete;
+
+            ~CommandBufferCache() {
+                this->destroy();
+            }
+
+            // The buffers are recorded on whichever thread records the frame, from a pool of
+            // their own, since the frame pools are reset every frame.
+            void init(VkDevice device, uint32_t queueFamilyIndex, const VkAllocationCallbacks* allocator) {
+                const auto poolInfo = VkCommandPoolCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+                    .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+                    .queueFamilyIndex = queueFamilyIndex,
+                };
+                auto commandPool = VkCommandPool {};
+                if (vkCreateCommandPool(device, &poolInfo, allocator, &commandPool) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create cached command pool!");
+                }
+
+                m_device = device;
+                m_allocator = allocator;
+                m_commandPool = commandPool;
+            }
+
+            // The device has to be idle.
+            void destroy() {
+                if (m_commandPool == VK_NULL_HANDLE) {
+                    return;
+                }
+
+                vkDestroyCommandPool(m_device, m_commandPool, m_allocator);
+                m_commandPool = VK_NULL_HANDLE;
+                m_entries.clear();
+            }
+
+            bool isInitialized() const {
+                return m_commandPool != VK_NULL_HANDLE;
+            }
+
+            // The buffer of `slot`, recorded by `record` within a render pass described by
+            // `inheritanceInfo`, which `hash` has to cover too, unless it was recorded with the
+            // same hash before.
+            VkCommandBuffer get(size_t slot, uint64_t hash, const VkCommandBufferInheritanceInfo& inheritanceInfo, const WorkItem& record) {
+                if (slot >= m_entries.size()) {
+                    m_entries.resize(slot + 1);
+                }
+
+                auto& entry = m_entries[slot];
+                if (entry.recorded && entry.hash == hash) {
+                    m_reuseCount++;
+                    return entry.commandBuffer;
+                }
+
+                if (entry.commandBuffer == VK_NULL_HANDLE) {
+                    const auto allocateInfo = VkCommandBufferAllocateInfo {
+                        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                        .commandPool = m_commandPool,
+                        .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+                        .commandBufferCount = 1,
+                    };
+                    if (vkAllocateCommandBuffers(m_device, &allocateInfo, &entry.commandBuffer) != VK_SUCCESS) {
+                        throw std::runtime_error("failed to allocate cached command buffer!");
+                    }
+                }
+
+                // Beginning the buffer again resets it.
+                entry.recorded = false;
+                const auto beginInfo = VkCommandBufferBeginInfo {
+                    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                    .flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+                    .pInheritanceInfo = &inheritanceInfo,
+                };
+                if (vkBeginCommandBuffer(entry.commandBuffer, &beginInfo) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to begin recording cached command buffer!");
+                }
+
+                record(entry.commandBuffer);
+
+                if (vkEndCommandBuffer(entry.commandBuffer) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to record cached command buffer!");
+                }
+
+                entry.hash = hash;
+                entry.recorded = true;
+                m_recordCount++;
+
+                return entry.commandBuffer;
+            }
+
+            void report(std::ostream& out) const {
+                if (m_recordCount == 0) {
+                    return;
+                }
+
+                fmt::println(out, "Cached command buffers: recorded {} times, executed again {} times", m_recordCount, m_reuseCount);
+            }
+        private:
+            struct Entry {
+                VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+                uint64_t hash = 0;
+                bool recorded = false;
+            };
+
+            VkDevice m_device = VK_NULL_HANDLE;
+            const VkAllocationCallbacks* m_allocator = nullptr;
+            VkCommandPool m_commandPool = VK_NULL_HANDLE;
+            std::vector<Entry> m_entries;
+            uint64_t m_recordCount = 0;
+            uint64_t m_reuseCount = 0;
+    };
+}
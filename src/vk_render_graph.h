@@ -0,0 +1,864 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#include "vk_breadcrumbs.h"
+#include "vk_debug.h"
+#include "vk_handles.h"
+#include "vk_memory.h"
+#include "vk_profiling.h"
+
+
+namespace vk_render_graph {
+    using ResourceId = uint32_t;
+
+    // The stages and accesses a pass uses a resource with, and the layout an image has to be
+    // in for them. Buffers ignore the layout.
+    struct ResourceState {
+        VkPipelineStageFlags2 stages = VK_PIPELINE_STAGE_2_NONE;
+        VkAccessFlags2 access = VK_ACCESS_2_NONE;
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    };
+
+    // The usages that keep an image within a render pass.
+    constexpr VkImageUsageFlags ATTACHMENT_USAGE = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT
+        | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT
+        | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+
+    // An image that only lives within a frame. Its contents are undefined at its first use,
+    // and its memory is shared with transient images whose uses do not overlap with its own.
+    //
+    // An image with no usage besides `ATTACHMENT_USAGE` is created as a transient attachment
+    // in lazily allocated memory, where the device has any. A tile based GPU then keeps it in
+    // tile memory and never backs it, as long as the passes using it do not store it.
+    struct TransientImageInfo {
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        VkExtent2D extent {};
+        VkImageUsageFlags usage = 0;
+        VkImageAspectFlags aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+
+        bool operator==(const TransientImageInfo& other) const {
+            return format == other.format
+                && extent.width == other.extent.width
+                && extent.height == other.extent.height
+                && usage == other.usage
+                && aspectMask == other.aspectMask
+                && samples == other.samples;
+        }
+    };
+
+    struct ResourceAccess {
+        ResourceId resource;
+        ResourceState state;
+        bool write;
+    };
+
+    inline ResourceAccess read(ResourceId resource, VkPipelineStageFlags2 stages, VkAccessFlags2 access, VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED) {
+        return ResourceAccess { resource, ResourceState { stages, access, layout }, false };
+    }
+
+    inline ResourceAccess write(ResourceId resource, VkPipelineStageFlags2 stages, VkAccessFlags2 access, VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED) {
+        return ResourceAccess { resource, ResourceState { stages, access, layout }, true };
+    }
+
+    // Records the pass into the frame's primary command buffer, outside of any render pass.
+    using PassCallback = std::function<void(VkCommandBuffer)>;
+
+    // The queue a pass asks to run on. Async compute passes only record compute and transfer
+    // commands, and run on the dedicated compute family when the graph has one and the pass
+    // can be moved there.
+    enum class PassQueue : uint32_t {
+        Graphics,
+        AsyncCompute,
+    };
+
+    // The stages and accesses a compute family supports, which barriers recorded on it are
+    // limited to.
+    constexpr VkPipelineStageFlags2 ASYNC_COMPUTE_STAGES = VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT
+        | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT
+        | VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT
+        | VK_PIPELINE_STAGE_2_ACCELERATION_STRUCTURE_BUILD_BIT_KHR;
+    constexpr VkAccessFlags2 ASYNC_COMPUTE_ACCESS = VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT
+        | VK_ACCESS_2_UNIFORM_READ_BIT
+        | VK_ACCESS_2_SHADER_READ_BIT
+        | VK_ACCESS_2_SHADER_WRITE_BIT
+        | VK_ACCESS_2_SHADER_SAMPLED_READ_BIT
+        | VK_ACCESS_2_SHADER_STORAGE_READ_BIT
+        | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT
+        | VK_ACCESS_2_TRANSFER_READ_BIT
+        | VK_ACCESS_2_TRANSFER_WRITE_BIT
+        | VK_ACCESS_2_ACCELERATION_STRUCTURE_READ_BIT_KHR
+        | VK_ACCESS_2_ACCELERATION_STRUCTURE_WRITE_BIT_KHR
+        | VK_ACCESS_2_MEMORY_READ_BIT
+        | VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+    // A frame's passes and the resources they read and write, rebuilt every frame.
+    //
+    // `compile` culls the passes nothing exported depends on, and places the transient images
+    // of the live passes into memory, sharing it between images that are never in use at
+    // the same time. `execute` then records the live passes in order, each behind a single
+    // `vkCmdPipelineBarrier2` with every barrier its accesses need:
+    //
+    // * a write, or a layout change, waits for the last write and every read since;
+    // * a read waits for the last write, unless an earlier read already made the write
+    //   visible to the same stages and accesses;
+    // * the first use of a transient image waits for the last use of the image that held
+    //   its memory before, in this frame or the previous one.
+    //
+    // Transient images keep their memory from frame to frame while the graph compiles to the
+    // same images and lifetimes, and are retired into a deferred destruction queue when it
+    // stops doing so.
+    //
+    // With an async compute queue, the async compute passes are recorded into a command
+    // buffer of their own, which is submitted to the compute queue ahead of the graphics one.
+    // The graphics submission waits for it at the stages that use what it wrote, so the
+    // graphics work before those stages overlaps with it. That only orders async work before
+    // graphics work, so a pass stays on the graphics queue when it uses a resource a graphics
+    // pass used earlier in the frame, or an imported resource not shared between the families.
+    // The compute submission has to wait for the previous frame's graphics work, which takes
+    // care of the resources the two queues share from one frame to the next. The transient
+    // images of async passes are shared between the families and never alias.
+    class RenderGraph {
+        public:
+            explicit RenderGraph() = default;
+
+            RenderGraph(const RenderGraph& other) = delete;
+            RenderGraph& operator=(const RenderGraph& other) = delete;
+
+            void init(VkDevice device, vk_memory::DeviceMemoryAllocator& memoryAllocator, const VkAllocationCallbacks* allocator) {
+                m_device = device;
+                m_memoryAllocator = &memoryAllocator;
+                m_allocator = allocator;
+            }
+
+            // Lets the async compute passes run on `computeFamily`, which has to differ from
+            // `graphicsFamily`. Takes effect with the next compile.
+            void setAsyncComputeQueue(uint32_t graphicsFamily, uint32_t computeFamily) {
+                m_queueFamilies = { graphicsFamily, computeFamily };
+                m_asyncComputeEnabled = true;
+            }
+
+            bool hasAsyncComputeQueue() const {
+                return m_asyncComputeEnabled;
+            }
+
+            // Counts the pipeline statistics of every pass on the graphics queue, by the pass's
+            // name. The profiler has to outlive the graph.
+            void setPipelineStatistics(vk_profiling::PipelineStatisticsProfiler* pipelineStatistics) {
+                m_pipelineStatistics = pipelineStatistics;
+            }
+
+            // Reads the hardware counters of every pass on the graphics queue, by the pass's
+            // name. The profiler has to outlive the graph.
+            void setPerformanceCounters(vk_profiling::PerformanceCounterProfiler* performanceCounters) {
+                m_performanceCounters = performanceCounters;
+            }
+
+            // Leaves a breadcrumb where every pass begins and ends on its queue, with the queue
+            // told apart by its `PassQueue`. The breadcrumbs have to outlive the graph.
+            void setBreadcrumbs(vk_breadcrumbs::Breadcrumbs* breadcrumbs) {
+                m_breadcrumbs = breadcrumbs;
+            }
+
+            // The transient images go first, their memory after them.
+            void destroy() {
+                m_transients.imageViews.clear();
+                m_transients.images.clear();
+                m_transients.memory.clear();
+                m_transientLifetimes.clear();
+                m_slotHistory.clear();
+                this->reset();
+            }
+
+            // Start building the next frame's graph. Keeps the transient images.
+            void reset() {
+                m_resources.clear();
+                m_passes.clear();
+                m_accesses.clear();
+                m_imageBarriers.clear();
+                m_bufferBarriers.clear();
+            }
+
+            ResourceId importImage(VkImage image, VkImageView imageView, ResourceState initialState, VkImageAspectFlags aspectMask = VK_IMAGE_ASPECT_COLOR_BIT) {
+                auto& resource = this->addResource(ResourceKind::ImportedImage);
+                resource.image = image;
+                resource.imageView = imageView;
+                resource.aspectMask = aspectMask;
+                resource.initialState = initialState;
+
+                return static_cast<ResourceId>(m_resources.size() - 1);
+            }
+
+            ResourceId importBuffer(VkBuffer buffer, ResourceState initialState) {
+                auto& resource = this->addResource(ResourceKind::ImportedBuffer);
+                resource.buffer = buffer;
+                resource.initialState = initialState;
+
+                return static_cast<ResourceId>(m_resources.size() - 1);
+            }
+
+            ResourceId createImage(const TransientImageInfo& info) {
+                auto& resource = this->addResource(ResourceKind::TransientImage);
+                resource.transientInfo = info;
+                resource.aspectMask = info.aspectMask;
+
+                return static_cast<ResourceId>(m_resources.size() - 1);
+            }
+
+            // The resource was created with concurrent sharing between the graphics and compute
+            // families, so async compute passes may use it.
+            void shareAcrossQueues(ResourceId resource) {
+                this->resource(resource).concurrent = true;
+            }
+
+            // An exported resource is used after the graph, and keeps the passes writing it, and
+            // whatever they read, from being culled.
+            void exportResource(ResourceId resource) {
+                this->resource(resource).exported = true;
+            }
+
+            // `name` must outlive the frame, a string literal in practice.
+            void addPass(const char* name, std::initializer_list<ResourceAccess> accesses, PassCallback callback, PassQueue queue = PassQueue::Graphics) {
+                this->addPass(name, std::span<const ResourceAccess> { accesses.begin(), accesses.size() }, std::move(callback), queue);
+            }
+
+            // For passes whose accesses depend on what else the frame renders.
+            void addPass(const char* name, std::span<const ResourceAccess> accesses, PassCallback callback, PassQueue queue = PassQueue::Graphics) {
+                const auto firstAccess = static_cast<uint32_t>(m_accesses.size());
+                for (const auto& access : accesses) {
+                    this->resource(access.resource);
+                    m_accesses.push_back(access);
+                }
+
+                m_passes.push_back(Pass {
+                    .name = name,
+                    .firstAccess = firstAccess,
+                    .accessCount = static_cast<uint32_t>(accesses.size()),
+                    .callback = std::move(callback),
+                    .requestedQueue = queue,
+                });
+            }
+
+            // Transient images replaced by this compile are retired against `retireValue`.
+            void compile(vk_handles::DeferredDestructionQueue& retiredResources, uint64_t retireValue) {
+                this->cullPasses();
+                this->schedulePasses();
+                this->computeLifetimes();
+                this->placeTransientImages(retiredResources, retireValue);
+            }
+
+            // `asyncCommandBuffer` is only used, and only has to be recording, when
+            // `hasAsyncPasses` is true after the compile.
+            void execute(VkCommandBuffer commandBuffer, VkCommandBuffer asyncCommandBuffer = VK_NULL_HANDLE) {
+                m_asyncWaitStages = VK_PIPELINE_STAGE_2_NONE;
+                for (auto& resource : m_resources) {
+                    resource.state = TrackedState {
+                        .layout = resource.initialState.layout,
+                        .writeStages = resource.initialState.stages,
+                        .writeAccess = resource.initialState.access,
+                    };
+                }
+                m_slotOccupants.assign(m_slotHistory.size(), NO_RESOURCE);
+
+                for (const auto& pass : m_passes) {
+                    if (!pass.live) {
+                        continue;
+                    }
+
+                    m_imageBarriers.clear();
+                    m_bufferBarriers.clear();
+                    for (const auto& access : this->accesses(pass)) {
+                        this->addBarrier(access.resource, access, pass.queue);
+                    }
+
+                    const auto passCommandBuffer = pass.queue == PassQueue::AsyncCompute ? asyncCommandBuffer : commandBuffer;
+                    if (!m_imageBarriers.empty() || !m_bufferBarriers.empty()) {
+                        const auto dependencyInfo = VkDependencyInfo {
+                            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+                            .bufferMemoryBarrierCount = static_cast<uint32_t>(m_bufferBarriers.size()),
+                            .pBufferMemoryBarriers = m_bufferBarriers.data(),
+                            .imageMemoryBarrierCount = static_cast<uint32_t>(m_imageBarriers.size()),
+                            .pImageMemoryBarriers = m_imageBarriers.data(),
+                        };
+                        vkCmdPipelineBarrier2(passCommandBuffer, &dependencyInfo);
+                    }
+
+                    // Labelled by name, so capture tools show the frame pass by pass.
+                    vk_debug::beginLabel(passCommandBuffer, pass.name);
+                    const auto breadcrumbQueue = static_cast<uint32_t>(pass.queue);
+                    const auto breadcrumb = m_breadcrumbs != nullptr
+                        ? std::optional<uint32_t> { m_breadcrumbs->beginPass(passCommandBuffer, breadcrumbQueue, pass.name) }
+                        : std::nullopt;
+                    const auto statisticsScope = m_pipelineStatistics != nullptr && pass.queue == PassQueue::Graphics
+                        ? m_pipelineStatistics->beginScope(passCommandBuffer, pass.name)
+                        : std::nullopt;
+                    const auto countersScope = m_performanceCounters != nullptr && pass.queue == PassQueue::Graphics
+                        ? m_performanceCounters->beginScope(passCommandBuffer, pass.name)
+                        : std::nullopt;
+                    pass.callback(passCommandBuffer);
+                    if (countersScope.has_value()) {
+                        m_performanceCounters->endScope(passCommandBuffer, countersScope);
+                    }
+                    if (statisticsScope.has_value()) {
+                        m_pipelineStatistics->endScope(passCommandBuffer, statisticsScope);
+                    }
+                    if (breadcrumb.has_value()) {
+                        m_breadcrumbs->endPass(passCommandBuffer, breadcrumbQueue, breadcrumb.value());
+                    }
+                    vk_debug::endLabel(passCommandBuffer);
+                }
+
+                // The next frame's first use of each slot waits for its last use in this one.
+                for (size_t i = 0; i < m_slotOccupants.size(); i++) {
+                    if (m_slotOccupants[i] != NO_RESOURCE) {
+                        m_slotHistory[i] = this->finalState(m_slotOccupants[i]);
+                    }
+                }
+            }
+
+            // Where a resource was left after `execute`, for whatever uses it next.
+            ResourceState finalState(ResourceId resource) const {
+                const auto& state = this->resource(resource).state;
+
+                return ResourceState {
+                    .stages = state.writeStages | state.readStages,
+                    .access = state.writeAccess,
+                    .layout = state.layout,
+                };
+            }
+
+            VkImage image(ResourceId resource) const {
+                const auto& entry = this->resource(resource);
+
+                return entry.kind == ResourceKind::TransientImage ? m_transients.images[entry.transientIndex].get() : entry.image;
+            }
+
+            VkImageView imageView(ResourceId resource) const {
+                const auto& entry = this->resource(resource);
+
+                return entry.kind == ResourceKind::TransientImage ? m_transients.imageViews[entry.transientIndex].get() : entry.imageView;
+            }
+
+            VkBuffer buffer(ResourceId resource) const {
+                return this->resource(resource).buffer;
+            }
+
+            // Whether the last compile moved any pass to the async compute queue.
+            bool hasAsyncPasses() const {
+                return std::any_of(m_passes.begin(), m_passes.end(), [](const Pass& pass) {
+                    return pass.live && pass.queue == PassQueue::AsyncCompute;
+                });
+            }
+
+            // The stages of the graphics work that uses what the async passes wrote, which the
+            // graphics submission waits for the async submission at. Known after `execute`, and
+            // none when no graphics pass uses their results.
+            VkPipelineStageFlags2 asyncWaitStages() const {
+                return m_asyncWaitStages;
+            }
+
+            size_t culledPassCount() const {
+                return static_cast<size_t>(std::count_if(m_passes.begin(), m_passes.end(), [](const Pass& pass) { return !pass.live; }));
+            }
+
+            // The memory the transient images take up, without aliasing and with it.
+            VkDeviceSize transientImageSize() const {
+                return m_transientImageSize;
+            }
+
+            VkDeviceSize transientMemorySize() const {
+                return m_transientMemorySize;
+            }
+
+            // The part of the transient memory placed for attachments alone, which a tile based
+            // GPU may never back at all.
+            VkDeviceSize lazilyAllocatedSize() const {
+                return m_lazilyAllocatedSize;
+            }
+        private:
+            static constexpr uint32_t NO_PASS = UINT32_MAX;
+            static constexpr ResourceId NO_RESOURCE = UINT32_MAX;
+
+            enum class ResourceKind : uint32_t {
+                ImportedImage,
+                ImportedBuffer,
+                TransientImage,
+            };
+
+            // The last write, and the reads since, that the next access may have to wait for.
+            // `visibleStages` and `visibleAccess` are what the last write was made visible to.
+            // A layout transition counts as a write by the stages it was made visible to.
+            struct TrackedState {
+                bool used = false;
+                PassQueue queue = PassQueue::Graphics;
+                VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+                VkPipelineStageFlags2 writeStages = VK_PIPELINE_STAGE_2_NONE;
+                VkAccessFlags2 writeAccess = VK_ACCESS_2_NONE;
+                VkPipelineStageFlags2 readStages = VK_PIPELINE_STAGE_2_NONE;
+                VkPipelineStageFlags2 visibleStages = VK_PIPELINE_STAGE_2_NONE;
+                VkAccessFlags2 visibleAccess = VK_ACCESS_2_NONE;
+            };
+
+            struct Resource {
+                ResourceKind kind;
+                VkImage image = VK_NULL_HANDLE;
+                VkImageView imageView = VK_NULL_HANDLE;
+                VkBuffer buffer = VK_NULL_HANDLE;
+                VkImageAspectFlags aspectMask = 0;
+                TransientImageInfo transientInfo {};
+                ResourceState initialState {};
+                bool exported = false;
+                bool concurrent = false;
+
+                uint32_t firstPass = NO_PASS;
+                uint32_t lastPass = NO_PASS;
+                uint32_t transientIndex = 0;
+                TrackedState state {};
+            };
+
+            struct Pass {
+                const char* name;
+                uint32_t firstAccess;
+                uint32_t accessCount;
+                PassCallback callback;
+                PassQueue requestedQueue = PassQueue::Graphics;
+                bool live = false;
+                PassQueue queue = PassQueue::Graphics;
+            };
+
+            struct TransientLifetime {
+                TransientImageInfo info;
+                uint32_t firstPass;
+                uint32_t lastPass;
+                bool concurrent;
+
+                bool operator==(const TransientLifetime& other) const = default;
+
+                bool lazilyAllocated() const {
+                    return (info.usage & ~ATTACHMENT_USAGE) == 0;
+                }
+            };
+
+            // Members are destroyed in reverse order, so the images and views go before the
+            // memory they are bound to.
+            struct TransientImages {
+                std::vector<vk_memory::ScopedAllocation> memory;
+                std::vector<vk_handles::Image> images;
+                std::vector<vk_handles::ImageView> imageViews;
+            };
+
+            VkDevice m_device = VK_NULL_HANDLE;
+            vk_memory::DeviceMemoryAllocator* m_memoryAllocator = nullptr;
+            const VkAllocationCallbacks* m_allocator = nullptr;
+            std::array<uint32_t, 2> m_queueFamilies {};
+            bool m_asyncComputeEnabled = false;
+            vk_profiling::PipelineStatisticsProfiler* m_pipelineStatistics = nullptr;
+            vk_profiling::PerformanceCounterProfiler* m_performanceCounters = nullptr;
+            vk_breadcrumbs::Breadcrumbs* m_breadcrumbs = nullptr;
+
+            std::vector<Resource> m_resources;
+            std::vector<Pass> m_passes;
+            std::vector<ResourceAccess> m_accesses;
+            std::vector<VkImageMemoryBarrier2> m_imageBarriers;
+            std::vector<VkBufferMemoryBarrier2> m_bufferBarriers;
+
+            TransientImages m_transients;
+            std::vector<TransientLifetime> m_transientLifetimes;
+            std::vector<uint32_t> m_transientSlots;
+            // How the last frame left each slot's memory, and the image holding it this frame.
+            std::vector<ResourceState> m_slotHistory;
+            std::vector<ResourceId> m_slotOccupants;
+            VkDeviceSize m_transientImageSize = 0;
+            VkDeviceSize m_transientMemorySize = 0;
+            VkDeviceSize m_lazilyAllocatedSize = 0;
+            VkPipelineStageFlags2 m_asyncWaitStages = VK_PIPELINE_STAGE_2_NONE;
+
+            Resource& addResource(ResourceKind kind) {
+                return m_resources.emplace_back(Resource { .kind = kind });
+            }
+
+            Resource& resource(ResourceId resource) {
+                if (resource >= m_resources.size()) {
+                    throw std::runtime_error("failed to find render graph resource!");
+                }
+
+                return m_resources[resource];
+            }
+
+            const Resource& resource(ResourceId resource) const {
+                if (resource >= m_resources.size()) {
+                    throw std::runtime_error("failed to find render graph resource!");
+                }
+
+                return m_resources[resource];
+            }
+
+            std::span<const ResourceAccess> accesses(const Pass& pass) const {
+                return std::span<const ResourceAccess> { m_accesses.data() + pass.firstAccess, pass.accessCount };
+            }
+
+            // Walk the passes backwards from the exported resources. A pass is live when it
+            // writes a resource something live or exported needs, and then needs what it reads.
+            void cullPasses() {
+                auto needed = std::vector<bool>(m_resources.size(), false);
+                for (size_t i = 0; i < m_resources.size(); i++) {
+                    needed[i] = m_resources[i].exported;
+                }
+
+                for (auto pass = m_passes.rbegin(); pass != m_passes.rend(); pass++) {
+                    const auto accesses = this->accesses(*pass);
+                    pass->live = std::any_of(accesses.begin(), accesses.end(), [&needed](const ResourceAccess& access) {
+                        return access.write && needed[access.resource];
+                    });
+                    if (!pass->live) {
+                        continue;
+                    }
+
+                    for (const auto& access : accesses) {
+                        if (!access.write) {
+                            needed[access.resource] = true;
+                        }
+                    }
+                }
+            }
+
+            // Moves the live async compute passes to the compute queue, in order, unless they use
+            // a resource the graphics queue used before them, or one that stays exclusive to a
+            // family. The resources of the passes moved are marked to be shared.
+            void schedulePasses() {
+                auto usedByGraphics = std::vector<bool>(m_resources.size(), false);
+                for (auto& pass : m_passes) {
+                    pass.queue = PassQueue::Graphics;
+                    if (!pass.live) {
+                        continue;
+                    }
+
+                    const auto accesses = this->accesses(pass);
+                    const bool movable = m_asyncComputeEnabled
+                        && pass.requestedQueue == PassQueue::AsyncCompute
+                        && std::none_of(accesses.begin(), accesses.end(), [this, &usedByGraphics](const ResourceAccess& access) {
+                            const auto& resource = m_resources[access.resource];
+
+                            return usedByGraphics[access.resource] || (resource.kind != ResourceKind::TransientImage && !resource.concurrent);
+                        });
+                    if (movable) {
+                        pass.queue = PassQueue::AsyncCompute;
+                        for (const auto& access : accesses) {
+                            if (m_resources[access.resource].kind == ResourceKind::TransientImage) {
+                                m_resources[access.resource].concurrent = true;
+                            }
+                        }
+                    } else {
+                        for (const auto& access : accesses) {
+                            usedByGraphics[access.resource] = true;
+                        }
+                    }
+                }
+            }
+
+            void computeLifetimes() {
+                for (uint32_t i = 0; i < m_passes.size(); i++) {
+                    if (!m_passes[i].live) {
+                        continue;
+                    }
+
+                    for (const auto& access : this->accesses(m_passes[i])) {
+                        auto& resource = m_resources[access.resource];
+                        resource.firstPass = std::min(resource.firstPass, i);
+                        resource.lastPass = resource.lastPass == NO_PASS ? i : std::max(resource.lastPass, i);
+                    }
+                }
+            }
+
+            // Only the transient images the live passes use get memory. A graph with the same
+            // images and lifetimes as the last one keeps the last one's images.
+            void placeTransientImages(vk_handles::DeferredDestructionQueue& retiredResources, uint64_t retireValue) {
+                auto lifetimes = std::vector<TransientLifetime> {};
+                for (auto& resource : m_resources) {
+                    if (resource.kind == ResourceKind::TransientImage && resource.firstPass != NO_PASS) {
+                        resource.transientIndex = static_cast<uint32_t>(lifetimes.size());
+                        lifetimes.push_back(TransientLifetime { resource.transientInfo, resource.firstPass, resource.lastPass, resource.concurrent });
+                    }
+                }
+
+                if (lifetimes == m_transientLifetimes) {
+                    return;
+                }
+
+                retiredResources.retire(retireValue, std::move(m_transients));
+                m_transients = TransientImages {};
+                m_transientLifetimes = std::move(lifetimes);
+                m_slotHistory.clear();
+                this->createTransientImages();
+            }
+
+            void createTransientImages() {
+                auto requirements = std::vector<VkMemoryRequirements> {};
+                requirements.reserve(m_transientLifetimes.size());
+                for (const auto& lifetime : m_transientLifetimes) {
+                    const auto createInfo = VkImageCreateInfo {
+                        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+                        .imageType = VK_IMAGE_TYPE_2D,
+                        .format = lifetime.info.format,
+                        .extent = VkExtent3D { lifetime.info.extent.width, lifetime.info.extent.height, 1 },
+                        .mipLevels = 1,
+                        .arrayLayers = 1,
+                        .samples = lifetime.info.samples,
+                        .tiling = VK_IMAGE_TILING_OPTIMAL,
+                        .usage = lifetime.info.usage | (lifetime.lazilyAllocated() ? VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT : 0),
+                        .sharingMode = lifetime.concurrent ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+                        .queueFamilyIndexCount = lifetime.concurrent ? static_cast<uint32_t>(m_queueFamilies.size()) : 0,
+                        .pQueueFamilyIndices = lifetime.concurrent ? m_queueFamilies.data() : nullptr,
+                        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                    };
+
+                    auto image = VkImage {};
+                    const auto result = vkCreateImage(m_device, &createInfo, m_allocator, &image);
+                    if (result != VK_SUCCESS) {
+                        throw std::runtime_error("failed to create transient image!");
+                    }
+
+                    m_transients.images.emplace_back(m_device, image, m_allocator);
+
+                    auto imageRequirements = VkMemoryRequirements2 {
+                        .sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2,
+                    };
+                    const auto requirementsInfo = VkImageMemoryRequirementsInfo2 {
+                        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2,
+                        .image = image,
+                    };
+                    vkGetImageMemoryRequirements2(m_device, &requirementsInfo, &imageRequirements);
+                    requirements.push_back(imageRequirements.memoryRequirements);
+                }
+
+                // Images are placed in the order they are first used, each into the slot that
+                // is free for its whole lifetime, allows a memory type it can use, and comes
+                // closest to its size. Pass order is not execution order across queues, so the
+                // images shared with the compute queue get slots of their own. Lazily allocated
+                // images only share slots with each other, which leaves the memory of the rest
+                // free to come from any type.
+                struct Slot {
+                    VkMemoryRequirements requirements;
+                    uint32_t lastPass;
+                    bool dedicated;
+                    bool lazilyAllocated;
+                };
+
+                auto order = std::vector<uint32_t>(m_transientLifetimes.size(), 0);
+                for (uint32_t i = 0; i < order.size(); i++) {
+                    order[i] = i;
+                }
+                std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+                    return m_transientLifetimes[a].firstPass < m_transientLifetimes[b].firstPass;
+                });
+
+                auto slots = std::vector<Slot> {};
+                m_transientSlots.assign(m_transientLifetimes.size(), 0);
+                m_transientImageSize = 0;
+                for (const auto index : order) {
+                    const auto& lifetime = m_transientLifetimes[index];
+                    const auto& imageRequirements = requirements[index];
+                    m_transientImageSize += imageRequirements.size;
+
+                    auto bestSlot = std::optional<size_t> {};
+                    for (size_t i = 0; i < slots.size(); i++) {
+                        const auto& slot = slots[i];
+                        const bool free = !lifetime.concurrent && !slot.dedicated && slot.lastPass < lifetime.firstPass;
+                        const bool compatible = (slot.requirements.memoryTypeBits & imageRequirements.memoryTypeBits) != 0
+                            && slot.lazilyAllocated == lifetime.lazilyAllocated();
+                        if (!free || !compatible) {
+                            continue;
+                        }
+
+                        const auto waste = [&imageRequirements](const Slot& candidate) {
+                            const auto size = candidate.requirements.size;
+
+                            return size > imageRequirements.size ? size - imageRequirements.size : imageRequirements.size - size;
+                        };
+                        if (!bestSlot.has_value() || waste(slot) < waste(slots[bestSlot.value()])) {
+                            bestSlot = i;
+                        }
+                    }
+
+                    if (!bestSlot.has_value()) {
+                        bestSlot = slots.size();
+                        slots.push_back(Slot { imageRequirements, lifetime.lastPass, lifetime.concurrent, lifetime.lazilyAllocated() });
+                    } else {
+                        auto& slot = slots[bestSlot.value()];
+                        slot.requirements.size = std::max(slot.requirements.size, imageRequirements.size);
+                        slot.requirements.alignment = std::max(slot.requirements.alignment, imageRequirements.alignment);
+                        slot.requirements.memoryTypeBits &= imageRequirements.memoryTypeBits;
+                        slot.lastPass = lifetime.lastPass;
+                    }
+
+                    m_transientSlots[index] = static_cast<uint32_t>(bestSlot.value());
+                }
+
+                // Lazily allocated memory is committed per allocation, when the device has to
+                // spill the image out of tile memory, so it is not suballocated.
+                m_transientMemorySize = 0;
+                m_lazilyAllocatedSize = 0;
+                for (const auto& slot : slots) {
+                    m_transients.memory.emplace_back(*m_memoryAllocator, m_memoryAllocator->allocate(slot.requirements, vk_memory::AllocationCreateInfo {
+                        .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                        .preferredFlags = slot.lazilyAllocated ? VkMemoryPropertyFlags { VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT } : VkMemoryPropertyFlags {},
+                        .kind = vk_memory::ResourceKind::Optimal,
+                        .priority = vk_memory::MemoryPriority::High,
+                        .dedicated = slot.lazilyAllocated,
+                    }));
+                    m_transientMemorySize += slot.requirements.size;
+                    if (slot.lazilyAllocated) {
+                        m_lazilyAllocatedSize += slot.requirements.size;
+                    }
+                }
+                m_slotHistory.assign(slots.size(), ResourceState {});
+
+                for (size_t i = 0; i < m_transientLifetimes.size(); i++) {
+                    const auto& memory = m_transients.memory[m_transientSlots[i]].get();
+                    const auto bindResult = vkBindImageMemory(m_device, m_transients.images[i], memory.memory, memory.offset);
+                    if (bindResult != VK_SUCCESS) {
+                        throw std::runtime_error("failed to bind transient image memory!");
+                    }
+
+                    const auto viewInfo = VkImageViewCreateInfo {
+                        .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+                        .image = m_transients.images[i],
+                        .viewType = VK_IMAGE_VIEW_TYPE_2D,
+                        .format = m_transientLifetimes[i].info.format,
+                        .subresourceRange = VkImageSubresourceRange {
+                            .aspectMask = m_transientLifetimes[i].info.aspectMask,
+                            .baseMipLevel = 0,
+                            .levelCount = 1,
+                            .baseArrayLayer = 0,
+                            .layerCount = 1,
+                        },
+                    };
+
+                    auto imageView = VkImageView {};
+                    const auto viewResult = vkCreateImageView(m_device, &viewInfo, m_allocator, &imageView);
+                    if (viewResult != VK_SUCCESS) {
+                        throw std::runtime_error("failed to create transient image view!");
+                    }
+
+                    m_transients.imageViews.emplace_back(m_device, imageView, m_allocator);
+                }
+            }
+
+            void addBarrier(ResourceId resourceId, const ResourceAccess& access, PassQueue queue) {
+                auto& resource = m_resources[resourceId];
+                auto& state = resource.state;
+                const bool isImage = resource.kind != ResourceKind::ImportedBuffer;
+                const bool layoutChange = isImage && access.state.layout != state.layout;
+                const bool firstTransientUse = resource.kind == ResourceKind::TransientImage && !state.used;
+                // Async work always comes first within a frame, and the graphics submission waits
+                // for all of it, which makes every write before the hand over visible, so only a
+                // layout change is left for a barrier.
+                if (state.used && state.queue == PassQueue::AsyncCompute && queue == PassQueue::Graphics) {
+                    m_asyncWaitStages |= access.state.stages;
+                    state = TrackedState { .used = true, .layout = state.layout };
+                }
+                state.used = true;
+                state.queue = queue;
+
+                auto srcStages = VkPipelineStageFlags2 { VK_PIPELINE_STAGE_2_NONE };
+                auto srcAccess = VkAccessFlags2 { VK_ACCESS_2_NONE };
+                auto oldLayout = state.layout;
+                if (firstTransientUse) {
+                    // Undefined contents, after whatever held the memory last, in this frame or
+                    // the previous one.
+                    const auto slot = m_transientSlots[resource.transientIndex];
+                    const auto previous = m_slotOccupants[slot] != NO_RESOURCE ? this->finalState(m_slotOccupants[slot]) : m_slotHistory[slot];
+                    srcStages = previous.stages;
+                    srcAccess = previous.access;
+                    oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+                    m_slotOccupants[slot] = resourceId;
+                } else if (access.write || layoutChange) {
+                    srcStages = state.writeStages | state.readStages;
+                    srcAccess = state.writeAccess;
+                } else {
+                    // Reads only wait for the last write, and only when no earlier read made it
+                    // visible to them already.
+                    const bool visible = (access.state.stages & ~state.visibleStages) == 0 && (access.state.access & ~state.visibleAccess) == 0;
+                    state.readStages |= access.state.stages;
+                    state.visibleStages |= access.state.stages;
+                    state.visibleAccess |= access.state.access;
+                    if (visible || state.writeStages == VK_PIPELINE_STAGE_2_NONE) {
+                        return;
+                    }
+
+                    srcStages = state.writeStages;
+                    srcAccess = state.writeAccess;
+                }
+
+                if (queue == PassQueue::AsyncCompute) {
+                    // Whatever the graphics queue did before is covered by the submission's wait
+                    // for the previous frame.
+                    srcStages &= ASYNC_COMPUTE_STAGES;
+                    srcAccess = srcStages == VK_PIPELINE_STAGE_2_NONE ? VK_ACCESS_2_NONE : srcAccess & ASYNC_COMPUTE_ACCESS;
+                }
+
+                if (isImage) {
+                    m_imageBarriers.push_back(VkImageMemoryBarrier2 {
+                        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+                        .srcStageMask = srcStages,
+                        .srcAccessMask = srcAccess,
+                        .dstStageMask = access.state.stages,
+                        .dstAccessMask = access.state.access,
+                        .oldLayout = oldLayout,
+                        .newLayout = access.state.layout,
+                        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                        .image = this->image(resourceId),
+                        .subresourceRange = VkImageSubresourceRange {
+                            .aspectMask = resource.aspectMask,
+                            .baseMipLevel = 0,
+                            .levelCount = VK_REMAINING_MIP_LEVELS,
+                            .baseArrayLayer = 0,
+                            .layerCount = VK_REMAINING_ARRAY_LAYERS,
+                        },
+                    });
+                } else {
+                    m_bufferBarriers.push_back(VkBufferMemoryBarrier2 {
+                        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+                        .srcStageMask = srcStages,
+                        .srcAccessMask = srcAccess,
+                        .dstStageMask = access.state.stages,
+                        .dstAccessMask = access.state.access,
+                        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                        .buffer = resource.buffer,
+                        .offset = 0,
+                        .size = VK_WHOLE_SIZE,
+                    });
+                }
+
+                if (access.write) {
+                    state.writeStages = access.state.stages;
+                    state.writeAccess = access.state.access;
+                    state.readStages = VK_PIPELINE_STAGE_2_NONE;
+                    state.visibleStages = VK_PIPELINE_STAGE_2_NONE;
+                    state.visibleAccess = VK_ACCESS_2_NONE;
+                } else if (layoutChange || firstTransientUse) {
+                    state.writeStages = access.state.stages;
+                    state.writeAccess = VK_ACCESS_2_NONE;
+                    state.readStages = access.state.stages;
+                    state.visibleStages = access.state.stages;
+                    state.visibleAccess = access.state.access;
+                }
+                if (isImage) {
+                    state.layout = access.state.layout;
+                }
+            }
+    };
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace vk_resolution {
+    // Holds the GPU frame time at a budget by scaling the resolution frames render at.
+    //
+    // GPU time grows with the pixel count, the square of the scale, so the error is taken as
+    // the change of the scale's logarithm that would land the last frame on budget. A PI
+    // controller in velocity form adds a share of the change in error and a share of the
+    // error itself to the logarithm every frame. Clamping the scale is then all the anti
+    // windup it takes, and equal errors above and below the budget move the scale by equal
+    // ratios. The timings arrive a couple of frames late, which the small gains keep from
+    // turning into oscillation.
+    class DynamicResolutionController {
+        public:
+            static constexpr double PROPORTIONAL_GAIN = 0.3;
+            static constexpr double INTEGRAL_GAIN = 0.15;
+            // Errors this small leave the scale alone, so that noise in the timings does not
+            // change the render size by a few pixels every frame.
+            static constexpr double DEADBAND = 0.02;
+
+            explicit DynamicResolutionController() = default;
+
+            DynamicResolutionController(const DynamicResolutionController& other) = delete;
+            DynamicResolutionController& operator=(const DynamicResolutionController& other) = delete;
+
+            // Starts at `maxScale`, and only scales down once a frame is over budget.
+            void init(double budgetMilliseconds, double minScale, double maxScale) {
+                m_budgetMilliseconds = budgetMilliseconds;
+                m_minLogScale = std::log(minScale);
+                m_maxLogScale = std::log(maxScale);
+                m_logScale = m_maxLogScale;
+                m_lastError = 0.0;
+            }
+
+            bool isEnabled() const {
+                return m_budgetMilliseconds > 0.0;
+            }
+
+            double budgetMilliseconds() const {
+                return m_budgetMilliseconds;
+            }
+
+            void update(double gpuMilliseconds) {
+                if (!this->isEnabled() || !(gpuMilliseconds > 0.0)) {
+                    return;
+                }
+
+                auto error = 0.5 * std::log(m_budgetMilliseconds / gpuMilliseconds);
+                if (std::abs(error) < DEADBAND) {
+                    error = 0.0;
+                }
+
+                const auto change = PROPORTIONAL_GAIN * (error - m_lastError) + INTEGRAL_GAIN * error;
+                m_logScale = std::clamp(m_logScale + change, m_minLogScale, m_maxLogScale);
+                m_lastError = error;
+            }
+
+            double scale() const {
+                return std::exp(m_logScale);
+            }
+        private:
+            double m_budgetMilliseconds = 0.0;
+            double m_minLogScale = 0.0;
+            double m_maxLogScale = 0.0;
+            double m_logScale = 0.0;
+            double m_lastError = 0.0;
+    };
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "vk_dispatch.h"
+#include "vk_handles.h"
+#include "vk_memory.h"
+
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+
+namespace vk_resources {
+    struct BufferResource {
+        vk_handles::Buffer buffer;
+        vk_memory::ScopedAllocation memory;
+        VkDeviceSize size = 0;
+    };
+
+    struct ImageResource {
+        vk_handles::Image image;
+        vk_memory::ScopedAllocation memory;
+        vk_handles::ImageView view;
+    };
+
+    struct PipelineResource {
+        vk_handles::Pipeline pipeline;
+        VkPipelineBindPoint bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    };
+
+    using BufferHandle = vk_handles::PoolHandle<BufferResource>;
+    using ImageHandle = vk_handles::PoolHandle<ImageResource>;
+    using PipelineHandle = vk_handles::PoolHandle<PipelineResource>;
+
+    // What a draw needs besides its geometry, by handle, so a material outlives neither the
+    // pipeline nor the texture it names without noticing.
+    struct Material {
+        PipelineHandle pipeline;
+        ImageHandle baseColor;
+        glm::vec4 baseColorFactor = glm::vec4 { 1.0f };
+    };
+
+    using MaterialHandle = vk_handles::PoolHandle<Material>;
+
+    // The renderer's long lived resources, one pool per type, so a handle to one type is never
+    // looked up in another's pool. Resources are destroyed by retiring them to the renderer's
+    // deferred destruction queue, against the frame after which the GPU is done with them.
+    class ResourcePools {
+        public:
+            explicit ResourcePools() = default;
+
+            ResourcePools(const ResourcePools& other) = delete;
+            ResourcePools& operator=(const ResourcePools& other) = delete;
+
+            vk_handles::Pool<BufferResource> buffers;
+            vk_handles::Pool<ImageResource> images;
+            vk_handles::Pool<PipelineResource> pipelines;
+            vk_handles::Pool<Material> materials;
+
+            // Destroys every resource, once the device is idle.
+            void clear() {
+                materials.clear();
+                pipelines.clear();
+                images.clear();
+                buffers.clear();
+            }
+    };
+}
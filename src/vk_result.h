@@ -0,0 +1,156 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+#include <fmt/core.h>
+
+// Returns the error of a `vk_result::Result` expression from the enclosing function, which
+// must return a `vk_result::Result` itself.
+#define VK_RESULT_TRY(expression) \
+    do { \
+        if (auto vkResultTry = (expression); !vkResultTry) { \
+            return vkResultTry.error(); \
+        } \
+    } while (false)
+
+
+namespace vk_result {
+    inline const char* resultToString(VkResult result) {
+        switch (result) {
+            case VK_SUCCESS: return "VK_SUCCESS";
+            case VK_NOT_READY: return "VK_NOT_READY";
+            case VK_TIMEOUT: return "VK_TIMEOUT";
+            case VK_EVENT_SET: return "VK_EVENT_SET";
+            case VK_EVENT_RESET: return "VK_EVENT_RESET";
+            case VK_INCOMPLETE: return "VK_INCOMPLETE";
+            case VK_ERROR_OUT_OF_HOST_MEMORY: return "VK_ERROR_OUT_OF_HOST_MEMORY";
+            case VK_ERROR_OUT_OF_DEVICE_MEMORY: return "VK_ERROR_OUT_OF_DEVICE_MEMORY";
+            case VK_ERROR_INITIALIZATION_FAILED: return "VK_ERROR_INITIALIZATION_FAILED";
+            case VK_ERROR_DEVICE_LOST: return "VK_ERROR_DEVICE_LOST";
+            case VK_ERROR_MEMORY_MAP_FAILED: return "VK_ERROR_MEMORY_MAP_FAILED";
+            case VK_ERROR_LAYER_NOT_PRESENT: return "VK_ERROR_LAYER_NOT_PRESENT";
+            case VK_ERROR_EXTENSION_NOT_PRESENT: return "VK_ERROR_EXTENSION_NOT_PRESENT";
+            case VK_ERROR_FEATURE_NOT_PRESENT: return "VK_ERROR_FEATURE_NOT_PRESENT";
+            case VK_ERROR_INCOMPATIBLE_DRIVER: return "VK_ERROR_INCOMPATIBLE_DRIVER";
+            case VK_ERROR_TOO_MANY_OBJECTS: return "VK_ERROR_TOO_MANY_OBJECTS";
+            case VK_ERROR_FORMAT_NOT_SUPPORTED: return "VK_ERROR_FORMAT_NOT_SUPPORTED";
+            case VK_ERROR_FRAGMENTED_POOL: return "VK_ERROR_FRAGMENTED_POOL";
+            case VK_ERROR_UNKNOWN: return "VK_ERROR_UNKNOWN";
+            case VK_ERROR_OUT_OF_POOL_MEMORY: return "VK_ERROR_OUT_OF_POOL_MEMORY";
+            case VK_ERROR_INVALID_EXTERNAL_HANDLE: return "VK_ERROR_INVALID_EXTERNAL_HANDLE";
+            case VK_ERROR_FRAGMENTATION: return "VK_ERROR_FRAGMENTATION";
+            case VK_ERROR_INVALID_OPAQUE_CAPTURE_ADDRESS: return "VK_ERROR_INVALID_OPAQUE_CAPTURE_ADDRESS";
+            case VK_PIPELINE_COMPILE_REQUIRED: return "VK_PIPELINE_COMPILE_REQUIRED";
+            case VK_ERROR_SURFACE_LOST_KHR: return "VK_ERROR_SURFACE_LOST_KHR";
+            case VK_ERROR_NATIVE_WINDOW_IN_USE_KHR: return "VK_ERROR_NATIVE_WINDOW_IN_USE_KHR";
+            case VK_SUBOPTIMAL_KHR: return "VK_SUBOPTIMAL_KHR";
+            case VK_ERROR_OUT_OF_DATE_KHR: return "VK_ERROR_OUT_OF_DATE_KHR";
+            case VK_ERROR_VALIDATION_FAILED_EXT: return "VK_ERROR_VALIDATION_FAILED_EXT";
+            case VK_ERROR_FULL_SCREEN_EXCLUSIVE_MODE_LOST_EXT: return "VK_ERROR_FULL_SCREEN_EXCLUSIVE_MODE_LOST_EXT";
+            default: return "unknown VkResult";
+        }
+    }
+
+    // The call that failed, like "failed to create instance", and what the driver returned.
+    // `context` is a string literal, so an error costs nothing to make or to pass up.
+    struct Error {
+        VkResult result;
+        const char* context;
+
+        std::string message() const {
+            return fmt::format("{} ({})!", this->context, resultToString(this->result));
+        }
+    };
+
+    // Either the value of a step that succeeded or the `Error` it failed with, returned instead
+    // of thrown, so a caller that expects the error, like a swapchain going out of date, checks
+    // it as cheaply as a `VkResult`. The app only turns an error into an exception, or an exit,
+    // at the top of `App::run`.
+    template <typename T>
+    class [[nodiscard]] Result {
+        public:
+            Result(T value)
+                : m_value { std::in_place_index<0>, std::move(value) }
+            {
+            }
+
+            Result(Error error)
+                : m_value { std::in_place_index<1>, error }
+            {
+            }
+
+            explicit operator bool() const {
+                return m_value.index() == 0;
+            }
+
+            T& value() {
+                return std::get<0>(m_value);
+            }
+
+            const T& value() const {
+                return std::get<0>(m_value);
+            }
+
+            const Error& error() const {
+                return std::get<1>(m_value);
+            }
+
+            // For the callers that cannot return a `Result` themselves.
+            T valueOrThrow() && {
+                if (m_value.index() != 0) {
+                    throw std::runtime_error(this->error().message());
+                }
+
+                return std::move(std::get<0>(m_value));
+            }
+        private:
+            std::variant<T, Error> m_value;
+    };
+
+    template <>
+    class [[nodiscard]] Result<void> {
+        public:
+            Result() = default;
+
+            Result(Error error)
+                : m_error { error }
+            {
+            }
+
+            explicit operator bool() const {
+                return !m_error.has_value();
+            }
+
+            const Error& error() const {
+                return m_error.value();
+            }
+
+            void orThrow() const {
+                if (m_error.has_value()) {
+                    throw std::runtime_error(m_error->message());
+                }
+            }
+        private:
+            std::optional<Error> m_error;
+    };
+
+    // A step that only succeeds or fails.
+    using Status = Result<void>;
+
+    // Success for `VK_SUCCESS` and the other non-negative codes, which only report how a call
+    // succeeded, and `context` with the code for the errors.
+    inline Status check(VkResult result, const char* context) {
+        if (result < 0) {
+            return Error { result, context };
+        }
+
+        return Status {};
+    }
+}
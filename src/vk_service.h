@@ -0,0 +1,240 @@
+#pragma once
+
+#include "vk_log.h"
+#include "vk_profiling.h"
+#include "vk_socket.h"
+#include "vk_tracing.h"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+
+#include <fmt/core.h>
+
+
+namespace vk_service {
+    // Only the port listens on the loopback interface, since any client can make the service
+    // render.
+    constexpr std::string_view DEFAULT_ADDRESS = "127.0.0.1";
+
+    enum class Command : uint32_t {
+        Render,
+        Status,
+    };
+
+    struct Request {
+        Command command = Command::Status;
+        uint64_t frames = 0;
+    };
+
+    // The CPU and GPU frame times of the latest `frames` frames, for a reply.
+    inline std::string summarizeFrames(const vk_profiling::FrameTelemetry& telemetry, uint64_t frames) {
+        const auto count = static_cast<size_t>(std::min<uint64_t>(frames, vk_profiling::FrameTelemetry::CAPACITY));
+        const auto cpuFrame = telemetry.percentiles(vk_profiling::FrameMetric::CpuFrame, count);
+        const auto gpu = telemetry.percentiles(vk_profiling::FrameMetric::Gpu, count);
+
+        return fmt::format(
+            "cpuFrameP50={:.3f} cpuFrameP99={:.3f} gpuP50={:.3f} gpuP99={:.3f}",
+            cpuFrame.p50,
+            cpuFrame.p99,
+            gpu.p50,
+            gpu.p99
+        );
+    }
+
+    // Keeps the instance, the device and everything created on them alive between runs, for
+    // hosts that would otherwise start a new process, and pay for the loader, the driver and
+    // device creation again, for every short run. Clients connect over TCP, one at a time,
+    // and send lines of text, each answered with one line starting with `ok` or `error`:
+    //
+    //     render <frames>   renders that many more frames offscreen, and replies with the
+    //                       time they took and their frame time percentiles
+    //     status            replies with the frames rendered so far, the device and the size
+    //                       of the offscreen images
+    //     quit              replies, then ends the service once the frame loop is idle
+    //
+    // The device belongs to the frame loop, so the service thread only parses requests and
+    // hands them over, and the frame loop takes them with `waitForRequest` and answers each
+    // with `reply`.
+    class RenderService {
+        public:
+            static constexpr auto POLL_INTERVAL = std::chrono::milliseconds { 100 };
+            static constexpr size_t MAX_LINE_LENGTH = 256;
+            static constexpr uint64_t MAX_FRAMES_PER_REQUEST = 1'000'000;
+
+            explicit RenderService() = default;
+
+            RenderService(const RenderService& other) = delete;
+            RenderService& operator=(const RenderService& other) = delete;
+
+            ~RenderService() {
+                this->stop();
+            }
+
+            void start(const vk_socket::Endpoint& endpoint) {
+                if (m_thread.joinable()) {
+                    return;
+                }
+
+                m_listener.listen(endpoint, "render requests");
+                m_running = true;
+                m_thread = std::thread { [this]() { this->serveLoop(); } };
+                VK_LOG_INFO("Serving render requests at {}:{}", endpoint.address, endpoint.port);
+            }
+
+            // A client still waiting for a reply is told the service stopped.
+            void stop() {
+                {
+                    const auto lock = std::scoped_lock { m_mutex };
+                    m_running = false;
+                }
+
+                m_changed.notify_all();
+                if (m_thread.joinable()) {
+                    m_thread.join();
+                }
+
+                m_listener.close();
+            }
+
+            bool isRunning() const {
+                const auto lock = std::scoped_lock { m_mutex };
+
+                return m_running;
+            }
+
+            // Blocks until a client asks for something, and returns nothing once a client asked
+            // the service to quit.
+            std::optional<Request> waitForRequest() {
+                auto lock = std::unique_lock { m_mutex };
+                m_changed.wait(lock, [this]() { return m_pending.has_value() || m_quit || !m_running; });
+                if (!m_pending.has_value()) {
+                    return std::nullopt;
+                }
+
+                return std::exchange(m_pending, std::nullopt);
+            }
+
+            // Answers the request `waitForRequest` returned last, with a line starting with `ok`
+            // or `error`.
+            void reply(std::string line) {
+                {
+                    const auto lock = std::scoped_lock { m_mutex };
+                    m_reply = std::move(line);
+                }
+
+                m_changed.notify_all();
+            }
+        private:
+            std::thread m_thread;
+            vk_socket::Listener m_listener;
+
+            mutable std::mutex m_mutex;
+            std::condition_variable m_changed;
+            bool m_running = false;
+            bool m_quit = false;
+            std::optional<Request> m_pending;
+            std::optional<std::string> m_reply;
+
+            void serveLoop() {
+                vk_tracing::setThreadName("service");
+                while (this->isRunning()) {
+                    if (const auto client = m_listener.accept(POLL_INTERVAL); client.has_value()) {
+                        this->serve(client.value());
+                        vk_socket::closeSocket(client.value());
+                    }
+                }
+            }
+
+            void serve(vk_socket::Socket client) {
+                auto received = std::string {};
+                auto chunk = std::array<char, MAX_LINE_LENGTH> {};
+                while (this->isRunning()) {
+                    const auto end = received.find('\n');
+                    if (end == std::string::npos) {
+                        if (received.size() > MAX_LINE_LENGTH) {
+                            vk_socket::sendAll(client, "error line too long\n");
+                            return;
+                        } else if (!vk_socket::waitReadable(client, POLL_INTERVAL)) {
+                            continue;
+                        }
+
+                        const auto count = vk_socket::receive(client, chunk.data(), chunk.size());
+                        if (count == 0) {
+                            return;
+                        }
+
+                        received.append(chunk.data(), count);
+                        continue;
+                    }
+
+                    auto line = std::string_view { received.data(), end };
+                    if (line.ends_with('\r')) {
+                        line.remove_suffix(1);
+                    }
+
+                    const auto [answer, quit] = this->handle(line);
+                    received.erase(0, end + 1);
+                    if (!vk_socket::sendAll(client, answer + "\n") || quit) {
+                        return;
+                    }
+                }
+            }
+
+            // The reply, and whether the client asked the service to quit.
+            std::pair<std::string, bool> handle(std::string_view line) {
+                const auto separator = line.find(' ');
+                const auto command = line.substr(0, separator);
+                const auto argument = separator == std::string_view::npos ? std::string_view {} : line.substr(separator + 1);
+                if (command == "quit") {
+                    {
+                        const auto lock = std::scoped_lock { m_mutex };
+                        m_quit = true;
+                    }
+
+                    m_changed.notify_all();
+
+                    return { "ok", true };
+                } else if (command == "status") {
+                    return { this->call(Request { .command = Command::Status }), false };
+                } else if (command == "render") {
+                    auto frames = uint64_t { 0 };
+                    const auto [end, error] = std::from_chars(argument.data(), argument.data() + argument.size(), frames);
+                    if (error != std::errc {} || end != argument.data() + argument.size() || frames == 0 || frames > MAX_FRAMES_PER_REQUEST) {
+                        return { fmt::format("error expected render <frames>, with 1 to {} frames", MAX_FRAMES_PER_REQUEST), false };
+                    }
+
+                    return { this->call(Request { .command = Command::Render, .frames = frames }), false };
+                }
+
+                return { fmt::format("error unknown command `{}`, expected render <frames>, status or quit", command), false };
+            }
+
+            std::string call(const Request& request) {
+                auto lock = std::unique_lock { m_mutex };
+                if (m_quit) {
+                    return "error the service is quitting";
+                }
+
+                m_pending = request;
+                m_reply.reset();
+                m_changed.notify_all();
+                m_changed.wait(lock, [this]() { return m_reply.has_value() || !m_running; });
+                if (!m_reply.has_value()) {
+                    m_pending.reset();
+                    return "error the service stopped";
+                }
+
+                return std::exchange(m_reply, std::nullopt).value();
+            }
+    };
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+// Set by the build when spirv-cross generated `shader_layouts.h` from the shaders' reflection
+// data, see `cmake/ShaderLayouts.cmake`. It holds a struct for every push constant and uniform
+// block, and the checks that a hand written struct has every member of one at its offset.
+// Without it every check compiles to nothing.
+#ifndef HELLO_WINDOW_SHADER_LAYOUTS
+#define HELLO_WINDOW_SHADER_LAYOUTS 0
+#endif
+
+#if HELLO_WINDOW_SHADER_LAYOUTS
+#include "shader_layouts.h"
+#else
+#define VK_SHADER_LAYOUT_CHECK(module, block, type)
+#endif
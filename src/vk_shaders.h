@@ -0,0 +1,376 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "vk_jobs.h"
+#include "vk_log.h"
+#include "vk_pipelines.h"
+
+
+namespace vk_shaders {
+    // Called on the thread that polls, with the new module after a shader has been rebuilt, so
+    // the owner can recreate the pipelines using it. `shaderModule` already answers with the
+    // new module by then.
+    using ReloadCallback = std::function<void(VkShaderModule shaderModule)>;
+
+    // Loads the SPIR-V modules compiled at build time, and rebuilds them when their GLSL sources
+    // change on disk. The SPIR-V itself is kept, for shader objects, which are created from code
+    // rather than from modules.
+    //
+    // `poll` is cheap enough to call every frame: it only looks at file modification times every
+    // `POLL_INTERVAL`. The files watched for a shader are the ones the depfile next to its module
+    // lists, which `glslc -MD` writes at build time and on every rebuild, so editing an included
+    // file rebuilds every shader including it. A changed shader is recompiled on the job system
+    // with the same `glslc` the build used, into a temporary file that only replaces the module
+    // once the compile succeeded, and the module is swapped in on a later `poll`. Editing a
+    // shader never stalls the frame loop, and only the affected modules and pipelines are
+    // rebuilt.
+    //
+    // A replaced module is kept until `destroy`, since its owner may still hold the handle to
+    // create a pipeline from, here or on a worker. Modules are looked up under a lock, so
+    // pipelines can be built on workers, but `poll` and `onReload` belong to one thread.
+    class ShaderLibrary {
+        public:
+            static constexpr auto POLL_INTERVAL = std::chrono::milliseconds { 250 };
+
+            explicit ShaderLibrary() = default;
+
+            ShaderLibrary(const ShaderLibrary& other) = delete;
+            ShaderLibrary& operator=(const ShaderLibrary& other) = delete;
+
+            // `glslc` may be empty, in which case only the compiled modules themselves are
+            // watched, and rebuilding them is left to the build.
+            void init(
+                VkDevice device,
+                vk_jobs::JobSystem& jobSystem,
+                std::filesystem::path sourceDirectory,
+                std::filesystem::path binaryDirectory,
+                std::string glslc
+            ) {
+                m_device = device;
+                m_jobSystem = &jobSystem;
+                m_sourceDirectory = std::move(sourceDirectory);
+                m_binaryDirectory = std::move(binaryDirectory);
+                m_glslc = std::move(glslc);
+                m_lastPoll = std::chrono::steady_clock::now();
+            }
+
+            void destroy() {
+                const auto lock = std::scoped_lock { m_mutex };
+                for (auto& [name, shader] : m_shaders) {
+                    m_jobSystem->wait(shader->compileJob);
+                    vkDestroyShaderModule(m_device, shader->shaderModule, nullptr);
+                }
+                for (const auto shaderModule : m_retiredModules) {
+                    vkDestroyShaderModule(m_device, shaderModule, nullptr);
+                }
+
+                m_shaders.clear();
+                m_retiredModules.clear();
+                m_codeHashes.clear();
+            }
+
+            // The module compiled from `name`, like `fullscreen.vert`, loaded on first use.
+            VkShaderModule shaderModule(const std::string& name) {
+                const auto lock = std::scoped_lock { m_mutex };
+
+                return this->load(name).shaderModule;
+            }
+
+            // The SPIR-V of `name`'s current module, which stays valid until the next `poll`.
+            const std::vector<uint32_t>& code(const std::string& name) {
+                const auto lock = std::scoped_lock { m_mutex };
+
+                return this->load(name).code;
+            }
+
+            // The hash of the SPIR-V `shaderModule` was created from, or zero for a module that
+            // did not come from here. Pipelines are keyed on it rather than on the handle, which
+            // the driver may hand out again once a module is destroyed.
+            uint64_t codeHash(VkShaderModule shaderModule) const {
+                const auto lock = std::scoped_lock { m_mutex };
+                const auto found = m_codeHashes.find(shaderModule);
+
+                return found != m_codeHashes.end() ? found->second : 0;
+            }
+
+            void onReload(const std::string& name, ReloadCallback callback) {
+                const auto lock = std::scoped_lock { m_mutex };
+                this->load(name).callbacks.push_back(std::move(callback));
+            }
+
+            void poll() {
+                const auto now = std::chrono::steady_clock::now();
+                if (now - m_lastPoll < POLL_INTERVAL) {
+                    return;
+                }
+
+                m_lastPoll = now;
+                auto shaders = std::vector<std::pair<std::string, Shader*>> {};
+                {
+                    const auto lock = std::scoped_lock { m_mutex };
+                    for (auto& [name, shader] : m_shaders) {
+                        shaders.emplace_back(name, shader.get());
+                    }
+                }
+
+                for (auto& [name, shader] : shaders) {
+                    if (!shader->compileJob.isFinished()) {
+                        continue;
+                    }
+
+                    const auto sourceTimes = this->lastWriteTimes(shader->sources);
+                    if (!m_glslc.empty() && sourceTimes != shader->sourceTimes) {
+                        shader->sourceTimes = sourceTimes;
+                        this->compile(name, *shader);
+                        continue;
+                    }
+
+                    const auto binaryTime = this->lastWriteTime(shader->binaryPath);
+                    if (binaryTime != shader->binaryTime) {
+                        shader->binaryTime = binaryTime;
+                        this->reload(name, *shader);
+                    }
+                }
+            }
+        private:
+            struct Shader {
+                std::filesystem::path sourcePath;
+                std::filesystem::path binaryPath;
+                // The source and everything it includes, and their modification times.
+                std::vector<std::filesystem::path> sources;
+                std::vector<std::filesystem::file_time_type> sourceTimes;
+                std::filesystem::file_time_type binaryTime;
+                std::vector<uint32_t> code;
+                VkShaderModule shaderModule = VK_NULL_HANDLE;
+                std::vector<ReloadCallback> callbacks;
+                vk_jobs::JobHandle compileJob;
+            };
+
+            VkDevice m_device = VK_NULL_HANDLE;
+            vk_jobs::JobSystem* m_jobSystem = nullptr;
+            std::filesystem::path m_sourceDirectory;
+            std::filesystem::path m_binaryDirectory;
+            std::string m_glslc;
+            std::chrono::steady_clock::time_point m_lastPoll;
+
+            mutable std::mutex m_mutex;
+            std::map<std::string, std::unique_ptr<Shader>> m_shaders;
+            std::vector<VkShaderModule> m_retiredModules;
+            std::unordered_map<VkShaderModule, uint64_t> m_codeHashes;
+
+            // Expects the lock to be held.
+            Shader& load(const std::string& name) {
+                const auto found = m_shaders.find(name);
+                if (found != m_shaders.end()) {
+                    return *found->second;
+                }
+
+                auto shader = std::make_unique<Shader>();
+                shader->sourcePath = m_sourceDirectory / name;
+                shader->binaryPath = m_binaryDirectory / (name + ".spv");
+                shader->code = this->readCode(shader->binaryPath);
+                shader->shaderModule = this->createShaderModule(shader->code, shader->binaryPath);
+                shader->sources = this->readSources(*shader);
+                shader->sourceTimes = this->lastWriteTimes(shader->sources);
+                shader->binaryTime = this->lastWriteTime(shader->binaryPath);
+                m_codeHashes.emplace(shader->shaderModule, hashCode(shader->code));
+
+                return *m_shaders.emplace(name, std::move(shader)).first->second;
+            }
+
+            static uint64_t hashCode(const std::vector<uint32_t>& code) {
+                auto hasher = vk_pipelines::StateHasher {};
+                hasher.addBytes(code.data(), code.size() * sizeof(uint32_t));
+
+                return hasher.value();
+            }
+
+            static std::filesystem::path depfilePath(const std::filesystem::path& binaryPath) {
+                return std::filesystem::path { binaryPath } += ".d";
+            }
+
+            // The files the depfile of `shader` lists as the dependencies of its module, which
+            // is only the source itself when there is no depfile to read.
+            std::vector<std::filesystem::path> readSources(const Shader& shader) const {
+                auto file = std::ifstream { depfilePath(shader.binaryPath), std::ios::binary };
+                const auto text = file ? std::string { std::istreambuf_iterator<char> { file }, std::istreambuf_iterator<char> {} } : std::string {};
+                // The target ends at the first colon followed by whitespace, which a drive
+                // letter never is.
+                auto position = text.find(": ");
+                if (position == std::string::npos) {
+                    return { shader.sourcePath };
+                }
+
+                // Dependencies are separated by whitespace, with spaces in paths escaped and
+                // lines continued by backslashes.
+                auto sources = std::vector<std::filesystem::path> {};
+                auto source = std::string {};
+                const auto flush = [&sources, &source]() {
+                    if (!source.empty()) {
+                        sources.emplace_back(source);
+                        source.clear();
+                    }
+                };
+                for (position += 1; position < text.size(); position++) {
+                    const auto character = text[position];
+                    const auto next = position + 1 < text.size() ? text[position + 1] : '\0';
+                    if (character == '\\' && next == ' ') {
+                        source.push_back(' ');
+                        position++;
+                    } else if (character == '\\' && (next == '\n' || next == '\r')) {
+                        flush();
+                    } else if (character == ' ' || character == '\t' || character == '\n' || character == '\r') {
+                        flush();
+                    } else {
+                        source.push_back(character);
+                    }
+                }
+                flush();
+
+                if (sources.empty()) {
+                    return { shader.sourcePath };
+                }
+
+                return sources;
+            }
+
+            std::vector<std::filesystem::file_time_type> lastWriteTimes(const std::vector<std::filesystem::path>& paths) const {
+                auto times = std::vector<std::filesystem::file_time_type> {};
+                times.reserve(paths.size());
+                for (const auto& path : paths) {
+                    times.push_back(this->lastWriteTime(path));
+                }
+
+                return times;
+            }
+
+            std::filesystem::file_time_type lastWriteTime(const std::filesystem::path& path) const {
+                auto error = std::error_code {};
+                const auto time = std::filesystem::last_write_time(path, error);
+
+                return error ? std::filesystem::file_time_type {} : time;
+            }
+
+            std::vector<uint32_t> readCode(const std::filesystem::path& path) const {
+                auto file = std::ifstream { path, std::ios::binary };
+                if (!file) {
+                    throw std::runtime_error(fmt::format("failed to open shader module `{}`!", path.string()));
+                }
+
+                const auto bytes = std::vector<char> { std::istreambuf_iterator<char> { file }, std::istreambuf_iterator<char> {} };
+                if (bytes.empty() || bytes.size() % sizeof(uint32_t) != 0) {
+                    throw std::runtime_error(fmt::format("shader module `{}` is not valid SPIR-V!", path.string()));
+                }
+
+                auto code = std::vector<uint32_t>(bytes.size() / sizeof(uint32_t));
+                std::memcpy(code.data(), bytes.data(), bytes.size());
+
+                return code;
+            }
+
+            VkShaderModule createShaderModule(const std::vector<uint32_t>& code, const std::filesystem::path& path) const {
+                const auto createInfo = VkShaderModuleCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+                    .codeSize = code.size() * sizeof(uint32_t),
+                    .pCode = code.data(),
+                };
+
+                auto shaderModule = VkShaderModule {};
+                const auto result = vkCreateShaderModule(m_device, &createInfo, nullptr, &shaderModule);
+                if (result != VK_SUCCESS) {
+                    throw std::runtime_error(fmt::format("failed to create shader module `{}`!", path.string()));
+                }
+
+                return shaderModule;
+            }
+
+            // Writes the module and its depfile next to their targets first, and only renames
+            // them over the targets once the compile succeeded, so a failed compile leaves the
+            // last good module in place. The module goes last, since its modification time is
+            // what `poll` reloads on.
+            void compile(const std::string& name, Shader& shader) {
+                const auto binaryPath = shader.binaryPath;
+                const auto depfile = depfilePath(binaryPath);
+                const auto temporaryBinaryPath = std::filesystem::path { binaryPath } += ".tmp";
+                const auto temporaryDepfile = std::filesystem::path { depfile } += ".tmp";
+                const auto command = fmt::format(
+                    "\"{}\" --target-env=vulkan1.3 -O -MD -MF \"{}\" -o \"{}\" \"{}\"",
+                    m_glslc,
+                    temporaryDepfile.string(),
+                    temporaryBinaryPath.string(),
+                    shader.sourcePath.string()
+                );
+
+                shader.compileJob = m_jobSystem->submit([name, command, binaryPath, depfile, temporaryBinaryPath, temporaryDepfile]() {
+                    auto error = std::error_code {};
+                    if (std::system(command.c_str()) != 0) {
+                        std::filesystem::remove(temporaryBinaryPath, error);
+                        std::filesystem::remove(temporaryDepfile, error);
+                        VK_LOG_WARNING("failed to rebuild shader `{}`, keeping the previous module", name);
+                        return;
+                    }
+
+                    // Without its depfile the module only misses its includes, so just the
+                    // module's rename is worth a warning.
+                    std::filesystem::rename(temporaryDepfile, depfile, error);
+                    std::filesystem::rename(temporaryBinaryPath, binaryPath, error);
+                    if (error) {
+                        VK_LOG_WARNING("failed to replace shader `{}`: {}", name, error.message());
+                    }
+                }, {}, vk_jobs::JobPriority::Background);
+            }
+
+            // A module that fails to load keeps the previous one in place, since a half saved
+            // file is common while editing.
+            void reload(const std::string& name, Shader& shader) {
+                auto code = std::vector<uint32_t> {};
+                auto shaderModule = VkShaderModule {};
+                try {
+                    code = this->readCode(shader.binaryPath);
+                    shaderModule = this->createShaderModule(code, shader.binaryPath);
+                } catch (const std::exception& exception) {
+                    VK_LOG_WARNING("failed to reload shader `{}`: {}", name, exception.what());
+                    return;
+                }
+
+                // The includes may have changed along with the source.
+                auto sources = this->readSources(shader);
+                auto sourceTimes = this->lastWriteTimes(sources);
+                {
+                    const auto lock = std::scoped_lock { m_mutex };
+                    m_codeHashes.emplace(shaderModule, hashCode(code));
+                    m_retiredModules.push_back(shader.shaderModule);
+                    shader.code = std::move(code);
+                    shader.shaderModule = shaderModule;
+                    shader.sources = std::move(sources);
+                    shader.sourceTimes = std::move(sourceTimes);
+                }
+
+                for (const auto& callback : shader.callbacks) {
+                    callback(shaderModule);
+                }
+
+                VK_LOG_INFO("Reloaded shader `{}`", name);
+            }
+    };
+}
@@ -0,0 +1,308 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <stdexcept>
+
+#include "vk_compute.h"
+#include "vk_descriptors.h"
+#include "vk_pipelines.h"
+#include "vk_render_graph.h"
+#include "vk_shaders.h"
+
+
+namespace vk_shading_rate {
+    // The format of the shading rate attachment, one rate per texel in the encoding of
+    // `VK_KHR_fragment_shading_rate`.
+    constexpr VkFormat ATTACHMENT_FORMAT = VK_FORMAT_R8_UINT;
+
+    // The texel size the attachment asks for, clamped to what the device supports. Finer
+    // texels follow the foveation more closely, at no gain the eye would notice.
+    constexpr uint32_t PREFERRED_TEXEL_SIZE = 16;
+
+    // The specialization constant ids of `local_size_x` and `local_size_y` in `shading_rate.comp`.
+    constexpr uint32_t WORKGROUP_WIDTH_ID = 0;
+    constexpr uint32_t WORKGROUP_HEIGHT_ID = 1;
+
+    // How the scene's fragments are shaded. A coarse rate shades every draw at one rate per
+    // 2x2 pixels, and a foveated one at full rate around the focus and coarser further out,
+    // from an attachment a compute pass fills every frame.
+    enum class Mode : uint32_t {
+        Off,
+        Coarse,
+        Foveated,
+    };
+
+    inline const char* modeToString(Mode mode) {
+        switch (mode) {
+            case Mode::Off: return "off";
+            case Mode::Coarse: return "coarse";
+            case Mode::Foveated: return "foveated";
+        }
+
+        return "unknown";
+    }
+
+    // The rate a draw sets with `vkCmdSetFragmentShadingRateKHR`, and whether it is drawn with
+    // a shading rate attachment, which its pipelines have to be created for.
+    struct DrawShadingRate {
+        VkExtent2D fragmentSize { 1, 1 };
+        std::array<VkFragmentShadingRateCombinerOpKHR, 2> combinerOps {
+            VK_FRAGMENT_SHADING_RATE_COMBINER_OP_KEEP_KHR,
+            VK_FRAGMENT_SHADING_RATE_COMBINER_OP_KEEP_KHR,
+        };
+        bool attachment = false;
+    };
+
+    // 1x1, 1x2, 2x1 and 2x2 are supported by every device with pipeline shading rates. The
+    // foveated rate replaces the draw's with the attachment's.
+    inline DrawShadingRate drawShadingRate(Mode mode) {
+        switch (mode) {
+            case Mode::Off:
+                return DrawShadingRate {};
+            case Mode::Coarse:
+                return DrawShadingRate { .fragmentSize = VkExtent2D { 2, 2 } };
+            case Mode::Foveated:
+                return DrawShadingRate {
+                    .combinerOps = {
+                        VK_FRAGMENT_SHADING_RATE_COMBINER_OP_KEEP_KHR,
+                        VK_FRAGMENT_SHADING_RATE_COMBINER_OP_REPLACE_KHR,
+                    },
+                    .attachment = true,
+                };
+        }
+
+        return DrawShadingRate {};
+    }
+
+    inline void setDrawShadingRate(VkCommandBuffer commandBuffer, const DrawShadingRate& rate) {
+        vkCmdSetFragmentShadingRateKHR(commandBuffer, &rate.fragmentSize, rate.combinerOps.data());
+    }
+
+    // The texel size of the device's shading rate attachments, or none when the attachment
+    // format cannot be written by compute shaders and read as an attachment.
+    inline std::optional<VkExtent2D> attachmentTexelSize(VkPhysicalDevice physicalDevice) {
+        auto formatProperties = VkFormatProperties {};
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, ATTACHMENT_FORMAT, &formatProperties);
+        const auto required = VkFormatFeatureFlags { VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT | VK_FORMAT_FEATURE_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR };
+        if ((formatProperties.optimalTilingFeatures & required) != required) {
+            return std::nullopt;
+        }
+
+        auto shadingRateProperties = VkPhysicalDeviceFragmentShadingRatePropertiesKHR {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_SHADING_RATE_PROPERTIES_KHR,
+        };
+        auto properties = VkPhysicalDeviceProperties2 {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+            .pNext = &shadingRateProperties,
+        };
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+        // Texel sizes are powers of two, so clamping keeps them one.
+        const auto& minSize = shadingRateProperties.minFragmentShadingRateAttachmentTexelSize;
+        const auto& maxSize = shadingRateProperties.maxFragmentShadingRateAttachmentTexelSize;
+
+        return VkExtent2D {
+            std::clamp(PREFERRED_TEXEL_SIZE, minSize.width, maxSize.width),
+            std::clamp(PREFERRED_TEXEL_SIZE, minSize.height, maxSize.height),
+        };
+    }
+
+    // Where the eye rests and how far out the rate coarsens, as fractions of half the render
+    // area's shorter side. Within `innerRadius` of the focus, fragments are shaded at full
+    // rate, out to `outerRadius` at one rate per two pixels across, and beyond at one per 2x2.
+    struct FoveationSettings {
+        float focusX = 0.5f;
+        float focusY = 0.5f;
+        float innerRadius = 0.6f;
+        float outerRadius = 1.0f;
+    };
+
+    // Fills a shading rate attachment for every window's main pass with a foveation pattern
+    // around the settings' focus, in a compute pass of each frame's render graph. The
+    // attachment is a transient of the graph, sized to the render area in texels.
+    class FoveatedShadingRate {
+        public:
+            explicit FoveatedShadingRate() = default;
+
+            FoveatedShadingRate(const FoveatedShadingRate& other) = delete;
+            FoveatedShadingRate& operator=(const FoveatedShadingRate& other) = delete;
+
+            void init(
+                VkDevice device,
+                vk_descriptors::DescriptorLayoutCache& layoutCache,
+                vk_descriptors::FrameDescriptorAllocator& frameDescriptors,
+                vk_shaders::ShaderLibrary& shaderLibrary,
+                vk_pipelines::PipelineRegistry& pipelineRegistry,
+                const vk_compute::ComputeTuning& computeTuning,
+                const VkAllocationCallbacks* allocator,
+                VkExtent2D texelSize,
+                const FoveationSettings& settings
+            ) {
+                m_device = device;
+                m_allocator = allocator;
+                m_frameDescriptors = &frameDescriptors;
+                m_tile = computeTuning.tile;
+                m_texelSize = texelSize;
+                m_settings = settings;
+
+                const auto binding = VkDescriptorSetLayoutBinding {
+                    .binding = 0,
+                    .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                    .descriptorCount = 1,
+                    .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                };
+                m_setLayout = layoutCache.layout(std::span { &binding, 1 });
+
+                const auto pushConstantRange = VkPushConstantRange {
+                    .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                    .offset = 0,
+                    .size = sizeof(PushConstants),
+                };
+                const auto layoutInfo = VkPipelineLayoutCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+                    .setLayoutCount = 1,
+                    .pSetLayouts = &m_setLayout,
+                    .pushConstantRangeCount = 1,
+                    .pPushConstantRanges = &pushConstantRange,
+                };
+
+                const auto result = vkCreatePipelineLayout(m_device, &layoutInfo, m_allocator, &m_pipelineLayout);
+                if (result != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create shading rate pipeline layout!");
+                }
+
+                auto constants = vk_pipelines::SpecializationConstants {};
+                constants
+                    .set(WORKGROUP_WIDTH_ID, m_tile)
+                    .set(WORKGROUP_HEIGHT_ID, m_tile);
+                const auto pipelineInfo = VkComputePipelineCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+                    .stage = VkPipelineShaderStageCreateInfo {
+                        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                        .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                        .module = shaderLibrary.shaderModule("shading_rate.comp"),
+                        .pName = "main",
+                        .pSpecializationInfo = constants.info(),
+                    },
+                    .layout = m_pipelineLayout,
+                };
+                m_pipeline = pipelineRegistry.computePipeline(pipelineInfo);
+            }
+
+            // The pipeline belongs to the registry, and the set layout to the layout cache.
+            void destroy() {
+                if (m_device == VK_NULL_HANDLE) {
+                    return;
+                }
+
+                vkDestroyPipelineLayout(m_device, m_pipelineLayout, m_allocator);
+                m_pipelineLayout = VK_NULL_HANDLE;
+                m_pipeline = VK_NULL_HANDLE;
+                m_device = VK_NULL_HANDLE;
+            }
+
+            bool isInitialized() const {
+                return m_device != VK_NULL_HANDLE;
+            }
+
+            VkExtent2D texelSize() const {
+                return m_texelSize;
+            }
+
+            // Adds the pass filling the attachment for a main pass rendering `renderExtent` of a
+            // `targetSize` target, and returns the attachment. It is sized to the target, so it
+            // keeps its memory while the render area follows the dynamic resolution.
+            vk_render_graph::ResourceId addPass(vk_render_graph::RenderGraph& graph, VkExtent2D targetSize, VkExtent2D renderExtent) const {
+                const auto extent = this->attachmentExtent(renderExtent);
+                const auto rates = graph.createImage(vk_render_graph::TransientImageInfo {
+                    .format = ATTACHMENT_FORMAT,
+                    .extent = this->attachmentExtent(targetSize),
+                    .usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR,
+                });
+                graph.addPass(
+                    "shadingRate",
+                    {
+                        vk_render_graph::write(rates, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL),
+                    },
+                    [this, &graph, rates, extent, renderExtent](VkCommandBuffer commandBuffer) {
+                        this->record(commandBuffer, graph.imageView(rates), extent, renderExtent);
+                    }
+                );
+
+                return rates;
+            }
+
+            // How the main pass reads the attachment.
+            static vk_render_graph::ResourceAccess attachmentAccess(vk_render_graph::ResourceId rates) {
+                return vk_render_graph::read(
+                    rates,
+                    VK_PIPELINE_STAGE_2_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR,
+                    VK_ACCESS_2_FRAGMENT_SHADING_RATE_ATTACHMENT_READ_BIT_KHR,
+                    VK_IMAGE_LAYOUT_FRAGMENT_SHADING_RATE_ATTACHMENT_OPTIMAL_KHR
+                );
+            }
+        private:
+            // Matches `shading_rate.comp`. The focus and radii are in pixels.
+            struct PushConstants {
+                uint32_t size[2];
+                uint32_t texelSize[2];
+                float focus[2];
+                float radii[2];
+            };
+
+            VkDevice m_device = VK_NULL_HANDLE;
+            const VkAllocationCallbacks* m_allocator = nullptr;
+            vk_descriptors::FrameDescriptorAllocator* m_frameDescriptors = nullptr;
+            VkDescriptorSetLayout m_setLayout = VK_NULL_HANDLE;
+            VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+            VkPipeline m_pipeline = VK_NULL_HANDLE;
+            uint32_t m_tile = 8;
+            VkExtent2D m_texelSize { PREFERRED_TEXEL_SIZE, PREFERRED_TEXEL_SIZE };
+            FoveationSettings m_settings {};
+
+            VkExtent2D attachmentExtent(VkExtent2D renderExtent) const {
+                return VkExtent2D {
+                    std::max((renderExtent.width + m_texelSize.width - 1) / m_texelSize.width, 1u),
+                    std::max((renderExtent.height + m_texelSize.height - 1) / m_texelSize.height, 1u),
+                };
+            }
+
+            void record(VkCommandBuffer commandBuffer, VkImageView ratesView, VkExtent2D extent, VkExtent2D renderExtent) const {
+                const auto set = m_frameDescriptors->allocate(m_setLayout);
+                const auto imageInfo = VkDescriptorImageInfo { VK_NULL_HANDLE, ratesView, VK_IMAGE_LAYOUT_GENERAL };
+                const auto write = VkWriteDescriptorSet {
+                    .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                    .dstSet = set,
+                    .dstBinding = 0,
+                    .descriptorCount = 1,
+                    .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                    .pImageInfo = &imageInfo,
+                };
+                vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
+
+                // Distances are measured in pixels, so the foveation stays round whatever the
+                // shape of the texels.
+                const auto halfSide = 0.5f * static_cast<float>(std::min(renderExtent.width, renderExtent.height));
+                const auto pushConstants = PushConstants {
+                    .size = { extent.width, extent.height },
+                    .texelSize = { m_texelSize.width, m_texelSize.height },
+                    .focus = {
+                        m_settings.focusX * static_cast<float>(renderExtent.width),
+                        m_settings.focusY * static_cast<float>(renderExtent.height),
+                    },
+                    .radii = { m_settings.innerRadius * halfSide, m_settings.outerRadius * halfSide },
+                };
+
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+                vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &set, 0, nullptr);
+                vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+                vkCmdDispatch(commandBuffer, (extent.width + m_tile - 1) / m_tile, (extent.height + m_tile - 1) / m_tile, 1);
+            }
+    };
+}
@@ -0,0 +1,179 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+
+namespace vk_shadows {
+    // Matches `SHADOW_CASCADE_COUNT` in `scene.glsl`.
+    constexpr uint32_t CASCADE_COUNT = 4;
+
+    // The cascades from this one on cover so much of the scene that the camera moving a
+    // little changes nothing they hold, so they are kept from frame to frame.
+    constexpr uint32_t FIRST_CACHED_CASCADE = 2;
+
+    // Every cascade is a layer of a square map this many texels a side. Sixteen bits of depth
+    // are enough for an orthographic projection, whose depth is linear, and every device can
+    // render and sample them.
+    constexpr uint32_t MAP_SIZE = 2048;
+    constexpr VkFormat MAP_FORMAT = VK_FORMAT_D16_UNORM;
+
+    // How far the split depths lean towards logarithmic from linear.
+    constexpr float SPLIT_LAMBDA = 0.75f;
+
+    // The share of its radius a cached cascade is grown by, and so how far the center of the
+    // slice it covers may move before it has to be rendered again.
+    constexpr float CACHE_MARGIN = 0.1f;
+
+    struct Cascade {
+        glm::mat4 viewProjection { 1.0f };
+        // The view depth the cascade covers up to, from where the one before it ends.
+        float splitDepth = 0.0f;
+        // Half the side of the square the cascade covers, in world units.
+        float radius = 0.0f;
+    };
+
+    // The view depths between `nearDepth` and `farDepth` the cascades end at: logarithmic
+    // splits keep the texels on screen about the same size, and linear ones keep the first
+    // cascade from ending right in front of the camera.
+    inline std::array<float, CASCADE_COUNT> splitDepths(float nearDepth, float farDepth) {
+        auto splits = std::array<float, CASCADE_COUNT> {};
+        for (uint32_t i = 0; i < CASCADE_COUNT; i++) {
+            const auto fraction = static_cast<float>(i + 1) / static_cast<float>(CASCADE_COUNT);
+            const auto logarithmic = nearDepth * std::pow(farDepth / nearDepth, fraction);
+            const auto linear = nearDepth + (farDepth - nearDepth) * fraction;
+            splits[i] = SPLIT_LAMBDA * logarithmic + (1.0f - SPLIT_LAMBDA) * linear;
+        }
+
+        return splits;
+    }
+
+    // Fits a cascade to every slice of a camera's view frustum and tells which cascades have to
+    // be rendered again.
+    //
+    // A cascade is the smallest sphere around its slice, whose radius only depends on the
+    // slice's depths and the field of view, so it does not change as the camera turns and the
+    // size of the cascade's texels stays the same. The near cascades move with the camera in
+    // steps of whole texels, so their shadows do not shimmer, and are rendered every frame.
+    // The cached cascades are grown by `CACHE_MARGIN` and stay where they were rendered until
+    // their slice has moved out of the margin: with static casters, what they hold is still
+    // right, and rendering them again is only needed when the view leaves them.
+    class ShadowCascades {
+        public:
+            explicit ShadowCascades() = default;
+
+            ShadowCascades(const ShadowCascades& other) = delete;
+            ShadowCascades& operator=(const ShadowCascades& other) = delete;
+
+            // `lightDirection` points towards the light, and every caster lies within
+            // `sceneRadius` of the origin, which the cascades reach back to.
+            void init(glm::vec3 lightDirection, float sceneRadius) {
+                m_lightDirection = glm::normalize(lightDirection);
+                m_sceneRadius = sceneRadius;
+                const auto up = std::abs(m_lightDirection.y) > 0.99f ? glm::vec3 { 1.0f, 0.0f, 0.0f } : glm::vec3 { 0.0f, 1.0f, 0.0f };
+                m_lightView = glm::lookAtRH(glm::vec3 { 0.0f }, -m_lightDirection, up);
+                m_cascades = {};
+                this->invalidate();
+            }
+
+            // The casters changed, so the cached cascades have to be rendered again.
+            void invalidate() {
+                m_cachedCenters = {};
+            }
+
+            glm::vec3 lightDirection() const {
+                return m_lightDirection;
+            }
+
+            const std::array<Cascade, CASCADE_COUNT>& cascades() const {
+                return m_cascades;
+            }
+
+            // Fits the cascades to a camera's `view`, whose projection scales x and y by
+            // `projectionX` and `projectionY`, between `nearDepth` and `shadowDistance`, past
+            // which nothing is shadowed. Returns a bit per cascade that has to be rendered.
+            uint32_t update(const glm::mat4& view, float projectionX, float projectionY, float nearDepth, float shadowDistance) {
+                const auto cameraToWorld = glm::inverse(view);
+                const auto eye = glm::vec3 { cameraToWorld[3] };
+                const auto forward = -glm::normalize(glm::vec3 { cameraToWorld[2] });
+                // The squared tangent of the angle from the view axis to a corner of the frustum.
+                const auto cornerSlope = 1.0f / (projectionX * projectionX) + 1.0f / (projectionY * projectionY);
+                const auto splits = vk_shadows::splitDepths(nearDepth, shadowDistance);
+
+                auto dirty = uint32_t { 0 };
+                auto sliceNear = nearDepth;
+                for (uint32_t i = 0; i < CASCADE_COUNT; i++) {
+                    const auto sliceFar = splits[i];
+                    // The center on the view axis that is as far from the near corners as from
+                    // the far ones, or the far plane's center for a slice too wide for one.
+                    const auto centerDepth = std::min(0.5f * (sliceNear + sliceFar) * (1.0f + cornerSlope), sliceFar);
+                    const auto farOffset = sliceFar - centerDepth;
+                    // Rounded up, so the radius is the same from frame to frame to the bit.
+                    const auto sliceRadius = std::ceil(std::sqrt(farOffset * farOffset + sliceFar * sliceFar * cornerSlope) * 16.0f) / 16.0f;
+                    const auto center = eye + forward * centerDepth;
+                    sliceNear = sliceFar;
+
+                    auto& cascade = m_cascades[i];
+                    cascade.splitDepth = sliceFar;
+                    if (i < FIRST_CACHED_CASCADE) {
+                        cascade.radius = sliceRadius;
+                        cascade.viewProjection = this->fit(center, sliceRadius, true);
+                        dirty |= 1u << i;
+                        continue;
+                    }
+
+                    const auto margin = CACHE_MARGIN * sliceRadius;
+                    auto& cachedCenter = m_cachedCenters[i];
+                    if (cachedCenter.has_value() && glm::length(center - cachedCenter.value()) <= margin) {
+                        continue;
+                    }
+
+                    cachedCenter = center;
+                    cascade.radius = sliceRadius + margin;
+                    cascade.viewProjection = this->fit(center, cascade.radius, false);
+                    dirty |= 1u << i;
+                }
+
+                return dirty;
+            }
+        private:
+            glm::vec3 m_lightDirection { 0.0f, 1.0f, 0.0f };
+            float m_sceneRadius = 0.0f;
+            glm::mat4 m_lightView { 1.0f };
+            std::array<Cascade, CASCADE_COUNT> m_cascades {};
+            std::array<std::optional<glm::vec3>, CASCADE_COUNT> m_cachedCenters {};
+
+            // An orthographic projection along the light around the sphere at `center`, which
+            // reaches back towards the light far enough for every caster of the scene. The map
+            // is sampled with the same matrix it is rendered with, so it needs no flip in y.
+            glm::mat4 fit(glm::vec3 center, float radius, bool snapToTexels) const {
+                auto lightCenter = glm::vec3 { m_lightView * glm::vec4 { center, 1.0f } };
+                if (snapToTexels) {
+                    const auto texelSize = 2.0f * radius / static_cast<float>(MAP_SIZE);
+                    lightCenter.x = std::floor(lightCenter.x / texelSize) * texelSize;
+                    lightCenter.y = std::floor(lightCenter.y / texelSize) * texelSize;
+                }
+
+                const auto nearDepth = std::min(-lightCenter.z - radius, -m_sceneRadius);
+                const auto farDepth = -lightCenter.z + radius;
+                const auto projection = glm::orthoRH_ZO(
+                    lightCenter.x - radius,
+                    lightCenter.x + radius,
+                    lightCenter.y - radius,
+                    lightCenter.y + radius,
+                    nearDepth,
+                    farDepth
+                );
+
+                return projection * m_lightView;
+            }
+    };
+}
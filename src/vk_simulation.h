@@ -0,0 +1,81 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+
+namespace vk_simulation {
+    using Clock = std::chrono::steady_clock;
+
+    constexpr double DEFAULT_TICK_RATE = 60.0;
+    // A frame that took longer than this many ticks drops the time past them instead of
+    // catching up, so a slow frame never makes the next one slower.
+    constexpr uint32_t MAX_TICKS_PER_FRAME = 4;
+
+    // The ticks a frame runs, and how far past the last of them the frame is, as a fraction of
+    // a tick, which the renderer interpolates the last two ticks' states by.
+    struct FrameTicks {
+        uint32_t count = 0;
+        float alpha = 0.0f;
+    };
+
+    // Runs the simulation at a fixed rate, however fast frames are rendered: each frame gets
+    // the ticks whose time has come since the last, so a fast display renders several frames
+    // between two ticks and a slow one runs several ticks a frame, up to
+    // `MAX_TICKS_PER_FRAME`.
+    class FixedTimestep {
+        public:
+            explicit FixedTimestep() = default;
+
+            FixedTimestep(const FixedTimestep& other) = delete;
+            FixedTimestep& operator=(const FixedTimestep& other) = delete;
+
+            void init(double tickRate) {
+                m_tick = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double> { 1.0 / tickRate });
+                this->reset();
+            }
+
+            double tickSeconds() const {
+                return std::chrono::duration<double> { m_tick }.count();
+            }
+
+            // The first frame runs a tick to have a state to render, and every frame after it
+            // the ticks due by `now`.
+            FrameTicks advance(Clock::time_point now) {
+                if (!m_lastFrame.has_value()) {
+                    m_lastFrame = now;
+                    m_accumulated = Clock::duration::zero();
+
+                    return FrameTicks { .count = 1, .alpha = 0.0f };
+                }
+
+                m_accumulated += now - m_lastFrame.value();
+                m_lastFrame = now;
+                auto count = static_cast<uint32_t>(std::min<Clock::rep>(m_accumulated / m_tick, MAX_TICKS_PER_FRAME + 1));
+                if (count > MAX_TICKS_PER_FRAME) {
+                    count = MAX_TICKS_PER_FRAME;
+                    m_accumulated %= m_tick;
+                } else {
+                    m_accumulated -= count * m_tick;
+                }
+
+                return FrameTicks {
+                    .count = count,
+                    .alpha = static_cast<float>(std::chrono::duration<double> { m_accumulated } / std::chrono::duration<double> { m_tick }),
+                };
+            }
+
+            // Forgets the time since the last frame, after rendering was suspended, so the
+            // simulation picks up where it stopped.
+            void reset() {
+                m_lastFrame.reset();
+                m_accumulated = Clock::duration::zero();
+            }
+        private:
+            Clock::duration m_tick = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double> { 1.0 / DEFAULT_TICK_RATE });
+            std::optional<Clock::time_point> m_lastFrame;
+            Clock::duration m_accumulated = Clock::duration::zero();
+    };
+}
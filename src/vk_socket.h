@@ -0,0 +1,281 @@
+#pragma once
+
+// Pulls in `windows.h` on Windows, with the same macros as everywhere else, which leave out
+// the old `winsock.h`.
+#include "vk_dispatch.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fmt/core.h>
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <afunix.h>
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+
+namespace vk_socket {
+    #if defined(_WIN32)
+    using Socket = SOCKET;
+    constexpr Socket INVALID_SOCKET_HANDLE = INVALID_SOCKET;
+    #else
+    using Socket = int;
+    constexpr Socket INVALID_SOCKET_HANDLE = -1;
+    #endif
+
+    // An IPv4 address and a port to listen on.
+    struct Endpoint {
+        std::string address;
+        uint16_t port = 0;
+    };
+
+    // `<address>:<port>`, like `127.0.0.1:9464`, or only the port, on `defaultAddress`.
+    inline std::optional<Endpoint> parseEndpoint(std::string_view text, std::string_view defaultAddress) {
+        auto endpoint = Endpoint { .address = std::string { defaultAddress } };
+        const auto separator = text.rfind(':');
+        if (separator != std::string_view::npos) {
+            endpoint.address = text.substr(0, separator);
+            text = text.substr(separator + 1);
+        }
+
+        auto port = uint32_t { 0 };
+        for (const char c : text) {
+            if (c < '0' || c > '9') {
+                return std::nullopt;
+            }
+
+            port = port * 10 + static_cast<uint32_t>(c - '0');
+            if (port > 65535) {
+                return std::nullopt;
+            }
+        }
+
+        auto address = in_addr {};
+        if (text.empty() || port == 0 || inet_pton(AF_INET, endpoint.address.c_str(), &address) != 1) {
+            return std::nullopt;
+        }
+
+        endpoint.port = static_cast<uint16_t>(port);
+
+        return endpoint;
+    }
+
+    inline void closeSocket(Socket socket) {
+        #if defined(_WIN32)
+        closesocket(socket);
+        #else
+        close(socket);
+        #endif
+    }
+
+    inline bool waitReadable(Socket socket, std::chrono::milliseconds timeout) {
+        auto descriptor = pollfd { .fd = socket, .events = POLLIN, .revents = 0 };
+        #if defined(_WIN32)
+        return WSAPoll(&descriptor, 1, static_cast<int>(timeout.count())) > 0;
+        #else
+        return poll(&descriptor, 1, static_cast<int>(timeout.count())) > 0;
+        #endif
+    }
+
+    // Whatever has arrived, up to `size` bytes, and zero once the peer has closed the
+    // connection or it failed.
+    inline size_t receive(Socket socket, char* data, size_t size) {
+        const auto count = recv(socket, data, static_cast<int>(size), 0);
+
+        return count > 0 ? static_cast<size_t>(count) : 0;
+    }
+
+    // A peer that went away only fails the send, and never raises `SIGPIPE`.
+    inline bool sendAll(Socket socket, std::string_view data) {
+        #if defined(MSG_NOSIGNAL)
+        constexpr int flags = MSG_NOSIGNAL;
+        #else
+        constexpr int flags = 0;
+        #endif
+        while (!data.empty()) {
+            const auto count = send(socket, data.data(), static_cast<int>(data.size()), flags);
+            if (count <= 0) {
+                return false;
+            }
+
+            data.remove_prefix(static_cast<size_t>(count));
+        }
+
+        return true;
+    }
+
+    // Sends fail instead of blocking from then on, for peers that must never hold up the
+    // sender.
+    inline void setNonBlocking(Socket socket) {
+        #if defined(_WIN32)
+        auto nonBlocking = u_long { 1 };
+        ioctlsocket(socket, FIONBIO, &nonBlocking);
+        #else
+        fcntl(socket, F_SETFL, fcntl(socket, F_GETFL) | O_NONBLOCK);
+        #endif
+    }
+
+    #if !defined(_WIN32)
+    // Sends `data` along with `descriptors`, which the peer of a local socket receives as
+    // descriptors of its own, while the sender keeps its own.
+    inline bool sendWithDescriptors(Socket socket, std::string_view data, std::span<const int> descriptors) {
+        auto control = std::vector<char>(CMSG_SPACE(descriptors.size_bytes()), 0);
+        auto vector = iovec { .iov_base = const_cast<char*>(data.data()), .iov_len = data.size() };
+        auto message = msghdr {};
+        message.msg_iov = &vector;
+        message.msg_iovlen = 1;
+        message.msg_control = control.data();
+        message.msg_controllen = control.size();
+
+        auto* header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(descriptors.size_bytes());
+        std::memcpy(CMSG_DATA(header), descriptors.data(), descriptors.size_bytes());
+
+        const auto count = sendmsg(socket, &message, MSG_NOSIGNAL);
+        if (count <= 0) {
+            return false;
+        }
+
+        // The descriptors went out with the first byte, the rest is plain data.
+        return sendAll(socket, data.substr(static_cast<size_t>(count)));
+    }
+    #endif
+
+    // A TCP or local socket listening for connections, which also holds Winsock on Windows
+    // while it is open. `what` names the listener in its errors, like "metrics scrapes".
+    class Listener {
+        public:
+            explicit Listener() = default;
+
+            Listener(const Listener& other) = delete;
+            Listener& operator=(const Listener& other) = delete;
+
+            ~Listener() {
+                this->close();
+            }
+
+            void listen(const Endpoint& endpoint, const char* what) {
+                this->startWinsock(what);
+                m_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+                if (m_socket == INVALID_SOCKET_HANDLE) {
+                    this->close();
+                    throw std::runtime_error(fmt::format("failed to create a socket to listen for {}!", what));
+                }
+
+                const int reuseAddress = 1;
+                setsockopt(m_socket, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuseAddress), sizeof(reuseAddress));
+
+                auto address = sockaddr_in {};
+                address.sin_family = AF_INET;
+                address.sin_port = htons(endpoint.port);
+                inet_pton(AF_INET, endpoint.address.c_str(), &address.sin_addr);
+                if (bind(m_socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || ::listen(m_socket, SOMAXCONN) != 0) {
+                    this->close();
+                    throw std::runtime_error(fmt::format("failed to listen for {} on {}:{}!", what, endpoint.address, endpoint.port));
+                }
+            }
+
+            // A local stream socket at `path`, for processes on the same machine, which
+            // replaces whatever a previous run left there and is removed again on close.
+            void listen(const std::filesystem::path& path, const char* what) {
+                const auto pathText = path.string();
+                auto address = sockaddr_un {};
+                if (pathText.empty() || pathText.size() >= sizeof(address.sun_path)) {
+                    throw std::runtime_error(fmt::format("failed to listen for {}, the socket path `{}` is too long!", what, pathText));
+                }
+
+                this->startWinsock(what);
+                m_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+                if (m_socket == INVALID_SOCKET_HANDLE) {
+                    this->close();
+                    throw std::runtime_error(fmt::format("failed to create a socket to listen for {}!", what));
+                }
+
+                address.sun_family = AF_UNIX;
+                std::memcpy(address.sun_path, pathText.data(), pathText.size());
+                auto error = std::error_code {};
+                std::filesystem::remove(path, error);
+                if (bind(m_socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || ::listen(m_socket, SOMAXCONN) != 0) {
+                    this->close();
+                    throw std::runtime_error(fmt::format("failed to listen for {} at `{}`!", what, pathText));
+                }
+
+                m_localPath = path;
+            }
+
+            void close() {
+                if (m_socket != INVALID_SOCKET_HANDLE) {
+                    closeSocket(m_socket);
+                    m_socket = INVALID_SOCKET_HANDLE;
+                }
+
+                if (!m_localPath.empty()) {
+                    auto error = std::error_code {};
+                    std::filesystem::remove(m_localPath, error);
+                    m_localPath.clear();
+                }
+
+                #if defined(_WIN32)
+                if (m_winsockStarted) {
+                    WSACleanup();
+                    m_winsockStarted = false;
+                }
+                #endif
+            }
+
+            bool isOpen() const {
+                return m_socket != INVALID_SOCKET_HANDLE;
+            }
+
+            // The next connection, or nothing when none came within `timeout`, so the caller
+            // gets to check whether to stop in between.
+            std::optional<Socket> accept(std::chrono::milliseconds timeout) {
+                if (!waitReadable(m_socket, timeout)) {
+                    return std::nullopt;
+                }
+
+                const auto client = ::accept(m_socket, nullptr, nullptr);
+                if (client == INVALID_SOCKET_HANDLE) {
+                    return std::nullopt;
+                }
+
+                return client;
+            }
+        private:
+            Socket m_socket = INVALID_SOCKET_HANDLE;
+            std::filesystem::path m_localPath;
+            #if defined(_WIN32)
+            bool m_winsockStarted = false;
+            #endif
+
+            void startWinsock([[maybe_unused]] const char* what) {
+                #if defined(_WIN32)
+                auto data = WSADATA {};
+                if (WSAStartup(MAKEWORD(2, 2), &data) != 0) {
+                    throw std::runtime_error(fmt::format("failed to initialize Winsock to listen for {}!", what));
+                }
+                m_winsockStarted = true;
+                #endif
+            }
+    };
+}
@@ -0,0 +1,541 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "vk_descriptors.h"
+#include "vk_handles.h"
+#include "vk_memory.h"
+#include "vk_pipelines.h"
+#include "vk_render_graph.h"
+#include "vk_shaders.h"
+#include "vk_upload.h"
+
+
+namespace vk_sprites {
+    // Matches `SOLID` in `sprite.glsl`. A sprite of this texture is filled with its color.
+    constexpr uint32_t SOLID = 0xffffffff;
+
+    // Matches `DISTANCE_FIELD` in `sprite.glsl`. Set on a texture's slot, its red channel is a
+    // distance field, with edges at one half, and sprites of it are their color with coverage
+    // antialiased over a pixel at any scale.
+    constexpr uint32_t DISTANCE_FIELD = 0x80000000;
+
+    // Sprite corners are whole pixels and texels of 12 bits each, so sprites are clipped to
+    // the first 4095 pixels of a target, and textures are addressed up to 4095 texels a side.
+    constexpr uint32_t COORDINATE_BITS = 12;
+    constexpr uint32_t MAX_COORDINATE = (1u << COORDINATE_BITS) - 1;
+
+    // The most sprites a pass draws, which also caps what it takes from the upload arena.
+    constexpr size_t MAX_SPRITES = 262144;
+
+    // Matches the vertex input of `sprite.vert`, one instance each. The corners in pixels, then
+    // in texels, each as `x0, y0, x1, y1`, are eight 12 bit fields packed from the lowest bit
+    // of the first word up, and the color is red in the lowest byte.
+    struct Sprite {
+        std::array<uint32_t, 3> corners;
+        uint32_t color;
+    };
+
+    static_assert(sizeof(Sprite) == 16, "Sprite must match the vertex input layout of the sprite pipeline");
+
+    inline Sprite packSprite(const std::array<uint32_t, 8>& fields, uint32_t color) {
+        auto sprite = Sprite { {}, color };
+        for (uint32_t i = 0; i < fields.size(); i++) {
+            const auto value = uint64_t { std::min(fields[i], MAX_COORDINATE) } << (i * COORDINATE_BITS % 32);
+            const auto word = i * COORDINATE_BITS / 32;
+            sprite.corners[word] |= static_cast<uint32_t>(value);
+            if (value >> 32 != 0) {
+                sprite.corners[word + 1] |= static_cast<uint32_t>(value >> 32);
+            }
+        }
+
+        return sprite;
+    }
+
+    // Icons of `ICON_SIZE` texels a side, side by side in one white texture with the shape in
+    // its alpha, tinted by the sprite's color: a disc, a ring, a rounded square and a diamond.
+    constexpr uint32_t ICON_SIZE = 32;
+    constexpr uint32_t ICON_COUNT = 4;
+
+    // The texel rectangle of icon `index` as `x, y, width, height`.
+    inline glm::vec4 iconRect(uint32_t index) {
+        return glm::vec4 { static_cast<float>(index * ICON_SIZE), 0.0f, static_cast<float>(ICON_SIZE), static_cast<float>(ICON_SIZE) };
+    }
+
+    // RGBA8 texels of the icons, a row at a time.
+    inline std::vector<uint32_t> iconTexels() {
+        auto texels = std::vector<uint32_t>(ICON_COUNT * ICON_SIZE * ICON_SIZE);
+        const auto half = 0.5f * static_cast<float>(ICON_SIZE);
+        for (uint32_t y = 0; y < ICON_SIZE; y++) {
+            for (uint32_t x = 0; x < ICON_SIZE; x++) {
+                const auto p = glm::vec2 { static_cast<float>(x) + 0.5f - half, static_cast<float>(y) + 0.5f - half };
+                const auto inner = glm::max(glm::abs(p) - glm::vec2 { half - 8.0f }, glm::vec2 { 0.0f });
+                // Signed distances in texels to each shape's edge, negative inside.
+                const auto distances = std::array {
+                    glm::length(p) - (half - 2.0f),
+                    std::abs(glm::length(p) - (half - 6.0f)) - 3.0f,
+                    glm::length(inner) - 6.0f,
+                    (std::abs(p.x) + std::abs(p.y) - (half - 2.0f)) * 0.7071f,
+                };
+                for (uint32_t icon = 0; icon < ICON_COUNT; icon++) {
+                    const auto coverage = std::clamp(0.5f - distances[icon], 0.0f, 1.0f);
+                    const auto alpha = static_cast<uint32_t>(std::lround(coverage * 255.0f));
+                    texels[y * ICON_COUNT * ICON_SIZE + icon * ICON_SIZE + x] = 0x00ffffffu | (alpha << 24);
+                }
+            }
+        }
+
+        return texels;
+    }
+
+    // The icons in a sampled image, queued on the upload service. They can be drawn once
+    // `uploadTicket` is complete.
+    struct IconAtlas {
+        vk_handles::Image image;
+        vk_memory::ScopedAllocation memory;
+        vk_handles::ImageView view;
+        std::optional<vk_upload::UploadTicket> uploadTicket;
+    };
+
+    inline IconAtlas createIconAtlas(
+        VkDevice device,
+        const VkAllocationCallbacks* allocator,
+        vk_memory::DeviceMemoryAllocator& memoryAllocator,
+        vk_upload::UploadService& uploadService
+    ) {
+        const auto extent = VkExtent3D { ICON_COUNT * ICON_SIZE, ICON_SIZE, 1 };
+        const auto imageInfo = VkImageCreateInfo {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+            .imageType = VK_IMAGE_TYPE_2D,
+            .format = VK_FORMAT_R8G8B8A8_UNORM,
+            .extent = extent,
+            .mipLevels = 1,
+            .arrayLayers = 1,
+            .samples = VK_SAMPLE_COUNT_1_BIT,
+            .tiling = VK_IMAGE_TILING_OPTIMAL,
+            .usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        };
+
+        auto image = VkImage {};
+        const auto imageResult = vkCreateImage(device, &imageInfo, allocator, &image);
+        if (imageResult != VK_SUCCESS) {
+            throw std::runtime_error("failed to create icon atlas image!");
+        }
+
+        auto atlas = IconAtlas {
+            .image = vk_handles::Image { device, image, allocator },
+            .memory = vk_memory::ScopedAllocation {
+                memoryAllocator,
+                memoryAllocator.allocateForImage(image, vk_memory::AllocationCreateInfo {
+                    .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                    .kind = vk_memory::ResourceKind::Optimal,
+                    .priority = vk_memory::MemoryPriority::Low,
+                }),
+            },
+            .view = vk_handles::ImageView {},
+            .uploadTicket = std::nullopt,
+        };
+
+        const auto viewInfo = VkImageViewCreateInfo {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .image = image,
+            .viewType = VK_IMAGE_VIEW_TYPE_2D,
+            .format = VK_FORMAT_R8G8B8A8_UNORM,
+            .subresourceRange = VkImageSubresourceRange {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .baseMipLevel = 0,
+                .levelCount = 1,
+                .baseArrayLayer = 0,
+                .layerCount = 1,
+            },
+        };
+
+        auto imageView = VkImageView {};
+        const auto viewResult = vkCreateImageView(device, &viewInfo, allocator, &imageView);
+        if (viewResult != VK_SUCCESS) {
+            throw std::runtime_error("failed to create icon atlas image view!");
+        }
+
+        atlas.view = vk_handles::ImageView { device, imageView, allocator };
+
+        const auto texels = iconTexels();
+        const auto uploadInfo = vk_upload::ImageUploadInfo {
+            .image = image,
+            .extent = extent,
+            .finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        };
+        atlas.uploadTicket = uploadService.uploadImage(uploadInfo, texels.data(), texels.size() * sizeof(uint32_t), VK_ACCESS_SHADER_READ_BIT);
+
+        return atlas;
+    }
+
+    // Draws any number of 2D sprites over a target in a handful of instanced draws. Sprites are
+    // added every frame, each with a layer and a texture of the bindless descriptor heap, and
+    // the pass sorts them by layer, then by texture, so every run of one texture within a layer
+    // is a single draw however many sprites it holds. Layers are drawn back to front, and the
+    // order of overlapping sprites of one layer is only kept among sprites of one texture.
+    //
+    // The sprites go through the frame upload arena as instanced vertex data, and the textures
+    // are indexed in the heap with push constants, so a frame binds no descriptor set of its
+    // own.
+    class SpriteBatcher {
+        public:
+            explicit SpriteBatcher() = default;
+
+            SpriteBatcher(const SpriteBatcher& other) = delete;
+            SpriteBatcher& operator=(const SpriteBatcher& other) = delete;
+
+            // The pipelines use the layout of `descriptorHeap`, which has to outlive the batcher,
+            // and the sampler comes from `samplerCache`.
+            void init(
+                VkDevice device,
+                vk_shaders::ShaderLibrary& shaderLibrary,
+                vk_pipelines::PipelineRegistry& pipelineRegistry,
+                vk_descriptors::BindlessDescriptorHeap& descriptorHeap,
+                vk_descriptors::SamplerCache& samplerCache,
+                const VkAllocationCallbacks* allocator
+            ) {
+                m_device = device;
+                m_allocator = allocator;
+                m_shaderLibrary = &shaderLibrary;
+                m_pipelineRegistry = &pipelineRegistry;
+                m_descriptorHeap = &descriptorHeap;
+                m_entries.reserve(MAX_SPRITES);
+
+                const auto samplerInfo = VkSamplerCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+                    .magFilter = VK_FILTER_LINEAR,
+                    .minFilter = VK_FILTER_LINEAR,
+                    .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+                    .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                    .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                    .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                    .maxLod = VK_LOD_CLAMP_NONE,
+                };
+                const auto samplerSlot = m_descriptorHeap->addSampler(samplerCache.sampler(samplerInfo));
+                if (!samplerSlot.has_value()) {
+                    throw std::runtime_error("failed to add the sprite sampler to the descriptor heap!");
+                }
+
+                m_samplerSlot = samplerSlot.value();
+            }
+
+            // The device has to be idle. Textures added to the heap keep their slots.
+            void destroy() {
+                if (m_device == VK_NULL_HANDLE) {
+                    return;
+                }
+
+                m_descriptorHeap->release(vk_descriptors::DescriptorKind::Sampler, m_samplerSlot, 0);
+                m_pipelines.clear();
+                m_device = VK_NULL_HANDLE;
+            }
+
+            bool isInitialized() const {
+                return m_device != VK_NULL_HANDLE;
+            }
+
+            // The heap slot sprites draw `view` with, which has to be in `layout` whenever they
+            // do.
+            std::optional<uint32_t> addTexture(VkImageView view, VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
+                return m_descriptorHeap->addSampledImage(view, layout);
+            }
+
+            // Starts the sprites of a target of `extent`, which they are clipped to.
+            void beginFrame(VkExtent2D extent) {
+                m_entries.clear();
+                m_bounds = glm::vec2 {
+                    static_cast<float>(std::min(extent.width, MAX_COORDINATE)),
+                    static_cast<float>(std::min(extent.height, MAX_COORDINATE)),
+                };
+            }
+
+            // `rect` is the sprite's `x, y, width, height` in pixels, and `textureRect` the same
+            // in texels of `texture`, ignored for `SOLID`. The part of it outside the target is
+            // cut off along with the matching part of its texels.
+            void add(uint16_t layer, uint32_t texture, const glm::vec4& rect, const glm::vec4& textureRect, uint32_t color) {
+                if (m_entries.size() >= MAX_SPRITES || rect.z <= 0.0f || rect.w <= 0.0f) {
+                    return;
+                }
+
+                const auto low = glm::vec2 { rect.x, rect.y };
+                const auto size = glm::vec2 { rect.z, rect.w };
+                const auto clippedLow = glm::clamp(glm::round(low), glm::vec2 { 0.0f }, m_bounds);
+                const auto clippedHigh = glm::clamp(glm::round(low + size), glm::vec2 { 0.0f }, m_bounds);
+                if (clippedLow.x >= clippedHigh.x || clippedLow.y >= clippedHigh.y) {
+                    return;
+                }
+
+                const auto textureLow = glm::vec2 { textureRect.x, textureRect.y };
+                const auto textureSize = glm::vec2 { textureRect.z, textureRect.w };
+                const auto texelLow = glm::round(textureLow + (clippedLow - low) / size * textureSize);
+                const auto texelHigh = glm::round(textureLow + (clippedHigh - low) / size * textureSize);
+                const auto field = [](float value) {
+                    return static_cast<uint32_t>(std::max(value, 0.0f));
+                };
+                const auto sprite = packSprite(
+                    {
+                        field(clippedLow.x), field(clippedLow.y), field(clippedHigh.x), field(clippedHigh.y),
+                        field(texelLow.x), field(texelLow.y), field(texelHigh.x), field(texelHigh.y),
+                    },
+                    color
+                );
+                // Sorted stably, so the order sprites were added in holds within a batch.
+                m_entries.push_back(Entry { uint64_t { layer } << 32 | texture, sprite });
+            }
+
+            // Adds the pass that draws the sprites over `target`, the `format` image of `extent`.
+            // The sprites are copied into `uploadArena` right away, so the pass has to be added
+            // before the arena's copies are recorded.
+            void addPass(
+                vk_render_graph::RenderGraph& graph,
+                vk_render_graph::ResourceId target,
+                VkFormat format,
+                VkExtent2D extent,
+                vk_memory::FrameUploadArena& uploadArena
+            ) {
+                m_batchCount = 0;
+                if (m_entries.empty()) {
+                    return;
+                }
+
+                std::stable_sort(m_entries.begin(), m_entries.end(), [](const Entry& left, const Entry& right) {
+                    return left.key < right.key;
+                });
+
+                const auto size = static_cast<VkDeviceSize>(m_entries.size() * sizeof(Sprite));
+                const auto allocation = uploadArena.allocate(size, alignof(Sprite));
+                if (!allocation.has_value()) {
+                    return;
+                }
+
+                auto batches = std::vector<Batch> {};
+                auto* sprites = static_cast<Sprite*>(allocation->mappedData);
+                for (uint32_t i = 0; i < m_entries.size(); i++) {
+                    sprites[i] = m_entries[i].sprite;
+                    if (i == 0 || m_entries[i].key != m_entries[i - 1].key) {
+                        batches.push_back(Batch { static_cast<uint32_t>(m_entries[i].key), i, 0 });
+                    }
+                    batches.back().spriteCount++;
+                }
+                m_batchCount = static_cast<uint32_t>(batches.size());
+
+                const auto buffer = allocation->buffer;
+                const auto offset = allocation->offset;
+                graph.addPass(
+                    "sprites",
+                    {
+                        vk_render_graph::write(target, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL),
+                    },
+                    [this, &graph, target, format, extent, buffer, offset, batches = std::move(batches)](VkCommandBuffer commandBuffer) {
+                        this->record(commandBuffer, graph.imageView(target), format, extent, buffer, offset, batches);
+                    }
+                );
+            }
+
+            // The draws of the last pass added.
+            uint32_t batchCount() const {
+                return m_batchCount;
+            }
+        private:
+            // Matches `PushConstants` in `sprite.glsl`.
+            struct PushConstants {
+                glm::vec2 extent;
+                uint32_t texture;
+                uint32_t sampler;
+            };
+
+            // The layer in the upper half of `key` and the texture in the lower.
+            struct Entry {
+                uint64_t key;
+                Sprite sprite;
+            };
+
+            struct Batch {
+                uint32_t texture;
+                uint32_t firstSprite;
+                uint32_t spriteCount;
+            };
+
+            VkDevice m_device = VK_NULL_HANDLE;
+            const VkAllocationCallbacks* m_allocator = nullptr;
+            vk_shaders::ShaderLibrary* m_shaderLibrary = nullptr;
+            vk_pipelines::PipelineRegistry* m_pipelineRegistry = nullptr;
+            vk_descriptors::BindlessDescriptorHeap* m_descriptorHeap = nullptr;
+            uint32_t m_samplerSlot = 0;
+            std::vector<std::pair<VkFormat, VkPipeline>> m_pipelines;
+
+            std::vector<Entry> m_entries;
+            glm::vec2 m_bounds { 0.0f };
+            uint32_t m_batchCount = 0;
+
+            void record(
+                VkCommandBuffer commandBuffer,
+                VkImageView targetView,
+                VkFormat format,
+                VkExtent2D extent,
+                VkBuffer buffer,
+                VkDeviceSize offset,
+                const std::vector<Batch>& batches
+            ) {
+                const auto colorAttachment = VkRenderingAttachmentInfo {
+                    .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+                    .imageView = targetView,
+                    .imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                    .loadOp = VK_ATTACHMENT_LOAD_OP_LOAD,
+                    .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+                };
+                const auto renderingInfo = VkRenderingInfo {
+                    .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+                    .renderArea = VkRect2D { VkOffset2D { 0, 0 }, extent },
+                    .layerCount = 1,
+                    .colorAttachmentCount = 1,
+                    .pColorAttachments = &colorAttachment,
+                };
+                const auto viewport = VkViewport {
+                    .x = 0.0f,
+                    .y = 0.0f,
+                    .width = static_cast<float>(extent.width),
+                    .height = static_cast<float>(extent.height),
+                    .minDepth = 0.0f,
+                    .maxDepth = 1.0f,
+                };
+                const auto scissor = VkRect2D {
+                    .offset = VkOffset2D { 0, 0 },
+                    .extent = extent,
+                };
+
+                vkCmdBeginRendering(commandBuffer, &renderingInfo);
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->pipeline(format));
+                vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+                vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+                m_descriptorHeap->bind(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS);
+                vkCmdBindVertexBuffers(commandBuffer, 0, 1, &buffer, &offset);
+                for (const auto& batch : batches) {
+                    const auto pushConstants = PushConstants {
+                        .extent = glm::vec2 { static_cast<float>(extent.width), static_cast<float>(extent.height) },
+                        .texture = batch.texture,
+                        .sampler = m_samplerSlot,
+                    };
+                    vkCmdPushConstants(commandBuffer, m_descriptorHeap->pipelineLayout(), VK_SHADER_STAGE_ALL, 0, sizeof(pushConstants), &pushConstants);
+                    vkCmdDraw(commandBuffer, 6, batch.spriteCount, 0, batch.firstSprite);
+                }
+                vkCmdEndRendering(commandBuffer);
+            }
+
+            // Blended over the target without depth, like the overlay.
+            VkPipeline pipeline(VkFormat colorFormat) {
+                const auto existing = std::find_if(m_pipelines.begin(), m_pipelines.end(), [colorFormat](const auto& entry) {
+                    return entry.first == colorFormat;
+                });
+                if (existing != m_pipelines.end()) {
+                    return existing->second;
+                }
+
+                const auto stage = [this](VkShaderStageFlagBits stage, const char* shaderName) {
+                    return VkPipelineShaderStageCreateInfo {
+                        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                        .stage = stage,
+                        .module = m_shaderLibrary->shaderModule(shaderName),
+                        .pName = "main",
+                    };
+                };
+                const auto stages = std::array {
+                    stage(VK_SHADER_STAGE_VERTEX_BIT, "sprite.vert"),
+                    stage(VK_SHADER_STAGE_FRAGMENT_BIT, "sprite.frag"),
+                };
+                const auto binding = VkVertexInputBindingDescription {
+                    .binding = 0,
+                    .stride = sizeof(Sprite),
+                    .inputRate = VK_VERTEX_INPUT_RATE_INSTANCE,
+                };
+                const auto attribute = VkVertexInputAttributeDescription { 0, 0, VK_FORMAT_R32G32B32A32_UINT, 0 };
+                const auto vertexInputState = VkPipelineVertexInputStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+                    .vertexBindingDescriptionCount = 1,
+                    .pVertexBindingDescriptions = &binding,
+                    .vertexAttributeDescriptionCount = 1,
+                    .pVertexAttributeDescriptions = &attribute,
+                };
+                const auto inputAssemblyState = VkPipelineInputAssemblyStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+                    .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+                };
+                const auto viewportState = VkPipelineViewportStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+                    .viewportCount = 1,
+                    .scissorCount = 1,
+                };
+                const auto rasterizationState = VkPipelineRasterizationStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+                    .polygonMode = VK_POLYGON_MODE_FILL,
+                    .cullMode = VK_CULL_MODE_NONE,
+                    .lineWidth = 1.0f,
+                };
+                const auto multisampleState = VkPipelineMultisampleStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+                    .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+                };
+                const auto colorBlendAttachment = VkPipelineColorBlendAttachmentState {
+                    .blendEnable = VK_TRUE,
+                    .srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA,
+                    .dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+                    .colorBlendOp = VK_BLEND_OP_ADD,
+                    .srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
+                    .dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+                    .alphaBlendOp = VK_BLEND_OP_ADD,
+                    .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+                };
+                const auto colorBlendState = VkPipelineColorBlendStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+                    .attachmentCount = 1,
+                    .pAttachments = &colorBlendAttachment,
+                };
+                const auto dynamicStates = std::array { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+                const auto dynamicState = VkPipelineDynamicStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+                    .dynamicStateCount = static_cast<uint32_t>(dynamicStates.size()),
+                    .pDynamicStates = dynamicStates.data(),
+                };
+                const auto renderingInfo = VkPipelineRenderingCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
+                    .colorAttachmentCount = 1,
+                    .pColorAttachmentFormats = &colorFormat,
+                };
+                const auto pipelineInfo = VkGraphicsPipelineCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+                    .pNext = &renderingInfo,
+                    .flags = m_descriptorHeap->pipelineCreateFlags(),
+                    .stageCount = static_cast<uint32_t>(stages.size()),
+                    .pStages = stages.data(),
+                    .pVertexInputState = &vertexInputState,
+                    .pInputAssemblyState = &inputAssemblyState,
+                    .pViewportState = &viewportState,
+                    .pRasterizationState = &rasterizationState,
+                    .pMultisampleState = &multisampleState,
+                    .pColorBlendState = &colorBlendState,
+                    .pDynamicState = &dynamicState,
+                    .layout = m_descriptorHeap->pipelineLayout(),
+                };
+
+                const auto pipeline = m_pipelineRegistry->graphicsPipeline(pipelineInfo);
+                m_pipelines.emplace_back(colorFormat, pipeline);
+
+                return pipeline;
+            }
+    };
+}
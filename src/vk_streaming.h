@@ -0,0 +1,1077 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <limits>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include "vk_assets.h"
+#include "vk_handles.h"
+#include "vk_memory.h"
+#include "vk_readback.h"
+#include "vk_render_graph.h"
+#include "vk_textures.h"
+#include "vk_upload.h"
+
+
+namespace vk_streaming {
+    // Feedback starts every frame at this value, which requests nothing, and residency reads it
+    // for textures whose mip tail is not in yet. Matches `texture_streaming.glsl`.
+    constexpr uint32_t NO_MIP = std::numeric_limits<uint32_t>::max();
+
+    // Binding memory is a queue operation the driver may take a while over, so a frame binds at
+    // most this many tiles and spreads a burst of requests over the next frames.
+    constexpr size_t MAX_BINDS_PER_FRAME = 64;
+
+    // A streamed texture's view of the feedback and residency arrays, indexed by level 0 tile,
+    // for shaders. Matches `StreamedTexture` in `texture_streaming.glsl`.
+    struct ShaderTextureInfo {
+        uint32_t firstRegion;
+        uint32_t regionsX;
+        uint32_t regionsY;
+        uint32_t tailLevel;
+    };
+
+    // Whether sampled images of `format` can be partially resident, which the sparse residency
+    // features only promise for some formats.
+    inline bool supportsStreaming(VkPhysicalDevice physicalDevice, VkFormat format) {
+        auto formatPropertyCount = uint32_t { 0 };
+        vkGetPhysicalDeviceSparseImageFormatProperties(
+            physicalDevice,
+            format,
+            VK_IMAGE_TYPE_2D,
+            VK_SAMPLE_COUNT_1_BIT,
+            VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+            VK_IMAGE_TILING_OPTIMAL,
+            &formatPropertyCount,
+            nullptr
+        );
+
+        return formatPropertyCount > 0;
+    }
+
+    // Textures too large to keep resident, as partially resident images whose tiles are bound
+    // and uploaded out of the asset pack as shaders ask for them, within a budget of device
+    // memory.
+    //
+    // Shaders sampling a streamed texture go through `sampleStreamed` in
+    // `texture_streaming.glsl`, which records the mip it wanted per tile of level 0, a region,
+    // in a feedback buffer, and clamps the level of detail to the finest mip resident there.
+    // Each frame reads the last frame's feedback back through `vk_readback::ReadbackService`
+    // and starts it over, and `update` picks the bytes up once that frame has finished, so
+    // nothing ever waits for the GPU. Every tile a region asked for, and every coarser one
+    // under it, is then bound and uploaded, coarse first, and once resident shows in the
+    // residency map the next frame reads. Over budget, the tiles no region asked for the
+    // longest are evicted first.
+    //
+    // A tile goes through binding, on the sparse binding queue, then uploading, on the upload
+    // service's transfer queue, each polled for completion, and eviction keeps its memory bound
+    // until the frames that may still sample it have finished. Levels past the start of the mip
+    // tail are bound and uploaded with the texture, and stay resident.
+    //
+    // Streamed images live in `VK_IMAGE_LAYOUT_GENERAL` and are shared concurrently by the
+    // graphics and transfer queue families, so tiles can be written while others are sampled.
+    class TextureStreamer {
+        public:
+            explicit TextureStreamer() = default;
+
+            TextureStreamer(const TextureStreamer& other) = delete;
+            TextureStreamer& operator=(const TextureStreamer& other) = delete;
+
+            // `sparseQueue` must support `VK_QUEUE_SPARSE_BINDING_BIT`, and is only used from the
+            // thread calling `addTexture` and `update`. `queueFamilies` are the families that
+            // use the images, the graphics and the transfer family.
+            void init(
+                VkPhysicalDevice physicalDevice,
+                VkDevice device,
+                const VkAllocationCallbacks* allocator,
+                vk_memory::DeviceMemoryAllocator& memoryAllocator,
+                VkQueue sparseQueue,
+                std::span<const uint32_t> queueFamilies,
+                uint32_t framesInFlight,
+                VkDeviceSize budget
+            ) {
+                m_physicalDevice = physicalDevice;
+                m_device = device;
+                m_allocator = allocator;
+                m_memoryAllocator = &memoryAllocator;
+                m_sparseQueue = sparseQueue;
+                m_framesInFlight = framesInFlight;
+                m_budget = budget;
+
+                m_queueFamilies.assign(queueFamilies.begin(), queueFamilies.end());
+                std::sort(m_queueFamilies.begin(), m_queueFamilies.end());
+                m_queueFamilies.erase(std::unique(m_queueFamilies.begin(), m_queueFamilies.end()), m_queueFamilies.end());
+
+                const auto timelineInfo = VkSemaphoreTypeCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+                    .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+                    .initialValue = 0,
+                };
+                const auto semaphoreInfo = VkSemaphoreCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+                    .pNext = &timelineInfo,
+                };
+
+                auto semaphore = VkSemaphore {};
+                const auto result = vkCreateSemaphore(m_device, &semaphoreInfo, m_allocator, &semaphore);
+                if (result != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create sparse binding semaphore!");
+                }
+
+                m_bindSemaphore = vk_handles::Semaphore { m_device, semaphore, m_allocator };
+            }
+
+            // The caller must make sure the device is idle.
+            void destroy() {
+                if (m_device == VK_NULL_HANDLE) {
+                    return;
+                }
+
+                for (auto& texture : m_textures) {
+                    for (const auto& tile : texture.tiles) {
+                        m_memoryAllocator->free(tile.page);
+                    }
+                    for (const auto& allocation : texture.tailMemory) {
+                        m_memoryAllocator->free(allocation);
+                    }
+                }
+                for (const auto& pendingFree : m_pendingFrees) {
+                    m_memoryAllocator->free(pendingFree.page);
+                }
+
+                m_textures.clear();
+                m_pendingFrees.clear();
+                m_pendingFeedback.clear();
+                m_feedback = BufferAllocation();
+                m_residency.clear();
+                m_bindSemaphore.reset();
+                m_feedbackCleared = false;
+                m_regionCount = 0;
+                m_streamedBytes = 0;
+                m_budgetLimit = std::numeric_limits<VkDeviceSize>::max();
+                m_nextBindValue = 1;
+                m_frameNumber = 0;
+                m_slot = 0;
+                m_device = VK_NULL_HANDLE;
+            }
+
+            bool isInitialized() const {
+                return m_device != VK_NULL_HANDLE;
+            }
+
+            // Opens the levels of `name` for `compression` in `pack`, which has to outlive the
+            // streamer, creates its partially resident image, and binds its mip tail. Textures
+            // are all added before the first `update`, which creates the feedback and residency
+            // buffers for them.
+            uint32_t addTexture(const vk_assets::AssetPack& pack, std::string_view name, vk_textures::BlockCompression compression, bool srgb) {
+                if (!m_residency.empty()) {
+                    throw std::runtime_error("failed to add streamed texture, streaming has started!");
+                }
+
+                auto& texture = m_textures.emplace_back();
+                texture.file.open(pack, name, compression, srgb);
+                this->createImage(texture);
+                this->createTiles(texture);
+                this->bindTail(texture);
+
+                return static_cast<uint32_t>(m_textures.size() - 1);
+            }
+
+            VkImageView view(uint32_t texture) const {
+                return m_textures[texture].view.get();
+            }
+
+            ShaderTextureInfo shaderInfo(uint32_t texture) const {
+                const auto& streamed = m_textures[texture];
+
+                return ShaderTextureInfo {
+                    .firstRegion = streamed.firstRegion,
+                    .regionsX = streamed.regionsX,
+                    .regionsY = streamed.regionsY,
+                    .tailLevel = streamed.tailLevel,
+                };
+            }
+
+            // The addresses of the buffer shaders write feedback to, and of the residency map
+            // of the frame the last `update` was for.
+            VkDeviceAddress feedbackAddress() const {
+                return m_feedback.address;
+            }
+
+            VkDeviceAddress residencyAddress() const {
+                return m_residency[m_slot].address;
+            }
+
+            // The frame the last `update` was for, which picks the pixels writing feedback.
+            uint64_t frameNumber() const {
+                return m_frameNumber;
+            }
+
+            VkDeviceSize regionBytes() const {
+                return std::max<VkDeviceSize>(m_regionCount, 1) * sizeof(uint32_t);
+            }
+
+            VkDeviceSize streamedBytes() const {
+                return m_streamedBytes;
+            }
+
+            // Shrinks the budget of the next `update` to what the device local heaps can still
+            // take, from `vk_memory::MemoryBudgetMonitor`, when other applications leave less
+            // than the configured budget. Over it, tiles are evicted even if nothing is requested.
+            void limitBudget(VkDeviceSize deviceLocalHeadroom) {
+                m_budgetLimit = m_streamedBytes + deviceLocalHeadroom;
+            }
+
+            // Reads the newest feedback whose frame has finished, moves every tile along, and
+            // writes the residency map of frame `frameNumber`, about to be recorded in frame slot
+            // `slot`.
+            void update(uint64_t frameNumber, uint32_t slot, vk_upload::UploadService& uploadService) {
+                if (m_residency.empty()) {
+                    this->createBuffers();
+                }
+
+                m_frameNumber = frameNumber;
+                m_slot = slot;
+
+                auto completedBindValue = uint64_t { 0 };
+                vkGetSemaphoreCounterValue(m_device, m_bindSemaphore.get(), &completedBindValue);
+
+                this->freeUnboundPages(completedBindValue);
+                this->advanceTiles(frameNumber, completedBindValue, uploadService);
+
+                // Older feedback is superseded by what came after it.
+                auto feedback = std::vector<std::byte> {};
+                while (!m_pendingFeedback.empty() && m_pendingFeedback.front().wait_for(std::chrono::seconds { 0 }) == std::future_status::ready) {
+                    feedback = m_pendingFeedback.front().get();
+                    m_pendingFeedback.pop_front();
+                }
+                auto requests = std::vector<Request> {};
+                if (feedback.size() == this->regionBytes()) {
+                    const auto* regions = reinterpret_cast<const uint32_t*>(feedback.data());
+                    requests = this->readFeedback(std::span { regions, m_regionCount }, frameNumber);
+                }
+                this->evictOverBudget(frameNumber);
+                this->bindRequested(requests, frameNumber);
+
+                this->writeResidency(slot);
+            }
+
+            // Imports the feedback buffer into the frame's graph, and adds the pass that reads
+            // the last frame's feedback back, to be collected by `update` once the frame timeline
+            // semaphore reaches `completionValue`, and starts this frame's over. Returns the
+            // feedback, for the passes sampling streamed textures to declare `samplingAccess` on.
+            vk_render_graph::ResourceId addFeedbackPasses(vk_render_graph::RenderGraph& graph, vk_readback::ReadbackService& readbackService, uint64_t completionValue) {
+                // Last frame's sampling passes are the last use of the feedback, or its fill when
+                // nothing sampled it.
+                const auto feedback = graph.importBuffer(
+                    m_feedback.buffer.get(),
+                    m_feedbackCleared
+                        ? vk_render_graph::ResourceState {
+                            VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_CLEAR_BIT,
+                            VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                        }
+                        : vk_render_graph::ResourceState {}
+                );
+                graph.exportResource(feedback);
+                graph.addPass(
+                    "textureFeedbackReadback",
+                    {
+                        vk_render_graph::write(feedback, VK_PIPELINE_STAGE_2_COPY_BIT | VK_PIPELINE_STAGE_2_CLEAR_BIT, VK_ACCESS_2_TRANSFER_READ_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT),
+                    },
+                    [this, &readbackService, completionValue, cleared = m_feedbackCleared](VkCommandBuffer commandBuffer) {
+                        if (cleared) {
+                            // A full readback ring skips a frame's feedback, which the next one
+                            // mostly repeats.
+                            auto readback = readbackService.readBuffer(commandBuffer, m_feedback.buffer.get(), 0, this->regionBytes(), completionValue);
+                            if (readback.has_value()) {
+                                m_pendingFeedback.push_back(std::move(readback.value()));
+                            }
+
+                            // The copy reads what the fill overwrites.
+                            const auto toFill = VkMemoryBarrier2 {
+                                .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+                                .srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+                                .srcAccessMask = VK_ACCESS_2_NONE,
+                                .dstStageMask = VK_PIPELINE_STAGE_2_CLEAR_BIT,
+                                .dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                            };
+                            const auto dependencyInfo = VkDependencyInfo {
+                                .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+                                .memoryBarrierCount = 1,
+                                .pMemoryBarriers = &toFill,
+                            };
+                            vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+                        }
+
+                        vkCmdFillBuffer(commandBuffer, m_feedback.buffer.get(), 0, VK_WHOLE_SIZE, NO_MIP);
+                    }
+                );
+                m_feedbackCleared = true;
+
+                return feedback;
+            }
+
+            // What a pass sampling streamed textures through `sampleStreamed` does to the
+            // feedback.
+            static vk_render_graph::ResourceAccess samplingAccess(vk_render_graph::ResourceId feedback) {
+                return vk_render_graph::write(feedback, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+            }
+        private:
+            enum class TileState : uint32_t {
+                Unbound,
+                // Waiting for the bind at `waitValue` on the sparse binding queue.
+                Binding,
+                // Bound, waiting for room in the staging ring.
+                Bound,
+                // Waiting for the upload ticket `waitValue`.
+                Uploading,
+                Resident,
+                // Out of the residency map since frame `waitValue`, and still bound for the
+                // frames in flight then.
+                Evicted,
+            };
+
+            struct Tile {
+                TileState state = TileState::Unbound;
+                vk_memory::Allocation page;
+                uint64_t waitValue = 0;
+                uint64_t lastRequested = 0;
+            };
+
+            struct TileKey {
+                uint32_t level;
+                uint32_t x;
+                uint32_t y;
+            };
+
+            struct StreamedTexture {
+                vk_textures::PackedTexture file;
+                vk_handles::Image image;
+                vk_handles::ImageView view;
+                VkExtent2D granularity = {};
+                VkDeviceSize pageSize = 0;
+                uint32_t pageMemoryTypeBits = 0;
+                uint32_t tailLevel = 0;
+                std::vector<vk_memory::Allocation> tailMemory;
+                uint64_t tailBindValue = 0;
+                std::optional<vk_upload::UploadTicket> tailTicket;
+                bool tailResident = false;
+                // Per level before the mip tail, its first tile and its width in tiles.
+                std::vector<uint32_t> levelFirstTile;
+                std::vector<uint32_t> levelTilesX;
+                std::vector<bool> levelWritten;
+                std::vector<Tile> tiles;
+                uint32_t firstRegion = 0;
+                uint32_t regionsX = 1;
+                uint32_t regionsY = 1;
+            };
+
+            struct Request {
+                uint32_t texture;
+                uint32_t tile;
+                uint32_t level;
+            };
+
+            struct PendingFree {
+                vk_memory::Allocation page;
+                uint64_t bindValue;
+            };
+
+            struct BufferAllocation {
+                vk_memory::ScopedAllocation memory;
+                vk_handles::Buffer buffer;
+                VkDeviceAddress address = 0;
+            };
+
+            VkPhysicalDevice m_physicalDevice = VK_NULL_HANDLE;
+            VkDevice m_device = VK_NULL_HANDLE;
+            const VkAllocationCallbacks* m_allocator = nullptr;
+            vk_memory::DeviceMemoryAllocator* m_memoryAllocator = nullptr;
+            VkQueue m_sparseQueue = VK_NULL_HANDLE;
+            std::vector<uint32_t> m_queueFamilies;
+            uint32_t m_framesInFlight = 0;
+            VkDeviceSize m_budget = 0;
+            VkDeviceSize m_budgetLimit = std::numeric_limits<VkDeviceSize>::max();
+            VkDeviceSize m_streamedBytes = 0;
+            vk_handles::Semaphore m_bindSemaphore;
+            uint64_t m_nextBindValue = 1;
+            std::deque<StreamedTexture> m_textures;
+            std::vector<PendingFree> m_pendingFrees;
+            size_t m_regionCount = 0;
+            BufferAllocation m_feedback;
+            // Whether a frame has cleared the feedback, which has nothing to read back before.
+            bool m_feedbackCleared = false;
+            // In the order they were recorded, which is the order they complete in.
+            std::deque<std::future<std::vector<std::byte>>> m_pendingFeedback;
+            std::vector<BufferAllocation> m_residency;
+            uint64_t m_frameNumber = 0;
+            uint32_t m_slot = 0;
+            std::vector<std::byte> m_tileScratch;
+
+            bool concurrent() const {
+                return m_queueFamilies.size() > 1;
+            }
+
+            void createImage(StreamedTexture& texture) {
+                const auto& file = texture.file;
+                if (!vk_streaming::supportsStreaming(m_physicalDevice, file.format())) {
+                    throw std::runtime_error("failed to create streamed texture, format cannot be sparse!");
+                }
+
+                const auto extent = file.extent();
+                const auto imageInfo = VkImageCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+                    .flags = VK_IMAGE_CREATE_SPARSE_BINDING_BIT | VK_IMAGE_CREATE_SPARSE_RESIDENCY_BIT,
+                    .imageType = VK_IMAGE_TYPE_2D,
+                    .format = file.format(),
+                    .extent = VkExtent3D { extent.width, extent.height, 1 },
+                    .mipLevels = file.levelCount(),
+                    .arrayLayers = 1,
+                    .samples = VK_SAMPLE_COUNT_1_BIT,
+                    .tiling = VK_IMAGE_TILING_OPTIMAL,
+                    .usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+                    .sharingMode = this->concurrent() ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+                    .queueFamilyIndexCount = this->concurrent() ? static_cast<uint32_t>(m_queueFamilies.size()) : 0,
+                    .pQueueFamilyIndices = this->concurrent() ? m_queueFamilies.data() : nullptr,
+                    .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                };
+
+                auto image = VkImage {};
+                const auto imageResult = vkCreateImage(m_device, &imageInfo, m_allocator, &image);
+                if (imageResult != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create streamed texture image!");
+                }
+
+                texture.image = vk_handles::Image { m_device, image, m_allocator };
+
+                const auto viewInfo = VkImageViewCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+                    .image = image,
+                    .viewType = VK_IMAGE_VIEW_TYPE_2D,
+                    .format = file.format(),
+                    .subresourceRange = VkImageSubresourceRange {
+                        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                        .baseMipLevel = 0,
+                        .levelCount = file.levelCount(),
+                        .baseArrayLayer = 0,
+                        .layerCount = 1,
+                    },
+                };
+
+                auto imageView = VkImageView {};
+                const auto viewResult = vkCreateImageView(m_device, &viewInfo, m_allocator, &imageView);
+                if (viewResult != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create streamed texture view!");
+                }
+
+                texture.view = vk_handles::ImageView { m_device, imageView, m_allocator };
+            }
+
+            // Every level before the mip tail is split into tiles of the sparse block shape, and
+            // the tiles of level 0 are the regions feedback and residency are tracked per.
+            void createTiles(StreamedTexture& texture) {
+                const auto image = texture.image.get();
+                auto memoryRequirements = VkMemoryRequirements2 {
+                    .sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2,
+                };
+                const auto memoryRequirementsInfo = VkImageMemoryRequirementsInfo2 {
+                    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2,
+                    .image = image,
+                };
+                vkGetImageMemoryRequirements2(m_device, &memoryRequirementsInfo, &memoryRequirements);
+                texture.pageSize = memoryRequirements.memoryRequirements.alignment;
+                texture.pageMemoryTypeBits = memoryRequirements.memoryRequirements.memoryTypeBits;
+
+                const auto sparseRequirements = this->sparseRequirements(image);
+                const auto color = std::find_if(sparseRequirements.begin(), sparseRequirements.end(), [](const VkSparseImageMemoryRequirements& requirements) {
+                    return (requirements.formatProperties.aspectMask & VK_IMAGE_ASPECT_COLOR_BIT) != 0;
+                });
+                if (color == sparseRequirements.end()) {
+                    throw std::runtime_error("failed to create streamed texture, no sparse color aspect!");
+                }
+
+                const auto granularity = color->formatProperties.imageGranularity;
+                texture.granularity = VkExtent2D { granularity.width, granularity.height };
+                texture.tailLevel = std::min(color->imageMipTailFirstLod, texture.file.levelCount());
+
+                for (uint32_t level = 0; level < texture.tailLevel; level++) {
+                    const auto extent = texture.file.levelExtent(level);
+                    const auto tilesX = (extent.width + granularity.width - 1) / granularity.width;
+                    const auto tilesY = (extent.height + granularity.height - 1) / granularity.height;
+                    texture.levelFirstTile.push_back(static_cast<uint32_t>(texture.tiles.size()));
+                    texture.levelTilesX.push_back(tilesX);
+                    texture.tiles.resize(texture.tiles.size() + tilesX * tilesY);
+                }
+                texture.levelWritten.assign(texture.tailLevel, false);
+
+                if (texture.tailLevel > 0) {
+                    const auto extent = texture.file.levelExtent(0);
+                    texture.regionsX = texture.levelTilesX[0];
+                    texture.regionsY = (extent.height + granularity.height - 1) / granularity.height;
+                }
+
+                texture.firstRegion = static_cast<uint32_t>(m_regionCount);
+                m_regionCount += size_t { texture.regionsX } * texture.regionsY;
+            }
+
+            std::vector<VkSparseImageMemoryRequirements> sparseRequirements(VkImage image) const {
+                const auto info = VkImageSparseMemoryRequirementsInfo2 {
+                    .sType = VK_STRUCTURE_TYPE_IMAGE_SPARSE_MEMORY_REQUIREMENTS_INFO_2,
+                    .image = image,
+                };
+
+                auto count = uint32_t { 0 };
+                vkGetImageSparseMemoryRequirements2(m_device, &info, &count, nullptr);
+                auto requirements2 = std::vector<VkSparseImageMemoryRequirements2>(count, VkSparseImageMemoryRequirements2 {
+                    .sType = VK_STRUCTURE_TYPE_SPARSE_IMAGE_MEMORY_REQUIREMENTS_2,
+                });
+                vkGetImageSparseMemoryRequirements2(m_device, &info, &count, requirements2.data());
+
+                auto requirements = std::vector<VkSparseImageMemoryRequirements> {};
+                for (const auto& requirement : requirements2) {
+                    requirements.push_back(requirement.memoryRequirements);
+                }
+
+                return requirements;
+            }
+
+            // The mip tail, and the metadata some formats keep beside it, are bound once and
+            // for good, and uploaded once the bind has been done.
+            void bindTail(StreamedTexture& texture) {
+                auto binds = std::vector<VkSparseMemoryBind> {};
+                for (const auto& requirement : this->sparseRequirements(texture.image.get())) {
+                    const bool metadata = (requirement.formatProperties.aspectMask & VK_IMAGE_ASPECT_METADATA_BIT) != 0;
+                    if (requirement.imageMipTailSize == 0 || (!metadata && requirement.imageMipTailFirstLod >= texture.file.levelCount())) {
+                        continue;
+                    }
+
+                    const auto allocation = m_memoryAllocator->allocate(
+                        VkMemoryRequirements {
+                            .size = requirement.imageMipTailSize,
+                            .alignment = texture.pageSize,
+                            .memoryTypeBits = texture.pageMemoryTypeBits,
+                        },
+                        vk_memory::AllocationCreateInfo {
+                            .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                            .kind = vk_memory::ResourceKind::Optimal,
+                            .priority = vk_memory::MemoryPriority::Low,
+                        }
+                    );
+                    texture.tailMemory.push_back(allocation);
+
+                    binds.push_back(VkSparseMemoryBind {
+                        .resourceOffset = requirement.imageMipTailOffset,
+                        .size = requirement.imageMipTailSize,
+                        .memory = allocation.memory,
+                        .memoryOffset = allocation.offset,
+                        .flags = metadata ? VkSparseMemoryBindFlags { VK_SPARSE_MEMORY_BIND_METADATA_BIT } : VkSparseMemoryBindFlags {},
+                    });
+                }
+
+                if (binds.empty()) {
+                    texture.tailBindValue = 0;
+                    return;
+                }
+
+                const auto opaqueBind = VkSparseImageOpaqueMemoryBindInfo {
+                    .image = texture.image.get(),
+                    .bindCount = static_cast<uint32_t>(binds.size()),
+                    .pBinds = binds.data(),
+                };
+                texture.tailBindValue = this->submitBinds(std::span { &opaqueBind, 1 }, {});
+            }
+
+            // Submits the binds to the sparse binding queue, and returns the value the bind
+            // semaphore reaches once they are done.
+            uint64_t submitBinds(std::span<const VkSparseImageOpaqueMemoryBindInfo> opaqueBinds, std::span<const VkSparseImageMemoryBindInfo> imageBinds) {
+                const auto signalValue = m_nextBindValue;
+                const auto timelineInfo = VkTimelineSemaphoreSubmitInfo {
+                    .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+                    .signalSemaphoreValueCount = 1,
+                    .pSignalSemaphoreValues = &signalValue,
+                };
+                const auto semaphore = m_bindSemaphore.get();
+                const auto bindInfo = VkBindSparseInfo {
+                    .sType = VK_STRUCTURE_TYPE_BIND_SPARSE_INFO,
+                    .pNext = &timelineInfo,
+                    .imageOpaqueBindCount = static_cast<uint32_t>(opaqueBinds.size()),
+                    .pImageOpaqueBinds = opaqueBinds.data(),
+                    .imageBindCount = static_cast<uint32_t>(imageBinds.size()),
+                    .pImageBinds = imageBinds.data(),
+                    .signalSemaphoreCount = 1,
+                    .pSignalSemaphores = &semaphore,
+                };
+
+                const auto result = vkQueueBindSparse(m_sparseQueue, 1, &bindInfo, VK_NULL_HANDLE);
+                if (result != VK_SUCCESS) {
+                    throw std::runtime_error("failed to bind sparse texture memory!");
+                }
+
+                m_nextBindValue++;
+
+                return signalValue;
+            }
+
+            // Shaders reach both through their addresses. Until the first feedback has been
+            // read back, the residency maps are all the CPU writes.
+            void createBuffers() {
+                m_feedback = this->createBuffer(
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                    vk_memory::AllocationCreateInfo {
+                        .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                    }
+                );
+
+                for (uint32_t slot = 0; slot < m_framesInFlight; slot++) {
+                    m_residency.push_back(this->createBuffer(
+                        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                        vk_memory::AllocationCreateInfo {
+                            .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                        }
+                    ));
+                }
+            }
+
+            BufferAllocation createBuffer(VkBufferUsageFlags usage, const vk_memory::AllocationCreateInfo& memoryInfo) const {
+                const auto bufferInfo = VkBufferCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                    .size = this->regionBytes(),
+                    .usage = usage,
+                    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                };
+
+                auto buffer = VkBuffer {};
+                const auto result = vkCreateBuffer(m_device, &bufferInfo, m_allocator, &buffer);
+                if (result != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create texture streaming buffer!");
+                }
+
+                auto allocation = BufferAllocation();
+                allocation.buffer = vk_handles::Buffer { m_device, buffer, m_allocator };
+                allocation.memory = vk_memory::ScopedAllocation {
+                    *m_memoryAllocator,
+                    m_memoryAllocator->allocateForBuffer(buffer, memoryInfo),
+                };
+                allocation.address = vk_memory::bufferDeviceAddress(m_device, buffer);
+
+                return allocation;
+            }
+
+            void freeUnboundPages(uint64_t completedBindValue) {
+                const auto unbound = std::stable_partition(m_pendingFrees.begin(), m_pendingFrees.end(), [completedBindValue](const PendingFree& pendingFree) {
+                    return pendingFree.bindValue > completedBindValue;
+                });
+                for (auto pendingFree = unbound; pendingFree != m_pendingFrees.end(); pendingFree++) {
+                    m_memoryAllocator->free(pendingFree->page);
+                }
+
+                m_pendingFrees.erase(unbound, m_pendingFrees.end());
+            }
+
+            // Moves the tails and tiles whose binds, uploads or evictions have completed on to
+            // the next state. Tiles whose upload the staging ring refuses stay bound and are
+            // tried again next frame.
+            void advanceTiles(uint64_t frameNumber, uint64_t completedBindValue, vk_upload::UploadService& uploadService) {
+                auto unbinds = std::vector<std::vector<VkSparseImageMemoryBind>>(m_textures.size());
+                auto freedPages = std::vector<vk_memory::Allocation> {};
+
+                for (size_t textureIndex = 0; textureIndex < m_textures.size(); textureIndex++) {
+                    auto& texture = m_textures[textureIndex];
+                    if (!texture.tailResident) {
+                        this->advanceTail(texture, completedBindValue, uploadService);
+                    }
+
+                    for (uint32_t level = 0; level < texture.tailLevel; level++) {
+                        const auto levelEnd = level + 1 < texture.tailLevel ? texture.levelFirstTile[level + 1] : static_cast<uint32_t>(texture.tiles.size());
+                        for (auto tileIndex = texture.levelFirstTile[level]; tileIndex < levelEnd; tileIndex++) {
+                            auto& tile = texture.tiles[tileIndex];
+                            if (tile.state == TileState::Binding && tile.waitValue <= completedBindValue) {
+                                tile.state = TileState::Bound;
+                            }
+
+                            if (tile.state == TileState::Bound) {
+                                this->uploadTile(texture, this->tileKey(texture, tileIndex), tile, uploadService);
+                            } else if (tile.state == TileState::Uploading && uploadService.isComplete(tile.waitValue)) {
+                                tile.state = TileState::Resident;
+                            } else if (tile.state == TileState::Evicted && frameNumber >= tile.waitValue + m_framesInFlight) {
+                                unbinds[textureIndex].push_back(this->tileBind(texture, this->tileKey(texture, tileIndex), vk_memory::Allocation {}));
+                                freedPages.push_back(tile.page);
+                                tile = Tile {};
+                            }
+                        }
+                    }
+                }
+
+                if (freedPages.empty()) {
+                    return;
+                }
+
+                const auto bindValue = this->submitImageBinds(unbinds);
+                for (const auto& page : freedPages) {
+                    m_pendingFrees.push_back(PendingFree { .page = page, .bindValue = bindValue });
+                }
+            }
+
+            // Each level of the tail is written whole, straight out of the pack, so its first
+            // and only write discards.
+            void advanceTail(StreamedTexture& texture, uint64_t completedBindValue, vk_upload::UploadService& uploadService) {
+                if (texture.tailTicket.has_value()) {
+                    texture.tailResident = uploadService.isComplete(texture.tailTicket.value());
+                    return;
+                }
+
+                if (texture.tailBindValue > completedBindValue) {
+                    return;
+                }
+
+                auto ticket = std::optional<vk_upload::UploadTicket> {};
+                for (auto level = texture.tailLevel; level < texture.file.levelCount(); level++) {
+                    const auto extent = texture.file.levelExtent(level);
+                    ticket = texture.file.pack().uploadImage(
+                        uploadService,
+                        texture.file.levelEntry(level),
+                        vk_upload::ImageUploadInfo {
+                            .image = texture.image.get(),
+                            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                            .offset = VkOffset3D { 0, 0, 0 },
+                            .extent = VkExtent3D { extent.width, extent.height, 1 },
+                            .mipLevel = level,
+                            .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                            .finalLayout = VK_IMAGE_LAYOUT_GENERAL,
+                            .concurrent = this->concurrent(),
+                        },
+                        VK_ACCESS_SHADER_READ_BIT
+                    );
+
+                    // The tail is a handful of small levels, and is tried again whole next frame.
+                    if (!ticket.has_value()) {
+                        return;
+                    }
+                }
+
+                // A texture entirely made of tiles has nothing to wait for.
+                texture.tailTicket = ticket.value_or(0);
+            }
+
+            TileKey tileKey(const StreamedTexture& texture, uint32_t tileIndex) const {
+                const auto levelStart = std::upper_bound(texture.levelFirstTile.begin(), texture.levelFirstTile.end(), tileIndex) - 1;
+                const auto level = static_cast<uint32_t>(levelStart - texture.levelFirstTile.begin());
+                const auto index = tileIndex - *levelStart;
+
+                return TileKey {
+                    .level = level,
+                    .x = index % texture.levelTilesX[level],
+                    .y = index / texture.levelTilesX[level],
+                };
+            }
+
+            // The texels of the tile, clipped to its level.
+            VkRect2D tileRect(const StreamedTexture& texture, const TileKey& key) const {
+                const auto extent = texture.file.levelExtent(key.level);
+                const auto x = key.x * texture.granularity.width;
+                const auto y = key.y * texture.granularity.height;
+
+                return VkRect2D {
+                    .offset = VkOffset2D { static_cast<int32_t>(x), static_cast<int32_t>(y) },
+                    .extent = VkExtent2D { std::min(texture.granularity.width, extent.width - x), std::min(texture.granularity.height, extent.height - y) },
+                };
+            }
+
+            VkSparseImageMemoryBind tileBind(const StreamedTexture& texture, const TileKey& key, const vk_memory::Allocation& page) const {
+                const auto rect = this->tileRect(texture, key);
+
+                return VkSparseImageMemoryBind {
+                    .subresource = VkImageSubresource {
+                        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                        .mipLevel = key.level,
+                        .arrayLayer = 0,
+                    },
+                    .offset = VkOffset3D { rect.offset.x, rect.offset.y, 0 },
+                    .extent = VkExtent3D { rect.extent.width, rect.extent.height, 1 },
+                    .memory = page.memory,
+                    .memoryOffset = page.offset,
+                    .flags = 0,
+                };
+            }
+
+            uint64_t submitImageBinds(const std::vector<std::vector<VkSparseImageMemoryBind>>& binds) {
+                auto imageBinds = std::vector<VkSparseImageMemoryBindInfo> {};
+                for (size_t textureIndex = 0; textureIndex < binds.size(); textureIndex++) {
+                    if (binds[textureIndex].empty()) {
+                        continue;
+                    }
+
+                    imageBinds.push_back(VkSparseImageMemoryBindInfo {
+                        .image = m_textures[textureIndex].image.get(),
+                        .bindCount = static_cast<uint32_t>(binds[textureIndex].size()),
+                        .pBinds = binds[textureIndex].data(),
+                    });
+                }
+
+                return this->submitBinds({}, imageBinds);
+            }
+
+            // Packed levels are tightly packed rows of blocks, so a tile's rows are gathered into
+            // one contiguous copy first.
+            void uploadTile(StreamedTexture& texture, const TileKey& key, Tile& tile, vk_upload::UploadService& uploadService) {
+                const auto block = vk_textures::blockInfo(texture.file.format()).value();
+                const auto rect = this->tileRect(texture, key);
+                const auto levelExtent = texture.file.levelExtent(key.level);
+                const auto levelRowBytes = size_t { (levelExtent.width + block.width - 1) / block.width } * block.bytes;
+                const auto tileRowBytes = size_t { (rect.extent.width + block.width - 1) / block.width } * block.bytes;
+                const auto tileRows = (rect.extent.height + block.height - 1) / block.height;
+                const auto firstRow = static_cast<uint32_t>(rect.offset.y) / block.height;
+                const auto rowOffset = static_cast<uint32_t>(rect.offset.x) / block.width * size_t { block.bytes };
+
+                const auto data = texture.file.levelData(key.level);
+                m_tileScratch.resize(tileRowBytes * tileRows);
+                for (uint32_t row = 0; row < tileRows; row++) {
+                    std::memcpy(m_tileScratch.data() + row * tileRowBytes, data.data() + (firstRow + row) * levelRowBytes + rowOffset, tileRowBytes);
+                }
+
+                const auto ticket = uploadService.uploadImage(
+                    vk_upload::ImageUploadInfo {
+                        .image = texture.image.get(),
+                        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                        .offset = VkOffset3D { rect.offset.x, rect.offset.y, 0 },
+                        .extent = VkExtent3D { rect.extent.width, rect.extent.height, 1 },
+                        .mipLevel = key.level,
+                        .oldLayout = texture.levelWritten[key.level] ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_UNDEFINED,
+                        .finalLayout = VK_IMAGE_LAYOUT_GENERAL,
+                        .concurrent = this->concurrent(),
+                    },
+                    m_tileScratch.data(),
+                    m_tileScratch.size(),
+                    VK_ACCESS_SHADER_READ_BIT
+                );
+                if (!ticket.has_value()) {
+                    return;
+                }
+
+                texture.levelWritten[key.level] = true;
+                tile.state = TileState::Uploading;
+                tile.waitValue = ticket.value();
+            }
+
+            // Every tile covering a region at the mip it asked for and every coarser level
+            // before the tail is requested, coarse levels first, since finer ones are of no use
+            // until those under them are resident. Tiles asked for again are kept from eviction.
+            std::vector<Request> readFeedback(std::span<const uint32_t> feedback, uint64_t frameNumber) {
+                auto requests = std::vector<Request> {};
+                for (size_t textureIndex = 0; textureIndex < m_textures.size(); textureIndex++) {
+                    auto& texture = m_textures[textureIndex];
+                    for (uint32_t regionY = 0; regionY < texture.regionsY; regionY++) {
+                        for (uint32_t regionX = 0; regionX < texture.regionsX; regionX++) {
+                            const auto requested = feedback[texture.firstRegion + regionY * texture.regionsX + regionX];
+                            for (auto level = requested; level < texture.tailLevel; level++) {
+                                const auto tileIndex = this->tileIndex(texture, level, regionX, regionY);
+                                auto& tile = texture.tiles[tileIndex];
+                                if (tile.lastRequested == frameNumber) {
+                                    continue;
+                                }
+
+                                tile.lastRequested = frameNumber;
+                                if (tile.state == TileState::Unbound) {
+                                    requests.push_back(Request {
+                                        .texture = static_cast<uint32_t>(textureIndex),
+                                        .tile = tileIndex,
+                                        .level = level,
+                                    });
+                                } else if (tile.state == TileState::Evicted) {
+                                    // Still bound and intact, so it can come straight back.
+                                    tile.state = TileState::Resident;
+                                    m_streamedBytes += texture.pageSize;
+                                }
+                            }
+                        }
+                    }
+                }
+
+                std::stable_sort(requests.begin(), requests.end(), [](const Request& a, const Request& b) {
+                    return a.level > b.level;
+                });
+
+                return requests;
+            }
+
+            uint32_t tileIndex(const StreamedTexture& texture, uint32_t level, uint32_t regionX, uint32_t regionY) const {
+                const auto levelExtent = texture.file.levelExtent(level);
+                const auto tilesY = (levelExtent.height + texture.granularity.height - 1) / texture.granularity.height;
+                const auto x = std::min(regionX >> level, texture.levelTilesX[level] - 1);
+                const auto y = std::min(regionY >> level, tilesY - 1);
+
+                return texture.levelFirstTile[level] + y * texture.levelTilesX[level] + x;
+            }
+
+            // Binds pages to the requested tiles, evicting the least recently requested resident
+            // tiles while over budget. Tiles requested within the frames in flight are never
+            // evicted, so a budget too small for what is on screen streams less detail instead
+            // of thrashing.
+            void bindRequested(const std::vector<Request>& requests, uint64_t frameNumber) {
+                if (requests.empty()) {
+                    return;
+                }
+
+                auto candidates = std::vector<std::pair<uint32_t, uint32_t>> {};
+                auto candidatesCollected = false;
+                auto nextCandidate = size_t { 0 };
+
+                auto binds = std::vector<std::vector<VkSparseImageMemoryBind>>(m_textures.size());
+                auto boundTiles = std::vector<Tile*> {};
+                for (const auto& request : requests) {
+                    if (boundTiles.size() == MAX_BINDS_PER_FRAME) {
+                        break;
+                    }
+
+                    auto& texture = m_textures[request.texture];
+                    while (m_streamedBytes + texture.pageSize > this->budget()) {
+                        if (!candidatesCollected) {
+                            candidates = this->evictionCandidates(frameNumber);
+                            candidatesCollected = true;
+                        }
+
+                        if (nextCandidate == candidates.size()) {
+                            break;
+                        }
+
+                        const auto [textureIndex, tileIndex] = candidates[nextCandidate++];
+                        this->evict(textureIndex, tileIndex, frameNumber);
+                    }
+
+                    if (m_streamedBytes + texture.pageSize > this->budget()) {
+                        break;
+                    }
+
+                    auto& tile = texture.tiles[request.tile];
+                    tile.page = m_memoryAllocator->allocate(
+                        VkMemoryRequirements {
+                            .size = texture.pageSize,
+                            .alignment = texture.pageSize,
+                            .memoryTypeBits = texture.pageMemoryTypeBits,
+                        },
+                        vk_memory::AllocationCreateInfo {
+                            .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                            .kind = vk_memory::ResourceKind::Optimal,
+                            .priority = vk_memory::MemoryPriority::Low,
+                        }
+                    );
+                    m_streamedBytes += texture.pageSize;
+
+                    binds[request.texture].push_back(this->tileBind(texture, this->tileKey(texture, request.tile), tile.page));
+                    boundTiles.push_back(&tile);
+                }
+
+                if (boundTiles.empty()) {
+                    return;
+                }
+
+                const auto bindValue = this->submitImageBinds(binds);
+                for (auto* tile : boundTiles) {
+                    tile->state = TileState::Binding;
+                    tile->waitValue = bindValue;
+                }
+            }
+
+            // Memory stays bound until the frames in flight are done with it, but is charged to
+            // the budget as free already, so the request making room does not stall.
+            void evict(uint32_t textureIndex, uint32_t tileIndex, uint64_t frameNumber) {
+                auto& evicted = m_textures[textureIndex].tiles[tileIndex];
+                evicted.state = TileState::Evicted;
+                evicted.waitValue = frameNumber;
+                m_streamedBytes -= m_textures[textureIndex].pageSize;
+            }
+
+            void evictOverBudget(uint64_t frameNumber) {
+                if (m_streamedBytes <= this->budget()) {
+                    return;
+                }
+
+                for (const auto& [textureIndex, tileIndex] : this->evictionCandidates(frameNumber)) {
+                    if (m_streamedBytes <= this->budget()) {
+                        break;
+                    }
+
+                    this->evict(textureIndex, tileIndex, frameNumber);
+                }
+            }
+
+            VkDeviceSize budget() const {
+                return std::min(m_budget, m_budgetLimit);
+            }
+
+            // Resident tiles not requested within the frames in flight, the least recently
+            // requested first, and the finer ones first among those requested the same frame.
+            std::vector<std::pair<uint32_t, uint32_t>> evictionCandidates(uint64_t frameNumber) const {
+                struct Candidate {
+                    uint64_t lastRequested;
+                    uint32_t level;
+                    uint32_t texture;
+                    uint32_t tile;
+                };
+
+                auto candidates = std::vector<Candidate> {};
+                for (size_t textureIndex = 0; textureIndex < m_textures.size(); textureIndex++) {
+                    const auto& texture = m_textures[textureIndex];
+                    for (uint32_t tileIndex = 0; tileIndex < texture.tiles.size(); tileIndex++) {
+                        const auto& tile = texture.tiles[tileIndex];
+                        if (tile.state != TileState::Resident || tile.lastRequested + m_framesInFlight > frameNumber) {
+                            continue;
+                        }
+
+                        candidates.push_back(Candidate {
+                            .lastRequested = tile.lastRequested,
+                            .level = this->tileKey(texture, tileIndex).level,
+                            .texture = static_cast<uint32_t>(textureIndex),
+                            .tile = tileIndex,
+                        });
+                    }
+                }
+
+                std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+                    return a.lastRequested != b.lastRequested ? a.lastRequested < b.lastRequested : a.level < b.level;
+                });
+
+                auto order = std::vector<std::pair<uint32_t, uint32_t>> {};
+                for (const auto& candidate : candidates) {
+                    order.emplace_back(candidate.texture, candidate.tile);
+                }
+
+                return order;
+            }
+
+            // A region's finest resident mip is the finest level whose tile over the region is
+            // resident along with every coarser one before the tail.
+            void writeResidency(uint32_t slot) const {
+                auto* residency = static_cast<uint32_t*>(m_residency[slot].memory.get().mappedData);
+                for (const auto& texture : m_textures) {
+                    for (uint32_t regionY = 0; regionY < texture.regionsY; regionY++) {
+                        for (uint32_t regionX = 0; regionX < texture.regionsX; regionX++) {
+                            auto finest = texture.tailResident ? texture.tailLevel : NO_MIP;
+                            for (auto level = texture.tailLevel; texture.tailResident && level > 0; level--) {
+                                const auto& tile = texture.tiles[this->tileIndex(texture, level - 1, regionX, regionY)];
+                                if (tile.state != TileState::Resident) {
+                                    break;
+                                }
+
+                                finest = level - 1;
+                            }
+
+                            residency[texture.firstRegion + regionY * texture.regionsX + regionX] = finest;
+                        }
+                    }
+                }
+            }
+    };
+}
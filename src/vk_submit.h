@@ -0,0 +1,164 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <span>
+#include <vector>
+
+#include <fmt/core.h>
+#include <fmt/ostream.h>
+
+
+namespace vk_submit {
+    inline VkSemaphoreSubmitInfo semaphoreInfo(VkSemaphore semaphore, uint64_t value, VkPipelineStageFlags2 stageMask) {
+        return VkSemaphoreSubmitInfo {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+            .semaphore = semaphore,
+            .value = value,
+            .stageMask = stageMask,
+        };
+    }
+
+    inline VkCommandBufferSubmitInfo commandBufferInfo(VkCommandBuffer commandBuffer) {
+        return VkCommandBufferSubmitInfo {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO,
+            .commandBuffer = commandBuffer,
+        };
+    }
+
+    // One submission to a queue. Values of binary semaphores are ignored.
+    struct Submission {
+        std::span<const VkSemaphoreSubmitInfo> waits;
+        std::span<const VkCommandBufferSubmitInfo> commandBuffers;
+        std::span<const VkSemaphoreSubmitInfo> signals;
+        // Extends the `VkSubmitInfo2`, and has to stay alive until the flush.
+        const void* next = nullptr;
+    };
+
+    // Collects the submissions of a frame, from uploads and async compute to the frame itself
+    // and its video encode, and hands each queue's to the driver in one `vkQueueSubmit2`. The
+    // submissions keep their own semaphores and stay in order on their queue, so batching moves
+    // no synchronization around and only saves the fixed cost of every call, which is a trip
+    // into the kernel on several drivers.
+    //
+    // The queues are submitted to in the order they were first added to. Waits on timeline
+    // semaphores may come before their signal, but a binary semaphore has to be signaled by a
+    // queue submitted to earlier, or outside of the batch.
+    class SubmitBatcher {
+        public:
+            explicit SubmitBatcher() = default;
+
+            SubmitBatcher(const SubmitBatcher& other) = delete;
+            SubmitBatcher& operator=(const SubmitBatcher& other) = delete;
+
+            // Copies the submission's semaphores and command buffers.
+            void add(VkQueue queue, const Submission& submission) {
+                m_pending.push_back(PendingSubmission {
+                    .queue = queue,
+                    .next = submission.next,
+                    .waitOffset = m_waits.size(),
+                    .waitCount = static_cast<uint32_t>(submission.waits.size()),
+                    .commandBufferOffset = m_commandBuffers.size(),
+                    .commandBufferCount = static_cast<uint32_t>(submission.commandBuffers.size()),
+                    .signalOffset = m_signals.size(),
+                    .signalCount = static_cast<uint32_t>(submission.signals.size()),
+                });
+                m_waits.insert(m_waits.end(), submission.waits.begin(), submission.waits.end());
+                m_commandBuffers.insert(m_commandBuffers.end(), submission.commandBuffers.begin(), submission.commandBuffers.end());
+                m_signals.insert(m_signals.end(), submission.signals.begin(), submission.signals.end());
+            }
+
+            bool isEmpty() const {
+                return m_pending.empty();
+            }
+
+            // Submits everything added since the last flush, and stops at the first queue that
+            // fails, whose result it returns. The batch is emptied either way.
+            VkResult flush() {
+                auto result = VK_SUCCESS;
+                m_queues.clear();
+                for (const auto& pending : m_pending) {
+                    if (std::find(m_queues.begin(), m_queues.end(), pending.queue) == m_queues.end()) {
+                        m_queues.push_back(pending.queue);
+                    }
+                }
+
+                for (const auto queue : m_queues) {
+                    m_submitInfos.clear();
+                    for (const auto& pending : m_pending) {
+                        if (pending.queue != queue) {
+                            continue;
+                        }
+
+                        m_submitInfos.push_back(VkSubmitInfo2 {
+                            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+                            .pNext = pending.next,
+                            .waitSemaphoreInfoCount = pending.waitCount,
+                            .pWaitSemaphoreInfos = m_waits.data() + pending.waitOffset,
+                            .commandBufferInfoCount = pending.commandBufferCount,
+                            .pCommandBufferInfos = m_commandBuffers.data() + pending.commandBufferOffset,
+                            .signalSemaphoreInfoCount = pending.signalCount,
+                            .pSignalSemaphoreInfos = m_signals.data() + pending.signalOffset,
+                        });
+                    }
+
+                    result = vkQueueSubmit2(queue, static_cast<uint32_t>(m_submitInfos.size()), m_submitInfos.data(), VK_NULL_HANDLE);
+                    m_callCount++;
+                    if (result != VK_SUCCESS) {
+                        break;
+                    }
+                }
+
+                if (!m_pending.empty()) {
+                    m_flushCount++;
+                    m_submissionCount += m_pending.size();
+                }
+                m_pending.clear();
+                m_waits.clear();
+                m_commandBuffers.clear();
+                m_signals.clear();
+
+                return result;
+            }
+
+            void report(std::ostream& out) const {
+                if (m_flushCount == 0) {
+                    return;
+                }
+
+                fmt::println(
+                    out,
+                    "Queue submission: {} submissions in {} vkQueueSubmit2 calls, {:.2f} calls per flush",
+                    m_submissionCount,
+                    m_callCount,
+                    static_cast<double>(m_callCount) / static_cast<double>(m_flushCount)
+                );
+            }
+        private:
+            // Offsets rather than pointers, since the arrays grow until the flush.
+            struct PendingSubmission {
+                VkQueue queue = VK_NULL_HANDLE;
+                const void* next = nullptr;
+                size_t waitOffset = 0;
+                uint32_t waitCount = 0;
+                size_t commandBufferOffset = 0;
+                uint32_t commandBufferCount = 0;
+                size_t signalOffset = 0;
+                uint32_t signalCount = 0;
+            };
+
+            std::vector<PendingSubmission> m_pending;
+            std::vector<VkSemaphoreSubmitInfo> m_waits;
+            std::vector<VkCommandBufferSubmitInfo> m_commandBuffers;
+            std::vector<VkSemaphoreSubmitInfo> m_signals;
+            std::vector<VkQueue> m_queues;
+            std::vector<VkSubmitInfo2> m_submitInfos;
+            uint64_t m_flushCount = 0;
+            uint64_t m_callCount = 0;
+            uint64_t m_submissionCount = 0;
+    };
+}
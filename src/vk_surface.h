@@ -0,0 +1,208 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+
+namespace vk_surface {
+    // Which swapchain formats to favor.
+    //
+    // * `Sdr` takes an 8 bit sRGB format, which the hardware encodes on write.
+    // * `Deep` favors 10 bit formats in the sRGB color space, for less banding in gradients
+    //   at the same 32 bits per pixel as 8 bit output.
+    // * `Hdr` favors scRGB half float output, then HDR10, both of which need
+    //   `VK_EXT_swapchain_colorspace` on the instance, and otherwise falls back to `Deep`.
+    enum class SurfaceFormatPolicy {
+        Sdr,
+        Deep,
+        Hdr,
+    };
+
+    inline const char* surfaceFormatPolicyToString(SurfaceFormatPolicy policy) {
+        switch (policy) {
+            case SurfaceFormatPolicy::Sdr: return "sdr";
+            case SurfaceFormatPolicy::Deep: return "10bit";
+            case SurfaceFormatPolicy::Hdr: return "hdr";
+        }
+
+        return "unknown";
+    }
+
+    inline std::optional<SurfaceFormatPolicy> surfaceFormatPolicyFromString(std::string_view name) {
+        for (const auto policy : { SurfaceFormatPolicy::Sdr, SurfaceFormatPolicy::Deep, SurfaceFormatPolicy::Hdr }) {
+            if (name == surfaceFormatPolicyToString(policy)) {
+                return policy;
+            }
+        }
+
+        return std::nullopt;
+    }
+
+    constexpr auto HDR_SURFACE_FORMATS = std::array<VkSurfaceFormatKHR, 3> {
+        VkSurfaceFormatKHR { VK_FORMAT_R16G16B16A16_SFLOAT, VK_COLOR_SPACE_EXTENDED_SRGB_LINEAR_EXT },
+        VkSurfaceFormatKHR { VK_FORMAT_A2B10G10R10_UNORM_PACK32, VK_COLOR_SPACE_HDR10_ST2084_EXT },
+        VkSurfaceFormatKHR { VK_FORMAT_A2R10G10B10_UNORM_PACK32, VK_COLOR_SPACE_HDR10_ST2084_EXT },
+    };
+
+    constexpr auto DEEP_SURFACE_FORMATS = std::array<VkSurfaceFormatKHR, 2> {
+        VkSurfaceFormatKHR { VK_FORMAT_A2B10G10R10_UNORM_PACK32, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR },
+        VkSurfaceFormatKHR { VK_FORMAT_A2R10G10B10_UNORM_PACK32, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR },
+    };
+
+    inline bool isHdrColorSpace(VkColorSpaceKHR colorSpace) {
+        return colorSpace == VK_COLOR_SPACE_EXTENDED_SRGB_LINEAR_EXT || colorSpace == VK_COLOR_SPACE_HDR10_ST2084_EXT;
+    }
+
+    inline std::optional<VkSurfaceFormatKHR> findSurfaceFormat(
+        const std::vector<VkSurfaceFormatKHR>& availableFormats,
+        std::span<const VkSurfaceFormatKHR> candidates
+    ) {
+        for (const auto& candidate : candidates) {
+            for (const auto& availableFormat : availableFormats) {
+                if (availableFormat.format == candidate.format && availableFormat.colorSpace == candidate.colorSpace) {
+                    return availableFormat;
+                }
+            }
+        }
+
+        return std::nullopt;
+    }
+
+    // Pick the first format of the policy's ranking the surface supports, trying `sdrFormats`
+    // in the sRGB color space last. Without any of them, the choice does not depend on the
+    // order the driver reports formats in: the lowest format in the sRGB color space wins,
+    // then the lowest format in any color space.
+    inline VkSurfaceFormatKHR selectSurfaceFormat(
+        const std::vector<VkSurfaceFormatKHR>& availableFormats,
+        SurfaceFormatPolicy policy,
+        std::span<const VkFormat> sdrFormats
+    ) {
+        if (policy == SurfaceFormatPolicy::Hdr) {
+            if (const auto found = findSurfaceFormat(availableFormats, HDR_SURFACE_FORMATS)) {
+                return *found;
+            }
+        }
+
+        if (policy == SurfaceFormatPolicy::Hdr || policy == SurfaceFormatPolicy::Deep) {
+            if (const auto found = findSurfaceFormat(availableFormats, DEEP_SURFACE_FORMATS)) {
+                return *found;
+            }
+        }
+
+        for (const auto sdrFormat : sdrFormats) {
+            const auto candidate = VkSurfaceFormatKHR { sdrFormat, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR };
+            if (const auto found = findSurfaceFormat(availableFormats, std::span { &candidate, 1 })) {
+                return *found;
+            }
+        }
+
+        const auto fallback = std::min_element(availableFormats.begin(), availableFormats.end(), [](const VkSurfaceFormatKHR& a, const VkSurfaceFormatKHR& b) {
+            const auto rank = [](const VkSurfaceFormatKHR& format) {
+                return std::make_tuple(format.colorSpace != VK_COLOR_SPACE_SRGB_NONLINEAR_KHR, format.format, format.colorSpace);
+            };
+
+            return rank(a) < rank(b);
+        });
+
+        return *fallback;
+    }
+
+    // The formats and present modes of a surface. Unlike its capabilities, whose current
+    // extent follows the window's size, they only change with the display it is shown on.
+    struct SurfaceSupport {
+        std::vector<VkSurfaceFormatKHR> formats;
+        std::vector<VkPresentModeKHR> presentModes;
+    };
+
+    inline SurfaceSupport querySurfaceSupport(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface) {
+        auto support = SurfaceSupport {};
+        uint32_t formatCount = 0;
+        vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, surface, &formatCount, nullptr);
+
+        support.formats.resize(formatCount);
+        vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, surface, &formatCount, support.formats.data());
+
+        uint32_t presentModeCount = 0;
+        vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &presentModeCount, nullptr);
+
+        support.presentModes.resize(presentModeCount);
+        vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &presentModeCount, support.presentModes.data());
+
+        return support;
+    }
+
+    // The support of one surface on every monitor its window has been on, by the monitor's
+    // handle, so moving back to a monitor, or recreating the swapchain on the same one, costs
+    // no enumeration. A window is on a few monitors at most, which a list searches fastest.
+    class SurfaceSupportCache {
+        public:
+            explicit SurfaceSupportCache() = default;
+
+            SurfaceSupportCache(const SurfaceSupportCache& other) = delete;
+            SurfaceSupportCache& operator=(const SurfaceSupportCache& other) = delete;
+            SurfaceSupportCache(SurfaceSupportCache&& other) = default;
+            SurfaceSupportCache& operator=(SurfaceSupportCache&& other) = default;
+
+            // The support on `monitor`, queried when there is none cached.
+            const SurfaceSupport& get(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, const void* monitor) {
+                if (const auto* cached = this->find(monitor); cached != nullptr) {
+                    m_hitCount++;
+
+                    return *cached;
+                }
+
+                m_queryCount++;
+
+                return this->insert(monitor, querySurfaceSupport(physicalDevice, surface));
+            }
+
+            // Support queried elsewhere, like the first window's, which device selection queried.
+            const SurfaceSupport& insert(const void* monitor, SurfaceSupport support) {
+                this->invalidate(monitor);
+                m_entries.emplace_back(monitor, std::move(support));
+
+                return m_entries.back().second;
+            }
+
+            void invalidate(const void* monitor) {
+                std::erase_if(m_entries, [monitor](const auto& entry) {
+                    return entry.first == monitor;
+                });
+            }
+
+            // Every monitor at once, for when the monitors themselves changed, and a handle may
+            // now stand for another one.
+            void clear() {
+                m_entries.clear();
+            }
+
+            uint64_t queryCount() const {
+                return m_queryCount;
+            }
+
+            uint64_t hitCount() const {
+                return m_hitCount;
+            }
+        private:
+            std::vector<std::pair<const void*, SurfaceSupport>> m_entries;
+            uint64_t m_queryCount = 0;
+            uint64_t m_hitCount = 0;
+
+            const SurfaceSupport* find(const void* monitor) const {
+                const auto existing = std::find_if(m_entries.begin(), m_entries.end(), [monitor](const auto& entry) {
+                    return entry.first == monitor;
+                });
+
+                return existing != m_entries.end() ? &existing->second : nullptr;
+            }
+    };
+}
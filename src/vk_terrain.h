@@ -0,0 +1,866 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "vk_descriptors.h"
+#include "vk_gpu_driven.h"
+#include "vk_handles.h"
+#include "vk_memory.h"
+#include "vk_pipelines.h"
+#include "vk_render_graph.h"
+#include "vk_shaders.h"
+#include "vk_shading_rate.h"
+#include "vk_streaming.h"
+
+
+namespace vk_terrain {
+    // Heights a level has along each side, around the camera. An odd count, so that a level
+    // spans a whole number of the cells of the level around it. Matches `GRID_SIZE` in
+    // `terrain.glsl`.
+    constexpr uint32_t GRID_SIZE = 127;
+
+    // The heights of a level are kept in a square of this many a side, addressed toroidally:
+    // the height at sample `(x, z)` lives at `(x mod RING_SIZE, z mod RING_SIZE)`, so a level
+    // that moves only overwrites what it moved onto. A power of two, so the modulo is a mask.
+    // Matches `RING_SIZE` in `terrain.glsl`.
+    constexpr uint32_t RING_SIZE = 128;
+
+    // Matches `MAX_LEVELS` in `terrain.glsl`.
+    constexpr uint32_t MAX_LEVELS = 12;
+
+    // The finest level's samples a streamed albedo spans before it repeats. Matches
+    // `ALBEDO_REPEAT` in `terrain.glsl`.
+    constexpr float ALBEDO_REPEAT = 64.0f;
+
+    // Heights are streamed in square tiles of this many a side, per level.
+    constexpr uint32_t TILE_SIZE = 64;
+
+    // The tiles kept around once streamed, the least recently used going first.
+    constexpr size_t MAX_CACHED_TILES = 256;
+
+    static_assert(GRID_SIZE <= RING_SIZE, "a level must fit its ring");
+    static_assert((RING_SIZE & (RING_SIZE - 1)) == 0, "the ring must be a power of two");
+    static_assert(GRID_SIZE % 2 == 1, "a level must span whole cells of the level around it");
+
+    // Matches `TerrainLevel` in `terrain.glsl`. `origin` is the sample at the level's corner,
+    // in samples of the level, which are `spacing` apart in world space.
+    struct ClipmapLevel {
+        glm::ivec2 origin;
+        float spacing;
+        float padding;
+    };
+
+    static_assert(sizeof(ClipmapLevel) == 16, "ClipmapLevel must match the std430 layout of the shader");
+
+    constexpr VkDeviceSize HEIGHTS_OFFSET = MAX_LEVELS * sizeof(ClipmapLevel);
+
+    // Matches `PushConstants` in `terrain.glsl`. The streaming fields are left zero for terrain
+    // without a streamed albedo.
+    struct DrawPushConstants {
+        glm::mat4 viewProjection;
+        glm::vec3 lightDirection;
+        uint32_t frame;
+        VkDeviceAddress terrain;
+        VkDeviceAddress residency;
+        VkDeviceAddress feedback;
+        vk_streaming::ShaderTextureInfo albedo;
+        uint32_t albedoImage;
+        uint32_t albedoSampler;
+    };
+
+    static_assert(offsetof(DrawPushConstants, terrain) == 80, "DrawPushConstants must match the std430 layout of the shader");
+    static_assert(offsetof(DrawPushConstants, albedo) == 104, "DrawPushConstants must match the std430 layout of the shader");
+    static_assert(sizeof(DrawPushConstants) == vk_descriptors::PUSH_CONSTANT_SIZE, "DrawPushConstants must fit the bindless heap's push constants");
+
+    // A terrain albedo streamed by `streamer` as its texture `texture`, sampled through
+    // `descriptorHeap`, whose pipeline layout the terrain then draws with. Both have to
+    // outlive the terrain renderer.
+    struct TerrainAlbedo {
+        vk_descriptors::BindlessDescriptorHeap* descriptorHeap;
+        vk_descriptors::SamplerCache* samplerCache;
+        const vk_streaming::TextureStreamer* streamer;
+        uint32_t texture;
+    };
+
+    // A rectangle of samples, `size` of them from `origin`.
+    struct Region {
+        glm::ivec2 origin;
+        glm::ivec2 size;
+    };
+
+    inline int32_t floorDivide(int32_t value, int32_t divisor) {
+        const auto quotient = value / divisor;
+
+        return quotient * divisor > value ? quotient - 1 : quotient;
+    }
+
+    // The corner of the level with samples `spacing` apart around `camera`, on the ground.
+    // Corners are snapped to every other sample, so that a level's edges lie on the samples of
+    // the level around it, which is twice as coarse. A level is then 31 or 32 of its outer
+    // level's cells in from each side of it, whichever way the camera goes.
+    inline glm::ivec2 snapOrigin(glm::vec2 camera, float spacing) {
+        const auto snapped = glm::floor(camera / (2.0f * spacing));
+        const auto half = static_cast<int32_t>(GRID_SIZE / 2) - 1;
+
+        return glm::ivec2 { 2 * static_cast<int32_t>(snapped.x) - half, 2 * static_cast<int32_t>(snapped.y) - half };
+    }
+
+    // What a level moving its corner from `previous` to `next` has not sampled yet: the rows
+    // it moved onto along z across its whole width, and the columns it moved onto along x for
+    // the rows it kept. A level without a previous corner, or that moved a whole level, is
+    // sampled anew.
+    inline std::vector<Region> dirtyRegions(std::optional<glm::ivec2> previous, glm::ivec2 next) {
+        const auto size = static_cast<int32_t>(GRID_SIZE);
+        if (!previous.has_value()) {
+            return { Region { next, glm::ivec2 { size } } };
+        }
+
+        const auto delta = next - *previous;
+        if (std::abs(delta.x) >= size || std::abs(delta.y) >= size) {
+            return { Region { next, glm::ivec2 { size } } };
+        }
+
+        auto regions = std::vector<Region> {};
+        if (delta.y != 0) {
+            const auto first = delta.y > 0 ? previous->y + size : next.y;
+            regions.push_back(Region { glm::ivec2 { next.x, first }, glm::ivec2 { size, std::abs(delta.y) } });
+        }
+        if (delta.x != 0) {
+            const auto first = delta.x > 0 ? previous->x + size : next.x;
+            const auto kept = std::max(previous->y, next.y);
+            regions.push_back(Region { glm::ivec2 { first, kept }, glm::ivec2 { std::abs(delta.x), size - std::abs(delta.y) } });
+        }
+
+        return regions;
+    }
+
+    // Which of `ringIndexOffsets` a level draws, from where the level inside it lies within it:
+    // the ring around that level's hole, or, without a level inside, the whole grid.
+    inline uint32_t ringVariant(std::optional<glm::ivec2> innerOffset) {
+        const auto half = static_cast<int32_t>(GRID_SIZE / 4);
+        if (!innerOffset.has_value()) {
+            return 0;
+        }
+
+        const auto x = innerOffset->x - half;
+        const auto z = innerOffset->y - half;
+        if ((x != 0 && x != 1) || (z != 0 && z != 1)) {
+            return 0;
+        }
+
+        return 1 + static_cast<uint32_t>(x) + 2 * static_cast<uint32_t>(z);
+    }
+
+    // Ground under the scene. Heights are `baseHeight` plus up to `amplitude` either way, of
+    // folds about `featureSize` across and finer ones on them, sampled `spacing` apart by the
+    // finest level. Levels are added until the coarsest covers `viewDistance` around the
+    // camera, so the terrain costs as many triangles a level whatever its size.
+    struct TerrainSettings {
+        float baseHeight = 0.0f;
+        float amplitude = 1.0f;
+        float featureSize = 16.0f;
+        float spacing = 0.25f;
+        float viewDistance = 100.0f;
+    };
+
+    // Ground well below a scene of `fieldSize`, out to the scene's far plane.
+    inline TerrainSettings underField(float fieldSize) {
+        return TerrainSettings {
+            .baseHeight = -0.75f * fieldSize,
+            .amplitude = 0.15f * fieldSize,
+            .featureSize = 0.5f * fieldSize,
+            .spacing = fieldSize / 128.0f,
+            .viewDistance = 4.0f * fieldSize,
+        };
+    }
+
+    inline uint32_t levelCount(const TerrainSettings& settings) {
+        // A level reaches at least 62 of its samples out from the camera.
+        auto count = uint32_t { 1 };
+        auto reach = 62.0f * settings.spacing;
+        while (reach < settings.viewDistance && count < MAX_LEVELS) {
+            reach *= 2.0f;
+            count++;
+        }
+
+        return count;
+    }
+
+    inline float lattice(int32_t x, int32_t z, uint32_t octave) {
+        auto hash = static_cast<uint32_t>(x) * 0x8da6b343u ^ static_cast<uint32_t>(z) * 0xd8163841u ^ octave * 0xcb1ab31fu;
+        hash ^= hash >> 16;
+        hash *= 0x7feb352du;
+        hash ^= hash >> 15;
+
+        return static_cast<float>(hash & 0xffffff) / 8388607.5f - 1.0f;
+    }
+
+    // Value noise of five octaves. The same world position gives the same height at every
+    // level, so a level's samples agree with the coarser level's wherever they meet.
+    inline float height(const TerrainSettings& settings, glm::vec2 position) {
+        auto sum = 0.0f;
+        auto weight = 0.5f;
+        auto frequency = 1.0f / settings.featureSize;
+        for (uint32_t octave = 0; octave < 5; octave++) {
+            const auto scaled = position * frequency;
+            const auto cell = glm::floor(scaled);
+            const auto fraction = scaled - cell;
+            const auto blend = fraction * fraction * (3.0f - 2.0f * fraction);
+            const auto x = static_cast<int32_t>(cell.x);
+            const auto z = static_cast<int32_t>(cell.y);
+            const auto near = glm::mix(vk_terrain::lattice(x, z, octave), vk_terrain::lattice(x + 1, z, octave), blend.x);
+            const auto far = glm::mix(vk_terrain::lattice(x, z + 1, octave), vk_terrain::lattice(x + 1, z + 1, octave), blend.x);
+            sum += weight * glm::mix(near, far, blend.y);
+            weight *= 0.5f;
+            frequency *= 2.0f;
+        }
+
+        return settings.baseHeight + settings.amplitude * sum;
+    }
+
+    // The heightmap tiles of every level, streamed in as the clipmap first touches them and
+    // kept until `MAX_CACHED_TILES` newer ones push them out. Tiles are synthesized from
+    // `height` here, where a game would read them from its world data.
+    class HeightTiles {
+        public:
+            explicit HeightTiles() = default;
+
+            HeightTiles(const HeightTiles& other) = delete;
+            HeightTiles& operator=(const HeightTiles& other) = delete;
+
+            void init(const TerrainSettings& settings) {
+                m_settings = settings;
+                m_tiles.clear();
+                m_useCount = 0;
+            }
+
+            size_t cachedCount() const {
+                return m_tiles.size();
+            }
+
+            // Writes the heights of `region` of `level` to `destination`, row by row.
+            void read(uint32_t level, const Region& region, std::span<float> destination) {
+                const auto tileSize = static_cast<int32_t>(TILE_SIZE);
+                for (int32_t z = 0; z < region.size.y; z++) {
+                    const auto sampleZ = region.origin.y + z;
+                    const auto tileZ = vk_terrain::floorDivide(sampleZ, tileSize);
+                    auto x = 0;
+                    while (x < region.size.x) {
+                        const auto sampleX = region.origin.x + x;
+                        const auto tileX = vk_terrain::floorDivide(sampleX, tileSize);
+                        const auto& tile = this->tile(level, glm::ivec2 { tileX, tileZ });
+                        const auto first = sampleX - tileX * tileSize;
+                        const auto count = std::min(tileSize - first, region.size.x - x);
+                        const auto row = static_cast<size_t>(sampleZ - tileZ * tileSize) * TILE_SIZE;
+                        std::copy_n(tile.begin() + static_cast<ptrdiff_t>(row + first), count, destination.begin() + static_cast<ptrdiff_t>(z * region.size.x + x));
+                        x += count;
+                    }
+                }
+            }
+        private:
+            struct Tile {
+                std::vector<float> heights;
+                uint64_t lastUse = 0;
+            };
+
+            TerrainSettings m_settings {};
+            std::unordered_map<uint64_t, Tile> m_tiles;
+            uint64_t m_useCount = 0;
+
+            const std::vector<float>& tile(uint32_t level, glm::ivec2 coordinate) {
+                const auto key = uint64_t { level } << 56
+                    | uint64_t { static_cast<uint32_t>(coordinate.x) & 0xfffffffu } << 28
+                    | uint64_t { static_cast<uint32_t>(coordinate.y) & 0xfffffffu };
+                const auto existing = m_tiles.find(key);
+                if (existing != m_tiles.end()) {
+                    existing->second.lastUse = ++m_useCount;
+
+                    return existing->second.heights;
+                }
+
+                if (m_tiles.size() >= MAX_CACHED_TILES) {
+                    const auto oldest = std::min_element(m_tiles.begin(), m_tiles.end(), [](const auto& left, const auto& right) {
+                        return left.second.lastUse < right.second.lastUse;
+                    });
+                    m_tiles.erase(oldest);
+                }
+
+                const auto spacing = std::ldexp(m_settings.spacing, static_cast<int>(level));
+                auto tile = Tile { .heights = std::vector<float>(TILE_SIZE * TILE_SIZE), .lastUse = ++m_useCount };
+                for (uint32_t z = 0; z < TILE_SIZE; z++) {
+                    for (uint32_t x = 0; x < TILE_SIZE; x++) {
+                        const auto sample = coordinate * static_cast<int32_t>(TILE_SIZE) + glm::ivec2 { x, z };
+                        tile.heights[z * TILE_SIZE + x] = vk_terrain::height(m_settings, glm::vec2 { sample } * spacing);
+                    }
+                }
+
+                return m_tiles.emplace(key, std::move(tile)).first->second.heights;
+            }
+    };
+
+    // The render graph resource of the frame's terrain, once uploaded, for the passes that
+    // draw it.
+    struct TerrainResources {
+        vk_render_graph::ResourceId terrain;
+    };
+
+    // Terrain drawn as geometry clipmaps: nested square grids of `GRID_SIZE` heights a side
+    // around the camera, each twice as coarse as the one inside it, so every level costs the
+    // same triangles and the terrain's size only adds levels.
+    //
+    // The heights of every level live in one device buffer, each level's in a ring of
+    // `RING_SIZE` a side addressed toroidally, so when the camera moves, a level only uploads
+    // the strips along the edges it moved onto, copied out of the frame's upload arena. Every
+    // level but the finest draws a ring around the level inside it from one shared index
+    // buffer, and the finest draws the whole grid. The finer level's outermost odd heights
+    // are averaged from their neighbours, so they lie on the coarser level's edges.
+    //
+    // Given a `TerrainAlbedo`, the ground is colored by the streamed texture, and the pass
+    // drawing it has to declare the streamer's `samplingAccess` too. Where the texture's tiles
+    // are not resident yet, the grass and rock colors show instead.
+    class TerrainRenderer {
+        public:
+            explicit TerrainRenderer() = default;
+
+            TerrainRenderer(const TerrainRenderer& other) = delete;
+            TerrainRenderer& operator=(const TerrainRenderer& other) = delete;
+
+            void init(
+                VkDevice device,
+                vk_memory::DeviceMemoryAllocator& memoryAllocator,
+                vk_shaders::ShaderLibrary& shaderLibrary,
+                vk_pipelines::PipelineRegistry& pipelineRegistry,
+                vk_pipelines::PipelineCompiler& pipelineCompiler,
+                const VkAllocationCallbacks* allocator,
+                VkSampleCountFlagBits samples,
+                VkFormat depthFormat,
+                std::optional<vk_shading_rate::DrawShadingRate> shadingRate,
+                std::optional<TerrainAlbedo> albedo,
+                const TerrainSettings& settings
+            ) {
+                m_device = device;
+                m_allocator = allocator;
+                m_memoryAllocator = &memoryAllocator;
+                m_shaderLibrary = &shaderLibrary;
+                m_pipelineRegistry = &pipelineRegistry;
+                m_pipelineCompiler = &pipelineCompiler;
+                m_samples = samples;
+                m_depthFormat = depthFormat;
+                m_shadingRate = shadingRate;
+                m_albedo = albedo;
+                m_levelCount = vk_terrain::levelCount(settings);
+                m_levels = {};
+                m_uploadedLevels.assign(m_levelCount, std::nullopt);
+                m_frameCount = 0;
+                m_tiles.init(settings);
+
+                for (uint32_t level = 0; level < MAX_LEVELS; level++) {
+                    m_levels[level].spacing = std::ldexp(settings.spacing, static_cast<int>(level));
+                }
+
+                this->createPipelineLayout();
+                if (m_albedo.has_value()) {
+                    this->addAlbedoDescriptors();
+                }
+                // The registry keeps the pipelines of a rebuilt shader alive for the frames still
+                // drawing with them, so a reload only drops them and the next draw recreates them.
+                for (const auto* shaderName : { "terrain.vert", this->fragmentShader() }) {
+                    shaderLibrary.onReload(shaderName, [this](VkShaderModule) { m_drawPipelines.clear(); });
+                }
+                m_terrain = this->createBuffer(
+                    HEIGHTS_OFFSET + VkDeviceSize { m_levelCount } * RING_SIZE * RING_SIZE * sizeof(float),
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                    vk_memory::AllocationCreateInfo {
+                        .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                        .priority = vk_memory::MemoryPriority::High,
+                    }
+                );
+                this->createIndexBuffer();
+            }
+
+            // The device has to be idle.
+            void destroy() {
+                if (m_device == VK_NULL_HANDLE) {
+                    return;
+                }
+
+                m_terrain = BufferAllocation();
+                m_indices = BufferAllocation();
+                m_drawPipelines.clear();
+                if (m_albedo.has_value()) {
+                    m_albedo->descriptorHeap->release(vk_descriptors::DescriptorKind::SampledImage, m_albedoImageSlot, 0);
+                    m_albedo->descriptorHeap->release(vk_descriptors::DescriptorKind::Sampler, m_albedoSamplerSlot, 0);
+                } else {
+                    vkDestroyPipelineLayout(m_device, m_pipelineLayout, m_allocator);
+                }
+                m_albedo.reset();
+                m_pipelineLayout = VK_NULL_HANDLE;
+                m_device = VK_NULL_HANDLE;
+            }
+
+            bool isInitialized() const {
+                return m_device != VK_NULL_HANDLE;
+            }
+
+            uint32_t levelCount() const {
+                return m_levelCount;
+            }
+
+            // Moves the levels to `camera`, and adds the pass that uploads the strips they moved
+            // onto. Levels are moved finest first, and once the frame's upload arena is full,
+            // the coarser ones stay where they are until a later frame.
+            TerrainResources addPasses(vk_render_graph::RenderGraph& graph, vk_memory::FrameUploadArena& uploadArena, const vk_gpu_driven::SceneCamera& camera) {
+                // The camera's position, from its view, and the origin until there is one.
+                const auto rotation = glm::mat3 { camera.view };
+                const auto eye = -(glm::transpose(rotation) * glm::vec3 { camera.view[3] });
+
+                auto regions = std::vector<VkBufferCopy> {};
+                for (uint32_t level = 0; level < m_levelCount; level++) {
+                    const auto origin = vk_terrain::snapOrigin(glm::vec2 { eye.x, eye.z }, m_levels[level].spacing);
+                    if (m_uploadedLevels[level] == origin) {
+                        continue;
+                    }
+
+                    const auto dirty = vk_terrain::dirtyRegions(m_uploadedLevels[level], origin);
+                    auto sampleCount = size_t { 0 };
+                    for (const auto& region : dirty) {
+                        sampleCount += static_cast<size_t>(region.size.x) * static_cast<size_t>(region.size.y);
+                    }
+                    const auto upload = uploadArena.allocate(sampleCount * sizeof(float));
+                    if (!upload.has_value()) {
+                        break;
+                    }
+
+                    auto* heights = static_cast<float*>(upload->mappedData);
+                    auto offset = upload->offset;
+                    for (const auto& region : dirty) {
+                        const auto count = static_cast<size_t>(region.size.x) * static_cast<size_t>(region.size.y);
+                        m_tiles.read(level, region, std::span { heights, count });
+                        this->appendCopies(regions, level, region, offset);
+                        heights += count;
+                        offset += count * sizeof(float);
+                    }
+                    m_levels[level].origin = origin;
+                    m_uploadedLevels[level] = origin;
+                }
+
+                // The next frame overwrites the strips this one's draws read.
+                const auto resources = TerrainResources {
+                    .terrain = graph.importBuffer(
+                        m_terrain.buffer,
+                        m_frameCount == 0
+                            ? vk_render_graph::ResourceState {}
+                            : vk_render_graph::ResourceState { VK_PIPELINE_STAGE_2_COPY_BIT | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT }
+                    ),
+                };
+                graph.exportResource(resources.terrain);
+                m_frameCount++;
+                if (regions.empty()) {
+                    return resources;
+                }
+
+                const auto levels = uploadArena.allocate(HEIGHTS_OFFSET);
+                if (!levels.has_value()) {
+                    throw std::runtime_error("failed to allocate terrain level upload!");
+                }
+
+                std::memcpy(levels->mappedData, m_levels.data(), HEIGHTS_OFFSET);
+                regions.push_back(VkBufferCopy {
+                    .srcOffset = levels->offset,
+                    .dstOffset = 0,
+                    .size = HEIGHTS_OFFSET,
+                });
+                graph.addPass(
+                    "terrainUpload",
+                    {
+                        vk_render_graph::write(resources.terrain, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT),
+                    },
+                    [this, source = uploadArena.buffer(), regions = std::move(regions)](VkCommandBuffer commandBuffer) {
+                        vkCmdCopyBuffer(commandBuffer, source, m_terrain.buffer, static_cast<uint32_t>(regions.size()), regions.data());
+                    }
+                );
+
+                return resources;
+            }
+
+            // What the pass that draws the terrain reads.
+            std::array<vk_render_graph::ResourceAccess, 1> drawAccesses(const TerrainResources& resources) const {
+                return {
+                    vk_render_graph::read(resources.terrain, VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT),
+                };
+            }
+
+            // Creates the pipeline `recordDraw` draws with into a `colorFormat` color attachment
+            // ahead of the draw, so that creating it never lands in the middle of recording.
+            void prepareDraw(VkFormat colorFormat) {
+                this->drawPipeline(colorFormat);
+            }
+
+            // Draws the terrain into a render pass with a `colorFormat` color attachment and the
+            // GPU driven scene's depth buffer, seen by `camera`, a draw a level.
+            void recordDraw(
+                VkCommandBuffer commandBuffer,
+                VkFormat colorFormat,
+                VkExtent2D renderExtent,
+                const vk_gpu_driven::SceneCamera& camera
+            ) {
+                const auto viewport = VkViewport {
+                    .x = 0.0f,
+                    .y = 0.0f,
+                    .width = static_cast<float>(renderExtent.width),
+                    .height = static_cast<float>(renderExtent.height),
+                    .minDepth = 0.0f,
+                    .maxDepth = 1.0f,
+                };
+                const auto scissor = VkRect2D {
+                    .offset = VkOffset2D { 0, 0 },
+                    .extent = renderExtent,
+                };
+                auto pushConstants = DrawPushConstants {
+                    .viewProjection = camera.viewProjection,
+                    .lightDirection = vk_gpu_driven::LIGHT_DIRECTION,
+                    .terrain = m_terrain.address,
+                };
+                if (m_albedo.has_value()) {
+                    const auto& streamer = *m_albedo->streamer;
+                    pushConstants.frame = static_cast<uint32_t>(streamer.frameNumber());
+                    pushConstants.residency = streamer.residencyAddress();
+                    pushConstants.feedback = streamer.feedbackAddress();
+                    pushConstants.albedo = streamer.shaderInfo(m_albedo->texture);
+                    pushConstants.albedoImage = m_albedoImageSlot;
+                    pushConstants.albedoSampler = m_albedoSamplerSlot;
+                }
+
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->drawPipeline(colorFormat));
+                vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+                vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+                if (m_shadingRate.has_value()) {
+                    vk_shading_rate::setDrawShadingRate(commandBuffer, *m_shadingRate);
+                }
+                if (m_albedo.has_value()) {
+                    m_albedo->descriptorHeap->bind(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS);
+                }
+                vkCmdPushConstants(commandBuffer, m_pipelineLayout, this->pushConstantStages(), 0, sizeof(DrawPushConstants), &pushConstants);
+                vkCmdBindIndexBuffer(commandBuffer, m_indices.buffer, 0, VK_INDEX_TYPE_UINT16);
+                for (uint32_t level = 0; level < m_levelCount; level++) {
+                    if (!m_uploadedLevels[level].has_value()) {
+                        continue;
+                    }
+
+                    // The level inside, in this level's cells, when it is there to leave a hole for.
+                    auto innerOffset = std::optional<glm::ivec2> {};
+                    if (level > 0 && m_uploadedLevels[level - 1].has_value()) {
+                        innerOffset = m_levels[level - 1].origin / 2 - m_levels[level].origin;
+                    }
+                    const auto variant = vk_terrain::ringVariant(innerOffset);
+                    // The level is the draw's instance, which the vertex shader finds it by.
+                    vkCmdDrawIndexed(commandBuffer, m_ringIndexCounts[variant], 1, m_ringIndexOffsets[variant], 0, level);
+                }
+            }
+        private:
+            struct BufferAllocation {
+                vk_memory::ScopedAllocation memory;
+                vk_handles::Buffer buffer;
+                VkDeviceAddress address = 0;
+            };
+
+            VkDevice m_device = VK_NULL_HANDLE;
+            const VkAllocationCallbacks* m_allocator = nullptr;
+            vk_memory::DeviceMemoryAllocator* m_memoryAllocator = nullptr;
+            vk_shaders::ShaderLibrary* m_shaderLibrary = nullptr;
+            vk_pipelines::PipelineRegistry* m_pipelineRegistry = nullptr;
+            vk_pipelines::PipelineCompiler* m_pipelineCompiler = nullptr;
+            VkSampleCountFlagBits m_samples = VK_SAMPLE_COUNT_1_BIT;
+            VkFormat m_depthFormat = VK_FORMAT_D32_SFLOAT;
+            std::optional<vk_shading_rate::DrawShadingRate> m_shadingRate;
+            std::optional<TerrainAlbedo> m_albedo;
+            uint32_t m_albedoImageSlot = 0;
+            uint32_t m_albedoSamplerSlot = 0;
+            uint32_t m_levelCount = 0;
+            // What the GPU's level table holds once the frame's uploads are done.
+            std::array<ClipmapLevel, MAX_LEVELS> m_levels {};
+            // The corner each level's heights were last uploaded around, none before the first.
+            std::vector<std::optional<glm::ivec2>> m_uploadedLevels;
+            HeightTiles m_tiles;
+            BufferAllocation m_terrain;
+            BufferAllocation m_indices;
+            // The whole grid first, then the rings around each of the four places the level
+            // inside can be.
+            std::array<uint32_t, 5> m_ringIndexOffsets {};
+            std::array<uint32_t, 5> m_ringIndexCounts {};
+            VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+            std::vector<std::pair<VkFormat, vk_pipelines::PipelineHandle>> m_drawPipelines;
+            uint64_t m_frameCount = 0;
+
+            BufferAllocation createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, const vk_memory::AllocationCreateInfo& allocationInfo) const {
+                const auto bufferInfo = VkBufferCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                    .size = size,
+                    .usage = usage,
+                    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                };
+
+                auto buffer = VkBuffer {};
+                const auto result = vkCreateBuffer(m_device, &bufferInfo, m_allocator, &buffer);
+                if (result != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create terrain buffer!");
+                }
+
+                auto allocation = BufferAllocation();
+                allocation.buffer = vk_handles::Buffer { m_device, buffer, m_allocator };
+                allocation.memory = vk_memory::ScopedAllocation { *m_memoryAllocator, m_memoryAllocator->allocateForBuffer(buffer, allocationInfo) };
+                if ((usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) != 0) {
+                    allocation.address = vk_memory::bufferDeviceAddress(m_device, buffer);
+                }
+
+                return allocation;
+            }
+
+            // The grid's cells as triangle pairs, the whole grid and then each ring. The indices
+            // never change, so they are written once into host visible memory, device local
+            // where there is such memory.
+            void createIndexBuffer() {
+                const auto cells = static_cast<int32_t>(GRID_SIZE - 1);
+                const auto hole = cells / 2;
+                auto indices = std::vector<uint16_t> {};
+                for (uint32_t variant = 0; variant < m_ringIndexOffsets.size(); variant++) {
+                    const auto place = variant == 0 ? 0 : static_cast<int32_t>(variant) - 1;
+                    const auto first = glm::ivec2 { static_cast<int32_t>(GRID_SIZE / 4) } + glm::ivec2 { place & 1, place >> 1 };
+                    m_ringIndexOffsets[variant] = static_cast<uint32_t>(indices.size());
+                    for (int32_t z = 0; z < cells; z++) {
+                        for (int32_t x = 0; x < cells; x++) {
+                            const bool inside = x >= first.x && x < first.x + hole && z >= first.y && z < first.y + hole;
+                            if (variant > 0 && inside) {
+                                continue;
+                            }
+
+                            const auto corner = static_cast<uint16_t>(z * static_cast<int32_t>(GRID_SIZE) + x);
+                            const auto below = static_cast<uint16_t>(corner + GRID_SIZE);
+                            indices.insert(indices.end(), { corner, static_cast<uint16_t>(corner + 1), below, static_cast<uint16_t>(corner + 1), static_cast<uint16_t>(below + 1), below });
+                        }
+                    }
+                    m_ringIndexCounts[variant] = static_cast<uint32_t>(indices.size()) - m_ringIndexOffsets[variant];
+                }
+
+                m_indices = this->createBuffer(
+                    indices.size() * sizeof(uint16_t),
+                    VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                    vk_memory::AllocationCreateInfo {
+                        .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                        .preferredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                    }
+                );
+                std::memcpy(m_indices.memory.get().mappedData, indices.data(), indices.size() * sizeof(uint16_t));
+            }
+
+            // One copy for each run of a row of `region` that is contiguous in the level's ring,
+            // two where the row wraps around it, out of `offset` in the upload arena.
+            void appendCopies(std::vector<VkBufferCopy>& regions, uint32_t level, const Region& region, VkDeviceSize offset) const {
+                const auto mask = static_cast<int32_t>(RING_SIZE - 1);
+                const auto levelOffset = HEIGHTS_OFFSET + VkDeviceSize { level } * RING_SIZE * RING_SIZE * sizeof(float);
+                for (int32_t z = 0; z < region.size.y; z++) {
+                    const auto row = static_cast<VkDeviceSize>((region.origin.y + z) & mask) * RING_SIZE;
+                    auto x = 0;
+                    while (x < region.size.x) {
+                        const auto column = (region.origin.x + x) & mask;
+                        const auto count = std::min(static_cast<int32_t>(RING_SIZE) - column, region.size.x - x);
+                        regions.push_back(VkBufferCopy {
+                            .srcOffset = offset + static_cast<VkDeviceSize>(z * region.size.x + x) * sizeof(float),
+                            .dstOffset = levelOffset + (row + static_cast<VkDeviceSize>(column)) * sizeof(float),
+                            .size = static_cast<VkDeviceSize>(count) * sizeof(float),
+                        });
+                        x += count;
+                    }
+                }
+            }
+
+            // A streamed albedo is drawn with the descriptor heap's layout, which every pipeline
+            // sampling out of the heap shares.
+            void createPipelineLayout() {
+                if (m_albedo.has_value()) {
+                    m_pipelineLayout = m_albedo->descriptorHeap->pipelineLayout();
+                    return;
+                }
+
+                const auto range = VkPushConstantRange {
+                    .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+                    .offset = 0,
+                    .size = sizeof(DrawPushConstants),
+                };
+                const auto layoutInfo = VkPipelineLayoutCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+                    .pushConstantRangeCount = 1,
+                    .pPushConstantRanges = &range,
+                };
+
+                const auto result = vkCreatePipelineLayout(m_device, &layoutInfo, m_allocator, &m_pipelineLayout);
+                if (result != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create terrain pipeline layout!");
+                }
+            }
+
+            // The streamed albedo's view lives in `VK_IMAGE_LAYOUT_GENERAL`, and repeats across
+            // the terrain.
+            void addAlbedoDescriptors() {
+                const auto imageSlot = m_albedo->descriptorHeap->addSampledImage(m_albedo->streamer->view(m_albedo->texture), VK_IMAGE_LAYOUT_GENERAL);
+                if (!imageSlot.has_value()) {
+                    throw std::runtime_error("failed to add the terrain albedo to the descriptor heap!");
+                }
+
+                const auto samplerInfo = VkSamplerCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+                    .magFilter = VK_FILTER_LINEAR,
+                    .minFilter = VK_FILTER_LINEAR,
+                    .mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
+                    .addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+                    .addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+                    .addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+                    .maxLod = VK_LOD_CLAMP_NONE,
+                };
+                const auto samplerSlot = m_albedo->descriptorHeap->addSampler(m_albedo->samplerCache->sampler(samplerInfo));
+                if (!samplerSlot.has_value()) {
+                    m_albedo->descriptorHeap->release(vk_descriptors::DescriptorKind::SampledImage, imageSlot.value(), 0);
+                    throw std::runtime_error("failed to add the terrain albedo sampler to the descriptor heap!");
+                }
+
+                m_albedoImageSlot = imageSlot.value();
+                m_albedoSamplerSlot = samplerSlot.value();
+            }
+
+            const char* fragmentShader() const {
+                return m_albedo.has_value() ? "terrain_streamed.frag" : "terrain.frag";
+            }
+
+            VkShaderStageFlags pushConstantStages() const {
+                return m_albedo.has_value() ? VkShaderStageFlags { VK_SHADER_STAGE_ALL } : VkShaderStageFlags { VK_SHADER_STAGE_VERTEX_BIT };
+            }
+
+            // The terrain is opaque and drawn after the scene, into its depth. Only the viewport
+            // and scissor are dynamic, which also overrides whatever state the scene left
+            // dynamic.
+            //
+            // The pipeline is requested from the pipeline compiler, and draws unoptimized until
+            // the optimized one has compiled.
+            VkPipeline drawPipeline(VkFormat colorFormat) {
+                const auto existing = std::find_if(m_drawPipelines.begin(), m_drawPipelines.end(), [colorFormat](const auto& entry) {
+                    return entry.first == colorFormat;
+                });
+                if (existing != m_drawPipelines.end()) {
+                    return m_pipelineCompiler->pipeline(existing->second);
+                }
+
+                const auto handle = vk_pipelines::requestGraphicsPipeline(*m_pipelineCompiler, *m_pipelineRegistry, m_device, [this, colorFormat](VkPipelineCreateFlags flags, auto&& create) {
+                    return this->withDrawPipelineInfo(colorFormat, flags, create);
+                });
+                m_drawPipelines.emplace_back(colorFormat, handle);
+
+                return m_pipelineCompiler->pipeline(handle);
+            }
+
+            // Calls `create` with the create info of the draw pipeline for `colorFormat`, which
+            // only lives for the call, with `extraFlags` added to its create flags.
+            template <typename Create>
+            std::invoke_result_t<Create, const VkGraphicsPipelineCreateInfo&> withDrawPipelineInfo(VkFormat colorFormat, VkPipelineCreateFlags extraFlags, Create&& create) const {
+                const auto stage = [this](VkShaderStageFlagBits stage, const char* shaderName) {
+                    return VkPipelineShaderStageCreateInfo {
+                        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                        .stage = stage,
+                        .module = m_shaderLibrary->shaderModule(shaderName),
+                        .pName = "main",
+                    };
+                };
+                const auto stages = std::array {
+                    stage(VK_SHADER_STAGE_VERTEX_BIT, "terrain.vert"),
+                    stage(VK_SHADER_STAGE_FRAGMENT_BIT, this->fragmentShader()),
+                };
+                const auto vertexInputState = VkPipelineVertexInputStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+                };
+                const auto inputAssemblyState = VkPipelineInputAssemblyStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+                    .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+                };
+                const auto viewportState = VkPipelineViewportStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+                    .viewportCount = 1,
+                    .scissorCount = 1,
+                };
+                const auto rasterizationState = VkPipelineRasterizationStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+                    .polygonMode = VK_POLYGON_MODE_FILL,
+                    .cullMode = VK_CULL_MODE_NONE,
+                    .lineWidth = 1.0f,
+                };
+                const auto multisampleState = VkPipelineMultisampleStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+                    .rasterizationSamples = m_samples,
+                };
+                const auto depthStencilState = VkPipelineDepthStencilStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+                    .depthTestEnable = VK_TRUE,
+                    .depthWriteEnable = VK_TRUE,
+                    .depthCompareOp = vk_gpu_driven::DEPTH_COMPARE_OP,
+                };
+                const auto colorBlendAttachment = VkPipelineColorBlendAttachmentState {
+                    .blendEnable = VK_FALSE,
+                    .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+                };
+                const auto colorBlendState = VkPipelineColorBlendStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+                    .attachmentCount = 1,
+                    .pAttachments = &colorBlendAttachment,
+                };
+                auto dynamicStates = std::vector { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+                if (m_shadingRate.has_value()) {
+                    dynamicStates.push_back(VK_DYNAMIC_STATE_FRAGMENT_SHADING_RATE_KHR);
+                }
+                const auto dynamicState = VkPipelineDynamicStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+                    .dynamicStateCount = static_cast<uint32_t>(dynamicStates.size()),
+                    .pDynamicStates = dynamicStates.data(),
+                };
+                const auto renderingInfo = VkPipelineRenderingCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
+                    .colorAttachmentCount = 1,
+                    .pColorAttachmentFormats = &colorFormat,
+                    .depthAttachmentFormat = m_depthFormat,
+                };
+                const auto pipelineInfo = VkGraphicsPipelineCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+                    .pNext = &renderingInfo,
+                    .flags = extraFlags | (m_albedo.has_value() ? m_albedo->descriptorHeap->pipelineCreateFlags() : VkPipelineCreateFlags { 0 }) | (m_shadingRate.has_value() && m_shadingRate->attachment
+                        ? VkPipelineCreateFlags { VK_PIPELINE_CREATE_RENDERING_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR }
+                        : VkPipelineCreateFlags { 0 }),
+                    .stageCount = static_cast<uint32_t>(stages.size()),
+                    .pStages = stages.data(),
+                    .pVertexInputState = &vertexInputState,
+                    .pInputAssemblyState = &inputAssemblyState,
+                    .pViewportState = &viewportState,
+                    .pRasterizationState = &rasterizationState,
+                    .pMultisampleState = &multisampleState,
+                    .pDepthStencilState = &depthStencilState,
+                    .pColorBlendState = &colorBlendState,
+                    .pDynamicState = &dynamicState,
+                    .layout = m_pipelineLayout,
+                };
+
+                return create(pipelineInfo);
+            }
+    };
+}
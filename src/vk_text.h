@@ -0,0 +1,407 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "vk_frame_budget.h"
+#include "vk_handles.h"
+#include "vk_jobs.h"
+#include "vk_memory.h"
+#include "vk_overlay.h"
+#include "vk_sprites.h"
+#include "vk_upload.h"
+
+
+namespace vk_text {
+    // The glyphs are the overlay's three by five font, drawn as strokes between the centers of
+    // its lit cells, each cell `UNIT` texels a side in the atlas, with `PADDING` texels around
+    // for the distance outside the strokes.
+    constexpr uint32_t UNIT = 8;
+    constexpr uint32_t PADDING = 4;
+    constexpr uint32_t GLYPH_WIDTH = 3 * UNIT + 2 * PADDING;
+    constexpr uint32_t GLYPH_HEIGHT = 5 * UNIT + 2 * PADDING;
+
+    // The half width of a stroke in cells, and how far from its edge the distance field goes
+    // in texels before it saturates.
+    constexpr float STROKE_RADIUS = 0.45f;
+    constexpr float SPREAD = static_cast<float>(PADDING);
+
+    // Characters are four cells apart, a column between each.
+    constexpr float ADVANCE = 4.0f;
+
+    constexpr VkFormat ATLAS_FORMAT = VK_FORMAT_R8_UNORM;
+    constexpr uint32_t ATLAS_SIZE = 512;
+
+    // Between the centers of two cells, in cells from the glyph's top left corner. Both ends
+    // are the same for a cell with no neighbours.
+    struct Stroke {
+        glm::vec2 from;
+        glm::vec2 to;
+    };
+
+    // Every lit cell is joined to the lit cells beside and below it, and diagonally to the lit
+    // cells below it that no such stroke already turns the corner to.
+    inline std::vector<Stroke> glyphStrokes(uint32_t glyph) {
+        const auto bitmap = vk_overlay::GLYPH_BITMAPS[glyph % vk_overlay::GLYPH_COUNT];
+        const auto lit = [bitmap](int32_t column, int32_t row) {
+            return column >= 0 && column < 3 && row >= 0 && row < 5 && ((bitmap >> (row * 3 + column)) & 1) != 0;
+        };
+        const auto center = [](int32_t column, int32_t row) {
+            return glm::vec2 { static_cast<float>(column) + 0.5f, static_cast<float>(row) + 0.5f };
+        };
+
+        auto strokes = std::vector<Stroke> {};
+        for (int32_t row = 0; row < 5; row++) {
+            for (int32_t column = 0; column < 3; column++) {
+                if (!lit(column, row)) {
+                    continue;
+                }
+
+                strokes.push_back(Stroke { center(column, row), center(column, row) });
+                if (lit(column + 1, row)) {
+                    strokes.push_back(Stroke { center(column, row), center(column + 1, row) });
+                }
+                if (lit(column, row + 1)) {
+                    strokes.push_back(Stroke { center(column, row), center(column, row + 1) });
+                }
+                if (lit(column + 1, row + 1) && !lit(column + 1, row) && !lit(column, row + 1)) {
+                    strokes.push_back(Stroke { center(column, row), center(column + 1, row + 1) });
+                }
+                if (lit(column - 1, row + 1) && !lit(column - 1, row) && !lit(column, row + 1)) {
+                    strokes.push_back(Stroke { center(column, row), center(column - 1, row + 1) });
+                }
+            }
+        }
+
+        return strokes;
+    }
+
+    // The `GLYPH_WIDTH` by `GLYPH_HEIGHT` distance field of `glyph`, a row at a time: one half
+    // on the edge of its strokes, rising to one `SPREAD` texels inside and falling to zero as
+    // far outside.
+    inline std::vector<uint8_t> rasterizeGlyph(uint32_t glyph) {
+        const auto strokes = glyphStrokes(glyph);
+        auto texels = std::vector<uint8_t>(GLYPH_WIDTH * GLYPH_HEIGHT, 0);
+        for (uint32_t y = 0; y < GLYPH_HEIGHT; y++) {
+            for (uint32_t x = 0; x < GLYPH_WIDTH; x++) {
+                const auto texel = glm::vec2 { static_cast<float>(x), static_cast<float>(y) } + 0.5f - static_cast<float>(PADDING);
+                const auto p = texel / static_cast<float>(UNIT);
+                auto distance = std::numeric_limits<float>::max();
+                for (const auto& stroke : strokes) {
+                    const auto along = stroke.to - stroke.from;
+                    const auto lengthSquared = glm::dot(along, along);
+                    const auto t = lengthSquared > 0.0f ? std::clamp(glm::dot(p - stroke.from, along) / lengthSquared, 0.0f, 1.0f) : 0.0f;
+                    distance = std::min(distance, glm::length(p - (stroke.from + t * along)));
+                }
+
+                const auto signedTexels = (distance - STROKE_RADIUS) * static_cast<float>(UNIT);
+                const auto value = std::clamp(0.5f - 0.5f * signedTexels / SPREAD, 0.0f, 1.0f);
+                texels[y * GLYPH_WIDTH + x] = static_cast<uint8_t>(std::lround(value * 255.0f));
+            }
+        }
+
+        return texels;
+    }
+
+    // Packs rectangles into rows as tall as the first rectangle each row was opened for, first
+    // fit, with a texel between neighbours so filtering never reaches into the next one.
+    // Nothing is ever freed.
+    class ShelfPacker {
+        public:
+            explicit ShelfPacker() = default;
+
+            explicit ShelfPacker(uint32_t width, uint32_t height)
+                : m_width { width }
+                , m_height { height }
+            {
+            }
+
+            std::optional<VkOffset2D> allocate(uint32_t width, uint32_t height) {
+                for (auto& shelf : m_shelves) {
+                    if (height <= shelf.height && shelf.x + width <= m_width) {
+                        const auto offset = VkOffset2D { static_cast<int32_t>(shelf.x), static_cast<int32_t>(shelf.y) };
+                        shelf.x += width + 1;
+
+                        return offset;
+                    }
+                }
+
+                if (m_nextY + height > m_height || width > m_width) {
+                    return std::nullopt;
+                }
+
+                m_shelves.push_back(Shelf { m_nextY, height, width + 1 });
+                m_nextY += height + 1;
+
+                return VkOffset2D { 0, static_cast<int32_t>(m_shelves.back().y) };
+            }
+        private:
+            struct Shelf {
+                uint32_t y;
+                uint32_t height;
+                uint32_t x;
+            };
+
+            uint32_t m_width = 0;
+            uint32_t m_height = 0;
+            uint32_t m_nextY = 0;
+            std::vector<Shelf> m_shelves;
+    };
+
+    // Draws text of any size through the sprite batcher, from one distance field per glyph in
+    // an atlas that fills in as text asks for it. A glyph is rasterized on a background worker
+    // the first time it is drawn, uploaded into its place in the atlas by the next frame's
+    // uploads, and drawn once the upload is complete, so labels never wait on the CPU and
+    // appear a character at a time on the frames after their glyphs are first seen.
+    //
+    // Every glyph is a sprite of the atlas's texture, so any number of labels on one layer is
+    // a single draw, and changing their text costs nothing but the sprites.
+    class TextRenderer {
+        public:
+            explicit TextRenderer() = default;
+
+            TextRenderer(const TextRenderer& other) = delete;
+            TextRenderer& operator=(const TextRenderer& other) = delete;
+
+            // The atlas is registered with `spriteBatcher`, and cleared by the first
+            // `streamUploads`. `jobSystem` has to outlive the renderer.
+            void init(
+                VkDevice device,
+                const VkAllocationCallbacks* allocator,
+                vk_memory::DeviceMemoryAllocator& memoryAllocator,
+                vk_jobs::JobSystem& jobSystem,
+                vk_sprites::SpriteBatcher& spriteBatcher
+            ) {
+                const auto imageInfo = VkImageCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+                    .imageType = VK_IMAGE_TYPE_2D,
+                    .format = ATLAS_FORMAT,
+                    .extent = VkExtent3D { ATLAS_SIZE, ATLAS_SIZE, 1 },
+                    .mipLevels = 1,
+                    .arrayLayers = 1,
+                    .samples = VK_SAMPLE_COUNT_1_BIT,
+                    .tiling = VK_IMAGE_TILING_OPTIMAL,
+                    .usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+                    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                    .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                };
+
+                auto image = VkImage {};
+                const auto imageResult = vkCreateImage(device, &imageInfo, allocator, &image);
+                if (imageResult != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create glyph atlas image!");
+                }
+
+                m_image = vk_handles::Image { device, image, allocator };
+                m_memory = vk_memory::ScopedAllocation {
+                    memoryAllocator,
+                    memoryAllocator.allocateForImage(image, vk_memory::AllocationCreateInfo {
+                        .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                        .kind = vk_memory::ResourceKind::Optimal,
+                        .priority = vk_memory::MemoryPriority::Low,
+                    }),
+                };
+
+                const auto viewInfo = VkImageViewCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+                    .image = image,
+                    .viewType = VK_IMAGE_VIEW_TYPE_2D,
+                    .format = ATLAS_FORMAT,
+                    .subresourceRange = VkImageSubresourceRange {
+                        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                        .baseMipLevel = 0,
+                        .levelCount = 1,
+                        .baseArrayLayer = 0,
+                        .layerCount = 1,
+                    },
+                };
+
+                auto imageView = VkImageView {};
+                const auto viewResult = vkCreateImageView(device, &viewInfo, allocator, &imageView);
+                if (viewResult != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create glyph atlas image view!");
+                }
+
+                m_view = vk_handles::ImageView { device, imageView, allocator };
+
+                // Glyphs are copied into the atlas while others are being sampled, so it stays
+                // in the general layout.
+                const auto texture = spriteBatcher.addTexture(imageView, VK_IMAGE_LAYOUT_GENERAL);
+                if (!texture.has_value()) {
+                    throw std::runtime_error("failed to add the glyph atlas to the descriptor heap!");
+                }
+
+                m_texture = texture.value() | vk_sprites::DISTANCE_FIELD;
+                m_jobSystem = &jobSystem;
+                m_packer = ShelfPacker { ATLAS_SIZE, ATLAS_SIZE };
+                m_cleared = false;
+                m_glyphs = {};
+                m_residentGlyphCount = 0;
+            }
+
+            // The device has to be idle. Glyphs still being rasterized finish into buffers of
+            // their own, which the jobs let go of.
+            void destroy() {
+                m_glyphs = {};
+                m_view = vk_handles::ImageView {};
+                m_image = vk_handles::Image {};
+                m_memory = vk_memory::ScopedAllocation {};
+                m_jobSystem = nullptr;
+            }
+
+            bool isInitialized() const {
+                return m_jobSystem != nullptr;
+            }
+
+            // Queues the atlas's clear the first time, and after it the glyphs rasterized since
+            // the last frame, and makes the glyphs whose uploads completed drawable. Glyphs the
+            // staging ring or `budget` has no room for wait for the next frame.
+            void streamUploads(vk_upload::UploadService& uploadService, vk_frame_budget::FrameBudget::Scope& budget) {
+                if (!m_cleared) {
+                    const auto zeros = std::vector<uint8_t>(ATLAS_SIZE * ATLAS_SIZE, 0);
+                    const auto clearInfo = vk_upload::ImageUploadInfo {
+                        .image = m_image.get(),
+                        .extent = VkExtent3D { ATLAS_SIZE, ATLAS_SIZE, 1 },
+                        .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                        .finalLayout = VK_IMAGE_LAYOUT_GENERAL,
+                    };
+                    if (!uploadService.uploadImage(clearInfo, zeros.data(), zeros.size(), VK_ACCESS_SHADER_READ_BIT).has_value()) {
+                        return;
+                    }
+
+                    m_cleared = true;
+                }
+
+                // At least one glyph goes out every frame, however long the clear took.
+                auto uploadedCount = uint32_t { 0 };
+                for (auto& glyph : m_glyphs) {
+                    if (glyph.state == GlyphState::Rasterizing && glyph.job.isFinished()) {
+                        glyph.state = GlyphState::Rasterized;
+                        glyph.job = vk_jobs::JobHandle {};
+                    }
+
+                    if (glyph.state == GlyphState::Rasterized && uploadedCount > 0 && !budget.hasTimeLeft()) {
+                        budget.defer();
+                    } else if (glyph.state == GlyphState::Rasterized) {
+                        const auto uploadInfo = vk_upload::ImageUploadInfo {
+                            .image = m_image.get(),
+                            .offset = VkOffset3D { glyph.position.x, glyph.position.y, 0 },
+                            .extent = VkExtent3D { GLYPH_WIDTH, GLYPH_HEIGHT, 1 },
+                            .oldLayout = VK_IMAGE_LAYOUT_GENERAL,
+                            .finalLayout = VK_IMAGE_LAYOUT_GENERAL,
+                        };
+                        const auto ticket = uploadService.uploadImage(uploadInfo, glyph.texels->data(), glyph.texels->size(), VK_ACCESS_SHADER_READ_BIT);
+                        if (!ticket.has_value()) {
+                            continue;
+                        }
+
+                        glyph.state = GlyphState::Uploading;
+                        glyph.ticket = ticket.value();
+                        glyph.texels.reset();
+                        uploadedCount++;
+                    } else if (glyph.state == GlyphState::Uploading && uploadService.isComplete(glyph.ticket)) {
+                        glyph.state = GlyphState::Resident;
+                        m_residentGlyphCount++;
+                    }
+                }
+            }
+
+            // Adds `text` to `batcher` on `layer`, its cells' top left corner at `position` and
+            // `height` pixels tall, in `color`. Glyphs not yet in the atlas are left out and
+            // asked for. The width of the text in pixels.
+            float draw(vk_sprites::SpriteBatcher& batcher, uint16_t layer, std::string_view text, const glm::vec2& position, float height, uint32_t color) {
+                const auto scale = height / static_cast<float>(5 * UNIT);
+                const auto advance = ADVANCE * static_cast<float>(UNIT) * scale;
+                auto x = position.x;
+                for (const char c : text) {
+                    const auto index = vk_overlay::glyphIndex(c);
+                    auto& glyph = m_glyphs[index];
+                    if (index == 0) {
+                        // The space draws nothing.
+                    } else if (glyph.state == GlyphState::Resident) {
+                        const auto rect = glm::vec4 {
+                            x - static_cast<float>(PADDING) * scale,
+                            position.y - static_cast<float>(PADDING) * scale,
+                            static_cast<float>(GLYPH_WIDTH) * scale,
+                            static_cast<float>(GLYPH_HEIGHT) * scale,
+                        };
+                        const auto textureRect = glm::vec4 {
+                            static_cast<float>(glyph.position.x),
+                            static_cast<float>(glyph.position.y),
+                            static_cast<float>(GLYPH_WIDTH),
+                            static_cast<float>(GLYPH_HEIGHT),
+                        };
+                        batcher.add(layer, m_texture, rect, textureRect, color);
+                    } else if (glyph.state == GlyphState::Missing) {
+                        this->rasterize(index);
+                    }
+                    x += advance;
+                }
+
+                return x - position.x;
+            }
+
+            uint32_t residentGlyphCount() const {
+                return m_residentGlyphCount;
+            }
+        private:
+            enum class GlyphState {
+                Missing,
+                Rasterizing,
+                Rasterized,
+                Uploading,
+                Resident,
+            };
+
+            struct Glyph {
+                GlyphState state = GlyphState::Missing;
+                VkOffset2D position {};
+                vk_jobs::JobHandle job {};
+                // Written by the job, and read once it has finished.
+                std::shared_ptr<std::vector<uint8_t>> texels;
+                vk_upload::UploadTicket ticket {};
+            };
+
+            vk_handles::Image m_image;
+            vk_memory::ScopedAllocation m_memory;
+            vk_handles::ImageView m_view;
+            vk_jobs::JobSystem* m_jobSystem = nullptr;
+            uint32_t m_texture = 0;
+            ShelfPacker m_packer;
+            bool m_cleared = false;
+            std::array<Glyph, vk_overlay::GLYPH_COUNT> m_glyphs {};
+            uint32_t m_residentGlyphCount = 0;
+
+            void rasterize(uint32_t index) {
+                const auto position = m_packer.allocate(GLYPH_WIDTH, GLYPH_HEIGHT);
+                if (!position.has_value()) {
+                    return;
+                }
+
+                auto& glyph = m_glyphs[index];
+                glyph.state = GlyphState::Rasterizing;
+                glyph.position = position.value();
+                glyph.texels = std::make_shared<std::vector<uint8_t>>();
+                glyph.job = m_jobSystem->submit(
+                    [texels = glyph.texels, index]() {
+                        *texels = rasterizeGlyph(index);
+                    },
+                    {},
+                    vk_jobs::JobPriority::Background
+                );
+            }
+    };
+}
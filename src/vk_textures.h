@@ -0,0 +1,527 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "vk_assets.h"
+#include "vk_features.h"
+#include "vk_handles.h"
+#include "vk_jobs.h"
+#include "vk_memory.h"
+#include "vk_upload.h"
+
+
+namespace vk_textures {
+    // The block compressed families textures ship in, best first. BC7 and ASTC 4x4 both take a
+    // byte per texel, and ETC2 the same for RGBA at a visibly lower quality. `None` is plain
+    // RGBA8, four times the memory and bandwidth, for the rare device without any of them.
+    enum class BlockCompression : uint32_t {
+        BC7,
+        ASTC4x4,
+        ETC2,
+        None,
+    };
+
+    constexpr auto BLOCK_COMPRESSION_PREFERENCE = std::array {
+        BlockCompression::BC7,
+        BlockCompression::ASTC4x4,
+        BlockCompression::ETC2,
+        BlockCompression::None,
+    };
+
+    inline const char* blockCompressionToString(BlockCompression compression) {
+        switch (compression) {
+            case BlockCompression::BC7: return "bc7";
+            case BlockCompression::ASTC4x4: return "astc";
+            case BlockCompression::ETC2: return "etc2";
+            case BlockCompression::None: return "rgba8";
+        }
+
+        return "unknown";
+    }
+
+    inline VkFormat formatFor(BlockCompression compression, bool srgb) {
+        switch (compression) {
+            case BlockCompression::BC7: return srgb ? VK_FORMAT_BC7_SRGB_BLOCK : VK_FORMAT_BC7_UNORM_BLOCK;
+            case BlockCompression::ASTC4x4: return srgb ? VK_FORMAT_ASTC_4x4_SRGB_BLOCK : VK_FORMAT_ASTC_4x4_UNORM_BLOCK;
+            case BlockCompression::ETC2: return srgb ? VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK : VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK;
+            case BlockCompression::None: return srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+        }
+
+        return VK_FORMAT_UNDEFINED;
+    }
+
+    // The device feature a family needs enabled before its formats may be used at all.
+    inline std::optional<vk_features::Feature> requiredFeature(BlockCompression compression) {
+        switch (compression) {
+            case BlockCompression::BC7: return vk_features::Feature::TextureCompressionBC;
+            case BlockCompression::ASTC4x4: return vk_features::Feature::TextureCompressionASTC;
+            case BlockCompression::ETC2: return vk_features::Feature::TextureCompressionETC2;
+            case BlockCompression::None: return std::nullopt;
+        }
+
+        return std::nullopt;
+    }
+
+    // Uncompressed formats count as blocks of a single texel.
+    struct BlockInfo {
+        uint32_t width;
+        uint32_t height;
+        uint32_t bytes;
+    };
+
+    inline std::optional<BlockInfo> blockInfo(VkFormat format) {
+        switch (format) {
+            case VK_FORMAT_BC7_UNORM_BLOCK:
+            case VK_FORMAT_BC7_SRGB_BLOCK:
+            case VK_FORMAT_ASTC_4x4_UNORM_BLOCK:
+            case VK_FORMAT_ASTC_4x4_SRGB_BLOCK:
+            case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
+            case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK:
+                return BlockInfo { 4, 4, 16 };
+            case VK_FORMAT_R8G8B8A8_UNORM:
+            case VK_FORMAT_R8G8B8A8_SRGB:
+                return BlockInfo { 1, 1, 4 };
+            default:
+                return std::nullopt;
+        }
+    }
+
+    // Whether textures of `format` can be uploaded to and sampled with linear filtering, which
+    // `textureCompression*` only promises for the family as a whole.
+    inline bool supportsSampling(VkPhysicalDevice physicalDevice, VkFormat format) {
+        auto properties = VkFormatProperties {};
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+
+        const auto required = VkFormatFeatureFlags {
+            VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT | VK_FORMAT_FEATURE_TRANSFER_DST_BIT
+        };
+
+        return (properties.optimalTilingFeatures & required) == required;
+    }
+
+    // The best family the device samples, which decides the variant of every texture loaded.
+    inline BlockCompression selectBlockCompression(VkPhysicalDevice physicalDevice, const vk_features::FeatureSet& features, bool srgb) {
+        for (const auto compression : BLOCK_COMPRESSION_PREFERENCE) {
+            const auto feature = requiredFeature(compression);
+            if (feature.has_value() && !vk_features::has(features, feature.value())) {
+                continue;
+            }
+
+            if (supportsSampling(physicalDevice, formatFor(compression, srgb))) {
+                return compression;
+            }
+        }
+
+        return BlockCompression::None;
+    }
+
+    // The asset pipeline encodes every texture once per family, `brick` as `brick.bc7.ktx2`,
+    // `brick.astc.ktx2`, `brick.etc2.ktx2` and `brick.rgba8.ktx2`, and the device loads the one
+    // it samples, so nothing is transcoded at startup.
+    inline std::filesystem::path variantPath(const std::filesystem::path& basePath, BlockCompression compression) {
+        auto path = basePath;
+        path += std::string { "." } + blockCompressionToString(compression) + ".ktx2";
+
+        return path;
+    }
+
+    constexpr std::array<uint8_t, 12> KTX2_IDENTIFIER = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+
+    // The fixed part of a KTX2 file, with the index of the data format descriptor, key value
+    // data and supercompression global data.
+    struct Ktx2Header {
+        std::array<uint8_t, 12> identifier;
+        VkFormat format;
+        uint32_t typeSize;
+        uint32_t pixelWidth;
+        uint32_t pixelHeight;
+        uint32_t pixelDepth;
+        uint32_t layerCount;
+        uint32_t faceCount;
+        uint32_t levelCount;
+        uint32_t supercompressionScheme;
+        uint32_t dfdByteOffset;
+        uint32_t dfdByteLength;
+        uint32_t kvdByteOffset;
+        uint32_t kvdByteLength;
+        uint64_t sgdByteOffset;
+        uint64_t sgdByteLength;
+    };
+
+    static_assert(sizeof(Ktx2Header) == 80, "Ktx2Header must match the KTX2 layout");
+
+    struct Ktx2Level {
+        uint64_t byteOffset;
+        uint64_t byteLength;
+        uint64_t uncompressedByteLength;
+    };
+
+    static_assert(sizeof(Ktx2Level) == 24, "Ktx2Level must match the KTX2 layout");
+
+    // A mapped KTX2 file holding a 2D texture and its mip chain in a format the device samples
+    // as is. Every level is validated against the size its format implies, so uploads can
+    // copy straight out of the mapping.
+    class TextureFile {
+        public:
+            explicit TextureFile() = default;
+
+            TextureFile(const TextureFile& other) = delete;
+            TextureFile& operator=(const TextureFile& other) = delete;
+
+            // Throws unless the file holds `expectedFormat`, since a variant encoded for another
+            // family would sample as garbage.
+            void open(const std::filesystem::path& path, VkFormat expectedFormat) {
+                m_file.open(path);
+
+                const auto bytes = m_file.bytes();
+                auto header = Ktx2Header {};
+                if (bytes.size() < sizeof(header)) {
+                    m_file.close();
+                    throw std::runtime_error("failed to load texture, file is truncated!");
+                }
+                std::memcpy(&header, bytes.data(), sizeof(header));
+
+                if (header.identifier != KTX2_IDENTIFIER) {
+                    m_file.close();
+                    throw std::runtime_error("failed to load texture, not a KTX2 file!");
+                }
+
+                // Basis Universal files leave the format undefined and are meant to be transcoded
+                // on the device, which needs a transcoder this tree does not carry. The asset
+                // pipeline transcodes them offline into a variant per family instead.
+                if (header.format == VK_FORMAT_UNDEFINED || header.supercompressionScheme != 0) {
+                    m_file.close();
+                    throw std::runtime_error("failed to load texture, supercompressed data is not supported!");
+                }
+
+                const auto block = blockInfo(header.format);
+                if (header.format != expectedFormat || !block.has_value()) {
+                    m_file.close();
+                    throw std::runtime_error("failed to load texture, unexpected format!");
+                }
+
+                if (header.pixelWidth == 0 || header.pixelHeight == 0 || header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount != 1) {
+                    m_file.close();
+                    throw std::runtime_error("failed to load texture, only 2D textures are supported!");
+                }
+
+                const auto levelCount = std::max(header.levelCount, 1u);
+                const auto levelIndexEnd = sizeof(Ktx2Header) + uint64_t { levelCount } * sizeof(Ktx2Level);
+                if (levelIndexEnd > bytes.size() || levelCount > static_cast<uint32_t>(std::bit_width(std::max(header.pixelWidth, header.pixelHeight)))) {
+                    m_file.close();
+                    throw std::runtime_error("failed to load texture, bad level index!");
+                }
+
+                m_format = header.format;
+                m_extent = VkExtent2D { header.pixelWidth, header.pixelHeight };
+                m_levels.resize(levelCount);
+                std::memcpy(m_levels.data(), bytes.data() + sizeof(Ktx2Header), m_levels.size() * sizeof(Ktx2Level));
+
+                for (uint32_t level = 0; level < levelCount; level++) {
+                    const auto extent = this->levelExtent(level);
+                    const auto blocksWide = (extent.width + block->width - 1) / block->width;
+                    const auto blocksHigh = (extent.height + block->height - 1) / block->height;
+                    const auto size = uint64_t { blocksWide } * blocksHigh * block->bytes;
+
+                    const auto& entry = m_levels[level];
+                    if (entry.byteLength != size || entry.byteOffset % block->bytes != 0 || entry.byteOffset > bytes.size() || size > bytes.size() - entry.byteOffset) {
+                        this->close();
+                        throw std::runtime_error("failed to load texture, bad level!");
+                    }
+                }
+            }
+
+            void close() {
+                m_levels.clear();
+                m_file.close();
+            }
+
+            // Starts reading every level in, so the uploads find the pages resident.
+            void prefetch() const {
+                for (const auto& level : m_levels) {
+                    m_file.prefetch(static_cast<size_t>(level.byteOffset), static_cast<size_t>(level.byteLength));
+                }
+            }
+
+            VkFormat format() const {
+                return m_format;
+            }
+
+            VkExtent2D extent() const {
+                return m_extent;
+            }
+
+            uint32_t levelCount() const {
+                return static_cast<uint32_t>(m_levels.size());
+            }
+
+            VkExtent2D levelExtent(uint32_t level) const {
+                return VkExtent2D { std::max(m_extent.width >> level, 1u), std::max(m_extent.height >> level, 1u) };
+            }
+
+            std::span<const std::byte> levelData(uint32_t level) const {
+                const auto& entry = m_levels[level];
+
+                return m_file.bytes().subspan(static_cast<size_t>(entry.byteOffset), static_cast<size_t>(entry.byteLength));
+            }
+        private:
+            vk_assets::MappedFile m_file;
+            VkFormat m_format = VK_FORMAT_UNDEFINED;
+            VkExtent2D m_extent = {};
+            std::vector<Ktx2Level> m_levels;
+    };
+
+    // Opens the variant of every texture in `basePaths` for `compression` on the job system,
+    // one job per texture, each validating its file and starting its pages reading in, so the
+    // disk sees every texture's reads at once instead of one file at a time. Rethrows the
+    // first failure.
+    inline std::vector<TextureFile> openTextureFiles(
+        vk_jobs::JobSystem& jobSystem,
+        std::span<const std::filesystem::path> basePaths,
+        BlockCompression compression,
+        bool srgb
+    ) {
+        auto files = std::vector<TextureFile>(basePaths.size());
+        const auto format = formatFor(compression, srgb);
+
+        auto tasks = vk_jobs::TaskGroup { jobSystem };
+        for (size_t i = 0; i < basePaths.size(); i++) {
+            tasks.run([&files, &basePaths, compression, format, i]() {
+                files[i].open(variantPath(basePaths[i], compression), format);
+                files[i].prefetch();
+            });
+        }
+
+        tasks.wait();
+
+        return files;
+    }
+
+    // Textures that are streamed tile by tile are stored in the asset pack instead, a blob per
+    // level of each variant, `terrain_albedo` as `terrain_albedo.bc7.0`, `terrain_albedo.bc7.1`
+    // and so on, so a tile is gathered straight out of the mapped pack.
+    inline std::string packedLevelName(std::string_view name, BlockCompression compression, uint32_t level) {
+        return std::string { name } + "." + blockCompressionToString(compression) + "." + std::to_string(level);
+    }
+
+    // The levels of a texture in an asset pack, which has to outlive it, with the same view of
+    // them as `TextureFile` has of a file.
+    class PackedTexture {
+        public:
+            explicit PackedTexture() = default;
+
+            PackedTexture(const PackedTexture& other) = delete;
+            PackedTexture& operator=(const PackedTexture& other) = delete;
+
+            // Throws unless the pack holds level 0 of the variant, and every level it holds is
+            // an uncompressed image of `format` and of that level's extent.
+            void open(const vk_assets::AssetPack& pack, std::string_view name, BlockCompression compression, bool srgb) {
+                const auto format = formatFor(compression, srgb);
+                const auto block = blockInfo(format);
+                const auto* first = pack.find(packedLevelName(name, compression, 0));
+                if (first == nullptr || !block.has_value()) {
+                    throw std::runtime_error("failed to load packed texture, no such texture!");
+                }
+
+                m_pack = &pack;
+                m_format = format;
+                m_extent = VkExtent2D { first->width, first->height };
+                m_levels.clear();
+
+                const auto maxLevelCount = static_cast<uint32_t>(std::bit_width(std::max(m_extent.width, m_extent.height)));
+                for (uint32_t level = 0; level < maxLevelCount; level++) {
+                    const auto* entry = pack.find(packedLevelName(name, compression, level));
+                    if (entry == nullptr) {
+                        break;
+                    }
+
+                    const auto extent = this->levelExtent(level);
+                    const auto blocksWide = (extent.width + block->width - 1) / block->width;
+                    const auto blocksHigh = (extent.height + block->height - 1) / block->height;
+                    const auto size = uint64_t { blocksWide } * blocksHigh * block->bytes;
+                    const bool matches = entry->kind == vk_assets::AssetKind::Image
+                        && entry->format == format
+                        && entry->width == extent.width
+                        && entry->height == extent.height
+                        && entry->compression == vk_assets::Compression::None
+                        && entry->size == size;
+                    if (!matches) {
+                        m_levels.clear();
+                        throw std::runtime_error("failed to load packed texture, bad level!");
+                    }
+
+                    m_levels.push_back(entry);
+                }
+            }
+
+            const vk_assets::AssetPack& pack() const {
+                return *m_pack;
+            }
+
+            VkFormat format() const {
+                return m_format;
+            }
+
+            VkExtent2D extent() const {
+                return m_extent;
+            }
+
+            uint32_t levelCount() const {
+                return static_cast<uint32_t>(m_levels.size());
+            }
+
+            VkExtent2D levelExtent(uint32_t level) const {
+                return VkExtent2D { std::max(m_extent.width >> level, 1u), std::max(m_extent.height >> level, 1u) };
+            }
+
+            const vk_assets::PackEntry& levelEntry(uint32_t level) const {
+                return *m_levels[level];
+            }
+
+            std::span<const std::byte> levelData(uint32_t level) const {
+                return m_pack->data(*m_levels[level]);
+            }
+        private:
+            const vk_assets::AssetPack* m_pack = nullptr;
+            VkFormat m_format = VK_FORMAT_UNDEFINED;
+            VkExtent2D m_extent = {};
+            std::vector<const vk_assets::PackEntry*> m_levels;
+    };
+
+    // A sampled texture and how much of its mip chain has been handed to the upload service.
+    // Levels are uploaded smallest first, so a texture whose upload is spread over several
+    // frames has something to show from the first.
+    struct Texture {
+        vk_handles::Image image;
+        vk_memory::ScopedAllocation memory;
+        vk_handles::ImageView view;
+        uint32_t levelCount = 0;
+        uint32_t levelsUploaded = 0;
+        vk_upload::UploadTicket uploadTicket = 0;
+        // Created with `VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT`, so that small levels are written
+        // from the CPU.
+        bool hostCopy = false;
+    };
+
+    // `hostCopy` should only be set where `vk_upload::supportsHostImageCopy` holds for the
+    // file's format.
+    inline Texture createTexture(
+        VkDevice device,
+        const VkAllocationCallbacks* allocator,
+        vk_memory::DeviceMemoryAllocator& memoryAllocator,
+        const TextureFile& file,
+        bool hostCopy = false
+    ) {
+        const auto extent = file.extent();
+        const auto imageInfo = VkImageCreateInfo {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+            .imageType = VK_IMAGE_TYPE_2D,
+            .format = file.format(),
+            .extent = VkExtent3D { extent.width, extent.height, 1 },
+            .mipLevels = file.levelCount(),
+            .arrayLayers = 1,
+            .samples = VK_SAMPLE_COUNT_1_BIT,
+            .tiling = VK_IMAGE_TILING_OPTIMAL,
+            .usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | (hostCopy ? VkImageUsageFlags { VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT } : 0),
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        };
+
+        auto image = VkImage {};
+        const auto imageResult = vkCreateImage(device, &imageInfo, allocator, &image);
+        if (imageResult != VK_SUCCESS) {
+            throw std::runtime_error("failed to create texture image!");
+        }
+
+        auto texture = Texture {
+            .image = vk_handles::Image { device, image, allocator },
+            .memory = vk_memory::ScopedAllocation {
+                memoryAllocator,
+                memoryAllocator.allocateForImage(image, vk_memory::AllocationCreateInfo {
+                    .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                    .kind = vk_memory::ResourceKind::Optimal,
+                    .priority = vk_memory::MemoryPriority::Low,
+                }),
+            },
+            .view = vk_handles::ImageView {},
+            .levelCount = file.levelCount(),
+            .levelsUploaded = 0,
+            .uploadTicket = 0,
+            .hostCopy = hostCopy,
+        };
+
+        const auto viewInfo = VkImageViewCreateInfo {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .image = image,
+            .viewType = VK_IMAGE_VIEW_TYPE_2D,
+            .format = file.format(),
+            .subresourceRange = VkImageSubresourceRange {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .baseMipLevel = 0,
+                .levelCount = file.levelCount(),
+                .baseArrayLayer = 0,
+                .layerCount = 1,
+            },
+        };
+
+        auto imageView = VkImageView {};
+        const auto viewResult = vkCreateImageView(device, &viewInfo, allocator, &imageView);
+        if (viewResult != VK_SUCCESS) {
+            throw std::runtime_error("failed to create texture image view!");
+        }
+
+        texture.view = vk_handles::ImageView { device, imageView, allocator };
+
+        return texture;
+    }
+
+    // Hands the levels not uploaded yet to the upload service, smallest first, until the
+    // staging ring refuses one. Returns the ticket the whole texture is complete at once every
+    // level is queued, and nothing while levels are left for the next call.
+    inline std::optional<vk_upload::UploadTicket> uploadTexture(
+        vk_upload::UploadService& uploadService,
+        Texture& texture,
+        const TextureFile& file,
+        VkAccessFlags dstAccessMask
+    ) {
+        while (texture.levelsUploaded < texture.levelCount) {
+            const auto level = texture.levelCount - 1 - texture.levelsUploaded;
+            const auto extent = file.levelExtent(level);
+            const auto data = file.levelData(level);
+            const auto imageInfo = vk_upload::ImageUploadInfo {
+                .image = texture.image.get(),
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .extent = VkExtent3D { extent.width, extent.height, 1 },
+                .mipLevel = level,
+                .finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                .hostCopy = texture.hostCopy,
+            };
+
+            const auto ticket = uploadService.uploadImage(imageInfo, data.data(), data.size(), dstAccessMask);
+            if (!ticket.has_value()) {
+                return std::nullopt;
+            }
+
+            // Levels copied from the host are complete at once, and must not hold the texture's
+            // ticket back from a staged level queued earlier.
+            texture.levelsUploaded++;
+            texture.uploadTicket = std::max(texture.uploadTicket, ticket.value());
+        }
+
+        return texture.uploadTicket;
+    }
+}
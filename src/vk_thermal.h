@@ -0,0 +1,206 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+
+
+namespace vk_thermal {
+    // A step down in quality: the share of the resolution frames render at, and of the rate
+    // particles are emitted at. Tier 0 is the quality the demo was started with.
+    struct QualityTier {
+        double renderScale;
+        double particleRate;
+    };
+
+    constexpr std::array<QualityTier, 4> QUALITY_TIERS = {
+        QualityTier { .renderScale = 1.0, .particleRate = 1.0 },
+        QualityTier { .renderScale = 0.85, .particleRate = 0.75 },
+        QualityTier { .renderScale = 0.7, .particleRate = 0.5 },
+        QualityTier { .renderScale = 0.5, .particleRate = 0.25 },
+    };
+
+    // The share of the first tier's GPU work a tier costs, taken as its share of the pixels,
+    // which most of a frame's GPU time grows with.
+    inline double relativeCost(uint32_t tier) {
+        const auto scale = QUALITY_TIERS[tier].renderScale;
+
+        return scale * scale;
+    }
+
+    // Finds the thermal throttle signature, GPU time rising while the work it does stays the
+    // same, and steps the quality down to the tier that keeps the frame time where it was
+    // before the GPU got hot.
+    //
+    // Frames are averaged over windows of `WINDOW_FRAMES`. A window's cost is its GPU time
+    // per unit of workload, shader invocations or pixels, whatever the caller counts, and the
+    // lowest cost seen is what the GPU does at full clocks. The throttle factor is how much
+    // slower a window is than that. Only windows whose GPU time takes up most of the frame,
+    // and whose workload is close to the one before, count as evidence: a GPU that waits for
+    // vsync clocks itself down, and a scene that changes costs what it costs.
+    //
+    // Stepping down takes `SUSTAINED_WINDOWS` of evidence in a row, and goes straight to the
+    // first tier that makes up for the factor. Stepping up, the factor has to stay low enough
+    // for the tier above for longer, or the tier has to hold for a while without the GPU
+    // proving either way, in which case the tier above is tried. Each time that trial gets
+    // throttled again soon after, the hold before the next trial doubles, so a GPU that can
+    // only sustain the lower tier settles there instead of bouncing between the two.
+    class ThermalGovernor {
+        public:
+            static constexpr uint32_t WINDOW_FRAMES = 60;
+            static constexpr uint32_t SUSTAINED_WINDOWS = 5;
+            static constexpr uint32_t RECOVERY_WINDOWS = 20;
+            // Windows left out after a change of tier, while swapchains are recreated and the
+            // clocks react to the new load.
+            static constexpr uint32_t SETTLE_WINDOWS = 2;
+            // The share of the frame time the GPU has to be busy for, and how far the workload
+            // may drift from the previous window's, for a window to count.
+            static constexpr double GPU_BOUND_SHARE = 0.75;
+            static constexpr double WORKLOAD_TOLERANCE = 0.1;
+            // How much slower than at full clocks the current tier may render before it steps
+            // down, and how close the tier above has to get before it steps back up.
+            static constexpr double SLOWDOWN_LIMIT = 1.15;
+            static constexpr double RECOVERY_LIMIT = 1.0;
+            static constexpr double INITIAL_HOLD_SECONDS = 60.0;
+            static constexpr double MAX_HOLD_SECONDS = 960.0;
+
+            explicit ThermalGovernor() = default;
+
+            ThermalGovernor(const ThermalGovernor& other) = delete;
+            ThermalGovernor& operator=(const ThermalGovernor& other) = delete;
+
+            void init() {
+                m_enabled = true;
+                m_tier = 0;
+                m_holdSeconds = INITIAL_HOLD_SECONDS;
+                m_secondsAtTier = 0.0;
+                m_probing = false;
+                m_baselineCost.reset();
+                this->startOver();
+            }
+
+            bool isEnabled() const {
+                return m_enabled;
+            }
+
+            uint32_t tier() const {
+                return m_tier;
+            }
+
+            // The last window's throttle factor, one at full clocks.
+            double throttleFactor() const {
+                return m_throttleFactor;
+            }
+
+            // Takes a frame's GPU and CPU frame times and its workload, and returns the tier to
+            // switch to once a window calls for it.
+            std::optional<uint32_t> update(double gpuMilliseconds, double frameMilliseconds, double workload) {
+                if (!m_enabled || !(gpuMilliseconds > 0.0) || !(frameMilliseconds > 0.0) || !(workload > 0.0)) {
+                    return std::nullopt;
+                }
+
+                m_secondsAtTier += frameMilliseconds / 1000.0;
+                m_window.gpuMilliseconds += gpuMilliseconds;
+                m_window.frameMilliseconds += frameMilliseconds;
+                m_window.workload += workload;
+                if (++m_window.frameCount < WINDOW_FRAMES) {
+                    return std::nullopt;
+                }
+
+                const auto window = m_window;
+                m_window = Window {};
+                if (m_settleWindows > 0) {
+                    m_settleWindows--;
+                    return std::nullopt;
+                }
+
+                return this->finishWindow(window);
+            }
+        private:
+            struct Window {
+                double gpuMilliseconds = 0.0;
+                double frameMilliseconds = 0.0;
+                double workload = 0.0;
+                uint32_t frameCount = 0;
+            };
+
+            bool m_enabled = false;
+            uint32_t m_tier = 0;
+            double m_holdSeconds = INITIAL_HOLD_SECONDS;
+            double m_secondsAtTier = 0.0;
+            // Whether the tier was entered from below, to see whether it holds.
+            bool m_probing = false;
+            std::optional<double> m_baselineCost;
+            double m_throttleFactor = 1.0;
+            Window m_window;
+            uint32_t m_settleWindows = 0;
+            std::optional<double> m_lastWorkload;
+            uint32_t m_slowWindows = 0;
+            uint32_t m_recoveredWindows = 0;
+
+            void startOver() {
+                m_window = Window {};
+                m_settleWindows = SETTLE_WINDOWS;
+                m_lastWorkload.reset();
+                m_slowWindows = 0;
+                m_recoveredWindows = 0;
+            }
+
+            std::optional<uint32_t> finishWindow(const Window& window) {
+                const auto frameCount = static_cast<double>(window.frameCount);
+                const auto gpuMilliseconds = window.gpuMilliseconds / frameCount;
+                const auto workload = window.workload / frameCount;
+                const auto cost = gpuMilliseconds / workload;
+                m_baselineCost = std::min(m_baselineCost.value_or(cost), cost);
+                m_throttleFactor = cost / m_baselineCost.value();
+
+                const bool gpuBound = gpuMilliseconds >= GPU_BOUND_SHARE * window.frameMilliseconds / frameCount;
+                const bool steady = m_lastWorkload.has_value() && std::abs(workload - m_lastWorkload.value()) <= WORKLOAD_TOLERANCE * m_lastWorkload.value();
+                m_lastWorkload = workload;
+                if (!gpuBound || !steady) {
+                    m_slowWindows = 0;
+                    m_recoveredWindows = 0;
+                } else if (m_throttleFactor * vk_thermal::relativeCost(m_tier) > SLOWDOWN_LIMIT) {
+                    m_slowWindows++;
+                    m_recoveredWindows = 0;
+                } else if (m_tier > 0 && m_throttleFactor * vk_thermal::relativeCost(m_tier - 1) <= RECOVERY_LIMIT) {
+                    m_slowWindows = 0;
+                    m_recoveredWindows++;
+                } else {
+                    m_slowWindows = 0;
+                    m_recoveredWindows = 0;
+                    if (m_tier > 0 && m_throttleFactor * vk_thermal::relativeCost(m_tier - 1) > SLOWDOWN_LIMIT) {
+                        // Proven too slow for the tier above, which is not worth a trial yet.
+                        m_secondsAtTier = 0.0;
+                    }
+                }
+
+                if (m_slowWindows >= SUSTAINED_WINDOWS && m_tier + 1 < QUALITY_TIERS.size()) {
+                    auto tier = m_tier + 1;
+                    while (tier + 1 < QUALITY_TIERS.size() && m_throttleFactor * vk_thermal::relativeCost(tier) > RECOVERY_LIMIT) {
+                        tier++;
+                    }
+                    if (m_probing && m_secondsAtTier < m_holdSeconds) {
+                        m_holdSeconds = std::min(2.0 * m_holdSeconds, MAX_HOLD_SECONDS);
+                    }
+
+                    return this->switchTier(tier, false);
+                } else if (m_tier > 0 && (m_recoveredWindows >= RECOVERY_WINDOWS || m_secondsAtTier >= m_holdSeconds)) {
+                    return this->switchTier(m_tier - 1, true);
+                }
+
+                return std::nullopt;
+            }
+
+            uint32_t switchTier(uint32_t tier, bool probing) {
+                m_tier = tier;
+                m_probing = probing;
+                m_secondsAtTier = 0.0;
+                this->startOver();
+
+                return tier;
+            }
+    };
+}
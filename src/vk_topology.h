@@ -0,0 +1,353 @@
+#pragma once
+
+// Pulls in `windows.h` on Windows, with the same macros as everywhere else.
+#include "vk_dispatch.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fmt/core.h>
+
+#if defined(__APPLE__)
+#include <pthread.h>
+#include <sys/qos.h>
+#include <sys/sysctl.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+
+namespace vk_topology {
+    struct LogicalCpu {
+        uint32_t index = 0;
+        uint32_t numaNode = 0;
+        // An E-core of a hybrid CPU, or a little core of big.LITTLE, which runs background
+        // work on less power but takes longer over latency critical work.
+        bool efficiency = false;
+    };
+
+    // The logical processors the process may run on. Systems that report no more than that
+    // look like a single NUMA node of performance cores.
+    struct CpuTopology {
+        std::vector<LogicalCpu> cpus;
+
+        bool isHybrid() const {
+            return std::any_of(cpus.begin(), cpus.end(), [](const LogicalCpu& cpu) { return cpu.efficiency; })
+                && std::any_of(cpus.begin(), cpus.end(), [](const LogicalCpu& cpu) { return !cpu.efficiency; });
+        }
+
+        uint32_t numaNodeCount() const {
+            auto nodes = std::vector<uint32_t> {};
+            for (const auto& cpu : cpus) {
+                if (std::find(nodes.begin(), nodes.end(), cpu.numaNode) == nodes.end()) {
+                    nodes.push_back(cpu.numaNode);
+                }
+            }
+
+            return static_cast<uint32_t>(nodes.size());
+        }
+
+        uint32_t efficiencyCount() const {
+            return static_cast<uint32_t>(std::count_if(cpus.begin(), cpus.end(), [](const LogicalCpu& cpu) { return cpu.efficiency; }));
+        }
+    };
+
+    // Where the render thread and each kind of job system worker run. Latency critical
+    // threads get the performance cores of the GPU's NUMA node, so the driver's writes to the
+    // command buffers and what it reads back cross no socket interconnect, and background
+    // workers get the efficiency cores, or on systems without any, the other nodes.
+    struct ThreadPlacement {
+        std::vector<uint32_t> latencyCpus;
+        std::vector<uint32_t> backgroundCpus;
+    };
+
+    inline ThreadPlacement placeThreads(const CpuTopology& topology, std::optional<uint32_t> gpuNumaNode) {
+        // Without a known node for the GPU, the first node stands in for it, which is the one
+        // the process usually started on.
+        const auto node = gpuNumaNode.has_value() || topology.cpus.empty()
+            ? gpuNumaNode.value_or(0)
+            : topology.cpus.front().numaNode;
+
+        auto placement = ThreadPlacement {};
+        const bool hybrid = topology.isHybrid();
+        for (const auto& cpu : topology.cpus) {
+            if (hybrid ? cpu.efficiency : cpu.numaNode != node) {
+                placement.backgroundCpus.push_back(cpu.index);
+            } else if (cpu.numaNode == node) {
+                placement.latencyCpus.push_back(cpu.index);
+            }
+        }
+
+        // A hybrid node without performance cores of its own falls back to those of any node.
+        if (placement.latencyCpus.empty()) {
+            for (const auto& cpu : topology.cpus) {
+                if (!cpu.efficiency) {
+                    placement.latencyCpus.push_back(cpu.index);
+                }
+            }
+        }
+
+        return placement;
+    }
+
+    // How many of `workerCount` workers should only run background jobs: as many as there are
+    // background cores, while leaving at least one worker for latency critical jobs. Needs no
+    // GPU, so the job system can be started before there is one.
+    inline uint32_t backgroundWorkerCount(const CpuTopology& topology, uint32_t workerCount) {
+        if (workerCount < 2) {
+            return 0;
+        }
+
+        auto backgroundCpus = size_t { 0 };
+        if (topology.isHybrid()) {
+            backgroundCpus = topology.efficiencyCount();
+        } else if (topology.numaNodeCount() > 1) {
+            const auto firstNode = topology.cpus.front().numaNode;
+            backgroundCpus = static_cast<size_t>(std::count_if(topology.cpus.begin(), topology.cpus.end(), [firstNode](const LogicalCpu& cpu) {
+                return cpu.numaNode != firstNode;
+            }));
+        }
+
+        return static_cast<uint32_t>(std::min(backgroundCpus, size_t { workerCount - 1 }));
+    }
+
+#if defined(__linux__)
+    namespace detail {
+        // A sysfs list like `0-3,8,10-11`.
+        inline std::vector<uint32_t> parseCpuList(const std::string& list) {
+            auto cpus = std::vector<uint32_t> {};
+            size_t position = 0;
+            while (position < list.size()) {
+                const auto end = std::min(list.find(',', position), list.size());
+                const auto range = list.substr(position, end - position);
+                const auto dash = range.find('-');
+                try {
+                    const auto first = static_cast<uint32_t>(std::stoul(range.substr(0, dash)));
+                    const auto last = dash == std::string::npos ? first : static_cast<uint32_t>(std::stoul(range.substr(dash + 1)));
+                    for (auto cpu = first; cpu <= last; cpu++) {
+                        cpus.push_back(cpu);
+                    }
+                } catch (const std::exception&) {
+                    // Blank lists and trailing newlines have nothing to add.
+                }
+                position = end + 1;
+            }
+
+            return cpus;
+        }
+
+        inline std::string readLine(const std::filesystem::path& path) {
+            auto file = std::ifstream { path };
+            auto line = std::string {};
+            std::getline(file, line);
+
+            return line;
+        }
+    }
+#endif
+
+    // Asks the kernel which logical processors there are, on which node, and of which kind.
+    // Windows reports processor group 0 only, the first 64 logical processors.
+    inline CpuTopology detect() {
+        auto topology = CpuTopology {};
+
+#if defined(__linux__)
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        const bool hasAffinity = ::sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+        for (const auto cpu : detail::parseCpuList(detail::readLine("/sys/devices/system/cpu/online"))) {
+            if (!hasAffinity || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))) {
+                topology.cpus.push_back(LogicalCpu { .index = cpu });
+            }
+        }
+
+        auto error = std::error_code {};
+        for (const auto& entry : std::filesystem::directory_iterator { "/sys/devices/system/node", error }) {
+            const auto name = entry.path().filename().string();
+            if (name.rfind("node", 0) != 0 || name.size() == 4 || !std::all_of(name.begin() + 4, name.end(), ::isdigit)) {
+                continue;
+            }
+
+            const auto node = static_cast<uint32_t>(std::stoul(name.substr(4)));
+            for (const auto cpu : detail::parseCpuList(detail::readLine(entry.path() / "cpulist"))) {
+                for (auto& logicalCpu : topology.cpus) {
+                    if (logicalCpu.index == cpu) {
+                        logicalCpu.numaNode = node;
+                    }
+                }
+            }
+        }
+
+        // Intel hybrid CPUs register a PMU per core type, and ARM ones report each core's
+        // capacity relative to the largest, which is 1024.
+        const auto atomCpus = detail::parseCpuList(detail::readLine("/sys/devices/cpu_atom/cpus"));
+        for (auto& cpu : topology.cpus) {
+            if (!atomCpus.empty()) {
+                cpu.efficiency = std::find(atomCpus.begin(), atomCpus.end(), cpu.index) != atomCpus.end();
+            } else {
+                const auto capacity = detail::readLine(fmt::format("/sys/devices/system/cpu/cpu{}/cpu_capacity", cpu.index));
+                cpu.efficiency = !capacity.empty() && std::stoul(capacity) < 1024;
+            }
+        }
+#elif defined(_WIN32)
+        auto length = DWORD { 0 };
+        GetLogicalProcessorInformationEx(RelationAll, nullptr, &length);
+        auto buffer = std::vector<std::byte>(length);
+        if (length == 0 || !GetLogicalProcessorInformationEx(RelationAll, reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(buffer.data()), &length)) {
+            return topology;
+        }
+
+        // Efficiency classes only order the cores, the highest being the fastest.
+        auto coreMasks = std::vector<std::pair<KAFFINITY, BYTE>> {};
+        auto nodeMasks = std::vector<std::pair<KAFFINITY, uint32_t>> {};
+        auto highestClass = BYTE { 0 };
+        for (DWORD offset = 0; offset < length;) {
+            const auto* info = reinterpret_cast<const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(buffer.data() + offset);
+            if (info->Relationship == RelationProcessorCore && info->Processor.GroupMask[0].Group == 0) {
+                coreMasks.emplace_back(info->Processor.GroupMask[0].Mask, info->Processor.EfficiencyClass);
+                highestClass = std::max(highestClass, info->Processor.EfficiencyClass);
+            } else if (info->Relationship == RelationNumaNode && info->NumaNode.GroupMask.Group == 0) {
+                nodeMasks.emplace_back(info->NumaNode.GroupMask.Mask, static_cast<uint32_t>(info->NumaNode.NodeNumber));
+            }
+            offset += info->Size;
+        }
+
+        for (const auto& [mask, efficiencyClass] : coreMasks) {
+            for (uint32_t cpu = 0; cpu < sizeof(KAFFINITY) * 8; cpu++) {
+                if ((mask & (KAFFINITY { 1 } << cpu)) == 0) {
+                    continue;
+                }
+
+                auto logicalCpu = LogicalCpu { .index = cpu, .efficiency = efficiencyClass < highestClass };
+                for (const auto& [nodeMask, node] : nodeMasks) {
+                    if ((nodeMask & (KAFFINITY { 1 } << cpu)) != 0) {
+                        logicalCpu.numaNode = node;
+                    }
+                }
+                topology.cpus.push_back(logicalCpu);
+            }
+        }
+        std::sort(topology.cpus.begin(), topology.cpus.end(), [](const LogicalCpu& a, const LogicalCpu& b) { return a.index < b.index; });
+#else
+        // macOS hides which processor is which, and places threads by their QoS class, so
+        // only the counts of each kind matter.
+        auto performanceCount = int32_t { 0 };
+        auto efficiencyCount = int32_t { 0 };
+        auto size = sizeof(int32_t);
+        if (::sysctlbyname("hw.perflevel0.logicalcpu", &performanceCount, &size, nullptr, 0) != 0) {
+            performanceCount = static_cast<int32_t>(std::thread::hardware_concurrency());
+        }
+        size = sizeof(int32_t);
+        if (::sysctlbyname("hw.perflevel1.logicalcpu", &efficiencyCount, &size, nullptr, 0) != 0) {
+            efficiencyCount = 0;
+        }
+        for (int32_t i = 0; i < performanceCount + efficiencyCount; i++) {
+            topology.cpus.push_back(LogicalCpu { .index = static_cast<uint32_t>(i), .efficiency = i >= performanceCount });
+        }
+#endif
+
+        return topology;
+    }
+
+    // The NUMA node of the PCIe root the GPU hangs off, which only Linux tells from the
+    // device's PCI address. Needs `VK_EXT_pci_bus_info` in `extensions`, the device's.
+    inline std::optional<uint32_t> gpuNumaNode(
+        [[maybe_unused]] VkPhysicalDevice physicalDevice,
+        [[maybe_unused]] std::span<const VkExtensionProperties> extensions
+    ) {
+#if defined(__linux__)
+        const bool pciBusInfo = std::any_of(extensions.begin(), extensions.end(), [](const VkExtensionProperties& extension) {
+            return std::string_view { extension.extensionName } == VK_EXT_PCI_BUS_INFO_EXTENSION_NAME;
+        });
+        if (!pciBusInfo) {
+            return std::nullopt;
+        }
+
+        auto busInfo = VkPhysicalDevicePCIBusInfoPropertiesEXT {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PCI_BUS_INFO_PROPERTIES_EXT,
+        };
+        auto properties = VkPhysicalDeviceProperties2 {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+            .pNext = &busInfo,
+        };
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+        const auto path = fmt::format(
+            "/sys/bus/pci/devices/{:04x}:{:02x}:{:02x}.{:x}/numa_node",
+            busInfo.pciDomain,
+            busInfo.pciBus,
+            busInfo.pciDevice,
+            busInfo.pciFunction
+        );
+        const auto node = detail::readLine(path);
+        // Single node systems report -1.
+        if (node.empty() || node.front() == '-') {
+            return std::nullopt;
+        }
+
+        return static_cast<uint32_t>(std::stoul(node));
+#else
+        return std::nullopt;
+#endif
+    }
+
+    // Restricts `thread` to `cpus`, leaving the scheduler to pick among them. macOS has no
+    // such thing. Whether the thread was moved.
+    inline bool pinThread([[maybe_unused]] std::thread::native_handle_type thread, std::span<const uint32_t> cpus) {
+        if (cpus.empty()) {
+            return false;
+        }
+
+#if defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (const auto cpu : cpus) {
+            if (cpu < CPU_SETSIZE) {
+                CPU_SET(cpu, &set);
+            }
+        }
+
+        return ::pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+#elif defined(_WIN32)
+        auto mask = DWORD_PTR { 0 };
+        for (const auto cpu : cpus) {
+            if (cpu < sizeof(DWORD_PTR) * 8) {
+                mask |= DWORD_PTR { 1 } << cpu;
+            }
+        }
+
+        return mask != 0 && SetThreadAffinityMask(static_cast<HANDLE>(thread), mask) != 0;
+#else
+        return false;
+#endif
+    }
+
+    inline bool pinCurrentThread(std::span<const uint32_t> cpus) {
+#if defined(_WIN32)
+        return pinThread(GetCurrentThread(), cpus);
+#elif defined(__linux__)
+        return pinThread(::pthread_self(), cpus);
+#else
+        static_cast<void>(cpus);
+        return false;
+#endif
+    }
+
+    // Lowers the calling thread's priority, and on macOS its QoS class, which is what moves
+    // it to the efficiency cores there.
+    inline void markBackgroundThread() {
+#if defined(__APPLE__)
+        ::pthread_set_qos_class_self_np(QOS_CLASS_UTILITY, 0);
+#elif defined(_WIN32)
+        SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+#endif
+    }
+}
@@ -0,0 +1,193 @@
+#pragma once
+
+#include "vk_allocation_tracking.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Set by the build with the `HELLO_WINDOW_TRACY` option, which links the Tracy client. Without
+// it every zone below compiles to nothing.
+#ifndef HELLO_WINDOW_TRACY
+#define HELLO_WINDOW_TRACY 0
+#endif
+
+#if HELLO_WINDOW_TRACY
+#include <tracy/Tracy.hpp>
+#include <tracy/TracyC.h>
+
+// A CPU zone named by a string literal, up to the end of the enclosing scope, which also tags
+// the allocations in it.
+#define VK_TRACING_ZONE(name) ZoneScopedN(name); VK_ALLOCATION_TAG(name)
+// A CPU zone named by a string only known at runtime, like a startup stage's.
+#define VK_TRACING_ZONE_TRANSIENT(name) ZoneTransientN(vkTracingZone, name, true)
+#define VK_TRACING_FRAME() FrameMark
+#else
+#define VK_TRACING_ZONE(name) VK_ALLOCATION_TAG(name)
+#define VK_TRACING_ZONE_TRANSIENT(name)
+#define VK_TRACING_FRAME()
+#endif
+
+
+namespace vk_tracing {
+    // The name the timeline and the allocation report show a thread under.
+    inline void setThreadName(const std::string& name) {
+#if HELLO_WINDOW_ALLOCATION_TRACKING
+        vk_allocation_tracking::tracker.nameThread(name);
+#endif
+#if HELLO_WINDOW_TRACY
+        tracy::SetThreadName(name.c_str());
+#else
+        static_cast<void>(name);
+#endif
+    }
+
+    // A pass the GPU ran, between two raw timestamps of its queue.
+    struct GpuZone {
+        std::string_view name;
+        uint64_t begin;
+        uint64_t end;
+    };
+
+    // Feeds the timestamps `vk_profiling::GpuTimestampProfiler` reads back into a GPU context of
+    // the timeline, so the passes show up under the CPU zones that recorded them. Tracy lines the
+    // context up with the CPU clock by one timestamp of a known CPU time, and spreads the rest
+    // out by the timestamp period. The zones arrive a few frames after they ran.
+    class GpuTimeline {
+        public:
+            // Tracy's `GpuContextType::Vulkan`.
+            static constexpr uint8_t CONTEXT_TYPE_VULKAN = 2;
+
+            explicit GpuTimeline() = default;
+
+            GpuTimeline(const GpuTimeline& other) = delete;
+            GpuTimeline& operator=(const GpuTimeline& other) = delete;
+
+            // `context` tells the queues of the app apart, and `referenceTicks` is the queue's
+            // timestamp at the time of the call.
+            void init(uint8_t context, const char* name, uint64_t referenceTicks, float timestampPeriod) {
+#if HELLO_WINDOW_TRACY
+                m_context = context;
+                ___tracy_emit_gpu_new_context_serial(___tracy_gpu_new_context_data {
+                    .gpuTime = static_cast<int64_t>(referenceTicks),
+                    .period = timestampPeriod,
+                    .context = context,
+                    .flags = 0,
+                    .type = CONTEXT_TYPE_VULKAN,
+                });
+                ___tracy_emit_gpu_context_name_serial(___tracy_gpu_context_name_data {
+                    .context = context,
+                    .name = name,
+                    .len = static_cast<uint16_t>(std::strlen(name)),
+                });
+                m_initialized = true;
+#else
+                static_cast<void>(context);
+                static_cast<void>(name);
+                static_cast<void>(referenceTicks);
+                static_cast<void>(timestampPeriod);
+#endif
+            }
+
+            bool isInitialized() const {
+                return m_initialized;
+            }
+
+            // Moves the context's reference point to `referenceTicks`, the queue's timestamp at
+            // the time of the call, which takes out the drift between the clocks.
+            void sync(uint64_t referenceTicks) {
+#if HELLO_WINDOW_TRACY
+                if (!m_initialized) {
+                    return;
+                }
+
+                ___tracy_emit_gpu_time_sync_serial(___tracy_gpu_time_sync_data {
+                    .gpuTime = static_cast<int64_t>(referenceTicks),
+                    .context = m_context,
+                });
+#else
+                static_cast<void>(referenceTicks);
+#endif
+            }
+
+            // The timeline nests zones by the order they are opened and closed in, so the zones
+            // of a frame are replayed sorted by when they began, the longer first when two
+            // begin together, and each closes before the next one that begins after it ended.
+            void emit(std::vector<GpuZone>& zones) {
+#if HELLO_WINDOW_TRACY
+                if (!m_initialized) {
+                    return;
+                }
+
+                std::sort(zones.begin(), zones.end(), [](const GpuZone& a, const GpuZone& b) {
+                    return a.begin != b.begin ? a.begin < b.begin : a.end > b.end;
+                });
+
+                m_openZones.clear();
+                for (const auto& zone : zones) {
+                    while (!m_openZones.empty() && m_openZones.back().end <= zone.begin) {
+                        this->close(m_openZones.back());
+                        m_openZones.pop_back();
+                    }
+
+                    m_openZones.push_back(this->open(zone));
+                }
+
+                while (!m_openZones.empty()) {
+                    this->close(m_openZones.back());
+                    m_openZones.pop_back();
+                }
+#else
+                static_cast<void>(zones);
+#endif
+            }
+        private:
+            bool m_initialized = false;
+#if HELLO_WINDOW_TRACY
+            struct OpenZone {
+                uint64_t end;
+                uint16_t queryId;
+            };
+
+            uint8_t m_context = 0;
+            uint16_t m_nextQueryId = 0;
+            std::vector<OpenZone> m_openZones;
+
+            // Every zone takes two query ids, which only have to stay unique while its two
+            // timestamps are in flight, here for no longer than `emit`.
+            OpenZone open(const GpuZone& zone) {
+                const auto queryId = m_nextQueryId;
+                m_nextQueryId += 2;
+                const auto sourceLocation = ___tracy_alloc_srcloc_name(0, "", 0, "", 0, zone.name.data(), zone.name.size(), 0);
+                ___tracy_emit_gpu_zone_begin_alloc_serial(___tracy_gpu_zone_begin_data {
+                    .srcloc = sourceLocation,
+                    .queryId = queryId,
+                    .context = m_context,
+                });
+                ___tracy_emit_gpu_time_serial(___tracy_gpu_time_data {
+                    .gpuTime = static_cast<int64_t>(zone.begin),
+                    .queryId = queryId,
+                    .context = m_context,
+                });
+
+                return OpenZone { zone.end, queryId };
+            }
+
+            void close(const OpenZone& zone) {
+                const auto queryId = static_cast<uint16_t>(zone.queryId + 1);
+                ___tracy_emit_gpu_zone_end_serial(___tracy_gpu_zone_end_data {
+                    .queryId = queryId,
+                    .context = m_context,
+                });
+                ___tracy_emit_gpu_time_serial(___tracy_gpu_time_data {
+                    .gpuTime = static_cast<int64_t>(zone.end),
+                    .queryId = queryId,
+                    .context = m_context,
+                });
+            }
+#endif
+    };
+}
@@ -0,0 +1,346 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "vk_jobs.h"
+
+
+namespace vk_transforms {
+    // Every array of a structure of arrays starts on a cache line, and holds a multiple of
+    // `LANE_COUNT` elements, so the kernels never need a scalar tail.
+    constexpr size_t ARRAY_ALIGNMENT = 64;
+    constexpr size_t LANE_COUNT = 4;
+
+    template <typename T>
+    struct AlignedAllocator {
+        using value_type = T;
+
+        AlignedAllocator() = default;
+
+        template <typename U>
+        AlignedAllocator(const AlignedAllocator<U>&) {}
+
+        T* allocate(size_t count) {
+            return static_cast<T*>(::operator new(count * sizeof(T), std::align_val_t { ARRAY_ALIGNMENT }));
+        }
+
+        void deallocate(T* pointer, size_t) {
+            ::operator delete(pointer, std::align_val_t { ARRAY_ALIGNMENT });
+        }
+
+        template <typename U>
+        bool operator==(const AlignedAllocator<U>&) const {
+            return true;
+        }
+    };
+
+    using AlignedFloats = std::vector<float, AlignedAllocator<float>>;
+
+    // The vectors the kernels compute with, one instance per lane. glm only takes its SIMD
+    // paths for the aligned qualifiers, which it offers when `GLM_FORCE_INTRINSICS` is set.
+#if GLM_CONFIG_ALIGNED_GENTYPES == GLM_ENABLE
+    constexpr auto LANE_QUALIFIER = glm::aligned_highp;
+#else
+    constexpr auto LANE_QUALIFIER = glm::packed_highp;
+#endif
+
+    using Lanes = glm::vec<4, float, LANE_QUALIFIER>;
+    using LaneMatrix = glm::mat<4, 4, float, LANE_QUALIFIER>;
+
+    // A world transform the way the shaders read it: the rows of the affine 3x4 matrix, with
+    // the translation in the last column.
+    struct WorldMatrix {
+        std::array<glm::vec4, 3> rows;
+    };
+
+    static_assert(sizeof(WorldMatrix) == 48, "WorldMatrix must match the std430 layout of the shaders");
+
+    // A node's transform relative to its parent, scaled uniformly like the instances.
+    struct LocalTransform {
+        glm::vec3 position = glm::vec3 { 0.0f };
+        glm::quat rotation = glm::quat { 1.0f, 0.0f, 0.0f, 0.0f };
+        float scale = 1.0f;
+    };
+
+    // Writes the world matrices of `transforms` to `destination`, which may be mapped device
+    // memory, and is only ever written.
+    //
+    // The transforms are read `LANE_COUNT` at a time into glm vectors, one transform per lane,
+    // so every operation of the composition works on four transforms at once in glm's SSE or
+    // NEON paths. The composed rows are transposed back to one matrix per transform on the way
+    // out. Scales stay uniform, which keeps the bounding spheres and normal cones of the
+    // culling valid under the transform.
+    inline void composeWorldMatrices(std::span<const LocalTransform> transforms, WorldMatrix* destination) {
+        for (size_t group = 0; group < transforms.size(); group += LANE_COUNT) {
+            const auto laneCount = std::min(LANE_COUNT, transforms.size() - group);
+
+            // The lanes past the end compose the identity, and are never written out.
+            auto position = std::array { Lanes { 0.0f }, Lanes { 0.0f }, Lanes { 0.0f } };
+            auto x = Lanes { 0.0f };
+            auto y = Lanes { 0.0f };
+            auto z = Lanes { 0.0f };
+            auto w = Lanes { 1.0f };
+            auto scale = Lanes { 1.0f };
+            for (size_t lane = 0; lane < laneCount; lane++) {
+                const auto& transform = transforms[group + lane];
+                const auto index = static_cast<glm::length_t>(lane);
+                position[0][index] = transform.position.x;
+                position[1][index] = transform.position.y;
+                position[2][index] = transform.position.z;
+                x[index] = transform.rotation.x;
+                y[index] = transform.rotation.y;
+                z[index] = transform.rotation.z;
+                w[index] = transform.rotation.w;
+                scale[index] = transform.scale;
+            }
+
+            const auto twiceScale = scale + scale;
+
+            // The rotation matrix of a unit quaternion, scaled.
+            const auto xx = x * x;
+            const auto yy = y * y;
+            const auto zz = z * z;
+            const auto xy = x * y;
+            const auto xz = x * z;
+            const auto yz = y * z;
+            const auto wx = w * x;
+            const auto wy = w * y;
+            const auto wz = w * z;
+
+            // Each matrix holds one row of the four transforms as its columns, so its
+            // transpose holds one transform's row per column.
+            const auto rows = std::array {
+                glm::transpose(LaneMatrix {
+                    scale - twiceScale * (yy + zz),
+                    twiceScale * (xy - wz),
+                    twiceScale * (xz + wy),
+                    position[0],
+                }),
+                glm::transpose(LaneMatrix {
+                    twiceScale * (xy + wz),
+                    scale - twiceScale * (xx + zz),
+                    twiceScale * (yz - wx),
+                    position[1],
+                }),
+                glm::transpose(LaneMatrix {
+                    twiceScale * (xz - wy),
+                    twiceScale * (yz + wx),
+                    scale - twiceScale * (xx + yy),
+                    position[2],
+                }),
+            };
+
+            for (size_t lane = 0; lane < laneCount; lane++) {
+                auto& matrix = destination[group + lane];
+                for (size_t row = 0; row < matrix.rows.size(); row++) {
+                    matrix.rows[row] = glm::vec4 { rows[row][static_cast<glm::length_t>(lane)] };
+                }
+            }
+        }
+    }
+
+    inline WorldMatrix toMatrix(const LocalTransform& transform) {
+        const auto rotation = glm::mat3_cast(transform.rotation);
+        auto matrix = WorldMatrix {};
+        for (glm::length_t row = 0; row < 3; row++) {
+            matrix.rows[row] = glm::vec4 {
+                glm::vec3 { rotation[0][row], rotation[1][row], rotation[2][row] } * transform.scale,
+                transform.position[row],
+            };
+        }
+
+        return matrix;
+    }
+
+    // The affine product `parent * child` of two world matrices.
+    inline WorldMatrix multiply(const WorldMatrix& parent, const WorldMatrix& child) {
+        auto matrix = WorldMatrix {};
+        for (size_t row = 0; row < 3; row++) {
+            const auto& p = parent.rows[row];
+            matrix.rows[row] = p.x * child.rows[0] + p.y * child.rows[1] + p.z * child.rows[2] + glm::vec4 { 0.0f, 0.0f, 0.0f, p.w };
+        }
+
+        return matrix;
+    }
+
+    // A transform hierarchy whose world matrices are only recomputed where something moved.
+    //
+    // Nodes are stored in breadth first order, every level of the tree after the one before
+    // it, so a node's parent always comes earlier and a whole level can be updated at once:
+    // `update` walks the levels in order, and splits each one into jobs of consecutive nodes,
+    // which read their parents from the finished level above and write their own entries
+    // only. A node is recomputed when it was set dirty or its parent was recomputed in the
+    // same update, so moving a node refreshes its subtree and nothing else. Until a node is
+    // set dirty, `update` returns right away, so static scenery costs nothing per frame, and
+    // the levels above the shallowest dirty node are never looked at.
+    class TransformHierarchy {
+        public:
+            static constexpr uint32_t NO_PARENT = UINT32_MAX;
+
+            // A job updates at most this many nodes of a level.
+            static constexpr size_t NODES_PER_JOB = 4096;
+
+            explicit TransformHierarchy() = default;
+
+            TransformHierarchy(const TransformHierarchy& other) = delete;
+            TransformHierarchy& operator=(const TransformHierarchy& other) = delete;
+
+            // Appends a node below `parent`, or a root with `NO_PARENT`, and returns its index.
+            // Nodes have to be added level by level: roots first, and every node no shallower
+            // than the one added before it.
+            uint32_t addNode(uint32_t parent, const LocalTransform& local) {
+                if (parent != NO_PARENT && parent >= m_parents.size()) {
+                    throw std::runtime_error("failed to add transform node, unknown parent!");
+                }
+
+                const auto level = parent == NO_PARENT ? 0u : this->levelOf(parent) + 1;
+
+                if (level + 1 < this->levelCount()) {
+                    throw std::runtime_error("failed to add transform node, nodes must be added in breadth first order!");
+                }
+
+                const auto node = static_cast<uint32_t>(m_parents.size());
+                if (level == this->levelCount()) {
+                    m_levelStarts.push_back(node + 1);
+                } else {
+                    m_levelStarts.back() = node + 1;
+                }
+
+                m_parents.push_back(parent);
+                m_locals.push_back(local);
+                m_worlds.push_back(WorldMatrix {});
+                m_dirty.push_back(1);
+                m_updateGenerations.push_back(0);
+                m_firstDirtyLevel = std::min(m_firstDirtyLevel, level);
+
+                return node;
+            }
+
+            void clear() {
+                m_parents.clear();
+                m_locals.clear();
+                m_worlds.clear();
+                m_dirty.clear();
+                m_updateGenerations.clear();
+                m_levelStarts.assign(1, 0);
+                m_firstDirtyLevel = NO_LEVEL;
+            }
+
+            size_t size() const {
+                return m_parents.size();
+            }
+
+            size_t levelCount() const {
+                return m_levelStarts.size() - 1;
+            }
+
+            const LocalTransform& local(uint32_t node) const {
+                return m_locals[node];
+            }
+
+            void setLocal(uint32_t node, const LocalTransform& local) {
+                m_locals[node] = local;
+                m_dirty[node] = 1;
+                m_firstDirtyLevel = std::min(m_firstDirtyLevel, this->levelOf(node));
+            }
+
+            // Valid as of the last `update`.
+            const WorldMatrix& world(uint32_t node) const {
+                return m_worlds[node];
+            }
+
+            bool wasUpdated(uint32_t node) const {
+                return m_updateGenerations[node] == m_generation;
+            }
+
+            // Recomputes the world matrices of every dirty subtree, and returns how many nodes
+            // it recomputed, which `wasUpdated` tells apart until the next update.
+            size_t update(vk_jobs::JobSystem& jobSystem) {
+                if (m_firstDirtyLevel == NO_LEVEL) {
+                    return 0;
+                }
+
+                // Nodes recomputed by an earlier update carry an older generation, so their marks
+                // never need clearing.
+                m_generation++;
+                auto updated = std::vector<size_t> {};
+                for (auto level = m_firstDirtyLevel; level + 1 < m_levelStarts.size(); level++) {
+                    const auto begin = size_t { m_levelStarts[level] };
+                    const auto end = size_t { m_levelStarts[level + 1] };
+                    const auto jobCount = (end - begin + NODES_PER_JOB - 1) / NODES_PER_JOB;
+                    const auto firstJob = updated.size();
+                    updated.resize(firstJob + jobCount, 0);
+
+                    auto tasks = vk_jobs::TaskGroup { jobSystem };
+                    for (size_t job = 0; job < jobCount; job++) {
+                        const auto jobBegin = begin + job * NODES_PER_JOB;
+                        const auto jobEnd = std::min(jobBegin + NODES_PER_JOB, end);
+                        tasks.run([this, &updated, jobIndex = firstJob + job, jobBegin, jobEnd]() {
+                            updated[jobIndex] = this->updateNodes(jobBegin, jobEnd);
+                        });
+                    }
+
+                    tasks.wait();
+                }
+
+                m_firstDirtyLevel = NO_LEVEL;
+
+                auto count = size_t { 0 };
+                for (const auto nodes : updated) {
+                    count += nodes;
+                }
+
+                return count;
+            }
+        private:
+            static constexpr uint32_t NO_LEVEL = UINT32_MAX;
+
+            std::vector<uint32_t> m_parents;
+            std::vector<LocalTransform> m_locals;
+            std::vector<WorldMatrix> m_worlds;
+            // Bytes, not `std::vector<bool>`, whose packed bits jobs on neighboring nodes would
+            // race on.
+            std::vector<uint8_t> m_dirty;
+            std::vector<uint32_t> m_updateGenerations;
+            uint32_t m_generation = 1;
+            // Where each level starts, and one past the last node.
+            std::vector<uint32_t> m_levelStarts = std::vector<uint32_t>(1, 0);
+            uint32_t m_firstDirtyLevel = NO_LEVEL;
+
+            uint32_t levelOf(uint32_t node) const {
+                const auto next = std::upper_bound(m_levelStarts.begin(), m_levelStarts.end(), node);
+
+                return static_cast<uint32_t>(next - m_levelStarts.begin()) - 1;
+            }
+
+            size_t updateNodes(size_t begin, size_t end) {
+                auto count = size_t { 0 };
+                for (auto node = begin; node < end; node++) {
+                    const auto parent = m_parents[node];
+                    const auto parentUpdated = parent != NO_PARENT && m_updateGenerations[parent] == m_generation;
+                    if (m_dirty[node] == 0 && !parentUpdated) {
+                        continue;
+                    }
+
+                    const auto local = toMatrix(m_locals[node]);
+                    m_worlds[node] = parent == NO_PARENT ? local : multiply(m_worlds[parent], local);
+                    m_dirty[node] = 0;
+                    m_updateGenerations[node] = m_generation;
+                    count++;
+                }
+
+                return count;
+            }
+    };
+}
@@ -0,0 +1,846 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "vk_descriptors.h"
+#include "vk_gpu_driven.h"
+#include "vk_handles.h"
+#include "vk_memory.h"
+#include "vk_pipelines.h"
+#include "vk_render_graph.h"
+#include "vk_shaders.h"
+
+
+namespace vk_transparency {
+    enum class Mode : uint32_t {
+        // Weighted blended order independent transparency: every fragment is added into an
+        // accumulation target and multiplied into a revealage target, and one fullscreen pass
+        // blends their average over the scene. Sort free and one pass, but approximate where
+        // fragments of very different opacity overlap.
+        WeightedBlended,
+        // Per pixel linked lists: every fragment is appended to its pixel's list, and the
+        // resolve pass sorts each list and blends it in order, exact for up to
+        // `MAX_SORTED_FRAGMENTS` fragments a pixel.
+        LinkedList,
+    };
+
+    inline const char* modeToString(Mode mode) {
+        switch (mode) {
+            case Mode::WeightedBlended: return "weighted";
+            case Mode::LinkedList: return "linked";
+        }
+
+        return "unknown";
+    }
+
+    constexpr VkFormat ACCUMULATION_FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;
+    constexpr VkFormat REVEALAGE_FORMAT = VK_FORMAT_R16_SFLOAT;
+    constexpr VkFormat HEAD_FORMAT = VK_FORMAT_R32_UINT;
+
+    // The fragments of a pixel the resolve pass sorts. Matches `MAX_SORTED_FRAGMENTS` in
+    // `transparent_resolve.frag`.
+    constexpr uint32_t MAX_SORTED_FRAGMENTS = 16;
+
+    // The list nodes there are for each pixel of the largest window, on average.
+    constexpr uint32_t NODES_PER_PIXEL = 4;
+
+    // Matches `END_OF_LIST` in `transparency.glsl`.
+    constexpr uint32_t END_OF_LIST = 0xffffffffu;
+
+    // Matches `Pane` in `transparency.glsl`.
+    struct Pane {
+        glm::vec4 center;
+        glm::vec4 axisU;
+        glm::vec4 axisV;
+        glm::vec4 color;
+    };
+
+    static_assert(sizeof(Pane) == 64, "Pane must match the std430 layout of the shaders");
+
+    // Matches `FragmentList` in `transparency.glsl`, before its nodes.
+    struct FragmentList {
+        uint32_t count;
+        uint32_t padding[3];
+    };
+
+    constexpr VkDeviceSize NODE_SIZE = 4 * sizeof(uint32_t);
+
+    // Matches `PushConstants` in `transparency.glsl`.
+    struct PushConstants {
+        glm::mat4 viewProjection;
+        VkDeviceAddress panes;
+        VkDeviceAddress list;
+        uint32_t capacity;
+    };
+
+    static_assert(offsetof(PushConstants, capacity) == 80, "PushConstants must match the std430 layout of the shaders");
+
+    // `count` tinted panes of glass across a scene of `fieldSize`, turned every which way and
+    // about twice as wide as the space each of them has, so that plenty of them overlap on
+    // screen.
+    inline std::vector<Pane> scatterPanes(uint32_t count, float fieldSize) {
+        const float spacing = fieldSize / std::cbrt(static_cast<float>(std::max(count, 1u)));
+        auto random = std::mt19937 { 7 };
+        auto position = std::uniform_real_distribution<float> { -0.5f * fieldSize, 0.5f * fieldSize };
+        auto unit = std::uniform_real_distribution<float> { -1.0f, 1.0f };
+        auto channel = std::uniform_real_distribution<float> { 0.2f, 1.0f };
+        auto opacity = std::uniform_real_distribution<float> { 0.2f, 0.6f };
+
+        auto panes = std::vector<Pane> {};
+        panes.reserve(count);
+        for (uint32_t i = 0; i < count; i++) {
+            auto normal = glm::vec3 { unit(random), unit(random), unit(random) };
+            if (glm::dot(normal, normal) < 1e-4f) {
+                normal = glm::vec3 { 0.0f, 0.0f, 1.0f };
+            }
+            normal = glm::normalize(normal);
+            const auto helper = std::abs(normal.y) < 0.9f ? glm::vec3 { 0.0f, 1.0f, 0.0f } : glm::vec3 { 1.0f, 0.0f, 0.0f };
+            const auto u = glm::normalize(glm::cross(helper, normal));
+            const auto v = glm::cross(normal, u);
+            const auto halfSize = spacing * (0.5f + 0.5f * channel(random));
+            panes.push_back(Pane {
+                .center = glm::vec4 { position(random), position(random), position(random), 0.0f },
+                .axisU = glm::vec4 { u * halfSize, 0.0f },
+                .axisV = glm::vec4 { v * halfSize, 0.0f },
+                .color = glm::vec4 { channel(random), channel(random), channel(random), opacity(random) },
+            });
+        }
+
+        return panes;
+    }
+
+    // The frame's fragment list, shared by the windows, which build and resolve it in turn.
+    struct FrameResources {
+        std::optional<vk_render_graph::ResourceId> list;
+    };
+
+    // Where a window's transparent passes draw: `target`, once the main pass drew the scene
+    // into it against `depth`.
+    struct WindowTargets {
+        vk_render_graph::ResourceId target;
+        vk_render_graph::ResourceId depth;
+        VkFormat colorFormat = VK_FORMAT_UNDEFINED;
+        VkExtent2D targetSize {};
+        VkExtent2D renderExtent {};
+    };
+
+    // Transparent panes drawn after the opaque scene without ever being sorted on the CPU, so
+    // their cost follows the pixels they cover rather than their count.
+    //
+    // Both modes test the panes against the scene's depth without writing it, at the scene's
+    // sample count, then blend the result over the scene's resolved color in a fullscreen
+    // pass. Weighted blended transparency accumulates into two transient targets, resolved
+    // within their pass when multisampled. Linked lists take nodes from one pool in a buffer
+    // for every window in turn, with the pixels' heads in a transient storage image, and a
+    // frame's fragments past the pool's capacity are dropped.
+    class TransparencyRenderer {
+        public:
+            explicit TransparencyRenderer() = default;
+
+            TransparencyRenderer(const TransparencyRenderer& other) = delete;
+            TransparencyRenderer& operator=(const TransparencyRenderer& other) = delete;
+
+            // The linked list pool holds `NODES_PER_PIXEL` nodes for each of `maxPixels`.
+            void init(
+                VkDevice device,
+                vk_memory::DeviceMemoryAllocator& memoryAllocator,
+                vk_descriptors::DescriptorLayoutCache& layoutCache,
+                vk_descriptors::SamplerCache& samplerCache,
+                vk_descriptors::FrameDescriptorAllocator& frameDescriptors,
+                vk_shaders::ShaderLibrary& shaderLibrary,
+                vk_pipelines::PipelineRegistry& pipelineRegistry,
+                const VkAllocationCallbacks* allocator,
+                VkSampleCountFlagBits samples,
+                VkFormat depthFormat,
+                Mode mode,
+                std::span<const Pane> panes,
+                uint64_t maxPixels
+            ) {
+                m_device = device;
+                m_allocator = allocator;
+                m_memoryAllocator = &memoryAllocator;
+                m_frameDescriptors = &frameDescriptors;
+                m_shaderLibrary = &shaderLibrary;
+                m_pipelineRegistry = &pipelineRegistry;
+                m_samples = samples;
+                m_depthFormat = depthFormat;
+                m_mode = mode;
+                m_paneCount = static_cast<uint32_t>(panes.size());
+                m_frameCount = 0;
+
+                m_panes = this->createBuffer(
+                    std::max<VkDeviceSize>(panes.size_bytes(), sizeof(Pane)),
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                    vk_memory::AllocationCreateInfo {
+                        .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                        .preferredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                    }
+                );
+                if (!panes.empty()) {
+                    std::memcpy(m_panes.memory.get().mappedData, panes.data(), panes.size_bytes());
+                }
+
+                if (mode == Mode::LinkedList) {
+                    m_capacity = static_cast<uint32_t>(std::min<uint64_t>(std::max<uint64_t>(maxPixels, 1) * NODES_PER_PIXEL, UINT32_MAX - 1));
+                    m_list = this->createBuffer(
+                        sizeof(FragmentList) + VkDeviceSize { m_capacity } * NODE_SIZE,
+                        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                        vk_memory::AllocationCreateInfo {
+                            .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                            .priority = vk_memory::MemoryPriority::High,
+                        }
+                    );
+                    const auto bindings = std::array {
+                        VkDescriptorSetLayoutBinding {
+                            .binding = 0,
+                            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                            .descriptorCount = 1,
+                            .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+                        },
+                    };
+                    m_setLayout = layoutCache.layout(bindings);
+                } else {
+                    const auto bindings = std::array {
+                        VkDescriptorSetLayoutBinding {
+                            .binding = 0,
+                            .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                            .descriptorCount = 1,
+                            .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+                        },
+                        VkDescriptorSetLayoutBinding {
+                            .binding = 1,
+                            .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                            .descriptorCount = 1,
+                            .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+                        },
+                    };
+                    m_setLayout = layoutCache.layout(bindings);
+                    this->createSampler(samplerCache);
+                }
+                this->createPipelineLayout();
+            }
+
+            // The device has to be idle. The set layout and the sampler belong to their caches.
+            void destroy() {
+                if (m_device == VK_NULL_HANDLE) {
+                    return;
+                }
+
+                m_panes = BufferAllocation();
+                m_list = BufferAllocation();
+                m_sampler = VK_NULL_HANDLE;
+                m_drawPipeline = VK_NULL_HANDLE;
+                m_blendPipelines.clear();
+                vkDestroyPipelineLayout(m_device, m_pipelineLayout, m_allocator);
+                m_pipelineLayout = VK_NULL_HANDLE;
+                m_setLayout = VK_NULL_HANDLE;
+                m_device = VK_NULL_HANDLE;
+            }
+
+            bool isInitialized() const {
+                return m_device != VK_NULL_HANDLE;
+            }
+
+            Mode mode() const {
+                return m_mode;
+            }
+
+            uint32_t paneCount() const {
+                return m_paneCount;
+            }
+
+            // Imports the fragment list once for all of the frame's windows, so their passes
+            // take turns with it.
+            FrameResources beginFrame(vk_render_graph::RenderGraph& graph) {
+                auto resources = FrameResources {};
+                if (m_mode == Mode::LinkedList) {
+                    resources.list = graph.importBuffer(
+                        m_list.buffer,
+                        m_frameCount == 0
+                            ? vk_render_graph::ResourceState {}
+                            : vk_render_graph::ResourceState { VK_PIPELINE_STAGE_2_CLEAR_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT }
+                    );
+                }
+                m_frameCount++;
+
+                return resources;
+            }
+
+            // The window's transparent passes, drawn from `camera`.
+            void addPasses(
+                vk_render_graph::RenderGraph& graph,
+                const FrameResources& frame,
+                const WindowTargets& targets,
+                const vk_gpu_driven::SceneCamera& camera
+            ) {
+                if (m_mode == Mode::LinkedList) {
+                    this->addListPasses(graph, frame, targets, camera);
+                } else {
+                    this->addWeightedPasses(graph, targets, camera);
+                }
+            }
+        private:
+            struct BufferAllocation {
+                vk_memory::ScopedAllocation memory;
+                vk_handles::Buffer buffer;
+                VkDeviceAddress address = 0;
+            };
+
+            // The blend pipelines blend the result over the scene, one for each color format.
+            struct PipelineEntry {
+                VkFormat colorFormat = VK_FORMAT_UNDEFINED;
+                VkPipeline pipeline = VK_NULL_HANDLE;
+            };
+
+            VkDevice m_device = VK_NULL_HANDLE;
+            const VkAllocationCallbacks* m_allocator = nullptr;
+            vk_memory::DeviceMemoryAllocator* m_memoryAllocator = nullptr;
+            vk_descriptors::FrameDescriptorAllocator* m_frameDescriptors = nullptr;
+            vk_shaders::ShaderLibrary* m_shaderLibrary = nullptr;
+            vk_pipelines::PipelineRegistry* m_pipelineRegistry = nullptr;
+            VkSampleCountFlagBits m_samples = VK_SAMPLE_COUNT_1_BIT;
+            VkFormat m_depthFormat = VK_FORMAT_D32_SFLOAT;
+            Mode m_mode = Mode::WeightedBlended;
+            uint32_t m_paneCount = 0;
+            uint32_t m_capacity = 0;
+            uint64_t m_frameCount = 0;
+            BufferAllocation m_panes;
+            BufferAllocation m_list;
+            VkSampler m_sampler = VK_NULL_HANDLE;
+            VkDescriptorSetLayout m_setLayout = VK_NULL_HANDLE;
+            VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+            // The panes are drawn the same whatever the window's format, so there is only one.
+            VkPipeline m_drawPipeline = VK_NULL_HANDLE;
+            std::vector<PipelineEntry> m_blendPipelines;
+
+            BufferAllocation createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, const vk_memory::AllocationCreateInfo& allocationInfo) const {
+                const auto bufferInfo = VkBufferCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                    .size = size,
+                    .usage = usage,
+                    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                };
+
+                auto buffer = VkBuffer {};
+                const auto result = vkCreateBuffer(m_device, &bufferInfo, m_allocator, &buffer);
+                if (result != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create transparency buffer!");
+                }
+
+                auto allocation = BufferAllocation();
+                allocation.buffer = vk_handles::Buffer { m_device, buffer, m_allocator };
+                allocation.memory = vk_memory::ScopedAllocation { *m_memoryAllocator, m_memoryAllocator->allocateForBuffer(buffer, allocationInfo) };
+                allocation.address = vk_memory::bufferDeviceAddress(m_device, buffer);
+
+                return allocation;
+            }
+
+            // The targets are read a texel at a time, at the pixel being blended.
+            void createSampler(vk_descriptors::SamplerCache& samplerCache) {
+                const auto samplerInfo = VkSamplerCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+                    .magFilter = VK_FILTER_NEAREST,
+                    .minFilter = VK_FILTER_NEAREST,
+                    .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+                    .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                    .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                    .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                    .minLod = 0.0f,
+                    .maxLod = 0.0f,
+                };
+                m_sampler = samplerCache.sampler(samplerInfo);
+            }
+
+            // One layout for every pipeline: the set is the targets the blend pass reads, or the
+            // list heads, and the push constants are only read by the passes drawing panes and
+            // resolving lists.
+            void createPipelineLayout() {
+                const auto range = VkPushConstantRange {
+                    .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+                    .offset = 0,
+                    .size = sizeof(PushConstants),
+                };
+                const auto layoutInfo = VkPipelineLayoutCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+                    .setLayoutCount = 1,
+                    .pSetLayouts = &m_setLayout,
+                    .pushConstantRangeCount = 1,
+                    .pPushConstantRanges = &range,
+                };
+
+                const auto result = vkCreatePipelineLayout(m_device, &layoutInfo, m_allocator, &m_pipelineLayout);
+                if (result != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create transparency pipeline layout!");
+                }
+            }
+
+            PushConstants pushConstants(const vk_gpu_driven::SceneCamera& camera) const {
+                return PushConstants {
+                    .viewProjection = camera.viewProjection,
+                    .panes = m_panes.address,
+                    .list = m_list.address,
+                    .capacity = m_capacity,
+                };
+            }
+
+            static std::pair<VkViewport, VkRect2D> viewportAndScissor(VkExtent2D renderExtent) {
+                return {
+                    VkViewport {
+                        .x = 0.0f,
+                        .y = 0.0f,
+                        .width = static_cast<float>(renderExtent.width),
+                        .height = static_cast<float>(renderExtent.height),
+                        .minDepth = 0.0f,
+                        .maxDepth = 1.0f,
+                    },
+                    VkRect2D {
+                        .offset = VkOffset2D { 0, 0 },
+                        .extent = renderExtent,
+                    },
+                };
+            }
+
+            static vk_render_graph::ResourceAccess depthAccess(vk_render_graph::ResourceId depth) {
+                return vk_render_graph::read(
+                    depth,
+                    VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+                    VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+                    VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL
+                );
+            }
+
+            static vk_render_graph::ResourceAccess targetAccess(vk_render_graph::ResourceId target) {
+                return vk_render_graph::write(
+                    target,
+                    VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+                    VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+                    VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+                );
+            }
+
+            static VkRenderingAttachmentInfo depthAttachment(VkImageView depthView) {
+                return VkRenderingAttachmentInfo {
+                    .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+                    .imageView = depthView,
+                    .imageLayout = VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL,
+                    .loadOp = VK_ATTACHMENT_LOAD_OP_LOAD,
+                    .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+                };
+            }
+
+            void addWeightedPasses(vk_render_graph::RenderGraph& graph, const WindowTargets& targets, const vk_gpu_driven::SceneCamera& camera) {
+                const bool multisampled = m_samples != VK_SAMPLE_COUNT_1_BIT;
+                const auto createTarget = [&](VkFormat format, VkImageUsageFlags usage, VkSampleCountFlagBits samples) {
+                    return graph.createImage(vk_render_graph::TransientImageInfo {
+                        .format = format,
+                        .extent = targets.targetSize,
+                        .usage = usage,
+                        .samples = samples,
+                    });
+                };
+                const auto sampledUsage = VkImageUsageFlags { VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT };
+                const auto accumulation = createTarget(ACCUMULATION_FORMAT, sampledUsage, VK_SAMPLE_COUNT_1_BIT);
+                const auto revealage = createTarget(REVEALAGE_FORMAT, sampledUsage, VK_SAMPLE_COUNT_1_BIT);
+                auto accesses = std::vector<vk_render_graph::ResourceAccess> {
+                    vk_render_graph::write(accumulation, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL),
+                    vk_render_graph::write(revealage, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL),
+                    TransparencyRenderer::depthAccess(targets.depth),
+                };
+                auto multisampledTargets = std::optional<std::pair<vk_render_graph::ResourceId, vk_render_graph::ResourceId>> {};
+                if (multisampled) {
+                    multisampledTargets = std::pair {
+                        createTarget(ACCUMULATION_FORMAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, m_samples),
+                        createTarget(REVEALAGE_FORMAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, m_samples),
+                    };
+                    accesses.push_back(vk_render_graph::write(multisampledTargets->first, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL));
+                    accesses.push_back(vk_render_graph::write(multisampledTargets->second, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL));
+                }
+
+                graph.addPass(
+                    "transparentAccumulate",
+                    accesses,
+                    [this, &graph, targets, camera, accumulation, revealage, multisampledTargets](VkCommandBuffer commandBuffer) {
+                        const auto attachment = [&](vk_render_graph::ResourceId resolved, std::optional<vk_render_graph::ResourceId> samples, float clear) {
+                            return VkRenderingAttachmentInfo {
+                                .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+                                .imageView = graph.imageView(samples.value_or(resolved)),
+                                .imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                                .resolveMode = samples.has_value() ? VK_RESOLVE_MODE_AVERAGE_BIT : VK_RESOLVE_MODE_NONE,
+                                .resolveImageView = samples.has_value() ? graph.imageView(resolved) : VK_NULL_HANDLE,
+                                .resolveImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                                .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+                                .storeOp = samples.has_value() ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE,
+                                .clearValue = VkClearValue {
+                                    .color = VkClearColorValue { .float32 = { clear, clear, clear, clear } },
+                                },
+                            };
+                        };
+                        // Nothing accumulated, and everything behind revealed.
+                        const auto colorAttachments = std::array {
+                            attachment(accumulation, multisampledTargets.has_value() ? std::optional { multisampledTargets->first } : std::nullopt, 0.0f),
+                            attachment(revealage, multisampledTargets.has_value() ? std::optional { multisampledTargets->second } : std::nullopt, 1.0f),
+                        };
+                        this->recordPanes(commandBuffer, graph, targets, camera, colorAttachments);
+                    }
+                );
+
+                graph.addPass(
+                    "transparentComposite",
+                    {
+                        vk_render_graph::read(accumulation, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+                        vk_render_graph::read(revealage, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+                        TransparencyRenderer::targetAccess(targets.target),
+                    },
+                    [this, &graph, targets, accumulation, revealage](VkCommandBuffer commandBuffer) {
+                        const auto set = m_frameDescriptors->allocate(m_setLayout);
+                        const auto accumulationInfo = VkDescriptorImageInfo { m_sampler, graph.imageView(accumulation), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+                        const auto revealageInfo = VkDescriptorImageInfo { m_sampler, graph.imageView(revealage), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+                        const auto writes = std::array {
+                            VkWriteDescriptorSet {
+                                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                                .dstSet = set,
+                                .dstBinding = 0,
+                                .descriptorCount = 1,
+                                .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                .pImageInfo = &accumulationInfo,
+                            },
+                            VkWriteDescriptorSet {
+                                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                                .dstSet = set,
+                                .dstBinding = 1,
+                                .descriptorCount = 1,
+                                .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                .pImageInfo = &revealageInfo,
+                            },
+                        };
+                        vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+                        this->recordBlend(commandBuffer, graph, targets, set, PushConstants {});
+                    }
+                );
+            }
+
+            void addListPasses(
+                vk_render_graph::RenderGraph& graph,
+                const FrameResources& frame,
+                const WindowTargets& targets,
+                const vk_gpu_driven::SceneCamera& camera
+            ) {
+                const auto list = frame.list.value();
+                const auto heads = graph.createImage(vk_render_graph::TransientImageInfo {
+                    .format = HEAD_FORMAT,
+                    .extent = targets.targetSize,
+                    .usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+                });
+                const auto storage = VkAccessFlags2 { VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT };
+
+                graph.addPass(
+                    "transparentList",
+                    {
+                        vk_render_graph::write(heads, VK_PIPELINE_STAGE_2_CLEAR_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT | storage, VK_IMAGE_LAYOUT_GENERAL),
+                        vk_render_graph::write(list, VK_PIPELINE_STAGE_2_CLEAR_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT | storage),
+                        TransparencyRenderer::depthAccess(targets.depth),
+                    },
+                    [this, &graph, targets, camera, heads](VkCommandBuffer commandBuffer) {
+                        const auto clear = VkClearColorValue { .uint32 = { END_OF_LIST, 0, 0, 0 } };
+                        const auto range = VkImageSubresourceRange {
+                            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                            .levelCount = 1,
+                            .layerCount = 1,
+                        };
+                        vkCmdClearColorImage(commandBuffer, graph.image(heads), VK_IMAGE_LAYOUT_GENERAL, &clear, 1, &range);
+                        vkCmdFillBuffer(commandBuffer, m_list.buffer, 0, sizeof(FragmentList), 0);
+                        const auto barrier = VkMemoryBarrier2 {
+                            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+                            .srcStageMask = VK_PIPELINE_STAGE_2_CLEAR_BIT,
+                            .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                            .dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+                            .dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                        };
+                        const auto dependency = VkDependencyInfo {
+                            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+                            .memoryBarrierCount = 1,
+                            .pMemoryBarriers = &barrier,
+                        };
+                        vkCmdPipelineBarrier2(commandBuffer, &dependency);
+
+                        const auto set = this->headSet(graph.imageView(heads));
+                        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &set, 0, nullptr);
+                        this->recordPanes(commandBuffer, graph, targets, camera, std::span<const VkRenderingAttachmentInfo> {});
+                    }
+                );
+
+                graph.addPass(
+                    "transparentResolve",
+                    {
+                        vk_render_graph::read(heads, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT, VK_IMAGE_LAYOUT_GENERAL),
+                        vk_render_graph::read(list, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT),
+                        TransparencyRenderer::targetAccess(targets.target),
+                    },
+                    [this, &graph, targets, camera, heads](VkCommandBuffer commandBuffer) {
+                        this->recordBlend(commandBuffer, graph, targets, this->headSet(graph.imageView(heads)), this->pushConstants(camera));
+                    }
+                );
+            }
+
+            VkDescriptorSet headSet(VkImageView headView) const {
+                const auto set = m_frameDescriptors->allocate(m_setLayout);
+                const auto headInfo = VkDescriptorImageInfo { VK_NULL_HANDLE, headView, VK_IMAGE_LAYOUT_GENERAL };
+                const auto write = VkWriteDescriptorSet {
+                    .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                    .dstSet = set,
+                    .dstBinding = 0,
+                    .descriptorCount = 1,
+                    .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                    .pImageInfo = &headInfo,
+                };
+                vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
+
+                return set;
+            }
+
+            // Draws every pane into `colorAttachments`, tested against the scene's depth.
+            void recordPanes(
+                VkCommandBuffer commandBuffer,
+                const vk_render_graph::RenderGraph& graph,
+                const WindowTargets& targets,
+                const vk_gpu_driven::SceneCamera& camera,
+                std::span<const VkRenderingAttachmentInfo> colorAttachments
+            ) {
+                const auto depth = TransparencyRenderer::depthAttachment(graph.imageView(targets.depth));
+                const auto renderingInfo = VkRenderingInfo {
+                    .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+                    .renderArea = VkRect2D {
+                        .offset = VkOffset2D { 0, 0 },
+                        .extent = targets.renderExtent,
+                    },
+                    .layerCount = 1,
+                    .colorAttachmentCount = static_cast<uint32_t>(colorAttachments.size()),
+                    .pColorAttachments = colorAttachments.data(),
+                    .pDepthAttachment = &depth,
+                };
+                const auto [viewport, scissor] = TransparencyRenderer::viewportAndScissor(targets.renderExtent);
+                const auto pushConstants = this->pushConstants(camera);
+
+                vkCmdBeginRendering(commandBuffer, &renderingInfo);
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->drawPipeline());
+                vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+                vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+                vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstants), &pushConstants);
+                vkCmdDraw(commandBuffer, 6, m_paneCount, 0, 0);
+                vkCmdEndRendering(commandBuffer);
+            }
+
+            // Blends the transparent result over the window's target in a fullscreen pass.
+            void recordBlend(
+                VkCommandBuffer commandBuffer,
+                const vk_render_graph::RenderGraph& graph,
+                const WindowTargets& targets,
+                VkDescriptorSet set,
+                const PushConstants& pushConstants
+            ) {
+                const auto colorAttachment = VkRenderingAttachmentInfo {
+                    .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+                    .imageView = graph.imageView(targets.target),
+                    .imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                    .loadOp = VK_ATTACHMENT_LOAD_OP_LOAD,
+                    .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+                };
+                const auto renderingInfo = VkRenderingInfo {
+                    .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+                    .renderArea = VkRect2D {
+                        .offset = VkOffset2D { 0, 0 },
+                        .extent = targets.renderExtent,
+                    },
+                    .layerCount = 1,
+                    .colorAttachmentCount = 1,
+                    .pColorAttachments = &colorAttachment,
+                };
+                const auto [viewport, scissor] = TransparencyRenderer::viewportAndScissor(targets.renderExtent);
+
+                vkCmdBeginRendering(commandBuffer, &renderingInfo);
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->blendPipeline(targets.colorFormat));
+                vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+                vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+                vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &set, 0, nullptr);
+                vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstants), &pushConstants);
+                vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+                vkCmdEndRendering(commandBuffer);
+            }
+
+            VkPipelineShaderStageCreateInfo stage(VkShaderStageFlagBits stage, const char* shaderName) const {
+                return VkPipelineShaderStageCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                    .stage = stage,
+                    .module = m_shaderLibrary->shaderModule(shaderName),
+                    .pName = "main",
+                };
+            }
+
+            VkPipeline createPipeline(
+                std::span<const VkPipelineShaderStageCreateInfo> stages,
+                std::span<const VkFormat> colorFormats,
+                std::span<const VkPipelineColorBlendAttachmentState> blendAttachments,
+                VkSampleCountFlagBits samples,
+                bool depthTest
+            ) const {
+                const auto vertexInputState = VkPipelineVertexInputStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+                };
+                const auto inputAssemblyState = VkPipelineInputAssemblyStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+                    .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+                };
+                const auto viewportState = VkPipelineViewportStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+                    .viewportCount = 1,
+                    .scissorCount = 1,
+                };
+                const auto rasterizationState = VkPipelineRasterizationStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+                    .polygonMode = VK_POLYGON_MODE_FILL,
+                    .cullMode = VK_CULL_MODE_NONE,
+                    .lineWidth = 1.0f,
+                };
+                const auto multisampleState = VkPipelineMultisampleStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+                    .rasterizationSamples = samples,
+                };
+                const auto depthStencilState = VkPipelineDepthStencilStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+                    .depthTestEnable = depthTest ? VK_TRUE : VK_FALSE,
+                    .depthWriteEnable = VK_FALSE,
+                    .depthCompareOp = vk_gpu_driven::DEPTH_COMPARE_OP,
+                };
+                const auto colorBlendState = VkPipelineColorBlendStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+                    .attachmentCount = static_cast<uint32_t>(blendAttachments.size()),
+                    .pAttachments = blendAttachments.data(),
+                };
+                const auto dynamicStates = std::array { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+                const auto dynamicState = VkPipelineDynamicStateCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+                    .dynamicStateCount = static_cast<uint32_t>(dynamicStates.size()),
+                    .pDynamicStates = dynamicStates.data(),
+                };
+                const auto renderingInfo = VkPipelineRenderingCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
+                    .colorAttachmentCount = static_cast<uint32_t>(colorFormats.size()),
+                    .pColorAttachmentFormats = colorFormats.data(),
+                    .depthAttachmentFormat = depthTest ? m_depthFormat : VK_FORMAT_UNDEFINED,
+                };
+                const auto pipelineInfo = VkGraphicsPipelineCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+                    .pNext = &renderingInfo,
+                    .stageCount = static_cast<uint32_t>(stages.size()),
+                    .pStages = stages.data(),
+                    .pVertexInputState = &vertexInputState,
+                    .pInputAssemblyState = &inputAssemblyState,
+                    .pViewportState = &viewportState,
+                    .pRasterizationState = &rasterizationState,
+                    .pMultisampleState = &multisampleState,
+                    .pDepthStencilState = &depthStencilState,
+                    .pColorBlendState = &colorBlendState,
+                    .pDynamicState = &dynamicState,
+                    .layout = m_pipelineLayout,
+                };
+
+                return m_pipelineRegistry->graphicsPipeline(pipelineInfo);
+            }
+
+            // Weighted blending adds premultiplied colors and weights into the accumulation
+            // target, and multiplies each fragment's transparency into the revealage target.
+            // Lists are built by the fragment shader alone, with no attachment but the depth.
+            VkPipeline drawPipeline() {
+                if (m_drawPipeline != VK_NULL_HANDLE) {
+                    return m_drawPipeline;
+                }
+
+                if (m_mode == Mode::LinkedList) {
+                    const auto stages = std::array {
+                        this->stage(VK_SHADER_STAGE_VERTEX_BIT, "transparent.vert"),
+                        this->stage(VK_SHADER_STAGE_FRAGMENT_BIT, "transparent_list.frag"),
+                    };
+                    m_drawPipeline = this->createPipeline(stages, {}, {}, m_samples, true);
+
+                    return m_drawPipeline;
+                }
+
+                const auto stages = std::array {
+                    this->stage(VK_SHADER_STAGE_VERTEX_BIT, "transparent.vert"),
+                    this->stage(VK_SHADER_STAGE_FRAGMENT_BIT, "transparent_weighted.frag"),
+                };
+                const auto colorFormats = std::array { ACCUMULATION_FORMAT, REVEALAGE_FORMAT };
+                const auto blendAttachments = std::array {
+                    VkPipelineColorBlendAttachmentState {
+                        .blendEnable = VK_TRUE,
+                        .srcColorBlendFactor = VK_BLEND_FACTOR_ONE,
+                        .dstColorBlendFactor = VK_BLEND_FACTOR_ONE,
+                        .colorBlendOp = VK_BLEND_OP_ADD,
+                        .srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+                        .dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+                        .alphaBlendOp = VK_BLEND_OP_ADD,
+                        .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+                    },
+                    VkPipelineColorBlendAttachmentState {
+                        .blendEnable = VK_TRUE,
+                        .srcColorBlendFactor = VK_BLEND_FACTOR_ZERO,
+                        .dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_COLOR,
+                        .colorBlendOp = VK_BLEND_OP_ADD,
+                        .srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
+                        .dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+                        .alphaBlendOp = VK_BLEND_OP_ADD,
+                        .colorWriteMask = VK_COLOR_COMPONENT_R_BIT,
+                    },
+                };
+                m_drawPipeline = this->createPipeline(stages, colorFormats, blendAttachments, m_samples, true);
+
+                return m_drawPipeline;
+            }
+
+            // The weighted average is blended by its coverage, and the sorted lists are already
+            // premultiplied.
+            VkPipeline blendPipeline(VkFormat colorFormat) {
+                const auto existing = std::find_if(m_blendPipelines.begin(), m_blendPipelines.end(), [colorFormat](const auto& entry) {
+                    return entry.colorFormat == colorFormat;
+                });
+                if (existing != m_blendPipelines.end()) {
+                    return existing->pipeline;
+                }
+
+                const bool list = m_mode == Mode::LinkedList;
+                const auto stages = std::array {
+                    this->stage(VK_SHADER_STAGE_VERTEX_BIT, "fullscreen.vert"),
+                    this->stage(VK_SHADER_STAGE_FRAGMENT_BIT, list ? "transparent_resolve.frag" : "transparent_composite.frag"),
+                };
+                const auto blendAttachment = VkPipelineColorBlendAttachmentState {
+                    .blendEnable = VK_TRUE,
+                    .srcColorBlendFactor = list ? VK_BLEND_FACTOR_ONE : VK_BLEND_FACTOR_SRC_ALPHA,
+                    .dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+                    .colorBlendOp = VK_BLEND_OP_ADD,
+                    .srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
+                    .dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+                    .alphaBlendOp = VK_BLEND_OP_ADD,
+                    .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+                };
+                const auto pipeline = this->createPipeline(stages, std::span { &colorFormat, 1 }, std::span { &blendAttachment, 1 }, VK_SAMPLE_COUNT_1_BIT, false);
+                m_blendPipelines.push_back(PipelineEntry { colorFormat, pipeline });
+
+                return pipeline;
+            }
+    };
+}
@@ -0,0 +1,644 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#include "vk_memory.h"
+#include "vk_platform.h"
+#include "vk_submit.h"
+
+
+namespace vk_upload {
+    // Timeline value the upload of a resource completes at on the transfer queue.
+    using UploadTicket = uint64_t;
+
+    // A batch of uploads handed to the transfer queue. Graphics work using the uploaded
+    // resources waits on `semaphore` reaching `timelineValue`, and records the acquire
+    // barriers first whenever the transfer and graphics queue families differ.
+    struct UploadSubmission {
+        VkSemaphore semaphore = VK_NULL_HANDLE;
+        uint64_t timelineValue = 0;
+        std::vector<VkBufferMemoryBarrier> bufferAcquireBarriers;
+        std::vector<VkImageMemoryBarrier> imageAcquireBarriers;
+    };
+
+    struct ImageUploadInfo {
+        VkImage image = VK_NULL_HANDLE;
+        VkImageAspectFlags aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        // The region of `mipLevel` written, by default all of it when `extent` is the level's.
+        VkOffset3D offset = {};
+        VkExtent3D extent = {};
+        uint32_t mipLevel = 0;
+        // `VK_IMAGE_LAYOUT_UNDEFINED` discards the rest of the level. Images that are written a
+        // region at a time stay in `VK_IMAGE_LAYOUT_GENERAL`, and are copied to in place.
+        VkImageLayout oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkImageLayout finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        // Images created with `VK_SHARING_MODE_CONCURRENT` need no ownership transfer.
+        bool concurrent = false;
+        // Images created with `VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT` may be written from the
+        // CPU instead, see `UploadService::canCopyFromHost`.
+        bool hostCopy = false;
+    };
+
+    // The largest upload written from the CPU with `VK_EXT_host_image_copy`. Host copies
+    // retile the texels on the calling thread, which the transfer queue does faster for
+    // large levels, so those still go through the staging ring.
+    constexpr VkDeviceSize HOST_IMAGE_COPY_MAX_SIZE = 4 * 1024 * 1024;
+
+    // The layouts host image copies can write images in.
+    inline std::vector<VkImageLayout> hostImageCopyLayouts(VkPhysicalDevice physicalDevice) {
+        auto hostImageCopyProperties = VkPhysicalDeviceHostImageCopyPropertiesEXT {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_IMAGE_COPY_PROPERTIES_EXT,
+        };
+        auto properties = VkPhysicalDeviceProperties2 {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+            .pNext = &hostImageCopyProperties,
+        };
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+        auto layouts = std::vector<VkImageLayout>(hostImageCopyProperties.copyDstLayoutCount);
+        hostImageCopyProperties.pCopyDstLayouts = layouts.data();
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+        layouts.resize(hostImageCopyProperties.copyDstLayoutCount);
+
+        return layouts;
+    }
+
+    // Whether images of `format` and `usage` can be created for host image copies without
+    // making device access to them any slower, which on some GPUs would cost them their
+    // compression. Textures only get `VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT` when it is free.
+    inline bool supportsHostImageCopy(VkPhysicalDevice physicalDevice, VkFormat format, VkImageUsageFlags usage) {
+        const auto formatInfo = VkPhysicalDeviceImageFormatInfo2 {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGE_FORMAT_INFO_2,
+            .format = format,
+            .type = VK_IMAGE_TYPE_2D,
+            .tiling = VK_IMAGE_TILING_OPTIMAL,
+            .usage = usage | VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT,
+        };
+        auto performance = VkHostImageCopyDevicePerformanceQueryEXT {
+            .sType = VK_STRUCTURE_TYPE_HOST_IMAGE_COPY_DEVICE_PERFORMANCE_QUERY_EXT,
+        };
+        auto properties = VkImageFormatProperties2 {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_FORMAT_PROPERTIES_2,
+            .pNext = &performance,
+        };
+        const auto result = vkGetPhysicalDeviceImageFormatProperties2(physicalDevice, &formatInfo, &properties);
+
+        return result == VK_SUCCESS && performance.optimalDeviceAccess == VK_TRUE;
+    }
+
+    // Batches buffer and image uploads through a reusable staging ring and records the copies
+    // on the transfer queue. Uploads may be enqueued from any thread. The frame loop calls
+    // `collect` and `submit` once per frame, neither of which waits on the GPU: completed
+    // batches are found by polling the timeline semaphore, and an upload that does not fit in
+    // the ring right now is refused so the caller can try again next frame.
+    //
+    // Given the layouts of `hostImageCopyLayouts`, small image uploads to images that allow it
+    // skip all of that, and are written from the CPU on the calling thread with
+    // `vkCopyMemoryToImageEXT`. They are complete when the call returns.
+    class UploadService {
+        public:
+            explicit UploadService() = default;
+
+            UploadService(const UploadService& other) = delete;
+            UploadService& operator=(const UploadService& other) = delete;
+
+            void init(
+                VkDevice device,
+                vk_memory::DeviceMemoryAllocator& allocator,
+                VkQueue transferQueue,
+                uint32_t transferQueueFamily,
+                uint32_t graphicsQueueFamily,
+                VkDeviceSize stagingSize,
+                VkDeviceSize copyOffsetAlignment,
+                std::span<const VkImageLayout> hostCopyLayouts = {}
+            ) {
+                m_device = device;
+                m_hostCopyLayouts.assign(hostCopyLayouts.begin(), hostCopyLayouts.end());
+                m_transferQueue = transferQueue;
+                m_transferQueueFamily = transferQueueFamily;
+                m_graphicsQueueFamily = graphicsQueueFamily;
+                m_stagingSize = stagingSize;
+                // Image copies need offsets that are a multiple of both the texel size and 4.
+                m_copyOffsetAlignment = std::max(copyOffsetAlignment, VkDeviceSize { 16 });
+
+                const auto bufferInfo = VkBufferCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                    .size = stagingSize,
+                    .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                };
+
+                const auto bufferResult = vkCreateBuffer(m_device, &bufferInfo, nullptr, &m_stagingBuffer);
+                if (bufferResult != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create staging buffer!");
+                }
+
+                // On unified memory every heap is device local, and preferring it keeps the
+                // staging buffer out of any slower, host only types the driver also lists.
+                const auto allocationInfo = vk_memory::AllocationCreateInfo {
+                    .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                    .preferredFlags = vk_platform::CurrentPlatform::UNIFIED_MEMORY ? VkMemoryPropertyFlags { VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT } : VkMemoryPropertyFlags {},
+                    .kind = vk_memory::ResourceKind::Linear,
+                    .dedicated = true,
+                    .userData = this,
+                };
+                m_stagingAllocation = allocator.allocateForBuffer(m_stagingBuffer, allocationInfo);
+
+                const auto poolInfo = VkCommandPoolCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+                    .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+                    .queueFamilyIndex = transferQueueFamily,
+                };
+
+                const auto poolResult = vkCreateCommandPool(m_device, &poolInfo, nullptr, &m_commandPool);
+                if (poolResult != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create upload command pool!");
+                }
+
+                const auto timelineInfo = VkSemaphoreTypeCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+                    .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+                    .initialValue = 0,
+                };
+                const auto semaphoreInfo = VkSemaphoreCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+                    .pNext = &timelineInfo,
+                };
+
+                const auto semaphoreResult = vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_timelineSemaphore);
+                if (semaphoreResult != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create upload timeline semaphore!");
+                }
+            }
+
+            // The caller must make sure the transfer queue is idle.
+            void destroy(vk_memory::DeviceMemoryAllocator& allocator) {
+                if (m_device == VK_NULL_HANDLE) {
+                    return;
+                }
+
+                vkDestroySemaphore(m_device, m_timelineSemaphore, nullptr);
+                vkDestroyCommandPool(m_device, m_commandPool, nullptr);
+                vkDestroyBuffer(m_device, m_stagingBuffer, nullptr);
+                allocator.free(m_stagingAllocation);
+
+                m_inFlightBatches.clear();
+                m_freeCommandBuffers.clear();
+                m_recording = Batch {};
+                m_device = VK_NULL_HANDLE;
+            }
+
+            // Copy `size` bytes to `buffer` at `offset`. The buffer must be created with
+            // `VK_BUFFER_USAGE_TRANSFER_DST_BIT` and `VK_SHARING_MODE_EXCLUSIVE`.
+            std::optional<UploadTicket> uploadBuffer(
+                VkBuffer buffer,
+                VkDeviceSize offset,
+                const void* data,
+                VkDeviceSize size,
+                VkAccessFlags dstAccessMask
+            ) {
+                const auto lock = std::scoped_lock { m_mutex };
+                const auto stagingOffset = this->allocateStaging(size, 4);
+                if (!stagingOffset.has_value()) {
+                    return std::nullopt;
+                }
+
+                std::memcpy(static_cast<char*>(m_stagingAllocation.mappedData) + stagingOffset.value(), data, size);
+                this->recordBufferCopy(m_stagingBuffer, stagingOffset.value(), buffer, offset, size, dstAccessMask);
+
+                return m_nextTimelineValue;
+            }
+
+            // Copy `size` bytes from `source` at `sourceOffset`, a buffer the GPU can read in place
+            // like imported host memory, to `buffer` at `offset`, without going through the
+            // staging ring. `source` must stay alive until the returned ticket completes.
+            UploadTicket copyBuffer(
+                VkBuffer source,
+                VkDeviceSize sourceOffset,
+                VkBuffer buffer,
+                VkDeviceSize offset,
+                VkDeviceSize size,
+                VkAccessFlags dstAccessMask
+            ) {
+                const auto lock = std::scoped_lock { m_mutex };
+                this->recordBufferCopy(source, sourceOffset, buffer, offset, size, dstAccessMask);
+
+                return m_nextTimelineValue;
+            }
+
+            // Copy tightly packed texels, or blocks of a compressed format, to a region of a mip
+            // level of array layer 0 that is not in use, leaving the level in `finalLayout`. The
+            // image must be created with `VK_IMAGE_USAGE_TRANSFER_DST_BIT`. Host copies return
+            // a ticket that is complete already.
+            std::optional<UploadTicket> uploadImage(
+                const ImageUploadInfo& imageInfo,
+                const void* data,
+                VkDeviceSize size,
+                VkAccessFlags dstAccessMask
+            ) {
+                if (this->canCopyFromHost(imageInfo, size)) {
+                    this->copyFromHost(imageInfo, data);
+                    return UploadTicket { 0 };
+                }
+
+                const auto lock = std::scoped_lock { m_mutex };
+                const auto stagingOffset = this->allocateStaging(size, m_copyOffsetAlignment);
+                if (!stagingOffset.has_value()) {
+                    return std::nullopt;
+                }
+
+                std::memcpy(static_cast<char*>(m_stagingAllocation.mappedData) + stagingOffset.value(), data, size);
+                this->recordImageCopy(imageInfo, m_stagingBuffer, stagingOffset.value(), dstAccessMask);
+
+                return m_nextTimelineValue;
+            }
+
+            // Copy tightly packed texels like `uploadImage` does, from `source` at `sourceOffset`
+            // instead of the staging ring. The offset must be a multiple of the texel size and of
+            // `optimalBufferCopyOffsetAlignment`, and `source` must stay alive until the returned
+            // ticket completes.
+            UploadTicket copyBufferToImage(
+                const ImageUploadInfo& imageInfo,
+                VkBuffer source,
+                VkDeviceSize sourceOffset,
+                VkAccessFlags dstAccessMask
+            ) {
+                const auto lock = std::scoped_lock { m_mutex };
+                this->recordImageCopy(imageInfo, source, sourceOffset, dstAccessMask);
+
+                return m_nextTimelineValue;
+            }
+
+            // Adds everything enqueued since the last call to `batcher`, signaling the next
+            // timeline value once the batch is flushed.
+            std::optional<UploadSubmission> submit(vk_submit::SubmitBatcher& batcher) {
+                const auto lock = std::scoped_lock { m_mutex };
+                if (m_recording.commandBuffer == VK_NULL_HANDLE) {
+                    return std::nullopt;
+                }
+
+                const auto commandBuffer = m_recording.commandBuffer;
+                if (!m_recording.bufferReleaseBarriers.empty() || !m_recording.imageReleaseBarriers.empty()) {
+                    vkCmdPipelineBarrier(
+                        commandBuffer,
+                        VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                        0,
+                        0, nullptr,
+                        static_cast<uint32_t>(m_recording.bufferReleaseBarriers.size()), m_recording.bufferReleaseBarriers.data(),
+                        static_cast<uint32_t>(m_recording.imageReleaseBarriers.size()), m_recording.imageReleaseBarriers.data()
+                    );
+                }
+
+                const auto endResult = vkEndCommandBuffer(commandBuffer);
+                if (endResult != VK_SUCCESS) {
+                    throw std::runtime_error("failed to record upload command buffer!");
+                }
+
+                const auto signalValue = m_nextTimelineValue;
+                const auto commandBufferInfo = vk_submit::commandBufferInfo(commandBuffer);
+                const auto signal = vk_submit::semaphoreInfo(m_timelineSemaphore, signalValue, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT);
+                batcher.add(m_transferQueue, vk_submit::Submission {
+                    .commandBuffers = std::span { &commandBufferInfo, 1 },
+                    .signals = std::span { &signal, 1 },
+                });
+
+                auto submission = UploadSubmission {
+                    .semaphore = m_timelineSemaphore,
+                    .timelineValue = signalValue,
+                    .bufferAcquireBarriers = std::move(m_recording.bufferAcquireBarriers),
+                    .imageAcquireBarriers = std::move(m_recording.imageAcquireBarriers),
+                };
+
+                m_inFlightBatches.push_back(InFlightBatch {
+                    .commandBuffer = commandBuffer,
+                    .timelineValue = signalValue,
+                    .stagingBytes = m_recording.stagingBytes,
+                });
+                m_recording = Batch {};
+                m_nextTimelineValue++;
+
+                return submission;
+            }
+
+            // Recycle the command buffers and staging space of every batch the transfer queue
+            // has finished, without waiting for the ones it has not.
+            void collect() {
+                const auto lock = std::scoped_lock { m_mutex };
+                if (m_inFlightBatches.empty()) {
+                    return;
+                }
+
+                uint64_t completedValue = 0;
+                vkGetSemaphoreCounterValue(m_device, m_timelineSemaphore, &completedValue);
+                while (!m_inFlightBatches.empty() && m_inFlightBatches.front().timelineValue <= completedValue) {
+                    const auto& batch = m_inFlightBatches.front();
+                    m_stagingUsed -= batch.stagingBytes;
+                    m_freeCommandBuffers.push_back(batch.commandBuffer);
+                    m_inFlightBatches.pop_front();
+                }
+
+                if (m_stagingUsed == 0) {
+                    m_stagingHead = 0;
+                }
+            }
+
+            // Whether `uploadImage` writes `size` bytes to the image from the CPU: the image has
+            // to allow it, and both of its layouts have to be ones host copies can write.
+            bool canCopyFromHost(const ImageUploadInfo& imageInfo, VkDeviceSize size) const {
+                const auto supported = [this](VkImageLayout layout) {
+                    return std::find(m_hostCopyLayouts.begin(), m_hostCopyLayouts.end(), layout) != m_hostCopyLayouts.end();
+                };
+
+                return imageInfo.hostCopy
+                    && size <= HOST_IMAGE_COPY_MAX_SIZE
+                    && supported(imageInfo.finalLayout)
+                    && (imageInfo.oldLayout == VK_IMAGE_LAYOUT_UNDEFINED || supported(imageInfo.oldLayout));
+            }
+
+            bool isComplete(UploadTicket ticket) const {
+                uint64_t completedValue = 0;
+                vkGetSemaphoreCounterValue(m_device, m_timelineSemaphore, &completedValue);
+
+                return completedValue >= ticket;
+            }
+        private:
+            struct Batch {
+                VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+                VkDeviceSize stagingBytes = 0;
+                std::vector<VkBufferMemoryBarrier> bufferReleaseBarriers;
+                std::vector<VkImageMemoryBarrier> imageReleaseBarriers;
+                std::vector<VkBufferMemoryBarrier> bufferAcquireBarriers;
+                std::vector<VkImageMemoryBarrier> imageAcquireBarriers;
+            };
+
+            struct InFlightBatch {
+                VkCommandBuffer commandBuffer;
+                uint64_t timelineValue;
+                VkDeviceSize stagingBytes;
+            };
+
+            VkDevice m_device = VK_NULL_HANDLE;
+            VkQueue m_transferQueue = VK_NULL_HANDLE;
+            uint32_t m_transferQueueFamily = 0;
+            uint32_t m_graphicsQueueFamily = 0;
+
+            VkBuffer m_stagingBuffer = VK_NULL_HANDLE;
+            vk_memory::Allocation m_stagingAllocation;
+            VkDeviceSize m_stagingSize = 0;
+            VkDeviceSize m_stagingHead = 0;
+            VkDeviceSize m_stagingUsed = 0;
+            VkDeviceSize m_copyOffsetAlignment = 16;
+
+            VkCommandPool m_commandPool = VK_NULL_HANDLE;
+            std::vector<VkCommandBuffer> m_freeCommandBuffers;
+            VkSemaphore m_timelineSemaphore = VK_NULL_HANDLE;
+            uint64_t m_nextTimelineValue = 1;
+
+            std::mutex m_mutex;
+            Batch m_recording;
+            std::deque<InFlightBatch> m_inFlightBatches;
+            std::vector<VkImageLayout> m_hostCopyLayouts;
+
+            // Copies in `finalLayout`, after moving the level there on the host. Touches no
+            // queue, so it needs neither the mutex nor an ownership transfer, and the host
+            // writes are visible to every submission made after it returns.
+            void copyFromHost(const ImageUploadInfo& imageInfo, const void* data) const {
+                if (imageInfo.oldLayout != imageInfo.finalLayout) {
+                    const auto transition = VkHostImageLayoutTransitionInfoEXT {
+                        .sType = VK_STRUCTURE_TYPE_HOST_IMAGE_LAYOUT_TRANSITION_INFO_EXT,
+                        .image = imageInfo.image,
+                        .oldLayout = imageInfo.oldLayout,
+                        .newLayout = imageInfo.finalLayout,
+                        .subresourceRange = VkImageSubresourceRange {
+                            .aspectMask = imageInfo.aspectMask,
+                            .baseMipLevel = imageInfo.mipLevel,
+                            .levelCount = 1,
+                            .baseArrayLayer = 0,
+                            .layerCount = 1,
+                        },
+                    };
+
+                    const auto transitionResult = vkTransitionImageLayoutEXT(m_device, 1, &transition);
+                    if (transitionResult != VK_SUCCESS) {
+                        throw std::runtime_error("failed to transition image layout on the host!");
+                    }
+                }
+
+                const auto region = VkMemoryToImageCopyEXT {
+                    .sType = VK_STRUCTURE_TYPE_MEMORY_TO_IMAGE_COPY_EXT,
+                    .pHostPointer = data,
+                    .memoryRowLength = 0,
+                    .memoryImageHeight = 0,
+                    .imageSubresource = VkImageSubresourceLayers {
+                        .aspectMask = imageInfo.aspectMask,
+                        .mipLevel = imageInfo.mipLevel,
+                        .baseArrayLayer = 0,
+                        .layerCount = 1,
+                    },
+                    .imageOffset = imageInfo.offset,
+                    .imageExtent = imageInfo.extent,
+                };
+                const auto copyInfo = VkCopyMemoryToImageInfoEXT {
+                    .sType = VK_STRUCTURE_TYPE_COPY_MEMORY_TO_IMAGE_INFO_EXT,
+                    .dstImage = imageInfo.image,
+                    .dstImageLayout = imageInfo.finalLayout,
+                    .regionCount = 1,
+                    .pRegions = &region,
+                };
+
+                const auto copyResult = vkCopyMemoryToImageEXT(m_device, &copyInfo);
+                if (copyResult != VK_SUCCESS) {
+                    throw std::runtime_error("failed to copy texels to image on the host!");
+                }
+            }
+
+            // Records the copy, and the queue family ownership transfer of the range when the
+            // transfer and graphics families differ. Called with the mutex held.
+            void recordBufferCopy(VkBuffer source, VkDeviceSize sourceOffset, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, VkAccessFlags dstAccessMask) {
+                const auto commandBuffer = this->recordingCommandBuffer();
+                const auto region = VkBufferCopy {
+                    .srcOffset = sourceOffset,
+                    .dstOffset = offset,
+                    .size = size,
+                };
+                vkCmdCopyBuffer(commandBuffer, source, buffer, 1, &region);
+
+                if (m_transferQueueFamily != m_graphicsQueueFamily) {
+                    auto barrier = VkBufferMemoryBarrier {
+                        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+                        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                        .dstAccessMask = 0,
+                        .srcQueueFamilyIndex = m_transferQueueFamily,
+                        .dstQueueFamilyIndex = m_graphicsQueueFamily,
+                        .buffer = buffer,
+                        .offset = offset,
+                        .size = size,
+                    };
+                    m_recording.bufferReleaseBarriers.push_back(barrier);
+
+                    barrier.srcAccessMask = 0;
+                    barrier.dstAccessMask = dstAccessMask;
+                    m_recording.bufferAcquireBarriers.push_back(barrier);
+                }
+            }
+
+            // Records the layout transitions around the copy, and the ownership transfer. Called
+            // with the mutex held.
+            void recordImageCopy(const ImageUploadInfo& imageInfo, VkBuffer source, VkDeviceSize sourceOffset, VkAccessFlags dstAccessMask) {
+                const auto subresourceRange = VkImageSubresourceRange {
+                    .aspectMask = imageInfo.aspectMask,
+                    .baseMipLevel = imageInfo.mipLevel,
+                    .levelCount = 1,
+                    .baseArrayLayer = 0,
+                    .layerCount = 1,
+                };
+
+                const auto copyLayout = imageInfo.oldLayout == VK_IMAGE_LAYOUT_GENERAL ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+                const auto commandBuffer = this->recordingCommandBuffer();
+                const auto toTransferBarrier = VkImageMemoryBarrier {
+                    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                    .srcAccessMask = 0,
+                    .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                    .oldLayout = imageInfo.oldLayout,
+                    .newLayout = copyLayout,
+                    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                    .image = imageInfo.image,
+                    .subresourceRange = subresourceRange,
+                };
+                vkCmdPipelineBarrier(
+                    commandBuffer,
+                    VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                    VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    0,
+                    0, nullptr,
+                    0, nullptr,
+                    1, &toTransferBarrier
+                );
+
+                const auto region = VkBufferImageCopy {
+                    .bufferOffset = sourceOffset,
+                    .bufferRowLength = 0,
+                    .bufferImageHeight = 0,
+                    .imageSubresource = VkImageSubresourceLayers {
+                        .aspectMask = imageInfo.aspectMask,
+                        .mipLevel = imageInfo.mipLevel,
+                        .baseArrayLayer = 0,
+                        .layerCount = 1,
+                    },
+                    .imageOffset = imageInfo.offset,
+                    .imageExtent = imageInfo.extent,
+                };
+                vkCmdCopyBufferToImage(commandBuffer, source, imageInfo.image, copyLayout, 1, &region);
+
+                // The layout transition is part of the queue family ownership transfer, so the
+                // release and the acquire barrier both name the same pair of layouts.
+                const bool transferOwnership = !imageInfo.concurrent && m_transferQueueFamily != m_graphicsQueueFamily;
+                auto barrier = VkImageMemoryBarrier {
+                    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                    .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                    .dstAccessMask = 0,
+                    .oldLayout = copyLayout,
+                    .newLayout = imageInfo.finalLayout,
+                    .srcQueueFamilyIndex = transferOwnership ? m_transferQueueFamily : VK_QUEUE_FAMILY_IGNORED,
+                    .dstQueueFamilyIndex = transferOwnership ? m_graphicsQueueFamily : VK_QUEUE_FAMILY_IGNORED,
+                    .image = imageInfo.image,
+                    .subresourceRange = subresourceRange,
+                };
+                m_recording.imageReleaseBarriers.push_back(barrier);
+
+                if (transferOwnership) {
+                    barrier.srcAccessMask = 0;
+                    barrier.dstAccessMask = dstAccessMask;
+                    m_recording.imageAcquireBarriers.push_back(barrier);
+                }
+            }
+
+            // Space is handed out in submission order and given back in completion order, which
+            // is the same order since the timeline only moves forward. Padding skipped at the end
+            // of the ring when wrapping is charged to the allocation that wrapped.
+            std::optional<VkDeviceSize> allocateStaging(VkDeviceSize size, VkDeviceSize alignment) {
+                if (size > m_stagingSize) {
+                    throw std::runtime_error("upload does not fit in the staging buffer!");
+                }
+
+                const auto tail = (m_stagingHead + m_stagingSize - m_stagingUsed) % m_stagingSize;
+                const auto alignedHead = (m_stagingHead + alignment - 1) / alignment * alignment;
+
+                auto offset = VkDeviceSize { 0 };
+                auto consumed = VkDeviceSize { 0 };
+                if (m_stagingUsed == 0 || m_stagingHead > tail) {
+                    if (alignedHead + size <= m_stagingSize) {
+                        offset = alignedHead;
+                        consumed = alignedHead + size - m_stagingHead;
+                    } else if (m_stagingUsed == 0 || size <= tail) {
+                        offset = 0;
+                        consumed = m_stagingSize - m_stagingHead + size;
+                    } else {
+                        return std::nullopt;
+                    }
+                } else if (alignedHead + size <= tail) {
+                    offset = alignedHead;
+                    consumed = alignedHead + size - m_stagingHead;
+                } else {
+                    return std::nullopt;
+                }
+
+                m_stagingHead = (offset + size) % m_stagingSize;
+                m_stagingUsed += consumed;
+                m_recording.stagingBytes += consumed;
+
+                return offset;
+            }
+
+            VkCommandBuffer recordingCommandBuffer() {
+                if (m_recording.commandBuffer != VK_NULL_HANDLE) {
+                    return m_recording.commandBuffer;
+                }
+
+                auto commandBuffer = VkCommandBuffer {};
+                if (!m_freeCommandBuffers.empty()) {
+                    commandBuffer = m_freeCommandBuffers.back();
+                    m_freeCommandBuffers.pop_back();
+                    vkResetCommandBuffer(commandBuffer, 0);
+                } else {
+                    const auto allocateInfo = VkCommandBufferAllocateInfo {
+                        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                        .commandPool = m_commandPool,
+                        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                        .commandBufferCount = 1,
+                    };
+
+                    const auto result = vkAllocateCommandBuffers(m_device, &allocateInfo, &commandBuffer);
+                    if (result != VK_SUCCESS) {
+                        throw std::runtime_error("failed to allocate upload command buffer!");
+                    }
+                }
+
+                const auto beginInfo = VkCommandBufferBeginInfo {
+                    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                    .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+                };
+
+                const auto beginResult = vkBeginCommandBuffer(commandBuffer, &beginInfo);
+                if (beginResult != VK_SUCCESS) {
+                    throw std::runtime_error("failed to begin recording upload command buffer!");
+                }
+
+                m_recording.commandBuffer = commandBuffer;
+
+                return commandBuffer;
+            }
+    };
+}
@@ -0,0 +1,407 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "vk_compute.h"
+#include "vk_descriptors.h"
+#include "vk_handles.h"
+#include "vk_memory.h"
+#include "vk_pipelines.h"
+#include "vk_render_graph.h"
+#include "vk_shaders.h"
+
+
+namespace vk_upscaling {
+    // The history accumulates in linear color of more precision than the swapchain has.
+    constexpr VkFormat HISTORY_FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;
+
+    // The jitter cycles through this many sub-pixel offsets, enough to cover the pixels of a
+    // frame rendered at a quarter of the output's.
+    constexpr uint32_t JITTER_PHASE_COUNT = 16;
+
+    // The specialization constant ids of `local_size_x` and `local_size_y` in `temporal_upscale.comp`.
+    constexpr uint32_t WORKGROUP_WIDTH_ID = 0;
+    constexpr uint32_t WORKGROUP_HEIGHT_ID = 1;
+
+    // How a frame rendered below the output resolution is scaled up to it. A linear upscale
+    // blits the frame with a linear filter, and a temporal one accumulates jittered frames
+    // into a history at the output resolution.
+    enum class Upscaler : uint32_t {
+        Linear,
+        Temporal,
+    };
+
+    inline float halton(uint32_t index, uint32_t base) {
+        auto fraction = 1.0f;
+        auto result = 0.0f;
+        while (index > 0) {
+            fraction /= static_cast<float>(base);
+            result += fraction * static_cast<float>(index % base);
+            index /= base;
+        }
+
+        return result;
+    }
+
+    // The sub-pixel offset of the frame's projection, in pixels of the frame, from the Halton
+    // sequence in bases 2 and 3, which spreads the samples of any run of frames evenly.
+    inline glm::vec2 jitter(uint64_t frameNumber) {
+        const auto index = static_cast<uint32_t>(frameNumber % JITTER_PHASE_COUNT) + 1;
+
+        return glm::vec2 { halton(index, 2) - 0.5f, halton(index, 3) - 0.5f };
+    }
+
+    // The history has to be written by compute shaders, and blitted to the swapchain image.
+    inline bool supportsTemporalUpscaling(VkPhysicalDevice physicalDevice) {
+        auto properties = VkFormatProperties {};
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, HISTORY_FORMAT, &properties);
+        const auto required = VkFormatFeatureFlags { VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT | VK_FORMAT_FEATURE_BLIT_SRC_BIT };
+
+        return (properties.optimalTilingFeatures & required) == required;
+    }
+
+    // The history images a window's upscale pass reads from and writes to this frame.
+    struct HistoryResources {
+        vk_render_graph::ResourceId previous;
+        vk_render_graph::ResourceId current;
+    };
+
+    // Upscales every scaled window's frame into a history of its own at the output resolution,
+    // in a compute pass that blends each frame's jittered samples into what the frames before
+    // it left. The history is clamped to the new frame's neighborhood, which stands in for the
+    // motion vectors the scene does not render. The history alternates between two images, and
+    // the one written is what the frame blits to its swapchain image.
+    class TemporalUpscaler {
+        public:
+            explicit TemporalUpscaler() = default;
+
+            TemporalUpscaler(const TemporalUpscaler& other) = delete;
+            TemporalUpscaler& operator=(const TemporalUpscaler& other) = delete;
+
+            // With `pushDescriptors`, the bindings are pushed instead of allocated from
+            // `frameDescriptors`.
+            void init(
+                VkDevice device,
+                vk_memory::DeviceMemoryAllocator& memoryAllocator,
+                vk_descriptors::DescriptorLayoutCache& layoutCache,
+                vk_descriptors::SamplerCache& samplerCache,
+                vk_descriptors::FrameDescriptorAllocator& frameDescriptors,
+                vk_shaders::ShaderLibrary& shaderLibrary,
+                vk_pipelines::PipelineRegistry& pipelineRegistry,
+                const vk_compute::ComputeTuning& computeTuning,
+                const VkAllocationCallbacks* allocator,
+                uint32_t windowCount,
+                bool pushDescriptors
+            ) {
+                m_device = device;
+                m_allocator = allocator;
+                m_memoryAllocator = &memoryAllocator;
+                m_tile = computeTuning.tile;
+                m_windows = std::vector<WindowHistory>(windowCount);
+
+                const auto bindings = std::array {
+                    VkDescriptorSetLayoutBinding {
+                        .binding = 0,
+                        .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                        .descriptorCount = 1,
+                        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                    },
+                    VkDescriptorSetLayoutBinding {
+                        .binding = 1,
+                        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                        .descriptorCount = 1,
+                        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                    },
+                    VkDescriptorSetLayoutBinding {
+                        .binding = 2,
+                        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                        .descriptorCount = 1,
+                        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                    },
+                };
+                m_descriptors.init(m_device, layoutCache, frameDescriptors, bindings, pushDescriptors);
+                const auto setLayout = m_descriptors.setLayout();
+
+                const auto pushConstantRange = VkPushConstantRange {
+                    .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                    .offset = 0,
+                    .size = sizeof(PushConstants),
+                };
+                const auto layoutInfo = VkPipelineLayoutCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+                    .setLayoutCount = 1,
+                    .pSetLayouts = &setLayout,
+                    .pushConstantRangeCount = 1,
+                    .pPushConstantRanges = &pushConstantRange,
+                };
+
+                const auto layoutResult = vkCreatePipelineLayout(m_device, &layoutInfo, m_allocator, &m_pipelineLayout);
+                if (layoutResult != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create temporal upscale pipeline layout!");
+                }
+
+                auto constants = vk_pipelines::SpecializationConstants {};
+                constants
+                    .set(WORKGROUP_WIDTH_ID, m_tile)
+                    .set(WORKGROUP_HEIGHT_ID, m_tile);
+                const auto pipelineInfo = VkComputePipelineCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+                    .stage = VkPipelineShaderStageCreateInfo {
+                        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                        .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                        .module = shaderLibrary.shaderModule("temporal_upscale.comp"),
+                        .pName = "main",
+                        .pSpecializationInfo = constants.info(),
+                    },
+                    .layout = m_pipelineLayout,
+                };
+                m_pipeline = pipelineRegistry.computePipeline(pipelineInfo);
+
+                // The frame is sampled with a linear filter where there is no history yet.
+                const auto samplerInfo = VkSamplerCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+                    .magFilter = VK_FILTER_LINEAR,
+                    .minFilter = VK_FILTER_LINEAR,
+                    .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+                    .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                    .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                    .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                    .minLod = 0.0f,
+                    .maxLod = 0.0f,
+                };
+                m_sampler = samplerCache.sampler(samplerInfo);
+            }
+
+            // The pipeline belongs to the registry, and the set layout and the sampler to their
+            // caches.
+            void destroy() {
+                if (m_device == VK_NULL_HANDLE) {
+                    return;
+                }
+
+                m_windows.clear();
+                m_sampler = VK_NULL_HANDLE;
+                m_descriptors.reset();
+                vkDestroyPipelineLayout(m_device, m_pipelineLayout, m_allocator);
+                m_pipelineLayout = VK_NULL_HANDLE;
+                m_pipeline = VK_NULL_HANDLE;
+                m_memoryAllocator = nullptr;
+                m_device = VK_NULL_HANDLE;
+            }
+
+            bool isInitialized() const {
+                return m_device != VK_NULL_HANDLE;
+            }
+
+            // Imports the window's history for a frame upscaled to `outputExtent`, swapping the
+            // image it reads with the one it writes. A history of the wrong size is retired
+            // against `retireValue`, and the frame after starts the history over.
+            HistoryResources importHistory(
+                vk_render_graph::RenderGraph& graph,
+                uint32_t windowIndex,
+                VkExtent2D outputExtent,
+                vk_handles::DeferredDestructionQueue& retiredResources,
+                uint64_t retireValue
+            ) {
+                auto& window = m_windows[windowIndex];
+                this->prepareHistory(window, outputExtent, retiredResources, retireValue);
+                window.current = 1 - window.current;
+
+                // The image read was written by the last frame's upscale pass, and the one
+                // written was read by it, and blitted by the frame before.
+                const auto& previous = window.images[1 - window.current];
+                const auto& current = window.images[window.current];
+                const auto previousState = window.valid
+                    ? vk_render_graph::ResourceState { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL }
+                    : vk_render_graph::ResourceState {};
+                const auto currentState = window.valid
+                    ? vk_render_graph::ResourceState { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_BLIT_BIT, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_GENERAL }
+                    : vk_render_graph::ResourceState {};
+                window.historyValid = window.valid;
+                window.valid = true;
+
+                return HistoryResources {
+                    .previous = graph.importImage(previous.image, previous.view, previousState),
+                    .current = graph.importImage(current.image, current.view, currentState),
+                };
+            }
+
+            // How the upscale pass uses the history, besides sampling the frame in the shader
+            // read only layout.
+            static std::array<vk_render_graph::ResourceAccess, 2> historyAccesses(const HistoryResources& history) {
+                return {
+                    vk_render_graph::read(history.previous, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT, VK_IMAGE_LAYOUT_GENERAL),
+                    vk_render_graph::write(history.current, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL),
+                };
+            }
+
+            // Blends `renderExtent` of the `inputSize` frame in `inputView`, rendered with the
+            // projection offset by `jitter` pixels, into the window's history.
+            void record(
+                VkCommandBuffer commandBuffer,
+                uint32_t windowIndex,
+                VkImageView inputView,
+                VkExtent2D inputSize,
+                VkExtent2D renderExtent,
+                glm::vec2 jitter
+            ) const {
+                const auto& window = m_windows[windowIndex];
+                const auto inputInfo = VkDescriptorImageInfo { m_sampler, inputView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+                const auto previousInfo = VkDescriptorImageInfo { VK_NULL_HANDLE, window.images[1 - window.current].view, VK_IMAGE_LAYOUT_GENERAL };
+                const auto currentInfo = VkDescriptorImageInfo { VK_NULL_HANDLE, window.images[window.current].view, VK_IMAGE_LAYOUT_GENERAL };
+                auto writes = std::array {
+                    VkWriteDescriptorSet {
+                        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                        .dstBinding = 0,
+                        .descriptorCount = 1,
+                        .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                        .pImageInfo = &inputInfo,
+                    },
+                    VkWriteDescriptorSet {
+                        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                        .dstBinding = 1,
+                        .descriptorCount = 1,
+                        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                        .pImageInfo = &previousInfo,
+                    },
+                    VkWriteDescriptorSet {
+                        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                        .dstBinding = 2,
+                        .descriptorCount = 1,
+                        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                        .pImageInfo = &currentInfo,
+                    },
+                };
+                const auto pushConstants = PushConstants {
+                    .outputSize = { window.extent.width, window.extent.height },
+                    .renderExtent = { renderExtent.width, renderExtent.height },
+                    .inputSize = { static_cast<float>(inputSize.width), static_cast<float>(inputSize.height) },
+                    .jitter = { jitter.x, jitter.y },
+                    .historyValid = window.historyValid ? 1u : 0u,
+                };
+
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+                m_descriptors.bind(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, writes);
+                vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+                vkCmdDispatch(commandBuffer, (window.extent.width + m_tile - 1) / m_tile, (window.extent.height + m_tile - 1) / m_tile, 1);
+            }
+        private:
+            // Matches `temporal_upscale.comp`.
+            struct PushConstants {
+                uint32_t outputSize[2];
+                uint32_t renderExtent[2];
+                float inputSize[2];
+                float jitter[2];
+                uint32_t historyValid;
+            };
+
+            struct HistoryImage {
+                vk_memory::ScopedAllocation memory;
+                vk_handles::Image image;
+                vk_handles::ImageView view;
+            };
+
+            // `valid` once the images have been written by a frame, and `historyValid` whether
+            // the frame being recorded has a history to read.
+            struct WindowHistory {
+                VkExtent2D extent {};
+                std::array<HistoryImage, 2> images;
+                uint32_t current = 0;
+                bool valid = false;
+                bool historyValid = false;
+            };
+
+            VkDevice m_device = VK_NULL_HANDLE;
+            const VkAllocationCallbacks* m_allocator = nullptr;
+            vk_memory::DeviceMemoryAllocator* m_memoryAllocator = nullptr;
+            vk_descriptors::PerDrawDescriptors m_descriptors;
+            VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+            VkPipeline m_pipeline = VK_NULL_HANDLE;
+            VkSampler m_sampler = VK_NULL_HANDLE;
+            uint32_t m_tile = 8;
+            std::vector<WindowHistory> m_windows;
+
+            void prepareHistory(WindowHistory& window, VkExtent2D extent, vk_handles::DeferredDestructionQueue& retiredResources, uint64_t retireValue) {
+                if (window.images[0].image && window.extent.width == extent.width && window.extent.height == extent.height) {
+                    return;
+                }
+
+                if (window.images[0].image) {
+                    retiredResources.retire(retireValue, std::move(window.images));
+                }
+
+                window.extent = extent;
+                window.valid = false;
+                for (auto& history : window.images) {
+                    history = this->createHistoryImage(extent);
+                }
+            }
+
+            HistoryImage createHistoryImage(VkExtent2D extent) const {
+                const auto imageInfo = VkImageCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+                    .imageType = VK_IMAGE_TYPE_2D,
+                    .format = HISTORY_FORMAT,
+                    .extent = VkExtent3D { extent.width, extent.height, 1 },
+                    .mipLevels = 1,
+                    .arrayLayers = 1,
+                    .samples = VK_SAMPLE_COUNT_1_BIT,
+                    .tiling = VK_IMAGE_TILING_OPTIMAL,
+                    // Blitted into the swapchain image, or sampled by the post processing pass.
+                    .usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                    .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                };
+
+                auto image = VkImage {};
+                const auto imageResult = vkCreateImage(m_device, &imageInfo, m_allocator, &image);
+                if (imageResult != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create upscale history!");
+                }
+
+                auto history = HistoryImage();
+                history.image = vk_handles::Image { m_device, image, m_allocator };
+                history.memory = vk_memory::ScopedAllocation {
+                    *m_memoryAllocator,
+                    m_memoryAllocator->allocateForImage(image, vk_memory::AllocationCreateInfo {
+                        .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                        .kind = vk_memory::ResourceKind::Optimal,
+                        .priority = vk_memory::MemoryPriority::High,
+                    }),
+                };
+
+                const auto viewInfo = VkImageViewCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+                    .image = image,
+                    .viewType = VK_IMAGE_VIEW_TYPE_2D,
+                    .format = HISTORY_FORMAT,
+                    .subresourceRange = VkImageSubresourceRange {
+                        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                        .baseMipLevel = 0,
+                        .levelCount = 1,
+                        .baseArrayLayer = 0,
+                        .layerCount = 1,
+                    },
+                };
+
+                auto imageView = VkImageView {};
+                const auto viewResult = vkCreateImageView(m_device, &viewInfo, m_allocator, &imageView);
+                if (viewResult != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create upscale history view!");
+                }
+
+                history.view = vk_handles::ImageView { m_device, imageView, m_allocator };
+
+                return history;
+            }
+    };
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+
+namespace vk_validation {
+    constexpr const char* KHRONOS_VALIDATION_LAYER = "VK_LAYER_KHRONOS_validation";
+
+    // How much the validation layer checks, from nothing at all to the expensive GPU side and
+    // synchronization validation.
+    //
+    // * `Off` does not load the layer.
+    // * `ErrorsOnly` reports errors only, and skips thread safety and shader validation, the
+    //   most expensive checks that run on every call, for sessions close to production speed.
+    // * `Full` runs the layer's default checks and reports errors, warnings and performance
+    //   warnings.
+    // * `GpuAssisted` adds GPU assisted validation, which instruments shaders to catch out of
+    //   bounds descriptor and buffer device address accesses.
+    // * `Synchronization` adds synchronization validation, which catches missing barriers.
+    enum class ValidationPolicy {
+        Off,
+        ErrorsOnly,
+        Full,
+        GpuAssisted,
+        Synchronization,
+    };
+
+    inline const char* validationPolicyToString(ValidationPolicy policy) {
+        switch (policy) {
+            case ValidationPolicy::Off: return "off";
+            case ValidationPolicy::ErrorsOnly: return "errors";
+            case ValidationPolicy::Full: return "full";
+            case ValidationPolicy::GpuAssisted: return "gpu-assisted";
+            case ValidationPolicy::Synchronization: return "sync";
+        }
+
+        return "unknown";
+    }
+
+    inline std::optional<ValidationPolicy> validationPolicyFromString(std::string_view name) {
+        for (const auto policy : { ValidationPolicy::Off, ValidationPolicy::ErrorsOnly, ValidationPolicy::Full, ValidationPolicy::GpuAssisted, ValidationPolicy::Synchronization }) {
+            if (name == validationPolicyToString(policy)) {
+                return policy;
+            }
+        }
+
+        return std::nullopt;
+    }
+
+    // The severities to ask the debug messenger for. Verbose and info messages are never
+    // requested, since formatting them costs more than every check the layer makes.
+    inline VkDebugUtilsMessageSeverityFlagsEXT messageSeverities(ValidationPolicy policy) {
+        if (policy == ValidationPolicy::ErrorsOnly) {
+            return VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+        }
+
+        return VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+    }
+
+    // The `VK_EXT_layer_settings` settings of the Khronos validation layer for a policy,
+    // chained into the instance create info. The structure points into its own storage, so it
+    // can neither be copied nor moved.
+    class LayerSettings {
+        public:
+            explicit LayerSettings(ValidationPolicy policy) {
+                if (policy == ValidationPolicy::ErrorsOnly) {
+                    this->addStrings("report_flags", ERROR_REPORT_FLAGS);
+                    this->addBool("thread_safety", m_false);
+                    this->addBool("check_shaders", m_false);
+                } else {
+                    this->addStrings("report_flags", DEFAULT_REPORT_FLAGS);
+                }
+
+                if (policy == ValidationPolicy::GpuAssisted) {
+                    this->addStrings("validate_gpu_based", GPU_ASSISTED);
+                }
+
+                if (policy == ValidationPolicy::Synchronization) {
+                    this->addBool("validate_sync", m_true);
+                }
+
+                m_createInfo = VkLayerSettingsCreateInfoEXT {
+                    .sType = VK_STRUCTURE_TYPE_LAYER_SETTINGS_CREATE_INFO_EXT,
+                    .pNext = nullptr,
+                    .settingCount = static_cast<uint32_t>(m_settings.size()),
+                    .pSettings = m_settings.data(),
+                };
+            }
+
+            LayerSettings(const LayerSettings& other) = delete;
+            LayerSettings& operator=(const LayerSettings& other) = delete;
+
+            // Chain `next` behind the settings and return the head of the chain.
+            const VkLayerSettingsCreateInfoEXT* chain(const void* next) {
+                m_createInfo.pNext = next;
+
+                return &m_createInfo;
+            }
+        private:
+            static constexpr auto ERROR_REPORT_FLAGS = std::array<const char*, 1> { "error" };
+            static constexpr auto DEFAULT_REPORT_FLAGS = std::array<const char*, 3> { "error", "warn", "perf" };
+            static constexpr auto GPU_ASSISTED = std::array<const char*, 1> { "GPU_BASED_GPU_ASSISTED" };
+
+            const VkBool32 m_true = VK_TRUE;
+            const VkBool32 m_false = VK_FALSE;
+            std::vector<VkLayerSettingEXT> m_settings;
+            VkLayerSettingsCreateInfoEXT m_createInfo {};
+
+            void addBool(const char* name, const VkBool32& value) {
+                m_settings.push_back(VkLayerSettingEXT {
+                    .pLayerName = KHRONOS_VALIDATION_LAYER,
+                    .pSettingName = name,
+                    .type = VK_LAYER_SETTING_TYPE_BOOL32_EXT,
+                    .valueCount = 1,
+                    .pValues = &value,
+                });
+            }
+
+            template <size_t N>
+            void addStrings(const char* name, const std::array<const char*, N>& values) {
+                m_settings.push_back(VkLayerSettingEXT {
+                    .pLayerName = KHRONOS_VALIDATION_LAYER,
+                    .pSettingName = name,
+                    .type = VK_LAYER_SETTING_TYPE_STRING_EXT,
+                    .valueCount = static_cast<uint32_t>(N),
+                    .pValues = values.data(),
+                });
+            }
+    };
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <span>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+
+namespace vk_vertex_format {
+    // Compact vertex attributes cut the bandwidth of vertex fetch, which tile based GPUs pay
+    // twice, once for binning and once for shading. Every encoding reads back with a format
+    // vertex buffers support everywhere.
+    //
+    // The box a mesh's positions are quantized relative to. `extent` is never zero, so a flat
+    // mesh still quantizes.
+    struct QuantizationBounds {
+        glm::vec3 min { 0.0f };
+        glm::vec3 extent { 1.0f };
+    };
+
+    inline QuantizationBounds computeBounds(std::span<const glm::vec3> positions) {
+        if (positions.empty()) {
+            return QuantizationBounds {};
+        }
+
+        auto min = positions.front();
+        auto max = positions.front();
+        for (const auto& position : positions) {
+            min = glm::min(min, position);
+            max = glm::max(max, position);
+        }
+
+        return QuantizationBounds {
+            .min = min,
+            .extent = glm::max(max - min, glm::vec3 { 1e-6f }),
+        };
+    }
+
+    // A position as 16 bit fractions of the bounds, read as `VK_FORMAT_R16G16B16A16_UNORM`,
+    // since three component 16 bit formats are optional for vertex buffers. The error is at
+    // most half a step, 1/131070 of the bounds.
+    inline std::array<uint16_t, 4> quantizePosition(const glm::vec3& position, const QuantizationBounds& bounds) {
+        const auto normalized = glm::clamp((position - bounds.min) / bounds.extent, glm::vec3 { 0.0f }, glm::vec3 { 1.0f });
+        const auto quantized = glm::round(normalized * 65535.0f);
+
+        return {
+            static_cast<uint16_t>(quantized.x),
+            static_cast<uint16_t>(quantized.y),
+            static_cast<uint16_t>(quantized.z),
+            0,
+        };
+    }
+
+    // A unit vector folded onto the octahedron and flattened into a square, as two 16 bit
+    // signed fractions read as `VK_FORMAT_R16G16_SNORM`. Normals and tangents both encode this
+    // way, a tangent's handedness going into a separate sign. Decoded by `decodeOctahedral` in
+    // `scene.glsl`, with an angular error well below what shading shows.
+    inline std::array<int16_t, 2> encodeOctahedral(const glm::vec3& direction) {
+        const auto signNotZero = [](float value) {
+            return value >= 0.0f ? 1.0f : -1.0f;
+        };
+
+        auto folded = glm::vec2 { direction } / (std::abs(direction.x) + std::abs(direction.y) + std::abs(direction.z));
+        if (direction.z < 0.0f) {
+            folded = glm::vec2 {
+                (1.0f - std::abs(folded.y)) * signNotZero(folded.x),
+                (1.0f - std::abs(folded.x)) * signNotZero(folded.y),
+            };
+        }
+
+        const auto quantized = glm::round(glm::clamp(folded, glm::vec2 { -1.0f }, glm::vec2 { 1.0f }) * 32767.0f);
+
+        return { static_cast<int16_t>(quantized.x), static_cast<int16_t>(quantized.y) };
+    }
+
+    // Texture coordinates as half floats, read as `VK_FORMAT_R16G16_SFLOAT`, which keeps a
+    // texel's precision for coordinates up to a few repeats of textures up to 2048 texels.
+    inline uint32_t encodeTextureCoordinates(const glm::vec2& coordinates) {
+        return glm::packHalf2x16(coordinates);
+    }
+}
@@ -0,0 +1,1265 @@
+#pragma once
+
+#include "vk_dispatch.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "vk_compute.h"
+#include "vk_descriptors.h"
+#include "vk_log.h"
+#include "vk_memory.h"
+#include "vk_pipelines.h"
+#include "vk_shaders.h"
+#include "vk_submit.h"
+
+
+namespace vk_video_encode {
+    // The picture format the encoder reads, two planes of 4:2:0 luma and interleaved chroma,
+    // which every H.264 encoder takes.
+    constexpr VkFormat PICTURE_FORMAT = VK_FORMAT_G8_B8R8_2PLANE_420_UNORM;
+    constexpr VkFormat LUMA_PLANE_FORMAT = VK_FORMAT_R8_UNORM;
+    constexpr VkFormat CHROMA_PLANE_FORMAT = VK_FORMAT_R8G8_UNORM;
+
+    // Pictures are coded in whole macroblocks, and the padding past the image is cropped away
+    // by the sequence parameter set.
+    constexpr uint32_t MACROBLOCK_SIZE = 16;
+
+    // The previous picture is the only reference, so two DPB slots take turns holding the
+    // reference and the picture being reconstructed.
+    constexpr uint32_t DPB_SLOT_COUNT = 2;
+
+    // The specialization constant ids of `local_size_x` and `local_size_y` in
+    // `video_encode.comp`.
+    constexpr uint32_t WORKGROUP_WIDTH_ID = 0;
+    constexpr uint32_t WORKGROUP_HEIGHT_ID = 1;
+
+    struct EncodeSettings {
+        std::filesystem::path outputPath;
+        uint32_t bitrate = 8'000'000;
+        uint32_t frameRate = 60;
+    };
+
+    // The codecs each queue family can encode, by family index.
+    inline std::vector<VkVideoCodecOperationFlagsKHR> queueFamilyVideoCodecs(VkPhysicalDevice physicalDevice) {
+        uint32_t queueFamilyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties2(physicalDevice, &queueFamilyCount, nullptr);
+
+        auto videoProperties = std::vector<VkQueueFamilyVideoPropertiesKHR>(queueFamilyCount, VkQueueFamilyVideoPropertiesKHR {
+            .sType = VK_STRUCTURE_TYPE_QUEUE_FAMILY_VIDEO_PROPERTIES_KHR,
+        });
+        auto properties = std::vector<VkQueueFamilyProperties2>(queueFamilyCount, VkQueueFamilyProperties2 {
+            .sType = VK_STRUCTURE_TYPE_QUEUE_FAMILY_PROPERTIES_2,
+        });
+        for (uint32_t i = 0; i < queueFamilyCount; i++) {
+            properties[i].pNext = &videoProperties[i];
+        }
+        vkGetPhysicalDeviceQueueFamilyProperties2(physicalDevice, &queueFamilyCount, properties.data());
+
+        auto codecs = std::vector<VkVideoCodecOperationFlagsKHR> {};
+        for (uint32_t i = 0; i < queueFamilyCount; i++) {
+            const bool encodes = properties[i].queueFamilyProperties.queueFlags & VK_QUEUE_VIDEO_ENCODE_BIT_KHR;
+            codecs.push_back(encodes ? videoProperties[i].videoCodecOperations : 0);
+        }
+
+        return codecs;
+    }
+
+    // The 8 bit 4:2:0 H.264 Main profile, which every decoder plays. Images and buffers the
+    // encoder touches are created for it, through the profile list.
+    struct H264Profile {
+        VkVideoEncodeH264ProfileInfoKHR codec {
+            .sType = VK_STRUCTURE_TYPE_VIDEO_ENCODE_H264_PROFILE_INFO_KHR,
+            .stdProfileIdc = STD_VIDEO_H264_PROFILE_IDC_MAIN,
+        };
+        VkVideoProfileInfoKHR profile {
+            .sType = VK_STRUCTURE_TYPE_VIDEO_PROFILE_INFO_KHR,
+            .videoCodecOperation = VK_VIDEO_CODEC_OPERATION_ENCODE_H264_BIT_KHR,
+            .chromaSubsampling = VK_VIDEO_CHROMA_SUBSAMPLING_420_BIT_KHR,
+            .lumaBitDepth = VK_VIDEO_COMPONENT_BIT_DEPTH_8_BIT_KHR,
+            .chromaBitDepth = VK_VIDEO_COMPONENT_BIT_DEPTH_8_BIT_KHR,
+        };
+        VkVideoProfileListInfoKHR list {
+            .sType = VK_STRUCTURE_TYPE_VIDEO_PROFILE_LIST_INFO_KHR,
+            .profileCount = 1,
+        };
+
+        // The structures point at each other, so they are linked once they stay put.
+        void link() {
+            profile.pNext = &codec;
+            list.pProfiles = &profile;
+        }
+    };
+
+    // What the device encodes the profile with, filled by `querySupport`.
+    struct EncodeSupport {
+        VkVideoCapabilitiesKHR capabilities {};
+        VkVideoEncodeCapabilitiesKHR encodeCapabilities {};
+        VkVideoEncodeH264CapabilitiesKHR h264Capabilities {};
+        VkImageCreateFlags pictureCreateFlags = 0;
+    };
+
+    // How pictures of the profile in `PICTURE_FORMAT` can be made for `usage`, or nothing when
+    // they cannot.
+    inline std::optional<VkVideoFormatPropertiesKHR> pictureFormat(VkPhysicalDevice physicalDevice, const H264Profile& profile, VkImageUsageFlags usage) {
+        const auto formatInfo = VkPhysicalDeviceVideoFormatInfoKHR {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VIDEO_FORMAT_INFO_KHR,
+            .pNext = &profile.list,
+            .imageUsage = usage,
+        };
+
+        uint32_t formatCount = 0;
+        if (vkGetPhysicalDeviceVideoFormatPropertiesKHR(physicalDevice, &formatInfo, &formatCount, nullptr) != VK_SUCCESS) {
+            return std::nullopt;
+        }
+
+        auto formats = std::vector<VkVideoFormatPropertiesKHR>(formatCount, VkVideoFormatPropertiesKHR {
+            .sType = VK_STRUCTURE_TYPE_VIDEO_FORMAT_PROPERTIES_KHR,
+        });
+        if (vkGetPhysicalDeviceVideoFormatPropertiesKHR(physicalDevice, &formatInfo, &formatCount, formats.data()) != VK_SUCCESS) {
+            return std::nullopt;
+        }
+
+        for (const auto& format : formats) {
+            if (format.format == PICTURE_FORMAT && format.imageTiling == VK_IMAGE_TILING_OPTIMAL) {
+                return format;
+            }
+        }
+
+        return std::nullopt;
+    }
+
+    // A compute shader writes the pictures through views of their planes, which takes
+    // pictures made with views of other formats and usages. Logs why the device cannot
+    // encode `extent`, and returns nothing then.
+    inline std::optional<EncodeSupport> querySupport(VkPhysicalDevice physicalDevice, VkExtent2D extent) {
+        auto profile = H264Profile {};
+        profile.link();
+
+        auto support = EncodeSupport {};
+        support.h264Capabilities = VkVideoEncodeH264CapabilitiesKHR {
+            .sType = VK_STRUCTURE_TYPE_VIDEO_ENCODE_H264_CAPABILITIES_KHR,
+        };
+        support.encodeCapabilities = VkVideoEncodeCapabilitiesKHR {
+            .sType = VK_STRUCTURE_TYPE_VIDEO_ENCODE_CAPABILITIES_KHR,
+            .pNext = &support.h264Capabilities,
+        };
+        support.capabilities = VkVideoCapabilitiesKHR {
+            .sType = VK_STRUCTURE_TYPE_VIDEO_CAPABILITIES_KHR,
+            .pNext = &support.encodeCapabilities,
+        };
+        if (vkGetPhysicalDeviceVideoCapabilitiesKHR(physicalDevice, &profile.profile, &support.capabilities) != VK_SUCCESS) {
+            VK_LOG_WARNING("Video encode: the device does not encode H.264 Main");
+            return std::nullopt;
+        }
+
+        // The pointers went stale with the copy out of the query.
+        support.capabilities.pNext = nullptr;
+        support.encodeCapabilities.pNext = nullptr;
+
+        const auto& capabilities = support.capabilities;
+        const auto codedWidth = (extent.width + MACROBLOCK_SIZE - 1) / MACROBLOCK_SIZE * MACROBLOCK_SIZE;
+        const auto codedHeight = (extent.height + MACROBLOCK_SIZE - 1) / MACROBLOCK_SIZE * MACROBLOCK_SIZE;
+        if (
+            codedWidth < capabilities.minCodedExtent.width
+            || codedHeight < capabilities.minCodedExtent.height
+            || codedWidth > capabilities.maxCodedExtent.width
+            || codedHeight > capabilities.maxCodedExtent.height
+        ) {
+            VK_LOG_WARNING(
+                "Video encode: {}x{} is outside the {}x{} to {}x{} the device encodes",
+                extent.width,
+                extent.height,
+                capabilities.minCodedExtent.width,
+                capabilities.minCodedExtent.height,
+                capabilities.maxCodedExtent.width,
+                capabilities.maxCodedExtent.height
+            );
+            return std::nullopt;
+        } else if (capabilities.maxDpbSlots < DPB_SLOT_COUNT || capabilities.maxActiveReferencePictures < 1 || support.h264Capabilities.maxPPictureL0ReferenceCount < 1) {
+            VK_LOG_WARNING("Video encode: the device cannot encode P pictures");
+            return std::nullopt;
+        }
+
+        const auto feedbackFlags = VkVideoEncodeFeedbackFlagsKHR {
+            VK_VIDEO_ENCODE_FEEDBACK_BITSTREAM_BUFFER_OFFSET_BIT_KHR | VK_VIDEO_ENCODE_FEEDBACK_BITSTREAM_BYTES_WRITTEN_BIT_KHR
+        };
+        if ((support.encodeCapabilities.supportedEncodeFeedbackFlags & feedbackFlags) != feedbackFlags) {
+            VK_LOG_WARNING("Video encode: the device does not report where it wrote the bitstream");
+            return std::nullopt;
+        }
+
+        const auto picture = pictureFormat(physicalDevice, profile, VK_IMAGE_USAGE_VIDEO_ENCODE_SRC_BIT_KHR);
+        const auto dpb = pictureFormat(physicalDevice, profile, VK_IMAGE_USAGE_VIDEO_ENCODE_DPB_BIT_KHR);
+        const auto planeFlags = VkImageCreateFlags { VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT | VK_IMAGE_CREATE_EXTENDED_USAGE_BIT };
+        if (!picture.has_value() || !dpb.has_value()) {
+            VK_LOG_WARNING("Video encode: the device does not encode pictures in the two plane 4:2:0 format");
+            return std::nullopt;
+        } else if ((picture->imageCreateFlags & planeFlags) != planeFlags || !(picture->imageUsageFlags & VK_IMAGE_USAGE_STORAGE_BIT)) {
+            VK_LOG_WARNING("Video encode: the device cannot write pictures through views of their planes");
+            return std::nullopt;
+        }
+
+        for (const auto format : { LUMA_PLANE_FORMAT, CHROMA_PLANE_FORMAT }) {
+            auto formatProperties = VkFormatProperties {};
+            vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProperties);
+            if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT)) {
+                VK_LOG_WARNING("Video encode: compute shaders cannot write the planes of a picture");
+                return std::nullopt;
+            }
+        }
+
+        support.pictureCreateFlags = planeFlags;
+
+        return support;
+    }
+
+    // Encodes the frames of a headless run to an H.264 elementary stream on the device's video
+    // encode queue, straight from the rendered images. Each frame, a compute pass on the
+    // graphics queue converts the rendered image into that frame slot's picture and hands the
+    // picture over to the encode family, and the encode queue encodes it once the frame
+    // timeline semaphore says the frame is done, while the graphics queue goes on with the
+    // next frame. The bitstream goes to the file when the frame slot comes around again,
+    // by which time the encode has long finished.
+    //
+    // The stream starts with an IDR picture and one more every second, each preceded by the
+    // parameter sets, so a player can join at any of them, and every other picture is a P
+    // picture referencing the one before it.
+    class VideoEncoder {
+        public:
+            explicit VideoEncoder() = default;
+
+            VideoEncoder(const VideoEncoder& other) = delete;
+            VideoEncoder& operator=(const VideoEncoder& other) = delete;
+
+            void init(
+                VkDevice device,
+                vk_memory::DeviceMemoryAllocator& memoryAllocator,
+                vk_descriptors::DescriptorLayoutCache& layoutCache,
+                vk_descriptors::FrameDescriptorAllocator& frameDescriptors,
+                vk_shaders::ShaderLibrary& shaderLibrary,
+                vk_pipelines::PipelineRegistry& pipelineRegistry,
+                const vk_compute::ComputeTuning& computeTuning,
+                const VkAllocationCallbacks* allocator,
+                VkQueue encodeQueue,
+                uint32_t encodeQueueFamily,
+                uint32_t graphicsQueueFamily,
+                const EncodeSupport& support,
+                VkExtent2D extent,
+                uint32_t framesInFlight,
+                const EncodeSettings& settings
+            ) {
+                m_device = device;
+                m_memoryAllocator = &memoryAllocator;
+                m_frameDescriptors = &frameDescriptors;
+                m_allocator = allocator;
+                m_encodeQueue = encodeQueue;
+                m_encodeQueueFamily = encodeQueueFamily;
+                m_graphicsQueueFamily = graphicsQueueFamily;
+                m_support = support;
+                m_extent = extent;
+                m_codedExtent = VkExtent2D {
+                    (extent.width + MACROBLOCK_SIZE - 1) / MACROBLOCK_SIZE * MACROBLOCK_SIZE,
+                    (extent.height + MACROBLOCK_SIZE - 1) / MACROBLOCK_SIZE * MACROBLOCK_SIZE,
+                };
+                m_tile = computeTuning.tile;
+                m_frameRate = std::max(settings.frameRate, 1u);
+                m_idrPeriod = m_frameRate;
+                m_profile.link();
+
+                m_output = std::ofstream { settings.outputPath, std::ios::binary | std::ios::trunc };
+                if (!m_output) {
+                    throw std::runtime_error("failed to open the video encode output file!");
+                }
+
+                this->createSession();
+                this->createSessionParameters();
+                this->createRateControl(settings.bitrate);
+                this->createPictures(framesInFlight);
+                this->createBitstream(framesInFlight);
+                this->createCommands(framesInFlight);
+                this->createConversion(layoutCache, shaderLibrary, pipelineRegistry);
+
+                VK_LOG_INFO(
+                    "Video encode: H.264 at {} kbit/s {}, {}x{} coded {}x{}, to {}",
+                    settings.bitrate / 1000,
+                    rateControlModeToString(m_rateControl.rateControlMode),
+                    m_extent.width,
+                    m_extent.height,
+                    m_codedExtent.width,
+                    m_codedExtent.height,
+                    settings.outputPath.string()
+                );
+            }
+
+            // The device has to be idle, and `finish` to have written out every frame.
+            void destroy() {
+                if (m_device == VK_NULL_HANDLE) {
+                    return;
+                }
+
+                vkDestroyPipelineLayout(m_device, m_pipelineLayout, m_allocator);
+                vkDestroyCommandPool(m_device, m_commandPool, m_allocator);
+                vkDestroySemaphore(m_device, m_encodeSemaphore, m_allocator);
+                vkDestroyQueryPool(m_device, m_queryPool, m_allocator);
+                vkDestroyBuffer(m_device, m_bitstreamBuffer, m_allocator);
+                m_memoryAllocator->free(m_bitstreamAllocation);
+                for (auto& picture : m_pictures) {
+                    vkDestroyImageView(m_device, picture.pictureView, m_allocator);
+                    vkDestroyImageView(m_device, picture.lumaView, m_allocator);
+                    vkDestroyImageView(m_device, picture.chromaView, m_allocator);
+                    vkDestroyImage(m_device, picture.image, m_allocator);
+                    m_memoryAllocator->free(picture.allocation);
+                }
+
+                vkDestroyImageView(m_device, m_dpbView, m_allocator);
+                vkDestroyImage(m_device, m_dpbImage, m_allocator);
+                m_memoryAllocator->free(m_dpbAllocation);
+                vkDestroyVideoSessionParametersKHR(m_device, m_sessionParameters, m_allocator);
+                vkDestroyVideoSessionKHR(m_device, m_session, m_allocator);
+                for (const auto& allocation : m_sessionAllocations) {
+                    m_memoryAllocator->free(allocation);
+                }
+
+                m_pictures.clear();
+                m_slots.clear();
+                m_sessionAllocations.clear();
+                m_pipelineLayout = VK_NULL_HANDLE;
+                m_pipeline = VK_NULL_HANDLE;
+                m_device = VK_NULL_HANDLE;
+            }
+
+            bool isInitialized() const {
+                return m_device != VK_NULL_HANDLE;
+            }
+
+            // Converts `source`, the rendered image of frame slot `frameSlot` in the general
+            // layout, into the slot's picture, and releases the picture to the encode queue.
+            // `collect` has to have taken the slot's previous frame.
+            void recordConversion(VkCommandBuffer commandBuffer, uint32_t frameSlot, VkImageView source) {
+                const auto& picture = m_pictures[frameSlot];
+                m_slots[frameSlot].converted = true;
+                this->pictureBarrier(
+                    commandBuffer,
+                    picture.image,
+                    VK_IMAGE_LAYOUT_UNDEFINED,
+                    VK_IMAGE_LAYOUT_GENERAL,
+                    VK_PIPELINE_STAGE_2_NONE,
+                    VK_ACCESS_2_NONE,
+                    VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                    VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                    VK_QUEUE_FAMILY_IGNORED,
+                    VK_QUEUE_FAMILY_IGNORED
+                );
+
+                const auto set = m_frameDescriptors->allocate(m_setLayout);
+                const auto imageInfos = std::array {
+                    VkDescriptorImageInfo { VK_NULL_HANDLE, source, VK_IMAGE_LAYOUT_GENERAL },
+                    VkDescriptorImageInfo { VK_NULL_HANDLE, picture.lumaView, VK_IMAGE_LAYOUT_GENERAL },
+                    VkDescriptorImageInfo { VK_NULL_HANDLE, picture.chromaView, VK_IMAGE_LAYOUT_GENERAL },
+                };
+                auto writes = std::array<VkWriteDescriptorSet, 3> {};
+                for (uint32_t i = 0; i < writes.size(); i++) {
+                    writes[i] = VkWriteDescriptorSet {
+                        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                        .dstSet = set,
+                        .dstBinding = i,
+                        .descriptorCount = 1,
+                        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                        .pImageInfo = &imageInfos[i],
+                    };
+                }
+                vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+
+                const auto chromaWidth = m_codedExtent.width / 2;
+                const auto chromaHeight = m_codedExtent.height / 2;
+                const auto pushConstants = PushConstants {
+                    .sourceSize = { m_extent.width, m_extent.height },
+                    .chromaSize = { chromaWidth, chromaHeight },
+                };
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+                vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &set, 0, nullptr);
+                vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+                vkCmdDispatch(commandBuffer, (chromaWidth + m_tile - 1) / m_tile, (chromaHeight + m_tile - 1) / m_tile, 1);
+
+                // The encode submission waits for the frame's whole submission, so the release
+                // only has to make the writes available.
+                this->pictureBarrier(
+                    commandBuffer,
+                    picture.image,
+                    VK_IMAGE_LAYOUT_GENERAL,
+                    VK_IMAGE_LAYOUT_VIDEO_ENCODE_SRC_KHR,
+                    VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                    VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                    VK_PIPELINE_STAGE_2_NONE,
+                    VK_ACCESS_2_NONE,
+                    this->transfersOwnership() ? m_graphicsQueueFamily : VK_QUEUE_FAMILY_IGNORED,
+                    this->transfersOwnership() ? m_encodeQueueFamily : VK_QUEUE_FAMILY_IGNORED
+                );
+            }
+
+            // Encodes the picture frame `frameNumber` converted into its slot, once the frame
+            // timeline semaphore reaches `frameNumber + 1`, in a submission added to `batcher`.
+            // Frames that recorded no conversion are left out of the stream.
+            VkResult submit(uint32_t frameSlot, uint64_t frameNumber, VkSemaphore frameTimelineSemaphore, vk_submit::SubmitBatcher& batcher) {
+                auto& slot = m_slots[frameSlot];
+                if (!std::exchange(slot.converted, false)) {
+                    return VK_SUCCESS;
+                }
+
+                const bool idr = m_framesSinceIdr % m_idrPeriod == 0;
+                if (idr) {
+                    m_framesSinceIdr = 0;
+                    m_frameNum = 0;
+                }
+
+                const auto commandBuffer = slot.commandBuffer;
+                vkResetCommandBuffer(commandBuffer, 0);
+                const auto beginInfo = VkCommandBufferBeginInfo {
+                    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                    .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+                };
+                if (const auto result = vkBeginCommandBuffer(commandBuffer, &beginInfo); result != VK_SUCCESS) {
+                    return result;
+                }
+
+                this->recordEncode(commandBuffer, frameSlot, idr);
+
+                if (const auto result = vkEndCommandBuffer(commandBuffer); result != VK_SUCCESS) {
+                    return result;
+                }
+
+                const auto signalValue = ++m_encodeCount;
+                const auto wait = vk_submit::semaphoreInfo(frameTimelineSemaphore, frameNumber + 1, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT);
+                const auto commandBufferInfo = vk_submit::commandBufferInfo(commandBuffer);
+                const auto signal = vk_submit::semaphoreInfo(m_encodeSemaphore, signalValue, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT);
+                batcher.add(m_encodeQueue, vk_submit::Submission {
+                    .waits = std::span { &wait, 1 },
+                    .commandBuffers = std::span { &commandBufferInfo, 1 },
+                    .signals = std::span { &signal, 1 },
+                });
+
+                slot.pendingValue = signalValue;
+                slot.idr = idr;
+                m_framesSinceIdr++;
+                m_frameNum = (m_frameNum + 1) % MAX_FRAME_NUM;
+                m_currentDpbSlot = (m_currentDpbSlot + 1) % DPB_SLOT_COUNT;
+                m_hasReference = true;
+                if (idr) {
+                    m_idrPicId++;
+                }
+
+                return VK_SUCCESS;
+            }
+
+            // Writes out the frame last encoded from `frameSlot`, waiting for its encode when it
+            // is still running, which frees the slot's picture and bitstream for another frame.
+            VkResult collect(uint32_t frameSlot) {
+                auto& slot = m_slots[frameSlot];
+                if (slot.pendingValue == 0) {
+                    return VK_SUCCESS;
+                }
+
+                const auto waitInfo = VkSemaphoreWaitInfo {
+                    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+                    .semaphoreCount = 1,
+                    .pSemaphores = &m_encodeSemaphore,
+                    .pValues = &slot.pendingValue,
+                };
+                if (const auto result = vkWaitSemaphores(m_device, &waitInfo, std::numeric_limits<uint64_t>::max()); result != VK_SUCCESS) {
+                    return result;
+                }
+
+                slot.pendingValue = 0;
+
+                // The offset into the slot's range, the bytes written and the status.
+                auto feedback = std::array<int64_t, 3> {};
+                const auto result = vkGetQueryPoolResults(
+                    m_device,
+                    m_queryPool,
+                    frameSlot,
+                    1,
+                    sizeof(feedback),
+                    feedback.data(),
+                    sizeof(feedback),
+                    VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT | VK_QUERY_RESULT_WITH_STATUS_BIT_KHR
+                );
+                if (result != VK_SUCCESS) {
+                    return result;
+                }
+
+                const auto offset = static_cast<VkDeviceSize>(feedback[0]);
+                const auto size = static_cast<VkDeviceSize>(feedback[1]);
+                if (feedback[2] <= 0 || offset + size > m_bitstreamSlotSize) {
+                    VK_LOG_WARNING("Video encode: a frame failed to encode, with status {}", feedback[2]);
+                    return VK_SUCCESS;
+                }
+
+                if (slot.idr) {
+                    m_output.write(reinterpret_cast<const char*>(m_parameterSets.data()), static_cast<std::streamsize>(m_parameterSets.size()));
+                }
+
+                const auto* bitstream = static_cast<const char*>(m_bitstreamAllocation.mappedData) + frameSlot * m_bitstreamSlotSize + offset;
+                m_output.write(bitstream, static_cast<std::streamsize>(size));
+                m_encodedFrames++;
+                m_encodedBytes += size;
+
+                return VK_SUCCESS;
+            }
+
+            // Writes out every frame still encoding and closes the stream.
+            VkResult finish() {
+                for (uint32_t i = 0; i < m_slots.size(); i++) {
+                    if (const auto result = this->collect(i); result != VK_SUCCESS) {
+                        return result;
+                    }
+                }
+
+                if (m_output.is_open()) {
+                    m_output.close();
+                    VK_LOG_INFO("Video encode: wrote {} frames, {:.1f} MiB", m_encodedFrames, static_cast<double>(m_encodedBytes) / (1024.0 * 1024.0));
+                }
+
+                return VK_SUCCESS;
+            }
+        private:
+            // Matches `video_encode.comp`.
+            struct PushConstants {
+                uint32_t sourceSize[2];
+                uint32_t chromaSize[2];
+            };
+
+            // One picture per frame slot, written by the graphics queue and read by the encode
+            // queue, through a view of each plane and one of the whole.
+            struct Picture {
+                VkImage image = VK_NULL_HANDLE;
+                vk_memory::Allocation allocation;
+                VkImageView pictureView = VK_NULL_HANDLE;
+                VkImageView lumaView = VK_NULL_HANDLE;
+                VkImageView chromaView = VK_NULL_HANDLE;
+            };
+
+            struct Slot {
+                VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+                // The encode semaphore's value once the slot's frame is encoded, or 0 once it
+                // was written out.
+                uint64_t pendingValue = 0;
+                bool idr = false;
+                bool converted = false;
+            };
+
+            // `log2_max_frame_num_minus4` of the sequence parameter set.
+            static constexpr uint32_t LOG2_MAX_FRAME_NUM_MINUS4 = 4;
+            static constexpr uint32_t MAX_FRAME_NUM = 1u << (LOG2_MAX_FRAME_NUM_MINUS4 + 4);
+            // The quantizer of every picture when the device has no rate control.
+            static constexpr int32_t CONSTANT_QP = 26;
+
+            VkDevice m_device = VK_NULL_HANDLE;
+            vk_memory::DeviceMemoryAllocator* m_memoryAllocator = nullptr;
+            vk_descriptors::FrameDescriptorAllocator* m_frameDescriptors = nullptr;
+            const VkAllocationCallbacks* m_allocator = nullptr;
+            VkQueue m_encodeQueue = VK_NULL_HANDLE;
+            uint32_t m_encodeQueueFamily = 0;
+            uint32_t m_graphicsQueueFamily = 0;
+            EncodeSupport m_support {};
+            H264Profile m_profile {};
+            VkExtent2D m_extent {};
+            VkExtent2D m_codedExtent {};
+            uint32_t m_tile = 8;
+
+            VkVideoSessionKHR m_session = VK_NULL_HANDLE;
+            std::vector<vk_memory::Allocation> m_sessionAllocations;
+            VkVideoSessionParametersKHR m_sessionParameters = VK_NULL_HANDLE;
+            // The sequence and picture parameter sets, in Annex B, written ahead of every IDR
+            // picture.
+            std::vector<uint8_t> m_parameterSets;
+            bool m_entropyCoding = false;
+
+            // The rate control state the session is in once the first encode set it, which
+            // every later video coding scope has to name.
+            VkVideoEncodeRateControlLayerInfoKHR m_rateControlLayer {};
+            VkVideoEncodeH264RateControlInfoKHR m_h264RateControl {};
+            VkVideoEncodeRateControlInfoKHR m_rateControl {};
+            bool m_sessionReset = false;
+
+            std::vector<Picture> m_pictures;
+            VkImage m_dpbImage = VK_NULL_HANDLE;
+            vk_memory::Allocation m_dpbAllocation;
+            VkImageView m_dpbView = VK_NULL_HANDLE;
+
+            VkBuffer m_bitstreamBuffer = VK_NULL_HANDLE;
+            vk_memory::Allocation m_bitstreamAllocation;
+            VkDeviceSize m_bitstreamSlotSize = 0;
+            VkQueryPool m_queryPool = VK_NULL_HANDLE;
+
+            VkCommandPool m_commandPool = VK_NULL_HANDLE;
+            std::vector<Slot> m_slots;
+            VkSemaphore m_encodeSemaphore = VK_NULL_HANDLE;
+            uint64_t m_encodeCount = 0;
+
+            VkDescriptorSetLayout m_setLayout = VK_NULL_HANDLE;
+            VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+            VkPipeline m_pipeline = VK_NULL_HANDLE;
+
+            uint32_t m_frameRate = 60;
+            uint32_t m_idrPeriod = 60;
+            uint32_t m_framesSinceIdr = 0;
+            uint32_t m_frameNum = 0;
+            uint16_t m_idrPicId = 0;
+            uint32_t m_currentDpbSlot = 0;
+            bool m_hasReference = false;
+
+            std::ofstream m_output;
+            uint64_t m_encodedFrames = 0;
+            uint64_t m_encodedBytes = 0;
+
+            static const char* rateControlModeToString(VkVideoEncodeRateControlModeFlagBitsKHR mode) {
+                switch (mode) {
+                    case VK_VIDEO_ENCODE_RATE_CONTROL_MODE_VBR_BIT_KHR: return "VBR";
+                    case VK_VIDEO_ENCODE_RATE_CONTROL_MODE_CBR_BIT_KHR: return "CBR";
+                    case VK_VIDEO_ENCODE_RATE_CONTROL_MODE_DISABLED_BIT_KHR: return "at a constant QP";
+                    default: return "with the driver's rate control";
+                }
+            }
+
+            bool transfersOwnership() const {
+                return m_encodeQueueFamily != m_graphicsQueueFamily;
+            }
+
+            void createSession() {
+                const auto createInfo = VkVideoSessionCreateInfoKHR {
+                    .sType = VK_STRUCTURE_TYPE_VIDEO_SESSION_CREATE_INFO_KHR,
+                    .queueFamilyIndex = m_encodeQueueFamily,
+                    .pVideoProfile = &m_profile.profile,
+                    .pictureFormat = PICTURE_FORMAT,
+                    .maxCodedExtent = m_codedExtent,
+                    .referencePictureFormat = PICTURE_FORMAT,
+                    .maxDpbSlots = DPB_SLOT_COUNT,
+                    .maxActiveReferencePictures = 1,
+                    .pStdHeaderVersion = &m_support.capabilities.stdHeaderVersion,
+                };
+                if (vkCreateVideoSessionKHR(m_device, &createInfo, m_allocator, &m_session) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create video encode session!");
+                }
+
+                uint32_t requirementCount = 0;
+                vkGetVideoSessionMemoryRequirementsKHR(m_device, m_session, &requirementCount, nullptr);
+                auto requirements = std::vector<VkVideoSessionMemoryRequirementsKHR>(requirementCount, VkVideoSessionMemoryRequirementsKHR {
+                    .sType = VK_STRUCTURE_TYPE_VIDEO_SESSION_MEMORY_REQUIREMENTS_KHR,
+                });
+                vkGetVideoSessionMemoryRequirementsKHR(m_device, m_session, &requirementCount, requirements.data());
+
+                auto bindInfos = std::vector<VkBindVideoSessionMemoryInfoKHR> {};
+                for (const auto& requirement : requirements) {
+                    const auto allocation = m_memoryAllocator->allocate(requirement.memoryRequirements, vk_memory::AllocationCreateInfo {
+                        .preferredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                        .kind = vk_memory::ResourceKind::Optimal,
+                    });
+                    m_sessionAllocations.push_back(allocation);
+                    bindInfos.push_back(VkBindVideoSessionMemoryInfoKHR {
+                        .sType = VK_STRUCTURE_TYPE_BIND_VIDEO_SESSION_MEMORY_INFO_KHR,
+                        .memoryBindIndex = requirement.memoryBindIndex,
+                        .memory = allocation.memory,
+                        .memoryOffset = allocation.offset,
+                        .memorySize = requirement.memoryRequirements.size,
+                    });
+                }
+
+                if (vkBindVideoSessionMemoryKHR(m_device, m_session, static_cast<uint32_t>(bindInfos.size()), bindInfos.data()) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to bind video encode session memory!");
+                }
+            }
+
+            // One sequence and one picture parameter set for the whole stream, progressive,
+            // with picture order counts following the frame numbers, since no picture is ever
+            // reordered.
+            void createSessionParameters() {
+                const auto cropRight = (m_codedExtent.width - m_extent.width) / 2;
+                const auto cropBottom = (m_codedExtent.height - m_extent.height) / 2;
+                m_entropyCoding = m_support.h264Capabilities.stdSyntaxFlags & VK_VIDEO_ENCODE_H264_STD_ENTROPY_CODING_MODE_FLAG_SET_BIT_KHR;
+
+                // Players show the pixels in BT.709 limited range, which the conversion writes, at
+                // the stream's frame rate, and as soon as they are decoded, since no picture is
+                // ever reordered.
+                const auto vui = StdVideoH264SequenceParameterSetVui {
+                    .flags = StdVideoH264SpsVuiFlags {
+                        .video_signal_type_present_flag = 1,
+                        .video_full_range_flag = 0,
+                        .color_description_present_flag = 1,
+                        .timing_info_present_flag = 1,
+                        .fixed_frame_rate_flag = 1,
+                        .bitstream_restriction_flag = 1,
+                    },
+                    .video_format = 5,
+                    .colour_primaries = 1,
+                    .transfer_characteristics = 1,
+                    .matrix_coefficients = 1,
+                    .num_units_in_tick = 1,
+                    .time_scale = 2 * m_frameRate,
+                    .max_num_reorder_frames = 0,
+                    .max_dec_frame_buffering = 1,
+                };
+                const auto sps = StdVideoH264SequenceParameterSet {
+                    .flags = StdVideoH264SpsFlags {
+                        .direct_8x8_inference_flag = 1,
+                        .frame_mbs_only_flag = 1,
+                        .frame_cropping_flag = cropRight != 0 || cropBottom != 0,
+                        .vui_parameters_present_flag = 1,
+                    },
+                    .profile_idc = STD_VIDEO_H264_PROFILE_IDC_MAIN,
+                    .level_idc = m_support.h264Capabilities.maxLevelIdc,
+                    .chroma_format_idc = STD_VIDEO_H264_CHROMA_FORMAT_IDC_420,
+                    .seq_parameter_set_id = 0,
+                    .bit_depth_luma_minus8 = 0,
+                    .bit_depth_chroma_minus8 = 0,
+                    .log2_max_frame_num_minus4 = LOG2_MAX_FRAME_NUM_MINUS4,
+                    .pic_order_cnt_type = STD_VIDEO_H264_POC_TYPE_2,
+                    .max_num_ref_frames = 1,
+                    .pic_width_in_mbs_minus1 = m_codedExtent.width / MACROBLOCK_SIZE - 1,
+                    .pic_height_in_map_units_minus1 = m_codedExtent.height / MACROBLOCK_SIZE - 1,
+                    .frame_crop_right_offset = cropRight,
+                    .frame_crop_bottom_offset = cropBottom,
+                    .pSequenceParameterSetVui = &vui,
+                };
+                const auto pps = StdVideoH264PictureParameterSet {
+                    .flags = StdVideoH264PpsFlags {
+                        .entropy_coding_mode_flag = m_entropyCoding,
+                    },
+                    .seq_parameter_set_id = 0,
+                    .pic_parameter_set_id = 0,
+                    .num_ref_idx_l0_default_active_minus1 = 0,
+                    .weighted_bipred_idc = STD_VIDEO_H264_WEIGHTED_BIPRED_IDC_DEFAULT,
+                };
+
+                const auto addInfo = VkVideoEncodeH264SessionParametersAddInfoKHR {
+                    .sType = VK_STRUCTURE_TYPE_VIDEO_ENCODE_H264_SESSION_PARAMETERS_ADD_INFO_KHR,
+                    .stdSPSCount = 1,
+                    .pStdSPSs = &sps,
+                    .stdPPSCount = 1,
+                    .pStdPPSs = &pps,
+                };
+                const auto h264CreateInfo = VkVideoEncodeH264SessionParametersCreateInfoKHR {
+                    .sType = VK_STRUCTURE_TYPE_VIDEO_ENCODE_H264_SESSION_PARAMETERS_CREATE_INFO_KHR,
+                    .maxStdSPSCount = 1,
+                    .maxStdPPSCount = 1,
+                    .pParametersAddInfo = &addInfo,
+                };
+                const auto createInfo = VkVideoSessionParametersCreateInfoKHR {
+                    .sType = VK_STRUCTURE_TYPE_VIDEO_SESSION_PARAMETERS_CREATE_INFO_KHR,
+                    .pNext = &h264CreateInfo,
+                    .videoSession = m_session,
+                };
+                if (vkCreateVideoSessionParametersKHR(m_device, &createInfo, m_allocator, &m_sessionParameters) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create video encode session parameters!");
+                }
+
+                // The driver may have overridden some of the parameters, so the stream carries
+                // the ones it encodes with.
+                const auto h264GetInfo = VkVideoEncodeH264SessionParametersGetInfoKHR {
+                    .sType = VK_STRUCTURE_TYPE_VIDEO_ENCODE_H264_SESSION_PARAMETERS_GET_INFO_KHR,
+                    .writeStdSPS = VK_TRUE,
+                    .writeStdPPS = VK_TRUE,
+                    .stdSPSId = 0,
+                    .stdPPSId = 0,
+                };
+                const auto getInfo = VkVideoEncodeSessionParametersGetInfoKHR {
+                    .sType = VK_STRUCTURE_TYPE_VIDEO_ENCODE_SESSION_PARAMETERS_GET_INFO_KHR,
+                    .pNext = &h264GetInfo,
+                    .videoSessionParameters = m_sessionParameters,
+                };
+                auto size = size_t { 0 };
+                auto result = vkGetEncodedVideoSessionParametersKHR(m_device, &getInfo, nullptr, &size, nullptr);
+                if (result == VK_SUCCESS) {
+                    m_parameterSets.resize(size);
+                    result = vkGetEncodedVideoSessionParametersKHR(m_device, &getInfo, nullptr, &size, m_parameterSets.data());
+                }
+
+                if (result != VK_SUCCESS) {
+                    throw std::runtime_error("failed to get the encoded video parameter sets!");
+                }
+            }
+
+            // Variable bitrate around the requested rate where the device has it, then constant
+            // bitrate, and a constant quantizer where it has neither.
+            void createRateControl(uint32_t bitrate) {
+                const auto modes = m_support.encodeCapabilities.rateControlModes;
+                auto mode = VK_VIDEO_ENCODE_RATE_CONTROL_MODE_DISABLED_BIT_KHR;
+                if (modes & VK_VIDEO_ENCODE_RATE_CONTROL_MODE_VBR_BIT_KHR) {
+                    mode = VK_VIDEO_ENCODE_RATE_CONTROL_MODE_VBR_BIT_KHR;
+                } else if (modes & VK_VIDEO_ENCODE_RATE_CONTROL_MODE_CBR_BIT_KHR) {
+                    mode = VK_VIDEO_ENCODE_RATE_CONTROL_MODE_CBR_BIT_KHR;
+                }
+
+                const auto maxBitrate = std::max<uint64_t>(m_support.encodeCapabilities.maxBitrate, 1);
+                const auto averageBitrate = std::min<uint64_t>(bitrate, maxBitrate);
+                m_rateControlLayer = VkVideoEncodeRateControlLayerInfoKHR {
+                    .sType = VK_STRUCTURE_TYPE_VIDEO_ENCODE_RATE_CONTROL_LAYER_INFO_KHR,
+                    .averageBitrate = averageBitrate,
+                    .maxBitrate = mode == VK_VIDEO_ENCODE_RATE_CONTROL_MODE_VBR_BIT_KHR ? std::min<uint64_t>(averageBitrate * 2, maxBitrate) : averageBitrate,
+                    .frameRateNumerator = m_frameRate,
+                    .frameRateDenominator = 1,
+                };
+                m_h264RateControl = VkVideoEncodeH264RateControlInfoKHR {
+                    .sType = VK_STRUCTURE_TYPE_VIDEO_ENCODE_H264_RATE_CONTROL_INFO_KHR,
+                    .flags = VK_VIDEO_ENCODE_H264_RATE_CONTROL_REGULAR_GOP_BIT_KHR | VK_VIDEO_ENCODE_H264_RATE_CONTROL_REFERENCE_PATTERN_FLAT_BIT_KHR,
+                    .gopFrameCount = m_idrPeriod,
+                    .idrPeriod = m_idrPeriod,
+                    .consecutiveBFrameCount = 0,
+                    .temporalLayerCount = 1,
+                };
+
+                const bool layered = mode != VK_VIDEO_ENCODE_RATE_CONTROL_MODE_DISABLED_BIT_KHR;
+                m_rateControl = VkVideoEncodeRateControlInfoKHR {
+                    .sType = VK_STRUCTURE_TYPE_VIDEO_ENCODE_RATE_CONTROL_INFO_KHR,
+                    .pNext = layered ? &m_h264RateControl : nullptr,
+                    .rateControlMode = mode,
+                    .layerCount = layered ? 1u : 0u,
+                    .pLayers = layered ? &m_rateControlLayer : nullptr,
+                    .virtualBufferSizeInMs = layered ? 1000u : 0u,
+                    .initialVirtualBufferSizeInMs = layered ? 500u : 0u,
+                };
+            }
+
+            void createPictures(uint32_t framesInFlight) {
+                const auto planeUsage = VkImageViewUsageCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO,
+                    .usage = VK_IMAGE_USAGE_STORAGE_BIT,
+                };
+                const auto pictureUsage = VkImageViewUsageCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO,
+                    .usage = VK_IMAGE_USAGE_VIDEO_ENCODE_SRC_BIT_KHR,
+                };
+
+                m_pictures.resize(framesInFlight);
+                for (auto& picture : m_pictures) {
+                    picture.image = this->createPictureImage(
+                        m_support.pictureCreateFlags,
+                        VK_IMAGE_USAGE_VIDEO_ENCODE_SRC_BIT_KHR | VK_IMAGE_USAGE_STORAGE_BIT,
+                        1,
+                        picture.allocation
+                    );
+                    picture.pictureView = this->createPictureView(picture.image, &pictureUsage, PICTURE_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_VIEW_TYPE_2D, 1);
+                    picture.lumaView = this->createPictureView(picture.image, &planeUsage, LUMA_PLANE_FORMAT, VK_IMAGE_ASPECT_PLANE_0_BIT, VK_IMAGE_VIEW_TYPE_2D, 1);
+                    picture.chromaView = this->createPictureView(picture.image, &planeUsage, CHROMA_PLANE_FORMAT, VK_IMAGE_ASPECT_PLANE_1_BIT, VK_IMAGE_VIEW_TYPE_2D, 1);
+                }
+
+                // The reconstructed pictures live in the layers of one image, which every
+                // device takes, unlike reference pictures in images of their own.
+                m_dpbImage = this->createPictureImage(0, VK_IMAGE_USAGE_VIDEO_ENCODE_DPB_BIT_KHR, DPB_SLOT_COUNT, m_dpbAllocation);
+                m_dpbView = this->createPictureView(m_dpbImage, nullptr, PICTURE_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_VIEW_TYPE_2D_ARRAY, DPB_SLOT_COUNT);
+            }
+
+            VkImage createPictureImage(VkImageCreateFlags flags, VkImageUsageFlags usage, uint32_t layers, vk_memory::Allocation& allocation) const {
+                const auto createInfo = VkImageCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+                    .pNext = &m_profile.list,
+                    .flags = flags,
+                    .imageType = VK_IMAGE_TYPE_2D,
+                    .format = PICTURE_FORMAT,
+                    .extent = VkExtent3D { m_codedExtent.width, m_codedExtent.height, 1 },
+                    .mipLevels = 1,
+                    .arrayLayers = layers,
+                    .samples = VK_SAMPLE_COUNT_1_BIT,
+                    .tiling = VK_IMAGE_TILING_OPTIMAL,
+                    .usage = usage,
+                    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                    .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                };
+
+                auto image = VkImage {};
+                if (vkCreateImage(m_device, &createInfo, m_allocator, &image) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create video encode picture!");
+                }
+
+                allocation = m_memoryAllocator->allocateForImage(image, vk_memory::AllocationCreateInfo {
+                    .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                    .kind = vk_memory::ResourceKind::Optimal,
+                    .priority = vk_memory::MemoryPriority::High,
+                });
+
+                return image;
+            }
+
+            VkImageView createPictureView(VkImage image, const void* next, VkFormat format, VkImageAspectFlags aspect, VkImageViewType viewType, uint32_t layers) const {
+                const auto createInfo = VkImageViewCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+                    .pNext = next,
+                    .image = image,
+                    .viewType = viewType,
+                    .format = format,
+                    .subresourceRange = VkImageSubresourceRange {
+                        .aspectMask = aspect,
+                        .baseMipLevel = 0,
+                        .levelCount = 1,
+                        .baseArrayLayer = 0,
+                        .layerCount = layers,
+                    },
+                };
+
+                auto view = VkImageView {};
+                if (vkCreateImageView(m_device, &createInfo, m_allocator, &view) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create video encode picture view!");
+                }
+
+                return view;
+            }
+
+            // Each frame slot writes into its own range of one persistently mapped buffer, sized
+            // for an uncompressed picture, which no encoded picture comes near.
+            void createBitstream(uint32_t framesInFlight) {
+                const auto& capabilities = m_support.capabilities;
+                const auto alignment = std::max(capabilities.minBitstreamBufferOffsetAlignment, capabilities.minBitstreamBufferSizeAlignment);
+                const auto pictureSize = VkDeviceSize { m_codedExtent.width } * m_codedExtent.height * 3 / 2;
+                m_bitstreamSlotSize = (pictureSize + alignment - 1) / alignment * alignment;
+
+                const auto createInfo = VkBufferCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                    .pNext = &m_profile.list,
+                    .size = m_bitstreamSlotSize * framesInFlight,
+                    .usage = VK_BUFFER_USAGE_VIDEO_ENCODE_DST_BIT_KHR,
+                    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                };
+                if (vkCreateBuffer(m_device, &createInfo, m_allocator, &m_bitstreamBuffer) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create video encode bitstream buffer!");
+                }
+
+                m_bitstreamAllocation = m_memoryAllocator->allocateForBuffer(m_bitstreamBuffer, vk_memory::AllocationCreateInfo {
+                    .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                    .preferredFlags = VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+                });
+
+                const auto feedbackInfo = VkQueryPoolVideoEncodeFeedbackCreateInfoKHR {
+                    .sType = VK_STRUCTURE_TYPE_QUERY_POOL_VIDEO_ENCODE_FEEDBACK_CREATE_INFO_KHR,
+                    .pNext = &m_profile.profile,
+                    .encodeFeedbackFlags = VK_VIDEO_ENCODE_FEEDBACK_BITSTREAM_BUFFER_OFFSET_BIT_KHR | VK_VIDEO_ENCODE_FEEDBACK_BITSTREAM_BYTES_WRITTEN_BIT_KHR,
+                };
+                const auto queryPoolInfo = VkQueryPoolCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+                    .pNext = &feedbackInfo,
+                    .queryType = VK_QUERY_TYPE_VIDEO_ENCODE_FEEDBACK_KHR,
+                    .queryCount = framesInFlight,
+                };
+                if (vkCreateQueryPool(m_device, &queryPoolInfo, m_allocator, &m_queryPool) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create video encode feedback query pool!");
+                }
+            }
+
+            void createCommands(uint32_t framesInFlight) {
+                const auto poolInfo = VkCommandPoolCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+                    .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+                    .queueFamilyIndex = m_encodeQueueFamily,
+                };
+                if (vkCreateCommandPool(m_device, &poolInfo, m_allocator, &m_commandPool) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create video encode command pool!");
+                }
+
+                auto commandBuffers = std::vector<VkCommandBuffer>(framesInFlight, VK_NULL_HANDLE);
+                const auto allocateInfo = VkCommandBufferAllocateInfo {
+                    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                    .commandPool = m_commandPool,
+                    .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                    .commandBufferCount = framesInFlight,
+                };
+                if (vkAllocateCommandBuffers(m_device, &allocateInfo, commandBuffers.data()) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to allocate video encode command buffers!");
+                }
+
+                m_slots.clear();
+                for (const auto commandBuffer : commandBuffers) {
+                    m_slots.push_back(Slot { .commandBuffer = commandBuffer });
+                }
+
+                const auto timelineInfo = VkSemaphoreTypeCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+                    .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+                    .initialValue = 0,
+                };
+                const auto semaphoreInfo = VkSemaphoreCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+                    .pNext = &timelineInfo,
+                };
+                if (vkCreateSemaphore(m_device, &semaphoreInfo, m_allocator, &m_encodeSemaphore) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create video encode semaphore!");
+                }
+            }
+
+            void createConversion(vk_descriptors::DescriptorLayoutCache& layoutCache, vk_shaders::ShaderLibrary& shaderLibrary, vk_pipelines::PipelineRegistry& pipelineRegistry) {
+                auto bindings = std::array<VkDescriptorSetLayoutBinding, 3> {};
+                for (uint32_t i = 0; i < bindings.size(); i++) {
+                    bindings[i] = VkDescriptorSetLayoutBinding {
+                        .binding = i,
+                        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                        .descriptorCount = 1,
+                        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                    };
+                }
+                m_setLayout = layoutCache.layout(bindings);
+
+                const auto pushConstantRange = VkPushConstantRange {
+                    .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                    .offset = 0,
+                    .size = sizeof(PushConstants),
+                };
+                const auto layoutInfo = VkPipelineLayoutCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+                    .setLayoutCount = 1,
+                    .pSetLayouts = &m_setLayout,
+                    .pushConstantRangeCount = 1,
+                    .pPushConstantRanges = &pushConstantRange,
+                };
+                if (vkCreatePipelineLayout(m_device, &layoutInfo, m_allocator, &m_pipelineLayout) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create video encode conversion pipeline layout!");
+                }
+
+                auto constants = vk_pipelines::SpecializationConstants {};
+                constants
+                    .set(WORKGROUP_WIDTH_ID, m_tile)
+                    .set(WORKGROUP_HEIGHT_ID, m_tile);
+                const auto pipelineInfo = VkComputePipelineCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+                    .stage = VkPipelineShaderStageCreateInfo {
+                        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                        .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                        .module = shaderLibrary.shaderModule("video_encode.comp"),
+                        .pName = "main",
+                        .pSpecializationInfo = constants.info(),
+                    },
+                    .layout = m_pipelineLayout,
+                };
+                m_pipeline = pipelineRegistry.computePipeline(pipelineInfo);
+            }
+
+            void pictureBarrier(
+                VkCommandBuffer commandBuffer,
+                VkImage image,
+                VkImageLayout oldLayout,
+                VkImageLayout newLayout,
+                VkPipelineStageFlags2 srcStageMask,
+                VkAccessFlags2 srcAccessMask,
+                VkPipelineStageFlags2 dstStageMask,
+                VkAccessFlags2 dstAccessMask,
+                uint32_t srcQueueFamilyIndex,
+                uint32_t dstQueueFamilyIndex,
+                uint32_t layerCount = 1
+            ) const {
+                const auto barrier = VkImageMemoryBarrier2 {
+                    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+                    .srcStageMask = srcStageMask,
+                    .srcAccessMask = srcAccessMask,
+                    .dstStageMask = dstStageMask,
+                    .dstAccessMask = dstAccessMask,
+                    .oldLayout = oldLayout,
+                    .newLayout = newLayout,
+                    .srcQueueFamilyIndex = srcQueueFamilyIndex,
+                    .dstQueueFamilyIndex = dstQueueFamilyIndex,
+                    .image = image,
+                    .subresourceRange = VkImageSubresourceRange {
+                        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                        .baseMipLevel = 0,
+                        .levelCount = 1,
+                        .baseArrayLayer = 0,
+                        .layerCount = layerCount,
+                    },
+                };
+                const auto dependencyInfo = VkDependencyInfo {
+                    .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+                    .imageMemoryBarrierCount = 1,
+                    .pImageMemoryBarriers = &barrier,
+                };
+
+                vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+            }
+
+            VkVideoPictureResourceInfoKHR dpbResource(uint32_t dpbSlot) const {
+                return VkVideoPictureResourceInfoKHR {
+                    .sType = VK_STRUCTURE_TYPE_VIDEO_PICTURE_RESOURCE_INFO_KHR,
+                    .codedOffset = VkOffset2D { 0, 0 },
+                    .codedExtent = m_codedExtent,
+                    .baseArrayLayer = dpbSlot,
+                    .imageViewBinding = m_dpbView,
+                };
+            }
+
+            void recordEncode(VkCommandBuffer commandBuffer, uint32_t frameSlot, bool idr) {
+                const auto& picture = m_pictures[frameSlot];
+                vkCmdResetQueryPool(commandBuffer, m_queryPool, frameSlot, 1);
+
+                if (this->transfersOwnership()) {
+                    this->pictureBarrier(
+                        commandBuffer,
+                        picture.image,
+                        VK_IMAGE_LAYOUT_GENERAL,
+                        VK_IMAGE_LAYOUT_VIDEO_ENCODE_SRC_KHR,
+                        VK_PIPELINE_STAGE_2_NONE,
+                        VK_ACCESS_2_NONE,
+                        VK_PIPELINE_STAGE_2_VIDEO_ENCODE_BIT_KHR,
+                        VK_ACCESS_2_VIDEO_ENCODE_READ_BIT_KHR,
+                        m_graphicsQueueFamily,
+                        m_encodeQueueFamily
+                    );
+                }
+
+                // The reconstructed pictures stay on the encode queue for good, and only have to
+                // be moved into their layout once.
+                if (!m_sessionReset) {
+                    this->pictureBarrier(
+                        commandBuffer,
+                        m_dpbImage,
+                        VK_IMAGE_LAYOUT_UNDEFINED,
+                        VK_IMAGE_LAYOUT_VIDEO_ENCODE_DPB_KHR,
+                        VK_PIPELINE_STAGE_2_NONE,
+                        VK_ACCESS_2_NONE,
+                        VK_PIPELINE_STAGE_2_VIDEO_ENCODE_BIT_KHR,
+                        VK_ACCESS_2_VIDEO_ENCODE_READ_BIT_KHR | VK_ACCESS_2_VIDEO_ENCODE_WRITE_BIT_KHR,
+                        VK_QUEUE_FAMILY_IGNORED,
+                        VK_QUEUE_FAMILY_IGNORED,
+                        DPB_SLOT_COUNT
+                    );
+                }
+
+                const auto setupSlot = m_currentDpbSlot;
+                const auto referenceSlot = (m_currentDpbSlot + DPB_SLOT_COUNT - 1) % DPB_SLOT_COUNT;
+                const bool predicted = !idr && m_hasReference;
+                const auto pictureType = idr ? STD_VIDEO_H264_PICTURE_TYPE_IDR : STD_VIDEO_H264_PICTURE_TYPE_P;
+
+                // The reference is the previous picture, whose frame number is one less, and
+                // picture order counts go up by two a frame.
+                const auto referenceFrameNum = (m_frameNum + MAX_FRAME_NUM - 1) % MAX_FRAME_NUM;
+                const auto referenceStdInfo = StdVideoEncodeH264ReferenceInfo {
+                    .primary_pic_type = m_framesSinceIdr == 1 ? STD_VIDEO_H264_PICTURE_TYPE_IDR : STD_VIDEO_H264_PICTURE_TYPE_P,
+                    .FrameNum = referenceFrameNum,
+                    .PicOrderCnt = static_cast<int32_t>(2 * (m_framesSinceIdr - 1)),
+                };
+                const auto setupStdInfo = StdVideoEncodeH264ReferenceInfo {
+                    .primary_pic_type = pictureType,
+                    .FrameNum = m_frameNum,
+                    .PicOrderCnt = static_cast<int32_t>(2 * m_framesSinceIdr),
+                };
+                const auto referenceDpbInfo = VkVideoEncodeH264DpbSlotInfoKHR {
+                    .sType = VK_STRUCTURE_TYPE_VIDEO_ENCODE_H264_DPB_SLOT_INFO_KHR,
+                    .pStdReferenceInfo = &referenceStdInfo,
+                };
+                const auto setupDpbInfo = VkVideoEncodeH264DpbSlotInfoKHR {
+                    .sType = VK_STRUCTURE_TYPE_VIDEO_ENCODE_H264_DPB_SLOT_INFO_KHR,
+                    .pStdReferenceInfo = &setupStdInfo,
+                };
+                const auto referenceResource = this->dpbResource(referenceSlot);
+                const auto setupResource = this->dpbResource(setupSlot);
+                const auto referenceSlotInfo = VkVideoReferenceSlotInfoKHR {
+                    .sType = VK_STRUCTURE_TYPE_VIDEO_REFERENCE_SLOT_INFO_KHR,
+                    .pNext = &referenceDpbInfo,
+                    .slotIndex = static_cast<int32_t>(referenceSlot),
+                    .pPictureResource = &referenceResource,
+                };
+                const auto setupSlotInfo = VkVideoReferenceSlotInfoKHR {
+                    .sType = VK_STRUCTURE_TYPE_VIDEO_REFERENCE_SLOT_INFO_KHR,
+                    .pNext = &setupDpbInfo,
+                    .slotIndex = static_cast<int32_t>(setupSlot),
+                    .pPictureResource = &setupResource,
+                };
+
+                // The slot the picture is reconstructed into is bound without the picture it
+                // held, which is no longer referenced.
+                auto boundSlots = std::array { setupSlotInfo, referenceSlotInfo };
+                boundSlots[0].slotIndex = -1;
+                const auto beginInfo = VkVideoBeginCodingInfoKHR {
+                    .sType = VK_STRUCTURE_TYPE_VIDEO_BEGIN_CODING_INFO_KHR,
+                    .pNext = m_sessionReset ? &m_rateControl : nullptr,
+                    .videoSession = m_session,
+                    .videoSessionParameters = m_sessionParameters,
+                    .referenceSlotCount = predicted ? 2u : 1u,
+                    .pReferenceSlots = boundSlots.data(),
+                };
+                vkCmdBeginVideoCodingKHR(commandBuffer, &beginInfo);
+
+                if (!m_sessionReset) {
+                    const auto controlInfo = VkVideoCodingControlInfoKHR {
+                        .sType = VK_STRUCTURE_TYPE_VIDEO_CODING_CONTROL_INFO_KHR,
+                        .pNext = &m_rateControl,
+                        .flags = VK_VIDEO_CODING_CONTROL_RESET_BIT_KHR | VK_VIDEO_CODING_CONTROL_ENCODE_RATE_CONTROL_BIT_KHR,
+                    };
+                    vkCmdControlVideoCodingKHR(commandBuffer, &controlInfo);
+                    m_sessionReset = true;
+                }
+
+                auto referenceLists = StdVideoEncodeH264ReferenceListsInfo {
+                    .num_ref_idx_l0_active_minus1 = 0,
+                    .num_ref_idx_l1_active_minus1 = 0,
+                };
+                std::fill(std::begin(referenceLists.RefPicList0), std::end(referenceLists.RefPicList0), STD_VIDEO_H264_NO_REFERENCE_PICTURE);
+                std::fill(std::begin(referenceLists.RefPicList1), std::end(referenceLists.RefPicList1), STD_VIDEO_H264_NO_REFERENCE_PICTURE);
+                if (predicted) {
+                    referenceLists.RefPicList0[0] = static_cast<uint8_t>(referenceSlot);
+                }
+
+                const auto stdPictureInfo = StdVideoEncodeH264PictureInfo {
+                    .flags = StdVideoEncodeH264PictureInfoFlags {
+                        .IdrPicFlag = idr ? 1u : 0u,
+                        .is_reference = 1,
+                    },
+                    .seq_parameter_set_id = 0,
+                    .pic_parameter_set_id = 0,
+                    .idr_pic_id = m_idrPicId,
+                    .primary_pic_type = pictureType,
+                    .frame_num = m_frameNum,
+                    .PicOrderCnt = static_cast<int32_t>(2 * m_framesSinceIdr),
+                    .pRefLists = &referenceLists,
+                };
+                const auto sliceHeader = StdVideoEncodeH264SliceHeader {
+                    .first_mb_in_slice = 0,
+                    .slice_type = idr ? STD_VIDEO_H264_SLICE_TYPE_I : STD_VIDEO_H264_SLICE_TYPE_P,
+                    .cabac_init_idc = STD_VIDEO_H264_CABAC_INIT_IDC_0,
+                    // The deblocking filter stays on, as the parameter set leaves it.
+                    .disable_deblocking_filter_idc = STD_VIDEO_H264_DISABLE_DEBLOCKING_FILTER_IDC_DISABLED,
+                };
+                const auto slice = VkVideoEncodeH264NaluSliceInfoKHR {
+                    .sType = VK_STRUCTURE_TYPE_VIDEO_ENCODE_H264_NALU_SLICE_INFO_KHR,
+                    .constantQp = m_rateControl.rateControlMode == VK_VIDEO_ENCODE_RATE_CONTROL_MODE_DISABLED_BIT_KHR ? CONSTANT_QP : 0,
+                    .pStdSliceHeader = &sliceHeader,
+                };
+                const auto h264PictureInfo = VkVideoEncodeH264PictureInfoKHR {
+                    .sType = VK_STRUCTURE_TYPE_VIDEO_ENCODE_H264_PICTURE_INFO_KHR,
+                    .naluSliceEntryCount = 1,
+                    .pNaluSliceEntries = &slice,
+                    .pStdPictureInfo = &stdPictureInfo,
+                    .generatePrefixNalu = VK_FALSE,
+                };
+                const auto encodeInfo = VkVideoEncodeInfoKHR {
+                    .sType = VK_STRUCTURE_TYPE_VIDEO_ENCODE_INFO_KHR,
+                    .pNext = &h264PictureInfo,
+                    .dstBuffer = m_bitstreamBuffer,
+                    .dstBufferOffset = frameSlot * m_bitstreamSlotSize,
+                    .dstBufferRange = m_bitstreamSlotSize,
+                    .srcPictureResource = VkVideoPictureResourceInfoKHR {
+                        .sType = VK_STRUCTURE_TYPE_VIDEO_PICTURE_RESOURCE_INFO_KHR,
+                        .codedOffset = VkOffset2D { 0, 0 },
+                        .codedExtent = m_codedExtent,
+                        .baseArrayLayer = 0,
+                        .imageViewBinding = picture.pictureView,
+                    },
+                    .pSetupReferenceSlot = &setupSlotInfo,
+                    .referenceSlotCount = predicted ? 1u : 0u,
+                    .pReferenceSlots = predicted ? &referenceSlotInfo : nullptr,
+                };
+
+                vkCmdBeginQuery(commandBuffer, m_queryPool, frameSlot, 0);
+                vkCmdEncodeVideoKHR(commandBuffer, &encodeInfo);
+                vkCmdEndQuery(commandBuffer, m_queryPool, frameSlot);
+
+                const auto endInfo = VkVideoEndCodingInfoKHR {
+                    .sType = VK_STRUCTURE_TYPE_VIDEO_END_CODING_INFO_KHR,
+                };
+                vkCmdEndVideoCodingKHR(commandBuffer, &endInfo);
+            }
+    };
+}
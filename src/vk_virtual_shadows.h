@@ -0,0 +1,328 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+
+namespace vk_virtual_shadows {
+    // The virtual map is split into square pages of this many texels a side, the unit pages
+    // are requested, rendered and evicted in. Matches `virtual_shadows.glsl`.
+    constexpr uint32_t PAGE_SIZE = 128;
+
+    // The finest level is this many pages a side, 16384 texels, and every level after it
+    // half as many, so a page of a coarser level covers four of the level before it.
+    constexpr uint32_t PAGES_PER_SIDE = 128;
+    constexpr uint32_t LEVEL_COUNT = 4;
+
+    // Rendered pages live in a square atlas of this many pages a side, a 4096x4096 depth map.
+    constexpr uint32_t ATLAS_PAGES_PER_SIDE = 32;
+    constexpr uint32_t ATLAS_SIZE = ATLAS_PAGES_PER_SIDE * PAGE_SIZE;
+    constexpr uint32_t PHYSICAL_PAGE_COUNT = ATLAS_PAGES_PER_SIDE * ATLAS_PAGES_PER_SIDE;
+
+    // Every page draws the whole scene, so a frame renders at most this many, and spreads a
+    // burst of requests over the next frames.
+    constexpr uint32_t PAGES_PER_FRAME = 16;
+
+    constexpr uint32_t pagesPerSide(uint32_t level) {
+        return PAGES_PER_SIDE >> level;
+    }
+
+    // Where the entries of `level` start in the page table, which lists the levels in order.
+    constexpr uint32_t levelOffset(uint32_t level) {
+        auto offset = uint32_t { 0 };
+        for (uint32_t i = 0; i < level; i++) {
+            offset += pagesPerSide(i) * pagesPerSide(i);
+        }
+
+        return offset;
+    }
+
+    // The entries of the page table, and of the page requests, one per page of every level.
+    constexpr uint32_t PAGE_COUNT = levelOffset(LEVEL_COUNT);
+
+    struct PageCoordinates {
+        uint32_t level;
+        uint32_t x;
+        uint32_t y;
+    };
+
+    inline uint32_t pageIndex(const PageCoordinates& coordinates) {
+        return levelOffset(coordinates.level) + coordinates.y * pagesPerSide(coordinates.level) + coordinates.x;
+    }
+
+    inline PageCoordinates pageCoordinates(uint32_t page) {
+        auto level = uint32_t { 0 };
+        while (level + 1 < LEVEL_COUNT && page >= levelOffset(level + 1)) {
+            level++;
+        }
+
+        const auto index = page - levelOffset(level);
+
+        return PageCoordinates { level, index % pagesPerSide(level), index / pagesPerSide(level) };
+    }
+
+    // A page a frame renders into a page of the atlas.
+    struct PageRender {
+        uint32_t page;
+        uint32_t physicalPage;
+    };
+
+    // A range of page table entries that changed since it was last uploaded.
+    struct PageTableRange {
+        uint32_t first;
+        uint32_t count;
+    };
+
+    // A shadow map for the directional light as large as the whole scene at a fine resolution,
+    // of which only the pages some window samples are ever rendered.
+    //
+    // The map is one orthographic projection along the light around every caster, fixed in
+    // the world, so a page holds the same shadows wherever the camera is and stays valid until
+    // the casters change. Its levels are coarser copies of it, and a view picks the level whose
+    // texels are about the size of its pixels, so far surfaces need few pages.
+    //
+    // Every frame a compute pass marks each page the depth buffer's pixels fall into in a
+    // request buffer of the frame slot, which `update` reads once the slot comes around again.
+    // Every page requested, and every coarser page under it for the fragment shader to fall
+    // back to, is then given a page of the atlas and rendered, coarse first, within a budget of
+    // `PAGES_PER_FRAME`, and the page table maps it to its atlas page the frame it is rendered
+    // in. Once the atlas is full, the page no frame has requested for the longest is evicted.
+    class VirtualShadowMap {
+        public:
+            explicit VirtualShadowMap() = default;
+
+            VirtualShadowMap(const VirtualShadowMap& other) = delete;
+            VirtualShadowMap& operator=(const VirtualShadowMap& other) = delete;
+
+            // `lightDirection` points towards the light, and every caster lies within
+            // `sceneRadius` of the origin.
+            void init(glm::vec3 lightDirection, float sceneRadius) {
+                const auto direction = glm::normalize(lightDirection);
+                const auto up = std::abs(direction.y) > 0.99f ? glm::vec3 { 1.0f, 0.0f, 0.0f } : glm::vec3 { 0.0f, 1.0f, 0.0f };
+                const auto lightView = glm::lookAtRH(glm::vec3 { 0.0f }, -direction, up);
+                m_sceneRadius = sceneRadius;
+                m_viewProjection = glm::orthoRH_ZO(-sceneRadius, sceneRadius, -sceneRadius, sceneRadius, -sceneRadius, sceneRadius) * lightView;
+
+                m_pageTable.assign(PAGE_COUNT, 0);
+                m_requested.assign(PAGE_COUNT, 0);
+                m_physicalPages.assign(PHYSICAL_PAGE_COUNT, PhysicalPage {});
+                m_freePages.clear();
+                for (uint32_t i = PHYSICAL_PAGE_COUNT; i > 0; i--) {
+                    m_freePages.push_back(i - 1);
+                }
+                m_updateCount = 0;
+                m_residentCount = 0;
+                m_rendered.clear();
+                // The table starts out empty on the GPU as well.
+                m_dirtyRange = PageTableRange { 0, PAGE_COUNT };
+            }
+
+            // The casters changed, so every resident page has to be rendered again. Until it is,
+            // it still holds the shadows it was rendered with.
+            void invalidate() {
+                for (auto& physicalPage : m_physicalPages) {
+                    physicalPage.stale = physicalPage.page.has_value();
+                }
+            }
+
+            // The projection of the whole map, whose xy in [-1, 1] covers the finest level.
+            const glm::mat4& viewProjection() const {
+                return m_viewProjection;
+            }
+
+            // The projection that renders `page` into a whole viewport: the map's, scaled and
+            // moved in xy so that the page covers [-1, 1].
+            glm::mat4 pageViewProjection(uint32_t page) const {
+                const auto coordinates = vk_virtual_shadows::pageCoordinates(page);
+                const auto pages = static_cast<float>(pagesPerSide(coordinates.level));
+                const auto offset = glm::vec3 {
+                    pages - 1.0f - 2.0f * static_cast<float>(coordinates.x),
+                    pages - 1.0f - 2.0f * static_cast<float>(coordinates.y),
+                    0.0f,
+                };
+                const auto crop = glm::scale(glm::translate(glm::mat4 { 1.0f }, offset), glm::vec3 { pages, pages, 1.0f });
+
+                return crop * m_viewProjection;
+            }
+
+            float sceneRadius() const {
+                return m_sceneRadius;
+            }
+
+            // The side of a texel of `level`, in world units.
+            float texelSize(uint32_t level) const {
+                return 2.0f * m_sceneRadius * static_cast<float>(1u << level) / static_cast<float>(PAGES_PER_SIDE * PAGE_SIZE);
+            }
+
+            uint32_t residentCount() const {
+                return m_residentCount;
+            }
+
+            // The pages requested since the table was last updated, a nonzero entry per page,
+            // or none before a frame has requested any. Returns the pages to render this frame.
+            const std::vector<PageRender>& update(std::span<const uint32_t> requests) {
+                m_updateCount++;
+                m_rendered.clear();
+                m_missing.clear();
+                m_stale.clear();
+                for (uint32_t page = 0; page < static_cast<uint32_t>(requests.size()); page++) {
+                    if (requests[page] != 0) {
+                        this->request(page);
+                    }
+                }
+
+                // Coarse pages come last in the table, and every view falls back to them.
+                std::sort(m_missing.begin(), m_missing.end(), std::greater<uint32_t> {});
+                for (const auto page : m_missing) {
+                    if (m_rendered.size() == PAGES_PER_FRAME) {
+                        break;
+                    }
+
+                    const auto physicalPage = this->allocatePhysicalPage();
+                    if (!physicalPage.has_value()) {
+                        break;
+                    }
+
+                    auto& entry = m_physicalPages[physicalPage.value()];
+                    entry.page = page;
+                    entry.lastRequested = m_updateCount;
+                    entry.stale = false;
+                    m_residentCount++;
+                    this->setPageTableEntry(page, physicalPage.value() + 1);
+                    m_rendered.push_back(PageRender { page, physicalPage.value() });
+                }
+
+                for (const auto page : m_stale) {
+                    if (m_rendered.size() == PAGES_PER_FRAME) {
+                        break;
+                    }
+
+                    const auto physicalPage = m_pageTable[page] - 1;
+                    m_physicalPages[physicalPage].stale = false;
+                    m_rendered.push_back(PageRender { page, physicalPage });
+                }
+
+                return m_rendered;
+            }
+
+            // The entries that changed since `clearDirtyRange`, which the GPU's copy of the table
+            // has to be brought up to date with.
+            const std::optional<PageTableRange>& dirtyRange() const {
+                return m_dirtyRange;
+            }
+
+            void clearDirtyRange() {
+                m_dirtyRange.reset();
+            }
+
+            // An entry per page: its atlas page plus one, or zero while it is not resident.
+            const std::vector<uint32_t>& pageTable() const {
+                return m_pageTable;
+            }
+        private:
+            struct PhysicalPage {
+                // The virtual page it holds.
+                std::optional<uint32_t> page;
+                uint64_t lastRequested = 0;
+                bool stale = false;
+            };
+
+            float m_sceneRadius = 0.0f;
+            glm::mat4 m_viewProjection { 1.0f };
+            std::vector<uint32_t> m_pageTable;
+            // The update that last requested each virtual page, to request it and the pages
+            // under it only once.
+            std::vector<uint64_t> m_requested;
+            std::vector<PhysicalPage> m_physicalPages;
+            std::vector<uint32_t> m_freePages;
+            uint64_t m_updateCount = 0;
+            uint32_t m_residentCount = 0;
+            std::vector<PageRender> m_rendered;
+            std::vector<uint32_t> m_missing;
+            std::vector<uint32_t> m_stale;
+            std::optional<PageTableRange> m_dirtyRange;
+
+            // Requests `page` and every coarser page under it, stopping at the first one this
+            // update already requested, whose own coarser pages then are as well.
+            void request(uint32_t page) {
+                auto coordinates = vk_virtual_shadows::pageCoordinates(page);
+                while (true) {
+                    const auto index = vk_virtual_shadows::pageIndex(coordinates);
+                    if (m_requested[index] == m_updateCount) {
+                        return;
+                    }
+
+                    m_requested[index] = m_updateCount;
+                    const auto entry = m_pageTable[index];
+                    if (entry == 0) {
+                        m_missing.push_back(index);
+                    } else {
+                        auto& physicalPage = m_physicalPages[entry - 1];
+                        physicalPage.lastRequested = m_updateCount;
+                        if (physicalPage.stale) {
+                            m_stale.push_back(index);
+                        }
+                    }
+
+                    if (coordinates.level + 1 == LEVEL_COUNT) {
+                        return;
+                    }
+
+                    coordinates = PageCoordinates { coordinates.level + 1, coordinates.x / 2, coordinates.y / 2 };
+                }
+            }
+
+            // A free atlas page, or the one requested the longest ago, which is evicted. Pages
+            // requested by this update are never evicted, so the atlas can run out.
+            std::optional<uint32_t> allocatePhysicalPage() {
+                if (!m_freePages.empty()) {
+                    const auto physicalPage = m_freePages.back();
+                    m_freePages.pop_back();
+
+                    return physicalPage;
+                }
+
+                auto oldest = std::optional<uint32_t> {};
+                for (uint32_t i = 0; i < PHYSICAL_PAGE_COUNT; i++) {
+                    const auto& physicalPage = m_physicalPages[i];
+                    if (physicalPage.lastRequested == m_updateCount) {
+                        continue;
+                    }
+                    if (!oldest.has_value() || physicalPage.lastRequested < m_physicalPages[oldest.value()].lastRequested) {
+                        oldest = i;
+                    }
+                }
+                if (!oldest.has_value()) {
+                    return std::nullopt;
+                }
+
+                auto& evicted = m_physicalPages[oldest.value()];
+                this->setPageTableEntry(evicted.page.value(), 0);
+                evicted = PhysicalPage {};
+                m_residentCount--;
+
+                return oldest;
+            }
+
+            void setPageTableEntry(uint32_t page, uint32_t entry) {
+                m_pageTable[page] = entry;
+                if (!m_dirtyRange.has_value()) {
+                    m_dirtyRange = PageTableRange { page, 1 };
+                    return;
+                }
+
+                const auto first = std::min(m_dirtyRange->first, page);
+                const auto end = std::max(m_dirtyRange->first + m_dirtyRange->count, page + 1);
+                m_dirtyRange = PageTableRange { first, end - first };
+            }
+    };
+}